@@ -0,0 +1,57 @@
+#!/bin/sh
+# Copyright (c) 2018 The SolarCoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+# Replay the blocks of blk*.dat files on a copy of a datadir snapshot up to a height, and print
+# the block connect summary solarcoind logs when it gets there.
+
+TOPDIR=${TOPDIR:-$(git rev-parse --show-toplevel)}
+SRCDIR=${SRCDIR:-$TOPDIR/src}
+SOLARCOIND=${SOLARCOIND:-$SRCDIR/solarcoind}
+DBCACHE=${DBCACHE:-450}
+PAR=${PAR:-0}
+
+if [ $# -lt 3 ]; then
+  echo "Usage: $0 <snapshot datadir> <stop height> <blk file>..."
+  echo "Environment: SOLARCOIND, DBCACHE (MiB, default 450), PAR (-par, default 0),"
+  echo "REPLAY_ARGS (more solarcoind options), KEEP_DATADIR=1 (keep the copy of the snapshot)"
+  exit 1
+fi
+SNAPSHOT=$1
+STOPHEIGHT=$2
+shift 2
+
+[ ! -x "$SOLARCOIND" ] && echo "$SOLARCOIND not found or not executable." && exit 1
+[ ! -d "$SNAPSHOT/blocks" ] && echo "$SNAPSHOT is not a datadir." && exit 1
+
+LOADBLOCKS=""
+for f in "$@"; do
+  [ ! -f "$f" ] && echo "$f not found." && exit 1
+  LOADBLOCKS="$LOADBLOCKS -loadblock=$(cd "$(dirname "$f")" && pwd)/$(basename "$f")"
+done
+
+# Replay on a copy, so every run starts from the same chain state
+DATADIR=$(mktemp -d)
+cp -a "$SNAPSHOT"/. "$DATADIR"
+rm -f "$DATADIR/debug.log" "$DATADIR/solarcoind.pid" "$DATADIR/.lock"
+
+# No network, wallet or startup verification, so only the replay is measured
+"$SOLARCOIND" -datadir="$DATADIR" -server=0 -listen=0 -connect=0 -dnsseed=0 -disablewallet \
+  -checkblocks=1 -checklevel=0 -printtoconsole=0 -dbcache="$DBCACHE" -par="$PAR" \
+  -stopatheight="$STOPHEIGHT" $LOADBLOCKS $REPLAY_ARGS
+STATUS=$?
+
+if grep -q "Block connect summary" "$DATADIR/debug.log"; then
+  grep "Block connect summary" "$DATADIR/debug.log" | sed 's/^.*Block connect summary: //'
+else
+  echo "Height $STOPHEIGHT was not reached, see $DATADIR/debug.log"
+  exit 1
+fi
+
+if [ "$KEEP_DATADIR" = "1" ]; then
+  echo "Replayed datadir kept in $DATADIR"
+else
+  rm -rf "$DATADIR"
+fi
+exit $STATUS
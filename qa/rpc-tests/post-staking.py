@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The SolarCoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test staking PoST blocks past the last PoW block with -regtestpost and generatestake
+#
+
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_jsonrpc,
+    connect_nodes_bi,
+    set_node_times,
+    start_nodes,
+    sync_blocks,
+)
+
+LAST_POW_BLOCK = 30
+# REGTEST_POST_STAKE_MIN_AGE in chainparams.h
+STAKE_MIN_AGE = 96
+
+class PoSTStakingTest(BitcoinTestFramework):
+    def __init__(self):
+        super().__init__()
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-regtestpost=%d" % LAST_POW_BLOCK]] * self.num_nodes
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, self.extra_args)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+
+    def run_test(self):
+        set_node_times(self.nodes, int(time.time()))
+
+        print("Mine the PoW blocks")
+        assert_raises_jsonrpc(-1, "PoST starts after height %d" % LAST_POW_BLOCK, self.nodes[0].generatestake, 1)
+        self.nodes[0].generate(LAST_POW_BLOCK)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[0].getblockcount(), LAST_POW_BLOCK)
+
+        print("Nothing stakes before the outputs reach the stake min age")
+        assert_equal(self.nodes[0].generatestake(1), [])
+        assert_equal(self.nodes[0].getblockcount(), LAST_POW_BLOCK)
+
+        print("Stake past the last PoW block")
+        tip_time = self.nodes[0].getblock(self.nodes[0].getbestblockhash())['time']
+        mocktime = tip_time + STAKE_MIN_AGE + 60
+        set_node_times(self.nodes, mocktime)
+        hashes = self.nodes[0].generatestake(5)
+        assert_equal(len(hashes), 5)
+        assert_equal(self.nodes[0].getblockcount(), LAST_POW_BLOCK + 5)
+        assert_equal(self.nodes[0].getbestblockhash(), hashes[-1])
+        prev_time = tip_time
+        for blockhash in hashes:
+            block = self.nodes[0].getblock(blockhash)
+            assert(prev_time < block['time'] <= mocktime)
+            prev_time = block['time']
+            # A coinbase and a coinstake, marked by its empty first output, paying the wallet
+            assert_equal(len(block['tx']), 2)
+            coinstake = self.nodes[0].decoderawtransaction(self.nodes[0].gettransaction(block['tx'][1])['hex'])
+            assert_equal(coinstake['vout'][0]['value'], 0)
+            assert_equal(coinstake['vout'][0]['scriptPubKey']['hex'], "")
+
+        print("The staked blocks are accepted by the other node")
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[1].getbestblockhash(), hashes[-1])
+
+        print("A wallet without outputs stakes nothing")
+        assert_equal(self.nodes[1].generatestake(1), [])
+        assert_equal(self.nodes[1].getblockcount(), LAST_POW_BLOCK + 5)
+
+if __name__ == '__main__':
+    PoSTStakingTest().main()
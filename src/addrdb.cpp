@@ -8,6 +8,7 @@
 #include "addrman.h"
 #include "chainparams.h"
 #include "clientversion.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "random.h"
 #include "streams.h"
@@ -16,24 +17,15 @@
 
 #include <boost/filesystem.hpp>
 
-CBanDB::CBanDB()
-{
-    pathBanlist = GetDataDir() / "banlist.dat";
-}
+namespace {
 
-bool CBanDB::Write(const banmap_t& banSet)
+/** Write a snapshot, which ends with its checksum, to a temporary file and rename it over path. */
+bool WriteSnapshot(const boost::filesystem::path& path, const CDataStream& ssData)
 {
     // Generate random temporary filename
     unsigned short randv = 0;
     GetRandBytes((unsigned char*)&randv, sizeof(randv));
-    std::string tmpfn = strprintf("banlist.dat.%04x", randv);
-
-    // serialize banlist, checksum data up to that point, then append csum
-    CDataStream ssBanlist(SER_DISK, CLIENT_VERSION);
-    ssBanlist << FLATDATA(Params().MessageStart());
-    ssBanlist << banSet;
-    uint256 hash = Hash(ssBanlist.begin(), ssBanlist.end());
-    ssBanlist << hash;
+    std::string tmpfn = strprintf("%s.%04x", path.filename().string(), randv);
 
     // open temp output file, and associate with CAutoFile
     boost::filesystem::path pathTmp = GetDataDir() / tmpfn;
@@ -44,7 +36,7 @@ bool CBanDB::Write(const banmap_t& banSet)
 
     // Write and commit header, data
     try {
-        fileout << ssBanlist;
+        fileout << ssData;
     }
     catch (const std::exception& e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
@@ -52,13 +44,199 @@ bool CBanDB::Write(const banmap_t& banSet)
     FileCommit(fileout.Get());
     fileout.fclose();
 
-    // replace existing banlist.dat, if any, with new banlist.dat.XXXX
-    if (!RenameOver(pathTmp, pathBanlist))
+    // replace the existing snapshot, if any, with the new one
+    if (!RenameOver(pathTmp, path))
         return error("%s: Rename-into-place failed", __func__);
 
     return true;
 }
 
+/** SolarCoin: The checksum a snapshot ends with. */
+bool ReadSnapshotHash(const boost::filesystem::path& path, uint256& hash)
+{
+    FILE *file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull() || fseek(filein.Get(), -(long)sizeof(uint256), SEEK_END) != 0)
+        return false;
+    try {
+        filein >> hash;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/** SolarCoin: Replace the journal at path with an empty one for the snapshot with checksum hashSnapshot. */
+bool ResetJournal(const boost::filesystem::path& path, const uint256& hashSnapshot)
+{
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+
+    try {
+        fileout << FLATDATA(Params().MessageStart());
+        fileout << hashSnapshot;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, path))
+        return error("%s: Rename-into-place failed", __func__);
+    return true;
+}
+
+/** SolarCoin: Read the header of a journal, and whether it belongs to the snapshot with checksum hashSnapshot. */
+bool ReadJournalHeader(CAutoFile& filein, const uint256& hashSnapshot)
+{
+    unsigned char pchMsgTmp[4];
+    uint256 hashJournal;
+    try {
+        filein >> FLATDATA(pchMsgTmp);
+        filein >> hashJournal;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)) == 0 && hashJournal == hashSnapshot;
+}
+
+/** SolarCoin: Read the next record of a journal; false at its end or at a record torn by a crash. */
+bool ReadJournalRecord(CAutoFile& filein, std::vector<char>& vchRecord)
+{
+    uint32_t nChecksum;
+    try {
+        vchRecord.resize(ReadCompactSize(filein));
+        filein.read(vchRecord.data(), vchRecord.size());
+        filein >> nChecksum;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return ReadLE32(Hash(vchRecord.begin(), vchRecord.end()).begin()) == nChecksum;
+}
+
+/**
+ * SolarCoin: Append records to the journal of the snapshot at pathSnapshot. Returns false if a
+ * new snapshot must be written instead: the journal is missing, belongs to another snapshot, has
+ * grown too large, or could not be written.
+ */
+template<typename Record>
+bool AppendJournal(const boost::filesystem::path& pathSnapshot, const boost::filesystem::path& pathJournal, const std::vector<Record>& vRecords)
+{
+    uint256 hashSnapshot;
+    if (!ReadSnapshotHash(pathSnapshot, hashSnapshot))
+        return false;
+
+    FILE *file = fopen(pathJournal.string().c_str(), "rb+");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull() || !ReadJournalHeader(fileout, hashSnapshot))
+        return false;
+
+    try {
+        uint64_t nJournalSize = boost::filesystem::file_size(pathJournal);
+        uint64_t nSnapshotSize = boost::filesystem::file_size(pathSnapshot);
+        if (nJournalSize > std::max(nSnapshotSize / 2, JOURNAL_COMPACT_MIN_SIZE))
+            return false;
+    }
+    catch (const boost::filesystem::filesystem_error&) {
+        return false;
+    }
+
+    // Append after the last complete record: reading stops at a torn one, so anything written
+    // behind it would be lost. The torn record is cut off first.
+    long nEnd = ftell(fileout.Get());
+    std::vector<char> vchRecord;
+    while (ReadJournalRecord(fileout, vchRecord))
+        nEnd = ftell(fileout.Get());
+    if (nEnd < 0 || fseek(fileout.Get(), 0, SEEK_END) != 0)
+        return false;
+    if (ftell(fileout.Get()) != nEnd) {
+        LogPrint("net", "Truncating %s at a torn record at offset %d\n", pathJournal.filename().string(), nEnd);
+        if (!TruncateFile(fileout.Get(), nEnd))
+            return false;
+    }
+    if (fseek(fileout.Get(), nEnd, SEEK_SET) != 0)
+        return false;
+    try {
+        for (const Record& record : vRecords) {
+            CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+            ssRecord << record;
+            uint256 hash = Hash(ssRecord.begin(), ssRecord.end());
+            WriteCompactSize(fileout, ssRecord.size());
+            fileout << ssRecord;
+            fileout << ReadLE32(hash.begin());
+        }
+    }
+    catch (const std::exception& e) {
+        // a partly written record is cut off by the next append
+        error("%s: Serialize or I/O error - %s", __func__, e.what());
+        return false;
+    }
+    FileCommit(fileout.Get());
+    return true;
+}
+
+/** SolarCoin: Read the records of the journal of the snapshot with checksum hashSnapshot, up to the first incomplete one. */
+template<typename Record>
+void ReadJournal(const boost::filesystem::path& pathJournal, const uint256& hashSnapshot, std::vector<Record>& vRecords)
+{
+    FILE *file = fopen(pathJournal.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull() || !ReadJournalHeader(filein, hashSnapshot))
+        return;
+
+    std::vector<char> vchRecord;
+    while (ReadJournalRecord(filein, vchRecord)) {
+        Record record;
+        try {
+            CDataStream ssRecord(vchRecord, SER_DISK, CLIENT_VERSION);
+            ssRecord >> record;
+        }
+        catch (const std::exception&) {
+            break;
+        }
+        vRecords.push_back(record);
+    }
+}
+
+} // anon namespace
+
+CBanDB::CBanDB()
+{
+    pathBanlist = GetDataDir() / "banlist.dat";
+    pathBanlistJournal = GetDataDir() / "banlist.journal";
+}
+
+bool CBanDB::Write(const banmap_t& banSet)
+{
+    // serialize banlist, checksum data up to that point, then append csum
+    CDataStream ssBanlist(SER_DISK, CLIENT_VERSION);
+    ssBanlist << FLATDATA(Params().MessageStart());
+    ssBanlist << banSet;
+    uint256 hash = Hash(ssBanlist.begin(), ssBanlist.end());
+    ssBanlist << hash;
+
+    if (!WriteSnapshot(pathBanlist, ssBanlist))
+        return false;
+    return ResetJournal(pathBanlistJournal, hash);
+}
+
+bool CBanDB::WriteChanges(const banmap_t& banSet, const std::vector<CBanJournalRecord>& vChanges)
+{
+    if (vChanges.empty())
+        return true;
+    if (AppendJournal(pathBanlist, pathBanlistJournal, vChanges))
+        return true;
+    return Write(banSet);
+}
+
 bool CBanDB::Read(banmap_t& banSet)
 {
     // open input file, and associate with CAutoFile
@@ -110,49 +288,69 @@ bool CBanDB::Read(banmap_t& banSet)
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
 
+    // SolarCoin: apply the changes journaled since, and compact them into a new snapshot
+    std::vector<CBanJournalRecord> vChanges;
+    ReadJournal(pathBanlistJournal, hashIn, vChanges);
+    for (const CBanJournalRecord& record : vChanges) {
+        if (record.banEntry.nBanUntil == 0)
+            banSet.erase(record.subNet);
+        else
+            banSet[record.subNet] = record.banEntry;
+    }
+    if (!vChanges.empty()) {
+        LogPrint("net", "Applied %d changes from banlist.journal\n", vChanges.size());
+        Write(banSet);
+    }
+
     return true;
 }
 
 CAddrDB::CAddrDB()
 {
     pathAddr = GetDataDir() / "peers.dat";
+    pathAddrJournal = GetDataDir() / "peers.journal";
 }
 
-bool CAddrDB::Write(const CAddrMan& addr)
+bool CAddrDB::Write(CAddrMan& addr)
 {
-    // Generate random temporary filename
-    unsigned short randv = 0;
-    GetRandBytes((unsigned char*)&randv, sizeof(randv));
-    std::string tmpfn = strprintf("peers.dat.%04x", randv);
-
-    // serialize addresses, checksum data up to that point, then append csum
+    // SolarCoin: serialize addresses in memory, which is all the addrman lock is held for,
+    // checksum data up to that point, then append csum
     CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
     ssPeers << FLATDATA(Params().MessageStart());
-    ssPeers << addr;
+    addr.Snapshot(ssPeers);
     uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
     ssPeers << hash;
 
-    // open temp output file, and associate with CAutoFile
-    boost::filesystem::path pathTmp = GetDataDir() / tmpfn;
-    FILE *file = fopen(pathTmp.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    if (!WriteSnapshot(pathAddr, ssPeers))
+        return false;
+    return ResetJournal(pathAddrJournal, hash);
+}
 
-    // Write and commit header, data
-    try {
-        fileout << ssPeers;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Serialize or I/O error - %s", __func__, e.what());
-    }
-    FileCommit(fileout.Get());
-    fileout.fclose();
+bool CAddrDB::WriteChanges(CAddrMan& addr)
+{
+    std::vector<CAddrJournalRecord> vChanges;
+    addr.GetChanges(vChanges);
+    if (vChanges.empty())
+        return true;
+    if (AppendJournal(pathAddr, pathAddrJournal, vChanges))
+        return true;
+    return Write(addr);
+}
 
-    // replace existing peers.dat, if any, with new peers.dat.XXXX
-    if (!RenameOver(pathTmp, pathAddr))
-        return error("%s: Rename-into-place failed", __func__);
+/** SolarCoin: Read the network magic and the addresses from a stream. */
+template<typename Stream>
+static bool DeserializeAddrMan(CAddrMan& addr, Stream& s)
+{
+    unsigned char pchMsgTmp[4];
+    // de-serialize file header (network specific magic number) and ..
+    s >> FLATDATA(pchMsgTmp);
 
+    // ... verify the network matches ours
+    if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+        return error("%s: Invalid network magic number", __func__);
+
+    // de-serialize address data into one CAddrMan object
+    s >> addr;
     return true;
 }
 
@@ -164,55 +362,103 @@ bool CAddrDB::Read(CAddrMan& addr)
     if (filein.IsNull())
         return error("%s: Failed to open file %s", __func__, pathAddr.string());
 
-    // use file size to size memory buffer
-    uint64_t fileSize = boost::filesystem::file_size(pathAddr);
-    uint64_t dataSize = 0;
-    // Don't try to resize to a negative number if file is small
-    if (fileSize >= sizeof(uint256))
-        dataSize = fileSize - sizeof(uint256);
-    std::vector<unsigned char> vchData;
-    vchData.resize(dataSize);
+    // SolarCoin: de-serialize straight from the file while hashing it, then verify the
+    // stored checksum that follows the data
     uint256 hashIn;
-
-    // read data and checksum from file
     try {
-        filein.read((char *)&vchData[0], dataSize);
+        CHashVerifier<CAutoFile> verifier(&filein);
+        if (!DeserializeAddrMan(addr, verifier))
+            return false;
         filein >> hashIn;
+        if (hashIn != verifier.GetHash()) {
+            addr.Clear();
+            return error("%s: Checksum mismatch, data corrupted", __func__);
+        }
     }
     catch (const std::exception& e) {
+        // de-serialization has failed, ensure addrman is left in a clean state
+        addr.Clear();
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
     filein.fclose();
 
-    CDataStream ssPeers(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssPeers.begin(), ssPeers.end());
-    if (hashIn != hashTmp)
-        return error("%s: Checksum mismatch, data corrupted", __func__);
+    // SolarCoin: apply the changes journaled since, and compact them into a new snapshot
+    std::vector<CAddrJournalRecord> vChanges;
+    ReadJournal(pathAddrJournal, hashIn, vChanges);
+    for (const CAddrJournalRecord& record : vChanges)
+        addr.Restore(record);
+    if (!vChanges.empty()) {
+        LogPrint("net", "Applied %d changes from peers.journal\n", vChanges.size());
+        Write(addr);
+    }
 
-    return Read(addr, ssPeers);
+    return true;
 }
 
 bool CAddrDB::Read(CAddrMan& addr, CDataStream& ssPeers)
 {
-    unsigned char pchMsgTmp[4];
     try {
-        // de-serialize file header (network specific magic number) and ..
-        ssPeers >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
-            return error("%s: Invalid network magic number", __func__);
-
-        // de-serialize address data into one CAddrMan object
-        ssPeers >> addr;
+        return DeserializeAddrMan(addr, ssPeers);
     }
     catch (const std::exception& e) {
         // de-serialization has failed, ensure addrman is left in a clean state
         addr.Clear();
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
+}
+
+CAnchorsDB::CAnchorsDB()
+{
+    pathAnchors = GetDataDir() / "anchors.dat";
+}
+
+bool CAnchorsDB::Write(const std::vector<CAddress>& vAnchors)
+{
+    CDataStream ssAnchors(SER_DISK, CLIENT_VERSION);
+    ssAnchors << FLATDATA(Params().MessageStart());
+    ssAnchors << vAnchors;
+    uint256 hash = Hash(ssAnchors.begin(), ssAnchors.end());
+    ssAnchors << hash;
+
+    return WriteSnapshot(pathAnchors, ssAnchors);
+}
+
+bool CAnchorsDB::Read(std::vector<CAddress>& vAnchors)
+{
+    FILE *file = fopen(pathAnchors.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+
+    uint64_t fileSize = boost::filesystem::file_size(pathAnchors);
+    std::vector<unsigned char> vchData(fileSize >= sizeof(uint256) ? fileSize - sizeof(uint256) : 0);
+    uint256 hashIn;
+    try {
+        filein.read((char *)vchData.data(), vchData.size());
+        filein >> hashIn;
+    }
+    catch (const std::exception& e) {
+        filein.fclose();
+        boost::filesystem::remove(pathAnchors);
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    filein.fclose();
+    boost::filesystem::remove(pathAnchors);
+
+    CDataStream ssAnchors(vchData, SER_DISK, CLIENT_VERSION);
+    if (hashIn != Hash(ssAnchors.begin(), ssAnchors.end()))
+        return error("%s: Checksum mismatch, data corrupted", __func__);
 
+    unsigned char pchMsgTmp[4];
+    try {
+        ssAnchors >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("%s: Invalid network magic number", __func__);
+        ssAnchors >> vAnchors;
+    }
+    catch (const std::exception& e) {
+        vAnchors.clear();
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
     return true;
 }
@@ -6,13 +6,15 @@
 #ifndef BITCOIN_ADDRDB_H
 #define BITCOIN_ADDRDB_H
 
+#include "netaddress.h"
 #include "serialize.h"
 
 #include <string>
 #include <map>
+#include <vector>
 #include <boost/filesystem/path.hpp>
 
-class CSubNet;
+class CAddress;
 class CAddrMan;
 class CDataStream;
 
@@ -76,14 +78,47 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
+/** SolarCoin: A change to the banlist since banlist.dat was written, as journaled in banlist.journal */
+class CBanJournalRecord
+{
+public:
+    CSubNet subNet;
+    CBanEntry banEntry; //!< the new entry, or a null one if the subnet was unbanned
+
+    CBanJournalRecord() {}
+    CBanJournalRecord(const CSubNet& subNetIn, const CBanEntry& banEntryIn) : subNet(subNetIn), banEntry(banEntryIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(subNet);
+        READWRITE(banEntry);
+    }
+};
+
+/**
+ * SolarCoin: peers.dat and banlist.dat are snapshots. The changes made after a snapshot are
+ * appended to a journal next to it, whose header names the snapshot by its checksum; a journal
+ * of another snapshot is ignored. Records carry their own checksum, so reading stops at a
+ * record torn by a crash, and the next append cuts the journal off there. Once the journal
+ * outgrows half the snapshot (and at least JOURNAL_COMPACT_MIN_SIZE), or when it has records at
+ * startup, it is compacted by writing a new snapshot.
+ */
+static const uint64_t JOURNAL_COMPACT_MIN_SIZE = 1 << 20;
+
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
 {
 private:
     boost::filesystem::path pathAddr;
+    boost::filesystem::path pathAddrJournal;
 public:
     CAddrDB();
-    bool Write(const CAddrMan& addr);
+    /** Write a snapshot of all addresses; addrman is only locked while they are serialized in memory. */
+    bool Write(CAddrMan& addr);
+    /** Journal the addresses that changed since the last snapshot, or write a new snapshot. */
+    bool WriteChanges(CAddrMan& addr);
     bool Read(CAddrMan& addr);
     bool Read(CAddrMan& addr, CDataStream& ssPeers);
 };
@@ -93,10 +128,28 @@ class CBanDB
 {
 private:
     boost::filesystem::path pathBanlist;
+    boost::filesystem::path pathBanlistJournal;
 public:
     CBanDB();
     bool Write(const banmap_t& banSet);
+    /** Journal vChanges, or write a snapshot of banSet, which includes them. */
+    bool WriteChanges(const banmap_t& banSet, const std::vector<CBanJournalRecord>& vChanges);
     bool Read(banmap_t& banSet);
 };
 
+/**
+ * SolarCoin: The outbound peers that served blocks best before shutdown (anchors.dat), to be
+ * reconnected to first on startup. The file is removed once read, so a node that keeps failing
+ * to start does not keep returning to the same peers.
+ */
+class CAnchorsDB
+{
+private:
+    boost::filesystem::path pathAnchors;
+public:
+    CAnchorsDB();
+    bool Write(const std::vector<CAddress>& vAnchors);
+    bool Read(std::vector<CAddress>& vAnchors);
+};
+
 #endif // BITCOIN_ADDRDB_H
@@ -0,0 +1,305 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "sync.h"
+#include "ui_interface.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <memory>
+
+static const char DB_ADDRESS = 'a';
+static const char DB_ADDRESS_UNSPENT = 'u';
+static const char DB_SPENT = 'p';
+static const char DB_BEST_BLOCK = 'B';
+static const char DB_FLAG = 'F';
+
+CAddressIndex* paddressindex = NULL;
+
+uint8_t ScriptToAddressIndex(const CScript& script, uint160& hashBytes)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(script, dest))
+        return ADDRESS_TYPE_NONE;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        return ADDRESS_TYPE_PUBKEYHASH;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        return ADDRESS_TYPE_SCRIPTHASH;
+    }
+    return ADDRESS_TYPE_NONE;
+}
+
+CAddressIndexKey::CAddressIndexKey() :
+    key(DB_ADDRESS), nType(ADDRESS_TYPE_NONE), nHeight(0), nIndex(0), fSpending(false)
+{
+}
+
+CAddressIndexKey::CAddressIndexKey(uint8_t nTypeIn, const uint160& hashBytesIn, int nHeightIn, const uint256& txidIn, uint32_t nIndexIn, bool fSpendingIn) :
+    key(DB_ADDRESS), nType(nTypeIn), hashBytes(hashBytesIn), nHeight(nHeightIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn)
+{
+}
+
+CAddressUnspentKey::CAddressUnspentKey() :
+    key(DB_ADDRESS_UNSPENT), nType(ADDRESS_TYPE_NONE)
+{
+}
+
+CAddressUnspentKey::CAddressUnspentKey(uint8_t nTypeIn, const uint160& hashBytesIn, const COutPoint& outpointIn) :
+    key(DB_ADDRESS_UNSPENT), nType(nTypeIn), hashBytes(hashBytesIn), outpoint(outpointIn)
+{
+}
+
+CAddressIndex::CAddressIndex(bool fAddressIndexIn, bool fSpentIndexIn, size_t nCacheSize, bool fWipe) :
+    db(GetDataDir() / "indexes" / "address", nCacheSize, false, fWipe), fAddressIndex(fAddressIndexIn), fSpentIndex(fSpentIndexIn), batch(db)
+{
+}
+
+bool CAddressIndex::Init(std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindexBest = NULL;
+    uint256 hashBest;
+    if (db.Read(DB_BEST_BLOCK, hashBest)) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+        if (it == mapBlockIndex.end()) {
+            strError = _("The address index is at an unknown block");
+            return false;
+        }
+        pindexBest = it->second;
+    }
+
+    // Changes that were written for blocks that were disconnected since, or of which the chain
+    // state was not written before a crash: the latter are added again as they are reconnected
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    while (pindexBest && !chainActive.Contains(pindexBest)) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindexBest, consensusParams) || pindexBest->GetUndoPos().IsNull() ||
+            !UndoReadFromDisk(blockundo, pindexBest->GetUndoPos(), pindexBest->pprev->GetBlockHash())) {
+            strError = _("Error reading a block to undo from the address index");
+            return false;
+        }
+        LogPrintf("%s: undoing block %s at height %d\n", __func__, pindexBest->GetBlockHash().ToString(), pindexBest->nHeight);
+        UpdateBlock(block, blockundo, pindexBest, false);
+        pindexBest = pindexBest->pprev;
+    }
+
+    // The transactions of the genesis block are not connected, so an index of it has no entries
+    bool fHadAddressIndex = false, fHadSpentIndex = false;
+    db.Read(std::make_pair(DB_FLAG, std::string("addressindex")), fHadAddressIndex);
+    db.Read(std::make_pair(DB_FLAG, std::string("spentindex")), fHadSpentIndex);
+    if (chainActive.Height() > 0 && (!pindexBest || pindexBest->nHeight < chainActive.Height() ||
+                                     (fAddressIndex && !fHadAddressIndex) || (fSpentIndex && !fHadSpentIndex))) {
+        strError = _("You need to rebuild the database using -reindex-chainstate to enable -addressindex or -spentindex");
+        return false;
+    }
+
+    // An index that is turned off is not kept up to date, so it cannot be turned on again without a rebuild
+    batch.Write(std::make_pair(DB_FLAG, std::string("addressindex")), fAddressIndex);
+    batch.Write(std::make_pair(DB_FLAG, std::string("spentindex")), fSpentIndex);
+    if (!WriteBatch(chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256())) {
+        strError = _("Error writing to the address index");
+        return false;
+    }
+    LogPrintf("%s: address index at height %d\n", __func__, chainActive.Height());
+    return true;
+}
+
+void CAddressIndex::UpdateBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, bool fConnect)
+{
+    // The transactions of the genesis block are not connected
+    if (!pindex->pprev || blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return;
+
+    // The changes of a disconnected block are made in reverse, so an output it both created and
+    // spent ends up removed
+    for (size_t n = 0; n < block.vtx.size(); n++) {
+        size_t i = fConnect ? n : block.vtx.size() - 1 - n;
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        if (!fConnect && fAddressIndex) {
+            for (uint32_t k = 0; k < tx.vout.size(); k++) {
+                uint160 hashBytes;
+                uint8_t nType = ScriptToAddressIndex(tx.vout[k].scriptPubKey, hashBytes);
+                if (nType == ADDRESS_TYPE_NONE)
+                    continue;
+                batch.Erase(CAddressIndexKey(nType, hashBytes, pindex->nHeight, txid, k, false));
+                batch.Erase(CAddressUnspentKey(nType, hashBytes, COutPoint(txid, k)));
+            }
+        }
+
+        if (i > 0 && blockundo.vtxundo[i - 1].vprevout.size() == tx.vin.size()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (uint32_t j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const Coin& coin = txundo.vprevout[j];
+                uint160 hashBytes;
+                uint8_t nType = ScriptToAddressIndex(coin.out.scriptPubKey, hashBytes);
+                if (fSpentIndex) {
+                    if (fConnect)
+                        batch.Write(std::make_pair(DB_SPENT, prevout), CSpentIndexValue(txid, j, pindex->nHeight, coin.out.nValue, nType, hashBytes));
+                    else
+                        batch.Erase(std::make_pair(DB_SPENT, prevout));
+                }
+                if (!fAddressIndex || nType == ADDRESS_TYPE_NONE)
+                    continue;
+                CAddressIndexKey key(nType, hashBytes, pindex->nHeight, txid, j, true);
+                CAddressUnspentKey keyUnspent(nType, hashBytes, prevout);
+                if (fConnect) {
+                    batch.Write(key, -coin.out.nValue);
+                    batch.Erase(keyUnspent);
+                } else {
+                    batch.Erase(key);
+                    batch.Write(keyUnspent, CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+                }
+            }
+        }
+
+        if (fConnect && fAddressIndex) {
+            for (uint32_t k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                uint8_t nType = ScriptToAddressIndex(out.scriptPubKey, hashBytes);
+                if (nType == ADDRESS_TYPE_NONE)
+                    continue;
+                batch.Write(CAddressIndexKey(nType, hashBytes, pindex->nHeight, txid, k, false), out.nValue);
+                batch.Write(CAddressUnspentKey(nType, hashBytes, COutPoint(txid, k)), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight));
+            }
+        }
+    }
+}
+
+bool CAddressIndex::WriteBatch(const uint256& hashBest)
+{
+    batch.Write(DB_BEST_BLOCK, hashBest);
+    bool fWritten = db.WriteBatch(batch);
+    batch.Clear();
+    if (fWritten)
+        hashBestWritten = hashBest;
+    return fWritten;
+}
+
+bool CAddressIndex::ConnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    UpdateBlock(block, blockundo, pindex, true);
+    if (batch.SizeEstimate() > ADDRESS_INDEX_MAX_PENDING)
+        return WriteBatch(pindex->GetBlockHash());
+    return true;
+}
+
+bool CAddressIndex::DisconnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    UpdateBlock(block, blockundo, pindex, false);
+    if (batch.SizeEstimate() > ADDRESS_INDEX_MAX_PENDING)
+        return WriteBatch(pindex->pprev->GetBlockHash());
+    return true;
+}
+
+bool CAddressIndex::Flush(const uint256& hashBest)
+{
+    AssertLockHeld(cs_main);
+    // A block without entries, such as one with only a coinbase on a node with just the spent
+    // index, still moves the index
+    if (batch.SizeEstimate() == 0 && hashBest == hashBestWritten)
+        return true;
+    return WriteBatch(hashBest);
+}
+
+bool CAddressIndex::GetAddressDeltas(uint8_t nType, const uint160& hashBytes, int nStartHeight, int nEndHeight,
+                                     std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, size_t nMaxTxs)
+{
+    {
+        LOCK(cs_main);
+        if (!Flush(pcoinsTip->GetBestBlock()))
+            return error("%s: failed to write to the address index", __func__);
+    }
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(CAddressIndexKey(nType, hashBytes, std::max(nStartHeight, 0), uint256(), 0, false));
+    CAddressIndexKey key;
+    size_t nTxs = 0;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.key == DB_ADDRESS && key.nType == nType && key.hashBytes == hashBytes) {
+        if (nEndHeight >= 0 && key.nHeight > nEndHeight)
+            break;
+        // The entries of a transaction are next to each other
+        if (nTxs == 0 || vDeltas.back().first.txid != key.txid || vDeltas.back().first.nHeight != key.nHeight) {
+            if (nMaxTxs > 0 && nTxs == nMaxTxs)
+                break;
+            nTxs++;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to read value", __func__);
+        vDeltas.push_back(std::make_pair(key, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+/** Order of the unspent outputs of an address: by the height of their block, then by outpoint */
+static bool CompareAddressUnspent(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    if (a.second.nHeight != b.second.nHeight)
+        return a.second.nHeight < b.second.nHeight;
+    return a.first.outpoint < b.first.outpoint;
+}
+
+bool CAddressIndex::GetAddressUnspent(uint8_t nType, const uint160& hashBytes,
+                                      std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent,
+                                      int nStartHeight, int nEndHeight, size_t nMax)
+{
+    {
+        LOCK(cs_main);
+        if (!Flush(pcoinsTip->GetBestBlock()))
+            return error("%s: failed to write to the address index", __func__);
+    }
+    // The outputs are stored by outpoint, not by height: with nMax, keep the newest of the oldest
+    // ones read so far on top of a heap, to drop it when an older one comes
+    const size_t nBegin = vUnspent.size();
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(CAddressUnspentKey(nType, hashBytes, COutPoint(uint256(), 0)));
+    CAddressUnspentKey key;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.key == DB_ADDRESS_UNSPENT && key.nType == nType && key.hashBytes == hashBytes) {
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read value", __func__);
+        pcursor->Next();
+        if (value.nHeight < nStartHeight || (nEndHeight >= 0 && value.nHeight > nEndHeight))
+            continue;
+        vUnspent.push_back(std::make_pair(key, value));
+        if (nMax > 0) {
+            std::push_heap(vUnspent.begin() + nBegin, vUnspent.end(), CompareAddressUnspent);
+            if (vUnspent.size() - nBegin > nMax) {
+                std::pop_heap(vUnspent.begin() + nBegin, vUnspent.end(), CompareAddressUnspent);
+                vUnspent.pop_back();
+            }
+        }
+    }
+    std::sort(vUnspent.begin() + nBegin, vUnspent.end(), CompareAddressUnspent);
+    return true;
+}
+
+bool CAddressIndex::GetSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value)
+{
+    {
+        LOCK(cs_main);
+        if (!Flush(pcoinsTip->GetBestBlock()))
+            return error("%s: failed to write to the address index", __func__);
+    }
+    return db.Read(std::make_pair(DB_SPENT, outpoint), value);
+}
@@ -0,0 +1,221 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "dbwrapper.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Default for -spentindex */
+static const bool DEFAULT_SPENTINDEX = false;
+/** Database cache of the address and spent indexes */
+static const size_t ADDRESS_INDEX_CACHE_SIZE = 16 << 20;
+/** Size of the pending changes at which they are written before the next chain state flush */
+static const size_t ADDRESS_INDEX_MAX_PENDING = 32 << 20;
+
+/** The kinds of output script an address is indexed by */
+enum AddressIndexType {
+    ADDRESS_TYPE_NONE = 0,
+    ADDRESS_TYPE_PUBKEYHASH = 1, //!< pay-to-pubkey-hash and pay-to-pubkey, by the key id
+    ADDRESS_TYPE_SCRIPTHASH = 2,
+};
+
+/** The address an output script pays to, as its type and hash; ADDRESS_TYPE_NONE for other scripts */
+uint8_t ScriptToAddressIndex(const CScript& script, uint160& hashBytes);
+
+/**
+ * Key of an address index entry: one per output paying to the address and one per input
+ * spending such an output. The height is big endian, so the entries of an address are in
+ * block order. The value is the amount received, or the negated amount spent.
+ */
+struct CAddressIndexKey
+{
+    char key;
+    uint8_t nType;
+    uint160 hashBytes;
+    int nHeight;
+    uint256 txid;
+    uint32_t nIndex;
+    bool fSpending;
+
+    CAddressIndexKey();
+    CAddressIndexKey(uint8_t nTypeIn, const uint160& hashBytesIn, int nHeightIn, const uint256& txidIn, uint32_t nIndexIn, bool fSpendingIn);
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << key << nType << hashBytes;
+        ser_writedata32be(s, nHeight);
+        s << txid;
+        ser_writedata32be(s, nIndex);
+        s << fSpending;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key >> nType >> hashBytes;
+        nHeight = ser_readdata32be(s);
+        s >> txid;
+        nIndex = ser_readdata32be(s);
+        s >> fSpending;
+    }
+};
+
+/** Key of an unspent output paying to an address */
+struct CAddressUnspentKey
+{
+    char key;
+    uint8_t nType;
+    uint160 hashBytes;
+    COutPoint outpoint;
+
+    CAddressUnspentKey();
+    CAddressUnspentKey(uint8_t nTypeIn, const uint160& hashBytesIn, const COutPoint& outpointIn);
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << key << nType << hashBytes;
+        s << outpoint.hash;
+        ser_writedata32be(s, outpoint.n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key >> nType >> hashBytes;
+        s >> outpoint.hash;
+        outpoint.n = ser_readdata32be(s);
+    }
+};
+
+struct CAddressUnspentValue
+{
+    CAmount nValue;
+    CScript script;
+    int nHeight;
+
+    CAddressUnspentValue() : nValue(-1), nHeight(-1) {}
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptIn, int nHeightIn) : nValue(nValueIn), script(scriptIn), nHeight(nHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nValue);
+        READWRITE(*(CScriptBase*)(&script));
+        READWRITE(VARINT(nHeight));
+    }
+};
+
+/** Where an output was spent, with the amount and address it had */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    uint32_t nInputIndex;
+    int nHeight;
+    CAmount nValue;
+    uint8_t nType;
+    uint160 hashBytes;
+
+    CSpentIndexValue() : nInputIndex(0), nHeight(-1), nValue(-1), nType(ADDRESS_TYPE_NONE) {}
+    CSpentIndexValue(const uint256& txidIn, uint32_t nInputIndexIn, int nHeightIn, CAmount nValueIn, uint8_t nTypeIn, const uint160& hashBytesIn) :
+        txid(txidIn), nInputIndex(nInputIndexIn), nHeight(nHeightIn), nValue(nValueIn), nType(nTypeIn), hashBytes(hashBytesIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(VARINT(nInputIndex));
+        READWRITE(VARINT(nHeight));
+        READWRITE(nValue);
+        READWRITE(nType);
+        READWRITE(hashBytes);
+    }
+};
+
+/**
+ * SolarCoin: The address index (-addressindex) and the spent index (-spentindex), in their own
+ * database under indexes/address.
+ *
+ * Unlike the transaction and block filter indexes they follow the active chain exactly: the
+ * changes of each connected or disconnected block are made from its undo data in ConnectTip()
+ * and DisconnectTip(), and collected in a batch. The batch is written with the coins database
+ * (before it, so the index is never behind the chain state), when it grows large, and before a
+ * query. The index records the block it is at; on startup it undoes the blocks it has beyond the
+ * active chain, and an index that is behind the chain has to be rebuilt with -reindex-chainstate.
+ */
+class CAddressIndex
+{
+private:
+    CDBWrapper db;
+    const bool fAddressIndex;
+    const bool fSpentIndex;
+    //! Changes of the blocks connected and disconnected since the last write (protected by cs_main)
+    CDBBatch batch;
+    //! The block the index was last written at (protected by cs_main)
+    uint256 hashBestWritten;
+
+    //! Add or remove the entries of a block
+    void UpdateBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, bool fConnect);
+    //! Write out the pending changes, with the block they bring the index to
+    bool WriteBatch(const uint256& hashBest);
+
+public:
+    CAddressIndex(bool fAddressIndexIn, bool fSpentIndexIn, size_t nCacheSize, bool fWipe);
+
+    /**
+     * Undo the blocks the index has beyond the active chain, and check that it covers the chain
+     * with the indexes enabled now; needs cs_main. Returns false when it has to be rebuilt.
+     */
+    bool Init(std::string& strError);
+
+    bool IsAddressIndexEnabled() const { return fAddressIndex; }
+    bool IsSpentIndexEnabled() const { return fSpentIndex; }
+
+    /** Add the entries of a block connected to the tip; needs cs_main */
+    bool ConnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    /** Remove the entries of the tip being disconnected; needs cs_main */
+    bool DisconnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    /**
+     * Write out the pending changes, and the block they bring the index to if it moved since the
+     * last write, even without changes; needs cs_main
+     */
+    bool Flush(const uint256& hashBest);
+
+    /**
+     * The queries take cs_main only to write out the pending changes, and read without it.
+     * The address entries of the blocks from nStartHeight to nEndHeight (both included, -1 for no limit),
+     * in block order. With nMaxTxs, reading stops after the entries of that many transactions.
+     */
+    bool GetAddressDeltas(uint8_t nType, const uint160& hashBytes, int nStartHeight, int nEndHeight,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, size_t nMaxTxs = 0);
+    /**
+     * The unspent outputs paying to an address, created from nStartHeight to nEndHeight, oldest first.
+     * With nMax, only the nMax oldest are kept while reading.
+     */
+    bool GetAddressUnspent(uint8_t nType, const uint160& hashBytes,
+                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent,
+                           int nStartHeight = 0, int nEndHeight = -1, size_t nMax = 0);
+    /** Where an output was spent; false if it is unspent or unknown */
+    bool GetSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value);
+};
+
+/** The address and spent index, NULL unless -addressindex or -spentindex */
+extern CAddressIndex* paddressindex;
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -67,12 +67,12 @@ double CAddrInfo::GetChance(int64_t nNow) const
 
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    std::unordered_map<CNetAddr, int, CNetAddrHasher>::iterator it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return NULL;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    std::unordered_map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return NULL;
@@ -121,6 +121,7 @@ void CAddrMan::Delete(int nId)
     vRandom.pop_back();
     mapAddr.erase(info);
     mapInfo.erase(nId);
+    setChanged.erase(nId);
     nNew--;
 }
 
@@ -179,6 +180,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
         infoOld.nRefCount = 1;
         vvNew[nUBucket][nUBucketPos] = nIdEvict;
         nNew++;
+        setChanged.insert(nIdEvict);
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
@@ -209,6 +211,7 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime)
     info.nLastSuccess = nTime;
     info.nLastTry = nTime;
     info.nAttempts = 0;
+    setChanged.insert(nId);
     // nTime is not updated here, to avoid leaking information about
     // currently-connected peers.
 
@@ -239,7 +242,23 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime)
     MakeTried(info, nId);
 }
 
+CAddrNewPos CAddrMan::GetNewPos(const uint256& nKeyIn, const CAddress& addr, const CNetAddr& source)
+{
+    CAddrInfo info(addr, source);
+    CAddrNewPos pos;
+    pos.nBucket = info.GetNewBucket(nKeyIn, source);
+    pos.nBucketPos = info.GetBucketPosition(nKeyIn, true, pos.nBucket);
+    return pos;
+}
+
 bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty)
+{
+    if (!addr.IsRoutable())
+        return false;
+    return Add_(addr, source, nTimePenalty, GetNewPos(nKey, addr, source));
+}
+
+bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, const CAddrNewPos& pos)
 {
     if (!addr.IsRoutable())
         return false;
@@ -254,6 +273,8 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     }
 
     if (pinfo) {
+        const unsigned int nTimePrev = pinfo->nTime;
+        const ServiceFlags nServicesPrev = pinfo->nServices;
         // periodically update nTime
         bool fCurrentlyOnline = (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
         int64_t nUpdateInterval = (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
@@ -262,6 +283,8 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
 
         // add services
         pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
+        if (pinfo->nTime != nTimePrev || pinfo->nServices != nServicesPrev)
+            setChanged.insert(nId);
 
         // do not update if no new information is present
         if (!addr.nTime || (pinfo->nTime && addr.nTime <= pinfo->nTime))
@@ -288,8 +311,13 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source);
-    int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    // The position depends on the port as well, which may differ from an existing entry's
+    int nUBucket = pos.nBucket;
+    int nUBucketPos = pos.nBucketPos;
+    if ((CService)*pinfo != (CService)addr) {
+        nUBucket = pinfo->GetNewBucket(nKey, source);
+        nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    }
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
@@ -303,6 +331,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
             vvNew[nUBucket][nUBucketPos] = nId;
+            setChanged.insert(nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -314,7 +343,8 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
 
 void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -331,6 +361,7 @@ void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
     if (fCountFailure && info.nLastCountAttempt < nLastGood) {
         info.nLastCountAttempt = nTime;
         info.nAttempts++;
+        setChanged.insert(nId);
     }
 }
 
@@ -390,7 +421,7 @@ int CAddrMan::Check_()
     if (vRandom.size() != nTried + nNew)
         return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+    for (std::unordered_map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
         int n = (*it).first;
         CAddrInfo& info = (*it).second;
         if (info.fInTried) {
@@ -482,7 +513,8 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
 
 void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -496,13 +528,16 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 
     // update info
     int64_t nUpdateInterval = 20 * 60;
-    if (nTime - info.nTime > nUpdateInterval)
+    if (nTime - info.nTime > nUpdateInterval) {
         info.nTime = nTime;
+        setChanged.insert(nId);
+    }
 }
 
 void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -515,7 +550,39 @@ void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
         return;
 
     // update info
-    info.nServices = nServices;
+    if (info.nServices != nServices) {
+        info.nServices = nServices;
+        setChanged.insert(nId);
+    }
+}
+
+void CAddrMan::GetChanges_(std::vector<CAddrJournalRecord>& vRecords)
+{
+    vRecords.reserve(vRecords.size() + setChanged.size());
+    for (int nId : setChanged) {
+        std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.find(nId);
+        assert(it != mapInfo.end());
+        vRecords.push_back(CAddrJournalRecord(it->second, it->second.fInTried));
+    }
+    setChanged.clear();
+}
+
+void CAddrMan::Restore_(const CAddrJournalRecord& record)
+{
+    const CAddrInfo& info = record.info;
+    Add_(info, info.source, 0);
+
+    int nId;
+    CAddrInfo* pinfo = Find(info, &nId);
+    // it lost its place in the new table to another entry, or is on another port
+    if (!pinfo || *pinfo != info)
+        return;
+    pinfo->nTime = info.nTime;
+    pinfo->nServices = info.nServices;
+    pinfo->nLastSuccess = info.nLastSuccess;
+    pinfo->nAttempts = info.nAttempts;
+    if (record.fInTried && !pinfo->fInTried && pinfo->nLastSuccess)
+        MakeTried(*pinfo, nId);
 }
 
 int CAddrMan::RandomInt(int nMax){
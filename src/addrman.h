@@ -6,6 +6,7 @@
 #ifndef BITCOIN_ADDRMAN_H
 #define BITCOIN_ADDRMAN_H
 
+#include "memusage.h"
 #include "netaddress.h"
 #include "protocol.h"
 #include "random.h"
@@ -13,9 +14,11 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <limits>
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -171,6 +174,44 @@ public:
 //! the maximum number of nodes to return in a getaddr call
 #define ADDRMAN_GETADDR_MAX 2500
 
+/** SolarCoin: An entry that changed since peers.dat was written, as journaled in peers.journal */
+class CAddrJournalRecord
+{
+public:
+    CAddrInfo info;
+    bool fInTried;
+
+    CAddrJournalRecord() : fInTried(false) {}
+    CAddrJournalRecord(const CAddrInfo& infoIn, bool fInTriedIn) : info(infoIn), fInTried(fInTriedIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(info);
+        READWRITE(fInTried);
+    }
+};
+
+/** SolarCoin: Hashes network addresses with a random key, so peers cannot pick colliding ones */
+class CNetAddrHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const CNetAddr& addr) const { return addr.GetSipHash(k0, k1); }
+};
+
+/** SolarCoin: The bucket and position an address takes in the "new" table, computed outside the lock */
+struct CAddrNewPos
+{
+    int nBucket;
+    int nBucketPos;
+};
+
 /** 
  * Stochastical (IP) address manager 
  */
@@ -184,10 +225,10 @@ private:
     int nIdCount;
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    std::unordered_map<int, CAddrInfo> mapInfo;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    std::unordered_map<CNetAddr, int, CNetAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -207,6 +248,9 @@ private:
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
+    //! SolarCoin: nIds of the entries that changed since the last snapshot or GetChanges() (memory only)
+    std::set<int> setChanged;
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -239,6 +283,12 @@ protected:
     //! Add an entry to the "new" table.
     bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty);
 
+    //! Add an entry to the "new" table, at the position GetNewPos() computed for it.
+    bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty, const CAddrNewPos& pos);
+
+    //! The position of addr from source in the "new" table with key nKeyIn; it needs no lock.
+    static CAddrNewPos GetNewPos(const uint256& nKeyIn, const CAddress& addr, const CNetAddr& source);
+
     //! Mark an entry as attempted to connect.
     void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime);
 
@@ -262,6 +312,12 @@ protected:
     //! Update an entry's service bits.
     void SetServices_(const CService &addr, ServiceFlags nServices);
 
+    //! Append the changed entries to vRecords and forget the changes.
+    void GetChanges_(std::vector<CAddrJournalRecord>& vRecords);
+
+    //! Apply a journaled change on top of the loaded entries.
+    void Restore_(const CAddrJournalRecord& record);
+
 public:
     /**
      * serialized format:
@@ -308,7 +364,7 @@ public:
         s << nUBuckets;
         std::map<int, int> mapUnkIds;
         int nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             mapUnkIds[(*it).first] = nIds;
             const CAddrInfo &info = (*it).second;
             if (info.nRefCount) {
@@ -318,7 +374,7 @@ public:
             }
         }
         nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             const CAddrInfo &info = (*it).second;
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
@@ -432,9 +488,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                std::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -467,6 +523,7 @@ public:
         nTried = 0;
         nNew = 0;
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
+        setChanged.clear();
     }
 
     CAddrMan()
@@ -486,6 +543,14 @@ public:
         return vRandom.size();
     }
 
+    //! SolarCoin: Bytes of memory used, including the bucket tables
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return sizeof(vvTried) + sizeof(vvNew) + memusage::DynamicUsage(mapInfo) + memusage::DynamicUsage(mapAddr) +
+            memusage::DynamicUsage(vRandom) + memusage::DynamicUsage(setChanged);
+    }
+
     //! Consistency check
     void Check()
     {
@@ -515,11 +580,27 @@ public:
     //! Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
+        // SolarCoin: The bucket hashes are computed before taking the lock, and again under
+        // it only if the key changed in between
+        uint256 nKeyPos;
+        {
+            LOCK(cs);
+            nKeyPos = nKey;
+        }
+        std::vector<CAddrNewPos> vPos;
+        vPos.reserve(vAddr.size());
+        for (const CAddress& addr : vAddr)
+            vPos.push_back(addr.IsRoutable() ? GetNewPos(nKeyPos, addr, source) : CAddrNewPos());
+
         LOCK(cs);
         int nAdd = 0;
         Check();
-        for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
-            nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+        for (size_t i = 0; i < vAddr.size(); i++) {
+            if (nKeyPos == nKey)
+                nAdd += Add_(vAddr[i], source, nTimePenalty, vPos[i]) ? 1 : 0;
+            else
+                nAdd += Add_(vAddr[i], source, nTimePenalty) ? 1 : 0;
+        }
         Check();
         if (nAdd)
             LogPrint("addrman", "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
@@ -589,6 +670,34 @@ public:
         Check();
     }
 
+    /**
+     * SolarCoin: Serialize all entries to s, which has them all in memory before anything is
+     * written to disk, and forget the changes the snapshot now includes.
+     */
+    template<typename Stream>
+    void Snapshot(Stream& s)
+    {
+        LOCK(cs);
+        s << *this;
+        setChanged.clear();
+    }
+
+    //! SolarCoin: The entries that changed since the last snapshot or call, to be journaled.
+    void GetChanges(std::vector<CAddrJournalRecord>& vRecords)
+    {
+        LOCK(cs);
+        GetChanges_(vRecords);
+    }
+
+    //! SolarCoin: Apply a journaled change on top of the entries loaded from a snapshot.
+    void Restore(const CAddrJournalRecord& record)
+    {
+        LOCK(cs);
+        Check();
+        Restore_(record);
+        Check();
+    }
+
 };
 
 #endif // BITCOIN_ADDRMAN_H
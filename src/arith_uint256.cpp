@@ -67,6 +67,28 @@ base_uint<BITS>& base_uint<BITS>::operator*=(uint32_t b32)
 template <unsigned int BITS>
 base_uint<BITS>& base_uint<BITS>::operator*=(const base_uint& b)
 {
+#ifdef __SIZEOF_INT128__
+    // SolarCoin: on 64-bit limbs, a quarter of the multiplications of 32-bit ones
+    static_assert(WIDTH % 2 == 0, "base_uint must have a whole number of 64-bit limbs");
+    uint64_t a64[WIDTH / 2], b64[WIDTH / 2], r64[WIDTH / 2];
+    for (int i = 0; i < WIDTH / 2; i++) {
+        a64[i] = pn[2 * i] | (uint64_t)pn[2 * i + 1] << 32;
+        b64[i] = b.pn[2 * i] | (uint64_t)b.pn[2 * i + 1] << 32;
+        r64[i] = 0;
+    }
+    for (int j = 0; j < WIDTH / 2; j++) {
+        uint64_t carry = 0;
+        for (int i = 0; i + j < WIDTH / 2; i++) {
+            unsigned __int128 n = (unsigned __int128)a64[j] * b64[i] + r64[i + j] + carry;
+            r64[i + j] = (uint64_t)n;
+            carry = (uint64_t)(n >> 64);
+        }
+    }
+    for (int i = 0; i < WIDTH / 2; i++) {
+        pn[2 * i] = (uint32_t)r64[i];
+        pn[2 * i + 1] = (uint32_t)(r64[i] >> 32);
+    }
+#else
     base_uint<BITS> a = *this;
     *this = 0;
     for (int j = 0; j < WIDTH; j++) {
@@ -77,32 +99,95 @@ base_uint<BITS>& base_uint<BITS>::operator*=(const base_uint& b)
             carry = n >> 32;
         }
     }
+#endif
     return *this;
 }
 
+/** Leading zero bits of a non-zero limb */
+static inline int CountLeadingZeros(uint32_t n)
+{
+#if defined(__GNUC__)
+    return __builtin_clz(n);
+#else
+    int nZeros = 0;
+    for (uint32_t nBit = 0x80000000; !(n & nBit); nBit >>= 1)
+        nZeros++;
+    return nZeros;
+#endif
+}
+
 template <unsigned int BITS>
 base_uint<BITS>& base_uint<BITS>::operator/=(const base_uint& b)
 {
-    base_uint<BITS> div = b;     // make a copy, so we can shift.
-    base_uint<BITS> num = *this; // make a copy, so we can subtract.
-    *this = 0;                   // the quotient.
-    int num_bits = num.bits();
-    int div_bits = div.bits();
-    if (div_bits == 0)
+    // SolarCoin: long division a limb of the quotient at a time (Knuth, TAOCP vol. 2, 4.3.1,
+    // algorithm D) rather than a bit at a time
+    const int nNumLimbs = (bits() + 31) / 32;
+    const int nDivLimbs = (b.bits() + 31) / 32;
+    if (nDivLimbs == 0)
         throw uint_error("Division by zero");
-    if (div_bits > num_bits) // the result is certainly 0.
+    if (nDivLimbs > nNumLimbs || *this < b) { // the result is certainly 0.
+        *this = 0;
         return *this;
-    int shift = num_bits - div_bits;
-    div <<= shift; // shift so that div and num align.
-    while (shift >= 0) {
-        if (num >= div) {
-            num -= div;
-            pn[shift / 32] |= (1 << (shift & 31)); // set a bit of the result.
+    }
+    uint32_t q[WIDTH] = {0};
+    if (nDivLimbs == 1) {
+        // A small divisor, one hardware division per limb
+        const uint64_t nDiv = b.pn[0];
+        uint64_t nRem = 0;
+        for (int j = nNumLimbs - 1; j >= 0; j--) {
+            const uint64_t n = nRem << 32 | pn[j];
+            q[j] = n / nDiv;
+            nRem = n % nDiv;
+        }
+    } else {
+        // Normalize so the top limb of the divisor has its high bit set, which keeps each
+        // estimate of a quotient limb at most 2 too large
+        const int nShift = CountLeadingZeros(b.pn[nDivLimbs - 1]);
+        uint32_t vn[WIDTH], un[WIDTH + 1];
+        for (int i = nDivLimbs - 1; i > 0; i--)
+            vn[i] = (b.pn[i] << nShift) | (uint32_t)((uint64_t)b.pn[i - 1] >> (32 - nShift));
+        vn[0] = b.pn[0] << nShift;
+        un[nNumLimbs] = (uint32_t)((uint64_t)pn[nNumLimbs - 1] >> (32 - nShift));
+        for (int i = nNumLimbs - 1; i > 0; i--)
+            un[i] = (pn[i] << nShift) | (uint32_t)((uint64_t)pn[i - 1] >> (32 - nShift));
+        un[0] = pn[0] << nShift;
+
+        for (int j = nNumLimbs - nDivLimbs; j >= 0; j--) {
+            const uint64_t n = (uint64_t)un[j + nDivLimbs] << 32 | un[j + nDivLimbs - 1];
+            uint64_t qhat = n / vn[nDivLimbs - 1];
+            uint64_t rhat = n % vn[nDivLimbs - 1];
+            while (qhat >> 32 || qhat * vn[nDivLimbs - 2] > (rhat << 32 | un[j + nDivLimbs - 2])) {
+                qhat--;
+                rhat += vn[nDivLimbs - 1];
+                if (rhat >> 32)
+                    break;
+            }
+            // Subtract qhat times the divisor
+            int64_t k = 0, t;
+            for (int i = 0; i < nDivLimbs; i++) {
+                const uint64_t p = qhat * vn[i];
+                t = (int64_t)un[i + j] - k - (int64_t)(p & 0xffffffff);
+                un[i + j] = (uint32_t)t;
+                k = (int64_t)(p >> 32) - (t >> 32);
+            }
+            t = (int64_t)un[j + nDivLimbs] - k;
+            un[j + nDivLimbs] = (uint32_t)t;
+            q[j] = (uint32_t)qhat;
+            if (t < 0) {
+                // Rarely one too many: add the divisor back
+                q[j]--;
+                uint64_t carry = 0;
+                for (int i = 0; i < nDivLimbs; i++) {
+                    const uint64_t n2 = (uint64_t)un[i + j] + vn[i] + carry;
+                    un[i + j] = (uint32_t)n2;
+                    carry = n2 >> 32;
+                }
+                un[j + nDivLimbs] += (uint32_t)carry;
+            }
         }
-        div >>= 1; // shift back.
-        shift--;
     }
-    // num now contains the remainder of the division.
+    for (int i = 0; i < WIDTH; i++)
+        pn[i] = q[i];
     return *this;
 }
 
@@ -172,13 +257,8 @@ template <unsigned int BITS>
 unsigned int base_uint<BITS>::bits() const
 {
     for (int pos = WIDTH - 1; pos >= 0; pos--) {
-        if (pn[pos]) {
-            for (int bits = 31; bits > 0; bits--) {
-                if (pn[pos] & 1 << bits)
-                    return 32 * pos + bits + 1;
-            }
-            return 32 * pos + 1;
-        }
+        if (pn[pos])
+            return 32 * pos + 32 - CountLeadingZeros(pn[pos]);
     }
     return 0;
 }
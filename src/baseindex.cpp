@@ -0,0 +1,139 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "baseindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+//! Read the undo data of a block of the active chain; the genesis block has none
+static bool ReadBlockUndo(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    if (!pindex->pprev)
+        return true;
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    return !pos.IsNull() && UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
+CBaseIndex::CBaseIndex(const std::string& strNameIn, const std::string& strThreadNameIn, const std::string& strLogCategoryIn,
+                       unsigned int nSyncBatchBlocksIn, bool fUndoIn, int64_t nMaxSyncRateIn) :
+    strName(strNameIn), strThreadName(strThreadNameIn), strLogCategory(strLogCategoryIn), nSyncBatchBlocks(nSyncBatchBlocksIn),
+    fUndo(fUndoIn), nMaxSyncRate(nMaxSyncRateIn), fSynced(false), pindexBest(NULL)
+{
+}
+
+void CBaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::shared_ptr<const CBlockUndo>& pblockundo)
+{
+    AssertLockHeld(cs_main);
+    if (!fSynced)
+        return;
+
+    std::shared_ptr<const CBlockUndo> pblockundoIndexed;
+    if (fUndo) {
+        pblockundoIndexed = pblockundo;
+        if (!pblockundoIndexed) {
+            std::shared_ptr<CBlockUndo> pblockundoRead = std::make_shared<CBlockUndo>();
+            if (!ReadBlockUndo(*pblockundoRead, pindex)) {
+                LogPrintf("%s: failed to read the undo data of block %s, %s not updated\n", __func__, pindex->GetBlockHash().ToString(), strName);
+                fSynced = false;
+                return;
+            }
+            pblockundoIndexed = pblockundoRead;
+        }
+    }
+    std::vector<CIndexedBlock> vBlocks(1, CIndexedBlock(pindex, pblock, pblockundoIndexed));
+    if (!WriteBlocks(vBlocks, chainActive.GetLocator(pindex))) {
+        // Let the sync thread retry from the last block written
+        LogPrintf("%s: failed to write block %s to the %s\n", __func__, pindex->GetBlockHash().ToString(), strName);
+        fSynced = false;
+        return;
+    }
+    pindexBest = pindex;
+}
+
+void CBaseIndex::ThreadSync()
+{
+    RenameThread(strThreadName.c_str());
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    int64_t nStart = GetTimeMicros();
+    uint64_t nBytesRead = 0;
+    while (true) {
+        // Continue after the last indexed block, from where it forked off if it was disconnected
+        std::vector<const CBlockIndex*> vIndex;
+        CBlockLocator locator;
+        {
+            LOCK(cs_main);
+            if (!fSynced) {
+                const CBlockIndex* pindexFork = pindexBest ? chainActive.FindFork(pindexBest) : NULL;
+                const CBlockIndex* pindex = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
+                while (pindex && vIndex.size() < nSyncBatchBlocks) {
+                    vIndex.push_back(pindex);
+                    pindex = chainActive.Next(pindex);
+                }
+                if (!vIndex.empty()) {
+                    locator = chainActive.GetLocator(vIndex.back());
+                } else if (chainActive.Tip() && !IsInitialBlockDownload()) {
+                    // Blocks connected during the initial download are indexed in batches, afterwards
+                    // BlockConnected() adds them as they come; cs_main makes sure none is missed.
+                    pindexBest = chainActive.Tip();
+                    fSynced = true;
+                    LogPrintf("%s: %s synced at height %d\n", __func__, strName, pindexBest->nHeight);
+                }
+            }
+        }
+        if (vIndex.empty()) {
+            MilliSleep(1000);
+            nStart = GetTimeMicros();
+            nBytesRead = 0;
+            continue;
+        }
+
+        std::vector<CIndexedBlock> vBlocks;
+        vBlocks.reserve(vIndex.size());
+        for (const CBlockIndex* pindex : vIndex) {
+            boost::this_thread::interruption_point();
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            std::shared_ptr<CBlockUndo> pblockundo;
+            if (fUndo)
+                pblockundo = std::make_shared<CBlockUndo>();
+            if (!ReadBlockFromDisk(*pblock, pindex, consensusParams) || (pblockundo && !ReadBlockUndo(*pblockundo, pindex))) {
+                LogPrintf("%s: failed to read block %s, %s not updated\n", __func__, pindex->GetBlockHash().ToString(), strName);
+                return;
+            }
+            nBytesRead += ::GetSerializeSize(*pblock, SER_DISK, CLIENT_VERSION);
+            vBlocks.push_back(CIndexedBlock(pindex, pblock, pblockundo));
+        }
+        if (!WriteBlocks(vBlocks, locator)) {
+            LogPrintf("%s: failed to write to the %s\n", __func__, strName);
+            return;
+        }
+        {
+            LOCK(cs_main);
+            pindexBest = vIndex.back();
+        }
+        if (vIndex.size() == nSyncBatchBlocks)
+            LogPrint(strLogCategory.c_str(), "%s: indexed up to height %d\n", __func__, vIndex.back()->nHeight);
+
+        // Leave disk bandwidth to block validation
+        if (nMaxSyncRate > 0) {
+            int64_t nWait = (int64_t)(nBytesRead * 1000000 / nMaxSyncRate) - (GetTimeMicros() - nStart);
+            if (nWait > 0)
+                MilliSleep(nWait / 1000);
+        }
+    }
+}
+
+bool CBaseIndex::IsSynced() const
+{
+    LOCK(cs_main);
+    return fSynced;
+}
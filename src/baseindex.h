@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BASEINDEX_H
+#define BITCOIN_BASEINDEX_H
+
+#include "validationinterface.h"
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+struct CBlockLocator;
+
+/** A block of the active chain to add to an index */
+struct CIndexedBlock
+{
+    const CBlockIndex* pindex;
+    std::shared_ptr<const CBlock> pblock;
+    //! The undo data of the block if the index uses them, NULL otherwise; empty for the genesis block
+    std::shared_ptr<const CBlockUndo> pblockundo;
+
+    CIndexedBlock(const CBlockIndex* pindexIn, const std::shared_ptr<const CBlock>& pblockIn, const std::shared_ptr<const CBlockUndo>& pblockundoIn) :
+        pindex(pindexIn), pblock(pblockIn), pblockundo(pblockundoIn) {}
+};
+
+/**
+ * SolarCoin: An index of the active chain kept next to the block tree, like the transaction, block
+ * filter and block statistics indexes. The index stores a locator of the last block it covers with
+ * its entries. A background thread reads the blocks of the active chain after that block and writes
+ * their entries in batches, so the index can be turned on, or resume after a crash, without
+ * -reindex. Once it has caught up with the tip after the initial block download, BlockConnected()
+ * adds the blocks as they are connected, with the undo data ConnectTip() built.
+ */
+class CBaseIndex : public CValidationInterface
+{
+private:
+    //! What the log calls the index
+    const std::string strName;
+    const std::string strThreadName;
+    //! The -debug category of the progress while catching up
+    const std::string strLogCategory;
+    //! Blocks written in one batch while catching up
+    const unsigned int nSyncBatchBlocks;
+    //! Whether WriteBlocks() needs the undo data of the blocks
+    const bool fUndo;
+    //! Bytes of blocks read per second at most while catching up, 0 for no limit
+    const int64_t nMaxSyncRate;
+    //! Whether BlockConnected() indexes the blocks, instead of the sync thread (protected by cs_main)
+    bool fSynced;
+
+protected:
+    //! The last block written to the index (protected by cs_main)
+    const CBlockIndex* pindexBest;
+
+    CBaseIndex(const std::string& strNameIn, const std::string& strThreadNameIn, const std::string& strLogCategoryIn,
+               unsigned int nSyncBatchBlocksIn, bool fUndoIn, int64_t nMaxSyncRateIn = 0);
+
+    /** Write the entries of blocks of the active chain, with the locator of the last one */
+    virtual bool WriteBlocks(const std::vector<CIndexedBlock>& vBlocks, const CBlockLocator& locator) = 0;
+
+    void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::shared_ptr<const CBlockUndo>& pblockundo) override;
+
+public:
+    /** Run the thread catching up with the active chain */
+    void ThreadSync();
+
+    /** Whether the index covers the active chain */
+    bool IsSynced() const;
+};
+
+#endif // BITCOIN_BASEINDEX_H
@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "random.h"
+
+static std::vector<arith_uint256> RandomNumbers(size_t count, int bits)
+{
+    FastRandomContext rng(true);
+    std::vector<arith_uint256> numbers(count);
+    for (arith_uint256& n : numbers) {
+        for (int i = 0; i < 8; i++)
+            n = (n << 32) | arith_uint256(rng.rand32());
+        n >>= 256 - bits;
+    }
+    return numbers;
+}
+
+/* Full width products, as in the difficulty retargeting */
+static void ArithUint256Multiply(benchmark::State& state)
+{
+    std::vector<arith_uint256> numbers = RandomNumbers(64, 256);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        numbers[i & 63] *= numbers[(i + 1) & 63] | arith_uint256(1);
+        i++;
+    }
+}
+
+/* The block proof of a target, (~target / (target + 1)) + 1 */
+static void ArithUint256BlockProof(benchmark::State& state)
+{
+    std::vector<arith_uint256> targets = RandomNumbers(64, 224);
+    arith_uint256 sum;
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const arith_uint256& target = targets[i++ & 63];
+        sum += (~target / (target + 1)) + 1;
+    }
+}
+
+/* Division by a divisor of one limb, as by the target spacing when retargeting */
+static void ArithUint256DivideSmall(benchmark::State& state)
+{
+    std::vector<arith_uint256> numbers = RandomNumbers(64, 256);
+    arith_uint256 sum;
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        sum += numbers[i & 63] / arith_uint256(60 + (i & 63));
+        i++;
+    }
+}
+
+static void ArithUint256Compact(benchmark::State& state)
+{
+    std::vector<arith_uint256> numbers = RandomNumbers(64, 224);
+    uint32_t nCompact = 0;
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        arith_uint256 n;
+        n.SetCompact(numbers[i++ & 63].GetCompact() ^ (nCompact & 1));
+        nCompact = n.GetCompact();
+    }
+}
+
+BENCHMARK(ArithUint256Multiply);
+BENCHMARK(ArithUint256BlockProof);
+BENCHMARK(ArithUint256DivideSmall);
+BENCHMARK(ArithUint256Compact);
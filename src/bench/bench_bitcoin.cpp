@@ -4,6 +4,9 @@
 
 #include "bench.h"
 
+#include "crypto/aes.h"
+#include "crypto/scrypt.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "validation.h"
 #include "util.h"
@@ -11,6 +14,9 @@
 int
 main(int argc, char** argv)
 {
+    SHA256AutoDetect();
+    scrypt_detect();
+    AESAutoDetect();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -0,0 +1,78 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/chainsetup.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "miner.h"
+#include "net.h"
+#include "net_processing.h"
+#include "pow.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "validationinterface.h"
+
+#include <mutex>
+
+#include <boost/filesystem.hpp>
+
+ChainBenchSetup::ChainBenchSetup(const std::string& chainName, int nBlocks)
+{
+    static std::once_flag initFlag;
+    std::call_once(initFlag, []() {
+        SetupNetworking();
+        InitSignatureCache();
+    });
+    SelectParams(chainName);
+    const CChainParams& chainparams = Params();
+    ClearDatadirCache();
+    pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_solarcoin_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    boost::filesystem::create_directories(pathTemp);
+    ForceSetArg("-datadir", pathTemp.string());
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    InitBlockIndex(chainparams);
+    CValidationState state;
+    ActivateBestChain(state, chainparams);
+    connman.reset(new CConnman(0x1337, 0x1337));
+    peerLogic.reset(new PeerLogicValidation(connman.get()));
+    RegisterValidationInterface(peerLogic.get());
+    RegisterNodeSignals(GetNodeSignals());
+
+    // Mined as TestChain100Setup does
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    for (int i = 0; i < nBlocks; i++) {
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+        CBlock& block = pblocktemplate->block;
+        unsigned int nExtraNonce = 0;
+        IncrementExtraNonce(&block, chainActive.Tip(), nExtraNonce);
+        while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus()))
+            ++block.nNonce;
+        ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, NULL);
+    }
+}
+
+ChainBenchSetup::~ChainBenchSetup()
+{
+    UnregisterNodeSignals(GetNodeSignals());
+    UnregisterValidationInterface(peerLogic.get());
+    peerLogic.reset();
+    connman.reset();
+    mempool.clear();
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    delete pcoinsdbview;
+    delete pblocktree;
+    pcoinsTip = NULL;
+    pcoinsdbview = NULL;
+    pblocktree = NULL;
+    boost::filesystem::remove_all(pathTemp);
+}
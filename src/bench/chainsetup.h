@@ -0,0 +1,32 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_CHAINSETUP_H
+#define BITCOIN_BENCH_CHAINSETUP_H
+
+#include <memory>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+class CConnman;
+class PeerLogicValidation;
+
+/**
+ * SolarCoin: A node for the benchmarks that need one, as TestingSetup makes it for the tests: the
+ * chain state of a chain in a temporary data directory, with nBlocks mined on top of genesis, and
+ * a connman without sockets. One at a time, as it is the global chain state.
+ */
+class ChainBenchSetup
+{
+public:
+    boost::filesystem::path pathTemp;
+    std::unique_ptr<CConnman> connman;
+    std::unique_ptr<PeerLogicValidation> peerLogic;
+
+    ChainBenchSetup(const std::string& chainName, int nBlocks);
+    ~ChainBenchSetup();
+};
+
+#endif // BITCOIN_BENCH_CHAINSETUP_H
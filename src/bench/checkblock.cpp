@@ -7,7 +7,10 @@
 #include "chainparams.h"
 #include "validation.h"
 #include "streams.h"
+#include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "key.h"
+#include "script/standard.h"
 
 namespace block_bench {
 #include "bench/data/block413567.raw.h"
@@ -52,5 +55,100 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// SolarCoin: No SolarCoin block is shipped under bench/data, so the blocks below are built here
+// like those of the main chain: 500 transactions with two inputs, two pay-to-pubkey-hash outputs
+// and a text comment. A PoW block starts with a paying coinbase; a PoST block with an empty
+// coinbase and a coinstake paying to a public key, and carries the block signature by that key.
+static std::vector<unsigned char> SerializeSolarCoinBlock(bool fProofOfStake)
+{
+    const std::vector<unsigned char> vchSig(72, 0x30);
+    const std::vector<unsigned char> vchPubKey(33, 0x02);
+    CKey key;
+    key.MakeNewKey(true);
+
+    CBlock block;
+    block.nVersion = fProofOfStake ? CBlockHeader::CURRENT_VERSION : CBlockHeader::LEGACY_VERSION_2;
+    block.hashPrevBlock = SerializeHash(fProofOfStake);
+    block.nTime = 1514764800;
+    block.nBits = 0x1e0fffff;
+    for (int n = 0; n < 500; n++) {
+        CMutableTransaction tx;
+        tx.nVersion = CTransaction::CURRENT_VERSION;
+        tx.nTime = block.nTime - 500 + n;
+        tx.vin.resize(n == 0 ? 1 : 2);
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            if (n == 0 && !fProofOfStake) {
+                tx.vin[i].scriptSig = CScript() << 1000000 << OP_0;
+            } else {
+                tx.vin[i].prevout = COutPoint(SerializeHash(n * 2 + i), i);
+                tx.vin[i].scriptSig = CScript() << vchSig << vchPubKey;
+            }
+        }
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            tx.vout[i].nValue = 1234567890 + n * COIN + i;
+            tx.vout[i].scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, n + i))));
+        }
+        tx.strTxComment = "text:Solar generation report, facility #" + std::to_string(n) + ", 1.21 MWh";
+        if (n == 0 && fProofOfStake) {
+            CMutableTransaction coinbase;
+            coinbase.nVersion = CTransaction::CURRENT_VERSION;
+            coinbase.nTime = block.nTime;
+            coinbase.vin.resize(1);
+            coinbase.vin[0].scriptSig = CScript() << 1000000 << OP_0;
+            coinbase.vout.resize(1);
+            coinbase.vout[0].SetEmpty();
+            block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+            tx.nTime = block.nTime;
+            tx.vout[0].SetEmpty();
+            tx.vout[1].scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+            tx.strTxComment.clear();
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    assert(block.IsProofOfStake() == fProofOfStake);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    if (fProofOfStake)
+        assert(key.Sign(block.GetHash(), block.vchBlockSig));
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    return std::vector<unsigned char>(stream.begin(), stream.end());
+}
+
+static void DeserializeAndCheckSolarCoinBlock(benchmark::State& state, bool fProofOfStake)
+{
+    const std::vector<unsigned char> vchBlock = SerializeSolarCoinBlock(fProofOfStake);
+    CDataStream stream((const char*)vchBlock.data(), (const char*)vchBlock.data() + vchBlock.size(),
+            SER_NETWORK, PROTOCOL_VERSION);
+    char a;
+    stream.write(&a, 1); // Prevent compaction
+
+    Consensus::Params params = Params(CBaseChainParams::MAIN).GetConsensus();
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> block;
+        assert(stream.Rewind(vchBlock.size()));
+
+        // The synthetic PoW block does not meet its target
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, params, false));
+    }
+}
+
+static void DeserializeAndCheckPoWBlockTest(benchmark::State& state)
+{
+    DeserializeAndCheckSolarCoinBlock(state, false);
+}
+
+static void DeserializeAndCheckPoSTBlockTest(benchmark::State& state)
+{
+    DeserializeAndCheckSolarCoinBlock(state, true);
+}
+
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(DeserializeAndCheckPoWBlockTest);
+BENCHMARK(DeserializeAndCheckPoSTBlockTest);
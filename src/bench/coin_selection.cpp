@@ -57,4 +57,52 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+
+// SolarCoin: a wallet holding a great many small grants, searched by both selectors
+static void AddManyCoins(const CWallet& wallet, std::vector<COutput>& vCoins)
+{
+    for (int i = 0; i < 100000; i++)
+        addCoin(1000 + (i % 1000) * 1000, wallet, vCoins);
+}
+
+static void CoinSelectionManyUTXOKnapsack(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+    AddManyCoins(wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(COIN / 2 + 12345, 1, 6, 0, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+    }
+
+    BOOST_FOREACH (COutput output, vCoins)
+        delete output.tx;
+}
+
+static void CoinSelectionManyUTXOBnB(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+    AddManyCoins(wallet, vCoins);
+    const CFeeRate feeRate(DEFAULT_TRANSACTION_MINFEE);
+    const CAmount nCostOfChange = feeRate.GetFee(CHANGE_OUTPUT_SIZE) + feeRate.GetFee(INPUT_SIZE_ESTIMATE);
+
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsBnB(COIN / 2 + 12345, 1, 6, 0, vCoins, feeRate, nCostOfChange, setCoinsRet, nValueRet);
+        assert(success);
+    }
+
+    BOOST_FOREACH (COutput output, vCoins)
+        delete output.tx;
+}
+
 BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionManyUTXOKnapsack);
+BENCHMARK(CoinSelectionManyUTXOBnB);
@@ -10,6 +10,7 @@
 #include "uint256.h"
 #include "utiltime.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
@@ -51,6 +52,51 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+/* Double SHA-256 of 28-byte messages, the size of a stake kernel, one at a time */
+static void SHA256D_28b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(28 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1024; i++)
+            CHash256().Write(&in[28 * i], 28).Finalize(&out[32 * i]);
+    }
+}
+
+/* The same messages hashed by SHA256DShort() */
+static void SHA256DShort_28b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(28 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning())
+        SHA256DShort(out.data(), in.data(), 28, 1024);
+}
+
+/* Double SHA-256 of 64-byte messages, the inner nodes of a merkle tree */
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning())
+        SHA256D64(out.data(), in.data(), 1024);
+}
+
+/* The SHA-256 benchmarks restricted to some of the implementations; the plain ones use the best for this CPU */
+static void WithSHA256Implementations(benchmark::State& state, unsigned int use, void (*bench)(benchmark::State&))
+{
+    SHA256AutoDetect(use);
+    bench(state);
+    SHA256AutoDetect();
+}
+
+static void SHA256_generic(benchmark::State& state) { WithSHA256Implementations(state, 0, SHA256); }
+static void SHA256DShort_28b_generic(benchmark::State& state) { WithSHA256Implementations(state, 0, SHA256DShort_28b); }
+static void SHA256DShort_28b_sse2(benchmark::State& state) { WithSHA256Implementations(state, SHA256_USE_SSE2, SHA256DShort_28b); }
+static void SHA256DShort_28b_avx2(benchmark::State& state) { WithSHA256Implementations(state, SHA256_USE_AVX2, SHA256DShort_28b); }
+static void SHA256D64_1024_generic(benchmark::State& state) { WithSHA256Implementations(state, 0, SHA256D64_1024); }
+static void SHA256D64_1024_sse2(benchmark::State& state) { WithSHA256Implementations(state, SHA256_USE_SSE2, SHA256D64_1024); }
+static void SHA256D64_1024_avx2(benchmark::State& state) { WithSHA256Implementations(state, SHA256_USE_AVX2, SHA256D64_1024); }
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -59,6 +105,32 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+/* Scrypt of block headers, one at a time and with the multi-buffer code */
+static void Scrypt_80b(benchmark::State& state)
+{
+    std::vector<char> in(SCRYPT_MULTI_MAX_WAYS * 80, 0);
+    std::vector<uint256> out(SCRYPT_MULTI_MAX_WAYS);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < SCRYPT_MULTI_MAX_WAYS; i++)
+            scrypt_1024_1_1_256(&in[80 * i], (char*)out[i].begin());
+    }
+}
+
+static void Scrypt_80b_multi(benchmark::State& state)
+{
+    std::vector<char> in(SCRYPT_MULTI_MAX_WAYS * 80, 0);
+    std::vector<uint256> out(SCRYPT_MULTI_MAX_WAYS);
+    std::vector<char> scratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    std::vector<const char*> input(SCRYPT_MULTI_MAX_WAYS);
+    std::vector<char*> output(SCRYPT_MULTI_MAX_WAYS);
+    for (int i = 0; i < SCRYPT_MULTI_MAX_WAYS; i++) {
+        input[i] = &in[80 * i];
+        output[i] = (char*)out[i].begin();
+    }
+    while (state.KeepRunning())
+        scrypt_1024_1_1_256_multi(input.data(), output.data(), SCRYPT_MULTI_MAX_WAYS, scratchpad.data());
+}
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -74,5 +146,17 @@ BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
+BENCHMARK(SHA256_generic);
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D_28b);
+BENCHMARK(SHA256DShort_28b);
+BENCHMARK(SHA256DShort_28b_generic);
+BENCHMARK(SHA256DShort_28b_sse2);
+BENCHMARK(SHA256DShort_28b_avx2);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(SHA256D64_1024_generic);
+BENCHMARK(SHA256D64_1024_sse2);
+BENCHMARK(SHA256D64_1024_avx2);
+BENCHMARK(Scrypt_80b);
+BENCHMARK(Scrypt_80b_multi);
 BENCHMARK(SipHash_32b);
@@ -0,0 +1,83 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "pubkey.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <assert.h>
+
+#include <boost/thread/thread.hpp>
+
+/* ECDSA with the bundled libsecp256k1, in batches of 100 so the per-thread figures compare */
+static const int ECDSA_BATCH = 100;
+
+static void ECDSASign(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < ECDSA_BATCH; i++) {
+            *hash.begin() = i;
+            key.Sign(hash, vchSig);
+        }
+    }
+}
+
+/* A batch of verifications of different signatures by different keys, like those of a block */
+class ECDSAVerifyBatch
+{
+public:
+    std::vector<CPubKey> vPubKeys;
+    std::vector<uint256> vHashes;
+    std::vector<std::vector<unsigned char> > vSigs;
+
+    ECDSAVerifyBatch() : vPubKeys(ECDSA_BATCH), vHashes(ECDSA_BATCH), vSigs(ECDSA_BATCH)
+    {
+        for (int i = 0; i < ECDSA_BATCH; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            vPubKeys[i] = key.GetPubKey();
+            *vHashes[i].begin() = i;
+            key.Sign(vHashes[i], vSigs[i]);
+        }
+    }
+
+    void Run() const
+    {
+        for (int i = 0; i < ECDSA_BATCH; i++)
+            assert(vPubKeys[i].Verify(vHashes[i], vSigs[i]));
+    }
+};
+
+static void ECDSAVerify(benchmark::State& state)
+{
+    ECCVerifyHandle verifyHandle;
+    ECDSAVerifyBatch batch;
+    while (state.KeepRunning())
+        batch.Run();
+}
+
+/* A batch on each core at once: the time against ECDSAVerify shows how the verify table shares the caches */
+static void ECDSAVerify_AllCores(benchmark::State& state)
+{
+    ECCVerifyHandle verifyHandle;
+    ECDSAVerifyBatch batch;
+    int nThreads = std::max(GetNumCores(), 1);
+    while (state.KeepRunning()) {
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread([&batch] { batch.Run(); });
+        threads.join_all();
+    }
+}
+
+BENCHMARK(ECDSASign);
+BENCHMARK(ECDSAVerify);
+BENCHMARK(ECDSAVerify_AllCores);
@@ -0,0 +1,43 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "consensus/merkle.h"
+#include "random.h"
+#include "uint256.h"
+
+static std::vector<uint256> RandomLeaves(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves(count);
+    for (uint256& leaf : leaves) {
+        for (unsigned char& c : leaf)
+            c = rng.rand32();
+    }
+    return leaves;
+}
+
+/* The merkle root of a block with 9001 transactions, and the branch of one of them */
+static void MerkleRoot(benchmark::State& state)
+{
+    std::vector<uint256> leaves = RandomLeaves(9001);
+    while (state.KeepRunning()) {
+        bool mutated = false;
+        uint256 hash = ComputeMerkleRoot(leaves, &mutated);
+        leaves[mutated] = hash;
+    }
+}
+
+static void MerkleBranch(benchmark::State& state)
+{
+    std::vector<uint256> leaves = RandomLeaves(9001);
+    while (state.KeepRunning()) {
+        std::vector<uint256> branch = ComputeMerkleBranch(leaves, 4567);
+        leaves[0] = branch[0];
+    }
+}
+
+BENCHMARK(MerkleRoot);
+BENCHMARK(MerkleBranch);
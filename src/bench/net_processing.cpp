@@ -0,0 +1,296 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/chainsetup.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "net.h"
+#include "net_processing.h"
+#include "netmessagemaker.h"
+#include "random.h"
+#include "sync.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <thread>
+
+/*
+ * SolarCoin: Benchmarks of the peer message processing. A workload, a list of messages as
+ * -capturemessages writes them, is fed to fresh inbound peers the way the socket and message
+ * handler threads do: each message is queued on the peer, then ProcessMessages() and
+ * SendMessages() run until it is done with, and what the peer was sent is thrown away. The peers
+ * have no socket, and there are DEFAULT_MSGHAND_THREADS of them at once, each on its own thread,
+ * so the handler threads contend for the locks as they would on a node.
+ *
+ * Besides its line of timings, a workload prints a line per command with the messages processed,
+ * messages per second and allocations per message, and its lock waits.
+ *
+ * NetReplayCapture replays the msgs_recv.dat of a peer given by the BENCH_MESSAGE_CAPTURE
+ * environment variable, on an empty chain of BENCH_MESSAGE_CAPTURE_CHAIN (default main), so the
+ * captures of a node syncing from scratch replay with their header sync; it is skipped without it.
+ */
+
+/**
+ * Allocations of the calling thread, counted by the replacement operator new for the workloads, so
+ * the peers replayed in parallel only count their own and do not contend on a shared counter
+ */
+static thread_local uint64_t nAllocations = 0;
+
+void* operator new(size_t nSize)
+{
+    nAllocations++;
+    void* p = malloc(nSize ? nSize : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+/** Blocks of the regtest chain the synthetic workloads are run on */
+static const int NET_BENCH_BLOCKS = 200;
+
+/** A message of a workload, with the header it is received with */
+struct WireMessage
+{
+    std::string strCommand;
+    std::vector<unsigned char> vHeader;
+    std::vector<unsigned char> vData;
+};
+
+struct CommandStats
+{
+    uint64_t nMessages = 0;
+    int64_t nMicros = 0;
+    uint64_t nAllocations = 0;
+};
+
+static WireMessage MakeWireMessage(const std::string& strCommand, const std::vector<unsigned char>& vData)
+{
+    WireMessage msg;
+    msg.strCommand = strCommand;
+    msg.vData = vData;
+    CMessageHeader hdr(Params().MessageStart(), strCommand.c_str(), vData.size());
+    uint256 hash = Hash(vData.begin(), vData.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, msg.vHeader, 0, hdr};
+    return msg;
+}
+
+template <typename... Args>
+static void AddMessage(std::vector<WireMessage>& vMessages, const std::string& strCommand, Args&&... args)
+{
+    CSerializedNetMsg msg = CNetMsgMaker(PROTOCOL_VERSION).Make(strCommand, std::forward<Args>(args)...);
+    vMessages.push_back(MakeWireMessage(msg.command, msg.data.ToVector()));
+}
+
+/** The version handshake of an inbound peer, first in every synthetic workload */
+static std::vector<WireMessage> Handshake()
+{
+    std::vector<WireMessage> vMessages;
+    CSerializedNetMsg version = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERSION, PROTOCOL_VERSION, (uint64_t)NODE_NETWORK,
+        GetTime(), CAddress(CService(), NODE_NONE), CAddress(CService(), NODE_NETWORK), GetRand(std::numeric_limits<uint64_t>::max()),
+        std::string("/bench/"), chainActive.Height(), true);
+    vMessages.push_back(MakeWireMessage(version.command, version.data.ToVector()));
+    AddMessage(vMessages, NetMsgType::VERACK);
+    return vMessages;
+}
+
+/** Throw away what the peer was sent */
+static void DiscardSent(CNode* pnode)
+{
+    LOCK(pnode->cs_vSend);
+    for (std::deque<CQueuedNetMsg>& queue : pnode->vSendMsg)
+        queue.clear();
+    pnode->nSendSize = 0;
+    pnode->nSendOffset = 0;
+    pnode->fPauseSend = false;
+}
+
+/** Process the messages on a fresh inbound peer, one at a time as the handler threads do */
+static void RunPeer(CConnman& connman, const std::vector<WireMessage>& vMessages, NodeId id, std::map<std::string, CommandStats>& mapStats)
+{
+    const std::atomic<bool> interruptDummy(false);
+    CAddress addr(CService(CNetAddr(), 0), NODE_NETWORK);
+    CNode* pnode = new CNode(id, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+    GetNodeSignals().InitializeNode(pnode, connman);
+
+    for (const WireMessage& wire : vMessages) {
+        int64_t nStart = GetTimeMicros();
+        uint64_t nAllocStart = nAllocations;
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+        msg.readHeader((const char*)wire.vHeader.data(), wire.vHeader.size());
+        if (!wire.vData.empty())
+            msg.readData((const char*)wire.vData.data(), wire.vData.size());
+        msg.nTime = nStart;
+        msg.nMsgType = GetNetMessageTypeIndex(wire.strCommand);
+        {
+            LOCK(pnode->cs_vProcessMsg);
+            pnode->nProcessQueueSize += msg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+            pnode->vProcessMsg.push_back(std::move(msg));
+        }
+        bool fMoreWork;
+        do {
+            fMoreWork = ProcessMessages(pnode, connman, interruptDummy);
+            SendMessages(pnode, connman, interruptDummy);
+            DiscardSent(pnode);
+        } while ((fMoreWork || !pnode->vRecvGetData.empty()) && !pnode->fDisconnect);
+
+        CommandStats& stats = mapStats[wire.strCommand];
+        stats.nMessages++;
+        stats.nMicros += GetTimeMicros() - nStart;
+        stats.nAllocations += nAllocations - nAllocStart;
+        // A peer that misbehaved its way out is not served any more
+        if (pnode->fDisconnect)
+            break;
+    }
+
+    bool fUpdateConnectionTime = false;
+    GetNodeSignals().FinalizeNode(pnode->GetId(), fUpdateConnectionTime);
+    delete pnode;
+}
+
+static uint64_t LockContentions()
+{
+    uint64_t nContentions = 0;
+    for (const CLockSite* psite : GetLockSites())
+        nContentions += psite->nContentions.load(std::memory_order_relaxed);
+    return nContentions;
+}
+
+static void RunWorkload(benchmark::State& state, const std::string& strName, ChainBenchSetup& setup, const std::vector<WireMessage>& vMessages)
+{
+    std::map<std::string, CommandStats> mapStats;
+    std::mutex csStats;
+    NodeId nextId = 0;
+    const bool fLockProfileBefore = fLockProfile;
+    fLockProfile = true;
+    const uint64_t nContentionsStart = LockContentions();
+
+    while (state.KeepRunning()) {
+        std::vector<std::thread> vThreads;
+        for (int i = 0; i < DEFAULT_MSGHAND_THREADS; i++) {
+            NodeId id = nextId++;
+            vThreads.emplace_back([&, id]() {
+                std::map<std::string, CommandStats> mapPeerStats;
+                RunPeer(*setup.connman, vMessages, id, mapPeerStats);
+                std::lock_guard<std::mutex> lock(csStats);
+                for (const std::pair<const std::string, CommandStats>& item : mapPeerStats) {
+                    CommandStats& stats = mapStats[item.first];
+                    stats.nMessages += item.second.nMessages;
+                    stats.nMicros += item.second.nMicros;
+                    stats.nAllocations += item.second.nAllocations;
+                }
+            });
+        }
+        for (std::thread& thread : vThreads)
+            thread.join();
+    }
+
+    const uint64_t nContentions = LockContentions() - nContentionsStart;
+    fLockProfile = fLockProfileBefore;
+    for (const std::pair<const std::string, CommandStats>& item : mapStats) {
+        const CommandStats& stats = item.second;
+        std::cout << "#" << strName << "," << SanitizeString(item.first) << "," << stats.nMessages << ","
+                  << std::fixed << std::setprecision(1) << (stats.nMicros ? stats.nMessages * 1e6 / stats.nMicros : 0) << " msgs/s,"
+                  << std::setprecision(1) << (stats.nMessages ? (double)stats.nAllocations / stats.nMessages : 0) << " allocs/msg\n";
+    }
+    std::cout << "#" << strName << ",lock waits," << nContentions << "\n";
+}
+
+static std::vector<CInv> RandomInvs(int nType, int nCount)
+{
+    std::vector<CInv> vInv;
+    for (int i = 0; i < nCount; i++)
+        vInv.push_back(CInv(nType, GetRandHash()));
+    return vInv;
+}
+
+// Announcements of transactions never seen before, each asked for with getdata
+static void NetInvFlood(benchmark::State& state)
+{
+    ChainBenchSetup setup(CBaseChainParams::REGTEST, NET_BENCH_BLOCKS);
+    std::vector<WireMessage> vMessages = Handshake();
+    for (int i = 0; i < 100; i++)
+        AddMessage(vMessages, NetMsgType::INV, RandomInvs(MSG_TX, 35));
+    RunWorkload(state, "NetInvFlood", setup, vMessages);
+}
+
+// A peer syncing headers from genesis, and announcing the blocks back as headers
+static void NetHeaderSync(benchmark::State& state)
+{
+    ChainBenchSetup setup(CBaseChainParams::REGTEST, NET_BENCH_BLOCKS);
+    std::vector<WireMessage> vMessages = Handshake();
+    std::vector<CBlockHeader> vHeaders;
+    {
+        LOCK(cs_main);
+        for (int nHeight = 0; nHeight <= chainActive.Height(); nHeight += 10) {
+            CBlockLocator locator(std::vector<uint256>(1, chainActive[nHeight]->GetBlockHash()));
+            AddMessage(vMessages, NetMsgType::GETHEADERS, locator, uint256());
+        }
+        for (int nHeight = 1; nHeight <= chainActive.Height(); nHeight++)
+            vHeaders.push_back(chainActive[nHeight]->GetBlockHeader());
+    }
+    for (int i = 0; i < 5; i++)
+        AddMessage(vMessages, NetMsgType::HEADERS, vHeaders);
+    RunWorkload(state, "NetHeaderSync", setup, vMessages);
+}
+
+// Every block asked for in getdatas of 16, then transactions that are not there
+static void NetGetDataBurst(benchmark::State& state)
+{
+    ChainBenchSetup setup(CBaseChainParams::REGTEST, NET_BENCH_BLOCKS);
+    std::vector<WireMessage> vMessages = Handshake();
+    {
+        LOCK(cs_main);
+        std::vector<CInv> vInv;
+        for (int nHeight = 1; nHeight <= chainActive.Height(); nHeight++) {
+            vInv.push_back(CInv(MSG_BLOCK, chainActive[nHeight]->GetBlockHash()));
+            if (vInv.size() == 16 || nHeight == chainActive.Height()) {
+                AddMessage(vMessages, NetMsgType::GETDATA, vInv);
+                vInv.clear();
+            }
+        }
+    }
+    for (int i = 0; i < 20; i++)
+        AddMessage(vMessages, NetMsgType::GETDATA, RandomInvs(MSG_TX, 50));
+    RunWorkload(state, "NetGetDataBurst", setup, vMessages);
+}
+
+static void NetReplayCapture(benchmark::State& state)
+{
+    const char* pszCapture = getenv("BENCH_MESSAGE_CAPTURE");
+    if (!pszCapture)
+        return;
+    const char* pszChain = getenv("BENCH_MESSAGE_CAPTURE_CHAIN");
+    ChainBenchSetup setup(pszChain ? pszChain : CBaseChainParams::MAIN, 0);
+    std::vector<CCapturedMessage> vCaptured;
+    if (!ReadMessageCapture(pszCapture, vCaptured))
+        std::cerr << "NetReplayCapture: " << pszCapture << " cannot be read to its end, replaying " << vCaptured.size() << " messages\n";
+    std::vector<WireMessage> vMessages;
+    for (const CCapturedMessage& captured : vCaptured)
+        vMessages.push_back(MakeWireMessage(captured.strCommand, captured.vData));
+    RunWorkload(state, "NetReplayCapture", setup, vMessages);
+}
+
+BENCHMARK(NetInvFlood);
+BENCHMARK(NetHeaderSync);
+BENCHMARK(NetGetDataBurst);
+BENCHMARK(NetReplayCapture);
@@ -0,0 +1,250 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "kernel.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <deque>
+
+/*
+ * SolarCoin: Benchmarks of the proof-of-stake-time consensus code. There is no block index to
+ * load here, so the benches run on synthetic index segments built the way AddToBlockIndex()
+ * builds the real one: block times jittering around the target spacing, PoST targets from
+ * GetNextTargetRequired() and stake modifiers from ComputeNextStakeModifier().
+ */
+
+/** Blocks of the PoST segment, more than KimotoGravityWell() and the stake modifier selection look back */
+static const int POST_CHAIN_BLOCKS = 5000;
+/** Blocks of the segment made the active chain for kernel checks, from genesis */
+static const int KERNEL_CHAIN_BLOCKS = 600;
+
+class StakeChain
+{
+public:
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vIndex;
+
+    StakeChain(int nHeightFirst, int nBlocks, bool fStakeModifiers, const Consensus::Params& params)
+    {
+        const int64_t nTimeFirst = 1514764800;
+        const unsigned int nBitsPoW = arith_uint256(UintToArith256(params.powLimit) >> 12).GetCompact();
+        for (int i = 0; i < nBlocks; i++) {
+            const int nHeight = nHeightFirst + i;
+            vHashes.push_back(SerializeHash(nHeight));
+            vIndex.emplace_back();
+            CBlockIndex& index = vIndex.back();
+            index.phashBlock = &vHashes.back();
+            index.pprev = i ? &vIndex[i - 1] : nullptr;
+            index.nHeight = nHeight;
+            // About a target spacing apart, sometimes out of order
+            index.nTime = nTimeFirst + i * params.nTargetSpacing + (i * 7919) % 41 - 20;
+            index.SetStakeEntropyBit(UintToArith256(vHashes.back()).GetLow64() & 1);
+            if (nHeight > params.LAST_POW_BLOCK) {
+                index.nBits = GetNextTargetRequired(index.pprev, true, params);
+                index.SetProofOfStake();
+                index.SetStake(COutPoint(SerializeHash(vHashes.back()), 1), index.nTime);
+                index.SetHashProofOfStake(SerializeHash(COutPoint(vHashes.back(), 1)));
+            } else {
+                index.nBits = nBitsPoW;
+            }
+            if (fStakeModifiers) {
+                uint64_t nStakeModifier = 0;
+                bool fGeneratedStakeModifier = false;
+                assert(ComputeNextStakeModifier(&index, nStakeModifier, fGeneratedStakeModifier, params));
+                index.SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+            }
+        }
+        ClearMemos(vIndex.size());
+    }
+
+    CBlockIndex* Tip() { return &vIndex.back(); }
+
+    /** Forget what the consensus code memoized in the last nBlocks entries, so it is computed again */
+    void ClearMemos(size_t nBlocks)
+    {
+        for (size_t i = vIndex.size() - std::min(nBlocks, vIndex.size()); i < vIndex.size(); i++) {
+            vIndex[i].nNextWorkRequired = 0;
+            vIndex[i].nNextTargetRequired = 0;
+            vIndex[i].dPoSKernelPS = -1;
+            vIndex[i].dAverageStakeWeight = -1;
+        }
+    }
+};
+
+static const Consensus::Params& MainParams()
+{
+    return Params(CBaseChainParams::MAIN).GetConsensus();
+}
+
+/** PoST blocks after the last consensus fork, built once as the modifiers take a while */
+static StakeChain& PoSTChain()
+{
+    static StakeChain chain(Consensus::Params::FORK_HEIGHT_2, POST_CHAIN_BLOCKS, true, MainParams());
+    return chain;
+}
+
+/** PoW blocks up to the last one, for the Kimoto Gravity Well retargeting */
+static StakeChain& PoWChain()
+{
+    static StakeChain chain(MainParams().LAST_POW_BLOCK - POST_CHAIN_BLOCKS + 1, POST_CHAIN_BLOCKS, false, MainParams());
+    return chain;
+}
+
+/**
+ * Makes a chain from genesis the active chain while in scope: the kernel code looks the block of
+ * a staked output up in mapBlockIndex and chainActive, and GetAverageStakeWeight() needs a chain.
+ */
+class ActiveStakeChain
+{
+public:
+    StakeChain chain;
+
+    ActiveStakeChain() : chain(0, KERNEL_CHAIN_BLOCKS, true, MainParams())
+    {
+        LOCK(cs_main);
+        for (CBlockIndex& index : chain.vIndex)
+            mapBlockIndex[index.GetBlockHash()] = &index;
+        chainActive.SetTip(chain.Tip());
+    }
+
+    ~ActiveStakeChain()
+    {
+        LOCK(cs_main);
+        UnloadStakeModifierIndex();
+        chainActive.SetTip(nullptr);
+        for (const uint256& hash : chain.vHashes)
+            mapBlockIndex.erase(hash);
+    }
+};
+
+// The modifiers of the last 100 blocks, ten of which generate a new one, as connecting them does
+static void PoSTComputeNextStakeModifier(benchmark::State& state)
+{
+    const Consensus::Params& params = MainParams();
+    StakeChain& chain = PoSTChain();
+    while (state.KeepRunning()) {
+        for (size_t i = chain.vIndex.size() - 100; i < chain.vIndex.size(); i++) {
+            uint64_t nStakeModifier;
+            bool fGeneratedStakeModifier;
+            assert(ComputeNextStakeModifier(&chain.vIndex[i], nStakeModifier, fGeneratedStakeModifier, params));
+        }
+    }
+}
+
+static void PoSTGetPoSKernelPS(benchmark::State& state)
+{
+    const Consensus::Params& params = MainParams();
+    StakeChain& chain = PoSTChain();
+    while (state.KeepRunning()) {
+        chain.ClearMemos(1);
+        GetPoSKernelPS(chain.Tip(), params);
+    }
+}
+
+// With nothing memoized: the kernels per second of the last 60 blocks
+static void PoSTGetAverageStakeWeight(benchmark::State& state)
+{
+    const Consensus::Params& params = MainParams();
+    StakeChain& chain = PoSTChain();
+    ActiveStakeChain active;
+    LOCK(cs_main);
+    while (state.KeepRunning()) {
+        chain.ClearMemos(60);
+        assert(GetAverageStakeWeight(chain.Tip(), params) > 0);
+    }
+}
+
+// The targets of the last 100 blocks, each computed once as when connecting them
+static void PoSTGetNextTargetRequired(benchmark::State& state)
+{
+    const Consensus::Params& params = MainParams();
+    StakeChain& chain = PoSTChain();
+    while (state.KeepRunning()) {
+        chain.ClearMemos(100);
+        for (size_t i = chain.vIndex.size() - 100; i < chain.vIndex.size(); i++)
+            GetNextTargetRequired(&chain.vIndex[i], true, params);
+    }
+}
+
+static void KimotoGravityWell(benchmark::State& state)
+{
+    const Consensus::Params& params = MainParams();
+    StakeChain& chain = PoWChain();
+    CBlockHeader header;
+    while (state.KeepRunning()) {
+        chain.ClearMemos(1);
+        GetNextWorkRequired(chain.Tip(), &header, params);
+    }
+}
+
+static void PoSTGetProofOfStakeTimeReward(benchmark::State& state)
+{
+    const Consensus::Params& params = MainParams();
+    StakeChain& chain = PoSTChain();
+    while (state.KeepRunning()) {
+        for (int64_t nStakeTime = 0; nStakeTime < 1000; nStakeTime++)
+            GetProofOfStakeTimeReward(nStakeTime * 1000, CENT, chain.Tip(), params);
+    }
+}
+
+// 100 kernels of outputs of different blocks at different times, each checked on its own as in
+// CheckProofOfStake(). The blocks staked from are below LAST_POW_BLOCK, as the active chain starts
+// at genesis, so the final comparison of the hash with the target is not done.
+static void PoSTCheckStakeTimeKernelHash(benchmark::State& state)
+{
+    const Consensus::Params& params = MainParams();
+    CBlockIndex* pindexPrev = PoSTChain().Tip();
+    ActiveStakeChain active;
+    LOCK(cs_main);
+    GetAverageStakeWeight(pindexPrev, params);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100; i++) {
+            const CBlockIndex& indexFrom = active.chain.vIndex[i * 2];
+            CStakePrevoutInfo prevoutInfo;
+            prevoutInfo.nBlockTime = indexFrom.nTime;
+            prevoutInfo.nTxOffset = 81 + i * 250;
+            prevoutInfo.nTxTime = indexFrom.nTime;
+            prevoutInfo.nValue = (1000 + i) * COIN;
+            prevoutInfo.hashBlock = indexFrom.GetBlockHash();
+            unsigned int nTimeTx = indexFrom.nTime + params.nStakeMinAge + i * 3600;
+            uint256 hashProofOfStake, targetProofOfStake;
+            assert(CheckStakeTimeKernelHash(pindexPrev->nBits, prevoutInfo, COutPoint(SerializeHash(i), i % 3), nTimeTx,
+                hashProofOfStake, targetProofOfStake, pindexPrev, false, params));
+        }
+    }
+}
+
+static void PoWHash(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = CBlockHeader::LEGACY_VERSION_2;
+    header.nTime = 1514764800;
+    header.nBits = 0x1e0fffff;
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.GetPoWHash();
+    }
+}
+
+BENCHMARK(PoSTComputeNextStakeModifier);
+BENCHMARK(PoSTGetPoSKernelPS);
+BENCHMARK(PoSTGetAverageStakeWeight);
+BENCHMARK(PoSTGetNextTargetRequired);
+BENCHMARK(KimotoGravityWell);
+BENCHMARK(PoSTGetProofOfStakeTimeReward);
+BENCHMARK(PoSTCheckStakeTimeKernelHash);
+BENCHMARK(PoWHash);
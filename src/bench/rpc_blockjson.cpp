@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "arith_uint256.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "rpc/server.h"
+#include "script/standard.h"
+#include "uint256.h"
+
+#include <assert.h>
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
+
+// SolarCoin: A block of 500 transactions like the payments of the main chain, each with two
+// inputs, two pay-to-pubkey-hash outputs and a text comment; the first is the coinbase.
+static CBlock RepresentativeBlock()
+{
+    const std::vector<unsigned char> vchSig(72, 0x30);
+    const std::vector<unsigned char> vchPubKey(33, 0x02);
+
+    CBlock block;
+    for (int n = 0; n < 500; n++) {
+        CMutableTransaction tx;
+        tx.nVersion = CTransaction::CURRENT_VERSION;
+        tx.nTime = 1514764800 + n;
+        tx.vin.resize(n == 0 ? 1 : 2);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            if (n == 0) {
+                tx.vin[i].scriptSig = CScript() << 1000000 << OP_0;
+            } else {
+                tx.vin[i].prevout = COutPoint(ArithToUint256(arith_uint256(n * 2 + i)), i);
+                tx.vin[i].scriptSig = CScript() << vchSig << vchPubKey;
+            }
+        }
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            tx.vout[i].nValue = 1234567890 + n * COIN + i;
+            tx.vout[i].scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, n + i))));
+        }
+        tx.strTxComment = "text:Solar generation report, facility #" + std::to_string(n) + ", 1.21 MWh";
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+static void RpcTxToJSON(benchmark::State& state)
+{
+    const CBlock block = RepresentativeBlock();
+    while (state.KeepRunning()) {
+        UniValue txs(UniValue::VARR);
+        txs.reserve(block.vtx.size());
+        for (const auto& tx : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(*tx, uint256(), objTx);
+            txs.push_back(std::move(objTx));
+        }
+    }
+}
+
+static void RpcTxToJSONWrite(benchmark::State& state)
+{
+    const CBlock block = RepresentativeBlock();
+    while (state.KeepRunning()) {
+        UniValue txs(UniValue::VARR);
+        txs.reserve(block.vtx.size());
+        for (const auto& tx : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(*tx, uint256(), objTx);
+            txs.push_back(std::move(objTx));
+        }
+        std::string strJSON = txs.write();
+        assert(!strJSON.empty());
+    }
+}
+
+static void RpcValueFromAmount(benchmark::State& state)
+{
+    CAmount nValue = 0;
+    while (state.KeepRunning()) {
+        UniValue value = ValueFromAmount(nValue);
+        nValue += 1234567;
+    }
+}
+
+BENCHMARK(RpcTxToJSON);
+BENCHMARK(RpcTxToJSONWrite);
+BENCHMARK(RpcValueFromAmount);
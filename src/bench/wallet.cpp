@@ -0,0 +1,272 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/chainsetup.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "rpc/server.h"
+#include "script/standard.h"
+#include "support/allocators/secure.h"
+#include "sync.h"
+#include "validation.h"
+#include "wallet/db.h"
+#include "wallet/wallet.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <memory>
+#include <stdlib.h>
+#include <vector>
+
+#include <univalue.h>
+
+/*
+ * SolarCoin: Benchmarks of the wallet on large synthetic wallets, a baseline for the wallet
+ * indexes. A wallet holds BENCH_WALLET_TXS transactions (default 100000) paying WALLET_BENCH_KEYS
+ * of its keys, a quarter of them spending an earlier one, confirmed in the blocks of a regtest
+ * chain. There is an unencrypted and an encrypted one, built once for all the benchmarks. The
+ * wallets are kept in the mock database environment of the wallet tests.
+ */
+
+extern UniValue listtransactions(const JSONRPCRequest& request);
+extern UniValue listunspent(const JSONRPCRequest& request);
+
+/** Keys the synthetic transactions pay to */
+static const int WALLET_BENCH_KEYS = 1000;
+/** Blocks of the regtest chain the transactions are confirmed in */
+static const int WALLET_BENCH_BLOCKS = 100;
+static const char* const WALLET_BENCH_PASSPHRASE = "bench";
+
+static CScript ForeignScript()
+{
+    uint160 hash;
+    GetRandBytes(hash.begin(), hash.size());
+    return GetScriptForDestination(CKeyID(hash));
+}
+
+static CMutableTransaction ForeignTransaction(unsigned int nTime)
+{
+    CMutableTransaction tx;
+    tx.nTime = nTime;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = ForeignScript();
+    tx.vout[0].nValue = COIN;
+    return tx;
+}
+
+class BenchWallet
+{
+public:
+    std::unique_ptr<CWallet> pwallet;
+    //! The blocks of the transactions with as many foreign ones, for the rescan
+    std::vector<std::vector<CTransactionRef> > vBlockTxs;
+
+    BenchWallet(const std::string& strWalletFile, bool fEncrypted, int nTxs) : vBlockTxs(chainActive.Height())
+    {
+        bool fFirstRun;
+        pwallet.reset(new CWallet(strWalletFile));
+        DBErrors nLoadRet = pwallet->LoadWallet(fFirstRun);
+        assert(nLoadRet == DB_LOAD_OK);
+        pwallet->SetMinVersion(FEATURE_LATEST);
+        if (fEncrypted) {
+            bool fEncryptedOk = pwallet->EncryptWallet(WALLET_BENCH_PASSPHRASE) && pwallet->Unlock(WALLET_BENCH_PASSPHRASE);
+            assert(fEncryptedOk);
+        }
+        std::vector<CScript> vScripts;
+        for (int i = 0; i < WALLET_BENCH_KEYS; i++)
+            vScripts.push_back(GetScriptForDestination(pwallet->GenerateNewKey().GetID()));
+
+        LOCK2(cs_main, pwallet->cs_wallet);
+        for (int i = 0; i < nTxs; i++) {
+            const CBlockIndex* pindex = chainActive[1 + (int64_t)i * chainActive.Height() / nTxs];
+            std::vector<CTransactionRef>& vTxs = vBlockTxs[pindex->nHeight - 1];
+            CMutableTransaction tx = ForeignTransaction(pindex->nTime);
+            if (i % 4 == 3 && vTxs.size() >= 4)
+                tx.vin[0].prevout = COutPoint(vTxs[vTxs.size() - 4]->GetHash(), 0);
+            tx.vout.resize(2);
+            tx.vout[0].scriptPubKey = vScripts[i % vScripts.size()];
+            tx.vout[0].nValue = (1 + i % 10) * COIN;
+
+            CWalletTx wtx(pwallet.get(), MakeTransactionRef(std::move(tx)));
+            wtx.SetMerkleBranch(pindex, vTxs.size());
+            wtx.nTimeReceived = pindex->nTime;
+            bool fAdded = pwallet->AddToWallet(wtx, false);
+            assert(fAdded);
+            vTxs.push_back(wtx.tx);
+            vTxs.push_back(MakeTransactionRef(ForeignTransaction(pindex->nTime)));
+        }
+        if (fEncrypted)
+            pwallet->Lock();
+    }
+};
+
+class BenchWallets
+{
+public:
+    ChainBenchSetup chain;
+    std::unique_ptr<BenchWallet> pwalletPlain;
+    std::unique_ptr<BenchWallet> pwalletEncrypted;
+
+    BenchWallets() : chain(CBaseChainParams::REGTEST, WALLET_BENCH_BLOCKS)
+    {
+        const char* pszTxs = getenv("BENCH_WALLET_TXS");
+        const int nTxs = pszTxs ? std::max(1, atoi(pszTxs)) : 100000;
+        bitdb.MakeMock();
+        pwalletPlain.reset(new BenchWallet("bench_wallet.dat", false, nTxs));
+        pwalletEncrypted.reset(new BenchWallet("bench_wallet_encrypted.dat", true, nTxs));
+    }
+
+    ~BenchWallets()
+    {
+        pwalletPlain.reset();
+        pwalletEncrypted.reset();
+        bitdb.Flush(true);
+        bitdb.Reset();
+    }
+};
+
+/** Built by the first wallet benchmark, and kept for the others */
+static BenchWallets& Wallets()
+{
+    static BenchWallets wallets;
+    return wallets;
+}
+
+static void LoadWallet(benchmark::State& state, const BenchWallet& wallet)
+{
+    while (state.KeepRunning()) {
+        bool fFirstRun;
+        CWallet loaded(wallet.pwallet->strWalletFile);
+        DBErrors nLoadRet = loaded.LoadWallet(fFirstRun);
+        assert(nLoadRet == DB_LOAD_OK);
+    }
+}
+
+static void WalletLoad(benchmark::State& state)
+{
+    LoadWallet(state, *Wallets().pwalletPlain);
+}
+
+static void WalletLoadEncrypted(benchmark::State& state)
+{
+    LoadWallet(state, *Wallets().pwalletEncrypted);
+}
+
+// With nothing cached, as after a transaction of the wallet changed
+static void WalletGetBalance(benchmark::State& state)
+{
+    CWallet& wallet = *Wallets().pwalletPlain->pwallet;
+    while (state.KeepRunning()) {
+        wallet.MarkDirty();
+        CAmount nBalance = wallet.GetBalance();
+        assert(nBalance > 0);
+    }
+}
+
+static void WalletAvailableCoins(benchmark::State& state)
+{
+    CWallet& wallet = *Wallets().pwalletPlain->pwallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+    while (state.KeepRunning()) {
+        std::vector<COutput> vCoins;
+        wallet.AvailableCoins(vCoins);
+        assert(!vCoins.empty());
+    }
+}
+
+// Selected and signed, not committed
+static void WalletCreateTransaction(benchmark::State& state)
+{
+    CWallet& wallet = *Wallets().pwalletPlain->pwallet;
+    std::vector<CRecipient> vecSend(1, CRecipient{ForeignScript(), 50 * COIN, false});
+    LOCK2(cs_main, wallet.cs_wallet);
+    while (state.KeepRunning()) {
+        CWalletTx wtx;
+        CReserveKey reservekey(&wallet);
+        CAmount nFeeRet;
+        int nChangePosRet = -1;
+        std::string strFailReason;
+        bool success = wallet.CreateTransaction(vecSend, wtx, reservekey, nFeeRet, nChangePosRet, strFailReason);
+        assert(success);
+        reservekey.ReturnKey();
+    }
+}
+
+static void CallWalletRPC(benchmark::State& state, UniValue (*pfn)(const JSONRPCRequest&), const UniValue& params)
+{
+    JSONRPCRequest request;
+    request.params = params;
+    request.URI = "/wallet/" + Wallets().pwalletPlain->pwallet->strWalletFile;
+    while (state.KeepRunning()) {
+        UniValue result = pfn(request);
+        assert(!result.empty());
+    }
+}
+
+// The last 100 transactions, the default view of the GUI and most callers
+static void WalletListTransactions(benchmark::State& state)
+{
+    UniValue params(UniValue::VARR);
+    params.push_back("*");
+    params.push_back(100);
+    CallWalletRPC(state, &listtransactions, params);
+}
+
+static void WalletListUnspent(benchmark::State& state)
+{
+    CallWalletRPC(state, &listunspent, UniValue(UniValue::VARR));
+}
+
+// The transaction work of ScanForWalletTransactions() over the blocks of the wallet, half the
+// transactions of which are foreign. The blocks are kept in memory rather than read from disk.
+static void WalletRescan(benchmark::State& state)
+{
+    BenchWallet& wallet = *Wallets().pwalletPlain;
+    LOCK2(cs_main, wallet.pwallet->cs_wallet);
+    while (state.KeepRunning()) {
+        for (size_t nBlock = 0; nBlock < wallet.vBlockTxs.size(); nBlock++) {
+            const CBlockIndex* pindex = chainActive[nBlock + 1];
+            for (size_t nPos = 0; nPos < wallet.vBlockTxs[nBlock].size(); nPos++)
+                wallet.pwallet->AddToWalletIfInvolvingMe(*wallet.vBlockTxs[nBlock][nPos], pindex, nPos, true);
+        }
+    }
+}
+
+// A keypool of -keypool keys made and written from scratch
+static void WalletKeypoolRefill(benchmark::State& state)
+{
+    CWallet& wallet = *Wallets().pwalletPlain->pwallet;
+    while (state.KeepRunning()) {
+        bool success = wallet.NewKeyPool();
+        assert(success);
+    }
+}
+
+static void WalletUnlock(benchmark::State& state)
+{
+    CWallet& wallet = *Wallets().pwalletEncrypted->pwallet;
+    const SecureString strPassphrase(WALLET_BENCH_PASSPHRASE);
+    while (state.KeepRunning()) {
+        bool success = wallet.Unlock(strPassphrase);
+        assert(success);
+        wallet.Lock();
+    }
+}
+
+BENCHMARK(WalletLoad);
+BENCHMARK(WalletLoadEncrypted);
+BENCHMARK(WalletGetBalance);
+BENCHMARK(WalletAvailableCoins);
+BENCHMARK(WalletCreateTransaction);
+BENCHMARK(WalletListTransactions);
+BENCHMARK(WalletListUnspent);
+BENCHMARK(WalletRescan);
+BENCHMARK(WalletKeypoolRefill);
+BENCHMARK(WalletUnlock);
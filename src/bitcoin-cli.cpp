@@ -14,9 +14,13 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
-#include <boost/filesystem/operations.hpp>
+#include <deque>
+#include <memory>
 #include <stdio.h>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/operations.hpp>
+
 #include <event2/buffer.h>
 #include <event2/keyvalq_struct.h>
 #include "support/events.h"
@@ -27,6 +31,10 @@ static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
 static const bool DEFAULT_NAMED=false;
 static const int CONTINUE_EXECUTION=-1;
+//! -rpcbatchsize default: commands per JSON-RPC batch of -stdin-batch
+static const int DEFAULT_RPC_BATCH_SIZE = 100;
+//! -rpcconcurrency default: connections -stdin-batch keeps a batch in flight on
+static const int DEFAULT_RPC_CONCURRENCY = 4;
 
 std::string HelpMessageCli()
 {
@@ -42,8 +50,13 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcwait", _("Wait for RPC server to start"));
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
+    strUsage += HelpMessageOpt("-rpcwallet=<walletname>", _("Send RPC for non-default wallet on RPC server (argument is wallet filename in the data directory, required if the server runs with multiple wallets)"));
     strUsage += HelpMessageOpt("-rpcclienttimeout=<n>", strprintf(_("Timeout during HTTP requests (default: %d)"), DEFAULT_HTTP_CLIENT_TIMEOUT));
     strUsage += HelpMessageOpt("-stdin", _("Read extra arguments from standard input, one per line until EOF/Ctrl-D (recommended for sensitive information such as passphrases)"));
+    strUsage += HelpMessageOpt("-stdin-batch", _("Read a command per line from standard input, as whitespace separated arguments or a JSON array, and send them in JSON-RPC batches over keep-alive connections. "
+        "The result of each command is written on one line, in input order, as the result string or single line JSON, or \"error: \" and the error (-rpcwait is not supported)"));
+    strUsage += HelpMessageOpt("-rpcbatchsize=<n>", strprintf(_("Commands per JSON-RPC batch with -stdin-batch (default: %d)"), DEFAULT_RPC_BATCH_SIZE));
+    strUsage += HelpMessageOpt("-rpcconcurrency=<n>", strprintf(_("Connections with a batch in flight with -stdin-batch (default: %d)"), DEFAULT_RPC_CONCURRENCY));
 
     return strUsage;
 }
@@ -83,6 +96,7 @@ static int AppInitRPC(int argc, char* argv[])
             strUsage += "\n" + _("Usage:") + "\n" +
                   "  solarcoin-cli [options] <command> [params]  " + strprintf(_("Send command to %s"), _(PACKAGE_NAME)) + "\n" +
                   "  solarcoin-cli [options] -named <command> [name=value] ... " + strprintf(_("Send command to %s (with named arguments)"), _(PACKAGE_NAME)) + "\n" +
+                  "  solarcoin-cli [options] -stdin-batch        " + _("Send the commands read from standard input") + "\n" +
                   "  solarcoin-cli [options] help                " + _("List commands") + "\n" +
                   "  solarcoin-cli [options] help <command>      " + _("Get help for a command") + "\n";
 
@@ -187,6 +201,43 @@ static void http_error_cb(enum evhttp_request_error err, void *ctx)
 }
 #endif
 
+/** The user:password to authenticate with, from -rpcuser/-rpcpassword or the cookie file */
+static std::string GetRPCUserColonPass()
+{
+    std::string strRPCUserColonPass;
+    if (GetArg("-rpcpassword", "") == "") {
+        // Try fall back to cookie-based authentication if no password is provided
+        if (!GetAuthCookie(&strRPCUserColonPass)) {
+            throw std::runtime_error(strprintf(
+                _("Could not locate RPC credentials. No authentication cookie could be found, and no rpcpassword is set in the configuration file (%s)"),
+                    GetConfigFile(GetArg("-conf", BITCOIN_CONF_FILENAME)).string().c_str()));
+
+        }
+    } else {
+        strRPCUserColonPass = GetArg("-rpcuser", "") + ":" + GetArg("-rpcpassword", "");
+    }
+    return strRPCUserColonPass;
+}
+
+/** The endpoint to post to: the wallet endpoint of -rpcwallet, or / */
+static std::string GetRPCEndpoint()
+{
+    // check if we should use a special wallet endpoint
+    std::string endpoint = "/";
+    std::string walletName = GetArg("-rpcwallet", "");
+    if (!walletName.empty()) {
+        char *encodedURI = evhttp_uriencode(walletName.c_str(), walletName.size(), false);
+        if (encodedURI) {
+            endpoint = "/wallet/"+ std::string(encodedURI);
+            free(encodedURI);
+        }
+        else {
+            throw CConnectionFailed("uri-encode failed");
+        }
+    }
+    return endpoint;
+}
+
 UniValue CallRPC(const std::string& strMethod, const UniValue& params)
 {
     std::string host = GetArg("-rpcconnect", DEFAULT_RPCCONNECT);
@@ -208,18 +259,7 @@ UniValue CallRPC(const std::string& strMethod, const UniValue& params)
 #endif
 
     // Get credentials
-    std::string strRPCUserColonPass;
-    if (GetArg("-rpcpassword", "") == "") {
-        // Try fall back to cookie-based authentication if no password is provided
-        if (!GetAuthCookie(&strRPCUserColonPass)) {
-            throw std::runtime_error(strprintf(
-                _("Could not locate RPC credentials. No authentication cookie could be found, and no rpcpassword is set in the configuration file (%s)"),
-                    GetConfigFile(GetArg("-conf", BITCOIN_CONF_FILENAME)).string().c_str()));
-
-        }
-    } else {
-        strRPCUserColonPass = GetArg("-rpcuser", "") + ":" + GetArg("-rpcpassword", "");
-    }
+    std::string strRPCUserColonPass = GetRPCUserColonPass();
 
     struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
     assert(output_headers);
@@ -233,7 +273,8 @@ UniValue CallRPC(const std::string& strMethod, const UniValue& params)
     assert(output_buffer);
     evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
 
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, "/");
+    std::string endpoint = GetRPCEndpoint();
+    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
     req.release(); // ownership moved to evcon in above call
     if (r != 0) {
         throw CConnectionFailed("send http request failed");
@@ -261,6 +302,244 @@ UniValue CallRPC(const std::string& strMethod, const UniValue& params)
     return reply;
 }
 
+/**
+ * SolarCoin: -stdin-batch client. Commands read from standard input are sent in JSON-RPC batches of
+ * -rpcbatchsize over -rpcconcurrency keep-alive connections, each with one batch in flight and
+ * the next one read and sent as soon as its reply arrives. Results are written in input order
+ * as their batches complete. Everything runs on the libevent loop of this thread.
+ */
+class CBatchRPCClient
+{
+private:
+    /** A batch of commands and the output lines of its commands */
+    struct Batch
+    {
+        CBatchRPCClient* pclient;
+        size_t nConnection;
+        std::vector<std::string> vOutput; //!< per command, set when its reply (or argument error) is known
+        std::vector<size_t> vSent;        //!< vOutput index of each command sent, by request id
+        HTTPReply reply;
+        bool fDone;
+
+        Batch(CBatchRPCClient* pclientIn, size_t nConnectionIn) : pclient(pclientIn), nConnection(nConnectionIn), fDone(false) {}
+    };
+
+    raii_event_base base;
+    std::vector<raii_evhttp_connection> vConnections;
+    const std::string host;
+    const std::string strAuthorization;
+    const std::string endpoint;
+    const size_t nBatchSize;
+    const bool fNamed;
+    std::deque<std::unique_ptr<Batch> > queue; //!< batches not written yet, in input order
+    int nInFlight;
+    bool fFailed; //!< a connection failed, no more batches are sent
+    int nRet;
+
+    /** Split a command line into the method and its arguments */
+    static std::vector<std::string> SplitCommand(const std::string& strLine)
+    {
+        std::vector<std::string> args;
+        if (strLine[0] == '[') {
+            UniValue val;
+            if (!val.read(strLine) || !val.isArray())
+                throw std::runtime_error("command is not a JSON array");
+            for (size_t i = 0; i < val.size(); i++)
+                args.push_back(val[i].isStr() ? val[i].get_str() : val[i].write());
+        } else {
+            boost::split(args, strLine, boost::is_any_of(" \t"), boost::token_compress_on);
+        }
+        if (args.empty() || args[0].empty())
+            throw std::runtime_error("too few parameters (need at least command)");
+        return args;
+    }
+
+    /** The output line of one reply of a batch */
+    std::string FormatReply(const UniValue& reply)
+    {
+        const UniValue& result = find_value(reply, "result");
+        const UniValue& error = find_value(reply, "error");
+        if (!error.isNull()) {
+            nRet = EXIT_FAILURE;
+            return "error: " + error.write();
+        }
+        if (result.isNull())
+            return "";
+        if (result.isStr())
+            return result.get_str();
+        return result.write();
+    }
+
+    /** Fill in the output of a batch from its reply */
+    void ProcessReply(Batch& batch)
+    {
+        const HTTPReply& response = batch.reply;
+        std::string strError;
+        if (response.status == 0)
+            strError = strprintf("couldn't connect to server: %s (code %d)", http_errorstring(response.error), response.error);
+        else if (response.status == HTTP_UNAUTHORIZED)
+            strError = "incorrect rpcuser or rpcpassword (authorization failed)";
+        else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
+            strError = strprintf("server returned HTTP error %d", response.status);
+        if (!strError.empty()) {
+            fFailed = true;
+            nRet = EXIT_FAILURE;
+            for (size_t n : batch.vSent)
+                batch.vOutput[n] = "error: " + strError;
+            return;
+        }
+
+        UniValue valReply;
+        if (!valReply.read(response.body) || !valReply.isArray()) {
+            nRet = EXIT_FAILURE;
+            std::string strBody = response.body;
+            boost::algorithm::trim(strBody);
+            for (size_t n : batch.vSent)
+                batch.vOutput[n] = "error: " + (strBody.empty() ? std::string("no response from server") : strBody);
+            return;
+        }
+        std::vector<bool> vReplied(batch.vSent.size(), false);
+        for (size_t i = 0; i < valReply.size(); i++) {
+            const UniValue& id = find_value(valReply[i], "id");
+            if (!id.isNum() || id.get_int() < 0 || (size_t)id.get_int() >= batch.vSent.size())
+                continue;
+            batch.vOutput[batch.vSent[id.get_int()]] = FormatReply(valReply[i]);
+            vReplied[id.get_int()] = true;
+        }
+        for (size_t i = 0; i < vReplied.size(); i++) {
+            if (!vReplied[i]) {
+                nRet = EXIT_FAILURE;
+                batch.vOutput[batch.vSent[i]] = "error: no reply from server";
+            }
+        }
+    }
+
+    /** Write the output of the completed batches at the front of the queue */
+    void Flush()
+    {
+        while (!queue.empty() && queue.front()->fDone) {
+            for (const std::string& strOutput : queue.front()->vOutput)
+                fprintf(stdout, "%s\n", strOutput.c_str());
+            queue.pop_front();
+        }
+        fflush(stdout);
+    }
+
+    /** Read the next batch from standard input and send it on a connection. Returns false once the input is exhausted. */
+    bool SendNext(size_t nConnection)
+    {
+        while (!fFailed) {
+            std::unique_ptr<Batch> batch(new Batch(this, nConnection));
+            UniValue requests(UniValue::VARR);
+            std::string strLine;
+            while (batch->vOutput.size() < nBatchSize && std::getline(std::cin, strLine)) {
+                boost::algorithm::trim(strLine);
+                if (strLine.empty())
+                    continue;
+                batch->vOutput.push_back("");
+                try {
+                    std::vector<std::string> args = SplitCommand(strLine);
+                    std::string strMethod = args[0];
+                    args.erase(args.begin());
+                    UniValue params = fNamed ? RPCConvertNamedValues(strMethod, args) : RPCConvertValues(strMethod, args);
+                    requests.push_back(JSONRPCRequestObj(strMethod, params, (int)batch->vSent.size()));
+                    batch->vSent.push_back(batch->vOutput.size() - 1);
+                } catch (const std::exception& e) {
+                    nRet = EXIT_FAILURE;
+                    batch->vOutput.back() = std::string("error: ") + e.what();
+                }
+            }
+            if (batch->vOutput.empty())
+                return false;
+            if (requests.empty()) {
+                // Only argument errors, nothing to send
+                batch->fDone = true;
+                queue.push_back(std::move(batch));
+                Flush();
+                continue;
+            }
+
+            raii_evhttp_request req = obtain_evhttp_request(&CBatchRPCClient::RequestDone, (void*)batch.get());
+            if (req == NULL)
+                throw std::runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+            evhttp_request_set_error_cb(req.get(), &CBatchRPCClient::RequestError);
+#endif
+            struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+            assert(output_headers);
+            evhttp_add_header(output_headers, "Host", host.c_str());
+            evhttp_add_header(output_headers, "Authorization", strAuthorization.c_str());
+            std::string strRequest = requests.write() + "\n";
+            struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+            assert(output_buffer);
+            evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+            int r = evhttp_make_request(vConnections[nConnection].get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
+            req.release(); // ownership moved to the connection in above call
+            if (r != 0)
+                throw CConnectionFailed("send http request failed");
+            nInFlight++;
+            queue.push_back(std::move(batch));
+            return true;
+        }
+        return false;
+    }
+
+    static void RequestDone(struct evhttp_request *req, void *ctx)
+    {
+        Batch* batch = static_cast<Batch*>(ctx);
+        CBatchRPCClient* client = batch->pclient;
+        size_t nConnection = batch->nConnection;
+        http_request_done(req, &batch->reply);
+        client->nInFlight--;
+        client->ProcessReply(*batch);
+        batch->fDone = true;
+        client->Flush(); // may free batch
+        if (!client->SendNext(nConnection) && client->nInFlight == 0)
+            event_base_loopbreak(client->base.get());
+    }
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+    static void RequestError(enum evhttp_request_error err, void *ctx)
+    {
+        static_cast<Batch*>(ctx)->reply.error = err;
+    }
+#endif
+
+public:
+    CBatchRPCClient() :
+        base(obtain_event_base()),
+        host(GetArg("-rpcconnect", DEFAULT_RPCCONNECT)),
+        strAuthorization(std::string("Basic ") + EncodeBase64(GetRPCUserColonPass())),
+        endpoint(GetRPCEndpoint()),
+        nBatchSize(std::max<int64_t>(1, GetArg("-rpcbatchsize", DEFAULT_RPC_BATCH_SIZE))),
+        fNamed(GetBoolArg("-named", DEFAULT_NAMED)),
+        nInFlight(0), fFailed(false), nRet(0)
+    {
+        int port = GetArg("-rpcport", BaseParams().RPCPort());
+        int nConnections = std::max<int64_t>(1, GetArg("-rpcconcurrency", DEFAULT_RPC_CONCURRENCY));
+        for (int i = 0; i < nConnections; i++) {
+            vConnections.push_back(obtain_evhttp_connection_base(base.get(), host, port));
+            evhttp_connection_set_timeout(vConnections.back().get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+        }
+    }
+
+    /** Send all commands of standard input and write their results. Returns the exit code. */
+    int Run()
+    {
+        for (size_t i = 0; i < vConnections.size(); i++) {
+            if (!SendNext(i))
+                break;
+        }
+        if (nInFlight > 0)
+            event_base_dispatch(base.get());
+        Flush();
+        if (fFailed)
+            fprintf(stderr, "error: request failed, the remaining commands were not sent\n");
+        return nRet;
+    }
+};
+
 int CommandLineRPC(int argc, char *argv[])
 {
     std::string strPrint;
@@ -272,6 +551,11 @@ int CommandLineRPC(int argc, char *argv[])
             argv++;
         }
         std::vector<std::string> args = std::vector<std::string>(&argv[1], &argv[argc]);
+        if (GetBoolArg("-stdin-batch", false)) {
+            if (!args.empty())
+                throw std::runtime_error("-stdin-batch reads the commands from standard input only");
+            return CBatchRPCClient().Run();
+        }
         if (GetBoolArg("-stdin", false)) {
             // Read one arg per line from stdin and append
             std::string line;
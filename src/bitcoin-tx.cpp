@@ -21,15 +21,24 @@
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 
+#include <iostream>
+#include <memory>
 #include <stdio.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 static bool fCreateBlank;
 static std::map<std::string,UniValue> registers;
 static const int CONTINUE_EXECUTION=-1;
 
+//! Most threads -batch builds and signs transactions on
+static const int MAX_BATCH_THREADS = 16;
+//! Lines of -batch input read, processed and written at a time
+static const size_t BATCH_CHUNK_LINES = 1024;
+
 //
 // This function returns either one of EXIT_ codes when it's expected to stop the process or
 // CONTINUE_EXECUTION when it's expected to continue further.
@@ -58,12 +67,17 @@ static int AppInitRawTx(int argc, char* argv[])
             _("Usage:") + "\n" +
               "  solarcoin-tx [options] <hex-tx> [commands]  " + _("Update hex-encoded solarcoin transaction") + "\n" +
               "  solarcoin-tx [options] -create [commands]   " + _("Create hex-encoded solarcoin transaction") + "\n" +
+              "  solarcoin-tx [options] -batch [register commands]  " + _("Create a solarcoin transaction for each line of standard input") + "\n" +
               "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
 
         strUsage = HelpMessageGroup(_("Options:"));
         strUsage += HelpMessageOpt("-?", _("This help message"));
+        strUsage += HelpMessageOpt("-batch", _("Read a JSON object per line from standard input and write the resulting TX of each on a line of standard output, or \"error: \" and the reason. "
+            "\"hex\" is the TX to update (default: a new, empty TX), \"commands\" an array of the commands below other than the register commands, "
+            "and \"registers\" an object overriding registers for that line. The keys and previous outputs of the registers set on the command line are parsed once for all lines."));
+        strUsage += HelpMessageOpt("-batchthreads=<n>", strprintf(_("Number of threads -batch builds and signs transactions on (default: %d, one per core up to %d)"), 0, MAX_BATCH_THREADS));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
         strUsage += HelpMessageOpt("-txid", _("Output only the hex-encoded transaction id of the resultant transaction."));
@@ -517,28 +531,18 @@ static CAmount AmountFromValue(const UniValue& value)
     return amount;
 }
 
-static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
+/** Keys, scripts and previous outputs the sign command uses, from the privatekeys and prevtxs registers */
+struct CSignData
 {
-    int nHashType = SIGHASH_ALL;
-
-    if (flagStr.size() > 0)
-        if (!findSighashFlags(nHashType, flagStr))
-            throw std::runtime_error("unknown sighash flag/sign option");
-
-    std::vector<CTransaction> txVariants;
-    txVariants.push_back(tx);
-
-    // mergedTx will end up with all the signatures; it
-    // starts as a clone of the raw tx:
-    CMutableTransaction mergedTx(txVariants[0]);
-    bool fComplete = true;
-    CCoinsView viewDummy;
-    CCoinsViewCache view(&viewDummy);
+    CBasicKeyStore keystore;
+    std::map<COutPoint, Coin> mapPrevOuts;
+};
 
-    if (!registers.count("privatekeys"))
+static void ParseSignData(const std::map<std::string,UniValue>& regs, CSignData& signdata)
+{
+    if (!regs.count("privatekeys"))
         throw std::runtime_error("privatekeys register variable must be set.");
-    CBasicKeyStore tempKeystore;
-    UniValue keysObj = registers["privatekeys"];
+    const UniValue& keysObj = regs.at("privatekeys");
 
     for (unsigned int kidx = 0; kidx < keysObj.size(); kidx++) {
         if (!keysObj[kidx].isStr())
@@ -549,13 +553,13 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
             throw std::runtime_error("privatekey not valid");
 
         CKey key = vchSecret.GetKey();
-        tempKeystore.AddKey(key);
+        signdata.keystore.AddKey(key);
     }
 
     // Add previous txouts given in the RPC call:
-    if (!registers.count("prevtxs"))
+    if (!regs.count("prevtxs"))
         throw std::runtime_error("prevtxs register variable must be set.");
-    UniValue prevtxsObj = registers["prevtxs"];
+    const UniValue& prevtxsObj = regs.at("prevtxs");
     {
         for (unsigned int previdx = 0; previdx < prevtxsObj.size(); previdx++) {
             UniValue prevOut = prevtxsObj[previdx];
@@ -572,52 +576,77 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
             if (nOut < 0)
                 throw std::runtime_error("vout must be positive");
 
+            COutPoint out(txid, nOut);
             std::vector<unsigned char> pkData(ParseHexUV(prevOut["scriptPubKey"], "scriptPubKey"));
             CScript scriptPubKey(pkData.begin(), pkData.end());
 
             {
-                CCoinsModifier coins = view.ModifyCoins(txid);
-                if (coins->IsAvailable(nOut) && coins->vout[nOut].scriptPubKey != scriptPubKey) {
+                std::map<COutPoint, Coin>::const_iterator it = signdata.mapPrevOuts.find(out);
+                if (it != signdata.mapPrevOuts.end() && it->second.out.scriptPubKey != scriptPubKey) {
                     std::string err("Previous output scriptPubKey mismatch:\n");
-                    err = err + ScriptToAsmStr(coins->vout[nOut].scriptPubKey) + "\nvs:\n"+
+                    err = err + ScriptToAsmStr(it->second.out.scriptPubKey) + "\nvs:\n"+
                         ScriptToAsmStr(scriptPubKey);
                     throw std::runtime_error(err);
                 }
-                if ((unsigned int)nOut >= coins->vout.size())
-                    coins->vout.resize(nOut+1);
-                coins->vout[nOut].scriptPubKey = scriptPubKey;
-                coins->vout[nOut].nValue = 0;
+                Coin newcoin;
+                newcoin.out.scriptPubKey = scriptPubKey;
+                newcoin.out.nValue = 0;
                 if (prevOut.exists("amount")) {
-                    coins->vout[nOut].nValue = AmountFromValue(prevOut["amount"]);
+                    newcoin.out.nValue = AmountFromValue(prevOut["amount"]);
                 }
+                newcoin.nHeight = 1;
+                signdata.mapPrevOuts[out] = std::move(newcoin);
             }
 
             // if redeemScript given and private keys given,
-            // add redeemScript to the tempKeystore so it can be signed:
+            // add redeemScript to the keystore so it can be signed:
             if ((scriptPubKey.IsPayToScriptHash() || scriptPubKey.IsPayToWitnessScriptHash()) &&
                 prevOut.exists("redeemScript")) {
                 UniValue v = prevOut["redeemScript"];
                 std::vector<unsigned char> rsData(ParseHexUV(v, "redeemScript"));
                 CScript redeemScript(rsData.begin(), rsData.end());
-                tempKeystore.AddCScript(redeemScript);
+                signdata.keystore.AddCScript(redeemScript);
             }
         }
     }
+}
+
+static int ParseSighashFlags(const std::string& flagStr)
+{
+    int nHashType = SIGHASH_ALL;
+
+    if (flagStr.size() > 0)
+        if (!findSighashFlags(nHashType, flagStr))
+            throw std::runtime_error("unknown sighash flag/sign option");
+    return nHashType;
+}
 
-    const CKeyStore& keystore = tempKeystore;
+/** Sign what we can of tx. Only reads signdata, so several threads may sign with the same one. */
+static void SignTx(CMutableTransaction& tx, int nHashType, const CSignData& signdata)
+{
+    std::vector<CTransaction> txVariants;
+    txVariants.push_back(tx);
+
+    // mergedTx will end up with all the signatures; it
+    // starts as a clone of the raw tx:
+    CMutableTransaction mergedTx(txVariants[0]);
+    bool fComplete = true;
+
+    const CKeyStore& keystore = signdata.keystore;
 
     bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
 
     // Sign what we can:
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
         CTxIn& txin = mergedTx.vin[i];
-        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-        if (!coins || !coins->IsAvailable(txin.prevout.n)) {
+        std::map<COutPoint, Coin>::const_iterator it = signdata.mapPrevOuts.find(txin.prevout);
+        if (it == signdata.mapPrevOuts.end()) {
             fComplete = false;
             continue;
         }
-        const CScript& prevPubKey = coins->vout[txin.prevout.n].scriptPubKey;
-        const CAmount& amount = coins->vout[txin.prevout.n].nValue;
+        const Coin& coin = it->second;
+        const CScript& prevPubKey = coin.out.scriptPubKey;
+        const CAmount& amount = coin.out.nValue;
 
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
@@ -641,6 +670,14 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
     tx = mergedTx;
 }
 
+static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
+{
+    int nHashType = ParseSighashFlags(flagStr);
+    CSignData signdata;
+    ParseSignData(registers, signdata);
+    SignTx(tx, nHashType, signdata);
+}
+
 class Secp256k1Init
 {
     ECCVerifyHandle globalVerifyHandle;
@@ -730,6 +767,151 @@ static void OutputTx(const CTransaction& tx)
         OutputTxHex(tx);
 }
 
+/** A transaction of a -batch input line as output: hex, txid or single line JSON */
+static std::string FormatBatchTx(const CTransaction& tx)
+{
+    if (GetBoolArg("-json", false)) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(tx, uint256(), entry);
+        return entry.write();
+    } else if (GetBoolArg("-txid", false)) {
+        return tx.GetHash().GetHex();
+    }
+    return EncodeHexTx(tx);
+}
+
+/**
+ * Build the transaction of one -batch input line. psignShared holds the keys and previous outputs
+ * of the command line registers, if they were set; a line with its own registers parses its own.
+ */
+static std::string ProcessBatchLine(const std::string& strLine, const CSignData* psignShared)
+{
+    UniValue spec;
+    if (!spec.read(strLine) || !spec.isObject())
+        throw std::runtime_error("line is not a JSON object");
+
+    CMutableTransaction tx;
+    const UniValue& hex = find_value(spec, "hex");
+    if (!hex.isNull()) {
+        if (!hex.isStr() || !DecodeHexTx(tx, hex.get_str(), true))
+            throw std::runtime_error("invalid transaction encoding");
+    }
+
+    std::map<std::string,UniValue> regsLine;
+    const UniValue& regs = find_value(spec, "registers");
+    if (!regs.isNull()) {
+        if (!regs.isObject())
+            throw std::runtime_error("registers is not a JSON object");
+        regsLine = registers;
+        for (const std::string& key : regs.getKeys())
+            regsLine[key] = regs[key];
+    }
+    std::unique_ptr<CSignData> psignLine;
+
+    const UniValue& commands = find_value(spec, "commands");
+    if (!commands.isNull() && !commands.isArray())
+        throw std::runtime_error("commands is not a JSON array");
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (!commands[i].isStr())
+            throw std::runtime_error("command is not a string");
+        const std::string& arg = commands[i].get_str();
+        std::string key, value;
+        size_t eqpos = arg.find('=');
+        if (eqpos == std::string::npos)
+            key = arg;
+        else {
+            key = arg.substr(0, eqpos);
+            value = arg.substr(eqpos + 1);
+        }
+
+        if (key == "sign") {
+            int nHashType = ParseSighashFlags(value);
+            const CSignData* psigndata = psignShared;
+            if (!regs.isNull() || !psignShared) {
+                if (!psignLine) {
+                    psignLine.reset(new CSignData());
+                    ParseSignData(regs.isNull() ? registers : regsLine, *psignLine);
+                }
+                psigndata = psignLine.get();
+            }
+            SignTx(tx, nHashType, *psigndata);
+        } else if (key == "load" || key == "set") {
+            throw std::runtime_error("register commands are not allowed in a batch line, use its registers object");
+        } else {
+            MutateTx(tx, key, value);
+        }
+    }
+    return FormatBatchTx(tx);
+}
+
+/**
+ * SolarCoin: Build a transaction for each line of standard input, BATCH_CHUNK_LINES lines at a
+ * time split across threads, writing them in input order. The ECC contexts are started once
+ * and the keys of the command line registers parsed once for the whole batch.
+ */
+static int BatchRawTx()
+{
+    Secp256k1Init ecc;
+
+    std::unique_ptr<CSignData> psignShared;
+    if (registers.count("privatekeys") && registers.count("prevtxs")) {
+        psignShared.reset(new CSignData());
+        ParseSignData(registers, *psignShared);
+    }
+
+    int nThreads = GetArg("-batchthreads", 0);
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    nThreads = std::max(1, std::min(nThreads, MAX_BATCH_THREADS));
+
+    bool fFailed = false;
+    std::vector<std::string> vLines;
+    std::vector<std::string> vResults;
+    std::vector<char> vFailed;
+    std::string strLine;
+    while (std::cin) {
+        vLines.clear();
+        while (vLines.size() < BATCH_CHUNK_LINES && std::getline(std::cin, strLine)) {
+            boost::algorithm::trim(strLine);
+            if (!strLine.empty())
+                vLines.push_back(strLine);
+        }
+        if (vLines.empty())
+            break;
+
+        vResults.assign(vLines.size(), std::string());
+        vFailed.assign(vLines.size(), 0);
+        auto processRange = [&](size_t nBegin, size_t nEnd) {
+            for (size_t i = nBegin; i < nEnd; i++) {
+                try {
+                    vResults[i] = ProcessBatchLine(vLines[i], psignShared.get());
+                } catch (const std::exception& e) {
+                    vResults[i] = std::string("error: ") + e.what();
+                    vFailed[i] = 1;
+                }
+            }
+        };
+        if (nThreads == 1 || vLines.size() < 2) {
+            processRange(0, vLines.size());
+        } else {
+            boost::thread_group threadGroup;
+            const size_t nChunk = (vLines.size() + nThreads - 1) / nThreads;
+            for (size_t nBegin = 0; nBegin < vLines.size(); nBegin += nChunk)
+                threadGroup.create_thread(boost::bind<void>(processRange, nBegin, std::min(nBegin + nChunk, vLines.size())));
+            threadGroup.join_all();
+        }
+
+        for (size_t i = 0; i < vResults.size(); i++) {
+            fprintf(stdout, "%s\n", vResults[i].c_str());
+            fFailed |= vFailed[i] != 0;
+        }
+        fflush(stdout);
+    }
+    if (std::cin.bad())
+        throw std::runtime_error("error reading stdin");
+    return fFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 static std::string readStdin()
 {
     char buf[4096];
@@ -762,6 +944,23 @@ static int CommandLineRawTx(int argc, char* argv[])
             argv++;
         }
 
+        // -batch: the remaining arguments set the registers shared by all lines
+        if (GetBoolArg("-batch", false)) {
+            for (int i = 1; i < argc; i++) {
+                std::string arg = argv[i];
+                size_t eqpos = arg.find('=');
+                std::string key = arg.substr(0, eqpos);
+                std::string value = eqpos == std::string::npos ? "" : arg.substr(eqpos + 1);
+                if (key == "load")
+                    RegisterLoad(value);
+                else if (key == "set")
+                    RegisterSet(value);
+                else
+                    throw std::runtime_error("only register commands are allowed with -batch");
+            }
+            return BatchRawTx();
+        }
+
         CMutableTransaction tx;
         int startArg;
 
@@ -19,21 +19,28 @@
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+        header(block), vchBlockSig(block.vchBlockSig) {
     FillShortTxIDSelector();
     //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
-    prefilledtxn[0] = {0, block.vtx[0]};
-    for (size_t i = 1; i < block.vtx.size(); i++) {
+    // SolarCoin: The coinstake of a PoST block is never in a mempool either, so it is prefilled too
+    size_t nPrefilled = block.IsProofOfStake() ? 2 : 1;
+    prefilledtxn.resize(nPrefilled);
+    shorttxids.resize(block.vtx.size() - nPrefilled);
+    for (size_t i = 0; i < nPrefilled; i++)
+        prefilledtxn[i] = {0, block.vtx[i]};
+    for (size_t i = nPrefilled; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        shorttxids[i - nPrefilled] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
     }
 }
 
 void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    // SolarCoin: The header and nonce serialized on the stack
+    unsigned char buf[128];
+    CSpanWriter stream(SER_NETWORK, PROTOCOL_VERSION, buf, buf + sizeof(buf));
     stream << header << nonce;
     CSHA256 hasher;
-    hasher.Write((unsigned char*)&(*stream.begin()), stream.end() - stream.begin());
+    hasher.Write(stream.data(), stream.size());
     uint256 shorttxidhash;
     hasher.Finalize(shorttxidhash.begin());
     shorttxidk0 = shorttxidhash.GetUint64(0);
@@ -55,6 +62,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
 
     assert(header.IsNull() && txn_available.empty());
     header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
     txn_available.resize(cmpctblock.BlockTxCount());
 
     int32_t lastprefilledindex = -1;
@@ -179,6 +187,7 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
     assert(!header.IsNull());
     uint256 hash = header.GetHash();
     block = header;
+    block.vchBlockSig = std::move(vchBlockSig);
     block.vtx.resize(txn_available.size());
 
     size_t tx_missing_offset = 0;
@@ -193,6 +202,7 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
 
     // Make sure we can't call FillBlock again.
     header.SetNull();
+    vchBlockSig.clear();
     txn_available.clear();
 
     if (vtx_missing.size() != tx_missing_offset)
@@ -144,6 +144,8 @@ protected:
 
 public:
     CBlockHeader header;
+    // SolarCoin: The signature of a PoST block, which is not part of the header
+    std::vector<unsigned char> vchBlockSig;
 
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
@@ -185,6 +187,8 @@ public:
         }
 
         READWRITE(prefilledtxn);
+        if (header.nVersion >= CBlockHeader::LEGACY_VERSION_3)
+            READWRITE(vchBlockSig);
 
         if (ser_action.ForRead())
             FillShortTxIDSelector();
@@ -194,6 +198,7 @@ public:
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
+    std::vector<unsigned char> vchBlockSig;
     size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
     CTxMemPool* pool;
 public:
@@ -0,0 +1,148 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "blockfilemap.h"
+
+#include "chain.h"
+#include "crypto/common.h"
+#include "protocol.h"
+#include "util.h"
+#include "validation.h"
+
+#include <list>
+#include <mutex>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+size_t nBlockFileMapBudget = DEFAULT_BLOCKFILE_MMAP * 1024 * 1024;
+
+namespace {
+
+/** The message start and size that precede each record, see WriteBlockToDisk() */
+static const size_t RECORD_HEADER_SIZE = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+
+struct CMappedFile
+{
+    bool fUndo;
+    int nFile;
+    size_t nSize;
+    std::shared_ptr<const void> mapping;
+};
+
+std::mutex cs_mappedFiles;
+//! The mapped files, the most recently used first (protected by cs_mappedFiles)
+std::list<CMappedFile> listMappedFiles;
+size_t nMappedBytes = 0;
+
+#ifndef WIN32
+bool MapFile(const CDiskBlockPos& pos, bool fUndo, CMappedFile& mapped)
+{
+    boost::filesystem::path path = GetBlockPosFilename(pos, fUndo ? "rev" : "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > nBlockFileMapBudget) {
+        close(fd);
+        return false;
+    }
+    size_t nSize = st.st_size;
+    void* p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrint("blockfilemap", "%s: mmap of %s failed\n", __func__, path.string());
+        return false;
+    }
+    // Records are read one at a time, from anywhere in the file
+    madvise(p, nSize, MADV_RANDOM);
+
+    mapped.fUndo = fUndo;
+    mapped.nFile = pos.nFile;
+    mapped.nSize = nSize;
+    mapped.mapping = std::shared_ptr<const void>(p, [nSize](const void* q) { munmap(const_cast<void*>(q), nSize); });
+    return true;
+}
+#endif
+
+void Unmap(std::list<CMappedFile>::iterator it)
+{
+    nMappedBytes -= it->nSize;
+    listMappedFiles.erase(it);
+}
+
+} // anon namespace
+
+bool MapBlockFileRecord(const CDiskBlockPos& pos, bool fUndo, size_t nTrailerSize, CMappedRecord& record)
+{
+#ifdef WIN32
+    return false;
+#else
+    if (nBlockFileMapBudget == 0 || pos.IsNull() || pos.nPos < RECORD_HEADER_SIZE)
+        return false;
+
+    std::lock_guard<std::mutex> lock(cs_mappedFiles);
+    while (true) {
+        std::list<CMappedFile>::iterator it = listMappedFiles.begin();
+        while (it != listMappedFiles.end() && (it->fUndo != fUndo || it->nFile != pos.nFile))
+            ++it;
+        bool fMapped = it == listMappedFiles.end();
+        if (fMapped) {
+            CMappedFile mapped;
+            if (!MapFile(pos, fUndo, mapped))
+                return false;
+            nMappedBytes += mapped.nSize;
+            listMappedFiles.push_front(mapped);
+            // Unmap the least recently used files beyond the budget; readers still holding a
+            // record keep their mapping until they are done
+            while (nMappedBytes > nBlockFileMapBudget && listMappedFiles.size() > 1)
+                Unmap(std::prev(listMappedFiles.end()));
+        } else {
+            listMappedFiles.splice(listMappedFiles.begin(), listMappedFiles, it);
+        }
+        const CMappedFile& mapped = listMappedFiles.front();
+
+        if (pos.nPos <= mapped.nSize) {
+            const unsigned char* pdata = static_cast<const unsigned char*>(mapped.mapping.get());
+            uint64_t nEnd = (uint64_t)pos.nPos + ReadLE32(pdata + pos.nPos - sizeof(unsigned int)) + nTrailerSize;
+            if (nEnd <= mapped.nSize) {
+                record.mapping = mapped.mapping;
+                record.pbegin = pdata + pos.nPos;
+                record.pend = pdata + nEnd;
+                return true;
+            }
+        }
+        // The record was not all in the file when it was mapped: map it again, once
+        Unmap(listMappedFiles.begin());
+        if (fMapped)
+            return false;
+    }
+#endif
+}
+
+void UnmapBlockFile(int nFile)
+{
+    std::lock_guard<std::mutex> lock(cs_mappedFiles);
+    for (std::list<CMappedFile>::iterator it = listMappedFiles.begin(); it != listMappedFiles.end(); ) {
+        if (it->nFile == nFile)
+            Unmap(it++);
+        else
+            ++it;
+    }
+}
+
+void UnmapBlockFiles()
+{
+    std::lock_guard<std::mutex> lock(cs_mappedFiles);
+    listMappedFiles.clear();
+    nMappedBytes = 0;
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include <memory>
+#include <stddef.h>
+
+struct CDiskBlockPos;
+
+/** -blockfilemmap default (MiB of block and undo files kept memory-mapped for reading, 0 = off) */
+static const unsigned int DEFAULT_BLOCKFILE_MMAP = 0;
+
+/** Address space the mapped block and undo files may take, 0 to read them with file I/O */
+extern size_t nBlockFileMapBudget;
+
+/** A record of a memory-mapped block or undo file; the mapping stays valid as long as the record */
+struct CMappedRecord
+{
+    std::shared_ptr<const void> mapping;
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+
+    CMappedRecord() : pbegin(NULL), pend(NULL) {}
+};
+
+/**
+ * SolarCoin: Find the block or undo data at pos in its memory-mapped file, so it is deserialized
+ * straight from the mapping (see CSpanReader) instead of opening, seeking and reading the file. The
+ * record runs for the size stored before it, plus nTrailerSize bytes (the checksum of undo data).
+ *
+ * Recently read files stay mapped, up to nBlockFileMapBudget bytes of address space, the least
+ * recently used being unmapped first. A file that grew past its mapping is mapped again. Returns
+ * false when mapping is off or fails, or the record does not fit in the file; the caller then
+ * reads the file as usual.
+ */
+bool MapBlockFileRecord(const CDiskBlockPos& pos, bool fUndo, size_t nTrailerSize, CMappedRecord& record);
+
+/** Unmap the block and undo files of a number, before they are truncated or deleted */
+void UnmapBlockFile(int nFile);
+
+/** Unmap all the block and undo files */
+void UnmapBlockFiles();
+
+#endif // BITCOIN_BLOCKFILEMAP_H
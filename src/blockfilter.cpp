@@ -0,0 +1,325 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "chain.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "streams.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/thread.hpp>
+
+static const char DB_BLOCK_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+CBlockFilterIndex* pblockfilterindex = NULL;
+
+/** The high 64 bits of x * n, which maps a uniform x into [0, n) without a division */
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xffffffff;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xffffffff;
+    uint64_t lo_lo = x_lo * n_lo, hi_lo = x_hi * n_lo, lo_hi = x_lo * n_hi, hi_hi = x_hi * n_hi;
+    uint64_t mid = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+    return hi_hi + (hi_lo >> 32) + (mid >> 32);
+#endif
+}
+
+/** Appends bits to a byte vector, most significant bit first */
+class CBitWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    uint8_t nBuffer;
+    int nBitsUsed;
+
+public:
+    CBitWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), nBuffer(0), nBitsUsed(0) {}
+
+    /** Write the nBits (at most 64) low bits of data */
+    void Write(uint64_t data, int nBits)
+    {
+        while (nBits > 0) {
+            int nFree = 8 - nBitsUsed;
+            int n = std::min(nFree, nBits);
+            uint8_t bits = (data >> (nBits - n)) & ((1 << n) - 1);
+            nBuffer |= bits << (nFree - n);
+            nBitsUsed += n;
+            nBits -= n;
+            if (nBitsUsed == 8)
+                Flush();
+        }
+    }
+
+    /** Write out the last partial byte, padded with zeroes */
+    void Flush()
+    {
+        if (nBitsUsed == 0)
+            return;
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nBitsUsed = 0;
+    }
+};
+
+/** Reads bits from a byte vector, most significant bit first */
+class CBitReader
+{
+private:
+    const std::vector<unsigned char>& vch;
+    size_t nPos;
+    int nBitsUsed;
+
+public:
+    CBitReader(const std::vector<unsigned char>& vchIn, size_t nPosIn) : vch(vchIn), nPos(nPosIn), nBitsUsed(0) {}
+
+    /** Read nBits (at most 64) bits; false past the end */
+    bool Read(int nBits, uint64_t& data)
+    {
+        data = 0;
+        while (nBits > 0) {
+            if (nPos >= vch.size())
+                return false;
+            int nAvail = 8 - nBitsUsed;
+            int n = std::min(nAvail, nBits);
+            data = (data << n) | ((vch[nPos] >> (nAvail - n)) & ((1 << n) - 1));
+            nBitsUsed += n;
+            nBits -= n;
+            if (nBitsUsed == 8) {
+                nPos++;
+                nBitsUsed = 0;
+            }
+        }
+        return true;
+    }
+};
+
+static void GolombRiceEncode(CBitWriter& writer, uint64_t x)
+{
+    // The quotient in unary, then the remainder in P bits
+    uint64_t q = x >> BLOCKFILTER_P;
+    while (q > 0) {
+        int nBits = (int)std::min(q, (uint64_t)64);
+        writer.Write(~(uint64_t)0, nBits);
+        q -= nBits;
+    }
+    writer.Write(0, 1);
+    writer.Write(x, BLOCKFILTER_P);
+}
+
+static bool GolombRiceDecode(CBitReader& reader, uint64_t& x)
+{
+    uint64_t q = 0, bit;
+    while (true) {
+        if (!reader.Read(1, bit))
+            return false;
+        if (!bit)
+            break;
+        q++;
+    }
+    uint64_t r;
+    if (!reader.Read(BLOCKFILTER_P, r))
+        return false;
+    x = (q << BLOCKFILTER_P) + r;
+    return true;
+}
+
+CGCSFilter::CGCSFilter() : k0(0), k1(0), nElements(0)
+{
+    vEncoded.push_back(0);
+}
+
+CGCSFilter::CGCSFilter(const uint256& key, const std::vector<GCSElement>& vElements) :
+    k0(ReadLE64(key.begin())), k1(ReadLE64(key.begin() + 8))
+{
+    std::vector<GCSElement> vDistinct(vElements);
+    std::sort(vDistinct.begin(), vDistinct.end());
+    vDistinct.erase(std::unique(vDistinct.begin(), vDistinct.end()), vDistinct.end());
+    nElements = vDistinct.size();
+
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(nElements);
+    for (const GCSElement& element : vDistinct)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+
+    CVectorWriter stream(SER_NETWORK, PROTOCOL_VERSION, vEncoded, 0);
+    WriteCompactSize(stream, nElements);
+    CBitWriter writer(vEncoded);
+    uint64_t nLast = 0;
+    for (uint64_t nHash : vHashes) {
+        GolombRiceEncode(writer, nHash - nLast);
+        nLast = nHash;
+    }
+    writer.Flush();
+}
+
+CGCSFilter::CGCSFilter(const uint256& key, const std::vector<unsigned char>& vEncodedIn) :
+    k0(ReadLE64(key.begin())), k1(ReadLE64(key.begin() + 8)), vEncoded(vEncodedIn)
+{
+    CSpanReader ss(SER_NETWORK, PROTOCOL_VERSION, vEncoded.data(), vEncoded.data() + vEncoded.size());
+    uint64_t n = ReadCompactSize(ss);
+    if (n > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("block filter has too many elements");
+    nElements = n;
+}
+
+uint64_t CGCSFilter::HashToRange(const GCSElement& element) const
+{
+    uint64_t nHash = CSipHasher(k0, k1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(nHash, (uint64_t)nElements * BLOCKFILTER_M);
+}
+
+bool CGCSFilter::MatchSorted(const std::vector<uint64_t>& vQuery) const
+{
+    CBitReader reader(vEncoded, GetSizeOfCompactSize(nElements));
+    uint64_t nValue = 0;
+    size_t i = 0;
+    for (uint32_t n = 0; n < nElements; n++) {
+        uint64_t nDelta;
+        // A damaged filter rules nothing out
+        if (!GolombRiceDecode(reader, nDelta))
+            return true;
+        nValue += nDelta;
+        while (i < vQuery.size() && vQuery[i] < nValue)
+            i++;
+        if (i == vQuery.size())
+            return false;
+        if (vQuery[i] == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool CGCSFilter::Match(const GCSElement& element) const
+{
+    if (nElements == 0)
+        return false;
+    return MatchSorted(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CGCSFilter::MatchAny(const std::vector<GCSElement>& vQuery) const
+{
+    if (nElements == 0 || vQuery.empty())
+        return false;
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(vQuery.size());
+    for (const GCSElement& element : vQuery)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+    return MatchSorted(vHashes);
+}
+
+GCSElement ScriptFilterElement(const CScript& script)
+{
+    return GCSElement(script.begin(), script.end());
+}
+
+GCSElement OutPointFilterElement(const COutPoint& outpoint)
+{
+    GCSElement element(outpoint.hash.begin(), outpoint.hash.end());
+    element.resize(element.size() + 4);
+    WriteLE32(&element[32], outpoint.n);
+    return element;
+}
+
+CGCSFilter BuildBlockFilter(const CBlock& block, const uint256& hashBlock)
+{
+    std::vector<GCSElement> vElements;
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const CTxOut& txout : tx->vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            vElements.push_back(ScriptFilterElement(script));
+        }
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin)
+            vElements.push_back(OutPointFilterElement(txin.prevout));
+    }
+    return CGCSFilter(hashBlock, vElements);
+}
+
+CBlockFilterIndex::CBlockFilterIndex(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CBaseIndex("block filter index", "bitcoin-blockfilter", "blockfilter", BLOCKFILTER_SYNC_BATCH_BLOCKS, false),
+    db(GetDataDir() / "indexes" / "blockfilter", nCacheSize, fMemory, fWipe)
+{
+}
+
+void CBlockFilterIndex::Init()
+{
+    AssertLockHeld(cs_main);
+    CBlockLocator locator;
+    if (db.Read(DB_BEST_BLOCK, locator))
+        pindexBest = FindForkInGlobalIndex(chainActive, locator);
+    LogPrintf("%s: block filter index complete up to height %d\n", __func__, pindexBest ? pindexBest->nHeight : -1);
+}
+
+bool CBlockFilterIndex::WriteBlocks(const std::vector<CIndexedBlock>& vBlocks, const CBlockLocator& locator)
+{
+    CDBBatch batch(db);
+    for (const CIndexedBlock& indexed : vBlocks) {
+        const uint256 hashBlock = indexed.pindex->GetBlockHash();
+        batch.Write(std::make_pair(DB_BLOCK_FILTER, hashBlock), BuildBlockFilter(*indexed.pblock, hashBlock).GetEncoded());
+    }
+    batch.Write(DB_BEST_BLOCK, locator);
+    return db.WriteBatch(batch);
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, CGCSFilter& filter) const
+{
+    std::vector<unsigned char> vEncoded;
+    if (!db.Read(std::make_pair(DB_BLOCK_FILTER, pindex->GetBlockHash()), vEncoded))
+        return false;
+    try {
+        filter = CGCSFilter(pindex->GetBlockHash(), vEncoded);
+    } catch (const std::exception& e) {
+        return error("%s: invalid filter of block %s: %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool InitBlockFilterIndex(boost::thread_group& threadGroup)
+{
+    if (!GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        return true;
+
+    try {
+        pblockfilterindex = new CBlockFilterIndex(BLOCKFILTER_INDEX_CACHE_SIZE);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return InitError(_("Error opening the block filter index"));
+    }
+    {
+        LOCK(cs_main);
+        pblockfilterindex->Init();
+    }
+    RegisterValidationInterface(pblockfilterindex);
+    threadGroup.create_thread(boost::bind(&CBaseIndex::ThreadSync, pblockfilterindex));
+    return true;
+}
+
+void StopBlockFilterIndex()
+{
+    if (pblockfilterindex) {
+        UnregisterValidationInterface(pblockfilterindex);
+        delete pblockfilterindex;
+        pblockfilterindex = NULL;
+    }
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "baseindex.h"
+#include "dbwrapper.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CScript;
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+/** Default for -blockfilterindex */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Blocks added to the block filter index in one database write while catching up */
+static const unsigned int BLOCKFILTER_SYNC_BATCH_BLOCKS = 256;
+/** Database cache of the block filter index */
+static const size_t BLOCKFILTER_INDEX_CACHE_SIZE = 8 << 20;
+/** Golomb-Rice parameter of the block filters, and their false positive rate 1/M, as in BIP158 */
+static const int BLOCKFILTER_P = 19;
+static const uint64_t BLOCKFILTER_M = 784931;
+
+typedef std::vector<unsigned char> GCSElement;
+
+/**
+ * SolarCoin: A Golomb-coded set of byte strings, as in BIP158. The elements are hashed with
+ * SipHash, keyed by the first 16 bytes of the key, into [0, N * M); the sorted hashes are stored
+ * as Golomb-Rice coded differences. Testing an element has false positives at a rate of 1/M, but
+ * no false negatives.
+ */
+class CGCSFilter
+{
+private:
+    uint64_t k0;
+    uint64_t k1;
+    uint32_t nElements;
+    //! CompactSize N followed by the coded differences
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const GCSElement& element) const;
+    //! Whether any of the sorted hashes is in the set
+    bool MatchSorted(const std::vector<uint64_t>& vQuery) const;
+
+public:
+    CGCSFilter();
+    /** Build the filter of the distinct elements */
+    CGCSFilter(const uint256& key, const std::vector<GCSElement>& vElements);
+    /** Take an encoded filter; throws std::ios_base::failure if its size is malformed, a damaged rest matches anything */
+    CGCSFilter(const uint256& key, const std::vector<unsigned char>& vEncodedIn);
+
+    uint32_t GetN() const { return nElements; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    bool Match(const GCSElement& element) const;
+    bool MatchAny(const std::vector<GCSElement>& vQuery) const;
+};
+
+/** The element of an output script in a block filter */
+GCSElement ScriptFilterElement(const CScript& script);
+/** The element of a spent outpoint in a block filter */
+GCSElement OutPointFilterElement(const COutPoint& outpoint);
+
+/**
+ * SolarCoin: The filter of a block, keyed by its hash: the scripts of its outputs, except empty
+ * and OP_RETURN ones, and the outpoints its transactions spend. The outpoints take the place of
+ * the spent scripts of BIP158, as they need no undo data, and a wallet knows its outpoints.
+ */
+CGCSFilter BuildBlockFilter(const CBlock& block, const uint256& hashBlock);
+
+/**
+ * SolarCoin: The block filter index (-blockfilterindex), in its own database under
+ * indexes/blockfilter. Filters are stored by block hash, so those of blocks that were
+ * disconnected stay valid; the locator of the last block it covers is stored with them.
+ */
+class CBlockFilterIndex : public CBaseIndex
+{
+private:
+    CDBWrapper db;
+
+protected:
+    bool WriteBlocks(const std::vector<CIndexedBlock>& vBlocks, const CBlockLocator& locator) override;
+
+public:
+    CBlockFilterIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Find the last block the index covers in the active chain; needs cs_main */
+    void Init();
+
+    /** The filter of a block, if the index has it; needs no lock */
+    bool LookupFilter(const CBlockIndex* pindex, CGCSFilter& filter) const;
+};
+
+/** The block filter index, NULL unless -blockfilterindex */
+extern CBlockFilterIndex* pblockfilterindex;
+
+/** Open the block filter index and start building it if enabled */
+bool InitBlockFilterIndex(boost::thread_group& threadGroup);
+/** Close the block filter index, after its thread stopped */
+void StopBlockFilterIndex();
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -0,0 +1,262 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "blockindexsnapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "protocol.h"
+#include "util.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <memory>
+#include <string.h>
+#include <unordered_map>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+//! Position of an entry without a parent
+static const uint32_t NO_PARENT = 0xffffffff;
+//! Entries written per fwrite()
+static const size_t WRITE_BATCH_ENTRIES = 4096;
+//! Maximum number of threads decoding entries
+static const int MAX_DECODE_THREADS = 16;
+//! Below this many entries they are decoded on the calling thread
+static const size_t MIN_PARALLEL_DECODE_ENTRIES = 100000;
+
+/** The fields of an entry as CDiskBlockIndex stores them, fields its status leaves out as zero */
+void EncodeEntry(unsigned char* p, const CBlockIndex* pindex, uint32_t nParent)
+{
+    const unsigned char* pBegin = p;
+    const bool fStake = pindex->IsProofOfStake();
+    memcpy(p, pindex->GetBlockHash().begin(), 32); p += 32;
+    WriteLE32(p, nParent); p += 4;
+    WriteLE32(p, pindex->nHeight); p += 4;
+    WriteLE32(p, pindex->nStatus); p += 4;
+    WriteLE32(p, pindex->nTx); p += 4;
+    WriteLE32(p, pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO) ? pindex->nFile : 0); p += 4;
+    WriteLE32(p, pindex->nStatus & BLOCK_HAVE_DATA ? pindex->nDataPos : 0); p += 4;
+    WriteLE32(p, pindex->nStatus & BLOCK_HAVE_UNDO ? pindex->nUndoPos : 0); p += 4;
+    WriteLE64(p, pindex->nMint); p += 8;
+    WriteLE64(p, pindex->nMoneySupply); p += 8;
+    WriteLE32(p, pindex->nFlags); p += 4;
+    WriteLE64(p, pindex->nStakeModifier); p += 8;
+    WriteLE32(p, pindex->nStatus & BLOCK_HAVE_STAKE_CHECKSUM ? pindex->nStakeModifierChecksum : 0); p += 4;
+    WriteLE32(p, pindex->nVersion); p += 4;
+    memcpy(p, pindex->hashMerkleRoot.begin(), 32); p += 32;
+    WriteLE32(p, pindex->nTime); p += 4;
+    WriteLE32(p, pindex->nBits); p += 4;
+    WriteLE32(p, pindex->nNonce); p += 4;
+    memcpy(p, fStake ? pindex->GetPrevoutStake().hash.begin() : uint256().begin(), 32); p += 32;
+    WriteLE32(p, fStake ? pindex->GetPrevoutStake().n : 0); p += 4;
+    WriteLE32(p, fStake ? pindex->GetStakeTime() : 0); p += 4;
+    memcpy(p, fStake ? pindex->GetHashProofOfStake().begin() : uint256().begin(), 32); p += 32;
+    assert(p - pBegin == (ptrdiff_t)BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE);
+}
+
+/** Set the fields of an entry as CBlockTreeDB::LoadBlockIndexGuts() does */
+void DecodeEntry(const unsigned char* p, CBlockIndex* pindex, const std::vector<CBlockIndex*>& vIndex)
+{
+    p += 32; // the hash, the entry is found by it
+    uint32_t nParent = ReadLE32(p); p += 4;
+    pindex->pprev = nParent == NO_PARENT ? NULL : vIndex[nParent];
+    pindex->nHeight = ReadLE32(p); p += 4;
+    pindex->nStatus = ReadLE32(p); p += 4;
+    pindex->nTx = ReadLE32(p); p += 4;
+    pindex->nFile = ReadLE32(p); p += 4;
+    pindex->nDataPos = ReadLE32(p); p += 4;
+    pindex->nUndoPos = ReadLE32(p); p += 4;
+    pindex->nMint = ReadLE64(p); p += 8;
+    pindex->nMoneySupply = ReadLE64(p); p += 8;
+    pindex->nFlags = ReadLE32(p); p += 4;
+    pindex->nStakeModifier = ReadLE64(p); p += 8;
+    pindex->nStakeModifierChecksum = ReadLE32(p); p += 4;
+    pindex->nVersion = ReadLE32(p); p += 4;
+    memcpy(pindex->hashMerkleRoot.begin(), p, 32); p += 32;
+    pindex->nTime = ReadLE32(p); p += 4;
+    pindex->nBits = ReadLE32(p); p += 4;
+    pindex->nNonce = ReadLE32(p); p += 4;
+    if (pindex->IsProofOfStake()) {
+        COutPoint prevoutStake;
+        memcpy(prevoutStake.hash.begin(), p, 32); p += 32;
+        prevoutStake.n = ReadLE32(p); p += 4;
+        unsigned int nStakeTime = ReadLE32(p); p += 4;
+        uint256 hashProofOfStake;
+        memcpy(hashProofOfStake.begin(), p, 32);
+        pindex->SetStake(prevoutStake, nStakeTime);
+        pindex->SetHashProofOfStake(hashProofOfStake);
+    } else {
+        pindex->SetStake(COutPoint(), 0);
+        pindex->SetHashProofOfStake(uint256());
+    }
+}
+
+/** The contents of a file: mapped where mmap() is available, read otherwise */
+class CFileContents
+{
+private:
+    std::shared_ptr<const void> mapping;
+    std::vector<unsigned char> vData;
+
+public:
+    const unsigned char* pBegin;
+    size_t nSize;
+
+    CFileContents() : pBegin(NULL), nSize(0) {}
+
+    bool Open(const boost::filesystem::path& path)
+    {
+#ifndef WIN32
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+        size_t nFileSize = st.st_size;
+        void* p = mmap(NULL, nFileSize, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        // Read through once, in parts by several threads
+        madvise(p, nFileSize, MADV_WILLNEED);
+        mapping = std::shared_ptr<const void>(p, [nFileSize](const void* q) { munmap(const_cast<void*>(q), nFileSize); });
+        pBegin = static_cast<const unsigned char*>(p);
+        nSize = nFileSize;
+#else
+        FILE* file = fopen(path.string().c_str(), "rb");
+        if (!file)
+            return false;
+        std::vector<unsigned char> vBuf(1 << 20);
+        size_t nRead;
+        while ((nRead = fread(vBuf.data(), 1, vBuf.size(), file)) > 0)
+            vData.insert(vData.end(), vBuf.begin(), vBuf.begin() + nRead);
+        bool fError = ferror(file);
+        fclose(file);
+        if (fError || vData.empty())
+            return false;
+        pBegin = vData.data();
+        nSize = vData.size();
+#endif
+        return true;
+    }
+};
+
+} // anon namespace
+
+bool WriteBlockIndexSnapshot(const boost::filesystem::path& path, uint64_t nId, const uint256& hashState, const std::vector<const CBlockIndex*>& vIndex)
+{
+    std::unordered_map<const CBlockIndex*, uint32_t> mapPosition;
+    mapPosition.reserve(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++)
+        mapPosition.emplace(vIndex[i], i);
+
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".incomplete";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("%s: unable to open %s for writing", __func__, pathTmp.string());
+
+    unsigned char header[BLOCK_INDEX_SNAPSHOT_HEADER_SIZE];
+    memcpy(header, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    WriteLE32(header + 4, BLOCK_INDEX_SNAPSHOT_VERSION);
+    WriteLE64(header + 8, nId);
+    memcpy(header + 16, hashState.begin(), 32);
+    WriteLE32(header + 48, BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE);
+    WriteLE64(header + 52, vIndex.size());
+    bool fOk = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    std::vector<unsigned char> vBatch(WRITE_BATCH_ENTRIES * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE);
+    for (size_t nBegin = 0; fOk && nBegin < vIndex.size(); nBegin += WRITE_BATCH_ENTRIES) {
+        const size_t nEnd = std::min(nBegin + WRITE_BATCH_ENTRIES, vIndex.size());
+        for (size_t i = nBegin; i < nEnd; i++) {
+            uint32_t nParent = NO_PARENT;
+            if (vIndex[i]->pprev) {
+                std::unordered_map<const CBlockIndex*, uint32_t>::const_iterator it = mapPosition.find(vIndex[i]->pprev);
+                if (it == mapPosition.end()) {
+                    fOk = false;
+                    break;
+                }
+                nParent = it->second;
+            }
+            EncodeEntry(&vBatch[(i - nBegin) * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE], vIndex[i], nParent);
+        }
+        const size_t nBytes = (nEnd - nBegin) * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE;
+        fOk = fOk && fwrite(vBatch.data(), 1, nBytes, file) == nBytes;
+    }
+    if (fOk)
+        FileCommit(file);
+    if (fclose(file) != 0 || !fOk || !RenameOver(pathTmp, path)) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathTmp, ec);
+        return error("%s: unable to write %s", __func__, path.string());
+    }
+    return true;
+}
+
+bool ReadBlockIndexSnapshot(const boost::filesystem::path& path, uint64_t nId, const uint256& hashState, const boost::function<CBlockIndex*(const uint256&)>& insertBlockIndex, std::vector<CBlockIndex*>& vIndex)
+{
+    CFileContents contents;
+    if (!contents.Open(path))
+        return error("%s: unable to read %s", __func__, path.string());
+    const unsigned char* header = contents.pBegin;
+    if (contents.nSize < BLOCK_INDEX_SNAPSHOT_HEADER_SIZE ||
+        memcmp(header, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0 ||
+        ReadLE32(header + 4) != BLOCK_INDEX_SNAPSHOT_VERSION ||
+        ReadLE64(header + 8) != nId ||
+        memcmp(header + 16, hashState.begin(), 32) != 0 ||
+        ReadLE32(header + 48) != BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE)
+        return error("%s: %s is not the snapshot of this block index", __func__, path.string());
+    const uint64_t nCount = ReadLE64(header + 52);
+    if (nCount >= NO_PARENT || contents.nSize != BLOCK_INDEX_SNAPSHOT_HEADER_SIZE + nCount * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE)
+        return error("%s: %s has the wrong size", __func__, path.string());
+    const unsigned char* pEntries = contents.pBegin + BLOCK_INDEX_SNAPSHOT_HEADER_SIZE;
+    for (uint64_t i = 0; i < nCount; i++) {
+        const uint32_t nParent = ReadLE32(pEntries + i * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE + 32);
+        if (nParent != NO_PARENT && nParent >= nCount)
+            return error("%s: %s has an entry with a parent out of range", __func__, path.string());
+    }
+
+    // Create the entries, then fill them in, as they refer to each other by position
+    vIndex.resize(nCount);
+    for (uint64_t i = 0; i < nCount; i++) {
+        uint256 hash;
+        memcpy(hash.begin(), pEntries + i * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE, 32);
+        vIndex[i] = insertBlockIndex(hash);
+    }
+    auto decodeRange = [pEntries, &vIndex](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++)
+            DecodeEntry(pEntries + i * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE, vIndex[i], vIndex);
+    };
+    const size_t nThreads = std::max(1, std::min(GetNumCores(), MAX_DECODE_THREADS));
+    if (nThreads == 1 || vIndex.size() < MIN_PARALLEL_DECODE_ENTRIES) {
+        decodeRange(0, vIndex.size());
+    } else {
+        boost::thread_group threadGroup;
+        const size_t nChunk = (vIndex.size() + nThreads - 1) / nThreads;
+        for (size_t nBegin = 0; nBegin < vIndex.size(); nBegin += nChunk)
+            threadGroup.create_thread(boost::bind<void>(decodeRange, nBegin, std::min(nBegin + nChunk, vIndex.size())));
+        threadGroup.join_all();
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKINDEXSNAPSHOT_H
+#define BITCOIN_BLOCKINDEXSNAPSHOT_H
+
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+class uint256;
+
+/** -blockindexsnapshot default (write a snapshot of the block index at shutdown, loaded at the next startup) */
+static const bool DEFAULT_BLOCK_INDEX_SNAPSHOT = true;
+/** SolarCoin: Version of the block index snapshot files */
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 2;
+/** Size of the header of a block index snapshot: message start, version, identifier, database state, entry size and count */
+static const size_t BLOCK_INDEX_SNAPSHOT_HEADER_SIZE = 60;
+/** Size of an entry of a block index snapshot */
+static const size_t BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE = 212;
+
+/**
+ * SolarCoin: Write the block index entries to a flat file of fixed size little-endian records, in
+ * the order given, with the fields the block tree database holds. The parent of an entry is stored
+ * as its position in the file, so loading needs no hash lookup per entry. nId identifies the
+ * snapshot; the caller records it in the block tree database, which is what makes the file current.
+ * hashState summarizes the state of the databases the snapshot was taken with, so that a snapshot
+ * whose identifier outlived changes made by a binary that does not know about it is not loaded.
+ */
+bool WriteBlockIndexSnapshot(const boost::filesystem::path& path, uint64_t nId, const uint256& hashState, const std::vector<const CBlockIndex*>& vIndex);
+
+/**
+ * SolarCoin: Load the entries of a snapshot written by WriteBlockIndexSnapshot() with identifier
+ * nId and database state hashState. The file is mapped into memory and checked whole before insertBlockIndex is called for any
+ * entry, so a file that does not match leaves the block index untouched. insertBlockIndex is then
+ * called for each entry in turn, and the fields decoded by several threads. vIndex receives the
+ * entries in the order of the file.
+ */
+bool ReadBlockIndexSnapshot(const boost::filesystem::path& path, uint64_t nId, const uint256& hashState, const boost::function<CBlockIndex*(const uint256&)>& insertBlockIndex, std::vector<CBlockIndex*>& vIndex);
+
+#endif // BITCOIN_BLOCKINDEXSNAPSHOT_H
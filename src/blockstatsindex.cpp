@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstatsindex.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "ui_interface.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+static const char DB_BLOCK_STATS = 's';
+static const char DB_BEST_BLOCK = 'B';
+
+CBlockStatsIndex* pblockstatsindex = NULL;
+
+CBlockStats ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    CBlockStats stats;
+    stats.nHeight = pindex->nHeight;
+    stats.nTime = block.GetBlockTime();
+    stats.nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    stats.nTx = block.vtx.size();
+    stats.nMint = pindex->nMint;
+    stats.nMoneySupply = pindex->nMoneySupply;
+    stats.fProofOfStake = block.IsProofOfStake();
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        stats.nOutputs += tx.vout.size();
+        if (tx.IsCoinBase())
+            continue;
+        stats.nInputs += tx.vin.size();
+
+        // The genesis block has no undo data
+        CAmount nValueIn = 0;
+        const CTxUndo* ptxundo = blockundo.vtxundo.size() + 1 == block.vtx.size() ? &blockundo.vtxundo[i - 1] : NULL;
+        bool fHaveInputs = ptxundo && ptxundo->vprevout.size() == tx.vin.size();
+        if (fHaveInputs) {
+            for (const Coin& coin : ptxundo->vprevout)
+                nValueIn += coin.out.nValue;
+        }
+        CAmount nValueOut = tx.GetValueOut();
+
+        if (tx.IsCoinStake()) {
+            if (fHaveInputs) {
+                stats.nStakeValue = nValueIn;
+                stats.nStakeReward = nValueOut - nValueIn;
+                const Coin& coinStaked = ptxundo->vprevout[0];
+                if (coinStaked.nTime)
+                    stats.nStakeAge = (int64_t)tx.nTime - coinStaked.nTime;
+            }
+            continue;
+        }
+        stats.nTotalOut += nValueOut;
+        if (fHaveInputs) {
+            stats.nFees += nValueIn - nValueOut;
+            stats.nMaxFee = std::max(stats.nMaxFee, nValueIn - nValueOut);
+        }
+    }
+    return stats;
+}
+
+CBlockStatsIndex::CBlockStatsIndex(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CBaseIndex("block statistics index", "bitcoin-blockstats", "blockstats", BLOCKSTATS_SYNC_BATCH_BLOCKS, true),
+    db(GetDataDir() / "indexes" / "blockstats", nCacheSize, fMemory, fWipe)
+{
+}
+
+void CBlockStatsIndex::Init()
+{
+    AssertLockHeld(cs_main);
+    CBlockLocator locator;
+    if (db.Read(DB_BEST_BLOCK, locator))
+        pindexBest = FindForkInGlobalIndex(chainActive, locator);
+    LogPrintf("%s: block statistics index complete up to height %d\n", __func__, pindexBest ? pindexBest->nHeight : -1);
+}
+
+bool CBlockStatsIndex::WriteBlocks(const std::vector<CIndexedBlock>& vBlocks, const CBlockLocator& locator)
+{
+    CDBBatch batch(db);
+    for (const CIndexedBlock& indexed : vBlocks)
+        batch.Write(std::make_pair(DB_BLOCK_STATS, indexed.pindex->GetBlockHash()), ComputeBlockStats(*indexed.pblock, *indexed.pblockundo, indexed.pindex));
+    batch.Write(DB_BEST_BLOCK, locator);
+    return db.WriteBatch(batch);
+}
+
+bool CBlockStatsIndex::LookupStats(const CBlockIndex* pindex, CBlockStats& stats) const
+{
+    return db.Read(std::make_pair(DB_BLOCK_STATS, pindex->GetBlockHash()), stats);
+}
+
+bool InitBlockStatsIndex(boost::thread_group& threadGroup)
+{
+    if (!GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+        return true;
+
+    try {
+        pblockstatsindex = new CBlockStatsIndex(BLOCKSTATS_INDEX_CACHE_SIZE);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return InitError(_("Error opening the block statistics index"));
+    }
+    {
+        LOCK(cs_main);
+        pblockstatsindex->Init();
+    }
+    RegisterValidationInterface(pblockstatsindex);
+    threadGroup.create_thread(boost::bind(&CBaseIndex::ThreadSync, pblockstatsindex));
+    return true;
+}
+
+void StopBlockStatsIndex()
+{
+    if (pblockstatsindex) {
+        UnregisterValidationInterface(pblockstatsindex);
+        delete pblockstatsindex;
+        pblockstatsindex = NULL;
+    }
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTATSINDEX_H
+#define BITCOIN_BLOCKSTATSINDEX_H
+
+#include "amount.h"
+#include "baseindex.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+/** Default for -blockstatsindex */
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
+/** Blocks added to the block statistics index in one database write while catching up */
+static const unsigned int BLOCKSTATS_SYNC_BATCH_BLOCKS = 256;
+/** Database cache of the block statistics index */
+static const size_t BLOCKSTATS_INDEX_CACHE_SIZE = 4 << 20;
+
+/** The statistics of a block, with the reward and stake data of proof-of-stake blocks */
+struct CBlockStats
+{
+    int nHeight;
+    int64_t nTime;
+    uint32_t nSize;
+    uint32_t nTx;
+    //! Inputs of the transactions other than the coinbase, and outputs of all
+    uint32_t nInputs;
+    uint32_t nOutputs;
+    //! Value paid by the transactions other than the coinbase and coinstake
+    CAmount nTotalOut;
+    CAmount nFees;
+    CAmount nMaxFee;
+    //! CBlockIndex::nMint and nMoneySupply
+    CAmount nMint;
+    CAmount nMoneySupply;
+    bool fProofOfStake;
+    //! Value of the outputs staked by the coinstake, and what it pays on top of them
+    CAmount nStakeValue;
+    CAmount nStakeReward;
+    //! Seconds between the staked transaction and the coinstake; 0 if the undo data do not know
+    int64_t nStakeAge;
+
+    CBlockStats() : nHeight(-1), nTime(0), nSize(0), nTx(0), nInputs(0), nOutputs(0), nTotalOut(0), nFees(0), nMaxFee(0),
+                    nMint(0), nMoneySupply(0), fProofOfStake(false), nStakeValue(0), nStakeReward(0), nStakeAge(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nTime));
+        READWRITE(VARINT(nSize));
+        READWRITE(VARINT(nTx));
+        READWRITE(VARINT(nInputs));
+        READWRITE(VARINT(nOutputs));
+        READWRITE(nTotalOut);
+        READWRITE(nFees);
+        READWRITE(nMaxFee);
+        READWRITE(nMint);
+        READWRITE(nMoneySupply);
+        READWRITE(fProofOfStake);
+        READWRITE(nStakeValue);
+        READWRITE(nStakeReward);
+        READWRITE(VARINT(nStakeAge));
+    }
+};
+
+/** The statistics of a connected block, from its undo data (empty for the genesis block) */
+CBlockStats ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+
+/**
+ * SolarCoin: The block statistics index (-blockstatsindex), in its own database under
+ * indexes/blockstats, so the statistics of a range of blocks are read instead of recomputed from
+ * the full blocks. Statistics are stored by block hash, with the locator of the last block the
+ * index covers; they are computed from the undo data ConnectTip() built, or read back while
+ * catching up.
+ */
+class CBlockStatsIndex : public CBaseIndex
+{
+private:
+    CDBWrapper db;
+
+protected:
+    bool WriteBlocks(const std::vector<CIndexedBlock>& vBlocks, const CBlockLocator& locator) override;
+
+public:
+    CBlockStatsIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Find the last block the index covers in the active chain; needs cs_main */
+    void Init();
+
+    /** The statistics of a block, if the index has them; needs no lock */
+    bool LookupStats(const CBlockIndex* pindex, CBlockStats& stats) const;
+};
+
+/** The block statistics index, NULL unless -blockstatsindex */
+extern CBlockStatsIndex* pblockstatsindex;
+
+/** Open the block statistics index and start building it if enabled */
+bool InitBlockStatsIndex(boost::thread_group& threadGroup);
+/** Close the block statistics index, after its thread stopped */
+void StopBlockStatsIndex();
+
+#endif // BITCOIN_BLOCKSTATSINDEX_H
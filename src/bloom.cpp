@@ -4,18 +4,18 @@
 
 #include "bloom.h"
 
+#include "crypto/common.h"
 #include "primitives/transaction.h"
 #include "hash.h"
+#include "memusage.h"
 #include "script/script.h"
 #include "script/standard.h"
 #include "random.h"
-#include "streams.h"
+#include "utiltime.h"
 
 #include <math.h>
 #include <stdlib.h>
 
-#include <boost/foreach.hpp>
-
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
 
@@ -50,67 +50,100 @@ CBloomFilter::CBloomFilter(unsigned int nElements, double nFPRate, unsigned int
 {
 }
 
-inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
+/* SolarCoin: An outpoint as serialized for the network, without a stream */
+static const size_t OUTPOINT_SIZE = 36;
+
+static inline void SerializeOutPoint(const COutPoint& outpoint, unsigned char* pch)
 {
-    // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (vData.size() * 8);
+    memcpy(pch, outpoint.hash.begin(), 32);
+    WriteLE32(pch + 32, outpoint.n);
 }
 
-void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+inline void CBloomFilter::Hashes(unsigned int nFirst, unsigned int nCount, const unsigned char* pchKey, size_t nKeySize, uint32_t* pnIndexes) const
+{
+    uint32_t vSeeds[MAX_HASH_FUNCS];
+    for (unsigned int i = 0; i < nCount; i++) {
+        // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
+        vSeeds[i] = (nFirst + i) * 0xFBA4C795 + nTweak;
+    }
+    MurmurHash3(vSeeds, nCount, pchKey, nKeySize, pnIndexes);
+    for (unsigned int i = 0; i < nCount; i++)
+        pnIndexes[i] %= vData.size() * 8;
+}
+
+void CBloomFilter::InsertKey(const unsigned char* pchKey, size_t nKeySize)
 {
     if (isFull)
         return;
-    for (unsigned int i = 0; i < nHashFuncs; i++)
+    uint32_t vIndexes[MAX_HASH_FUNCS];
+    for (unsigned int nFirst = 0; nFirst < nHashFuncs; nFirst += MAX_HASH_FUNCS)
     {
-        unsigned int nIndex = Hash(i, vKey);
-        // Sets bit nIndex of vData
-        vData[nIndex >> 3] |= (1 << (7 & nIndex));
+        unsigned int nCount = std::min(nHashFuncs - nFirst, MAX_HASH_FUNCS);
+        Hashes(nFirst, nCount, pchKey, nKeySize, vIndexes);
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            unsigned int nIndex = vIndexes[i];
+            // Sets bit nIndex of vData
+            vData[nIndex >> 3] |= (1 << (7 & nIndex));
+        }
     }
     isEmpty = false;
 }
 
+bool CBloomFilter::ContainsKey(const unsigned char* pchKey, size_t nKeySize) const
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    uint32_t vIndexes[MAX_HASH_FUNCS];
+    for (unsigned int nFirst = 0; nFirst < nHashFuncs; nFirst += MAX_HASH_FUNCS)
+    {
+        unsigned int nCount = std::min(nHashFuncs - nFirst, MAX_HASH_FUNCS);
+        Hashes(nFirst, nCount, pchKey, nKeySize, vIndexes);
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            unsigned int nIndex = vIndexes[i];
+            // Checks bit nIndex of vData
+            if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+                return false;
+        }
+    }
+    return true;
+}
+
+void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    InsertKey(vKey.data(), vKey.size());
+}
+
 void CBloomFilter::insert(const COutPoint& outpoint)
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    insert(data);
+    unsigned char vchOutPoint[OUTPOINT_SIZE];
+    SerializeOutPoint(outpoint, vchOutPoint);
+    InsertKey(vchOutPoint, OUTPOINT_SIZE);
 }
 
 void CBloomFilter::insert(const uint256& hash)
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    insert(data);
+    InsertKey(hash.begin(), hash.size());
 }
 
 bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
 {
-    if (isFull)
-        return true;
-    if (isEmpty)
-        return false;
-    for (unsigned int i = 0; i < nHashFuncs; i++)
-    {
-        unsigned int nIndex = Hash(i, vKey);
-        // Checks bit nIndex of vData
-        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
-            return false;
-    }
-    return true;
+    return ContainsKey(vKey.data(), vKey.size());
 }
 
 bool CBloomFilter::contains(const COutPoint& outpoint) const
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    return contains(data);
+    unsigned char vchOutPoint[OUTPOINT_SIZE];
+    SerializeOutPoint(outpoint, vchOutPoint);
+    return ContainsKey(vchOutPoint, OUTPOINT_SIZE);
 }
 
 bool CBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    return ContainsKey(hash.begin(), hash.size());
 }
 
 void CBloomFilter::clear()
@@ -131,7 +164,58 @@ bool CBloomFilter::IsWithinSizeConstraints() const
     return vData.size() <= MAX_BLOOM_FILTER_SIZE && nHashFuncs <= MAX_HASH_FUNCS;
 }
 
+CBloomTxElements::CBloomTxElements(const CTransaction& txIn) : ptx(&txIn)
+{
+    vEnd.reserve(txIn.vout.size() + txIn.vin.size());
+    for (const CTxOut& txout : txIn.vout)
+    {
+        AddScriptElements(txout.scriptPubKey);
+        vEnd.push_back(vElements.size());
+    }
+    for (const CTxIn& txin : txIn.vin)
+    {
+        unsigned char vchOutPoint[OUTPOINT_SIZE];
+        SerializeOutPoint(txin.prevout, vchOutPoint);
+        AddElement(vchOutPoint, OUTPOINT_SIZE);
+        AddScriptElements(txin.scriptSig);
+        vEnd.push_back(vElements.size());
+    }
+}
+
+void CBloomTxElements::AddElement(const unsigned char* pch, size_t nSize)
+{
+    Element element;
+    element.nBegin = vData.size();
+    element.nSize = nSize;
+    vElements.push_back(element);
+    vData.insert(vData.end(), pch, pch + nSize);
+}
+
+void CBloomTxElements::AddScriptElements(const CScript& script)
+{
+    // Every non-empty data element pushed, up to the first invalid opcode
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            AddElement(data.data(), data.size());
+    }
+}
+
 bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    return IsRelevantAndUpdate(CBloomTxElements(tx));
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomTxElements& elements)
 {
     bool fFound = false;
     // Match if the filter contains the hash of tx
@@ -140,10 +224,12 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
         return true;
     if (isEmpty)
         return false;
+    const CTransaction& tx = *elements.ptx;
     const uint256& hash = tx.GetHash();
     if (contains(hash))
         fFound = true;
 
+    uint32_t nElement = 0;
     for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
         const CTxOut& txout = tx.vout[i];
@@ -151,14 +237,10 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
         // If this matches, also add the specific output that was matched.
         // This means clients don't have to update the filter themselves when a new relevant tx 
         // is discovered in order to find spending transactions, which avoids round-tripping and race conditions.
-        CScript::const_iterator pc = txout.scriptPubKey.begin();
-        std::vector<unsigned char> data;
-        while (pc < txout.scriptPubKey.end())
+        for (; nElement < elements.vEnd[i]; nElement++)
         {
-            opcodetype opcode;
-            if (!txout.scriptPubKey.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+            const CBloomTxElements::Element& element = elements.vElements[nElement];
+            if (ContainsKey(elements.vData.data() + element.nBegin, element.nSize))
             {
                 fFound = true;
                 if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
@@ -174,28 +256,19 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
                 break;
             }
         }
+        nElement = elements.vEnd[i];
     }
 
     if (fFound)
         return true;
 
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    // Match if the filter contains an outpoint tx spends, which is the first element of each input,
+    // or any arbitrary script data element in any scriptSig in tx
+    for (; nElement < elements.vElements.size(); nElement++)
     {
-        // Match if the filter contains an outpoint tx spends
-        if (contains(txin.prevout))
+        const CBloomTxElements::Element& element = elements.vElements[nElement];
+        if (ContainsKey(elements.vData.data() + element.nBegin, element.nSize))
             return true;
-
-        // Match if the filter contains any arbitrary script data element in any scriptSig in tx
-        CScript::const_iterator pc = txin.scriptSig.begin();
-        std::vector<unsigned char> data;
-        while (pc < txin.scriptSig.end())
-        {
-            opcodetype opcode;
-            if (!txin.scriptSig.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
-                return true;
-        }
     }
 
     return false;
@@ -237,17 +310,21 @@ CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double fpRate)
      * treated as set in generation 1, 2, or 3 respectively.
      * These bits are stored in separate integers: position P corresponds to bit
      * (P & 63) of the integers data[(P >> 6) * 2] and data[(P >> 6) * 2 + 1]. */
-    data.resize(((nFilterBits + 63) / 64) << 1);
+    nDataSize = ((nFilterBits + 63) / 64) << 1;
     reset();
 }
 
-/* Similar to CBloomFilter::Hash */
-static inline uint32_t RollingBloomHash(unsigned int nHashNum, uint32_t nTweak, const std::vector<unsigned char>& vDataToHash) {
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash);
+/* SolarCoin: All hash functions are derived from one 64-bit SipHash of the key, as h1 + n * h2,
+ * rather than hashing the key again for each of them. */
+static inline uint32_t RollingBloomHash(unsigned int nHashNum, uint64_t nHash) {
+    return (uint32_t)nHash + nHashNum * (uint32_t)(nHash >> 32);
 }
 
-void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
+void CRollingBloomFilter::InsertHash(uint64_t nHash)
 {
+    if (data.empty()) {
+        data.resize(nDataSize);
+    }
     if (nEntriesThisGeneration == nEntriesPerGeneration) {
         nEntriesThisGeneration = 0;
         nGeneration++;
@@ -267,7 +344,7 @@ void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
     nEntriesThisGeneration++;
 
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
+        uint32_t h = RollingBloomHash(n, nHash);
         int bit = h & 0x3F;
         uint32_t pos = (h >> 6) % data.size();
         /* The lowest bit of pos is ignored, and set to zero for the first bit, and to one for the second. */
@@ -276,19 +353,16 @@ void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
     }
 }
 
-void CRollingBloomFilter::insert(const uint256& hash)
-{
-    std::vector<unsigned char> vData(hash.begin(), hash.end());
-    insert(vData);
-}
-
-bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+bool CRollingBloomFilter::ContainsHash(uint64_t nHash) const
 {
+    if (data.empty()) {
+        return false;
+    }
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
+        uint32_t h = RollingBloomHash(n, nHash);
         int bit = h & 0x3F;
         uint32_t pos = (h >> 6) % data.size();
-        /* If the relevant bit is not set in either data[pos & ~1] or data[pos | 1], the filter does not contain vKey */
+        /* If the relevant bit is not set in either data[pos & ~1] or data[pos | 1], the filter does not contain the key */
         if (!(((data[pos & ~1] | data[pos | 1]) >> bit) & 1)) {
             return false;
         }
@@ -296,18 +370,84 @@ bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
     return true;
 }
 
+void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    InsertHash(CSipHasher(nHashKey0, nHashKey1).Write(vKey.data(), vKey.size()).Finalize());
+}
+
+void CRollingBloomFilter::insert(const uint256& hash)
+{
+    InsertHash(SipHashUint256(nHashKey0, nHashKey1, hash));
+}
+
+bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+{
+    return ContainsHash(CSipHasher(nHashKey0, nHashKey1).Write(vKey.data(), vKey.size()).Finalize());
+}
+
 bool CRollingBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> vData(hash.begin(), hash.end());
-    return contains(vData);
+    return ContainsHash(SipHashUint256(nHashKey0, nHashKey1, hash));
+}
+
+size_t CRollingBloomFilter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(data);
 }
 
 void CRollingBloomFilter::reset()
 {
-    nTweak = GetRand(std::numeric_limits<unsigned int>::max());
+    nHashKey0 = GetRand(std::numeric_limits<uint64_t>::max());
+    nHashKey1 = GetRand(std::numeric_limits<uint64_t>::max());
     nEntriesThisGeneration = 0;
     nGeneration = 1;
     for (std::vector<uint64_t>::iterator it = data.begin(); it != data.end(); it++) {
         *it = 0;
     }
 }
+
+CAdaptiveRollingBloomFilter::CAdaptiveRollingBloomFilter(unsigned int nMinElementsIn, unsigned int nMaxElementsIn, double fpRateIn, int64_t nMinAgeIn) :
+    nMaxElements(std::max(nMinElementsIn, nMaxElementsIn)),
+    fpRate(fpRateIn),
+    nMinAge(nMinAgeIn),
+    nElements(nMinElementsIn),
+    filter(nMinElementsIn, fpRateIn),
+    nInserted(0),
+    nPrevElements(0),
+    nInsertedPeriod(0),
+    nPeriodStart(GetTime())
+{
+}
+
+void CAdaptiveRollingBloomFilter::insert(const uint256& hash)
+{
+    filter.insert(hash);
+    nInserted++;
+    if (filterPrev && nInserted >= nPrevElements) {
+        filterPrev.reset();
+    }
+
+    if (++nInsertedPeriod < (nElements + 1) / 2) {
+        return;
+    }
+    int64_t nNow = GetTime();
+    if (nElements < nMaxElements && nNow - nPeriodStart < nMinAge) {
+        filterPrev.reset(new CRollingBloomFilter(std::move(filter)));
+        nPrevElements = nElements;
+        nElements = std::min(nElements * 2, nMaxElements);
+        filter = CRollingBloomFilter(nElements, fpRate);
+        nInserted = 0;
+    }
+    nInsertedPeriod = 0;
+    nPeriodStart = nNow;
+}
+
+bool CAdaptiveRollingBloomFilter::contains(const uint256& hash) const
+{
+    return filter.contains(hash) || (filterPrev && filterPrev->contains(hash));
+}
+
+size_t CAdaptiveRollingBloomFilter::DynamicMemoryUsage() const
+{
+    return filter.DynamicMemoryUsage() + (filterPrev ? memusage::DynamicUsage(filterPrev) + filterPrev->DynamicMemoryUsage() : 0);
+}
@@ -7,9 +7,11 @@
 
 #include "serialize.h"
 
+#include <memory>
 #include <vector>
 
 class COutPoint;
+class CScript;
 class CTransaction;
 class uint256;
 
@@ -30,6 +32,37 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * SolarCoin: What BIP37 filters are matched against in a transaction, extracted once so it can be
+ * matched against the filters of many peers: the data elements pushed by each scriptPubKey, and
+ * for each input the serialized outpoint it spends followed by the data elements of its
+ * scriptSig. Refers to tx, which must outlive it.
+ */
+class CBloomTxElements
+{
+public:
+    explicit CBloomTxElements(const CTransaction& txIn);
+
+private:
+    friend class CBloomFilter;
+
+    struct Element
+    {
+        uint32_t nBegin;
+        uint32_t nSize;
+    };
+
+    const CTransaction* ptx;
+    //! The bytes of all elements
+    std::vector<unsigned char> vData;
+    std::vector<Element> vElements;
+    //! The elements of output i end at vEnd[i], those of input i at vEnd[vout.size() + i]
+    std::vector<uint32_t> vEnd;
+
+    void AddElement(const unsigned char* pch, size_t nSize);
+    void AddScriptElements(const CScript& script);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -51,7 +84,10 @@ private:
     unsigned int nTweak;
     unsigned char nFlags;
 
-    unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
+    //! SolarCoin: The bit indexes of hash functions nFirst..nFirst+nCount-1 for the key, nCount <= MAX_HASH_FUNCS
+    void Hashes(unsigned int nFirst, unsigned int nCount, const unsigned char* pchKey, size_t nKeySize, uint32_t* pnIndexes) const;
+    void InsertKey(const unsigned char* pchKey, size_t nKeySize);
+    bool ContainsKey(const unsigned char* pchKey, size_t nKeySize) const;
 
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(unsigned int nElements, double nFPRate, unsigned int nTweak);
@@ -97,6 +133,8 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    //! SolarCoin: The same, for a transaction whose elements were already extracted
+    bool IsRelevantAndUpdate(const CBloomTxElements& elements);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
@@ -131,13 +169,55 @@ public:
 
     void reset();
 
+    size_t DynamicMemoryUsage() const;
+
 private:
     int nEntriesPerGeneration;
     int nEntriesThisGeneration;
     int nGeneration;
+    //! SolarCoin: allocated on the first insert, nDataSize words
     std::vector<uint64_t> data;
-    unsigned int nTweak;
+    uint32_t nDataSize;
+    uint64_t nHashKey0;
+    uint64_t nHashKey1;
     int nHashFuncs;
+
+    void InsertHash(uint64_t nHash);
+    bool ContainsHash(uint64_t nHash) const;
+};
+
+/**
+ * SolarCoin: A rolling bloom filter whose capacity follows the rate of insertion. It starts with
+ * room for nMinElements and doubles, up to nMaxElements, whenever half of its capacity is
+ * inserted within nMinAge seconds. The smaller filter is still consulted until the larger one
+ * has seen as many entries, so growing never forgets an entry early.
+ */
+class CAdaptiveRollingBloomFilter
+{
+public:
+    CAdaptiveRollingBloomFilter(unsigned int nMinElementsIn, unsigned int nMaxElementsIn, double fpRateIn, int64_t nMinAgeIn);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+
+    //! The number of most recent entries that are remembered at least
+    unsigned int GetCapacity() const { return nElements; }
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    const unsigned int nMaxElements;
+    const double fpRate;
+    const int64_t nMinAge;
+
+    unsigned int nElements;
+    CRollingBloomFilter filter;
+    unsigned int nInserted;
+    std::unique_ptr<CRollingBloomFilter> filterPrev;
+    unsigned int nPrevElements;
+
+    unsigned int nInsertedPeriod;
+    int64_t nPeriodStart;
 };
 
 #endif // BITCOIN_BLOOM_H
@@ -5,6 +5,8 @@
 
 #include "chain.h"
 
+#include <mutex>
+
 /**
  * CChain implementation
  */
@@ -117,12 +119,39 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
-arith_uint256 GetBlockProof(const CBlockIndex& block)
+void CBlockIndex::BuildPrevOtherType(int nLastPowHeight)
+{
+    if (!pprev)
+        pprevOtherType = NULL;
+    else if ((pprev->nHeight > nLastPowHeight) != (nHeight > nLastPowHeight) || !pprev->pprevOtherType)
+        pprevOtherType = pprev;
+    else
+        pprevOtherType = pprev->pprevOtherType;
+}
+
+namespace {
+
+/** SolarCoin: Entries of the compact target to block proof memo, a power of two */
+const unsigned int BLOCK_PROOF_CACHE_SIZE = 1024;
+
+struct CBlockProofCacheEntry
+{
+    uint32_t nBits;
+    bool fSet;
+    arith_uint256 proof;
+
+    CBlockProofCacheEntry() : nBits(0), fSet(false) {}
+};
+
+std::mutex csBlockProofCache;
+CBlockProofCacheEntry blockProofCache[BLOCK_PROOF_CACHE_SIZE];
+
+arith_uint256 ComputeBlockProof(uint32_t nBits)
 {
     arith_uint256 bnTarget;
     bool fNegative;
     bool fOverflow;
-    bnTarget.SetCompact(block.nBits, &fNegative, &fOverflow);
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
     if (fNegative || fOverflow || bnTarget == 0)
         return 0;
     // We need to compute 2**256 / (bnTarget+1), but we can't represent 2**256
@@ -132,6 +161,27 @@ arith_uint256 GetBlockProof(const CBlockIndex& block)
     return (~bnTarget / (bnTarget + 1)) + 1;
 }
 
+} // anon namespace
+
+arith_uint256 GetBlockProof(const CBlockIndex& block)
+{
+    // SolarCoin: Runs of blocks share their nBits, so the 256-bit division is done once per compact
+    // target rather than for every block index entry loaded or header accepted
+    const uint32_t nBits = block.nBits;
+    CBlockProofCacheEntry& entry = blockProofCache[((nBits * 0x9E3779B1U) >> 16) & (BLOCK_PROOF_CACHE_SIZE - 1)];
+    {
+        std::lock_guard<std::mutex> lock(csBlockProofCache);
+        if (entry.fSet && entry.nBits == nBits)
+            return entry.proof;
+    }
+    arith_uint256 proof = ComputeBlockProof(nBits);
+    std::lock_guard<std::mutex> lock(csBlockProofCache);
+    entry.nBits = nBits;
+    entry.proof = proof;
+    entry.fSet = true;
+    return proof;
+}
+
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params& params)
 {
     arith_uint256 r;
@@ -148,3 +198,20 @@ int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& fr
     }
     return sign * r.GetLow64();
 }
+
+const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb) {
+    if (pa->nHeight > pb->nHeight) {
+        pa = pa->GetAncestor(pb->nHeight);
+    } else if (pb->nHeight > pa->nHeight) {
+        pb = pb->GetAncestor(pa->nHeight);
+    }
+
+    while (pa != pb && pa && pb) {
+        pa = pa->pprev;
+        pb = pb->pprev;
+    }
+
+    // Eventually all chain branches meet at the genesis block.
+    assert(pa == pb);
+    return pa;
+}
@@ -147,6 +147,85 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    //! SolarCoin: AcceptBlock() accepted the proof of work of the stored block. This does not mean
+    //! scrypt ran on it: it is not hashed again for -assumevalid ancestors, nor when CheckBlock() or
+    //! the header checks already did. Reads of blk*.dat matching this index entry skip it the same way.
+    BLOCK_POW_VERIFIED       =   256,
+
+    //! SolarCoin: nStakeModifierChecksum is stored with the index entry, after the block header
+    BLOCK_HAVE_STAKE_CHECKSUM =  512,
+
+    //! SolarCoin: Only set in index entries on disk: nMint and nMoneySupply are zero (the block
+    //! is not connected yet, as for all headers fetched ahead of their blocks) and left out
+    BLOCK_DISK_NO_MINT       = 1024,
+};
+
+/**
+ * SolarCoin: First client version whose block index entries can have BLOCK_HAVE_STAKE_CHECKSUM set
+ * and the checksum stored. Entries of earlier versions are read without either, whatever their
+ * status says.
+ */
+static const int BLOCK_INDEX_STAKE_CHECKSUM_VERSION = 3140201;
+/**
+ * SolarCoin: First client version whose block index entries can have BLOCK_DISK_NO_MINT set and
+ * leave out nMint and nMoneySupply. Entries of earlier versions always have both.
+ */
+static const int BLOCK_INDEX_NO_MINT_VERSION = 3140201;
+
+/**
+ * SolarCoin: The fields of a block index entry that only proof-of-stake blocks have. They are only
+ * needed for the stake checks, so they are kept out of CBlockIndex, and proof-of-work entries,
+ * including all headers of the proof-of-work era, do without them.
+ */
+struct CBlockIndexStake
+{
+    COutPoint prevoutStake;
+    unsigned int nStakeTime;
+    uint256 hashProofOfStake;
+
+    CBlockIndexStake() : nStakeTime(0) {}
+};
+
+/** SolarCoin: Owning pointer to the CBlockIndexStake of an entry, if it has one. Copies copy the fields. */
+class CBlockIndexStakePtr
+{
+private:
+    CBlockIndexStake* p;
+
+public:
+    CBlockIndexStakePtr() : p(NULL) {}
+    CBlockIndexStakePtr(const CBlockIndexStakePtr& other) : p(other.p ? new CBlockIndexStake(*other.p) : NULL) {}
+    ~CBlockIndexStakePtr() { delete p; }
+
+    CBlockIndexStakePtr& operator=(const CBlockIndexStakePtr& other)
+    {
+        if (this != &other) {
+            CBlockIndexStake* pnew = other.p ? new CBlockIndexStake(*other.p) : NULL;
+            delete p;
+            p = pnew;
+        }
+        return *this;
+    }
+
+    const CBlockIndexStake& Get() const
+    {
+        static const CBlockIndexStake stakeNull;
+        return p ? *p : stakeNull;
+    }
+
+    CBlockIndexStake& GetForWrite()
+    {
+        if (!p)
+            p = new CBlockIndexStake();
+        return *p;
+    }
+
+    void Reset()
+    {
+        delete p;
+        p = NULL;
+    }
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -166,6 +245,9 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
+    //! (memory only) SolarCoin: last predecessor of the other block type (PoW or PoST, by height), or the genesis block
+    const CBlockIndex* pprevOtherType;
+
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
@@ -193,9 +275,6 @@ public:
     //! Verification status of this block. See enum BlockStatus
     unsigned int nStatus;
 
-    int64_t nMint;
-    uint64_t nMoneySupply;
-
     unsigned int nFlags;  // ppcoin: block index flags
     enum  
     {
@@ -204,13 +283,11 @@ public:
         BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
     };
 
-    uint64_t nStakeModifier; // hash modifier for proof-of-stake
-    unsigned int nStakeModifierChecksum; // checksum of index; in-memory only
+    int64_t nMint;
+    uint64_t nMoneySupply;
 
-    // proof-of-stake specific fields
-    COutPoint prevoutStake;
-    unsigned int nStakeTime;
-    uint256 hashProofOfStake;
+    uint64_t nStakeModifier; // hash modifier for proof-of-stake
+    unsigned int nStakeModifierChecksum; // checksum of index; stored when BLOCK_HAVE_STAKE_CHECKSUM is set
 
     //! block header
     int nVersion;
@@ -225,11 +302,31 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    //! SolarCoin: (memory only) GetMedianTimePast(), set by BuildMedianTimePast(); 0 if not set
+    unsigned int nMedianTimePast;
+
+    //! (memory only) SolarCoin: GetNextWorkRequired() (Kimoto Gravity Well) and GetNextTargetRequired() (PoST)
+    //! of a child of this block, or 0 if not computed yet. Guarded by cs_main; never invalidated, for the same reason.
+    mutable unsigned int nNextWorkRequired;
+    mutable unsigned int nNextTargetRequired;
+
+    //! (memory only) SolarCoin: GetPoSKernelPS() and GetAverageStakeWeight() of this block, or -1 if not computed yet.
+    //! Both only depend on this block and its ancestors, so they never need to be invalidated.
+    double dPoSKernelPS;
+    double dAverageStakeWeight;
+
+private:
+    //! SolarCoin: proof-of-stake fields, see CBlockIndexStake
+    CBlockIndexStakePtr stake;
+
+public:
+
     void SetNull()
     {
         phashBlock = NULL;
         pprev = NULL;
         pskip = NULL;
+        pprevOtherType = NULL;
         nHeight = 0;
         nFile = 0;
         nDataPos = 0;
@@ -240,15 +337,18 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        nMedianTimePast = 0;
+        dPoSKernelPS = -1;
+        dAverageStakeWeight = -1;
+        nNextWorkRequired = 0;
+        nNextTargetRequired = 0;
 
         nMint = 0;
         nMoneySupply = 0;
         nFlags = 0;
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
-        prevoutStake.SetNull();
-        nStakeTime = 0;
-        hashProofOfStake = uint256();
+        stake.Reset();
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -270,14 +370,7 @@ public:
         if (block.IsProofOfStake())
         {
             SetProofOfStake();
-            CTransaction tx = *block.vtx[1];
-            prevoutStake = tx.vin[0].prevout;
-            nStakeTime = tx.nTime;
-        }
-        else
-        {
-            prevoutStake.SetNull();
-            nStakeTime = 0;
+            SetStake(block.vtx[1]->vin[0].prevout, block.vtx[1]->nTime);
         }
 
         nVersion       = block.nVersion;
@@ -347,6 +440,20 @@ public:
     enum { nMedianTimeSpan=11 };
 
     int64_t GetMedianTimePast() const
+    {
+        // SolarCoin: an entry's ancestors and their times never change once it is in the block index
+        if (nMedianTimePast)
+            return nMedianTimePast;
+        return ComputeMedianTimePast();
+    }
+
+    //! SolarCoin: Cache GetMedianTimePast(), once pprev and the times of the ancestors are set
+    void BuildMedianTimePast()
+    {
+        nMedianTimePast = ComputeMedianTimePast();
+    }
+
+    int64_t ComputeMedianTimePast() const
     {
         int64_t pmedian[nMedianTimeSpan];
         int64_t* pbegin = &pmedian[nMedianTimeSpan];
@@ -400,6 +507,31 @@ public:
             nFlags |= BLOCK_STAKE_MODIFIER;
     }
 
+    const COutPoint& GetPrevoutStake() const { return stake.Get().prevoutStake; }
+    unsigned int GetStakeTime() const { return stake.Get().nStakeTime; }
+    const uint256& GetHashProofOfStake() const { return stake.Get().hashProofOfStake; }
+
+    //! SolarCoin: Set the kernel of a proof-of-stake block (null for others)
+    void SetStake(const COutPoint& prevout, unsigned int nTime)
+    {
+        if (prevout.IsNull() && nTime == 0 && GetHashProofOfStake().IsNull()) {
+            stake.Reset();
+            return;
+        }
+        CBlockIndexStake& s = stake.GetForWrite();
+        s.prevoutStake = prevout;
+        s.nStakeTime = nTime;
+    }
+
+    void SetHashProofOfStake(const uint256& hash)
+    {
+        if (hash.IsNull() && GetPrevoutStake().IsNull() && GetStakeTime() == 0) {
+            stake.Reset();
+            return;
+        }
+        stake.GetForWrite().hashProofOfStake = hash;
+    }
+
 
     std::string ToString() const
     {
@@ -416,8 +548,8 @@ public:
             FormatMoney(nMint).c_str(), FormatMoney(nMoneySupply).c_str(),
             GeneratedStakeModifier() ? "MOD" : "-", GetStakeEntropyBit(), IsProofOfStake()? "PoS" : "PoW",
             nStakeModifier, nStakeModifierChecksum,
-            hashProofOfStake.ToString().c_str(),
-            prevoutStake.ToString().c_str(), nStakeTime,
+            GetHashProofOfStake().ToString().c_str(),
+            GetPrevoutStake().ToString().c_str(), GetStakeTime(),
             hashMerkleRoot.ToString().c_str(),
             GetBlockHash().ToString().c_str());
     }
@@ -448,6 +580,9 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! SolarCoin: Build the pprevOtherType pointer for this entry. Blocks above nLastPowHeight are PoST blocks.
+    void BuildPrevOtherType(int nLastPowHeight);
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
@@ -457,6 +592,10 @@ arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
 
+/** Find the last common ancestor two blocks have.
+ *  Both pa and pb must be non-NULL. */
+const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb);
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
@@ -480,7 +619,20 @@ public:
             READWRITE(VARINT(nVersion));
 
         READWRITE(VARINT(nHeight));
-        READWRITE(VARINT(nStatus));
+        // SolarCoin: the status bits of the entry's version only, others are neither written nor read
+        unsigned int nVersionStatus = ~0u;
+        if (nVersion < BLOCK_INDEX_STAKE_CHECKSUM_VERSION)
+            nVersionStatus &= ~BLOCK_HAVE_STAKE_CHECKSUM;
+        if (nVersion < BLOCK_INDEX_NO_MINT_VERSION)
+            nVersionStatus &= ~BLOCK_DISK_NO_MINT;
+        unsigned int nDiskStatus = nStatus;
+        if (!ser_action.ForRead() && nMint == 0 && nMoneySupply == 0)
+            nDiskStatus |= BLOCK_DISK_NO_MINT;
+        nDiskStatus &= nVersionStatus;
+        READWRITE(VARINT(nDiskStatus));
+        nDiskStatus &= nVersionStatus;
+        if (ser_action.ForRead())
+            nStatus = nDiskStatus & ~BLOCK_DISK_NO_MINT;
         READWRITE(VARINT(nTx));
         if (nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO))
             READWRITE(VARINT(nFile));
@@ -489,21 +641,30 @@ public:
         if (nStatus & BLOCK_HAVE_UNDO)
             READWRITE(VARINT(nUndoPos));
 
-        // SolarCoin: PoST
-        READWRITE(VARINT(nMint));
-        READWRITE(VARINT(nMoneySupply));
+        // SolarCoin: PoST; the stake fields only for proof-of-stake blocks
+        if (nDiskStatus & BLOCK_DISK_NO_MINT) {
+            nMint = 0;
+            nMoneySupply = 0;
+        } else {
+            READWRITE(VARINT(nMint));
+            READWRITE(VARINT(nMoneySupply));
+        }
         READWRITE(VARINT(nFlags));
         READWRITE(VARINT(nStakeModifier));
         if (IsProofOfStake()) {
+            COutPoint prevoutStake = GetPrevoutStake();
+            unsigned int nStakeTime = GetStakeTime();
+            uint256 hashProofOfStake = GetHashProofOfStake();
             READWRITE(prevoutStake);
             READWRITE(nStakeTime);
             READWRITE(hashProofOfStake);
-        } else {
             if (ser_action.ForRead()) {
-                const_cast<CDiskBlockIndex*>(this)->prevoutStake.SetNull();
-                const_cast<CDiskBlockIndex*>(this)->nStakeTime = 0;
-                const_cast<CDiskBlockIndex*>(this)->hashProofOfStake = uint256();
+                SetStake(prevoutStake, nStakeTime);
+                SetHashProofOfStake(hashProofOfStake);
             }
+        } else if (ser_action.ForRead()) {
+            SetStake(COutPoint(), 0);
+            SetHashProofOfStake(uint256());
         }
 
         // block header
@@ -513,6 +674,10 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
+
+        // SolarCoin: appended last, so versions that do not know the flag ignore it
+        if (nDiskStatus & BLOCK_HAVE_STAKE_CHECKSUM)
+            READWRITE(VARINT(nStakeModifierChecksum));
     }
 
     uint256 GetBlockHash() const
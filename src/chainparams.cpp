@@ -89,6 +89,8 @@ public:
         
         consensus.nStakeMinAge = 8 * 60 * 60; // SolarCoin: 8 hours proof-of-stake min age
         consensus.nModifierInterval = 10 * 60; // SolarCoin: 10 minute time interval modifier 
+        consensus.LAST_POW_BLOCK = 835213;
+        consensus.TWO_PERCENT_INT_HEIGHT = consensus.LAST_POW_BLOCK + 1000;
 
         consensus.fAllowMinDifficultyBlocks = false;
         consensus.fPowNoRetargeting = false;
@@ -214,6 +216,8 @@ public:
         consensus.nTargetTimespan_Version1 = 24 * 60 * 60; // 24 hours
         consensus.nTargetSpacing = 1 * 60; // 1 minute
         consensus.fAllowMinDifficultyBlocks = true;
+        consensus.LAST_POW_BLOCK = 835213;
+        consensus.TWO_PERCENT_INT_HEIGHT = consensus.LAST_POW_BLOCK + 1000;
 
         consensus.nHeight_Version2 = 208440;
         consensus.nInterval_Version2 = 15;
@@ -311,6 +315,13 @@ public:
         consensus.nTargetSpacing = 2.5 * 60;
         consensus.fAllowMinDifficultyBlocks = true;
         consensus.fPowNoRetargeting = true;
+        // SolarCoin: PoST starts at the mainnet height unless -regtestpost moves it down
+        consensus.posLimit = consensus.powLimit;
+        consensus.nTargetTimespan = 16 * 60;
+        consensus.nStakeMinAge = 8 * 60 * 60;
+        consensus.nModifierInterval = 10 * 60;
+        consensus.LAST_POW_BLOCK = 835213;
+        consensus.TWO_PERCENT_INT_HEIGHT = consensus.LAST_POW_BLOCK + 1000;
         consensus.nRuleChangeActivationThreshold = 108; // 75% for testchains
         consensus.nMinerConfirmationWindow = 144; // Faster than normal for regtest (144 instead of 2016)
         consensus.vDeployments[Consensus::DEPLOYMENT_TESTDUMMY].bit = 28;
@@ -374,6 +385,14 @@ public:
         consensus.vDeployments[d].nStartTime = nStartTime;
         consensus.vDeployments[d].nTimeout = nTimeout;
     }
+
+    void UpdateStakingParameters(int nLastPowBlock, unsigned int nStakeMinAge, unsigned int nModifierInterval)
+    {
+        consensus.LAST_POW_BLOCK = nLastPowBlock;
+        consensus.TWO_PERCENT_INT_HEIGHT = nLastPowBlock;
+        consensus.nStakeMinAge = nStakeMinAge;
+        consensus.nModifierInterval = nModifierInterval;
+    }
 };
 static CRegTestParams regTestParams;
 
@@ -406,4 +425,9 @@ void UpdateRegtestBIP9Parameters(Consensus::DeploymentPos d, int64_t nStartTime,
 {
     regTestParams.UpdateBIP9Parameters(d, nStartTime, nTimeout);
 }
+
+void UpdateRegtestStakingParameters(int nLastPowBlock, unsigned int nStakeMinAge, unsigned int nModifierInterval)
+{
+    regTestParams.UpdateStakingParameters(nLastPowBlock, nStakeMinAge, nModifierInterval);
+}
  
@@ -119,4 +119,15 @@ void SelectParams(const std::string& chain);
  */
 void UpdateRegtestBIP9Parameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
 
+//! SolarCoin: -regtestpost stake min age, in the mainnet ratio to the modifier interval
+static const unsigned int REGTEST_POST_STAKE_MIN_AGE = 96;
+//! SolarCoin: -regtestpost stake modifier interval
+static const unsigned int REGTEST_POST_MODIFIER_INTERVAL = 2;
+
+/**
+ * SolarCoin: Allows switching regtest to PoST after nLastPowBlock, with the given stake min age
+ * and stake modifier interval. The interest rate is fixed from the first PoST block on.
+ */
+void UpdateRegtestStakingParameters(int nLastPowBlock, unsigned int nStakeMinAge, unsigned int nModifierInterval);
+
 #endif // BITCOIN_CHAINPARAMS_H
@@ -5,7 +5,11 @@
 #ifndef BITCOIN_CHECKQUEUE_H
 #define BITCOIN_CHECKQUEUE_H
 
+#include "reverselock.h"
+
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -13,9 +17,104 @@
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 
+
 template <typename T>
 class CCheckQueueControl;
 
+/** SolarCoin: The priority classes of the check queues sharing a CCheckPool, most urgent first */
+enum CheckPriority
+{
+    CHECK_PRIORITY_TIP = 0,        //!< A block or headers extending the chain being followed
+    CHECK_PRIORITY_MEMPOOL = 1,    //!< Transactions for the mempool
+    CHECK_PRIORITY_BACKGROUND = 2, //!< Reindex and block import
+    CHECK_PRIORITY_COUNT
+};
+
+/** What a CCheckPool knows of a queue, independently of the type of its checks */
+class CCheckQueueBase
+{
+public:
+    virtual ~CCheckQueueBase() {}
+
+    //! Take a batch of the queued checks and run it, false if there were none
+    virtual bool RunBatch() = 0;
+    virtual bool IsEmpty() = 0;
+};
+
+/**
+ * SolarCoin: Worker threads shared by the check queues constructed with the pool, so one set of
+ * -par threads serves all the verification work. A worker runs a batch of the most urgent queue
+ * with checks pending, so a tip block is never starved by mempool or background checks. The
+ * master of each queue still joins in while it waits, as with dedicated threads.
+ */
+class CCheckPool
+{
+private:
+    //! Mutex to protect the inner state, taken before a queue's own
+    boost::mutex mutex;
+
+    //! Worker threads block on this when no queue has checks
+    boost::condition_variable condWorker;
+
+    //! The queues with checks pending, by priority
+    std::deque<CCheckQueueBase*> vPending[CHECK_PRIORITY_COUNT];
+
+    //! The number of worker threads, read by the queues under their own lock
+    std::atomic<int> nThreads;
+
+public:
+    CCheckPool() : nThreads(0) {}
+
+    //! Worker thread
+    void Thread()
+    {
+        nThreads++;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true) {
+            CCheckQueueBase* pqueue = NULL;
+            for (int nPriority = 0; nPriority < CHECK_PRIORITY_COUNT && !pqueue; nPriority++) {
+                if (!vPending[nPriority].empty())
+                    pqueue = vPending[nPriority].front();
+            }
+            if (!pqueue) {
+                // Interruption point of thread shutdown
+                condWorker.wait(lock);
+                continue;
+            }
+            bool fRan;
+            {
+                reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+                fRan = pqueue->RunBatch();
+            }
+            // Checked again under the lock, as checks added meanwhile found the queue still pending
+            if (!fRan && pqueue->IsEmpty()) {
+                for (std::deque<CCheckQueueBase*>& vQueues : vPending)
+                    vQueues.erase(std::remove(vQueues.begin(), vQueues.end(), pqueue), vQueues.end());
+            }
+        }
+    }
+
+    //! Checks were added to a queue
+    void Schedule(CCheckQueueBase* pqueue, int nPriority, size_t nChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (const std::deque<CCheckQueueBase*>& vQueues : vPending) {
+            if (std::find(vQueues.begin(), vQueues.end(), pqueue) != vQueues.end())
+                return condWorker.notify_all();
+        }
+        vPending[nPriority].push_back(pqueue);
+        if (nChecks == 1)
+            condWorker.notify_one();
+        else
+            condWorker.notify_all();
+    }
+
+    int GetThreads() const
+    {
+        return nThreads;
+    }
+};
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,9 +124,12 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * SolarCoin: The worker threads are either the queue's own, running Thread(), or those of the
+  * CCheckPool it was constructed with.
   */
 template <typename T>
-class CCheckQueue
+class CCheckQueue : public CCheckQueueBase
 {
 private:
     //! Mutex to protect the inner state
@@ -65,6 +167,28 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The pool running the checks, NULL if the queue has its own threads
+    CCheckPool* ppool;
+
+    //! The priority of the checks in the pool, set for each master
+    int nPriority;
+
+    /**
+     * Take the next batch of checks (lock held). Aim for increasingly smaller batches so all
+     * workers finish approximately simultaneously, accounting for nWorkers that help.
+     */
+    void TakeBatch(std::vector<T>& vChecks, int nWorkers)
+    {
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nWorkers + 1)));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // We want the lock on the mutex to be as short as possible, so swap jobs from the global
+            // queue to the local batch vector instead of copying.
+            vChecks[i].swap(queue.back());
+            queue.pop_back();
+        }
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
@@ -107,14 +231,8 @@ private:
                 //   all workers finish approximately simultaneously.
                 // * Try to account for idle jobs which will instantly start helping.
                 // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+                TakeBatch(vChecks, ppool ? nTotal + ppool->GetThreads() : nTotal + nIdle);
+                nNow = vChecks.size();
                 // Check whether we need to do work at all
                 fOk = fAllOk;
             }
@@ -128,7 +246,45 @@ private:
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn, CCheckPool* ppoolIn = NULL) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn), ppool(ppoolIn), nPriority(CHECK_PRIORITY_TIP) {}
+
+    //! Run a batch on a thread of the pool
+    bool RunBatch() override
+    {
+        std::vector<T> vChecks;
+        bool fOk;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (queue.empty())
+                return false;
+            TakeBatch(vChecks, nTotal + ppool->GetThreads());
+            fOk = fAllOk;
+        }
+        for (T& check : vChecks)
+            if (fOk)
+                fOk = check();
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fAllOk &= fOk;
+            nTodo -= vChecks.size();
+            if (nTodo == 0)
+                condMaster.notify_one();
+        }
+        return true;
+    }
+
+    bool IsEmpty() override
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return queue.empty();
+    }
+
+    //! Set the priority in the pool of the checks added from now on
+    void SetPriority(int nPriorityIn)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nPriority = nPriorityIn;
+    }
 
     //! Worker thread
     void Thread()
@@ -145,16 +301,25 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        int nPriorityNow;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            BOOST_FOREACH (T& check, vChecks) {
+                queue.push_back(T());
+                check.swap(queue.back());
+            }
+            nTodo += vChecks.size();
+            nPriorityNow = nPriority;
+            if (!ppool) {
+                if (vChecks.size() == 1)
+                    condWorker.notify_one();
+                else if (vChecks.size() > 1)
+                    condWorker.notify_all();
+            }
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        // Without the queue's lock, which the pool takes after its own
+        if (ppool && !vChecks.empty())
+            ppool->Schedule(this, nPriorityNow, vChecks.size());
     }
 
     ~CCheckQueue()
@@ -181,12 +346,13 @@ private:
     bool fDone;
 
 public:
-    CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
+    CCheckQueueControl(CCheckQueue<T>* pqueueIn, int nPriority = CHECK_PRIORITY_TIP) : pqueue(pqueueIn), fDone(false)
     {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
             bool isIdle = pqueue->IsIdle();
             assert(isIdle);
+            pqueue->SetPriority(nPriority);
         }
     }
 
@@ -17,7 +17,7 @@
 #define CLIENT_VERSION_MAJOR 3
 #define CLIENT_VERSION_MINOR 14
 #define CLIENT_VERSION_REVISION 2
-#define CLIENT_VERSION_BUILD 0
+#define CLIENT_VERSION_BUILD 1
 
 //! Set to true for release, false for prerelease or test build
 #define CLIENT_VERSION_IS_RELEASE true
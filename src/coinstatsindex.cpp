@@ -0,0 +1,249 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstatsindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "sync.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <memory>
+
+static const char DB_BLOCK_STATS = 's';
+static const char DB_RUNNING_STATS = 'S';
+static const char DB_BEST_BLOCK = 'B';
+
+CCoinStatsIndex* pcoinstatsindex = NULL;
+
+namespace {
+
+/** The running statistics, as written with the best block */
+struct CRunningCoinStats
+{
+    uint64_t nTxOuts;
+    CAmount nTotalAmount;
+    unsigned char vchMuHash[MuHash3072::SERIALIZED_SIZE];
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nTxOuts));
+        READWRITE(nTotalAmount);
+        READWRITE(FLATDATA(vchMuHash));
+    }
+};
+
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const CTxOut& out, bool fInsert)
+{
+    // Only the outpoint and output are hashed: the undo data of blocks from before the per-output
+    // format do not always have the height of the spent output
+    CDataStream ss(SER_DISK, 0);
+    ss << outpoint << out;
+    if (fInsert)
+        muhash.Insert((const unsigned char*)ss.data(), ss.size());
+    else
+        muhash.Remove((const unsigned char*)ss.data(), ss.size());
+}
+
+CCoinStatsIndex::CCoinStatsIndex(size_t nCacheSize, bool fWipe) :
+    db(GetDataDir() / "indexes" / "coinstats", nCacheSize, false, fWipe), batch(db), nTxOuts(0), nTotalAmount(0), fDirty(false)
+{
+}
+
+bool CCoinStatsIndex::ReadCoinsDB(std::string& strError)
+{
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    muhash = MuHash3072();
+    nTxOuts = 0;
+    nTotalAmount = 0;
+    if (!pindexTip->pprev) {
+        WriteBlockStats(pindexTip);
+        return true;
+    }
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    if (pcursor->GetBestBlock() != pindexTip->GetBlockHash()) {
+        strError = _("The chain state database is not at the tip for the coin statistics index");
+        return false;
+    }
+    LogPrintf("%s: reading the unspent outputs at height %d\n", __func__, pindexTip->nHeight);
+    while (pcursor->Valid()) {
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin)) {
+            strError = _("Error reading the chain state database");
+            return false;
+        }
+        ApplyCoinHash(muhash, outpoint, coin.out, true);
+        nTxOuts++;
+        nTotalAmount += coin.out.nValue;
+        pcursor->Next();
+    }
+    WriteBlockStats(pindexTip);
+    return true;
+}
+
+bool CCoinStatsIndex::Init(std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    if (!chainActive.Tip())
+        return true;
+
+    const CBlockIndex* pindexBest = NULL;
+    uint256 hashBest;
+    CRunningCoinStats running;
+    if (db.Read(DB_BEST_BLOCK, hashBest) && db.Read(DB_RUNNING_STATS, running)) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+        if (it == mapBlockIndex.end()) {
+            strError = _("The coin statistics index is at an unknown block");
+            return false;
+        }
+        pindexBest = it->second;
+        nTxOuts = running.nTxOuts;
+        nTotalAmount = running.nTotalAmount;
+        muhash.FromBytes(running.vchMuHash);
+    }
+
+    // Blocks that were disconnected since, or of which the chain state was not written before a
+    // crash: the latter are added again as they are reconnected
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    while (pindexBest && !chainActive.Contains(pindexBest)) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindexBest, consensusParams) || pindexBest->GetUndoPos().IsNull() ||
+            !UndoReadFromDisk(blockundo, pindexBest->GetUndoPos(), pindexBest->pprev->GetBlockHash())) {
+            strError = _("Error reading a block to undo from the coin statistics index");
+            return false;
+        }
+        LogPrintf("%s: undoing block %s at height %d\n", __func__, pindexBest->GetBlockHash().ToString(), pindexBest->nHeight);
+        UpdateBlock(block, blockundo, pindexBest, false);
+        pindexBest = pindexBest->pprev;
+    }
+
+    // The statistics of the blocks in between are not known, but those of the blocks from here on
+    // are as good as if the index had been on
+    if (pindexBest != chainActive.Tip() && !ReadCoinsDB(strError))
+        return false;
+
+    if (!WriteBatch(chainActive.Tip()->GetBlockHash())) {
+        strError = _("Error writing to the coin statistics index");
+        return false;
+    }
+    LogPrintf("%s: coin statistics index at height %d, %u outputs\n", __func__, chainActive.Height(), nTxOuts);
+    return true;
+}
+
+void CCoinStatsIndex::UpdateBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, bool fConnect)
+{
+    // The transactions of the genesis block are not connected
+    if (!pindex->pprev || blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return;
+    fDirty = true;
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        // Unspendable outputs are never added to the chain state
+        for (uint32_t k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            if (out.scriptPubKey.IsUnspendable())
+                continue;
+            ApplyCoinHash(muhash, COutPoint(txid, k), out, fConnect);
+            if (fConnect) {
+                nTxOuts++;
+                nTotalAmount += out.nValue;
+            } else {
+                nTxOuts--;
+                nTotalAmount -= out.nValue;
+            }
+        }
+
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (size_t j = 0; j < tx.vin.size() && j < txundo.vprevout.size(); j++) {
+                const CTxOut& out = txundo.vprevout[j].out;
+                ApplyCoinHash(muhash, tx.vin[j].prevout, out, !fConnect);
+                if (fConnect) {
+                    nTxOuts--;
+                    nTotalAmount -= out.nValue;
+                } else {
+                    nTxOuts++;
+                    nTotalAmount += out.nValue;
+                }
+            }
+        }
+    }
+}
+
+void CCoinStatsIndex::WriteBlockStats(const CBlockIndex* pindex)
+{
+    CBlockCoinStats stats;
+    stats.nHeight = pindex->nHeight;
+    stats.nTxOuts = nTxOuts;
+    stats.nTotalAmount = nTotalAmount;
+    unsigned char hash[32];
+    muhash.Finalize(hash);
+    stats.hashMuHash = uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+    batch.Write(std::make_pair(DB_BLOCK_STATS, pindex->GetBlockHash()), stats);
+    fDirty = true;
+}
+
+bool CCoinStatsIndex::WriteBatch(const uint256& hashBest)
+{
+    CRunningCoinStats running;
+    running.nTxOuts = nTxOuts;
+    running.nTotalAmount = nTotalAmount;
+    muhash.ToBytes(running.vchMuHash);
+    batch.Write(DB_RUNNING_STATS, running);
+    batch.Write(DB_BEST_BLOCK, hashBest);
+    bool fWritten = db.WriteBatch(batch);
+    batch.Clear();
+    fDirty = false;
+    return fWritten;
+}
+
+bool CCoinStatsIndex::ConnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    UpdateBlock(block, blockundo, pindex, true);
+    WriteBlockStats(pindex);
+    return true;
+}
+
+bool CCoinStatsIndex::DisconnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // The record of the disconnected block stays: it is still right for that block
+    UpdateBlock(block, blockundo, pindex, false);
+    return true;
+}
+
+bool CCoinStatsIndex::Flush(const uint256& hashBest)
+{
+    AssertLockHeld(cs_main);
+    if (!fDirty)
+        return true;
+    return WriteBatch(hashBest);
+}
+
+bool CCoinStatsIndex::GetStats(const CBlockIndex* pindex, CBlockCoinStats& stats)
+{
+    {
+        LOCK(cs_main);
+        if (!Flush(pcoinsTip->GetBestBlock()))
+            return error("%s: failed to write to the coin statistics index", __func__);
+    }
+    return db.Read(std::make_pair(DB_BLOCK_STATS, pindex->GetBlockHash()), stats);
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATSINDEX_H
+#define BITCOIN_COINSTATSINDEX_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class COutPoint;
+class CTxOut;
+
+/** Default for -coinstatsindex */
+static const bool DEFAULT_COINSTATSINDEX = false;
+/** Database cache of the coin statistics index */
+static const size_t COIN_STATS_INDEX_CACHE_SIZE = 2 << 20;
+
+/** The unspent transaction output set after a block */
+struct CBlockCoinStats
+{
+    int nHeight;
+    uint64_t nTxOuts;
+    CAmount nTotalAmount;
+    //! MuHash3072 of the outputs, each as its outpoint and CTxOut
+    uint256 hashMuHash;
+
+    CBlockCoinStats() : nHeight(-1), nTxOuts(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nTxOuts));
+        READWRITE(nTotalAmount);
+        READWRITE(hashMuHash);
+    }
+};
+
+/** Add an unspent output to a set hash, or remove it */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const CTxOut& out, bool fInsert);
+
+/**
+ * SolarCoin: The coin statistics index (-coinstatsindex), in its own database under
+ * indexes/coinstats: the output count, total amount and MuHash3072 of the unspent output set
+ * after each block, so gettxoutsetinfo answers at once, for any block of the active chain, instead
+ * of reading the whole chain state.
+ *
+ * It follows the active chain like the address index: the running statistics are updated from the
+ * undo data of each block in ConnectTip() and DisconnectTip(), and written with the coins database
+ * (before it). A new index, or one that fell behind, starts from one pass over the chain state;
+ * the blocks before that have statistics only after a -reindex-chainstate.
+ */
+class CCoinStatsIndex
+{
+private:
+    CDBWrapper db;
+    //! Statistics of the blocks connected since the last write (protected by cs_main)
+    CDBBatch batch;
+    //! The running statistics of the unspent output set at the tip (protected by cs_main)
+    MuHash3072 muhash;
+    uint64_t nTxOuts;
+    CAmount nTotalAmount;
+    //! Whether anything changed since the last write
+    bool fDirty;
+
+    //! Add or remove the outputs created and spent by a block
+    void UpdateBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, bool fConnect);
+    //! Record the running statistics as those after pindex
+    void WriteBlockStats(const CBlockIndex* pindex);
+    //! Write out the pending records and the running statistics, at hashBest
+    bool WriteBatch(const uint256& hashBest);
+    //! Start over from the unspent outputs in the coins database
+    bool ReadCoinsDB(std::string& strError);
+
+public:
+    CCoinStatsIndex(size_t nCacheSize, bool fWipe);
+
+    /**
+     * Undo the blocks the index has beyond the active chain, or start it from the chain state
+     * when it is new or behind; needs cs_main.
+     */
+    bool Init(std::string& strError);
+
+    /** Add the outputs of a block connected to the tip; needs cs_main */
+    bool ConnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    /** Remove the outputs of the tip being disconnected; needs cs_main */
+    bool DisconnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    /** Write out the pending changes, which bring the index to hashBest; needs cs_main */
+    bool Flush(const uint256& hashBest);
+
+    /** The statistics after a block; false if the index has none for it */
+    bool GetStats(const CBlockIndex* pindex, CBlockCoinStats& stats);
+};
+
+/** The coin statistics index, NULL unless -coinstatsindex */
+extern CCoinStatsIndex* pcoinstatsindex;
+
+#endif // BITCOIN_COINSTATSINDEX_H
@@ -44,9 +44,20 @@
 #include <ifaddrs.h>
 #include <limits.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #endif
 
+// SolarCoin: The socket thread waits with epoll or kqueue where available, and with select() otherwise
+#if defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#elif defined(HAVE_SYS_EVENT_H)
+#define USE_KQUEUE
+#endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+#define USE_SOCKET_EVENTS
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT        0
 #else
@@ -84,7 +95,7 @@ size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_SOCKET_EVENTS)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -73,10 +73,12 @@ struct Params {
     // Fork params
     static const int FORK_HEIGHT_1 = 1177000;
     static const int FORK_HEIGHT_2 = 1440000;
-    static const int LAST_POW_BLOCK = 835213;
+    /** SolarCoin: Last PoW block, set per network so regtest can switch to PoST early (-regtestpost) */
+    int LAST_POW_BLOCK;
 
     // PoS params
-    static const int TWO_PERCENT_INT_HEIGHT = LAST_POW_BLOCK + 1000;
+    /** Height above which the interest rate is fixed at TWO_PERCENT_INT */
+    int TWO_PERCENT_INT_HEIGHT;
     static const int64_t INITIAL_COIN_SUPPLY = 34145512; // Used in calculating interest rate (97.990085882B are out of circulation)
     static constexpr double COIN_SUPPLY_GROWTH_RATE = 1.35;
     static constexpr int TWO_PERCENT_INT = 2.0;
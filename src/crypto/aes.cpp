@@ -12,6 +12,106 @@ extern "C" {
 #include "crypto/ctaes/ctaes.c"
 }
 
+#if defined(ENABLE_AES_NI)
+#include <cpuid.h>
+
+namespace aes_ni
+{
+uint32_t SubWord(uint32_t w);
+void InvMixColumns(unsigned char out[16], const unsigned char in[16]);
+void Encrypt256(const unsigned char* rk, unsigned char out[16], const unsigned char in[16]);
+void Decrypt256(const unsigned char* dk, unsigned char* out, const unsigned char* in, size_t blocks);
+}
+#endif
+
+#if defined(ENABLE_AES_ARMV8)
+#if !defined(__ARM_FEATURE_CRYPTO)
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#endif
+
+namespace aes_armv8
+{
+uint32_t SubWord(uint32_t w);
+void InvMixColumns(unsigned char out[16], const unsigned char in[16]);
+void Encrypt256(const unsigned char* rk, unsigned char out[16], const unsigned char in[16]);
+void Decrypt256(const unsigned char* dk, unsigned char* out, const unsigned char* in, size_t blocks);
+}
+#endif
+
+namespace
+{
+typedef uint32_t (*SubWordType)(uint32_t);
+typedef void (*InvMixColumnsType)(unsigned char*, const unsigned char*);
+typedef void (*Encrypt256Type)(const unsigned char*, unsigned char*, const unsigned char*);
+typedef void (*Decrypt256Type)(const unsigned char*, unsigned char*, const unsigned char*, size_t);
+
+//! SolarCoin: the hardware AES-256 code selected by AESAutoDetect(), or NULL for ctaes
+SubWordType SubWord = NULL;
+InvMixColumnsType InvMixColumns = NULL;
+Encrypt256Type Encrypt256 = NULL;
+Decrypt256Type Decrypt256 = NULL;
+
+/** The AES-256 key schedule of FIPS 197, with the SubBytes of the hardware code. */
+void ExpandKey256(unsigned char rk[AES256_ROUNDKEYS_SIZE], const unsigned char key[AES256_KEYSIZE])
+{
+    uint32_t w[60];
+    uint32_t rcon = 1;
+    for (int i = 0; i < 8; i++)
+        w[i] = ReadLE32(key + 4 * i);
+    for (int i = 8; i < 60; i++) {
+        uint32_t t = w[i - 1];
+        if (i % 8 == 0) {
+            // RotWord moves the first byte, the low one, to the end
+            t = SubWord((t >> 8) | (t << 24)) ^ rcon;
+            rcon = (rcon << 1) ^ ((rcon >> 7) * 0x11b);
+        } else if (i % 8 == 4) {
+            t = SubWord(t);
+        }
+        w[i] = w[i - 8] ^ t;
+    }
+    for (int i = 0; i < 60; i++)
+        WriteLE32(rk + 4 * i, w[i]);
+    memset(w, 0, sizeof(w));
+}
+}
+
+std::string AESAutoDetect(bool fUseHardware)
+{
+    SubWord = NULL;
+    InvMixColumns = NULL;
+    Encrypt256 = NULL;
+    Decrypt256 = NULL;
+
+#if defined(ENABLE_AES_NI)
+    uint32_t eax, ebx, ecx, edx;
+    if (fUseHardware && __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 25))) {
+        SubWord = &aes_ni::SubWord;
+        InvMixColumns = &aes_ni::InvMixColumns;
+        Encrypt256 = &aes_ni::Encrypt256;
+        Decrypt256 = &aes_ni::Decrypt256;
+        return "aes256: using aes-ni";
+    }
+#endif
+#if defined(ENABLE_AES_ARMV8)
+#if defined(__ARM_FEATURE_CRYPTO)
+    bool fHardware = fUseHardware;
+#else
+    bool fHardware = fUseHardware && (getauxval(AT_HWCAP) & HWCAP_AES);
+#endif
+    if (fHardware) {
+        SubWord = &aes_armv8::SubWord;
+        InvMixColumns = &aes_armv8::InvMixColumns;
+        Encrypt256 = &aes_armv8::Encrypt256;
+        Decrypt256 = &aes_armv8::Decrypt256;
+        return "aes256: using armv8";
+    }
+#endif
+    return "aes256: using ctaes";
+}
+
 AES128Encrypt::AES128Encrypt(const unsigned char key[16])
 {
     AES128_init(&ctx, key);
@@ -42,34 +142,67 @@ void AES128Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char cip
     AES128_decrypt(&ctx, 1, plaintext, ciphertext);
 }
 
-AES256Encrypt::AES256Encrypt(const unsigned char key[32])
+void AES128Decrypt::Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const
 {
-    AES256_init(&ctx, key);
+    AES128_decrypt(&ctx, blocks, plaintext, ciphertext);
+}
+
+AES256Encrypt::AES256Encrypt(const unsigned char key[32]) : fHardware(Encrypt256 != NULL)
+{
+    if (fHardware)
+        ExpandKey256(rk, key);
+    else
+        AES256_init(&ctx, key);
 }
 
 AES256Encrypt::~AES256Encrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(rk, 0, sizeof(rk));
 }
 
 void AES256Encrypt::Encrypt(unsigned char ciphertext[16], const unsigned char plaintext[16]) const
 {
-    AES256_encrypt(&ctx, 1, ciphertext, plaintext);
+    if (fHardware)
+        Encrypt256(rk, ciphertext, plaintext);
+    else
+        AES256_encrypt(&ctx, 1, ciphertext, plaintext);
 }
 
-AES256Decrypt::AES256Decrypt(const unsigned char key[32])
+AES256Decrypt::AES256Decrypt(const unsigned char key[32]) : fHardware(Decrypt256 != NULL)
 {
-    AES256_init(&ctx, key);
+    if (fHardware) {
+        // The equivalent inverse cipher takes the round keys in reverse order, with
+        // InvMixColumns applied to all but the first and the last
+        unsigned char rk[AES256_ROUNDKEYS_SIZE];
+        ExpandKey256(rk, key);
+        memcpy(dk, rk + 14 * AES_BLOCKSIZE, AES_BLOCKSIZE);
+        for (int r = 1; r < 14; r++)
+            InvMixColumns(dk + r * AES_BLOCKSIZE, rk + (14 - r) * AES_BLOCKSIZE);
+        memcpy(dk + 14 * AES_BLOCKSIZE, rk, AES_BLOCKSIZE);
+        memset(rk, 0, sizeof(rk));
+    } else {
+        AES256_init(&ctx, key);
+    }
 }
 
 AES256Decrypt::~AES256Decrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(dk, 0, sizeof(dk));
 }
 
 void AES256Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const
 {
-    AES256_decrypt(&ctx, 1, plaintext, ciphertext);
+    Decrypt(plaintext, ciphertext, 1);
+}
+
+void AES256Decrypt::Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const
+{
+    if (fHardware)
+        Decrypt256(dk, plaintext, ciphertext, blocks);
+    else
+        AES256_decrypt(&ctx, blocks, plaintext, ciphertext);
 }
 
 
@@ -124,8 +257,9 @@ static int CBCDecrypt(const T& dec, const unsigned char iv[AES_BLOCKSIZE], const
         return 0;
 
     // Decrypt all data. Padding will be checked in the output.
+    // SolarCoin: the blocks are decrypted together, which the hardware code interleaves
+    dec.Decrypt(out, data, size / AES_BLOCKSIZE);
     while (written != size) {
-        dec.Decrypt(out, data + written);
         for (int i = 0; i != AES_BLOCKSIZE; i++)
             *out++ ^= prev[i];
         prev = data + written;
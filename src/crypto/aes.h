@@ -11,9 +11,24 @@ extern "C" {
 #include "crypto/ctaes/ctaes.h"
 }
 
+#include <stddef.h>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__amd64__)) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+//! The compiler can build AES-NI functions into a baseline x86-64 binary
+#define ENABLE_AES_NI 1
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || (defined(__linux__) && !defined(__clang__) && __GNUC__ >= 6))
+//! The ARMv8 AES instructions are in the baseline, or can be detected and built in through the target attribute
+#define ENABLE_AES_ARMV8 1
+#endif
+
 static const int AES_BLOCKSIZE = 16;
 static const int AES128_KEYSIZE = 16;
 static const int AES256_KEYSIZE = 32;
+//! SolarCoin: the 15 round keys of AES-256
+static const int AES256_ROUNDKEYS_SIZE = 15 * AES_BLOCKSIZE;
 
 /** An encryption class for AES-128. */
 class AES128Encrypt
@@ -37,6 +52,7 @@ public:
     AES128Decrypt(const unsigned char key[16]);
     ~AES128Decrypt();
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
+    void Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const;
 };
 
 /** An encryption class for AES-256. */
@@ -44,6 +60,9 @@ class AES256Encrypt
 {
 private:
     AES256_ctx ctx;
+    //! SolarCoin: the round keys instead, if AESAutoDetect() had selected the hardware code
+    unsigned char rk[AES256_ROUNDKEYS_SIZE];
+    bool fHardware;
 
 public:
     AES256Encrypt(const unsigned char key[32]);
@@ -56,11 +75,15 @@ class AES256Decrypt
 {
 private:
     AES256_ctx ctx;
+    //! SolarCoin: the round keys of the equivalent inverse cipher instead, if AESAutoDetect() had selected the hardware code
+    unsigned char dk[AES256_ROUNDKEYS_SIZE];
+    bool fHardware;
 
 public:
     AES256Decrypt(const unsigned char key[32]);
     ~AES256Decrypt();
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
+    void Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const;
 };
 
 class AES256CBCEncrypt
@@ -115,4 +138,11 @@ private:
     unsigned char iv[AES_BLOCKSIZE];
 };
 
+/**
+ * SolarCoin: select the AES-NI or ARMv8 code for AES-256 when the CPU has it, and ctaes
+ * otherwise or if fUseHardware is false. Only affects objects constructed afterwards.
+ * Returns a description of the selection.
+ */
+std::string AESAutoDetect(bool fUseHardware = true);
+
 #endif // BITCOIN_CRYPTO_AES_H
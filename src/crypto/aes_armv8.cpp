@@ -0,0 +1,84 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// AES-256 using the ARMv8 cryptography extensions. aese and aesd add the round key before
+// the (inverse) ShiftRows and SubBytes, and aesmc and aesimc do the (inverse) MixColumns, so
+// the same round keys as for AES-NI are used one round earlier. When the extensions are not
+// in the baseline, the functions are compiled for them through the target attribute, and
+// AESAutoDetect() only selects them when the CPU reports them.
+
+#include "crypto/aes.h"
+
+#if defined(ENABLE_AES_ARMV8)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <arm_neon.h>
+
+#if defined(__ARM_FEATURE_CRYPTO)
+#define ARMV8_CRYPTO
+#else
+#define ARMV8_CRYPTO __attribute__((target("+crypto")))
+#endif
+
+namespace aes_armv8 {
+
+/** SubBytes of each byte of w: with the four columns equal, ShiftRows leaves them unchanged. */
+ARMV8_CRYPTO uint32_t SubWord(uint32_t w)
+{
+    return vgetq_lane_u32(vreinterpretq_u32_u8(vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(w)), vdupq_n_u8(0))), 0);
+}
+
+ARMV8_CRYPTO void InvMixColumns(unsigned char out[16], const unsigned char in[16])
+{
+    vst1q_u8(out, vaesimcq_u8(vld1q_u8(in)));
+}
+
+/** Encrypt one block with the 15 round keys at rk. */
+ARMV8_CRYPTO void Encrypt256(const unsigned char* rk, unsigned char out[16], const unsigned char in[16])
+{
+    uint8x16_t s = vld1q_u8(in);
+    for (int r = 0; r < 13; r++)
+        s = vaesmcq_u8(vaeseq_u8(s, vld1q_u8(rk + 16 * r)));
+    s = vaeseq_u8(s, vld1q_u8(rk + 16 * 13));
+    vst1q_u8(out, veorq_u8(s, vld1q_u8(rk + 16 * 14)));
+}
+
+/**
+ * Decrypt blocks with the 15 round keys of the equivalent inverse cipher at dk. The blocks are
+ * independent, so four are interleaved to cover the latency of the rounds.
+ */
+ARMV8_CRYPTO void Decrypt256(const unsigned char* dk, unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    while (blocks >= 4) {
+        uint8x16_t s[4];
+        for (int n = 0; n < 4; n++)
+            s[n] = vld1q_u8(in + 16 * n);
+        for (int r = 0; r < 13; r++) {
+            uint8x16_t kr = vld1q_u8(dk + 16 * r);
+            for (int n = 0; n < 4; n++)
+                s[n] = vaesimcq_u8(vaesdq_u8(s[n], kr));
+        }
+        uint8x16_t k13 = vld1q_u8(dk + 16 * 13), k14 = vld1q_u8(dk + 16 * 14);
+        for (int n = 0; n < 4; n++)
+            vst1q_u8(out + 16 * n, veorq_u8(vaesdq_u8(s[n], k13), k14));
+        in += 64;
+        out += 64;
+        blocks -= 4;
+    }
+    while (blocks) {
+        uint8x16_t s = vld1q_u8(in);
+        for (int r = 0; r < 13; r++)
+            s = vaesimcq_u8(vaesdq_u8(s, vld1q_u8(dk + 16 * r)));
+        s = vaesdq_u8(s, vld1q_u8(dk + 16 * 13));
+        vst1q_u8(out, veorq_u8(s, vld1q_u8(dk + 16 * 14)));
+        in += 16;
+        out += 16;
+        blocks -= 1;
+    }
+}
+
+} // namespace aes_armv8
+
+#endif // ENABLE_AES_ARMV8
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// AES-256 using the AES-NI instructions. Each round is one instruction, and since they take no
+// data dependent lookups the code is constant time like ctaes. CBC encryption is serial, so
+// only decryption works on several blocks at once. The functions are compiled for AES-NI
+// through the target attribute, and AESAutoDetect() only selects them when the CPU has it.
+
+#include "crypto/aes.h"
+
+#if defined(ENABLE_AES_NI)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#define AESNI __attribute__((target("aes,sse2")))
+
+namespace aes_ni {
+
+/** SubBytes of each byte of w: with the four columns equal, ShiftRows leaves them unchanged. */
+AESNI uint32_t SubWord(uint32_t w)
+{
+    return _mm_cvtsi128_si32(_mm_aesenclast_si128(_mm_set1_epi32(w), _mm_setzero_si128()));
+}
+
+AESNI void InvMixColumns(unsigned char out[16], const unsigned char in[16])
+{
+    _mm_storeu_si128((__m128i*)out, _mm_aesimc_si128(_mm_loadu_si128((const __m128i*)in)));
+}
+
+/** Encrypt one block with the 15 round keys at rk. */
+AESNI void Encrypt256(const unsigned char* rk, unsigned char out[16], const unsigned char in[16])
+{
+    const __m128i* k = (const __m128i*)rk;
+    __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_loadu_si128(&k[0]));
+    for (int r = 1; r < 14; r++)
+        s = _mm_aesenc_si128(s, _mm_loadu_si128(&k[r]));
+    _mm_storeu_si128((__m128i*)out, _mm_aesenclast_si128(s, _mm_loadu_si128(&k[14])));
+}
+
+/**
+ * Decrypt blocks with the 15 round keys of the equivalent inverse cipher at dk. The blocks are
+ * independent, so four are interleaved to cover the latency of the rounds.
+ */
+AESNI void Decrypt256(const unsigned char* dk, unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    const __m128i* k = (const __m128i*)dk;
+    while (blocks >= 4) {
+        __m128i s[4];
+        for (int n = 0; n < 4; n++)
+            s[n] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 16 * n)), _mm_loadu_si128(&k[0]));
+        for (int r = 1; r < 14; r++) {
+            __m128i kr = _mm_loadu_si128(&k[r]);
+            for (int n = 0; n < 4; n++)
+                s[n] = _mm_aesdec_si128(s[n], kr);
+        }
+        __m128i klast = _mm_loadu_si128(&k[14]);
+        for (int n = 0; n < 4; n++)
+            _mm_storeu_si128((__m128i*)(out + 16 * n), _mm_aesdeclast_si128(s[n], klast));
+        in += 64;
+        out += 64;
+        blocks -= 4;
+    }
+    while (blocks) {
+        __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_loadu_si128(&k[0]));
+        for (int r = 1; r < 14; r++)
+            s = _mm_aesdec_si128(s, _mm_loadu_si128(&k[r]));
+        _mm_storeu_si128((__m128i*)out, _mm_aesdeclast_si128(s, _mm_loadu_si128(&k[14])));
+        in += 16;
+        out += 16;
+        blocks -= 1;
+    }
+}
+
+} // namespace aes_ni
+
+#endif // ENABLE_AES_NI
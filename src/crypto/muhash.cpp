@@ -0,0 +1,283 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+/** 2^3072 - MAX_PRIME_DIFF is the largest prime below 2^3072 */
+const Num3072::limb_t MAX_PRIME_DIFF = 1103717;
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+const int LIMBS = Num3072::LIMBS;
+const int LIMB_SIZE = Num3072::LIMB_SIZE;
+
+bool IsZero(const limb_t* a)
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (a[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+bool IsOne(const limb_t* a)
+{
+    if (a[0] != 1)
+        return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (a[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+int Compare(const limb_t* a, const limb_t* b)
+{
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/** a += b, returning the carry out */
+limb_t Add(limb_t* a, const limb_t* b)
+{
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)a[i] + b[i] + carry;
+        a[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+    return carry;
+}
+
+/** a -= b, returning the borrow out */
+limb_t Subtract(limb_t* a, const limb_t* b)
+{
+    limb_t borrow = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t bi = b[i] + borrow;
+        limb_t nextBorrow = (bi < borrow) || (a[i] < bi);
+        a[i] -= bi;
+        borrow = nextBorrow;
+    }
+    return borrow;
+}
+
+/** a >>= 1, shifting top in as the highest bit */
+void ShiftRight(limb_t* a, limb_t top)
+{
+    for (int i = 0; i < LIMBS - 1; ++i)
+        a[i] = (a[i] >> 1) | (a[i + 1] << (LIMB_SIZE - 1));
+    a[LIMBS - 1] = (a[LIMBS - 1] >> 1) | (top << (LIMB_SIZE - 1));
+}
+
+/** a = a / 2 modulo the odd prime, for a below it */
+void HalveModPrime(limb_t* a, const limb_t* prime)
+{
+    limb_t top = 0;
+    if (a[0] & 1)
+        top = Add(a, prime);
+    ShiftRight(a, top);
+}
+
+/** a = a - b modulo the prime, for a and b below it */
+void SubtractModPrime(limb_t* a, const limb_t* b, const limb_t* prime)
+{
+    if (Subtract(a, b))
+        Add(a, prime);
+}
+
+}
+
+Num3072::Num3072()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = 0;
+        for (int j = LIMB_SIZE / 8 - 1; j >= 0; --j)
+            limbs[i] = (limbs[i] << 8) | data[i * (LIMB_SIZE / 8) + j];
+    }
+    if (IsOverflow())
+        FullReduce();
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= (limb_t)(0 - MAX_PRIME_DIFF - 1))
+        return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != (limb_t)-1)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the prime adds MAX_PRIME_DIFF and drops 2^3072; the limbs above the lowest are
+    // all ones, so the carry clears them
+    limbs[0] += MAX_PRIME_DIFF;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t prod[2 * LIMBS];
+    memset(prod, 0, sizeof(prod));
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + prod[i + j] + carry;
+            prod[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> LIMB_SIZE);
+        }
+        prod[i + LIMBS] = carry;
+    }
+
+    // 2^3072 is MAX_PRIME_DIFF modulo the prime: fold the high half into the low one, then the
+    // few bits that carry out of it
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)prod[i + LIMBS] * MAX_PRIME_DIFF + prod[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+    while (carry) {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && t; ++i) {
+            t += limbs[i];
+            limbs[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Binary extended Euclid, keeping x1 * a == u and x2 * a == v (mod p): it needs no
+    // multiplications, which makes it much faster than raising to the power p - 2. The number
+    // being inverted is a public set hash, so it need not run in constant time.
+    limb_t prime[LIMBS];
+    prime[0] = (limb_t)0 - MAX_PRIME_DIFF;
+    for (int i = 1; i < LIMBS; ++i)
+        prime[i] = (limb_t)-1;
+    limb_t u[LIMBS], v[LIMBS];
+    Num3072 x1, x2;
+    for (int i = 0; i < LIMBS; ++i) {
+        u[i] = limbs[i];
+        v[i] = prime[i];
+        x2.limbs[i] = 0;
+    }
+    assert(!IsZero(u));
+    while (!IsOne(u) && !IsOne(v)) {
+        while (!(u[0] & 1)) {
+            ShiftRight(u, 0);
+            HalveModPrime(x1.limbs, prime);
+        }
+        while (!(v[0] & 1)) {
+            ShiftRight(v, 0);
+            HalveModPrime(x2.limbs, prime);
+        }
+        if (Compare(u, v) >= 0) {
+            Subtract(u, v);
+            SubtractModPrime(x1.limbs, x2.limbs, prime);
+        } else {
+            Subtract(v, u);
+            SubtractModPrime(x2.limbs, x1.limbs, prime);
+        }
+    }
+    return IsOne(u) ? x1 : x2;
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t limb = limbs[i];
+        for (int j = 0; j < LIMB_SIZE / 8; ++j) {
+            out[i * (LIMB_SIZE / 8) + j] = (unsigned char)limb;
+            limb >>= 8;
+        }
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    // The SHA256 of the element, stretched to 384 bytes by hashing it with a counter
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(seed);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    for (uint32_t i = 0; i < Num3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; ++i) {
+        unsigned char counter[4];
+        WriteLE32(counter, i);
+        CSHA256().Write(seed, sizeof(seed)).Write(counter, sizeof(counter)).Finalize(bytes + i * CSHA256::OUTPUT_SIZE);
+    }
+    return Num3072(bytes);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char (&out)[32]) const
+{
+    Num3072 result(numerator);
+    result.Multiply(denominator.GetInverse());
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    result.ToBytes(bytes);
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(out);
+}
+
+void MuHash3072::ToBytes(unsigned char (&out)[SERIALIZED_SIZE]) const
+{
+    numerator.ToBytes(*(unsigned char (*)[Num3072::BYTE_SIZE])out);
+    denominator.ToBytes(*(unsigned char (*)[Num3072::BYTE_SIZE])(out + Num3072::BYTE_SIZE));
+}
+
+void MuHash3072::FromBytes(const unsigned char (&data)[SERIALIZED_SIZE])
+{
+    numerator = Num3072(*(const unsigned char (*)[Num3072::BYTE_SIZE])data);
+    denominator = Num3072(*(const unsigned char (*)[Num3072::BYTE_SIZE])(data + Num3072::BYTE_SIZE));
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717, in little endian limbs */
+class Num3072
+{
+public:
+#ifdef __SIZEOF_INT128__
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+    static const int LIMB_SIZE = 32;
+#endif
+    static const int LIMBS = 3072 / LIMB_SIZE;
+    static const size_t BYTE_SIZE = 384;
+
+    limb_t limbs[LIMBS];
+
+    /** One */
+    Num3072();
+    /** From 384 little endian bytes, reduced modulo the prime */
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void Multiply(const Num3072& a);
+    /** The inverse, which must exist: the number is not zero */
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/**
+ * SolarCoin: A hash of a set of byte strings that can be updated one element at a time, in any
+ * order: MuHash over the multiplicative group modulo 2^3072 - 1103717. Each element is hashed to a
+ * number, and the set hash is their product; removing an element multiplies the denominator, so a
+ * removal costs a multiplication like an insertion, and the one inverse is taken by Finalize().
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t SERIALIZED_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    /** The hash of the empty set */
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+    /** Combine with the hash of another (disjoint) set */
+    MuHash3072& operator*=(const MuHash3072& mul);
+    /** Remove the elements of a subset */
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /** The 32-byte hash of the set; the same for every order of insertions and removals */
+    void Finalize(unsigned char (&out)[32]) const;
+
+    /** The numerator and denominator, to be continued later with FromBytes() */
+    void ToBytes(unsigned char (&out)[SERIALIZED_SIZE]) const;
+    void FromBytes(const unsigned char (&data)[SERIALIZED_SIZE]);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
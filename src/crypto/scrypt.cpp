@@ -33,15 +33,9 @@
 #include <string.h>
 #include <openssl/sha.h>
 
-#if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
-#ifdef _MSC_VER
-// MSVC 64bit is unable to use inline asm
-#include <intrin.h>
-#else
-// GCC Linux or i686-w64-mingw32
+#if defined(USE_SCRYPT_SSE2)
 #include <cpuid.h>
 #endif
-#endif
 
 static inline uint32_t be32dec(const void *pp)
 {
@@ -285,46 +279,83 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
-#if defined(USE_SSE2)
-// By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
+#if defined(USE_SCRYPT_SSE2) && !defined(__i386__)
+void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_sse2;
+#elif defined(USE_SCRYPT_NEON)
+void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_neon;
+#else
 void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
+#endif
+
+#if defined(USE_SCRYPT_AVX2)
+static bool fUseAVX2 = false;
 
-std::string scrypt_detect_sse2()
+static bool inline AVXEnabled()
 {
-    std::string ret;
-#if defined(USE_SSE2_ALWAYS)
-    ret = "scrypt: using scrypt-sse2 as built.";
-#else // USE_SSE2_ALWAYS
-    // 32bit x86 Linux or Windows, detect cpuid features
-    unsigned int cpuid_edx=0;
-#if defined(_MSC_VER)
-    // MSVC
-    int x86cpuid[4];
-    __cpuid(x86cpuid, 1);
-    cpuid_edx = (unsigned int)buffer[3];
-#else // _MSC_VER
-    // Linux or i686-w64-mingw32 (gcc-4.6.3)
-    unsigned int eax, ebx, ecx;
-    __get_cpuid(1, &eax, &ebx, &ecx, &cpuid_edx);
-#endif // _MSC_VER
-
-    if (cpuid_edx & 1<<26)
-    {
-        scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_sse2;
-        ret = "scrypt: using scrypt-sse2 as detected");
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+std::string scrypt_detect()
+{
+#if defined(USE_SCRYPT_AVX2)
+    unsigned int eax, ebx, ecx, edx;
+    fUseAVX2 = false;
+    if (__get_cpuid(0, &eax, &ebx, &ecx, &edx) && eax >= 7) {
+        __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+        // OSXSAVE and AVX, then AVX2
+        if ((ecx & (1 << 27)) && (ecx & (1 << 28)) && AVXEnabled()) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            fUseAVX2 = (ebx & (1 << 5)) != 0;
+        }
     }
-    else
-    {
+    scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_sse2;
+    return fUseAVX2 ? "scrypt: using sse2 and 4-way avx2" : "scrypt: using sse2 and 2-way sse2";
+#elif defined(USE_SCRYPT_SSE2)
+#if defined(__i386__)
+    // 32-bit x86: SSE2 is bit 26 of EDX for CPUID leaf 1
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 26))) {
         scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_generic;
-        ret = "scrypt: using scrypt-generic, SSE2 unavailable";
+        return "scrypt: using generic, SSE2 unavailable";
     }
-#endif // USE_SSE2_ALWAYS
-    return ret;
-}
 #endif
+    scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_sse2;
+    return "scrypt: using sse2 and 2-way sse2";
+#elif defined(USE_SCRYPT_NEON)
+    scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_neon;
+    return "scrypt: using neon";
+#else
+    scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_generic;
+    return "scrypt: using generic";
+#endif
+}
 
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
 	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
     scrypt_1024_1_1_256_sp(input, output, scratchpad);
 }
+
+void scrypt_1024_1_1_256_multi(const char* const input[], char* const output[], size_t n, char *scratchpad)
+{
+    size_t i = 0;
+#if defined(USE_SCRYPT_AVX2)
+    if (fUseAVX2) {
+        for (; i + 4 <= n; i += 4)
+            scrypt_1024_1_1_256_sp_avx2_4way(&input[i], &output[i], scratchpad);
+        for (; i + 2 <= n; i += 2)
+            scrypt_1024_1_1_256_sp_avx2_2way(&input[i], &output[i], scratchpad);
+    }
+#endif
+#if defined(USE_SCRYPT_SSE2)
+    if (scrypt_1024_1_1_256_sp_detected == &scrypt_1024_1_1_256_sp_sse2) {
+        for (; i + 2 <= n; i += 2)
+            scrypt_1024_1_1_256_sp_sse2_2way(&input[i], &output[i], scratchpad);
+    }
+#endif
+    for (; i < n; i++)
+        scrypt_1024_1_1_256_sp(input[i], output[i], scratchpad);
+}
@@ -2,28 +2,52 @@
 #define SCRYPT_H
 #include <stdlib.h>
 #include <stdint.h>
+#include <string>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
-#if defined(USE_SSE2)
-#include <string>
-#if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
-#define USE_SSE2_ALWAYS 1
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_sse2((input), (output), (scratchpad))
-#else
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_detected((input), (output), (scratchpad))
+#if (defined(__x86_64__) || defined(__amd64__) || defined(__i386__)) && defined(__GNUC__)
+//! SSE2 is part of the x86-64 baseline; on 32-bit x86, scrypt_detect() checks for it
+#define USE_SCRYPT_SSE2 1
+void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
+void scrypt_1024_1_1_256_sp_sse2_2way(const char* const input[], char* const output[], char *scratchpad);
 #endif
 
-std::string scrypt_detect_sse2();
-void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
-extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
-#else
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
+#if (defined(__x86_64__) || defined(__amd64__)) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+//! The compiler can build AVX2 functions into a baseline x86-64 binary
+#define USE_SCRYPT_AVX2 1
+void scrypt_1024_1_1_256_sp_avx2_2way(const char* const input[], char* const output[], char *scratchpad);
+void scrypt_1024_1_1_256_sp_avx2_4way(const char* const input[], char* const output[], char *scratchpad);
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+//! NEON is part of the AArch64 baseline, and of 32-bit ARM targets that define __ARM_NEON
+#define USE_SCRYPT_NEON 1
+void scrypt_1024_1_1_256_sp_neon(const char *input, char *output, char *scratchpad);
 #endif
 
+/** The implementation selected by scrypt_detect(), the fastest one known to be available until then. */
+extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
+#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_detected((input), (output), (scratchpad))
+
+//! Inputs scrypt_1024_1_1_256_multi() hashes together at most
+static const int SCRYPT_MULTI_MAX_WAYS = 4;
+static const int SCRYPT_MULTI_SCRATCHPAD_SIZE = SCRYPT_MULTI_MAX_WAYS * 131072 + 63;
+
+/**
+ * Hash n 80-byte inputs, interleaving as many as the implementation selected by scrypt_detect()
+ * allows: four with AVX2, two with SSE2. That hides the latency of the Salsa20/8 rounds and
+ * fills the vector lanes, so a thread hashes up to three times as many inputs per second.
+ * The scratchpad must hold SCRYPT_MULTI_SCRATCHPAD_SIZE bytes.
+ */
+void scrypt_1024_1_1_256_multi(const char* const input[], char* const output[], size_t n, char *scratchpad);
+
+/** Select the fastest scrypt implementation for this CPU, and return a description of it. */
+std::string scrypt_detect();
+
 void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
     size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen);
@@ -0,0 +1,139 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 2-way and 4-way AVX2 scrypt(1024, 1, 1) cores, used by scrypt_1024_1_1_256_multi(). One
+// Salsa20/8 chain is bound by the latency of its rounds, which 128-bit vectors already cover,
+// so the wider registers are used for two independent hashes instead: each 128-bit half holds
+// the diagonal layout of scrypt_sse2.cpp for one of them. The 4-way core interleaves two such
+// pairs to fill the execution units. The functions are compiled for AVX2 through the target
+// attribute, and scrypt_detect() only selects them when the CPU and OS support AVX2.
+
+#include "crypto/scrypt.h"
+
+#if defined(USE_SCRYPT_AVX2)
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+namespace {
+
+AVX2 __m256i inline RotL(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+
+/** B = Salsa20/8(B ^ Bx) for each of the G pairs, where B and Bx are X[g][o..o+3] and X[g][ox..ox+3]. */
+template <int G>
+AVX2 void inline XorSalsa8(__m256i (*X)[8], int o, int ox)
+{
+    __m256i X0[G], X1[G], X2[G], X3[G];
+    for (int g = 0; g < G; g++) {
+        X0[g] = X[g][o + 0] = _mm256_xor_si256(X[g][o + 0], X[g][ox + 0]);
+        X1[g] = X[g][o + 1] = _mm256_xor_si256(X[g][o + 1], X[g][ox + 1]);
+        X2[g] = X[g][o + 2] = _mm256_xor_si256(X[g][o + 2], X[g][ox + 2]);
+        X3[g] = X[g][o + 3] = _mm256_xor_si256(X[g][o + 3], X[g][ox + 3]);
+    }
+
+    for (int i = 0; i < 8; i += 2) {
+        // Columns
+        for (int g = 0; g < G; g++) X1[g] = _mm256_xor_si256(X1[g], RotL(_mm256_add_epi32(X0[g], X3[g]), 7));
+        for (int g = 0; g < G; g++) X2[g] = _mm256_xor_si256(X2[g], RotL(_mm256_add_epi32(X1[g], X0[g]), 9));
+        for (int g = 0; g < G; g++) X3[g] = _mm256_xor_si256(X3[g], RotL(_mm256_add_epi32(X2[g], X1[g]), 13));
+        for (int g = 0; g < G; g++) X0[g] = _mm256_xor_si256(X0[g], RotL(_mm256_add_epi32(X3[g], X2[g]), 18));
+
+        // The shuffles work within each 128-bit half, so on each hash separately
+        for (int g = 0; g < G; g++) {
+            X1[g] = _mm256_shuffle_epi32(X1[g], 0x93);
+            X2[g] = _mm256_shuffle_epi32(X2[g], 0x4E);
+            X3[g] = _mm256_shuffle_epi32(X3[g], 0x39);
+        }
+
+        // Rows
+        for (int g = 0; g < G; g++) X3[g] = _mm256_xor_si256(X3[g], RotL(_mm256_add_epi32(X0[g], X1[g]), 7));
+        for (int g = 0; g < G; g++) X2[g] = _mm256_xor_si256(X2[g], RotL(_mm256_add_epi32(X3[g], X0[g]), 9));
+        for (int g = 0; g < G; g++) X1[g] = _mm256_xor_si256(X1[g], RotL(_mm256_add_epi32(X2[g], X3[g]), 13));
+        for (int g = 0; g < G; g++) X0[g] = _mm256_xor_si256(X0[g], RotL(_mm256_add_epi32(X1[g], X2[g]), 18));
+
+        for (int g = 0; g < G; g++) {
+            X1[g] = _mm256_shuffle_epi32(X1[g], 0x39);
+            X2[g] = _mm256_shuffle_epi32(X2[g], 0x4E);
+            X3[g] = _mm256_shuffle_epi32(X3[g], 0x93);
+        }
+    }
+
+    for (int g = 0; g < G; g++) {
+        X[g][o + 0] = _mm256_add_epi32(X[g][o + 0], X0[g]);
+        X[g][o + 1] = _mm256_add_epi32(X[g][o + 1], X1[g]);
+        X[g][o + 2] = _mm256_add_epi32(X[g][o + 2], X2[g]);
+        X[g][o + 3] = _mm256_add_epi32(X[g][o + 3], X3[g]);
+    }
+}
+
+/** scrypt(1024, 1, 1) of 2 * G inputs, with 2 * G * 128 KiB of scratchpad. */
+template <int G>
+AVX2 void inline Scrypt(const char* const input[], char* const output[], char *scratchpad)
+{
+    uint8_t B[2 * G][128];
+    uint32_t W[2][32] __attribute__((aligned(32)));
+    __m256i X[G][8];
+    __m256i* V = (__m256i*)(((uintptr_t)(scratchpad) + 63) & ~(uintptr_t)(63));
+
+    for (int g = 0; g < G; g++) {
+        for (int h = 0; h < 2; h++) {
+            PBKDF2_SHA256((const uint8_t*)input[2 * g + h], 80, (const uint8_t*)input[2 * g + h], 80, 1, B[2 * g + h], 128);
+            // Word i of each block goes to position i * 5 % 16, which lines up its diagonals
+            for (int k = 0; k < 2; k++)
+                for (int i = 0; i < 16; i++)
+                    W[h][k * 16 + i] = le32dec(&B[2 * g + h][(k * 16 + (i * 5 % 16)) * 4]);
+        }
+        for (int k = 0; k < 8; k++)
+            X[g][k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i*)&W[0][4 * k])), _mm_load_si128((const __m128i*)&W[1][4 * k]), 1);
+    }
+
+    for (int i = 0; i < 1024; i++) {
+        for (int g = 0; g < G; g++)
+            memcpy(&V[(g * 1024 + i) * 8], X[g], 256);
+        XorSalsa8<G>(X, 0, 4);
+        XorSalsa8<G>(X, 4, 0);
+    }
+    for (int i = 0; i < 1024; i++) {
+        for (int g = 0; g < G; g++) {
+            // Word 16 of each hash stays in place, so the first lane of each half of X[g][4].
+            // The low half comes from element j of V, the high half from element k.
+            const __m256i* Vj = &V[(g * 1024 + (_mm256_extract_epi32(X[g][4], 0) & 1023)) * 8];
+            const __m256i* Vk = &V[(g * 1024 + (_mm256_extract_epi32(X[g][4], 4) & 1023)) * 8];
+            for (int n = 0; n < 8; n++)
+                X[g][n] = _mm256_xor_si256(X[g][n], _mm256_blend_epi32(_mm256_load_si256(&Vj[n]), _mm256_load_si256(&Vk[n]), 0xF0));
+        }
+        XorSalsa8<G>(X, 0, 4);
+        XorSalsa8<G>(X, 4, 0);
+    }
+
+    for (int g = 0; g < G; g++) {
+        for (int k = 0; k < 8; k++) {
+            _mm_store_si128((__m128i*)&W[0][4 * k], _mm256_castsi256_si128(X[g][k]));
+            _mm_store_si128((__m128i*)&W[1][4 * k], _mm256_extracti128_si256(X[g][k], 1));
+        }
+        for (int h = 0; h < 2; h++) {
+            for (int k = 0; k < 2; k++)
+                for (int i = 0; i < 16; i++)
+                    le32enc(&B[2 * g + h][(k * 16 + (i * 5 % 16)) * 4], W[h][k * 16 + i]);
+            PBKDF2_SHA256((const uint8_t*)input[2 * g + h], 80, B[2 * g + h], 128, 1, (uint8_t*)output[2 * g + h], 32);
+        }
+    }
+}
+
+} // namespace
+
+AVX2 void scrypt_1024_1_1_256_sp_avx2_2way(const char* const input[], char* const output[], char *scratchpad)
+{
+    Scrypt<1>(input, output, scratchpad);
+}
+
+AVX2 void scrypt_1024_1_1_256_sp_avx2_4way(const char* const input[], char* const output[], char *scratchpad)
+{
+    Scrypt<2>(input, output, scratchpad);
+}
+
+#endif // USE_SCRYPT_AVX2
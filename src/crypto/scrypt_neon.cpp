@@ -0,0 +1,100 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// NEON scrypt(1024, 1, 1) core, the counterpart of scrypt_sse2.cpp for ARM: each Salsa20/8
+// block is kept in four vectors holding its diagonals. It is only built for targets that have
+// NEON in their baseline, so it needs no runtime detection.
+
+#include "crypto/scrypt.h"
+
+#if defined(USE_SCRYPT_NEON)
+
+#include <stdint.h>
+#include <string.h>
+#include <arm_neon.h>
+
+namespace {
+
+template <int n>
+uint32x4_t inline RotL(uint32x4_t x) { return vsriq_n_u32(vshlq_n_u32(x, n), x, 32 - n); }
+
+/** B = Salsa20/8(B ^ Bx), on blocks in the diagonal layout. */
+void inline XorSalsa8(uint32x4_t* B, const uint32x4_t* Bx)
+{
+    uint32x4_t X0 = B[0] = veorq_u32(B[0], Bx[0]);
+    uint32x4_t X1 = B[1] = veorq_u32(B[1], Bx[1]);
+    uint32x4_t X2 = B[2] = veorq_u32(B[2], Bx[2]);
+    uint32x4_t X3 = B[3] = veorq_u32(B[3], Bx[3]);
+
+    for (int i = 0; i < 8; i += 2) {
+        // Columns
+        X1 = veorq_u32(X1, RotL<7>(vaddq_u32(X0, X3)));
+        X2 = veorq_u32(X2, RotL<9>(vaddq_u32(X1, X0)));
+        X3 = veorq_u32(X3, RotL<13>(vaddq_u32(X2, X1)));
+        X0 = veorq_u32(X0, RotL<18>(vaddq_u32(X3, X2)));
+
+        X1 = vextq_u32(X1, X1, 3);
+        X2 = vextq_u32(X2, X2, 2);
+        X3 = vextq_u32(X3, X3, 1);
+
+        // Rows
+        X3 = veorq_u32(X3, RotL<7>(vaddq_u32(X0, X1)));
+        X2 = veorq_u32(X2, RotL<9>(vaddq_u32(X3, X0)));
+        X1 = veorq_u32(X1, RotL<13>(vaddq_u32(X2, X3)));
+        X0 = veorq_u32(X0, RotL<18>(vaddq_u32(X1, X2)));
+
+        X1 = vextq_u32(X1, X1, 1);
+        X2 = vextq_u32(X2, X2, 2);
+        X3 = vextq_u32(X3, X3, 3);
+    }
+
+    B[0] = vaddq_u32(B[0], X0);
+    B[1] = vaddq_u32(B[1], X1);
+    B[2] = vaddq_u32(B[2], X2);
+    B[3] = vaddq_u32(B[3], X3);
+}
+
+} // namespace
+
+void scrypt_1024_1_1_256_sp_neon(const char *input, char *output, char *scratchpad)
+{
+    uint8_t B[128];
+    uint32_t W[32];
+    uint32x4_t X[8];
+    uint32x4_t* V = (uint32x4_t*)(((uintptr_t)(scratchpad) + 63) & ~(uintptr_t)(63));
+
+    PBKDF2_SHA256((const uint8_t*)input, 80, (const uint8_t*)input, 80, 1, B, 128);
+
+    // Word i of each block goes to position i * 5 % 16, which lines up its diagonals
+    for (int k = 0; k < 2; k++)
+        for (int i = 0; i < 16; i++)
+            W[k * 16 + i] = le32dec(&B[(k * 16 + (i * 5 % 16)) * 4]);
+    for (int k = 0; k < 8; k++)
+        X[k] = vld1q_u32(&W[4 * k]);
+
+    for (int i = 0; i < 1024; i++) {
+        for (int k = 0; k < 8; k++)
+            V[i * 8 + k] = X[k];
+        XorSalsa8(&X[0], &X[4]);
+        XorSalsa8(&X[4], &X[0]);
+    }
+    for (int i = 0; i < 1024; i++) {
+        // Word 16 stays in place, so the first lane of X[4]
+        const uint32x4_t* Vj = &V[8 * (vgetq_lane_u32(X[4], 0) & 1023)];
+        for (int k = 0; k < 8; k++)
+            X[k] = veorq_u32(X[k], Vj[k]);
+        XorSalsa8(&X[0], &X[4]);
+        XorSalsa8(&X[4], &X[0]);
+    }
+
+    for (int k = 0; k < 8; k++)
+        vst1q_u32(&W[4 * k], X[k]);
+    for (int k = 0; k < 2; k++)
+        for (int i = 0; i < 16; i++)
+            le32enc(&B[(k * 16 + (i * 5 % 16)) * 4], W[k * 16 + i]);
+
+    PBKDF2_SHA256((const uint8_t*)input, 80, B, 128, 1, (uint8_t*)output, 32);
+}
+
+#endif // USE_SCRYPT_NEON
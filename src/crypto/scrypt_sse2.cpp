@@ -0,0 +1,130 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SSE2 scrypt(1024, 1, 1) cores, after the SSE2 code of Colin Percival's scrypt.
+// Each 64-byte Salsa20/8 block is kept in four vectors holding its diagonals, so the column
+// and the row rounds both work on whole vectors, with a lane rotation in between. One chain of
+// rounds leaves most of the execution units idle, so the 2-way core interleaves two hashes.
+// SSE2 is part of the x86-64 baseline; on 32-bit x86 the functions are compiled for it through
+// the target attribute and scrypt_detect() only selects them when the CPU has it.
+
+#include "crypto/scrypt.h"
+
+#if defined(USE_SCRYPT_SSE2)
+
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+
+namespace {
+
+SSE2 __m128i inline RotL(__m128i x, int n) { return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n)); }
+
+/** B = Salsa20/8(B ^ Bx) for each of the G hashes, where B and Bx are X[g][o..o+3] and X[g][ox..ox+3]. */
+template <int G>
+SSE2 void inline XorSalsa8(__m128i (*X)[8], int o, int ox)
+{
+    __m128i X0[G], X1[G], X2[G], X3[G];
+    for (int g = 0; g < G; g++) {
+        X0[g] = X[g][o + 0] = _mm_xor_si128(X[g][o + 0], X[g][ox + 0]);
+        X1[g] = X[g][o + 1] = _mm_xor_si128(X[g][o + 1], X[g][ox + 1]);
+        X2[g] = X[g][o + 2] = _mm_xor_si128(X[g][o + 2], X[g][ox + 2]);
+        X3[g] = X[g][o + 3] = _mm_xor_si128(X[g][o + 3], X[g][ox + 3]);
+    }
+
+    for (int i = 0; i < 8; i += 2) {
+        // Columns
+        for (int g = 0; g < G; g++) X1[g] = _mm_xor_si128(X1[g], RotL(_mm_add_epi32(X0[g], X3[g]), 7));
+        for (int g = 0; g < G; g++) X2[g] = _mm_xor_si128(X2[g], RotL(_mm_add_epi32(X1[g], X0[g]), 9));
+        for (int g = 0; g < G; g++) X3[g] = _mm_xor_si128(X3[g], RotL(_mm_add_epi32(X2[g], X1[g]), 13));
+        for (int g = 0; g < G; g++) X0[g] = _mm_xor_si128(X0[g], RotL(_mm_add_epi32(X3[g], X2[g]), 18));
+
+        for (int g = 0; g < G; g++) {
+            X1[g] = _mm_shuffle_epi32(X1[g], 0x93);
+            X2[g] = _mm_shuffle_epi32(X2[g], 0x4E);
+            X3[g] = _mm_shuffle_epi32(X3[g], 0x39);
+        }
+
+        // Rows
+        for (int g = 0; g < G; g++) X3[g] = _mm_xor_si128(X3[g], RotL(_mm_add_epi32(X0[g], X1[g]), 7));
+        for (int g = 0; g < G; g++) X2[g] = _mm_xor_si128(X2[g], RotL(_mm_add_epi32(X3[g], X0[g]), 9));
+        for (int g = 0; g < G; g++) X1[g] = _mm_xor_si128(X1[g], RotL(_mm_add_epi32(X2[g], X3[g]), 13));
+        for (int g = 0; g < G; g++) X0[g] = _mm_xor_si128(X0[g], RotL(_mm_add_epi32(X1[g], X2[g]), 18));
+
+        for (int g = 0; g < G; g++) {
+            X1[g] = _mm_shuffle_epi32(X1[g], 0x39);
+            X2[g] = _mm_shuffle_epi32(X2[g], 0x4E);
+            X3[g] = _mm_shuffle_epi32(X3[g], 0x93);
+        }
+    }
+
+    for (int g = 0; g < G; g++) {
+        X[g][o + 0] = _mm_add_epi32(X[g][o + 0], X0[g]);
+        X[g][o + 1] = _mm_add_epi32(X[g][o + 1], X1[g]);
+        X[g][o + 2] = _mm_add_epi32(X[g][o + 2], X2[g]);
+        X[g][o + 3] = _mm_add_epi32(X[g][o + 3], X3[g]);
+    }
+}
+
+/** scrypt(1024, 1, 1) of G inputs, with G * 128 KiB of scratchpad. */
+template <int G>
+SSE2 void inline Scrypt(const char* const input[], char* const output[], char *scratchpad)
+{
+    uint8_t B[G][128];
+    uint32_t W[32] __attribute__((aligned(16)));
+    __m128i X[G][8];
+    __m128i* V = (__m128i*)(((uintptr_t)(scratchpad) + 63) & ~(uintptr_t)(63));
+
+    for (int g = 0; g < G; g++) {
+        PBKDF2_SHA256((const uint8_t*)input[g], 80, (const uint8_t*)input[g], 80, 1, B[g], 128);
+        // Word i of each block goes to position i * 5 % 16, which lines up its diagonals
+        for (int k = 0; k < 2; k++)
+            for (int i = 0; i < 16; i++)
+                W[k * 16 + i] = le32dec(&B[g][(k * 16 + (i * 5 % 16)) * 4]);
+        for (int k = 0; k < 8; k++)
+            X[g][k] = _mm_load_si128((const __m128i*)&W[4 * k]);
+    }
+
+    for (int i = 0; i < 1024; i++) {
+        for (int g = 0; g < G; g++)
+            memcpy(&V[(g * 1024 + i) * 8], X[g], 128);
+        XorSalsa8<G>(X, 0, 4);
+        XorSalsa8<G>(X, 4, 0);
+    }
+    for (int i = 0; i < 1024; i++) {
+        for (int g = 0; g < G; g++) {
+            // Word 16 stays in place, so the first lane of X[g][4]
+            const __m128i* Vj = &V[(g * 1024 + (_mm_cvtsi128_si32(X[g][4]) & 1023)) * 8];
+            for (int k = 0; k < 8; k++)
+                X[g][k] = _mm_xor_si128(X[g][k], Vj[k]);
+        }
+        XorSalsa8<G>(X, 0, 4);
+        XorSalsa8<G>(X, 4, 0);
+    }
+
+    for (int g = 0; g < G; g++) {
+        for (int k = 0; k < 8; k++)
+            _mm_store_si128((__m128i*)&W[4 * k], X[g][k]);
+        for (int k = 0; k < 2; k++)
+            for (int i = 0; i < 16; i++)
+                le32enc(&B[g][(k * 16 + (i * 5 % 16)) * 4], W[k * 16 + i]);
+        PBKDF2_SHA256((const uint8_t*)input[g], 80, B[g], 128, 1, (uint8_t*)output[g], 32);
+    }
+}
+
+} // namespace
+
+SSE2 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad)
+{
+    Scrypt<1>(&input, &output, scratchpad);
+}
+
+SSE2 void scrypt_1024_1_1_256_sp_sse2_2way(const char* const input[], char* const output[], char *scratchpad)
+{
+    Scrypt<2>(input, output, scratchpad);
+}
+
+#endif // USE_SCRYPT_SSE2
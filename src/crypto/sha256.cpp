@@ -6,8 +6,66 @@
 
 #include "crypto/common.h"
 
+#include <assert.h>
 #include <string.h>
 
+namespace sha256d64
+{
+/**
+ * The message schedule of the padding block of a 64-byte message plus the round constants: the
+ * block is the same for every message, so the multi-way cores skip its schedule.
+ */
+extern const uint32_t PADDING_WK[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76};
+}
+
+#if defined(__x86_64__) || defined(__amd64__)
+#include <cpuid.h>
+
+namespace sha256d_sse2
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+void Transform_4way_64(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_SHA256_AVX2)
+namespace sha256d_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+void Transform_8way_64(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_SHA256_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk);
+void Transform_2way_64(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_SHA256_ARMV8)
+#if !defined(__ARM_FEATURE_CRYPTO)
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+
+namespace sha256_armv8
+{
+void Transform(uint32_t* s, const unsigned char* chunk);
+}
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -127,7 +185,112 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Perform the SHA-256 transformation of the padding block of a 64-byte message. */
+void TransformPadding64(uint32_t* s)
+{
+    uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i += 8) {
+        Round(a, b, c, d, e, f, g, h, 0, sha256d64::PADDING_WK[i + 0]);
+        Round(h, a, b, c, d, e, f, g, 0, sha256d64::PADDING_WK[i + 1]);
+        Round(g, h, a, b, c, d, e, f, 0, sha256d64::PADDING_WK[i + 2]);
+        Round(f, g, h, a, b, c, d, e, 0, sha256d64::PADDING_WK[i + 3]);
+        Round(e, f, g, h, a, b, c, d, 0, sha256d64::PADDING_WK[i + 4]);
+        Round(d, e, f, g, h, a, b, c, 0, sha256d64::PADDING_WK[i + 5]);
+        Round(c, d, e, f, g, h, a, b, 0, sha256d64::PADDING_WK[i + 6]);
+        Round(b, c, d, e, f, g, h, a, 0, sha256d64::PADDING_WK[i + 7]);
+    }
+    s[0] += a;
+    s[1] += b;
+    s[2] += c;
+    s[3] += d;
+    s[4] += e;
+    s[5] += f;
+    s[6] += g;
+    s[7] += h;
+}
+
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t* s, const unsigned char* chunk);
+
+// The single block transform, replaced by the hardware one by SHA256AutoDetect()
+TransformType Transform = &sha256::Transform;
+
+/** Double SHA-256 of one padded 64-byte block. */
+void TransformD_1way(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    unsigned char buf[64] = {0};
+    sha256::Initialize(s);
+    Transform(s, in);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i]);
+    buf[32] = 0x80;
+    WriteBE64(buf + 56, 256);
+    sha256::Initialize(s);
+    Transform(s, buf);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+/** Double SHA-256 of one 64-byte message. */
+void TransformD64_1way(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char pad64[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+    uint32_t s[8];
+    unsigned char buf[64] = {0};
+    sha256::Initialize(s);
+    Transform(s, in);
+    if (Transform == &sha256::Transform)
+        sha256::TransformPadding64(s);
+    else
+        Transform(s, pad64);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i]);
+    buf[32] = 0x80;
+    WriteBE64(buf + 56, 256);
+    sha256::Initialize(s);
+    Transform(s, buf);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+typedef void (*TransformDMultiType)(unsigned char* out, const unsigned char* in);
+
+// All of these are set by SHA256AutoDetect(); SSE2 is always available on x86-64
+#if defined(__x86_64__) || defined(__amd64__)
+TransformDMultiType TransformD_4way = &sha256d_sse2::Transform_4way;
+TransformDMultiType TransformD64_4way = &sha256d_sse2::Transform_4way_64;
+#else
+TransformDMultiType TransformD_4way = NULL;
+TransformDMultiType TransformD64_4way = NULL;
+#endif
+TransformDMultiType TransformD_8way = NULL;
+TransformDMultiType TransformD64_8way = NULL;
+TransformDMultiType TransformD64_2way = NULL;
+
+/** Pad a message of len <= SHA256D_SHORT_MAX_LEN bytes into one SHA-256 block. */
+void inline PadShort(unsigned char* block, const unsigned char* in, size_t len)
+{
+    memcpy(block, in, len);
+    block[len] = 0x80;
+    memset(block + len + 1, 0, 55 - len);
+    WriteBE64(block + 56, (uint64_t)len << 3);
+}
+
+#if defined(ENABLE_SHA256_AVX2)
+/** Whether the OS saves the AVX (YMM) registers on context switches. */
+bool inline AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
 
@@ -147,12 +310,12 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf);
         bufsize = 0;
     }
     while (end >= data + 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
+        Transform(s, data);
         bytes += 64;
         data += 64;
     }
@@ -187,3 +350,128 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256DShort(unsigned char* out, const unsigned char* in, size_t len, size_t blocks)
+{
+    assert(len <= SHA256D_SHORT_MAX_LEN);
+    unsigned char padded[8 * 64];
+    while (blocks) {
+        size_t lanes = 1;
+        TransformDMultiType transform = &TransformD_1way;
+        if (TransformD_8way && blocks >= 8) {
+            lanes = 8;
+            transform = TransformD_8way;
+        } else if (TransformD_4way && blocks >= 4) {
+            lanes = 4;
+            transform = TransformD_4way;
+        }
+        for (size_t i = 0; i < lanes; i++)
+            PadShort(padded + 64 * i, in + len * i, len);
+        transform(out, padded);
+        out += 32 * lanes;
+        in += len * lanes;
+        blocks -= lanes;
+    }
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    if (TransformD64_2way) {
+        while (blocks >= 2) {
+            TransformD64_2way(out, in);
+            out += 64;
+            in += 128;
+            blocks -= 2;
+        }
+    }
+    while (blocks) {
+        TransformD64_1way(out, in);
+        out += 32;
+        in += 64;
+        blocks -= 1;
+    }
+}
+
+std::string SHA256AutoDetect(unsigned int use)
+{
+    std::string ret = "sha256: using ";
+    Transform = &sha256::Transform;
+#if defined(__x86_64__) || defined(__amd64__)
+    TransformD_4way = NULL;
+    TransformD64_4way = NULL;
+#endif
+    TransformD_8way = NULL;
+    TransformD64_8way = NULL;
+    TransformD64_2way = NULL;
+
+#if defined(__x86_64__) || defined(__amd64__)
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t nMaxLeaf = 0, ecx1 = 0, ebx7 = 0;
+    if (__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+        nMaxLeaf = eax;
+        __get_cpuid(1, &eax, &ebx, &ecx1, &edx);
+        if (nMaxLeaf >= 7)
+            __cpuid_count(7, 0, eax, ebx7, ecx, edx);
+    }
+#endif
+
+    bool fHardware = false;
+#if defined(ENABLE_SHA256_SHANI)
+    // SHA and SSE4.1
+    if ((use & SHA256_USE_HW) && (ebx7 & (1 << 29)) && (ecx1 & (1 << 19))) {
+        Transform = &sha256_shani::Transform;
+        TransformD64_2way = &sha256_shani::Transform_2way_64;
+        ret += "sha-ni";
+        fHardware = true;
+    }
+#endif
+#if defined(ENABLE_SHA256_ARMV8)
+#if defined(__ARM_FEATURE_CRYPTO)
+    fHardware = (use & SHA256_USE_HW) != 0;
+#else
+    fHardware = (use & SHA256_USE_HW) && (getauxval(AT_HWCAP) & HWCAP_SHA2);
+#endif
+    if (fHardware) {
+        Transform = &sha256_armv8::Transform;
+        ret += "armv8";
+    }
+#endif
+    if (!fHardware)
+        ret += "generic";
+
+#if defined(__x86_64__) || defined(__amd64__)
+    // One hardware transform at a time beats 4-way SSE2
+    if ((use & SHA256_USE_SSE2) && !fHardware) {
+        TransformD_4way = &sha256d_sse2::Transform_4way;
+        TransformD64_4way = &sha256d_sse2::Transform_4way_64;
+        ret += ", 4-way sse2";
+    }
+#endif
+#if defined(ENABLE_SHA256_AVX2)
+    // OSXSAVE and AVX, then AVX2. 8-way AVX2 still beats one hardware transform at a time on
+    // short messages, but not the interleaved SHA-NI code on 64-byte ones.
+    if ((use & SHA256_USE_AVX2) && (ecx1 & (1 << 27)) && (ecx1 & (1 << 28)) && AVXEnabled() && (ebx7 & (1 << 5))) {
+        TransformD_8way = &sha256d_avx2::Transform_8way;
+        if (!TransformD64_2way)
+            TransformD64_8way = &sha256d_avx2::Transform_8way_64;
+        ret += ", 8-way avx2";
+    }
+#endif
+    return ret;
+}
@@ -7,6 +7,22 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__amd64__)) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+//! The compiler can build AVX2 functions into a baseline x86-64 binary
+#define ENABLE_SHA256_AVX2 1
+#endif
+
+#if (defined(__x86_64__) || defined(__amd64__)) && (defined(__clang__) || __GNUC__ >= 5)
+//! The compiler can build SHA-NI functions into a baseline x86-64 binary
+#define ENABLE_SHA256_SHANI 1
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || (defined(__linux__) && !defined(__clang__) && __GNUC__ >= 6))
+//! The ARMv8 SHA-256 instructions are in the baseline, or can be detected and built in through the target attribute
+#define ENABLE_SHA256_ARMV8 1
+#endif
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +41,35 @@ public:
     CSHA256& Reset();
 };
 
+/** Longest message SHA256DShort() accepts: it and its padding must fit in one 64-byte block. */
+static const size_t SHA256D_SHORT_MAX_LEN = 55;
+
+/**
+ * Compute the double SHA-256 of `blocks` messages of `len` bytes each, stored back to back at `in`,
+ * into `blocks` consecutive 32-byte digests at `out`. The messages are hashed several at a time
+ * with the SIMD code picked by SHA256AutoDetect().
+ */
+void SHA256DShort(unsigned char* out, const unsigned char* in, size_t len, size_t blocks);
+
+/**
+ * Compute the double SHA-256 of `blocks` 64-byte messages at `in`, such as the pairs of child hashes
+ * of the inner nodes of a merkle tree, into `blocks` consecutive 32-byte digests at `out`. The
+ * digests may overwrite the messages: `out` may be equal to `in`.
+ */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
+/** Implementations SHA256AutoDetect() may select, so the benchmarks can compare them. */
+enum {
+    SHA256_USE_SSE2 = 1,  //!< 4-way SSE2 for SHA256DShort() and SHA256D64()
+    SHA256_USE_AVX2 = 2,  //!< 8-way AVX2 for SHA256DShort() and SHA256D64()
+    SHA256_USE_HW = 4,    //!< SHA-NI or the ARMv8 SHA-256 instructions for every transform
+    SHA256_USE_ALL = 7,
+};
+
+/**
+ * Select the fastest SHA-256 implementations for this CPU among those allowed by `use`, and
+ * return a description of them. Not thread safe: call it before hashing starts.
+ */
+std::string SHA256AutoDetect(unsigned int use = SHA256_USE_ALL);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 transform using the ARMv8 cryptography extensions. The state is kept as the ABCD and
+// EFGH vectors that sha256h and sha256h2 work on, and the message schedule is extended four
+// words at a time with sha256su0 and sha256su1. When the extensions are not in the baseline,
+// the function is compiled for them through the target attribute, and SHA256AutoDetect() only
+// selects it when the CPU reports them.
+
+#include "crypto/sha256.h"
+
+#if defined(ENABLE_SHA256_ARMV8)
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#if defined(__ARM_FEATURE_CRYPTO)
+#define ARMV8_CRYPTO
+#define ARMV8_CRYPTO_INLINE __attribute__((always_inline)) inline
+#else
+#define ARMV8_CRYPTO __attribute__((target("+crypto")))
+#define ARMV8_CRYPTO_INLINE __attribute__((target("+crypto"), always_inline)) inline
+#endif
+
+namespace sha256_armv8 {
+namespace {
+
+const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/** Four rounds on the message words m, then m + 4 is extended into m when more are needed. */
+template <int i>
+ARMV8_CRYPTO_INLINE void QuadRound(uint32x4_t& abcd, uint32x4_t& efgh, uint32x4_t* m)
+{
+    uint32x4_t wk = vaddq_u32(m[i & 3], vld1q_u32(&k[4 * i]));
+    uint32x4_t abcd_prev = abcd;
+    abcd = vsha256hq_u32(abcd, efgh, wk);
+    efgh = vsha256h2q_u32(efgh, abcd_prev, wk);
+    if (i < 12) {
+        // m[i & 3] holds words 4i..4i+3 and is replaced by words 4i+16..4i+19
+        m[i & 3] = vsha256su1q_u32(vsha256su0q_u32(m[i & 3], m[(i + 1) & 3]), m[(i + 2) & 3], m[(i + 3) & 3]);
+    }
+}
+
+} // namespace
+
+/** Perform one SHA-256 transformation, processing a 64-byte chunk. */
+ARMV8_CRYPTO void Transform(uint32_t* s, const unsigned char* chunk)
+{
+    uint32x4_t abcd = vld1q_u32(&s[0]);
+    uint32x4_t efgh = vld1q_u32(&s[4]);
+    const uint32x4_t abcd_save = abcd, efgh_save = efgh;
+
+    uint32x4_t m[4];
+    for (int i = 0; i < 4; i++)
+        m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(chunk + 16 * i)));
+
+    // Each of the 16 groups is instantiated separately, so m stays in registers
+    QuadRound<0>(abcd, efgh, m);
+    QuadRound<1>(abcd, efgh, m);
+    QuadRound<2>(abcd, efgh, m);
+    QuadRound<3>(abcd, efgh, m);
+    QuadRound<4>(abcd, efgh, m);
+    QuadRound<5>(abcd, efgh, m);
+    QuadRound<6>(abcd, efgh, m);
+    QuadRound<7>(abcd, efgh, m);
+    QuadRound<8>(abcd, efgh, m);
+    QuadRound<9>(abcd, efgh, m);
+    QuadRound<10>(abcd, efgh, m);
+    QuadRound<11>(abcd, efgh, m);
+    QuadRound<12>(abcd, efgh, m);
+    QuadRound<13>(abcd, efgh, m);
+    QuadRound<14>(abcd, efgh, m);
+    QuadRound<15>(abcd, efgh, m);
+
+    vst1q_u32(&s[0], vaddq_u32(abcd, abcd_save));
+    vst1q_u32(&s[4], vaddq_u32(efgh, efgh_save));
+}
+
+} // namespace sha256_armv8
+
+#endif // ENABLE_SHA256_ARMV8
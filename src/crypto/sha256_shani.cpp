@@ -0,0 +1,172 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 transform using the Intel SHA extensions (SHA-NI), after Intel's reference code.
+// The state is kept as the ABEF and CDGH halves that sha256rnds2 works on, and the message
+// schedule is extended four words at a time with sha256msg1 and sha256msg2. The functions are
+// compiled for SHA-NI through the target attribute, and SHA256AutoDetect() only selects them
+// when the CPU has it.
+
+#include "crypto/sha256.h"
+
+#if defined(ENABLE_SHA256_SHANI)
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define SHANI __attribute__((target("sha,sse4.1")))
+// The helpers take arrays of vectors, which only stay in registers once inlined
+#define SHANI_INLINE __attribute__((target("sha,sse4.1"), always_inline)) inline
+
+namespace sha256_shani {
+namespace {
+
+const uint32_t k[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+/** Four rounds on the message words m of each of the N blocks, then m + 4 is extended into m when more are needed. */
+template <int i, int N>
+SHANI_INLINE void QuadRound(__m128i* abef, __m128i* cdgh, __m128i (*m)[4])
+{
+    __m128i wk[N];
+    for (int n = 0; n < N; n++) {
+        wk[n] = _mm_add_epi32(m[n][i & 3], _mm_load_si128((const __m128i*)&k[4 * i]));
+        cdgh[n] = _mm_sha256rnds2_epu32(cdgh[n], abef[n], wk[n]);
+    }
+    for (int n = 0; n < N; n++)
+        abef[n] = _mm_sha256rnds2_epu32(abef[n], cdgh[n], _mm_shuffle_epi32(wk[n], 0x0e));
+    if (i < 12) {
+        // m[i & 3] holds words 4i..4i+3 and is replaced by words 4i+16..4i+19
+        for (int n = 0; n < N; n++) {
+            __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(m[n][i & 3], m[n][(i + 1) & 3]), _mm_alignr_epi8(m[n][(i + 3) & 3], m[n][(i + 2) & 3], 4));
+            m[n][i & 3] = _mm_sha256msg2_epu32(t, m[n][(i + 3) & 3]);
+        }
+    }
+}
+
+/** One SHA-256 compression of each of the N blocks whose words are in m, on the states in abef and cdgh. */
+template <int N>
+SHANI_INLINE void Compress(__m128i* abef, __m128i* cdgh, __m128i (*m)[4])
+{
+    __m128i abef_save[N], cdgh_save[N];
+    for (int n = 0; n < N; n++) {
+        abef_save[n] = abef[n];
+        cdgh_save[n] = cdgh[n];
+    }
+
+    // Each of the 16 groups is instantiated separately, so m stays in registers
+    QuadRound<0, N>(abef, cdgh, m);
+    QuadRound<1, N>(abef, cdgh, m);
+    QuadRound<2, N>(abef, cdgh, m);
+    QuadRound<3, N>(abef, cdgh, m);
+    QuadRound<4, N>(abef, cdgh, m);
+    QuadRound<5, N>(abef, cdgh, m);
+    QuadRound<6, N>(abef, cdgh, m);
+    QuadRound<7, N>(abef, cdgh, m);
+    QuadRound<8, N>(abef, cdgh, m);
+    QuadRound<9, N>(abef, cdgh, m);
+    QuadRound<10, N>(abef, cdgh, m);
+    QuadRound<11, N>(abef, cdgh, m);
+    QuadRound<12, N>(abef, cdgh, m);
+    QuadRound<13, N>(abef, cdgh, m);
+    QuadRound<14, N>(abef, cdgh, m);
+    QuadRound<15, N>(abef, cdgh, m);
+
+    for (int n = 0; n < N; n++) {
+        abef[n] = _mm_add_epi32(abef[n], abef_save[n]);
+        cdgh[n] = _mm_add_epi32(cdgh[n], cdgh_save[n]);
+    }
+}
+
+/** From the state words s[0..7] in order to the ABEF and CDGH halves. */
+SHANI_INLINE void Load(__m128i& abef, __m128i& cdgh, const uint32_t* s)
+{
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&s[0]), 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&s[4]), 0x1b);
+    abef = _mm_alignr_epi8(cdab, efgh, 8);
+    cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+}
+
+/** And back. */
+SHANI_INLINE void Store(uint32_t* s, __m128i abef, __m128i cdgh)
+{
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i*)&s[0], _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i*)&s[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+SHANI_INLINE void ReadBlock(__m128i* m, const unsigned char* chunk)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    for (int i = 0; i < 4; i++)
+        m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16 * i)), bswap);
+}
+
+} // namespace
+
+/** Perform one SHA-256 transformation, processing a 64-byte chunk. */
+SHANI void Transform(uint32_t* s, const unsigned char* chunk)
+{
+    __m128i abef[1], cdgh[1], m[1][4];
+    Load(abef[0], cdgh[0], s);
+    ReadBlock(m[0], chunk);
+    Compress<1>(abef, cdgh, m);
+    Store(s, abef[0], cdgh[0]);
+}
+
+/**
+ * Double SHA-256 of two 64-byte messages at in, into 2 * 32 bytes at out. The rounds of one
+ * message are latency bound, so the two are interleaved.
+ */
+SHANI void Transform_2way_64(unsigned char* out, const unsigned char* in)
+{
+    __m128i abef[2], cdgh[2], m[2][4];
+    uint32_t s[8];
+
+    for (int n = 0; n < 2; n++) {
+        Load(abef[n], cdgh[n], init);
+        ReadBlock(m[n], in + 64 * n);
+    }
+    Compress<2>(abef, cdgh, m);
+
+    // The padding of a 64-byte message is a block of its own
+    for (int n = 0; n < 2; n++) {
+        m[n][0] = _mm_set_epi32(0, 0, 0, 0x80000000);
+        m[n][1] = m[n][2] = _mm_setzero_si128();
+        m[n][3] = _mm_set_epi32(512, 0, 0, 0);
+    }
+    Compress<2>(abef, cdgh, m);
+
+    // The second hash is of the 32-byte digest, which pads to a single block
+    for (int n = 0; n < 2; n++) {
+        Store(s, abef[n], cdgh[n]);
+        m[n][0] = _mm_loadu_si128((const __m128i*)&s[0]);
+        m[n][1] = _mm_loadu_si128((const __m128i*)&s[4]);
+        m[n][2] = _mm_set_epi32(0, 0, 0, 0x80000000);
+        m[n][3] = _mm_set_epi32(256, 0, 0, 0);
+        Load(abef[n], cdgh[n], init);
+    }
+    Compress<2>(abef, cdgh, m);
+
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    for (int n = 0; n < 2; n++) {
+        Store(s, abef[n], cdgh[n]);
+        _mm_storeu_si128((__m128i*)(out + 32 * n), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&s[0]), bswap));
+        _mm_storeu_si128((__m128i*)(out + 32 * n + 16), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&s[4]), bswap));
+    }
+}
+
+} // namespace sha256_shani
+
+#endif // ENABLE_SHA256_SHANI
@@ -0,0 +1,181 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way SSE2 double SHA-256 of single block messages and of 64-byte messages, used by
+// SHA256DShort() and SHA256D64().
+// SSE2 is part of the x86-64 baseline, so this needs no special compiler flags.
+
+#if defined(__x86_64__) || defined(__amd64__)
+
+#include <stdint.h>
+#include <emmintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64 {
+extern const uint32_t PADDING_WK[64];
+}
+
+namespace sha256d_sse2 {
+namespace {
+
+__m128i inline K(uint32_t x) { return _mm_set1_epi32(x); }
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z) { return Add(Add(x, y), z); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w) { return Add(Add(x, y), Add(z, w)); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline Xor(__m128i x, __m128i y, __m128i z) { return Xor(Xor(x, y), z); }
+__m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+__m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+__m128i inline ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+__m128i inline ShL(__m128i x, int n) { return _mm_slli_epi32(x, n); }
+__m128i inline RotR(__m128i x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+
+__m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+__m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m128i inline Sigma0(__m128i x) { return Xor(RotR(x, 2), RotR(x, 13), RotR(x, 22)); }
+__m128i inline Sigma1(__m128i x) { return Xor(RotR(x, 6), RotR(x, 11), RotR(x, 25)); }
+__m128i inline sigma0(__m128i x) { return Xor(RotR(x, 7), RotR(x, 18), ShR(x, 3)); }
+__m128i inline sigma1(__m128i x) { return Xor(RotR(x, 17), RotR(x, 19), ShR(x, 10)); }
+
+const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+/** One SHA-256 compression of the four blocks whose first 16 words are in w. */
+void inline Transform(__m128i* s, __m128i* w)
+{
+    for (int i = 16; i < 64; i++)
+        w[i] = Add(sigma1(w[i - 2]), w[i - 7], sigma0(w[i - 15]), w[i - 16]);
+
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        __m128i t1 = Add(Add(h, Sigma1(e), Ch(e, f, g)), K(k[i]), w[i]);
+        __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = Add(t1, t2);
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** The same for the padding block of 64-byte messages, whose schedule is precomputed. */
+void inline TransformPadding64(__m128i* s)
+{
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), K(sha256d64::PADDING_WK[i]));
+        __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = Add(t1, t2);
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+__m128i inline Read4(const unsigned char* in, int offset)
+{
+    return _mm_set_epi32(ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+}
+
+void inline Write4(unsigned char* out, int offset, __m128i v)
+{
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    WriteBE32(out + offset, lanes[0]);
+    WriteBE32(out + 32 + offset, lanes[1]);
+    WriteBE32(out + 64 + offset, lanes[2]);
+    WriteBE32(out + 96 + offset, lanes[3]);
+}
+
+} // namespace
+
+/** Double SHA-256 of four padded 64-byte blocks at in, into 4 * 32 bytes at out. */
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s[8], w[64];
+    for (int i = 0; i < 8; i++)
+        s[i] = K(init[i]);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read4(in, 4 * i);
+    Transform(s, w);
+
+    // The second hash is of the 32-byte digest, which pads to a single block
+    for (int i = 0; i < 8; i++) {
+        w[i] = s[i];
+        s[i] = K(init[i]);
+    }
+    w[8] = K(0x80000000);
+    for (int i = 9; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(256);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; i++)
+        Write4(out, 4 * i, s[i]);
+}
+
+/** Double SHA-256 of 4 64-byte messages at in, into 4 * 32 bytes at out. */
+void Transform_4way_64(unsigned char* out, const unsigned char* in)
+{
+    __m128i s[8], w[64];
+    for (int i = 0; i < 8; i++)
+        s[i] = K(init[i]);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read4(in, 4 * i);
+    Transform(s, w);
+
+    // The padding of a 64-byte message is a block of its own
+    TransformPadding64(s);
+
+    for (int i = 0; i < 8; i++) {
+        w[i] = s[i];
+        s[i] = K(init[i]);
+    }
+    w[8] = K(0x80000000);
+    for (int i = 9; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(256);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; i++)
+        Write4(out, 4 * i, s[i]);
+}
+
+} // namespace sha256d_sse2
+
+#endif
@@ -11,6 +11,7 @@
 #include <cstring>
 #include <cmath>
 #include <memory>
+#include <stdint.h>
 #include <vector>
 
 
@@ -23,6 +24,8 @@
  * 2) cache is a cache which is performant in memory usage and lookup speed. It
  * is lockfree for erase operations. Elements are lazily erased on the next
  * insert.
+ *
+ * 3) map is a cache of values by key built on cache (SolarCoin)
  */
 namespace CuckooCache
 {
@@ -132,7 +135,9 @@ public:
  *  Write Operations:
  *      - setup()
  *      - setup_bytes()
+ *      - resize()
  *      - insert()
+ *      - erase()
  *      - please_keep()
  *
  *  Synchronization Free Operations:
@@ -154,7 +159,8 @@ public:
  * @tparam Element should be a movable and copyable type
  * @tparam Hash should be a function/callable which takes a template parameter
  * hash_select and an Element and extracts a hash from it. Should return
- * high-entropy hashes for `Hash h; h<0>(e) ... h<7>(e)`.
+ * high-entropy hashes for `Hash h; h<0>(e) ... h<7>(e)`. SolarCoin: find() and
+ * erase() look up any key type K that Hash hashes like the Element it equals.
  */
 template <typename Element, typename Hash>
 class cache
@@ -203,6 +209,10 @@ private:
      * Should be set to log2(n)*/
     uint8_t depth_limit;
 
+    /** epoch_count counts the epochs started since setup, the generations
+     * of elements aged out (SolarCoin) */
+    uint64_t epoch_count;
+
     /** hash_function is a const instance of the hash function. It cannot be
      * static or initialized at call time as it may have internal state (such as
      * a nonce).
@@ -212,10 +222,11 @@ private:
     /** compute_hashes is convenience for not having to write out this
      * expression everywhere we use the hash values of an Element.
      *
-     * @param e the element whose hashes will be returned
+     * @param e the element (or key) whose hashes will be returned
      * @returns std::array<uint32_t, 8> of deterministic hashes derived from e
      */
-    inline std::array<uint32_t, 8> compute_hashes(const Element& e) const
+    template <typename K>
+    inline std::array<uint32_t, 8> compute_hashes(const K& e) const
     {
         return {{hash_function.template operator()<0>(e) & hash_mask,
                  hash_function.template operator()<1>(e) & hash_mask,
@@ -284,6 +295,7 @@ private:
                 else
                     allow_erase(i);
             epoch_heuristic_counter = epoch_size;
+            ++epoch_count;
         } else
             // reset the epoch_heuristic_counter to next do a scan when worst
             // case behavior (no intermittent erases) would exceed epoch size,
@@ -300,14 +312,15 @@ public:
      * call to setup or setup_bytes, otherwise operations may segfault.
      */
     cache() : table(), size(), collection_flags(0), epoch_flags(),
-    epoch_heuristic_counter(), epoch_size(), depth_limit(0), hash_function()
+    epoch_heuristic_counter(), epoch_size(), depth_limit(0), epoch_count(0), hash_function()
     {
     }
 
     /** setup initializes the container to store no more than new_size
      * elements. setup rounds down to a power of two size.
      *
-     * setup should only be called once.
+     * SolarCoin: setup may be called again, which empties the container; see
+     * resize() to keep the elements.
      *
      * @param new_size the desired number of elements to store
      * @returns the maximum number of elements storable
@@ -318,9 +331,11 @@ public:
         depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(std::max((uint32_t)2, new_size))));
         size = 1 << depth_limit;
         hash_mask = size-1;
+        table.clear();
         table.resize(size);
         collection_flags.setup(size);
-        epoch_flags.resize(size);
+        epoch_flags.assign(size, false);
+        epoch_count = 0;
         // Set to 45% as described above
         epoch_size = std::max((uint32_t)1, (45 * size) / 100);
         // Initially set to wait for a whole epoch
@@ -345,6 +360,43 @@ public:
         return setup(bytes/sizeof(Element));
     }
 
+    /** resize is setup keeping the elements not erased, as far as they fit,
+     * those of the current epoch last so they are the least likely dropped.
+     * The epoch count carries over. (SolarCoin)
+     *
+     * @param new_size the desired number of elements to store
+     * @returns the maximum number of elements storable
+     */
+    uint32_t resize(uint32_t new_size)
+    {
+        std::vector<Element> old_elements, recent_elements;
+        for (uint32_t i = 0; i < size; ++i) {
+            if (collection_flags.bit_is_set(i))
+                continue;
+            (epoch_flags[i] ? recent_elements : old_elements).push_back(std::move(table[i]));
+        }
+        const uint64_t old_epoch_count = epoch_count;
+        setup(new_size);
+        epoch_count = old_epoch_count;
+        for (Element& e : old_elements)
+            insert(std::move(e));
+        for (Element& e : recent_elements)
+            insert(std::move(e));
+        return size;
+    }
+
+    /** capacity returns the number of elements storable (SolarCoin) */
+    uint32_t capacity() const
+    {
+        return size;
+    }
+
+    /** epochs returns the number of epochs aged out since setup (SolarCoin) */
+    uint64_t epochs() const
+    {
+        return epoch_count;
+    }
+
     /** insert loops at most depth_limit times trying to insert a hash
      * at various locations in the table via a variant of the Cuckoo Algorithm
      * with eight hash locations.
@@ -363,21 +415,24 @@ public:
      * @post one of the following: All previously inserted elements and e are
      * now in the table, one previously inserted element is evicted from the
      * table, the entry attempted to be inserted is evicted.
+     * @returns false if an element was evicted (SolarCoin)
      *
      */
-    inline void insert(Element e)
+    inline bool insert(Element e)
     {
         epoch_check();
         uint32_t last_loc = invalid();
         bool last_epoch = true;
         std::array<uint32_t, 8> locs = compute_hashes(e);
         // Make sure we have not already inserted this element
-        // If we have, make sure that it does not get deleted
+        // If we have, make sure that it does not get deleted, and take the
+        // new one in case it differs beyond equality, as map values do
         for (uint32_t loc : locs)
             if (table[loc] == e) {
+                table[loc] = std::move(e);
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return true;
             }
         for (uint8_t depth = 0; depth < depth_limit; ++depth) {
             // First try to insert to an empty slot, if one exists
@@ -387,7 +442,7 @@ public:
                 table[loc] = std::move(e);
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return true;
             }
             /** Swap with the element at the location that was
             * not the last one looked at. Example:
@@ -413,6 +468,7 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        return false;
     }
 
     /* contains iterates through the hash locations for a given element
@@ -442,16 +498,174 @@ public:
      */
     inline bool contains(const Element& e, const bool erase) const
     {
-        std::array<uint32_t, 8> locs = compute_hashes(e);
+        return find(e, erase) != nullptr;
+    }
+
+    /** find is contains returning the element found, or nullptr (SolarCoin)
+     *
+     * @param k the element, or a key equal to it
+     * @param erase
+     * @returns the element in the table, valid until the next Write
+     */
+    template <typename K>
+    inline const Element* find(const K& k, const bool erase) const
+    {
+        std::array<uint32_t, 8> locs = compute_hashes(k);
         for (uint32_t loc : locs)
-            if (table[loc] == e) {
+            if (table[loc] == k) {
                 if (erase)
                     allow_erase(loc);
+                return &table[loc];
+            }
+        return nullptr;
+    }
+
+    /** erase removes an element right away, so it is no longer found, unlike
+     * contains(*, true) which leaves it until the space is needed (SolarCoin)
+     *
+     * @param k the element, or a key equal to it
+     * @returns true if the element was found
+     */
+    template <typename K>
+    bool erase(const K& k)
+    {
+        std::array<uint32_t, 8> locs = compute_hashes(k);
+        for (uint32_t loc : locs)
+            if (table[loc] == k) {
+                table[loc] = Element();
+                allow_erase(loc);
                 return true;
             }
         return false;
     }
 };
+
+/** map_entry is the element of a map: a key, its value and the salted hash
+ * of the key, kept so that moving the entry in the table never rehashes the
+ * key. Entries are equal to their key. (SolarCoin)
+ */
+template <typename Key, typename Value>
+struct map_entry
+{
+    Key key;
+    Value value;
+    uint64_t hash;
+
+    map_entry() : key(), value(), hash(0) {}
+    map_entry(const Key& key_in, const Value& value_in, uint64_t hash_in) : key(key_in), value(value_in), hash(hash_in) {}
+
+    bool operator==(const map_entry& other) const { return hash == other.hash && key == other.key; }
+};
+
+/** map_probe is a key being looked up, with its hash (SolarCoin) */
+template <typename Key>
+struct map_probe
+{
+    const Key& key;
+    uint64_t hash;
+};
+
+template <typename Key, typename Value>
+inline bool operator==(const map_entry<Key, Value>& entry, const map_probe<Key>& probe)
+{
+    return entry.hash == probe.hash && entry.key == probe.key;
+}
+
+/** map_hasher spreads the hash of an entry or a probe into the eight hashes
+ * of the cache, multiplying it by distinct odd constants (SolarCoin)
+ */
+class map_hasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(uint64_t hash) const
+    {
+        static_assert(hash_select < 8, "map_hasher only has 8 hashes available.");
+        static const uint64_t multipliers[8] = {
+            0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL,
+            0xff51afd7ed558ccdULL, 0xc4ceb9fe1a85ec53ULL, 0x94d049bb133111ebULL, 0xbf58476d1ce4e5b9ULL};
+        return (hash * multipliers[hash_select]) >> 32;
+    }
+
+    template <uint8_t hash_select, typename Key, typename Value>
+    uint32_t operator()(const map_entry<Key, Value>& entry) const
+    {
+        return operator()<hash_select>(entry.hash);
+    }
+
+    template <uint8_t hash_select, typename Key>
+    uint32_t operator()(const map_probe<Key>& probe) const
+    {
+        return operator()<hash_select>(probe.hash);
+    }
+};
+
+/** map is a cache of values by key, with the lookup speed, memory efficiency
+ * and epoch based aging of cache: a value inserted may be dropped at any time
+ * for a newer one, and looking it up lets it be dropped first when erase is
+ * set. The same synchronization as for cache applies. (SolarCoin)
+ *
+ * @tparam Key should be copyable and equality comparable
+ * @tparam Value should be default constructible and copyable
+ * @tparam Hash should be a callable returning a salted high-entropy hash of a
+ * Key, as SaltedTxidHasher or SaltedOutpointHasher; it is called once per
+ * operation.
+ */
+template <typename Key, typename Value, typename Hash>
+class map
+{
+private:
+    typedef map_entry<Key, Value> entry_type;
+
+    cache<entry_type, map_hasher> entries;
+    const Hash hash_function;
+
+public:
+    /** As cache, map must be set up before use */
+    map() : entries(), hash_function() {}
+
+    uint32_t setup(uint32_t new_size) { return entries.setup(new_size); }
+    uint32_t setup_bytes(size_t bytes) { return entries.setup_bytes(bytes); }
+    uint32_t resize(uint32_t new_size) { return entries.resize(new_size); }
+    uint32_t capacity() const { return entries.capacity(); }
+    uint64_t epochs() const { return entries.epochs(); }
+    /** Memory of the table, not counting what the keys and values own */
+    size_t memory_usage() const { return (size_t)capacity() * (sizeof(entry_type) + 1) + capacity() / 8; }
+
+    /** insert a value for key, replacing the one it had
+     * @returns false if an entry was evicted */
+    bool insert(const Key& key, const Value& value)
+    {
+        return entries.insert(entry_type(key, value, hash_function(key)));
+    }
+
+    /** find the value of key, valid until the next Write, or nullptr */
+    const Value* find(const Key& key, const bool erase = false) const
+    {
+        const entry_type* entry = entries.find(map_probe<Key>{key, (uint64_t)hash_function(key)}, erase);
+        return entry ? &entry->value : nullptr;
+    }
+
+    bool erase(const Key& key)
+    {
+        return entries.erase(map_probe<Key>{key, (uint64_t)hash_function(key)});
+    }
+};
 } // namespace CuckooCache
 
+/** SolarCoin: counters of a cache since startup, reported by getsigcacheinfo */
+struct CacheStats
+{
+    uint64_t nHits;
+    uint64_t nMisses;
+    //! Elements dropped by an insertion that found no room for them
+    uint64_t nEvictions;
+    //! Epochs aged out, each a generation of elements allowed to be dropped
+    uint64_t nEpochs;
+    //! Capacity in elements
+    size_t nElements;
+
+    CacheStats() : nHits(0), nMisses(0), nEvictions(0), nEpochs(0), nElements(0) {}
+};
+
 #endif
@@ -6,6 +6,10 @@
 
 #include "util.h"
 #include "random.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+
 
 #include <boost/filesystem.hpp>
 
@@ -15,14 +19,17 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dboptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // up to two write buffers may be held in memory simultaneously, the rest is for the block cache
+    size_t nWriteBufferSize = dboptions.nWriteBufferSize ? dboptions.nWriteBufferSize : nCacheSize / 4;
+    options.block_cache = leveldb::NewLRUCache(nCacheSize > 4 * nWriteBufferSize ? nCacheSize - 2 * nWriteBufferSize : nCacheSize / 2);
+    options.write_buffer_size = nWriteBufferSize;
+    options.filter_policy = dboptions.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dboptions.nBloomBits) : NULL;
+    options.compression = dboptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dboptions.nMaxOpenFiles;
+    options.block_size = dboptions.nBlockSize;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -31,14 +38,14 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const CDBOptions& dboptionsIn) : dboptions(dboptionsIn)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -122,6 +129,67 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+bool CDBWrapper::GetProperty(const std::string& strName, std::string& strValue) const
+{
+    return pdb->GetProperty(strName, &strValue);
+}
+
+size_t CDBWrapper::DynamicMemoryUsage() const
+{
+    std::string strValue;
+    size_t nUsage = GetProperty("leveldb.approximate-memory-usage", strValue) ? atoi64(strValue) : 0;
+    if (options.block_cache)
+        nUsage += options.block_cache->TotalCharge();
+    return nUsage;
+}
+
+uint64_t CDBWrapper::EstimateSize() const
+{
+    // All keys start with a one byte prefix
+    const std::string strEnd(DBWRAPPER_PREALLOC_KEY_SIZE, '\xff');
+    const leveldb::Range range("", strEnd);
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+bool CDBWrapper::CompactInSteps(const std::string& strPrefixes, int nSplits, const boost::function<bool()>& fnStep) const
+{
+    nSplits = std::max(1, std::min(256, nSplits));
+    int nPrefix = 0;
+    while (nPrefix < 256) {
+        // Find the next prefix in use. The iterator is dropped before compacting, as it would keep
+        // the tables being replaced on disk.
+        {
+            const char chPrefix = (char)nPrefix;
+            std::unique_ptr<leveldb::Iterator> piter(pdb->NewIterator(iteroptions));
+            piter->Seek(leveldb::Slice(&chPrefix, 1));
+            if (!piter->Valid())
+                break;
+            nPrefix = (unsigned char)piter->key()[0];
+        }
+        if (strPrefixes.empty() || strPrefixes.find((char)nPrefix) != std::string::npos) {
+            for (int i = 0; i < nSplits; i++) {
+                if (fnStep && !fnStep())
+                    return false;
+                std::string strBegin(1, (char)nPrefix), strEnd(1, (char)nPrefix);
+                if (i > 0)
+                    strBegin += (char)(i * 256 / nSplits);
+                if (i + 1 < nSplits)
+                    strEnd += (char)((i + 1) * 256 / nSplits);
+                else if (nPrefix < 255)
+                    strEnd.assign(1, (char)(nPrefix + 1));
+                else
+                    strEnd.clear();
+                const leveldb::Slice slBegin(strBegin), slEnd(strEnd);
+                pdb->CompactRange(&slBegin, strEnd.empty() ? NULL : &slEnd);
+            }
+        }
+        nPrefix++;
+    }
+    return true;
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
@@ -148,4 +216,16 @@ const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w)
     return w.obfuscate_key;
 }
 
+void Deobfuscate(unsigned char* pch, size_t nSize, const std::vector<unsigned char>& key)
+{
+    if (key.empty() || std::all_of(key.begin(), key.end(), [](unsigned char c) { return c == 0; }))
+        return;
+    for (size_t i = 0, j = 0; i != nSize; i++) {
+        pch[i] ^= key[j++];
+        // As CDataStream::Xor(), without a division per byte
+        if (j == key.size())
+            j = 0;
+    }
+}
+
 };
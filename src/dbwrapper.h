@@ -13,6 +13,7 @@
 #include "version.h"
 
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
@@ -20,12 +21,35 @@
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+static const int DEFAULT_DB_BLOCK_SIZE = 4096;
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+static const bool DEFAULT_DB_COMPRESSION = false;
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
     dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+/** SolarCoin: LevelDB tuning of one database */
+struct CDBOptions
+{
+    //! Number of table files LevelDB may keep open
+    int nMaxOpenFiles;
+    //! Approximate size of the uncompressed data in a table block
+    size_t nBlockSize;
+    //! Bits per key of the bloom filters, 0 for no filters
+    int nBloomBits;
+    //! Size of the memtable; 0 to use a quarter of the cache size
+    size_t nWriteBufferSize;
+    //! Snappy compression of table blocks (has no effect if LevelDB is built without Snappy)
+    bool fCompression;
+
+    CDBOptions() : nMaxOpenFiles(DEFAULT_DB_MAX_OPEN_FILES), nBlockSize(DEFAULT_DB_BLOCK_SIZE),
+        nBloomBits(DEFAULT_DB_BLOOM_BITS), nWriteBufferSize(0), fCompression(DEFAULT_DB_COMPRESSION) {}
+};
+
 class CDBWrapper;
 
 /** These should be considered an implementation detail of the specific database.
@@ -42,6 +66,37 @@ void HandleError(const leveldb::Status& status);
  */
 const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
+/** SolarCoin: Undo the obfuscation of a value read from the database, in place */
+void Deobfuscate(unsigned char* pch, size_t nSize, const std::vector<unsigned char>& key);
+
+};
+
+/** SolarCoin: A key serialized on the stack, or in a stream if longer than DBWRAPPER_PREALLOC_KEY_SIZE, for a lookup */
+class CDBKey
+{
+private:
+    unsigned char buf[DBWRAPPER_PREALLOC_KEY_SIZE];
+    CDataStream ssKey;
+    leveldb::Slice slKey;
+
+public:
+    template <typename K>
+    explicit CDBKey(const K& key) : ssKey(SER_DISK, CLIENT_VERSION)
+    {
+        const size_t nSize = ::GetSerializeSize(key, SER_DISK, CLIENT_VERSION);
+        if (nSize <= sizeof(buf)) {
+            CSpanWriter(SER_DISK, CLIENT_VERSION, buf, buf + nSize) << key;
+            slKey = leveldb::Slice((const char*)buf, nSize);
+        } else {
+            ssKey << key;
+            slKey = leveldb::Slice(ssKey.data(), ssKey.size());
+        }
+    }
+
+    const leveldb::Slice& GetSlice() const { return slKey; }
+
+    CDBKey(const CDBKey&) = delete;
+    CDBKey& operator=(const CDBKey&) = delete;
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -56,11 +111,19 @@ private:
     CDataStream ssKey;
     CDataStream ssValue;
 
+    size_t size_estimate;
+
 public:
     /**
      * @param[in] _parent   CDBWrapper that this batch is to be submitted to
      */
-    CDBBatch(const CDBWrapper &_parent) : parent(_parent), ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION) { };
+    CDBBatch(const CDBWrapper &_parent) : parent(_parent), ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), size_estimate(0) { };
+
+    void Clear()
+    {
+        batch.Clear();
+        size_estimate = 0;
+    }
 
     template <typename K, typename V>
     void Write(const K& key, const V& value)
@@ -75,6 +138,14 @@ public:
         leveldb::Slice slValue(ssValue.data(), ssValue.size());
 
         batch.Put(slKey, slValue);
+        // LevelDB serializes writes as:
+        // - byte: header
+        // - varint: key length (1 byte up to 127B, 2 bytes up to 16383B, ...)
+        // - byte[]: key
+        // - varint: value length
+        // - byte[]: value
+        // The formula below assumes the key and value are both less than 16k.
+        size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
         ssKey.clear();
         ssValue.clear();
     }
@@ -87,8 +158,16 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         batch.Delete(slKey);
+        // LevelDB serializes erases as:
+        // - byte: header
+        // - varint: key length
+        // - byte[]: key
+        // The formula below assumes the key is less than 16kB.
+        size_estimate += 2 + (slKey.size() > 127) + slKey.size();
         ssKey.clear();
     }
+
+    size_t SizeEstimate() const { return size_estimate; }
 };
 
 class CDBIterator
@@ -96,6 +175,8 @@ class CDBIterator
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    //! The value last read, deobfuscated
+    std::vector<unsigned char> vchValue;
 
 public:
 
@@ -112,11 +193,8 @@ public:
     void SeekToFirst();
 
     template<typename K> void Seek(const K& key) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
-        piter->Seek(slKey);
+        CDBKey dbkey(key);
+        piter->Seek(dbkey.GetSlice());
     }
 
     void Next();
@@ -124,7 +202,7 @@ public:
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssKey(SER_DISK, CLIENT_VERSION, (const unsigned char*)slKey.data(), (const unsigned char*)slKey.data() + slKey.size());
             ssKey >> key;
         } catch (const std::exception&) {
             return false;
@@ -139,8 +217,10 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
+            // SolarCoin: Deobfuscated in a buffer kept across the values, rather than in a new stream each
+            vchValue.assign(slValue.data(), slValue.data() + slValue.size());
+            dbwrapper_private::Deobfuscate(vchValue.data(), vchValue.size(), dbwrapper_private::GetObfuscateKey(parent));
+            CSpanReader ssValue(SER_DISK, CLIENT_VERSION, vchValue.data(), vchValue.data() + vchValue.size());
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -164,6 +244,9 @@ private:
     //! database options used
     leveldb::Options options;
 
+    //! tuning the database was opened with
+    CDBOptions dboptions;
+
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
@@ -198,20 +281,18 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dboptionsIn LevelDB tuning.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBOptions& dboptionsIn = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        CDBKey dbkey(key);
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(readoptions, dbkey.GetSlice(), &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -219,8 +300,10 @@ public:
             dbwrapper_private::HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
+            // SolarCoin: Deobfuscated and read where LevelDB put it, rather than copied into a stream
+            unsigned char* pbegin = (unsigned char*)&strValue[0];
+            dbwrapper_private::Deobfuscate(pbegin, strValue.size(), obfuscate_key);
+            CSpanReader ssValue(SER_DISK, CLIENT_VERSION, pbegin, pbegin + strValue.size());
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -239,13 +322,10 @@ public:
     template <typename K>
     bool Exists(const K& key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        CDBKey dbkey(key);
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(readoptions, dbkey.GetSlice(), &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -286,6 +366,32 @@ public:
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    //! SolarCoin: Read a LevelDB property, such as "leveldb.stats"
+    bool GetProperty(const std::string& strName, std::string& strValue) const;
+
+    //! SolarCoin: Approximate size of all data on disk, in bytes
+    uint64_t EstimateSize() const;
+
+    //! SolarCoin: Bytes of memory held by the memtables and the block cache
+    size_t DynamicMemoryUsage() const;
+
+    const CDBOptions& GetDBOptions() const { return dboptions; }
+
+    /**
+     * SolarCoin: Compact the keys starting with one of the bytes of strPrefixes (every key if it is
+     * empty) one range at a time, so that reads and writes are held up for a short while at most:
+     * each prefix in use is split in nSplits ranges on the byte that follows it. fnStep runs before
+     * every range, and may pause; it returning false stops the compaction, and this returns false.
+     */
+    bool CompactInSteps(const std::string& strPrefixes, int nSplits, const boost::function<bool()>& fnStep) const;
+
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CDBKey dbkey1(key_begin), dbkey2(key_end);
+        pdb->CompactRange(&dbkey1.GetSlice(), &dbkey2.GetSlice());
+    }
 };
 
 #endif // BITCOIN_DBWRAPPER_H
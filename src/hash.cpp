@@ -72,6 +72,67 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
     return h1;
 }
 
+void MurmurHash3(const uint32_t* pnHashSeeds, unsigned int nSeeds, const unsigned char* pData, size_t nLen, uint32_t* pnHashes)
+{
+    // The same as above, but every block of the data is loaded and mixed once for all seeds:
+    // only h1 depends on the seed.
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+
+    for (unsigned int j = 0; j < nSeeds; j++)
+        pnHashes[j] = pnHashSeeds[j];
+
+    //----------
+    // body
+    const size_t nblocks = nLen / 4;
+    for (size_t i = 0; i < nblocks; i++) {
+        uint32_t k1 = ReadLE32(pData + i*4);
+
+        k1 *= c1;
+        k1 = ROTL32(k1, 15);
+        k1 *= c2;
+
+        for (unsigned int j = 0; j < nSeeds; j++) {
+            uint32_t h1 = pnHashes[j] ^ k1;
+            h1 = ROTL32(h1, 13);
+            pnHashes[j] = h1 * 5 + 0xe6546b64;
+        }
+    }
+
+    //----------
+    // tail
+    const uint8_t* tail = pData + nblocks * 4;
+
+    uint32_t k1 = 0;
+
+    switch (nLen & 3) {
+    case 3:
+        k1 ^= tail[2] << 16;
+    case 2:
+        k1 ^= tail[1] << 8;
+    case 1:
+        k1 ^= tail[0];
+        k1 *= c1;
+        k1 = ROTL32(k1, 15);
+        k1 *= c2;
+        for (unsigned int j = 0; j < nSeeds; j++)
+            pnHashes[j] ^= k1;
+    }
+
+    //----------
+    // finalization
+    for (unsigned int j = 0; j < nSeeds; j++) {
+        uint32_t h1 = pnHashes[j];
+        h1 ^= nLen;
+        h1 ^= h1 >> 16;
+        h1 *= 0x85ebca6b;
+        h1 ^= h1 >> 13;
+        h1 *= 0xc2b2ae35;
+        h1 ^= h1 >> 16;
+        pnHashes[j] = h1;
+    }
+}
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64])
 {
     unsigned char num[4];
@@ -208,3 +269,44 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val)
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra)
+{
+    /* Specialized implementation for efficiency */
+    uint64_t d = val.GetUint64(0);
+
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1 ^ d;
+
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(1);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(2);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(3);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = (((uint64_t)36) << 56) | extra;
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    v2 ^= 0xFF;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
@@ -160,6 +160,31 @@ public:
     }
 };
 
+/** SolarCoin: Reads from a stream, hashing everything that was read. */
+template<typename Source>
+class CHashVerifier : public CHashWriter
+{
+private:
+    Source* source;
+
+public:
+    CHashVerifier(Source* sourceIn) : CHashWriter(sourceIn->GetType(), sourceIn->GetVersion()), source(sourceIn) {}
+
+    void read(char* pch, size_t nSize)
+    {
+        source->read(pch, nSize);
+        this->write(pch, nSize);
+    }
+
+    template<typename T>
+    CHashVerifier<Source>& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+};
+
 /** Compute the 256-bit hash of an object's serialization. */
 template<typename T>
 uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL_VERSION)
@@ -170,6 +195,8 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
 }
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
+/** SolarCoin: The MurmurHash3 of the same data under each of nSeeds seeds, in one pass over the data */
+void MurmurHash3(const uint32_t* pnHashSeeds, unsigned int nSeeds, const unsigned char* pData, size_t nLen, uint32_t* pnHashes);
 
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
@@ -206,5 +233,8 @@ public:
  *      .Finalize()
  */
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+/** Like SipHashUint256, with an extra 32-bit value appended to the input
+ *  (used to hash outpoints without building a serialized copy). */
+uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
 #endif // BITCOIN_HASH_H
@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -18,12 +19,32 @@
 #include <stdio.h>
 #include "utilstrencodings.h"
 
+#include <set>
+
 #include <boost/algorithm/string.hpp> // boost::trim
 #include <boost/foreach.hpp> //BOOST_FOREACH
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
+/** SolarCoin: Largest request body looked into for its method, to pick the work queue */
+static const size_t MAX_FAST_REQUEST_SIZE = 1024;
+
+/** SolarCoin: Short read-only calls, served by the fast work queue */
+static const std::set<std::string> setFastMethods = {
+    "getbestblockhash",
+    "getblockchaininfo",
+    "getblockcount",
+    "getblockhash",
+    "getconnectioncount",
+    "getdifficulty",
+    "getmempoolinfo",
+    "getmemoryinfo",
+    "getrpcinfo",
+    "getschedulerinfo",
+    "ping",
+};
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wallet.
  */
@@ -83,6 +104,16 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     req->WriteReply(nStatus, strReply);
 }
 
+/** SolarCoin: End a streamed reply that failed after its status was sent; returns false if none was started */
+static bool EndStreamedReply(HTTPRequest* req, const CJSONStream& stream)
+{
+    if (!stream.IsFlushed())
+        return false;
+    LogPrintf("ThreadRPCServer: call failed after part of its result was sent, ending the reply\n");
+    req->EndChunkedReply();
+    return true;
+}
+
 //This function checks username and password against -rpcauth
 //entries from config file.
 static bool multiUserAuthorized(std::string strUserPass)
@@ -176,6 +207,16 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
+    // SolarCoin: A large result is sent as it is written, as a chunked reply started by the first chunk
+    CJSONStream stream([req](const std::string& strChunk) {
+        if (!req->IsChunkedReply()) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartChunkedReply(HTTP_OK);
+            req->WriteChunk("{\"result\":");
+        }
+        req->WriteChunk(strChunk);
+    });
+
     try {
         // Parse request
         UniValue valRequest;
@@ -189,30 +230,56 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
+            jreq.stream = &stream;
 
             UniValue result = tableRPC.execute(jreq);
 
+            if (stream.IsFlushed()) {
+                stream.Flush();
+                req->WriteChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                req->EndChunkedReply();
+                return true;
+            }
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            if (stream.IsUsed())
+                strReply = "{\"result\":" + stream.TakeBuffer() + ",\"error\":null,\"id\":" + jreq.id.write() + "}\n";
+            else
+                strReply = JSONRPCReply(result, NullUniValue, jreq.id);
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
-        JSONErrorReply(req, objError, jreq.id);
+        if (!EndStreamedReply(req, stream))
+            JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (const std::exception& e) {
-        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        if (!EndStreamedReply(req, stream))
+            JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
     return true;
 }
 
+/** SolarCoin: Whether a JSON-RPC request is a single call of a fast method. Runs on the
+ * event loop thread, so bodies longer than a short call are not parsed at all.
+ */
+static bool HTTPReq_JSONRPC_IsFast(HTTPRequest* req, const std::string &)
+{
+    if (req->GetRequestMethod() != HTTPRequest::POST)
+        return false;
+    UniValue valRequest;
+    if (!valRequest.read(req->PeekBody(MAX_FAST_REQUEST_SIZE)) || !valRequest.isObject())
+        return false;
+    const UniValue& valMethod = find_value(valRequest.get_obj(), "method");
+    return valMethod.isStr() && setFastMethods.count(valMethod.get_str());
+}
+
 static bool InitRPCAuthentication()
 {
     if (GetArg("-rpcpassword", "") == "")
@@ -237,7 +304,11 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPC_IsFast);
+#ifdef ENABLE_WALLET
+    // SolarCoin: Wallet calls can name the wallet they are for as /wallet/<filename>
+    RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC, HTTPReq_JSONRPC_IsFast);
+#endif
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -254,6 +325,9 @@ void StopHTTPRPC()
 {
     LogPrint("rpc", "Stopping HTTP RPC server\n");
     UnregisterHTTPHandler("/", true);
+#ifdef ENABLE_WALLET
+    UnregisterHTTPHandler("/wallet/", false);
+#endif
     if (httpRPCTimerInterface) {
         RPCUnsetTimerInterface(httpRPCTimerInterface);
         delete httpRPCTimerInterface;
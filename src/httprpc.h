@@ -34,4 +34,13 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Start the /metrics handler.
+ * Precondition; HTTP has been started.
+ */
+bool StartHTTPMetrics();
+/** Stop the /metrics handler.
+ * Precondition; HTTP has been stopped.
+ */
+void StopHTTPMetrics();
+
 #endif
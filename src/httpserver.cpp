@@ -7,6 +7,7 @@
 #include "chainparamsbase.h"
 #include "compat.h"
 #include "util.h"
+#include "metrics.h"
 #include "netbase.h"
 #include "rpc/protocol.h" // For HTTP status codes
 #include "sync.h"
@@ -68,10 +69,13 @@ private:
     /** Mutex protects entire object */
     std::mutex cs;
     std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
+    //! SolarCoin: Work items with the time (in microseconds) they were enqueued at
+    std::deque<std::pair<int64_t, std::unique_ptr<WorkItem>>> queue;
     bool running;
     size_t maxDepth;
     int numThreads;
+    //! SolarCoin: Counters of the work done, reported by GetStats()
+    HTTPWorkQueueStats stats;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -92,10 +96,12 @@ private:
     };
 
 public:
-    WorkQueue(size_t _maxDepth) : running(true),
+    WorkQueue(const std::string& name, size_t _maxDepth) : running(true),
                                  maxDepth(_maxDepth),
                                  numThreads(0)
     {
+        stats.name = name;
+        stats.nMaxDepth = _maxDepth;
     }
     /** Precondition: worker threads have all stopped
      * (call WaitExit)
@@ -108,9 +114,13 @@ public:
     {
         std::unique_lock<std::mutex> lock(cs);
         if (queue.size() >= maxDepth) {
+            stats.nRejected++;
+            AddMetric(METRIC_HTTP_REJECTED);
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        queue.emplace_back(GetTimeMicros(), std::unique_ptr<WorkItem>(item));
+        AddMetric(METRIC_HTTP_QUEUE_DEPTH);
+        stats.nPeakDepth = std::max(stats.nPeakDepth, queue.size());
         cond.notify_one();
         return true;
     }
@@ -120,16 +130,29 @@ public:
         ThreadCounter count(*this);
         while (true) {
             std::unique_ptr<WorkItem> i;
+            int64_t nStart;
             {
                 std::unique_lock<std::mutex> lock(cs);
                 while (running && queue.empty())
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = std::move(queue.front());
+                nStart = GetTimeMicros();
+                int64_t nWait = nStart - queue.front().first;
+                stats.nWaitMicros += nWait;
+                stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, nWait);
+                i = std::move(queue.front().second);
                 queue.pop_front();
+                AddMetric(METRIC_HTTP_QUEUE_DEPTH, -1);
             }
             (*i)();
+            int64_t nRun = GetTimeMicros() - nStart;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                stats.nProcessed++;
+                stats.nRunMicros += nRun;
+                stats.nMaxRunMicros = std::max(stats.nMaxRunMicros, nRun);
+            }
         }
     }
     /** Interrupt and exit loops */
@@ -153,18 +176,29 @@ public:
         std::unique_lock<std::mutex> lock(cs);
         return queue.size();
     }
+
+    /** Return the counters of the queue */
+    HTTPWorkQueueStats GetStats()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        HTTPWorkQueueStats ret = stats;
+        ret.nDepth = queue.size();
+        ret.nThreads = numThreads;
+        return ret;
+    }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler):
-        prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler, HTTPRequestIsFast _isFast):
+        prefix(_prefix), exactMatch(_exactMatch), handler(_handler), isFast(_isFast)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestIsFast isFast;
 };
 
 /** HTTP module state */
@@ -177,6 +211,8 @@ struct evhttp* eventHTTP = 0;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
+//! SolarCoin: Work queue for the requests the handlers deem fast, so they do not wait behind long ones
+static WorkQueue<HTTPClosure>* fastWorkQueue = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -284,12 +320,14 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        bool fFast = fastWorkQueue && i->isFast && i->isFast(hreq.get(), path);
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if ((fFast ? fastWorkQueue : workQueue)->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            LogPrintf("WARNING: request rejected because http %swork queue depth exceeded, it can be increased with the %s= setting\n",
+                      fFast ? "fast " : "", fFast ? "-rpcfastworkqueue" : "-rpcworkqueue");
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
     } else {
@@ -435,7 +473,12 @@ bool InitHTTPServer()
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    workQueue = new WorkQueue<HTTPClosure>("general", workQueueDepth);
+    if (GetArg("-rpcfastthreads", DEFAULT_HTTP_FAST_THREADS) > 0) {
+        int fastWorkQueueDepth = std::max((long)GetArg("-rpcfastworkqueue", DEFAULT_HTTP_FAST_WORKQUEUE), 1L);
+        LogPrintf("HTTP: creating fast work queue of depth %d\n", fastWorkQueueDepth);
+        fastWorkQueue = new WorkQueue<HTTPClosure>("fast", fastWorkQueueDepth);
+    }
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -457,6 +500,14 @@ bool StartHTTPServer()
         std::thread rpc_worker(HTTPWorkQueueRun, workQueue);
         rpc_worker.detach();
     }
+    if (fastWorkQueue) {
+        int rpcFastThreads = GetArg("-rpcfastthreads", DEFAULT_HTTP_FAST_THREADS);
+        LogPrintf("HTTP: starting %d fast worker threads\n", rpcFastThreads);
+        for (int i = 0; i < rpcFastThreads; i++) {
+            std::thread rpc_worker(HTTPWorkQueueRun, fastWorkQueue);
+            rpc_worker.detach();
+        }
+    }
     return true;
 }
 
@@ -473,6 +524,8 @@ void InterruptHTTPServer()
     }
     if (workQueue)
         workQueue->Interrupt();
+    if (fastWorkQueue)
+        fastWorkQueue->Interrupt();
 }
 
 void StopHTTPServer()
@@ -482,6 +535,12 @@ void StopHTTPServer()
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
         workQueue->WaitExit();
         delete workQueue;
+        workQueue = 0;
+    }
+    if (fastWorkQueue) {
+        fastWorkQueue->WaitExit();
+        delete fastWorkQueue;
+        fastWorkQueue = 0;
     }
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -508,6 +567,16 @@ void StopHTTPServer()
     LogPrint("http", "Stopped HTTP server\n");
 }
 
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats()
+{
+    std::vector<HTTPWorkQueueStats> vStats;
+    if (workQueue)
+        vStats.push_back(workQueue->GetStats());
+    if (fastWorkQueue)
+        vStats.push_back(fastWorkQueue->GetStats());
+    return vStats;
+}
+
 struct event_base* EventBase()
 {
     return eventBase;
@@ -540,12 +609,17 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyChunked(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyChunked) {
+        // The status was sent already, so the best left to do is to end the reply
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -584,6 +658,20 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t nMaxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    size_t size = evbuffer_get_length(buf);
+    if (size > nMaxSize)
+        return "";
+    std::string rv(size, '\0');
+    if (size == 0 || evbuffer_copyout(buf, &rv[0], size) != (ev_ssize_t)size)
+        return "";
+    return rv;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -610,6 +698,42 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && !replyChunked && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        std::bind(evhttp_send_reply_start, req, nStatus, (const char*)NULL));
+    ev->trigger(0);
+    replyChunked = true;
+}
+
+void HTTPRequest::WriteChunk(const std::string& strChunk)
+{
+    assert(replyChunked && req);
+    if (strChunk.empty())
+        return;
+    // The request's own output buffer belongs to the event loop thread while the reply is sent
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    struct evhttp_request* reqChunk = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reqChunk, evb]() {
+        evhttp_send_reply_chunk(reqChunk, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(replyChunked && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(evhttp_send_reply_end, req));
+    ev->trigger(0);
+    replyChunked = false;
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -650,10 +774,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestIsFast &isFast)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, isFast));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -670,3 +794,14 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
     }
 }
 
+std::string urlDecode(const std::string &urlEncoded) {
+    std::string res;
+    if (!urlEncoded.empty()) {
+        char *decoded = evhttp_uridecode(urlEncoded.c_str(), false, NULL);
+        if (decoded) {
+            res = std::string(decoded);
+            free(decoded);
+        }
+    }
+    return res;
+}
@@ -8,9 +8,12 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <vector>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
+static const int DEFAULT_HTTP_FAST_THREADS=2;
+static const int DEFAULT_HTTP_FAST_WORKQUEUE=64;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
@@ -34,14 +37,41 @@ void StopHTTPServer();
 
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** SolarCoin: Whether a request to a certain HTTP path is fast to serve.
+ * It is called on the event loop thread, so it must only take a cheap look at the request.
+ */
+typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestIsFast;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Requests for which isFast returns true go to the fast work
+ * queue (-rpcfastthreads), so they are not held up by long requests.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestIsFast &isFast = nullptr);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** SolarCoin: Counters of an HTTP work queue */
+struct HTTPWorkQueueStats
+{
+    std::string name;
+    int nThreads = 0;
+    size_t nDepth = 0;
+    size_t nMaxDepth = 0;
+    //! Deepest the queue has been
+    size_t nPeakDepth = 0;
+    uint64_t nProcessed = 0;
+    //! Requests refused because the queue was full
+    uint64_t nRejected = 0;
+    //! Time the processed requests waited in the queue, and took to run
+    int64_t nWaitMicros = 0;
+    int64_t nMaxWaitMicros = 0;
+    int64_t nRunMicros = 0;
+    int64_t nMaxRunMicros = 0;
+};
+
+/** SolarCoin: Return the counters of the HTTP work queues */
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats();
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -55,6 +85,8 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! SolarCoin: Whether a chunked reply was started and not ended yet
+    bool replyChunked;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -94,6 +126,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * SolarCoin: Return the request body without consuming it, or an empty
+     * string if it is longer than nMaxSize.
+     */
+    std::string PeekBody(size_t nMaxSize);
+
     /**
      * Write output header.
      *
@@ -110,6 +148,17 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * SolarCoin: Reply with chunked transfer encoding, for replies written as they are made.
+     * Start with StartChunkedReply, after the headers; send the body with any number of
+     * WriteChunk calls, and finish with EndChunkedReply. The chunks are sent in order by
+     * the event loop thread.
+     */
+    void StartChunkedReply(int nStatus);
+    void WriteChunk(const std::string& strChunk);
+    void EndChunkedReply();
+    bool IsChunkedReply() const { return replyChunked; }
 };
 
 /** Event handler closure.
@@ -144,4 +193,6 @@ private:
     struct event* ev;
 };
 
+std::string urlDecode(const std::string &urlEncoded);
+
 #endif // BITCOIN_HTTPSERVER_H
@@ -9,29 +9,44 @@
 
 #include "init.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilter.h"
+#include "blockfilemap.h"
+#include "blockindexsnapshot.h"
+#include "blockstatsindex.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "coinstatsindex.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/aes.h"
+#include "crypto/scrypt.h"
+#include "crypto/sha256.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "kernel.h"
 #include "key.h"
 #include "validation.h"
+#include "metrics.h"
 #include "miner.h"
 #include "netbase.h"
 #include "net.h"
 #include "net_processing.h"
+#include "notify.h"
 #include "policy/policy.h"
+#include "profile.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "support/largepages.h"
 #include "timedata.h"
 #include "txdb.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
@@ -72,6 +87,7 @@ static const bool DEFAULT_DISABLE_SAFEMODE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 
 std::unique_ptr<CConnman> g_connman;
+CScheduler* g_scheduler = NULL;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
 #if ENABLE_ZMQ
@@ -96,6 +112,12 @@ enum BindFlags {
 };
 
 static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
+/** SolarCoin: how often queued fee estimator events are applied, in seconds */
+static const int64_t FEE_ESTIMATES_PROCESS_INTERVAL = 1;
+/** SolarCoin: how often the fee estimates are saved while running, in seconds */
+static const int64_t FEE_ESTIMATES_FLUSH_INTERVAL = 60 * 60;
+/** SolarCoin: how often the mempool is dumped to mempool.dat while running, in seconds */
+static const int64_t MEMPOOL_DUMP_INTERVAL = 5 * 60;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -148,9 +170,9 @@ class CCoinsViewErrorCatcher : public CCoinsViewBacked
 {
 public:
     CCoinsViewErrorCatcher(CCoinsView* view) : CCoinsViewBacked(view) {}
-    bool GetCoins(const uint256 &txid, CCoins &coins) const {
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const {
         try {
-            return CCoinsViewBacked::GetCoins(txid, coins);
+            return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
             uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
             LogPrintf("Error reading from database: %s\n", e.what());
@@ -164,7 +186,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -180,6 +201,36 @@ void Interrupt(boost::thread_group& threadGroup)
     threadGroup.interrupt_all();
 }
 
+/** SolarCoin: save the fee estimates through a temporary file, so a crash never leaves a torn file */
+static void FlushFeeEstimates()
+{
+    boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+    boost::filesystem::path est_path_new = GetDataDir() / (std::string(FEE_ESTIMATES_FILENAME) + ".new");
+    bool fWritten = false;
+    {
+        CAutoFile est_fileout(fopen(est_path_new.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (!est_fileout.IsNull())
+            fWritten = mempool.WriteFeeEstimates(est_fileout);
+    }
+    if (!fWritten || !RenameOver(est_path_new, est_path))
+        LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
+}
+
+/** SolarCoin: Write the -profile call paths for flamegraph.pl */
+static void DumpProfile()
+{
+    boost::filesystem::path path = GetDataDir() / "profile.folded";
+    FILE* file = fopen(path.string().c_str(), "w");
+    if (!file) {
+        LogPrintf("%s: Unable to write %s\n", __func__, path.string());
+        return;
+    }
+    std::string strFolded = FormatProfileFolded(GetProfilePaths());
+    fwrite(strFolded.data(), 1, strFolded.size(), file);
+    fclose(file);
+    LogPrintf("Wrote the profile to %s\n", path.string());
+}
+
 void Shutdown()
 {
     LogPrintf("%s: In progress...\n", __func__);
@@ -197,11 +248,13 @@ void Shutdown()
 
     StopHTTPRPC();
     StopREST();
+    StopHTTPMetrics();
     StopRPC();
     StopHTTPServer();
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
-        pwalletMain->Flush(false);
+    for (CWallet* pwallet : vpwallets) {
+        pwallet->Flush(false);
+    }
 #endif
     MapPort(false);
     UnregisterValidationInterface(peerLogic.get());
@@ -209,25 +262,29 @@ void Shutdown()
     g_connman.reset();
 
     StopTorControl();
+    StopNotifications();
+    g_scheduler = NULL;
     UnregisterNodeSignals(GetNodeSignals());
     if (fDumpMempoolLater)
         DumpMempool();
 
     if (fFeeEstimatesInitialized)
     {
-        boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-        CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
-        if (!est_fileout.IsNull())
-            mempool.WriteFeeEstimates(est_fileout);
-        else
-            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
+        FlushFeeEstimates();
         fFeeEstimatesInitialized = false;
     }
 
+    StopSnapshotValidation();
+    StopTxIndex();
+    StopBlockFilterIndex();
+    StopBlockStatsIndex();
+
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
+            if (GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT))
+                DumpBlockIndexSnapshot();
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
@@ -237,11 +294,19 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete paddressindex;
+        paddressindex = NULL;
+        delete pcoinstatsindex;
+        pcoinstatsindex = NULL;
     }
+    StopBlockFileRemover();
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
-        pwalletMain->Flush(true);
+    for (CWallet* pwallet : vpwallets) {
+        pwallet->Flush(true);
+    }
 #endif
+    if (fProfile)
+        DumpProfile();
 
 #if ENABLE_ZMQ
     if (pzmqNotificationInterface) {
@@ -250,6 +315,7 @@ void Shutdown()
         pzmqNotificationInterface = NULL;
     }
 #endif
+    StopValidationInterfaceQueue();
 
 #ifndef WIN32
     try {
@@ -260,12 +326,16 @@ void Shutdown()
 #endif
     UnregisterAllValidationInterfaces();
 #ifdef ENABLE_WALLET
-    delete pwalletMain;
+    for (CWallet* pwallet : vpwallets) {
+        delete pwallet;
+    }
+    vpwallets.clear();
     pwalletMain = NULL;
 #endif
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    StopAsyncLog();
 }
 
 /**
@@ -325,9 +395,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt("-notifybatch=<n>", strprintf(_("Maximum number of values replacing %%s in one notify command (default: %u)"), DEFAULT_NOTIFY_BATCH));
+    strUsage += HelpMessageOpt("-notifyqueue=<n>", strprintf(_("Maximum number of notifications waiting for a notify command, beyond which the oldest are dropped (default: %u)"), DEFAULT_NOTIFY_QUEUE));
+    strUsage += HelpMessageOpt("-notifythreads=<n>", strprintf(_("Number of notify commands running at the same time (1 to %d, and fewer than -schedulerthreads, default: %d). A command \"%s<path>\" writes \"<option> <value>\" lines to the unix socket at path instead"), MAX_NOTIFY_THREADS, DEFAULT_NOTIFY_THREADS, NOTIFY_UNIX_PREFIX));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
-    strUsage +=HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)"), Params(CBaseChainParams::MAIN).GetConsensus().defaultAssumeValid.GetHex(), Params(CBaseChainParams::TESTNET).GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage +=HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their scrypt re-checks and script verification (0 to verify all, default: %s or the last checkpoint, testnet: %s)"), Params(CBaseChainParams::MAIN).GetConsensus().defaultAssumeValid.GetHex(), Params(CBaseChainParams::TESTNET).GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage += HelpMessageOpt("-coinsprefetch=<n>", strprintf(_("Set the number of threads reading the inputs of blocks ahead of their validation (0 to %d, 0 = off, default: %d)"),
+        MAX_COINS_PREFETCH_THREADS, DEFAULT_COINS_PREFETCH_THREADS));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -337,10 +412,33 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    if (showDebug) {
+        // SolarCoin: LevelDB tuning, per database
+        strUsage += HelpMessageOpt("-<db>maxopenfiles=<n>", strprintf("Table files LevelDB keeps open for the chainstate or blockindex database (default: %u)", DEFAULT_DB_MAX_OPEN_FILES));
+        strUsage += HelpMessageOpt("-<db>blocksize=<n>", strprintf("Size of LevelDB table blocks in bytes (default: %u)", DEFAULT_DB_BLOCK_SIZE));
+        strUsage += HelpMessageOpt("-<db>bloombits=<n>", strprintf("Bits per key of the LevelDB bloom filters, 0 to disable them (default: %u)", DEFAULT_DB_BLOOM_BITS));
+        strUsage += HelpMessageOpt("-<db>writebuffer=<n>", "Size of the LevelDB write buffer in megabytes, taken from the cache of that database (default: a quarter of it)");
+        strUsage += HelpMessageOpt("-<db>compression", strprintf("Compress LevelDB tables with Snappy, if available (default: %u)", DEFAULT_DB_COMPRESSION));
+        strUsage += HelpMessageOpt("-dbcompactafteribd", strprintf("Compact the chainstate database in the background once the initial block download is done (default: %u)", DEFAULT_DB_COMPACT_AFTER_IBD));
+        strUsage += HelpMessageOpt("-dbcompactsplits=<n>", strprintf("Ranges each key prefix is compacted in by -dbcompactafteribd and the compactdb rpc call (1-256, default: %u)", DEFAULT_DB_COMPACT_SPLITS));
+        strUsage += HelpMessageOpt("-dbcompactpause=<n>", strprintf("Milliseconds to pause between the ranges of a compaction (default: %u)", DEFAULT_DB_COMPACT_PAUSE));
+    }
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the transactions and unspent outputs of each address, used by the getaddress* rpc calls; needs -reindex-chainstate when turned on (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-blockfileprealloc=<n>", strprintf(_("Grow block files on disk by <n> MiB at a time, and undo files by 1/16 of it (1-%u, default: %u)"), MAX_BLOCKFILE_SIZE / 1024 / 1024, DEFAULT_BLOCKFILE_PREALLOC));
+    strUsage += HelpMessageOpt("-blockfilemmap=<n>", strprintf(_("Read blocks and undo data from memory-mapped files, keeping up to <n> MiB of them mapped (default: %u, 0 = off)"), DEFAULT_BLOCKFILE_MMAP));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of compact block filters, used to skip blocks during wallet rescans, built in the background when turned on (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-blockindexsnapshot", strprintf(_("Write the block index to a file at shutdown, loaded at the next startup instead of the block index database (default: %u)"), DEFAULT_BLOCK_INDEX_SNAPSHOT));
+    strUsage += HelpMessageOpt("-blockservecache=<n>", strprintf(_("Keep up to <n> megabytes of recently served blocks serialized for other peers (default: %u)"), DEFAULT_BLOCK_SERVE_CACHE));
+    strUsage += HelpMessageOpt("-blockstatsindex", strprintf(_("Maintain an index of the fees, rewards, stake data and sizes of each block, used by the getblockstats rpc calls, built in the background when turned on (default: %u)"), DEFAULT_BLOCKSTATSINDEX));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain the statistics of the unspent output set after each block, so gettxoutsetinfo answers at once and for any height (default: %u)"), DEFAULT_COINSTATSINDEX));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadheaders=<file>", _("Imports the headers of a bundle written by dumpheaders on startup, up to the last checkpoint it reaches"));
+    strUsage += HelpMessageOpt("-snapshotblocks=<file>", _("Validates a UTXO snapshot loaded by loadtxoutset in the background, with the blocks below it from this blk000??.dat or bootstrap file (may be repeated, in chain order)"));
+    strUsage += HelpMessageOpt("-snapshotvalidationdbcache=<n>", strprintf(_("Memory for the coins of the UTXO snapshot validation in megabytes (minimum %d, default: %d)"), MIN_SNAPSHOT_VALIDATION_DBCACHE, DEFAULT_SNAPSHOT_VALIDATION_DBCACHE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphantxsize=<n>", strprintf(_("Keep at most <n> kilobytes of unconnectable transactions in memory, a quarter of them per peer (default: %u)"), DEFAULT_MAX_ORPHAN_TX_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
@@ -354,15 +452,21 @@ std::string HelpMessage(HelpMessageMode mode)
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
+    strUsage += HelpMessageOpt("-reindexbuffer=<n>", strprintf(_("Keep up to <n> MiB of out-of-order blocks in memory during -reindex and -loadblock (default: %u)"), DEFAULT_REINDEX_BUFFER));
+    strUsage += HelpMessageOpt("-schedulerthreads=<n>", strprintf(_("Number of threads running the scheduled tasks and notify commands (2 to %d, default: %d)"), MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain an index of where each output was spent, used by the getspentinfo rpc call; needs -reindex-chainstate when turned on (default: %u)"), DEFAULT_SPENTINDEX));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call, built in the background when turned on (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindexcompact", strprintf(_("Keep the transaction index as block heights and offsets under truncated txids (default: %u)"), DEFAULT_TXINDEX_COMPACT));
+    strUsage += HelpMessageOpt("-txindexsyncrate=<n>", strprintf(_("Read at most <n> MiB of blocks per second while building the transaction index, 0 = no limit (default: %u)"), DEFAULT_TXINDEX_SYNC_RATE));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), DEFAULT_BANSCORE_THRESHOLD));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), DEFAULT_MISBEHAVING_BANTIME));
+    strUsage += HelpMessageOpt("-blockrelayconns=<n>", strprintf(_("Make <n> more outbound connections that relay blocks only, not transactions or addresses (0-%d, default: %d)"), MAX_BLOCK_RELAY_ONLY_CONNECTIONS, DEFAULT_BLOCK_RELAY_ONLY_CONNECTIONS));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s); -noconnect or -connect=0 alone to disable automatic connections"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
@@ -376,9 +480,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Number of threads to handle peer messages, each serving a fixed share of the peers (1 to %d, default: %d)"), MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
+    strUsage += HelpMessageOpt("-peerdownloadrate=<n>", _("Receive at most <n> kB per second from each peer that is not whitelisted, 0 = no limit (default: 0)"));
+    strUsage += HelpMessageOpt("-peeruploadrate=<n>", _("Send at most <n> kB per second to each peer that is not whitelisted, besides control messages, 0 = no limit (default: 0)"));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), Params(CBaseChainParams::MAIN).GetDefaultPort(), Params(CBaseChainParams::TESTNET).GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
@@ -401,6 +508,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-whitelistrelay", strprintf(_("Accept relayed transactions received from whitelisted peers even when not relaying transactions (default: %d)"), DEFAULT_WHITELISTRELAY));
     strUsage += HelpMessageOpt("-whitelistforcerelay", strprintf(_("Force relay of transactions from whitelisted peers even if they violate local relay policy (default: %d)"), DEFAULT_WHITELISTFORCERELAY));
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt("-uploadrate=<class>:<n>", _("Send at most <n> kB per second of traffic class <class> to all peers together, 0 = no limit. Classes are block, historical (blocks more than a week old), tx and addr. Can be specified once per class"));
 
 #ifdef ENABLE_WALLET
     strUsage += CWallet::GetWalletHelpString(showDebug);
@@ -410,6 +518,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("ZeroMQ notification options:"));
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubmempool=<address>", _("Enable publish mempool transaction additions and removals in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
 #endif
@@ -425,16 +534,21 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
+        strUsage += HelpMessageOpt("-capturemessages", strprintf("Write the messages of every peer to message_capture/ in the data directory, to replay them with bench_solarcoin (default: %u)", DEFAULT_CAPTURE_MESSAGES));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
         strUsage += HelpMessageOpt("-fuzzmessagestest=<n>", "Randomly fuzz 1 of every <n> network messages");
+        strUsage += HelpMessageOpt("-lockprofile", strprintf("Profile lock contention and hold times per lock site, see getlockstats (default: %u)", DEFAULT_LOCKPROFILE));
+        strUsage += HelpMessageOpt("-profile", strprintf("Time the validation, kernel, network and wallet hot paths in CPU cycles, see getprofile, and write them to profile.folded in the data directory on shutdown (default: %u)", DEFAULT_PROFILE));
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT));
+        strUsage += HelpMessageOpt("-stopatheight", strprintf("Stop running after reaching the given height in the main chain, logging a block connect summary (default: %u)", DEFAULT_STOPATHEIGHT));
         strUsage += HelpMessageOpt("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT));
         strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-bip9params=deployment:start:end", "Use given start/end times for specified BIP9 deployment (regtest-only)");
+        strUsage += HelpMessageOpt("-regtestpost=<n>", strprintf("Make the blocks after height <n> PoST blocks, with a stake min age of %us and a stake modifier interval of %us, see generatestake (regtest-only)", REGTEST_POST_STAKE_MIN_AGE, REGTEST_POST_MODIFIER_INTERVAL));
     }
-    std::string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq"; // Don't translate these and qt below
+    std::string debugCategories = "addrman, alert, bench, blockfilemap, blockfilter, blockstats, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, stake, tor, txindex, zmq"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -443,14 +557,19 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-nodebug", "Turn off debugging messages, same as -debug=0");
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
+    strUsage += HelpMessageOpt("-logformat=<format>", _("Format of debug output, text or json with one object per message (default: text)"));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-logasync", strprintf("Write debug output on a thread of its own, the logging threads only queue their messages (default: %u)", DEFAULT_LOGASYNC));
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-scriptexeccache", strprintf("Cache the script checks of whole transactions in half of -maxsigcachesize, so that blocks skip those of mempool transactions (default: %u)", DEFAULT_SCRIPT_EXEC_CACHE));
+        strUsage += HelpMessageOpt("-largepages=<n>", strprintf("Back the coins cache and the scrypt scratchpads with huge pages placed on the NUMA node of their thread: 0 off, 1 transparent huge pages, 2 explicit huge pages (vm.nr_hugepages) then transparent ones (default: %u)", DEFAULT_LARGE_PAGES));
+        strUsage += HelpMessageOpt("-stakeprevoutcachesize=<n>", strprintf("Cache the chain data of <n> outputs spent by stake kernels, rounded down to a power of two (default: %u)", DEFAULT_STAKE_PREVOUT_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"),
@@ -488,6 +607,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server", _("Accept command line and JSON-RPC commands"));
     strUsage += HelpMessageOpt("-rest", strprintf(_("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
+    strUsage += HelpMessageOpt("-metrics", strprintf(_("Serve Prometheus metrics at /metrics, without authentication (default: %u)"), DEFAULT_METRICS_ENABLE));
     strUsage += HelpMessageOpt("-rpcbind=<addr>", _("Bind to given address to listen for JSON-RPC connections. Use [host]:port notation for IPv6. This option can be specified multiple times (default: bind to all interfaces)"));
     strUsage += HelpMessageOpt("-rpccookiefile=<loc>", _("Location of the auth cookie (default: data dir)"));
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
@@ -498,6 +618,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcfastthreads=<n>", strprintf("Set the number of threads to service short read-only RPC calls, 0 to service them with the others (default: %d)", DEFAULT_HTTP_FAST_THREADS));
+        strUsage += HelpMessageOpt("-rpcfastworkqueue=<n>", strprintf("Set the depth of the work queue to service short read-only RPC calls (default: %d)", DEFAULT_HTTP_FAST_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf("Set the number of threads running the read-only calls of a JSON-RPC batch at the same time (default: %d)", DEFAULT_RPC_BATCH_THREADS));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -531,10 +654,8 @@ static void BlockNotifyCallback(bool initialSync, const CBlockIndex *pBlockIndex
     if (initialSync || !pBlockIndex)
         return;
 
-    std::string strCmd = GetArg("-blocknotify", "");
-
-    boost::replace_all(strCmd, "%s", pBlockIndex->GetBlockHash().GetHex());
-    boost::thread t(runCommand, strCmd); // thread runs free
+    // SolarCoin: only the newest tip waiting for a worker is notified
+    QueueNotification("blocknotify", GetArg("-blocknotify", ""), pBlockIndex->GetBlockHash().GetHex(), true);
 }
 
 static bool fHaveGenesis = false;
@@ -677,6 +798,13 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     fDumpMempoolLater = !fRequestShutdown;
 }
 
+/** SolarCoin: dump the mempool now and then, once it has been loaded, so a crash loses little of it */
+static void PeriodicDumpMempool()
+{
+    if (fDumpMempoolLater && !ShutdownRequested())
+        DumpMempool();
+}
+
 /** Sanity checks
  *  Ensure that Bitcoin is running in a usable environment with all
  *  necessary library support.
@@ -706,6 +834,8 @@ bool AppInitServers(boost::thread_group& threadGroup)
         return false;
     if (GetBoolArg("-rest", DEFAULT_REST_ENABLE) && !StartREST())
         return false;
+    if (GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE) && !StartHTTPMetrics())
+        return false;
     if (!StartHTTPServer())
         return false;
     return true;
@@ -786,6 +916,7 @@ void InitLogging()
     fLogTimestamps = GetBoolArg("-logtimestamps", DEFAULT_LOGTIMESTAMPS);
     fLogTimeMicros = GetBoolArg("-logtimemicros", DEFAULT_LOGTIMEMICROS);
     fLogIPs = GetBoolArg("-logips", DEFAULT_LOGIPS);
+    fLogJson = GetArg("-logformat", "text") == "json";
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("SolarCoin version %s\n", FormatFullVersion());
@@ -883,6 +1014,14 @@ bool AppInitParameterInteraction()
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+        if (GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -blockstatsindex."));
+        if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex and -spentindex."));
+        if (GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -coinstatsindex."));
     }
 
     // Make sure enough file descriptors are available
@@ -892,12 +1031,23 @@ bool AppInitParameterInteraction()
     nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    // SolarCoin: LevelDB table files beyond the default need descriptors as well
+    int nMinCoreFileDescriptors = MIN_CORE_FILEDESCRIPTORS;
+#ifndef WIN32
+    nMinCoreFileDescriptors += std::max(0, GetDBOptionsFromArgs("chainstate").nMaxOpenFiles + GetDBOptionsFromArgs("blockindex").nMaxOpenFiles - 2 * DEFAULT_DB_MAX_OPEN_FILES);
+#endif
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
-    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+#ifdef USE_SOCKET_EVENTS
+    // SolarCoin: Only select() is limited to FD_SETSIZE, with epoll or kqueue the listening sockets just need descriptors
+    nMinCoreFileDescriptors += nBind;
+#else
+    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - nMinCoreFileDescriptors - MAX_ADDNODE_CONNECTIONS)), 0);
+#endif
+    nFD = RaiseFileDescriptorLimit(nMaxConnections + nMinCoreFileDescriptors + MAX_ADDNODE_CONNECTIONS);
+    if (nFD < nMinCoreFileDescriptors)
         return InitError(_("Not enough file descriptors available."));
-    nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS, nMaxConnections);
+    nMaxConnections = std::min(nFD - nMinCoreFileDescriptors - MAX_ADDNODE_CONNECTIONS, nMaxConnections);
 
     if (nMaxConnections < nUserMaxConnections)
         InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, because of system limitations."), nUserMaxConnections, nMaxConnections));
@@ -938,17 +1088,30 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fLockProfile = GetBoolArg("-lockprofile", DEFAULT_LOCKPROFILE);
+    fProfile = GetBoolArg("-profile", DEFAULT_PROFILE);
+    // SolarCoin: before the coins cache and the first scrypt scratchpad are allocated
+    SetLargePagesMode(std::max(0, std::min((int)GetArg("-largepages", DEFAULT_LARGE_PAGES), (int)LARGE_PAGES_EXPLICIT)));
+    const std::string strLogFormat = GetArg("-logformat", "text");
+    if (strLogFormat != "text" && strLogFormat != "json")
+        return InitError(strprintf(_("Unknown -logformat: '%s'"), strLogFormat));
+    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
+    fTxIndexCompact = fTxIndex && GetBoolArg("-txindexcompact", DEFAULT_TXINDEX_COMPACT);
 
     // SolarCoin: solarcoin.conf args
     fPrintProofOfStake = GetBoolArg("-printproofofstake", false);
     fPrintStakeModifier = GetBoolArg("-printstakemodifier", false);
     fPrintCoinAge = GetBoolArg("-printcoinage", false);
 
-    hashAssumeValid = uint256S(GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
+    // SolarCoin: Without a default assumed valid block, the last checkpoint is assumed valid
+    uint256 hashDefaultAssumeValid = chainparams.GetConsensus().defaultAssumeValid;
+    if (hashDefaultAssumeValid.IsNull() && fCheckpointsEnabled && !chainparams.Checkpoints().mapCheckpoints.empty())
+        hashDefaultAssumeValid = chainparams.Checkpoints().mapCheckpoints.rbegin()->second;
+    hashAssumeValid = uint256S(GetArg("-assumevalid", hashDefaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
-        LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
+        LogPrintf("Assuming ancestors of block %s have valid proof of work and signatures.\n", hashAssumeValid.GetHex());
     else
-        LogPrintf("Validating signatures for all blocks.\n");
+        LogPrintf("Validating proof of work and signatures for all blocks.\n");
 
     // mempool limits
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
@@ -974,6 +1137,28 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nCoinsPrefetchThreads = std::max(0, std::min((int)GetArg("-coinsprefetch", DEFAULT_COINS_PREFETCH_THREADS), MAX_COINS_PREFETCH_THREADS));
+
+    int64_t nReindexBufferArg = GetArg("-reindexbuffer", DEFAULT_REINDEX_BUFFER);
+    if (nReindexBufferArg < 0)
+        return InitError(_("-reindexbuffer cannot be configured with a negative value."));
+    nReindexBufferSize = (size_t)nReindexBufferArg * 1024 * 1024;
+
+    int64_t nBlockFilePreallocArg = GetArg("-blockfileprealloc", DEFAULT_BLOCKFILE_PREALLOC);
+    if (nBlockFilePreallocArg < 1 || nBlockFilePreallocArg > MAX_BLOCKFILE_SIZE / 1024 / 1024)
+        return InitError(strprintf(_("-blockfileprealloc must be between 1 and %u."), MAX_BLOCKFILE_SIZE / 1024 / 1024));
+    nBlockFileChunkSize = (unsigned int)nBlockFilePreallocArg * 1024 * 1024;
+    nUndoFileChunkSize = nBlockFileChunkSize / 16;
+
+    int64_t nBlockFileMapArg = GetArg("-blockfilemmap", DEFAULT_BLOCKFILE_MMAP);
+    if (nBlockFileMapArg < 0)
+        return InitError(_("-blockfilemmap cannot be configured with a negative value."));
+    if (sizeof(void*) < 8 && nBlockFileMapArg > 0) {
+        // The mappings would compete with the rest of the node for a 32-bit address space
+        nBlockFileMapArg = std::min<int64_t>(nBlockFileMapArg, 512);
+    }
+    nBlockFileMapBudget = (size_t)nBlockFileMapArg * 1024 * 1024;
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1110,6 +1295,19 @@ bool AppInitParameterInteraction()
             }
         }
     }
+
+    if (IsArgSet("-regtestpost")) {
+        // SolarCoin: Fast PoST for testing
+        if (!chainparams.MineBlocksOnDemand()) {
+            return InitError("PoST parameters may only be overridden on regtest.");
+        }
+        int nLastPowBlock = GetArg("-regtestpost", 0);
+        if (nLastPowBlock <= 0) {
+            return InitError(strprintf("Invalid last PoW block height (%s)", GetArg("-regtestpost", "")));
+        }
+        UpdateRegtestStakingParameters(nLastPowBlock, REGTEST_POST_STAKE_MIN_AGE, REGTEST_POST_MODIFIER_INTERVAL);
+        LogPrintf("Setting PoST parameters to last PoW block=%d, stake min age=%u, modifier interval=%u\n", nLastPowBlock, REGTEST_POST_STAKE_MIN_AGE, REGTEST_POST_MODIFIER_INTERVAL);
+    }
     return true;
 }
 
@@ -1140,6 +1338,13 @@ bool AppInitSanityChecks()
 {
     // ********************************************************* Step 4: sanity checks
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using %s\n", sha256_algo);
+    std::string scrypt_algo = scrypt_detect();
+    LogPrintf("Using %s\n", scrypt_algo);
+    std::string aes_algo = AESAutoDetect();
+    LogPrintf("Using %s\n", aes_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1175,6 +1380,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if (fPrintToDebugLog)
         OpenDebugLog();
+    if (GetBoolArg("-logasync", DEFAULT_LOGASYNC))
+        StartAsyncLog();
 
     if (!fLogTimestamps)
         LogPrintf("Startup time: %s\n", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()));
@@ -1184,16 +1391,31 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    InitStakePrevoutCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
-
-    // Start the lightweight task scheduler thread
+    for (int i=0; i<nCoinsPrefetchThreads; i++)
+        threadGroup.create_thread(&ThreadCoinsPrefetch);
+
+    // Start the lightweight task scheduler threads. SolarCoin: they are shared by the queues of
+    // several subsystems; the tasks scheduled without a queue still run one at a time. Some
+    // background work keeps threads of its own: ThreadImport runs for the whole of a reindex or
+    // import and would hold a scheduler thread for hours, the pruned file remover finishes its
+    // deletions in Shutdown(), after the scheduler threads were interrupted, and the header proof
+    // of work checks are split over the -par verification threads, which their caller waits on.
+    scheduler.setQueueLimit(CScheduler::DEFAULT_QUEUE, 1);
+    int nSchedulerThreads = std::max(2, std::min<int>(GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), MAX_SCHEDULER_THREADS));
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    g_scheduler = &scheduler;
+
+    // SolarCoin: -blocknotify, -walletnotify and -alertnotify on a queue of the scheduler
+    StartNotifications(scheduler, nSchedulerThreads);
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1309,6 +1531,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     fDiscover = GetBoolArg("-discover", true);
     fNameLookup = GetBoolArg("-dns", DEFAULT_NAME_LOOKUP);
     fRelayTxes = !GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY);
+    fCaptureMessages = GetBoolArg("-capturemessages", DEFAULT_CAPTURE_MESSAGES);
 
     if (fListen) {
         bool fBound = false;
@@ -1359,7 +1582,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     pzmqNotificationInterface = CZMQNotificationInterface::Create();
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        RegisterValidationInterfaceQueued(pzmqNotificationInterface);
     }
 #endif
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
@@ -1369,10 +1592,39 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         nMaxOutboundLimit = GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET)*1024*1024;
     }
 
+    // SolarCoin: bandwidth shaping per traffic class and per peer
+    int64_t vSendRate[SEND_LANE_COUNT] = {};
+    if (mapMultiArgs.count("-uploadrate")) {
+        static const std::map<std::string, SendLane> mapSendClasses = {
+            {"block", SEND_LANE_BLOCK},
+            {"historical", SEND_LANE_HISTORICAL},
+            {"tx", SEND_LANE_TX},
+            {"addr", SEND_LANE_ADDR},
+        };
+        for (const std::string& strRate : mapMultiArgs.at("-uploadrate")) {
+            size_t nSep = strRate.find(':');
+            int64_t nRate = 0;
+            std::map<std::string, SendLane>::const_iterator it = mapSendClasses.find(strRate.substr(0, nSep));
+            if (nSep == std::string::npos || it == mapSendClasses.end() || !ParseInt64(strRate.substr(nSep + 1), &nRate) ||
+                    nRate < 0 || nRate > MAX_SHAPING_RATE)
+                return InitError(strprintf(_("Invalid -uploadrate: '%s'"), strRate));
+            vSendRate[it->second] = nRate * 1000;
+        }
+    }
+    int64_t nPeerSendRate = GetArg("-peeruploadrate", 0);
+    int64_t nPeerRecvRate = GetArg("-peerdownloadrate", 0);
+    if (nPeerSendRate < 0 || nPeerSendRate > MAX_SHAPING_RATE)
+        return InitError(strprintf(_("Invalid -peeruploadrate: '%s'"), GetArg("-peeruploadrate", "")));
+    if (nPeerRecvRate < 0 || nPeerRecvRate > MAX_SHAPING_RATE)
+        return InitError(strprintf(_("Invalid -peerdownloadrate: '%s'"), GetArg("-peerdownloadrate", "")));
+
     // ********************************************************* Step 7: load block chain
 
     fReindex = GetBoolArg("-reindex", false);
     bool fReindexChainState = GetBoolArg("-reindex-chainstate", false);
+    bool fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    bool fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    bool fCoinStatsIndex = GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX);
 
     // Upgrading to 0.8; hard-link the old blknnnn.dat files into /blocks/
     boost::filesystem::path blocksDir = GetDataDir() / "blocks";
@@ -1429,15 +1681,32 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         do {
             try {
                 UnloadBlockIndex();
+                CancelCoinsPrefetch();
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete paddressindex;
+                paddressindex = NULL;
+                delete pcoinstatsindex;
+                pcoinstatsindex = NULL;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+
+                // If necessary, upgrade from the per-txid database format.
+                // This is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                if (fAddressIndex || fSpentIndex)
+                    paddressindex = new CAddressIndex(fAddressIndex, fSpentIndex, ADDRESS_INDEX_CACHE_SIZE, fReindex || fReindexChainState);
+                if (fCoinStatsIndex)
+                    pcoinstatsindex = new CCoinStatsIndex(COIN_STATS_INDEX_CACHE_SIZE, fReindex || fReindexChainState);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1462,10 +1731,15 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -txindex");
-                    break;
+                if (paddressindex) {
+                    LOCK(cs_main);
+                    if (!paddressindex->Init(strLoadError))
+                        break;
+                }
+                if (pcoinstatsindex) {
+                    LOCK(cs_main);
+                    if (!pcoinstatsindex->Init(strLoadError))
+                        break;
                 }
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
@@ -1551,6 +1825,16 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (!est_filein.IsNull())
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
+    // SolarCoin: the estimator only queues mempool and block events; apply them off the
+    // block connection path, and save the estimates now and then rather than only at shutdown
+    scheduler.scheduleEvery(boost::bind(&CTxMemPool::ProcessFeeEstimates, &mempool), FEE_ESTIMATES_PROCESS_INTERVAL);
+    scheduler.scheduleEvery(&FlushFeeEstimates, FEE_ESTIMATES_FLUSH_INTERVAL);
+
+    // SolarCoin: before the wallet, so that a rescan at startup can use the filters built so far
+    if (!InitBlockFilterIndex(threadGroup))
+        return false;
+    if (!InitBlockStatsIndex(threadGroup))
+        return false;
 
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
@@ -1608,7 +1892,30 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             vImportFiles.push_back(strFile);
     }
 
+    // SolarCoin: -loadheaders, before the header sync with peers starts
+    if (IsArgSet("-loadheaders")) {
+        boost::filesystem::path path = boost::filesystem::absolute(GetArg("-loadheaders", ""), GetDataDir());
+        CHeaderBundleInfo info;
+        std::string strError;
+        uiInterface.InitMessage(_("Importing headers..."));
+        if (!LoadHeaderBundle(chainparams, path, info, strError))
+            LogPrintf("Warning: Could not import headers from %s: %s\n", path.string(), strError);
+    }
+
+    // Before any block is connected, so an index written by an older version is known to cover the tip
+    if (!InitTxIndex(threadGroup))
+        return false;
+
+    if (fPruneMode)
+        StartBlockFileRemover();
+
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (GetBoolArg("-dbcompactafteribd", DEFAULT_DB_COMPACT_AFTER_IBD))
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "compactdb", &ThreadCompactAfterIBD));
+    StartSnapshotValidation(chainparams);
+    scheduler.scheduleEvery(&PeriodicDumpMempool, MEMPOOL_DUMP_INTERVAL);
+    if (fProfile)
+        scheduler.scheduleEvery(&AggregateProfile, PROFILE_AGGREGATE_INTERVAL);
 
     // Wait for genesis block to be processed
     {
@@ -1640,13 +1947,18 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.nMaxOutbound = std::min(MAX_OUTBOUND_CONNECTIONS, connOptions.nMaxConnections);
     connOptions.nMaxAddnode = MAX_ADDNODE_CONNECTIONS;
     connOptions.nMaxFeeler = 1;
+    connOptions.nMaxBlockRelayOnly = GetArg("-blockrelayconns", DEFAULT_BLOCK_RELAY_ONLY_CONNECTIONS);
     connOptions.nBestHeight = chainActive.Height();
     connOptions.uiInterface = &uiInterface;
     connOptions.nSendBufferMaxSize = 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nMessageHandlerThreads = GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS);
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
+    std::copy(vSendRate, vSendRate + SEND_LANE_COUNT, connOptions.vSendRate);
+    connOptions.nPeerSendRate = nPeerSendRate * 1000;
+    connOptions.nPeerRecvRate = nPeerRecvRate * 1000;
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
@@ -1657,8 +1969,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     uiInterface.InitMessage(_("Done loading"));
 
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
-        pwalletMain->postInitProcess(threadGroup);
+    for (CWallet* pwallet : vpwallets) {
+        pwallet->postInitProcess(threadGroup, scheduler);
+    }
 #endif
 
     return !fRequestShutdown;
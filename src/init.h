@@ -16,6 +16,9 @@ namespace boost
 class thread_group;
 } // namespace boost
 
+/** SolarCoin: The scheduler passed to AppInitMain(), for getschedulerinfo; NULL before and after */
+extern CScheduler* g_scheduler;
+
 void StartShutdown();
 bool ShutdownRequested();
 /** Interrupt threads */
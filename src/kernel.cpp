@@ -28,16 +28,24 @@
 #include <validation.h>
 
 #include <boost/assign/list_of.hpp>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+#include <cuckoocache.h>
 #include <rpc/server.h>
 #include <txdb.h>
+#include <txindex.h>
 #include <timedata.h>
 #include <kernel.h>
+#include <memusage.h>
 #include <pow.h>
+#include <profile.h>
+#include <sync.h>
+#include <validationstats.h>
+
+#include <algorithm>
 
-using namespace std;
 
-int nAverageStakeWeightHeightCached = 0;
-double dAverageStakeWeightCached = 0;
+using namespace std;
 
 typedef std::map<int, unsigned int> MapModifierCheckpoints;
 
@@ -54,6 +62,198 @@ static std::map<int, unsigned int> mapStakeModifierCheckpointsTestNet =
         ( 0, 0)
    ;
 
+/**
+ * Salted cuckoo cache of CStakePrevoutInfo keyed by the outpoint a stake kernel spends, of
+ * -stakeprevoutcachesize entries.
+ *
+ * Entries only describe outputs of transactions in the active chain; a hit is
+ * rejected if its block is no longer part of chainActive (e.g. after a reorg).
+ */
+class CStakePrevoutCache
+{
+private:
+    CCriticalSection cs;
+    CuckooCache::map<COutPoint, CStakePrevoutInfo, SaltedOutpointHasher> mapEntries;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+
+public:
+    CStakePrevoutCache() : nHits(0), nMisses(0), nEvictions(0)
+    {
+        mapEntries.setup(DEFAULT_STAKE_PREVOUT_CACHE_SIZE);
+    }
+
+    uint32_t Resize(uint32_t nEntries)
+    {
+        LOCK(cs);
+        return mapEntries.resize(nEntries);
+    }
+
+    bool Get(const COutPoint& prevout, CStakePrevoutInfo& info)
+    {
+        LOCK(cs);
+        const CStakePrevoutInfo* pinfo = mapEntries.find(prevout);
+        if (!pinfo) {
+            nMisses++;
+            return false;
+        }
+        nHits++;
+        info = *pinfo;
+        return true;
+    }
+
+    void Insert(const COutPoint& prevout, const CStakePrevoutInfo& info)
+    {
+        LOCK(cs);
+        if (!mapEntries.insert(prevout, info))
+            nEvictions++;
+    }
+
+    void Erase(const COutPoint& prevout)
+    {
+        LOCK(cs);
+        mapEntries.erase(prevout);
+    }
+
+    size_t DynamicMemoryUsage()
+    {
+        LOCK(cs);
+        return mapEntries.memory_usage();
+    }
+
+    CacheStats GetStats()
+    {
+        LOCK(cs);
+        CacheStats stats;
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        stats.nEvictions = nEvictions;
+        stats.nEpochs = mapEntries.epochs();
+        stats.nElements = mapEntries.capacity();
+        return stats;
+    }
+};
+
+static CStakePrevoutCache stakePrevoutCache;
+
+/**
+ * The blocks of chainActive that generated a stake modifier, in height order, together with
+ * the running maximum of their block times. Lets GetKernelStakeModifier() binary search for
+ * the modifier a selection interval after a given block instead of walking chainActive.
+ *
+ * Modifier values and flags are read from the block index entries themselves; only the list
+ * of generating blocks is kept here. Synced against chainActive by UpdateStakeModifierIndex();
+ * protected by cs_main.
+ */
+class CStakeModifierIndex
+{
+private:
+    struct Entry
+    {
+        const CBlockIndex* pindex;
+        int64_t nTimeMax; //!< maximum block time of this and all previous entries
+    };
+
+    std::vector<Entry> vEntries;
+    const CBlockIndex* pindexSynced; //!< last block of chainActive that has been scanned
+
+public:
+    CStakeModifierIndex() : pindexSynced(nullptr) {}
+
+    void Clear()
+    {
+        vEntries.clear();
+        pindexSynced = nullptr;
+    }
+
+    void Sync(const CChain& chain)
+    {
+        const CBlockIndex* pindexTip = chain.Tip();
+        if (pindexSynced == pindexTip)
+            return;
+
+        // Roll back to the fork point if the chain was reorganized
+        if (pindexSynced && !chain.Contains(pindexSynced)) {
+            pindexSynced = pindexTip ? chain.FindFork(pindexSynced) : nullptr;
+            int nForkHeight = pindexSynced ? pindexSynced->nHeight : -1;
+            while (!vEntries.empty() && vEntries.back().pindex->nHeight > nForkHeight)
+                vEntries.pop_back();
+        }
+
+        for (int nHeight = pindexSynced ? pindexSynced->nHeight + 1 : 0; nHeight <= chain.Height(); nHeight++) {
+            const CBlockIndex* pindex = chain[nHeight];
+            if (pindex->GeneratedStakeModifier()) {
+                Entry entry;
+                entry.pindex = pindex;
+                entry.nTimeMax = vEntries.empty() ? pindex->GetBlockTime() : std::max(vEntries.back().nTimeMax, pindex->GetBlockTime());
+                vEntries.push_back(entry);
+            }
+        }
+        pindexSynced = pindexTip;
+    }
+
+    /**
+     * Find the first block above pindexFrom in the synced chain that generated a stake
+     * modifier with a block time of at least nTargetTime. Returns nullptr if there is none yet.
+     */
+    const CBlockIndex* Find(const CBlockIndex* pindexFrom, int64_t nTargetTime) const
+    {
+        std::vector<Entry>::const_iterator itFirst = std::upper_bound(vEntries.begin(), vEntries.end(), pindexFrom->nHeight,
+            [](int nHeight, const Entry& entry) { return nHeight < entry.pindex->nHeight; });
+        if (itFirst == vEntries.end())
+            return nullptr;
+
+        if (itFirst == vEntries.begin() || (itFirst - 1)->nTimeMax < nTargetTime) {
+            // No earlier entry reaches the target, so the first entry from itFirst on whose running
+            // maximum reaches it is the first one whose own time does.
+            std::vector<Entry>::const_iterator it = std::lower_bound(itFirst, vEntries.end(), nTargetTime,
+                [](const Entry& entry, int64_t nTime) { return entry.nTimeMax < nTime; });
+            return it == vEntries.end() ? nullptr : it->pindex;
+        }
+
+        // Out of order block times before pindexFrom, fall back to a scan of the generating blocks
+        for (std::vector<Entry>::const_iterator it = itFirst; it != vEntries.end(); ++it)
+            if (it->pindex->GetBlockTime() >= nTargetTime)
+                return it->pindex;
+        return nullptr;
+    }
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vEntries); }
+};
+
+static CStakeModifierIndex stakeModifierIndex;
+
+void UpdateStakeModifierIndex(const CChain& chain)
+{
+    AssertLockHeld(cs_main);
+    stakeModifierIndex.Sync(chain);
+}
+
+void UnloadStakeModifierIndex()
+{
+    AssertLockHeld(cs_main);
+    stakeModifierIndex.Clear();
+}
+
+void InitStakePrevoutCache()
+{
+    int64_t nEntries = std::min(std::max((int64_t)0, GetArg("-stakeprevoutcachesize", DEFAULT_STAKE_PREVOUT_CACHE_SIZE)), (int64_t)MAX_STAKE_PREVOUT_CACHE_SIZE);
+    uint32_t nCapacity = stakePrevoutCache.Resize(nEntries);
+    LogPrintf("Using a stake prevout cache of %u entries\n", nCapacity);
+}
+
+CacheStats GetStakePrevoutCacheStats()
+{
+    return stakePrevoutCache.GetStats();
+}
+
+size_t GetStakeIndexMemoryUsage()
+{
+    AssertLockHeld(cs_main);
+    return stakeModifierIndex.DynamicMemoryUsage() + stakePrevoutCache.DynamicMemoryUsage();
+}
+
 // Get time weight
 int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd, const Consensus::Params& params)
 {
@@ -109,72 +309,93 @@ int64_t GetStakeModifierSelectionInterval(const Consensus::Params& params)
     return nSelectionInterval;
 }
 
+/** A block that may be selected into a new stake modifier */
+struct CStakeModifierCandidate
+{
+    int64_t nTime;
+    // SolarCoin: The 'sort' function in bitcoin core behaves differently than it did in the legacy code.
+    // If two blocks have the same timestamp (should not have happened but it did at 63967 and 63968 for example),
+    // the hash is sorted "as an ascii string" data type instead of an arith_uint256 data type as in bitcoin core.
+    // To solve this, the block hash is kept as an arith_uint256 so we can do a valid sort comparison.
+    arith_uint256 hashBlock;
+    const CBlockIndex* pindex;
+    bool fSelected;
+
+    explicit CStakeModifierCandidate(const CBlockIndex* pindexIn) :
+        nTime(pindexIn->GetBlockTime()), hashBlock(UintToArith256(pindexIn->GetBlockHash())), pindex(pindexIn), fSelected(false) {}
+
+    bool operator<(const CStakeModifierCandidate& other) const
+    {
+        if (nTime != other.nTime)
+            return nTime < other.nTime;
+        return hashBlock < other.hashBlock;
+    }
+};
+
 /**
   * Called from ComputeNextStakeModifier().
   *
   * Iterates over the candidate blocks in vSortedByTimestamp, computing the selection hash from the proofhash and previous stake modifier, and selecting
-  * the lowest one. Excludes blocks already in vSelectedBlocks, breaks when the timestamp of a block in the sorted vector is greater than the interval stop.
-  * @param[out] vSortedByTimestmp a vector of block hashes and timestamps
-  * @param[out] mapSelectedBlocks a map of blocks chosen for this interval (?)
+  * the lowest one. Excludes blocks already selected, breaks when the timestamp of a block in the sorted vector is greater than the interval stop.
+  * @param vSortedByTimestamp the candidate blocks, sorted by timestamp then hash
   * @param nSelectionIntervalStop the endpoint timestamp for the interval
   * @param nStakeModifierPrev the existing stake modifier, prior to this one being computed
-  * @param pindexSelected[out] the pointer to the selected block from the candidates 
+  * @param[out] pcandidateSelected the selected candidate
   **/
-static bool SelectBlockFromCandidates(vector<pair<int64_t, arith_uint256> >& vSortedByTimestamp, map<uint256, const CBlockIndex*>& mapSelectedBlocks,
-    int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, const CBlockIndex** pindexSelected, const Consensus::Params& params)
+static bool SelectBlockFromCandidates(vector<CStakeModifierCandidate>& vSortedByTimestamp,
+    int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, CStakeModifierCandidate** pcandidateSelected, const Consensus::Params& params)
 {
     bool fSelected = false;
-    uint256 hashBest = uint256();
-    *pindexSelected = (const CBlockIndex*) 0;
-    for (const PAIRTYPE(int64_t, arith_uint256)& item : vSortedByTimestamp)
+    arith_uint256 hashBest;
+    *pcandidateSelected = nullptr;
+    // Selection hash input: the proof-hash followed by the previous modifier, as serialized before
+    unsigned char vSelectionData[32 + 8];
+    WriteLE64(vSelectionData + 32, nStakeModifierPrev);
+    for (CStakeModifierCandidate& candidate : vSortedByTimestamp)
     {
-        uint256 hash = ArithToUint256(item.second);
-        if (!mapBlockIndex.count(hash)) {
-            LogPrintf("%s: failed to find block index for candidate block %s\n", __func__, hash.ToString().c_str());
-            return false;
-        }
-        const CBlockIndex* pindex = mapBlockIndex[hash];
-        if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
+        const CBlockIndex* pindex = candidate.pindex;
+        if (fSelected && candidate.nTime > nSelectionIntervalStop)
             break;
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (candidate.fSelected)
             continue;
         // compute the selection hash by hashing its proof-hash and the
         // previous proof-of-stake modifier
         // SolarCoin: CBlockIndex::IsProofOfStake is not valid during header download. Use height instead.
-        uint256 hashProof = pindex->nHeight > params.LAST_POW_BLOCK ? pindex->hashProofOfStake : pindex->GetBlockHash();
+        const uint256& hashProof = pindex->nHeight > params.LAST_POW_BLOCK ? pindex->GetHashProofOfStake() : pindex->GetBlockHash();
         static const int LOG_BLOCK = 835320;
         static const int LOG_END_BLOCK = 835380;
         
         if(pindex->nHeight > LOG_BLOCK) {
           if(pindex->nHeight < LOG_END_BLOCK) {
 
-            LogPrintf("%s: Checking candidate block %s\n", __func__, hash.ToString().c_str());
+            LogPrintf("%s: Checking candidate block %s\n", __func__, pindex->GetBlockHash().ToString().c_str());
             LogPrintf("%s(): candidate hashproof=%s\n", __func__, hashProof.ToString().c_str());
           }
         }
-        CDataStream ss(SER_GETHASH, 0);
-        ss << hashProof << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
+        memcpy(vSelectionData, hashProof.begin(), 32);
+        uint256 hashSelectionRaw;
+        CHash256().Write(vSelectionData, sizeof(vSelectionData)).Finalize(hashSelectionRaw.begin());
+        arith_uint256 hashSelection = UintToArith256(hashSelectionRaw);
         // the selection hash is divided by 2**32 so that proof-of-stake block
         // is always favored over proof-of-work block. this is to preserve
         // the energy efficiency property
         // SolarCoin: CBlockIndex::IsProofOfStake is not valid during header download. Use height instead.
         if (pindex->nHeight > params.LAST_POW_BLOCK)
-            hashSelection = ArithToUint256(UintToArith256(hashSelection) >>= 32);
-        if (fSelected && UintToArith256(hashSelection) < UintToArith256(hashBest))
+            hashSelection >>= 32;
+        if (fSelected && hashSelection < hashBest)
         {
             hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
+            *pcandidateSelected = &candidate;
         }
         else if (!fSelected)
         {
             fSelected = true;
             hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
+            *pcandidateSelected = &candidate;
         }
     }
     if (fDebug && GetBoolArg("-printstakemodifier", false))
-        LogPrintf("%s(): selection hash=%s\n", __func__, hashBest.ToString().c_str());
+        LogPrintf("%s(): selection hash=%s\n", __func__, ArithToUint256(hashBest).ToString().c_str());
     return fSelected;
 }
 
@@ -191,6 +412,7 @@ static bool SelectBlockFromCandidates(vector<pair<int64_t, arith_uint256> >& vSo
   **/
 bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier, const Consensus::Params& params)
 {
+    PROFILE_SCOPE("ComputeNextStakeModifier");
     const CBlockIndex* pindexPrev = pindexCurrent->pprev;
     nStakeModifier = 0;
     fGeneratedStakeModifier = false;
@@ -222,18 +444,14 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
     }
 
     // Sort candidate blocks by timestamp
-    vector<pair<int64_t, arith_uint256> > vSortedByTimestamp;
+    vector<CStakeModifierCandidate> vSortedByTimestamp;
     vSortedByTimestamp.reserve(64 * params.nModifierInterval / params.nTargetSpacing);
     int64_t nSelectionInterval = GetStakeModifierSelectionInterval(params);
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / params.nModifierInterval) * params.nModifierInterval - nSelectionInterval;
     const CBlockIndex* pindex = pindexPrev;
     while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
     {
-        // SolarCoin: The 'sort' function in bitcoin core behaves differently than it did in the legacy code.
-        // If two blocks have the same timestamp (should not have happened but it did at 63967 and 63968 for example),
-        // the hash is sorted "as an ascii string" data type instead of an arith_uint256 data type as in bitcoin core.
-        // To solve this, I converted the vector uint256 hash to an arith_uint256 so we can do a valid sort comparison.
-        vSortedByTimestamp.push_back(make_pair(pindex->GetBlockTime(), UintToArith256(pindex->GetBlockHash())));
+        vSortedByTimestamp.push_back(CStakeModifierCandidate(pindex));
         pindex = pindex->pprev;
     }
     int nHeightFirstCandidate = pindex ? (pindex->nHeight + 1) : 0;
@@ -243,29 +461,30 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
     // DEBUG: dump the vSortedByTimestamp
     if(nHeightFirstCandidate == 835323) {
     LogPrintf("%s(): vSortedByTimestamp:[",__func__);
-    for (const PAIRTYPE(int64_t, arith_uint256)& item : vSortedByTimestamp) {
-        LogPrintf("%s, ",item.second.GetHex().c_str());
+    for (const CStakeModifierCandidate& candidate : vSortedByTimestamp) {
+        LogPrintf("%s, ",candidate.hashBlock.GetHex().c_str());
     }
     LogPrintf("]\n");
 }
     // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
     int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    map<uint256, const CBlockIndex*> mapSelectedBlocks;
     for (int nRound=0; nRound < min(64, (int)vSortedByTimestamp.size()); nRound++)
     {
         // add an interval section to the current selection round
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound, params);
-        // select a block from the candidates of current round (pindex is returned)
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex, params)) {
+        // select a block from the candidates of current round
+        CStakeModifierCandidate* pcandidate = nullptr;
+        if (!SelectBlockFromCandidates(vSortedByTimestamp, nSelectionIntervalStop, nStakeModifier, &pcandidate, params)) {
             LogPrintf("%s: unable to select block at round %d", __func__, nRound);
             return false;
         }
+        pindex = pcandidate->pindex;
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
 
         // add the selected block from candidates to selected list
-        mapSelectedBlocks.insert(make_pair(pindex->GetBlockHash(), pindex));
+        pcandidate->fSelected = true;
         if (fDebug || GetBoolArg("-printstakemodifier", false))
             LogPrintf("%s(): selected modifier=0x%016x round %d stop=%ld height=%d entropybit=%d\n", __func__, nStakeModifierNew, nRound, nSelectionIntervalStop, pindex->nHeight, pindex->GetStakeEntropyBit());
     }
@@ -285,12 +504,14 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
                 strSelectionMap.replace(pindex->nHeight - nHeightFirstCandidate, 1, "=");
             pindex = pindex->pprev;
         }
-        for (const PAIRTYPE(uint256, const CBlockIndex*)& item : mapSelectedBlocks)
+        for (const CStakeModifierCandidate& candidate : vSortedByTimestamp)
         {
+            if (!candidate.fSelected)
+                continue;
             // 'S' indicates selected proof-of-stake blocks
             // 'W' indicates selected proof-of-work blocks
             // SolarCoin: CBlockIndex::IsProofOfStake is not valid during header download. Use height instead.
-            strSelectionMap.replace(item.second->nHeight - nHeightFirstCandidate, 1, item.second->nHeight > params.LAST_POW_BLOCK ? "S" : "W");
+            strSelectionMap.replace(candidate.pindex->nHeight - nHeightFirstCandidate, 1, candidate.pindex->nHeight > params.LAST_POW_BLOCK ? "S" : "W");
         }
         LogPrintf("%s(): selection height [%d, %d] map %s\n", __func__, nHeightFirstCandidate, pindexPrev->nHeight, strSelectionMap.c_str());
     }
@@ -320,6 +541,7 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
  */
 static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake, const Consensus::Params& params)
 {
+    PROFILE_SCOPE("GetKernelStakeModifier");
     nStakeModifier = 0;
     if (!mapBlockIndex.count(hashBlockFrom))
         return error("GetKernelStakeModifier() : block not indexed");
@@ -329,42 +551,182 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval(params);
     int64_t nStakeModifierTargetTime = nStakeModifierTime + nStakeModifierSelectionInterval;
 
-    const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex *pNext = chainActive.Next(pindex);
-
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < nStakeModifierTargetTime)
+    // find the stake modifier later by a selection interval
+    const CBlockIndex* pindex = nullptr;
+    if (chainActive.Contains(pindexFrom)) {
+        UpdateStakeModifierIndex(chainActive);
+        pindex = stakeModifierIndex.Find(pindexFrom, nStakeModifierTargetTime);
+    }
+    if (pindex == nullptr)
     {
-        if (pNext == nullptr)
+        // reached best block; may happen if node is behind on block chain
+        const CBlockIndex* pindexLast = chainActive.Contains(pindexFrom) ? chainActive.Tip() : pindexFrom;
+        if (fPrintProofOfStake || (pindexLast->GetBlockTime() + params.nStakeMinAge - nStakeModifierSelectionInterval > GetAdjustedTime()))
         {
-            // reached best block; may happen if node is behind on block chain
-            if (fPrintProofOfStake || (pindex->GetBlockTime() + params.nStakeMinAge - nStakeModifierSelectionInterval > GetAdjustedTime()))
-            {
-                LogPrintf("%s: reached best block %s at height %d from block %s\n", __func__,
-                    pindex->GetBlockHash().ToString().c_str(), pindex->nHeight, hashBlockFrom.ToString().c_str());
-                return false;
-            }
-            else
-            {
-                if (fDebug || GetBoolArg("-printstakemodifier", false))
-                    LogPrintf("%s: Nothing! Ending modifier=%u height=%d time=%u target=%u\n", __func__,
-                        nStakeModifier, nStakeModifierHeight, nStakeModifierTime, nStakeModifierTargetTime);
-                return false;
-            }
+            LogPrintf("%s: reached best block %s at height %d from block %s\n", __func__,
+                pindexLast->GetBlockHash().ToString().c_str(), pindexLast->nHeight, hashBlockFrom.ToString().c_str());
+            return false;
         }
-        pindex = pNext;
-        pNext = chainActive.Next(pindex);
-        //LogPrintf("DEBUG: pindex=%s\n", pindex->ToVerboseString());
-        if (pindex && pindex->GeneratedStakeModifier())
+        else
         {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
+            if (fDebug || GetBoolArg("-printstakemodifier", false))
+                LogPrintf("%s: Nothing! Ending modifier=%u height=%d time=%u target=%u\n", __func__,
+                    nStakeModifier, nStakeModifierHeight, nStakeModifierTime, nStakeModifierTargetTime);
+            return false;
         }
     }
+    nStakeModifierHeight = pindex->nHeight;
+    nStakeModifierTime = pindex->GetBlockTime();
     nStakeModifier = pindex->nStakeModifier;
     return true;
 }
 
+/**
+ * @brief Serialize a stake kernel for hashing
+ * 
+ * Writes the little-endian fields the CDataStream serialization of the kernel produced:
+ * nStakeModifier (8 bytes), then nTimeBlockFrom, nTxOffset, nTxTime, prevout.n and nTimeTx (4 bytes each).
+ * 
+ * @param[out] out STAKE_KERNEL_SIZE bytes
+ */
+void SerializeStakeKernel(unsigned char* out, uint64_t nStakeModifier, const CStakePrevoutInfo& prevoutInfo, uint32_t nPrevout, unsigned int nTimeTx)
+{
+    WriteLE64(out, nStakeModifier);
+    WriteLE32(out + 8, prevoutInfo.nBlockTime);
+    WriteLE32(out + 12, prevoutInfo.nTxOffset);
+    WriteLE32(out + 16, prevoutInfo.nTxTime);
+    WriteLE32(out + 20, nPrevout);
+    WriteLE32(out + 24, nTimeTx);
+}
+
+/**
+ * @brief Compute the hashProofOfStake of several serialized kernels
+ * 
+ * The kernels fit in a single SHA-256 block, so they are double hashed several at a time
+ * by SHA256DShort(). The result is bit-identical to Hash() of each kernel.
+ * 
+ * @param in nCount kernels of STAKE_KERNEL_SIZE bytes, written by SerializeStakeKernel()
+ * @param nCount number of kernels
+ * @param[out] hashProofOfStake nCount hashes
+ */
+void ComputeStakeKernelHashes(const unsigned char* in, size_t nCount, uint256* hashProofOfStake)
+{
+    static_assert(STAKE_KERNEL_SIZE <= SHA256D_SHORT_MAX_LEN, "stake kernel must fit in one SHA-256 block");
+    static_assert(sizeof(uint256) == CSHA256::OUTPUT_SIZE, "uint256 arrays must be contiguous hashes");
+    SHA256DShort(hashProofOfStake[0].begin(), in, STAKE_KERNEL_SIZE, nCount);
+}
+
+/**
+ * @brief Static part of a stake-time factored weight
+ *
+ * Shared by GetStakeTimeFactoredWeight() and CStakeKernelContext, so both give bit-identical results.
+ */
+static int64_t FactorStakeTimeWeight(int64_t timeWeight, int64_t nCoinDayWeight, double dAverageStakeWeight, const Consensus::Params& params)
+{
+    int64_t factoredTimeWeight;
+    double weightFraction = (nCoinDayWeight+1) / dAverageStakeWeight;
+    if (weightFraction > 0.45)
+    {
+        factoredTimeWeight = params.nStakeMinAge+1;
+    }
+    else
+    {
+        double stakeTimeFactor = pow(cos((params.PI*weightFraction)),2.0);
+        factoredTimeWeight = stakeTimeFactor*timeWeight;
+    }
+    return factoredTimeWeight;
+}
+
+/**
+ * @brief Construct a kernel context for blocks built on pindexPrev
+ *
+ * @param nBitsIn The new block's nBits
+ * @param pindexPrevIn Block the network weight is measured at, see CheckStakeTimeKernelHash()
+ * @param paramsIn Consensus params
+ */
+CStakeKernelContext::CStakeKernelContext(unsigned int nBitsIn, CBlockIndex* pindexPrevIn, const Consensus::Params& paramsIn) :
+    nBits(nBitsIn), pindexPrev(pindexPrevIn), params(paramsIn)
+{
+    AssertLockHeld(cs_main);
+    bnTargetPerCoinDay.SetCompact(nBits);
+    dAverageStakeWeight = GetAverageStakeWeight(pindexPrev, params);
+}
+
+int64_t CStakeKernelContext::GetFactoredTimeWeight(int64_t timeWeight, int64_t nCoinDayWeight) const
+{
+    return FactorStakeTimeWeight(timeWeight, nCoinDayWeight, dAverageStakeWeight, params);
+}
+
+/**
+ * @brief Get the target a stake kernel must meet
+ * 
+ * The target per coin day of nBits, scaled by the stake-time factored weight of the output at nTimeTx.
+ * 
+ * @param prevoutInfo Kernel data of the output being staked
+ * @param nTimeTx The timestamp of the kernel
+ * @return the target
+ */
+arith_uint256 CStakeKernelContext::GetTarget(const CStakePrevoutInfo& prevoutInfo, unsigned int nTimeTx) const
+{
+    int64_t nValueIn = prevoutInfo.nValue;
+    int64_t timeWeight = GetWeight((int64_t)prevoutInfo.nTxTime, (int64_t)nTimeTx, params);
+    int64_t nCoinDayWeight = nValueIn * timeWeight / COIN / (24 * 60 * 60);
+
+    // Stake Time factored weight
+    int64_t factoredTimeWeight = GetFactoredTimeWeight(timeWeight, nCoinDayWeight);
+    arith_uint256 bnStakeTimeWeight = arith_uint256(nValueIn) * factoredTimeWeight / COIN / (24 * 60 * 60);
+    return bnStakeTimeWeight * bnTargetPerCoinDay;
+}
+
+/**
+ * @brief Get an upper bound of the target of a stake kernel over a range of timestamps
+ * 
+ * The stake-time factor is at most 1, so the factored weight never exceeds the larger of the time
+ * weight at nTimeTxTo and the weight given to heavy outputs. A kernel hash above the bound cannot
+ * meet the target at any of the timestamps, which the stake miner tests without computing the
+ * exact target. The bound is ~0 where the target can be negative or overflow in the range.
+ * 
+ * @param prevoutInfo Kernel data of the output being staked
+ * @param nTimeTxFrom The first timestamp of the range
+ * @param nTimeTxTo The last timestamp of the range
+ * @return the bound
+ */
+arith_uint256 CStakeKernelContext::GetTargetBound(const CStakePrevoutInfo& prevoutInfo, unsigned int nTimeTxFrom, unsigned int nTimeTxTo) const
+{
+    if (prevoutInfo.nValue < 0 || GetWeight((int64_t)prevoutInfo.nTxTime, (int64_t)nTimeTxFrom, params) < 0)
+        return ~arith_uint256();
+    int64_t timeWeightMax = std::max(GetWeight((int64_t)prevoutInfo.nTxTime, (int64_t)nTimeTxTo, params), (int64_t)params.nStakeMinAge + 1);
+    arith_uint256 bnStakeTimeWeight = arith_uint256(prevoutInfo.nValue) * timeWeightMax / COIN / (24 * 60 * 60);
+    // GetTarget() wraps around on overflow, which a bound cannot follow
+    if (bnStakeTimeWeight.bits() + bnTargetPerCoinDay.bits() > 256)
+        return ~arith_uint256();
+    return bnStakeTimeWeight * bnTargetPerCoinDay;
+}
+
+/**
+ * @brief Get the stake modifier of a kernel
+ * 
+ * The modifier only depends on the block of the staked output, so it is looked up once per block.
+ * 
+ * @param prevoutInfo Kernel data of the output being staked
+ * @param[out] nStakeModifier the stake modifier to hash the kernel with
+ * @return false if the modifier is not available yet
+ */
+bool CStakeKernelContext::GetModifier(const CStakePrevoutInfo& prevoutInfo, uint64_t& nStakeModifier)
+{
+    AssertLockHeld(cs_main);
+    std::map<uint256, std::pair<bool, uint64_t> >::const_iterator it = mapModifiers.find(prevoutInfo.hashBlock);
+    if (it == mapModifiers.end()) {
+        std::pair<bool, uint64_t> modifier;
+        int nStakeModifierHeight = 0;
+        int64_t nStakeModifierTime = 0;
+        modifier.first = GetKernelStakeModifier(prevoutInfo.hashBlock, modifier.second, nStakeModifierHeight, nStakeModifierTime, false, params);
+        it = mapModifiers.insert(std::make_pair(prevoutInfo.hashBlock, modifier)).first;
+    }
+    nStakeModifier = it->second.second;
+    return it->second.first;
+}
+
 /**
  * @brief Validates whether a given hashProofOfStake meets the target.
  * 
@@ -397,9 +759,7 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
  *   a proof-of-work situation.
  * 
  * @param nBits The new block's nBits
- * @param blockFrom The block being used to generate the stake hash 
- * @param nTxOffset The byte-level offset of the transaction inside the block. Seems to depend on the txIndex being built
- * @param txPrev The transaction used to find the block used to generate the stake hash  
+ * @param prevoutInfo Block time, tx offset (including the block header), tx time, value and block hash of the output being staked
  * @param prevout The previous output of the first input of the new block's (not the block used to generate the stake hash) first non-coinstake tx (vtx[1])
  * @param nTimeTx The timestamp of the new block's first non-coinstake tx (vtx[1])
  * @param[out] hashProofOfStake An address to hold the hashProofOfStake
@@ -410,61 +770,71 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
  * @return true 
  * @return false 
  */
-bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params)
+bool CheckStakeTimeKernelHash(unsigned int nBits, const CStakePrevoutInfo& prevoutInfo, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params)
 {
-    if (nTimeTx < txPrev.nTime) {  // Transaction timestamp violation
+    PROFILE_SCOPE("CheckStakeTimeKernelHash");
+    CStakeKernelContext context(nBits, pindexPrev, params);
+    return CheckStakeTimeKernelHash(context, prevoutInfo, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+}
+
+/**
+ * @brief Validates whether a given hashProofOfStake meets the target, with the block data taken from a kernel context.
+ * 
+ * See the overload above. Checking many kernels with one context computes the average stake weight,
+ * the target per coin day and each stake modifier only once.
+ */
+bool CheckStakeTimeKernelHash(CStakeKernelContext& context, const CStakePrevoutInfo& prevoutInfo, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+{
+    const Consensus::Params& params = context.GetParams();
+
+    if (nTimeTx < prevoutInfo.nTxTime) {  // Transaction timestamp violation
         LogPrintf("%s(): nTime violation\n", __func__);
         return false;
     }
 
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    unsigned int nTimeBlockFrom = prevoutInfo.nBlockTime;
     if (nTimeBlockFrom + params.nStakeMinAge > nTimeTx) { // Min age requirement
         LogPrintf("%s(): min age violation\n", __func__);
         return false;
     }
 
-    arith_uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    uint256 hashBlockFrom = blockFrom.GetHash();
-
+    const uint256& hashBlockFrom = prevoutInfo.hashBlock;
     CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
     int heightBlockFrom = pindexFrom->nHeight;
-    int64_t timeWeight = GetWeight((int64_t)txPrev.nTime, (int64_t)nTimeTx, params);
-    int64_t nCoinDayWeight = nValueIn * timeWeight / COIN / (24 * 60 * 60);
-
-    // Stake Time factored weight
-    int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, nCoinDayWeight, pindexPrev, params);
-    arith_uint256 bnStakeTimeWeight = arith_uint256(nValueIn) * factoredTimeWeight / COIN / (24 * 60 * 60);
-    targetProofOfStake = ArithToUint256(bnStakeTimeWeight * bnTargetPerCoinDay);
+    targetProofOfStake = ArithToUint256(context.GetTarget(prevoutInfo, nTimeTx));
 
     // Calculate hash
-    CDataStream ss(SER_GETHASH, 0);
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
 
-    if (!GetKernelStakeModifier(hashBlockFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake, params)) {
-        LogPrintf("%s(): GetKernelStakeModifier failed\n", __func__);
+    // The modifier height and time are only needed for the log, so the context's cached lookup is bypassed then
+    bool fModifier = fPrintProofOfStake ?
+        GetKernelStakeModifier(hashBlockFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake, params) :
+        context.GetModifier(prevoutInfo, nStakeModifier);
+    if (!fModifier) {
+        if (fPrintProofOfStake)
+            LogPrintf("%s(): GetKernelStakeModifier failed\n", __func__);
         return false;
     }
 
-    ss << nStakeModifier;
-
-    ss << nTimeBlockFrom << nTxOffset << txPrev.nTime << prevout.n << nTimeTx;
-    hashProofOfStake = Hash(ss.begin(), ss.end());
+    unsigned char kernel[STAKE_KERNEL_SIZE];
+    SerializeStakeKernel(kernel, nStakeModifier, prevoutInfo, prevout.n, nTimeTx);
+    ComputeStakeKernelHashes(kernel, 1, &hashProofOfStake);
 
     if (fPrintProofOfStake)
     {
+        int64_t timeWeight = GetWeight((int64_t)prevoutInfo.nTxTime, (int64_t)nTimeTx, params);
+        int64_t nCoinDayWeight = prevoutInfo.nValue * timeWeight / COIN / (24 * 60 * 60);
         LogPrintf("%s(): using modifier %016x at height=%d timestamp=%u for block from height=%d timestamp=%u\n timeWeight=%d coinDayWeight=%d\n", __func__,
             nStakeModifier, nStakeModifierHeight,
             nStakeModifierTime,
             heightBlockFrom,
-            blockFrom.GetBlockTime(),
+            nTimeBlockFrom,
             timeWeight, nCoinDayWeight);
         LogPrintf("%s(): check modifier=%016x nTimeBlockFrom=%u nTxOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s targetProof=%s\n", __func__,
             nStakeModifier,
-            nTimeBlockFrom, nTxOffset, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, prevoutInfo.nTxOffset, prevoutInfo.nTxTime, prevout.n, nTimeTx,
             hashProofOfStake.ToString().c_str(), targetProofOfStake.ToString().c_str());
     }
 
@@ -472,22 +842,160 @@ bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsig
     if (heightBlockFrom > params.LAST_POW_BLOCK) {
         // Now check if proof-of-stake hash meets target protocol
         if (UintToArith256(hashProofOfStake) > UintToArith256(targetProofOfStake)) {
-            LogPrintf("DEBUG: BUG: hashProofOfStake=%s > targetProofOfStake=%s (%08x > %08x) at height=%d\n", hashProofOfStake.ToString(), targetProofOfStake.ToString(), UintToArith256(hashProofOfStake).GetCompact(), UintToArith256(targetProofOfStake).GetCompact(), pindexFrom->nHeight);
-                return false;
+            // Expected for nearly every timestamp tried by the stake miner, so only log when asked to
+            if (fPrintProofOfStake)
+                LogPrintf("DEBUG: BUG: hashProofOfStake=%s > targetProofOfStake=%s (%08x > %08x) at height=%d\n", hashProofOfStake.ToString(), targetProofOfStake.ToString(), UintToArith256(hashProofOfStake).GetCompact(), UintToArith256(targetProofOfStake).GetCompact(), pindexFrom->nHeight);
+            return false;
         }
     }
     return true;
 }
 
+/**
+ * @brief Get the chain data of an unspent stake prevout from the UTXO set
+ *
+ * Coins connected by this version carry all the kernel data: the output value, the transaction time,
+ * the block time and the offset of the transaction inside its block, so no index or block is read.
+ * For older coins, which only know the transaction time, the offset is taken from the transaction index
+ * (in its compact form, from the entry at the coin's height).
+ * Coins upgraded from the old per-transaction database (nTime 0) are not handled here.
+ *
+ * @param prevout the outpoint spent by the stake input
+ * @param[out] info address to store the prevout data
+ * @return false if the coin is spent, lacks its transaction time or does not match the index entry
+ */
+static bool GetStakePrevoutInfoFromCoins(const COutPoint& prevout, CStakePrevoutInfo& info)
+{
+    Coin coin;
+    CBlockIndex* pindexFrom = NULL;
+    {
+        LOCK(cs_main);
+        if (!pcoinsTip->GetCoin(prevout, coin) || coin.nTime == 0 || (int)coin.nHeight > chainActive.Height())
+            return false;
+        pindexFrom = chainActive[coin.nHeight];
+        if (coin.HasKernelData()) {
+            info.nBlockTime = coin.nBlockTime;
+            info.nTxOffset = coin.nTxOffset + 80; // Add the block header offset
+            info.nTxTime = coin.nTime;
+            info.nValue = coin.out.nValue;
+            info.hashBlock = pindexFrom->GetBlockHash();
+            stakePrevoutCache.Insert(prevout, info);
+            return true;
+        }
+    }
+
+    unsigned int nTxOffset = 0;
+    if (!ptxindex || !ptxindex->FindTxOffset(prevout.hash, pindexFrom, nTxOffset))
+        return false;
+
+    LOCK(cs_main);
+    if (!chainActive.Contains(pindexFrom))
+        return false;
+    info.nBlockTime = pindexFrom->GetBlockTime();
+    info.nTxOffset = nTxOffset + 80; // Add the block header offset
+    info.nTxTime = coin.nTime;
+    info.nValue = coin.out.nValue;
+    info.hashBlock = pindexFrom->GetBlockHash();
+    stakePrevoutCache.Insert(prevout, info);
+    return true;
+}
+
+/**
+ * SolarCoin: Get the chain data of an output spent by a stake kernel from a coins view other than the
+ * active chain's, as used by the background validation of a UTXO snapshot. Only the fields the stake
+ * time depends on are set; hashBlock and the offset are left for the kernel hash check.
+ *
+ * @return false if the coin is not in the view or lacks its block time
+ */
+static bool GetStakePrevoutInfoFromView(const CCoinsViewCache& view, const COutPoint& prevout, CStakePrevoutInfo& info)
+{
+    const Coin& coin = view.AccessCoin(prevout);
+    if (coin.IsSpent() || !coin.HasKernelData())
+        return false;
+    info.nBlockTime = coin.nBlockTime;
+    info.nTxOffset = coin.nTxOffset + 80; // Add the block header offset
+    info.nTxTime = coin.nTime;
+    info.nValue = coin.out.nValue;
+    return true;
+}
+
+/**
+ * @brief Get the chain data of an output spent by a stake kernel
+ *
+ * Called from CheckProofOfStake(), GetStakeTime() and GetCoinAge().
+ *
+ * Looks the outpoint up in the stake prevout cache first, then in the UTXO set. Otherwise the previous transaction is read
+ * through the transaction index without holding cs_main; the block time is taken from its block index
+ * entry, so no block is read from disk. Only outputs of transactions in the active chain are cached.
+ *
+ * @param prevout the outpoint spent by the stake input
+ * @param[out] info address to store the prevout data
+ * @param params consensus parameters
+ * @return true
+ * @return false if the previous transaction could not be found in a known block
+ */
+bool GetStakePrevoutInfo(const COutPoint& prevout, CStakePrevoutInfo& info, const Consensus::Params& params)
+{
+    PROFILE_SCOPE("GetStakePrevoutInfo");
+    {
+        LOCK(cs_main);
+        if (stakePrevoutCache.Get(prevout, info)) {
+            BlockMap::iterator mi = mapBlockIndex.find(info.hashBlock);
+            if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second)) {
+                IncrementBlockCounter(BLOCK_COUNTER_STAKE_PREVOUT_HIT);
+                return true;
+            }
+            stakePrevoutCache.Erase(prevout);
+        }
+    }
+    IncrementBlockCounter(BLOCK_COUNTER_STAKE_PREVOUT_MISS);
+
+    if (GetStakePrevoutInfoFromCoins(prevout, info))
+        return true;
+
+    // Read the previous transaction through the transaction index without cs_main, so callers
+    // that do not hold it yet (ProcessNewBlock(), the stake miner) do not stall other threads on disk I/O.
+    // Without an index entry, GetTransaction() scans the block found through the coins database.
+    uint256 hashBlock;
+    CTransactionRef txPrevRef;
+    unsigned int nTxOffset = 0;
+    bool fIndexed = false;
+    bool fRead = ptxindex && ptxindex->FindTx(prevout.hash, txPrevRef, nTxOffset, hashBlock, fIndexed);
+    if (!fIndexed)
+        fRead = GetTransaction(prevout.hash, txPrevRef, nTxOffset, params, hashBlock, true);
+    if (!fRead) {
+        LogPrint("stake", "%s(): INFO: read txPrev failed\n", __func__);  // previous transaction not in main chain, may occur during initial download
+        return false;
+    }
+
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end() || !mi->second) // e.g. txPrev is still in the mempool
+        return fDebug ? error("%s: block of previous transaction %s not indexed", __func__, prevout.hash.ToString()) : false;
+    if (prevout.n >= txPrevRef->vout.size())
+        return error("%s: invalid prevout %s", __func__, prevout.ToString());
+
+    info.nBlockTime = mi->second->GetBlockTime();
+    info.nTxOffset = nTxOffset + 80; // Add the block header offset
+    info.nTxTime = txPrevRef->nTime;
+    info.nValue = txPrevRef->vout[prevout.n].nValue;
+    info.hashBlock = hashBlock;
+
+    if (chainActive.Contains(mi->second))
+        stakePrevoutCache.Insert(prevout, info);
+    return true;
+}
+
 /**
  * @brief Check kernel hash target and coinstake signature 
  * 
- * Called from ProcessNewBlock(). 
+ * Called from ProcessNewBlock() before it takes cs_main. cs_main is only held to look up the
+ * previous output and to check the kernel hash, not while reading from disk. 
  * 
  * Uses the transaction stored at the block-to-be-validated's vtx[1]. (the first non-coinstake tx?). 
- * That transaction's vin[0].prevout.hash (the tx hash of the previous output of the first input of the new block's first non-coinstake tx)
- * is fetched from the database, along with the hash of its corresponding block. That prior block and tx, along with the tx's offset inside the block,
- * are used to generate the proof-of-stake for the new block.
+ * That transaction's vin[0].prevout (the previous output of the first input of the new block's first non-coinstake tx)
+ * is looked up via GetStakePrevoutInfo(), which provides the previous tx, its block time and its offset inside the block;
+ * these are used to generate the proof-of-stake for the new block.
  * 
  * @param tx Corresponds to the new block's vtx[1].  
  * @param nBits The nBits of the new block
@@ -499,25 +1007,16 @@ bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsig
  */
 bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params)
 {
+    PROFILE_SCOPE("CheckProofOfStake");
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txIn = tx.vin[0];
-    const uint256& hashTx = txIn.prevout.hash;
-    uint256 hashBlock;
-    CTransactionRef txPrevRef;
 
-    // First try finding the previous transaction in database
-    unsigned int nTxOffset = 0;
-    if (!GetTransaction(hashTx, txPrevRef, nTxOffset, params, hashBlock, true)) {
-        LogPrintf("%s(): INFO: read txPrev failed\n", __func__);  // previous transaction not in main chain, may occur during initial download
+    CStakePrevoutInfo prevoutInfo;
+    if (!GetStakePrevoutInfo(txIn.prevout, prevoutInfo, params))
         return false;
-    }
-    // Add the block header offset
-    nTxOffset += 80;
-
-    const CTransaction& txPrev = *txPrevRef;
 
     // TODO: Verify signature
     //if (!VerifySignature(txPrev, tx, 0, 0)) {
@@ -525,15 +1024,9 @@ bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hash
     //    return false;
     //}
 
-    // Read block header
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-    if(!ReadBlockFromDisk(block, pblockindex, params, false)) {
-        return fDebug ? error("CheckProofOfStake() : read block failed") : false; // unable to read block of previous transaction
-    }
-
-    if (!CheckStakeTimeKernelHash(nBits, block, nTxOffset, txPrev, txIn.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, chainActive.Tip()->pprev, fDebug, params)) {
-        LogPrintf("%s(): INFO: check kernel failed on coinstake %s, hashProof=%s\n", __func__, tx.GetHash().ToString(), hashProofOfStake.ToString()); // may occur during initial download or if behind on block chain sync
+    LOCK(cs_main);
+    if (!CheckStakeTimeKernelHash(nBits, prevoutInfo, txIn.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, chainActive.Tip()->pprev, fDebug, params)) {
+        LogPrint("stake", "%s(): INFO: check kernel failed on coinstake %s, hashProof=%s\n", __func__, tx.GetHash().ToString(), hashProofOfStake.ToString()); // may occur during initial download or if behind on block chain sync
         return false;
     }
     return true;
@@ -570,11 +1063,11 @@ unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex, const Consensus
 {
     assert (pindex->pprev || pindex->GetBlockHash() == params.hashGenesisBlock);
     // Hash previous checksum with flags, hashProofOfStake and nStakeModifier
-    CDataStream ss(SER_GETHASH, 0);
+    CHashWriter ss(SER_GETHASH, 0);
     if (pindex->pprev)
         ss << pindex->pprev->nStakeModifierChecksum;
-    ss << pindex->nFlags << pindex->hashProofOfStake << pindex->nStakeModifier;
-    uint256 hashChecksum = Hash(ss.begin(), ss.end());
+    ss << pindex->nFlags << pindex->GetHashProofOfStake() << pindex->nStakeModifier;
+    uint256 hashChecksum = ss.GetHash();
     hashChecksum = ArithToUint256(UintToArith256(hashChecksum) >>= (256 - 32));
     return hashChecksum.GetUint64(0);
 }
@@ -620,23 +1113,15 @@ bool CheckStakeModifierCheckpoints(int nHeight, unsigned int nStakeModifierCheck
  */
 int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
-    int64_t factoredTimeWeight;
-    double weightFraction = (nCoinDayWeight+1) / GetAverageStakeWeight(pindexPrev, params);
-    if (weightFraction > 0.45)
-    {
-        factoredTimeWeight = params.nStakeMinAge+1;
-    }
-    else
-    {
-        double stakeTimeFactor = pow(cos((params.PI*weightFraction)),2.0);
-        factoredTimeWeight = stakeTimeFactor*timeWeight;
-    }
-    return factoredTimeWeight;
+    return FactorStakeTimeWeight(timeWeight, nCoinDayWeight, GetAverageStakeWeight(pindexPrev, params), params);
 }
 
 
 /**
  * @brief Get the Average Stake Weight of the network over the past 60 blocks for PoST hash and stake calculations
+ *
+ * The result only depends on pindexPrev and its ancestors and is memoized in CBlockIndex::dAverageStakeWeight,
+ * so reorgs and queries for blocks other than the tip never invalidate it. Must be called with cs_main held.
  * 
  * @param pindexPrev pointer to the previous block
  * @param params consensus params
@@ -644,17 +1129,16 @@ int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, C
  */
 double GetAverageStakeWeight(CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
+    PROFILE_SCOPE("GetAverageStakeWeight");
     double weightSum = 0.0, weightAve = 0.0;
     if (chainActive.Height() < 1)
         return weightAve;
 
-    // Use cached weight if it's still valid
-    if (pindexPrev->nHeight == nAverageStakeWeightHeightCached)
-    {
-        return dAverageStakeWeightCached;
-    }
-    nAverageStakeWeightHeightCached = pindexPrev->nHeight;
+    // Use cached weight if it was already computed for this block
+    if (pindexPrev->dAverageStakeWeight >= 0)
+        return pindexPrev->dAverageStakeWeight;
 
+    // Sum in the same order as before memoization so the (consensus) result is unchanged
     int i;
     CBlockIndex* currentBlockIndex = pindexPrev;
     for (i = 0; currentBlockIndex && i < 60; i++)
@@ -666,7 +1150,7 @@ double GetAverageStakeWeight(CBlockIndex* pindexPrev, const Consensus::Params& p
     weightAve = (weightSum/i)+21;
 
     // Cache the stake weight value
-    dAverageStakeWeightCached = weightAve;
+    pindexPrev->dAverageStakeWeight = weightAve;
 
     return weightAve;
 }
@@ -700,37 +1184,22 @@ bool GetCoinAge(const CTransaction& tx, uint64_t& nCoinAge, const Consensus::Par
 
     for (unsigned int i=0; i < tx.vin.size(); i++) {
         const CTxIn& txIn = tx.vin[i];
-        const uint256& hashTx = txIn.prevout.hash;
-        uint256 hashBlock;
-        CTransactionRef txPrevRef;
-
-        // First try finding the previous transaction in database
-        unsigned int nTxOffset = 0;
-        if (!GetTransaction(hashTx, txPrevRef, nTxOffset, params, hashBlock, true)) {
-            LogPrintf("%s(): INFO: read txPrev failed\n", __func__);  // previous transaction not in main chain, may occur during initial download
-            return false;
-        }
 
-        const CTransaction& txPrev = *txPrevRef;
+        CStakePrevoutInfo prevoutInfo;
+        if (!GetStakePrevoutInfo(txIn.prevout, prevoutInfo, params))
+            return false;
 
-        if (tx.nTime < txPrev.nTime)
+        if (tx.nTime < prevoutInfo.nTxTime)
             return false;  // Transaction timestamp violation
 
-        // Read block header
-        CBlock block;
-        CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-        if(!ReadBlockFromDisk(block, pblockindex, params, false)) {
-            return fDebug ? error("GetStakeTime() : read block failed") : false; // unable to read block of previous transaction
-        }
-
-        if (block.GetBlockTime() + params.nStakeMinAge > tx.nTime)
+        if (prevoutInfo.nBlockTime + params.nStakeMinAge > tx.nTime)
             continue; // only count coins meeting min age requirement
 
-        int64_t nValueIn = txPrev.vout[txIn.prevout.n].nValue;
-        bnCentSecond += arith_uint256(nValueIn) * (tx.nTime - txPrev.nTime) / CENT;
+        int64_t nValueIn = prevoutInfo.nValue;
+        bnCentSecond += arith_uint256(nValueIn) * (tx.nTime - prevoutInfo.nTxTime) / CENT;
 
         if (fDebug || GetBoolArg("-printcoinage", false))
-            LogPrintf("coin age nValueIn=%ld nTimeDiff=%ld bnCentSecond=%s\n", nValueIn, tx.nTime - txPrev.nTime, bnCentSecond.ToString());
+            LogPrintf("coin age nValueIn=%ld nTimeDiff=%ld bnCentSecond=%s\n", nValueIn, tx.nTime - prevoutInfo.nTxTime, bnCentSecond.ToString());
     }
 
     arith_uint256 bnCoinDay = bnCentSecond * CENT / COIN / (24 * 60 * 60);
@@ -758,10 +1227,11 @@ bool GetCoinAge(const CTransaction& tx, uint64_t& nCoinAge, const Consensus::Par
  * @param nStakeTime address to store the coinAge in 
  * @param pindexPrev pointer to previous block
  * @param params consensus params
+ * @param pview SolarCoin: coins view to look the spent outputs up in instead of the active chain, if not NULL
  * @return true 
  * @return false 
  */
-bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params)
+bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params, const CCoinsViewCache* pview)
 {
     arith_uint256 bnStakeTime = 0;  // coin age in the unit of cent-seconds
     nStakeTime = 0;
@@ -771,34 +1241,19 @@ bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pin
 
     for (unsigned int i=0; i < tx.vin.size(); i++) {
         const CTxIn& txIn = tx.vin[i];
-        const uint256& hashTx = txIn.prevout.hash;
-        uint256 hashBlock;
-        CTransactionRef txPrevRef;
-
-        // First try finding the previous transaction in database
-        unsigned int nTxOffset = 0;
-        if (!GetTransaction(hashTx, txPrevRef, nTxOffset, params, hashBlock, true)) {
-            LogPrintf("%s(): INFO: read txPrev failed\n", __func__);  // previous transaction not in main chain, may occur during initial download
-            return false;
-        }
 
-        const CTransaction& txPrev = *txPrevRef;
+        CStakePrevoutInfo prevoutInfo;
+        if (pview ? !GetStakePrevoutInfoFromView(*pview, txIn.prevout, prevoutInfo) : !GetStakePrevoutInfo(txIn.prevout, prevoutInfo, params))
+            return false;
 
-        if (tx.nTime < txPrev.nTime)
+        if (tx.nTime < prevoutInfo.nTxTime)
             return false;  // Transaction timestamp violation
 
-        // Read block header
-        CBlock block;
-        CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-        if(!ReadBlockFromDisk(block, pblockindex, params, false)) {
-            return fDebug ? error("GetStakeTime() : read block failed") : false; // unable to read block of previous transaction
-        }
-
-        if (block.GetBlockTime() + params.nStakeMinAge > tx.nTime)
+        if (prevoutInfo.nBlockTime + params.nStakeMinAge > tx.nTime)
             continue; // only count coins meeting min age requirement
 
-        int64_t nValueIn = txPrev.vout[txIn.prevout.n].nValue;
-        int64_t timeWeight = tx.nTime - txPrev.nTime;
+        int64_t nValueIn = prevoutInfo.nValue;
+        int64_t timeWeight = tx.nTime - prevoutInfo.nTxTime;
 
         // Prevent really large stake weights by maxing at 30 days weight (2.0.2 restriction)
         if (timeWeight > 30 * (24 * 60 * 60))
@@ -824,7 +1279,7 @@ bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pin
  * Called from GetAverageStakeWeight()
  * 
  * Returns the sum of difficulty of a series of blocks over an interval divided by the 
- * total time taken between blocks in the interval
+ * total time taken between blocks in the interval. The result is memoized in CBlockIndex::dPoSKernelPS.
  * 
  * @param pindexPrev pointer to prior block
  * @param params 
@@ -832,28 +1287,35 @@ bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pin
  */
 double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
+    if (!pindexPrev)
+        return 0;
+    if (pindexPrev->dPoSKernelPS >= 0)
+        return pindexPrev->dPoSKernelPS;
+
     int nPoSInterval = 72;
     double dStakeKernelsTriedAvg = 0;
     int nStakesHandled = 0, nStakesTime = 0;
 
+    CBlockIndex* pindex = pindexPrev;
     CBlockIndex* pindexPrevStake = nullptr;
 
-    while (pindexPrev && nStakesHandled < nPoSInterval)
+    while (pindex && nStakesHandled < nPoSInterval)
     {
         // SolarCoin: CBlockIndex::IsProofOfStake is not valid during header download. Use height instead.
-        if (pindexPrev->nHeight > params.LAST_POW_BLOCK)
+        if (pindex->nHeight > params.LAST_POW_BLOCK)
         {
-            dStakeKernelsTriedAvg += GetDifficulty(pindexPrev) * 4294967296.0;
-            if (pindexPrev->nHeight >= params.FORK_HEIGHT_2)
+            dStakeKernelsTriedAvg += GetDifficulty(pindex) * 4294967296.0;
+            if (pindex->nHeight >= params.FORK_HEIGHT_2)
                 // Bug fix: Prevent negative stake weight
-                nStakesTime += std::max((int)(pindexPrevStake ? (pindexPrevStake->nTime - pindexPrev->nTime) : 0), 0);
+                nStakesTime += std::max((int)(pindexPrevStake ? (pindexPrevStake->nTime - pindex->nTime) : 0), 0);
             else
-                nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindexPrev->nTime) : 0;
-            pindexPrevStake = pindexPrev;
+                nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindex->nTime) : 0;
+            pindexPrevStake = pindex;
             nStakesHandled++;
         }
-        pindexPrev = pindexPrev->pprev;
+        pindex = pindex->pprev;
     }
 
-   return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
+    pindexPrev->dPoSKernelPS = nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
+    return pindexPrev->dPoSKernelPS;
 }
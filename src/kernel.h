@@ -4,16 +4,92 @@
 #ifndef PPCOIN_KERNEL_H
 #define PPCOIN_KERNEL_H
 
+#include <amount.h>
+#include <arith_uint256.h>
 #include <consensus/params.h>
+#include <cuckoocache.h>
 #include <primitives/block.h>
 
+#include <map>
+
+class CChain;
+class CCoinsViewCache;
+
 // MODIFIER_INTERVAL_RATIO:
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
 
+// Entries of the stake kernel prevout cache (-stakeprevoutcachesize), rounded down to a power of two
+static const unsigned int DEFAULT_STAKE_PREVOUT_CACHE_SIZE = 65536;
+static const unsigned int MAX_STAKE_PREVOUT_CACHE_SIZE = 1 << 24;
+
+// Serialized size of a stake kernel: modifier, block time, tx offset, tx time, prevout n and timestamp
+static const size_t STAKE_KERNEL_SIZE = 28;
+
+/** Chain data of the output spent by a stake kernel, as used in the kernel hash. */
+struct CStakePrevoutInfo
+{
+    unsigned int nBlockTime; //!< time of the block containing txPrev
+    unsigned int nTxOffset;  //!< offset of txPrev inside its block, including the block header
+    unsigned int nTxTime;    //!< txPrev.nTime
+    CAmount nValue;          //!< value of the spent output
+    uint256 hashBlock;       //!< hash of the block containing txPrev
+
+    CStakePrevoutInfo() : nBlockTime(0), nTxOffset(0), nTxTime(0), nValue(0) {}
+};
+
+/**
+ * SolarCoin: the parts of a PoST kernel check that only depend on the block being built on.
+ *
+ * Holds the target per coin day of nBits, the average stake weight at pindexPrev and the stake
+ * modifiers looked up so far, so checking many kernels against the same block does not repeat
+ * them. Construct and use with cs_main held, and only while pindexPrev is in the chain the
+ * kernels are checked against. Not thread safe: use one context per thread.
+ */
+class CStakeKernelContext
+{
+public:
+    CStakeKernelContext(unsigned int nBitsIn, CBlockIndex* pindexPrevIn, const Consensus::Params& paramsIn);
+
+    /** GetStakeTimeFactoredWeight() with the precomputed average stake weight */
+    int64_t GetFactoredTimeWeight(int64_t timeWeight, int64_t nCoinDayWeight) const;
+    /** The target a kernel of prevoutInfo at nTimeTx must meet */
+    arith_uint256 GetTarget(const CStakePrevoutInfo& prevoutInfo, unsigned int nTimeTx) const;
+    /** An upper bound of GetTarget() for every nTimeTx in [nTimeTxFrom, nTimeTxTo], which may be ~0 */
+    arith_uint256 GetTargetBound(const CStakePrevoutInfo& prevoutInfo, unsigned int nTimeTxFrom, unsigned int nTimeTxTo) const;
+    /** The stake modifier a kernel spending an output of the block prevoutInfo.hashBlock hashes with */
+    bool GetModifier(const CStakePrevoutInfo& prevoutInfo, uint64_t& nStakeModifier);
+
+    const Consensus::Params& GetParams() const { return params; }
+
+private:
+    const unsigned int nBits;
+    CBlockIndex* const pindexPrev;
+    const Consensus::Params& params;
+    arith_uint256 bnTargetPerCoinDay;
+    double dAverageStakeWeight;
+    std::map<uint256, std::pair<bool, uint64_t> > mapModifiers; //!< GetModifier() results by block hash
+};
+
 int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd, const Consensus::Params& params);
+/** Bring the stake modifier lookup index used by kernel checks in line with chain (normally chainActive). */
+void UpdateStakeModifierIndex(const CChain& chain);
+/** Forget the stake modifier lookup index, its block index entries are about to be deleted. */
+void UnloadStakeModifierIndex();
+/** Size the stake prevout cache after -stakeprevoutcachesize, keeping its entries. */
+void InitStakePrevoutCache();
+/** Counters of the stake prevout cache since startup. */
+CacheStats GetStakePrevoutCacheStats();
+/** Bytes of memory used by the stake modifier lookup index and the stake prevout cache. */
+size_t GetStakeIndexMemoryUsage();
 bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier, const Consensus::Params& params);
-bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params);
+bool GetStakePrevoutInfo(const COutPoint& prevout, CStakePrevoutInfo& info, const Consensus::Params& params);
+/** Write the STAKE_KERNEL_SIZE bytes hashed into hashProofOfStake for the kernel of prevout n at nTimeTx. */
+void SerializeStakeKernel(unsigned char* out, uint64_t nStakeModifier, const CStakePrevoutInfo& prevoutInfo, uint32_t nPrevout, unsigned int nTimeTx);
+/** Hash nCount kernels written back to back by SerializeStakeKernel() at once. */
+void ComputeStakeKernelHashes(const unsigned char* in, size_t nCount, uint256* hashProofOfStake);
+bool CheckStakeTimeKernelHash(unsigned int nBits, const CStakePrevoutInfo& prevoutInfo, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params);
+bool CheckStakeTimeKernelHash(CStakeKernelContext& context, const CStakePrevoutInfo& prevoutInfo, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake);
 bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params);
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
 unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex, const Consensus::Params& params);
@@ -23,7 +99,7 @@ int64_t GetStakeModifierSelectionIntervalSection(int nSection, const Consensus::
 int64_t GetStakeModifierSelectionInterval(const Consensus::Params& params);
 int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, CBlockIndex* pindexPrev, const Consensus::Params& params);
 bool GetCoinAge(const CTransaction& tx, uint64_t& nCoinAge, const Consensus::Params& params);
-bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params);
+bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params, const CCoinsViewCache* pview = NULL);
 double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params);
 
 // This is needed because the foreach macro can't get over the comma in pair<t1, t2>
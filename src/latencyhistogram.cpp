@@ -0,0 +1,47 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "latencyhistogram.h"
+
+#include <algorithm>
+
+CLatencyHistogram::CLatencyHistogram() : nCount(0), nTotal(0), nMax(0)
+{
+    for (int i = 0; i < BUCKETS; i++)
+        vBuckets[i].store(0, std::memory_order_relaxed);
+}
+
+void CLatencyHistogram::Add(int64_t nMicros)
+{
+    if (nMicros < 0)
+        nMicros = 0;
+    int nBucket = 0;
+    while (nBucket < BUCKETS - 1 && (nMicros >> nBucket) != 0)
+        nBucket++;
+    vBuckets[nBucket].fetch_add(1, std::memory_order_relaxed);
+    nCount.fetch_add(1, std::memory_order_relaxed);
+    nTotal.fetch_add(nMicros, std::memory_order_relaxed);
+    int64_t nPrevMax = nMax.load(std::memory_order_relaxed);
+    while (nMicros > nPrevMax && !nMax.compare_exchange_weak(nPrevMax, nMicros, std::memory_order_relaxed)) {}
+}
+
+int64_t CLatencyHistogram::GetPercentile(double dQuantile) const
+{
+    uint64_t nSamples = 0;
+    for (int i = 0; i < BUCKETS; i++)
+        nSamples += vBuckets[i].load(std::memory_order_relaxed);
+    if (nSamples == 0)
+        return 0;
+    uint64_t nRank = (uint64_t)(dQuantile * nSamples);
+    if (nRank >= nSamples)
+        nRank = nSamples - 1;
+    uint64_t nSeen = 0;
+    int64_t nMaxSeen = GetMax();
+    for (int i = 0; i < BUCKETS; i++) {
+        nSeen += vBuckets[i].load(std::memory_order_relaxed);
+        if (nSeen > nRank)
+            return std::min(((int64_t)1 << i) - 1, nMaxSeen);
+    }
+    return nMaxSeen;
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LATENCYHISTOGRAM_H
+#define BITCOIN_LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Latency histogram with power-of-two microsecond buckets. Add() only does relaxed atomic
+ * increments, so it can be called from any thread without a lock. Readers may see a slightly
+ * inconsistent snapshot while samples are added.
+ */
+class CLatencyHistogram
+{
+public:
+    //! Bucket i counts samples below 2^i microseconds (and at least 2^(i-1))
+    static const int BUCKETS = 40;
+
+    CLatencyHistogram();
+
+    void Add(int64_t nMicros);
+
+    uint64_t GetCount() const { return nCount.load(std::memory_order_relaxed); }
+    int64_t GetTotal() const { return nTotal.load(std::memory_order_relaxed); }
+    int64_t GetMax() const { return nMax.load(std::memory_order_relaxed); }
+    /** Upper bound of the bucket holding the given quantile (0..1), capped at the maximum */
+    int64_t GetPercentile(double dQuantile) const;
+
+private:
+    std::atomic<uint64_t> vBuckets[BUCKETS];
+    std::atomic<uint64_t> nCount;
+    std::atomic<int64_t> nTotal;
+    std::atomic<int64_t> nMax;
+};
+
+#endif // BITCOIN_LATENCYHISTOGRAM_H
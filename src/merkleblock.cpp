@@ -35,6 +35,40 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CBloomBlockElements::CBloomBlockElements(const std::shared_ptr<const CBlock>& pblockIn) : pblock(pblockIn)
+{
+    vTxElements.reserve(pblock->vtx.size());
+    for (const CTransactionRef& tx : pblock->vtx)
+        vTxElements.emplace_back(*tx);
+}
+
+CMerkleBlock::CMerkleBlock(const CBloomBlockElements& elements, CBloomFilter& filter)
+{
+    const CBlock& block = *elements.pblock;
+    header = block.GetBlockHeader();
+
+    std::vector<bool> vMatch;
+    std::vector<uint256> vHashes;
+
+    vMatch.reserve(block.vtx.size());
+    vHashes.reserve(block.vtx.size());
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const uint256& hash = block.vtx[i]->GetHash();
+        if (filter.IsRelevantAndUpdate(elements.vTxElements[i]))
+        {
+            vMatch.push_back(true);
+            vMatchedTxn.push_back(std::make_pair(i, hash));
+        }
+        else
+            vMatch.push_back(false);
+        vHashes.push_back(hash);
+    }
+
+    txn = CPartialMerkleTree(vHashes, vMatch);
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
 {
     header = block.GetBlockHeader();
@@ -11,6 +11,7 @@
 #include "primitives/block.h"
 #include "bloom.h"
 
+#include <memory>
 #include <vector>
 
 /** Data structure that represents a partial merkle tree.
@@ -118,6 +119,19 @@ public:
 };
 
 
+/**
+ * SolarCoin: The CBloomTxElements of every transaction of a block, extracted once for all the
+ * peers the block is sent filtered to.
+ */
+class CBloomBlockElements
+{
+public:
+    explicit CBloomBlockElements(const std::shared_ptr<const CBlock>& pblockIn);
+
+    std::shared_ptr<const CBlock> pblock;
+    std::vector<CBloomTxElements> vTxElements;
+};
+
 /**
  * Used to relay blocks as header + vector<merkle branch>
  * to filtered nodes.
@@ -140,6 +154,9 @@ public:
      */
     CMerkleBlock(const CBlock& block, CBloomFilter& filter);
 
+    // SolarCoin: The same, with the elements of the block extracted already
+    CMerkleBlock(const CBloomBlockElements& elements, CBloomFilter& filter);
+
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids);
 
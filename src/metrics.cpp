@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+
+#include "httprpc.h"
+#include "httpserver.h"
+#include "rpc/protocol.h"
+#include "tinyformat.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "validationstats.h"
+
+#include <assert.h>
+#include <atomic>
+
+namespace {
+
+struct CMetricInfo
+{
+    const char* pszName;
+    const char* pszType;
+    const char* pszHelp;
+};
+
+const CMetricInfo metricInfos[METRIC_COUNT] = {
+    {"solarcoin_peers", "gauge", "Connected peers"},
+    {"solarcoin_peers_inbound", "gauge", "Inbound connected peers"},
+    {"solarcoin_mempool_transactions", "gauge", "Transactions in the mempool"},
+    {"solarcoin_mempool_bytes", "gauge", "Virtual size of the mempool transactions"},
+    {"solarcoin_coins_cache_coins", "gauge", "Coins in the coins tip cache"},
+    {"solarcoin_coins_cache_bytes", "gauge", "Memory usage of the coins tip cache"},
+    {"solarcoin_http_queue_depth", "gauge", "HTTP requests waiting for a worker"},
+    {"solarcoin_net_received_bytes_total", "counter", "Bytes received from peers"},
+    {"solarcoin_net_sent_bytes_total", "counter", "Bytes sent to peers"},
+    {"solarcoin_http_rejected_total", "counter", "HTTP requests refused as the work queue was full"},
+    {"solarcoin_stake_searches_total", "counter", "Block time intervals searched by the stake miner"},
+    {"solarcoin_stake_kernels_total", "counter", "Kernels hashed by the stake miner"},
+    {"solarcoin_stake_blocks_total", "counter", "Blocks staked"},
+};
+
+std::atomic<int64_t> nMetrics[METRIC_COUNT];
+
+const int64_t nTimeStarted = GetTime();
+
+void FormatMetric(std::string& str, const char* pszName, const char* pszType, const char* pszHelp, const std::string& strValue)
+{
+    str += strprintf("# HELP %s %s\n# TYPE %s %s\n%s %s\n", pszName, pszHelp, pszName, pszType, pszName, strValue);
+}
+
+void FormatMetric(std::string& str, const char* pszName, const char* pszType, const char* pszHelp, int64_t nValue)
+{
+    FormatMetric(str, pszName, pszType, pszHelp, strprintf("%d", nValue));
+}
+
+bool HTTPReq_Metrics(HTTPRequest* req, const std::string&)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET is supported\r\n");
+        return false;
+    }
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, FormatMetrics());
+    return true;
+}
+
+// Scrapes never wait behind slow RPC calls
+bool HTTPReq_Metrics_IsFast(HTTPRequest*, const std::string&)
+{
+    return true;
+}
+
+} // anon namespace
+
+void SetMetric(MetricId id, int64_t nValue)
+{
+    assert(id < METRIC_COUNT);
+    nMetrics[id].store(nValue, std::memory_order_relaxed);
+}
+
+void AddMetric(MetricId id, int64_t nAmount)
+{
+    assert(id < METRIC_COUNT);
+    nMetrics[id].fetch_add(nAmount, std::memory_order_relaxed);
+}
+
+int64_t GetMetric(MetricId id)
+{
+    assert(id < METRIC_COUNT);
+    return nMetrics[id].load(std::memory_order_relaxed);
+}
+
+std::string FormatMetrics()
+{
+    std::string str;
+    for (int i = 0; i < METRIC_COUNT; i++)
+        FormatMetric(str, metricInfos[i].pszName, metricInfos[i].pszType, metricInfos[i].pszHelp, GetMetric((MetricId)i));
+
+    CChainTipSnapshotRef tip = GetChainTipSnapshot();
+    if (tip) {
+        FormatMetric(str, "solarcoin_block_height", "gauge", "Height of the chain tip", tip->nHeight);
+        FormatMetric(str, "solarcoin_headers_height", "gauge", "Height of the best header", tip->nHeaders);
+        FormatMetric(str, "solarcoin_block_time_seconds", "gauge", "Time of the chain tip", tip->nTime);
+        FormatMetric(str, "solarcoin_block_lag_seconds", "gauge", "Seconds since the time of the chain tip", GetTime() - tip->nTime);
+        FormatMetric(str, "solarcoin_verification_progress", "gauge", "Estimated share of the transactions verified", strprintf("%.6f", tip->dVerificationProgress));
+        FormatMetric(str, "solarcoin_net_stake_weight", "gauge", "Network stake weight at the chain tip", strprintf("%.0f", tip->dNetStakeWeight));
+    }
+    FormatMetric(str, "solarcoin_blocks_connected_total", "counter", "Blocks connected", GetBlockCounter(BLOCK_COUNTER_BLOCKS));
+    FormatMetric(str, "solarcoin_transactions_connected_total", "counter", "Transactions of the blocks connected", GetBlockCounter(BLOCK_COUNTER_TRANSACTIONS));
+    FormatMetric(str, "solarcoin_uptime_seconds", "gauge", "Seconds since the process started", GetTime() - nTimeStarted);
+    return str;
+}
+
+bool StartHTTPMetrics()
+{
+    RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics, HTTPReq_Metrics_IsFast);
+    return true;
+}
+
+void StopHTTPMetrics()
+{
+    UnregisterHTTPHandler("/metrics", true);
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_METRICS_H
+#define BITCOIN_METRICS_H
+
+#include <stdint.h>
+#include <string>
+
+/** -metrics default */
+static const bool DEFAULT_METRICS_ENABLE = false;
+
+/** Operational metrics served at /metrics, set where they change */
+enum MetricId
+{
+    // Gauges
+    METRIC_PEERS,                //!< connected peers
+    METRIC_PEERS_INBOUND,        //!< inbound connected peers
+    METRIC_MEMPOOL_TRANSACTIONS, //!< mempool transactions
+    METRIC_MEMPOOL_BYTES,        //!< virtual size of the mempool transactions
+    METRIC_COINS_CACHE_COINS,    //!< coins in the coins tip cache
+    METRIC_COINS_CACHE_USAGE,    //!< memory usage of the coins tip cache
+    METRIC_HTTP_QUEUE_DEPTH,     //!< HTTP requests waiting for a worker
+    // Counters
+    METRIC_BYTES_RECV,           //!< bytes received from peers
+    METRIC_BYTES_SENT,           //!< bytes sent to peers
+    METRIC_HTTP_REJECTED,        //!< HTTP requests refused as the work queue was full
+    METRIC_STAKE_SEARCHES,       //!< intervals searched by the stake miner
+    METRIC_STAKE_KERNELS,        //!< kernels hashed by the stake miner
+    METRIC_STAKE_BLOCKS,         //!< blocks staked
+    METRIC_COUNT
+};
+
+/**
+ * SolarCoin: Set or add to a metric. Metrics are relaxed atomics, so they can be updated from any
+ * thread, under any lock, for the cost of an uncontended atomic operation.
+ */
+void SetMetric(MetricId id, int64_t nValue);
+void AddMetric(MetricId id, int64_t nAmount = 1);
+int64_t GetMetric(MetricId id);
+
+/**
+ * The metrics in the Prometheus text format, with those of the chain tip, the block processing
+ * counters and the uptime. Takes no lock but that of the tip snapshot, so a scrape never waits for
+ * cs_main.
+ */
+std::string FormatMetrics();
+
+#endif // BITCOIN_METRICS_H
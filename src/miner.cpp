@@ -112,6 +112,7 @@ BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    setTooNew.clear();
 
     // Reserve space for coinbase tx
     nBlockSize = 2000;
@@ -127,11 +128,13 @@ void BlockAssembler::resetBlock()
     blockFinished = false;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, unsigned int nCoinStakeTimeIn)
 {
     int64_t nTimeStart = GetTimeMicros();
+    const bool fProofOfStake = nCoinStakeTimeIn != 0;
 
     resetBlock();
+    nCoinStakeTime = nCoinStakeTimeIn;
 
     pblocktemplate.reset(new CBlockTemplate());
 
@@ -154,9 +157,15 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (chainparams.MineBlocksOnDemand())
         pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
 
-    pblock->nTime = GetAdjustedTime();
+    // SolarCoin: a PoST block carries the timestamp of its coinstake kernel
+    pblock->nTime = fProofOfStake ? nCoinStakeTime : GetAdjustedTime();
     const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
 
+    // SolarCoin: no transaction in a PoST block may be newer than its coinstake, nor spend one
+    // that is; the mempool's nTime index finds them, so selection never has to try them
+    if (fProofOfStake)
+        mempool.CalculateNewerThan(nCoinStakeTime, setTooNew);
+
     nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
                        ? nMedianTimePast
                        : pblock->GetBlockTime();
@@ -185,11 +194,18 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     coinbaseTx.vin.resize(1);
     coinbaseTx.vin[0].prevout.SetNull();
     coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
     coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    if (fProofOfStake) {
+        // SolarCoin: the reward and the fees go to the coinstake
+        coinbaseTx.nTime = nCoinStakeTime;
+        coinbaseTx.vout[0].SetEmpty();
+    } else {
+        coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+        coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
+    }
     pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
+    if (!fProofOfStake)
+        pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
 
     uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
@@ -197,13 +213,18 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     // Fill in header
     pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    if (fProofOfStake) {
+        pblock->nBits      = GetNextTargetRequired(pindexPrev, true, chainparams.GetConsensus());
+    } else {
+        UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+        pblock->nBits      = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    }
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
+    // A PoST template is checked once the staker has added and signed its coinstake
     CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+    if (!fProofOfStake && !TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
@@ -339,9 +360,10 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 
     bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
-        double dPriority = iter->GetPriority(nHeight);
-        CAmount dummy;
-        mempool.ApplyDeltas(iter->GetTx().GetHash(), dPriority, dummy);
+        // SolarCoin: The priority index is keyed at nHeight once addPriorityTxs() ran
+        double dPriority = iter->GetPriorityScore();
+        if (iter->GetPriorityHeight() != (unsigned int)nHeight)
+            dPriority = iter->GetPriority(nHeight) + iter->GetPriorityDelta();
         LogPrintf("priority %.1f fee %s txid %s\n",
                   dPriority,
                   CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(),
@@ -353,12 +375,13 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
         indexed_modified_transaction_set &mapModifiedTx)
 {
     int nDescendantsUpdated = 0;
+    std::vector<CTxMemPool::txiter> descendants;
     BOOST_FOREACH(const CTxMemPool::txiter it, alreadyAdded) {
-        CTxMemPool::setEntries descendants;
+        descendants.clear();
         mempool.CalculateDescendants(it, descendants);
         // Insert all descendants (not yet in block) into the modified set
         BOOST_FOREACH(CTxMemPool::txiter desc, descendants) {
-            if (alreadyAdded.count(desc))
+            if (alreadyAdded.count(desc) || setTooNew.count(desc))
                 continue;
             ++nDescendantsUpdated;
             modtxiter mit = mapModifiedTx.find(desc);
@@ -385,10 +408,11 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
 // guaranteed to fail again, but as a belt-and-suspenders check we put it in
 // failedTx and avoid re-evaluation, since the re-evaluation would be using
 // cached size/sigops/fee values that are not actually correct.
+// SolarCoin: skip those too new for a PoST block as well.
 bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
 {
     assert (it != mempool.mapTx.end());
-    if (mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it))
+    if (mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it) || setTooNew.count(it))
         return true;
     return false;
 }
@@ -558,30 +582,35 @@ void BlockAssembler::addPriorityTxs()
     bool fSizeAccounting = fNeedSizeAccounting;
     fNeedSizeAccounting = true;
 
-    // This vector will be sorted into a priority queue:
+    // SolarCoin: The mempool's priority index is walked in order; this heap only holds the
+    // transactions queued again once the parents they waited for were added
     std::vector<TxCoinAgePriority> vecPriority;
     TxCoinAgePriorityCompare pricomparer;
     std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
     typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
     double actualPriority = -1;
 
-    vecPriority.reserve(mempool.mapTx.size());
-    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-         mi != mempool.mapTx.end(); ++mi)
-    {
-        double dPriority = mi->GetPriority(nHeight);
-        CAmount dummy;
-        mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-    }
-    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+    mempool.UpdatePriorityHeight(nHeight);
+    CTxMemPool::indexed_transaction_set::index<priority_score>::type::iterator mi = mempool.mapTx.get<priority_score>().begin();
+    const CTxMemPool::indexed_transaction_set::index<priority_score>::type::iterator miEnd = mempool.mapTx.get<priority_score>().end();
 
     CTxMemPool::txiter iter;
-    while (!vecPriority.empty() && !blockFinished) { // add a tx from priority queue to fill the blockprioritysize
-        iter = vecPriority.front().second;
-        actualPriority = vecPriority.front().first;
-        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-        vecPriority.pop_back();
+    while (!blockFinished) { // add a tx from priority queue to fill the blockprioritysize
+        if (mi != miEnd && (vecPriority.empty() ||
+                !pricomparer(TxCoinAgePriority(mi->GetPriorityScore(), mempool.mapTx.project<0>(mi)), vecPriority.front()))) {
+            iter = mempool.mapTx.project<0>(mi);
+            actualPriority = mi->GetPriorityScore();
+            ++mi;
+            if (setTooNew.count(iter))
+                continue;
+        } else if (!vecPriority.empty()) {
+            iter = vecPriority.front().second;
+            actualPriority = vecPriority.front().first;
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+            vecPriority.pop_back();
+        } else {
+            break;
+        }
 
         // If tx already in block, skip
         if (inBlock.count(iter)) {
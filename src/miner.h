@@ -152,10 +152,12 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    CTxMemPool::setEntries setTooNew; //!< SolarCoin: entries newer than the coinstake of a PoST template, with their descendants
 
     // Chain context for the block
     int nHeight;
     int64_t nLockTimeCutoff;
+    unsigned int nCoinStakeTime; //!< SolarCoin: timestamp of the coinstake of a PoST template, 0 for PoW
     const CChainParams& chainparams;
 
     // Variables used for addPriorityTxs
@@ -164,8 +166,13 @@ private:
 
 public:
     BlockAssembler(const CChainParams& chainparams);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
+    /** Construct a new block template with coinbase to scriptPubKeyIn.
+     *  SolarCoin: with nCoinStakeTimeIn set, a proof-of-stake template for a coinstake with that
+     *  timestamp is built instead: the coinbase pays nothing, the block takes the coinstake's time
+     *  and the PoST target, and only transactions not newer than the coinstake are included. The
+     *  caller inserts the coinstake at vtx[1], then adds the witness commitment and the merkle root
+     *  before signing the block. */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true, unsigned int nCoinStakeTimeIn=0);
 
 private:
     // utility functions
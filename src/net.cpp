@@ -16,7 +16,10 @@
 #include "crypto/common.h"
 #include "crypto/sha256.h"
 #include "hash.h"
+#include "memusage.h"
+#include "metrics.h"
 #include "primitives/transaction.h"
+#include "profile.h"
 #include "netbase.h"
 #include "scheduler.h"
 #include "ui_interface.h"
@@ -26,6 +29,13 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
 #endif
 
 #ifdef USE_UPNP
@@ -35,9 +45,12 @@
 #include <miniupnpc/upnperrors.h>
 #endif
 
-
+#include <algorithm>
+#include <future>
 #include <math.h>
 
+#include <boost/filesystem.hpp>
+
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
@@ -59,27 +72,72 @@
 #endif
 #endif
 
-const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
-
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
+/** SolarCoin: Pieces of a queued message, its header and payload segments, sent by one call */
+static const size_t SEND_GATHER_MAX = 64;
 //
 // Global state variables
 //
 bool fDiscover = true;
 bool fListen = true;
 bool fRelayTxes = true;
+bool fCaptureMessages = DEFAULT_CAPTURE_MESSAGES;
 CCriticalSection cs_mapLocalHost;
 std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 static bool vfLimited[NET_MAX] = {};
 std::string strSubVersion;
 
-limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
-
 // Signals for message handling
 static CNodeSignals g_signals;
 CNodeSignals& GetNodeSignals() { return g_signals; }
 
+void CaptureMessage(const CAddress& addr, const std::string& strCommand, const unsigned char* pbegin, const unsigned char* pend, bool fIncoming)
+{
+    static CCriticalSection cs_capture;
+    CCapturedMessage msg;
+    msg.nTimeMicros = GetTimeMicros();
+    msg.strCommand = strCommand;
+    msg.vData.assign(pbegin, pend);
+
+    std::string strAddr = addr.ToString();
+    std::replace(strAddr.begin(), strAddr.end(), ':', '_');
+    boost::filesystem::path pathCapture = GetDataDir() / "message_capture" / strAddr;
+    // One writer at a time, so the records of a file never interleave
+    LOCK(cs_capture);
+    try {
+        boost::filesystem::create_directories(pathCapture);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return;
+    }
+    CAutoFile file(fopen((pathCapture / (fIncoming ? "msgs_recv.dat" : "msgs_sent.dat")).string().c_str(), "ab"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return;
+    file << msg;
+}
+
+bool ReadMessageCapture(const boost::filesystem::path& path, std::vector<CCapturedMessage>& vMessages)
+{
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull() || fseek(file.Get(), 0, SEEK_END) != 0)
+        return false;
+    const long nFileSize = ftell(file.Get());
+    rewind(file.Get());
+    try {
+        while (ftell(file.Get()) < nFileSize) {
+            CCapturedMessage msg;
+            file >> msg;
+            vMessages.push_back(std::move(msg));
+        }
+    } catch (const std::exception& e) {
+        // A record cut short, by a crash while capturing
+        LogPrintf("%s: %s: %s\n", __func__, path.string(), e.what());
+        return false;
+    }
+    return true;
+}
+
 void CConnman::AddOneShot(const std::string& strDest)
 {
     LOCK(cs_vOneShots);
@@ -413,13 +471,25 @@ void CConnman::DumpBanlist()
 
     CBanDB bandb;
     banmap_t banmap;
-    SetBannedSetDirty(false);
-    GetBanned(banmap);
-    if (!bandb.Write(banmap))
-        SetBannedSetDirty(true);
+    std::vector<CBanJournalRecord> vChanges;
+    bool fSnapshot;
+    {
+        LOCK(cs_setBanned);
+        banmap = setBanned;
+        vChanges.swap(vBanChanges);
+        fSnapshot = fBanSnapshotNeeded;
+        setBannedIsDirty = false;
+        fBanSnapshotNeeded = false;
+    }
+    // SolarCoin: journal the changes unless the whole list was replaced
+    if (!(fSnapshot ? bandb.Write(banmap) : bandb.WriteChanges(banmap, vChanges))) {
+        LOCK(cs_setBanned);
+        setBannedIsDirty = true;
+        fBanSnapshotNeeded = true;
+    }
 
-    LogPrint("net", "Flushed %d banned node ips/subnets to banlist.dat  %dms\n",
-        banmap.size(), GetTimeMillis() - nStart);
+    LogPrint("net", "Flushed %d banned node ips/subnets (%d changes) to banlist  %dms\n",
+        banmap.size(), fSnapshot ? banmap.size() : vChanges.size(), GetTimeMillis() - nStart);
 }
 
 void CNode::CloseSocketDisconnect()
@@ -439,6 +509,7 @@ void CConnman::ClearBanned()
         LOCK(cs_setBanned);
         setBanned.clear();
         setBannedIsDirty = true;
+        fBanSnapshotNeeded = true;
     }
     DumpBanlist(); //store banlist to disk
     if(clientInterface)
@@ -498,6 +569,7 @@ void CConnman::Ban(const CSubNet& subNet, const BanReason &banReason, int64_t ba
         if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
             setBanned[subNet] = banEntry;
             setBannedIsDirty = true;
+            vBanChanges.push_back(CBanJournalRecord(subNet, banEntry));
         }
         else
             return;
@@ -526,6 +598,7 @@ bool CConnman::Unban(const CSubNet &subNet) {
         if (!setBanned.erase(subNet))
             return false;
         setBannedIsDirty = true;
+        vBanChanges.push_back(CBanJournalRecord(subNet, CBanEntry()));
     }
     if(clientInterface)
         clientInterface->BannedListChanged();
@@ -544,6 +617,8 @@ void CConnman::SetBanned(const banmap_t &banMap)
     LOCK(cs_setBanned);
     setBanned = banMap;
     setBannedIsDirty = true;
+    vBanChanges.clear();
+    fBanSnapshotNeeded = true;
 }
 
 void CConnman::SweepBanned()
@@ -560,6 +635,7 @@ void CConnman::SweepBanned()
         {
             setBanned.erase(it++);
             setBannedIsDirty = true;
+            vBanChanges.push_back(CBanJournalRecord(subNet, CBanEntry()));
             LogPrint("net", "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
         }
         else
@@ -577,6 +653,9 @@ void CConnman::SetBannedSetDirty(bool dirty)
 {
     LOCK(cs_setBanned); //reuse setBanned lock for the isDirty flag
     setBannedIsDirty = dirty;
+    // SolarCoin: either the files hold everything, or what changed is unknown
+    vBanChanges.clear();
+    fBanSnapshotNeeded = dirty;
 }
 
 
@@ -644,17 +723,27 @@ void CNode::copyStats(CNodeStats &stats)
     }
     X(fInbound);
     X(fAddnode);
+    X(fBlockRelayOnly);
     X(nStartingHeight);
     {
         LOCK(cs_vSend);
-        X(mapSendBytesPerMsgCmd);
         X(nSendBytes);
+        stats.nSendQueueMsgs = 0;
+        for (int nLane = 0; nLane < SEND_LANE_COUNT; nLane++)
+            stats.nSendQueueMsgs += vSendMsg[nLane].size();
+        stats.nSendQueueBytes = nSendSize;
     }
     {
         LOCK(cs_vRecv);
-        X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_vProcessMsg);
+        stats.nProcessQueueMsgs = vProcessMsg.size();
+        stats.nProcessQueueBytes = nProcessQueueSize;
+    }
+    stats.vMsgTypeStats.assign(NUM_NET_MESSAGE_TYPES + 1, CNetMsgTypeStats());
+    msgCounters.AddTo(stats.vMsgTypeStats);
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -681,6 +770,7 @@ void CNode::copyStats(CNodeStats &stats)
 
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete)
 {
+    PROFILE_SCOPE("ReceiveMsgBytes");
     complete = false;
     int64_t nTimeMicros = GetTimeMicros();
     LOCK(cs_vRecv);
@@ -691,7 +781,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -714,16 +804,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         nBytes -= handled;
 
         if (msg.complete()) {
-
-            //store received bytes per message command
-            //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
-            if (i == mapRecvBytesPerMsgCmd.end())
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
-
-            msg.nTime = nTimeMicros;
+            RecordMessageComplete(msg, nTimeMicros);
             complete = true;
         }
     }
@@ -731,6 +812,45 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::RecordMessageComplete(CNetMessage& msg, int64_t nTimeMicros)
+{
+    //store received bytes per message command, invalid commands are counted together
+    msg.nMsgType = GetNetMessageTypeIndex(msg.hdr.GetCommand());
+    msgCounters.RecordRecv(msg.nMsgType, msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
+
+    msg.nTime = nTimeMicros;
+}
+
+/** SolarCoin: Payloads shorter than this are copied out of the socket thread's buffer instead. */
+static const unsigned int RECV_IN_PLACE_MIN_SIZE = 0x10000;
+
+char* CNode::GetReceiveBuffer(unsigned int& nSize)
+{
+    // Only the socket handler thread changes vRecvMsg; GetNodeMemoryUsage() reads it under cs_vRecv
+    LOCK(cs_vRecv);
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data || vRecvMsg.back().complete())
+        return NULL;
+    CNetMessage& msg = vRecvMsg.back();
+    if (msg.hdr.nMessageSize - msg.nDataPos < RECV_IN_PLACE_MIN_SIZE)
+        return NULL;
+    return msg.GetDataBuffer(nSize);
+}
+
+void CNode::ReceiveMsgBytesInPlace(unsigned int nBytes, bool& complete)
+{
+    complete = false;
+    int64_t nTimeMicros = GetTimeMicros();
+    LOCK(cs_vRecv);
+    nLastRecv = nTimeMicros / 1000000;
+    nRecvBytes += nBytes;
+    CNetMessage& msg = vRecvMsg.back();
+    msg.readDataInPlace(nBytes);
+    if (msg.complete()) {
+        RecordMessageComplete(msg, nTimeMicros);
+        complete = true;
+    }
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -758,27 +878,45 @@ int CNode::GetSendVersion() const
 }
 
 
+/**
+ * SolarCoin: Payload buffers of processed messages, so large messages reuse memory that is
+ * already mapped instead of allocating it and clearing it again on free every time.
+ */
+static const size_t RECV_BUFFER_POOL_SIZE = 8;
+static const size_t RECV_BUFFER_POOL_MIN_SIZE = 0x10000;
+static const size_t RECV_BUFFER_POOL_MAX_SIZE = 1000000;
+static std::mutex cs_vRecvBufferPool;
+static std::vector<CDataStream> vRecvBufferPool;
+
+void CNetMessage::ParseHeader(const char *pch)
+{
+    // The fields are fixed size, so they are taken from the received bytes directly
+    memcpy(hdr.pchMessageStart, pch, CMessageHeader::MESSAGE_START_SIZE);
+    memcpy(hdr.pchCommand, pch + CMessageHeader::MESSAGE_START_SIZE, CMessageHeader::COMMAND_SIZE);
+    hdr.nMessageSize = ReadLE32((const unsigned char*)pch + CMessageHeader::MESSAGE_SIZE_OFFSET);
+    memcpy(hdr.pchChecksum, pch + CMessageHeader::CHECKSUM_OFFSET, CMessageHeader::CHECKSUM_SIZE);
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
-    // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
+    unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+    if (nHdrPos == 0 && nCopy == CMessageHeader::HEADER_SIZE) {
+        // the whole header is in this read
+        ParseHeader(pch);
+    } else {
+        // copy data to temporary parsing buffer
+        memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+        if (nHdrPos + nCopy == CMessageHeader::HEADER_SIZE)
+            ParseHeader(hdrbuf);
+    }
     nHdrPos += nCopy;
 
     // if header incomplete, exit
-    if (nHdrPos < 24)
+    if (nHdrPos < CMessageHeader::HEADER_SIZE)
         return nCopy;
 
-    // deserialize to CMessageHeader
-    try {
-        hdrbuf >> hdr;
-    }
-    catch (const std::exception&) {
-        return -1;
-    }
-
     // reject messages larger than MAX_SIZE
     if (hdr.nMessageSize > MAX_SIZE)
             return -1;
@@ -786,18 +924,34 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    if (hdr.nMessageSize >= RECV_BUFFER_POOL_MIN_SIZE) {
+        std::lock_guard<std::mutex> lock(cs_vRecvBufferPool);
+        if (!vRecvBufferPool.empty()) {
+            int nType = vRecv.GetType(), nVersion = vRecv.GetVersion();
+            vRecv = std::move(vRecvBufferPool.back());
+            vRecvBufferPool.pop_back();
+            vRecv.SetType(nType);
+            vRecv.SetVersion(nVersion);
+        }
+    }
+
     return nCopy;
 }
 
+void CNetMessage::ExpandData(unsigned int nBytes)
+{
+    if (vRecv.size() < nDataPos + nBytes) {
+        // Allocate up to 256 KiB ahead, but never more than the total message size.
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nBytes + 256 * 1024));
+    }
+}
+
 int CNetMessage::readData(const char *pch, unsigned int nBytes)
 {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
+    ExpandData(nCopy);
 
     hasher.Write((const unsigned char*)pch, nCopy);
     memcpy(&vRecv[nDataPos], pch, nCopy);
@@ -806,6 +960,31 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
+char* CNetMessage::GetDataBuffer(unsigned int& nSize)
+{
+    // Make room for at least a socket buffer's worth, so the reads stay large
+    ExpandData(std::min(hdr.nMessageSize - nDataPos, RECV_IN_PLACE_MIN_SIZE));
+    nSize = vRecv.size() - nDataPos;
+    return &vRecv[nDataPos];
+}
+
+void CNetMessage::readDataInPlace(unsigned int nBytes)
+{
+    assert(nDataPos + nBytes <= vRecv.size());
+    hasher.Write((const unsigned char*)&vRecv[nDataPos], nBytes);
+    nDataPos += nBytes;
+}
+
+void CNetMessage::ReleaseBuffer()
+{
+    vRecv.clear();
+    if (vRecv.capacity() < RECV_BUFFER_POOL_MIN_SIZE || vRecv.capacity() > RECV_BUFFER_POOL_MAX_SIZE)
+        return;
+    std::lock_guard<std::mutex> lock(cs_vRecvBufferPool);
+    if (vRecvBufferPool.size() < RECV_BUFFER_POOL_SIZE)
+        vRecvBufferPool.push_back(std::move(vRecv));
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -822,33 +1001,137 @@ const uint256& CNetMessage::GetMessageHash() const
 
 
 
+SendLane GetSendLane(size_t nMsgType)
+{
+    static const std::vector<SendLane> vLanes = [] {
+        // unknown commands, the last index, are sent as control messages
+        std::vector<SendLane> vLanes(NUM_NET_MESSAGE_TYPES + 1, SEND_LANE_CONTROL);
+        for (size_t nType = 0; nType < NUM_NET_MESSAGE_TYPES; nType++) {
+            const std::string& strType = GetNetMessageTypeName(nType);
+            if (strType == NetMsgType::BLOCK || strType == NetMsgType::CMPCTBLOCK ||
+                    strType == NetMsgType::BLOCKTXN || strType == NetMsgType::MERKLEBLOCK)
+                vLanes[nType] = SEND_LANE_BLOCK;
+            else if (strType == NetMsgType::TX || strType == NetMsgType::INV || strType == NetMsgType::NOTFOUND)
+                vLanes[nType] = SEND_LANE_TX;
+            else if (strType == NetMsgType::ADDR || strType == NetMsgType::GETADDR)
+                vLanes[nType] = SEND_LANE_ADDR;
+        }
+        return vLanes;
+    }();
+    return vLanes[nMsgType];
+}
+
+// requires LOCK(cs_vSend)
+int64_t CConnman::GetSendBudget(CNode *pnode, int nLane, int64_t nNow) const
+{
+    // SolarCoin: control messages always go, though they do use up the peer's tokens
+    if (nLane == SEND_LANE_CONTROL)
+        return std::numeric_limits<int64_t>::max();
+    int64_t nBudget = pnode->sendBucket.Available(nNow);
+    LOCK(cs_sendBuckets);
+    return std::min(nBudget, vSendBuckets[nLane].Available(nNow));
+}
+
+// requires LOCK(cs_vSend)
+int CConnman::GetSendableLane(CNode *pnode, int64_t nNow) const
+{
+    // SolarCoin: a message that was started is finished first, then the highest lane with tokens goes
+    if (pnode->nSendOffset != 0)
+        return GetSendBudget(pnode, pnode->nSendLane, nNow) > 0 ? pnode->nSendLane : SEND_LANE_COUNT;
+    for (int nLane = 0; nLane < SEND_LANE_COUNT; nLane++) {
+        if (!pnode->vSendMsg[nLane].empty() && GetSendBudget(pnode, nLane, nNow) > 0)
+            return nLane;
+    }
+    return SEND_LANE_COUNT;
+}
+
+/**
+ * SolarCoin: Send up to nLen bytes of msg from nOffset: the rest of the header and the segments of
+ * the payload, gathered by a single sendmsg() rather than first copied together. Windows sends the
+ * piece nOffset is in, as SocketSendData() comes back for the rest.
+ */
+static int SendQueuedMessage(SOCKET hSocket, const CQueuedNetMsg& msg, size_t nOffset, size_t nLen)
+{
+    const unsigned char* vpch[SEND_GATHER_MAX];
+    size_t vnLen[SEND_GATHER_MAX];
+    size_t nPieces = 0;
+    if (nOffset < msg.header.size()) {
+        vpch[nPieces] = msg.header.data() + nOffset;
+        vnLen[nPieces++] = std::min(nLen, msg.header.size() - nOffset);
+        nLen -= vnLen[0];
+        nOffset = 0;
+    } else {
+        nOffset -= msg.header.size();
+    }
+    if (nLen) {
+        size_t nSegment, nSegmentOffset;
+        msg.data.Find(nOffset, nSegment, nSegmentOffset);
+        for (; nLen && nPieces < SEND_GATHER_MAX && nSegment < msg.data.GetSegmentCount(); nSegment++, nSegmentOffset = 0) {
+            const CSegmentedBuffer::Segment& segment = msg.data.GetSegment(nSegment);
+            vpch[nPieces] = segment.data() + nSegmentOffset;
+            vnLen[nPieces] = std::min(nLen, segment.size() - nSegmentOffset);
+            nLen -= vnLen[nPieces++];
+        }
+    }
+#ifdef WIN32
+    return send(hSocket, reinterpret_cast<const char*>(vpch[0]), vnLen[0], MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    struct iovec vIov[SEND_GATHER_MAX];
+    for (size_t n = 0; n < nPieces; n++) {
+        vIov[n].iov_base = const_cast<unsigned char*>(vpch[n]);
+        vIov[n].iov_len = vnLen[n];
+    }
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = vIov;
+    header.msg_iovlen = nPieces;
+    return sendmsg(hSocket, &header, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode) const
 {
-    auto it = pnode->vSendMsg.begin();
+    PROFILE_SCOPE("SocketSendData");
     size_t nSentSize = 0;
-
-    while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+    const int64_t nNow = GetTimeMicros();
+
+    pnode->fSendThrottled = false;
+    while (pnode->nSendSize) {
+        const int nLane = GetSendableLane(pnode, nNow);
+        if (nLane == SEND_LANE_COUNT) {
+            // SolarCoin: out of tokens; the rest waits in the queue until the buckets refill
+            pnode->fSendThrottled = true;
+            break;
+        }
+        pnode->nSendLane = nLane;
+        std::deque<CQueuedNetMsg>& queue = pnode->vSendMsg[nLane];
+        const CQueuedNetMsg& msg = queue.front();
+        assert(msg.size() > pnode->nSendOffset);
+        const size_t nSendLen = std::min<int64_t>(msg.size() - pnode->nSendOffset, GetSendBudget(pnode, nLane, nNow));
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SendQueuedMessage(pnode->hSocket, msg, pnode->nSendOffset, nSendLen);
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            pnode->sendBucket.Consume(nBytes);
+            if (nLane != SEND_LANE_CONTROL) {
+                LOCK(cs_sendBuckets);
+                vSendBuckets[nLane].Consume(nBytes);
+            }
+            if (pnode->nSendOffset == msg.size()) {
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= msg.size();
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
+                queue.pop_front();
+            } else if ((size_t)nBytes < nSendLen) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -867,11 +1150,9 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->nSendSize == 0) {
         assert(pnode->nSendOffset == 0);
-        assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1027,7 +1308,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
     CAddress addr;
     int nInbound = 0;
-    int nMaxInbound = nMaxConnections - (nMaxOutbound + nMaxFeeler);
+    int nMaxInbound = nMaxConnections - (nMaxOutbound + nMaxFeeler + nMaxBlockRelayOnly);
 
     if (hSocket != INVALID_SOCKET)
         if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
@@ -1094,6 +1375,11 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     CNode* pnode = new CNode(id, nLocalServices, GetBestHeight(), hSocket, addr, CalculateKeyedNetGroup(addr), nonce, "", true);
     pnode->AddRef();
     pnode->fWhitelisted = whitelisted;
+    // SolarCoin: whitelisted peers are not held to the per-peer rates
+    if (!whitelisted) {
+        pnode->sendBucket.SetRate(nPeerSendRate);
+        pnode->recvBucket.SetRate(nPeerRecvRate);
+    }
     GetNodeSignals().InitializeNode(pnode, *this);
 
     LogPrint("net", "connection from %s accepted\n", addr.ToString());
@@ -1104,6 +1390,271 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+/** How long the socket thread waits for events before it checks for disconnects and timeouts */
+static const int SOCKET_EVENTS_TIMEOUT_MS = 50; // frequency to poll pnode->vSend
+#ifdef USE_SOCKET_EVENTS
+/** SolarCoin: Events taken from the queue per wait; the rest are left for the next one */
+static const int MAX_SOCKET_EVENTS = 256;
+#endif
+
+void CConnman::GenerateSocketSets(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        recv_set.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+            // * SolarCoin: A peer that is out of send or receive tokens is left out
+            //   until the buckets refill, at the latest in a later round of this loop.
+
+            const int64_t nNow = GetTimeMicros();
+            bool select_recv = !pnode->fPauseRecv && pnode->recvBucket.Available(nNow) > 0;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = pnode->nSendSize != 0 && GetSendableLane(pnode, nNow) != SEND_LANE_COUNT;
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+#ifdef USE_SOCKET_EVENTS
+            if (!pnode->fSocketEventsRegistered) {
+                // The descriptor may have belonged to a closed socket, whose readiness is stale
+                setSocketsReadable.erase(pnode->hSocket);
+                setSocketsWritable.erase(pnode->hSocket);
+#ifdef USE_EPOLL
+                struct epoll_event event = {};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.fd = pnode->hSocket;
+                if (epoll_ctl(hSocketEvents, EPOLL_CTL_ADD, pnode->hSocket, &event) == SOCKET_ERROR)
+#else
+                struct kevent events[2];
+                EV_SET(&events[0], pnode->hSocket, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, NULL);
+                EV_SET(&events[1], pnode->hSocket, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, NULL);
+                if (kevent(hSocketEvents, events, 2, NULL, 0, NULL) == SOCKET_ERROR)
+#endif
+                {
+                    LogPrintf("socket event registration failed for peer=%d: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+                    pnode->fDisconnect = true;
+                    continue;
+                }
+                pnode->fSocketEventsRegistered = true;
+            }
+#endif
+
+            error_set.insert(pnode->hSocket);
+            if (select_send) {
+                send_set.insert(pnode->hSocket);
+                continue;
+            }
+            if (select_recv) {
+                recv_set.insert(pnode->hSocket);
+            }
+        }
+    }
+}
+
+#ifdef USE_SOCKET_EVENTS
+bool CConnman::InitSocketEvents(std::string& strError)
+{
+#ifdef USE_EPOLL
+    hSocketEvents = epoll_create1(EPOLL_CLOEXEC);
+#else
+    hSocketEvents = kqueue();
+#endif
+    if (hSocketEvents == -1) {
+        strError = strprintf(_("Unable to create the socket event queue: %s"), NetworkErrorString(WSAGetLastError()));
+        LogPrintf("%s\n", strError);
+        return false;
+    }
+    // Listening sockets are watched level-triggered: AcceptConnection() takes one connection per round
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+#ifdef USE_EPOLL
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket.socket;
+        if (epoll_ctl(hSocketEvents, EPOLL_CTL_ADD, hListenSocket.socket, &event) == SOCKET_ERROR)
+#else
+        struct kevent event;
+        EV_SET(&event, hListenSocket.socket, EVFILT_READ, EV_ADD, 0, 0, NULL);
+        if (kevent(hSocketEvents, &event, 1, NULL, 0, NULL) == SOCKET_ERROR)
+#endif
+        {
+            strError = strprintf(_("Unable to watch a listening socket: %s"), NetworkErrorString(WSAGetLastError()));
+            LogPrintf("%s\n", strError);
+            return false;
+        }
+    }
+    LogPrintf("Using %s for socket events\n",
+#ifdef USE_EPOLL
+        "epoll"
+#else
+        "kqueue"
+#endif
+    );
+    return true;
+}
+
+/**
+ * SolarCoin: Wait on the epoll or kqueue descriptor. Only sockets that became ready are returned by
+ * the kernel, so the cost no longer grows with the number of connections, and there is no
+ * FD_SETSIZE limit. Readiness that was not used up in an earlier round is served without waiting.
+ */
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    GenerateSocketSets(recv_select_set, send_select_set, error_select_set);
+
+    bool fPending = false;
+    for (SOCKET hSocket : recv_select_set)
+        fPending |= setSocketsReadable.count(hSocket) > 0;
+    for (SOCKET hSocket : send_select_set)
+        fPending |= setSocketsWritable.count(hSocket) > 0;
+
+    int nTimeout = fPending ? 0 : SOCKET_EVENTS_TIMEOUT_MS;
+#ifdef USE_EPOLL
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(hSocketEvents, events, MAX_SOCKET_EVENTS, nTimeout);
+#else
+    struct kevent events[MAX_SOCKET_EVENTS];
+    struct timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = nTimeout * 1000000L;
+    int nEvents = kevent(hSocketEvents, NULL, 0, events, MAX_SOCKET_EVENTS, &timeout);
+#endif
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket event wait error %s\n", NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS)))
+                return;
+        }
+        nEvents = 0;
+    }
+
+    std::set<SOCKET> listen_recv_set;
+    for (int i = 0; i < nEvents; i++) {
+#ifdef USE_EPOLL
+        SOCKET hSocket = events[i].data.fd;
+        bool fRecv = events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+        bool fSend = events[i].events & EPOLLOUT;
+        bool fError = events[i].events & (EPOLLHUP | EPOLLERR);
+#else
+        SOCKET hSocket = events[i].ident;
+        bool fRecv = events[i].filter == EVFILT_READ || (events[i].flags & (EV_EOF | EV_ERROR));
+        bool fSend = events[i].filter == EVFILT_WRITE;
+        bool fError = events[i].flags & (EV_EOF | EV_ERROR);
+#endif
+        if (std::any_of(vhListenSocket.begin(), vhListenSocket.end(), [hSocket](const ListenSocket& s) { return s.socket == hSocket; })) {
+            // Listening sockets are level-triggered and report again until accepted
+            listen_recv_set.insert(hSocket);
+            continue;
+        }
+        if (fRecv)
+            setSocketsReadable.insert(hSocket);
+        if (fSend)
+            setSocketsWritable.insert(hSocket);
+        if (fError && error_select_set.count(hSocket))
+            error_set.insert(hSocket);
+    }
+
+    for (SOCKET hSocket : recv_select_set) {
+        if (setSocketsReadable.count(hSocket) || listen_recv_set.count(hSocket))
+            recv_set.insert(hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        if (setSocketsWritable.count(hSocket))
+            send_set.insert(hSocket);
+    }
+}
+#else
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    GenerateSocketSets(recv_select_set, send_select_set, error_select_set);
+
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_EVENTS_TIMEOUT_MS * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (SOCKET hSocket : recv_select_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        have_fds = true;
+    }
+    for (SOCKET hSocket : send_select_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        have_fds = true;
+    }
+    for (SOCKET hSocket : error_select_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        have_fds = true;
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS)))
+            return;
+    }
+
+    for (SOCKET hSocket : recv_select_set) {
+        if (FD_ISSET(hSocket, &fdsetRecv))
+            recv_set.insert(hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        // After a select error every socket is tried for receiving, as before
+        if (FD_ISSET(hSocket, &fdsetRecv))
+            recv_set.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetError))
+            error_set.insert(hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        if (FD_ISSET(hSocket, &fdsetSend))
+            send_set.insert(hSocket);
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1160,10 +1711,15 @@ void CConnman::ThreadSocketHandler()
             }
         }
         size_t vNodesSize;
+        int nInbound = 0;
         {
             LOCK(cs_vNodes);
             vNodesSize = vNodes.size();
+            for (const CNode* pnode : vNodes)
+                nInbound += pnode->fInbound;
         }
+        SetMetric(METRIC_PEERS, vNodesSize);
+        SetMetric(METRIC_PEERS_INBOUND, nInbound);
         if(vNodesSize != nPrevNodeCount) {
             nPrevNodeCount = vNodesSize;
             if(clientInterface)
@@ -1173,91 +1729,17 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::set<SOCKET> recv_set, send_set, error_set;
+        SocketEvents(recv_set, send_set, error_set);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket) > 0)
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1284,31 +1766,51 @@ void CConnman::ThreadSocketHandler()
             bool recvSet = false;
             bool sendSet = false;
             bool errorSet = false;
+            SOCKET hSocket;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                hSocket = pnode->hSocket;
+                recvSet = recv_set.count(hSocket) > 0;
+                sendSet = send_set.count(hSocket) > 0;
+                errorSet = error_set.count(hSocket) > 0;
             }
-            if (recvSet || errorSet)
+            // SolarCoin: a peer out of receive tokens is read again once they refill
+            const int64_t nRecvBudget = pnode->recvBucket.Available(GetTimeMicros());
+            if ((recvSet || errorSet) && nRecvBudget > 0)
             {
                 {
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
+                        // SolarCoin: the rest of a large payload is read straight into its message
+                        unsigned int nBufSize = sizeof(pchBuf);
+                        char* pchRecv = pnode->GetReceiveBuffer(nBufSize);
+                        if (pchRecv == NULL) {
+                            pchRecv = pchBuf;
+                            nBufSize = sizeof(pchBuf);
+                        }
+                        nBufSize = std::min<int64_t>(nBufSize, nRecvBudget);
                         int nBytes = 0;
                         {
                             LOCK(pnode->cs_hSocket);
                             if (pnode->hSocket == INVALID_SOCKET)
                                 continue;
-                            nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                            nBytes = recv(pnode->hSocket, pchRecv, nBufSize, MSG_DONTWAIT);
                         }
+#ifdef USE_SOCKET_EVENTS
+                        // A short read drained the socket: the next data to arrive raises a new edge
+                        if (nBytes < (int)nBufSize)
+                            setSocketsReadable.erase(hSocket);
+#endif
                         if (nBytes > 0)
                         {
+                            pnode->recvBucket.Consume(nBytes);
                             bool notify = false;
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+                            if (pchRecv != pchBuf)
+                                pnode->ReceiveMsgBytesInPlace(nBytes, notify);
+                            else if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
                                 pnode->CloseSocketDisconnect();
                             RecordBytesRecv(nBytes);
                             if (notify) {
@@ -1325,7 +1827,7 @@ void CConnman::ThreadSocketHandler()
                                     pnode->nProcessQueueSize += nSizeAdded;
                                     pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                                 }
-                                WakeMessageHandler();
+                                WakeMessageHandler(pnode->GetId());
                             }
                         }
                         else if (nBytes == 0)
@@ -1360,6 +1862,12 @@ void CConnman::ThreadSocketHandler()
                 if (nBytes) {
                     RecordBytesSent(nBytes);
                 }
+#ifdef USE_SOCKET_EVENTS
+                // Data left over means the send buffer filled up, which raises a new edge once it drains,
+                // unless the peer merely ran out of tokens
+                if (pnode->nSendSize != 0 && !pnode->fSendThrottled)
+                    setSocketsWritable.erase(hSocket);
+#endif
             }
 
             //
@@ -1407,9 +1915,18 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        vfMsgProcWake.assign(vfMsgProcWake.size(), true);
+    }
+    condMsgProc.notify_all();
+}
+
+void CConnman::WakeMessageHandler(NodeId id)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        vfMsgProcWake[GetMessageHandlerWorker(id)] = true;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -1578,40 +2095,60 @@ void CConnman::ThreadDNSAddressSeed()
 
     LogPrintf("Loading addresses from DNS seeds (could take a while)\n");
 
+    // SolarCoin: all seeds are resolved at the same time, and the addresses of each go to addrman
+    // as soon as it answers, so a slow or dead seed does not hold up the others
+    struct SeedResult
+    {
+        std::vector<CAddress> vAdd;
+        CService seedSource;
+    };
+    std::vector<std::future<SeedResult> > vLookups;
     BOOST_FOREACH(const CDNSSeedData &seed, vSeeds) {
-        if (interruptNet) {
-            return;
-        }
         if (HaveNameProxy()) {
             AddOneShot(seed.host);
-        } else {
+            continue;
+        }
+        ServiceFlags requiredServiceBits = nRelevantServices;
+        std::string strHost = GetDNSHost(seed, &requiredServiceBits);
+        std::string strName = seed.name;
+        vLookups.push_back(std::async(std::launch::async, [strHost, strName, requiredServiceBits] {
+            SeedResult result;
             std::vector<CNetAddr> vIPs;
-            std::vector<CAddress> vAdd;
-            ServiceFlags requiredServiceBits = nRelevantServices;
-            if (LookupHost(GetDNSHost(seed, &requiredServiceBits).c_str(), vIPs, 0, true))
+            if (LookupHost(strHost.c_str(), vIPs, 0, true))
             {
                 BOOST_FOREACH(const CNetAddr& ip, vIPs)
                 {
                     int nOneDay = 24*3600;
                     CAddress addr = CAddress(CService(ip, Params().GetDefaultPort()), requiredServiceBits);
                     addr.nTime = GetTime() - 3*nOneDay - GetRand(4*nOneDay); // use a random age between 3 and 7 days old
-                    vAdd.push_back(addr);
-                    found++;
+                    result.vAdd.push_back(addr);
                 }
             }
-            if (interruptNet) {
-                return;
-            }
             // TODO: The seed name resolve may fail, yielding an IP of [::], which results in
             // addrman assigning the same source to results from different seeds.
             // This should switch to a hard-coded stable dummy IP for each seed name, so that the
             // resolve is not required at all.
-            if (!vIPs.empty()) {
-                CService seedSource;
-                Lookup(seed.name.c_str(), seedSource, 0, true);
-                addrman.Add(vAdd, seedSource);
+            if (!result.vAdd.empty())
+                Lookup(strName.c_str(), result.seedSource, 0, true);
+            return result;
+        }));
+    }
+
+    size_t nPending = vLookups.size();
+    while (nPending > 0) {
+        for (std::future<SeedResult>& lookup : vLookups) {
+            if (!lookup.valid() || lookup.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+                continue;
+            SeedResult result = lookup.get();
+            nPending--;
+            if (!result.vAdd.empty()) {
+                addrman.Add(result.vAdd, result.seedSource);
+                found += result.vAdd.size();
             }
         }
+        // The lookups that are still running are waited for on return, as getaddrinfo cannot be cancelled
+        if (nPending > 0 && !interruptNet.sleep_for(std::chrono::milliseconds(100)))
+            return;
     }
 
     LogPrintf("%d addresses found from DNS seeds\n", found);
@@ -1632,8 +2169,9 @@ void CConnman::DumpAddresses()
 {
     int64_t nStart = GetTimeMillis();
 
+    // SolarCoin: the changed addresses are journaled, with a snapshot now and then
     CAddrDB adb;
-    adb.Write(addrman);
+    adb.WriteChanges(addrman);
 
     LogPrint("net", "Flushed %d addresses to peers.dat  %dms\n",
            addrman.size(), GetTimeMillis() - nStart);
@@ -1645,6 +2183,32 @@ void CConnman::DumpData()
     DumpBanlist();
 }
 
+void CConnman::DumpAnchors()
+{
+    // SolarCoin: the full outbound peers that relayed a new block most recently, which are the
+    // ones that keep up with the tip and serve it quickly
+    std::vector<std::pair<int64_t, CAddress> > vCandidates;
+    {
+        LOCK(cs_vNodes);
+        for (const CNode* pnode : vNodes) {
+            if (pnode->fInbound || pnode->fFeeler || pnode->fOneShot || pnode->fAddnode || pnode->fBlockRelayOnly ||
+                    !pnode->fSuccessfullyConnected || pnode->nLastBlockTime == 0)
+                continue;
+            vCandidates.push_back(std::make_pair(pnode->nLastBlockTime.load(), pnode->addr));
+        }
+    }
+    std::sort(vCandidates.begin(), vCandidates.end(), [](const std::pair<int64_t, CAddress>& a, const std::pair<int64_t, CAddress>& b) {
+        return a.first > b.first;
+    });
+    std::vector<CAddress> vAnchorsOut;
+    for (size_t i = 0; i < vCandidates.size() && i < (size_t)MAX_ANCHORS; i++)
+        vAnchorsOut.push_back(vCandidates[i].second);
+
+    CAnchorsDB anchorsdb;
+    if (anchorsdb.Write(vAnchorsOut))
+        LogPrint("net", "Flushed %d anchor peers to anchors.dat\n", vAnchorsOut.size());
+}
+
 void CConnman::ProcessOneShot()
 {
     std::string strDest;
@@ -1690,7 +2254,7 @@ int CConnman::GetExtraOutboundCount()
         LOCK(cs_vNodes);
         for (CNode* pnode : vNodes) {
             //if (!pnode->fInbound && !pnode->m_manual_connection && !pnode->fFeeler && !pnode->fDisconnect && !pnode->fOneShot && pnode->fSuccessfullyConnected) {
-            if (!pnode->fInbound && !pnode->fFeeler && !pnode->fDisconnect && !pnode->fOneShot && pnode->fSuccessfullyConnected) {
+            if (!pnode->fInbound && !pnode->fFeeler && !pnode->fBlockRelayOnly && !pnode->fDisconnect && !pnode->fOneShot && pnode->fSuccessfullyConnected) {
                 ++nOutbound;
             }
         }
@@ -1721,17 +2285,39 @@ void CConnman::ThreadOpenConnections()
         }
     }
 
+    // SolarCoin: the anchors from before the restart are tried first, all at once
+    for (const CAddress& addr : vAnchors) {
+        if (interruptNet)
+            return;
+        if (!addr.IsValid() || IsLocal(addr) || IsLimited(addr))
+            continue;
+        CSemaphoreGrant grant(*semOutbound, true);
+        if (!grant)
+            break;
+        LogPrint("net", "Reconnecting to anchor peer %s\n", addr.ToString());
+        QueueConnectAttempt(addr, false, grant, false, false);
+    }
+    vAnchors.clear();
+
     // Initiate network connections
     int64_t nStart = GetTime();
 
     // Minimum time before next feeler connection (in microseconds).
     int64_t nNextFeeler = PoissonNextSend(nStart*1000*1000, FEELER_INTERVAL);
+    bool fStartedAttempt = false;
     while (!interruptNet)
     {
         ProcessOneShot();
 
-        if (!interruptNet.sleep_for(std::chrono::milliseconds(500)))
+        // SolarCoin: while attempts are being handed off the next one is chosen right away,
+        // as soon as one of MAX_CONNECT_ATTEMPTS is free
+        if (!fStartedAttempt && !interruptNet.sleep_for(std::chrono::milliseconds(500)))
             return;
+        fStartedAttempt = false;
+        {
+            std::unique_lock<std::mutex> lock(mutexConnectAttempts);
+            condConnectAttempts.wait(lock, [this] { return interruptNet || listConnectAttempts.size() < (size_t)MAX_CONNECT_ATTEMPTS; });
+        }
 
         CSemaphoreGrant grant(*semOutbound);
         if (interruptNet)
@@ -1758,6 +2344,7 @@ void CConnman::ThreadOpenConnections()
         // Do this here so we don't have to critsect vNodes inside mapAddresses critsect.
         int nOutbound = 0;
         int nOutboundRelevant = 0;
+        int nBlockRelayOnly = 0;
         std::set<std::vector<unsigned char> > setConnected;
         {
             LOCK(cs_vNodes);
@@ -1774,10 +2361,26 @@ void CConnman::ThreadOpenConnections()
                     // also have the added issue that they're attacker controlled and could be used
                     // to prevent us from connecting to particular hosts if we used them here.
                     setConnected.insert(pnode->addr.GetGroup());
-                    nOutbound++;
+                    // SolarCoin: block-relay-only connections have slots of their own
+                    if (pnode->fBlockRelayOnly)
+                        nBlockRelayOnly++;
+                    else
+                        nOutbound++;
                 }
             }
         }
+        // SolarCoin: the attempts in flight count as the connections they may become
+        std::set<std::vector<unsigned char> > setConnecting;
+        {
+            std::lock_guard<std::mutex> lock(mutexConnectAttempts);
+            for (const ConnectAttempt& attempt : listConnectAttempts) {
+                setConnecting.insert(attempt.addr.GetGroup());
+                if (attempt.fBlockRelayOnly)
+                    nBlockRelayOnly++;
+                else if (!attempt.fFeeler)
+                    nOutbound++;
+            }
+        }
 
         // Feeler Connections
         //
@@ -1792,7 +2395,10 @@ void CConnman::ThreadOpenConnections()
         //  * Only make a feeler connection once every few minutes.
         //
         bool fFeeler = false;
-        if (nOutbound >= nMaxOutbound) {
+        bool fBlockRelayOnly = false;
+        if (nOutbound >= nMaxOutbound && nBlockRelayOnly < nMaxBlockRelayOnly) {
+            fBlockRelayOnly = true;
+        } else if (nOutbound >= nMaxOutbound) {
             int64_t nTime = GetTimeMicros(); // The current time right now (in microseconds).
             if (nTime > nNextFeeler) {
                 nNextFeeler = PoissonNextSend(nTime, FEELER_INTERVAL);
@@ -1809,7 +2415,7 @@ void CConnman::ThreadOpenConnections()
             CAddrInfo addr = addrman.Select(fFeeler);
 
             // if we selected an invalid address, restart
-            if (!addr.IsValid() || setConnected.count(addr.GetGroup()) || IsLocal(addr))
+            if (!addr.IsValid() || setConnected.count(addr.GetGroup()) || setConnecting.count(addr.GetGroup()) || IsLocal(addr))
                 break;
 
             // If we didn't find an appropriate destination after trying 100 addresses fetched from addrman,
@@ -1865,11 +2471,51 @@ void CConnman::ThreadOpenConnections()
                 LogPrint("net", "Making feeler connection to %s\n", addrConnect.ToString());
             }
 
-            OpenNetworkConnection(addrConnect, (int)setConnected.size() >= std::min(nMaxConnections - 1, 2), &grant, NULL, false, fFeeler);
+            QueueConnectAttempt(addrConnect, (int)setConnected.size() >= std::min(nMaxConnections - 1, 2), grant, fFeeler, fBlockRelayOnly);
+            fStartedAttempt = true;
         }
     }
 }
 
+void CConnman::QueueConnectAttempt(const CAddress& addr, bool fCountFailure, CSemaphoreGrant& grant, bool fFeeler, bool fBlockRelayOnly)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexConnectAttempts);
+        listConnectAttempts.emplace_back();
+        ConnectAttempt& attempt = listConnectAttempts.back();
+        attempt.addr = addr;
+        attempt.fCountFailure = fCountFailure;
+        attempt.fFeeler = fFeeler;
+        attempt.fBlockRelayOnly = fBlockRelayOnly;
+        attempt.fRunning = false;
+        grant.MoveTo(attempt.grant);
+    }
+    condConnectAttempts.notify_all();
+}
+
+void CConnman::ThreadConnectAttempts()
+{
+    std::unique_lock<std::mutex> lock(mutexConnectAttempts);
+    while (true) {
+        std::list<ConnectAttempt>::iterator it;
+        condConnectAttempts.wait(lock, [this, &it] {
+            if (interruptNet)
+                return true;
+            it = std::find_if(listConnectAttempts.begin(), listConnectAttempts.end(), [](const ConnectAttempt& attempt) { return !attempt.fRunning; });
+            return it != listConnectAttempts.end();
+        });
+        if (interruptNet)
+            return;
+        it->fRunning = true;
+        lock.unlock();
+        // Only this thread touches the attempt until it is erased; a failed one gives its grant back then
+        OpenNetworkConnection(it->addr, it->fCountFailure, &it->grant, NULL, false, it->fFeeler, false, it->fBlockRelayOnly);
+        lock.lock();
+        listConnectAttempts.erase(it);
+        condConnectAttempts.notify_all();
+    }
+}
+
 std::vector<AddedNodeInfo> CConnman::GetAddedNodeInfo()
 {
     std::vector<AddedNodeInfo> ret;
@@ -1959,7 +2605,7 @@ void CConnman::ThreadOpenAddedConnections()
 }
 
 // if successful, this moves the passed grant to the constructed node
-bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSemaphoreGrant *grantOutbound, const char *pszDest, bool fOneShot, bool fFeeler, bool fAddnode)
+bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSemaphoreGrant *grantOutbound, const char *pszDest, bool fOneShot, bool fFeeler, bool fAddnode, bool fBlockRelayOnly)
 {
     //
     // Initiate outbound network connection
@@ -1990,6 +2636,10 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->fFeeler = true;
     if (fAddnode)
         pnode->fAddnode = true;
+    if (fBlockRelayOnly)
+        pnode->fBlockRelayOnly = true;
+    pnode->sendBucket.SetRate(nPeerSendRate);
+    pnode->recvBucket.SetRate(nPeerRecvRate);
 
     GetNodeSignals().InitializeNode(pnode, *this);
     {
@@ -2000,16 +2650,24 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+/**
+ * SolarCoin: Each message handler thread serves the peers whose id maps to it, so the messages of
+ * one peer stay in order, and a peer that keeps its thread busy (serving blocks, say) only delays
+ * the peers that share the thread. Chain state is still guarded by cs_main, which the handlers
+ * take only for the commands that need it.
+ */
+void CConnman::ThreadMessageHandler(int nWorker)
 {
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (GetMessageHandlerWorker(pnode->GetId()) != nWorker)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
@@ -2043,9 +2701,9 @@ void CConnman::ThreadMessageHandler()
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nWorker] { return vfMsgProcWake[nWorker]; });
         }
-        fMsgProcWake = false;
+        vfMsgProcWake[nWorker] = false;
     }
 }
 
@@ -2227,15 +2885,23 @@ void CConnman::SetNetworkActive(bool active)
 CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSeed1(nSeed1In)
 {
     fNetworkActive = true;
+#ifdef USE_SOCKET_EVENTS
+    hSocketEvents = -1;
+#endif
     setBannedIsDirty = false;
+    fBanSnapshotNeeded = false;
     fAddressesInitialized = false;
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
+    nPeerSendRate = 0;
+    nPeerRecvRate = 0;
+    nMessageHandlerThreads = 1;
     semOutbound = NULL;
     semAddnode = NULL;
     nMaxConnections = 0;
     nMaxOutbound = 0;
+    nMaxBlockRelayOnly = 0;
     nMaxAddnode = 0;
     nBestHeight = 0;
     clientInterface = NULL;
@@ -2261,13 +2927,23 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nMaxOutbound = std::min((connOptions.nMaxOutbound), nMaxConnections);
     nMaxAddnode = connOptions.nMaxAddnode;
     nMaxFeeler = connOptions.nMaxFeeler;
+    nMaxBlockRelayOnly = std::max(0, std::min(connOptions.nMaxBlockRelayOnly, MAX_BLOCK_RELAY_ONLY_CONNECTIONS));
 
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
+    nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHAND_THREADS));
 
     nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
 
+    {
+        LOCK(cs_sendBuckets);
+        for (int nLane = SEND_LANE_CONTROL + 1; nLane < SEND_LANE_COUNT; nLane++)
+            vSendBuckets[nLane].SetRate(connOptions.vSendRate[nLane]);
+    }
+    nPeerSendRate = connOptions.nPeerSendRate;
+    nPeerRecvRate = connOptions.nPeerRecvRate;
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2282,7 +2958,7 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         else {
             addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
             LogPrintf("Invalid or missing peers.dat; recreating\n");
-            DumpAddresses();
+            adb.Write(addrman);
         }
     }
     if (clientInterface)
@@ -2304,13 +2980,23 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         DumpBanlist();
     }
 
+    // SolarCoin: the peers to reconnect to first
+    {
+        CAnchorsDB anchorsdb;
+        if (anchorsdb.Read(vAnchors)) {
+            if (vAnchors.size() > (size_t)MAX_ANCHORS)
+                vAnchors.resize(MAX_ANCHORS);
+            LogPrintf("Loaded %d anchor peers from anchors.dat\n", vAnchors.size());
+        }
+    }
+
     uiInterface.InitMessage(_("Starting network threads..."));
 
     fAddressesInitialized = true;
 
     if (semOutbound == NULL) {
         // initialize semaphore
-        semOutbound = new CSemaphore(std::min((nMaxOutbound + nMaxFeeler), nMaxConnections));
+        semOutbound = new CSemaphore(std::min((nMaxOutbound + nMaxFeeler + nMaxBlockRelayOnly), nMaxConnections));
     }
     if (semAddnode == NULL) {
         // initialize semaphore
@@ -2326,9 +3012,14 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        vfMsgProcWake.assign(nMessageHandlerThreads, false);
     }
 
+#ifdef USE_SOCKET_EVENTS
+    if (!InitSocketEvents(strNodeError))
+        return false;
+#endif
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2342,10 +3033,15 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     // Initiate outbound connections unless connect=0
     if (!mapMultiArgs.count("-connect") || mapMultiArgs.at("-connect").size() != 1 || mapMultiArgs.at("-connect")[0] != "0")
+    {
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
+        for (int i = 0; i < MAX_CONNECT_ATTEMPTS; i++)
+            vThreadConnectAttempts.push_back(std::thread(&TraceThread<std::function<void()> >, "connect", std::function<void()>(std::bind(&CConnman::ThreadConnectAttempts, this))));
+    }
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        vThreadMessageHandler.push_back(std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i))));
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL);
@@ -2378,9 +3074,13 @@ void CConnman::Interrupt()
 
     interruptNet();
     InterruptSocks5(true);
+    {
+        std::lock_guard<std::mutex> lock(mutexConnectAttempts);
+    }
+    condConnectAttempts.notify_all();
 
     if (semOutbound) {
-        for (int i=0; i<(nMaxOutbound + nMaxFeeler); i++) {
+        for (int i=0; i<(nMaxOutbound + nMaxFeeler + nMaxBlockRelayOnly); i++) {
             semOutbound->post();
         }
     }
@@ -2394,10 +3094,19 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : vThreadMessageHandler) {
+        if (thread.joinable())
+            thread.join();
+    }
+    vThreadMessageHandler.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
+    for (std::thread& thread : vThreadConnectAttempts) {
+        if (thread.joinable())
+            thread.join();
+    }
+    vThreadConnectAttempts.clear();
+    listConnectAttempts.clear();
     if (threadOpenAddedConnections.joinable())
         threadOpenAddedConnections.join();
     if (threadDNSAddressSeed.joinable())
@@ -2408,6 +3117,7 @@ void CConnman::Stop()
     if (fAddressesInitialized)
     {
         DumpData();
+        DumpAnchors();
         fAddressesInitialized = false;
     }
 
@@ -2418,6 +3128,14 @@ void CConnman::Stop()
         if (hListenSocket.socket != INVALID_SOCKET)
             if (!CloseSocket(hListenSocket.socket))
                 LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+#ifdef USE_SOCKET_EVENTS
+    if (hSocketEvents != -1) {
+        close(hSocketEvents);
+        hSocketEvents = -1;
+    }
+    setSocketsReadable.clear();
+    setSocketsWritable.clear();
+#endif
 
     // clean up some globals (to help leak detection)
     BOOST_FOREACH(CNode *pnode, vNodes) {
@@ -2442,6 +3160,7 @@ void CConnman::DeleteNode(CNode* pnode)
     GetNodeSignals().FinalizeNode(pnode->GetId(), fUpdateConnectionTime);
     if(fUpdateConnectionTime)
         addrman.Connected(pnode->addr);
+    msgCountersClosed.Add(pnode->msgCounters);
     delete pnode;
 }
 
@@ -2531,6 +3250,31 @@ void CConnman::GetNodeStats(std::vector<CNodeStats>& vstats)
     }
 }
 
+void CConnman::GetNodeMemoryUsage(size_t& nRecvBytes, size_t& nSendBytes, size_t& nInventoryBytes)
+{
+    nRecvBytes = nSendBytes = nInventoryBytes = 0;
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        {
+            // The list node holds the message, which holds its data. The socket handler thread
+            // appends to vRecvMsg under cs_vRecv and moves complete messages out under cs_vProcessMsg.
+            LOCK2(pnode->cs_vProcessMsg, pnode->cs_vRecv);
+            for (const CNetMessage& msg : pnode->vProcessMsg)
+                nRecvBytes += memusage::MallocUsage(sizeof(CNetMessage) + 2 * sizeof(void*)) + memusage::MallocUsage(msg.vRecv.capacity());
+            for (const CNetMessage& msg : pnode->vRecvMsg)
+                nRecvBytes += memusage::MallocUsage(sizeof(CNetMessage) + 2 * sizeof(void*)) + memusage::MallocUsage(msg.vRecv.capacity());
+        }
+        {
+            LOCK(pnode->cs_vSend);
+            for (const std::deque<CQueuedNetMsg>& lane : pnode->vSendMsg)
+                for (const CQueuedNetMsg& msg : lane)
+                    nSendBytes += memusage::DynamicUsage(msg.header) + msg.data.DynamicMemoryUsage();
+        }
+        LOCK(pnode->cs_inventory);
+        nInventoryBytes += pnode->filterInventoryKnown.DynamicMemoryUsage();
+    }
+}
+
 bool CConnman::DisconnectNode(const std::string& strNode)
 {
     LOCK(cs_vNodes);
@@ -2554,12 +3298,14 @@ bool CConnman::DisconnectNode(NodeId id)
 
 void CConnman::RecordBytesRecv(uint64_t bytes)
 {
+    AddMetric(METRIC_BYTES_RECV, bytes);
     LOCK(cs_totalBytesRecv);
     nTotalBytesRecv += bytes;
 }
 
 void CConnman::RecordBytesSent(uint64_t bytes)
 {
+    AddMetric(METRIC_BYTES_SENT, bytes);
     LOCK(cs_totalBytesSent);
     nTotalBytesSent += bytes;
 
@@ -2660,6 +3406,87 @@ uint64_t CConnman::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+void CConnman::GetMsgTypeStats(std::vector<CNetMsgTypeStats>& vStats)
+{
+    vStats.assign(NUM_NET_MESSAGE_TYPES + 1, CNetMsgTypeStats());
+    {
+        LOCK(cs_vNodes);
+        for (const CNode* pnode : vNodes)
+            pnode->msgCounters.AddTo(vStats);
+    }
+    msgCountersClosed.AddTo(vStats);
+}
+
+CNetMsgCounters::CNetMsgCounters()
+{
+    for (Counters& c : counters) {
+        c.nSendMsgs = 0;
+        c.nSendBytes = 0;
+        c.nRecvMsgs = 0;
+        c.nRecvBytes = 0;
+        c.nProcessTime = 0;
+        for (std::atomic<uint64_t>& nBucket : c.vProcessTimeBuckets)
+            nBucket = 0;
+    }
+}
+
+void CNetMsgCounters::RecordSend(size_t nType, uint64_t nBytes)
+{
+    assert(nType <= NUM_NET_MESSAGE_TYPES);
+    counters[nType].nSendMsgs.fetch_add(1, std::memory_order_relaxed);
+    counters[nType].nSendBytes.fetch_add(nBytes, std::memory_order_relaxed);
+}
+
+void CNetMsgCounters::RecordRecv(size_t nType, uint64_t nBytes)
+{
+    assert(nType <= NUM_NET_MESSAGE_TYPES);
+    counters[nType].nRecvMsgs.fetch_add(1, std::memory_order_relaxed);
+    counters[nType].nRecvBytes.fetch_add(nBytes, std::memory_order_relaxed);
+}
+
+void CNetMsgCounters::RecordProcessingTime(size_t nType, int64_t nMicros)
+{
+    assert(nType <= NUM_NET_MESSAGE_TYPES);
+    if (nMicros < 0)
+        nMicros = 0;
+    int nBucket = 0;
+    for (int64_t nBound = 10; nBucket < NET_PROCESSING_TIME_BUCKETS - 1 && nMicros >= nBound; nBound *= 10)
+        nBucket++;
+    counters[nType].nProcessTime.fetch_add(nMicros, std::memory_order_relaxed);
+    counters[nType].vProcessTimeBuckets[nBucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CNetMsgCounters::AddTo(std::vector<CNetMsgTypeStats>& vStats) const
+{
+    assert(vStats.size() == NUM_NET_MESSAGE_TYPES + 1);
+    for (size_t i = 0; i <= NUM_NET_MESSAGE_TYPES; i++) {
+        const Counters& c = counters[i];
+        CNetMsgTypeStats& stats = vStats[i];
+        stats.nSendMsgs += c.nSendMsgs.load(std::memory_order_relaxed);
+        stats.nSendBytes += c.nSendBytes.load(std::memory_order_relaxed);
+        stats.nRecvMsgs += c.nRecvMsgs.load(std::memory_order_relaxed);
+        stats.nRecvBytes += c.nRecvBytes.load(std::memory_order_relaxed);
+        stats.nProcessTime += c.nProcessTime.load(std::memory_order_relaxed);
+        for (int n = 0; n < NET_PROCESSING_TIME_BUCKETS; n++)
+            stats.vProcessTimeBuckets[n] += c.vProcessTimeBuckets[n].load(std::memory_order_relaxed);
+    }
+}
+
+void CNetMsgCounters::Add(const CNetMsgCounters& other)
+{
+    for (size_t i = 0; i <= NUM_NET_MESSAGE_TYPES; i++) {
+        const Counters& o = other.counters[i];
+        Counters& c = counters[i];
+        c.nSendMsgs.fetch_add(o.nSendMsgs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        c.nSendBytes.fetch_add(o.nSendBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        c.nRecvMsgs.fetch_add(o.nRecvMsgs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        c.nRecvBytes.fetch_add(o.nRecvBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        c.nProcessTime.fetch_add(o.nProcessTime.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        for (int n = 0; n < NET_PROCESSING_TIME_BUCKETS; n++)
+            c.vProcessTimeBuckets[n].fetch_add(o.vProcessTimeBuckets[n].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
 ServiceFlags CConnman::GetLocalServices() const
 {
     return nLocalServices;
@@ -2685,7 +3512,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     id(idIn),
     nKeyedNetGroup(nKeyedNetGroupIn),
     addrKnown(5000, 0.001),
-    filterInventoryKnown(50000, 0.000001),
+    filterInventoryKnown(INVENTORY_KNOWN_MIN_ELEMENTS, INVENTORY_KNOWN_MAX_ELEMENTS, 0.000001, INVENTORY_KNOWN_MIN_AGE),
     nLocalHostNonce(nLocalHostNonceIn),
     nLocalServices(nLocalServicesIn),
     nMyStartingHeight(nMyStartingHeightIn),
@@ -2706,6 +3533,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fWhitelisted = false;
     fOneShot = false;
     fAddnode = false;
+    fBlockRelayOnly = false;
     fClient = false; // set by version message
     fFeeler = false;
     fSuccessfullyConnected = false;
@@ -2713,9 +3541,10 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    nSendLane = 0;
+    fSendThrottled = false;
     hashContinue = uint256();
     nStartingHeight = -1;
-    filterInventoryKnown.reset();
     fSendMempool = false;
     fGetAddr = false;
     nNextLocalAddrSend = 0;
@@ -2737,12 +3566,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nextSendTimeFeeFilter = 0;
     fPauseRecv = false;
     fPauseSend = false;
+    fSocketEventsRegistered = false;
     nProcessQueueSize = 0;
 
-    BOOST_FOREACH(const std::string &msg, getAllNetMessageTypes())
-        mapRecvBytesPerMsgCmd[msg] = 0;
-    mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
-
     if (fLogIPs)
         LogPrint("net", "Added connection to %s peer=%d\n", addrName, id);
     else
@@ -2757,40 +3583,6 @@ CNode::~CNode()
         delete pfilter;
 }
 
-void CNode::AskFor(const CInv& inv)
-{
-    if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ)
-        return;
-    // a peer may not have multiple non-responded queue positions for a single inv item
-    if (!setAskFor.insert(inv.hash).second)
-        return;
-
-    // We're using mapAskFor as a priority queue,
-    // the key is the earliest time the request can be sent
-    int64_t nRequestTime;
-    limitedmap<uint256, int64_t>::const_iterator it = mapAlreadyAskedFor.find(inv.hash);
-    if (it != mapAlreadyAskedFor.end())
-        nRequestTime = it->second;
-    else
-        nRequestTime = 0;
-    LogPrint("net", "askfor %s  %d (%s) peer=%d\n", inv.ToString(), nRequestTime, DateTimeStrFormat("%H:%M:%S", nRequestTime/1000000), id);
-
-    // Make sure not to reuse time indexes to keep things in the same order
-    int64_t nNow = GetTimeMicros() - 1000000;
-    static int64_t nLastTime;
-    ++nLastTime;
-    nNow = std::max(nNow, nLastTime);
-    nLastTime = nNow;
-
-    // Each retry is 2 minutes after the last
-    nRequestTime = std::max(nRequestTime + 2 * 60 * 1000000, nNow);
-    if (it != mapAlreadyAskedFor.end())
-        mapAlreadyAskedFor.update(it, nRequestTime);
-    else
-        mapAlreadyAskedFor.insert(std::make_pair(inv.hash, nRequestTime));
-    mapAskFor.insert(std::make_pair(nRequestTime, inv));
-}
-
 bool CConnman::NodeFullyConnected(const CNode* pnode)
 {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
@@ -2801,10 +3593,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nMessageSize = msg.data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
+    if (fCaptureMessages) {
+        const std::vector<unsigned char> vData = msg.data.ToVector();
+        CaptureMessage(pnode->addr, msg.command, vData.data(), vData.data() + vData.size(), false);
+    }
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    uint256 hash = msg.hashData.IsNull() ? msg.data.GetHash() : msg.hashData;
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
@@ -2813,17 +3609,19 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
-        bool optimisticSend(pnode->vSendMsg.empty());
+        bool optimisticSend(pnode->nSendSize == 0);
+        const size_t nMsgType = GetNetMessageTypeIndex(msg.command);
 
         //log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
+        pnode->msgCounters.RecordSend(nMsgType, nTotalSize);
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        std::deque<CQueuedNetMsg>& queue = pnode->vSendMsg[msg.fHistorical ? SEND_LANE_HISTORICAL : GetSendLane(nMsgType)];
+        queue.emplace_back();
+        queue.back().header = std::move(serializedHeader);
+        queue.back().data = std::move(msg.data);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -12,10 +12,10 @@
 #include "bloom.h"
 #include "compat.h"
 #include "hash.h"
-#include "limitedmap.h"
 #include "netaddress.h"
 #include "protocol.h"
 #include "random.h"
+#include "segmentedbuffer.h"
 #include "streams.h"
 #include "sync.h"
 #include "uint256.h"
@@ -23,9 +23,12 @@
 
 #include <atomic>
 #include <deque>
+#include <limits>
+#include <list>
 #include <stdint.h>
 #include <thread>
 #include <memory>
+#include <set>
 #include <condition_variable>
 
 #ifndef WIN32
@@ -50,8 +53,19 @@ static const int PING_INTERVAL = 2 * 60;
 static const int TIMEOUT_INTERVAL = 20 * 60;
 /** Run the feeler connection loop once every 2 minutes or 120 seconds. **/
 static const int FEELER_INTERVAL = 120;
+/** SolarCoin: The number of automatic outbound connection attempts that may run at the same time */
+static const int MAX_CONNECT_ATTEMPTS = 4;
+/** SolarCoin: The number of outbound peers kept in anchors.dat across a restart */
+static const int MAX_ANCHORS = 4;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
+/**
+ * SolarCoin: The filter of the inventory a peer knows starts with room for this many entries and
+ * doubles, up to the maximum, while the peer relays half of its capacity within the minimum age.
+ */
+static const unsigned int INVENTORY_KNOWN_MIN_ELEMENTS = 1000;
+static const unsigned int INVENTORY_KNOWN_MAX_ELEMENTS = 50000;
+static const int64_t INVENTORY_KNOWN_MIN_AGE = 30 * 60;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /** Maximum length of incoming protocol messages (no message over 4 MB is currently acceptable). */
@@ -62,6 +76,11 @@ static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 static const int MAX_OUTBOUND_CONNECTIONS = 8;
 /** Maximum number of addnode outgoing nodes */
 static const int MAX_ADDNODE_CONNECTIONS = 8;
+/** SolarCoin: -blockrelayconns default: outbound connections that relay blocks only, not transactions or addresses */
+static const int DEFAULT_BLOCK_RELAY_ONLY_CONNECTIONS = 0;
+static const int MAX_BLOCK_RELAY_ONLY_CONNECTIONS = 8;
+/** SolarCoin: The highest -uploadrate, -peeruploadrate and -peerdownloadrate, in kB per second */
+static const int64_t MAX_SHAPING_RATE = 1000000;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
 /** -upnp default */
@@ -70,12 +89,11 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
-/** The maximum number of entries in mapAskFor */
-static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
-/** The maximum number of entries in setAskFor (larger due to getdata latency)*/
-static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** SolarCoin: The number of message handler threads, each serving a fixed share of the peers */
+static const int DEFAULT_MSGHAND_THREADS = 2;
+static const int MAX_MSGHAND_THREADS = 16;
 /** The default for -maxuploadtarget. 0 = Unlimited */
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 /** The default timeframe for -maxuploadtarget. 1 day. */
@@ -91,6 +109,8 @@ static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
+/** SolarCoin: -capturemessages default */
+static const bool DEFAULT_CAPTURE_MESSAGES = false;
 
 typedef int64_t NodeId;
 
@@ -106,6 +126,120 @@ class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
 
+/**
+ * SolarCoin: Message processing times are counted in buckets with the upper bounds 10us, 100us,
+ * 1ms, 10ms, 100ms and 1s, and one for longer times.
+ */
+static const int NET_PROCESSING_TIME_BUCKETS = 7;
+
+/** SolarCoin: The traffic and processing time of one message type */
+struct CNetMsgTypeStats
+{
+    uint64_t nSendMsgs;
+    uint64_t nSendBytes;
+    uint64_t nRecvMsgs;
+    uint64_t nRecvBytes;
+    uint64_t nProcessTime; //!< microseconds spent in ProcessMessage
+    uint64_t vProcessTimeBuckets[NET_PROCESSING_TIME_BUCKETS];
+
+    CNetMsgTypeStats() : nSendMsgs(0), nSendBytes(0), nRecvMsgs(0), nRecvBytes(0), nProcessTime(0), vProcessTimeBuckets() {}
+};
+
+/**
+ * SolarCoin: Per message type counters, indexed by GetNetMessageTypeIndex(). They are relaxed
+ * atomics, so the socket and message handler threads update them without taking a lock.
+ */
+class CNetMsgCounters
+{
+public:
+    CNetMsgCounters();
+
+    void RecordSend(size_t nType, uint64_t nBytes);
+    void RecordRecv(size_t nType, uint64_t nBytes);
+    void RecordProcessingTime(size_t nType, int64_t nMicros);
+
+    /** Add the counters to vStats, which must have NUM_NET_MESSAGE_TYPES + 1 entries. */
+    void AddTo(std::vector<CNetMsgTypeStats>& vStats) const;
+    /** Add the counters of other to these. */
+    void Add(const CNetMsgCounters& other);
+
+private:
+    struct Counters
+    {
+        std::atomic<uint64_t> nSendMsgs;
+        std::atomic<uint64_t> nSendBytes;
+        std::atomic<uint64_t> nRecvMsgs;
+        std::atomic<uint64_t> nRecvBytes;
+        std::atomic<uint64_t> nProcessTime;
+        std::atomic<uint64_t> vProcessTimeBuckets[NET_PROCESSING_TIME_BUCKETS];
+    };
+
+    Counters counters[NUM_NET_MESSAGE_TYPES + 1];
+};
+
+/**
+ * SolarCoin: The send lanes of a peer, highest priority first. A queued message is sent before
+ * those of lower lanes, but after any message already started, so a large block or a burst of
+ * transaction announcements does not hold up the headers and compact blocks behind it. The lanes
+ * other than the control one are also the traffic classes of -uploadrate.
+ */
+enum SendLane
+{
+    SEND_LANE_CONTROL, //!< control messages, requests and headers
+    SEND_LANE_BLOCK,
+    SEND_LANE_TX,
+    SEND_LANE_ADDR,
+    SEND_LANE_HISTORICAL, //!< blocks served to peers that are catching up
+    SEND_LANE_COUNT
+};
+
+/** SolarCoin: The send lane of a message, by GetNetMessageTypeIndex() */
+SendLane GetSendLane(size_t nMsgType);
+
+/**
+ * SolarCoin: A token bucket of bytes. Tokens flow in at nRate bytes per second up to one second
+ * worth, and every transfer takes out what it used. A transfer is allowed while any tokens are
+ * left, so the bucket may go into debt by the end of one, which the next ones wait for. A rate of
+ * 0 means no limit.
+ */
+class CTokenBucket
+{
+public:
+    CTokenBucket() : nRate(0), nTokens(0), nLastRefill(0) {}
+
+    void SetRate(int64_t nRateIn)
+    {
+        nRate = nRateIn;
+        nTokens = nRate * 1000000;
+    }
+    int64_t GetRate() const { return nRate; }
+
+    /** The number of bytes that may be transferred at nNowMicros, std::numeric_limits<int64_t>::max() if unlimited. */
+    int64_t Available(int64_t nNowMicros)
+    {
+        if (nRate == 0)
+            return std::numeric_limits<int64_t>::max();
+        if (nNowMicros > nLastRefill) {
+            // Tokens are counted in byte-microseconds, so no fraction of a byte is lost between refills
+            int64_t nElapsed = std::min<int64_t>(nNowMicros - nLastRefill, 1000000);
+            nTokens = std::min(nTokens + nElapsed * nRate, nRate * 1000000);
+            nLastRefill = nNowMicros;
+        }
+        return nTokens / 1000000;
+    }
+
+    void Consume(int64_t nBytes)
+    {
+        if (nRate != 0)
+            nTokens -= nBytes * 1000000;
+    }
+
+private:
+    int64_t nRate;
+    int64_t nTokens;
+    int64_t nLastRefill;
+};
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -115,8 +249,10 @@ struct CSerializedNetMsg
     CSerializedNetMsg(const CSerializedNetMsg& msg) = delete;
     CSerializedNetMsg& operator=(const CSerializedNetMsg&) = delete;
 
-    std::vector<unsigned char> data;
+    CSegmentedBuffer data;
     std::string command;
+    uint256 hashData; //!< SolarCoin: checksum of data if already known, computed on push when null
+    bool fHistorical = false; //!< SolarCoin: a block for a peer that is catching up, sent in SEND_LANE_HISTORICAL
 };
 
 
@@ -139,12 +275,17 @@ public:
         int nMaxOutbound = 0;
         int nMaxAddnode = 0;
         int nMaxFeeler = 0;
+        int nMaxBlockRelayOnly = 0;
         int nBestHeight = 0;
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        int nMessageHandlerThreads = 1;
+        int64_t vSendRate[SEND_LANE_COUNT] = {}; //!< SolarCoin: bytes per second of every peer together, per lane; 0 for no limit
+        int64_t nPeerSendRate = 0;
+        int64_t nPeerRecvRate = 0;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -154,7 +295,7 @@ public:
     bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
     bool GetNetworkActive() const { return fNetworkActive; };
     void SetNetworkActive(bool active);
-    bool OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSemaphoreGrant *grantOutbound = NULL, const char *strDest = NULL, bool fOneShot = false, bool fFeeler = false, bool fAddnode = false);
+    bool OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSemaphoreGrant *grantOutbound = NULL, const char *strDest = NULL, bool fOneShot = false, bool fFeeler = false, bool fAddnode = false, bool fBlockRelayOnly = false);
     bool CheckIncomingNonce(uint64_t nonce);
 
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
@@ -259,6 +400,13 @@ public:
 
     size_t GetNodeCount(NumConnections num);
     void GetNodeStats(std::vector<CNodeStats>& vstats);
+    /**
+     * SolarCoin: Bytes of memory the peers hold in received messages, partial or waiting to be
+     * processed, in messages waiting to be sent, and in their known inventory filters
+     */
+    void GetNodeMemoryUsage(size_t& nRecvBytes, size_t& nSendBytes, size_t& nInventoryBytes);
+    /** SolarCoin: Bytes of memory used by the address manager */
+    size_t GetAddrManMemoryUsage() const { return addrman.DynamicMemoryUsage(); }
     bool DisconnectNode(const std::string& node);
     bool DisconnectNode(NodeId id);
 
@@ -291,6 +439,8 @@ public:
 
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
+    /** SolarCoin: Traffic and processing time per message type, of all peers since startup */
+    void GetMsgTypeStats(std::vector<CNetMsgTypeStats>& vStats);
 
     void SetBestHeight(int height);
     int GetBestHeight() const;
@@ -301,6 +451,7 @@ public:
     unsigned int GetReceiveFloodSize() const;
 
     void WakeMessageHandler();
+    void WakeMessageHandler(NodeId id);
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -312,8 +463,16 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadConnectAttempts();
+    void QueueConnectAttempt(const CAddress& addr, bool fCountFailure, CSemaphoreGrant& grant, bool fFeeler, bool fBlockRelayOnly);
+    void ThreadMessageHandler(int nWorker);
+    int GetMessageHandlerWorker(NodeId id) const { return id % nMessageHandlerThreads; }
     void AcceptConnection(const ListenSocket& hListenSocket);
+#ifdef USE_SOCKET_EVENTS
+    bool InitSocketEvents(std::string& strError);
+#endif
+    void GenerateSocketSets(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    void SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -332,6 +491,9 @@ private:
 
     NodeId GetNewNodeId();
 
+    // SolarCoin: the bytes nLane of pnode may send now, and the lane to send from now or SEND_LANE_COUNT for none
+    int64_t GetSendBudget(CNode *pnode, int nLane, int64_t nNow) const;
+    int GetSendableLane(CNode *pnode, int64_t nNow) const;
     size_t SocketSendData(CNode *pnode) const;
     //!check is the banlist has unwritten changes
     bool BannedSetIsDirty();
@@ -342,6 +504,7 @@ private:
     void DumpAddresses();
     void DumpData();
     void DumpBanlist();
+    void DumpAnchors();
 
     // Network stats
     void RecordBytesRecv(uint64_t bytes);
@@ -355,6 +518,8 @@ private:
     CCriticalSection cs_totalBytesSent;
     uint64_t nTotalBytesRecv;
     uint64_t nTotalBytesSent;
+    // SolarCoin: the message type counters of the peers that are gone
+    CNetMsgCounters msgCountersClosed;
 
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle;
@@ -370,11 +535,30 @@ private:
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
 
+    // SolarCoin: bandwidth shaping, see CTokenBucket. The control lane is never held back.
+    mutable CCriticalSection cs_sendBuckets;
+    mutable CTokenBucket vSendBuckets[SEND_LANE_COUNT]; // protected by cs_sendBuckets
+    int64_t nPeerSendRate;
+    int64_t nPeerRecvRate;
+
     std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_SOCKET_EVENTS
+    /**
+     * SolarCoin: The epoll or kqueue descriptor. Node sockets are registered edge-triggered, so the
+     * readiness the socket thread has not used up yet is remembered per socket until a short read or
+     * write shows that it is gone.
+     */
+    int hSocketEvents;
+    std::set<SOCKET> setSocketsReadable;
+    std::set<SOCKET> setSocketsWritable;
+#endif
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
+    // SolarCoin: the ban changes to journal, or whether a snapshot must be written instead; protected by cs_setBanned
+    std::vector<CBanJournalRecord> vBanChanges;
+    bool fBanSnapshotNeeded;
     bool fAddressesInitialized;
     CAddrMan addrman;
     std::deque<std::string> vOneShots;
@@ -398,14 +582,16 @@ private:
     int nMaxOutbound;
     int nMaxAddnode;
     int nMaxFeeler;
+    int nMaxBlockRelayOnly;
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
 
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** flags for waking the message processors, one per thread. */
+    std::vector<bool> vfMsgProcWake;
+    int nMessageHandlerThreads;
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -417,7 +603,27 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> vThreadConnectAttempts;
+    std::vector<std::thread> vThreadMessageHandler;
+
+    /**
+     * SolarCoin: An outbound connection that ThreadOpenConnections chose, made by one of the
+     * vThreadConnectAttempts threads so that a dead address does not hold up the next ones.
+     */
+    struct ConnectAttempt
+    {
+        CAddress addr;
+        bool fCountFailure;
+        bool fFeeler;
+        bool fBlockRelayOnly;
+        bool fRunning;
+        CSemaphoreGrant grant;
+    };
+    std::list<ConnectAttempt> listConnectAttempts; // protected by mutexConnectAttempts
+    // SolarCoin: the peers read from anchors.dat, reconnected to first by ThreadOpenConnections
+    std::vector<CAddress> vAnchors;
+    std::mutex mutexConnectAttempts;
+    std::condition_variable condConnectAttempts;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -490,8 +696,52 @@ CAddress GetLocalAddress(const CNetAddr *paddrPeer, ServiceFlags nLocalServices)
 extern bool fDiscover;
 extern bool fListen;
 extern bool fRelayTxes;
+/** SolarCoin: Whether the messages of every peer are written to message_capture/ in the data directory (-capturemessages) */
+extern bool fCaptureMessages;
+
+/**
+ * SolarCoin: A message as -capturemessages writes it: the time it was processed or sent in
+ * microseconds, the command padded to COMMAND_SIZE, the payload size and the payload. The
+ * messages of a peer are appended to message_capture/<address>/msgs_recv.dat and msgs_sent.dat.
+ */
+struct CCapturedMessage
+{
+    int64_t nTimeMicros;
+    std::string strCommand;
+    std::vector<unsigned char> vData;
+
+    CCapturedMessage() : nTimeMicros(0) {}
 
-extern limitedmap<uint256, int64_t> mapAlreadyAskedFor;
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        char pchCommand[CMessageHeader::COMMAND_SIZE] = {};
+        memcpy(pchCommand, strCommand.data(), std::min(strCommand.size(), sizeof(pchCommand)));
+        ser_writedata64(s, nTimeMicros);
+        s.write(pchCommand, sizeof(pchCommand));
+        ser_writedata32(s, vData.size());
+        s.write((const char*)vData.data(), vData.size());
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char pchCommand[CMessageHeader::COMMAND_SIZE];
+        nTimeMicros = ser_readdata64(s);
+        s.read(pchCommand, sizeof(pchCommand));
+        strCommand.assign(pchCommand, strnlen(pchCommand, sizeof(pchCommand)));
+        uint32_t nSize = ser_readdata32(s);
+        if (nSize > MAX_PROTOCOL_MESSAGE_LENGTH)
+            throw std::ios_base::failure("CCapturedMessage::Unserialize(): payload size too large");
+        vData.resize(nSize);
+        s.read((char*)vData.data(), nSize);
+    }
+};
+
+/** SolarCoin: Append a message of a peer to its capture file */
+void CaptureMessage(const CAddress& addr, const std::string& strCommand, const unsigned char* pbegin, const unsigned char* pend, bool fIncoming);
+/** SolarCoin: Read the messages of a capture file, false if it cannot be opened or read to its end */
+bool ReadMessageCapture(const boost::filesystem::path& path, std::vector<CCapturedMessage>& vMessages);
 
 /** Subversion as sent to the P2P network in `version` messages */
 extern std::string strSubVersion;
@@ -503,7 +753,6 @@ struct LocalServiceInfo {
 
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
-typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
 class CNodeStats
 {
@@ -520,11 +769,15 @@ public:
     std::string cleanSubVer;
     bool fInbound;
     bool fAddnode;
+    bool fBlockRelayOnly;
     int nStartingHeight;
     uint64_t nSendBytes;
-    mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
-    mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    std::vector<CNetMsgTypeStats> vMsgTypeStats; //!< SolarCoin: indexed by GetNetMessageTypeIndex()
+    size_t nSendQueueMsgs;
+    size_t nSendQueueBytes;
+    size_t nProcessQueueMsgs;
+    size_t nProcessQueueBytes;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -543,7 +796,7 @@ private:
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    char hdrbuf[CMessageHeader::HEADER_SIZE]; // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
@@ -551,13 +804,14 @@ public:
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
+    size_t nMsgType;                // SolarCoin: GetNetMessageTypeIndex() of the command, once complete
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        nMsgType = NUM_NET_MESSAGE_TYPES;
     }
 
     bool complete() const
@@ -571,15 +825,37 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    /**
+     * SolarCoin: The free space for the payload in vRecv, so the socket can be read straight into
+     * it. readDataInPlace() then accounts for the nBytes that were written there.
+     */
+    char* GetDataBuffer(unsigned int& nSize);
+    void readDataInPlace(unsigned int nBytes);
+
+    /** SolarCoin: Return the payload buffer to the pool once the message has been processed. */
+    void ReleaseBuffer();
+
+private:
+    void ParseHeader(const char *pch);
+    void ExpandData(unsigned int nBytes);
 };
 
 
+/** SolarCoin: A message queued for sending, header and payload */
+struct CQueuedNetMsg
+{
+    std::vector<unsigned char> header;
+    CSegmentedBuffer data;
+
+    size_t size() const { return header.size() + data.size(); }
+};
+
 /** Information about a peer */
 class CNode
 {
@@ -590,9 +866,13 @@ public:
     ServiceFlags nServicesExpected;
     SOCKET hSocket;
     size_t nSendSize; // total size of all vSendMsg entries
-    size_t nSendOffset; // offset inside the first vSendMsg already sent
+    size_t nSendOffset; // offset inside the first vSendMsg of nSendLane already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CQueuedNetMsg> vSendMsg[SEND_LANE_COUNT];
+    int nSendLane; // the lane being sent from; another is picked only between messages
+    CTokenBucket sendBucket; // SolarCoin: protected by cs_vSend
+    bool fSendThrottled; // SolarCoin: the last send stopped for lack of tokens rather than socket space
+    CTokenBucket recvBucket; // SolarCoin: only used by the socket thread
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -623,6 +903,7 @@ public:
     bool fFeeler; // If true this node is being used as a short lived feeler.
     bool fOneShot;
     bool fAddnode;
+    bool fBlockRelayOnly; // SolarCoin: an outbound connection that relays no transactions or addresses
     bool fClient;
     const bool fInbound;
     std::atomic_bool fSuccessfullyConnected;
@@ -642,16 +923,18 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
-protected:
-
-    mapMsgCmdSize mapSendBytesPerMsgCmd;
-    mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    // SolarCoin: Whether hSocket is in the socket event queue, only used by the socket thread
+    bool fSocketEventsRegistered;
+    // SolarCoin: Traffic and processing time per message type
+    CNetMsgCounters msgCounters;
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // SolarCoin: Addresses are relayed by the message handler threads of other peers as well
+    CCriticalSection cs_vAddrToSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -660,7 +943,7 @@ public:
     int64_t nNextLocalAddrSend;
 
     // inventory based relay
-    CRollingBloomFilter filterInventoryKnown;
+    CAdaptiveRollingBloomFilter filterInventoryKnown;
     // Set of transaction ids we still have to announce.
     // They are sorted by the mempool before relay, so the order is not important.
     std::set<uint256> setInventoryTxToSend;
@@ -669,8 +952,6 @@ public:
     // and in the order requested.
     std::vector<uint256> vInventoryBlockToSend;
     CCriticalSection cs_inventory;
-    std::set<uint256> setAskFor;
-    std::multimap<int64_t, CInv> mapAskFor;
     int64_t nNextInvSend;
     // Used for headers announcements - unfiltered blocks to relay
     // Also protected by cs_inventory
@@ -715,7 +996,8 @@ private:
     const ServiceFlags nLocalServices;
     const int nMyStartingHeight;
     int nSendVersion;
-    std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
+    std::list<CNetMessage> vRecvMsg;  // Changed only by SocketHandler thread, under cs_vRecv or cs_vProcessMsg
+    void RecordMessageComplete(CNetMessage& msg, int64_t nTimeMicros);
 
     mutable CCriticalSection cs_addrName;
     std::string addrName;
@@ -743,6 +1025,9 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    // SolarCoin: Large payloads are received in place, see CNetMessage::GetDataBuffer()
+    char* GetReceiveBuffer(unsigned int& nSize);
+    void ReceiveMsgBytesInPlace(unsigned int nBytes, bool& complete);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -774,6 +1059,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -782,6 +1068,9 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        if (fBlockRelayOnly)
+            return;
+        LOCK(cs_vAddrToSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.rand32() % vAddrToSend.size()] = _addr;
@@ -804,7 +1093,7 @@ public:
     {
         LOCK(cs_inventory);
         if (inv.type == MSG_TX) {
-            if (!filterInventoryKnown.contains(inv.hash)) {
+            if (!fBlockRelayOnly && !filterInventoryKnown.contains(inv.hash)) {
                 setInventoryTxToSend.insert(inv.hash);
             }
         } else if (inv.type == MSG_BLOCK) {
@@ -818,8 +1107,6 @@ public:
         vBlockHashesToAnnounce.push_back(hash);
     }
 
-    void AskFor(const CInv& inv);
-
     void CloseSocketDisconnect();
 
     void copyStats(CNodeStats &stats);
@@ -12,6 +12,7 @@
 #include "consensus/validation.h"
 #include "hash.h"
 #include "init.h"
+#include "memusage.h"
 #include "validation.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -21,15 +22,20 @@
 #include "policy/policy.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "profile.h"
 #include "random.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txmempool.h"
+#include "txrequest.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 #include "validationinterface.h"
 
+#include <unordered_map>
+
 #include <boost/thread.hpp>
 
 #if defined(NDEBUG)
@@ -52,9 +58,14 @@ struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    size_t nUsage; //!< SolarCoin: memory counted against -maxorphantxsize
 };
 std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
+/** SolarCoin: hashed, as it is looked up for every output of every accepted transaction */
+std::unordered_map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>, SaltedOutpointHasher> mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
+/** SolarCoin: memory used by the orphans, in all and per peer that sent them */
+size_t nOrphanTxUsage GUARDED_BY(cs_main) = 0;
+std::map<NodeId, size_t> mapOrphanTxUsageByPeer GUARDED_BY(cs_main);
 void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 static size_t vExtraTxnForCompactIt = 0;
@@ -105,6 +116,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTime;                                           //!< SolarCoin: When the block was requested, in microseconds
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -128,6 +140,87 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /**
+     * SolarCoin: The transactions to announce, looked up in the mempool and put in its
+     * depth-and-score order once per cycle for all peers, instead of by every peer at its own
+     * trickle. Peers announce their candidates in the order of the batch, filtered by their own
+     * fee filter, bloom filter and known inventory.
+     */
+    class CTxAnnouncementBatch
+    {
+    public:
+        struct Batch
+        {
+            std::vector<TxMempoolInfo> vTx;
+            std::unordered_map<uint256, size_t, SaltedTxidHasher> mapRank; //!< index in vTx
+        };
+
+    private:
+        CCriticalSection cs;
+        std::map<uint256, int64_t> mapQueued; //!< txid -> time it was queued
+        bool fQueuedSinceBuild;
+        unsigned int nTransactionsUpdated;
+        int64_t nNextBuild;
+        std::shared_ptr<const Batch> batch;
+
+    public:
+        CTxAnnouncementBatch() : fQueuedSinceBuild(false), nTransactionsUpdated(0), nNextBuild(0), batch(std::make_shared<Batch>()) {}
+
+        void Queue(const uint256& hash, int64_t nNow)
+        {
+            LOCK(cs);
+            if (mapQueued.insert(std::make_pair(hash, nNow)).second)
+                fQueuedSinceBuild = true;
+        }
+
+        /** Rebuild the batch on the next Get(), so a peer that just connected does not start from a stale one. */
+        void Expire()
+        {
+            LOCK(cs);
+            fQueuedSinceBuild = true;
+            nNextBuild = 0;
+        }
+
+        /** The current batch, rebuilt first when it is due and anything changed. */
+        std::shared_ptr<const Batch> Get(int64_t nNow)
+        {
+            LOCK(cs);
+            unsigned int nUpdated = mempool.GetTransactionsUpdated();
+            if (nNow < nNextBuild || (!fQueuedSinceBuild && nUpdated == nTransactionsUpdated))
+                return batch;
+
+            std::vector<uint256> vHashes;
+            vHashes.reserve(mapQueued.size());
+            for (std::map<uint256, int64_t>::iterator it = mapQueued.begin(); it != mapQueued.end(); ) {
+                if (it->second < nNow - TX_ANNOUNCEMENT_EXPIRY) {
+                    mapQueued.erase(it++);
+                } else {
+                    vHashes.push_back(it->first);
+                    it++;
+                }
+            }
+            std::shared_ptr<Batch> batchNew = std::make_shared<Batch>();
+            batchNew->vTx = mempool.infoSorted(vHashes);
+            for (size_t i = 0; i < batchNew->vTx.size(); i++)
+                batchNew->mapRank.insert(std::make_pair(batchNew->vTx[i].tx->GetHash(), i));
+            // Transactions that left the mempool are not announced anymore
+            for (const uint256& hash : vHashes) {
+                if (!batchNew->mapRank.count(hash))
+                    mapQueued.erase(hash);
+            }
+            batch = batchNew;
+            fQueuedSinceBuild = false;
+            nTransactionsUpdated = nUpdated;
+            nNextBuild = nNow + TX_ANNOUNCEMENT_BATCH_INTERVAL;
+            return batch;
+        }
+    };
+
+    CTxAnnouncementBatch txAnnouncementBatch;
+
+    /** SolarCoin: Transactions announced by peers and requested from them, protected by cs_main. */
+    CTxRequestTracker txRequestTracker;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -235,6 +328,14 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement; // DEBUG: 0.15.1
 
+    //! SolarCoin: Time left for this peer's PoST blocks to fail proof-of-stake checks, in microseconds
+    int64_t nStakeProofBudget;
+    //! SolarCoin: Time nStakeProofBudget was last refilled at, in microseconds
+    int64_t nStakeProofBudgetTime;
+
+    //! SolarCoin: Requested blocks this peer delivered
+    CBlockDownloadStats blockDownloadStats;
+
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
         nMisbehavior = 0;
@@ -258,6 +359,8 @@ struct CNodeState {
         fSupportsDesiredCmpctVersion = false;
         m_chain_sync = { 0, nullptr, false, false }; // DEBUG: 0.15.1
         m_last_block_announcement = 0; // DEBUG: 0.15.1
+        nStakeProofBudget = MAX_STAKE_PROOF_BUDGET;
+        nStakeProofBudgetTime = GetTimeMicros();
     }
 };
 
@@ -272,6 +375,55 @@ CNodeState *State(NodeId pnode) {
     return &it->second;
 }
 
+/**
+ * SolarCoin: Whether a PoST block of a peer may be processed. The time its blocks spend failing
+ * CheckProofOfStake(), or the timestamp check before it, is charged by ChargeStakeProofBudget(), so a
+ * flood of bad kernels from one peer is ignored once its budget runs out instead of keeping the other
+ * peers' blocks waiting.
+ * Requires cs_main.
+ */
+bool HasStakeProofBudget(CNodeState* state)
+{
+    int64_t nNow = GetTimeMicros();
+    int64_t nElapsed = std::max<int64_t>(0, nNow - state->nStakeProofBudgetTime);
+    state->nStakeProofBudgetTime = nNow;
+    // Divided first, as the elapsed time of a long idle peer would overflow
+    state->nStakeProofBudget = std::min(MAX_STAKE_PROOF_BUDGET, state->nStakeProofBudget + nElapsed / 1000000 * STAKE_PROOF_BUDGET_RATE +
+        nElapsed % 1000000 * STAKE_PROOF_BUDGET_RATE / 1000000);
+    return state->nStakeProofBudget > 0;
+}
+
+// Requires cs_main.
+void ChargeStakeProofBudget(NodeId nodeid, int64_t nMicros)
+{
+    CNodeState* state = State(nodeid);
+    if (state && nMicros > 0) {
+        state->nStakeProofBudget -= nMicros;
+        LogPrint("net", "peer=%d failed a proof-of-stake or timestamp check, %d us of its budget left\n", nodeid, state->nStakeProofBudget);
+    }
+}
+
+/** SolarCoin: ProcessNewBlock() for a block received from a peer, within its proof-of-stake check budget */
+bool ProcessPeerBlock(CNode* pfrom, const CChainParams& chainparams, const std::shared_ptr<const CBlock>& pblock, bool fForceProcessing, bool* fNewBlock)
+{
+    if (pblock->IsProofOfStake()) {
+        LOCK(cs_main);
+        CNodeState* state = State(pfrom->GetId());
+        if (state && !HasStakeProofBudget(state)) {
+            LogPrint("net", "ignoring PoST block %s, peer=%d is out of proof-of-stake check budget\n", pblock->GetHash().ToString(), pfrom->id);
+            *fNewBlock = false;
+            return false;
+        }
+    }
+    int64_t nProofFailedMicros = 0;
+    bool ret = ProcessNewBlock(chainparams, pblock, fForceProcessing, fNewBlock, &nProofFailedMicros);
+    if (nProofFailedMicros) {
+        LOCK(cs_main);
+        ChargeStakeProofBudget(pfrom->GetId(), nProofFailedMicros);
+    }
+    return ret;
+}
+
 void UpdatePreferredDownload(CNode* node, CNodeState* state)
 {
     nPreferredDownload -= state->fPreferredDownload;
@@ -294,7 +446,7 @@ void PushNodeVersion(CNode *pnode, CConnman& connman, int64_t nTime)
     CAddress addrMe = CAddress(CService(), nLocalNodeServices);
 
     connman.PushMessage(pnode, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERSION, PROTOCOL_VERSION, (uint64_t)nLocalNodeServices, nTime, addrYou, addrMe,
-            nonce, strSubVersion, nNodeStartingHeight, ::fRelayTxes));
+            nonce, strSubVersion, nNodeStartingHeight, ::fRelayTxes && !pnode->fBlockRelayOnly));
 
     if (fLogIPs)
         LogPrint("net", "send version message: version %d, blocks=%d, us=%s, them=%s, peer=%d\n", PROTOCOL_VERSION, nNodeStartingHeight, addrMe.ToString(), addrYou.ToString(), nodeid);
@@ -310,6 +462,7 @@ void InitializeNode(CNode *pnode, CConnman& connman) {
         LOCK(cs_main);
         mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName)));
     }
+    txAnnouncementBatch.Expire();
     if(!pnode->fInbound)
         PushNodeVersion(pnode, connman, GetTime());
 }
@@ -322,6 +475,8 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
     if (state->fSyncStarted)
         nSyncStarted--;
 
+    txRequestTracker.DisconnectedPeer(nodeid);
+
     if (state->nMisbehavior == 0 && state->fCurrentlyConnected) {
         fUpdateConnectionTime = true;
     }
@@ -352,10 +507,13 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
 // Requires cs_main.
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another peer
-bool MarkBlockAsReceived(const uint256& hash) {
+// SolarCoin: nodeFrom is the peer the block arrived from, if it did
+bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1) {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
+        if (itInFlight->second.first == nodeFrom)
+            state->blockDownloadStats.BlockReceived(GetTimeMicros(), itInFlight->second.second->nTime);
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         if (state->nBlocksInFlightValidHeaders == 0 && itInFlight->second.second->fValidatedHeaders) {
             // Last validated block on the queue was received.
@@ -394,7 +552,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)});
+            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -504,28 +662,41 @@ bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
     return false;
 }
 
-/** Find the last common ancestor two blocks have.
- *  Both pa and pb must be non-NULL. */
-const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb) {
-    if (pa->nHeight > pb->nHeight) {
-        pa = pa->GetAncestor(pb->nHeight);
-    } else if (pb->nHeight > pa->nHeight) {
-        pb = pb->GetAncestor(pa->nHeight);
-    }
+/** SolarCoin: Rate at which the active chain grows, in blocks per second, or 0 before it is measured (protected by cs_main) */
+double dValidationRate = 0;
+int64_t nValidationRateTime = 0;
+int nValidationRateHeight = -1;
 
-    while (pa != pb && pa && pb) {
-        pa = pa->pprev;
-        pb = pb->pprev;
+/**
+ * SolarCoin: Size of the download window for the current download and validation rates. Ten second
+ * periods in which no block was connected are not counted as the validation rate, so a stall at the
+ * lower edge of the window does not shrink it.
+ */
+unsigned int GetBlockDownloadWindow() {
+    const int64_t nNow = GetTimeMicros();
+    const int nHeight = chainActive.Height();
+    if (nValidationRateHeight < 0 || nHeight < nValidationRateHeight) {
+        nValidationRateTime = nNow;
+        nValidationRateHeight = nHeight;
+    } else if (nNow - nValidationRateTime >= 10 * 1000000) {
+        if (nHeight > nValidationRateHeight) {
+            double dRate = (nHeight - nValidationRateHeight) * 1000000.0 / (nNow - nValidationRateTime);
+            dValidationRate = dValidationRate > 0 ? (3 * dValidationRate + dRate) / 4 : dRate;
+        }
+        nValidationRateTime = nNow;
+        nValidationRateHeight = nHeight;
     }
 
-    // Eventually all chain branches meet at the genesis block.
-    assert(pa == pb);
-    return pa;
+    double dDownloadRate = 0;
+    for (const auto& entry : mapNodeState)
+        dDownloadRate += entry.second.blockDownloadStats.GetRate();
+    return ::GetBlockDownloadWindow(dDownloadRate, dValidationRate);
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
+ *  at most count entries. SolarCoin: If nothing can be fetched because of a block in flight from
+ *  another peer, that peer is nodeStaller and the block pindexStalled. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalled, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
 
@@ -562,12 +733,13 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than the download window + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + GetBlockDownloadWindow();
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -603,6 +775,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -613,6 +786,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -620,6 +794,59 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
 
 } // anon namespace
 
+void CBlockDownloadStats::BlockReceived(int64_t nNow, int64_t nRequested)
+{
+    // The time since the previous block only measures throughput if this one was requested by then
+    const int64_t nInterval = nNow - std::max(nLastBlockReceived, nRequested);
+    const int64_t nLatency = nNow - nRequested;
+    if (nBlocksDownloaded == 0) {
+        nBlockInterval = nInterval;
+        nBlockLatency = nLatency;
+    } else {
+        nBlockInterval = (7 * nBlockInterval + nInterval) / 8;
+        nBlockLatency = (7 * nBlockLatency + nLatency) / 8;
+    }
+    nLastBlockReceived = nNow;
+    nBlocksDownloaded++;
+    if (nBlocksDownloaded % BLOCK_STALL_FORGIVE_BLOCKS == 0 && nBlockStalls > 0)
+        nBlockStalls--;
+}
+
+bool CBlockDownloadStats::IsMeasured() const
+{
+    return nBlocksDownloaded >= BLOCK_DOWNLOAD_MIN_SAMPLES;
+}
+
+double CBlockDownloadStats::GetRate() const
+{
+    if (!IsMeasured())
+        return 0;
+    return 1000000.0 / std::max<int64_t>(1, nBlockInterval);
+}
+
+int CBlockDownloadStats::GetBlocksInTransitLimit() const
+{
+    if (!IsMeasured())
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nLimit = BLOCKS_IN_TRANSIT_TARGET_TIME * 1000000 / std::max<int64_t>(1, nBlockInterval);
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, nLimit));
+}
+
+bool CBlockDownloadStats::IsStalling() const
+{
+    return nBlockStalls >= MAX_BLOCK_STALLS;
+}
+
+unsigned int GetBlockDownloadWindow(double dDownloadRate, double dValidationRate)
+{
+    double dRate = dDownloadRate;
+    if (dValidationRate > 0 && (dRate == 0 || dValidationRate < dRate))
+        dRate = dValidationRate;
+    if (dRate == 0)
+        return BLOCK_DOWNLOAD_WINDOW;
+    return std::max<double>(MIN_BLOCK_DOWNLOAD_WINDOW, std::min<double>(MAX_BLOCK_DOWNLOAD_WINDOW, dRate * BLOCK_DOWNLOAD_WINDOW_TIME));
+}
+
 // DEBUG: 0.15.1
 // This function is used for testing the stale tip eviction logic, see
 // DoS_tests.cpp
@@ -647,6 +874,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+    stats.nBlocksDownloaded = state->blockDownloadStats.nBlocksDownloaded;
+    stats.nBlockInterval = state->blockDownloadStats.nBlockInterval;
+    stats.nBlockLatency = state->blockDownloadStats.nBlockLatency;
+    stats.nBlocksInTransitLimit = state->blockDownloadStats.GetBlocksInTransitLimit();
+    stats.nBlockStalls = state->blockDownloadStats.nBlockStalls;
     BOOST_FOREACH(const QueuedBlock& queue, state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
@@ -654,6 +886,16 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     return true;
 }
 
+size_t GetOrphanTxMemoryUsage()
+{
+    LOCK(cs_main);
+    size_t nUsage = nOrphanTxUsage + memusage::DynamicUsage(mapOrphanTransactions) + memusage::DynamicUsage(mapOrphanTransactionsByPrev) +
+        memusage::DynamicUsage(mapOrphanTxUsageByPeer);
+    for (const auto& entry : mapOrphanTransactionsByPrev)
+        nUsage += memusage::DynamicUsage(entry.second);
+    return nUsage;
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
@@ -706,16 +948,30 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
         return false;
     }
 
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
+    // SolarCoin: a peer may fill only its share of the orphan memory, so one peer cannot push out
+    // the orphans of all others
+    size_t nUsage = RecursiveDynamicUsage(*tx);
+    size_t nMaxPeerUsage = (size_t)std::max((int64_t)0, GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TX_SIZE)) * 1000 / ORPHAN_TX_PEER_SHARE;
+    std::map<NodeId, size_t>::const_iterator itPeer = mapOrphanTxUsageByPeer.find(peer);
+    size_t nPeerUsage = itPeer == mapOrphanTxUsageByPeer.end() ? 0 : itPeer->second;
+    if (nPeerUsage + nUsage > nMaxPeerUsage)
+    {
+        LogPrint("mempool", "ignoring orphan tx over the quota of peer=%d (usage: %u, hash: %s)\n", peer, nPeerUsage, hash.ToString());
+        return false;
+    }
+
+    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, nUsage});
     assert(ret.second);
     BOOST_FOREACH(const CTxIn& txin, tx->vin) {
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
+    nOrphanTxUsage += nUsage;
+    mapOrphanTxUsageByPeer[peer] += nUsage;
 
     AddToCompactExtraTransactions(tx);
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u usage %u)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), nOrphanTxUsage);
     return true;
 }
 
@@ -733,6 +989,12 @@ int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+    nOrphanTxUsage -= it->second.nUsage;
+    std::map<NodeId, size_t>::iterator itPeer = mapOrphanTxUsageByPeer.find(it->second.fromPeer);
+    assert(itPeer != mapOrphanTxUsageByPeer.end() && itPeer->second >= it->second.nUsage);
+    itPeer->second -= it->second.nUsage;
+    if (itPeer->second == 0)
+        mapOrphanTxUsageByPeer.erase(itPeer);
     mapOrphanTransactions.erase(it);
     return 1;
 }
@@ -753,7 +1015,7 @@ void EraseOrphansFor(NodeId peer)
 }
 
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphanUsage) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     unsigned int nEvicted = 0;
     static int64_t nNextSweep;
@@ -776,7 +1038,7 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRE
         nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
         if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx due to expiration\n", nErased);
     }
-    while (mapOrphanTransactions.size() > nMaxOrphans)
+    while (mapOrphanTransactions.size() > nMaxOrphans || nOrphanTxUsage > nMaxOrphanUsage)
     {
         // Evict a random orphan:
         uint256 randomhash = GetRandHash();
@@ -861,6 +1123,99 @@ static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
 
+/**
+ * SolarCoin: The bloom filter match data of the block last sent filtered. Most SPV peers ask for
+ * the same new block, so its scripts are parsed once for all of them.
+ */
+static CCriticalSection cs_filtered_block;
+static std::shared_ptr<const CBloomBlockElements> filtered_block_elements;
+static uint256 filtered_block_hash;
+
+static std::shared_ptr<const CBloomBlockElements> GetFilteredBlockElements(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    LOCK(cs_filtered_block);
+    if (!filtered_block_elements || filtered_block_hash != hash) {
+        filtered_block_elements = std::make_shared<const CBloomBlockElements>(pblock);
+        filtered_block_hash = hash;
+    }
+    return filtered_block_elements;
+}
+
+/**
+ * SolarCoin: LRU cache of recently served blocks in their wire form, keyed by block hash and
+ * serialization flags, within the memory budget of -blockservecache. A new block is requested by
+ * most peers at once, and syncing peers ask for the same ranges; a hit skips reading the block
+ * from disk (and scrypt for PoW blocks), serializing it and hashing the payload for the header.
+ */
+class CServedBlockCache
+{
+public:
+    struct Entry
+    {
+        CSegmentedBuffer data; //!< shares its segments with the messages made from it
+        uint256 hashData;
+    };
+
+private:
+    typedef std::pair<uint256, int> Key;
+    typedef std::list<std::pair<Key, std::shared_ptr<const Entry> > > EntryList;
+    typedef std::map<Key, EntryList::iterator> EntryMap;
+
+    CCriticalSection cs;
+    EntryList listEntries; //!< most recently used first
+    EntryMap mapEntries;
+    size_t nBytes;
+
+public:
+    CServedBlockCache() : nBytes(0) {}
+
+    std::shared_ptr<const Entry> Get(const uint256& hash, int nSendFlags)
+    {
+        LOCK(cs);
+        EntryMap::iterator it = mapEntries.find(std::make_pair(hash, nSendFlags));
+        if (it == mapEntries.end())
+            return nullptr;
+        listEntries.splice(listEntries.begin(), listEntries, it->second);
+        return it->second->second;
+    }
+
+    void Insert(const uint256& hash, int nSendFlags, std::shared_ptr<const Entry> entry)
+    {
+        size_t nMaxBytes = GetArg("-blockservecache", DEFAULT_BLOCK_SERVE_CACHE) * 1024 * 1024;
+        if (entry->data.size() > nMaxBytes)
+            return;
+        LOCK(cs);
+        Key key = std::make_pair(hash, nSendFlags);
+        if (mapEntries.count(key))
+            return;
+        listEntries.push_front(std::make_pair(key, entry));
+        mapEntries.insert(std::make_pair(key, listEntries.begin()));
+        nBytes += entry->data.size();
+        while (nBytes > nMaxBytes) {
+            nBytes -= listEntries.back().second->data.size();
+            mapEntries.erase(listEntries.back().first);
+            listEntries.pop_back();
+        }
+    }
+};
+
+static CServedBlockCache servedBlockCache;
+
+/** SolarCoin: Push a serialized full block to pfrom, keeping a copy in servedBlockCache. */
+static void PushServedBlock(CNode* pfrom, const uint256& hash, int nSendFlags, CSegmentedBuffer&& data, bool fHistorical, CConnman& connman)
+{
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::BLOCK;
+    msg.data = std::move(data);
+    msg.fHistorical = fHistorical;
+    std::shared_ptr<CServedBlockCache::Entry> entry = std::make_shared<CServedBlockCache::Entry>();
+    entry->data = msg.data;
+    entry->hashData = msg.data.GetHash();
+    msg.hashData = entry->hashData;
+    servedBlockCache.Insert(hash, nSendFlags, entry);
+    connman.PushMessage(pfrom, std::move(msg));
+}
+
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
@@ -882,7 +1237,12 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_compact_block = pcmpctblock;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    // SolarCoin: With 60 second spacing, a PoST block, which only gets here once its kernel and
+    // signature checked, goes to every peer that negotiated compact blocks rather than to the
+    // high-bandwidth ones only. Such peers don't ban for a compact block that fails to connect.
+    bool fProofOfStake = pblock->IsProofOfStake();
+
+    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, fProofOfStake, &hashBlock](CNode* pnode) {
         // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
@@ -890,7 +1250,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         CNodeState &state = *State(pnode->GetId());
         // If the peer has, or we announced to them the previous block already,
         // but we don't think they have this one, go ahead and announce it
-        if (state.fPreferHeaderAndIDs && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
+        if ((state.fPreferHeaderAndIDs || (fProofOfStake && state.fSupportsDesiredCmpctVersion)) && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
                 !PeerHasHeader(&state, pindex) && PeerHasHeader(&state, pindex->pprev)) {
 
             LogPrint("net", "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
@@ -1118,12 +1478,13 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                 recentRejects->reset();
             }
 
-            // Use pcoinsTip->HaveCoinsInCache as a quick approximation to exclude
+            // Use pcoinsTip->HaveCoinInCache as a quick approximation to exclude
             // requesting or processing some txs which have already been included in a block
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoinsInCache(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_BLOCK:
     case MSG_WITNESS_BLOCK:
@@ -1136,6 +1497,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 static void RelayTransaction(const CTransaction& tx, CConnman& connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
+    txAnnouncementBatch.Queue(inv.hash, GetTimeMicros());
     connman.ForEachNode([&inv](CNode* pnode)
     {
         pnode->PushInventory(inv);
@@ -1178,12 +1540,198 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/**
+ * SolarCoin: Serve one block request. What to send is decided under cs_main, but the block is
+ * read and serialized without it, so serving old blocks does not stall the other message
+ * handler threads and validation.
+ */
+void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensusParams, const CInv& inv, CConnman& connman)
+{
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    std::shared_ptr<const CBlock> a_recent_block;
+    {
+        LOCK(cs_most_recent_block);
+        a_recent_block = most_recent_block;
+    }
+    bool need_activate_chain = false;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        if (mi != mapBlockIndex.end() && mi->second->nChainTx && !mi->second->IsValid(BLOCK_VALID_SCRIPTS) &&
+                mi->second->IsValid(BLOCK_VALID_TREE)) {
+            // If we have the block and all of its parents, but have not yet validated it,
+            // we might be in the middle of connecting it (ie in the unlock of cs_main
+            // before ActivateBestChain but after AcceptBlock).
+            // In this case, we need to run ActivateBestChain prior to checking the relay
+            // conditions below.
+            need_activate_chain = true;
+        }
+    }
+    if (need_activate_chain) {
+        CValidationState dummy;
+        ActivateBestChain(dummy, Params(), a_recent_block);
+    }
+
+    bool send = false;
+    CBlockIndex indexRead;
+    bool fCompact = false;
+    bool fPeerWantsWitness = false;
+    int nSendFlags = 0;
+    bool fFullBlock = false;
+    bool fRawBlock = false;
+    bool fHistorical = false;
+    uint256 hashContinueTip;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        if (mi != mapBlockIndex.end())
+        {
+            if (chainActive.Contains(mi->second)) {
+                send = true;
+            } else {
+                static const int nOneMonth = 30 * 24 * 60 * 60;
+                // To prevent fingerprinting attacks, only send blocks outside of the active
+                // chain if they are valid, and no more than a month older (both in time, and in
+                // best equivalent proof of work) than the best header chain we know about.
+                send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                    (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                    (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
+                if (!send) {
+                    LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                }
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        // never disconnect whitelisted nodes
+        static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
+        if (send && connman.OutboundTargetReached(true) && ( ((pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
+        {
+            LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+
+            //disconnect node
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        send = send && (mi->second->nStatus & BLOCK_HAVE_DATA);
+        if (send) {
+            // A copy of the index entry, so the block can be read from disk after cs_main is released
+            indexRead = *mi->second;
+            fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            fCompact = CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+            if (inv.type == MSG_BLOCK)
+                nSendFlags = SERIALIZE_TRANSACTION_NO_WITNESS;
+            else if (inv.type == MSG_CMPCT_BLOCK)
+                nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            fFullBlock = inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fCompact);
+            // Full blocks are copied from the block file when the stored bytes are what the peer asked for
+            fRawBlock = fFullBlock && IsRawBlockSerialization(mi->second, nSendFlags, consensusParams);
+            // SolarCoin: old blocks go out in the lowest send lane, within the historical -uploadrate
+            fHistorical = pindexBestHeader != NULL && pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek;
+            if (inv.hash == pfrom->hashContinue)
+                hashContinueTip = chainActive.Tip()->GetBlockHash();
+        }
+    }
+    if (!send)
+        return;
+
+    // Full blocks are sent from servedBlockCache when they were served recently
+    std::shared_ptr<const CServedBlockCache::Entry> cached;
+    if (fFullBlock)
+        cached = servedBlockCache.Get(inv.hash, nSendFlags);
+
+    std::shared_ptr<const CBlock> pblock;
+    std::vector<unsigned char> vchRawBlock;
+    if (cached) {
+        // no need for the block itself
+    } else if (a_recent_block && a_recent_block->GetHash() == inv.hash) {
+        pblock = a_recent_block;
+    } else if (fRawBlock) {
+        if (!ReadRawBlockFromDisk(vchRawBlock, &indexRead, Params().MessageStart())) {
+            LogPrintf("%s: cannot load block %s from disk, disconnecting peer=%d\n", __func__, inv.hash.ToString(), pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return;
+        }
+    } else {
+        // Send block from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, &indexRead, consensusParams)) {
+            // The block may have been pruned since cs_main was released
+            LogPrintf("%s: cannot load block %s from disk, disconnecting peer=%d\n", __func__, inv.hash.ToString(), pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return;
+        }
+        pblock = pblockRead;
+    }
+    if (fFullBlock)
+    {
+        if (cached) {
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            msg.data = cached->data;
+            msg.hashData = cached->hashData;
+            msg.fHistorical = fHistorical;
+            connman.PushMessage(pfrom, std::move(msg));
+        } else if (pblock) {
+            PushServedBlock(pfrom, inv.hash, nSendFlags, std::move(msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock).data), fHistorical, connman);
+        } else
+            PushServedBlock(pfrom, inv.hash, nSendFlags, CSegmentedBuffer(std::move(vchRawBlock)), fHistorical, connman);
+    }
+    else if (inv.type == MSG_FILTERED_BLOCK)
+    {
+        bool sendMerkleBlock = false;
+        CMerkleBlock merkleBlock;
+        {
+            LOCK(pfrom->cs_filter);
+            if (pfrom->pfilter) {
+                sendMerkleBlock = true;
+                merkleBlock = CMerkleBlock(*GetFilteredBlockElements(inv.hash, pblock), *pfrom->pfilter);
+            }
+        }
+        if (sendMerkleBlock) {
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+            // This avoids hurting performance by pointlessly requiring a round-trip
+            // Note that there is currently no way for a node to request any single transactions we didn't send here -
+            // they must either disconnect and retry or request the full block.
+            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+            // however we MUST always provide at least what the remote peer needs
+            typedef std::pair<unsigned int, uint256> PairType;
+            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
+        }
+        // else
+            // no response
+    }
+    else if (inv.type == MSG_CMPCT_BLOCK)
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+        connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+    }
+
+    // Trigger the peer node to send a getblocks request for the next batch of inventory
+    if (!hashContinueTip.IsNull())
+    {
+        // Bypass PushInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, hashContinueTip));
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom->hashContinue.SetNull();
+    }
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    LOCK(cs_main);
 
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -1199,125 +1747,11 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
             {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                std::shared_ptr<const CBlock> a_recent_block;
-                {
-                    LOCK(cs_most_recent_block);
-                    a_recent_block = most_recent_block;
-                }
-                if (mi != mapBlockIndex.end())
-                {
-                    if (mi->second->nChainTx && !mi->second->IsValid(BLOCK_VALID_SCRIPTS) &&
-                            mi->second->IsValid(BLOCK_VALID_TREE)) {
-                        // If we have the block and all of its parents, but have not yet validated it,
-                        // we might be in the middle of connecting it (ie in the unlock of cs_main
-                        // before ActivateBestChain but after AcceptBlock).
-                        // In this case, we need to run ActivateBestChain prior to checking the relay
-                        // conditions below.
-                        CValidationState dummy;
-                        ActivateBestChain(dummy, Params(), a_recent_block);
-                    }
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-                        }
-                    }
-                }
-                // disconnect node in case we have reached the outbound limit for serving historical blocks
-                // never disconnect whitelisted nodes
-                static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
-                if (send && connman.OutboundTargetReached(true) && ( ((pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
-                {
-                    LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
-
-                    //disconnect node
-                    pfrom->fDisconnect = true;
-                    send = false;
-                }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
-                {
-                    std::shared_ptr<const CBlock> pblock;
-                    if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
-                        pblock = a_recent_block;
-                    } else {
-                        // Send block from disk
-                        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-                        if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
-                            assert(!"cannot load block from disk");
-                        pblock = pblockRead;
-                    }
-                    if (inv.type == MSG_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-                    else if (inv.type == MSG_FILTERED_BLOCK)
-                    {
-                        bool sendMerkleBlock = false;
-                        CMerkleBlock merkleBlock;
-                        {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                sendMerkleBlock = true;
-                                merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
-                            }
-                        }
-                        if (sendMerkleBlock) {
-                            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
-                        }
-                        // else
-                            // no response
-                    }
-                    else if (inv.type == MSG_CMPCT_BLOCK)
-                    {
-                        // If a peer is asking for old blocks, we're almost guaranteed
-                        // they won't have a useful mempool to match against a compact block,
-                        // and we don't feel like constructing the object for them, so
-                        // instead we respond with the full, non-compact block.
-                        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                        int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                        if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                            connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                        } else
-                            connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
-                    }
-
-                    // Trigger the peer node to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue)
-                    {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        std::vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-                        pfrom->hashContinue.SetNull();
-                    }
-                }
+                ProcessGetBlockData(pfrom, consensusParams, inv, connman);
             }
             else if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX)
             {
+                LOCK(cs_main);
                 // Send stream from relay memory
                 bool push = false;
                 auto mi = mapRelay.find(inv.hash);
@@ -1610,6 +2044,7 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
 
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
+    PROFILE_SCOPE("ProcessMessage");
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
     if (IsArgSet("-dropmessagestest") && GetRand(GetArg("-dropmessagestest", 0)) == 0)
     {
@@ -1787,7 +2222,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             }
 
             // Get recent addresses
-            if (pfrom->fOneShot || pfrom->nVersion >= CADDR_TIME_VERSION || connman.GetAddressCount() < 1000)
+            if (!pfrom->fBlockRelayOnly && (pfrom->fOneShot || pfrom->nVersion >= CADDR_TIME_VERSION || connman.GetAddressCount() < 1000))
             {
                 connman.PushMessage(pfrom, CNetMsgMaker(nSendVersion).Make(NetMsgType::GETADDR));
                 pfrom->fGetAddr = true;
@@ -1883,6 +2318,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // Don't want addr from older versions unless seeding
         if (pfrom->nVersion < CADDR_TIME_VERSION && connman.GetAddressCount() > 1000)
             return true;
+        // SolarCoin: nor over block-relay-only connections
+        if (pfrom->fBlockRelayOnly)
+            return true;
         if (vAddr.size() > 1000)
         {
             LOCK(cs_main);
@@ -1968,6 +2406,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // Allow whitelisted peers to send data other than blocks in blocks only mode if whitelistrelay is true
         if (pfrom->fWhitelisted && GetBoolArg("-whitelistrelay", DEFAULT_WHITELISTRELAY))
             fBlocksOnly = false;
+        // SolarCoin: we asked the peer not to relay transactions over a block-relay-only connection
+        if (pfrom->fBlockRelayOnly)
+            fBlocksOnly = true;
 
         LOCK(cs_main);
 
@@ -1997,13 +2438,19 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     // fell back to inv we probably have a reorg which we should get the headers for first,
                     // we now only provide a getheaders response here. When we receive the headers, we will
                     // then ask for the blocks we need.
-                    // SolarCoin: Despite the comment above, we need to request the block if the peer is at
-                    // legacy protocol version 70005.
-                    if (pfrom->nVersion == LEGACY_PROTOCOL_VERSION) {
-                        pfrom->AskFor(inv);
-                    } else {
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash));
-                        LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash));
+                    LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    // SolarCoin: Legacy 70005 peers only announce blocks by inv. During initial block download
+                    // the getheaders above makes their chain known like any other peer's, so their blocks are
+                    // scheduled over all peers by FindNextBlocksToDownload, and a peer that stalls the window
+                    // is disconnected and replaced. Near the tip the announced block is also requested right
+                    // away to save the headers round trip, but it is tracked in mapBlocksInFlight so that a
+                    // legacy peer which does not deliver times out like any other.
+                    if (pfrom->nVersion == LEGACY_PROTOCOL_VERSION && !IsInitialBlockDownload() &&
+                            State(pfrom->GetId())->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                        vToFetch.push_back(CInv(MSG_BLOCK | nFetchFlags, inv.hash));
+                        MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
+                        LogPrint("net", "Requesting block %s from legacy peer=%d\n", inv.hash.ToString(), pfrom->id);
                     }
                 }
             }
@@ -2013,7 +2460,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 if (fBlocksOnly)
                     LogPrint("net", "transaction (%s) inv sent in violation of protocol peer=%d\n", inv.hash.ToString(), pfrom->id);
                 else if (!fAlreadyHave && !fImporting && !fReindex && !IsInitialBlockDownload())
-                    pfrom->AskFor(inv);
+                    txRequestTracker.ReceivedInv(pfrom->GetId(), inv.hash, !pfrom->fInbound || pfrom->fWhitelisted, GetTimeMicros());
             }
 
             // Track requests for our stuff
@@ -2219,7 +2666,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     {
         // Stop processing the transaction early if
         // We are in blocks only mode and peer is either not whitelisted or whitelistrelay is off
-        if (!fRelayTxes && (!pfrom->fWhitelisted || !GetBoolArg("-whitelistrelay", DEFAULT_WHITELISTRELAY)))
+        if ((!fRelayTxes && (!pfrom->fWhitelisted || !GetBoolArg("-whitelistrelay", DEFAULT_WHITELISTRELAY))) || pfrom->fBlockRelayOnly)
         {
             LogPrint("net", "transaction sent in violation of protocol peer=%d\n", pfrom->id);
             return true;
@@ -2234,19 +2681,39 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // SolarCoin: run its scripts before the acceptance below, without holding cs_main; the
+        // acceptance then finds them in the script execution cache, or is not needed if they fail
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            fAlreadyHave = AlreadyHave(inv);
+        }
+        std::vector<CValidationState> vScriptsState;
+        if (!fAlreadyHave)
+            PreVerifyTransactionScripts(std::vector<CTransactionRef>(1, ptx), &vScriptsState);
+
+        bool fAccepted = false;
+        std::list<CTransactionRef> lRemovedTxn;
+
+        {
         LOCK(cs_main);
 
         bool fMissingInputs = false;
         CValidationState state;
 
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
+        txRequestTracker.ReceivedResponse(pfrom->GetId(), inv.hash);
 
-        std::list<CTransactionRef> lRemovedTxn;
+        if (!AlreadyHave(inv)) {
+            if (!vScriptsState.empty() && !vScriptsState[0].IsValid())
+                state = vScriptsState[0];
+            else
+                fAccepted = AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, &lRemovedTxn);
+        }
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, &lRemovedTxn)) {
+        if (fAccepted) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx, connman);
+            txRequestTracker.ForgetTxHash(tx.GetHash());
             for (unsigned int i = 0; i < tx.vout.size(); i++) {
                 vWorkQueue.emplace_back(inv.hash, i);
             }
@@ -2257,67 +2724,6 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 pfrom->id,
                 tx.GetHash().ToString(),
                 mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            std::set<NodeId> setMisbehaving;
-            while (!vWorkQueue.empty()) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
-                vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const CTransactionRef& porphanTx = (*mi)->second.tx;
-                    const CTransaction& orphanTx = *porphanTx;
-                    const uint256& orphanHash = orphanTx.GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2, &lRemovedTxn)) {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx, connman);
-                        for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanHash, i);
-                        }
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
-                            // Do not use rejection cache for witness transactions or
-                            // witness-stripped transactions, as they can have been malleated.
-                            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                            assert(recentRejects);
-                            recentRejects->insert(orphanHash);
-                        }
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
         }
         else if (fMissingInputs)
         {
@@ -2333,13 +2739,14 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 BOOST_FOREACH(const CTxIn& txin, tx.vin) {
                     CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
                     pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+                    if (!AlreadyHave(_inv)) txRequestTracker.ReceivedInv(pfrom->GetId(), _inv.hash, !pfrom->fInbound || pfrom->fWhitelisted, GetTimeMicros());
                 }
                 AddOrphanTx(ptx, pfrom->GetId());
 
                 // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                size_t nMaxOrphanTxUsage = (size_t)std::max((int64_t)0, GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TX_SIZE)) * 1000;
+                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanTxUsage);
                 if (nEvicted > 0)
                     LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
             } else {
@@ -2383,6 +2790,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         for (const CTransactionRef& removedTx : lRemovedTxn)
             AddToCompactExtraTransactions(removedTx);
+        lRemovedTxn.clear();
 
         int nDoS = 0;
         if (state.IsInvalid(nDoS))
@@ -2397,6 +2805,106 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 Misbehaving(pfrom->GetId(), nDoS);
             }
         }
+        }
+
+        // Recursively process any orphan transactions that depended on this one
+        // SolarCoin: a round at a time: the orphans spending the outputs queued by the previous
+        // round have their scripts verified together, against one coins view, on the script
+        // check threads and without holding cs_main, before they are accepted one by one
+        std::set<NodeId> setMisbehaving;
+        std::set<uint256> setOrphansDone;
+        while (fAccepted && !vWorkQueue.empty()) {
+            std::vector<CTransactionRef> vRound;
+            std::vector<NodeId> vRoundPeers;
+            {
+                LOCK(cs_main);
+                std::set<uint256> setRound;
+                for (const COutPoint& outpoint : vWorkQueue) {
+                    auto itByPrev = mapOrphanTransactionsByPrev.find(outpoint);
+                    if (itByPrev == mapOrphanTransactionsByPrev.end())
+                        continue;
+                    for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
+                        const uint256& orphanHash = (*mi)->first;
+                        if (setOrphansDone.count(orphanHash) || !setRound.insert(orphanHash).second)
+                            continue;
+                        vRound.push_back((*mi)->second.tx);
+                        vRoundPeers.push_back((*mi)->second.fromPeer);
+                    }
+                }
+            }
+            vWorkQueue.clear();
+            std::vector<CValidationState> vRoundState;
+            if (!vRound.empty())
+                PreVerifyTransactionScripts(vRound, &vRoundState);
+
+            LOCK(cs_main);
+            for (size_t nOrphan = 0; nOrphan < vRound.size(); nOrphan++)
+            {
+                const CTransactionRef& porphanTx = vRound[nOrphan];
+                const CTransaction& orphanTx = *porphanTx;
+                const uint256& orphanHash = orphanTx.GetHash();
+                NodeId fromPeer = vRoundPeers[nOrphan];
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+
+                if (setMisbehaving.count(fromPeer))
+                    continue;
+                // Accepted or dropped from another peer's transaction while cs_main was not held
+                if (!mapOrphanTransactions.count(orphanHash))
+                    continue;
+                bool fOrphanAccepted = false;
+                if (!vRoundState[nOrphan].IsValid())
+                    stateDummy = vRoundState[nOrphan];
+                else
+                    fOrphanAccepted = AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2, &lRemovedTxn);
+                if (fOrphanAccepted) {
+                    LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(orphanTx, connman);
+                    txRequestTracker.ForgetTxHash(orphanHash);
+                    for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
+                        vWorkQueue.emplace_back(orphanHash, i);
+                    }
+                    vEraseQueue.push_back(orphanHash);
+                    setOrphansDone.insert(orphanHash);
+                }
+                else if (!fMissingInputs2)
+                {
+                    int nDos = 0;
+                    if (stateDummy.IsInvalid(nDos) && nDos > 0)
+                    {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
+                    }
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee/priority
+                    LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+                    vEraseQueue.push_back(orphanHash);
+                    setOrphansDone.insert(orphanHash);
+                    if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
+                        // Do not use rejection cache for witness transactions or
+                        // witness-stripped transactions, as they can have been malleated.
+                        // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+                        assert(recentRejects);
+                        recentRejects->insert(orphanHash);
+                    }
+                }
+                mempool.check(pcoinsTip);
+            }
+        }
+
+        if (!vEraseQueue.empty() || !lRemovedTxn.empty()) {
+            LOCK(cs_main);
+            BOOST_FOREACH(uint256 hash, vEraseQueue)
+                EraseOrphanTx(hash);
+            for (const CTransactionRef& removedTx : lRemovedTxn)
+                AddToCompactExtraTransactions(removedTx);
+        }
     }
 
 
@@ -2600,7 +3108,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 mapBlockSource.emplace(pblock->GetHash(), std::make_pair(pfrom->GetId(), false));
             }
             bool fNewBlock = false;
-            ProcessNewBlock(chainparams, pblock, true, &fNewBlock);
+            ProcessPeerBlock(pfrom, chainparams, pblock, true, &fNewBlock);
             if (fNewBlock)
                 pfrom->nLastBlockTime = GetTime();
 
@@ -2663,7 +3171,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 // though the block was successfully read, and rely on the
                 // handling in ProcessNewBlock to ensure the block index is
                 // updated, reject messages go out, etc.
-                MarkBlockAsReceived(resp.blockhash); // it is now an empty pointer
+                MarkBlockAsReceived(resp.blockhash, pfrom->GetId()); // it is now an empty pointer
                 fBlockRead = true;
                 // mapBlockSource is only used for sending reject messages and DoS scores,
                 // so the race between here and cs_main in ProcessNewBlock is fine.
@@ -2677,7 +3185,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             bool fNewBlock = false;
             // Since we requested this block (it was in mapBlocksInFlight), force it to be processed,
             // even if it would not be a candidate for new tip (missing previous block, chain not long enough, etc)
-            ProcessNewBlock(chainparams, pblock, true, &fNewBlock);
+            ProcessPeerBlock(pfrom, chainparams, pblock, true, &fNewBlock);
             if (fNewBlock) {
                 pfrom->nLastBlockTime = GetTime();
             } else {
@@ -2864,13 +3372,13 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
-            forceProcessing |= MarkBlockAsReceived(hash);
+            forceProcessing |= MarkBlockAsReceived(hash, pfrom->GetId());
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
         }
         bool fNewBlock = false;
-        ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
+        ProcessPeerBlock(pfrom, chainparams, pblock, forceProcessing, &fNewBlock);
         if (fNewBlock) {
             pfrom->nLastBlockTime = GetTime();
         } else {
@@ -2903,7 +3411,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman.GetAddresses();
         FastRandomContext insecure_rand;
         BOOST_FOREACH(const CAddress &addr, vAddr)
@@ -2927,6 +3438,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
+        if (pfrom->fBlockRelayOnly)
+        {
+            LogPrint("net", "Ignoring mempool request over block-relay-only connection. peer=%d\n", pfrom->GetId());
+            return true;
+        }
+
         LOCK(pfrom->cs_inventory);
         pfrom->fSendMempool = true;
     }
@@ -3081,8 +3598,16 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
     else if (strCommand == NetMsgType::NOTFOUND) {
-        // We do not care about the NOTFOUND message, but logging an Unknown Command
-        // message would be undesirable as we transmit it ourselves.
+        // SolarCoin: A peer that does not have a transaction we asked for lets the next one be asked
+        std::vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() <= MAX_INV_SZ) {
+            LOCK(cs_main);
+            for (const CInv& inv : vInv) {
+                if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX)
+                    txRequestTracker.ReceivedResponse(pfrom->GetId(), inv.hash);
+            }
+        }
     }
 
     else {
@@ -3127,6 +3652,7 @@ static bool SendRejectsAndCheckIfBanned(CNode* pnode, CConnman& connman)
 
 bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
+    PROFILE_SCOPE("ProcessMessages");
     const CChainParams& chainparams = Params();
     //
     // Message format
@@ -3196,8 +3722,13 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
             return fMoreWork;
         }
 
+        if (fCaptureMessages)
+            CaptureMessage(pfrom->addr, strCommand, (const unsigned char*)vRecv.data(), (const unsigned char*)vRecv.data() + vRecv.size(), true);
+
         // Process message
         bool fRet = false;
+        int64_t nProcessStart = GetTimeMicros();
+        TRACE3(net, inbound_message, pfrom->id, strCommand.c_str(), nMessageSize);
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
@@ -3234,6 +3765,11 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
         } catch (...) {
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
+        int64_t nProcessTime = GetTimeMicros() - nProcessStart;
+        pfrom->msgCounters.RecordProcessingTime(msg.nMsgType, nProcessTime);
+        TRACE5(net, processed_message, pfrom->id, strCommand.c_str(), nMessageSize, nProcessTime, fRet);
+
+        msg.ReleaseBuffer();
 
         if (!fRet) {
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -3245,25 +3781,9 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
     return fMoreWork;
 }
 
-class CompareInvMempoolOrder
-{
-    CTxMemPool *mp;
-public:
-    CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
-
 bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
+    PROFILE_SCOPE("SendMessages");
     const Consensus::Params& consensusParams = Params().GetConsensus();
     {
         // Don't send anything until the version handshake is complete
@@ -3322,6 +3842,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_vAddrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
@@ -3586,42 +4107,50 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
+                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons,
+                // by the place of each candidate in the shared announcement batch.
+                std::shared_ptr<const CTxAnnouncementBatch::Batch> batch = txAnnouncementBatch.Get(nNow);
+                std::vector<std::pair<size_t, uint256> > vInvTx;
+                {
+                    LOCK(pto->cs_inventory);
+                    vInvTx.reserve(pto->setInventoryTxToSend.size());
+                    for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); ) {
+                        auto mi = batch->mapRank.find(*it);
+                        if (mi != batch->mapRank.end()) {
+                            vInvTx.push_back(std::make_pair(mi->second, *it));
+                        } else if (mempool.exists(*it)) {
+                            // Not in a batch yet, or expired from it: announce it with the next one
+                            txAnnouncementBatch.Queue(*it, nNow);
+                        } else {
+                            // Not in the mempool anymore? don't bother sending it.
+                            pto->setInventoryTxToSend.erase(it++);
+                            continue;
+                        }
+                        it++;
+                    }
                 }
+                std::sort(vInvTx.begin(), vInvTx.end());
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
                     filterrate = pto->minFeeFilter;
                 }
-                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
-                // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    uint256 hash = *it;
+                for (size_t i = 0; i < vInvTx.size() && nRelayedTransactions < INVENTORY_BROADCAST_MAX; i++) {
+                    const uint256& hash = vInvTx[i].second;
                     // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
+                    {
+                        LOCK(pto->cs_inventory);
+                        pto->setInventoryTxToSend.erase(hash);
+                    }
                     // Check if not in the filter already
                     if (pto->filterInventoryKnown.contains(hash)) {
                         continue;
                     }
-                    // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
-                    if (!txinfo.tx) {
-                        continue;
-                    }
+                    TxMempoolInfo txinfo = batch->vTx[vInvTx[i].first];
                     if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
                         continue;
                     }
@@ -3663,6 +4192,13 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
             pto->fDisconnect = true;
             return true;
         }
+        // SolarCoin: A peer whose blocks at the lower edge of the window keep being fetched from faster peers
+        // holds the window back as well, only not for long enough to time out
+        if (state.blockDownloadStats.IsStalling()) {
+            LogPrintf("Peer=%d stalled block download %d times, disconnecting\n", pto->id, state.blockDownloadStats.nBlockStalls);
+            pto->fDisconnect = true;
+            return true;
+        }
         // In case there is a block that has been in flight from this peer for 2 + 0.5 * N times the block interval
         // (with N the number of peers from which we're downloading validated blocks), disconnect due to timeout.
         // We compensate for other peers to prevent killing off peers due to our own downstream link
@@ -3682,10 +4218,12 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const int nInTransitLimit = state.blockDownloadStats.GetBlocksInTransitLimit();
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nInTransitLimit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalled = NULL;
+            FindNextBlocksToDownload(pto->GetId(), nInTransitLimit - state.nBlocksInFlight, vToDownload, staller, pindexStalled, consensusParams);
             BOOST_FOREACH(const CBlockIndex *pindex, vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -3699,14 +4237,29 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                     LogPrint("net", "Stall started peer=%d\n", staller);
                 }
             }
+            // SolarCoin: If the block holding the window back has been in flight for a while from a peer slower
+            // than this one, ask this one for it too. The first to deliver it moves the window on.
+            if (staller != -1 && pindexStalled && state.blockDownloadStats.IsMeasured()) {
+                CNodeState* stateStaller = State(staller);
+                auto itInFlight = mapBlocksInFlight.find(pindexStalled->GetBlockHash());
+                if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == staller &&
+                        nNow - itInFlight->second.second->nTime > BLOCK_EDGE_REFETCH_TIMEOUT &&
+                        state.blockDownloadStats.GetRate() > stateStaller->blockDownloadStats.GetRate()) {
+                    stateStaller->blockDownloadStats.BlockStalled();
+                    LogPrint("net", "Refetching block %s (%d) stalled by peer=%d from peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                        pindexStalled->nHeight, staller, pto->id);
+                    vGetData.push_back(CInv(MSG_BLOCK | GetFetchFlags(pto, pindexStalled->pprev, consensusParams), pindexStalled->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexStalled->GetBlockHash(), consensusParams, pindexStalled);
+                }
+            }
         }
 
         //
         // Message: getdata (non-blocks)
         //
-        while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
+        for (const uint256& txid : txRequestTracker.GetRequestable(pto->GetId(), nNow))
         {
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
+            CInv inv(MSG_TX | GetFetchFlags(pto, chainActive.Tip(), consensusParams), txid);
             if (!AlreadyHave(inv))
             {
                 if (fDebug)
@@ -3718,10 +4271,9 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                     vGetData.clear();
                 }
             } else {
-                //If we're not going to ask, don't expect a response.
-                pto->setAskFor.erase(inv.hash);
+                // Nobody needs to be asked for it anymore
+                txRequestTracker.ForgetTxHash(txid);
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
         if (!vGetData.empty())
             connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
@@ -3730,13 +4282,13 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
         // Message: feefilter
         //
         // We don't want white listed peers to filter txs to us if we have -whitelistforcerelay
-        if (pto->nVersion >= FEEFILTER_VERSION && GetBoolArg("-feefilter", DEFAULT_FEEFILTER) &&
+        if (pto->nVersion >= FEEFILTER_VERSION && GetBoolArg("-feefilter", DEFAULT_FEEFILTER) && !pto->fBlockRelayOnly &&
             !(pto->fWhitelisted && GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY))) {
             CAmount currentFilter = mempool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
             int64_t timeNow = GetTimeMicros();
             if (timeNow > pto->nextSendTimeFeeFilter) {
-                static CFeeRate default_feerate(DEFAULT_MIN_RELAY_TX_FEE);
-                static FeeFilterRounder filterRounder(default_feerate);
+                // SolarCoin: Space the buckets from our own -minrelaytxfee rather than the default
+                static FeeFilterRounder filterRounder(::minRelayTxFee);
                 CAmount filterToSend = filterRounder.round(currentFilter);
                 // If we don't allow free transactions, then we always have a fee filter of at least minRelayTxFee
                 if (GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) <= 0)
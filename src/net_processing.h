@@ -12,12 +12,26 @@
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** SolarCoin: Default for -maxorphantxsize, maximum memory of the orphan transactions in kilobytes */
+static const unsigned int DEFAULT_MAX_ORPHAN_TX_SIZE = 10000;
+/** SolarCoin: The orphan transactions of one peer may use at most 1/n of -maxorphantxsize */
+static const unsigned int ORPHAN_TX_PEER_SHARE = 4;
 /** Expiration time for orphan transactions in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** SolarCoin: Default for -blockservecache, megabytes of served blocks kept in their wire form (0 to disable) */
+static const unsigned int DEFAULT_BLOCK_SERVE_CACHE = 16;
+/** SolarCoin: Least time between rebuilds of the shared transaction announcement batch, in microseconds; a new peer forces one */
+static const int64_t TX_ANNOUNCEMENT_BATCH_INTERVAL = 1000000;
+/** SolarCoin: Time a transaction stays in the announcement batch, in microseconds; peers that still hold it queue it again */
+static const int64_t TX_ANNOUNCEMENT_EXPIRY = 60 * 1000000;
+/** SolarCoin: Time a peer's PoST blocks may spend failing proof-of-stake checks before they are ignored, in microseconds */
+static const int64_t MAX_STAKE_PROOF_BUDGET = 1000000;
+/** SolarCoin: Rate the proof-of-stake check budget of a peer refills at, in microseconds per second */
+static const int64_t STAKE_PROOF_BUDGET_RATE = 10000;
 /** Headers download timeout expressed in microseconds
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
@@ -35,6 +49,43 @@ static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 /** Minimum time an outbound-peer-eviction candidate must be connected for, in order to evict, in seconds */
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
 
+/** SolarCoin: Statistics of the requested blocks a peer delivered, which size its share of the block download (protected by cs_main) */
+struct CBlockDownloadStats
+{
+    //! Requested blocks the peer delivered
+    int nBlocksDownloaded;
+    //! Moving average of the time between those blocks while some were in flight, in microseconds
+    int64_t nBlockInterval;
+    //! Moving average of the time from request to arrival of those blocks, in microseconds
+    int64_t nBlockLatency;
+    //! When the last of those blocks arrived, in microseconds
+    int64_t nLastBlockReceived;
+    //! Times the block at the lower edge of the download window was refetched from a faster peer
+    int nBlockStalls;
+
+    CBlockDownloadStats() : nBlocksDownloaded(0), nBlockInterval(0), nBlockLatency(0), nLastBlockReceived(0), nBlockStalls(0) {}
+
+    /** Record the arrival at nNow of a block requested at nRequested; one stall is forgiven every BLOCK_STALL_FORGIVE_BLOCKS blocks */
+    void BlockReceived(int64_t nNow, int64_t nRequested);
+    /** Record that the block at the lower edge of the download window was refetched from a faster peer */
+    void BlockStalled() { nBlockStalls++; }
+    /** Whether the peer delivered enough blocks for its throughput to be used */
+    bool IsMeasured() const;
+    /** Blocks per second the peer delivers, 0 before it is measured */
+    double GetRate() const;
+    /** Blocks that may be in flight from the peer: enough for BLOCKS_IN_TRANSIT_TARGET_TIME of its throughput */
+    int GetBlocksInTransitLimit() const;
+    /** Whether the peer stalled the download too often to stay connected */
+    bool IsStalling() const;
+};
+
+/**
+ * SolarCoin: Size of the block download window, covering BLOCK_DOWNLOAD_WINDOW_TIME of the slower of
+ * the summed download rate of the peers and the rate the active chain grows at, in blocks per second
+ * (0 when not measured yet).
+ */
+unsigned int GetBlockDownloadWindow(double dDownloadRate, double dValidationRate);
+
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
@@ -65,10 +116,18 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    //! SolarCoin: Block download statistics, see CBlockDownloadStats
+    int nBlocksDownloaded;
+    int64_t nBlockInterval;
+    int64_t nBlockLatency;
+    int nBlocksInTransitLimit;
+    int nBlockStalls;
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/** SolarCoin: Bytes of memory used by the orphan transactions and their indexes */
+size_t GetOrphanTxMemoryUsage();
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
@@ -7,6 +7,7 @@
 #define BITCOIN_NETMESSAGEMAKER_H
 
 #include "net.h"
+#include "segmentedbuffer.h"
 #include "serialize.h"
 
 class CNetMsgMaker
@@ -19,7 +20,7 @@ public:
     {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
-        CVectorWriter{ SER_NETWORK, nFlags | nVersion, msg.data, 0, std::forward<Args>(args)... };
+        CSegmentedWriter{ SER_NETWORK, nFlags | nVersion, msg.data, std::forward<Args>(args)... };
         return msg;
     }
 
@@ -0,0 +1,246 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notify.h"
+
+#include "scheduler.h"
+#include "util.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <boost/algorithm/string/replace.hpp>
+
+namespace {
+
+/** The notification a command runs for, and the command */
+typedef std::pair<std::string, std::string> NotifyKey;
+
+/** The arguments waiting for a notification command */
+struct CNotifyCommand
+{
+    std::deque<std::string> queue;
+    std::set<std::string> setQueued;
+    bool fReady; //!< in queueReady
+    uint64_t nDropped;
+
+    CNotifyCommand() : fReady(false), nDropped(0) {}
+};
+
+std::mutex cs_notify;
+std::condition_variable condNotify;
+std::map<NotifyKey, CNotifyCommand> mapNotifyCommands; //!< by notification and command, as one command can serve several
+std::deque<NotifyKey> queueReady; //!< commands with waiting arguments
+CScheduler* pNotifyScheduler = NULL;
+CScheduler::QueueId nNotifySchedulerQueue = -1; //!< capped at -notifythreads
+int nNotifyTasksRunning = 0;
+bool fNotifyRunning = false;
+size_t nNotifyBatch = DEFAULT_NOTIFY_BATCH;
+size_t nNotifyQueue = DEFAULT_NOTIFY_QUEUE;
+
+#ifndef WIN32
+/** Connections to the unix socket sinks, by path, reconnected after an error */
+std::mutex cs_notifySockets;
+std::map<std::string, int> mapNotifySockets;
+
+bool WriteNotifySocket(const std::string& strPath, const std::string& strLines)
+{
+    std::lock_guard<std::mutex> lock(cs_notifySockets);
+    for (int nTry = 0; nTry < 2; nTry++) {
+        std::map<std::string, int>::iterator it = mapNotifySockets.find(strPath);
+        if (it == mapNotifySockets.end()) {
+            struct sockaddr_un addr;
+            if (strPath.size() >= sizeof(addr.sun_path)) {
+                LogPrintf("%s: socket path too long: %s\n", __func__, strPath);
+                return false;
+            }
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            memcpy(addr.sun_path, strPath.data(), strPath.size());
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                return false;
+            if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                LogPrintf("%s: cannot connect to %s: %s\n", __func__, strPath, strerror(errno));
+                close(fd);
+                return false;
+            }
+            it = mapNotifySockets.insert(std::make_pair(strPath, fd)).first;
+        }
+        size_t nWritten = 0;
+        while (nWritten < strLines.size()) {
+            int flags = 0;
+#ifdef MSG_NOSIGNAL
+            flags |= MSG_NOSIGNAL;
+#endif
+            ssize_t n = send(it->second, strLines.data() + nWritten, strLines.size() - nWritten, flags);
+            if (n <= 0)
+                break;
+            nWritten += n;
+        }
+        if (nWritten == strLines.size())
+            return true;
+        close(it->second);
+        mapNotifySockets.erase(it);
+        // The listener went away: reconnect once, unless it got part of the lines already
+        if (nWritten > 0)
+            break;
+    }
+    LogPrintf("%s: write to %s failed\n", __func__, strPath);
+    return false;
+}
+
+void CloseNotifySockets()
+{
+    std::lock_guard<std::mutex> lock(cs_notifySockets);
+    for (const auto& item : mapNotifySockets)
+        close(item.second);
+    mapNotifySockets.clear();
+}
+#endif
+
+void RunNotification(const std::string& strName, const std::string& strCommand, const std::vector<std::string>& vArgs)
+{
+    if (strCommand.compare(0, strlen(NOTIFY_UNIX_PREFIX), NOTIFY_UNIX_PREFIX) == 0) {
+#ifndef WIN32
+        std::string strLines;
+        for (const std::string& strArg : vArgs)
+            strLines += strName + " " + strArg + "\n";
+        WriteNotifySocket(strCommand.substr(strlen(NOTIFY_UNIX_PREFIX)), strLines);
+#else
+        LogPrintf("%s: unix socket notifications are not supported on this platform\n", __func__);
+#endif
+        return;
+    }
+    std::string strArgs;
+    for (const std::string& strArg : vArgs)
+        strArgs += (strArgs.empty() ? "" : " ") + strArg;
+    std::string strCmd = strCommand;
+    boost::replace_all(strCmd, "%s", strArgs);
+    runCommand(strCmd);
+}
+
+void NotifyTask();
+
+/** Have the scheduler run a command with waiting arguments. cs_notify must be held. */
+void ScheduleNotifyTask()
+{
+    pNotifyScheduler->schedule(&NotifyTask, boost::chrono::system_clock::now(), nNotifySchedulerQueue);
+}
+
+void NotifyTask()
+{
+    std::unique_lock<std::mutex> lock(cs_notify);
+    if (!fNotifyRunning || queueReady.empty())
+        return;
+    NotifyKey key = queueReady.front();
+    queueReady.pop_front();
+    CNotifyCommand& command = mapNotifyCommands[key];
+    std::vector<std::string> vArgs;
+    while (!command.queue.empty() && vArgs.size() < nNotifyBatch) {
+        command.setQueued.erase(command.queue.front());
+        vArgs.push_back(std::move(command.queue.front()));
+        command.queue.pop_front();
+    }
+    // Another task takes the rest, so a burst of arguments runs up to the cap of the queue
+    command.fReady = !command.queue.empty();
+    if (command.fReady) {
+        queueReady.push_back(key);
+        ScheduleNotifyTask();
+    }
+    if (command.nDropped) {
+        LogPrintf("%s: %s dropped %u notifications as its queue was full\n", __func__, key.first, command.nDropped);
+        command.nDropped = 0;
+    }
+    nNotifyTasksRunning++;
+    lock.unlock();
+    try {
+        RunNotification(key.first, key.second, vArgs);
+    } catch (...) {
+        lock.lock();
+        nNotifyTasksRunning--;
+        condNotify.notify_all();
+        throw;
+    }
+    lock.lock();
+    nNotifyTasksRunning--;
+    condNotify.notify_all();
+}
+
+} // namespace
+
+void QueueNotification(const std::string& strName, const std::string& strCommand, const std::string& strArg, bool fLatestOnly)
+{
+    if (strCommand.empty())
+        return;
+    std::lock_guard<std::mutex> lock(cs_notify);
+    const NotifyKey key(strName, strCommand);
+    CNotifyCommand& command = mapNotifyCommands[key];
+    if (fLatestOnly) {
+        command.queue.clear();
+        command.setQueued.clear();
+    } else if (command.setQueued.count(strArg)) {
+        return;
+    }
+    if (command.queue.size() >= nNotifyQueue) {
+        command.setQueued.erase(command.queue.front());
+        command.queue.pop_front();
+        command.nDropped++;
+    }
+    command.queue.push_back(strArg);
+    command.setQueued.insert(strArg);
+    if (!command.fReady) {
+        command.fReady = true;
+        queueReady.push_back(key);
+        if (fNotifyRunning)
+            ScheduleNotifyTask();
+    }
+}
+
+void StartNotifications(CScheduler& scheduler, int nSchedulerThreads)
+{
+    std::lock_guard<std::mutex> lock(cs_notify);
+    if (fNotifyRunning)
+        return;
+    nNotifyBatch = std::max<int64_t>(1, GetArg("-notifybatch", DEFAULT_NOTIFY_BATCH));
+    nNotifyQueue = std::max<int64_t>(1, GetArg("-notifyqueue", DEFAULT_NOTIFY_QUEUE));
+    int nThreads = std::max(1, std::min<int>(GetArg("-notifythreads", DEFAULT_NOTIFY_THREADS), std::min(MAX_NOTIFY_THREADS, nSchedulerThreads - 1)));
+    if (pNotifyScheduler != &scheduler) {
+        pNotifyScheduler = &scheduler;
+        // Ahead of the periodic tasks, which can wait a little
+        nNotifySchedulerQueue = scheduler.addQueue("notify", nThreads, 1);
+    } else {
+        scheduler.setQueueLimit(nNotifySchedulerQueue, nThreads);
+    }
+    fNotifyRunning = true;
+    for (size_t i = 0; i < queueReady.size(); i++)
+        ScheduleNotifyTask();
+}
+
+void StopNotifications()
+{
+    {
+        std::unique_lock<std::mutex> lock(cs_notify);
+        fNotifyRunning = false;
+        // Tasks finish the command they are running; those not started yet return at once
+        while (nNotifyTasksRunning > 0)
+            condNotify.wait(lock);
+    }
+#ifndef WIN32
+    CloseNotifySockets();
+#endif
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NOTIFY_H
+#define BITCOIN_NOTIFY_H
+
+#include <string>
+
+class CScheduler;
+
+/** -notifythreads default: notification commands running at the same time on the scheduler threads */
+static const int DEFAULT_NOTIFY_THREADS = 2;
+/** Maximum of -notifythreads */
+static const int MAX_NOTIFY_THREADS = 16;
+/** -notifybatch default: arguments substituted for %s in one invocation of a notification command */
+static const int DEFAULT_NOTIFY_BATCH = 1;
+/** -notifyqueue default: arguments waiting for a notification command, beyond which the oldest are dropped */
+static const int DEFAULT_NOTIFY_QUEUE = 10000;
+/** Prefix of a notification command that writes to a unix socket instead of running a command */
+static const char NOTIFY_UNIX_PREFIX[] = "unix:";
+
+/**
+ * SolarCoin: Queue a notification of -blocknotify, -walletnotify or -alertnotify (strName, without
+ * the dash) for strCommand, with strArg as the value of %s. Arguments already waiting for the
+ * same command are not queued again, and with fLatestOnly only the newest one is kept. Tasks on a
+ * "notify" queue of the scheduler, capped at -notifythreads, run the command for up to
+ * -notifybatch waiting arguments at a time, separated
+ * by spaces in place of %s. A command "unix:<path>" writes a line "<name> <arg>" per argument to
+ * a persistent connection to the unix socket at path instead.
+ */
+void QueueNotification(const std::string& strName, const std::string& strCommand, const std::string& strArg, bool fLatestOnly = false);
+
+/**
+ * Start running the notifications on the nSchedulerThreads threads of scheduler. Notifications
+ * queued before are kept. -notifythreads is capped so that one of the threads is always left to
+ * the other queues, which slow notify commands would otherwise hold up.
+ */
+void StartNotifications(CScheduler& scheduler, int nSchedulerThreads);
+/** Stop running notifications, waiting for the commands running, and drop those still waiting */
+void StopNotifications();
+
+#endif // BITCOIN_NOTIFY_H
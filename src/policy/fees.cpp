@@ -286,7 +286,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
 // tracked. Txs that were part of a block have already been removed in
 // processBlockTx to ensure they are never double tracked, but it is
 // of no harm to try to remove them again.
-bool CBlockPolicyEstimator::removeTx(uint256 hash)
+bool CBlockPolicyEstimator::ApplyRemoveTx(const uint256& hash)
 {
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
@@ -309,12 +309,85 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
     }
     vfeelist.push_back(INF_FEERATE);
     feeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY);
+    medianFees = std::make_shared<const std::vector<double> >(feeStats.GetMaxConfirms(), -1);
 }
 
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
 {
-    unsigned int txHeight = entry.GetHeight();
-    uint256 hash = entry.GetTx().GetHash();
+    FeeEstimatorEvent event;
+    event.type = FeeEstimatorEvent::TX_ADDED;
+    event.fValidFeeEstimate = validFeeEstimate;
+    event.tx.hash = entry.GetTx().GetHash();
+    event.tx.nHeight = entry.GetHeight();
+    // Feerates are stored and reported as BTC-per-kb:
+    event.tx.nFeePerK = CFeeRate(entry.GetFee(), entry.GetTxSize()).GetFeePerK();
+    LOCK(cs_queue);
+    queueEvents.push_back(std::move(event));
+}
+
+void CBlockPolicyEstimator::removeTx(uint256 hash)
+{
+    FeeEstimatorEvent event;
+    event.type = FeeEstimatorEvent::TX_REMOVED;
+    event.tx.hash = hash;
+    LOCK(cs_queue);
+    queueEvents.push_back(std::move(event));
+}
+
+void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
+                                         std::vector<const CTxMemPoolEntry*>& entries)
+{
+    FeeEstimatorEvent event;
+    event.type = FeeEstimatorEvent::BLOCK;
+    event.nBlockHeight = nBlockHeight;
+    event.vBlockTxs.reserve(entries.size());
+    for (const CTxMemPoolEntry* entry : entries) {
+        FeeEstimatorTx tx;
+        tx.hash = entry->GetTx().GetHash();
+        tx.nHeight = entry->GetHeight();
+        tx.nFeePerK = CFeeRate(entry->GetFee(), entry->GetTxSize()).GetFeePerK();
+        event.vBlockTxs.push_back(tx);
+    }
+    LOCK(cs_queue);
+    queueEvents.push_back(std::move(event));
+}
+
+void CBlockPolicyEstimator::ProcessQueued()
+{
+    LOCK(cs_feeEstimator);
+    std::deque<FeeEstimatorEvent> events;
+    {
+        LOCK(cs_queue);
+        events.swap(queueEvents);
+    }
+    if (events.empty())
+        return;
+
+    bool fNewBlock = false;
+    for (const FeeEstimatorEvent& event : events) {
+        switch (event.type) {
+        case FeeEstimatorEvent::TX_ADDED:
+            ApplyTransaction(event.tx, event.fValidFeeEstimate);
+            break;
+        case FeeEstimatorEvent::TX_REMOVED:
+            ApplyRemoveTx(event.tx.hash);
+            break;
+        case FeeEstimatorEvent::BLOCK:
+            ApplyBlock(event.nBlockHeight, event.vBlockTxs);
+            fNewBlock = true;
+            break;
+        }
+    }
+
+    // The estimates only change when a block updates the moving averages
+    if (fNewBlock)
+        PublishEstimates();
+}
+
+void CBlockPolicyEstimator::ApplyTransaction(const FeeEstimatorTx& tx, bool validFeeEstimate)
+{
+    unsigned int txHeight = tx.nHeight;
+    const uint256& hash = tx.hash;
     if (mapMemPoolTxs.count(hash)) {
         LogPrint("estimatefee", "Blockpolicy error mempool tx %s already being tracked\n",
                  hash.ToString().c_str());
@@ -337,16 +410,13 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     }
     trackedTxs++;
 
-    // Feerates are stored and reported as BTC-per-kb:
-    CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
-
     mapMemPoolTxs[hash].blockHeight = txHeight;
-    mapMemPoolTxs[hash].bucketIndex = feeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
+    mapMemPoolTxs[hash].bucketIndex = feeStats.NewTx(txHeight, (double)tx.nFeePerK);
 }
 
-bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
+bool CBlockPolicyEstimator::ApplyBlockTx(unsigned int nBlockHeight, const FeeEstimatorTx& tx)
 {
-    if (!removeTx(entry->GetTx().GetHash())) {
+    if (!ApplyRemoveTx(tx.hash)) {
         // This transaction wasn't being tracked for fee estimation
         return false;
     }
@@ -354,7 +424,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     // How many blocks did it take for miners to include this transaction?
     // blocksToConfirm is 1-based, so a transaction included in the earliest
     // possible block has confirmation count of 1
-    int blocksToConfirm = nBlockHeight - entry->GetHeight();
+    int blocksToConfirm = nBlockHeight - tx.nHeight;
     if (blocksToConfirm <= 0) {
         // This can't happen because we don't process transactions from a block with a height
         // lower than our greatest seen height
@@ -362,15 +432,11 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
         return false;
     }
 
-    // Feerates are stored and reported as BTC-per-kb:
-    CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
-
-    feeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    feeStats.Record(blocksToConfirm, (double)tx.nFeePerK);
     return true;
 }
 
-void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
-                                         std::vector<const CTxMemPoolEntry*>& entries)
+void CBlockPolicyEstimator::ApplyBlock(unsigned int nBlockHeight, const std::vector<FeeEstimatorTx>& vTxs)
 {
     if (nBlockHeight <= nBestSeenHeight) {
         // Ignore side chains and re-orgs; assuming they are random
@@ -382,7 +448,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     }
 
     // Must update nBestSeenHeight in sync with ClearCurrent so that
-    // calls to removeTx (via processBlockTx) correctly calculate age
+    // calls to ApplyRemoveTx (via ApplyBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
 
@@ -391,8 +457,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     unsigned int countedTxs = 0;
     // Repopulate the current block states
-    for (unsigned int i = 0; i < entries.size(); i++) {
-        if (processBlockTx(nBlockHeight, entries[i]))
+    for (unsigned int i = 0; i < vTxs.size(); i++) {
+        if (ApplyBlockTx(nBlockHeight, vTxs[i]))
             countedTxs++;
     }
 
@@ -400,20 +466,38 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     feeStats.UpdateMovingAverages();
 
     LogPrint("estimatefee", "Blockpolicy after updating estimates for %u of %u txs in block, since last block %u of %u tracked, new mempool map size %u\n",
-             countedTxs, entries.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size());
+             countedTxs, vTxs.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size());
 
     trackedTxs = 0;
     untrackedTxs = 0;
 }
 
+void CBlockPolicyEstimator::PublishEstimates()
+{
+    AssertLockHeld(cs_feeEstimator);
+    std::vector<double> vMedians(feeStats.GetMaxConfirms(), -1);
+    // It's not possible to get reasonable estimates for confTarget of 1
+    for (unsigned int confTarget = 2; confTarget <= vMedians.size(); confTarget++)
+        vMedians[confTarget - 1] = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    std::shared_ptr<const std::vector<double> > newMedianFees = std::make_shared<const std::vector<double> >(std::move(vMedians));
+    std::atomic_store(&medianFees, newMedianFees);
+}
+
+std::shared_ptr<const std::vector<double> > CBlockPolicyEstimator::GetMedianFees() const
+{
+    return std::atomic_load(&medianFees);
+}
+
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
 {
+    std::shared_ptr<const std::vector<double> > medians = GetMedianFees();
+
     // Return failure if trying to analyze a target we're not tracking
     // It's not possible to get reasonable estimates for confTarget of 1
-    if (confTarget <= 1 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
+    if (confTarget <= 1 || (unsigned int)confTarget > medians->size())
         return CFeeRate(0);
 
-    double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    double median = (*medians)[confTarget - 1];
 
     if (median < 0)
         return CFeeRate(0);
@@ -423,10 +507,12 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
 
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoundAtTarget, const CTxMemPool& pool)
 {
+    std::shared_ptr<const std::vector<double> > medians = GetMedianFees();
+
     if (answerFoundAtTarget)
         *answerFoundAtTarget = confTarget;
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
+    if (confTarget <= 0 || (unsigned int)confTarget > medians->size())
         return CFeeRate(0);
 
     // It's not possible to get reasonable estimates for confTarget of 1
@@ -434,8 +520,8 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoun
         confTarget = 2;
 
     double median = -1;
-    while (median < 0 && (unsigned int)confTarget <= feeStats.GetMaxConfirms()) {
-        median = feeStats.EstimateMedianVal(confTarget++, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    while (median < 0 && (unsigned int)confTarget <= medians->size()) {
+        median = (*medians)[confTarget++ - 1];
     }
 
     if (answerFoundAtTarget)
@@ -472,12 +558,15 @@ double CBlockPolicyEstimator::estimateSmartPriority(int confTarget, int *answerF
 
 void CBlockPolicyEstimator::Write(CAutoFile& fileout)
 {
+    ProcessQueued();
+    LOCK(cs_feeEstimator);
     fileout << nBestSeenHeight;
     feeStats.Write(fileout);
 }
 
 void CBlockPolicyEstimator::Read(CAutoFile& filein, int nFileVersion)
 {
+    LOCK(cs_feeEstimator);
     int nFileBestSeenHeight;
     filein >> nFileBestSeenHeight;
     feeStats.Read(filein);
@@ -486,6 +575,7 @@ void CBlockPolicyEstimator::Read(CAutoFile& filein, int nFileVersion)
         TxConfirmStats priStats;
         priStats.Read(filein);
     }
+    PublishEstimates();
 }
 
 FeeFilterRounder::FeeFilterRounder(const CFeeRate& minIncrementalFee)
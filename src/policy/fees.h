@@ -8,8 +8,11 @@
 #include "amount.h"
 #include "uint256.h"
 #include "random.h"
+#include "sync.h"
 
+#include <deque>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -201,18 +204,24 @@ public:
     /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values */
     CBlockPolicyEstimator(const CFeeRate& minRelayFee);
 
+    /**
+     * SolarCoin: processBlock, processTransaction and removeTx only queue the event, so that
+     * connecting a block or accepting a transaction does not pay for the statistics update.
+     * ProcessQueued applies the queued events in order and publishes the new estimates.
+     */
+
     /** Process all the transactions that have been included in a block */
     void processBlock(unsigned int nBlockHeight,
                       std::vector<const CTxMemPoolEntry*>& entries);
 
-    /** Process a transaction confirmed in a block*/
-    bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
-
     /** Process a transaction accepted to the mempool*/
     void processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate);
 
     /** Remove a transaction from the mempool tracking stats*/
-    bool removeTx(uint256 hash);
+    void removeTx(uint256 hash);
+
+    /** Apply the queued events to the tracking stats and publish the resulting estimates */
+    void ProcessQueued();
 
     /** Return a feerate estimate */
     CFeeRate estimateFee(int confTarget);
@@ -237,13 +246,51 @@ public:
      */
     double estimateSmartPriority(int confTarget, int *answerFoundAtTarget, const CTxMemPool& pool);
 
-    /** Write estimation data to a file */
+    /** Write estimation data to a file, after applying the queued events */
     void Write(CAutoFile& fileout);
 
     /** Read estimation data from a file */
     void Read(CAutoFile& filein, int nFileVersion);
 
 private:
+    /** The part of a mempool entry the stats need, copied when an event is queued */
+    struct FeeEstimatorTx
+    {
+        uint256 hash;
+        unsigned int nHeight;
+        CAmount nFeePerK;
+    };
+
+    struct FeeEstimatorEvent
+    {
+        enum Type { TX_ADDED, TX_REMOVED, BLOCK };
+        Type type;
+        bool fValidFeeEstimate;                //!< TX_ADDED
+        FeeEstimatorTx tx;                     //!< TX_ADDED, TX_REMOVED (hash only)
+        unsigned int nBlockHeight;             //!< BLOCK
+        std::vector<FeeEstimatorTx> vBlockTxs; //!< BLOCK
+    };
+
+    /** Queued events, guarded by cs_queue */
+    CCriticalSection cs_queue;
+    std::deque<FeeEstimatorEvent> queueEvents;
+
+    /** Guards the tracking stats below */
+    CCriticalSection cs_feeEstimator;
+
+    /**
+     * The median feerate per confirmation target (index 0 is target 1), -1 where there is no
+     * answer. Replaced as a whole with std::atomic_store, so readers never take a lock.
+     */
+    std::shared_ptr<const std::vector<double> > medianFees;
+
+    void ApplyTransaction(const FeeEstimatorTx& tx, bool validFeeEstimate);
+    bool ApplyRemoveTx(const uint256& hash);
+    bool ApplyBlockTx(unsigned int nBlockHeight, const FeeEstimatorTx& tx);
+    void ApplyBlock(unsigned int nBlockHeight, const std::vector<FeeEstimatorTx>& vTxs);
+    void PublishEstimates();
+    std::shared_ptr<const std::vector<double> > GetMedianFees() const;
+
     CFeeRate minTrackedFee;    //!< Passed to constructor to avoid dependency on main
     unsigned int nBestSeenHeight;
     struct TxStatsInfo
@@ -12,6 +12,8 @@
 #include <timedata.h>
 #include <util.h>
 
+#include <algorithm>
+
 /*
 * SolarCoin: PoW / PoST
 */
@@ -64,6 +66,43 @@ int64_t GetCurrentCoinSupply(CBlockIndex* pindexPrev, const Consensus::Params& p
         return (params.INITIAL_COIN_SUPPLY + ((pindexPrev->nHeight - params.LAST_POW_BLOCK) * params.COIN_SUPPLY_GROWTH_RATE));
 }
 
+double GetNetworkHashPS(const CBlockIndex* pindex, int lookup, const Consensus::Params& params)
+{
+    if (pindex == NULL || !pindex->nHeight)
+        return 0;
+
+    // If lookup is -1, then use blocks since last difficulty change.
+    if (lookup <= 0) {
+        if (pindex->nHeight < params.nHeight_Version2)
+            lookup = pindex->nHeight % params.DifficultyAdjustmentInterval_V1() + 1;
+        else
+            lookup = pindex->nHeight % params.DifficultyAdjustmentInterval_V2() + 1;
+    }
+
+    // If lookup is larger than chain, then set it to chain length.
+    if (lookup > pindex->nHeight)
+        lookup = pindex->nHeight;
+
+    const CBlockIndex* pindex0 = pindex;
+    int64_t minTime = pindex0->GetBlockTime();
+    int64_t maxTime = minTime;
+    for (int i = 0; i < lookup; i++) {
+        pindex0 = pindex0->pprev;
+        int64_t time = pindex0->GetBlockTime();
+        minTime = std::min(time, minTime);
+        maxTime = std::max(time, maxTime);
+    }
+
+    // In case there's a situation where minTime == maxTime, we don't want a divide by zero exception.
+    if (minTime == maxTime)
+        return 0;
+
+    arith_uint256 workDiff = pindex->nChainWork - pindex0->nChainWork;
+    int64_t timeDiff = maxTime - minTime;
+
+    return workDiff.getdouble() / timeDiff;
+}
+
 // Get the block rate for one hour
 int GetBlockRatePerHour(const Consensus::Params& params)
 {
@@ -93,13 +132,10 @@ int64_t GetProofOfStakeTimeReward(int64_t nStakeTime, int64_t nFees, CBlockIndex
 }
 
 // PoST Target adjustment
-unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake, const Consensus::Params& params)
+static unsigned int ComputeNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake, const Consensus::Params& params)
 {
     arith_uint256 bnTargetLimit = UintToArith256(params.posLimit);
 
-    if (pindexLast == nullptr)
-        return bnTargetLimit.GetCompact(); // genesis block
-
     // DEBUG: Watch for pindexLast 835245
     bool DEBUG = false;
     if (pindexLast->nHeight == 835245) {
@@ -146,6 +182,19 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfS
     return bnNew.GetCompact();
 }
 
+unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake, const Consensus::Params& params)
+{
+    if (pindexLast == nullptr)
+        return UintToArith256(params.posLimit).GetCompact(); // genesis block
+
+    // SolarCoin: only the PoST target is requested by callers, so only that one is memoized
+    if (!fProofOfStake)
+        return ComputeNextTargetRequired(pindexLast, fProofOfStake, params);
+    if (pindexLast->nNextTargetRequired == 0)
+        pindexLast->nNextTargetRequired = ComputeNextTargetRequired(pindexLast, fProofOfStake, params);
+    return pindexLast->nNextTargetRequired;
+}
+
 // PoW Difficulty adjustment
 unsigned int static KimotoGravityWell(const CBlockIndex* pindexLast, uint64_t TargetBlocksSpacingSeconds, uint64_t PastBlocksMin, uint64_t PastBlocksMax, const Consensus::Params& params) {
 
@@ -349,8 +398,11 @@ unsigned int static GetNextWorkRequired_V2(const CBlockIndex* pindexLast, const
 
     if (fTestNet && GetBoolArg("-zerogravity", false))
         return UintToArith256(params.powLimit).GetCompact();
-    else
-        return KimotoGravityWell(pindexLast, BlocksTargetSpacing, PastBlocksMin, PastBlocksMax, params);
+
+    // The result only depends on pindexLast and its ancestors
+    if (pindexLast->nNextWorkRequired == 0)
+        pindexLast->nNextWorkRequired = KimotoGravityWell(pindexLast, BlocksTargetSpacing, PastBlocksMin, PastBlocksMax, params);
+    return pindexLast->nNextWorkRequired;
 }
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
@@ -387,7 +439,12 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake, const Consensus::Params& params)
 {
     // SolarCoin: CBlockIndex::IsProofOfStake is not valid during header download. Use height instead.
-    while (pindex && pindex->pprev && ((pindex->nHeight > params.LAST_POW_BLOCK) != fProofOfStake))
+    if (!pindex || !pindex->pprev || ((pindex->nHeight > params.LAST_POW_BLOCK) == fProofOfStake))
+        return pindex;
+    // Indexes outside of mapBlockIndex (e.g. in tests) may not have pprevOtherType built
+    if (pindex->pprevOtherType)
+        return pindex->pprevOtherType;
+    while (pindex->pprev && ((pindex->nHeight > params.LAST_POW_BLOCK) != fProofOfStake))
         pindex = pindex->pprev;
     return pindex;
 }
@@ -19,6 +19,10 @@ double GetCurrentInflationRate(double nAverageWeight);
 double GetCurrentInterestRate(CBlockIndex* pindexPrev, const Consensus::Params& params);
 int64_t GetCurrentCoinSupply(CBlockIndex* pindexPrev, const Consensus::Params& params);
 int GetBlockRatePerHour(const Consensus::Params& params);
+/** Default number of blocks getnetworkhashps and getmininginfo estimate the hash rate over */
+static const int DEFAULT_NETWORK_HASHPS_LOOKUP = 120;
+/** Estimated network hashes per second over the lookup blocks up to pindex, or since the last difficulty change if lookup <= 0 */
+double GetNetworkHashPS(const CBlockIndex* pindex, int lookup, const Consensus::Params& params);
 int64_t GetProofOfStakeTimeReward(int64_t nStakeTime, int64_t nFees, CBlockIndex* pindexPrev, const Consensus::Params& params);
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake, const Consensus::Params& params);
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
@@ -10,10 +10,54 @@
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 #include "stdlib.h"
+#include "support/largepages.h"
 #include "timedata.h"
 
+#include <boost/thread/tss.hpp>
+
 typedef std::vector<unsigned char> valtype;
 
+namespace {
+/** A scratchpad on large pages local to the NUMA node of its thread with -largepages, on the heap otherwise */
+class CScryptScratchpad
+{
+private:
+    char* pch;
+    bool fLargePages;
+
+public:
+    CScryptScratchpad()
+    {
+        pch = static_cast<char*>(AllocateLargePages(SCRYPT_MULTI_SCRATCHPAD_SIZE));
+        fLargePages = pch != NULL;
+        if (!fLargePages)
+            pch = new char[SCRYPT_MULTI_SCRATCHPAD_SIZE];
+    }
+
+    ~CScryptScratchpad()
+    {
+        if (fLargePages)
+            FreeLargePages(pch, SCRYPT_MULTI_SCRATCHPAD_SIZE);
+        else
+            delete[] pch;
+    }
+
+    CScryptScratchpad(const CScryptScratchpad&) = delete;
+    CScryptScratchpad& operator=(const CScryptScratchpad&) = delete;
+
+    char* data() { return pch; }
+};
+} // anon namespace
+
+char* GetScryptScratchpad()
+{
+    // Freed when the thread exits
+    static boost::thread_specific_ptr<CScryptScratchpad> ptrScratchpad;
+    if (!ptrScratchpad.get())
+        ptrScratchpad.reset(new CScryptScratchpad());
+    return ptrScratchpad->data();
+}
+
 void CBlockHeader::UpdateTime(const CBlockIndex* pindexPrev)
 {
     nTime = std::max(GetBlockTime(), GetAdjustedTime());
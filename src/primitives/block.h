@@ -18,6 +18,12 @@
 class CBlockIndex;
 class CWallet;
 
+/**
+ * SolarCoin: The scrypt scratchpad of the calling thread, SCRYPT_MULTI_SCRATCHPAD_SIZE bytes that are
+ * allocated on first use and reused by every later hash, instead of taking 128 KiB of stack per call.
+ */
+char* GetScryptScratchpad();
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -87,6 +93,14 @@ public:
         return nEntropyBit;
     }
 
+    // SolarCoin: scrypt hash of the 80 header bytes, checked against nBits for PoW blocks
+    uint256 GetPoWHash() const
+    {
+        uint256 thash;
+        scrypt_1024_1_1_256_sp(BEGIN(nVersion), BEGIN(thash), GetScryptScratchpad());
+        return thash;
+    }
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -117,6 +131,9 @@ public:
 
     // memory only
     mutable bool fChecked;
+    //! SolarCoin: (memory only) the transactions but the coinbase and coinstake are those of a
+    //! template of this node, so they passed CheckTransaction() when it was built
+    bool fTemplateTxsChecked;
 
     CBlock()
     {
@@ -137,7 +154,7 @@ public:
         READWRITE(*(CBlockHeader*)this);
         // PoST: ConnectBlock depends on vtx following header to generate CDiskTxPos
         if (!fHeaderOnly || this->nVersion >= CBlockHeader::LEGACY_VERSION_3) {
-            READWRITE(vtx);
+            SerReadWriteTransactionArena(s, vtx, ser_action);
             if (!fHeaderOnly && this->nVersion >= CBlockHeader::LEGACY_VERSION_3) {
                 READWRITE(vchBlockSig);
             }
@@ -157,6 +174,7 @@ public:
         vMerkleTree.clear();
         nDoS = 0;
         fChecked = false;
+        fTemplateTxsChecked = false;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -175,18 +193,10 @@ public:
 
     /* SolarCoin methods */
 
-    uint256 GetPoWHash() const
-    {
-        uint256 thash;
-        scrypt_1024_1_1_256(BEGIN(nVersion), BEGIN(thash));
-        return thash;
-    }
-
     // ppcoin: two types of block: proof-of-work or proof-of-stake
     bool IsProofOfStake() const
     {
-        const CTransaction& tx = *vtx[1];
-        return (vtx.size() > 1 && tx.IsCoinStake());
+        return (vtx.size() > 1 && vtx[1]->IsCoinStake());
     }
 
     bool IsProofOfWork() const
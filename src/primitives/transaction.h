@@ -11,6 +11,9 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <memory>
+#include <new>
+
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 
 static const int WITNESS_SCALE_FACTOR = 4;
@@ -259,8 +262,11 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    //! SolarCoin: Memory only, the serialized size with nTime, with or without witness alike as no witness is serialized
+    const unsigned int nSerializedSize;
 
     uint256 ComputeHash() const;
+    unsigned int ComputeSerializedSize() const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -275,6 +281,9 @@ public:
         SerializeTransaction(*this, s);
     }
 
+    /** SolarCoin: The size is the cached one, unless the serialization leaves nTime out */
+    inline void Serialize(CSizeComputer& s) const;
+
     /** This deserializing constructor is provided instead of an Unserialize method.
      *  Unserialize is not possible, since it would require overwriting const fields. */
     template <typename Stream>
@@ -401,6 +410,13 @@ inline void SerializeTransaction(const TxType& tx, Stream& s) {
     }
 }
 
+inline void CTransaction::Serialize(CSizeComputer& s) const {
+    if (!(s.GetType() & (SER_GETHASH|SER_LEGACYPROTOCOL)) || nVersion > CTransaction::LEGACY_VERSION_3 || (s.GetType() & SER_DISK))
+        s.seek(nSerializedSize);
+    else
+        SerializeTransaction(*this, s);
+}
+
 /** A mutable version of CTransaction. */
 struct CMutableTransaction
 {
@@ -455,6 +471,93 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/** Most transactions in one arena, so a forged count does not allocate much more than the data holds */
+static const size_t MAX_TRANSACTION_ARENA_SIZE = 5000000 / sizeof(CTransaction);
+
+/**
+ * SolarCoin: The transactions of a block deserialized side by side in one allocation, rather than
+ * one make_shared each. The CTransactionRefs handed out share the ownership of the whole arena,
+ * which is freed with the last of them. Their inputs, outputs and scripts are allocated as usual.
+ */
+class CTransactionArena
+{
+private:
+    CTransaction* ptxs;
+    size_t nCapacity;
+    size_t nSize;
+
+public:
+    //! Tells the arena transactions apart, see IsArenaTransaction()
+    struct Deleter
+    {
+        void operator()(CTransactionArena* parena) const { delete parena; }
+    };
+
+    explicit CTransactionArena(size_t nCapacityIn) : ptxs(static_cast<CTransaction*>(::operator new(nCapacityIn * sizeof(CTransaction)))), nCapacity(nCapacityIn), nSize(0) {}
+
+    ~CTransactionArena()
+    {
+        while (nSize)
+            ptxs[--nSize].~CTransaction();
+        ::operator delete(ptxs);
+    }
+
+    bool IsFull() const { return nSize == nCapacity; }
+
+    /** Deserialize the next transaction of the arena */
+    template <typename Stream>
+    const CTransaction* Emplace(Stream& s)
+    {
+        assert(nSize < nCapacity);
+        new (ptxs + nSize) CTransaction(deserialize, s);
+        return ptxs + nSize++;
+    }
+
+    CTransactionArena(const CTransactionArena&) = delete;
+    CTransactionArena& operator=(const CTransactionArena&) = delete;
+};
+
+/** Deserialize the transactions of a block into arenas */
+template <typename Stream>
+void UnserializeTransactionArena(Stream& s, std::vector<CTransactionRef>& vtx)
+{
+    vtx.clear();
+    const uint64_t nSize = ReadCompactSize(s);
+    std::shared_ptr<CTransactionArena> arena;
+    while (vtx.size() < nSize) {
+        if (!arena || arena->IsFull()) {
+            const size_t nArena = std::min<uint64_t>(nSize - vtx.size(), MAX_TRANSACTION_ARENA_SIZE);
+            arena.reset(new CTransactionArena(nArena), CTransactionArena::Deleter());
+            vtx.reserve(vtx.size() + nArena);
+        }
+        vtx.emplace_back(arena, arena->Emplace(s));
+    }
+}
+
+template <typename Stream>
+inline void SerReadWriteTransactionArena(Stream& s, const std::vector<CTransactionRef>& vtx, CSerActionSerialize ser_action)
+{
+    ::Serialize(s, vtx);
+}
+
+template <typename Stream>
+inline void SerReadWriteTransactionArena(Stream& s, std::vector<CTransactionRef>& vtx, CSerActionUnserialize ser_action)
+{
+    UnserializeTransactionArena(s, vtx);
+}
+
+/** Whether a transaction lives in the arena of a block, and keeps all of the block allocated */
+static inline bool IsArenaTransaction(const CTransactionRef& tx)
+{
+    return std::get_deleter<CTransactionArena::Deleter>(tx) != NULL;
+}
+
+/** The transaction, copied out of its arena if it is to be kept longer than its block */
+static inline CTransactionRef DetachTransactionRef(const CTransactionRef& tx)
+{
+    return IsArenaTransaction(tx) ? MakeTransactionRef(*tx) : tx;
+}
+
 /** Compute the weight of a transaction, as defined by BIP 141 */
 int64_t GetTransactionWeight(const CTransaction &tx);
 
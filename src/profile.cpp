@@ -0,0 +1,275 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "profile.h"
+
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include <boost/thread/tss.hpp>
+
+std::atomic<bool> fProfile(DEFAULT_PROFILE);
+
+/** A call path of a thread, as its innermost scope and the node of the scope it was entered in */
+struct CProfileNode
+{
+    const CProfileSite* psite;
+    uint32_t nParent;
+    //! Producer side only: the first node entered in this one, and the next entered in the same parent
+    uint32_t nFirstChild;
+    uint32_t nNextSibling;
+};
+
+struct CProfileSample
+{
+    uint32_t nNode;
+    uint64_t nTicks;
+};
+
+/**
+ * The samples of a thread, written by that thread and read by the aggregation. A node and the
+ * samples are written before the counts publishing them, so the aggregation never reads a node
+ * or a sample in the making. Node 0 is the root, outside all scopes.
+ */
+struct CProfileThread
+{
+    CProfileNode vNodes[PROFILE_THREAD_NODES];
+    std::atomic<uint32_t> nNodes;
+    CProfileSample vSamples[PROFILE_THREAD_SAMPLES];
+    std::atomic<uint64_t> nHead;
+    std::atomic<uint64_t> nTail;
+    std::atomic<uint64_t> nDropped;
+
+    //! Producer side only: the node of the innermost scope entered, and scopes entered beyond the nodes
+    uint32_t nCurrent;
+    uint32_t nLost;
+
+    //! Aggregation side only (cs_profile): the totals of each node
+    std::vector<CProfilePath> vTotals;
+    //! Whether a thread owns it, threads that exit leave it to the next one (cs_profile)
+    bool fInUse;
+
+    CProfileThread() : nNodes(1), nHead(0), nTail(0), nDropped(0), nCurrent(0), nLost(0), fInUse(true)
+    {
+        vNodes[0].psite = NULL;
+        vNodes[0].nParent = 0;
+        vNodes[0].nFirstChild = 0;
+        vNodes[0].nNextSibling = 0;
+    }
+};
+
+namespace {
+
+struct CProfileRegistry
+{
+    std::mutex cs_profile;
+    //! Never freed, a thread that exits hands its own to the next thread entering a scope
+    std::vector<CProfileThread*> vThreads;
+    uint64_t nStartTicks;
+    int64_t nStartMicros;
+
+    CProfileRegistry() : nStartTicks(ProfileTicks()), nStartMicros(GetTimeMicros()) {}
+};
+
+CProfileRegistry& GetProfileRegistry()
+{
+    // Leaked, so threads exiting after the statics are destroyed never find it gone
+    static CProfileRegistry* pregistry = new CProfileRegistry();
+    return *pregistry;
+}
+
+void ReleaseProfileThread(CProfileThread* pthread)
+{
+    CProfileRegistry& registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs_profile);
+    pthread->nCurrent = 0;
+    pthread->nLost = 0;
+    pthread->fInUse = false;
+}
+
+boost::thread_specific_ptr<CProfileThread> ptrProfileThread(ReleaseProfileThread);
+
+CProfileThread* GetProfileThread()
+{
+    CProfileThread* pthread = ptrProfileThread.get();
+    if (pthread)
+        return pthread;
+    CProfileRegistry& registry = GetProfileRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.cs_profile);
+        for (CProfileThread* pfree : registry.vThreads) {
+            if (!pfree->fInUse) {
+                pfree->fInUse = true;
+                pthread = pfree;
+                break;
+            }
+        }
+        if (!pthread) {
+            pthread = new CProfileThread();
+            registry.vThreads.push_back(pthread);
+        }
+    }
+    ptrProfileThread.reset(pthread);
+    return pthread;
+}
+
+/** Move the samples of a thread into its totals (cs_profile held) */
+void DrainProfileThread(CProfileThread& thread)
+{
+    uint64_t nTail = thread.nTail.load(std::memory_order_relaxed);
+    uint64_t nHead = thread.nHead.load(std::memory_order_acquire);
+    thread.vTotals.resize(thread.nNodes.load(std::memory_order_acquire));
+    for (; nTail != nHead; nTail++) {
+        const CProfileSample& sample = thread.vSamples[nTail % PROFILE_THREAD_SAMPLES];
+        CProfilePath& totals = thread.vTotals[sample.nNode];
+        totals.nCount++;
+        totals.nTicks += sample.nTicks;
+        thread.vTotals[thread.vNodes[sample.nNode].nParent].nChildTicks += sample.nTicks;
+    }
+    thread.nTail.store(nTail, std::memory_order_release);
+}
+
+} // anon namespace
+
+CProfileThread* ProfileEnter(const CProfileSite& site)
+{
+    CProfileThread* pthread = GetProfileThread();
+    if (pthread->nLost) {
+        pthread->nLost++;
+        return pthread;
+    }
+    const uint32_t nParent = pthread->nCurrent;
+    uint32_t nNode = pthread->vNodes[nParent].nFirstChild;
+    while (nNode && pthread->vNodes[nNode].psite != &site)
+        nNode = pthread->vNodes[nNode].nNextSibling;
+    if (!nNode) {
+        nNode = pthread->nNodes.load(std::memory_order_relaxed);
+        if (nNode == PROFILE_THREAD_NODES) {
+            // No room for the path, the scope and those nested in it count in the parent
+            pthread->nLost++;
+            return pthread;
+        }
+        CProfileNode& node = pthread->vNodes[nNode];
+        node.psite = &site;
+        node.nParent = nParent;
+        node.nFirstChild = 0;
+        node.nNextSibling = pthread->vNodes[nParent].nFirstChild;
+        pthread->vNodes[nParent].nFirstChild = nNode;
+        pthread->nNodes.store(nNode + 1, std::memory_order_release);
+    }
+    pthread->nCurrent = nNode;
+    return pthread;
+}
+
+void ProfileLeave(CProfileThread* pthread, uint64_t nTicks)
+{
+    if (pthread->nLost) {
+        pthread->nLost--;
+        return;
+    }
+    const uint32_t nNode = pthread->nCurrent;
+    pthread->nCurrent = pthread->vNodes[nNode].nParent;
+    uint64_t nHead = pthread->nHead.load(std::memory_order_relaxed);
+    if (nHead - pthread->nTail.load(std::memory_order_acquire) >= PROFILE_THREAD_SAMPLES) {
+        pthread->nDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    CProfileSample& sample = pthread->vSamples[nHead % PROFILE_THREAD_SAMPLES];
+    sample.nNode = nNode;
+    sample.nTicks = nTicks;
+    pthread->nHead.store(nHead + 1, std::memory_order_release);
+}
+
+void AggregateProfile()
+{
+    CProfileRegistry& registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs_profile);
+    for (CProfileThread* pthread : registry.vThreads)
+        DrainProfileThread(*pthread);
+}
+
+std::vector<CProfilePath> GetProfilePaths()
+{
+    // The same path taken by different threads counts once
+    std::map<std::vector<const CProfileSite*>, CProfilePath> mapPaths;
+    CProfileRegistry& registry = GetProfileRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.cs_profile);
+        for (CProfileThread* pthread : registry.vThreads) {
+            DrainProfileThread(*pthread);
+            for (uint32_t nNode = 1; nNode < pthread->vTotals.size(); nNode++) {
+                const CProfilePath& totals = pthread->vTotals[nNode];
+                if (!totals.nCount && !totals.nChildTicks)
+                    continue;
+                std::vector<const CProfileSite*> vSites;
+                for (uint32_t n = nNode; n; n = pthread->vNodes[n].nParent)
+                    vSites.push_back(pthread->vNodes[n].psite);
+                std::reverse(vSites.begin(), vSites.end());
+                CProfilePath& path = mapPaths[vSites];
+                path.nCount += totals.nCount;
+                path.nTicks += totals.nTicks;
+                path.nChildTicks += totals.nChildTicks;
+            }
+        }
+    }
+    std::vector<CProfilePath> vPaths;
+    vPaths.reserve(mapPaths.size());
+    for (std::pair<const std::vector<const CProfileSite*>, CProfilePath>& item : mapPaths) {
+        vPaths.push_back(item.second);
+        vPaths.back().vSites = item.first;
+    }
+    return vPaths;
+}
+
+uint64_t GetProfileDropped()
+{
+    CProfileRegistry& registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs_profile);
+    uint64_t nDropped = 0;
+    for (const CProfileThread* pthread : registry.vThreads)
+        nDropped += pthread->nDropped.load(std::memory_order_relaxed);
+    return nDropped;
+}
+
+double GetProfileTicksPerMicro()
+{
+    const CProfileRegistry& registry = GetProfileRegistry();
+    int64_t nMicros = GetTimeMicros() - registry.nStartMicros;
+    if (nMicros <= 0)
+        return 1;
+    return std::max(1.0, (double)(ProfileTicks() - registry.nStartTicks) / nMicros);
+}
+
+void ResetProfile()
+{
+    CProfileRegistry& registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs_profile);
+    for (CProfileThread* pthread : registry.vThreads) {
+        DrainProfileThread(*pthread);
+        pthread->vTotals.assign(pthread->vTotals.size(), CProfilePath());
+        pthread->nDropped.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::string FormatProfileFolded(const std::vector<CProfilePath>& vPaths)
+{
+    const double dTicksPerMicro = GetProfileTicksPerMicro();
+    std::string strOut;
+    for (const CProfilePath& path : vPaths) {
+        uint64_t nMicros = path.GetSelfTicks() / dTicksPerMicro;
+        if (nMicros == 0)
+            continue;
+        for (size_t i = 0; i < path.vSites.size(); i++) {
+            if (i)
+                strOut += ';';
+            strOut += path.vSites[i]->pszName;
+        }
+        strOut += strprintf(" %u\n", nMicros);
+    }
+    return strOut;
+}
@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PROFILE_H
+#define BITCOIN_PROFILE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include "bench/perf.h"
+#else
+#include <chrono>
+#endif
+
+/** -profile default */
+static const bool DEFAULT_PROFILE = false;
+/** Seconds between the aggregations of the samples the threads buffered */
+static const int64_t PROFILE_AGGREGATE_INTERVAL = 1;
+/** Samples a thread buffers until the next aggregation, later ones are dropped */
+static const size_t PROFILE_THREAD_SAMPLES = 8192;
+/** Call paths, one per scope and the scopes it is nested in, a thread keeps track of */
+static const size_t PROFILE_THREAD_NODES = 2048;
+
+/** Whether PROFILE_SCOPE()s are timed (-profile), can be switched at any time */
+extern std::atomic<bool> fProfile;
+
+/** The profiler clock: the CPU cycle counter where bench/perf.h reads it from user space, nanoseconds elsewhere */
+static inline uint64_t ProfileTicks()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return perf_cpucycles();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/** SolarCoin: A PROFILE_SCOPE() in the code, made the first time it runs while profiling and kept for the life of the process */
+class CProfileSite
+{
+public:
+    const char* const pszName;
+    const char* const pszFile;
+    const int nLine;
+
+    CProfileSite(const char* pszNameIn, const char* pszFileIn, int nLineIn) : pszName(pszNameIn), pszFile(pszFileIn), nLine(nLineIn) {}
+};
+
+struct CProfileThread;
+
+/** Enter a scope on the calling thread, NULL if it cannot be recorded */
+CProfileThread* ProfileEnter(const CProfileSite& site);
+/** Leave the scope last entered on the calling thread, after nTicks */
+void ProfileLeave(CProfileThread* pthread, uint64_t nTicks);
+
+/**
+ * SolarCoin: Times a scope in profiler ticks while -profile is set. The time is buffered in a
+ * sample of the calling thread, under the path of scopes it is nested in, until the samples of
+ * all threads are aggregated by AggregateProfile().
+ */
+class CProfileScope
+{
+private:
+    CProfileThread* pthread;
+    uint64_t nStart;
+
+public:
+    explicit CProfileScope(const CProfileSite& (*pGetSite)()) : pthread(NULL), nStart(0)
+    {
+        if (fProfile.load(std::memory_order_relaxed) && (pthread = ProfileEnter(pGetSite())))
+            nStart = ProfileTicks();
+    }
+
+    ~CProfileScope()
+    {
+        if (pthread)
+            ProfileLeave(pthread, ProfileTicks() - nStart);
+    }
+
+    CProfileScope(const CProfileScope&) = delete;
+    CProfileScope& operator=(const CProfileScope&) = delete;
+};
+
+#ifndef PASTE2
+#define PASTE(x, y) x ## y
+#define PASTE2(x, y) PASTE(x, y)
+#endif
+
+/** Time the rest of the enclosing block as name, while profiling */
+#define PROFILE_SCOPE(name) CProfileScope PASTE2(profilescope, __COUNTER__)([]() -> const CProfileSite& { static const CProfileSite site(name, __FILE__, __LINE__); return site; })
+
+/** The totals of a call path: a scope and the scopes it was entered in, outermost first */
+struct CProfilePath
+{
+    std::vector<const CProfileSite*> vSites;
+    uint64_t nCount;
+    //! Ticks spent in the scope, and in the scopes nested in it
+    uint64_t nTicks;
+    //! Ticks spent in the nested scopes of the path
+    uint64_t nChildTicks;
+
+    CProfilePath() : nCount(0), nTicks(0), nChildTicks(0) {}
+    uint64_t GetSelfTicks() const { return nTicks > nChildTicks ? nTicks - nChildTicks : 0; }
+};
+
+/** Move the samples the threads buffered into the totals, periodically and before they are read */
+void AggregateProfile();
+/** The totals of every call path recorded since startup or the last ResetProfile() */
+std::vector<CProfilePath> GetProfilePaths();
+/** Samples dropped as a thread buffer was full */
+uint64_t GetProfileDropped();
+/** Profiler ticks per microsecond, measured since startup */
+double GetProfileTicksPerMicro();
+/** Forget the totals and the samples buffered so far */
+void ResetProfile();
+/** The call paths in the folded format of flamegraph.pl, one "outer;inner microseconds" line per path with time of its own */
+std::string FormatProfileFolded(const std::vector<CProfilePath>& vPaths);
+
+#endif // BITCOIN_PROFILE_H
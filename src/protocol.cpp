@@ -8,6 +8,8 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+
 #ifndef WIN32
 # include <arpa/inet.h>
 #endif
@@ -73,6 +75,20 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::BLOCKTXN,
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes+ARRAYLEN(allNetMessageTypes));
+static_assert(ARRAYLEN(allNetMessageTypes) == NUM_NET_MESSAGE_TYPES, "NUM_NET_MESSAGE_TYPES must match allNetMessageTypes");
+
+const static std::string NET_MESSAGE_TYPE_OTHER = "*other*";
+
+/** SolarCoin: The message types in sorted order with their index, for a binary search */
+static std::vector<std::pair<std::string, size_t> > SortNetMessageTypes()
+{
+    std::vector<std::pair<std::string, size_t> > vSorted;
+    for (size_t i = 0; i < ARRAYLEN(allNetMessageTypes); i++)
+        vSorted.push_back(std::make_pair(allNetMessageTypes[i], i));
+    std::sort(vSorted.begin(), vSorted.end());
+    return vSorted;
+}
+const static std::vector<std::pair<std::string, size_t> > sortedNetMessageTypes = SortNetMessageTypes();
 
 CMessageHeader::CMessageHeader(const MessageStartChars& pchMessageStartIn)
 {
@@ -192,3 +208,16 @@ const std::vector<std::string> &getAllNetMessageTypes()
 {
     return allNetMessageTypesVec;
 }
+
+size_t GetNetMessageTypeIndex(const std::string& strCommand)
+{
+    std::vector<std::pair<std::string, size_t> >::const_iterator it = std::lower_bound(sortedNetMessageTypes.begin(), sortedNetMessageTypes.end(), std::make_pair(strCommand, (size_t)0));
+    if (it == sortedNetMessageTypes.end() || it->first != strCommand)
+        return NUM_NET_MESSAGE_TYPES;
+    return it->second;
+}
+
+const std::string& GetNetMessageTypeName(size_t nIndex)
+{
+    return nIndex < NUM_NET_MESSAGE_TYPES ? allNetMessageTypes[nIndex] : NET_MESSAGE_TYPE_OTHER;
+}
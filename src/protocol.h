@@ -245,6 +245,13 @@ extern const char *BLOCKTXN;
 /* Get a vector of all valid message types (see above) */
 const std::vector<std::string> &getAllNetMessageTypes();
 
+/** SolarCoin: The number of valid message types; any other type is counted at this index */
+static const size_t NUM_NET_MESSAGE_TYPES = 26;
+/** SolarCoin: The index of strCommand in getAllNetMessageTypes(), or NUM_NET_MESSAGE_TYPES if it is not valid */
+size_t GetNetMessageTypeIndex(const std::string& strCommand);
+/** SolarCoin: The message type at nIndex, "*other*" for NUM_NET_MESSAGE_TYPES */
+const std::string& GetNetMessageTypeName(size_t nIndex);
+
 /** nServices flags */
 enum ServiceFlags : uint64_t {
     // Nothing
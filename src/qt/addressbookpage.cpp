@@ -21,6 +21,36 @@
 #include <QMessageBox>
 #include <QSortFilterProxyModel>
 
+/* SolarCoin: Shows the entries of one type that match the search, asking the model, which keeps
+   the lower case text of each entry, rather than going through data() for every row.
+*/
+class AddressBookSortFilterProxyModel : public QSortFilterProxyModel
+{
+public:
+    AddressBookSortFilterProxyModel(const QString &_type, QObject *parent) :
+        QSortFilterProxyModel(parent), type(_type) {}
+
+    void setSearchString(const QString &text)
+    {
+        QString lowerText = text.toLower();
+        if(lowerText == searchString)
+            return;
+        searchString = lowerText;
+        invalidateFilter();
+    }
+
+protected:
+    bool filterAcceptsRow(int row, const QModelIndex &parent) const
+    {
+        Q_UNUSED(parent);
+        return static_cast<AddressTableModel*>(sourceModel())->matchesFilter(row, type, searchString);
+    }
+
+private:
+    QString type;
+    QString searchString;
+};
+
 AddressBookPage::AddressBookPage(const PlatformStyle *platformStyle, Mode _mode, Tabs _tab, QWidget *parent) :
     QDialog(parent),
     ui(new Ui::AddressBookPage),
@@ -113,24 +143,12 @@ void AddressBookPage::setModel(AddressTableModel *_model)
     if(!_model)
         return;
 
-    proxyModel = new QSortFilterProxyModel(this);
+    proxyModel = new AddressBookSortFilterProxyModel(
+        tab == ReceivingTab ? AddressTableModel::Receive : AddressTableModel::Send, this);
     proxyModel->setSourceModel(_model);
     proxyModel->setDynamicSortFilter(true);
     proxyModel->setSortCaseSensitivity(Qt::CaseInsensitive);
-    proxyModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
-    switch(tab)
-    {
-    case ReceivingTab:
-        // Receive filter
-        proxyModel->setFilterRole(AddressTableModel::TypeRole);
-        proxyModel->setFilterFixedString(AddressTableModel::Receive);
-        break;
-    case SendingTab:
-        // Send filter
-        proxyModel->setFilterRole(AddressTableModel::TypeRole);
-        proxyModel->setFilterFixedString(AddressTableModel::Send);
-        break;
-    }
+    connect(ui->searchLineEdit, SIGNAL(textChanged(QString)), this, SLOT(searchChanged(QString)));
     ui->tableView->setModel(proxyModel);
     ui->tableView->sortByColumn(0, Qt::AscendingOrder);
 
@@ -300,6 +318,11 @@ void AddressBookPage::contextualMenu(const QPoint &point)
     }
 }
 
+void AddressBookPage::searchChanged(const QString &text)
+{
+    proxyModel->setSearchString(text);
+}
+
 void AddressBookPage::selectNewAddress(const QModelIndex &parent, int begin, int /*end*/)
 {
     QModelIndex idx = proxyModel->mapFromSource(model->index(begin, AddressTableModel::Address, parent));
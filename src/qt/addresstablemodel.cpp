@@ -14,6 +14,8 @@
 #include <QFont>
 #include <QDebug>
 
+#include <mutex>
+
 const QString AddressTableModel::Send = "S";
 const QString AddressTableModel::Receive = "R";
 
@@ -28,10 +30,17 @@ struct AddressTableEntry
     Type type;
     QString label;
     QString address;
+    /* Label and address in lower case, for searching */
+    QString searchText;
 
     AddressTableEntry() {}
     AddressTableEntry(Type _type, const QString &_label, const QString &_address):
-        type(_type), label(_label), address(_address) {}
+        type(_type), label(_label), address(_address) { updateSearchText(); }
+
+    void updateSearchText()
+    {
+        searchText = label.toLower() + QChar('\n') + address.toLower();
+    }
 };
 
 struct AddressTableEntryLessThan
@@ -64,6 +73,16 @@ static AddressTableEntry::Type translateTransactionType(const QString &strPurpos
     return addressType;
 }
 
+/* An address book change notified while the table was loading */
+struct AddressTableUpdate
+{
+    QString address;
+    QString label;
+    bool isMine;
+    QString purpose;
+    int status;
+};
+
 // Private implementation
 class AddressTablePriv
 {
@@ -71,35 +90,32 @@ public:
     CWallet *wallet;
     QList<AddressTableEntry> cachedAddressTable;
     AddressTableModel *parent;
+    /** The table was loaded; until then the changes are kept in pendingUpdates */
+    bool fLoaded;
+    QList<AddressTableUpdate> pendingUpdates;
 
     AddressTablePriv(CWallet *_wallet, AddressTableModel *_parent):
-        wallet(_wallet), parent(_parent) {}
+        wallet(_wallet), parent(_parent), fLoaded(false) {}
 
-    void refreshAddressTable()
+    /* Find the entry of an address, the table being sorted by address */
+    QList<AddressTableEntry>::iterator find(const QString &address)
     {
-        cachedAddressTable.clear();
-        {
-            LOCK(wallet->cs_wallet);
-            for (const std::pair<CTxDestination, CAddressBookData>& item : wallet->mapAddressBook)
-            {
-                const CBitcoinAddress& address = item.first;
-                bool fMine = IsMine(*wallet, address.Get());
-                AddressTableEntry::Type addressType = translateTransactionType(
-                        QString::fromStdString(item.second.purpose), fMine);
-                const std::string& strName = item.second.name;
-                cachedAddressTable.append(AddressTableEntry(addressType,
-                                  QString::fromStdString(strName),
-                                  QString::fromStdString(address.ToString())));
-            }
-        }
-        // qLowerBound() and qUpperBound() require our cachedAddressTable list to be sorted in asc order
-        // Even though the map is already sorted this re-sorting step is needed because the originating map
-        // is sorted by binary address, not by base58() address.
-        qSort(cachedAddressTable.begin(), cachedAddressTable.end(), AddressTableEntryLessThan());
+        QList<AddressTableEntry>::iterator lower = qLowerBound(
+            cachedAddressTable.begin(), cachedAddressTable.end(), address, AddressTableEntryLessThan());
+        if(lower == cachedAddressTable.end() || lower->address != address)
+            return cachedAddressTable.end();
+        return lower;
     }
 
-    void updateEntry(const QString &address, const QString &label, bool isMine, const QString &purpose, int status)
+    void updateEntry(const QString &address, const QString &label, bool isMine, const QString &purpose, int status, bool fReplay = false)
     {
+        if(!fLoaded)
+        {
+            AddressTableUpdate update = {address, label, isMine, purpose, status};
+            pendingUpdates.append(update);
+            return;
+        }
+
         // Find address / label in model
         QList<AddressTableEntry>::iterator lower = qLowerBound(
             cachedAddressTable.begin(), cachedAddressTable.end(), address, AddressTableEntryLessThan());
@@ -110,6 +126,15 @@ public:
         bool inModel = (lower != upper);
         AddressTableEntry::Type newEntryType = translateTransactionType(purpose, isMine);
 
+        // A change notified while loading may or may not be in the loaded table already
+        if(fReplay)
+        {
+            if(status == CT_DELETED && !inModel)
+                return;
+            if(status != CT_DELETED)
+                status = inModel ? CT_UPDATED : CT_NEW;
+        }
+
         switch(status)
         {
         case CT_NEW:
@@ -130,6 +155,7 @@ public:
             }
             lower->type = newEntryType;
             lower->label = label;
+            lower->updateSearchText();
             parent->emitDataChanged(lowerIndex);
             break;
         case CT_DELETED:
@@ -163,19 +189,109 @@ public:
     }
 };
 
+/* SolarCoin: Reads the address book into a table sorted by address on a worker thread, as
+   encoding tens of thousands of addresses and looking up whether they are ours takes a while.
+*/
+class AddressTableLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AddressTableLoader(CWallet *_wallet) : wallet(_wallet) {}
+
+    /* Hand the loaded table over to the model */
+    QList<AddressTableEntry> takeEntries()
+    {
+        std::lock_guard<std::mutex> lock(cs_entries);
+        QList<AddressTableEntry> result;
+        result.swap(entries);
+        return result;
+    }
+
+public Q_SLOTS:
+    void load();
+
+Q_SIGNALS:
+    void loaded();
+
+private:
+    CWallet *wallet;
+    std::mutex cs_entries;
+    QList<AddressTableEntry> entries;
+};
+
+#include <qt/addresstablemodel.moc>
+
+void AddressTableLoader::load()
+{
+    QList<AddressTableEntry> table;
+    {
+        LOCK(wallet->cs_wallet);
+#if QT_VERSION >= 0x040700
+        table.reserve(wallet->mapAddressBook.size());
+#endif
+        for (const std::pair<CTxDestination, CAddressBookData>& item : wallet->mapAddressBook)
+        {
+            const CBitcoinAddress& address = item.first;
+            bool fMine = IsMine(*wallet, address.Get());
+            AddressTableEntry::Type addressType = translateTransactionType(
+                    QString::fromStdString(item.second.purpose), fMine);
+            const std::string& strName = item.second.name;
+            table.append(AddressTableEntry(addressType,
+                              QString::fromStdString(strName),
+                              QString::fromStdString(address.ToString())));
+        }
+    }
+    // qLowerBound() and qUpperBound() require our cachedAddressTable list to be sorted in asc order
+    // Even though the map is already sorted this re-sorting step is needed because the originating map
+    // is sorted by binary address, not by base58() address.
+    qSort(table.begin(), table.end(), AddressTableEntryLessThan());
+    qDebug() << "AddressTableLoader::load: " + QString::number(table.size()) + " addresses";
+
+    {
+        std::lock_guard<std::mutex> lock(cs_entries);
+        entries.swap(table);
+    }
+    Q_EMIT loaded();
+}
+
 AddressTableModel::AddressTableModel(CWallet *_wallet, WalletModel *parent) :
-    QAbstractTableModel(parent),walletModel(parent),wallet(_wallet),priv(0)
+    QAbstractTableModel(parent),walletModel(parent),wallet(_wallet),priv(0),loader(0)
 {
     columns << tr("Label") << tr("Address");
     priv = new AddressTablePriv(wallet, this);
-    priv->refreshAddressTable();
+
+    loader = new AddressTableLoader(wallet);
+    loader->moveToThread(&loaderThread);
+    connect(&loaderThread, SIGNAL(started()), loader, SLOT(load()));
+    connect(loader, SIGNAL(loaded()), this, SLOT(addLoadedEntries()));
+    // The loader is deleted in its thread once the thread is done
+    connect(&loaderThread, SIGNAL(finished()), loader, SLOT(deleteLater()), Qt::DirectConnection);
+    loaderThread.start();
 }
 
 AddressTableModel::~AddressTableModel()
 {
+    loaderThread.quit();
+    loaderThread.wait();
     delete priv;
 }
 
+void AddressTableModel::addLoadedEntries()
+{
+    beginResetModel();
+    priv->cachedAddressTable = loader->takeEntries();
+    priv->fLoaded = true;
+    endResetModel();
+
+    // Apply the changes notified while the table was loading
+    QList<AddressTableUpdate> pendingUpdates;
+    pendingUpdates.swap(priv->pendingUpdates);
+    for (const AddressTableUpdate& update : pendingUpdates)
+        priv->updateEntry(update.address, update.label, update.isMine, update.purpose, update.status, true);
+    loaderThread.quit();
+}
+
 int AddressTableModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
@@ -421,6 +537,16 @@ bool AddressTableModel::removeRows(int row, int count, const QModelIndex &parent
  */
 QString AddressTableModel::labelForAddress(const QString &address) const
 {
+    // SolarCoin: once loaded, the table has every entry of the address book
+    if(priv->fLoaded)
+    {
+        QList<AddressTableEntry>::iterator it = priv->find(address);
+        if(it != priv->cachedAddressTable.end())
+        {
+            return it->label;
+        }
+        return QString();
+    }
     {
         LOCK(wallet->cs_wallet);
         CBitcoinAddress address_parsed(address.toStdString());
@@ -435,18 +561,28 @@ QString AddressTableModel::labelForAddress(const QString &address) const
 
 int AddressTableModel::lookupAddress(const QString &address) const
 {
-    QModelIndexList lst = match(index(0, Address, QModelIndex()),
-                                Qt::EditRole, address, 1, Qt::MatchExactly);
-    if(lst.isEmpty())
+    QList<AddressTableEntry>::iterator it = priv->find(address);
+    if(it == priv->cachedAddressTable.end())
     {
         return -1;
     }
     else
     {
-        return lst.at(0).row();
+        return it - priv->cachedAddressTable.begin();
     }
 }
 
+bool AddressTableModel::matchesFilter(int row, const QString &type, const QString &text) const
+{
+    AddressTableEntry *rec = priv->index(row);
+    if(!rec)
+        return false;
+    if((type == Send && rec->type != AddressTableEntry::Sending) ||
+       (type == Receive && rec->type != AddressTableEntry::Receiving))
+        return false;
+    return text.isEmpty() || rec->searchText.contains(text);
+}
+
 void AddressTableModel::emitDataChanged(int idx)
 {
     Q_EMIT dataChanged(index(idx, 0, QModelIndex()), index(idx, columns.length()-1, QModelIndex()));
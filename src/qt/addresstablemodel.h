@@ -7,7 +7,9 @@
 
 #include <QAbstractTableModel>
 #include <QStringList>
+#include <QThread>
 
+class AddressTableLoader;
 class AddressTablePriv;
 class WalletModel;
 
@@ -72,6 +74,11 @@ public:
      */
     int lookupAddress(const QString &address) const;
 
+    /* Whether the entry at row is of type (Send or Receive) and has text, in lower case, in its label
+       or address. Reads a lower case copy kept with each entry, for filtering large address books.
+     */
+    bool matchesFilter(int row, const QString &type, const QString &text) const;
+
     EditStatus getEditStatus() const { return editStatus; }
 
 private:
@@ -80,6 +87,9 @@ private:
     AddressTablePriv *priv;
     QStringList columns;
     EditStatus editStatus;
+    /** SolarCoin: Reads the address book on loaderThread, so large ones do not hold up the window */
+    AddressTableLoader *loader;
+    QThread loaderThread;
 
     /** Notify listeners that data changed. */
     void emitDataChanged(int index);
@@ -89,6 +99,9 @@ public Q_SLOTS:
      */
     void updateEntry(const QString &address, const QString &label, bool isMine, const QString &purpose, int status);
 
+private Q_SLOTS:
+    void addLoadedEntries();
+
     friend class AddressTablePriv;
 };
 
@@ -44,25 +44,20 @@ public:
     /** Order (ascending or descending) to sort nodes by */
     Qt::SortOrder sortOrder;
 
-    /** Pull a full list of banned nodes from CNode into our cache */
-    void refreshBanlist()
+    /** Whether the cache is in the order of sortColumn (always, when unsorted) */
+    bool isSorted() const
     {
-        banmap_t banMap;
-        if(g_connman)
-            g_connman->GetBanned(banMap);
-
-        cachedBanlist.clear();
-#if QT_VERSION >= 0x040700
-        cachedBanlist.reserve(banMap.size());
-#endif
-        for (banmap_t::iterator it = banMap.begin(); it != banMap.end(); it++)
-        {
-            CCombinedBan banEntry;
-            banEntry.subnet = (*it).first;
-            banEntry.banEntry = (*it).second;
-            cachedBanlist.append(banEntry);
-        }
+        if (sortColumn < 0)
+            return true;
+        BannedNodeLessThan lessThan(sortColumn, sortOrder);
+        for (int i = 1; i < cachedBanlist.size(); i++)
+            if (lessThan(cachedBanlist[i], cachedBanlist[i - 1]))
+                return false;
+        return true;
+    }
 
+    void sort()
+    {
         if (sortColumn >= 0)
             // sort cachedBanlist (use stable sort to prevent rows jumping around unnecessarily)
             qStableSort(cachedBanlist.begin(), cachedBanlist.end(), BannedNodeLessThan(sortColumn, sortOrder));
@@ -167,16 +162,69 @@ QModelIndex BanTableModel::index(int row, int column, const QModelIndex &parent)
 
 void BanTableModel::refresh()
 {
-    Q_EMIT layoutAboutToBeChanged();
-    priv->refreshBanlist();
-    Q_EMIT layoutChanged();
+    banmap_t banMap;
+    if(g_connman)
+        g_connman->GetBanned(banMap);
+
+    // SolarCoin: apply the difference to the rows, so that the views only redo the rows that
+    // changed, instead of resetting the whole layout for every ban
+    QList<CCombinedBan> &cached = priv->cachedBanlist;
+
+    // Remove the rows of the lifted bans, a run of rows at a time
+    for (int row = cached.size() - 1; row >= 0; --row)
+    {
+        if (banMap.count(cached[row].subnet))
+            continue;
+        int last = row;
+        while (row > 0 && !banMap.count(cached[row - 1].subnet))
+            --row;
+        beginRemoveRows(QModelIndex(), row, last);
+        cached.erase(cached.begin() + row, cached.begin() + last + 1);
+        endRemoveRows();
+    }
+
+    // Update the bans that were extended or shortened
+    for (int row = 0; row < cached.size(); ++row)
+    {
+        banmap_t::iterator it = banMap.find(cached[row].subnet);
+        if (cached[row].banEntry.nBanUntil != it->second.nBanUntil)
+        {
+            cached[row].banEntry = it->second;
+            Q_EMIT dataChanged(index(row, 0, QModelIndex()), index(row, columns.length() - 1, QModelIndex()));
+        }
+        banMap.erase(it);
+    }
+
+    // Add rows for the new bans
+    if (!banMap.empty())
+    {
+        beginInsertRows(QModelIndex(), cached.size(), cached.size() + banMap.size() - 1);
+        for (banmap_t::iterator it = banMap.begin(); it != banMap.end(); it++)
+        {
+            CCombinedBan banEntry;
+            banEntry.subnet = (*it).first;
+            banEntry.banEntry = (*it).second;
+            cached.append(banEntry);
+        }
+        endInsertRows();
+    }
+
+    // Move rows only when the sort order no longer holds
+    if (!priv->isSorted())
+    {
+        Q_EMIT layoutAboutToBeChanged();
+        priv->sort();
+        Q_EMIT layoutChanged();
+    }
 }
 
 void BanTableModel::sort(int column, Qt::SortOrder order)
 {
     priv->sortColumn = column;
     priv->sortOrder = order;
-    refresh();
+    Q_EMIT layoutAboutToBeChanged();
+    priv->sort();
+    Q_EMIT layoutChanged();
 }
 
 bool BanTableModel::shouldShow()
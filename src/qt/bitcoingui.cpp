@@ -25,6 +25,8 @@
 #ifdef ENABLE_WALLET
 #include <qt/walletframe.h>
 #include <qt/walletmodel.h>
+#include <wallet/stakeminer.h>
+#include <wallet/wallet.h>
 #endif // ENABLE_WALLET
 
 #ifdef Q_OS_MAC
@@ -33,8 +35,10 @@
 
 #include <chainparams.h>
 #include <init.h>
+#include <kernel.h>
 #include <ui_interface.h>
 #include <util.h>
+#include <validation.h>
 
 #include <iostream>
 
@@ -92,6 +96,7 @@ BitcoinGUI::BitcoinGUI(const PlatformStyle *_platformStyle, const NetworkStyle *
     unitDisplayControl(0),
     labelWalletEncryptionIcon(0),
     labelWalletHDStatusIcon(0),
+    labelStakingIcon(0),
     connectionsControl(0),
     labelBlocksIcon(0),
     progressBarLabel(0),
@@ -231,6 +236,7 @@ BitcoinGUI::BitcoinGUI(const PlatformStyle *_platformStyle, const NetworkStyle *
     setStyleSheet(GUIUtil::veriStyleSheet);
     labelWalletEncryptionIcon = new QLabel();
     labelWalletHDStatusIcon = new QLabel();
+    labelStakingIcon = new QLabel();
     connectionsControl = new GUIUtil::ClickableLabel();
     labelBlocksIcon = new GUIUtil::ClickableLabel();
     if(enableWallet)
@@ -240,6 +246,7 @@ BitcoinGUI::BitcoinGUI(const PlatformStyle *_platformStyle, const NetworkStyle *
         frameBlocksLayout->addStretch();
         frameBlocksLayout->addWidget(labelWalletEncryptionIcon);
         frameBlocksLayout->addWidget(labelWalletHDStatusIcon);
+        frameBlocksLayout->addWidget(labelStakingIcon);
     }
     frameBlocksLayout->addStretch();
     frameBlocksLayout->addWidget(connectionsControl);
@@ -284,6 +291,11 @@ BitcoinGUI::BitcoinGUI(const PlatformStyle *_platformStyle, const NetworkStyle *
         connect(walletFrame, SIGNAL(requestedSyncWarningInfo()), this, SLOT(showModalOverlay()));
         connect(labelBlocksIcon, SIGNAL(clicked(QPoint)), this, SLOT(showModalOverlay()));
         connect(progressBar, SIGNAL(clicked(QPoint)), this, SLOT(showModalOverlay()));
+
+        QTimer *timerStakingIcon = new QTimer(labelStakingIcon);
+        connect(timerStakingIcon, SIGNAL(timeout()), this, SLOT(updateStakingIcon()));
+        timerStakingIcon->start(STAKING_UPDATE_DELAY);
+        updateStakingIcon();
     }
 #endif
 }
@@ -1216,6 +1228,46 @@ void BitcoinGUI::setHDStatus(int hdEnabled)
     labelWalletHDStatusIcon->setEnabled(hdEnabled);
 }
 
+void BitcoinGUI::updateStakingIcon()
+{
+    // SolarCoin: only reads what the stake miner and the stake candidates keep, so it never walks
+    // the wallet; the weight is as of the stake miner's last round.
+    if (!pwalletMain)
+        return;
+    CStakeMinerStats stats = GetStakeMinerStats();
+    CAmount nWeight = pwalletMain->stakeCandidates.GetWeight();
+    double dNetworkWeight;
+    {
+        TRY_LOCK(cs_main, lockMain);
+        if (!lockMain)
+            return;
+        dNetworkWeight = GetPoSKernelPS(chainActive.Tip(), Params().GetConsensus());
+    }
+
+    labelStakingIcon->setPixmap(platformStyle->SingleColorIcon(":/icons/stake100").pixmap(STATUSBAR_ICONSIZE,STATUSBAR_ICONSIZE));
+    if (stats.fStaking && nWeight > 0) {
+        int unit = clientModel && clientModel->getOptionsModel() ? clientModel->getOptionsModel()->getDisplayUnit() : BitcoinUnits::BTC;
+        int64_t nExpectedTime = Params().GetConsensus().nTargetSpacing * dNetworkWeight * COIN / nWeight;
+        labelStakingIcon->setEnabled(true);
+        labelStakingIcon->setToolTip(tr("Staking.<br>Your weight is %1<br>Network weight is %2<br>Expected time to earn reward is %3<br>Searching %4 kernels per second")
+            .arg(BitcoinUnits::formatWithUnit(unit, nWeight))
+            .arg(QString::number(dNetworkWeight, 'f', 0))
+            .arg(GUIUtil::formatDurationStr(nExpectedTime))
+            .arg(QString::number(stats.dKernelsPerSecond, 'f', 0)));
+    } else {
+        // Disabling the QLabel sets its opacity to 50%
+        labelStakingIcon->setEnabled(false);
+        if (!stats.fEnabled)
+            labelStakingIcon->setToolTip(tr("Not staking because staking is disabled"));
+        else if (pwalletMain->IsLocked())
+            labelStakingIcon->setToolTip(tr("Not staking because wallet is locked"));
+        else if (!stats.fStaking)
+            labelStakingIcon->setToolTip(tr("Not staking because wallet is offline or syncing"));
+        else
+            labelStakingIcon->setToolTip(tr("Not staking because you don't have mature coins"));
+    }
+}
+
 void BitcoinGUI::setEncryptionStatus(int status)
 {
     switch(status)
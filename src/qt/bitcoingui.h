@@ -83,6 +83,7 @@ private:
     UnitDisplayStatusBarControl *unitDisplayControl;
     QLabel *labelWalletEncryptionIcon;
     QLabel *labelWalletHDStatusIcon;
+    QLabel *labelStakingIcon;
     QLabel *connectionsControl;
     QLabel *labelBlocksIcon;
     QLabel *progressBarLabel;
@@ -221,6 +222,9 @@ private Q_SLOTS:
 
     /** Show open dialog */
     void openClicked();
+
+    /** Show the stake miner state from its counters and the cached stake weight */
+    void updateStakingIcon();
 #endif // ENABLE_WALLET
     /**Resize GUI window*/
     void resizeGUI();
@@ -27,15 +27,15 @@
 class CBlockIndex;
 
 static const int64_t nClientStartupTime = GetTime();
-static int64_t nLastHeaderTipUpdateNotification = 0;
-static int64_t nLastBlockTipUpdateNotification = 0;
 
 ClientModel::ClientModel(OptionsModel *_optionsModel, QObject *parent) :
     QObject(parent),
     optionsModel(_optionsModel),
     peerTableModel(0),
     banTableModel(0),
-    pollTimer(0)
+    pollTimer(0),
+    blockTipTimer(0),
+    headerTipTimer(0)
 {
     cachedBestHeaderHeight = -1;
     cachedBestHeaderTime = -1;
@@ -45,6 +45,14 @@ ClientModel::ClientModel(OptionsModel *_optionsModel, QObject *parent) :
     connect(pollTimer, SIGNAL(timeout()), this, SLOT(updateTimer()));
     pollTimer->start(MODEL_UPDATE_DELAY);
 
+    blockTip = headerTip = TipSnapshot{-1, 0, 0.0, false};
+    blockTipTimer = new QTimer(this);
+    blockTipTimer->setSingleShot(true);
+    connect(blockTipTimer, SIGNAL(timeout()), this, SLOT(publishBlockTip()));
+    headerTipTimer = new QTimer(this);
+    headerTipTimer->setSingleShot(true);
+    connect(headerTipTimer, SIGNAL(timeout()), this, SLOT(publishHeaderTip()));
+
     subscribeToCoreSignals();
 }
 
@@ -287,30 +295,63 @@ static void BannedListChanged(ClientModel *clientmodel)
 
 static void BlockTipChanged(ClientModel *clientmodel, bool initialSync, const CBlockIndex *pIndex, bool fHeader)
 {
-    // lock free async UI updates in case we have a new block tip
-    // during initial sync, only update the UI if the last update
-    // was > 250ms (MODEL_UPDATE_DELAY) ago
-    int64_t now = 0;
-    if (initialSync)
-        now = GetTimeMillis();
-
-    int64_t& nLastUpdateNotification = fHeader ? nLastHeaderTipUpdateNotification : nLastBlockTipUpdateNotification;
-
     if (fHeader) {
         // cache best headers time and height to reduce future cs_main locks
         clientmodel->cachedBestHeaderHeight = pIndex->nHeight;
         clientmodel->cachedBestHeaderTime = pIndex->GetBlockTime();
     }
-    // if we are in-sync, update the UI regardless of last update time
-    if (!initialSync || now - nLastUpdateNotification > MODEL_UPDATE_DELAY) {
-        //pass a async signal to the UI thread
-        QMetaObject::invokeMethod(clientmodel, "numBlocksChanged", Qt::QueuedConnection,
-                                  Q_ARG(int, pIndex->nHeight),
-                                  Q_ARG(QDateTime, QDateTime::fromTime_t(pIndex->GetBlockTime())),
-                                  Q_ARG(double, clientmodel->getVerificationProgress(pIndex)),
-                                  Q_ARG(bool, fHeader));
-        nLastUpdateNotification = now;
+    // lock free async UI updates, the GUI thread only ever sees a copy of the tip
+    clientmodel->notifyTip(fHeader, initialSync, pIndex->nHeight, pIndex->GetBlockTime(),
+                           GuessVerificationProgress(Params().TxData(), const_cast<CBlockIndex *>(pIndex)));
+}
+
+void ClientModel::notifyTip(bool header, bool initialSync, int height, int64_t time, double verificationProgress)
+{
+    bool fQueue;
+    {
+        std::lock_guard<std::mutex> lock(cs_tips);
+        TipSnapshot& tip = header ? headerTip : blockTip;
+        fQueue = !tip.fQueued;
+        tip = TipSnapshot{height, time, verificationProgress, true};
+    }
+    if (fQueue)
+        QMetaObject::invokeMethod(this, "queueTip", Qt::QueuedConnection, Q_ARG(bool, header), Q_ARG(bool, initialSync));
+}
+
+void ClientModel::queueTip(bool header, bool initialSync)
+{
+    // SolarCoin: during initial sync, show the newest tip at most every MODEL_UPDATE_DELAY; as the
+    // tip is picked up when the timer fires, the last one of a burst is never dropped
+    QTimer *timer = header ? headerTipTimer : blockTipTimer;
+    if (initialSync) {
+        if (!timer->isActive())
+            timer->start(MODEL_UPDATE_DELAY);
+        return;
+    }
+    timer->stop();
+    publishTip(header);
+}
+
+void ClientModel::publishBlockTip()
+{
+    publishTip(false);
+}
+
+void ClientModel::publishHeaderTip()
+{
+    publishTip(true);
+}
+
+void ClientModel::publishTip(bool header)
+{
+    TipSnapshot tip;
+    {
+        std::lock_guard<std::mutex> lock(cs_tips);
+        TipSnapshot& queued = header ? headerTip : blockTip;
+        queued.fQueued = false;
+        tip = queued;
     }
+    Q_EMIT numBlocksChanged(tip.nHeight, QDateTime::fromTime_t(tip.nTime), tip.dProgress, header);
 }
 
 void ClientModel::subscribeToCoreSignals()
@@ -9,6 +9,7 @@
 #include <QDateTime>
 
 #include <atomic>
+#include <mutex>
 
 class BanTableModel;
 class OptionsModel;
@@ -84,6 +85,9 @@ public:
     mutable std::atomic<int> cachedBestHeaderHeight;
     mutable std::atomic<int64_t> cachedBestHeaderTime;
 
+    //! Take a new block or header tip, from the thread that connected it
+    void notifyTip(bool header, bool initialSync, int height, int64_t time, double verificationProgress);
+
 private:
     OptionsModel *optionsModel;
     PeerTableModel *peerTableModel;
@@ -91,6 +95,22 @@ private:
 
     QTimer *pollTimer;
 
+    //! SolarCoin: The newest tip not shown yet, copied by value so that the GUI thread never reads
+    //! the block index; notifications coming in while one is queued only replace it
+    struct TipSnapshot
+    {
+        int nHeight;
+        int64_t nTime;
+        double dProgress;
+        bool fQueued;
+    };
+    std::mutex cs_tips;
+    TipSnapshot blockTip;
+    TipSnapshot headerTip;
+    QTimer *blockTipTimer;
+    QTimer *headerTipTimer;
+
+    void publishTip(bool header);
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
 
@@ -114,6 +134,11 @@ public Q_SLOTS:
     void updateNetworkActive(bool networkActive);
     void updateAlert();
     void updateBanlist();
+
+private Q_SLOTS:
+    void queueTip(bool header, bool initialSync);
+    void publishBlockTip();
+    void publishHeaderTip();
 };
 
 #endif // BITCOIN_QT_CLIENTMODEL_H
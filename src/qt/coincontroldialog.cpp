@@ -20,11 +20,15 @@
 #include <validation.h> // For mempool
 #include <wallet/wallet.h>
 
+#include <map>
+#include <set>
+
 #include <QApplication>
 #include <QCheckBox>
 #include <QCursor>
 #include <QDialogButtonBox>
 #include <QFlags>
+#include <QHash>
 #include <QIcon>
 #include <QSettings>
 #include <QString>
@@ -35,6 +39,62 @@ QList<CAmount> CoinControlDialog::payAmounts;
 CCoinControl* CoinControlDialog::coinControl = new CCoinControl();
 bool CoinControlDialog::fSubtractFeeFromAmount = false;
 
+namespace {
+
+/** What a selected coin adds to the totals of updateLabels() */
+struct CoinControlInput
+{
+    CAmount nValue;
+    double dPriority;
+    unsigned int nBytes;
+    bool fUncompressed;
+    bool fWitness;
+};
+
+/**
+ * SolarCoin: The coins selected so far, so a click only computes the coins it selects rather than
+ * reading every selected coin and its key from the wallet again. Dropped when the chain moves, as
+ * the priorities depend on the depth.
+ */
+std::map<COutPoint, CoinControlInput> mapSelectedInputs;
+int nSelectedInputsHeight = -1;
+
+CoinControlInput GetCoinControlInput(WalletModel *model, const COutput& out)
+{
+    const CTxOut& txout = out.tx->tx->vout[out.i];
+    CoinControlInput input;
+    input.nValue = txout.nValue;
+    input.dPriority = (double)txout.nValue * (out.nDepth+1);
+    input.fUncompressed = false;
+    input.fWitness = false;
+
+    // Bytes
+    CTxDestination address;
+    int witnessversion = 0;
+    std::vector<unsigned char> witnessprogram;
+    if (txout.scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram))
+    {
+        input.nBytes = (32 + 4 + 1 + (107 / WITNESS_SCALE_FACTOR) + 4);
+        input.fWitness = true;
+    }
+    else if(ExtractDestination(txout.scriptPubKey, address))
+    {
+        CPubKey pubkey;
+        CKeyID *keyid = boost::get<CKeyID>(&address);
+        if (keyid && model->getPubKey(*keyid, pubkey))
+        {
+            input.nBytes = (pubkey.IsCompressed() ? 148 : 180);
+            input.fUncompressed = !pubkey.IsCompressed();
+        }
+        else
+            input.nBytes = 148; // in all error cases, simply assume 148 here
+    }
+    else input.nBytes = 148;
+    return input;
+}
+
+} // anon namespace
+
 bool CCoinControlWidgetItem::operator<(const QTreeWidgetItem &other) const {
     int column = treeWidget()->sortColumn();
     if (column == CoinControlDialog::COLUMN_AMOUNT || column == CoinControlDialog::COLUMN_DATE || column == CoinControlDialog::COLUMN_CONFIRMATIONS)
@@ -462,53 +522,59 @@ void CoinControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
     bool fWitness               = false;
 
     std::vector<COutPoint> vCoinControl;
-    std::vector<COutput>   vOutputs;
     coinControl->ListSelected(vCoinControl);
-    model->getOutputs(vCoinControl, vOutputs);
-
-    BOOST_FOREACH(const COutput& out, vOutputs) {
-        // unselect already spent, very unlikely scenario, this could happen
-        // when selected are spent elsewhere, like rpc or another computer
-        uint256 txhash = out.tx->GetHash();
-        COutPoint outpt(txhash, out.i);
-        if (model->isSpent(outpt))
-        {
+
+    // unselect already spent, very unlikely scenario, this could happen
+    // when selected are spent elsewhere, like rpc or another computer
+    std::vector<COutPoint> vSpent;
+    int nHeight = model->listSpent(vCoinControl, vSpent);
+    if (!vSpent.empty())
+    {
+        BOOST_FOREACH(const COutPoint& outpt, vSpent)
             coinControl->UnSelect(outpt);
+        vCoinControl.clear();
+        coinControl->ListSelected(vCoinControl);
+    }
+
+    // Read only the coins selected since the last update from the wallet
+    if (nHeight != nSelectedInputsHeight)
+    {
+        mapSelectedInputs.clear();
+        nSelectedInputsHeight = nHeight;
+    }
+    std::vector<COutPoint> vNewlySelected;
+    BOOST_FOREACH(const COutPoint& outpt, vCoinControl)
+        if (!mapSelectedInputs.count(outpt))
+            vNewlySelected.push_back(outpt);
+    if (!vNewlySelected.empty())
+    {
+        std::vector<COutput> vOutputs;
+        model->getOutputs(vNewlySelected, vOutputs);
+        BOOST_FOREACH(const COutput& out, vOutputs)
+            mapSelectedInputs[COutPoint(out.tx->GetHash(), out.i)] = GetCoinControlInput(model, out);
+    }
+
+    BOOST_FOREACH(const COutPoint& outpt, vCoinControl) {
+        std::map<COutPoint, CoinControlInput>::const_iterator it = mapSelectedInputs.find(outpt);
+        if (it == mapSelectedInputs.end())
             continue;
-        }
+        const CoinControlInput& input = it->second;
 
         // Quantity
         nQuantity++;
 
         // Amount
-        nAmount += out.tx->tx->vout[out.i].nValue;
+        nAmount += input.nValue;
 
         // Priority
-        dPriorityInputs += (double)out.tx->tx->vout[out.i].nValue * (out.nDepth+1);
+        dPriorityInputs += input.dPriority;
 
         // Bytes
-        CTxDestination address;
-        int witnessversion = 0;
-        std::vector<unsigned char> witnessprogram;
-        if (out.tx->tx->vout[out.i].scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram))
-        {
-            nBytesInputs += (32 + 4 + 1 + (107 / WITNESS_SCALE_FACTOR) + 4);
+        nBytesInputs += input.nBytes;
+        if (input.fUncompressed)
+            nQuantityUncompressed++;
+        if (input.fWitness)
             fWitness = true;
-        }
-        else if(ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, address))
-        {
-            CPubKey pubkey;
-            CKeyID *keyid = boost::get<CKeyID>(&address);
-            if (keyid && model->getPubKey(*keyid, pubkey))
-            {
-                nBytesInputs += (pubkey.IsCompressed() ? 148 : 180);
-                if (!pubkey.IsCompressed())
-                    nQuantityUncompressed++;
-            }
-            else
-                nBytesInputs += 148; // in all error cases, simply assume 148 here
-        }
-        else nBytesInputs += 148;
     }
 
     // calculation
@@ -651,6 +717,7 @@ void CoinControlDialog::updateView()
 
     ui->treeWidget->clear();
     ui->treeWidget->setEnabled(false); // performance, otherwise updateLabels would be called for every checked checkbox
+    ui->treeWidget->setUpdatesEnabled(false); // performance, painted once filled
     ui->treeWidget->setAlternatingRowColors(!treeMode);
     QFlags<Qt::ItemFlag> flgCheckbox = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable;
     QFlags<Qt::ItemFlag> flgTristate = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsTristate;
@@ -660,13 +727,28 @@ void CoinControlDialog::updateView()
     std::map<QString, std::vector<COutput> > mapCoins;
     model->listCoins(mapCoins);
 
+    // SolarCoin: The locked coins and the labels are looked up once, not for every output
+    std::vector<COutPoint> vLockedCoins;
+    model->listLockedCoins(vLockedCoins);
+    std::set<COutPoint> setLockedCoins(vLockedCoins.begin(), vLockedCoins.end());
+    QHash<QString, QString> labels;
+    AddressTableModel *addressTableModel = model->getAddressTableModel();
+    auto labelForAddress = [&labels, addressTableModel](const QString& address) -> QString {
+        QHash<QString, QString>::const_iterator it = labels.constFind(address);
+        if (it != labels.constEnd())
+            return it.value();
+        QString label = addressTableModel->labelForAddress(address);
+        if (label.isEmpty())
+            label = tr("(no label)");
+        labels.insert(address, label);
+        return label;
+    };
+
     BOOST_FOREACH(const PAIRTYPE(QString, std::vector<COutput>)& coins, mapCoins) {
         CCoinControlWidgetItem *itemWalletAddress = new CCoinControlWidgetItem();
         itemWalletAddress->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
         QString sWalletAddress = coins.first;
-        QString sWalletLabel = model->getAddressTableModel()->labelForAddress(sWalletAddress);
-        if (sWalletLabel.isEmpty())
-            sWalletLabel = tr("(no label)");
+        QString sWalletLabel = labelForAddress(sWalletAddress);
 
         if (treeMode)
         {
@@ -716,10 +798,7 @@ void CoinControlDialog::updateView()
             }
             else if (!treeMode)
             {
-                QString sLabel = model->getAddressTableModel()->labelForAddress(sAddress);
-                if (sLabel.isEmpty())
-                    sLabel = tr("(no label)");
-                itemOutput->setText(COLUMN_LABEL, sLabel);
+                itemOutput->setText(COLUMN_LABEL, labelForAddress(sAddress));
             }
 
             // amount
@@ -742,7 +821,7 @@ void CoinControlDialog::updateView()
             itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.i));
 
              // disable locked coins
-            if (model->isLockedCoin(txhash, out.i))
+            if (setLockedCoins.count(COutPoint(txhash, out.i)))
             {
                 COutPoint outpt(txhash, out.i);
                 coinControl->UnSelect(outpt); // just to be sure
@@ -774,5 +853,6 @@ void CoinControlDialog::updateView()
 
     // sort view
     sortView(sortColumn, sortOrder);
+    ui->treeWidget->setUpdatesEnabled(true);
     ui->treeWidget->setEnabled(true);
 }
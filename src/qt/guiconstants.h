@@ -12,12 +12,18 @@
 /* Milliseconds between model updates */
 static const int MODEL_UPDATE_DELAY = 250;
 
+/* Milliseconds without typing before the transaction filters apply */
+static const int INPUT_FILTER_DELAY = 200;
+
 /* AskPassphraseDialog -- Maximum passphrase length */
 static const int MAX_PASSPHRASE_SIZE = 1024;
 
 /* BitcoinGUI -- Size of icons in status bar */
 static const int STATUSBAR_ICONSIZE = 16;
 
+/* BitcoinGUI -- Milliseconds between updates of the staking icon */
+static const int STAKING_UPDATE_DELAY = 10000;
+
 static const bool DEFAULT_SPLASHSCREEN = true;
 
 /* Invalid field background style */
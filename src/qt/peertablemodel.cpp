@@ -38,6 +38,14 @@ bool NodeLessThan::operator()(const CNodeCombinedStats &left, const CNodeCombine
     return false;
 }
 
+/** Whether the columns shown for a peer differ between two snapshots of its statistics */
+static bool NodeRowChanged(const CNodeCombinedStats &left, const CNodeCombinedStats &right)
+{
+    return left.nodeStats.addrName != right.nodeStats.addrName ||
+           left.nodeStats.cleanSubVer != right.nodeStats.cleanSubVer ||
+           left.nodeStats.dMinPing != right.nodeStats.dMinPing;
+}
+
 // private implementation
 class PeerTablePriv
 {
@@ -51,44 +59,28 @@ public:
     /** Index of rows by node ID */
     std::map<NodeId, int> mapNodeRows;
 
-    /** Pull a full list of peers from vNodes into our cache */
-    void refreshPeers()
+    /** Whether the cache is in the order of sortColumn (always, when unsorted) */
+    bool isSorted() const
     {
-        {
-            cachedNodeStats.clear();
-            std::vector<CNodeStats> vstats;
-            if(g_connman)
-                g_connman->GetNodeStats(vstats);
-#if QT_VERSION >= 0x040700
-            cachedNodeStats.reserve(vstats.size());
-#endif
-            for (const CNodeStats& nodestats : vstats)
-            {
-                CNodeCombinedStats stats;
-                stats.nodeStateStats.nMisbehavior = 0;
-                stats.nodeStateStats.nSyncHeight = -1;
-                stats.nodeStateStats.nCommonHeight = -1;
-                stats.fNodeStateStatsAvailable = false;
-                stats.nodeStats = nodestats;
-                cachedNodeStats.append(stats);
-            }
-        }
-
-        // Try to retrieve the CNodeStateStats for each node.
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (lockMain)
-            {
-                for (CNodeCombinedStats &stats : cachedNodeStats)
-                    stats.fNodeStateStatsAvailable = GetNodeStateStats(stats.nodeStats.nodeid, stats.nodeStateStats);
-            }
-        }
+        if (sortColumn < 0)
+            return true;
+        NodeLessThan lessThan(sortColumn, sortOrder);
+        for (int i = 1; i < cachedNodeStats.size(); i++)
+            if (lessThan(cachedNodeStats[i], cachedNodeStats[i - 1]))
+                return false;
+        return true;
+    }
 
+    void sort()
+    {
         if (sortColumn >= 0)
             // sort cacheNodeStats (use stable sort to prevent rows jumping around unnecessarily)
             qStableSort(cachedNodeStats.begin(), cachedNodeStats.end(), NodeLessThan(sortColumn, sortOrder));
+    }
 
-        // build index map
+    /** Rebuild the index map */
+    void indexRows()
+    {
         mapNodeRows.clear();
         int row = 0;
         for (const CNodeCombinedStats& stats : cachedNodeStats)
@@ -109,10 +101,63 @@ public:
     }
 };
 
+/* SolarCoin: Pulls the statistics of the peers from the node on a worker thread, so that neither
+   copying them nor waiting for cs_main holds up the GUI.
+*/
+class PeerTableCollector : public QObject
+{
+    Q_OBJECT
+
+public Q_SLOTS:
+    void collect();
+
+Q_SIGNALS:
+    void collected(const QList<CNodeCombinedStats> &stats);
+};
+
+#include <qt/peertablemodel.moc>
+
+void PeerTableCollector::collect()
+{
+    QList<CNodeCombinedStats> collectedStats;
+    {
+        std::vector<CNodeStats> vstats;
+        if(g_connman)
+            g_connman->GetNodeStats(vstats);
+#if QT_VERSION >= 0x040700
+        collectedStats.reserve(vstats.size());
+#endif
+        for (const CNodeStats& nodestats : vstats)
+        {
+            CNodeCombinedStats stats;
+            stats.nodeStateStats.nMisbehavior = 0;
+            stats.nodeStateStats.nSyncHeight = -1;
+            stats.nodeStateStats.nCommonHeight = -1;
+            stats.fNodeStateStatsAvailable = false;
+            stats.nodeStats = nodestats;
+            collectedStats.append(stats);
+        }
+    }
+
+    // Try to retrieve the CNodeStateStats for each node.
+    {
+        TRY_LOCK(cs_main, lockMain);
+        if (lockMain)
+        {
+            for (CNodeCombinedStats &stats : collectedStats)
+                stats.fNodeStateStatsAvailable = GetNodeStateStats(stats.nodeStats.nodeid, stats.nodeStateStats);
+        }
+    }
+
+    Q_EMIT collected(collectedStats);
+}
+
 PeerTableModel::PeerTableModel(ClientModel *parent) :
     QAbstractTableModel(parent),
     clientModel(parent),
-    timer(0)
+    timer(0),
+    collector(new PeerTableCollector()),
+    fCollecting(false)
 {
     columns << tr("NodeId") << tr("Node/Service") << tr("User Agent") << tr("Ping");
     priv.reset(new PeerTablePriv());
@@ -124,13 +169,21 @@ PeerTableModel::PeerTableModel(ClientModel *parent) :
     connect(timer, SIGNAL(timeout()), SLOT(refresh()));
     timer->setInterval(MODEL_UPDATE_DELAY);
 
+    qRegisterMetaType<QList<CNodeCombinedStats> >("QList<CNodeCombinedStats>");
+    collector->moveToThread(&collectorThread);
+    connect(collector, SIGNAL(collected(QList<CNodeCombinedStats>)), this, SLOT(applyStats(QList<CNodeCombinedStats>)));
+    // The collector is deleted in its thread once the thread is done
+    connect(&collectorThread, SIGNAL(finished()), collector, SLOT(deleteLater()), Qt::DirectConnection);
+    collectorThread.start();
+
     // load initial data
     refresh();
 }
 
 PeerTableModel::~PeerTableModel()
 {
-    // Intentionally left empty
+    collectorThread.quit();
+    collectorThread.wait();
 }
 
 void PeerTableModel::startAutoRefresh()
@@ -220,9 +273,78 @@ const CNodeCombinedStats *PeerTableModel::getNodeStats(int idx)
 
 void PeerTableModel::refresh()
 {
-    Q_EMIT layoutAboutToBeChanged();
-    priv->refreshPeers();
-    Q_EMIT layoutChanged();
+    // The ticks of the timer while a collection is in flight are skipped
+    if (fCollecting)
+        return;
+    fCollecting = true;
+    QMetaObject::invokeMethod(collector, "collect", Qt::QueuedConnection);
+}
+
+void PeerTableModel::applyStats(const QList<CNodeCombinedStats> &stats)
+{
+    fCollecting = false;
+
+    // SolarCoin: apply the difference to the rows, so that the views only redo the rows that
+    // changed, instead of resetting the whole layout at every refresh
+    std::map<NodeId, const CNodeCombinedStats*> mapStats;
+    for (const CNodeCombinedStats &nodeStats : stats)
+        mapStats.insert(std::make_pair(nodeStats.nodeStats.nodeid, &nodeStats));
+    QList<CNodeCombinedStats> &cached = priv->cachedNodeStats;
+
+    // Remove the rows of the peers that disconnected, a run of rows at a time
+    for (int row = cached.size() - 1; row >= 0; --row)
+    {
+        if (mapStats.count(cached[row].nodeStats.nodeid))
+            continue;
+        int last = row;
+        while (row > 0 && !mapStats.count(cached[row - 1].nodeStats.nodeid))
+            --row;
+        beginRemoveRows(QModelIndex(), row, last);
+        cached.erase(cached.begin() + row, cached.begin() + last + 1);
+        endRemoveRows();
+    }
+
+    // Update the rows of the peers still connected, telling the views about those shown differently
+    int firstChanged = -1;
+    int lastChanged = -1;
+    for (int row = 0; row < cached.size(); ++row)
+    {
+        std::map<NodeId, const CNodeCombinedStats*>::iterator it = mapStats.find(cached[row].nodeStats.nodeid);
+        if (NodeRowChanged(cached[row], *it->second))
+        {
+            if (firstChanged < 0)
+                firstChanged = row;
+            lastChanged = row;
+        }
+        cached[row] = *it->second;
+        mapStats.erase(it);
+    }
+    if (firstChanged >= 0)
+        Q_EMIT dataChanged(index(firstChanged, 0, QModelIndex()), index(lastChanged, columns.length() - 1, QModelIndex()));
+
+    // Add rows for the peers that connected
+    if (!mapStats.empty())
+    {
+        beginInsertRows(QModelIndex(), cached.size(), cached.size() + mapStats.size() - 1);
+        for (const CNodeCombinedStats &nodeStats : stats)
+            if (mapStats.count(nodeStats.nodeStats.nodeid))
+                cached.append(nodeStats);
+        endInsertRows();
+    }
+
+    // Move rows only when the sort order no longer holds
+    if (!priv->isSorted())
+    {
+        Q_EMIT layoutAboutToBeChanged();
+        priv->sort();
+        priv->indexRows();
+        Q_EMIT layoutChanged();
+    }
+    else
+    {
+        priv->indexRows();
+    }
+    Q_EMIT statsUpdated();
 }
 
 int PeerTableModel::getRowByNodeId(NodeId nodeid)
@@ -238,5 +360,8 @@ void PeerTableModel::sort(int column, Qt::SortOrder order)
 {
     priv->sortColumn = column;
     priv->sortOrder = order;
-    refresh();
+    Q_EMIT layoutAboutToBeChanged();
+    priv->sort();
+    priv->indexRows();
+    Q_EMIT layoutChanged();
 }
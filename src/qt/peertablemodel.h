@@ -10,8 +10,10 @@
 
 #include <QAbstractTableModel>
 #include <QStringList>
+#include <QThread>
 
 class ClientModel;
+class PeerTableCollector;
 class PeerTablePriv;
 
 QT_BEGIN_NAMESPACE
@@ -73,11 +75,23 @@ public:
 public Q_SLOTS:
     void refresh();
 
+Q_SIGNALS:
+    /** The statistics of the peers were updated, whether or not a row changed */
+    void statsUpdated();
+
+private Q_SLOTS:
+    void applyStats(const QList<CNodeCombinedStats> &stats);
+
 private:
     ClientModel *clientModel;
     QStringList columns;
     std::unique_ptr<PeerTablePriv> priv;
     QTimer *timer;
+    /** SolarCoin: Collects the statistics on collectorThread, so the GUI does not wait on the
+        node locks; at most one collection is in flight (fCollecting) */
+    PeerTableCollector *collector;
+    QThread collectorThread;
+    bool fCollecting;
 };
 
 #endif // BITCOIN_QT_PEERTABLEMODEL_H
@@ -29,6 +29,7 @@
 #endif
 
 #include <QDesktopWidget>
+#include <QFile>
 #include <QKeyEvent>
 #include <QMenu>
 #include <QMessageBox>
@@ -52,6 +53,10 @@ const int CONSOLE_HISTORY = 50;
 const int INITIAL_TRAFFIC_GRAPH_MINS = 30;
 const QSize FONT_RANGE(4, 40);
 const char fontSizeSettingsKey[] = "consoleFontSize";
+// SolarCoin: A reply longer than this is shown cut short; the whole of it can be saved to a file
+const int CONSOLE_MAX_REPLY_CHARS = 256 * 1024;
+// SolarCoin: A long reply is appended this much at a time, the GUI repainting and taking input in between
+const int CONSOLE_REPLY_CHUNK_CHARS = 16 * 1024;
 
 const struct {
     const char *url;
@@ -418,7 +423,8 @@ RPCConsole::RPCConsole(const PlatformStyle *_platformStyle, QWidget *parent) :
     platformStyle(_platformStyle),
     peersTableContextMenu(0),
     banTableContextMenu(0),
-    consoleFontSize(0)
+    consoleFontSize(0),
+    replyTimer(0)
 {
     ui->setupUi(this);
     QSettings settings;
@@ -445,6 +451,11 @@ RPCConsole::RPCConsole(const PlatformStyle *_platformStyle, QWidget *parent) :
     connect(ui->fontSmallerButton, SIGNAL(clicked()), this, SLOT(fontSmaller()));
     connect(ui->btnClearTrafficGraph, SIGNAL(clicked()), ui->trafficGraph, SLOT(clear()));
 
+    ui->saveOutputButton->setIcon(platformStyle->SingleColorIcon(":/icons/export"));
+    replyTimer = new QTimer(this);
+    replyTimer->setSingleShot(true);
+    connect(replyTimer, SIGNAL(timeout()), this, SLOT(appendReplyChunk()));
+
     // set library version labels
 #ifdef ENABLE_WALLET
     ui->berkeleyDBVersion->setText(DbEnv::version(0, 0, 0));
@@ -590,6 +601,8 @@ void RPCConsole::setClientModel(ClientModel *model)
             this, SLOT(peerSelected(const QItemSelection &, const QItemSelection &)));
         // peer table signal handling - update peer details when new nodes are added to the model
         connect(model->getPeerTableModel(), SIGNAL(layoutChanged()), this, SLOT(peerLayoutChanged()));
+        // peer table signal handling - update peer details when the statistics were refreshed
+        connect(model->getPeerTableModel(), SIGNAL(statsUpdated()), this, SLOT(peerLayoutChanged()));
         // peer table signal handling - cache selected node ids
         connect(model->getPeerTableModel(), SIGNAL(layoutAboutToBeChanged()), this, SLOT(peerLayoutAboutToChange()));
         
@@ -619,6 +632,8 @@ void RPCConsole::setClientModel(ClientModel *model)
         connect(ui->banlistWidget, SIGNAL(clicked(const QModelIndex&)), this, SLOT(clearSelectedNode()));
         // ban table signal handling - ensure ban table is shown or hidden (if empty)
         connect(model->getBanTableModel(), SIGNAL(layoutChanged()), this, SLOT(showOrHideBanTableIfRequired()));
+        connect(model->getBanTableModel(), SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(showOrHideBanTableIfRequired()));
+        connect(model->getBanTableModel(), SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(showOrHideBanTableIfRequired()));
         showOrHideBanTableIfRequired();
 
         // Provide initial values
@@ -659,6 +674,7 @@ static QString categoryClass(int category)
     {
     case RPCConsole::CMD_REQUEST:  return "cmd-request"; break;
     case RPCConsole::CMD_REPLY:    return "cmd-reply"; break;
+    case RPCConsole::CMD_REPLY_CONTINUED: return "cmd-reply"; break;
     case RPCConsole::CMD_ERROR:    return "cmd-error"; break;
     default:                       return "misc";
     }
@@ -702,6 +718,8 @@ void RPCConsole::setFontSize(int newSize)
 void RPCConsole::clear(bool clearHistory)
 {
     ui->messagesWidget->clear();
+    pendingReplyChunks.clear();
+    replyTimer->stop();
     if(clearHistory)
     {
         history.clear();
@@ -762,8 +780,13 @@ void RPCConsole::message(int category, const QString &message, bool html)
     QTime time = QTime::currentTime();
     QString timeString = time.toString();
     QString out;
-    out += "<table><tr><td class=\"time\" width=\"65\">" + timeString + "</td>";
-    out += "<td class=\"icon\" width=\"32\"><img src=\"" + categoryClass(category) + "\"></td>";
+    // The parts of a long reply after the first go on without a time and an icon
+    bool fContinued = category == CMD_REPLY_CONTINUED;
+    out += "<table><tr><td class=\"time\" width=\"65\">" + (fContinued ? QString() : timeString) + "</td>";
+    if(fContinued)
+        out += "<td class=\"icon\" width=\"32\"></td>";
+    else
+        out += "<td class=\"icon\" width=\"32\"><img src=\"" + categoryClass(category) + "\"></td>";
     out += "<td class=\"message " + categoryClass(category) + "\" valign=\"middle\">";
     if(html)
         out += message;
@@ -773,6 +796,73 @@ void RPCConsole::message(int category, const QString &message, bool html)
     ui->messagesWidget->append(out);
 }
 
+void RPCConsole::reply(int category, const QString &text)
+{
+    stopPendingReply();
+    if(category != CMD_REPLY || text.size() <= CONSOLE_REPLY_CHUNK_CHARS)
+    {
+        message(category, text);
+        return;
+    }
+
+    // SolarCoin: a long reply is kept whole for saving, and only its beginning is shown, a part
+    // at a time: laying out megabytes in the text widget at once would freeze the GUI
+    lastReply = text;
+    ui->saveOutputButton->setEnabled(true);
+    int shownSize = qMin(text.size(), CONSOLE_MAX_REPLY_CHARS);
+    for(int pos = 0; pos < shownSize; )
+    {
+        // Break at the end of a line, when there is one in the part
+        int end = qMin(pos + CONSOLE_REPLY_CHUNK_CHARS, shownSize);
+        int next = end;
+        if(end < shownSize)
+        {
+            int newline = text.lastIndexOf('\n', end - 1);
+            if(newline > pos)
+            {
+                end = newline;
+                next = newline + 1;
+            }
+        }
+        pendingReplyChunks.append(text.mid(pos, end - pos));
+        pos = next;
+    }
+    if(shownSize < text.size())
+        pendingReplyChunks.append(tr("(%1 more characters not shown, save the reply to a file to see all of it)").arg(text.size() - shownSize));
+
+    message(CMD_REPLY, pendingReplyChunks.takeFirst());
+    replyTimer->start(0);
+}
+
+void RPCConsole::appendReplyChunk()
+{
+    if(pendingReplyChunks.isEmpty())
+        return;
+    message(CMD_REPLY_CONTINUED, pendingReplyChunks.takeFirst());
+    if(!pendingReplyChunks.isEmpty())
+        replyTimer->start(0);
+}
+
+void RPCConsole::stopPendingReply()
+{
+    if(pendingReplyChunks.isEmpty())
+        return;
+    pendingReplyChunks.clear();
+    replyTimer->stop();
+    message(CMD_REPLY_CONTINUED, tr("(reply cut short, save it to a file to see all of it)"));
+}
+
+void RPCConsole::on_saveOutputButton_clicked()
+{
+    QString filename = GUIUtil::getSaveFileName(this, tr("Save Reply"), QString(), tr("Text file (*.txt)"), NULL);
+    if(filename.isEmpty())
+        return;
+
+    QFile file(filename);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(lastReply.toUtf8()) < 0)
+        QMessageBox::critical(this, tr("Save Reply"), tr("There was an error trying to save the reply to %1.").arg(filename));
+}
+
 void RPCConsole::updateNetworkState()
 {
     QString connections = QString::number(clientModel->getNumConnections()) + " (";
@@ -839,6 +929,7 @@ void RPCConsole::on_lineEdit_returnPressed()
 
         cmdBeforeBrowsing = QString();
 
+        stopPendingReply();
         message(CMD_REQUEST, QString::fromStdString(strFilteredCmd));
         Q_EMIT cmdRequest(cmd);
 
@@ -886,7 +977,7 @@ void RPCConsole::startExecutor()
     executor->moveToThread(&thread);
 
     // Replies from executor object must go to this object
-    connect(executor, SIGNAL(reply(int,QString)), this, SLOT(message(int,QString)));
+    connect(executor, SIGNAL(reply(int,QString)), this, SLOT(reply(int,QString)));
     // Requests from this object must go to executor
     connect(this, SIGNAL(cmdRequest(QString)), executor, SLOT(request(QString)));
 
@@ -25,6 +25,7 @@ namespace Ui {
 QT_BEGIN_NAMESPACE
 class QMenu;
 class QItemSelection;
+class QTimer;
 QT_END_NAMESPACE
 
 /** Local Bitcoin RPC console. */
@@ -48,6 +49,7 @@ public:
         MC_DEBUG,
         CMD_REQUEST,
         CMD_REPLY,
+        CMD_REPLY_CONTINUED,
         CMD_ERROR
     };
 
@@ -82,6 +84,10 @@ private Q_SLOTS:
     void showOrHideBanTableIfRequired();
     /** clear the selected node */
     void clearSelectedNode();
+    /** Append the next part of a long reply */
+    void appendReplyChunk();
+    /** Save the last long reply to a file */
+    void on_saveOutputButton_clicked();
 
 public Q_SLOTS:
     void clear(bool clearHistory = true);
@@ -90,6 +96,8 @@ public Q_SLOTS:
     void setFontSize(int newSize);
     /** Append the message to the message widget */
     void message(int category, const QString &message, bool html = false);
+    /** Append a reply of the RPC executor, a long one a part at a time */
+    void reply(int category, const QString &text);
     /** Set number of connections shown in the UI */
     void setNumConnections(int count);
     /** Set network state shown in the UI */
@@ -128,6 +136,8 @@ private:
     void setTrafficGraphRange(int mins);
     /** show detailed information on ui about selected node */
     void updateNodeDetail(const CNodeCombinedStats *stats);
+    /** Stop appending a long reply, noting that it was cut short */
+    void stopPendingReply();
 
     enum ColumnWidths
     {
@@ -152,6 +162,10 @@ private:
     int consoleFontSize;
     QCompleter *autoCompleter;
     QThread thread;
+    //! The last long reply, in full, and the parts of it still to be appended
+    QString lastReply;
+    QStringList pendingReplyChunks;
+    QTimer *replyTimer;
 
     /** Update UI with latest network info from model. */
     void updateNetworkState();
@@ -20,6 +20,8 @@ TransactionFilterProxy::TransactionFilterProxy(QObject *parent) :
     QSortFilterProxyModel(parent),
     dateFrom(MIN_DATE),
     dateTo(MAX_DATE),
+    nTimeFrom(MIN_DATE.toTime_t()),
+    nTimeTo(MAX_DATE.toTime_t()),
     addrPrefix(),
     typeFilter(ALL_TYPES),
     watchOnlyFilter(WatchOnlyFilter_All),
@@ -32,29 +34,31 @@ TransactionFilterProxy::TransactionFilterProxy(QObject *parent) :
 bool TransactionFilterProxy::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
     QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
-
-    int type = index.data(TransactionTableModel::TypeRole).toInt();
-    QDateTime datetime = index.data(TransactionTableModel::DateRole).toDateTime();
-    bool involvesWatchAddress = index.data(TransactionTableModel::WatchonlyRole).toBool();
-    QString address = index.data(TransactionTableModel::AddressRole).toString();
-    QString label = index.data(TransactionTableModel::LabelRole).toString();
-    qint64 amount = llabs(index.data(TransactionTableModel::AmountRole).toLongLong());
-    int status = index.data(TransactionTableModel::StatusRole).toInt();
-
-    if(!showInactive && status == TransactionStatus::Conflicted)
+    const TransactionRecord *rec = static_cast<const TransactionRecord*>(index.internalPointer());
+    if(!rec)
         return false;
-    if(!(TYPE(type) & typeFilter))
+
+    // SolarCoin: The numeric fields of the record first, the address and label strings only for
+    // the rows passing them and a non-empty search
+    if(!showInactive && rec->status.status == TransactionStatus::Conflicted)
         return false;
-    if (involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_No)
+    if(!(TYPE(rec->type) & typeFilter))
         return false;
-    if (!involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_Yes)
+    if (rec->involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_No)
         return false;
-    if(datetime < dateFrom || datetime > dateTo)
+    if (!rec->involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_Yes)
         return false;
-    if (!address.contains(addrPrefix, Qt::CaseInsensitive) && !label.contains(addrPrefix, Qt::CaseInsensitive))
+    if(rec->time < nTimeFrom || rec->time > nTimeTo)
         return false;
-    if(amount < minAmount)
+    if(llabs(rec->credit + rec->debit) < minAmount)
         return false;
+    if(!addrPrefix.isEmpty())
+    {
+        QString address = QString::fromStdString(rec->address);
+        if (!address.contains(addrPrefix, Qt::CaseInsensitive) &&
+            !index.data(TransactionTableModel::LabelRole).toString().contains(addrPrefix, Qt::CaseInsensitive))
+            return false;
+    }
 
     return true;
 }
@@ -63,6 +67,8 @@ void TransactionFilterProxy::setDateRange(const QDateTime &from, const QDateTime
 {
     this->dateFrom = from;
     this->dateTo = to;
+    this->nTimeFrom = from.toTime_t();
+    this->nTimeTo = to.toTime_t();
     invalidateFilter();
 }
 
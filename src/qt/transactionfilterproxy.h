@@ -57,6 +57,8 @@ protected:
 private:
     QDateTime dateFrom;
     QDateTime dateTo;
+    qint64 nTimeFrom; //!< dateFrom and dateTo as compared to TransactionRecord::time
+    qint64 nTimeTo;
     QString addrPrefix;
     quint32 typeFilter;
     WatchOnlyFilter watchOnlyFilter;
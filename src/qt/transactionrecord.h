@@ -138,9 +138,9 @@ public:
      */
     void updateStatus(const CWalletTx &wtx);
 
-    /** Return whether a status update is needed.
+    /** Return whether a status update is needed, the chain being numBlocks high.
      */
-    bool statusUpdateNeeded();
+    bool statusUpdateNeeded(int numBlocks) const;
 };
 
 #endif // BITCOIN_QT_TRANSACTIONRECORD_H
@@ -19,6 +19,11 @@
 #include <uint256.h>
 #include <util.h>
 #include <wallet/wallet.h>
+#include <wallet/walletdb.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
 #include <QColor>
 #include <QDateTime>
@@ -26,6 +31,11 @@
 #include <QIcon>
 #include <QList>
 
+/** Wallet transactions decomposed into records with the locks held at once, when loading */
+static const size_t TRANSACTION_LOAD_CHUNK = 1000;
+/** Address labels cached for the rows displayed and filtered */
+static const int LABEL_CACHE_SIZE = 10000;
+
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
         Qt::AlignLeft|Qt::AlignVCenter, /* status */
@@ -59,33 +69,66 @@ class TransactionTablePriv
 public:
     TransactionTablePriv(CWallet *_wallet, TransactionTableModel *_parent) :
         wallet(_wallet),
-        parent(_parent)
+        parent(_parent),
+        cachedNumBlocks(-1)
     {
     }
 
     CWallet *wallet;
     TransactionTableModel *parent;
 
+    /* Height of the chain when the wallet model last told us it changed */
+    int cachedNumBlocks;
+
     /* Local cache of wallet.
      * As it is in the same order as the CWallet, by definition
      * this is sorted by sha256.
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* SolarCoin: Add a chunk of records from the TransactionTableLoader, sorted by hash, in as few
+       row insertions as possible. The transactions updateWallet() added while they were loading
+       are already in the model and skipped.
      */
-    void refreshWallet()
+    void insertLoaded(const QList<TransactionRecord> &records)
     {
-        qDebug() << "TransactionTablePriv::refreshWallet";
-        cachedWallet.clear();
+        QList<TransactionRecord> batch;
+        int insertAt = 0;
+        int i = 0;
+        while(i < records.size())
         {
-            LOCK2(cs_main, wallet->cs_wallet);
-            for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+            // The records of a transaction follow each other
+            const uint256 &hash = records[i].hash;
+            int end = i + 1;
+            while(end < records.size() && records[end].hash == hash)
+                end++;
+
+            QList<TransactionRecord>::iterator lower = qLowerBound(
+                cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
+            int lowerIndex = (lower - cachedWallet.begin());
+            bool inModel = (lower != cachedWallet.end() && lower->hash == hash);
+            if(!inModel)
             {
-                if(TransactionRecord::showTransaction(it->second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                if(!batch.isEmpty() && lowerIndex != insertAt)
+                    insertBatch(batch, insertAt);
+                if(batch.isEmpty())
+                    insertAt = lowerIndex;
+                for(int j = i; j < end; j++)
+                    batch.append(records[j]);
             }
+            i = end;
         }
+        if(!batch.isEmpty())
+            insertBatch(batch, insertAt);
+    }
+
+    void insertBatch(QList<TransactionRecord> &batch, int insertAt)
+    {
+        parent->beginInsertRows(QModelIndex(), insertAt, insertAt+batch.size()-1);
+        for(int j = 0; j < batch.size(); j++)
+            cachedWallet.insert(insertAt+j, batch[j]);
+        parent->endInsertRows();
+        batch.clear();
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -185,24 +228,26 @@ public:
         {
             TransactionRecord *rec = &cachedWallet[idx];
 
+            // If a status update is needed (blocks came in since last check),
+            //  update the status of this transaction from the wallet. Otherwise,
+            // simply re-use the cached status, without taking any lock.
+            //
             // Get required locks upfront. This avoids the GUI from getting
             // stuck if the core is holding the locks for a longer time - for
             // example, during a wallet rescan.
-            //
-            // If a status update is needed (blocks came in since last check),
-            //  update the status of this transaction from the wallet. Otherwise,
-            // simply re-use the cached status.
+            if(!rec->statusUpdateNeeded(cachedNumBlocks))
+                return rec;
             TRY_LOCK(cs_main, lockMain);
             if(lockMain)
             {
                 TRY_LOCK(wallet->cs_wallet, lockWallet);
-                if(lockWallet && rec->statusUpdateNeeded())
+                if(lockWallet)
                 {
-                    std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
+                    std::shared_ptr<const CWalletTx> wtx = wallet->GetWalletTx(rec->hash);
 
-                    if(mi != wallet->mapWallet.end())
+                    if(wtx)
                     {
-                        rec->updateStatus(mi->second);
+                        rec->updateStatus(*wtx);
                     }
                 }
             }
@@ -215,10 +260,11 @@ public:
     {
         {
             LOCK2(cs_main, wallet->cs_wallet);
-            std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
-            if(mi != wallet->mapWallet.end())
+            std::shared_ptr<const CWalletTx> pwtx = wallet->GetWalletTx(rec->hash);
+            if(pwtx)
             {
-                return TransactionDesc::toHTML(wallet, mi->second, rec, unit);
+                CWalletTx wtx = *pwtx;
+                return TransactionDesc::toHTML(wallet, wtx, rec, unit);
             }
         }
         return QString();
@@ -227,38 +273,140 @@ public:
     QString getTxHex(TransactionRecord *rec)
     {
         LOCK2(cs_main, wallet->cs_wallet);
-        std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
-        if(mi != wallet->mapWallet.end())
+        std::shared_ptr<const CWalletTx> wtx = wallet->GetWalletTx(rec->hash);
+        if(wtx)
         {
-            std::string strHex = EncodeHexTx(static_cast<CTransaction>(mi->second));
+            std::string strHex = EncodeHexTx(static_cast<CTransaction>(*wtx));
             return QString::fromStdString(strHex);
         }
         return QString();
     }
 };
 
+/* SolarCoin: Decomposes the wallet transactions into records on a worker thread, a chunk at a
+   time, taking cs_main and cs_wallet for one chunk only, so loading a large wallet neither
+   freezes the window nor holds up the node.
+*/
+class TransactionTableLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransactionTableLoader(CWallet *_wallet) : wallet(_wallet), fInterrupted(false) {}
+
+    /* Stop loading, before the model goes away */
+    void interrupt() { fInterrupted = true; }
+
+public Q_SLOTS:
+    void load();
+
+Q_SIGNALS:
+    void loaded(const QList<TransactionRecord> &records);
+
+private:
+    CWallet *wallet;
+    std::atomic<bool> fInterrupted;
+};
+
+#include <qt/transactiontablemodel.moc>
+
+void TransactionTableLoader::load()
+{
+    // The model is sorted by hash, and so are the chunks
+    std::vector<uint256> hashes;
+    {
+        LOCK(wallet->cs_wallet);
+        hashes.reserve(wallet->mapWallet.size() + wallet->mapUnloadedTx.size());
+        for(const auto &entry : wallet->mapWallet)
+            hashes.push_back(entry.first);
+        for(const auto &entry : wallet->mapUnloadedTx)
+            hashes.push_back(entry.first);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    qDebug() << "TransactionTableLoader::load: " + QString::number(hashes.size()) + " transactions";
+
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletTx wtxUnloaded;
+    for(size_t start = 0; start < hashes.size() && !fInterrupted; start += TRANSACTION_LOAD_CHUNK)
+    {
+        QList<TransactionRecord> records;
+        {
+            LOCK2(cs_main, wallet->cs_wallet);
+            size_t end = std::min(hashes.size(), start + TRANSACTION_LOAD_CHUNK);
+            for(size_t i = start; i < end; i++)
+            {
+                // As CWalletTxWalker, reading the unloaded transactions without caching them
+                const CWalletTx *wtx = NULL;
+                std::map<uint256, CWalletTx>::const_iterator mi = wallet->mapWallet.find(hashes[i]);
+                if(mi != wallet->mapWallet.end())
+                {
+                    wtx = &mi->second;
+                }
+                else if(wallet->mapUnloadedTx.count(hashes[i]))
+                {
+                    if(!pwalletdb)
+                        pwalletdb.reset(new CWalletDB(wallet->strWalletFile, "r"));
+                    if(pwalletdb->ReadTx(hashes[i], wtxUnloaded))
+                    {
+                        wtxUnloaded.BindWallet(wallet);
+                        wtx = &wtxUnloaded;
+                    }
+                }
+                if(wtx && TransactionRecord::showTransaction(*wtx))
+                    records.append(TransactionRecord::decomposeTransaction(wallet, *wtx));
+            }
+        }
+        Q_EMIT loaded(records);
+    }
+}
+
 TransactionTableModel::TransactionTableModel(const PlatformStyle *_platformStyle, CWallet* _wallet, WalletModel *parent):
         QAbstractTableModel(parent),
         wallet(_wallet),
         walletModel(parent),
         priv(new TransactionTablePriv(_wallet, this)),
         fProcessingQueuedTransactions(false),
-        platformStyle(_platformStyle)
+        platformStyle(_platformStyle),
+        loader(new TransactionTableLoader(_wallet))
 {
     columns << QString() << QString() << tr("Date") << tr("Type") << tr("Label") << BitcoinUnits::getAmountColumnTitle(walletModel->getOptionsModel()->getDisplayUnit());
-    priv->refreshWallet();
 
     connect(walletModel->getOptionsModel(), SIGNAL(displayUnitChanged(int)), this, SLOT(updateDisplayUnit()));
 
+    cachedLabels.setMaxCost(LABEL_CACHE_SIZE);
+    AddressTableModel *addressTableModel = walletModel->getAddressTableModel();
+    connect(addressTableModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(clearLabelCache()));
+    connect(addressTableModel, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(clearLabelCache()));
+    connect(addressTableModel, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(clearLabelCache()));
+    connect(addressTableModel, SIGNAL(modelReset()), this, SLOT(clearLabelCache()));
+
+    // Subscribe before loading, so no transaction is missed; one notified while loading is
+    // added once
     subscribeToCoreSignals();
+
+    qRegisterMetaType<QList<TransactionRecord> >("QList<TransactionRecord>");
+    loader->moveToThread(&loaderThread);
+    connect(&loaderThread, SIGNAL(started()), loader, SLOT(load()));
+    connect(loader, SIGNAL(loaded(QList<TransactionRecord>)), this, SLOT(addLoadedRecords(QList<TransactionRecord>)));
+    // The loader is deleted in its thread once the thread is done
+    connect(&loaderThread, SIGNAL(finished()), loader, SLOT(deleteLater()), Qt::DirectConnection);
+    loaderThread.start();
 }
 
 TransactionTableModel::~TransactionTableModel()
 {
+    loader->interrupt();
+    loaderThread.quit();
+    loaderThread.wait();
     unsubscribeFromCoreSignals();
     delete priv;
 }
 
+void TransactionTableModel::addLoadedRecords(const QList<TransactionRecord> &records)
+{
+    priv->insertLoaded(records);
+}
+
 /** Updates the column title to "Amount (DisplayUnit)" and emits headerDataChanged() signal for table headers to react. */
 void TransactionTableModel::updateAmountColumnTitle()
 {
@@ -274,9 +422,10 @@ void TransactionTableModel::updateTransaction(const QString &hash, int status, b
     priv->updateWallet(updated, status, showTransaction);
 }
 
-void TransactionTableModel::updateConfirmations()
+void TransactionTableModel::updateConfirmations(int numBlocks)
 {
-    // Blocks came in since last poll.
+    priv->cachedNumBlocks = numBlocks;
+    // Blocks came in since last update.
     // Invalidate status (number of confirmations) and (possibly) description
     //  for all rows. Qt is smart enough to only actually request the data for the
     //  visible rows.
@@ -352,9 +501,26 @@ QString TransactionTableModel::formatTxDate(const TransactionRecord *wtx) const
 /* Look up address in address book, if found return label (address)
    otherwise just return (address)
  */
+QString TransactionTableModel::labelForAddress(const std::string &address) const
+{
+    // SolarCoin: The labels of the rows painted and filtered are cached, saving the address
+    // decoding and the cs_wallet lock of each lookup
+    QString strAddress = QString::fromStdString(address);
+    if(QString *label = cachedLabels.object(strAddress))
+        return *label;
+    QString label = walletModel->getAddressTableModel()->labelForAddress(strAddress);
+    cachedLabels.insert(strAddress, new QString(label));
+    return label;
+}
+
+void TransactionTableModel::clearLabelCache()
+{
+    cachedLabels.clear();
+}
+
 QString TransactionTableModel::lookupAddress(const std::string &address, bool tooltip) const
 {
-    QString label = walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(address));
+    QString label = labelForAddress(address);
     QString description;
     if(!label.isEmpty())
     {
@@ -437,7 +603,7 @@ QVariant TransactionTableModel::addressColor(const TransactionRecord *wtx) const
     case TransactionRecord::SendToAddress:
     case TransactionRecord::Generated:
         {
-        QString label = walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(wtx->address));
+        QString label = labelForAddress(wtx->address);
         if(label.isEmpty())
             return COLOR_BAREADDRESS;
         } break;
@@ -612,7 +778,7 @@ QVariant TransactionTableModel::data(const QModelIndex &index, int role) const
     case AddressRole:
         return QString::fromStdString(rec->address);
     case LabelRole:
-        return walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(rec->address));
+        return labelForAddress(rec->address);
     case AmountRole:
         return qint64(rec->credit + rec->debit);
     case TxIDRole:
@@ -625,7 +791,7 @@ QVariant TransactionTableModel::data(const QModelIndex &index, int role) const
         {
             QString details;
             QDateTime date = QDateTime::fromTime_t(static_cast<uint>(rec->time));
-            QString txLabel = walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(rec->address));
+            QString txLabel = labelForAddress(rec->address);
 
             details.append(date.toString("M/d/yy HH:mm"));
             details.append(" ");
@@ -8,10 +8,14 @@
 #include <qt/bitcoinunits.h>
 
 #include <QAbstractTableModel>
+#include <QCache>
+#include <QList>
 #include <QStringList>
+#include <QThread>
 
 class PlatformStyle;
 class TransactionRecord;
+class TransactionTableLoader;
 class TransactionTablePriv;
 class WalletModel;
 
@@ -88,10 +92,16 @@ private:
     TransactionTablePriv *priv;
     bool fProcessingQueuedTransactions;
     const PlatformStyle *platformStyle;
+    /** SolarCoin: Loads the wallet transactions on loaderThread, so the window is usable meanwhile */
+    TransactionTableLoader *loader;
+    QThread loaderThread;
+    /** Labels by address, the least recently used dropped first */
+    mutable QCache<QString, QString> cachedLabels;
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
 
+    QString labelForAddress(const std::string &address) const;
     QString lookupAddress(const std::string &address, bool tooltip) const;
     QVariant addressColor(const TransactionRecord *wtx) const;
     QString formatTxStatus(const TransactionRecord *wtx) const;
@@ -107,12 +117,17 @@ private:
 public Q_SLOTS:
     /* New transaction, or transaction changed status */
     void updateTransaction(const QString &hash, int status, bool showTransaction);
-    void updateConfirmations();
+    /* The chain is numBlocks high, or the wallet changed */
+    void updateConfirmations(int numBlocks);
     void updateDisplayUnit();
     /** Updates the column title to "Amount (DisplayUnit)" and emits headerDataChanged() signal for table headers to react. */
     void updateAmountColumnTitle();
     /* Needed to update fProcessingQueuedTransactions through a QueuedConnection */
     void setProcessingQueuedTransactions(bool value) { fProcessingQueuedTransactions = value; }
+    /* Add a chunk of the records loaded by the loader thread */
+    void addLoadedRecords(const QList<TransactionRecord> &records);
+    /* The address book changed */
+    void clearLabelCache();
 
     friend class TransactionTablePriv;
 };
@@ -8,6 +8,7 @@
 #include "bitcoinunits.h"
 #include "csvmodelwriter.h"
 #include "editaddressdialog.h"
+#include "guiconstants.h"
 #include "guiutil.h"
 #include "optionsmodel.h"
 #include "platformstyle.h"
@@ -32,6 +33,7 @@
 #include <QScrollBar>
 #include <QSignalMapper>
 #include <QTableView>
+#include <QTimer>
 #include <QUrl>
 #include <QVBoxLayout>
 
@@ -167,8 +169,17 @@ TransactionView::TransactionView(const PlatformStyle *platformStyle, QWidget *pa
     connect(dateWidget, SIGNAL(activated(int)), this, SLOT(chooseDate(int)));
     connect(typeWidget, SIGNAL(activated(int)), this, SLOT(chooseType(int)));
     connect(watchOnlyWidget, SIGNAL(activated(int)), this, SLOT(chooseWatchonly(int)));
-    connect(addressWidget, SIGNAL(textChanged(QString)), this, SLOT(changedPrefix(QString)));
-    connect(amountWidget, SIGNAL(textChanged(QString)), this, SLOT(changedAmount(QString)));
+    // SolarCoin: Filter once typing pauses, not on every keystroke
+    QTimer *prefixTypingDelay = new QTimer(this);
+    prefixTypingDelay->setSingleShot(true);
+    prefixTypingDelay->setInterval(INPUT_FILTER_DELAY);
+    QTimer *amountTypingDelay = new QTimer(this);
+    amountTypingDelay->setSingleShot(true);
+    amountTypingDelay->setInterval(INPUT_FILTER_DELAY);
+    connect(addressWidget, SIGNAL(textChanged(QString)), prefixTypingDelay, SLOT(start()));
+    connect(prefixTypingDelay, SIGNAL(timeout()), this, SLOT(changedPrefix()));
+    connect(amountWidget, SIGNAL(textChanged(QString)), amountTypingDelay, SLOT(start()));
+    connect(amountTypingDelay, SIGNAL(timeout()), this, SLOT(changedAmount()));
 
     connect(view, SIGNAL(doubleClicked(QModelIndex)), this, SIGNAL(doubleClicked(QModelIndex)));
     connect(view, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(contextualMenu(QPoint)));
@@ -305,19 +316,19 @@ void TransactionView::chooseWatchonly(int idx)
         (TransactionFilterProxy::WatchOnlyFilter)watchOnlyWidget->itemData(idx).toInt());
 }
 
-void TransactionView::changedPrefix(const QString &prefix)
+void TransactionView::changedPrefix()
 {
     if(!transactionProxyModel)
         return;
-    transactionProxyModel->setAddressPrefix(prefix);
+    transactionProxyModel->setAddressPrefix(addressWidget->text());
 }
 
-void TransactionView::changedAmount(const QString &amount)
+void TransactionView::changedAmount()
 {
     if(!transactionProxyModel)
         return;
     CAmount amount_parsed = 0;
-    if(BitcoinUnits::parse(model->getOptionsModel()->getDisplayUnit(), amount, &amount_parsed))
+    if(BitcoinUnits::parse(model->getOptionsModel()->getDisplayUnit(), amountWidget->text(), &amount_parsed))
     {
         transactionProxyModel->setMinAmount(amount_parsed);
     }
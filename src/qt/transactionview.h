@@ -110,8 +110,8 @@ public Q_SLOTS:
     void chooseDate(int idx);
     void chooseType(int idx);
     void chooseWatchonly(int idx);
-    void changedPrefix(const QString &prefix);
-    void changedAmount(const QString &amount);
+    void changedPrefix();
+    void changedAmount();
     void exportClicked();
     void focusTransaction(const QModelIndex&);
 
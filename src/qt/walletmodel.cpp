@@ -35,22 +35,24 @@ WalletModel::WalletModel(const PlatformStyle *platformStyle, CWallet *_wallet, O
     transactionTableModel(0),
     recentRequestsTableModel(0),
     cachedBalance(0), cachedUnconfirmedBalance(0), cachedImmatureBalance(0),
-    cachedEncryptionStatus(Unencrypted),
-    cachedNumBlocks(0)
+    cachedEncryptionStatus(Unencrypted)
 {
     fHaveWatchOnly = wallet->HaveWatchOnly();
-    fForceCheckBalanceChanged = false;
+    fUpdateQueued = false;
+    fInitialSync = false;
 
     addressTableModel = new AddressTableModel(wallet, this);
     transactionTableModel = new TransactionTableModel(platformStyle, wallet, this);
     recentRequestsTableModel = new RecentRequestsTableModel(wallet, this);
 
-    // This timer will be fired repeatedly to update the balance
-    pollTimer = new QTimer(this);
-    connect(pollTimer, SIGNAL(timeout()), this, SLOT(pollBalanceChanged()));
-    pollTimer->start(MODEL_UPDATE_DELAY);
+    // SolarCoin: The balance is updated once for the changes notified within MODEL_UPDATE_DELAY,
+    // instead of being polled
+    updateTimer = new QTimer(this);
+    updateTimer->setSingleShot(true);
+    connect(updateTimer, SIGNAL(timeout()), this, SLOT(updateBalance()));
 
     subscribeToCoreSignals();
+    scheduleUpdate();
 }
 
 WalletModel::~WalletModel()
@@ -113,44 +115,69 @@ void WalletModel::updateStatus()
         Q_EMIT encryptionStatusChanged(newEncryptionStatus);
 }
 
-void WalletModel::pollBalanceChanged()
+void WalletModel::scheduleUpdate()
 {
-    // Get required locks upfront. This avoids the GUI from getting stuck on
-    // periodical polls if the core is holding the locks for a longer time -
-    // for example, during a wallet rescan.
+    if(!fUpdateQueued.exchange(true))
+        QMetaObject::invokeMethod(this, "startUpdateTimer", Qt::QueuedConnection);
+}
+
+void WalletModel::notifyBlockTip(bool initialSync)
+{
+    // SolarCoin: during initial sync the statuses of the rows are left as they are, and the
+    // balances follow the wallet transactions only; all is brought up to date once near the tip
+    bool fWasInitialSync = fInitialSync.exchange(initialSync);
+    if(!initialSync || !fWasInitialSync)
+        scheduleUpdate();
+}
+
+void WalletModel::startUpdateTimer()
+{
+    if(!updateTimer->isActive())
+        updateTimer->start(MODEL_UPDATE_DELAY);
+}
+
+void WalletModel::updateBalance()
+{
+    // Changes notified from now on queue another update
+    fUpdateQueued = false;
+
+    // Get required locks upfront. This avoids the GUI from getting stuck
+    // if the core is holding the locks for a longer time - for example,
+    // during a wallet rescan. The update is then tried again later.
     TRY_LOCK(cs_main, lockMain);
     if(!lockMain)
+    {
+        scheduleUpdate();
         return;
+    }
     TRY_LOCK(wallet->cs_wallet, lockWallet);
     if(!lockWallet)
-        return;
-
-    if(fForceCheckBalanceChanged || chainActive.Height() != cachedNumBlocks)
     {
-        fForceCheckBalanceChanged = false;
-
-        // Balance and number of transactions might have changed
-        cachedNumBlocks = chainActive.Height();
-
-        checkBalanceChanged();
-        if(transactionTableModel)
-            transactionTableModel->updateConfirmations();
+        scheduleUpdate();
+        return;
     }
+
+    // Balance and number of transactions might have changed
+    checkBalanceChanged();
+    if(transactionTableModel && !fInitialSync)
+        transactionTableModel->updateConfirmations(chainActive.Height());
 }
 
 void WalletModel::checkBalanceChanged()
 {
-    CAmount newBalance = getBalance();
-    CAmount newUnconfirmedBalance = getUnconfirmedBalance();
-    CAmount newImmatureBalance = getImmatureBalance();
+    // SolarCoin: all balances from one pass over the wallet, which is skipped while nothing changed
+    CWallet::Balances balances = wallet->GetBalances();
+    CAmount newBalance = balances.nTrusted;
+    CAmount newUnconfirmedBalance = balances.nUntrustedPending;
+    CAmount newImmatureBalance = balances.nImmature;
     CAmount newWatchOnlyBalance = 0;
     CAmount newWatchUnconfBalance = 0;
     CAmount newWatchImmatureBalance = 0;
     if (haveWatchOnly())
     {
-        newWatchOnlyBalance = getWatchBalance();
-        newWatchUnconfBalance = getWatchUnconfirmedBalance();
-        newWatchImmatureBalance = getWatchImmatureBalance();
+        newWatchOnlyBalance = balances.nWatchTrusted;
+        newWatchUnconfBalance = balances.nWatchUntrustedPending;
+        newWatchImmatureBalance = balances.nWatchImmature;
     }
 
     if(cachedBalance != newBalance || cachedUnconfirmedBalance != newUnconfirmedBalance || cachedImmatureBalance != newImmatureBalance ||
@@ -170,7 +197,7 @@ void WalletModel::checkBalanceChanged()
 void WalletModel::updateTransaction()
 {
     // Balance and number of transactions might have changed
-    fForceCheckBalanceChanged = true;
+    scheduleUpdate();
 }
 
 void WalletModel::updateAddressBook(const QString &address, const QString &label,
@@ -368,7 +395,7 @@ WalletModel::SendCoinsReturn WalletModel::sendCoins(WalletModelTransaction &tran
         }
         Q_EMIT coinsSent(wallet, rcp, transaction_array);
     }
-    checkBalanceChanged(); // update balance immediately, otherwise there could be a short noticeable delay until pollBalanceChanged hits
+    checkBalanceChanged(); // update balance immediately, otherwise there could be a short noticeable delay until updateBalance hits
 
     return SendCoinsReturn(OK);
 }
@@ -482,7 +509,13 @@ static void NotifyTransactionChanged(WalletModel *walletmodel, CWallet *wallet,
     Q_UNUSED(wallet);
     Q_UNUSED(hash);
     Q_UNUSED(status);
-    QMetaObject::invokeMethod(walletmodel, "updateTransaction", Qt::QueuedConnection);
+    walletmodel->scheduleUpdate();
+}
+
+static void NotifyBlockTip(WalletModel *walletmodel, bool initialSync, const CBlockIndex *pIndex)
+{
+    Q_UNUSED(pIndex);
+    walletmodel->notifyBlockTip(initialSync);
 }
 
 static void ShowProgress(WalletModel *walletmodel, const std::string &title, int nProgress)
@@ -507,6 +540,7 @@ void WalletModel::subscribeToCoreSignals()
     wallet->NotifyTransactionChanged.connect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
     wallet->ShowProgress.connect(boost::bind(ShowProgress, this, _1, _2));
     wallet->NotifyWatchonlyChanged.connect(boost::bind(NotifyWatchonlyChanged, this, _1));
+    uiInterface.NotifyBlockTip.connect(boost::bind(NotifyBlockTip, this, _1, _2));
 }
 
 void WalletModel::unsubscribeFromCoreSignals()
@@ -517,6 +551,7 @@ void WalletModel::unsubscribeFromCoreSignals()
     wallet->NotifyTransactionChanged.disconnect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
     wallet->ShowProgress.disconnect(boost::bind(ShowProgress, this, _1, _2));
     wallet->NotifyWatchonlyChanged.disconnect(boost::bind(NotifyWatchonlyChanged, this, _1));
+    uiInterface.NotifyBlockTip.disconnect(boost::bind(NotifyBlockTip, this, _1, _2));
 }
 
 // WalletModel::UnlockContext implementation
@@ -591,6 +626,15 @@ bool WalletModel::isSpent(const COutPoint& outpoint) const
     return wallet->IsSpent(outpoint.hash, outpoint.n);
 }
 
+int WalletModel::listSpent(const std::vector<COutPoint>& vOutpoints, std::vector<COutPoint>& vSpent) const
+{
+    LOCK2(cs_main, wallet->cs_wallet);
+    BOOST_FOREACH(const COutPoint& outpoint, vOutpoints)
+        if (wallet->IsSpent(outpoint.hash, outpoint.n))
+            vSpent.push_back(outpoint);
+    return chainActive.Height();
+}
+
 // AvailableCoins + LockedCoins grouped by wallet address (put change in one group with wallet address)
 void WalletModel::listCoins(std::map<QString, std::vector<COutput> >& mapCoins) const
 {
@@ -680,7 +724,7 @@ bool WalletModel::saveReceiveRequest(const std::string &sAddress, const int64_t
 bool WalletModel::transactionCanBeAbandoned(uint256 hash) const
 {
     LOCK2(cs_main, wallet->cs_wallet);
-    const CWalletTx *wtx = wallet->GetWalletTx(hash);
+    std::shared_ptr<const CWalletTx> wtx = wallet->GetWalletTx(hash);
     if (!wtx || wtx->isAbandoned() || wtx->GetDepthInMainChain() > 0 || wtx->InMempool())
         return false;
     return true;
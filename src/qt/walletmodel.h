@@ -10,6 +10,7 @@
 
 #include "support/allocators/secure.h"
 
+#include <atomic>
 #include <map>
 #include <vector>
 
@@ -194,6 +195,8 @@ public:
     bool getPrivKey(const CKeyID &address, CKey& vchPrivKeyOut) const;
     void getOutputs(const std::vector<COutPoint>& vOutpoints, std::vector<COutput>& vOutputs);
     bool isSpent(const COutPoint& outpoint) const;
+    /* Of the outpoints, those spent, checked with the locks taken once; returns the chain height */
+    int listSpent(const std::vector<COutPoint>& vOutpoints, std::vector<COutPoint>& vSpent) const;
     void listCoins(std::map<QString, std::vector<COutput> >& mapCoins) const;
 
     bool isLockedCoin(uint256 hash, unsigned int n) const;
@@ -213,10 +216,19 @@ public:
 
     int getDefaultConfirmTarget() const;
 
+    /* Update the balances and the transaction statuses soon, coalescing the changes notified
+       meanwhile; safe to call from any thread */
+    void scheduleUpdate();
+    /* Take a new block tip; while the node is in initial sync, the tips only are recorded */
+    void notifyBlockTip(bool initialSync);
+
 private:
     CWallet *wallet;
     bool fHaveWatchOnly;
-    bool fForceCheckBalanceChanged;
+    //! An update is queued and requests can wait for it
+    std::atomic<bool> fUpdateQueued;
+    //! The last block tip was connected during initial sync
+    std::atomic<bool> fInitialSync;
 
     // Wallet has an options model for wallet-specific options
     // (transaction fee, for example)
@@ -234,9 +246,8 @@ private:
     CAmount cachedWatchUnconfBalance;
     CAmount cachedWatchImmatureBalance;
     EncryptionStatus cachedEncryptionStatus;
-    int cachedNumBlocks;
 
-    QTimer *pollTimer;
+    QTimer *updateTimer;
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
@@ -276,8 +287,12 @@ public Q_SLOTS:
     void updateAddressBook(const QString &address, const QString &label, bool isMine, const QString &purpose, int status);
     /* Watch-only added */
     void updateWatchOnlyFlag(bool fHaveWatchonly);
+
+private Q_SLOTS:
+    /* Start the update timer, unless it already runs */
+    void startUpdateTimer();
     /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so */
-    void pollBalanceChanged();
+    void updateBalance();
 };
 
 #endif // BITCOIN_QT_WALLETMODEL_H
@@ -5,14 +5,17 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "clientversion.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "validation.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "undo.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
@@ -21,6 +24,10 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+//! SolarCoin: Most blocks /rest/blockrange returns at once
+static const long MAX_REST_BLOCKRANGE_COUNT = 1000;
+//! SolarCoin: Most transactions /rest/txs returns at once
+static const size_t MAX_REST_TXS = 1000;
 
 enum RetFormat {
     RF_UNDEF,
@@ -40,25 +47,28 @@ static const struct {
 };
 
 struct CCoin {
-    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside IMPLEMENT_SERIALIZE
     uint32_t nHeight;
     CTxOut out;
 
     ADD_SERIALIZE_METHODS;
 
+    CCoin() : nHeight(0) {}
+    CCoin(Coin&& in) : nHeight(in.nHeight), out(std::move(in.out)) {}
+
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
-        READWRITE(nTxVer);
+        uint32_t nTxVerDummy = 0;
+        READWRITE(nTxVerDummy);
         READWRITE(nHeight);
         READWRITE(out);
     }
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false, CJSONStream* stream = NULL);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern UniValue mempoolToJSON(bool fVerbose = false, CJSONStream* stream = NULL);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -69,6 +79,39 @@ static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string me
     return false;
 }
 
+/**
+ * SolarCoin: Reply with the JSON written by fWrite to a stream: as a chunked reply if it grew past
+ * a chunk, so large replies are sent as they are written, else as a plain reply.
+ */
+static bool WriteJSONStreamReply(HTTPRequest* req, const std::function<void(CJSONStream&)>& fWrite)
+{
+    CJSONStream stream([req](const std::string& strChunk) {
+        if (!req->IsChunkedReply()) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartChunkedReply(HTTP_OK);
+        }
+        req->WriteChunk(strChunk);
+    });
+    try {
+        fWrite(stream);
+    } catch (const std::exception& e) {
+        if (!stream.IsFlushed())
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, e.what());
+        LogPrintf("REST: %s failed after part of its reply was sent: %s\n", req->GetURI(), e.what());
+        req->EndChunkedReply();
+        return false;
+    }
+    if (stream.IsFlushed()) {
+        stream.Flush();
+        req->WriteChunk("\n");
+        req->EndChunkedReply();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, stream.TakeBuffer() + "\n");
+    }
+    return true;
+}
+
 static enum RetFormat ParseDataFormat(std::string& param, const std::string& strReq)
 {
     const std::string::size_type pos = strReq.rfind('.');
@@ -212,6 +255,7 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = NULL;
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -221,13 +265,19 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        // SolarCoin: binary and hex replies are the stored bytes when they match the serialization
+        if (rf != RF_JSON && IsRawBlockSerialization(pblockindex, RPCSerializationFlags(), Params().GetConsensus())) {
+            std::vector<unsigned char> vchBlock;
+            if (!ReadRawBlockFromDisk(vchBlock, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            ssBlock.write((const char*)vchBlock.data(), vchBlock.size());
+        } else {
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            ssBlock << block;
+        }
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
         std::string binaryBlock = ssBlock.str();
@@ -244,11 +294,9 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
+        return WriteJSONStreamReply(req, [&](CJSONStream& stream) {
+            blockToJSON(block, pblockindex, showTxDetails, &stream);
+        });
     }
 
     default: {
@@ -270,6 +318,157 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/**
+ * SolarCoin: /rest/blockrange/<start>/<count>.<bin|hex>: the blocks of the active chain from height
+ * start on, as a chunked reply written a block at a time. Blocks are sent as stored in the block
+ * files where that is their serialization; bin concatenates them, hex puts one block per line.
+ */
+static bool rest_blockrange(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: bin, hex)");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    int32_t nStart;
+    int32_t nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nStart) || !ParseInt32(path[1], &nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/blockrange/<start>/<count>.<ext>.");
+    if (nCount < 1 || nCount > MAX_REST_BLOCKRANGE_COUNT)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Block count out of range (max: %d): %s", MAX_REST_BLOCKRANGE_COUNT, path[1]));
+
+    // Index entries live as long as the node, so only finding them needs cs_main
+    std::vector<std::pair<const CBlockIndex*, bool> > vBlocks;
+    {
+        LOCK(cs_main);
+        if (nStart < 0 || nStart > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+        for (int nHeight = nStart; nHeight <= chainActive.Height() && (int)vBlocks.size() < nCount; nHeight++) {
+            const CBlockIndex* pindex = chainActive[nHeight];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return RESTERR(req, HTTP_NOT_FOUND, strprintf("Block %d not available (pruned data)", nHeight));
+            vBlocks.push_back(std::make_pair(pindex, IsRawBlockSerialization(pindex, RPCSerializationFlags(), Params().GetConsensus())));
+        }
+    }
+
+    for (const std::pair<const CBlockIndex*, bool>& item : vBlocks) {
+        std::vector<unsigned char> vchBlock;
+        bool fRead;
+        if (item.second) {
+            fRead = ReadRawBlockFromDisk(vchBlock, item.first, Params().MessageStart());
+        } else {
+            CBlock block;
+            fRead = ReadBlockFromDisk(block, item.first, Params().GetConsensus());
+            if (fRead) {
+                CVectorWriter ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vchBlock, 0);
+                ssBlock << block;
+            }
+        }
+        if (!fRead) {
+            if (!req->IsChunkedReply())
+                return RESTERR(req, HTTP_NOT_FOUND, item.first->GetBlockHash().GetHex() + " not found");
+            // The status was sent already; a short reply tells the client
+            LogPrintf("REST: blockrange stopped, block %s could not be read\n", item.first->GetBlockHash().GetHex());
+            req->EndChunkedReply();
+            return false;
+        }
+        if (!req->IsChunkedReply()) {
+            req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+            req->StartChunkedReply(HTTP_OK);
+        }
+        if (rf == RF_BINARY)
+            req->WriteChunk(std::string(vchBlock.begin(), vchBlock.end()));
+        else
+            req->WriteChunk(HexStr(vchBlock.begin(), vchBlock.end()) + "\n");
+    }
+    req->EndChunkedReply();
+    return true;
+}
+
+/**
+ * SolarCoin: /rest/blockundo/<hash>.<bin|hex|json>: the outputs a block spent, as the CBlockUndo
+ * stored in the undo files, for all transactions but the coinbase.
+ */
+static bool rest_blockundo(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    const CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        pindex = it->second;
+        if (!(pindex->nStatus & BLOCK_HAVE_UNDO) || !pindex->pprev)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " has no undo data");
+    }
+
+    std::vector<unsigned char> vchUndo;
+    if (!ReadRawUndoFromDisk(vchUndo, pindex, Params().MessageStart()))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " undo data not available");
+
+    switch (rf) {
+    case RF_BINARY: {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, std::string(vchUndo.begin(), vchUndo.end()));
+        return true;
+    }
+
+    case RF_HEX: {
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, HexStr(vchUndo.begin(), vchUndo.end()) + "\n");
+        return true;
+    }
+
+    case RF_JSON: {
+        CBlockUndo blockundo;
+        try {
+            CDataStream ssUndo(vchUndo, SER_DISK, CLIENT_VERSION);
+            ssUndo >> blockundo;
+        } catch (const std::exception& e) {
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, hashStr + " undo data unreadable");
+        }
+        return WriteJSONStreamReply(req, [&](CJSONStream& stream) {
+            CJSONResult txs(&stream, UniValue::VARR);
+            for (const CTxUndo& txundo : blockundo.vtxundo) {
+                UniValue prevouts(UniValue::VARR);
+                for (const Coin& coin : txundo.vprevout) {
+                    UniValue prevout(UniValue::VOBJ);
+                    prevout.push_back(Pair("height", (int32_t)coin.nHeight));
+                    prevout.push_back(Pair("coinbase", (bool)coin.fCoinBase));
+                    prevout.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
+                    UniValue o(UniValue::VOBJ);
+                    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
+                    prevout.push_back(Pair("scriptPubKey", o));
+                    prevouts.push_back(prevout);
+                }
+                txs.push_back(prevouts);
+            }
+            txs.Finish();
+        });
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const JSONRPCRequest& request);
 
@@ -333,12 +532,9 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        std::string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
+        return WriteJSONStreamReply(req, [](CJSONStream& stream) {
+            mempoolToJSON(true, &stream);
+        });
     }
     default: {
         return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
@@ -402,6 +598,104 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * SolarCoin: /rest/txs/<txid>/<txid>/....<bin|hex|json>, or a POST of a serialized vector of txids
+ * to /rest/txs.<bin|hex>: several transactions at once, in the order asked for. bin concatenates
+ * them, hex puts one per line and json returns an array.
+ */
+static bool rest_txs(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    std::vector<uint256> vTxids;
+    std::string strRequest = req->ReadBody();
+    if (param.length() > 1) {
+        if (!strRequest.empty())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Combination of URI scheme inputs and raw post data is not allowed");
+        std::vector<std::string> uriParts;
+        boost::split(uriParts, param.substr(1), boost::is_any_of("/"));
+        for (const std::string& strTxid : uriParts) {
+            uint256 txid;
+            if (!ParseHashStr(strTxid, txid))
+                return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + strTxid);
+            vTxids.push_back(txid);
+        }
+    } else if (!strRequest.empty() && (rf == RF_BINARY || rf == RF_HEX)) {
+        if (rf == RF_HEX) {
+            std::vector<unsigned char> vchRequest = ParseHex(strRequest);
+            strRequest.assign(vchRequest.begin(), vchRequest.end());
+        }
+        try {
+            CDataStream ssRequest(strRequest.data(), strRequest.data() + strRequest.size(), SER_NETWORK, PROTOCOL_VERSION);
+            ssRequest >> vTxids;
+        } catch (const std::ios_base::failure& e) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        }
+    }
+    if (vTxids.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Error: empty request");
+    if (vTxids.size() > MAX_REST_TXS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max transactions exceeded (max: %d, tried: %d)", MAX_REST_TXS, vTxids.size()));
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<std::pair<CTransactionRef, uint256> > vTxs;
+    vTxs.reserve(vTxids.size());
+    for (const uint256& txid : vTxids) {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        unsigned int nTxOffset = 0;
+        if (!GetTransaction(txid, tx, nTxOffset, Params().GetConsensus(), hashBlock, true))
+            return RESTERR(req, HTTP_NOT_FOUND, txid.GetHex() + " not found");
+        vTxs.push_back(std::make_pair(tx, hashBlock));
+    }
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+        std::string strReply;
+        for (const std::pair<CTransactionRef, uint256>& item : vTxs) {
+            ssTxs << item.first;
+            if (rf == RF_HEX) {
+                strReply += HexStr(ssTxs.begin(), ssTxs.end()) + "\n";
+                ssTxs.clear();
+            }
+        }
+        if (rf == RF_BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, ssTxs.str());
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strReply);
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        return WriteJSONStreamReply(req, [&](CJSONStream& stream) {
+            CJSONResult txs(&stream, UniValue::VARR);
+            for (const std::pair<CTransactionRef, uint256>& item : vTxs) {
+                UniValue objTx(UniValue::VOBJ);
+                TxToJSON(*item.first, item.second, objTx);
+                txs.push_back(objTx);
+            }
+            txs.Finish();
+        });
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -515,22 +809,11 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
             view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
 
         for (size_t i = 0; i < vOutPoints.size(); i++) {
-            CCoins coins;
-            uint256 hash = vOutPoints[i].hash;
             bool hit = false;
-            if (view.GetCoins(hash, coins)) {
-                mempool.pruneSpent(hash, coins);
-                if (coins.IsAvailable(vOutPoints[i].n)) {
-                    hit = true;
-                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
-                    // n is valid but points to an already spent output (IsNull).
-                    CCoin coin;
-                    coin.nTxVer = coins.nVersion;
-                    coin.nHeight = coins.nHeight;
-                    coin.out = coins.vout.at(vOutPoints[i].n);
-                    assert(!coin.out.IsNull());
-                    outs.push_back(coin);
-                }
+            Coin coin;
+            if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i])) {
+                hit = true;
+                outs.emplace_back(std::move(coin));
             }
 
             hits.push_back(hit);
@@ -574,7 +857,6 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         UniValue utxos(UniValue::VARR);
         BOOST_FOREACH (const CCoin& coin, outs) {
             UniValue utxo(UniValue::VOBJ);
-            utxo.push_back(Pair("txvers", (int32_t)coin.nTxVer));
             utxo.push_back(Pair("height", (int32_t)coin.nHeight));
             utxo.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
 
@@ -606,6 +888,9 @@ static const struct {
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
 } uri_prefixes[] = {
       {"/rest/tx/", rest_tx},
+      {"/rest/txs", rest_txs},
+      {"/rest/blockrange/", rest_blockrange},
+      {"/rest/blockundo/", rest_blockundo},
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
       {"/rest/chaininfo", rest_chaininfo},
@@ -5,25 +5,35 @@
 
 #include "amount.h"
 #include "chain.h"
+#include "blockstatsindex.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
+#include "coinstatsindex.h"
 #include "consensus/validation.h"
+#include "kernel.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "profile.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "validationinterface.h"
+#include "validationstats.h"
 #include "hash.h"
 
 #include <stdint.h>
 
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 #include <mutex>
@@ -45,8 +55,6 @@ void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fInclud
 
 double GetDifficulty(const CBlockIndex* blockindex)
 {
-    // Floating point number that is a multiple of the minimum difficulty,
-    // minimum difficulty = 1.0.
     if (blockindex == NULL)
     {
         if (chainActive.Tip() == NULL)
@@ -55,10 +63,17 @@ double GetDifficulty(const CBlockIndex* blockindex)
             blockindex = chainActive.Tip();
     }
 
-    int nShift = (blockindex->nBits >> 24) & 0xff;
+    return GetDifficultyFromBits(blockindex->nBits);
+}
+
+double GetDifficultyFromBits(unsigned int nBits)
+{
+    // Floating point number that is a multiple of the minimum difficulty,
+    // minimum difficulty = 1.0.
+    int nShift = (nBits >> 24) & 0xff;
 
     double dDiff =
-        (double)0x0000ffff / (double)(blockindex->nBits & 0x00ffffff);
+        (double)0x0000ffff / (double)(nBits & 0x00ffffff);
 
     while (nShift < 29)
     {
@@ -77,34 +92,35 @@ double GetDifficulty(const CBlockIndex* blockindex)
 UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
+    result.reserve(14);
+    result.pushKVEnd("hash", blockindex->GetBlockHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", blockindex->nVersion));
-    result.push_back(Pair("versionHex", strprintf("%08x", blockindex->nVersion)));
-    result.push_back(Pair("merkleroot", blockindex->hashMerkleRoot.GetHex()));
-    result.push_back(Pair("time", (int64_t)blockindex->nTime));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)blockindex->nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    result.pushKVEnd("confirmations", confirmations);
+    result.pushKVEnd("height", blockindex->nHeight);
+    result.pushKVEnd("version", blockindex->nVersion);
+    result.pushKVEnd("versionHex", strprintf("%08x", blockindex->nVersion));
+    result.pushKVEnd("merkleroot", blockindex->hashMerkleRoot.GetHex());
+    result.pushKVEnd("time", (int64_t)blockindex->nTime);
+    result.pushKVEnd("mediantime", (int64_t)blockindex->GetMedianTimePast());
+    result.pushKVEnd("nonce", (uint64_t)blockindex->nNonce);
+    result.pushKVEnd("bits", strprintf("%08x", blockindex->nBits));
+    result.pushKVEnd("difficulty", GetDifficulty(blockindex));
+    result.pushKVEnd("chainwork", blockindex->nChainWork.GetHex());
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        result.pushKVEnd("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     CBlockIndex *pskip = chainActive.Next(blockindex);
     if (pskip)
-        result.push_back(Pair("nextblockhash", pskip->GetBlockHash().GetHex()));
+        result.pushKVEnd("nextblockhash", pskip->GetBlockHash().GetHex());
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false, CJSONStream* stream = NULL)
 {
-    UniValue result(UniValue::VOBJ);
+    CJSONResult result(stream, UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
@@ -118,19 +134,19 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
+    CJSONResult txs(result, "tx", UniValue::VARR);
     for(const auto& tx : block.vtx)
     {
         if(txDetails)
         {
             UniValue objTx(UniValue::VOBJ);
             TxToJSON(*tx, uint256(), objTx);
-            txs.push_back(objTx);
+            txs.push_back(std::move(objTx));
         }
         else
             txs.push_back(tx->GetHash().GetHex());
     }
-    result.push_back(Pair("tx", txs));
+    txs.Finish();
     result.push_back(Pair("time", block.GetBlockTime()));
     result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
     result.push_back(Pair("nonce", (uint64_t)block.nNonce));
@@ -143,7 +159,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     CBlockIndex *pskip = chainActive.Next(blockindex);
     if (pskip)
         result.push_back(Pair("nextblockhash", pskip->GetBlockHash().GetHex()));
-    return result;
+    return result.Finish();
 }
 
 UniValue getblockcount(const JSONRPCRequest& request)
@@ -159,8 +175,8 @@ UniValue getblockcount(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    CChainTipSnapshotRef tip = GetChainTipSnapshot();
+    return tip ? tip->nHeight : -1;
 }
 
 UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -176,8 +192,10 @@ UniValue getbestblockhash(const JSONRPCRequest& request)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    CChainTipSnapshotRef tip = GetChainTipSnapshot();
+    if (!tip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No active chain");
+    return tip->hashBlock.GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
@@ -190,6 +208,20 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
 	cond_blockchange.notify_all();
 }
 
+UniValue syncwithvalidationinterfacequeue(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw runtime_error(
+            "syncwithvalidationinterfacequeue\n"
+            "\nWaits for the validation interface queue to run the callbacks of what was validated so far.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("syncwithvalidationinterfacequeue", "")
+            + HelpExampleRpc("syncwithvalidationinterfacequeue", "")
+        );
+    SyncWithValidationInterfaceQueue();
+    return NullUniValue;
+}
+
 UniValue waitfornewblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -325,8 +357,8 @@ UniValue getdifficulty(const JSONRPCRequest& request)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    LOCK(cs_main);
-    return GetDifficulty();
+    CChainTipSnapshotRef tip = GetChainTipSnapshot();
+    return tip ? GetDifficultyFromBits(tip->nBits) : 1.0;
 }
 
 std::string EntryDescriptionString()
@@ -349,65 +381,66 @@ std::string EntryDescriptionString()
            "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+/** SolarCoin: The fields getrawmempool and getmempoolentry report for a mempool entry */
+static void summaryToJSON(UniValue &info, const TxMempoolEntrySummary &e)
 {
-    AssertLockHeld(mempool.cs);
-
-    info.push_back(Pair("size", (int)e.GetTxSize()));
-    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-    info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-    info.push_back(Pair("time", e.GetTime()));
-    info.push_back(Pair("height", (int)e.GetHeight()));
-    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-    info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-    info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-    info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-    info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
-    info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
-    info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-    const CTransaction& tx = e.GetTx();
-    set<string> setDepends;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-    {
-        if (mempool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
-    }
+    info.push_back(Pair("size", (int)e.nTxSize));
+    info.push_back(Pair("fee", ValueFromAmount(e.nFee)));
+    info.push_back(Pair("modifiedfee", ValueFromAmount(e.nModifiedFee)));
+    info.push_back(Pair("time", e.nTime));
+    info.push_back(Pair("height", (int)e.nHeight));
+    info.push_back(Pair("startingpriority", e.dStartingPriority));
+    info.push_back(Pair("currentpriority", e.dCurrentPriority));
+    info.push_back(Pair("descendantcount", e.nCountWithDescendants));
+    info.push_back(Pair("descendantsize", e.nSizeWithDescendants));
+    info.push_back(Pair("descendantfees", e.nModFeesWithDescendants));
+    info.push_back(Pair("ancestorcount", e.nCountWithAncestors));
+    info.push_back(Pair("ancestorsize", e.nSizeWithAncestors));
+    info.push_back(Pair("ancestorfees", e.nModFeesWithAncestors));
 
     UniValue depends(UniValue::VARR);
-    BOOST_FOREACH(const string& dep, setDepends)
+    BOOST_FOREACH(const uint256& dep, e.vDepends)
     {
-        depends.push_back(dep);
+        depends.push_back(dep.ToString());
     }
 
     info.push_back(Pair("depends", depends));
 }
 
-UniValue mempoolToJSON(bool fVerbose = false)
+void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+{
+    AssertLockHeld(mempool.cs);
+
+    CTxMemPool::txiter it = mempool.mapTx.find(e.GetTx().GetHash());
+    assert(it != mempool.mapTx.end());
+    summaryToJSON(info, mempool.GetEntrySummary(it, chainActive.Height()));
+}
+
+UniValue mempoolToJSON(bool fVerbose = false, CJSONStream* stream = NULL)
 {
     if (fVerbose)
     {
-        LOCK(mempool.cs);
-        UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+        // SolarCoin: from a snapshot, so mempool.cs is not held while the reply is built
+        std::shared_ptr<const TxMempoolSnapshot> snapshot = mempool.GetSnapshot(chainActive.Height());
+        CJSONResult o(stream, UniValue::VOBJ);
+        BOOST_FOREACH(const TxMempoolEntrySummary& e, snapshot->vEntries)
         {
-            const uint256& hash = e.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
-            o.push_back(Pair(hash.ToString(), info));
+            summaryToJSON(info, e);
+            o.pushKV(e.hash.ToString(), info);
         }
-        return o;
+        return o.Finish();
     }
     else
     {
         vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
 
-        UniValue a(UniValue::VARR);
+        CJSONResult a(stream, UniValue::VARR);
         BOOST_FOREACH(const uint256& hash, vtxid)
             a.push_back(hash.ToString());
 
-        return a;
+        return a.Finish();
     }
 }
 
@@ -439,7 +472,69 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     if (request.params.size() > 0)
         fVerbose = request.params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    return mempoolToJSON(fVerbose, request.stream);
+}
+
+/** SolarCoin: Default and largest number of transactions getrawmempoolpage returns */
+static const int64_t DEFAULT_MEMPOOL_PAGE_SIZE = 1000;
+static const int64_t MAX_MEMPOOL_PAGE_SIZE = 10000;
+
+UniValue getrawmempoolpage(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 3)
+        throw runtime_error(
+            "getrawmempoolpage ( \"start\" count verbose )\n"
+            "\nReturns a page of the transactions in memory pool, in txid order, for walking a large mempool\n"
+            "a page at a time. Each call reads a snapshot of the mempool that is shared by all callers and\n"
+            "only taken again after the mempool changed.\n"
+            "\nArguments:\n"
+            "1. \"start\"   (string, optional, default=\"\") The txid to start at; the \"next\" of the previous page, or empty for the first page\n"
+            "2. count     (numeric, optional, default=" + i64tostr(DEFAULT_MEMPOOL_PAGE_SIZE) + ") The most transactions to return, at most " + i64tostr(MAX_MEMPOOL_PAGE_SIZE) + "\n"
+            "3. verbose   (boolean, optional, default=false) True for a json object, false for array of transaction ids\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txs\" : [...] or {...},   (json array or object) As getrawmempool returns, for the transactions of this page\n"
+            "  \"next\" : \"txid\"         (string, optional) The start of the next page, missing on the last page\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrawmempoolpage", "")
+            + HelpExampleCli("getrawmempoolpage", "\"mytxid\" 500 true")
+            + HelpExampleRpc("getrawmempoolpage", "\"mytxid\", 500, true")
+        );
+
+    uint256 hashStart;
+    if (request.params.size() > 0 && !request.params[0].get_str().empty())
+        hashStart = ParseHashV(request.params[0], "start");
+    int64_t nCount = DEFAULT_MEMPOOL_PAGE_SIZE;
+    if (request.params.size() > 1)
+        nCount = request.params[1].get_int64();
+    if (nCount <= 0 || nCount > MAX_MEMPOOL_PAGE_SIZE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 1 and %d", MAX_MEMPOOL_PAGE_SIZE));
+    bool fVerbose = false;
+    if (request.params.size() > 2)
+        fVerbose = request.params[2].get_bool();
+
+    std::shared_ptr<const TxMempoolSnapshot> snapshot = mempool.GetSnapshot(chainActive.Height());
+    std::vector<TxMempoolEntrySummary>::const_iterator it = std::lower_bound(snapshot->vEntries.begin(), snapshot->vEntries.end(), hashStart,
+        [](const TxMempoolEntrySummary& e, const uint256& hash) { return e.hash < hash; });
+    std::vector<TxMempoolEntrySummary>::const_iterator itEnd = it + std::min<int64_t>(nCount, snapshot->vEntries.end() - it);
+
+    UniValue txs(fVerbose ? UniValue::VOBJ : UniValue::VARR);
+    for (; it != itEnd; it++) {
+        if (fVerbose) {
+            UniValue info(UniValue::VOBJ);
+            summaryToJSON(info, *it);
+            txs.push_back(Pair(it->hash.ToString(), info));
+        } else {
+            txs.push_back(it->hash.ToString());
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txs", txs));
+    if (itEnd != snapshot->vEntries.end())
+        ret.push_back(Pair("next", itEnd->hash.ToString()));
+    return ret;
 }
 
 UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -746,6 +841,15 @@ UniValue getblock(const JSONRPCRequest& request)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    // SolarCoin: the hex form is the stored bytes when they match the serialization
+    if (!fVerbose && IsRawBlockSerialization(pblockindex, RPCSerializationFlags(), Params().GetConsensus()))
+    {
+        std::vector<unsigned char> vchBlock;
+        if (!ReadRawBlockFromDisk(vchBlock, pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        return HexStr(vchBlock.begin(), vchBlock.end());
+    }
+
     if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -773,6 +877,21 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
 };
 
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    // Hashed the same way as the per-txid records of older versions, so hash_serialized can be compared across the upgrade
+    ss << hash;
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out;
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+    }
+    ss << VARINT(0);
+}
+
 //! Calculate statistics about the unspent transaction output set
 static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 {
@@ -785,32 +904,29 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    nTotalAmount += out.nValue;
-                }
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                outputs.clear();
             }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
             stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
+    if (!outputs.empty()) {
+        ApplyStats(stats, ss, prevkey, outputs);
+    }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -824,6 +940,8 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
             "                  to prune blocks whose block time is at least 2 hours older than the provided timestamp.\n"
             "\nResult:\n"
             "n    (numeric) Height of the last block pruned.\n"
+            "\nA few block files are pruned at once; the rest follow with the next blocks connected. Their files\n"
+            "are deleted in the background.\n"
             "\nExamples:\n"
             + HelpExampleCli("pruneblockchain", "1000")
             + HelpExampleRpc("pruneblockchain", "1000"));
@@ -863,30 +981,77 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(height);
 }
 
+/** SolarCoin: The block of a hash, or the block of the active chain at a height, given as a number or string */
+static const CBlockIndex* ParseHashOrHeight(const UniValue& param)
+{
+    AssertLockHeld(cs_main);
+    if (param.isNum() || (param.isStr() && param.get_str().size() != 64)) {
+        int nHeight;
+        if (param.isNum())
+            nHeight = param.get_int();
+        else if (!ParseInt32(param.get_str(), &nHeight))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block hash or height");
+        if (nHeight < 0 || nHeight > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        return chainActive[nHeight];
+    }
+    uint256 hash = ParseHashV(param, "hash_or_height");
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    if (it == mapBlockIndex.end())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    return it->second;
+}
+
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless -coinstatsindex is on: then the statistics are read\n"
+            "from the index, and are also available for the earlier blocks of the active chain.\n"
+            "\nArguments:\n"
+            "1. \"hash_or_height\"   (string or numeric, optional) The block hash or height to return the statistics after;\n"
+            "                       needs -coinstatsindex (default: the tip)\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, without -coinstatsindex\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size, without -coinstatsindex\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, without -coinstatsindex\n"
+            "  \"muhash\": \"hash\",     (string) The MuHash3072 of the outputs, with -coinstatsindex\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    // SolarCoin: The index has the statistics of every block since it was turned on
+    if (pcoinstatsindex) {
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = request.params.size() > 0 ? ParseHashOrHeight(request.params[0]) : chainActive.Tip();
+        }
+        CBlockCoinStats stats;
+        if (!pcoinstatsindex->GetStats(pindex, stats))
+            throw JSONRPCError(RPC_MISC_ERROR, "No statistics for this block: it is from before -coinstatsindex was turned on, or not in the active chain since");
+        ret.push_back(Pair("height", (int64_t)stats.nHeight));
+        ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
+        ret.push_back(Pair("txouts", (int64_t)stats.nTxOuts));
+        ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        return ret;
+    }
+    if (request.params.size() > 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Querying a block other than the tip needs -coinstatsindex");
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsTip, stats)) {
@@ -903,6 +1068,293 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue BlockStatsToJSON(const CBlockStats& stats, const CBlockIndex* pindex)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.reserve(stats.fProofOfStake ? 16 : 13);
+    ret.pushKVEnd("height", stats.nHeight);
+    ret.pushKVEnd("blockhash", pindex->GetBlockHash().GetHex());
+    ret.pushKVEnd("time", stats.nTime);
+    ret.pushKVEnd("size", (int64_t)stats.nSize);
+    ret.pushKVEnd("txs", (int64_t)stats.nTx);
+    ret.pushKVEnd("ins", (int64_t)stats.nInputs);
+    ret.pushKVEnd("outs", (int64_t)stats.nOutputs);
+    ret.pushKVEnd("total_out", ValueFromAmount(stats.nTotalOut));
+    ret.pushKVEnd("totalfee", ValueFromAmount(stats.nFees));
+    ret.pushKVEnd("maxfee", ValueFromAmount(stats.nMaxFee));
+    ret.pushKVEnd("mint", ValueFromAmount(stats.nMint));
+    ret.pushKVEnd("moneysupply", ValueFromAmount(stats.nMoneySupply));
+    ret.pushKVEnd("proofofstake", stats.fProofOfStake);
+    if (stats.fProofOfStake) {
+        ret.pushKVEnd("stake_value", ValueFromAmount(stats.nStakeValue));
+        ret.pushKVEnd("stake_reward", ValueFromAmount(stats.nStakeReward));
+        ret.pushKVEnd("stake_age", stats.nStakeAge);
+    }
+    return ret;
+}
+
+static void EnsureBlockStatsIndex()
+{
+    if (!pblockstatsindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block statistics index not enabled, start with -blockstatsindex");
+}
+
+static const std::string strBlockStatsHelp =
+    "{\n"
+    "  \"height\": n,            (numeric) The height of the block\n"
+    "  \"blockhash\": \"hash\",    (string) The hash of the block\n"
+    "  \"time\": n,              (numeric) The block time\n"
+    "  \"size\": n,              (numeric) The serialized size of the block\n"
+    "  \"txs\": n,               (numeric) The number of transactions, with the coinbase and coinstake\n"
+    "  \"ins\": n,               (numeric) The number of inputs, without the coinbase\n"
+    "  \"outs\": n,              (numeric) The number of outputs\n"
+    "  \"total_out\": x.xxx,     (numeric) The value paid by the transactions other than the coinbase and coinstake\n"
+    "  \"totalfee\": x.xxx,      (numeric) The fees of the transactions\n"
+    "  \"maxfee\": x.xxx,        (numeric) The largest fee of a transaction\n"
+    "  \"mint\": x.xxx,          (numeric) The coins created by the block\n"
+    "  \"moneysupply\": x.xxx,   (numeric) The money supply after the block\n"
+    "  \"proofofstake\": true|false, (boolean) Whether the block is proof-of-stake\n"
+    "  \"stake_value\": x.xxx,   (numeric) The value staked by the coinstake, for proof-of-stake blocks\n"
+    "  \"stake_reward\": x.xxx,  (numeric) What the coinstake pays on top of the stake\n"
+    "  \"stake_age\": n          (numeric) Seconds from the staked transaction to the coinstake, 0 if not known\n"
+    "}\n";
+
+UniValue getblockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getblockstats hash_or_height\n"
+            "\nReturns the statistics of a block, from the block statistics index (-blockstatsindex).\n"
+            "\nArguments:\n"
+            "1. \"hash_or_height\"   (string or numeric, required) The block hash, or height in the active chain\n"
+            "\nResult:\n"
+            + strBlockStatsHelp +
+            "\nExamples:\n"
+            + HelpExampleCli("getblockstats", "1000")
+            + HelpExampleRpc("getblockstats", "1000")
+        );
+
+    EnsureBlockStatsIndex();
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = ParseHashOrHeight(request.params[0]);
+    }
+    CBlockStats stats;
+    if (!pblockstatsindex->LookupStats(pindex, stats))
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not indexed yet");
+    return BlockStatsToJSON(stats, pindex);
+}
+
+UniValue getblockstatsrange(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+            "getblockstatsrange start_height ( end_height )\n"
+            "\nReturns the statistics of a range of blocks of the active chain, from the block statistics index\n"
+            "(-blockstatsindex).\n"
+            "\nArguments:\n"
+            "1. start_height   (numeric, required) The height of the first block\n"
+            "2. end_height     (numeric, optional) The height of the last block (default: the tip)\n"
+            "\nResult:\n"
+            "[                  (array of json objects) The statistics of each block, as in getblockstats\n"
+            + strBlockStatsHelp +
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockstatsrange", "1000 2000")
+            + HelpExampleRpc("getblockstatsrange", "1000, 2000")
+        );
+
+    EnsureBlockStatsIndex();
+    std::vector<const CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        int nStart = request.params[0].get_int();
+        int nEnd = request.params.size() > 1 ? request.params[1].get_int() : chainActive.Height();
+        if (nStart < 0 || nEnd > chainActive.Height() || nStart > nEnd)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        vIndex.reserve(nEnd - nStart + 1);
+        for (int nHeight = nStart; nHeight <= nEnd; nHeight++)
+            vIndex.push_back(chainActive[nHeight]);
+    }
+    CBlockStats stats;
+    if (!pblockstatsindex->LookupStats(vIndex.back(), stats))
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Blocks not indexed yet up to height %d", vIndex.back()->nHeight));
+
+    // The blocks are indexed in order, so a block is missing only if it was disconnected since
+    CJSONResult result(request.stream, UniValue::VARR);
+    for (const CBlockIndex* pindex : vIndex) {
+        if (pblockstatsindex->LookupStats(pindex, stats))
+            result.push_back(BlockStatsToJSON(stats, pindex));
+    }
+    return result.Finish();
+}
+
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set and the block index data needed to continue\n"
+            "validating (money supply, stake modifiers) to a snapshot file that loadtxoutset can load.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) The file to write, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,           (numeric) The height of the snapshot block\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the snapshot block\n"
+            "  \"coins\": n,           (numeric) The number of unspent transaction outputs\n"
+            "  \"path\": \"path\"        (string) The absolute path of the snapshot\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    boost::filesystem::path path = boost::filesystem::absolute(request.params[0].get_str(), GetDataDir());
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CTxOutSetSnapshotInfo info;
+    std::string strError;
+    if (!DumpTxOutSetSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", info.nHeight));
+    ret.push_back(Pair("bestblock", info.hashBlock.GetHex()));
+    ret.push_back(Pair("coins", (int64_t)info.nCoins));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "loadtxoutset \"path\"\n"
+            "\nLoads a snapshot written by dumptxoutset into an empty chainstate and continues syncing\n"
+            "from the snapshot block. The headers up to the snapshot block must have been received.\n"
+            "Blocks below the snapshot are not downloaded, so the node must run with -prune. They are\n"
+            "replayed in the background from the -snapshotblocks files, if given, to check the snapshot.\n"
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) The snapshot file, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,           (numeric) The height of the snapshot block\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the snapshot block\n"
+            "  \"coins\": n            (numeric) The number of unspent transaction outputs loaded\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\"")
+        );
+
+    boost::filesystem::path path = boost::filesystem::absolute(request.params[0].get_str(), GetDataDir());
+    if (!boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " not found");
+
+    CTxOutSetSnapshotInfo info;
+    std::string strError;
+    if (!LoadTxOutSetSnapshot(Params(), path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    StartSnapshotValidation(Params());
+
+    CValidationState state;
+    ActivateBestChain(state, Params());
+    if (!state.IsValid())
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", info.nHeight));
+    ret.push_back(Pair("bestblock", info.hashBlock.GetHex()));
+    ret.push_back(Pair("coins", (int64_t)info.nCoins));
+    return ret;
+}
+
+UniValue dumpheaders(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+            "dumpheaders \"path\" ( height )\n"
+            "\nWrites the headers of the active chain from height 1 to a header bundle that loadheaders or\n"
+            "-loadheaders can import. Only the headers up to the last checkpoint in the bundle are imported.\n"
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) The file to write, relative to the data directory if not absolute\n"
+            "2. height       (numeric, optional) The height of the last header (default: the last checkpoint)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,           (numeric) The height of the last header\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the last header\n"
+            "  \"headers\": n,         (numeric) The number of headers written\n"
+            "  \"path\": \"path\"        (string) The absolute path of the bundle\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumpheaders", "\"headers.dat\"")
+            + HelpExampleRpc("dumpheaders", "\"headers.dat\"")
+        );
+
+    boost::filesystem::path path = boost::filesystem::absolute(request.params[0].get_str(), GetDataDir());
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    int nHeight = -1;
+    if (request.params.size() > 1) {
+        nHeight = request.params[1].get_int();
+        if (nHeight < 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    CHeaderBundleInfo info;
+    std::string strError;
+    if (!DumpHeaderBundle(Params(), path, nHeight, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", info.nHeight));
+    ret.push_back(Pair("bestblock", info.hashBlock.GetHex()));
+    ret.push_back(Pair("headers", (int64_t)info.nHeaders));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+UniValue loadheaders(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "loadheaders \"path\"\n"
+            "\nImports the headers of a bundle written by dumpheaders, up to the last checkpoint it reaches.\n"
+            "The headers must match every checkpoint they reach, so their proof of work is not checked again.\n"
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) The bundle file, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,           (numeric) The height of the last header imported\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the last header imported\n"
+            "  \"headers\": n          (numeric) The number of headers new to the block index\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadheaders", "\"headers.dat\"")
+            + HelpExampleRpc("loadheaders", "\"headers.dat\"")
+        );
+
+    boost::filesystem::path path = boost::filesystem::absolute(request.params[0].get_str(), GetDataDir());
+    if (!boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " not found");
+
+    CHeaderBundleInfo info;
+    std::string strError;
+    if (!LoadHeaderBundle(Params(), path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", info.nHeight));
+    ret.push_back(Pair("bestblock", info.hashBlock.GetHex()));
+    ret.push_back(Pair("headers", (int64_t)info.nHeaders));
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -928,8 +1380,8 @@ UniValue gettxout(const JSONRPCRequest& request)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
+            "  \"coinstake\" : true|false  (boolean) Coinstake or not\n"
             "}\n"
 
             "\nExamples:\n"
@@ -952,33 +1404,31 @@ UniValue gettxout(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
-    CCoins coins;
+    COutPoint out(hash, n);
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) // TODO: filtering spent coins should be done by the CCoinsViewMemPool
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin))
             return NullUniValue;
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+        ret.push_back(Pair("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1)));
+    ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
+    ret.push_back(Pair("coinbase", (bool)coin.fCoinBase));
+    ret.push_back(Pair("coinstake", (bool)coin.fCoinStake));
 
     return ret;
 }
@@ -1068,6 +1518,14 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
             "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored\n"
+            "  \"snapshot_validation\": {   (object) only if the chainstate was loaded from a UTXO snapshot\n"
+            "     \"height\": xxxxxx,       (numeric) the height of the snapshot block\n"
+            "     \"blockhash\": \"...\",     (string) the hash of the snapshot block\n"
+            "     \"status\": \"xxxx\",       (string) one of \"pending\", \"valid\", \"invalid\"\n"
+            "     \"running\": xx,          (boolean) if the blocks below the snapshot are being replayed\n"
+            "     \"validated\": xxxxxx,    (numeric) the height up to which the blocks were replayed\n"
+            "     \"error\": \"...\"          (string) why the snapshot is invalid, if it is\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1092,17 +1550,20 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockchaininfo", "")
         );
 
-    LOCK(cs_main);
+    // SolarCoin: Only the prune height needs cs_main, the rest comes from the tip snapshot
+    CChainTipSnapshotRef tip = GetChainTipSnapshot();
+    if (!tip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No active chain");
 
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain",                 Params().NetworkIDString()));
-    obj.push_back(Pair("blocks",                (int)chainActive.Height()));
-    obj.push_back(Pair("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash",         chainActive.Tip()->GetBlockHash().GetHex()));
-    obj.push_back(Pair("difficulty",            (double)GetDifficulty()));
-    obj.push_back(Pair("mediantime",            (int64_t)chainActive.Tip()->GetMedianTimePast()));
-    obj.push_back(Pair("verificationprogress",  GuessVerificationProgress(Params().TxData(), chainActive.Tip())));
-    obj.push_back(Pair("chainwork",             chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("blocks",                tip->nHeight));
+    obj.push_back(Pair("headers",               tip->nHeaders));
+    obj.push_back(Pair("bestblockhash",         tip->hashBlock.GetHex()));
+    obj.push_back(Pair("difficulty",            GetDifficultyFromBits(tip->nBits)));
+    obj.push_back(Pair("mediantime",            tip->nMedianTimePast));
+    obj.push_back(Pair("verificationprogress",  tip->dVerificationProgress));
+    obj.push_back(Pair("chainwork",             tip->nChainWork.GetHex()));
     obj.push_back(Pair("pruned",                fPruneMode));
 
     // SolarCoin: No softforks
@@ -1120,12 +1581,28 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
 
     if (fPruneMode)
     {
+        LOCK(cs_main);
         CBlockIndex *block = chainActive.Tip();
         while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
             block = block->pprev;
 
         obj.push_back(Pair("pruneheight",        block->nHeight));
     }
+
+    CSnapshotValidationInfo snapshot;
+    GetSnapshotValidationInfo(snapshot);
+    if (snapshot.fLoaded) {
+        static const char* const pszStatus[] = {"pending", "valid", "invalid"};
+        UniValue validation(UniValue::VOBJ);
+        validation.push_back(Pair("height", snapshot.nHeight));
+        validation.push_back(Pair("blockhash", snapshot.hashBlock.GetHex()));
+        validation.push_back(Pair("status", pszStatus[snapshot.nStatus]));
+        validation.push_back(Pair("running", snapshot.fRunning));
+        validation.push_back(Pair("validated", snapshot.nValidated));
+        if (!snapshot.strError.empty())
+            validation.push_back(Pair("error", snapshot.strError));
+        obj.push_back(Pair("snapshot_validation", validation));
+    }
     return obj;
 }
 
@@ -1247,6 +1724,361 @@ UniValue getchaintips(const JSONRPCRequest& request)
     return res;
 }
 
+static UniValue LatencyHistogramToJSON(const CLatencyHistogram& hist)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", (uint64_t)hist.GetCount()));
+    obj.push_back(Pair("total", 0.001 * hist.GetTotal()));
+    obj.push_back(Pair("p50", 0.001 * hist.GetPercentile(0.5)));
+    obj.push_back(Pair("p90", 0.001 * hist.GetPercentile(0.9)));
+    obj.push_back(Pair("p99", 0.001 * hist.GetPercentile(0.99)));
+    obj.push_back(Pair("max", 0.001 * hist.GetMax()));
+    return obj;
+}
+
+UniValue getblockprocessingstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getblockprocessingstats\n"
+            "\nReturns latency histograms of the block connection phases since startup.\n"
+            "Percentiles are upper bounds of power-of-two buckets, all times are in milliseconds.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"phases\": {\n"
+            "    \"name\": {         (string) check, forks, connect, verify, index, callbacks and connectblock\n"
+            "                      for ConnectBlock(), prefetch, read, flush, chainstate, postconnect and connecttip\n"
+            "                      for ConnectTip(), disconnect, and staketime, proofofstake and stakemodifier for PoST\n"
+            "      \"count\": n,     (numeric) number of samples\n"
+            "      \"total\": x.xxx, (numeric) sum of all samples\n"
+            "      \"p50\": x.xxx,   (numeric) median\n"
+            "      \"p90\": x.xxx,   (numeric) 90th percentile\n"
+            "      \"p99\": x.xxx,   (numeric) 99th percentile\n"
+            "      \"max\": x.xxx    (numeric) largest sample\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"counters\": {\n"
+            "    \"stakeprevout_cache_hits\": n,   (numeric) stake prevout cache hits\n"
+            "    \"stakeprevout_cache_misses\": n, (numeric) stake prevout cache misses\n"
+            "    \"coins_prefetched\": n,          (numeric) coins read ahead of ConnectBlock() into the cache\n"
+            "    \"coins_prefetch_stale\": n,      (numeric) block prefetches discarded as the coins database changed\n"
+            "    \"blocks\": n,                    (numeric) blocks connected\n"
+            "    \"transactions\": n,              (numeric) transactions of the blocks connected\n"
+            "    \"inputs\": n                     (numeric) transaction inputs of the blocks connected\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockprocessingstats", "")
+            + HelpExampleRpc("getblockprocessingstats", "")
+        );
+
+    UniValue phases(UniValue::VOBJ);
+    for (int i = 0; i < BLOCK_PHASE_COUNT; i++) {
+        BlockProcessingPhase phase = (BlockProcessingPhase)i;
+        phases.push_back(Pair(GetBlockPhaseName(phase), LatencyHistogramToJSON(GetBlockPhaseHistogram(phase))));
+    }
+    UniValue counters(UniValue::VOBJ);
+    for (int i = 0; i < BLOCK_COUNTER_COUNT; i++) {
+        BlockProcessingCounter counter = (BlockProcessingCounter)i;
+        counters.push_back(Pair(GetBlockCounterName(counter), (uint64_t)GetBlockCounter(counter)));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("phases", phases));
+    ret.push_back(Pair("counters", counters));
+    return ret;
+}
+
+static UniValue CacheStatsToJSON(const CacheStats& stats)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("elements", (uint64_t)stats.nElements));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    ret.push_back(Pair("epochs", stats.nEpochs));
+    return ret;
+}
+
+UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns the counters of the signature cache, the script execution cache and the stake prevout cache since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {          (string) signatures, scripts or stakeprevouts\n"
+            "    \"elements\": n,   (numeric) capacity in entries, 0 if the cache is disabled\n"
+            "    \"hits\": n,       (numeric) lookups that found their entry\n"
+            "    \"misses\": n,     (numeric) lookups that did not\n"
+            "    \"evictions\": n,  (numeric) entries dropped by an insertion that found no room\n"
+            "    \"epochs\": n      (numeric) generations of entries aged out to make room\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("signatures", CacheStatsToJSON(GetSignatureCacheStats())));
+    ret.push_back(Pair("scripts", CacheStatsToJSON(GetScriptExecutionCacheStats())));
+    ret.push_back(Pair("stakeprevouts", CacheStatsToJSON(GetStakePrevoutCacheStats())));
+    return ret;
+}
+
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw runtime_error(
+            "getlockstats ( count )\n"
+            "\nReturns the lock sites with the most contention since -lockprofile was set, the longest waits caused first.\n"
+            "Percentiles are upper bounds of power-of-two buckets, all times are in milliseconds.\n"
+            "\nArguments:\n"
+            "1. count    (numeric, optional, default=20) number of lock sites to return\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,  (boolean) whether lock contention is being profiled (-lockprofile)\n"
+            "  \"sites\": [\n"
+            "    {\n"
+            "      \"lock\": \"name\",       (string) the lock, as named where it is taken\n"
+            "      \"site\": \"file:line\",  (string) where it is taken\n"
+            "      \"contentions\": n,     (numeric) times it was taken here after waiting for it\n"
+            "      \"wait\": {...},        (json object) time waited for it here, with count, total, p50, p90, p99 and max\n"
+            "      \"blocking\": n,        (numeric) times others waited for it while it was held from here\n"
+            "      \"blocking_wait\": {...}, (json object) time others waited for it while it was held from here\n"
+            "      \"hold\": {...}         (json object) time it was held from here, sampled one in " + strprintf("%u", LOCK_HOLD_SAMPLE_INTERVAL) + "\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleRpc("getlockstats", "10")
+        );
+
+    size_t nCount = 20;
+    if (request.params.size() > 0) {
+        int n = request.params[0].get_int();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+        nCount = n;
+    }
+
+    // Both sides of a contention count: the site waiting and the site making it wait
+    std::vector<const CLockSite*> vSites = GetLockSites();
+    std::vector<std::pair<int64_t, const CLockSite*> > vSorted;
+    for (const CLockSite* psite : vSites) {
+        int64_t nWaits = psite->histWait.GetTotal() + psite->histBlocking.GetTotal();
+        if (psite->nContentions.load(std::memory_order_relaxed) || psite->nBlocking.load(std::memory_order_relaxed))
+            vSorted.push_back(std::make_pair(nWaits, psite));
+    }
+    std::sort(vSorted.begin(), vSorted.end(), [](const std::pair<int64_t, const CLockSite*>& a, const std::pair<int64_t, const CLockSite*>& b) {
+        return a.first > b.first;
+    });
+
+    UniValue sites(UniValue::VARR);
+    for (size_t i = 0; i < vSorted.size() && i < nCount; i++) {
+        const CLockSite& site = *vSorted[i].second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", site.pszName));
+        obj.push_back(Pair("site", strprintf("%s:%d", site.pszFile, site.nLine)));
+        obj.push_back(Pair("contentions", (uint64_t)site.nContentions.load(std::memory_order_relaxed)));
+        obj.push_back(Pair("wait", LatencyHistogramToJSON(site.histWait)));
+        obj.push_back(Pair("blocking", (uint64_t)site.nBlocking.load(std::memory_order_relaxed)));
+        obj.push_back(Pair("blocking_wait", LatencyHistogramToJSON(site.histBlocking)));
+        obj.push_back(Pair("hold", LatencyHistogramToJSON(site.histHold)));
+        sites.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", fLockProfile.load(std::memory_order_relaxed)));
+    ret.push_back(Pair("sites", sites));
+    return ret;
+}
+
+UniValue getprofile(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw runtime_error(
+            "getprofile ( \"format\" count )\n"
+            "\nReturns the time spent in the profiled scopes of the validation, kernel, network and wallet code since\n"
+            "-profile was set, the most time of their own first. Times are measured in CPU cycles where the cycle\n"
+            "counter can be read and reported in microseconds.\n"
+            "\nArguments:\n"
+            "1. \"format\"   (string, optional, default=\"json\") \"json\", or \"folded\" for the call paths in the input\n"
+            "               format of flamegraph.pl\n"
+            "2. count      (numeric, optional, default=20) number of scopes to return in the \"json\" format\n"
+            "\nResult (for \"json\"):\n"
+            "{\n"
+            "  \"enabled\": true|false,  (boolean) whether the scopes are being profiled (-profile)\n"
+            "  \"ticks_per_us\": x.xxx,  (numeric) profiler clock ticks per microsecond\n"
+            "  \"dropped\": n,           (numeric) samples dropped as the buffer of their thread was full\n"
+            "  \"scopes\": [\n"
+            "    {\n"
+            "      \"scope\": \"name\",      (string) the scope, as named where it is profiled\n"
+            "      \"site\": \"file:line\",  (string) where it is profiled\n"
+            "      \"count\": n,           (numeric) times it was entered\n"
+            "      \"total_us\": n,        (numeric) time spent in it, and in the scopes nested in it\n"
+            "      \"self_us\": n          (numeric) time spent in it outside the scopes nested in it\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nResult (for \"folded\"):\n"
+            "\"profile\"                (string) one \"outer;inner microseconds\" line per call path\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getprofile", "")
+            + HelpExampleCli("getprofile", "folded")
+            + HelpExampleRpc("getprofile", "\"json\", 10")
+        );
+
+    std::string strFormat = request.params.size() > 0 ? request.params[0].get_str() : "json";
+    if (strFormat != "json" && strFormat != "folded")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown format " + strFormat);
+    size_t nCount = 20;
+    if (request.params.size() > 1) {
+        int n = request.params[1].get_int();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+        nCount = n;
+    }
+
+    std::vector<CProfilePath> vPaths = GetProfilePaths();
+    if (strFormat == "folded")
+        return FormatProfileFolded(vPaths);
+
+    // The paths through each scope summed up, the total time of a recursive scope counted at its outermost entry
+    struct ScopeTotals { uint64_t nCount = 0, nTicks = 0, nSelfTicks = 0; };
+    std::map<const CProfileSite*, ScopeTotals> mapScopes;
+    for (const CProfilePath& path : vPaths) {
+        const CProfileSite* psite = path.vSites.back();
+        ScopeTotals& scope = mapScopes[psite];
+        scope.nCount += path.nCount;
+        scope.nSelfTicks += path.GetSelfTicks();
+        if (std::find(path.vSites.begin(), path.vSites.end() - 1, psite) == path.vSites.end() - 1)
+            scope.nTicks += path.nTicks;
+    }
+    std::vector<std::pair<const CProfileSite*, ScopeTotals> > vScopes(mapScopes.begin(), mapScopes.end());
+    std::sort(vScopes.begin(), vScopes.end(), [](const std::pair<const CProfileSite*, ScopeTotals>& a, const std::pair<const CProfileSite*, ScopeTotals>& b) {
+        return a.second.nSelfTicks > b.second.nSelfTicks;
+    });
+
+    const double dTicksPerMicro = GetProfileTicksPerMicro();
+    UniValue scopes(UniValue::VARR);
+    for (size_t i = 0; i < vScopes.size() && i < nCount; i++) {
+        const CProfileSite& site = *vScopes[i].first;
+        const ScopeTotals& scope = vScopes[i].second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("scope", site.pszName));
+        obj.push_back(Pair("site", strprintf("%s:%d", site.pszFile, site.nLine)));
+        obj.push_back(Pair("count", scope.nCount));
+        obj.push_back(Pair("total_us", (uint64_t)(scope.nTicks / dTicksPerMicro)));
+        obj.push_back(Pair("self_us", (uint64_t)(scope.nSelfTicks / dTicksPerMicro)));
+        scopes.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", fProfile.load(std::memory_order_relaxed)));
+    ret.push_back(Pair("ticks_per_us", dTicksPerMicro));
+    ret.push_back(Pair("dropped", GetProfileDropped()));
+    ret.push_back(Pair("scopes", scopes));
+    return ret;
+}
+
+static UniValue DBStatsToJSON(const CDBWrapper& db)
+{
+    const CDBOptions& dboptions = db.GetDBOptions();
+    UniValue options(UniValue::VOBJ);
+    options.push_back(Pair("maxopenfiles", dboptions.nMaxOpenFiles));
+    options.push_back(Pair("blocksize", (uint64_t)dboptions.nBlockSize));
+    options.push_back(Pair("bloombits", dboptions.nBloomBits));
+    options.push_back(Pair("writebuffer", (uint64_t)dboptions.nWriteBufferSize));
+    options.push_back(Pair("compression", dboptions.fCompression));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("options", options));
+    ret.push_back(Pair("approximate_size", db.EstimateSize()));
+    std::string strValue;
+    if (db.GetProperty("leveldb.approximate-memory-usage", strValue))
+        ret.push_back(Pair("memory_usage", atoi64(strValue)));
+    if (db.GetProperty("leveldb.stats", strValue))
+        ret.push_back(Pair("stats", strValue));
+    return ret;
+}
+
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the LevelDB settings and statistics of the chainstate and block index databases.\n"
+            "The block index database also holds the transaction index.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                (string) chainstate or blockindex\n"
+            "    \"options\": {\n"
+            "      \"maxopenfiles\": n,   (numeric) table files kept open\n"
+            "      \"blocksize\": n,      (numeric) table block size in bytes\n"
+            "      \"bloombits\": n,      (numeric) bloom filter bits per key, 0 if disabled\n"
+            "      \"writebuffer\": n,    (numeric) write buffer size in bytes, 0 for a quarter of the cache\n"
+            "      \"compression\": true|false (boolean) whether Snappy compression was requested\n"
+            "    },\n"
+            "    \"approximate_size\": n, (numeric) approximate size on disk in bytes\n"
+            "    \"memory_usage\": n,     (numeric) approximate memory used by LevelDB in bytes\n"
+            "    \"stats\": \"...\"        (string) the leveldb.stats property: files, size and compaction time per level\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    if (pcoinsdbview)
+        ret.push_back(Pair("chainstate", DBStatsToJSON(pcoinsdbview->GetDB())));
+    if (pblocktree)
+        ret.push_back(Pair("blockindex", DBStatsToJSON(*pblocktree)));
+    return ret;
+}
+
+UniValue compactdb(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "compactdb \"name\"\n"
+            "\nCompacts a LevelDB database, a key range at a time with a pause of -dbcompactpause milliseconds\n"
+            "between ranges, so block connection goes on meanwhile. Returns once the compaction is done.\n"
+            "\nArguments:\n"
+            "1. \"name\"    (string, required) chainstate, blockindex or txindex (the transaction index entries of blockindex)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"approximate_size\": n, (numeric) approximate size on disk in bytes, after the compaction\n"
+            "  \"time_ms\": n           (numeric) milliseconds the compaction took\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("compactdb", "\"chainstate\"")
+            + HelpExampleRpc("compactdb", "\"chainstate\"")
+        );
+
+    const std::string strName = request.params[0].get_str();
+    if (strName != "chainstate" && strName != "blockindex" && strName != "txindex")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database, expected chainstate, blockindex or txindex");
+
+    const int64_t nStart = GetTimeMillis();
+    if (!CompactChainDB(strName))
+        throw JSONRPCError(RPC_MISC_ERROR, "Compaction was interrupted");
+
+    UniValue ret(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        const CDBWrapper* pdb = strName == "chainstate" ? &pcoinsdbview->GetDB() : pblocktree;
+        ret.push_back(Pair("approximate_size", pdb->EstimateSize()));
+    }
+    ret.push_back(Pair("time_ms", GetTimeMillis() - nStart));
+    return ret;
+}
+
 UniValue mempoolInfoToJSON()
 {
     UniValue ret(UniValue::VOBJ);
@@ -1399,20 +2231,33 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ ----------
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  {} },
-    { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
-    { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbose"} },
-    { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
-    { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  {}, true },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  {}, true },
+    { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbose"}, true },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"}, true },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"}, true },
+    { "blockchain",         "getblockprocessingstats", &getblockprocessingstats, true, {} },
+    { "blockchain",         "getblockstats",          &getblockstats,          true,  {"hash_or_height"}, true },
+    { "blockchain",         "getblockstatsrange",     &getblockstatsrange,     true,  {"start_height","end_height"}, true },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
+    { "blockchain",         "getdbstats",             &getdbstats,             true,  {} },
+    { "blockchain",         "compactdb",              &compactdb,              true,  {"name"} },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {}, true },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"} },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"}, true },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
-    { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "getrawmempoolpage",      &getrawmempoolpage,      true,  {"start","count","verbose"} },
+    { "blockchain",         "getsigcacheinfo",        &getsigcacheinfo,        true,  {} },
+    { "blockchain",         "getlockstats",           &getlockstats,           true,  {"count"} },
+    { "blockchain",         "getprofile",             &getprofile,             true,  {"format","count"} },
+    { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"}, true },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_or_height"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           true,  {"path"} },
+    { "blockchain",         "dumpheaders",            &dumpheaders,            true,  {"path","height"} },
+    { "blockchain",         "loadheaders",            &loadheaders,            true,  {"path"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
 
@@ -1421,6 +2266,7 @@ static const CRPCCommand commands[] =
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        true,  {"blockhash"} },
     { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  {"blockhash"} },
+    { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, true, {} },
     { "hidden",             "waitfornewblock",        &waitfornewblock,        true,  {"timeout"} },
     { "hidden",             "waitforblock",           &waitforblock,           true,  {"blockhash","timeout"} },
     { "hidden",             "waitforblockheight",     &waitforblockheight,     true,  {"height","timeout"} },
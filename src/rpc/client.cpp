@@ -34,8 +34,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "setmocktime", 0, "timestamp" },
     { "generate", 0, "nblocks" },
     { "generate", 1, "maxtries" },
+    { "generatestake", 0, "nblocks" },
     { "generatetoaddress", 0, "nblocks" },
     { "generatetoaddress", 2, "maxtries" },
+    { "dumpheaders", 1, "height" },
     { "getnetworkhashps", 0, "nblocks" },
     { "getnetworkhashps", 1, "height" },
     { "sendtoaddress", 1, "amount" },
@@ -80,7 +82,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listunspent", 1, "maxconf" },
     { "listunspent", 2, "addresses" },
     { "getblock", 1, "verbose" },
+    { "getlockstats", 0, "count" },
+    { "getprofile", 1, "count" },
     { "getblockheader", 1, "verbose" },
+    { "getblockstatsrange", 0, "start_height" },
+    { "getblockstatsrange", 1, "end_height" },
     { "gettransaction", 1, "include_watchonly" },
     { "getrawtransaction", 1, "verbose" },
     { "createrawtransaction", 0, "inputs" },
@@ -89,16 +95,27 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "signrawtransaction", 1, "prevtxs" },
     { "signrawtransaction", 2, "privkeys" },
     { "sendrawtransaction", 1, "allowhighfees" },
+    { "sendrawtransactions", 0, "hexstrings" },
+    { "sendrawtransactions", 1, "allowhighfees" },
     { "fundrawtransaction", 1, "options" },
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
     { "gettxoutproof", 0, "txids" },
+    { "getaddresstxids", 0, "query" },
+    { "getaddressbalance", 0, "query" },
+    { "getaddressutxos", 0, "query" },
+    { "getspentinfo", 0, "query" },
     { "lockunspent", 0, "unlock" },
     { "lockunspent", 1, "transactions" },
     { "importprivkey", 2, "rescan" },
+    { "importprivkey", 3, "timestamp" },
     { "importaddress", 2, "rescan" },
     { "importaddress", 3, "p2sh" },
+    { "importaddress", 4, "timestamp" },
     { "importpubkey", 2, "rescan" },
+    { "importpubkey", 3, "timestamp" },
+    { "rescanblockchain", 0, "start_height" },
+    { "rescanblockchain", 1, "stop_height" },
     { "importmulti", 0, "requests" },
     { "importmulti", 1, "options" },
     { "verifychain", 0, "checklevel" },
@@ -106,6 +123,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "pruneblockchain", 0, "height" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
+    { "getrawmempoolpage", 1, "count" },
+    { "getrawmempoolpage", 2, "verbose" },
     { "estimatefee", 0, "nblocks" },
     { "estimatepriority", 0, "nblocks" },
     { "estimatesmartfee", 0, "nblocks" },
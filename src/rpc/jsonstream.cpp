@@ -0,0 +1,164 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+CJSONStream::CJSONStream(const Sink& sinkIn, size_t nChunkSizeIn) :
+    sink(sinkIn), nChunkSize(nChunkSizeIn), fAfterKey(false), fUsed(false), fFlushed(false)
+{
+}
+
+void CJSONStream::Separate()
+{
+    fUsed = true;
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            strBuffer += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void CJSONStream::Write(const std::string& str)
+{
+    strBuffer += str;
+    if (strBuffer.size() >= nChunkSize)
+        Flush();
+}
+
+void CJSONStream::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONStream::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Write("]");
+}
+
+void CJSONStream::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONStream::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Write("}");
+}
+
+void CJSONStream::Key(const std::string& key)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    Separate();
+    // Written as a string value, so it is escaped the same way
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStream::Value(const UniValue& value)
+{
+    Separate();
+    Write(value.write());
+}
+
+void CJSONStream::PushKV(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    Value(value);
+}
+
+void CJSONStream::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    fFlushed = true;
+    sink(strBuffer);
+    strBuffer.clear();
+}
+
+std::string CJSONStream::TakeBuffer()
+{
+    std::string ret;
+    ret.swap(strBuffer);
+    return ret;
+}
+
+CJSONResult::CJSONResult(CJSONStream* streamIn, UniValue::VType type) :
+    stream(streamIn), value(type), parent(NULL)
+{
+    assert(type == UniValue::VARR || type == UniValue::VOBJ);
+    if (stream) {
+        if (type == UniValue::VARR)
+            stream->BeginArray();
+        else
+            stream->BeginObject();
+    }
+}
+
+CJSONResult::CJSONResult(CJSONResult& parentIn, const std::string& key, UniValue::VType type) :
+    stream(parentIn.stream), value(type), parent(&parentIn), strKey(key)
+{
+    assert(type == UniValue::VARR || type == UniValue::VOBJ);
+    if (stream) {
+        stream->Key(key);
+        if (type == UniValue::VARR)
+            stream->BeginArray();
+        else
+            stream->BeginObject();
+    }
+}
+
+void CJSONResult::push_back(const UniValue& val)
+{
+    if (stream)
+        stream->Value(val);
+    else
+        value.push_back(val);
+}
+
+void CJSONResult::push_back(UniValue&& val)
+{
+    if (stream)
+        stream->Value(val);
+    else
+        value.push_back(std::move(val));
+}
+
+void CJSONResult::pushKV(const std::string& key, const UniValue& val)
+{
+    if (stream)
+        stream->PushKV(key, val);
+    else
+        value.pushKV(key, val);
+}
+
+UniValue CJSONResult::Finish()
+{
+    if (stream) {
+        if (value.isArray())
+            stream->EndArray();
+        else
+            stream->EndObject();
+        return NullUniValue;
+    }
+    if (parent) {
+        parent->pushKV(strKey, value);
+        return NullUniValue;
+    }
+    return value;
+}
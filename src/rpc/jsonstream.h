@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <univalue.h>
+
+/** Size of the JSON text a CJSONStream collects before passing it on */
+static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * SolarCoin: Writes a JSON value piece by piece, passing the text to a sink in chunks of about
+ * nChunkSize bytes. Large RPC results are written with it straight into a chunked HTTP reply,
+ * instead of building the whole result as a UniValue and then as a string. The caller keeps the
+ * calls balanced; the stream only places the commas and colons.
+ */
+class CJSONStream
+{
+public:
+    typedef std::function<void(const std::string& strChunk)> Sink;
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+    //! For each open array or object, whether it has no element yet
+    std::vector<bool> vEmpty;
+    //! Whether a key was written, so the next value is its value
+    bool fAfterKey;
+    bool fUsed;
+    bool fFlushed;
+
+    //! Write the separator before a new value or key
+    void Separate();
+    void Write(const std::string& str);
+
+public:
+    explicit CJSONStream(const Sink& sinkIn, size_t nChunkSizeIn = JSON_STREAM_CHUNK_SIZE);
+
+    void BeginArray();
+    void EndArray();
+    void BeginObject();
+    void EndObject();
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    void PushKV(const std::string& key, const UniValue& value);
+
+    /** Pass the text written so far to the sink */
+    void Flush();
+    /** Return the text not passed to the sink yet, and forget it */
+    std::string TakeBuffer();
+
+    /** Whether anything was written */
+    bool IsUsed() const { return fUsed; }
+    /** Whether any text was passed to the sink */
+    bool IsFlushed() const { return fFlushed; }
+};
+
+/**
+ * SolarCoin: An array or object result of an RPC, built element by element. With a stream, each
+ * element is written to it as it is added, so the whole result is never held; without one (for
+ * batches and the GUI console) the elements are collected into a UniValue. Finish() closes it and
+ * returns the collected value, or NullUniValue when it was streamed.
+ */
+class CJSONResult
+{
+private:
+    CJSONStream* stream;
+    UniValue value;
+    CJSONResult* parent;
+    std::string strKey;
+
+public:
+    CJSONResult(CJSONStream* streamIn, UniValue::VType type);
+    /** A member of the object parent; parent must not be added to until this is finished */
+    CJSONResult(CJSONResult& parentIn, const std::string& key, UniValue::VType type);
+
+    void push_back(const UniValue& val);
+    void push_back(UniValue&& val);
+    void push_back(const std::pair<std::string, UniValue>& pair) { pushKV(pair.first, pair.second); }
+    void pushKV(const std::string& key, const UniValue& val);
+    UniValue Finish();
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
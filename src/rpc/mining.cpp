@@ -11,6 +11,7 @@
 #include "consensus/params.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "hash.h"
 #include "init.h"
 #include "validation.h"
 #include "miner.h"
@@ -23,6 +24,7 @@
 #include "validationinterface.h"
 #include "primitives/transaction.h"
 
+#include <deque>
 #include <memory>
 #include <stdint.h>
 
@@ -38,50 +40,12 @@ using namespace std;
  * or from the last difficulty change if 'lookup' is nonpositive.
  * If 'height' is nonnegative, compute the estimate at the time when a given block was found.
  */
-UniValue GetNetworkHashPS(int lookup, int height) {
-    CBlockIndex *pb = chainActive.Tip();
-
-    if (height >= 0 && height < chainActive.Height())
-        pb = chainActive[height];
-
-    if (pb == NULL || !pb->nHeight)
-        return 0;
-
-    // If lookup is -1, then use blocks since last difficulty change.
-    if (lookup <= 0) {
-        if (pb->nHeight < Params().GetConsensus().nHeight_Version2)
-        {
-            lookup = pb->nHeight % Params().GetConsensus().DifficultyAdjustmentInterval_V1() + 1;
-        }
-        else
-        {
-            lookup = pb->nHeight % Params().GetConsensus().DifficultyAdjustmentInterval_V2() + 1;
-        }
-    }
-
-    // If lookup is larger than chain, then set it to chain length.
-    if (lookup > pb->nHeight)
-        lookup = pb->nHeight;
-
-    CBlockIndex *pb0 = pb;
-    int64_t minTime = pb0->GetBlockTime();
-    int64_t maxTime = minTime;
-    for (int i = 0; i < lookup; i++) {
-        pb0 = pb0->pprev;
-        int64_t time = pb0->GetBlockTime();
-        minTime = std::min(time, minTime);
-        maxTime = std::max(time, maxTime);
-    }
-
-    // In case there's a situation where minTime == maxTime, we don't want a divide by zero exception.
-    if (minTime == maxTime)
-        return 0;
-
-    arith_uint256 workDiff = pb->nChainWork - pb0->nChainWork;
-    int64_t timeDiff = maxTime - minTime;
-
-    return workDiff.getdouble() / timeDiff;
-}
+/**
+ * SolarCoin: Estimates for other windows and blocks than the one published with the tip, so a
+ * client polling them does not walk the window on every call (protected by cs_main)
+ */
+static std::map<std::pair<uint256, int>, double> mapNetworkHashPS;
+static const size_t MAX_NETWORK_HASHPS_CACHE = 64;
 
 UniValue getnetworkhashps(const JSONRPCRequest& request)
 {
@@ -101,8 +65,33 @@ UniValue getnetworkhashps(const JSONRPCRequest& request)
             + HelpExampleRpc("getnetworkhashps", "")
        );
 
+    int lookup = request.params.size() > 0 ? request.params[0].get_int() : DEFAULT_NETWORK_HASHPS_LOOKUP;
+    int height = request.params.size() > 1 ? request.params[1].get_int() : -1;
+
+    // SolarCoin: The estimate for the tip over the default window is published with the tip
+    if (lookup == DEFAULT_NETWORK_HASHPS_LOOKUP && height < 0) {
+        CChainTipSnapshotRef tip = GetChainTipSnapshot();
+        if (tip)
+            return tip->dNetworkHashPS;
+    }
+
     LOCK(cs_main);
-    return GetNetworkHashPS(request.params.size() > 0 ? request.params[0].get_int() : 120, request.params.size() > 1 ? request.params[1].get_int() : -1);
+    const CBlockIndex* pindex = chainActive.Tip();
+    if (height >= 0 && height < chainActive.Height())
+        pindex = chainActive[height];
+    if (!pindex)
+        return 0;
+
+    // The estimate only depends on the block and its ancestors, so it never goes stale
+    std::pair<uint256, int> key(pindex->GetBlockHash(), lookup);
+    std::map<std::pair<uint256, int>, double>::const_iterator it = mapNetworkHashPS.find(key);
+    if (it != mapNetworkHashPS.end())
+        return it->second;
+    double dHashPS = GetNetworkHashPS(pindex, lookup, Params().GetConsensus());
+    if (mapNetworkHashPS.size() >= MAX_NETWORK_HASHPS_CACHE)
+        mapNetworkHashPS.clear();
+    mapNetworkHashPS.insert(std::make_pair(key, dHashPS));
+    return dHashPS;
 }
 
 UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript)
@@ -237,6 +226,7 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"currentblockweight\": nnn, (numeric) The last block weight\n"
             "  \"currentblocktx\": nnn,     (numeric) The last block transaction\n"
             "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
+            "  \"netstakeweight\": xxx.xxxxx (numeric) The estimated network stake weight, 0 during the initial block download\n"
             "  \"errors\": \"...\"            (string) Current errors\n"
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
@@ -247,17 +237,20 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             + HelpExampleRpc("getmininginfo", "")
         );
 
-
-    LOCK(cs_main);
+    // SolarCoin: The tip fields come from the tip snapshot, so this takes no cs_main
+    CChainTipSnapshotRef tip = GetChainTipSnapshot();
+    if (!tip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No active chain");
 
     UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("blocks",           (int)chainActive.Height()));
+    obj.push_back(Pair("blocks",           tip->nHeight));
     obj.push_back(Pair("currentblocksize", (uint64_t)nLastBlockSize));
     obj.push_back(Pair("currentblockweight", (uint64_t)nLastBlockWeight));
     obj.push_back(Pair("currentblocktx",   (uint64_t)nLastBlockTx));
-    obj.push_back(Pair("difficulty",       (double)GetDifficulty()));
+    obj.push_back(Pair("difficulty",       GetDifficultyFromBits(tip->nBits)));
+    obj.push_back(Pair("netstakeweight",   tip->dNetStakeWeight));
     obj.push_back(Pair("errors",           GetWarnings("statusbar")));
-    obj.push_back(Pair("networkhashps",    getnetworkhashps(request)));
+    obj.push_back(Pair("networkhashps",    tip->dNetworkHashPS));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
     return obj;
@@ -315,6 +308,119 @@ static UniValue BIP22ValidationResult(const CValidationState& state)
     return "valid?";
 }
 
+/**
+ * SolarCoin: The block template getblocktemplate serves, shared by its callers (protected by
+ * cs_main). It is rebuilt when the tip changes, or when the mempool changed and the template is
+ * more than 5 seconds old. nSequence only changes when a rebuild changed the transactions of the
+ * template, which is what a longpoll waits for; the results already built for each set of client
+ * rules are kept until the next rebuild, so polling clients do not encode the template every time.
+ */
+struct CBlockTemplateCache
+{
+    CBlockIndex* pindexPrev;
+    int64_t nStart;
+    unsigned int nTransactionsUpdatedLast;
+    std::shared_ptr<CBlockTemplate> pblocktemplate;
+    bool fSupportsSegwit;
+    int32_t nVersion;                     //!< version of the block before the client rules are applied
+    uint256 hashTransactions;             //!< hash of the txids of the template
+    unsigned int nSequence;
+    //! by client rules and maxversion: the nBits and the result it was built for, without curtime
+    std::map<std::pair<std::set<std::string>, int64_t>, std::pair<uint32_t, UniValue> > mapResults;
+    //! the last templates built on the tip with the hashes of their txids, newest last, for submitblock
+    std::deque<std::pair<uint256, std::shared_ptr<const CBlockTemplate> > > vRecent;
+
+    CBlockTemplateCache() : pindexPrev(nullptr), nStart(0), nTransactionsUpdatedLast(0), fSupportsSegwit(true), nVersion(0), nSequence(0) {}
+};
+static CBlockTemplateCache blockTemplateCache;
+static const size_t MAX_BLOCK_TEMPLATE_RESULTS = 16;
+static const size_t MAX_RECENT_BLOCK_TEMPLATES = 4;
+
+/** SolarCoin: Hash of the txids of a block but its coinbase */
+static uint256 GetBlockTemplateTransactionsHash(const CBlock& block)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase())
+            ss << tx->GetHash();
+    }
+    return ss.GetHash();
+}
+
+/** SolarCoin: Rebuild the template of blockTemplateCache if it is out of date. Returns false if that failed. */
+static bool UpdateBlockTemplateCache(bool fSupportsSegwit)
+{
+    AssertLockHeld(cs_main);
+    CBlockTemplateCache& cache = blockTemplateCache;
+    if (cache.pindexPrev == chainActive.Tip() && cache.fSupportsSegwit == fSupportsSegwit &&
+        (mempool.GetTransactionsUpdated() == cache.nTransactionsUpdatedLast || GetTime() - cache.nStart <= 5))
+        return true;
+
+    // Clear pindexPrev so future calls make a new block, despite any failures from here on
+    cache.pindexPrev = nullptr;
+    cache.mapResults.clear();
+
+    // Store the pindexBest used before CreateNewBlock, to avoid races
+    cache.nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+    CBlockIndex* pindexPrevNew = chainActive.Tip();
+    cache.nStart = GetTime();
+    // Cache whether the last invocation was with segwit support, to avoid returning
+    // a segwit-block to a non-segwit caller.
+    cache.fSupportsSegwit = fSupportsSegwit;
+
+    // Create new block
+    CScript scriptDummy = CScript() << OP_TRUE;
+    cache.pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
+    if (!cache.pblocktemplate)
+        return false;
+    cache.nVersion = cache.pblocktemplate->block.nVersion;
+
+    uint256 hashTransactions = GetBlockTemplateTransactionsHash(cache.pblocktemplate->block);
+    if (hashTransactions != cache.hashTransactions) {
+        cache.hashTransactions = hashTransactions;
+        cache.nSequence++;
+    }
+    if (!cache.vRecent.empty() && cache.vRecent.back().second->block.hashPrevBlock != pindexPrevNew->GetBlockHash())
+        cache.vRecent.clear();
+    if (cache.vRecent.size() >= MAX_RECENT_BLOCK_TEMPLATES)
+        cache.vRecent.pop_front();
+    cache.vRecent.push_back(std::make_pair(hashTransactions, cache.pblocktemplate));
+
+    // Need to update only after we know CreateNewBlock succeeded
+    cache.pindexPrev = pindexPrevNew;
+    return true;
+}
+
+/**
+ * SolarCoin: If the transactions of block but its coinbase are those of a recent template of
+ * getblocktemplate, which passed TestBlockValidity() on the same parent, share them with the
+ * template and mark them checked, so CheckBlock() does not check them again.
+ */
+static bool MatchRecentBlockTemplate(CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    const CBlockTemplateCache& cache = blockTemplateCache;
+    if (cache.vRecent.empty() || block.vtx.empty() || !block.vtx[0]->IsCoinBase())
+        return false;
+    const uint256 hashTransactions = GetBlockTemplateTransactionsHash(block);
+    for (const auto& recent : cache.vRecent) {
+        const CBlock& blockTemplate = recent.second->block;
+        if (recent.first != hashTransactions || blockTemplate.hashPrevBlock != block.hashPrevBlock || blockTemplate.vtx.size() != block.vtx.size())
+            continue;
+        // The same txids with different witnesses are different transactions
+        bool fMatch = true;
+        for (size_t i = 1; i < block.vtx.size() && fMatch; i++)
+            fMatch = block.vtx[i]->GetWitnessHash() == blockTemplate.vtx[i]->GetWitnessHash();
+        if (!fMatch)
+            continue;
+        for (size_t i = 1; i < block.vtx.size(); i++)
+            block.vtx[i] = blockTemplate.vtx[i];
+        block.fTemplateTxsChecked = true;
+        return true;
+    }
+    return false;
+}
+
 std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     const struct BIP9DeploymentInfo& vbinfo = VersionBitsDeploymentInfo[pos];
     std::string s = vbinfo.name;
@@ -480,28 +586,33 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     if (IsInitialBlockDownload())
         throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "SolarCoin is downloading blocks...");
 
-    static unsigned int nTransactionsUpdatedLast;
+    const struct BIP9DeploymentInfo& segwit_info = VersionBitsDeploymentInfo[Consensus::DEPLOYMENT_SEGWIT];
+    // If the caller is indicating segwit support, then allow CreateNewBlock()
+    // to select witness transactions, after segwit activates (otherwise
+    // don't).
+    bool fSupportsSegwit = setClientRules.find(segwit_info.name) != setClientRules.end();
 
+    CBlockTemplateCache& cache = blockTemplateCache;
     if (!lpval.isNull())
     {
         // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
         uint256 hashWatchedChain;
         boost::system_time checktxtime;
-        unsigned int nTransactionsUpdatedLastLP;
+        unsigned int nSequenceLP;
 
         if (lpval.isStr())
         {
-            // Format: <hashBestChain><nTransactionsUpdatedLast>
+            // Format: <hashBestChain><nSequence>
             std::string lpstr = lpval.get_str();
 
             hashWatchedChain.SetHex(lpstr.substr(0, 64));
-            nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+            nSequenceLP = atoi64(lpstr.substr(64));
         }
         else
         {
             // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
             hashWatchedChain = chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            nSequenceLP = cache.nSequence;
         }
 
         // Release the wallet and main lock while waiting
@@ -509,13 +620,22 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         {
             checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
 
-            boost::unique_lock<boost::mutex> lock(csBestBlock);
+            WAIT_LOCK(csBestBlock, lock);
             while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
             {
                 if (!cvBlockChange.timed_wait(lock, checktxtime))
                 {
                     // Timeout: Check transactions for update
-                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
+                    // SolarCoin: only a change of the transactions of the template ends the wait,
+                    // not any change of the mempool
+                    lock.unlock();
+                    bool fChanged;
+                    {
+                        LOCK(cs_main);
+                        fChanged = !UpdateBlockTemplateCache(fSupportsSegwit) || cache.nSequence != nSequenceLP;
+                    }
+                    lock.lock();
+                    if (fChanged)
                         break;
                     checktxtime += boost::posix_time::seconds(10);
                 }
@@ -528,41 +648,11 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         // TODO: Maybe recheck connections/IBD and (if something wrong) send an expires-immediately template to stop miners?
     }
 
-    const struct BIP9DeploymentInfo& segwit_info = VersionBitsDeploymentInfo[Consensus::DEPLOYMENT_SEGWIT];
-    // If the caller is indicating segwit support, then allow CreateNewBlock()
-    // to select witness transactions, after segwit activates (otherwise
-    // don't).
-    bool fSupportsSegwit = setClientRules.find(segwit_info.name) != setClientRules.end();
-
     // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    // Cache whether the last invocation was with segwit support, to avoid returning
-    // a segwit-block to a non-segwit caller.
-    static bool fLastTemplateSupportsSegwit = true;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
-        fLastTemplateSupportsSegwit != fSupportsSegwit)
-    {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = nullptr;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
-        fLastTemplateSupportsSegwit = fSupportsSegwit;
-
-        // Create new block
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
+    if (!UpdateBlockTemplateCache(fSupportsSegwit))
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+    CBlockIndex* pindexPrev = cache.pindexPrev;
+    CBlockTemplate* pblocktemplate = cache.pblocktemplate.get();
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
@@ -570,6 +660,17 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     UpdateTime(pblock, consensusParams, pindexPrev);
     pblock->nNonce = 0;
 
+    // SolarCoin: Only the time changes between the calls with the same rules, unless it changes the target too
+    const std::pair<std::set<std::string>, int64_t> resultKey(setClientRules, nMaxVersionPreVB);
+    auto itResult = cache.mapResults.find(resultKey);
+    if (itResult != cache.mapResults.end() && itResult->second.first == pblock->nBits) {
+        UniValue result = itResult->second.second;
+        result.push_back(Pair("curtime", pblock->GetBlockTime()));
+        return result;
+    }
+    // The version bits below are set for these client rules, not those of the previous caller
+    pblock->nVersion = cache.nVersion;
+
     // NOTE: If at some point we support pre-segwit miners post-segwit-activation, this needs to take segwit support into consideration
     const bool fPreSegWit = (THRESHOLD_ACTIVE != VersionBitsState(pindexPrev, consensusParams, Consensus::DEPLOYMENT_SEGWIT, versionbitscache));
 
@@ -685,7 +786,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     result.push_back(Pair("transactions", transactions));
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue));
-    result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
+    result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(cache.nSequence)));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1));
     result.push_back(Pair("mutable", aMutable));
@@ -702,7 +803,6 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         result.push_back(Pair("sizelimit", (int64_t)MAX_BLOCK_SERIALIZED_SIZE));
         result.push_back(Pair("weightlimit", (int64_t)MAX_BLOCK_WEIGHT));
     }
-    result.push_back(Pair("curtime", pblock->GetBlockTime()));
     result.push_back(Pair("bits", strprintf("%08x", pblock->nBits)));
     result.push_back(Pair("height", (int64_t)(pindexPrev->nHeight+1)));
 
@@ -710,6 +810,10 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         result.push_back(Pair("default_witness_commitment", HexStr(pblocktemplate->vchCoinbaseCommitment.begin(), pblocktemplate->vchCoinbaseCommitment.end())));
     }
 
+    if (cache.mapResults.size() >= MAX_BLOCK_TEMPLATE_RESULTS)
+        cache.mapResults.clear();
+    cache.mapResults[resultKey] = std::make_pair(pblock->nBits, result);
+    result.push_back(Pair("curtime", pblock->GetBlockTime()));
     return result;
 }
 
@@ -783,6 +887,8 @@ UniValue submitblock(const JSONRPCRequest& request)
         if (mi != mapBlockIndex.end()) {
             UpdateUncommittedBlockStructures(block, mi->second, Params().GetConsensus());
         }
+        if (MatchRecentBlockTemplate(block))
+            LogPrint("rpc", "%s: block %s was built from a recent template\n", __func__, hash.ToString());
     }
 
     submitblock_StateCatcher sc(block.GetHash());
@@ -3,21 +3,33 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
 #include "clientversion.h"
+#include "httpserver.h"
 #include "init.h"
+#include "kernel.h"
 #include "validation.h"
 #include "net.h"
+#include "net_processing.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "scheduler.h"
+#include "script/sigcache.h"
+#include "script/standard.h"
 #include "timedata.h"
+#include "txdb.h"
+#include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #ifdef ENABLE_WALLET
+#include "wallet/rpcwallet.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
 
+#include <algorithm>
+#include <set>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -41,6 +53,10 @@ using namespace std;
  **/
 UniValue getinfo(const JSONRPCRequest& request)
 {
+#ifdef ENABLE_WALLET
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+#endif
+
     if (request.fHelp || request.params.size() != 0)
         throw runtime_error(
             "getinfo\n"
@@ -52,6 +68,7 @@ UniValue getinfo(const JSONRPCRequest& request)
             "  \"walletversion\": xxxxx,     (numeric) the wallet version\n"
             "  \"balance\": xxxxxxx,         (numeric) the total bitcoin balance of the wallet\n"
             "  \"blocks\": xxxxxx,           (numeric) the current number of blocks processed in the server\n"
+            "  \"moneysupply\": xxxxxx,      (numeric) the total amount of coins in existence\n"
             "  \"timeoffset\": xxxxx,        (numeric) the time offset\n"
             "  \"connections\": xxxxx,       (numeric) the number of connections\n"
             "  \"proxy\": \"host:port\",     (string, optional) the proxy used by the server\n"
@@ -69,11 +86,10 @@ UniValue getinfo(const JSONRPCRequest& request)
             + HelpExampleRpc("getinfo", "")
         );
 
-#ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
-#else
-    LOCK(cs_main);
-#endif
+    // SolarCoin: The chain fields come from the tip snapshot, so cs_main is only taken for the wallet balance
+    CChainTipSnapshotRef tip = GetChainTipSnapshot();
+    if (!tip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No active chain");
 
     proxyType proxy;
     GetProxy(NET_IPV4, proxy);
@@ -82,25 +98,27 @@ UniValue getinfo(const JSONRPCRequest& request)
     obj.push_back(Pair("version", CLIENT_VERSION));
     obj.push_back(Pair("protocolversion", PROTOCOL_VERSION));
 #ifdef ENABLE_WALLET
-    if (pwalletMain) {
-        obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
-        obj.push_back(Pair("balance",       ValueFromAmount(pwalletMain->GetBalance())));
+    if (pwallet) {
+        obj.push_back(Pair("walletversion", pwallet->GetVersion()));
+        obj.push_back(Pair("balance",       ValueFromAmount(pwallet->GetBalance())));
     }
 #endif
-    obj.push_back(Pair("blocks",        (int)chainActive.Height()));
+    obj.push_back(Pair("blocks",        tip->nHeight));
+    obj.push_back(Pair("moneysupply",   ValueFromAmount(tip->nMoneySupply)));
     obj.push_back(Pair("timeoffset",    GetTimeOffset()));
     if(g_connman)
         obj.push_back(Pair("connections",   (int)g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL)));
     obj.push_back(Pair("proxy",         (proxy.IsValid() ? proxy.proxy.ToStringIPPort() : string())));
-    obj.push_back(Pair("difficulty",    (double)GetDifficulty()));
+    obj.push_back(Pair("difficulty",    GetDifficultyFromBits(tip->nBits)));
     obj.push_back(Pair("testnet",       Params().NetworkIDString() == CBaseChainParams::TESTNET));
 #ifdef ENABLE_WALLET
-    if (pwalletMain) {
-        obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
-        obj.push_back(Pair("keypoolsize",   (int)pwalletMain->GetKeyPoolSize()));
+    if (pwallet) {
+        LOCK(pwallet->cs_wallet);
+        obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
+        obj.push_back(Pair("keypoolsize",   (int)pwallet->GetKeyPoolSize()));
+        if (pwallet->IsCrypted())
+            obj.push_back(Pair("unlocked_until", pwallet->nRelockTime));
     }
-    if (pwalletMain && pwalletMain->IsCrypted())
-        obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
     obj.push_back(Pair("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK())));
 #endif
     obj.push_back(Pair("relayfee",      ValueFromAmount(::minRelayTxFee.GetFeePerK())));
@@ -112,13 +130,17 @@ UniValue getinfo(const JSONRPCRequest& request)
 class DescribeAddressVisitor : public boost::static_visitor<UniValue>
 {
 public:
+    CWallet * const pwallet;
+
+    DescribeAddressVisitor(CWallet *_pwallet) : pwallet(_pwallet) {}
+
     UniValue operator()(const CNoDestination &dest) const { return UniValue(UniValue::VOBJ); }
 
     UniValue operator()(const CKeyID &keyID) const {
         UniValue obj(UniValue::VOBJ);
         CPubKey vchPubKey;
         obj.push_back(Pair("isscript", false));
-        if (pwalletMain && pwalletMain->GetPubKey(keyID, vchPubKey)) {
+        if (pwallet && pwallet->GetPubKey(keyID, vchPubKey)) {
             obj.push_back(Pair("pubkey", HexStr(vchPubKey)));
             obj.push_back(Pair("iscompressed", vchPubKey.IsCompressed()));
         }
@@ -129,7 +151,7 @@ public:
         UniValue obj(UniValue::VOBJ);
         CScript subscript;
         obj.push_back(Pair("isscript", true));
-        if (pwalletMain && pwalletMain->GetCScript(scriptID, subscript)) {
+        if (pwallet && pwallet->GetCScript(scriptID, subscript)) {
             std::vector<CTxDestination> addresses;
             txnouttype whichType;
             int nRequired;
@@ -150,6 +172,10 @@ public:
 
 UniValue validateaddress(const JSONRPCRequest& request)
 {
+#ifdef ENABLE_WALLET
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+#endif
+
     if (request.fHelp || request.params.size() != 1)
         throw runtime_error(
             "validateaddress \"address\"\n"
@@ -177,7 +203,7 @@ UniValue validateaddress(const JSONRPCRequest& request)
         );
 
 #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+    LOCK2(cs_main, pwallet ? &pwallet->cs_wallet : NULL);
 #else
     LOCK(cs_main);
 #endif
@@ -197,16 +223,16 @@ UniValue validateaddress(const JSONRPCRequest& request)
         ret.push_back(Pair("scriptPubKey", HexStr(scriptPubKey.begin(), scriptPubKey.end())));
 
 #ifdef ENABLE_WALLET
-        isminetype mine = pwalletMain ? IsMine(*pwalletMain, dest) : ISMINE_NO;
+        isminetype mine = pwallet ? IsMine(*pwallet, dest) : ISMINE_NO;
         ret.push_back(Pair("ismine", (mine & ISMINE_SPENDABLE) ? true : false));
         ret.push_back(Pair("iswatchonly", (mine & ISMINE_WATCH_ONLY) ? true: false));
-        UniValue detail = boost::apply_visitor(DescribeAddressVisitor(), dest);
+        UniValue detail = boost::apply_visitor(DescribeAddressVisitor(pwallet), dest);
         ret.pushKVs(detail);
-        if (pwalletMain && pwalletMain->mapAddressBook.count(dest))
-            ret.push_back(Pair("account", pwalletMain->mapAddressBook[dest].name));
+        if (pwallet && pwallet->mapAddressBook.count(dest))
+            ret.push_back(Pair("account", pwallet->mapAddressBook[dest].name));
         CKeyID keyID;
-        if (pwalletMain) {
-            const auto& meta = pwalletMain->mapKeyMetadata;
+        if (pwallet) {
+            const auto& meta = pwallet->mapKeyMetadata;
             auto it = address.GetKeyID(keyID) ? meta.find(keyID) : meta.end();
             if (it == meta.end()) {
                 it = meta.find(CScriptID(scriptPubKey));
@@ -227,7 +253,7 @@ UniValue validateaddress(const JSONRPCRequest& request)
 /**
  * Used by addmultisigaddress / createmultisig:
  */
-CScript _createmultisig_redeemScript(const UniValue& params)
+CScript _createmultisig_redeemScript(CWallet * const pwallet, const UniValue& params)
 {
     int nRequired = params[0].get_int();
     const UniValue& keys = params[1].get_array();
@@ -249,14 +275,14 @@ CScript _createmultisig_redeemScript(const UniValue& params)
 #ifdef ENABLE_WALLET
         // Case 1: Bitcoin address and we have full public key:
         CBitcoinAddress address(ks);
-        if (pwalletMain && address.IsValid())
+        if (pwallet && address.IsValid())
         {
             CKeyID keyID;
             if (!address.GetKeyID(keyID))
                 throw runtime_error(
                     strprintf("%s does not refer to a key",ks));
             CPubKey vchPubKey;
-            if (!pwalletMain->GetPubKey(keyID, vchPubKey))
+            if (!pwallet->GetPubKey(keyID, vchPubKey))
                 throw runtime_error(
                     strprintf("no full public key for address %s",ks));
             if (!vchPubKey.IsFullyValid())
@@ -290,6 +316,12 @@ CScript _createmultisig_redeemScript(const UniValue& params)
 
 UniValue createmultisig(const JSONRPCRequest& request)
 {
+#ifdef ENABLE_WALLET
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+#else
+    CWallet * const pwallet = NULL;
+#endif
+
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 2)
     {
         string msg = "createmultisig nrequired [\"key\",...]\n"
@@ -320,7 +352,7 @@ UniValue createmultisig(const JSONRPCRequest& request)
     }
 
     // Construct using pay-to-script-hash:
-    CScript inner = _createmultisig_redeemScript(request.params);
+    CScript inner = _createmultisig_redeemScript(pwallet, request.params);
     CScriptID innerID(inner);
     CBitcoinAddress address(innerID);
 
@@ -467,15 +499,62 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCMemoryUsage()
+{
+    UniValue usage(UniValue::VOBJ);
+    uint64_t nTotal = 0;
+    auto push = [&](UniValue& obj, const std::string& strName, size_t nBytes) {
+        obj.push_back(Pair(strName, (uint64_t)nBytes));
+        nTotal += nBytes;
+    };
+    {
+        LOCK(cs_main);
+        push(usage, "blockindex", GetBlockIndexMemoryUsage());
+        push(usage, "stakeseen", setStakeSeen.DynamicMemoryUsage());
+        push(usage, "stakeindex", GetStakeIndexMemoryUsage());
+        push(usage, "coinscache", pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0);
+        UniValue leveldb(UniValue::VOBJ);
+        push(leveldb, "chainstate", pcoinsdbview ? pcoinsdbview->GetDB().DynamicMemoryUsage() : 0);
+        push(leveldb, "blockindex", pblocktree ? pblocktree->DynamicMemoryUsage() : 0);
+        usage.push_back(Pair("leveldb", leveldb));
+    }
+    push(usage, "mempool", mempool.DynamicMemoryUsage());
+    push(usage, "orphans", GetOrphanTxMemoryUsage());
+    push(usage, "sigcache", GetSignatureCacheStats().nElements * sizeof(uint256));
+    push(usage, "scriptexeccache", GetScriptExecutionCacheStats().nElements * sizeof(uint256));
+    if (g_connman) {
+        size_t nRecvBytes, nSendBytes, nInventoryBytes;
+        g_connman->GetNodeMemoryUsage(nRecvBytes, nSendBytes, nInventoryBytes);
+        UniValue peers(UniValue::VOBJ);
+        push(peers, "recv", nRecvBytes);
+        push(peers, "send", nSendBytes);
+        push(peers, "inventory", nInventoryBytes);
+        usage.push_back(Pair("peers", peers));
+        push(usage, "addrman", g_connman->GetAddrManMemoryUsage());
+    }
+#ifdef ENABLE_WALLET
+    size_t nWalletBytes = 0;
+    for (const CWallet* pwallet : vpwallets)
+        nWalletBytes += pwallet->DynamicMemoryUsage();
+    push(usage, "wallet", nWalletBytes);
+#endif
+    usage.push_back(Pair("total", nTotal));
+    return usage;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
      * as users will undoubtedly confuse it with the other "memory pool"
      */
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw runtime_error(
-            "getmemoryinfo\n"
+            "getmemoryinfo ( \"mode\" )\n"
             "Returns an object containing information about memory usage.\n"
+            "\nArguments:\n"
+            "1. \"mode\"    (string, optional, default=\"stats\") \"stats\" for the locked memory only,\n"
+            "               \"detailed\" to add the bytes used by each subsystem. Computing these walks\n"
+            "               the wallet transactions and the peers, so it takes longer.\n"
             "\nResult:\n"
             "{\n"
             "  \"locked\": {               (json object) Information about locked memory manager\n"
@@ -485,17 +564,433 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"usage\": {                (json object) Only in \"detailed\" mode, the estimated bytes used by each subsystem\n"
+            "    \"blockindex\": xxxxx,    (numeric) The block index entries and mapBlockIndex\n"
+            "    \"stakeseen\": xxxxx,     (numeric) The set of stakes seen in blocks\n"
+            "    \"stakeindex\": xxxxx,    (numeric) The stake modifier lookup index and the stake prevout cache\n"
+            "    \"coinscache\": xxxxx,    (numeric) The UTXO cache\n"
+            "    \"leveldb\": {            (json object) The memtables and block caches of the databases\n"
+            "      \"chainstate\": xxxxx,  (numeric) The chainstate database\n"
+            "      \"blockindex\": xxxxx,  (numeric) The block index database\n"
+            "    },\n"
+            "    \"mempool\": xxxxx,       (numeric) The memory pool\n"
+            "    \"orphans\": xxxxx,       (numeric) The orphan transactions\n"
+            "    \"sigcache\": xxxxx,      (numeric) The signature cache\n"
+            "    \"scriptexeccache\": xxx, (numeric) The script execution cache\n"
+            "    \"peers\": {              (json object) The buffers of all peers\n"
+            "      \"recv\": xxxxx,        (numeric) Received messages, partial or waiting to be processed\n"
+            "      \"send\": xxxxx,        (numeric) Messages waiting to be sent\n"
+            "      \"inventory\": xxxxx,   (numeric) The filters of inventory known to the peers\n"
+            "    },\n"
+            "    \"addrman\": xxxxx,       (numeric) The address manager\n"
+            "    \"wallet\": xxxxx,        (numeric) The transactions and spends of the loaded wallets\n"
+            "    \"total\": xxxxx,         (numeric) The sum of the above\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmemoryinfo", "")
-            + HelpExampleRpc("getmemoryinfo", "")
+            + HelpExampleCli("getmemoryinfo", "\"detailed\"")
+            + HelpExampleRpc("getmemoryinfo", "\"detailed\"")
         );
+    std::string strMode = request.params.size() > 0 ? request.params[0].get_str() : "stats";
+    if (strMode != "stats" && strMode != "detailed")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown mode " + strMode);
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+    if (strMode == "detailed")
+        obj.push_back(Pair("usage", RPCMemoryUsage()));
     return obj;
 }
 
+UniValue getrpcinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "Returns an object containing information about the work queues of the RPC server.\n"
+            "Short read-only calls are served by the \"fast\" queue, all others by the \"general\" queue.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queues\": [              (json array) The work queues\n"
+            "    {\n"
+            "      \"name\": \"xxxx\",          (string) The name of the queue\n"
+            "      \"threads\": n,            (numeric) Number of worker threads\n"
+            "      \"depth\": n,              (numeric) Number of requests waiting\n"
+            "      \"maxdepth\": n,           (numeric) Number of requests that can wait before new ones are rejected\n"
+            "      \"peakdepth\": n,          (numeric) Largest number of requests that waited at once\n"
+            "      \"processed\": n,          (numeric) Number of requests served\n"
+            "      \"rejected\": n,           (numeric) Number of requests rejected because the queue was full\n"
+            "      \"avgwait\": n,            (numeric) Average time in microseconds the served requests waited\n"
+            "      \"maxwait\": n,            (numeric) Longest time in microseconds a served request waited\n"
+            "      \"avgrun\": n,             (numeric) Average time in microseconds the served requests took\n"
+            "      \"maxrun\": n              (numeric) Longest time in microseconds a served request took\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
+    UniValue queues(UniValue::VARR);
+    for (const HTTPWorkQueueStats& stats : GetHTTPWorkQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.name));
+        obj.push_back(Pair("threads", stats.nThreads));
+        obj.push_back(Pair("depth", (uint64_t)stats.nDepth));
+        obj.push_back(Pair("maxdepth", (uint64_t)stats.nMaxDepth));
+        obj.push_back(Pair("peakdepth", (uint64_t)stats.nPeakDepth));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        obj.push_back(Pair("avgwait", stats.nProcessed ? stats.nWaitMicros / (int64_t)stats.nProcessed : 0));
+        obj.push_back(Pair("maxwait", stats.nMaxWaitMicros));
+        obj.push_back(Pair("avgrun", stats.nProcessed ? stats.nRunMicros / (int64_t)stats.nProcessed : 0));
+        obj.push_back(Pair("maxrun", stats.nMaxRunMicros));
+        queues.push_back(obj);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("queues", queues));
+    return ret;
+}
+
+UniValue getschedulerinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getschedulerinfo\n"
+            "Returns an object containing information about the task queues sharing the scheduler threads.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queues\": [              (json array) The task queues\n"
+            "    {\n"
+            "      \"name\": \"xxxx\",          (string) The name of the queue\n"
+            "      \"maxconcurrent\": n,      (numeric) Number of its tasks that can run at once, 0 for no limit\n"
+            "      \"priority\": n,           (numeric) Due tasks of queues with a higher priority run first\n"
+            "      \"queued\": n,             (numeric) Number of tasks waiting, due or not\n"
+            "      \"running\": n,            (numeric) Number of tasks running\n"
+            "      \"processed\": n,          (numeric) Number of tasks started\n"
+            "      \"avgwait\": n,            (numeric) Average time in microseconds the started tasks waited past their due time\n"
+            "      \"maxwait\": n,            (numeric) Longest time in microseconds a started task waited past its due time\n"
+            "      \"avgrun\": n              (numeric) Average time in microseconds the finished tasks took\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getschedulerinfo", "")
+            + HelpExampleRpc("getschedulerinfo", "")
+        );
+    if (!g_scheduler)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Scheduler not running");
+    UniValue queues(UniValue::VARR);
+    for (const CScheduler::QueueStats& stats : g_scheduler->getQueueStats()) {
+        uint64_t nFinished = stats.nRun - stats.nRunning;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.strName));
+        obj.push_back(Pair("maxconcurrent", stats.nMaxConcurrent));
+        obj.push_back(Pair("priority", stats.nPriority));
+        obj.push_back(Pair("queued", (uint64_t)stats.nQueued));
+        obj.push_back(Pair("running", stats.nRunning));
+        obj.push_back(Pair("processed", stats.nRun));
+        obj.push_back(Pair("avgwait", stats.nRun ? stats.nWaitMicros / (int64_t)stats.nRun : 0));
+        obj.push_back(Pair("maxwait", stats.nMaxWaitMicros));
+        obj.push_back(Pair("avgrun", nFinished ? stats.nRunMicros / (int64_t)nFinished : 0));
+        queues.push_back(obj);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("queues", queues));
+    return ret;
+}
+
+/** SolarCoin: The addresses of an address index query: one address, or an object with an array of them */
+static std::vector<std::pair<uint8_t, uint160> > ParseAddressIndexQuery(const UniValue& query)
+{
+    std::vector<UniValue> vValues;
+    if (query.isStr()) {
+        vValues.push_back(query);
+    } else if (query.isObject()) {
+        const UniValue& addresses = find_value(query.get_obj(), "addresses");
+        if (!addresses.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses are expected to be an array");
+        vValues = addresses.getValues();
+    } else {
+        throw JSONRPCError(RPC_TYPE_ERROR, "Expected an address or an object with addresses");
+    }
+
+    std::vector<std::pair<uint8_t, uint160> > vAddresses;
+    for (const UniValue& value : vValues) {
+        CBitcoinAddress address(value.get_str());
+        uint160 hashBytes;
+        uint8_t nType = address.IsValid() ? ScriptToAddressIndex(GetScriptForDestination(address.Get()), hashBytes) : (uint8_t)ADDRESS_TYPE_NONE;
+        if (nType == ADDRESS_TYPE_NONE)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + value.get_str());
+        if (std::find(vAddresses.begin(), vAddresses.end(), std::make_pair(nType, hashBytes)) == vAddresses.end())
+            vAddresses.push_back(std::make_pair(nType, hashBytes));
+    }
+    return vAddresses;
+}
+
+/** The optional "start" and "end" heights of an address index query, -1 for no end */
+static void ParseAddressIndexRange(const UniValue& query, int& nStart, int& nEnd)
+{
+    nStart = 0;
+    nEnd = -1;
+    if (!query.isObject())
+        return;
+    const UniValue& start = find_value(query.get_obj(), "start");
+    const UniValue& end = find_value(query.get_obj(), "end");
+    if (!start.isNull())
+        nStart = start.get_int();
+    if (!end.isNull())
+        nEnd = end.get_int();
+    if (nStart < 0 || (!end.isNull() && nEnd < nStart))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+}
+
+/** The optional "skip" and "count" of an address index query, -1 for all */
+static void ParseAddressIndexPage(const UniValue& query, int& nSkip, int& nCount)
+{
+    nSkip = 0;
+    nCount = -1;
+    if (!query.isObject())
+        return;
+    const UniValue& skip = find_value(query.get_obj(), "skip");
+    const UniValue& count = find_value(query.get_obj(), "count");
+    if (!skip.isNull())
+        nSkip = skip.get_int();
+    if (!count.isNull())
+        nCount = count.get_int();
+    if (nSkip < 0 || (!count.isNull() && nCount < 0))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid skip or count");
+}
+
+static std::string AddressIndexToString(uint8_t nType, const uint160& hashBytes)
+{
+    if (nType == ADDRESS_TYPE_PUBKEYHASH)
+        return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+    if (nType == ADDRESS_TYPE_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return "";
+}
+
+static void EnsureAddressIndex()
+{
+    if (!paddressindex || !paddressindex->IsAddressIndexEnabled())
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled (see -addressindex)");
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"address\"|{\"addresses\":[\"address\",...],\"start\":n,\"end\":n,\"skip\":n,\"count\":n}\n"
+            "\nReturns the txids of the transactions paying to or spending from the addresses, in block order. Needs -addressindex.\n"
+            "\nArguments:\n"
+            "1. query               (string or json object, required) An address, or an object with\n"
+            "     \"addresses\"       (json array of strings, required) The addresses\n"
+            "     \"start\"           (numeric, optional) The first block height (default: 0)\n"
+            "     \"end\"             (numeric, optional) The last block height (default: the tip)\n"
+            "     \"skip\"            (numeric, optional) Number of txids to leave out from the start (default: 0)\n"
+            "     \"count\"           (numeric, optional) Number of txids to return at most (default: all)\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"txid\"              (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"], \"start\": 1000, \"count\": 50}'")
+            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"], \"start\": 1000, \"count\": 50}")
+        );
+
+    EnsureAddressIndex();
+    std::vector<std::pair<uint8_t, uint160> > vAddresses = ParseAddressIndexQuery(request.params[0]);
+    int nStart, nEnd, nSkip, nCount;
+    ParseAddressIndexRange(request.params[0], nStart, nEnd);
+    ParseAddressIndexPage(request.params[0], nSkip, nCount);
+
+    // No address contributes more than the transactions of the page and those skipped before it
+    const size_t nMaxTxs = nCount < 0 ? 0 : (size_t)nSkip + nCount;
+    std::set<std::pair<int, uint256> > setTxids;
+    for (const auto& address : vAddresses) {
+        if (nCount == 0)
+            break;
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+        if (!paddressindex->GetAddressDeltas(address.first, address.second, nStart, nEnd, vDeltas, nMaxTxs))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Error reading the address index");
+        for (const auto& delta : vDeltas)
+            setTxids.insert(std::make_pair(delta.first.nHeight, delta.first.txid));
+    }
+
+    UniValue result(UniValue::VARR);
+    int n = 0;
+    for (const auto& txid : setTxids) {
+        if (n++ < nSkip)
+            continue;
+        if (nCount >= 0 && (int)result.size() >= nCount)
+            break;
+        result.push_back(txid.second.GetHex());
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"|{\"addresses\":[\"address\",...],\"start\":n,\"end\":n}\n"
+            "\nReturns the balance of the addresses, and the amount they received. Needs -addressindex.\n"
+            "\nArguments:\n"
+            "1. query               (string or json object, required) An address, or an object with\n"
+            "     \"addresses\"       (json array of strings, required) The addresses\n"
+            "     \"start\"           (numeric, optional) The first block height (default: 0)\n"
+            "     \"end\"             (numeric, optional) The last block height (default: the tip)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,    (numeric) The balance in " + CURRENCY_UNIT + ", or its change over the blocks given\n"
+            "  \"received\": x.xxx    (numeric) The amount received in " + CURRENCY_UNIT + ", including change\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}")
+        );
+
+    EnsureAddressIndex();
+    std::vector<std::pair<uint8_t, uint160> > vAddresses = ParseAddressIndexQuery(request.params[0]);
+    int nStart, nEnd;
+    ParseAddressIndexRange(request.params[0], nStart, nEnd);
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const auto& address : vAddresses) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+        if (!paddressindex->GetAddressDeltas(address.first, address.second, nStart, nEnd, vDeltas))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Error reading the address index");
+        for (const auto& delta : vDeltas) {
+            nBalance += delta.second;
+            if (delta.second > 0)
+                nReceived += delta.second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    return result;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\"|{\"addresses\":[\"address\",...],\"start\":n,\"end\":n,\"skip\":n,\"count\":n}\n"
+            "\nReturns the unspent outputs paying to the addresses, oldest first. Needs -addressindex.\n"
+            "\nArguments:\n"
+            "1. query               (string or json object, required) An address, or an object with\n"
+            "     \"addresses\"       (json array of strings, required) The addresses\n"
+            "     \"start\"           (numeric, optional) The first block height of the outputs (default: 0)\n"
+            "     \"end\"             (numeric, optional) The last block height of the outputs (default: the tip)\n"
+            "     \"skip\"            (numeric, optional) Number of outputs to leave out from the start (default: 0)\n"
+            "     \"count\"           (numeric, optional) Number of outputs to return at most (default: all)\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address\n"
+            "    \"txid\": \"txid\",        (string) The transaction id\n"
+            "    \"outputIndex\": n,      (numeric) The output number\n"
+            "    \"script\": \"hex\",       (string) The output script\n"
+            "    \"amount\": x.xxx,       (numeric) The amount in " + CURRENCY_UNIT + "\n"
+            "    \"height\": n            (numeric) The height of the block of the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"], \"count\": 100}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"], \"count\": 100}")
+        );
+
+    EnsureAddressIndex();
+    std::vector<std::pair<uint8_t, uint160> > vAddresses = ParseAddressIndexQuery(request.params[0]);
+    int nStart, nEnd, nSkip, nCount;
+    ParseAddressIndexRange(request.params[0], nStart, nEnd);
+    ParseAddressIndexPage(request.params[0], nSkip, nCount);
+
+    // No address contributes more than the outputs of the page and those skipped before it
+    const size_t nMax = nCount < 0 ? 0 : (size_t)nSkip + nCount;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (const auto& address : vAddresses) {
+        if (nCount == 0)
+            break;
+        if (!paddressindex->GetAddressUnspent(address.first, address.second, vUnspent, nStart, nEnd, nMax))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Error reading the address index");
+    }
+    std::sort(vUnspent.begin(), vUnspent.end(), [](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+        if (a.second.nHeight != b.second.nHeight)
+            return a.second.nHeight < b.second.nHeight;
+        return a.first.outpoint < b.first.outpoint;
+    });
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = nSkip; i < vUnspent.size() && (nCount < 0 || (int)result.size() < nCount); i++) {
+        const CAddressUnspentKey& key = vUnspent[i].first;
+        const CAddressUnspentValue& value = vUnspent[i].second;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", AddressIndexToString(key.nType, key.hashBytes)));
+        entry.push_back(Pair("txid", key.outpoint.hash.GetHex()));
+        entry.push_back(Pair("outputIndex", (int64_t)key.outpoint.n));
+        entry.push_back(Pair("script", HexStr(value.script.begin(), value.script.end())));
+        entry.push_back(Pair("amount", ValueFromAmount(value.nValue)));
+        entry.push_back(Pair("height", value.nHeight));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1 || !request.params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\":\"txid\",\"index\":n}\n"
+            "\nReturns the transaction input that spent an output. Needs -spentindex.\n"
+            "\nArguments:\n"
+            "1. query               (json object, required) The output\n"
+            "     \"txid\"            (string, required) The transaction id\n"
+            "     \"index\"           (numeric, required) The output number\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"txid\",      (string) The id of the spending transaction\n"
+            "  \"index\": n,          (numeric) The number of the spending input\n"
+            "  \"height\": n,         (numeric) The height of the block of the spending transaction\n"
+            "  \"amount\": x.xxx,     (numeric) The amount of the output in " + CURRENCY_UNIT + "\n"
+            "  \"address\": \"address\" (string, optional) The address the output paid to\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
+        );
+
+    if (!paddressindex || !paddressindex->IsSpentIndexEnabled())
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled (see -spentindex)");
+    const UniValue& query = request.params[0].get_obj();
+    uint256 txid = ParseHashV(find_value(query, "txid"), "txid");
+    const UniValue& index = find_value(query, "index");
+    if (!index.isNum() || index.get_int() < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+
+    CSpentIndexValue value;
+    if (!paddressindex->GetSpentInfo(COutPoint(txid, index.get_int()), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int64_t)value.nInputIndex));
+    result.push_back(Pair("height", value.nHeight));
+    result.push_back(Pair("amount", ValueFromAmount(value.nValue)));
+    if (value.nType != ADDRESS_TYPE_NONE)
+        result.push_back(Pair("address", AddressIndexToString(value.nType, value.hashBytes)));
+    return result;
+}
+
 UniValue echo(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -513,12 +1008,19 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getinfo",                &getinfo,                true,  {} }, /* uses wallet if enabled */
-    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  {} },
-    { "util",               "validateaddress",        &validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  {"mode"} },
+    { "control",            "getrpcinfo",             &getrpcinfo,             true,  {} },
+    { "control",            "getschedulerinfo",       &getschedulerinfo,       true,  {} },
+    { "util",               "validateaddress",        &validateaddress,        true,  {"address"}, true }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         true,  {"nrequired","keys"} },
     { "util",               "verifymessage",          &verifymessage,          true,  {"address","signature","message"} },
     { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true,  {"privkey","message"} },
 
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        true,  {"query"}, true },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      true,  {"query"}, true },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        true,  {"query"}, true },
+    { "addressindex",       "getspentinfo",           &getspentinfo,           true,  {"query"}, true },
+
     /* Not shown in help */
     { "hidden",             "setmocktime",            &setmocktime,            true,  {"timestamp"}},
     { "hidden",             "echo",                   &echo,                   true,  {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
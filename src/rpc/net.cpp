@@ -14,6 +14,7 @@
 #include "protocol.h"
 #include "sync.h"
 #include "timedata.h"
+#include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -67,6 +68,24 @@ UniValue ping(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+/** SolarCoin: The processing time histogram of one message type, or null if it was never processed */
+static UniValue ProcessTimeToJSON(const CNetMsgTypeStats& stats)
+{
+    uint64_t nCount = 0;
+    UniValue buckets(UniValue::VARR);
+    for (int n = 0; n < NET_PROCESSING_TIME_BUCKETS; n++) {
+        nCount += stats.vProcessTimeBuckets[n];
+        buckets.push_back(stats.vProcessTimeBuckets[n]);
+    }
+    if (nCount == 0)
+        return NullUniValue;
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", nCount));
+    obj.push_back(Pair("total_us", stats.nProcessTime));
+    obj.push_back(Pair("histogram", buckets));
+    return obj;
+}
+
 UniValue getpeerinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -94,6 +113,7 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"subver\": \"/Satoshi:0.8.5/\",  (string) The string version\n"
             "    \"inbound\": true|false,     (boolean) Inbound (true) or Outbound (false)\n"
             "    \"addnode\": true|false,     (boolean) Whether connection was due to addnode and is using an addnode slot\n"
+            "    \"blockrelayonly\": true|false, (boolean) Whether the connection relays blocks only, not transactions or addresses\n"
             "    \"startingheight\": n,       (numeric) The starting height (block) of the peer\n"
             "    \"banscore\": n,             (numeric) The ban score\n"
             "    \"synced_headers\": n,       (numeric) The last header we have in common with this peer\n"
@@ -102,6 +122,11 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"inflight_limit\": n,       (numeric) The blocks that may be in flight from this peer, adapted to its throughput\n"
+            "    \"blocks_downloaded\": n,    (numeric) The requested blocks this peer delivered\n"
+            "    \"block_interval_ms\": n,    (numeric) Average time between those blocks while some were in flight\n"
+            "    \"block_latency_ms\": n,     (numeric) Average time from request to arrival of those blocks\n"
+            "    \"block_stalls\": n,         (numeric) Recent times this peer held back the download window and a faster peer was asked\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"					
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -110,7 +135,19 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
-            "    }\n"
+            "    },\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"addr\": {               (json object) The time spent processing messages of this type\n"
+            "         \"count\": n,           (numeric) The number of messages processed\n"
+            "         \"total_us\": n,        (numeric) The total processing time in microseconds\n"
+            "         \"histogram\": [n,...]  (array) The number of messages that took under 10us, 100us, 1ms, 10ms, 100ms, 1s, and longer\n"
+            "       },\n"
+            "       ...\n"
+            "    },\n"
+            "    \"sendqueue_msgs\": n,       (numeric) The number of messages waiting to be sent\n"
+            "    \"sendqueue_bytes\": n,      (numeric) The size of the messages waiting to be sent\n"
+            "    \"processqueue_msgs\": n,    (numeric) The number of received messages waiting to be processed\n"
+            "    \"processqueue_bytes\": n    (numeric) The size of the received messages waiting to be processed\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -156,6 +193,7 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         obj.push_back(Pair("subver", stats.cleanSubVer));
         obj.push_back(Pair("inbound", stats.fInbound));
         obj.push_back(Pair("addnode", stats.fAddnode));
+        obj.push_back(Pair("blockrelayonly", stats.fBlockRelayOnly));
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         if (fStateStats) {
             obj.push_back(Pair("banscore", statestats.nMisbehavior));
@@ -166,22 +204,35 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflight_limit", statestats.nBlocksInTransitLimit));
+            obj.push_back(Pair("blocks_downloaded", statestats.nBlocksDownloaded));
+            obj.push_back(Pair("block_interval_ms", statestats.nBlockInterval / 1000));
+            obj.push_back(Pair("block_latency_ms", statestats.nBlockLatency / 1000));
+            obj.push_back(Pair("block_stalls", statestats.nBlockStalls));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
-        BOOST_FOREACH(const mapMsgCmdSize::value_type &i, stats.mapSendBytesPerMsgCmd) {
-            if (i.second > 0)
-                sendPerMsgCmd.push_back(Pair(i.first, i.second));
-        }
-        obj.push_back(Pair("bytessent_per_msg", sendPerMsgCmd));
-
         UniValue recvPerMsgCmd(UniValue::VOBJ);
-        BOOST_FOREACH(const mapMsgCmdSize::value_type &i, stats.mapRecvBytesPerMsgCmd) {
-            if (i.second > 0)
-                recvPerMsgCmd.push_back(Pair(i.first, i.second));
+        UniValue timePerMsgCmd(UniValue::VOBJ);
+        for (size_t i = 0; i < stats.vMsgTypeStats.size(); i++) {
+            const CNetMsgTypeStats& typeStats = stats.vMsgTypeStats[i];
+            const std::string& strType = GetNetMessageTypeName(i);
+            if (typeStats.nSendBytes > 0)
+                sendPerMsgCmd.push_back(Pair(strType, typeStats.nSendBytes));
+            if (typeStats.nRecvBytes > 0)
+                recvPerMsgCmd.push_back(Pair(strType, typeStats.nRecvBytes));
+            UniValue processTime = ProcessTimeToJSON(typeStats);
+            if (!processTime.isNull())
+                timePerMsgCmd.push_back(Pair(strType, processTime));
         }
+        obj.push_back(Pair("bytessent_per_msg", sendPerMsgCmd));
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
+        obj.push_back(Pair("processtime_per_msg", timePerMsgCmd));
+        obj.push_back(Pair("sendqueue_msgs", (uint64_t)stats.nSendQueueMsgs));
+        obj.push_back(Pair("sendqueue_bytes", (uint64_t)stats.nSendQueueBytes));
+        obj.push_back(Pair("processqueue_msgs", (uint64_t)stats.nProcessQueueMsgs));
+        obj.push_back(Pair("processqueue_bytes", (uint64_t)stats.nProcessQueueBytes));
 
         ret.push_back(obj);
     }
@@ -370,6 +421,78 @@ UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getnetstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw runtime_error(
+            "getnetstats\n"
+            "\nReturns the network traffic and message processing time per message type, of all peers\n"
+            "since startup, and the current depth of the peer message queues.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"msgtypes\": {\n"
+            "    \"addr\": {                 (json object) The statistics of one message type\n"
+            "      \"msgssent\": n,          (numeric) The number of messages sent\n"
+            "      \"bytessent\": n,         (numeric) The total bytes sent\n"
+            "      \"msgsrecv\": n,          (numeric) The number of messages received\n"
+            "      \"bytesrecv\": n,         (numeric) The total bytes received\n"
+            "      \"processtime\": {        (json object) The time spent processing messages, if any were\n"
+            "        \"count\": n,           (numeric) The number of messages processed\n"
+            "        \"total_us\": n,        (numeric) The total processing time in microseconds\n"
+            "        \"histogram\": [n,...]  (array) The number of messages that took under 10us, 100us, 1ms, 10ms, 100ms, 1s, and longer\n"
+            "      }\n"
+            "    },\n"
+            "    ...\n"
+            "  },\n"
+            "  \"sendqueue_msgs\": n,        (numeric) The number of messages waiting to be sent to all peers\n"
+            "  \"sendqueue_bytes\": n,       (numeric) The size of the messages waiting to be sent to all peers\n"
+            "  \"processqueue_msgs\": n,     (numeric) The number of received messages waiting to be processed\n"
+            "  \"processqueue_bytes\": n     (numeric) The size of the received messages waiting to be processed\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetstats", "")
+            + HelpExampleRpc("getnetstats", "")
+       );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    std::vector<CNetMsgTypeStats> vMsgTypeStats;
+    g_connman->GetMsgTypeStats(vMsgTypeStats);
+    UniValue msgTypes(UniValue::VOBJ);
+    for (size_t i = 0; i < vMsgTypeStats.size(); i++) {
+        const CNetMsgTypeStats& typeStats = vMsgTypeStats[i];
+        if (typeStats.nSendMsgs == 0 && typeStats.nRecvMsgs == 0)
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("msgssent", typeStats.nSendMsgs));
+        obj.push_back(Pair("bytessent", typeStats.nSendBytes));
+        obj.push_back(Pair("msgsrecv", typeStats.nRecvMsgs));
+        obj.push_back(Pair("bytesrecv", typeStats.nRecvBytes));
+        UniValue processTime = ProcessTimeToJSON(typeStats);
+        if (!processTime.isNull())
+            obj.push_back(Pair("processtime", processTime));
+        msgTypes.push_back(Pair(GetNetMessageTypeName(i), obj));
+    }
+
+    vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+    uint64_t nSendQueueMsgs = 0, nSendQueueBytes = 0, nProcessQueueMsgs = 0, nProcessQueueBytes = 0;
+    BOOST_FOREACH(const CNodeStats& stats, vstats) {
+        nSendQueueMsgs += stats.nSendQueueMsgs;
+        nSendQueueBytes += stats.nSendQueueBytes;
+        nProcessQueueMsgs += stats.nProcessQueueMsgs;
+        nProcessQueueBytes += stats.nProcessQueueBytes;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("msgtypes", msgTypes));
+    ret.push_back(Pair("sendqueue_msgs", nSendQueueMsgs));
+    ret.push_back(Pair("sendqueue_bytes", nSendQueueBytes));
+    ret.push_back(Pair("processqueue_msgs", nProcessQueueMsgs));
+    ret.push_back(Pair("processqueue_bytes", nProcessQueueBytes));
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -427,6 +550,13 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
             "  }\n"
             "  ,...\n"
             "  ]\n"
+            "  \"torcontrol\": {                       (object, only with -listenonion) the onion service setup\n"
+            "    \"authenticated\": true|false,        (boolean) whether the Tor control port is connected and authenticated\n"
+            "    \"service\": \"xxxx\",                 (string) the onion service advertised, empty if none\n"
+            "    \"lastsetupms\": n,                    (numeric) milliseconds from connecting to the control port to advertising the service, -1 if never\n"
+            "    \"lastoutagems\": n,                   (numeric) milliseconds the service was last unavailable after a disconnect, -1 if never\n"
+            "    \"reconnects\": n                      (numeric) number of reconnections to the control port\n"
+            "  },\n"
             "  \"warnings\": \"...\"                    (string) any network warnings\n"
             "}\n"
             "\nExamples:\n"
@@ -463,6 +593,16 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
         }
     }
     obj.push_back(Pair("localaddresses", localAddresses));
+    TorControlStats torStats;
+    if (GetTorControlStats(torStats)) {
+        UniValue torControl(UniValue::VOBJ);
+        torControl.push_back(Pair("authenticated", torStats.fAuthenticated));
+        torControl.push_back(Pair("service", torStats.strService));
+        torControl.push_back(Pair("lastsetupms", torStats.nLastSetupMillis));
+        torControl.push_back(Pair("lastoutagems", torStats.nLastOutageMillis));
+        torControl.push_back(Pair("reconnects", torStats.nReconnects));
+        obj.push_back(Pair("torcontrol", torControl));
+    }
     obj.push_back(Pair("warnings",       GetWarnings("statusbar")));
     return obj;
 }
@@ -612,6 +752,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         true,  {"address"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  {"node"} },
     { "network",            "getnettotals",           &getnettotals,           true,  {} },
+    { "network",            "getnetstats",            &getnetstats,            true,  {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  {} },
     { "network",            "setban",                 &setban,                 true,  {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             true,  {} },
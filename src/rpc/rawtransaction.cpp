@@ -20,14 +20,17 @@
 #include "script/script_error.h"
 #include "script/sign.h"
 #include "script/standard.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
 #ifdef ENABLE_WALLET
+#include "wallet/rpcwallet.h"
 #include "wallet/wallet.h"
 #endif
 
 #include <stdint.h>
+#include <future>
 
 #include <boost/assign/list_of.hpp>
 
@@ -41,84 +44,93 @@ void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fInclud
     vector<CTxDestination> addresses;
     int nRequired;
 
-    out.push_back(Pair("asm", ScriptToAsmStr(scriptPubKey)));
+    out.reserve(5);
+    out.pushKVEnd("asm", ScriptToAsmStr(scriptPubKey));
     if (fIncludeHex)
-        out.push_back(Pair("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end())));
+        out.pushKVEnd("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end()));
 
     if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired)) {
-        out.push_back(Pair("type", GetTxnOutputType(type)));
+        out.pushKVEnd("type", GetTxnOutputType(type));
         return;
     }
 
-    out.push_back(Pair("reqSigs", nRequired));
-    out.push_back(Pair("type", GetTxnOutputType(type)));
+    out.pushKVEnd("reqSigs", nRequired);
+    out.pushKVEnd("type", GetTxnOutputType(type));
 
     UniValue a(UniValue::VARR);
+    a.reserve(addresses.size());
     BOOST_FOREACH(const CTxDestination& addr, addresses)
         a.push_back(CBitcoinAddress(addr).ToString());
-    out.push_back(Pair("addresses", a));
+    out.pushKVEnd("addresses", std::move(a));
 }
 
+// SolarCoin: The keys of these objects are fixed, so they are appended with pushKVEnd into
+// reserved objects, and the finished members are moved in rather than copied.
 void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
 {
-    entry.push_back(Pair("txid", tx.GetHash().GetHex()));
-    entry.push_back(Pair("hash", tx.GetWitnessHash().GetHex()));
-    entry.push_back(Pair("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION)));
-    entry.push_back(Pair("vsize", (int)::GetVirtualTransactionSize(tx)));
-    entry.push_back(Pair("version", tx.nVersion));
-    entry.push_back(Pair("locktime", (int64_t)tx.nLockTime));
+    entry.reserve(12);
+    entry.pushKVEnd("txid", tx.GetHash().GetHex());
+    entry.pushKVEnd("hash", tx.GetWitnessHash().GetHex());
+    entry.pushKVEnd("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+    entry.pushKVEnd("vsize", (int)::GetVirtualTransactionSize(tx));
+    entry.pushKVEnd("version", tx.nVersion);
+    entry.pushKVEnd("locktime", (int64_t)tx.nLockTime);
 
     UniValue vin(UniValue::VARR);
+    vin.reserve(tx.vin.size());
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
         const CTxIn& txin = tx.vin[i];
         UniValue in(UniValue::VOBJ);
+        in.reserve(5);
         if (tx.IsCoinBase())
-            in.push_back(Pair("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
+            in.pushKVEnd("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
         else {
-            in.push_back(Pair("txid", txin.prevout.hash.GetHex()));
-            in.push_back(Pair("vout", (int64_t)txin.prevout.n));
+            in.pushKVEnd("txid", txin.prevout.hash.GetHex());
+            in.pushKVEnd("vout", (int64_t)txin.prevout.n);
             UniValue o(UniValue::VOBJ);
-            o.push_back(Pair("asm", ScriptToAsmStr(txin.scriptSig, true)));
-            o.push_back(Pair("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
-            in.push_back(Pair("scriptSig", o));
+            o.reserve(2);
+            o.pushKVEnd("asm", ScriptToAsmStr(txin.scriptSig, true));
+            o.pushKVEnd("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
+            in.pushKVEnd("scriptSig", std::move(o));
         }
         if (tx.HasWitness()) {
                 UniValue txinwitness(UniValue::VARR);
-                for (unsigned int j = 0; j < tx.vin[i].scriptWitness.stack.size(); j++) {
-                    std::vector<unsigned char> item = tx.vin[i].scriptWitness.stack[j];
+                txinwitness.reserve(txin.scriptWitness.stack.size());
+                for (const std::vector<unsigned char>& item : txin.scriptWitness.stack)
                     txinwitness.push_back(HexStr(item.begin(), item.end()));
-                }
-                in.push_back(Pair("txinwitness", txinwitness));
+                in.pushKVEnd("txinwitness", std::move(txinwitness));
         }
-        in.push_back(Pair("sequence", (int64_t)txin.nSequence));
-        vin.push_back(in);
+        in.pushKVEnd("sequence", (int64_t)txin.nSequence);
+        vin.push_back(std::move(in));
     }
-    entry.push_back(Pair("vin", vin));
+    entry.pushKVEnd("vin", std::move(vin));
     UniValue vout(UniValue::VARR);
+    vout.reserve(tx.vout.size());
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const CTxOut& txout = tx.vout[i];
         UniValue out(UniValue::VOBJ);
-        out.push_back(Pair("value", ValueFromAmount(txout.nValue)));
-        out.push_back(Pair("n", (int64_t)i));
+        out.reserve(3);
+        out.pushKVEnd("value", ValueFromAmount(txout.nValue));
+        out.pushKVEnd("n", (int64_t)i);
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-        out.push_back(Pair("scriptPubKey", o));
-        vout.push_back(out);
+        out.pushKVEnd("scriptPubKey", std::move(o));
+        vout.push_back(std::move(out));
     }
-    entry.push_back(Pair("vout", vout));
+    entry.pushKVEnd("vout", std::move(vout));
 
     if (!hashBlock.IsNull()) {
-        entry.push_back(Pair("blockhash", hashBlock.GetHex()));
+        entry.pushKVEnd("blockhash", hashBlock.GetHex());
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
             CBlockIndex* pindex = (*mi).second;
             if (chainActive.Contains(pindex)) {
-                entry.push_back(Pair("confirmations", 1 + chainActive.Height() - pindex->nHeight));
-                entry.push_back(Pair("time", pindex->GetBlockTime()));
-                entry.push_back(Pair("blocktime", pindex->GetBlockTime()));
+                entry.pushKVEnd("confirmations", 1 + chainActive.Height() - pindex->nHeight);
+                entry.pushKVEnd("time", pindex->GetBlockTime());
+                entry.pushKVEnd("blocktime", pindex->GetBlockTime());
             }
             else
-                entry.push_back(Pair("confirmations", 0));
+                entry.pushKVEnd("confirmations", 0);
         }
     }
 }
@@ -221,8 +233,9 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
     uint256 hashBlock;
     unsigned int nTxOffset = 0;
     if (!GetTransaction(hash, tx, nTxOffset, Params().GetConsensus(), hashBlock, true))
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string(fTxIndex ? "No such mempool or blockchain transaction"
-            : "No such mempool transaction. Use -txindex to enable blockchain transaction queries") +
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string(!ptxindex ? "No such mempool transaction. Use -txindex to enable blockchain transaction queries"
+            : ptxindex->IsSynced() ? "No such mempool or blockchain transaction"
+            : "No such mempool or blockchain transaction, the transaction index is still being built") +
             ". Use gettransaction for wallet transactions.");
 
     string strHex = EncodeHexTx(*tx, RPCSerializationFlags());
@@ -283,9 +296,9 @@ UniValue gettxoutproof(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         pblockindex = mapBlockIndex[hashBlock];
     } else {
-        CCoins coins;
-        if (pcoinsTip->GetCoins(oneTxid, coins) && coins.nHeight > 0 && coins.nHeight <= chainActive.Height())
-            pblockindex = chainActive[coins.nHeight];
+        const Coin& coin = AccessByTxid(*pcoinsTip, oneTxid);
+        if (!coin.IsSpent() && coin.nHeight > 0 && coin.nHeight <= chainActive.Height())
+            pblockindex = chainActive[coin.nHeight];
     }
 
     if (pblockindex == NULL)
@@ -596,6 +609,10 @@ static void TxInErrorToJSON(const CTxIn& txin, UniValue& vErrorsRet, const std::
 
 UniValue signrawtransaction(const JSONRPCRequest& request)
 {
+#ifdef ENABLE_WALLET
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+#endif
+
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
         throw runtime_error(
             "signrawtransaction \"hexstring\" ( [{\"txid\":\"id\",\"vout\":n,\"scriptPubKey\":\"hex\",\"redeemScript\":\"hex\"},...] [\"privatekey1\",...] sighashtype )\n"
@@ -605,7 +622,7 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
             "The third optional argument (may be null) is an array of base58-encoded private\n"
             "keys that, if given, will be the only keys used to sign the transaction.\n"
 #ifdef ENABLE_WALLET
-            + HelpRequiringPassphrase() + "\n"
+            + HelpRequiringPassphrase(pwallet) + "\n"
 #endif
 
             "\nArguments:\n"
@@ -656,7 +673,7 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
         );
 
 #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+    LOCK2(cs_main, pwallet ? &pwallet->cs_wallet : NULL);
 #else
     LOCK(cs_main);
 #endif
@@ -693,9 +710,7 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
         BOOST_FOREACH(const CTxIn& txin, mergedTx.vin) {
-            const uint256& prevHash = txin.prevout.hash;
-            CCoins coins;
-            view.AccessCoins(prevHash); // this is certainly allowed to fail
+            view.AccessCoin(txin.prevout); // Load entries from viewChain into view; can fail.
         }
 
         view.SetBackend(viewDummy); // switch back to avoid locking mempool for too long
@@ -719,8 +734,8 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
         }
     }
 #ifdef ENABLE_WALLET
-    else if (pwalletMain)
-        EnsureWalletIsUnlocked();
+    else if (pwallet)
+        EnsureWalletIsUnlocked(pwallet);
 #endif
 
     // Add previous txouts given in the RPC call:
@@ -746,24 +761,26 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
             if (nOut < 0)
                 throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "vout must be positive");
 
+            COutPoint out(txid, nOut);
             vector<unsigned char> pkData(ParseHexO(prevOut, "scriptPubKey"));
             CScript scriptPubKey(pkData.begin(), pkData.end());
 
             {
-                CCoinsModifier coins = view.ModifyCoins(txid);
-                if (coins->IsAvailable(nOut) && coins->vout[nOut].scriptPubKey != scriptPubKey) {
+                const Coin& coin = view.AccessCoin(out);
+                if (!coin.IsSpent() && coin.out.scriptPubKey != scriptPubKey) {
                     string err("Previous output scriptPubKey mismatch:\n");
-                    err = err + ScriptToAsmStr(coins->vout[nOut].scriptPubKey) + "\nvs:\n"+
+                    err = err + ScriptToAsmStr(coin.out.scriptPubKey) + "\nvs:\n"+
                         ScriptToAsmStr(scriptPubKey);
                     throw JSONRPCError(RPC_DESERIALIZATION_ERROR, err);
                 }
-                if ((unsigned int)nOut >= coins->vout.size())
-                    coins->vout.resize(nOut+1);
-                coins->vout[nOut].scriptPubKey = scriptPubKey;
-                coins->vout[nOut].nValue = 0;
+                Coin newcoin;
+                newcoin.out.scriptPubKey = scriptPubKey;
+                newcoin.out.nValue = 0;
                 if (prevOut.exists("amount")) {
-                    coins->vout[nOut].nValue = AmountFromValue(find_value(prevOut, "amount"));
+                    newcoin.out.nValue = AmountFromValue(find_value(prevOut, "amount"));
                 }
+                newcoin.nHeight = 1;
+                view.AddCoin(out, std::move(newcoin), true);
             }
 
             // if redeemScript given and not using the local wallet (private keys
@@ -787,7 +804,7 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
     }
 
 #ifdef ENABLE_WALLET
-    const CKeyStore& keystore = ((fGivenKeys || !pwalletMain) ? tempKeystore : *pwalletMain);
+    const CKeyStore& keystore = ((fGivenKeys || !pwallet) ? tempKeystore : *pwallet);
 #else
     const CKeyStore& keystore = tempKeystore;
 #endif
@@ -821,13 +838,13 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
     // Sign what we can:
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
         CTxIn& txin = mergedTx.vin[i];
-        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-        if (coins == NULL || !coins->IsAvailable(txin.prevout.n)) {
+        const Coin& coin = view.AccessCoin(txin.prevout);
+        if (coin.IsSpent()) {
             TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
             continue;
         }
-        const CScript& prevPubKey = coins->vout[txin.prevout.n].scriptPubKey;
-        const CAmount& amount = coins->vout[txin.prevout.n].nValue;
+        const CScript& prevPubKey = coin.out.scriptPubKey;
+        const CAmount& amount = coin.out.nValue;
 
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
@@ -899,9 +916,12 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
         nMaxRawTxFee = 0;
 
     CCoinsViewCache &view = *pcoinsTip;
-    const CCoins* existingCoins = view.AccessCoins(hashTx);
+    bool fHaveChain = false;
+    for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
+        const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+        fHaveChain = !existingCoin.IsSpent();
+    }
     bool fHaveMempool = mempool.exists(hashTx);
-    bool fHaveChain = existingCoins && existingCoins->nHeight < 1000000000;
     if (!fHaveMempool && !fHaveChain) {
         // push to local node and sync with wallets
         CValidationState state;
@@ -930,14 +950,174 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+/** SolarCoin: The fewest transactions sendrawtransactions decodes per job */
+static const size_t SENDRAWTXS_DECODE_JOB_SIZE = 64;
+
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "Transactions that spend outputs of others in the batch are accepted after them. The results\n"
+            "are given per transaction, in the order of the batch; a rejected one does not stop the others.\n"
+            "\nArguments:\n"
+            "1. [\"hexstring\",...]  (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees      (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hex\",       (string) The transaction hash in hex, unless it failed to decode\n"
+            "    \"accepted\" : true|false, (boolean) If it is in the mempool now\n"
+            "    \"error\" : \"message\"    (string) Why it was rejected, if it was\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+    const UniValue& hexstrings = request.params[0].get_array();
+    const size_t nTx = hexstrings.size();
+    for (size_t i = 0; i < nTx; i++) {
+        if (!hexstrings[i].isStr())
+            throw JSONRPCError(RPC_TYPE_ERROR, "Expected an array of hex strings");
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (request.params.size() > 1 && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Decode the transactions and make the checks that need no context, spread over the script
+    // check threads for a large batch
+    std::vector<CTransactionRef> vtx(nTx);
+    std::vector<std::string> vError(nTx);
+    auto decode = [&hexstrings, &vtx, &vError](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            CMutableTransaction mtx;
+            if (!DecodeHexTx(mtx, hexstrings[i].get_str())) {
+                vError[i] = "TX decode failed";
+                continue;
+            }
+            vtx[i] = MakeTransactionRef(std::move(mtx));
+            CValidationState state;
+            if (!CheckTransaction(*vtx[i], state))
+                vError[i] = strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason());
+        }
+    };
+    size_t nJobs = std::max<size_t>(1, std::min<size_t>(nScriptCheckThreads, nTx / SENDRAWTXS_DECODE_JOB_SIZE));
+    size_t nJobSize = (nTx + nJobs - 1) / nJobs;
+    std::vector<std::future<void> > vJobs;
+    for (size_t nBegin = nJobSize; nBegin < nTx; nBegin += nJobSize)
+        vJobs.push_back(std::async(std::launch::async, decode, nBegin, std::min(nBegin + nJobSize, nTx)));
+    decode(0, std::min(nJobSize, nTx));
+    for (std::future<void>& job : vJobs)
+        job.get();
+
+    // Order the batch so parents come before the children spending them
+    std::map<uint256, size_t> mapBatch;
+    for (size_t i = 0; i < nTx; i++) {
+        if (vError[i].empty())
+            mapBatch[vtx[i]->GetHash()] = i;
+    }
+    std::vector<size_t> vOrder;
+    std::vector<bool> vPlaced(nTx, false);
+    bool fProgress = true;
+    while (fProgress) {
+        fProgress = false;
+        for (size_t i = 0; i < nTx; i++) {
+            if (vPlaced[i] || !vError[i].empty())
+                continue;
+            bool fReady = true;
+            for (const CTxIn& txin : vtx[i]->vin) {
+                std::map<uint256, size_t>::const_iterator it = mapBatch.find(txin.prevout.hash);
+                if (it != mapBatch.end() && it->second != i && !vPlaced[it->second]) {
+                    fReady = false;
+                    break;
+                }
+            }
+            if (fReady) {
+                vPlaced[i] = true;
+                vOrder.push_back(i);
+                fProgress = true;
+            }
+        }
+    }
+
+    // Run their scripts before taking cs_main, then accept them all under one lock
+    std::vector<CTransactionRef> vOrdered;
+    vOrdered.reserve(vOrder.size());
+    for (size_t i : vOrder)
+        vOrdered.push_back(vtx[i]);
+    PreVerifyTransactionScripts(vOrdered);
+
+    std::vector<uint256> vRelay;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t i : vOrder) {
+            const uint256& hashTx = vtx[i]->GetHash();
+            bool fHaveChain = false;
+            for (size_t o = 0; !fHaveChain && o < vtx[i]->vout.size(); o++) {
+                const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+                fHaveChain = !existingCoin.IsSpent();
+            }
+            if (fHaveChain) {
+                vError[i] = "transaction already in block chain";
+                continue;
+            }
+            if (!mempool.exists(hashTx)) {
+                CValidationState state;
+                bool fMissingInputs;
+                if (!AcceptToMemoryPool(mempool, state, vtx[i], false, &fMissingInputs, NULL, false, nMaxRawTxFee)) {
+                    if (state.IsInvalid()) {
+                        vError[i] = strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason());
+                    } else if (fMissingInputs) {
+                        vError[i] = "Missing inputs";
+                    } else {
+                        vError[i] = state.GetRejectReason();
+                    }
+                    continue;
+                }
+            }
+            vRelay.push_back(hashTx);
+        }
+    }
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    // Announce the whole batch to each peer in one go
+    g_connman->ForEachNode([&vRelay](CNode* pnode)
+    {
+        for (const uint256& hashTx : vRelay)
+            pnode->PushInventory(CInv(MSG_TX, hashTx));
+    });
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < nTx; i++) {
+        UniValue entry(UniValue::VOBJ);
+        if (vtx[i])
+            entry.push_back(Pair("txid", vtx[i]->GetHash().GetHex()));
+        entry.push_back(Pair("accepted", vError[i].empty()));
+        if (!vError[i].empty())
+            entry.push_back(Pair("error", vError[i]));
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  {"txid","verbose"} },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  {"txid","verbose"}, true },
     { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  {"inputs","outputs","locktime"} },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  {"hexstring"} },
-    { "rawtransactions",    "decodescript",           &decodescript,           true,  {"hexstring"} },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  {"hexstring"}, true },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  {"hexstring"}, true },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false, {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  {"txids", "blockhash"} },
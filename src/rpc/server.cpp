@@ -23,7 +23,9 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <atomic>
 #include <memory> // for unique_ptr
+#include <thread>
 #include <unordered_map>
 
 using namespace RPCServer;
@@ -136,11 +138,25 @@ CAmount AmountFromValue(const UniValue& value)
 UniValue ValueFromAmount(const CAmount& amount)
 {
     bool sign = amount < 0;
-    int64_t n_abs = (sign ? -amount : amount);
-    int64_t quotient = n_abs / COIN;
-    int64_t remainder = n_abs % COIN;
-    return UniValue(UniValue::VNUM,
-            strprintf("%s%d.%08d", sign ? "-" : "", quotient, remainder));
+    uint64_t n_abs = (sign ? -(uint64_t)amount : (uint64_t)amount);
+    uint64_t quotient = n_abs / COIN;
+    uint64_t remainder = n_abs % COIN;
+    // SolarCoin: Written from the end without strprintf, as every output of a verbose block goes through here
+    char buf[32];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    for (int i = 0; i < 8; i++) {
+        *--p = '0' + (remainder % 10);
+        remainder /= 10;
+    }
+    *--p = '.';
+    do {
+        *--p = '0' + (quotient % 10);
+        quotient /= 10;
+    } while (quotient);
+    if (sign)
+        *--p = '-';
+    return UniValue(UniValue::VNUM, std::string(p, end));
 }
 
 uint256 ParseHashV(const UniValue& v, string strName)
@@ -391,11 +407,10 @@ void JSONRPCRequest::parse(const UniValue& valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array or object");
 }
 
-static UniValue JSONRPCExecOne(const UniValue& req)
+static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
 {
     UniValue rpc_result(UniValue::VOBJ);
 
-    JSONRPCRequest jreq;
     try {
         jreq.parse(req);
 
@@ -415,11 +430,69 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** SolarCoin: Whether a call of a batch is of a command marked fConcurrent */
+static bool IsConcurrentCall(const UniValue& req)
 {
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req, "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->fConcurrent;
+}
+
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
+{
+    // The batch is sent to the current wallet endpoint, and never streamed
+    JSONRPCRequest jreqBatch;
+    jreqBatch.URI = jreq.URI;
+    jreqBatch.authUser = jreq.authUser;
+
+    std::vector<UniValue> vResults(vReq.size());
+    const size_t nMaxThreads = std::max((int64_t)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), (int64_t)1);
+    size_t nStart = 0;
+    while (nStart < vReq.size()) {
+        // SolarCoin: Each stretch of concurrent calls runs on several threads; any other call runs
+        // alone, after the calls before it finished, so a batch keeps the effects of its order
+        size_t nEnd = nStart;
+        while (nEnd < vReq.size() && IsConcurrentCall(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - nStart < 2) {
+            nEnd = std::max(nEnd, nStart + 1);
+            for (size_t i = nStart; i < nEnd; i++)
+                vResults[i] = JSONRPCExecOne(jreqBatch, vReq[i]);
+            nStart = nEnd;
+            continue;
+        }
+
+        std::atomic<size_t> nNext(nStart);
+        auto worker = [&]() {
+            for (size_t i = nNext++; i < nEnd; i = nNext++) {
+                try {
+                    vResults[i] = JSONRPCExecOne(jreqBatch, vReq[i]);
+                } catch (...) {
+                    vResults[i] = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_INTERNAL_ERROR, "Unknown error"), find_value(vReq[i], "id"));
+                }
+            }
+        };
+        std::vector<std::thread> vThreads;
+        try {
+            for (size_t n = 1; n < std::min(nMaxThreads, nEnd - nStart); n++)
+                vThreads.emplace_back(worker);
+        } catch (const std::system_error& e) {
+            // Fewer threads just take longer
+            LogPrintf("%s: could not start batch thread: %s\n", __func__, e.what());
+        }
+        worker();
+        for (std::thread& thread : vThreads)
+            thread.join();
+        nStart = nEnd;
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (const UniValue& result : vResults)
+        ret.push_back(result);
 
     return ret.write() + "\n";
 }
@@ -20,6 +20,8 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** SolarCoin: Default for -rpcbatchthreads, the threads running the concurrent calls of a batch */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 
 class CRPCCommand;
 
@@ -33,6 +35,7 @@ namespace RPCServer
 
 class CBlockIndex;
 class CNetAddr;
+class CJSONStream;
 
 /** Wrapper for UniValue::VType, which includes typeAny:
  * Used to denote don't care type. Only used by RPCTypeCheckObj */
@@ -52,8 +55,13 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /**
+     * SolarCoin: If set, methods with large results may write them here, with CJSONResult,
+     * and return NullUniValue. Only set for single calls over HTTP.
+     */
+    CJSONStream* stream;
 
-    JSONRPCRequest() { id = NullUniValue; params = NullUniValue; fHelp = false; }
+    JSONRPCRequest() { id = NullUniValue; params = NullUniValue; fHelp = false; stream = NULL; }
     void parse(const UniValue& valRequest);
 };
 
@@ -137,11 +145,18 @@ typedef UniValue(*rpcfn_type)(const JSONRPCRequest& jsonRequest);
 class CRPCCommand
 {
 public:
+    CRPCCommand(std::string _category, std::string _name, rpcfn_type _actor, bool _okSafeMode, std::vector<std::string> _argNames, bool _fConcurrent = false) :
+        category(std::move(_category)), name(std::move(_name)), actor(_actor), okSafeMode(_okSafeMode), argNames(std::move(_argNames)), fConcurrent(_fConcurrent)
+    {
+    }
+
     std::string category;
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
     std::vector<std::string> argNames;
+    //! SolarCoin: Whether calls only read state, so the calls in a batch may run at the same time
+    bool fConcurrent;
 };
 
 /**
@@ -190,20 +205,19 @@ extern uint256 ParseHashO(const UniValue& o, std::string strKey);
 extern std::vector<unsigned char> ParseHexV(const UniValue& v, std::string strName);
 extern std::vector<unsigned char> ParseHexO(const UniValue& o, std::string strKey);
 
-extern int64_t nWalletUnlockTime;
 extern CAmount AmountFromValue(const UniValue& value);
 extern UniValue ValueFromAmount(const CAmount& amount);
 extern double GetDifficulty(const CBlockIndex* blockindex = NULL);
-extern std::string HelpRequiringPassphrase();
+/** SolarCoin: The difficulty of a compact target, as GetDifficulty() */
+extern double GetDifficultyFromBits(unsigned int nBits);
 extern std::string HelpExampleCli(const std::string& methodname, const std::string& args);
 extern std::string HelpExampleRpc(const std::string& methodname, const std::string& args);
 
-extern void EnsureWalletIsUnlocked();
-
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/** Execute a batch of calls; the consecutive calls of commands marked fConcurrent run at the same time */
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
 // Retrieves any serialization flags requested in command line argument
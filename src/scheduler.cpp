@@ -6,12 +6,14 @@
 
 #include "reverselock.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <boost/bind.hpp>
 #include <utility>
 
 CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
 {
+    addQueue("default", 0);
 }
 
 CScheduler::~CScheduler()
@@ -31,50 +33,85 @@ void CScheduler::serviceQueue()
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
     ++nThreadsServicingQueue;
+    QueueId nRunningQueue = -1;
 
     // newTaskMutex is locked throughout this loop EXCEPT
     // when the thread is waiting or when the user's function
     // is called.
     while (!shouldStop()) {
         try {
-            while (!shouldStop() && taskQueue.empty()) {
-                // Wait until there is something to do.
-                newTaskScheduled.wait(lock);
-            }
-
-            // Wait until either there is a new task, or until
-            // the time of the first item on the queue:
+            // SolarCoin: Pick the due task of the highest priority among the queues below their
+            // cap, or wait for the first task of those queues to become due. A task finishing
+            // wakes the waiting threads, as its queue may be below its cap again.
+            std::multimap<boost::chrono::system_clock::time_point, Task>::iterator itRun = taskQueue.end();
+            while (!shouldStop()) {
+                boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+                std::multimap<boost::chrono::system_clock::time_point, Task>::iterator itNext = taskQueue.end();
+                for (std::multimap<boost::chrono::system_clock::time_point, Task>::iterator it = taskQueue.begin(); it != taskQueue.end(); ++it) {
+                    const QueueStats& queue = vQueues[it->second.nQueue];
+                    if (queue.nMaxConcurrent > 0 && queue.nRunning >= queue.nMaxConcurrent)
+                        continue;
+                    if (it->first > now) {
+                        itNext = it;
+                        break;
+                    }
+                    if (itRun == taskQueue.end() || queue.nPriority > vQueues[itRun->second.nQueue].nPriority)
+                        itRun = it;
+                }
+                if (itRun != taskQueue.end())
+                    break;
+                if (itNext == taskQueue.end()) {
+                    // Wait until there is something to do.
+                    newTaskScheduled.wait(lock);
+                    continue;
+                }
+                // Wait until either there is a new task, or until
+                // the time of the first task that can run:
 
 // wait_until needs boost 1.50 or later; older versions have timed_wait:
 #if BOOST_VERSION < 105000
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.timed_wait(lock, toPosixTime(taskQueue.begin()->first))) {
-                // Keep waiting until timeout
-            }
+                newTaskScheduled.timed_wait(lock, toPosixTime(itNext->first));
 #else
-            // Some boost versions have a conflicting overload of wait_until that returns void.
-            // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
-                boost::chrono::system_clock::time_point timeToWaitFor = taskQueue.begin()->first;
-                if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
-                    break; // Exit loop after timeout, it means we reached the time of the event
-            }
+                // Some boost versions have a conflicting overload of wait_until that returns void.
+                // Explicitly use a template here to avoid hitting that overload.
+                newTaskScheduled.wait_until<>(lock, itNext->first);
 #endif
+            }
             // If there are multiple threads, the queue can empty while we're waiting (another
             // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (shouldStop() || itRun == taskQueue.end())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            Task task = itRun->second;
+            boost::chrono::system_clock::time_point timeDue = itRun->first;
+            taskQueue.erase(itRun);
+
+            boost::chrono::system_clock::time_point timeStart = boost::chrono::system_clock::now();
+            int64_t nWaitMicros = std::max<int64_t>(0, boost::chrono::duration_cast<boost::chrono::microseconds>(timeStart - timeDue).count());
+            QueueStats& queue = vQueues[task.nQueue];
+            queue.nRun++;
+            queue.nWaitMicros += nWaitMicros;
+            queue.nMaxWaitMicros = std::max(queue.nMaxWaitMicros, nWaitMicros);
+            queue.nRunning++;
+            nRunningQueue = task.nQueue;
 
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
-                f();
+                task.f();
             }
+
+            // vQueues may have grown while unlocked
+            vQueues[task.nQueue].nRunning--;
+            vQueues[task.nQueue].nRunMicros += boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::system_clock::now() - timeStart).count();
+            nRunningQueue = -1;
+            newTaskScheduled.notify_all();
         } catch (...) {
+            if (nRunningQueue >= 0) {
+                vQueues[nRunningQueue].nRunning--;
+                newTaskScheduled.notify_all();
+            }
             --nThreadsServicingQueue;
             throw;
         }
@@ -95,29 +132,62 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+CScheduler::QueueId CScheduler::addQueue(const std::string& strName, int nMaxConcurrent, int nPriority)
+{
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    QueueStats queue;
+    queue.strName = strName;
+    queue.nMaxConcurrent = std::max(0, nMaxConcurrent);
+    queue.nPriority = nPriority;
+    queue.nQueued = 0;
+    queue.nRunning = 0;
+    queue.nRun = 0;
+    queue.nWaitMicros = 0;
+    queue.nMaxWaitMicros = 0;
+    queue.nRunMicros = 0;
+    vQueues.push_back(queue);
+    return vQueues.size() - 1;
+}
+
+void CScheduler::setQueueLimit(QueueId nQueue, int nMaxConcurrent)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        assert(nQueue >= 0 && (size_t)nQueue < vQueues.size());
+        vQueues[nQueue].nMaxConcurrent = std::max(0, nMaxConcurrent);
     }
-    newTaskScheduled.notify_one();
+    newTaskScheduled.notify_all();
+}
+
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, QueueId nQueue)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(newTaskMutex);
+        assert(nQueue >= 0 && (size_t)nQueue < vQueues.size());
+        Task task;
+        task.f = f;
+        task.nQueue = nQueue;
+        taskQueue.insert(std::make_pair(t, task));
+    }
+    // A waiting thread may be unable to run the task, because of the cap of its queue, while
+    // another could: wake them all
+    newTaskScheduled.notify_all();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds, QueueId nQueue)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds), nQueue);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds, CScheduler::QueueId nQueue)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds), deltaSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds, nQueue), deltaSeconds, nQueue);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds, QueueId nQueue)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds), deltaSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds, nQueue), deltaSeconds, nQueue);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
@@ -131,3 +201,12 @@ size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
     }
     return result;
 }
+
+std::vector<CScheduler::QueueStats> CScheduler::getQueueStats() const
+{
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    std::vector<QueueStats> vStats = vQueues;
+    for (std::multimap<boost::chrono::system_clock::time_point, Task>::const_iterator it = taskQueue.begin(); it != taskQueue.end(); ++it)
+        vStats[it->second.nQueue].nQueued++;
+    return vStats;
+}
@@ -14,6 +14,13 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
 #include <map>
+#include <string>
+#include <vector>
+
+/** SolarCoin: -schedulerthreads default: threads servicing the scheduler queues of all subsystems */
+static const int DEFAULT_SCHEDULER_THREADS = 4;
+/** Maximum number of scheduler threads */
+static const int MAX_SCHEDULER_THREADS = 32;
 
 //
 // Simple class for background tasks that should be run
@@ -32,6 +39,13 @@
 // delete t;
 // delete s; // Must be done after thread is interrupted/joined.
 //
+// SolarCoin: Several subsystems share the threads servicing one scheduler. Each
+// task belongs to a named queue, which caps how many of its tasks run at the
+// same time and gives them a priority over the due tasks of other queues:
+//
+// CScheduler::QueueId q = s->addQueue("notify", 2, 1);
+// s->schedule(doSomething, boost::chrono::system_clock::now(), q);
+//
 
 class CScheduler
 {
@@ -41,18 +55,30 @@ public:
 
     typedef boost::function<void(void)> Function;
 
+    // SolarCoin: Identifies a queue of tasks sharing a concurrency cap and a priority
+    typedef int QueueId;
+    // The queue of the tasks scheduled without one, without a cap unless set
+    static const QueueId DEFAULT_QUEUE = 0;
+
+    // Add a queue whose tasks run on at most nMaxConcurrent threads at a time
+    // (0: no cap). Due tasks of queues with a higher nPriority run first.
+    QueueId addQueue(const std::string& strName, int nMaxConcurrent, int nPriority = 0);
+
+    // Change the cap of a queue
+    void setQueueLimit(QueueId nQueue, int nMaxConcurrent);
+
     // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t);
+    void schedule(Function f, boost::chrono::system_clock::time_point t, QueueId nQueue = DEFAULT_QUEUE);
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaSeconds);
+    void scheduleFromNow(Function f, int64_t deltaSeconds, QueueId nQueue = DEFAULT_QUEUE);
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaSeconds);
+    void scheduleEvery(Function f, int64_t deltaSeconds, QueueId nQueue = DEFAULT_QUEUE);
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -70,8 +96,31 @@ public:
     size_t getQueueInfo(boost::chrono::system_clock::time_point &first,
                         boost::chrono::system_clock::time_point &last) const;
 
+    // SolarCoin: What a queue ran so far and has waiting
+    struct QueueStats
+    {
+        std::string strName;
+        int nMaxConcurrent;
+        int nPriority;
+        size_t nQueued;   //!< tasks waiting, due or not
+        int nRunning;
+        uint64_t nRun;    //!< tasks started
+        int64_t nWaitMicros;    //!< total time tasks waited past their due time to start
+        int64_t nMaxWaitMicros;
+        int64_t nRunMicros;     //!< total time spent running tasks
+    };
+
+    // Returns the stats of every queue, by QueueId
+    std::vector<QueueStats> getQueueStats() const;
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    struct Task
+    {
+        Function f;
+        QueueId nQueue;
+    };
+    std::multimap<boost::chrono::system_clock::time_point, Task> taskQueue;
+    std::vector<QueueStats> vQueues;
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
@@ -11,6 +11,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 using namespace std;
@@ -1142,6 +1143,55 @@ public:
     }
 };
 
+/** Serializes into a CHash256, as CHashWriter does into its own */
+class CHash256Writer
+{
+private:
+    CHash256& ctx;
+
+public:
+    explicit CHash256Writer(CHash256& ctxIn) : ctx(ctxIn) {}
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return 0; }
+
+    void write(const char* pch, size_t size) {
+        ctx.Write((const unsigned char*)pch, size);
+    }
+
+    template<typename T>
+    CHash256Writer& operator<<(const T& obj) {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+};
+
+/** The bytes of an input not being signed with SIGHASH_ALL: its prevout, an empty script and its nSequence */
+static const size_t LEGACY_BLANK_INPUT_SIZE = 36 + 1 + 4;
+
+void PrecomputeLegacySignatureHash(const CTransaction& txTo, PrecomputedTransactionData& txdata) {
+    // Signing an input out of range blanks them all
+    const CScript scriptEmpty;
+    const CTransactionSignatureSerializer txBlank(txTo, scriptEmpty, txTo.vin.size(), SIGHASH_ALL);
+    CVectorWriter inputs(SER_GETHASH, 0, txdata.vLegacyInputs, 0);
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++)
+        txBlank.SerializeInput(inputs, nInput);
+    assert(txdata.vLegacyInputs.size() == txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE);
+
+    CVectorWriter tail(SER_GETHASH, 0, txdata.vLegacyTail, 0);
+    tail << txTo.vout << txTo.nLockTime;
+
+    txdata.vLegacyPrefixes.resize(txTo.vin.size());
+    CHash256 ctx;
+    CHash256Writer prefix(ctx);
+    prefix << txTo.nVersion;
+    WriteCompactSize(prefix, txTo.vin.size());
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++) {
+        txdata.vLegacyPrefixes[nInput] = ctx;
+        ctx.Write(txdata.vLegacyInputs.data() + nInput * LEGACY_BLANK_INPUT_SIZE, LEGACY_BLANK_INPUT_SIZE);
+    }
+}
+
 uint256 GetPrevoutHash(const CTransaction& txTo) {
     CHashWriter ss(SER_GETHASH, 0);
     for (unsigned int n = 0; n < txTo.vin.size(); n++) {
@@ -1168,11 +1218,20 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
 
 } // anon namespace
 
-PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo) : fReady(false)
 {
+    Init(txTo);
+}
+
+void PrecomputedTransactionData::Init(const CTransaction& txTo)
+{
+    if (fReady)
+        return;
     hashPrevouts = GetPrevoutHash(txTo);
     hashSequence = GetSequenceHash(txTo);
     hashOutputs = GetOutputsHash(txTo);
+    PrecomputeLegacySignatureHash(txTo, *this);
+    fReady = true;
 }
 
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
@@ -1239,6 +1298,21 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // SolarCoin: With SIGHASH_ALL, only the section of the input signed is not cached
+    if (cache && !cache->vLegacyPrefixes.empty() && !(nHashType & SIGHASH_ANYONECANPAY) &&
+        (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        CHash256 ctx = cache->vLegacyPrefixes[nIn];
+        CHash256Writer writer(ctx);
+        txTmp.SerializeInput(writer, nIn);
+        const size_t nAfter = (nIn + 1) * LEGACY_BLANK_INPUT_SIZE;
+        ctx.Write(cache->vLegacyInputs.data() + nAfter, cache->vLegacyInputs.size() - nAfter);
+        ctx.Write(cache->vLegacyTail.data(), cache->vLegacyTail.size());
+        writer << nHashType;
+        uint256 hash;
+        ctx.Finalize(hash.begin());
+        return hash;
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -114,7 +115,22 @@ struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
 
+    /**
+     * SolarCoin: The SIGVERSION_BASE serialization of the transaction signed with SIGHASH_ALL, so an
+     * input hashes its own section and the cached bytes rather than serializing the transaction again.
+     * The inputs other than the one signed serialize blanked, side by side in vLegacyInputs, then come
+     * the outputs and nLockTime in vLegacyTail. vLegacyPrefixes holds the hasher at each input.
+     */
+    std::vector<unsigned char> vLegacyInputs;
+    std::vector<unsigned char> vLegacyTail;
+    std::vector<CHash256> vLegacyPrefixes;
+    //! SolarCoin: Whether Init() has run; block connection initializes only the transactions
+    //! whose scripts are not in the script execution cache
+    bool fReady;
+
+    PrecomputedTransactionData() : fReady(false) {}
     PrecomputedTransactionData(const CTransaction& tx);
+    void Init(const CTransaction& tx);
 };
 
 enum SigVersion
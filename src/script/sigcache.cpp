@@ -12,6 +12,7 @@
 #include "util.h"
 
 #include "cuckoocache.h"
+#include <atomic>
 #include <boost/thread.hpp>
 
 namespace {
@@ -37,6 +38,78 @@ public:
     }
 };
 
+/**
+ * SolarCoin: a cuckoo cache split into shards with a lock each, so that script check threads
+ * looking up and inserting entries rarely wait on each other. The shard is picked by the low
+ * byte of the last word, which hardly moves the position the hasher derives from that word.
+ */
+class CShardedCache
+{
+private:
+    static const int SHARDS = 16;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+
+    struct Shard
+    {
+        map_type setValid;
+        boost::shared_mutex cs;
+        std::atomic<uint64_t> nHits{0};
+        std::atomic<uint64_t> nMisses{0};
+        std::atomic<uint64_t> nEvictions{0};
+        size_t nElements = 0;
+    };
+    Shard shards[SHARDS];
+
+    Shard& GetShard(const uint256& entry) { return shards[entry.begin()[28] % SHARDS]; }
+
+public:
+    bool
+    Get(const uint256& entry, const bool erase)
+    {
+        Shard& shard = GetShard(entry);
+        bool fFound;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(shard.cs);
+            fFound = shard.setValid.contains(entry, erase);
+        }
+        (fFound ? shard.nHits : shard.nMisses).fetch_add(1, std::memory_order_relaxed);
+        return fFound;
+    }
+
+    void Set(const uint256& entry)
+    {
+        Shard& shard = GetShard(entry);
+        boost::unique_lock<boost::shared_mutex> lock(shard.cs);
+        if (!shard.setValid.insert(entry))
+            shard.nEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t setup_bytes(size_t n)
+    {
+        size_t nTotal = 0;
+        for (Shard& shard : shards) {
+            boost::unique_lock<boost::shared_mutex> lock(shard.cs);
+            shard.nElements = shard.setValid.setup_bytes(n / SHARDS);
+            nTotal += shard.nElements;
+        }
+        return nTotal;
+    }
+
+    CacheStats GetStats()
+    {
+        CacheStats stats;
+        for (Shard& shard : shards) {
+            stats.nHits += shard.nHits.load(std::memory_order_relaxed);
+            stats.nMisses += shard.nMisses.load(std::memory_order_relaxed);
+            stats.nEvictions += shard.nEvictions.load(std::memory_order_relaxed);
+            boost::shared_lock<boost::shared_mutex> lock(shard.cs);
+            stats.nEpochs += shard.setValid.epochs();
+            stats.nElements += shard.nElements;
+        }
+        return stats;
+    }
+};
+
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
@@ -45,39 +118,47 @@ public:
 class CSignatureCache
 {
 private:
-     //! Entries are SHA256(nonce || signature hash || public key || signature):
+     //! Entries are SHA256(nonce || nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    //! SolarCoin: the hasher after the nonce twice, a whole block, so computing an entry saves a compression
+    CSHA256 saltedHasher;
 
 public:
+    CShardedCache setValid;
+
     CSignatureCache()
     {
         GetRandBytes(nonce.begin(), 32);
+        saltedHasher.Write(nonce.begin(), 32).Write(nonce.begin(), 32);
     }
 
     void
     ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
     {
-        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
+        CSHA256(saltedHasher).Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
     }
+};
 
-    bool
-    Get(const uint256& entry, const bool erase)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
-    }
+/** SolarCoin: transactions whose scripts all passed, as SHA256(nonce || nonce || witness hash || flags) */
+class CScriptExecutionCache
+{
+private:
+    uint256 nonce;
+    CSHA256 saltedHasher;
 
-    void Set(uint256& entry)
+public:
+    CShardedCache setValid;
+    bool fEnabled;
+
+    CScriptExecutionCache() : fEnabled(false)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        GetRandBytes(nonce.begin(), 32);
+        saltedHasher.Write(nonce.begin(), 32).Write(nonce.begin(), 32);
     }
-    uint32_t setup_bytes(size_t n)
+
+    void ComputeEntry(uint256& entry, const uint256& wtxid, unsigned int flags)
     {
-        return setValid.setup_bytes(n);
+        CSHA256(saltedHasher).Write(wtxid.begin(), 32).Write((const unsigned char*)&flags, sizeof(flags)).Finalize(entry.begin());
     }
 };
 
@@ -88,6 +169,7 @@ public:
  * signatureCache could be made local to VerifySignature.
 */
 static CSignatureCache signatureCache;
+static CScriptExecutionCache scriptExecutionCache;
 }
 
 // To be called once in AppInit2/TestingSetup to initialize the signatureCache
@@ -96,20 +178,54 @@ void InitSignatureCache()
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-    size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
+    // SolarCoin: the script execution cache, if enabled, gets half
+    scriptExecutionCache.fEnabled = GetBoolArg("-scriptexeccache", DEFAULT_SCRIPT_EXEC_CACHE);
+    size_t nSigCacheSize = scriptExecutionCache.fEnabled ? nMaxCacheSize / 2 : nMaxCacheSize;
+    size_t nElems = signatureCache.setValid.setup_bytes(nSigCacheSize);
     LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+    if (scriptExecutionCache.fEnabled) {
+        nElems = scriptExecutionCache.setValid.setup_bytes(nMaxCacheSize - nSigCacheSize);
+        LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+                (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+    }
+}
+
+CacheStats GetSignatureCacheStats()
+{
+    return signatureCache.setValid.GetStats();
+}
+
+void ComputeScriptExecutionCacheEntry(uint256& entry, const CTransaction& tx, unsigned int flags)
+{
+    scriptExecutionCache.ComputeEntry(entry, tx.GetWitnessHash(), flags);
+}
+
+bool ScriptExecutionCacheGet(const uint256& entry, bool erase)
+{
+    return scriptExecutionCache.fEnabled && scriptExecutionCache.setValid.Get(entry, erase);
+}
+
+void ScriptExecutionCacheSet(const uint256& entry)
+{
+    if (scriptExecutionCache.fEnabled)
+        scriptExecutionCache.setValid.Set(entry);
+}
+
+CacheStats GetScriptExecutionCacheStats()
+{
+    return scriptExecutionCache.setValid.GetStats();
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
-    if (signatureCache.Get(entry, !store))
+    if (signatureCache.setValid.Get(entry, !store))
         return true;
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
     if (store)
-        signatureCache.Set(entry);
+        signatureCache.setValid.Set(entry);
     return true;
 }
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "cuckoocache.h"
 #include "script/interpreter.h"
 
 #include <vector>
@@ -16,6 +17,8 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+//! SolarCoin: whether the results of whole transactions are cached, taking half of -maxsigcachesize
+static const bool DEFAULT_SCRIPT_EXEC_CACHE = true;
 
 class CPubKey;
 
@@ -31,5 +34,17 @@ public:
 };
 
 void InitSignatureCache();
+CacheStats GetSignatureCacheStats();
+
+/**
+ * SolarCoin: cache of transactions whose scripts all passed with the given flags, so a
+ * transaction accepted to the mempool skips its script checks when its block is connected.
+ * The entry commits to the witness hash and the flags; the spent outputs are committed to by
+ * the prevouts. Lookups and insertions are thread-safe.
+ */
+void ComputeScriptExecutionCacheEntry(uint256& entry, const CTransaction& tx, unsigned int flags);
+bool ScriptExecutionCacheGet(const uint256& entry, bool erase);
+void ScriptExecutionCacheSet(const uint256& entry);
+CacheStats GetScriptExecutionCacheStats();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -32,7 +32,12 @@
 #define WINDOW_A 5
 /** larger numbers may result in slightly better performance, at the cost of
     exponentially larger precomputed tables. */
-#ifdef USE_ENDOMORPHISM
+#if defined(ECMULT_WINDOW_SIZE)
+#  if ECMULT_WINDOW_SIZE < 2 || ECMULT_WINDOW_SIZE > 24
+#    error Set ECMULT_WINDOW_SIZE to an integer in range [2..24]
+#  endif
+#define WINDOW_G ECMULT_WINDOW_SIZE
+#elif defined(USE_ENDOMORPHISM)
 /** Two tables for window size 15: 1.375 MiB. */
 #define WINDOW_G 15
 #else
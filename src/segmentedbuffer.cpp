@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "segmentedbuffer.h"
+
+#include "memusage.h"
+
+#include <algorithm>
+#include <assert.h>
+
+const size_t CSegmentedBuffer::SEGMENT_SIZE;
+
+CSegmentedBuffer::CSegmentedBuffer(std::vector<unsigned char>&& vch) : nSize(vch.size()), nHashed(0)
+{
+    if (!vch.empty())
+        vSegments.push_back(std::make_shared<Segment>(std::move(vch)));
+}
+
+void CSegmentedBuffer::write(const char* pch, size_t nLen)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(pch);
+    while (nLen) {
+        if (vSegments.empty() || vSegments.back()->size() >= SEGMENT_SIZE || !vSegments.back().unique()) {
+            // The segments written so far are final, and still in the cache
+            for (; nHashed < vSegments.size(); nHashed++)
+                hasher.Write(vSegments[nHashed]->data(), vSegments[nHashed]->size());
+            vSegments.push_back(std::make_shared<Segment>());
+            if (vSegments.size() > 1)
+                vSegments.back()->reserve(SEGMENT_SIZE);
+        }
+        Segment& segment = *vSegments.back();
+        const size_t nCopy = std::min(nLen, SEGMENT_SIZE - segment.size());
+        if (segment.capacity() < segment.size() + nCopy)
+            segment.reserve(std::min(SEGMENT_SIZE, std::max(2 * segment.capacity(), segment.size() + nCopy)));
+        segment.insert(segment.end(), p, p + nCopy);
+        p += nCopy;
+        nLen -= nCopy;
+        nSize += nCopy;
+    }
+}
+
+void CSegmentedBuffer::Find(size_t nOffset, size_t& nSegment, size_t& nSegmentOffset) const
+{
+    assert(nOffset < nSize);
+    nSegment = 0;
+    while (nOffset >= vSegments[nSegment]->size())
+        nOffset -= vSegments[nSegment++]->size();
+    nSegmentOffset = nOffset;
+}
+
+uint256 CSegmentedBuffer::GetHash() const
+{
+    CHash256 hasherRest(hasher);
+    for (size_t n = nHashed; n < vSegments.size(); n++)
+        hasherRest.Write(vSegments[n]->data(), vSegments[n]->size());
+    uint256 hash;
+    hasherRest.Finalize(hash.begin());
+    return hash;
+}
+
+std::vector<unsigned char> CSegmentedBuffer::ToVector() const
+{
+    std::vector<unsigned char> vch;
+    vch.reserve(nSize);
+    for (const std::shared_ptr<Segment>& segment : vSegments)
+        vch.insert(vch.end(), segment->begin(), segment->end());
+    return vch;
+}
+
+size_t CSegmentedBuffer::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vSegments);
+    for (const std::shared_ptr<Segment>& segment : vSegments)
+        nUsage += memusage::DynamicUsage(segment) + memusage::DynamicUsage(*segment);
+    return nUsage;
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SEGMENTEDBUFFER_H
+#define BITCOIN_SEGMENTEDBUFFER_H
+
+#include "hash.h"
+#include "uint256.h"
+
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * SolarCoin: Bytes held as a chain of segments of up to SEGMENT_SIZE, for the payloads of network
+ * messages. It grows without reallocating or moving what was written, so a large message is
+ * serialized without the copies of a growing vector, and is sent from its segments as they are.
+ * Copies share the segments, a copy only ever appends to segments of its own. The double-SHA256 of
+ * the bytes is computed as the segments fill, while they are still in the cache.
+ */
+class CSegmentedBuffer
+{
+public:
+    typedef std::vector<unsigned char> Segment;
+
+    /** Size of the segments the buffer grows by, the first one grows to it as a vector */
+    static const size_t SEGMENT_SIZE = 64 * 1024;
+
+private:
+    std::vector<std::shared_ptr<Segment> > vSegments;
+    size_t nSize;
+    //! The segments before nHashed are in hasher
+    size_t nHashed;
+    CHash256 hasher;
+
+public:
+    CSegmentedBuffer() : nSize(0), nHashed(0) {}
+    /** Take a vector as the first segment, whatever its size */
+    explicit CSegmentedBuffer(std::vector<unsigned char>&& vch);
+
+    void write(const char* pch, size_t nLen);
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    size_t GetSegmentCount() const { return vSegments.size(); }
+    const Segment& GetSegment(size_t n) const { return *vSegments[n]; }
+
+    /** Locate the byte at nOffset as its segment and the offset in that segment */
+    void Find(size_t nOffset, size_t& nSegment, size_t& nSegmentOffset) const;
+
+    /** The double-SHA256 of the bytes, the message checksum */
+    uint256 GetHash() const;
+    /** The bytes in one vector, a copy */
+    std::vector<unsigned char> ToVector() const;
+    /** Heap memory of the segments, shared ones counted in full */
+    size_t DynamicMemoryUsage() const;
+};
+
+/** SolarCoin: Serialize into a CSegmentedBuffer, appending */
+class CSegmentedWriter
+{
+public:
+    /*
+     * @param[in]  nTypeIn Serialization Type
+     * @param[in]  nVersionIn Serialization Version (including any flags)
+     * @param[in]  bufferIn Referenced buffer to append to
+     * @param[in]  args  A list of items to serialize.
+    */
+    template <typename... Args>
+    CSegmentedWriter(int nTypeIn, int nVersionIn, CSegmentedBuffer& bufferIn, Args&&... args) : nType(nTypeIn), nVersion(nVersionIn), buffer(bufferIn)
+    {
+        ::SerializeMany(*this, std::forward<Args>(args)...);
+    }
+
+    void write(const char* pch, size_t nSize)
+    {
+        buffer.write(pch, nSize);
+    }
+
+    template <typename T>
+    CSegmentedWriter& operator<<(const T& obj)
+    {
+        // Serialize to this stream
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+
+    int GetType() const
+    {
+        return nType;
+    }
+
+private:
+    const int nType;
+    const int nVersion;
+    CSegmentedBuffer& buffer;
+};
+
+#endif // BITCOIN_SEGMENTEDBUFFER_H
@@ -0,0 +1,86 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakeseen.h"
+
+#include "chain.h"
+#include "hash.h"
+#include "random.h"
+
+#include <algorithm>
+#include <limits>
+
+//! Number of slots of the first allocation
+static const size_t STAKE_SEEN_MIN_SLOTS = 1024;
+
+CStakeSeenSet::CStakeSeenSet() :
+    nEntries(0), k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
+
+uint64_t CStakeSeenSet::Hash(const COutPoint& prevout, unsigned int nTime) const
+{
+    return CSipHasher(k0, k1)
+        .Write(prevout.hash.GetUint64(0))
+        .Write(prevout.hash.GetUint64(1))
+        .Write(prevout.hash.GetUint64(2))
+        .Write(prevout.hash.GetUint64(3))
+        .Write(((uint64_t)prevout.n << 32) | nTime)
+        .Finalize();
+}
+
+void CStakeSeenSet::Resize(size_t nSlots)
+{
+    std::vector<const CBlockIndex*> vOld(nSlots, NULL);
+    vOld.swap(vSlots);
+    const size_t nMask = vSlots.size() - 1;
+    for (const CBlockIndex* pindex : vOld) {
+        if (pindex == NULL)
+            continue;
+        size_t i = Hash(pindex->GetPrevoutStake(), pindex->GetStakeTime()) & nMask;
+        while (vSlots[i] != NULL)
+            i = (i + 1) & nMask;
+        vSlots[i] = pindex;
+    }
+}
+
+void CStakeSeenSet::insert(const CBlockIndex* pindex)
+{
+    // Blocks known from their header only have no stake; the duplicate check never looks one up
+    if (pindex->GetPrevoutStake().IsNull())
+        return;
+    // Keep the load at most 3/4 so probe sequences stay short
+    if (4 * (nEntries + 1) > 3 * vSlots.size())
+        Resize(std::max(STAKE_SEEN_MIN_SLOTS, 2 * vSlots.size()));
+
+    const size_t nMask = vSlots.size() - 1;
+    size_t i = Hash(pindex->GetPrevoutStake(), pindex->GetStakeTime()) & nMask;
+    while (vSlots[i] != NULL) {
+        if (vSlots[i]->GetPrevoutStake() == pindex->GetPrevoutStake() && vSlots[i]->GetStakeTime() == pindex->GetStakeTime())
+            return;
+        i = (i + 1) & nMask;
+    }
+    vSlots[i] = pindex;
+    nEntries++;
+}
+
+size_t CStakeSeenSet::count(const std::pair<COutPoint, unsigned int>& stake) const
+{
+    if (nEntries == 0)
+        return 0;
+    const size_t nMask = vSlots.size() - 1;
+    size_t i = Hash(stake.first, stake.second) & nMask;
+    while (vSlots[i] != NULL) {
+        if (vSlots[i]->GetPrevoutStake() == stake.first && vSlots[i]->GetStakeTime() == stake.second)
+            return 1;
+        i = (i + 1) & nMask;
+    }
+    return 0;
+}
+
+void CStakeSeenSet::clear()
+{
+    std::vector<const CBlockIndex*>().swap(vSlots);
+    nEntries = 0;
+}
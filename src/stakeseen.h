@@ -0,0 +1,48 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_STAKESEEN_H
+#define BITCOIN_STAKESEEN_H
+
+#include "memusage.h"
+#include "primitives/transaction.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * SolarCoin: the stakes (kernel prevout and coinstake time) of the block index, for the duplicate
+ * stake check of ProcessNewBlock.
+ *
+ * An open-addressing hash table of block index pointers, keyed by their prevoutStake and nStakeTime,
+ * which do not change once the block is in mapBlockIndex. That costs a few pointer-sized slots per
+ * stake instead of a tree node holding a copy of it, and a lookup is a probe of adjacent slots.
+ * The hash is salted so that peers cannot aim stakes at the same slots. Guarded by cs_main.
+ */
+class CStakeSeenSet
+{
+public:
+    CStakeSeenSet();
+
+    /** Add the stake of pindex, unless it has none or the same stake was added before */
+    void insert(const CBlockIndex* pindex);
+    /** Return 1 if a block with this (prevout, time) stake was added, 0 otherwise */
+    size_t count(const std::pair<COutPoint, unsigned int>& stake) const;
+    size_t size() const { return nEntries; }
+    void clear();
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vSlots); }
+
+private:
+    uint64_t Hash(const COutPoint& prevout, unsigned int nTime) const;
+    void Resize(size_t nSlots);
+
+    std::vector<const CBlockIndex*> vSlots; //!< size is zero or a power of two, NULL marks a free slot
+    size_t nEntries;
+    uint64_t k0, k1;
+};
+
+#endif // BITCOIN_STAKESEEN_H
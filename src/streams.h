@@ -138,6 +138,96 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from an existing byte range, such as a memory-mapped file, without copying it
+ *
+ * The range must stay valid for as long as the stream reads from it
+ */
+class CSpanReader
+{
+ public:
+    CSpanReader(int nTypeIn, int nVersionIn, const unsigned char* pbeginIn, const unsigned char* pendIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pend(pendIn) {}
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pbegin))
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+    }
+    void ignore(size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pbegin))
+            throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+        pbegin += nSize;
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pbegin;
+    const unsigned char* const pend;
+};
+
+/** Minimal stream for writing into an existing fixed-size buffer, such as one on the stack, without allocating
+ *
+ * Writing past the end of the buffer throws
+ */
+class CSpanWriter
+{
+ public:
+    CSpanWriter(int nTypeIn, int nVersionIn, unsigned char* pbeginIn, unsigned char* pendIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pnext(pbeginIn), pend(pendIn) {}
+
+    template<typename T>
+    CSpanWriter& operator<<(const T& obj)
+    {
+        // Serialize to this stream
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+    void write(const char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pnext))
+            throw std::ios_base::failure("CSpanWriter::write(): end of buffer");
+        memcpy(pnext, pch, nSize);
+        pnext += nSize;
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    const unsigned char* data() const { return pbegin; }
+    //! The bytes written so far
+    size_t size() const { return pnext - pbegin; }
+private:
+    const int nType;
+    const int nVersion;
+    unsigned char* const pbegin;
+    unsigned char* pnext;
+    unsigned char* const pend;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -238,6 +328,7 @@ public:
     bool empty() const                               { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c=0)         { vch.resize(n + nReadPos, c); }
     void reserve(size_type n)                        { vch.reserve(n + nReadPos); }
+    size_type capacity() const                       { return vch.capacity() - nReadPos; }
     const_reference operator[](size_type pos) const  { return vch[pos + nReadPos]; }
     reference operator[](size_type pos)              { return vch[pos + nReadPos]; }
     void clear()                                     { vch.clear(); nReadPos = 0; }
@@ -0,0 +1,209 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include "support/largepages.h"
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * A memory resource for many small allocations of similar sizes, such as the nodes of a node-based
+ * container. Memory is taken from the system in large chunks and carved into blocks, and freed blocks
+ * go to a free list per size, to be reused by the next allocation of that size. Chunks are only
+ * returned to the system when the resource is destroyed.
+ *
+ * Allocations larger than MAX_BLOCK_SIZE_BYTES, or aligned more strictly than ALIGN_BYTES, are passed
+ * on to ::operator new.
+ *
+ * SolarCoin: With fLargePages, chunks are a multiple of LARGE_PAGE_SIZE and mapped on large pages
+ * (AllocateLargePages()) when -largepages allows, placed on the NUMA node of the allocating thread.
+ *
+ * Not thread safe; the containers using one resource must be protected by the same lock.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+
+    //! A free block, which holds the link to the next one of the same size
+    struct ListNode {
+        ListNode* pnext;
+    };
+
+    //! All blocks are a multiple of this, so that each can hold a ListNode
+    static const std::size_t ELEM_ALIGN_BYTES = ALIGN_BYTES > alignof(ListNode) ? ALIGN_BYTES : alignof(ListNode);
+    static_assert(ELEM_ALIGN_BYTES <= alignof(std::max_align_t), "chunks from ::operator new are not aligned enough");
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES, "a free block must hold a ListNode");
+
+    static std::size_t NumElemAlignBytes(std::size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    const std::size_t nChunkSizeBytes;
+    const bool fLargePages;
+    std::vector<void*> vChunks;
+    //! Whether each chunk is on large pages, rather than from ::operator new
+    std::vector<bool> vChunkLargePages;
+    //! Free lists, indexed by the block size in units of ELEM_ALIGN_BYTES
+    std::array<ListNode*, (MAX_BLOCK_SIZE_BYTES + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + 1> vFreeLists;
+    //! Rest of the last chunk that has not been handed out yet
+    char* pAvailableBegin;
+    char* pAvailableEnd;
+    //! Bytes in blocks handed out and not freed
+    std::size_t nUsedBytes;
+
+    static bool IsFreeListUsable(std::size_t bytes, std::size_t alignment)
+    {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PushToFreeList(void* p, std::size_t nNumAlignments)
+    {
+        ListNode* node = new (p) ListNode;
+        node->pnext = vFreeLists[nNumAlignments];
+        vFreeLists[nNumAlignments] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // The rest of the old chunk is still good for smaller blocks
+        if (pAvailableBegin != pAvailableEnd)
+            PushToFreeList(pAvailableBegin, (pAvailableEnd - pAvailableBegin) / ELEM_ALIGN_BYTES);
+
+        void* pChunk = fLargePages ? AllocateLargePages(nChunkSizeBytes) : NULL;
+        vChunkLargePages.push_back(pChunk != NULL);
+        if (!pChunk)
+            pChunk = ::operator new(nChunkSizeBytes);
+        vChunks.push_back(pChunk);
+        pAvailableBegin = static_cast<char*>(pChunk);
+        pAvailableEnd = pAvailableBegin + nChunkSizeBytes;
+    }
+
+    static std::size_t RoundChunkSizeBytes(std::size_t nChunkSizeBytesIn, bool fLargePagesIn)
+    {
+        const std::size_t nBytes = NumElemAlignBytes(nChunkSizeBytesIn < MAX_BLOCK_SIZE_BYTES ? MAX_BLOCK_SIZE_BYTES : nChunkSizeBytesIn) * ELEM_ALIGN_BYTES;
+        return fLargePagesIn ? (nBytes + LARGE_PAGE_SIZE - 1) / LARGE_PAGE_SIZE * LARGE_PAGE_SIZE : nBytes;
+    }
+
+public:
+    static const std::size_t DEFAULT_CHUNK_SIZE_BYTES = 1 << 18;
+
+    explicit PoolResource(std::size_t nChunkSizeBytesIn = DEFAULT_CHUNK_SIZE_BYTES, bool fLargePagesIn = false)
+        : nChunkSizeBytes(RoundChunkSizeBytes(nChunkSizeBytesIn, fLargePagesIn)), fLargePages(fLargePagesIn),
+          pAvailableBegin(NULL), pAvailableEnd(NULL), nUsedBytes(0)
+    {
+        vFreeLists.fill(NULL);
+    }
+
+    ~PoolResource()
+    {
+        for (std::size_t i = 0; i < vChunks.size(); i++) {
+            if (vChunkLargePages[i])
+                FreeLargePages(vChunks[i], nChunkSizeBytes);
+            else
+                ::operator delete(vChunks[i]);
+        }
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment))
+            return ::operator new(bytes);
+
+        const std::size_t nNumAlignments = NumElemAlignBytes(bytes);
+        nUsedBytes += nNumAlignments * ELEM_ALIGN_BYTES;
+        if (vFreeLists[nNumAlignments] != NULL) {
+            ListNode* node = vFreeLists[nNumAlignments];
+            vFreeLists[nNumAlignments] = node->pnext;
+            return node;
+        }
+        if ((std::size_t)(pAvailableEnd - pAvailableBegin) < nNumAlignments * ELEM_ALIGN_BYTES)
+            AllocateChunk();
+        void* p = pAvailableBegin;
+        pAvailableBegin += nNumAlignments * ELEM_ALIGN_BYTES;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        const std::size_t nNumAlignments = NumElemAlignBytes(bytes);
+        nUsedBytes -= nNumAlignments * ELEM_ALIGN_BYTES;
+        PushToFreeList(p, nNumAlignments);
+    }
+
+    //! Bytes in blocks that are handed out, excluding the allocations passed on to ::operator new
+    std::size_t UsedBytes() const { return nUsedBytes; }
+    std::size_t NumAllocatedChunks() const { return vChunks.size(); }
+    std::size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+};
+
+/**
+ * Allocator that takes its memory from a PoolResource. Default-constructed, or without a resource,
+ * it uses ::operator new like std::allocator. Allocators are equal when they share a resource.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() : resource(NULL) {}
+    explicit PoolAllocator(ResourceType* resourceIn) : resource(resourceIn) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) : resource(other.GetResource()) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (resource == NULL)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (resource == NULL)
+            ::operator delete(p);
+        else
+            resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* GetResource() const { return resource; }
+
+private:
+    ResourceType* resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b)
+{
+    return a.GetResource() == b.GetResource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b)
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
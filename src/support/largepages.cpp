@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "support/largepages.h"
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#ifndef WIN32
+#include <sys/mman.h> // for mmap, madvise
+#include <unistd.h> // for sysconf
+#endif
+
+#include <atomic>
+#include <stdint.h>
+
+// Some systems (at least OS X) do not define MAP_ANONYMOUS yet and define
+// MAP_ANON which is deprecated
+#if !defined(WIN32) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static std::atomic<int> nLargePagesMode(DEFAULT_LARGE_PAGES);
+
+void SetLargePagesMode(int nMode)
+{
+    nLargePagesMode = nMode;
+}
+
+int GetLargePagesMode()
+{
+    return nLargePagesMode;
+}
+
+static size_t RoundUpToLargePage(size_t nBytes)
+{
+    return (nBytes + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+}
+
+void* AllocateLargePages(size_t nBytes)
+{
+    const int nMode = nLargePagesMode;
+    if (nMode == LARGE_PAGES_NONE || nBytes == 0)
+        return NULL;
+#ifdef WIN32
+    // Large pages need the SeLockMemoryPrivilege there, the heap is used instead
+    return NULL;
+#else
+    const size_t nMapped = RoundUpToLargePage(nBytes);
+    char* p = NULL;
+#ifdef MAP_HUGETLB
+    if (nMode == LARGE_PAGES_EXPLICIT) {
+        void* pMap = mmap(NULL, nMapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pMap != MAP_FAILED)
+            p = static_cast<char*>(pMap);
+    }
+#endif
+    if (!p) {
+        // Transparent huge pages only back ranges aligned to the huge page size: map one more
+        // and unmap what lies outside the aligned range
+        void* pMap = mmap(NULL, nMapped + LARGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pMap == MAP_FAILED)
+            return NULL;
+        char* pBegin = static_cast<char*>(pMap);
+        p = reinterpret_cast<char*>(RoundUpToLargePage(reinterpret_cast<uintptr_t>(pBegin)));
+        if (p != pBegin)
+            munmap(pBegin, p - pBegin);
+        if (p + nMapped != pBegin + nMapped + LARGE_PAGE_SIZE)
+            munmap(p + nMapped, pBegin + LARGE_PAGE_SIZE - p);
+#ifdef MADV_HUGEPAGE
+        madvise(p, nMapped, MADV_HUGEPAGE);
+#endif
+    }
+    // First touch from this thread, so the pages are placed on its NUMA node rather than on
+    // that of the thread happening to touch them first later
+    const size_t nPageSize = sysconf(_SC_PAGESIZE);
+    for (size_t nOffset = 0; nOffset < nMapped; nOffset += nPageSize)
+        static_cast<volatile char*>(p)[nOffset] = 0;
+    return p;
+#endif
+}
+
+void FreeLargePages(void* p, size_t nBytes)
+{
+#ifndef WIN32
+    if (p)
+        munmap(p, RoundUpToLargePage(nBytes));
+#endif
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_LARGEPAGES_H
+#define BITCOIN_SUPPORT_LARGEPAGES_H
+
+#include <stddef.h>
+
+/** How the large hot allocations (coins cache pool, scrypt scratchpads) are backed, -largepages */
+enum LargePagesMode
+{
+    LARGE_PAGES_NONE = 0,
+    //! Transparent huge pages, asked for with madvise()
+    LARGE_PAGES_TRANSPARENT = 1,
+    //! Explicit huge pages (MAP_HUGETLB) from the vm.nr_hugepages reserve, transparent ones when it runs out
+    LARGE_PAGES_EXPLICIT = 2,
+};
+
+static const int DEFAULT_LARGE_PAGES = LARGE_PAGES_NONE;
+/** The huge page size of x86-64 and most ARM64 kernels; allocations are rounded up to it */
+static const size_t LARGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+void SetLargePagesMode(int nMode);
+int GetLargePagesMode();
+
+/**
+ * SolarCoin: Map nBytes, rounded up to LARGE_PAGE_SIZE, backed by large pages as set by
+ * SetLargePagesMode(). Every page is touched by the calling thread before returning, so that the
+ * kernel's first touch policy places the memory on the NUMA node of that thread, the one that
+ * will use it. Returns NULL if large pages are off or unavailable on the platform, in which case
+ * the caller allocates from the heap.
+ */
+void* AllocateLargePages(size_t nBytes);
+/** Unmap what AllocateLargePages(nBytes) returned */
+void FreeLargePages(void* p, size_t nBytes);
+
+#endif // BITCOIN_SUPPORT_LARGEPAGES_H
@@ -7,11 +7,57 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <mutex>
 #include <stdio.h>
 
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+std::atomic<bool> fLockProfile(DEFAULT_LOCKPROFILE);
+
+namespace {
+
+/** The lock sites profiled so far */
+struct CLockSites
+{
+    std::mutex cs;
+    std::vector<const CLockSite*> vSites;
+};
+
+CLockSites& GetLockSiteRegistry()
+{
+    // Leaked, so sites destroyed at exit never find it gone
+    static CLockSites* psites = new CLockSites();
+    return *psites;
+}
+
+} // anon namespace
+
+CLockSite::CLockSite(const char* pszNameIn, const char* pszFileIn, int nLineIn) :
+    pszName(pszNameIn), pszFile(pszFileIn), nLine(nLineIn), nContentions(0), nBlocking(0), nHoldTick(0)
+{
+    CLockSites& sites = GetLockSiteRegistry();
+    std::lock_guard<std::mutex> lock(sites.cs);
+    sites.vSites.push_back(this);
+}
+
+void RecordLockContention(CLockSite& site, CLockSite* pholder, int64_t nMicros)
+{
+    site.nContentions.fetch_add(1, std::memory_order_relaxed);
+    site.histWait.Add(nMicros);
+    if (pholder) {
+        pholder->nBlocking.fetch_add(1, std::memory_order_relaxed);
+        pholder->histBlocking.Add(nMicros);
+    }
+}
+
+std::vector<const CLockSite*> GetLockSites()
+{
+    CLockSites& sites = GetLockSiteRegistry();
+    std::lock_guard<std::mutex> lock(sites.cs);
+    return sites.vSites;
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
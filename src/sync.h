@@ -6,7 +6,12 @@
 #ifndef BITCOIN_SYNC_H
 #define BITCOIN_SYNC_H
 
+#include "latencyhistogram.h"
 #include "threadsafety.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -85,6 +90,58 @@ void static inline DeleteLock(void* cs) {}
 #endif
 #define AssertLockHeld(cs) AssertLockHeldInternal(#cs, __FILE__, __LINE__, &cs)
 
+/** -lockprofile default */
+static const bool DEFAULT_LOCKPROFILE = false;
+/** One in this many acquisitions of a lock site has its hold time sampled */
+static const unsigned int LOCK_HOLD_SAMPLE_INTERVAL = 64;
+
+/** Whether lock contention is profiled (-lockprofile), can be switched at any time */
+extern std::atomic<bool> fLockProfile;
+
+/**
+ * SolarCoin: A place in the code a lock is taken, with its contention profile. Each LOCK() has its
+ * own, made the first time it runs while profiling and kept for the life of the process. The wait
+ * for a contended lock is recorded against the site waiting, and against the site that held the
+ * lock then (when known), so the holders keeping others waiting show up. Hold times are sampled.
+ */
+class CLockSite
+{
+public:
+    const char* const pszName;
+    const char* const pszFile;
+    const int nLine;
+
+    //! Times the lock was taken here after waiting for it
+    std::atomic<uint64_t> nContentions;
+    //! Waits of the lock for it while it was held from here
+    std::atomic<uint64_t> nBlocking;
+    //! Time the lock was waited for when taken here
+    CLatencyHistogram histWait;
+    //! Time others waited for the lock held from here
+    CLatencyHistogram histBlocking;
+    //! Sampled time the lock was held from here
+    CLatencyHistogram histHold;
+
+    CLockSite(const char* pszNameIn, const char* pszFileIn, int nLineIn);
+
+    /** Whether the hold time of this acquisition is to be sampled */
+    bool SampleHold()
+    {
+        return nHoldTick.fetch_add(1, std::memory_order_relaxed) % LOCK_HOLD_SAMPLE_INTERVAL == 0;
+    }
+
+private:
+    std::atomic<unsigned int> nHoldTick;
+};
+
+/** Record a contended acquisition at a site, holder being the site holding the lock at the time or NULL */
+void RecordLockContention(CLockSite& site, CLockSite* pholder, int64_t nMicros);
+/** All the lock sites profiled so far */
+std::vector<const CLockSite*> GetLockSites();
+
+/** The static lock site of a LOCK(), returned by a function only called while profiling */
+#define LOCK_SITE(cs) []() -> CLockSite& { static CLockSite site(#cs, __FILE__, __LINE__); return site; }
+
 /**
  * Wrapped boost mutex: supports recursive locking, but no waiting
  * TODO: We should move away from using the recursive lock by default.
@@ -92,6 +149,11 @@ void static inline DeleteLock(void* cs) {}
 class CCriticalSection : public AnnotatedMixin<boost::recursive_mutex>
 {
 public:
+    //! The lock site holding it, while lock contention is profiled
+    std::atomic<CLockSite*> pProfileHolder;
+
+    CCriticalSection() : pProfileHolder(NULL) {}
+
     ~CCriticalSection() {
         DeleteLock((void*)this);
     }
@@ -114,10 +176,29 @@ class SCOPED_LOCKABLE CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    //! Lock site, while profiled
+    CLockSite* psite;
+    //! Lock site that held the mutex before, for recursive locks
+    CLockSite* pprevHolder;
+    //! When the mutex was taken, if its hold time is sampled
+    int64_t nTimeHeld;
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        if (psite) {
+            if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
+                PrintLockContention(pszName, pszFile, nLine);
+#endif
+                CLockSite* pholder = lock.mutex()->pProfileHolder.load(std::memory_order_relaxed);
+                int64_t nTimeStart = GetTimeMicros();
+                lock.lock();
+                RecordLockContention(*psite, pholder, GetTimeMicros() - nTimeStart);
+            }
+            Held();
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -134,33 +215,53 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (psite)
+            Held();
         return lock.owns_lock();
     }
 
-public:
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock)
+    void Held()
     {
+        pprevHolder = lock.mutex()->pProfileHolder.exchange(psite, std::memory_order_relaxed);
+        if (psite->SampleHold())
+            nTimeHeld = GetTimeMicros();
+    }
+
+    void Init(bool fTry, const char* pszName, const char* pszFile, int nLine, CLockSite& (*pGetSite)())
+    {
+        psite = pGetSite && fLockProfile.load(std::memory_order_relaxed) ? &pGetSite() : NULL;
+        pprevHolder = NULL;
+        nTimeHeld = 0;
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
         else
             Enter(pszName, pszFile, nLine);
     }
 
-    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+public:
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false, CLockSite& (*pGetSite)() = NULL) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock)
+    {
+        Init(fTry, pszName, pszFile, nLine, pGetSite);
+    }
+
+    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false, CLockSite& (*pGetSite)() = NULL) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : psite(NULL)
     {
         if (!pmutexIn) return;
 
         lock = boost::unique_lock<Mutex>(*pmutexIn, boost::defer_lock);
-        if (fTry)
-            TryEnter(pszName, pszFile, nLine);
-        else
-            Enter(pszName, pszFile, nLine);
+        Init(fTry, pszName, pszFile, nLine, pGetSite);
     }
 
     ~CMutexLock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            if (psite) {
+                lock.mutex()->pProfileHolder.store(pprevHolder, std::memory_order_relaxed);
+                if (nTimeHeld)
+                    psite->histHold.Add(GetTimeMicros() - nTimeHeld);
+            }
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -174,9 +275,31 @@ typedef CMutexLock<CCriticalSection> CCriticalBlock;
 #define PASTE(x, y) x ## y
 #define PASTE2(x, y) PASTE(x, y)
 
-#define LOCK(cs) CCriticalBlock PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
-#define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__), criticalblock2(cs2, #cs2, __FILE__, __LINE__)
-#define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true)
+#define LOCK(cs) CCriticalBlock PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__, false, LOCK_SITE(cs))
+#define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__, false, LOCK_SITE(cs1)), criticalblock2(cs2, #cs2, __FILE__, __LINE__, false, LOCK_SITE(cs2))
+#define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true, LOCK_SITE(cs))
+
+/**
+ * SolarCoin: boost::unique_lock of a CWaitableCriticalSection, to wait on a condition variable
+ * with, whose contention is profiled. Condition waits release the mutex, so neither its hold
+ * times nor its holders are recorded.
+ */
+class CWaitableLock : public boost::unique_lock<boost::mutex>
+{
+public:
+    CWaitableLock(CWaitableCriticalSection& mutexIn, CLockSite& (*pGetSite)()) : boost::unique_lock<boost::mutex>(mutexIn, boost::defer_lock)
+    {
+        if (fLockProfile.load(std::memory_order_relaxed) && !try_lock()) {
+            int64_t nTimeStart = GetTimeMicros();
+            lock();
+            RecordLockContention(pGetSite(), NULL, GetTimeMicros() - nTimeStart);
+        } else if (!owns_lock()) {
+            lock();
+        }
+    }
+};
+
+#define WAIT_LOCK(cs, name) CWaitableLock name(cs, LOCK_SITE(cs))
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
     {                                                         \
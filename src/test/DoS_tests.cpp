@@ -17,6 +17,7 @@
 #include "test/test_bitcoin.h"
 
 #include <stdint.h>
+#include <limits>
 
 #include <boost/assign/list_of.hpp> // for 'map_list_of()'
 #include <boost/date_time/posix_time/posix_time_types.hpp>
@@ -26,13 +27,15 @@
 // Tests these internal-to-net_processing.cpp methods:
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphanUsage);
 struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    size_t nUsage;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern size_t nOrphanTxUsage;
 
 CService ip(uint32_t i)
 {
@@ -207,12 +210,123 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    const size_t nNoUsageLimit = std::numeric_limits<size_t>::max();
+    LimitOrphanTxSize(40, nNoUsageLimit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    LimitOrphanTxSize(10, nNoUsageLimit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+    size_t nUsageBefore = nOrphanTxUsage;
+    BOOST_CHECK(nUsageBefore > 0);
+    LimitOrphanTxSize(10, nUsageBefore - 1);
+    BOOST_CHECK(nOrphanTxUsage < nUsageBefore);
+    LimitOrphanTxSize(0, nNoUsageLimit);
     BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxUsage, 0U);
+
+    // A peer may only fill its share of -maxorphantxsize
+    size_t nPeerOrphans = 0;
+    for (int i = 0; i < 100000; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        if (!AddOrphanTx(MakeTransactionRef(tx), 0))
+            break;
+        nPeerOrphans++;
+    }
+    BOOST_CHECK(nPeerOrphans > 0 && nPeerOrphans < 100000);
+    BOOST_CHECK(nOrphanTxUsage <= DEFAULT_MAX_ORPHAN_TX_SIZE * 1000 / ORPHAN_TX_PEER_SHARE);
+    EraseOrphansFor(0);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_limits)
+{
+    // Until enough blocks are delivered, the fixed limit applies
+    CBlockDownloadStats stats;
+    BOOST_CHECK(!stats.IsMeasured());
+    BOOST_CHECK_EQUAL(stats.GetRate(), 0);
+    BOOST_CHECK_EQUAL(stats.GetBlocksInTransitLimit(), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // A block every 100 ms: BLOCKS_IN_TRANSIT_TARGET_TIME worth of them may be in flight
+    int64_t nNow = 1000000000;
+    for (int i = 0; i < BLOCK_DOWNLOAD_MIN_SAMPLES; i++) {
+        nNow += 100000;
+        stats.BlockReceived(nNow, nNow - 100000);
+    }
+    BOOST_CHECK(stats.IsMeasured());
+    BOOST_CHECK_EQUAL(stats.nBlockInterval, 100000);
+    BOOST_CHECK_EQUAL(stats.nBlockLatency, 100000);
+    BOOST_CHECK_EQUAL(stats.GetRate(), 10);
+    BOOST_CHECK_EQUAL(stats.GetBlocksInTransitLimit(), 10 * BLOCKS_IN_TRANSIT_TARGET_TIME);
+
+    // Blocks requested while others were in flight are timed from the previous arrival
+    for (int i = 0; i < 8; i++) {
+        nNow += 100000;
+        stats.BlockReceived(nNow, nNow - 500000);
+    }
+    BOOST_CHECK_EQUAL(stats.nBlockInterval, 100000);
+    BOOST_CHECK(stats.nBlockLatency > 100000);
+
+    // Within bounds for very fast and very slow peers
+    CBlockDownloadStats statsFast, statsSlow;
+    for (int i = 0; i < BLOCK_DOWNLOAD_MIN_SAMPLES; i++) {
+        statsFast.BlockReceived(nNow + 1000 * (i + 1), nNow + 1000 * i);
+        statsSlow.BlockReceived(nNow + 10000000 * (i + 1), nNow + 10000000 * i);
+    }
+    BOOST_CHECK_EQUAL(statsFast.GetBlocksInTransitLimit(), MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(statsSlow.GetBlocksInTransitLimit(), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_window)
+{
+    // Until a rate is measured, the fixed window applies
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(0, 0), BLOCK_DOWNLOAD_WINDOW);
+
+    // BLOCK_DOWNLOAD_WINDOW_TIME of the slower of the download and validation rates
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(50, 20), (unsigned int)(20 * BLOCK_DOWNLOAD_WINDOW_TIME));
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(20, 50), (unsigned int)(20 * BLOCK_DOWNLOAD_WINDOW_TIME));
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(20, 0), (unsigned int)(20 * BLOCK_DOWNLOAD_WINDOW_TIME));
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(0, 20), (unsigned int)(20 * BLOCK_DOWNLOAD_WINDOW_TIME));
+
+    // Within bounds
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1, 1), MIN_BLOCK_DOWNLOAD_WINDOW);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1000, 1000), MAX_BLOCK_DOWNLOAD_WINDOW);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_stalls)
+{
+    CBlockDownloadStats stats;
+    for (int i = 0; i < MAX_BLOCK_STALLS - 1; i++)
+        stats.BlockStalled();
+    BOOST_CHECK(!stats.IsStalling());
+    stats.BlockStalled();
+    BOOST_CHECK(stats.IsStalling());
+
+    // One stall is forgiven every BLOCK_STALL_FORGIVE_BLOCKS blocks delivered
+    int64_t nNow = 1000000000;
+    for (int i = 0; i < BLOCK_STALL_FORGIVE_BLOCKS - 1; i++) {
+        nNow += 100000;
+        stats.BlockReceived(nNow, nNow - 100000);
+    }
+    BOOST_CHECK(stats.IsStalling());
+    nNow += 100000;
+    stats.BlockReceived(nNow, nNow - 100000);
+    BOOST_CHECK(!stats.IsStalling());
+    BOOST_CHECK_EQUAL(stats.nBlockStalls, MAX_BLOCK_STALLS - 1);
+
+    // Down to none
+    for (int i = 0; i < BLOCK_STALL_FORGIVE_BLOCKS * MAX_BLOCK_STALLS; i++) {
+        nNow += 100000;
+        stats.BlockReceived(nNow, nNow - 100000);
+    }
+    BOOST_CHECK_EQUAL(stats.nBlockStalls, 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
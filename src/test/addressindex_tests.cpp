@@ -0,0 +1,116 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "chain.h"
+#include "primitives/block.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "undo.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_script_types)
+{
+    const CKeyID keyID(uint160(std::vector<unsigned char>(20, 0x12)));
+    const CScriptID scriptID(uint160(std::vector<unsigned char>(20, 0x34)));
+    uint160 hashBytes;
+    BOOST_CHECK_EQUAL(ScriptToAddressIndex(GetScriptForDestination(keyID), hashBytes), ADDRESS_TYPE_PUBKEYHASH);
+    BOOST_CHECK(hashBytes == keyID);
+    BOOST_CHECK_EQUAL(ScriptToAddressIndex(GetScriptForDestination(scriptID), hashBytes), ADDRESS_TYPE_SCRIPTHASH);
+    BOOST_CHECK(hashBytes == scriptID);
+    BOOST_CHECK_EQUAL(ScriptToAddressIndex(CScript() << OP_RETURN, hashBytes), ADDRESS_TYPE_NONE);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    // tx1 pays 5 to A; tx2 spends it in the same block, paying 3 to B and 2 back to A
+    IndexTestBlock test;
+    const CKeyID& keyA = test.keyA;
+    const CKeyID& keyB = test.keyB;
+    const CBlock& block = test.block;
+    const CBlockUndo& blockundo = test.blockundo;
+    const CMutableTransaction& tx1 = test.tx1;
+    const CMutableTransaction& tx2 = test.tx2;
+    CBlockIndex& index = test.index;
+
+    CAddressIndex addressindex(true, true, 1 << 20, true);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(addressindex.ConnectBlock(block, blockundo, &index));
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+    BOOST_CHECK(addressindex.GetAddressDeltas(ADDRESS_TYPE_PUBKEYHASH, keyA, 0, -1, vDeltas));
+    BOOST_CHECK_EQUAL(vDeltas.size(), 4U);
+    CAmount nBalance = 0;
+    for (const auto& delta : vDeltas)
+        nBalance += delta.second;
+    BOOST_CHECK_EQUAL(nBalance, -6 * COIN + 5 * COIN - 5 * COIN + 2 * COIN);
+
+    // Out of the height range
+    vDeltas.clear();
+    BOOST_CHECK(addressindex.GetAddressDeltas(ADDRESS_TYPE_PUBKEYHASH, keyA, 11, -1, vDeltas));
+    BOOST_CHECK(vDeltas.empty());
+
+    // Only tx2's change is left unspent for A; B has the coinbase and tx2's payment
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(addressindex.GetAddressUnspent(ADDRESS_TYPE_PUBKEYHASH, keyA, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.outpoint == COutPoint(tx2.GetHash(), 1));
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 2 * COIN);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nHeight, 10);
+    vUnspent.clear();
+    BOOST_CHECK(addressindex.GetAddressUnspent(ADDRESS_TYPE_PUBKEYHASH, keyB, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 2U);
+
+    // Limited reads keep the first transactions and the oldest outputs, in order
+    vDeltas.clear();
+    BOOST_CHECK(addressindex.GetAddressDeltas(ADDRESS_TYPE_PUBKEYHASH, keyA, 0, -1, vDeltas, 1));
+    BOOST_CHECK_EQUAL(vDeltas.size(), 2U);
+    BOOST_CHECK(vDeltas[0].first.txid == vDeltas[1].first.txid);
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentFirst;
+    BOOST_CHECK(addressindex.GetAddressUnspent(ADDRESS_TYPE_PUBKEYHASH, keyB, vUnspentFirst, 0, -1, 1));
+    BOOST_CHECK_EQUAL(vUnspentFirst.size(), 1U);
+    BOOST_CHECK(vUnspentFirst[0].first.outpoint == vUnspent[0].first.outpoint);
+    vUnspentFirst.clear();
+    BOOST_CHECK(addressindex.GetAddressUnspent(ADDRESS_TYPE_PUBKEYHASH, keyB, vUnspentFirst, 11, -1));
+    BOOST_CHECK(vUnspentFirst.empty());
+
+    CSpentIndexValue spent;
+    BOOST_CHECK(addressindex.GetSpentInfo(COutPoint(tx1.GetHash(), 0), spent));
+    BOOST_CHECK(spent.txid == tx2.GetHash());
+    BOOST_CHECK_EQUAL(spent.nInputIndex, 0U);
+    BOOST_CHECK_EQUAL(spent.nHeight, 10);
+    BOOST_CHECK_EQUAL(spent.nValue, 5 * COIN);
+    BOOST_CHECK(spent.hashBytes == keyA);
+    BOOST_CHECK(!addressindex.GetSpentInfo(COutPoint(tx2.GetHash(), 0), spent));
+
+    // Disconnecting the block restores the output it spent from before, and nothing else
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(addressindex.DisconnectBlock(block, blockundo, &index));
+    }
+    vDeltas.clear();
+    BOOST_CHECK(addressindex.GetAddressDeltas(ADDRESS_TYPE_PUBKEYHASH, keyA, 0, -1, vDeltas));
+    BOOST_CHECK(vDeltas.empty());
+    vUnspent.clear();
+    BOOST_CHECK(addressindex.GetAddressUnspent(ADDRESS_TYPE_PUBKEYHASH, keyA, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.outpoint == COutPoint(uint256S("0xabcdef"), 0));
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nHeight, 7);
+    vUnspent.clear();
+    BOOST_CHECK(addressindex.GetAddressUnspent(ADDRESS_TYPE_PUBKEYHASH, keyB, vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    BOOST_CHECK(!addressindex.GetSpentInfo(COutPoint(tx1.GetHash(), 0), spent));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,9 +6,11 @@
 #include <string>
 #include <boost/test/unit_test.hpp>
 
+#include "clientversion.h"
 #include "hash.h"
 #include "netbase.h"
 #include "random.h"
+#include "streams.h"
 
 class CAddrManTest : public CAddrMan
 {
@@ -238,6 +240,78 @@ BOOST_AUTO_TEST_CASE(addrman_new_collisions)
     BOOST_CHECK(addrman.size() == 18);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_add_batch)
+{
+    CAddrManTest addrman;
+    CAddrManTest addrmanSingle;
+
+    // Set addrman addr placement to be deterministic.
+    addrman.MakeDeterministic();
+    addrmanSingle.MakeDeterministic();
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    // The batch lands in the same positions as single adds, with the same collision
+    std::vector<CAddress> vAddr;
+    for (unsigned int i = 1; i < 20; i++)
+        vAddr.push_back(CAddress(ResolveService("250.1.1." + boost::to_string(i)), NODE_NONE));
+    vAddr.push_back(CAddress(ResolveService("250.1.1.1", 8334), NODE_NONE));
+    vAddr.push_back(CAddress(CService(), NODE_NONE));
+    BOOST_CHECK(addrman.Add(vAddr, source));
+    for (const CAddress& addr : vAddr)
+        addrmanSingle.Add(addr, source);
+    BOOST_CHECK(addrman.size() == 18);
+    BOOST_CHECK(addrmanSingle.size() == 18);
+    for (const CAddress& addr : vAddr)
+        BOOST_CHECK((addrman.Find(addr) == NULL) == (addrmanSingle.Find(addr) == NULL));
+
+    // The entry keeps its first port
+    CAddrInfo* info = addrman.Find(ResolveService("250.1.1.1", 8334));
+    BOOST_REQUIRE(info != NULL);
+    BOOST_CHECK_EQUAL(info->GetPort(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_journal)
+{
+    CAddrManTest addrman;
+    CAddrManTest addrmanRestored;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    CAddress addr1 = CAddress(ResolveService("250.1.1.1", 8333), NODE_NONE);
+    CAddress addr2 = CAddress(ResolveService("250.1.1.2", 8333), NODE_NONE);
+    addrman.Add(addr1, source);
+
+    // A snapshot includes every change so far
+    CDataStream ssSnapshot(SER_DISK, CLIENT_VERSION);
+    addrman.Snapshot(ssSnapshot);
+    std::vector<CAddrJournalRecord> vRecords;
+    addrman.GetChanges(vRecords);
+    BOOST_CHECK(vRecords.empty());
+    ssSnapshot >> addrmanRestored;
+    BOOST_CHECK(addrmanRestored.size() == 1);
+
+    // New and updated entries are journaled once, and replay on top of the snapshot
+    addrman.Add(addr2, source);
+    addrman.Connected(CService(addr1), 1000000000);
+    addrman.SetServices(CService(addr1), NODE_NETWORK);
+    addrman.SetServices(CService(addr2), NODE_NETWORK);
+    addrman.GetChanges(vRecords);
+    BOOST_CHECK(vRecords.size() == 2);
+    std::vector<CAddrJournalRecord> vRecordsAgain;
+    addrman.GetChanges(vRecordsAgain);
+    BOOST_CHECK(vRecordsAgain.empty());
+
+    for (const CAddrJournalRecord& record : vRecords)
+        addrmanRestored.Restore(record);
+    BOOST_CHECK(addrmanRestored.size() == 2);
+    CAddrInfo* info1 = addrmanRestored.Find(addr1);
+    CAddrInfo* info2 = addrmanRestored.Find(addr2);
+    BOOST_REQUIRE(info1 != NULL && info2 != NULL);
+    BOOST_CHECK_EQUAL(info1->nTime, 1000000000U);
+    BOOST_CHECK(info1->nServices == NODE_NETWORK);
+    BOOST_CHECK(info2->nServices == NODE_NETWORK);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_tried_collisions)
 {
     CAddrManTest addrman;
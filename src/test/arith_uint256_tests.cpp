@@ -13,6 +13,7 @@
 #include <string>
 #include "version.h"
 #include "test/test_bitcoin.h"
+#include "test/test_random.h"
 
 BOOST_FIXTURE_TEST_SUITE(arith_uint256_tests, BasicTestingSetup)
 
@@ -368,6 +369,56 @@ BOOST_AUTO_TEST_CASE( divide )
     BOOST_CHECK_THROW(R2L / ZeroL, uint_error);
 }
 
+/** A random number of up to nLimbs 32-bit limbs, with runs of all-ones and zero limbs */
+static arith_uint256 RandomLimbs(int nLimbs)
+{
+    arith_uint256 n;
+    for (int i = 0; i < nLimbs; i++) {
+        const uint32_t r = insecure_rand();
+        n = (n << 32) | arith_uint256(r % 8 == 0 ? 0xffffffff : r % 8 == 1 ? 0 : insecure_rand());
+    }
+    return n;
+}
+
+/** The bit at a time long division the limb at a time one replaced */
+static arith_uint256 ReferenceDivide(arith_uint256 num, arith_uint256 div)
+{
+    arith_uint256 quotient;
+    int shift = num.bits() - div.bits();
+    if (shift < 0)
+        return quotient;
+    div <<= shift;
+    for (; shift >= 0; shift--) {
+        if (num >= div) {
+            num -= div;
+            quotient |= OneL << shift;
+        }
+        div >>= 1;
+    }
+    return quotient;
+}
+
+BOOST_AUTO_TEST_CASE( multiply_divide_random )
+{
+    // SolarCoin: the 64-bit limb multiplication and the limb at a time division give exactly
+    // what shift-and-add and shift-and-subtract do
+    for (int i = 0; i < 2000; i++) {
+        const arith_uint256 a = RandomLimbs(1 + insecure_rand() % 8);
+        const arith_uint256 b = RandomLimbs(1 + insecure_rand() % 8);
+        arith_uint256 product;
+        for (unsigned int bit = 0; bit < b.bits(); bit++) {
+            if (((b >> bit) & OneL) == OneL)
+                product += a << bit;
+        }
+        BOOST_CHECK(a * b == product);
+        if (b == 0)
+            continue;
+        const arith_uint256 quotient = a / b;
+        BOOST_CHECK(quotient == ReferenceDivide(a, b));
+        BOOST_CHECK(a - quotient * b < b);
+    }
+}
+
 
 bool almostEqual(double d1, double d2)
 {
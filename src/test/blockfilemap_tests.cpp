@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "streams.h"
+#include "validation.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+/** Append a record as WriteBlockToDisk() does, and return its position */
+static CDiskBlockPos AppendRecord(int nFile, const std::string& strData, unsigned int nSize)
+{
+    CAutoFile fileout(OpenBlockFile(CDiskBlockPos(nFile, 0)), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    BOOST_REQUIRE(fseek(fileout.Get(), 0, SEEK_END) == 0);
+    fileout << FLATDATA(Params().MessageStart()) << nSize;
+    CDiskBlockPos pos(nFile, ftell(fileout.Get()));
+    fileout.write(strData.data(), strData.size());
+    return pos;
+}
+
+static std::string RecordString(const CMappedRecord& record)
+{
+    return std::string(record.pbegin, record.pend);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_records)
+{
+    const int nFile = 999;
+    CMappedRecord record;
+    CDiskBlockPos pos1 = AppendRecord(nFile, "hello", 5);
+
+    // Off by default
+    BOOST_CHECK(!MapBlockFileRecord(pos1, false, 0, record));
+
+    nBlockFileMapBudget = 1 << 20;
+    BOOST_CHECK(MapBlockFileRecord(pos1, false, 0, record));
+    BOOST_CHECK_EQUAL(RecordString(record), "hello");
+
+    // A record appended after the file was mapped is found by mapping it again, and the first
+    // mapping stays valid for the record still holding it
+    CDiskBlockPos pos2 = AppendRecord(nFile, "world!", 6);
+    CMappedRecord record2;
+    BOOST_CHECK(MapBlockFileRecord(pos2, false, 0, record2));
+    BOOST_CHECK_EQUAL(RecordString(record2), "world!");
+    BOOST_CHECK_EQUAL(RecordString(record), "hello");
+
+    // The trailer is part of the record
+    BOOST_CHECK(MapBlockFileRecord(pos1, false, 8, record));
+    BOOST_CHECK_EQUAL(RecordString(record), std::string("hello") + std::string((const char*)Params().MessageStart(), 4) + std::string("\x06\x00\x00\x00", 4));
+
+    // A record running past the end of the file, or in a file that does not exist, is not mapped
+    CDiskBlockPos pos3 = AppendRecord(nFile, "ab", 100);
+    BOOST_CHECK(!MapBlockFileRecord(pos3, false, 0, record2));
+    BOOST_CHECK(!MapBlockFileRecord(pos1, true, 0, record2));
+    BOOST_CHECK(!MapBlockFileRecord(CDiskBlockPos(nFile + 1, 8), false, 0, record2));
+
+    UnmapBlockFile(nFile);
+    BOOST_CHECK_EQUAL(RecordString(record), std::string("hello") + std::string((const char*)Params().MessageStart(), 4) + std::string("\x06\x00\x00\x00", 4));
+    nBlockFileMapBudget = DEFAULT_BLOCKFILE_MMAP * 1024 * 1024;
+    UnmapBlockFiles();
+}
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    std::vector<unsigned char> vch;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, vch, 0, std::string("span"), (uint32_t)7);
+
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, vch.data(), vch.data() + vch.size());
+    std::string str;
+    uint32_t n;
+    reader >> str >> n;
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK_EQUAL(n, 7U);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
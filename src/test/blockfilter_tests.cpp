@@ -0,0 +1,116 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "primitives/block.h"
+#include "pubkey.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "uint256.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+static GCSElement Element(unsigned int n)
+{
+    GCSElement element(8);
+    for (unsigned int i = 0; i < 4; i++)
+        element[i] = (n >> (8 * i)) & 0xff;
+    element[4] = 0x5c;
+    return element;
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    const uint256 key = uint256S("0x6f3a1d2c9b8e7f60514233245566778899aabbccddeeff00112233445566778");
+    std::vector<GCSElement> vElements;
+    for (unsigned int n = 0; n < 1000; n++)
+        vElements.push_back(Element(n));
+    // Duplicates are only counted once
+    vElements.push_back(Element(7));
+
+    CGCSFilter filter(key, vElements);
+    BOOST_CHECK_EQUAL(filter.GetN(), 1000U);
+    for (const GCSElement& element : vElements)
+        BOOST_CHECK(filter.Match(element));
+
+    // Elements that are not in the set rarely match, at a rate of 1/M
+    unsigned int nFalsePositives = 0;
+    for (unsigned int n = 1000; n < 11000; n++)
+        if (filter.Match(Element(n)))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives < 5);
+
+    std::vector<GCSElement> vQuery;
+    for (unsigned int n = 5000; n < 5100; n++)
+        vQuery.push_back(Element(n));
+    BOOST_CHECK(!filter.MatchAny(vQuery));
+    vQuery.push_back(Element(999));
+    BOOST_CHECK(filter.MatchAny(vQuery));
+
+    // The encoding decodes to the same set
+    CGCSFilter decoded(key, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), filter.GetN());
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    for (unsigned int n = 0; n < 1000; n += 37)
+        BOOST_CHECK(decoded.Match(Element(n)));
+
+    // Under another key the same elements hash differently
+    CGCSFilter other(uint256S("0x01"), vElements);
+    BOOST_CHECK(other.GetEncoded() != filter.GetEncoded());
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_empty)
+{
+    CGCSFilter filter(uint256S("0x01"), std::vector<GCSElement>());
+    BOOST_CHECK_EQUAL(filter.GetN(), 0U);
+    BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1U);
+    BOOST_CHECK(!filter.Match(Element(0)));
+    BOOST_CHECK(!filter.MatchAny(std::vector<GCSElement>(1, Element(0))));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_contents)
+{
+    CScript scriptPayTo = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 0x12))));
+    CScript scriptOther = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 0x56))));
+    CScript scriptData = CScript() << OP_RETURN << std::vector<unsigned char>(20, 0x42);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].scriptPubKey = scriptOther;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(uint256S("0xabcdef"), 3);
+    tx.vout.resize(2);
+    tx.vout[0].scriptPubKey = scriptPayTo;
+    tx.vout[1].scriptPubKey = scriptData;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(tx));
+    const uint256 hashBlock = block.GetHash();
+
+    CGCSFilter filter = BuildBlockFilter(block, hashBlock);
+    BOOST_CHECK_EQUAL(filter.GetN(), 3U);
+    BOOST_CHECK(filter.Match(ScriptFilterElement(scriptPayTo)));
+    BOOST_CHECK(filter.Match(ScriptFilterElement(scriptOther)));
+    BOOST_CHECK(filter.Match(OutPointFilterElement(COutPoint(uint256S("0xabcdef"), 3))));
+    BOOST_CHECK(!filter.Match(ScriptFilterElement(scriptData)));
+    BOOST_CHECK(!filter.Match(OutPointFilterElement(coinbase.vin[0].prevout)));
+    BOOST_CHECK(!filter.Match(OutPointFilterElement(COutPoint(uint256S("0xabcdef"), 4))));
+
+    // A filter read back under its block hash matches the same
+    CGCSFilter decoded(hashBlock, filter.GetEncoded());
+    BOOST_CHECK(decoded.Match(ScriptFilterElement(scriptPayTo)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
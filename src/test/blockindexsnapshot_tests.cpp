@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "amount.h"
+#include "blockindexsnapshot.h"
+#include "chain.h"
+#include "random.h"
+#include "util.h"
+#include "test/test_bitcoin.h"
+#include "test/testutil.h"
+
+#include <limits>
+#include <map>
+#include <memory>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+/** Block index entries keyed by hash, as mapBlockIndex and InsertBlockIndex() keep them */
+struct CTestBlockIndex
+{
+    std::map<uint256, std::unique_ptr<CBlockIndex> > mapIndex;
+
+    CBlockIndex* Insert(const uint256& hash)
+    {
+        std::unique_ptr<CBlockIndex>& pindex = mapIndex[hash];
+        if (!pindex) {
+            pindex.reset(new CBlockIndex());
+            pindex->phashBlock = &mapIndex.find(hash)->first;
+        }
+        return pindex.get();
+    }
+};
+
+void CheckEqual(const CBlockIndex* a, const CBlockIndex* b)
+{
+    BOOST_CHECK(a->GetBlockHash() == b->GetBlockHash());
+    BOOST_CHECK(a->pprev ? b->pprev && a->pprev->GetBlockHash() == b->pprev->GetBlockHash() : !b->pprev);
+    BOOST_CHECK_EQUAL(a->nHeight, b->nHeight);
+    BOOST_CHECK_EQUAL(a->nStatus, b->nStatus);
+    BOOST_CHECK_EQUAL(a->nTx, b->nTx);
+    BOOST_CHECK_EQUAL(a->nFile, b->nFile);
+    BOOST_CHECK_EQUAL(a->nDataPos, b->nDataPos);
+    BOOST_CHECK_EQUAL(a->nUndoPos, b->nUndoPos);
+    BOOST_CHECK_EQUAL(a->nMint, b->nMint);
+    BOOST_CHECK_EQUAL(a->nMoneySupply, b->nMoneySupply);
+    BOOST_CHECK_EQUAL(a->nFlags, b->nFlags);
+    BOOST_CHECK_EQUAL(a->nStakeModifier, b->nStakeModifier);
+    BOOST_CHECK_EQUAL(a->nStakeModifierChecksum, b->nStakeModifierChecksum);
+    BOOST_CHECK_EQUAL(a->nVersion, b->nVersion);
+    BOOST_CHECK(a->hashMerkleRoot == b->hashMerkleRoot);
+    BOOST_CHECK_EQUAL(a->nTime, b->nTime);
+    BOOST_CHECK_EQUAL(a->nBits, b->nBits);
+    BOOST_CHECK_EQUAL(a->nNonce, b->nNonce);
+    BOOST_CHECK(a->GetPrevoutStake() == b->GetPrevoutStake());
+    BOOST_CHECK_EQUAL(a->GetStakeTime(), b->GetStakeTime());
+    BOOST_CHECK(a->GetHashProofOfStake() == b->GetHashProofOfStake());
+}
+
+} // anon namespace
+
+BOOST_FIXTURE_TEST_SUITE(blockindexsnapshot_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_roundtrip)
+{
+    // A chain of proof-of-work then proof-of-stake entries, with a fork
+    CTestBlockIndex index;
+    std::vector<const CBlockIndex*> vIndex;
+    for (int i = 0; i < 200; i++) {
+        CBlockIndex* pindex = index.Insert(GetRandHash());
+        pindex->pprev = i == 0 ? NULL : const_cast<CBlockIndex*>(vIndex[i < 150 ? i - 1 : i - 50]);
+        pindex->nHeight = pindex->pprev ? pindex->pprev->nHeight + 1 : 0;
+        pindex->nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA | (i % 3 ? BLOCK_HAVE_UNDO : 0) | BLOCK_HAVE_STAKE_CHECKSUM;
+        pindex->nTx = 1 + i % 7;
+        pindex->nFile = i / 50;
+        pindex->nDataPos = 8 + 1000 * i;
+        pindex->nUndoPos = pindex->nStatus & BLOCK_HAVE_UNDO ? 8 + 100 * i : 0;
+        pindex->nMint = 100 * COIN + i;
+        pindex->nMoneySupply = 1000000 * COIN + 100 * COIN * i;
+        pindex->nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        pindex->nStakeModifierChecksum = GetRand(0xffffffff);
+        pindex->nVersion = 7;
+        pindex->hashMerkleRoot = GetRandHash();
+        pindex->nTime = 1500000000 + 60 * i;
+        pindex->nBits = 0x1e0fffff;
+        pindex->nNonce = i;
+        if (i >= 100) {
+            pindex->SetProofOfStake();
+            pindex->SetStake(COutPoint(GetRandHash(), i % 3), pindex->nTime - 600);
+            pindex->SetHashProofOfStake(GetRandHash());
+        }
+        vIndex.push_back(pindex);
+    }
+
+    boost::filesystem::path path = GetTempPath() / strprintf("test_solarcoin_blockindex_%lu.snapshot", (unsigned long)GetRand(1000000));
+    const uint64_t nId = GetRand(std::numeric_limits<uint64_t>::max());
+    const uint256 hashState = GetRandHash();
+    BOOST_CHECK(WriteBlockIndexSnapshot(path, nId, hashState, vIndex));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), BLOCK_INDEX_SNAPSHOT_HEADER_SIZE + vIndex.size() * BLOCK_INDEX_SNAPSHOT_ENTRY_SIZE);
+
+    CTestBlockIndex loaded;
+    std::vector<CBlockIndex*> vLoaded;
+    BOOST_CHECK(ReadBlockIndexSnapshot(path, nId, hashState, boost::bind(&CTestBlockIndex::Insert, &loaded, _1), vLoaded));
+    BOOST_CHECK_EQUAL(vLoaded.size(), vIndex.size());
+    BOOST_CHECK_EQUAL(loaded.mapIndex.size(), index.mapIndex.size());
+    for (size_t i = 0; i < vLoaded.size() && i < vIndex.size(); i++)
+        CheckEqual(vIndex[i], vLoaded[i]);
+
+    // The snapshot of another state of the database, or a damaged one, is not loaded at all
+    CTestBlockIndex other;
+    std::vector<CBlockIndex*> vOther;
+    BOOST_CHECK(!ReadBlockIndexSnapshot(path, nId + 1, hashState, boost::bind(&CTestBlockIndex::Insert, &other, _1), vOther));
+    BOOST_CHECK(!ReadBlockIndexSnapshot(path, nId, GetRandHash(), boost::bind(&CTestBlockIndex::Insert, &other, _1), vOther));
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 1);
+    BOOST_CHECK(!ReadBlockIndexSnapshot(path, nId, hashState, boost::bind(&CTestBlockIndex::Insert, &other, _1), vOther));
+    BOOST_CHECK(other.mapIndex.empty());
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
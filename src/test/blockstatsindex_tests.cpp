@@ -0,0 +1,99 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstatsindex.h"
+#include "chain.h"
+#include "primitives/block.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "undo.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstatsindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockstats_proof_of_stake)
+{
+    const CScript script = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 0xaa))));
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].SetEmpty();
+
+    // The coinstake stakes 100 received a day before, and pays 101 back
+    CMutableTransaction coinstake;
+    coinstake.nTime = 1600086400;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(uint256S("0x01"), 0);
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1] = CTxOut(101 * COIN, script);
+
+    // Two payments with fees of 1 and 3
+    CMutableTransaction tx1;
+    tx1.vin.resize(2);
+    tx1.vin[0].prevout = COutPoint(uint256S("0x02"), 0);
+    tx1.vin[1].prevout = COutPoint(uint256S("0x02"), 1);
+    tx1.vout.resize(1);
+    tx1.vout[0] = CTxOut(9 * COIN, script);
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(uint256S("0x03"), 0);
+    tx2.vout.resize(2);
+    tx2.vout[0] = CTxOut(4 * COIN, script);
+    tx2.vout[1] = CTxOut(3 * COIN, script);
+
+    CBlock block;
+    block.nTime = 1600086400;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(coinstake));
+    block.vtx.push_back(MakeTransactionRef(tx1));
+    block.vtx.push_back(MakeTransactionRef(tx2));
+    BOOST_CHECK(block.IsProofOfStake());
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(3);
+    blockundo.vtxundo[0].vprevout.push_back(Coin(CTxOut(100 * COIN, script), 5, false, false, 1600000000));
+    blockundo.vtxundo[1].vprevout.push_back(Coin(CTxOut(4 * COIN, script), 6, false, false, 0));
+    blockundo.vtxundo[1].vprevout.push_back(Coin(CTxOut(6 * COIN, script), 6, false, false, 0));
+    blockundo.vtxundo[2].vprevout.push_back(Coin(CTxOut(10 * COIN, script), 7, false, false, 0));
+
+    CBlockIndex indexPrev;
+    CBlockIndex index;
+    index.pprev = &indexPrev;
+    index.nHeight = 10;
+    index.nMint = 5 * COIN;
+    index.nMoneySupply = 1000 * COIN;
+
+    CBlockStats stats = ComputeBlockStats(block, blockundo, &index);
+    BOOST_CHECK_EQUAL(stats.nHeight, 10);
+    BOOST_CHECK_EQUAL(stats.nTime, 1600086400);
+    BOOST_CHECK_EQUAL(stats.nTx, 4U);
+    BOOST_CHECK_EQUAL(stats.nInputs, 4U);
+    BOOST_CHECK_EQUAL(stats.nOutputs, 6U);
+    BOOST_CHECK_EQUAL(stats.nTotalOut, 16 * COIN);
+    BOOST_CHECK_EQUAL(stats.nFees, 4 * COIN);
+    BOOST_CHECK_EQUAL(stats.nMaxFee, 3 * COIN);
+    BOOST_CHECK_EQUAL(stats.nMint, 5 * COIN);
+    BOOST_CHECK_EQUAL(stats.nMoneySupply, 1000 * COIN);
+    BOOST_CHECK(stats.fProofOfStake);
+    BOOST_CHECK_EQUAL(stats.nStakeValue, 100 * COIN);
+    BOOST_CHECK_EQUAL(stats.nStakeReward, 1 * COIN);
+    BOOST_CHECK_EQUAL(stats.nStakeAge, 86400);
+    BOOST_CHECK_EQUAL(stats.nSize, ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+
+    // Without undo data, as for the genesis block, only what the block itself has
+    stats = ComputeBlockStats(block, CBlockUndo(), &index);
+    BOOST_CHECK_EQUAL(stats.nTotalOut, 16 * COIN);
+    BOOST_CHECK_EQUAL(stats.nFees, 0);
+    BOOST_CHECK_EQUAL(stats.nStakeValue, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -14,6 +14,7 @@
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 #include "test/test_bitcoin.h"
 
 #include <vector>
@@ -541,4 +542,31 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rolling_bloom_adaptive)
+{
+    SetMockTime(1000000000);
+    CAdaptiveRollingBloomFilter filter(100, 400, 0.001, 60);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 1000; i++)
+        vHashes.push_back(GetRandHash());
+
+    // Slow relay: the filter stays small
+    for (int i = 0; i < 200; i++) {
+        filter.insert(vHashes[i]);
+        SetMockTime(1000000000 + 2 * i);
+    }
+    BOOST_CHECK_EQUAL(filter.GetCapacity(), 100U);
+
+    // Fast relay: it doubles up to the maximum, without forgetting the last entries while it grows
+    for (int i = 200; i < 1000; i++) {
+        filter.insert(vHashes[i]);
+        BOOST_CHECK(filter.contains(vHashes[i]));
+        BOOST_CHECK(filter.contains(vHashes[i - 99]));
+    }
+    BOOST_CHECK_EQUAL(filter.GetCapacity(), 400U);
+    for (int i = 600; i < 1000; i++)
+        BOOST_CHECK(filter.contains(vHashes[i]));
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
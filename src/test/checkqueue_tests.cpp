@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+static std::atomic<int> nChecksRun(0);
+static std::atomic<int> nChecksOffMaster(0);
+static boost::thread::id idMaster;
+
+/** A check counting where it ran, that fails if told to */
+class CTestCheck
+{
+private:
+    bool fOk;
+    int nSleepMillis;
+
+public:
+    CTestCheck() : fOk(true), nSleepMillis(0) {}
+    CTestCheck(bool fOkIn, int nSleepMillisIn) : fOk(fOkIn), nSleepMillis(nSleepMillisIn) {}
+
+    bool operator()()
+    {
+        if (nSleepMillis)
+            MilliSleep(nSleepMillis);
+        nChecksRun++;
+        if (boost::this_thread::get_id() != idMaster)
+            nChecksOffMaster++;
+        return fOk;
+    }
+
+    void swap(CTestCheck& check)
+    {
+        std::swap(fOk, check.fOk);
+        std::swap(nSleepMillis, check.nSleepMillis);
+    }
+};
+
+static bool RunChecks(CCheckQueue<CTestCheck>& queue, int nPriority, int nChecks, bool fFail, int nSleepMillis)
+{
+    std::vector<CTestCheck> vChecks;
+    for (int i = 0; i < nChecks; i++)
+        vChecks.push_back(CTestCheck(!fFail || i != nChecks / 2, nSleepMillis));
+    CCheckQueueControl<CTestCheck> control(&queue, nPriority);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+BOOST_AUTO_TEST_CASE(checkpool_tests)
+{
+    CCheckPool pool;
+    CCheckQueue<CTestCheck> queueTip(16, &pool);
+    CCheckQueue<CTestCheck> queueMempool(16, &pool);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CCheckPool::Thread, boost::ref(pool)));
+    idMaster = boost::this_thread::get_id();
+
+    // The threads of the pool help the master
+    nChecksRun = 0;
+    nChecksOffMaster = 0;
+    BOOST_CHECK(RunChecks(queueTip, CHECK_PRIORITY_TIP, 100, false, 1));
+    BOOST_CHECK_EQUAL(nChecksRun, 100);
+    BOOST_CHECK(nChecksOffMaster > 0);
+
+    // A failure is reported, and the queue is reusable
+    BOOST_CHECK(!RunChecks(queueMempool, CHECK_PRIORITY_MEMPOOL, 1000, true, 0));
+    BOOST_CHECK(RunChecks(queueMempool, CHECK_PRIORITY_MEMPOOL, 1000, false, 0));
+    BOOST_CHECK(queueMempool.IsIdle());
+
+    // Masters of queues of different priorities at once
+    nChecksRun = 0;
+    bool fMempoolOk = false;
+    boost::thread threadMempool([&queueMempool, &fMempoolOk]() {
+        fMempoolOk = RunChecks(queueMempool, CHECK_PRIORITY_MEMPOOL, 5000, false, 0);
+    });
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK(RunChecks(queueTip, i % 2 ? CHECK_PRIORITY_TIP : CHECK_PRIORITY_BACKGROUND, 500, false, 0));
+    threadMempool.join();
+    BOOST_CHECK(fMempoolOk);
+    BOOST_CHECK_EQUAL(nChecksRun, 10000);
+    BOOST_CHECK(queueTip.IsIdle() && queueMempool.IsIdle());
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
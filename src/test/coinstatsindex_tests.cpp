@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstatsindex.h"
+#include "chain.h"
+#include "crypto/muhash.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinstatsindex_tests, TestingSetup)
+
+static uint256 SetHash(const MuHash3072& muhash)
+{
+    unsigned char hash[32];
+    muhash.Finalize(hash);
+    return uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+}
+
+BOOST_AUTO_TEST_CASE(coinstatsindex_connect_disconnect)
+{
+    // tx1 spends an output from before the block; tx2 spends tx1's output in the same block and
+    // has an unspendable output, which is not part of the set
+    IndexTestBlock test;
+    const CBlock& block = test.block;
+    const CBlockUndo& blockundo = test.blockundo;
+    const CMutableTransaction& coinbase = test.coinbase;
+    const CMutableTransaction& tx2 = test.tx2;
+    CBlockIndex& indexPrev = test.indexPrev;
+    CBlockIndex& index = test.index;
+
+    CCoinStatsIndex coinstatsindex(1 << 20, true);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(coinstatsindex.ConnectBlock(block, blockundo, &index));
+    }
+
+    // From an empty set: the block adds the coinbase and tx2's spendable outputs, and removes the
+    // output from before it
+    MuHash3072 muhash;
+    ApplyCoinHash(muhash, COutPoint(coinbase.GetHash(), 0), coinbase.vout[0], true);
+    ApplyCoinHash(muhash, COutPoint(tx2.GetHash(), 0), tx2.vout[0], true);
+    ApplyCoinHash(muhash, COutPoint(tx2.GetHash(), 1), tx2.vout[1], true);
+    ApplyCoinHash(muhash, test.prevout, test.outPrev, false);
+
+    CBlockCoinStats stats;
+    BOOST_CHECK(coinstatsindex.GetStats(&index, stats));
+    BOOST_CHECK_EQUAL(stats.nHeight, 10);
+    BOOST_CHECK_EQUAL(stats.nTxOuts, 2U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 1 * COIN + 3 * COIN + 2 * COIN - 6 * COIN);
+    BOOST_CHECK(stats.hashMuHash == SetHash(muhash));
+    BOOST_CHECK(!coinstatsindex.GetStats(&indexPrev, stats));
+
+    // Disconnecting it goes back to the empty set, which a block with just a coinbase extends
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(coinstatsindex.DisconnectBlock(block, blockundo, &index));
+    }
+    CBlock blockOther;
+    blockOther.vtx.push_back(block.vtx[0]);
+    const uint256 hashOther = uint256S("0x03");
+    CBlockIndex indexOther;
+    indexOther.phashBlock = &hashOther;
+    indexOther.pprev = &indexPrev;
+    indexOther.nHeight = 10;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(coinstatsindex.ConnectBlock(blockOther, CBlockUndo(), &indexOther));
+    }
+    MuHash3072 muhashOther;
+    ApplyCoinHash(muhashOther, COutPoint(coinbase.GetHash(), 0), coinbase.vout[0], true);
+    BOOST_CHECK(coinstatsindex.GetStats(&indexOther, stats));
+    BOOST_CHECK_EQUAL(stats.nTxOuts, 1U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 1 * COIN);
+    BOOST_CHECK(stats.hashMuHash == SetHash(muhashOther));
+
+    // The record of the disconnected block stays
+    BOOST_CHECK(coinstatsindex.GetStats(&index, stats));
+    BOOST_CHECK(stats.hashMuHash == SetHash(muhash));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,12 +3,15 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypto/aes.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
@@ -255,6 +258,64 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_short) {
+    // Every message length and enough messages to use each batch width and the remainder path
+    const size_t counts[] = {1, 3, 4, 5, 8, 9, 12, 17};
+    for (size_t len = 0; len <= SHA256D_SHORT_MAX_LEN; len++) {
+        for (size_t blocks : counts) {
+            std::vector<unsigned char> in(len * blocks + 1);
+            for (unsigned char& c : in)
+                c = insecure_rand();
+            std::vector<unsigned char> out(32 * blocks), expected(32 * blocks);
+            SHA256DShort(out.data(), in.data(), len, blocks);
+            for (size_t i = 0; i < blocks; i++)
+                CHash256().Write(in.data() + len * i, len).Finalize(expected.data() + 32 * i);
+            BOOST_CHECK(out == expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64) {
+    const size_t counts[] = {1, 2, 3, 4, 5, 8, 9, 12, 17, 32};
+    for (size_t blocks : counts) {
+        std::vector<unsigned char> in(64 * blocks);
+        for (unsigned char& c : in)
+            c = insecure_rand();
+        std::vector<unsigned char> out(32 * blocks), expected(32 * blocks);
+        SHA256D64(out.data(), in.data(), blocks);
+        for (size_t i = 0; i < blocks; i++)
+            CHash256().Write(in.data() + 64 * i, 64).Finalize(expected.data() + 32 * i);
+        BOOST_CHECK(out == expected);
+        // In place, as ComputeMerkleRoot() does
+        SHA256D64(in.data(), in.data(), blocks);
+        BOOST_CHECK(std::equal(expected.begin(), expected.end(), in.begin()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_implementations) {
+    // Every combination of the implementations this CPU has must match the generic code
+    std::vector<unsigned char> in(64 * 17 + 1000);
+    for (unsigned char& c : in)
+        c = insecure_rand();
+    std::vector<unsigned char> expected;
+    for (unsigned int use = 0; use <= SHA256_USE_ALL; use++) {
+        BOOST_TEST_MESSAGE(SHA256AutoDetect(use));
+        std::vector<unsigned char> out;
+        for (size_t len : {0, 1, 55, 56, 63, 64, 65, 119, 120, 1000}) {
+            out.resize(out.size() + CSHA256::OUTPUT_SIZE);
+            CSHA256().Write(in.data(), len).Finalize(&out[out.size() - CSHA256::OUTPUT_SIZE]);
+        }
+        out.resize(out.size() + 32 * 17);
+        SHA256D64(&out[out.size() - 32 * 17], in.data(), 17);
+        out.resize(out.size() + 32 * 17);
+        SHA256DShort(&out[out.size() - 32 * 17], in.data(), 28, 17);
+        if (use == 0)
+            expected = out;
+        BOOST_CHECK(out == expected);
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -439,4 +500,143 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+BOOST_AUTO_TEST_CASE(aes256_implementations) {
+    // The hardware code, if this CPU has it, must match ctaes on random keys and messages
+    std::vector<unsigned char> key(AES256_KEYSIZE), iv(AES_BLOCKSIZE), in(AES_BLOCKSIZE * 9 + 5);
+    for (int i = 0; i < 10; i++) {
+        for (unsigned char& c : key) c = insecure_rand();
+        for (unsigned char& c : iv) c = insecure_rand();
+        for (unsigned char& c : in) c = insecure_rand();
+        std::vector<unsigned char> expected;
+        for (bool fUseHardware : {false, true}) {
+            BOOST_TEST_MESSAGE(AESAutoDetect(fUseHardware));
+            std::vector<unsigned char> out(in.size() + AES_BLOCKSIZE), decrypted(out.size());
+            out.resize(AES256CBCEncrypt(key.data(), iv.data(), true).Encrypt(in.data(), in.size(), out.data()));
+            decrypted.resize(AES256CBCDecrypt(key.data(), iv.data(), true).Decrypt(out.data(), out.size(), decrypted.data()));
+            BOOST_CHECK(decrypted == in);
+            if (!fUseHardware)
+                expected = out;
+            BOOST_CHECK(out == expected);
+        }
+    }
+    AESAutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_implementations) {
+    // A zero input, then random ones
+    std::vector<unsigned char> in(80, 0);
+    std::vector<char> scratchpad(SCRYPT_SCRATCHPAD_SIZE);
+    for (int i = 0; i < 4; i++) {
+        if (i > 0) {
+            for (size_t j = 0; j < in.size(); j++)
+                in[j] = insecure_rand();
+        }
+        const char* input = (const char*)in.data();
+        uint256 hash;
+        scrypt_1024_1_1_256_sp_generic(input, (char*)hash.begin(), scratchpad.data());
+        if (i == 0)
+            BOOST_CHECK_EQUAL(hash.GetHex(), "694b3a55a61339b43c01421b13f710e22e33a7eabda1cd48103bb9f376081d16");
+
+        uint256 out;
+        scrypt_1024_1_1_256(input, (char*)out.begin());
+        BOOST_CHECK(out == hash);
+#if defined(USE_SCRYPT_SSE2)
+        out.SetNull();
+        scrypt_1024_1_1_256_sp_sse2(input, (char*)out.begin(), scratchpad.data());
+        BOOST_CHECK(out == hash);
+#endif
+#if defined(USE_SCRYPT_NEON)
+        out.SetNull();
+        scrypt_1024_1_1_256_sp_neon(input, (char*)out.begin(), scratchpad.data());
+        BOOST_CHECK(out == hash);
+#endif
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_multi) {
+    // Every number of inputs up to two full rounds and a remainder of the widest implementation
+    const size_t nMax = 2 * SCRYPT_MULTI_MAX_WAYS + 1;
+    std::vector<unsigned char> in(80 * nMax);
+    for (size_t j = 0; j < in.size(); j++)
+        in[j] = insecure_rand();
+    std::vector<char> scratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    std::vector<uint256> hashes(nMax);
+    std::vector<const char*> input(nMax);
+    for (size_t i = 0; i < nMax; i++) {
+        input[i] = (const char*)&in[80 * i];
+        scrypt_1024_1_1_256_sp_generic(input[i], (char*)hashes[i].begin(), scratchpad.data());
+    }
+
+    for (size_t n = 1; n <= nMax; n++) {
+        std::vector<uint256> out(n);
+        std::vector<char*> output(n);
+        for (size_t i = 0; i < n; i++)
+            output[i] = (char*)out[i].begin();
+        scrypt_1024_1_1_256_multi(input.data(), output.data(), n, scratchpad.data());
+        for (size_t i = 0; i < n; i++)
+            BOOST_CHECK(out[i] == hashes[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // The inverse, also of the largest number, which is reduced on the way in
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    for (int n = 0; n < 3; n++) {
+        for (size_t i = 0; i < sizeof(bytes); i++)
+            bytes[i] = n == 0 ? 0xff : insecure_rand();
+        Num3072 num(bytes);
+        num.Multiply(num.GetInverse());
+        num.ToBytes(bytes);
+        BOOST_CHECK_EQUAL(bytes[0], 1);
+        for (size_t i = 1; i < sizeof(bytes); i++)
+            BOOST_CHECK_EQUAL(bytes[i], 0);
+    }
+
+    // The same set in any order of insertions and removals
+    std::vector<std::vector<unsigned char> > vElements;
+    for (unsigned char i = 0; i < 8; i++)
+        vElements.push_back(std::vector<unsigned char>(i + 1, i));
+    unsigned char hashEmpty[32], hashA[32], hashB[32], hashC[32];
+    MuHash3072().Finalize(hashEmpty);
+    MuHash3072 a, b, c;
+    for (size_t i = 0; i < vElements.size(); i++)
+        a.Insert(vElements[i].data(), vElements[i].size());
+    for (size_t i = vElements.size(); i-- > 0; )
+        b.Insert(vElements[i].data(), vElements[i].size());
+    a.Finalize(hashA);
+    b.Finalize(hashB);
+    BOOST_CHECK(memcmp(hashA, hashB, 32) == 0);
+    BOOST_CHECK(memcmp(hashA, hashEmpty, 32) != 0);
+
+    // Removing before inserting, and combining the hashes of parts
+    c.Remove(vElements[0].data(), vElements[0].size());
+    for (size_t i = 4; i < vElements.size(); i++)
+        c.Insert(vElements[i].data(), vElements[i].size());
+    MuHash3072 d;
+    for (size_t i = 0; i < 4; i++)
+        d.Insert(vElements[i].data(), vElements[i].size());
+    d.Insert(vElements[0].data(), vElements[0].size());
+    c *= d;
+    c.Finalize(hashC);
+    BOOST_CHECK(memcmp(hashA, hashC, 32) == 0);
+    c /= d;
+    c.Finalize(hashC);
+    BOOST_CHECK(memcmp(hashA, hashC, 32) != 0);
+
+    // Continued from its serialized state
+    unsigned char state[MuHash3072::SERIALIZED_SIZE];
+    a.Remove(vElements[7].data(), vElements[7].size());
+    a.ToBytes(state);
+    MuHash3072 e;
+    e.FromBytes(state);
+    e.Insert(vElements[7].data(), vElements[7].size());
+    e.Finalize(hashC);
+    BOOST_CHECK(memcmp(hashA, hashC, 32) == 0);
+    for (size_t i = 0; i < vElements.size(); i++)
+        e.Remove(vElements[i].data(), vElements[i].size());
+    e.Finalize(hashC);
+    BOOST_CHECK(memcmp(hashEmpty, hashC, 32) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
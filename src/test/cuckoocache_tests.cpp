@@ -391,4 +391,79 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, uint256Hasher>>();
 }
 
+/** A hasher of the hashes to be used as keys of a map, like SaltedTxidHasher
+ */
+class uint256KeyHasher
+{
+public:
+    size_t operator()(const uint256& key) const
+    {
+        return key.GetCheapHash();
+    }
+};
+
+/* Test that a map finds the last value inserted for a key, and none once the
+ * key is erased.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_map_ok)
+{
+    insecure_rand = FastRandomContext(true);
+    CuckooCache::map<uint256, uint32_t, uint256KeyHasher> map{};
+    map.setup(1 << 12);
+    std::vector<uint256> keys(1000);
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+        insecure_GetRandHash(keys[i]);
+        map.insert(keys[i], i);
+    }
+    for (uint32_t i = 0; i < keys.size(); i += 2)
+        map.insert(keys[i], i + 1);
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+        const uint32_t* value = map.find(keys[i]);
+        BOOST_CHECK(value && *value == i + (i % 2 == 0));
+    }
+    for (uint32_t i = 0; i < keys.size(); i += 3)
+        BOOST_CHECK(map.erase(keys[i]));
+    for (uint32_t i = 0; i < keys.size(); ++i)
+        BOOST_CHECK_EQUAL(map.find(keys[i]) != nullptr, i % 3 != 0);
+    uint256 absent;
+    insecure_GetRandHash(absent);
+    BOOST_CHECK(!map.find(absent));
+    BOOST_CHECK(!map.erase(absent));
+}
+
+/* Test that resizing keeps the elements that fit, whichever way, and that
+ * epochs are counted as the cache is filled over and over.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_resize_ok)
+{
+    insecure_rand = FastRandomContext(true);
+    CuckooCache::cache<uint256, uint256Hasher> cc{};
+    cc.setup(1 << 10);
+    std::vector<uint256> hashes(400);
+    for (uint256& hash : hashes) {
+        insecure_GetRandHash(hash);
+        cc.insert(hash);
+    }
+    BOOST_CHECK_EQUAL(cc.epochs(), 0U);
+
+    BOOST_CHECK_EQUAL(cc.resize(1 << 16), 1U << 16);
+    BOOST_CHECK_EQUAL(cc.capacity(), 1U << 16);
+    for (const uint256& hash : hashes)
+        BOOST_CHECK(cc.contains(hash, false));
+
+    // Shrunk to fewer slots than elements, the table is full of them
+    BOOST_CHECK_EQUAL(cc.resize(1 << 8), 1U << 8);
+    uint32_t count = 0;
+    for (const uint256& hash : hashes)
+        count += cc.contains(hash, false);
+    BOOST_CHECK(count > (1 << 8) / 2 && count <= (1 << 8));
+
+    uint256 hash;
+    for (uint32_t i = 0; i < 10 * (1 << 8); ++i) {
+        insecure_GetRandHash(hash);
+        cc.insert(hash);
+    }
+    BOOST_CHECK(cc.epochs() > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
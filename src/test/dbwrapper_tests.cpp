@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "dbwrapper.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
@@ -43,6 +44,37 @@ BOOST_AUTO_TEST_CASE(dbwrapper)
     }
 }
 
+// Keys longer than DBWRAPPER_PREALLOC_KEY_SIZE are serialized in a stream rather than on the stack
+BOOST_AUTO_TEST_CASE(dbwrapper_long_keys)
+{
+    for (int i = 0; i < 2; i++) {
+        bool obfuscate = (bool)i;
+        boost::filesystem::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+        const std::string keyShort(DBWRAPPER_PREALLOC_KEY_SIZE - 1, 'k');
+        const std::string keyLong(DBWRAPPER_PREALLOC_KEY_SIZE, 'k');
+        uint256 in1 = GetRandHash();
+        uint256 in2 = GetRandHash();
+        uint256 res;
+
+        BOOST_CHECK(dbw.Write(keyShort, in1));
+        BOOST_CHECK(dbw.Write(keyLong, in2));
+        BOOST_CHECK(dbw.Read(keyShort, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in1.ToString());
+        BOOST_CHECK(dbw.Read(keyLong, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in2.ToString());
+        BOOST_CHECK(dbw.Exists(keyLong));
+        BOOST_CHECK(!dbw.Exists(keyLong + "k"));
+
+        std::unique_ptr<CDBIterator> it(const_cast<CDBWrapper*>(&dbw)->NewIterator());
+        it->Seek(keyLong);
+        std::string key;
+        BOOST_CHECK(it->Valid() && it->GetKey(key) && key == keyLong);
+        BOOST_CHECK(it->GetValue(res));
+        BOOST_CHECK_EQUAL(res.ToString(), in2.ToString());
+    }
+}
+
 // Test batch operations
 BOOST_AUTO_TEST_CASE(dbwrapper_batch)
 {
@@ -320,4 +352,126 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 
 
 
+BOOST_AUTO_TEST_CASE(dbwrapper_options)
+{
+    boost::filesystem::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    CDBOptions dboptions;
+    dboptions.nMaxOpenFiles = 100;
+    dboptions.nBloomBits = 0;
+    dboptions.nWriteBufferSize = 1 << 16;
+    dboptions.fCompression = true;
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, dboptions);
+    BOOST_CHECK_EQUAL(dbw.GetDBOptions().nMaxOpenFiles, 100);
+    BOOST_CHECK_EQUAL(dbw.GetDBOptions().nWriteBufferSize, 1U << 16);
+
+    // More than the write buffer holds, so that tables are written
+    for (int i = 0; i < 1000; i++)
+        BOOST_CHECK(dbw.Write(std::make_pair('k', i), GetRandHash()));
+    uint256 res;
+    BOOST_CHECK(dbw.Read(std::make_pair('k', 999), res));
+
+    std::string strStats;
+    BOOST_CHECK(dbw.GetProperty("leveldb.stats", strStats));
+    BOOST_CHECK(strStats.find("Compactions") != std::string::npos);
+    BOOST_CHECK(!dbw.GetProperty("leveldb.nonexistent", strStats));
+    dbw.CompactRange('k', 'l');
+    BOOST_CHECK(dbw.EstimateSize() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_compact_in_steps)
+{
+    boost::filesystem::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, false);
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK(dbw.Write(std::make_pair('a', GetRandHash()), i));
+        BOOST_CHECK(dbw.Write(std::make_pair('b', GetRandHash()), i));
+    }
+
+    int nSteps = 0;
+    auto step = [&nSteps]() { nSteps++; return true; };
+    // Every range of each prefix in use
+    BOOST_CHECK(dbw.CompactInSteps("", 4, step));
+    BOOST_CHECK_EQUAL(nSteps, 8);
+    // Only the given prefixes, skipping those not in use
+    nSteps = 0;
+    BOOST_CHECK(dbw.CompactInSteps("bz", 4, step));
+    BOOST_CHECK_EQUAL(nSteps, 4);
+    // Stopped by the step function
+    nSteps = 0;
+    BOOST_CHECK(!dbw.CompactInSteps("", 4, [&nSteps]() { return ++nSteps < 3; }));
+    BOOST_CHECK_EQUAL(nSteps, 3);
+
+    int nValue;
+    BOOST_CHECK(!dbw.Read(std::make_pair('a', uint256()), nValue));
+    BOOST_CHECK(dbw.EstimateSize() > 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_tree_async_write, TestingSetup)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint256 hash = GetRandHash();
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    CBlockFileInfo info;
+    info.nBlocks = 7;
+    std::vector<std::pair<int, const CBlockFileInfo*> > vFiles(1, std::make_pair(3, &info));
+    std::vector<const CBlockIndex*> vBlocks(1, &index);
+    BOOST_CHECK(db.WriteBatchAsync(vFiles, 3, vBlocks));
+    // The entries are serialized already
+    info.nBlocks = 8;
+    BOOST_CHECK(db.WaitForWrite());
+
+    int nLastFile = 0;
+    BOOST_CHECK(db.ReadLastBlockFile(nLastFile));
+    BOOST_CHECK_EQUAL(nLastFile, 3);
+    CBlockFileInfo infoRead;
+    BOOST_CHECK(db.ReadBlockFileInfo(3, infoRead));
+    BOOST_CHECK_EQUAL(infoRead.nBlocks, 7U);
+
+    // A second write waits for the first one
+    BOOST_CHECK(db.WriteBatchAsync(vFiles, 4, vBlocks));
+    BOOST_CHECK(db.WriteBatchAsync(vFiles, 5, vBlocks));
+    BOOST_CHECK(db.WaitForWrite());
+    BOOST_CHECK(db.ReadLastBlockFile(nLastFile));
+    BOOST_CHECK_EQUAL(nLastFile, 5);
+}
+
+BOOST_FIXTURE_TEST_CASE(compact_txindex, TestingSetup)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint256 txid1 = GetRandHash(), txid2 = GetRandHash();
+    std::vector<uint256> vHave(1, GetRandHash());
+    CBlockLocator locator(vHave);
+    std::vector<std::pair<uint256, CCompactTxPos> > vPos;
+    vPos.push_back(std::make_pair(txid1, CCompactTxPos(10, 81)));
+    vPos.push_back(std::make_pair(txid2, CCompactTxPos(10, 300)));
+    BOOST_CHECK(db.WriteCompactTxIndex(vPos, locator));
+    CBlockLocator locatorRead;
+    BOOST_CHECK(db.ReadTxIndexLocator(true, locatorRead));
+    BOOST_CHECK(locatorRead.vHave == vHave);
+    // Each format keeps its own locator
+    BOOST_CHECK(!db.ReadTxIndexLocator(false, locatorRead));
+    BOOST_CHECK(db.EraseTxIndexLocator(true));
+    BOOST_CHECK(!db.ReadTxIndexLocator(true, locatorRead));
+
+    std::vector<CCompactTxPos> vRead;
+    BOOST_CHECK(db.ReadCompactTxIndex(txid2, vRead));
+    BOOST_REQUIRE_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vRead[0].nHeight, 10);
+    BOOST_CHECK_EQUAL(vRead[0].nTxOffset, 300U);
+    BOOST_CHECK(!db.ReadCompactTxIndex(GetRandHash(), vRead));
+    BOOST_CHECK(vRead.empty());
+
+    // The same transaction in a block at another height after a reorg gets a second entry,
+    // and one at the same height replaces the old entry
+    vPos.clear();
+    vPos.push_back(std::make_pair(txid1, CCompactTxPos(12, 81)));
+    vPos.push_back(std::make_pair(txid1, CCompactTxPos(10, 500)));
+    BOOST_CHECK(db.WriteCompactTxIndex(vPos, locator));
+    BOOST_CHECK(db.ReadCompactTxIndex(txid1, vRead));
+    BOOST_REQUIRE_EQUAL(vRead.size(), 2U);
+    for (const CCompactTxPos& pos : vRead)
+        BOOST_CHECK(pos.nHeight == 10 ? pos.nTxOffset == 500 : pos.nHeight == 12 && pos.nTxOffset == 81);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,8 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
+#include "test/test_random.h"
 
 #include <vector>
 
@@ -12,10 +14,22 @@
 
 BOOST_FIXTURE_TEST_SUITE(hash_tests, BasicTestingSetup)
 
+// SolarCoin: The one-pass MurmurHash3 of several seeds agrees with the plain one for each
+static uint32_t MurmurHash3Multi(uint32_t nHashSeed, const std::vector<unsigned char>& vData)
+{
+    uint32_t vSeeds[3] = {nHashSeed + 1, nHashSeed, nHashSeed * 0xFBA4C795};
+    uint32_t vHashes[3];
+    MurmurHash3(vSeeds, 3, vData.data(), vData.size(), vHashes);
+    BOOST_CHECK_EQUAL(vHashes[0], MurmurHash3(vSeeds[0], vData));
+    BOOST_CHECK_EQUAL(vHashes[2], MurmurHash3(vSeeds[2], vData));
+    return vHashes[1];
+}
+
 BOOST_AUTO_TEST_CASE(murmurhash3)
 {
 
-#define T(expected, seed, data) BOOST_CHECK_EQUAL(MurmurHash3(seed, ParseHex(data)), expected)
+#define T(expected, seed, data) BOOST_CHECK_EQUAL(MurmurHash3(seed, ParseHex(data)), expected); \
+    BOOST_CHECK_EQUAL(MurmurHash3Multi(seed, ParseHex(data)), expected)
 
     // Test MurmurHash3 with various inputs. Of course this is retested in the
     // bloom filter tests - they would fail if MurmurHash3() had any problems -
@@ -23,7 +37,7 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
     // source of test data for their MurmurHash3() primitive during
     // development.
     //
-    // The magic number 0xFBA4C795 comes from CBloomFilter::Hash()
+    // The magic number 0xFBA4C795 comes from CBloomFilter::Hashes()
 
     T(0x00000000, 0x00000000, "");
     T(0x6a396f08, 0xFBA4C795, "");
@@ -121,6 +135,21 @@ BOOST_AUTO_TEST_CASE(siphash)
                      (uint64_t(x+4)<<32)|(uint64_t(x+5)<<40)|(uint64_t(x+6)<<48)|(uint64_t(x+7)<<56));
     }
 
+    // Check the specialized uint256 (+ 32 bit) variants against the generic hasher
+    for (int i = 0; i < 16; ++i) {
+        uint64_t k0 = insecure_rand() | ((uint64_t)insecure_rand() << 32);
+        uint64_t k1 = insecure_rand() | ((uint64_t)insecure_rand() << 32);
+        uint256 x = GetRandHash();
+        uint32_t n = insecure_rand();
+        unsigned char nb[4] = {(unsigned char)n, (unsigned char)(n >> 8), (unsigned char)(n >> 16), (unsigned char)(n >> 24)};
+        CSipHasher sip256(k0, k1);
+        sip256.Write(x.begin(), 32);
+        CSipHasher sip288 = sip256;
+        sip288.Write(nb, 4);
+        BOOST_CHECK_EQUAL(SipHashUint256(k0, k1, x), sip256.Finalize());
+        BOOST_CHECK_EQUAL(SipHashUint256Extra(k0, k1, x, n), sip288.Finalize());
+    }
+
     CHashWriter ss(SER_DISK, CLIENT_VERSION);
     CMutableTransaction tx;
     // Note these tests were originally written with tx.nVersion=1
@@ -0,0 +1,157 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "streams.h"
+#include "util.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(headerbundle_tests, TestChain100Setup)
+
+/** The parameters of the running chain with the given checkpoints */
+class CHeaderBundleTestParams : public CChainParams
+{
+public:
+    CHeaderBundleTestParams(const CChainParams& params, const MapCheckpoints& mapCheckpoints) : CChainParams(params)
+    {
+        checkpointData.mapCheckpoints = mapCheckpoints;
+    }
+};
+
+/** Headers from genesis that are not in the block index; their proof of work is not checked on load */
+static std::vector<CBlockHeader> BuildHeaders(int nCount)
+{
+    std::vector<CBlockHeader> vHeaders;
+    CBlockHeader header = chainActive.Genesis()->GetBlockHeader();
+    for (int i = 0; i < nCount; i++) {
+        header.hashPrevBlock = header.GetHash();
+        header.nTime += 60;
+        header.nNonce = 1000000 + i;
+        vHeaders.push_back(header);
+    }
+    return vHeaders;
+}
+
+/** Write a header bundle as DumpHeaderBundle() does */
+static void WriteHeaderBundle(const boost::filesystem::path& path, const std::vector<CBlockHeader>& vHeaders)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << FLATDATA(Params().MessageStart()) << HEADER_BUNDLE_VERSION << (uint64_t)vHeaders.size();
+    for (const CBlockHeader& header : vHeaders)
+        ss << header;
+    ss << Hash(ss.begin(), ss.end());
+    FILE* file = fopen(path.string().c_str(), "wb");
+    BOOST_REQUIRE(file);
+    BOOST_CHECK_EQUAL(fwrite(ss.data(), 1, ss.size(), file), ss.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(headerbundle_round_trip)
+{
+    const boost::filesystem::path path = GetDataDir() / "headers.dat";
+    MapCheckpoints mapCheckpoints;
+    mapCheckpoints[30] = chainActive[30]->GetBlockHash();
+    mapCheckpoints[50] = chainActive[50]->GetBlockHash();
+    CHeaderBundleTestParams params(Params(), mapCheckpoints);
+
+    // Up to the last checkpoint in the active chain by default
+    CHeaderBundleInfo info;
+    std::string strError;
+    BOOST_CHECK_MESSAGE(DumpHeaderBundle(params, path, -1, info, strError), strError);
+    BOOST_CHECK_EQUAL(info.nHeight, 50);
+    BOOST_CHECK_EQUAL(info.nHeaders, 50U);
+    BOOST_CHECK(info.hashBlock == chainActive[50]->GetBlockHash());
+
+    // Loading it again pins the headers up to the last checkpoint, which are all known
+    CHeaderBundleInfo infoLoad;
+    BOOST_CHECK_MESSAGE(LoadHeaderBundle(params, path, infoLoad, strError), strError);
+    BOOST_CHECK_EQUAL(infoLoad.nHeight, 50);
+    BOOST_CHECK(infoLoad.hashBlock == info.hashBlock);
+    BOOST_CHECK_EQUAL(infoLoad.nHeaders, 0U);
+    boost::filesystem::remove(path);
+
+    // Beyond the last checkpoint, the headers are written but not loaded
+    BOOST_CHECK_MESSAGE(DumpHeaderBundle(params, path, 70, info, strError), strError);
+    BOOST_CHECK_EQUAL(info.nHeaders, 70U);
+    infoLoad = CHeaderBundleInfo();
+    BOOST_CHECK_MESSAGE(LoadHeaderBundle(params, path, infoLoad, strError), strError);
+    BOOST_CHECK_EQUAL(infoLoad.nHeight, 50);
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(headerbundle_new_headers)
+{
+    const boost::filesystem::path path = GetDataDir() / "headers.dat";
+    std::vector<CBlockHeader> vHeaders = BuildHeaders(20);
+    WriteHeaderBundle(path, vHeaders);
+
+    // The headers up to the last checkpoint they reach are added, the others are not
+    MapCheckpoints mapCheckpoints;
+    mapCheckpoints[5] = vHeaders[4].GetHash();
+    mapCheckpoints[15] = vHeaders[14].GetHash();
+    CHeaderBundleTestParams params(Params(), mapCheckpoints);
+    CHeaderBundleInfo info;
+    std::string strError;
+    BOOST_CHECK_MESSAGE(LoadHeaderBundle(params, path, info, strError), strError);
+    BOOST_CHECK_EQUAL(info.nHeight, 15);
+    BOOST_CHECK(info.hashBlock == vHeaders[14].GetHash());
+    BOOST_CHECK_EQUAL(info.nHeaders, 15U);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(vHeaders[14].GetHash());
+        BOOST_REQUIRE(it != mapBlockIndex.end());
+        BOOST_CHECK_EQUAL(it->second->nHeight, 15);
+        BOOST_CHECK(it->second->pprev->GetBlockHash() == vHeaders[13].GetHash());
+        BOOST_CHECK(!mapBlockIndex.count(vHeaders[15].GetHash()));
+    }
+
+    // A checkpoint the headers do not match
+    CHeaderBundleInfo infoMismatch;
+    mapCheckpoints[10] = uint256S("0x1234");
+    CHeaderBundleTestParams paramsMismatch(Params(), mapCheckpoints);
+    BOOST_CHECK(!LoadHeaderBundle(paramsMismatch, path, infoMismatch, strError));
+    BOOST_CHECK_EQUAL(strError, "Header at height 10 does not match its checkpoint");
+
+    // No checkpoint among the headers
+    CHeaderBundleInfo infoNone;
+    CHeaderBundleTestParams paramsNone(Params(), MapCheckpoints());
+    BOOST_CHECK(!LoadHeaderBundle(paramsNone, path, infoNone, strError));
+    BOOST_CHECK_EQUAL(strError, "The header bundle does not reach a checkpoint");
+
+    // Headers that do not link up
+    boost::filesystem::remove(path);
+    std::vector<CBlockHeader> vBroken = BuildHeaders(20);
+    vBroken[7].hashPrevBlock = uint256S("0x5678");
+    WriteHeaderBundle(path, vBroken);
+    CHeaderBundleInfo infoBroken;
+    MapCheckpoints mapCheckpointsBroken;
+    mapCheckpointsBroken[15] = vBroken[14].GetHash();
+    CHeaderBundleTestParams paramsBroken(Params(), mapCheckpointsBroken);
+    BOOST_CHECK(!LoadHeaderBundle(paramsBroken, path, infoBroken, strError));
+    BOOST_CHECK_EQUAL(strError, "Header at height 8 does not follow the previous one");
+
+    // A damaged bundle fails its checksum
+    boost::filesystem::remove(path);
+    WriteHeaderBundle(path, vHeaders);
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, 20, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, 20, SEEK_SET);
+    fputc(ch ^ 0xff, file);
+    fclose(file);
+    CHeaderBundleInfo infoDamaged;
+    BOOST_CHECK(!LoadHeaderBundle(params, path, infoDamaged, strError));
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,201 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "kernel.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "validation.h"
+
+#include <limits>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+/* Batched kernel hashes must match the CDataStream serialization CheckStakeTimeKernelHash used to hash */
+BOOST_AUTO_TEST_CASE(stake_kernel_hashes)
+{
+    const size_t nCount = 37;
+    uint64_t nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+    CStakePrevoutInfo info;
+    info.nBlockTime = 1518000000 + GetRand(1000000);
+    info.nTxOffset = 80 + GetRand(1000);
+    info.nTxTime = info.nBlockTime - GetRand(100);
+    uint32_t nPrevout = GetRand(10);
+    unsigned int nTimeTx = info.nBlockTime + 8 * 60 * 60;
+
+    std::vector<unsigned char> vKernels(nCount * STAKE_KERNEL_SIZE);
+    for (size_t i = 0; i < nCount; i++)
+        SerializeStakeKernel(&vKernels[i * STAKE_KERNEL_SIZE], nStakeModifier, info, nPrevout, nTimeTx + i);
+    std::vector<uint256> vHashes(nCount);
+    ComputeStakeKernelHashes(vKernels.data(), nCount, vHashes.data());
+
+    for (size_t i = 0; i < nCount; i++) {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << nStakeModifier << info.nBlockTime << info.nTxOffset << info.nTxTime << nPrevout << (unsigned int)(nTimeTx + i);
+        BOOST_CHECK_EQUAL(ss.size(), STAKE_KERNEL_SIZE);
+        BOOST_CHECK(vHashes[i] == Hash(ss.begin(), ss.end()));
+    }
+}
+
+/* The kernel context must give the targets of the uncached computation, within its bounds */
+BOOST_AUTO_TEST_CASE(stake_kernel_context_targets)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    LOCK(cs_main);
+    CBlockIndex blocks[2];
+    blocks[1].pprev = &blocks[0];
+    blocks[1].nHeight = 1;
+    chainActive.SetTip(&blocks[1]);
+
+    const unsigned int nBits = 0x1d00ffff;
+    const double averageWeights[] = {21.0, 5000.0, 1e9};
+    const CAmount values[] = {COIN / 10, 50 * COIN, 100000 * COIN, 1000000000 * COIN};
+    for (double dAverageStakeWeight : averageWeights) {
+        blocks[1].dAverageStakeWeight = dAverageStakeWeight;
+        CStakeKernelContext context(nBits, &blocks[1], params);
+        for (CAmount nValue : values) {
+            CStakePrevoutInfo info;
+            info.nValue = nValue;
+            info.nBlockTime = 1518000000;
+            info.nTxTime = info.nBlockTime - 10;
+            unsigned int nTimeFrom = info.nBlockTime + params.nStakeMinAge;
+            unsigned int nTimeTo = nTimeFrom + 30 * 24 * 60 * 60;
+            arith_uint256 bnBound = context.GetTargetBound(info, nTimeFrom, nTimeTo);
+            for (unsigned int nTimeTx = nTimeFrom; nTimeTx <= nTimeTo; nTimeTx += 6007) {
+                int64_t timeWeight = GetWeight(info.nTxTime, nTimeTx, params);
+                int64_t nCoinDayWeight = nValue * timeWeight / COIN / (24 * 60 * 60);
+                BOOST_CHECK_EQUAL(context.GetFactoredTimeWeight(timeWeight, nCoinDayWeight), GetStakeTimeFactoredWeight(timeWeight, nCoinDayWeight, &blocks[1], params));
+                BOOST_CHECK(context.GetTarget(info, nTimeTx) <= bnBound);
+            }
+        }
+    }
+
+    chainActive.SetTip(nullptr);
+}
+
+/* The stake modifier checksum is stored after the block header, and only with BLOCK_HAVE_STAKE_CHECKSUM */
+BOOST_AUTO_TEST_CASE(stake_modifier_checksum_disk_index)
+{
+    CBlockIndex index;
+    index.nHeight = 1000;
+    index.nStakeModifier = 0x0123456789abcdefULL;
+    index.nStakeModifierChecksum = 0xfedcba98;
+
+    CDataStream ssOld(SER_DISK, CLIENT_VERSION);
+    ssOld << CDiskBlockIndex(&index);
+
+    index.nStatus |= BLOCK_HAVE_STAKE_CHECKSUM;
+    CDataStream ssNew(SER_DISK, CLIENT_VERSION);
+    ssNew << CDiskBlockIndex(&index);
+    BOOST_CHECK(ssNew.size() > ssOld.size());
+
+    CDiskBlockIndex diskindex;
+    ssNew >> diskindex;
+    BOOST_CHECK(ssNew.empty());
+    BOOST_CHECK_EQUAL(diskindex.nStakeModifierChecksum, 0xfedcba98);
+    BOOST_CHECK_EQUAL(diskindex.nStakeModifier, 0x0123456789abcdefULL);
+
+    CDiskBlockIndex diskindexOld;
+    ssOld >> diskindexOld;
+    BOOST_CHECK(ssOld.empty());
+    BOOST_CHECK_EQUAL(diskindexOld.nStakeModifierChecksum, 0);
+
+    // Entries of the versions from before the checksum have neither the flag nor the checksum
+    CDataStream ssLegacy(SER_DISK, BLOCK_INDEX_STAKE_CHECKSUM_VERSION - 1);
+    ssLegacy << CDiskBlockIndex(&index);
+    BOOST_CHECK_EQUAL(ssLegacy.size(), ssOld.size());
+    CDiskBlockIndex diskindexLegacy;
+    ssLegacy >> diskindexLegacy;
+    BOOST_CHECK(ssLegacy.empty());
+    BOOST_CHECK(!(diskindexLegacy.nStatus & BLOCK_HAVE_STAKE_CHECKSUM));
+    BOOST_CHECK(index.nStatus & BLOCK_HAVE_STAKE_CHECKSUM);
+}
+
+/* Entries of blocks that are not connected leave out nMint and nMoneySupply */
+BOOST_AUTO_TEST_CASE(disk_index_no_mint)
+{
+    CBlockIndex index;
+    index.nHeight = 1000;
+    index.nStatus = BLOCK_VALID_TREE;
+    index.nStakeModifier = 0x0123456789abcdefULL;
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << CDiskBlockIndex(&index);
+
+    index.nStatus |= BLOCK_HAVE_DATA | BLOCK_VALID_SCRIPTS;
+    index.nMint = 100 * COIN;
+    index.nMoneySupply = 1000 * COIN;
+    CDataStream ssConnected(SER_DISK, CLIENT_VERSION);
+    ssConnected << CDiskBlockIndex(&index);
+    BOOST_CHECK(ssConnected.size() > ssHeader.size());
+
+    CDiskBlockIndex diskindex;
+    ssHeader >> diskindex;
+    BOOST_CHECK(ssHeader.empty());
+    BOOST_CHECK_EQUAL(diskindex.nStatus, (unsigned int)BLOCK_VALID_TREE);
+    BOOST_CHECK_EQUAL(diskindex.nMint, 0);
+    BOOST_CHECK_EQUAL(diskindex.nMoneySupply, 0U);
+    BOOST_CHECK_EQUAL(diskindex.nStakeModifier, 0x0123456789abcdefULL);
+
+    ssConnected >> diskindex;
+    BOOST_CHECK(ssConnected.empty());
+    BOOST_CHECK(!(diskindex.nStatus & BLOCK_DISK_NO_MINT));
+    BOOST_CHECK_EQUAL(diskindex.nMint, 100 * COIN);
+    BOOST_CHECK_EQUAL(diskindex.nMoneySupply, (uint64_t)(1000 * COIN));
+
+    // Entries of the versions from before the flag keep the zero amounts
+    index.nMint = 0;
+    index.nMoneySupply = 0;
+    CDataStream ssLegacy(SER_DISK, BLOCK_INDEX_NO_MINT_VERSION - 1);
+    ssLegacy << CDiskBlockIndex(&index);
+    CDataStream ssCurrent(SER_DISK, CLIENT_VERSION);
+    ssCurrent << CDiskBlockIndex(&index);
+    BOOST_CHECK(ssLegacy.size() > ssCurrent.size());
+    ssLegacy >> diskindex;
+    BOOST_CHECK(ssLegacy.empty());
+    BOOST_CHECK(!(diskindex.nStatus & BLOCK_DISK_NO_MINT));
+    BOOST_CHECK_EQUAL(diskindex.nMint, 0);
+    BOOST_CHECK_EQUAL(diskindex.nMoneySupply, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(block_index_stake_fields)
+{
+    CBlockIndex index;
+    BOOST_CHECK(index.GetPrevoutStake().IsNull());
+    BOOST_CHECK_EQUAL(index.GetStakeTime(), 0U);
+    BOOST_CHECK(index.GetHashProofOfStake().IsNull());
+
+    COutPoint prevout(uint256S("0x01"), 2);
+    index.SetProofOfStake();
+    index.SetStake(prevout, 1500000000);
+    index.SetHashProofOfStake(uint256S("0x03"));
+
+    // Copies own their stake fields
+    CBlockIndex copy(index);
+    index.SetStake(COutPoint(), 0);
+    index.SetHashProofOfStake(uint256());
+    BOOST_CHECK(index.GetPrevoutStake().IsNull());
+    BOOST_CHECK(copy.GetPrevoutStake() == prevout);
+    BOOST_CHECK_EQUAL(copy.GetStakeTime(), 1500000000U);
+    BOOST_CHECK(copy.GetHashProofOfStake() == uint256S("0x03"));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&copy);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.GetPrevoutStake() == prevout);
+    BOOST_CHECK_EQUAL(diskindex.GetStakeTime(), 1500000000U);
+    BOOST_CHECK(diskindex.GetHashProofOfStake() == uint256S("0x03"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "consensus/validation.h"
+#include "random.h"
+#include "timedata.h"
 #include "validation.h"
 #include "net.h"
 
@@ -73,4 +76,121 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_FIXTURE_TEST_CASE(read_raw_block, TestChain100Setup)
+{
+    LOCK(cs_main);
+    const CBlockIndex* pindex = chainActive.Tip();
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    std::vector<unsigned char> vchRaw;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vchRaw, pindex, Params().MessageStart()));
+
+    // The stored bytes are the network serialization with witness data
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == vchRaw);
+    BOOST_CHECK(IsRawBlockSerialization(pindex, 0, Params().GetConsensus()));
+
+    // Another block's position fails the hash check
+    CBlockIndex indexWrong = *pindex->pprev;
+    indexWrong.phashBlock = pindex->phashBlock;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchRaw, &indexWrong, Params().MessageStart()));
+}
+
+BOOST_FIXTURE_TEST_CASE(assumevalid_skips_pow, TestChain100Setup)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    uint256 hashAssumeValidOld = hashAssumeValid;
+    CBlock block;
+    {
+        LOCK(cs_main);
+        hashAssumeValid = chainActive[80]->GetBlockHash();
+        BOOST_REQUIRE(ReadBlockFromDisk(block, chainActive[50], consensusParams));
+    }
+
+    // Ancestors of the -assumevalid block skip the scrypt check, and CheckBlock() does not cache
+    // a result without it
+    BOOST_CHECK(!IsBlockPoWCheckNeeded(block.GetHash(), consensusParams));
+    BOOST_CHECK(!IsBlockPoWCheckNeeded(hashAssumeValid, consensusParams));
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, consensusParams, false));
+    BOOST_CHECK(!block.fChecked);
+
+    // Its descendants, unknown blocks and everything without -assumevalid are checked
+    BOOST_CHECK(IsBlockPoWCheckNeeded(chainActive.Tip()->GetBlockHash(), consensusParams));
+    BOOST_CHECK(IsBlockPoWCheckNeeded(GetRandHash(), consensusParams));
+    hashAssumeValid.SetNull();
+    BOOST_CHECK(IsBlockPoWCheckNeeded(block.GetHash(), consensusParams));
+
+    // A header whose hash misses its target fails where the check is needed
+    CBlock blockBad = block;
+    blockBad.fChecked = false;
+    blockBad.nBits = 0x1d00ffff;
+    BOOST_CHECK(IsBlockPoWCheckNeeded(blockBad.GetHash(), consensusParams));
+    BOOST_CHECK(!CheckBlock(blockBad, state, consensusParams, true));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+
+    hashAssumeValid = hashAssumeValidOld;
+}
+
+BOOST_FIXTURE_TEST_CASE(new_block_proof_of_stake, TestChain100Setup)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    // A PoST block staking an output that does not exist, so its kernel fails
+    CMutableTransaction coinstake;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1].nValue = 50 * COIN;
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbaseTxns[0]));
+    block.vtx.push_back(MakeTransactionRef(std::move(coinstake)));
+    BOOST_REQUIRE(block.IsProofOfStake());
+    int64_t nMedianTimePast;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        hashTip = chainActive.Tip()->GetBlockHash();
+        block.nBits = chainActive.Tip()->nBits;
+        nMedianTimePast = chainActive.Tip()->GetMedianTimePast();
+    }
+    block.nTime = nMedianTimePast + 1;
+
+    // Without its parent, the kernel is not checked yet, as when ProcessNewBlock() checks it before taking cs_main
+    CValidationState state;
+    bool fCheckedProofOfStake = false;
+    bool fRelayEarly = false;
+    uint256 hashProofOfStake;
+    int64_t nProofFailedMicros = 0;
+    block.hashPrevBlock = GetRandHash();
+    BOOST_CHECK(CheckNewBlockProofOfStake(block, state, fCheckedProofOfStake, hashProofOfStake, fRelayEarly, &nProofFailedMicros, consensusParams));
+    BOOST_CHECK(!fCheckedProofOfStake);
+
+    // Once another thread added the parent, the check ProcessNewBlock() repeats under cs_main runs the kernel
+    block.hashPrevBlock = hashTip;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!CheckNewBlockProofOfStake(block, state, fCheckedProofOfStake, hashProofOfStake, fRelayEarly, &nProofFailedMicros, consensusParams));
+    }
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(!fCheckedProofOfStake);
+
+    // A kernel that passed is not checked again
+    fCheckedProofOfStake = true;
+    BOOST_CHECK(CheckNewBlockProofOfStake(block, state, fCheckedProofOfStake, hashProofOfStake, fRelayEarly, &nProofFailedMicros, consensusParams));
+
+    // Timestamps ContextualCheckBlockHeader() rejects are rejected before the kernel
+    fCheckedProofOfStake = false;
+    block.nTime = nMedianTimePast;
+    BOOST_CHECK(!CheckNewBlockProofOfStake(block, state, fCheckedProofOfStake, hashProofOfStake, fRelayEarly, &nProofFailedMicros, consensusParams));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "time-too-old");
+    state = CValidationState();
+    block.nTime = GetAdjustedTime() + 2 * 60 * 60 + 60;
+    BOOST_CHECK(!CheckNewBlockProofOfStake(block, state, fCheckedProofOfStake, hashProofOfStake, fRelayEarly, &nProofFailedMicros, consensusParams));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "time-too-new");
+    BOOST_CHECK(!fCheckedProofOfStake);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -429,6 +429,171 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     CheckSort<ancestor_score>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolNewerThanTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // An old parent with a newer child, and an old unrelated transaction
+    CMutableTransaction txParent;
+    txParent.nTime = 1000;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+
+    CMutableTransaction txChild;
+    txChild.nTime = 2000;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild));
+
+    // A grandchild that claims to be older than its parent still depends on it
+    CMutableTransaction txGrandChild;
+    txGrandChild.nTime = 500;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild.GetHash();
+    txGrandChild.vin[0].prevout.n = 0;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 8 * COIN;
+    pool.addUnchecked(txGrandChild.GetHash(), entry.FromTx(txGrandChild));
+
+    LOCK(pool.cs);
+    CTxMemPool::setEntries setNewer;
+    pool.CalculateNewerThan(3000, setNewer);
+    BOOST_CHECK(setNewer.empty());
+
+    pool.CalculateNewerThan(2000, setNewer);
+    BOOST_CHECK(setNewer.empty());
+
+    pool.CalculateNewerThan(1999, setNewer);
+    BOOST_CHECK_EQUAL(setNewer.size(), 2U);
+    BOOST_CHECK(setNewer.count(pool.mapTx.find(txChild.GetHash())));
+    BOOST_CHECK(setNewer.count(pool.mapTx.find(txGrandChild.GetHash())));
+
+    setNewer.clear();
+    pool.CalculateNewerThan(999, setNewer);
+    BOOST_CHECK_EQUAL(setNewer.size(), 3U);
+
+    // The walks without staging sets agree with the chain
+    std::vector<CTxMemPool::txiter> vDescendants;
+    pool.CalculateDescendants(pool.mapTx.find(txParent.GetHash()), vDescendants);
+    BOOST_CHECK_EQUAL(vDescendants.size(), 2U);
+    BOOST_CHECK(vDescendants[0] == pool.mapTx.find(txChild.GetHash()));
+    BOOST_CHECK(vDescendants[1] == pool.mapTx.find(txGrandChild.GetHash()));
+
+    CTxMemPool::setEntries setAncestors;
+    std::string dummy;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*pool.mapTx.find(txGrandChild.GetHash()), setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 2U);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*pool.mapTx.find(txGrandChild.GetHash()), setAncestors, 2, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPriorityIndexTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    pool.UpdatePriorityHeight(1);
+
+    // A high priority transaction of a small value, and a large one without priority yet
+    CMutableTransaction txSmall;
+    txSmall.vin.resize(1);
+    txSmall.vin[0].scriptSig = CScript() << OP_11;
+    txSmall.vout.resize(1);
+    txSmall.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txSmall.vout[0].nValue = 1 * COIN;
+    pool.addUnchecked(txSmall.GetHash(), entry.Priority(1e9).FromTx(txSmall, &pool));
+
+    CMutableTransaction txLarge;
+    txLarge.vin.resize(1);
+    txLarge.vin[0].scriptSig = CScript() << OP_12;
+    txLarge.vout.resize(1);
+    txLarge.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txLarge.vout[0].nValue = 100 * COIN;
+    pool.addUnchecked(txLarge.GetHash(), entry.Priority(0).FromTx(txLarge, &pool));
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.push_back(txSmall.GetHash().ToString());
+    sortedOrder.push_back(txLarge.GetHash().ToString());
+    CheckSort<priority_score>(pool, sortedOrder);
+
+    // The value of the large one ages faster, so it overtakes once keyed at a later height
+    pool.UpdatePriorityHeight(101);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txSmall.GetHash())->GetPriorityScore(), pool.mapTx.find(txSmall.GetHash())->GetPriority(101));
+    std::swap(sortedOrder[0], sortedOrder[1]);
+    CheckSort<priority_score>(pool, sortedOrder);
+
+    // Priority deltas are part of the key
+    pool.PrioritiseTransaction(txSmall.GetHash(), txSmall.GetHash().ToString(), 1e12, 0);
+    std::swap(sortedOrder[0], sortedOrder[1]);
+    CheckSort<priority_score>(pool, sortedOrder);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txSmall.GetHash())->GetPriorityScore(), pool.mapTx.find(txSmall.GetHash())->GetPriority(101) + 1e12);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000).FromTx(txParent));
+
+    std::shared_ptr<const TxMempoolSnapshot> snapshot = pool.GetSnapshot(1);
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 1U);
+    BOOST_CHECK(snapshot->vEntries[0].hash == txParent.GetHash());
+    BOOST_CHECK_EQUAL(snapshot->vEntries[0].nFee, 1000);
+    // Shared until the mempool or the chain height changes
+    BOOST_CHECK(pool.GetSnapshot(1) == snapshot);
+    BOOST_CHECK(pool.GetSnapshot(2) != snapshot);
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(2000).FromTx(txChild));
+
+    snapshot = pool.GetSnapshot(2);
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 2U);
+    BOOST_CHECK(snapshot->vEntries[0].hash < snapshot->vEntries[1].hash);
+    for (const TxMempoolEntrySummary& e : snapshot->vEntries) {
+        if (e.hash == txChild.GetHash()) {
+            BOOST_CHECK(e.vDepends.size() == 1 && e.vDepends[0] == txParent.GetHash());
+            BOOST_CHECK_EQUAL(e.nCountWithAncestors, 2U);
+        } else {
+            BOOST_CHECK(e.vDepends.empty());
+            BOOST_CHECK_EQUAL(e.nCountWithDescendants, 2U);
+        }
+    }
+
+    // Prioritising changes the modified fees, so the snapshot is taken again
+    pool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0, 500);
+    std::shared_ptr<const TxMempoolSnapshot> snapshotPrioritised = pool.GetSnapshot(2);
+    BOOST_CHECK(snapshotPrioritised != snapshot);
+    for (const TxMempoolEntrySummary& e : snapshotPrioritised->vEntries) {
+        if (e.hash == txParent.GetHash())
+            BOOST_CHECK_EQUAL(e.nModifiedFee, 1500);
+    }
+}
 
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
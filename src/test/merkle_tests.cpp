@@ -3,6 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "consensus/merkle.h"
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "random.h"
+#include "validation.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
 
@@ -133,4 +138,87 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+// CheckBlock() of a large block, on the block check threads of the fixture and serially, which must agree
+static bool CheckLargeBlock(const CBlock& block, std::string& strReason)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    CValidationState stateParallel, stateSerial;
+    BOOST_CHECK(nScriptCheckThreads > 0);
+    bool fParallel = CheckBlock(block, stateParallel, consensusParams, false);
+    int nThreads = nScriptCheckThreads;
+    nScriptCheckThreads = 0;
+    bool fSerial = CheckBlock(block, stateSerial, consensusParams, false);
+    nScriptCheckThreads = nThreads;
+    BOOST_CHECK_EQUAL(fParallel, fSerial);
+    BOOST_CHECK_EQUAL(stateParallel.GetRejectReason(), stateSerial.GetRejectReason());
+    strReason = stateParallel.GetRejectReason();
+    return fParallel;
+}
+
+static CBlock BuildLargeBlock(unsigned int nSigOpsPerTx)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 1;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 0; i < 200; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY;
+        for (unsigned int n = 0; n < nSigOpsPerTx; n++)
+            tx.vout[0].scriptPubKey << OP_CHECKSIG;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(block_check_jobs)
+{
+    std::string strReason;
+    CBlock block = BuildLargeBlock(1);
+    BOOST_CHECK(block.vtx.size() > BLOCK_CHECK_TXS_PER_JOB);
+    BOOST_CHECK(CheckLargeBlock(block, strReason));
+
+    // Wrong merkle root
+    CBlock blockBadRoot = block;
+    blockBadRoot.hashMerkleRoot = uint256();
+    BOOST_CHECK(!CheckLargeBlock(blockBadRoot, strReason));
+    BOOST_CHECK_EQUAL(strReason, "bad-txnmrklroot");
+
+    // Duplicating the last of an odd number of transactions keeps the merkle root (CVE-2012-2459)
+    CBlock blockMutated = block;
+    blockMutated.vtx.push_back(blockMutated.vtx.back());
+    BOOST_CHECK(BlockMerkleRoot(blockMutated) == block.hashMerkleRoot);
+    BOOST_CHECK(!CheckLargeBlock(blockMutated, strReason));
+    BOOST_CHECK_EQUAL(strReason, "bad-txns-duplicate");
+
+    // A transaction without outputs in one of the later jobs
+    CBlock blockBadTx = block;
+    CMutableTransaction txBad(*blockBadTx.vtx[150]);
+    txBad.vout.clear();
+    blockBadTx.vtx[150] = MakeTransactionRef(txBad);
+    blockBadTx.hashMerkleRoot = BlockMerkleRoot(blockBadTx);
+    BOOST_CHECK(!CheckLargeBlock(blockBadTx, strReason));
+    BOOST_CHECK_EQUAL(strReason, "bad-txns-vout-empty");
+
+    // The sigops counted by the jobs add up to the limit, and one more is too many
+    const unsigned int nSigOpsPerTx = MAX_BLOCK_SIGOPS_COST / WITNESS_SCALE_FACTOR / 200;
+    BOOST_CHECK(CheckLargeBlock(BuildLargeBlock(nSigOpsPerTx), strReason));
+    CBlock blockSigOps = BuildLargeBlock(nSigOpsPerTx);
+    CMutableTransaction txSigOps(*blockSigOps.vtx[200]);
+    txSigOps.vout[0].scriptPubKey << OP_CHECKSIG;
+    blockSigOps.vtx[200] = MakeTransactionRef(txSigOps);
+    blockSigOps.hashMerkleRoot = BlockMerkleRoot(blockSigOps);
+    BOOST_CHECK(!CheckLargeBlock(blockSigOps, strReason));
+    BOOST_CHECK_EQUAL(strReason, "bad-blk-sigops");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,40 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(metrics_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(metrics_format)
+{
+    SetMetric(METRIC_PEERS, 8);
+    SetMetric(METRIC_PEERS, 5);
+    int64_t nSent = GetMetric(METRIC_BYTES_SENT);
+    AddMetric(METRIC_BYTES_SENT, 100);
+    AddMetric(METRIC_BYTES_SENT, 20);
+    BOOST_CHECK_EQUAL(GetMetric(METRIC_PEERS), 5);
+    BOOST_CHECK_EQUAL(GetMetric(METRIC_BYTES_SENT), nSent + 120);
+
+    std::string str = FormatMetrics();
+    BOOST_CHECK(str.find("# HELP solarcoin_peers Connected peers\n# TYPE solarcoin_peers gauge\nsolarcoin_peers 5\n") != std::string::npos);
+    BOOST_CHECK(str.find("# TYPE solarcoin_net_sent_bytes_total counter\nsolarcoin_net_sent_bytes_total " + std::to_string(nSent + 120) + "\n") != std::string::npos);
+    BOOST_CHECK(str.find("solarcoin_uptime_seconds ") != std::string::npos);
+    // Every sample line is a name and a value
+    size_t nLines = 0;
+    for (size_t nPos = 0; nPos < str.size(); nPos = str.find('\n', nPos) + 1) {
+        if (str[nPos] != '#') {
+            BOOST_CHECK(str.compare(nPos, 10, "solarcoin_") == 0);
+            nLines++;
+        }
+    }
+    BOOST_CHECK(nLines >= METRIC_COUNT);
+    SetMetric(METRIC_PEERS, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
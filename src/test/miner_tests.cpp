@@ -70,6 +70,14 @@ CBlockIndex CreateBlockIndex(int nHeight)
     return index;
 }
 
+// SolarCoin: The median time past is cached in the block index, recompute it for the tip and the
+// ancestors whose times a test changed
+void RebuildMedianTimePast()
+{
+    for (int i = CBlockIndex::nMedianTimeSpan - 1; i >= 0; i--)
+        chainActive.Tip()->GetAncestor(chainActive.Tip()->nHeight - i)->BuildMedianTimePast();
+}
+
 bool TestSequenceLocks(const CTransaction &tx, int flags)
 {
     LOCK(mempool.cs);
@@ -428,9 +436,11 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 
     for (int i = 0; i < CBlockIndex::nMedianTimeSpan; i++)
         chainActive.Tip()->GetAncestor(chainActive.Tip()->nHeight - i)->nTime += 512; //Trick the MedianTimePast
+    RebuildMedianTimePast();
     BOOST_CHECK(SequenceLocks(tx, flags, &prevheights, CreateBlockIndex(chainActive.Tip()->nHeight + 1))); // Sequence locks pass 512 seconds later
     for (int i = 0; i < CBlockIndex::nMedianTimeSpan; i++)
         chainActive.Tip()->GetAncestor(chainActive.Tip()->nHeight - i)->nTime -= 512; //undo tricked MTP
+    RebuildMedianTimePast();
 
     // absolute height locked
     tx.vin[0].prevout.hash = txFirst[2]->GetHash();
@@ -478,6 +488,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     // However if we advance height by 1 and time by 512, all of them should be mined
     for (int i = 0; i < CBlockIndex::nMedianTimeSpan; i++)
         chainActive.Tip()->GetAncestor(chainActive.Tip()->nHeight - i)->nTime += 512; //Trick the MedianTimePast
+    RebuildMedianTimePast();
     chainActive.Tip()->nHeight++;
     SetMockTime(chainActive.Tip()->GetMedianTimePast() + 1);
 
@@ -11,6 +11,8 @@
 #include "net.h"
 #include "netbase.h"
 #include "chainparams.h"
+#include "test/testutil.h"
+#include <boost/filesystem.hpp>
 
 class CAddrManSerializationMock : public CAddrMan
 {
@@ -172,4 +174,209 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnetmessage_in_place)
+{
+    // A block sized payload, received with the header split and the payload partly in place
+    std::vector<unsigned char> payload(200000);
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = i * 7;
+    uint256 hash = Hash(payload.begin(), payload.end());
+    CMessageHeader hdrSent(Params().MessageStart(), "block", payload.size());
+    memcpy(hdrSent.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << hdrSent;
+    BOOST_CHECK_EQUAL(ssHeader.size(), CMessageHeader::HEADER_SIZE);
+
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(msg.readHeader(&ssHeader[0], 10), 10);
+    BOOST_CHECK(!msg.in_data);
+    BOOST_CHECK_EQUAL(msg.readHeader(&ssHeader[10], ssHeader.size() - 10), ssHeader.size() - 10);
+    BOOST_CHECK(msg.in_data);
+    BOOST_CHECK_EQUAL(msg.hdr.GetCommand(), "block");
+    BOOST_CHECK_EQUAL(msg.hdr.nMessageSize, payload.size());
+
+    size_t nPos = msg.readData((const char*)&payload[0], 1000);
+    BOOST_CHECK_EQUAL(nPos, 1000U);
+    while (nPos < payload.size() / 2) {
+        unsigned int nSize = 0;
+        char* pch = msg.GetDataBuffer(nSize);
+        BOOST_REQUIRE(nSize > 0);
+        unsigned int nBytes = std::min<size_t>(nSize, 30000);
+        memcpy(pch, &payload[nPos], nBytes);
+        msg.readDataInPlace(nBytes);
+        nPos += nBytes;
+    }
+    BOOST_CHECK(!msg.complete());
+    BOOST_CHECK_EQUAL(msg.readData((const char*)&payload[nPos], payload.size() - nPos), payload.size() - nPos);
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(msg.vRecv.size() == payload.size() && memcmp(&msg.vRecv[0], &payload[0], payload.size()) == 0);
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+
+    // A header in a single read is parsed where it was received
+    CNetMessage msg2(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(msg2.readHeader(&ssHeader[0], ssHeader.size()), ssHeader.size());
+    BOOST_CHECK(msg2.in_data);
+    BOOST_CHECK(memcmp(msg2.hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(net_msg_counters)
+{
+    const std::vector<std::string>& vTypes = getAllNetMessageTypes();
+    for (size_t i = 0; i < vTypes.size(); i++) {
+        BOOST_CHECK_EQUAL(GetNetMessageTypeIndex(vTypes[i]), i);
+        BOOST_CHECK_EQUAL(GetNetMessageTypeName(i), vTypes[i]);
+    }
+    BOOST_CHECK_EQUAL(GetNetMessageTypeIndex("nosuchtype"), NUM_NET_MESSAGE_TYPES);
+    BOOST_CHECK_EQUAL(GetNetMessageTypeIndex(""), NUM_NET_MESSAGE_TYPES);
+    BOOST_CHECK_EQUAL(GetNetMessageTypeName(NUM_NET_MESSAGE_TYPES), "*other*");
+
+    size_t nTx = GetNetMessageTypeIndex(NetMsgType::TX);
+    CNetMsgCounters counters;
+    counters.RecordSend(nTx, 250);
+    counters.RecordSend(nTx, 300);
+    counters.RecordRecv(NUM_NET_MESSAGE_TYPES, 40);
+    counters.RecordProcessingTime(nTx, 5);
+    counters.RecordProcessingTime(nTx, 10);
+    counters.RecordProcessingTime(nTx, 2500);
+    counters.RecordProcessingTime(nTx, 5000000);
+
+    CNetMsgCounters total;
+    total.Add(counters);
+    total.Add(counters);
+    std::vector<CNetMsgTypeStats> vStats(NUM_NET_MESSAGE_TYPES + 1);
+    total.AddTo(vStats);
+    BOOST_CHECK_EQUAL(vStats[nTx].nSendMsgs, 4U);
+    BOOST_CHECK_EQUAL(vStats[nTx].nSendBytes, 1100U);
+    BOOST_CHECK_EQUAL(vStats[nTx].nRecvMsgs, 0U);
+    BOOST_CHECK_EQUAL(vStats[NUM_NET_MESSAGE_TYPES].nRecvBytes, 80U);
+    BOOST_CHECK_EQUAL(vStats[nTx].nProcessTime, 2 * 5002515U);
+    BOOST_CHECK_EQUAL(vStats[nTx].vProcessTimeBuckets[0], 2U);
+    BOOST_CHECK_EQUAL(vStats[nTx].vProcessTimeBuckets[1], 2U);
+    BOOST_CHECK_EQUAL(vStats[nTx].vProcessTimeBuckets[3], 2U);
+    BOOST_CHECK_EQUAL(vStats[nTx].vProcessTimeBuckets[NET_PROCESSING_TIME_BUCKETS - 1], 2U);
+}
+
+BOOST_AUTO_TEST_CASE(net_send_lanes)
+{
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex(NetMsgType::HEADERS)), SEND_LANE_CONTROL);
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex(NetMsgType::PING)), SEND_LANE_CONTROL);
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex(NetMsgType::CMPCTBLOCK)), SEND_LANE_BLOCK);
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex(NetMsgType::BLOCK)), SEND_LANE_BLOCK);
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex(NetMsgType::INV)), SEND_LANE_TX);
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex(NetMsgType::TX)), SEND_LANE_TX);
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex(NetMsgType::ADDR)), SEND_LANE_ADDR);
+    BOOST_CHECK_EQUAL(GetSendLane(GetNetMessageTypeIndex("nosuchtype")), SEND_LANE_CONTROL);
+}
+
+BOOST_AUTO_TEST_CASE(net_token_bucket)
+{
+    CTokenBucket bucket;
+    int64_t nNow = 1000000000;
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), std::numeric_limits<int64_t>::max());
+
+    // Starts full with one second worth
+    bucket.SetRate(1000);
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), 1000);
+
+    // A transfer may overdraw it, and the next waits until the debt is paid
+    bucket.Consume(1500);
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), -500);
+    nNow += 400000;
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), -100);
+    nNow += 100000;
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), 0);
+
+    // Fractions of a byte add up over many refills
+    for (int i = 0; i < 10; i++) {
+        nNow += 100;
+        bucket.Available(nNow);
+    }
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), 1);
+
+    // Never more than one second worth
+    nNow += 60 * 1000000;
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), 1000);
+}
+
+BOOST_AUTO_TEST_CASE(net_message_capture)
+{
+    boost::filesystem::path pathTemp = GetTempPath() / strprintf("test_capture_%i", (int)GetRand(100000));
+    ForceSetArg("-datadir", pathTemp.string());
+    ClearDatadirCache();
+    boost::filesystem::create_directories(pathTemp);
+
+    CAddress addr(LookupNumeric("1.2.3.4", 8333), NODE_NONE);
+    const unsigned char pchPing[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    CaptureMessage(addr, NetMsgType::PING, pchPing, pchPing + sizeof(pchPing), true);
+    CaptureMessage(addr, NetMsgType::VERACK, pchPing, pchPing, true);
+    CaptureMessage(addr, NetMsgType::PONG, pchPing, pchPing + sizeof(pchPing), false);
+
+    std::string strAddr = addr.ToString();
+    std::replace(strAddr.begin(), strAddr.end(), ':', '_');
+    boost::filesystem::path pathRecv = pathTemp / "message_capture" / strAddr / "msgs_recv.dat";
+    std::vector<CCapturedMessage> vMessages;
+    BOOST_CHECK(ReadMessageCapture(pathRecv, vMessages));
+    BOOST_REQUIRE_EQUAL(vMessages.size(), 2U);
+    BOOST_CHECK_EQUAL(vMessages[0].strCommand, NetMsgType::PING);
+    BOOST_CHECK(vMessages[0].vData == std::vector<unsigned char>(pchPing, pchPing + sizeof(pchPing)));
+    BOOST_CHECK_EQUAL(vMessages[1].strCommand, NetMsgType::VERACK);
+    BOOST_CHECK(vMessages[1].vData.empty());
+    BOOST_CHECK(vMessages[0].nTimeMicros <= vMessages[1].nTimeMicros);
+
+    vMessages.clear();
+    BOOST_CHECK(ReadMessageCapture(pathRecv.parent_path() / "msgs_sent.dat", vMessages));
+    BOOST_REQUIRE_EQUAL(vMessages.size(), 1U);
+    BOOST_CHECK_EQUAL(vMessages[0].strCommand, NetMsgType::PONG);
+
+    // A record cut short is not read
+    boost::filesystem::resize_file(pathRecv, boost::filesystem::file_size(pathRecv) - 1);
+    vMessages.clear();
+    BOOST_CHECK(!ReadMessageCapture(pathRecv, vMessages));
+    BOOST_CHECK_EQUAL(vMessages.size(), 1U);
+
+    ClearDatadirCache();
+    boost::filesystem::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(cbandb_journal_torn_record)
+{
+    boost::filesystem::path pathTemp = GetTempPath() / strprintf("test_banjournal_%i", (int)GetRand(100000));
+    ForceSetArg("-datadir", pathTemp.string());
+    ClearDatadirCache();
+    boost::filesystem::create_directories(pathTemp);
+
+    CBanDB bandb;
+    banmap_t banSet;
+    BOOST_CHECK(bandb.Write(banSet));
+
+    CSubNet subNetA, subNetB;
+    BOOST_CHECK(LookupSubNet("1.2.3.0/24", subNetA));
+    BOOST_CHECK(LookupSubNet("5.6.7.8", subNetB));
+    CBanEntry banEntry(GetTime());
+    banEntry.nBanUntil = GetTime() + 3600;
+    banSet[subNetA] = banEntry;
+    BOOST_CHECK(bandb.WriteChanges(banSet, std::vector<CBanJournalRecord>(1, CBanJournalRecord(subNetA, banEntry))));
+
+    // A record torn by a crash is cut off, so the records appended after it are read back
+    boost::filesystem::path pathJournal = pathTemp / "banlist.journal";
+    uint64_t nJournalSize = boost::filesystem::file_size(pathJournal);
+    FILE* file = fopen(pathJournal.string().c_str(), "ab");
+    BOOST_REQUIRE(file);
+    const unsigned char pchTorn[] = {100, 1, 2, 3};
+    BOOST_CHECK_EQUAL(fwrite(pchTorn, 1, sizeof(pchTorn), file), sizeof(pchTorn));
+    fclose(file);
+    banSet[subNetB] = banEntry;
+    BOOST_CHECK(bandb.WriteChanges(banSet, std::vector<CBanJournalRecord>(1, CBanJournalRecord(subNetB, banEntry))));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(pathJournal), 2 * nJournalSize - (4 + 32));
+
+    banmap_t banSetRead;
+    BOOST_CHECK(bandb.Read(banSetRead));
+    BOOST_CHECK_EQUAL(banSetRead.size(), 2U);
+    BOOST_CHECK(banSetRead.count(subNetA));
+    BOOST_CHECK(banSetRead.count(subNetB));
+
+    ClearDatadirCache();
+    boost::filesystem::remove_all(pathTemp);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notify.h"
+#include "random.h"
+#include "scheduler.h"
+#include "util.h"
+
+#include "test/test_bitcoin.h"
+#include "test/testutil.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(notify_tests, BasicTestingSetup)
+
+#ifndef WIN32
+static std::vector<std::string> ReadLines(const boost::filesystem::path& path)
+{
+    std::vector<std::string> vLines;
+    std::ifstream file(path.string().c_str());
+    std::string strLine;
+    while (std::getline(file, strLine))
+        vLines.push_back(strLine);
+    return vLines;
+}
+
+BOOST_AUTO_TEST_CASE(notify_queue)
+{
+    ForceSetArg("-notifybatch", "100");
+    ForceSetArg("-notifyqueue", "3");
+    const boost::filesystem::path dir = GetTempPath() / strprintf("test_solarcoin_notify_%lu", (unsigned long)GetRand(1000000));
+    boost::filesystem::create_directories(dir);
+    auto command = [&dir](const std::string& strFile) { return "echo %s >> " + (dir / strFile).string(); };
+
+    // Queued before the notifications start, so each command runs once for all its arguments
+    // An argument waiting already is not queued again, but a command serving two notifications gets it for each
+    QueueNotification("blocknotify", command("shared"), "a");
+    QueueNotification("blocknotify", command("shared"), "b");
+    QueueNotification("blocknotify", command("shared"), "a");
+    QueueNotification("walletnotify", command("shared"), "a");
+    // Only the newest is kept
+    QueueNotification("alertnotify", command("latest"), "x", true);
+    QueueNotification("alertnotify", command("latest"), "y", true);
+    QueueNotification("alertnotify", command("latest"), "z", true);
+    // Beyond -notifyqueue the oldest are dropped
+    for (int i = 1; i <= 5; i++)
+        QueueNotification("walletnotify", command("capped"), strprintf("%d", i));
+
+    CScheduler scheduler;
+    StartNotifications(scheduler, 2);
+    boost::thread thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    thread.join();
+    StopNotifications();
+
+    std::vector<std::string> vShared = ReadLines(dir / "shared");
+    std::sort(vShared.begin(), vShared.end());
+    const std::string expectedShared[] = { "a", "a b" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(vShared.begin(), vShared.end(), expectedShared, expectedShared + 2);
+    std::vector<std::string> vLatest = ReadLines(dir / "latest");
+    BOOST_CHECK_EQUAL(vLatest.size(), 1U);
+    BOOST_CHECK(vLatest.size() == 1 && vLatest[0] == "z");
+    std::vector<std::string> vCapped = ReadLines(dir / "capped");
+    BOOST_CHECK_EQUAL(vCapped.size(), 1U);
+    BOOST_CHECK(vCapped.size() == 1 && vCapped[0] == "3 4 5");
+
+    boost::filesystem::remove_all(dir);
+    ForceSetArg("-notifybatch", strprintf("%d", DEFAULT_NOTIFY_BATCH));
+    ForceSetArg("-notifyqueue", strprintf("%d", DEFAULT_NOTIFY_QUEUE));
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
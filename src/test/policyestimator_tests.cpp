@@ -73,6 +73,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
             }
         }
         mpool.removeForBlock(block, ++blocknum);
+        mpool.ProcessFeeEstimates();
         block.clear();
         if (blocknum == 30) {
             // At this point we should need to combine 5 buckets to get enough data points
@@ -115,8 +116,10 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
 
     // Mine 50 more blocks with no transactions happening, estimates shouldn't change
     // We haven't decayed the moving average enough so we still have enough data points in every bucket
-    while (blocknum < 250)
+    while (blocknum < 250) {
         mpool.removeForBlock(block, ++blocknum);
+        mpool.ProcessFeeEstimates();
+    }
 
     BOOST_CHECK(mpool.estimateFee(1) == CFeeRate(0));
     for (int i = 2; i < 10;i++) {
@@ -137,6 +140,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
             }
         }
         mpool.removeForBlock(block, ++blocknum);
+        mpool.ProcessFeeEstimates();
     }
 
     int answerFound;
@@ -156,6 +160,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
         }
     }
     mpool.removeForBlock(block, 265);
+    mpool.ProcessFeeEstimates();
     block.clear();
     BOOST_CHECK(mpool.estimateFee(1) == CFeeRate(0));
     for (int i = 2; i < 10;i++) {
@@ -177,6 +182,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
             }
         }
         mpool.removeForBlock(block, ++blocknum);
+        mpool.ProcessFeeEstimates();
         block.clear();
     }
     BOOST_CHECK(mpool.estimateFee(1) == CFeeRate(0));
@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "memusage.h"
+#include "support/allocators/pool.h"
+#include "support/largepages.h"
+
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_reuse)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Sizes are rounded up to the alignment
+    void* a = resource.Allocate(10, 8);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 16U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    void* b = resource.Allocate(16, 8);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 32U);
+    BOOST_CHECK(a != b);
+
+    // A freed block is handed out again for the same size
+    resource.Deallocate(a, 10, 8);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 16U);
+    BOOST_CHECK(resource.Allocate(12, 8) == a);
+
+    // Larger or more strictly aligned allocations bypass the pool
+    void* c = resource.Allocate(100, 8);
+    void* d = resource.Allocate(8, 16);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 32U);
+    resource.Deallocate(c, 100, 8);
+    resource.Deallocate(d, 8, 16);
+
+    // A new chunk is taken once the first one is used up
+    for (int i = 0; i < 1024 / 64; i++)
+        resource.Allocate(64, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_coins_map)
+{
+    CCoinsMapMemoryResource resource;
+    size_t nUsage = 0;
+    {
+        CCoinsMap map(0, SaltedOutpointHasher(), std::equal_to<COutPoint>(), CCoinsMapAllocator(&resource));
+        std::vector<COutPoint> outpoints;
+        for (int i = 0; i < 1000; i++) {
+            outpoints.push_back(COutPoint(GetRandHash(), insecure_rand() % 10));
+            map[outpoints.back()].coin.out.nValue = i;
+        }
+        // Every node is accounted for
+        BOOST_CHECK(resource.UsedBytes() >= map.size() * sizeof(CCoinsMap::value_type));
+        nUsage = memusage::DynamicUsage(map);
+        BOOST_CHECK(nUsage >= resource.UsedBytes());
+
+        // The chunks are counted whole, as they are allocated
+        BOOST_CHECK(nUsage >= resource.NumAllocatedChunks() * resource.ChunkSizeBytes());
+
+        // Erased nodes free their blocks, but the pool keeps the memory, and reuses it
+        size_t nUsedBytes = resource.UsedBytes();
+        for (int i = 0; i < 500; i++)
+            map.erase(outpoints[i]);
+        BOOST_CHECK(resource.UsedBytes() < nUsedBytes);
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), nUsage);
+        size_t nChunks = resource.NumAllocatedChunks();
+        for (int i = 0; i < 500; i++)
+            map[COutPoint(GetRandHash(), 0)].coin.out.nValue = i;
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), nUsage);
+
+        // Entries can move between maps with and without a pool
+        CCoinsMap mapPlain;
+        for (CCoinsMap::iterator it = map.begin(); it != map.end();) {
+            mapPlain.emplace(it->first, std::move(it->second));
+            map.erase(it++);
+        }
+        BOOST_CHECK_EQUAL(mapPlain.size(), 1000U);
+        BOOST_CHECK(mapPlain.get_allocator() != map.get_allocator());
+    }
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_large_pages)
+{
+    // Off, nothing is mapped and the pool takes chunks from the heap
+    BOOST_CHECK_EQUAL(GetLargePagesMode(), LARGE_PAGES_NONE);
+    BOOST_CHECK(AllocateLargePages(LARGE_PAGE_SIZE) == NULL);
+
+    SetLargePagesMode(LARGE_PAGES_EXPLICIT);
+    {
+        // Explicit huge pages are rarely reserved on test hosts; either way the pool works
+        PoolResource<64, 8> resource(1024, true);
+        BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), LARGE_PAGE_SIZE);
+        std::vector<char*> vBlocks;
+        for (size_t i = 0; i < 2 * LARGE_PAGE_SIZE / 64; i++) {
+            vBlocks.push_back(static_cast<char*>(resource.Allocate(64, 8)));
+            memset(vBlocks.back(), (int)i, 64);
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+        for (size_t i = 0; i < vBlocks.size(); i++)
+            BOOST_CHECK_EQUAL(vBlocks[i][63], (char)i);
+
+        void* p = AllocateLargePages(1);
+#ifndef WIN32
+        BOOST_CHECK(p != NULL);
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p) % LARGE_PAGE_SIZE, 0U);
+        memset(p, 1, LARGE_PAGE_SIZE);
+#endif
+        FreeLargePages(p, 1);
+    }
+    SetLargePagesMode(DEFAULT_LARGE_PAGES);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
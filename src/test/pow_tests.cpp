@@ -4,12 +4,15 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "pow.h"
 #include "random.h"
 #include "util.h"
+#include "validation.h"
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(pow_tests, BasicTestingSetup)
 
@@ -93,4 +96,110 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* Test that the PoW/PoST type links and the memoized PoST target match a plain walk of the chain */
+BOOST_AUTO_TEST_CASE(next_target_required_memoized)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    // Two identical chains across the last PoW block, only the first one has its type links built
+    const int nBlocks = 200;
+    const int nStartHeight = params.LAST_POW_BLOCK - nBlocks / 2;
+    std::vector<CBlockIndex> blocks(nBlocks), blocksPlain(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        for (std::vector<CBlockIndex>* chain : {&blocks, &blocksPlain}) {
+            CBlockIndex& block = (*chain)[i];
+            block.pprev = i ? &(*chain)[i - 1] : NULL;
+            block.nHeight = nStartHeight + i;
+            block.nTime = 1269211443 + i * params.nTargetSpacing + (i % 7) * 13;
+            block.nBits = 0x1e0fffff - (i % 5) * 0x100;
+        }
+        blocks[i].BuildPrevOtherType(params.LAST_POW_BLOCK);
+    }
+
+    for (int i = 0; i < nBlocks; i++) {
+        for (bool fProofOfStake : {false, true}) {
+            const CBlockIndex* pindexLast = GetLastBlockIndex(&blocks[i], fProofOfStake, params);
+            const CBlockIndex* pindexLastPlain = GetLastBlockIndex(&blocksPlain[i], fProofOfStake, params);
+            BOOST_CHECK_EQUAL(pindexLast->nHeight, pindexLastPlain->nHeight);
+        }
+        BOOST_CHECK_EQUAL(blocks[i].nNextTargetRequired, 0U);
+        unsigned int nBits = GetNextTargetRequired(&blocks[i], true, params);
+        BOOST_CHECK_EQUAL(blocks[i].nNextTargetRequired, nBits);
+        BOOST_CHECK_EQUAL(GetNextTargetRequired(&blocks[i], true, params), nBits);
+        BOOST_CHECK_EQUAL(GetNextTargetRequired(&blocksPlain[i], true, params), nBits);
+    }
+}
+
+/* Test that header proof of work checks run on a check queue give the serial results */
+BOOST_AUTO_TEST_CASE(header_pow_check_queue)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    // About half of the nonces satisfy the regtest limit
+    std::vector<CBlockHeader> headers(64);
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].nVersion = CBlockHeader::LEGACY_VERSION_2;
+        headers[i].hashPrevBlock = GetRandHash();
+        headers[i].nTime = 1269211443 + i;
+        headers[i].nBits = UintToArith256(params.powLimit).GetCompact();
+        headers[i].nNonce = i;
+    }
+
+    std::vector<char> vValid(headers.size(), 0);
+    std::vector<CHeaderPoWCheck> vChecks;
+    // Checks of 1, 2, ... SCRYPT_MULTI_MAX_WAYS headers in turn
+    size_t nWays = 0, nInCheck = 0;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (nInCheck == nWays) {
+            vChecks.push_back(CHeaderPoWCheck(params));
+            nWays = nWays % SCRYPT_MULTI_MAX_WAYS + 1;
+            nInCheck = 0;
+        }
+        vChecks.back().Add(headers[i], &vValid[i]);
+        nInCheck++;
+    }
+
+    CCheckQueue<CHeaderPoWCheck> queue(8);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 2; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CHeaderPoWCheck>::Thread, boost::ref(queue)));
+    {
+        CCheckQueueControl<CHeaderPoWCheck> control(&queue);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    int nValid = 0;
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK_EQUAL(vValid[i] != 0, CheckProofOfWork(headers[i].GetPoWHash(), headers[i].nBits, params));
+        nValid += vValid[i] != 0;
+    }
+    BOOST_CHECK(nValid > 0 && nValid < (int)headers.size());
+}
+
+/* Test that the memoized block proof matches the division for every target, including ones that evict each other */
+BOOST_AUTO_TEST_CASE(block_proof_memoized)
+{
+    CBlockIndex block;
+    for (int nRound = 0; nRound < 2; nRound++) {
+        for (uint32_t i = 0; i < 5000; i++) {
+            block.nBits = 0x1c100000 + i * 0x101;
+            arith_uint256 bnTarget;
+            bnTarget.SetCompact(block.nBits);
+            BOOST_CHECK(GetBlockProof(block) == (~bnTarget / (bnTarget + 1)) + 1);
+        }
+    }
+    // Negative, overflowing and zero targets have no proof
+    block.nBits = 0x04923456;
+    BOOST_CHECK(GetBlockProof(block) == 0);
+    block.nBits = 0xff123456;
+    BOOST_CHECK(GetBlockProof(block) == 0);
+    block.nBits = 0;
+    BOOST_CHECK(GetBlockProof(block) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,83 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "profile.h"
+#include "utiltime.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(profile_tests, BasicTestingSetup)
+
+static void ProfiledInner()
+{
+    PROFILE_SCOPE("ProfileTestInner");
+    MilliSleep(2);
+}
+
+static void ProfiledOuter()
+{
+    PROFILE_SCOPE("ProfileTestOuter");
+    ProfiledInner();
+    ProfiledInner();
+}
+
+static std::string PathString(const CProfilePath& path)
+{
+    std::string str;
+    for (const CProfileSite* psite : path.vSites)
+        str += str.empty() ? psite->pszName : std::string(";") + psite->pszName;
+    return str;
+}
+
+static const CProfilePath* FindPath(const std::vector<CProfilePath>& vPaths, const std::string& str)
+{
+    for (const CProfilePath& path : vPaths) {
+        if (PathString(path) == str)
+            return &path;
+    }
+    return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(profile_paths)
+{
+    ResetProfile();
+
+    // Not profiled: nothing is recorded
+    ProfiledOuter();
+    BOOST_CHECK(!FindPath(GetProfilePaths(), "ProfileTestOuter"));
+
+    fProfile = true;
+    ProfiledOuter();
+    ProfiledInner();
+    // The same path taken on another thread adds up with this one
+    std::thread thread(ProfiledOuter);
+    thread.join();
+    fProfile = false;
+
+    std::vector<CProfilePath> vPaths = GetProfilePaths();
+    const CProfilePath* pouter = FindPath(vPaths, "ProfileTestOuter");
+    const CProfilePath* pnested = FindPath(vPaths, "ProfileTestOuter;ProfileTestInner");
+    const CProfilePath* pinner = FindPath(vPaths, "ProfileTestInner");
+    BOOST_REQUIRE(pouter && pnested && pinner);
+    BOOST_CHECK_EQUAL(pouter->nCount, 2U);
+    BOOST_CHECK_EQUAL(pnested->nCount, 4U);
+    BOOST_CHECK_EQUAL(pinner->nCount, 1U);
+    // The outer scope spent its time in the inner one
+    BOOST_CHECK_EQUAL(pouter->nChildTicks, pnested->nTicks);
+    BOOST_CHECK(pouter->nTicks >= pnested->nTicks);
+    BOOST_CHECK(pnested->nTicks / GetProfileTicksPerMicro() >= 4 * 2000 * 0.9);
+
+    std::string strFolded = FormatProfileFolded(vPaths);
+    BOOST_CHECK(strFolded.find("ProfileTestOuter;ProfileTestInner ") != std::string::npos);
+    BOOST_CHECK(strFolded.find("\nProfileTestInner ") != std::string::npos || strFolded.find("ProfileTestInner ") == 0);
+
+    ResetProfile();
+    BOOST_CHECK(!FindPath(GetProfilePaths(), "ProfileTestOuter"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/jsonstream.h"
 
 #include "base58.h"
 #include "netbase.h"
@@ -104,6 +105,22 @@ BOOST_AUTO_TEST_CASE(rpc_togglenetwork)
     BOOST_CHECK_EQUAL(netState, true);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_getmemoryinfo)
+{
+    UniValue r = CallRPC("getmemoryinfo");
+    BOOST_CHECK(find_value(r.get_obj(), "locked").isObject());
+    BOOST_CHECK(find_value(r.get_obj(), "usage").isNull());
+
+    r = CallRPC("getmemoryinfo detailed");
+    const UniValue& usage = find_value(r.get_obj(), "usage");
+    int64_t nBlockIndex = find_value(usage, "blockindex").get_int64();
+    BOOST_CHECK(nBlockIndex > 0);
+    BOOST_CHECK(find_value(usage, "total").get_int64() >= nBlockIndex + find_value(usage, "coinscache").get_int64());
+    BOOST_CHECK(find_value(usage, "leveldb").isObject());
+
+    BOOST_CHECK_THROW(CallRPC("getmemoryinfo other"), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_CASE(rpc_rawsign)
 {
     UniValue r;
@@ -343,4 +360,51 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+static void WriteJSONResult(CJSONStream* stream, UniValue& ret)
+{
+    CJSONResult result(stream, UniValue::VOBJ);
+    result.pushKV("name", "a\"b");
+    CJSONResult list(result, "list", UniValue::VARR);
+    for (int i = 0; i < 100; i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("n", i));
+        list.push_back(entry);
+    }
+    list.Finish();
+    CJSONResult empty(result, "empty", UniValue::VARR);
+    empty.Finish();
+    result.push_back(Pair("last", true));
+    ret = result.Finish();
+}
+
+BOOST_AUTO_TEST_CASE(rpc_jsonstream)
+{
+    // Without a stream the result is collected
+    UniValue collected;
+    WriteJSONResult(NULL, collected);
+    BOOST_CHECK(collected.isObject());
+    BOOST_CHECK_EQUAL(collected["list"].size(), 100U);
+
+    // Streamed in small chunks it is the same text
+    std::string strStreamed;
+    int nChunks = 0;
+    CJSONStream stream([&](const std::string& strChunk) { strStreamed += strChunk; nChunks++; }, 64);
+    UniValue ret;
+    WriteJSONResult(&stream, ret);
+    BOOST_CHECK(ret.isNull());
+    BOOST_CHECK(stream.IsUsed() && stream.IsFlushed());
+    strStreamed += stream.TakeBuffer();
+    BOOST_CHECK(nChunks > 1);
+    BOOST_CHECK_EQUAL(strStreamed, collected.write());
+
+    // A short result stays in the buffer
+    CJSONStream streamShort([](const std::string&) { BOOST_ERROR("unexpected flush"); });
+    CJSONResult a(&streamShort, UniValue::VARR);
+    a.push_back(UniValue(1));
+    a.push_back(UniValue("x"));
+    a.Finish();
+    BOOST_CHECK(!streamShort.IsFlushed());
+    BOOST_CHECK_EQUAL(streamShort.TakeBuffer(), "[1,\"x\"]");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
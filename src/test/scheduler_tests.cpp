@@ -7,6 +7,9 @@
 
 #include "test/test_bitcoin.h"
 
+#include <algorithm>
+#include <vector>
+
 #include <boost/bind.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
@@ -114,4 +117,79 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+static void cappedTask(boost::mutex& mutex, int& nRunning, int& nMaxRunning)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nMaxRunning = std::max(nMaxRunning, ++nRunning);
+    }
+    MicroSleep(200);
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nRunning--;
+}
+
+BOOST_AUTO_TEST_CASE(queue_caps)
+{
+    // Tasks of a queue never run on more threads than its cap, while the
+    // queues without a cap use all of them
+    CScheduler scheduler;
+    CScheduler::QueueId nCapped = scheduler.addQueue("capped", 2);
+    boost::mutex mutex;
+    int nRunning[2] = { 0 }, nMaxRunning[2] = { 0 };
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    for (int i = 0; i < 40; i++) {
+        scheduler.schedule(boost::bind(&cappedTask, boost::ref(mutex), boost::ref(nRunning[0]), boost::ref(nMaxRunning[0])), now, nCapped);
+        scheduler.schedule(boost::bind(&cappedTask, boost::ref(mutex), boost::ref(nRunning[1]), boost::ref(nMaxRunning[1])), now);
+    }
+
+    boost::thread_group threads;
+    for (int i = 0; i < 6; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK(nMaxRunning[0] >= 1 && nMaxRunning[0] <= 2);
+    BOOST_CHECK(nMaxRunning[1] >= 1);
+    std::vector<CScheduler::QueueStats> vStats = scheduler.getQueueStats();
+    BOOST_CHECK_EQUAL(vStats.size(), 2U);
+    BOOST_CHECK_EQUAL(vStats[CScheduler::DEFAULT_QUEUE].strName, "default");
+    BOOST_CHECK_EQUAL(vStats[nCapped].strName, "capped");
+    BOOST_CHECK_EQUAL(vStats[nCapped].nMaxConcurrent, 2);
+    for (const CScheduler::QueueStats& stats : vStats) {
+        BOOST_CHECK_EQUAL(stats.nRun, 40U);
+        BOOST_CHECK_EQUAL(stats.nQueued, 0U);
+        BOOST_CHECK_EQUAL(stats.nRunning, 0);
+        BOOST_CHECK(stats.nMaxWaitMicros >= 0 && stats.nWaitMicros >= stats.nMaxWaitMicros);
+    }
+}
+
+static void orderedTask(std::vector<int>& vOrder, int n)
+{
+    vOrder.push_back(n);
+}
+
+BOOST_AUTO_TEST_CASE(queue_priorities)
+{
+    // Among the due tasks, those of the queue with the higher priority run first
+    CScheduler scheduler;
+    CScheduler::QueueId nLow = scheduler.addQueue("low", 0, -1);
+    CScheduler::QueueId nHigh = scheduler.addQueue("high", 0, 1);
+    std::vector<int> vOrder;
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    for (int i = 0; i < 3; i++) {
+        scheduler.schedule(boost::bind(&orderedTask, boost::ref(vOrder), 0), now - boost::chrono::seconds(3 - i), nLow);
+        scheduler.schedule(boost::bind(&orderedTask, boost::ref(vOrder), 1), now - boost::chrono::seconds(3 - i));
+        scheduler.schedule(boost::bind(&orderedTask, boost::ref(vOrder), 2), now - boost::chrono::seconds(3 - i), nHigh);
+    }
+    // Not due yet: runs last whatever its priority
+    scheduler.schedule(boost::bind(&orderedTask, boost::ref(vOrder), 3), now + boost::chrono::milliseconds(50), nHigh);
+
+    boost::thread thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    thread.join();
+
+    const int expected[] = { 2, 2, 2, 1, 1, 1, 0, 0, 0, 3 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(vOrder.begin(), vOrder.end(), expected, expected + 10);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "segmentedbuffer.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(segmentedbuffer_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(segmentedbuffer_write)
+{
+    // Writes of every size, some crossing segments, some larger than a segment
+    std::vector<unsigned char> vchExpected;
+    CSegmentedBuffer buffer;
+    const size_t vnWrites[] = {1, 0, 100, CSegmentedBuffer::SEGMENT_SIZE - 50, 100, 3 * CSegmentedBuffer::SEGMENT_SIZE + 7, 12345};
+    for (size_t nWrite : vnWrites) {
+        std::vector<unsigned char> vch(nWrite);
+        if (nWrite)
+            GetRandBytes(vch.data(), vch.size());
+        buffer.write(reinterpret_cast<const char*>(vch.data()), vch.size());
+        vchExpected.insert(vchExpected.end(), vch.begin(), vch.end());
+        BOOST_CHECK_EQUAL(buffer.size(), vchExpected.size());
+        BOOST_CHECK(buffer.GetHash() == Hash(vchExpected.begin(), vchExpected.end()));
+    }
+    BOOST_CHECK(buffer.ToVector() == vchExpected);
+    for (size_t n = 0; n < buffer.GetSegmentCount(); n++)
+        BOOST_CHECK(buffer.GetSegment(n).size() <= CSegmentedBuffer::SEGMENT_SIZE);
+
+    // Every offset is found in the segment holding its byte
+    const size_t vnOffsets[] = {0, 1, CSegmentedBuffer::SEGMENT_SIZE - 1, CSegmentedBuffer::SEGMENT_SIZE, CSegmentedBuffer::SEGMENT_SIZE + 1, vchExpected.size() - 1};
+    for (size_t nOffset : vnOffsets) {
+        size_t nSegment, nSegmentOffset;
+        buffer.Find(nOffset, nSegment, nSegmentOffset);
+        BOOST_CHECK(nSegmentOffset < buffer.GetSegment(nSegment).size());
+        BOOST_CHECK_EQUAL(buffer.GetSegment(nSegment)[nSegmentOffset], vchExpected[nOffset]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(segmentedbuffer_shared)
+{
+    std::vector<unsigned char> vch(CSegmentedBuffer::SEGMENT_SIZE + 10, 0x01);
+    std::vector<unsigned char> vchCopied(vch);
+    CSegmentedBuffer buffer(std::move(vchCopied));
+    BOOST_CHECK_EQUAL(buffer.GetSegmentCount(), 1U);
+    BOOST_CHECK(buffer.GetHash() == Hash(vch.begin(), vch.end()));
+
+    // A copy shares the segments, and neither sees what the other appends
+    CSegmentedBuffer copy(buffer);
+    const char a = 0x02, b = 0x03;
+    buffer.write(&a, 1);
+    copy.write(&b, 1);
+    BOOST_CHECK(&buffer.GetSegment(0) == &copy.GetSegment(0));
+    std::vector<unsigned char> vchBuffer(vch), vchCopy(vch);
+    vchBuffer.push_back(a);
+    vchCopy.push_back(b);
+    BOOST_CHECK(buffer.ToVector() == vchBuffer);
+    BOOST_CHECK(copy.ToVector() == vchCopy);
+    BOOST_CHECK(buffer.GetHash() == Hash(vchBuffer.begin(), vchBuffer.end()));
+    BOOST_CHECK(copy.GetHash() == Hash(vchCopy.begin(), vchCopy.end()));
+}
+
+BOOST_AUTO_TEST_CASE(segmentedbuffer_writer)
+{
+    std::vector<uint256> vHashes(10000);
+    for (uint256& hash : vHashes)
+        hash = GetRandHash();
+    CSegmentedBuffer buffer;
+    CSegmentedWriter(SER_NETWORK, PROTOCOL_VERSION, buffer, vHashes, (uint32_t)7);
+    std::vector<unsigned char> vch;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vch, 0, vHashes, (uint32_t)7);
+    BOOST_CHECK(buffer.ToVector() == vch);
+    BOOST_CHECK(buffer.GetSegmentCount() > 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
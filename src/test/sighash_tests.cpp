@@ -144,6 +144,11 @@ BOOST_AUTO_TEST_CASE(sighash_test)
         uint256 sh, sho;
         sho = SignatureHashOld(scriptCode, txTo, nIn, nHashType);
         sh = SignatureHash(scriptCode, txTo, nIn, nHashType, 0, SIGVERSION_BASE);
+        // The legacy serialization cached for SIGHASH_ALL hashes the same
+        const CTransaction tx(txTo);
+        const PrecomputedTransactionData txdata(tx);
+        BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE, &txdata) == sho);
+        BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL, 0, SIGVERSION_BASE, &txdata) == SignatureHashOld(scriptCode, tx, nIn, SIGHASH_ALL));
         #if defined(PRINT_SIGHASH_JSON)
         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
         ss << txTo;
@@ -143,4 +143,19 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_test)
         BOOST_CHECK(vBlocksMain[r].GetAncestor(ret->nHeight) == ret);
     }
 }
+
+BOOST_AUTO_TEST_CASE(mediantimepast_cache_test)
+{
+    std::vector<CBlockIndex> vIndex(1000);
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+        vIndex[i].nTime = 1500000000 + insecure_rand() % 10000;
+        BOOST_CHECK_EQUAL(vIndex[i].GetMedianTimePast(), vIndex[i].ComputeMedianTimePast());
+        vIndex[i].BuildMedianTimePast();
+        BOOST_CHECK_EQUAL(vIndex[i].nMedianTimePast, vIndex[i].ComputeMedianTimePast());
+        BOOST_CHECK_EQUAL(vIndex[i].GetMedianTimePast(), vIndex[i].ComputeMedianTimePast());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
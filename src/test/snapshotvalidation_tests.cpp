@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "txdb.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(snapshotvalidation_tests, TestChain100Setup)
+
+/** Connect the blocks of the active chain from nFrom to nTo to view, as the background validation does */
+static void ReplaySnapshotBlocks(CCoinsViewCache& view, int nFrom, int nTo)
+{
+    for (int nHeight = nFrom; nHeight <= nTo; nHeight++) {
+        CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = chainActive[nHeight];
+        }
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+        CValidationState state;
+        BOOST_CHECK_MESSAGE(ConnectSnapshotBlock(block, pindex, view, Params(), state), FormatStateMessage(state));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_replay)
+{
+    // The coins a snapshot of the tip would load
+    FlushStateToDisk();
+    uint256 hashLoaded;
+    BOOST_REQUIRE(GetSnapshotCoinsHash(*pcoinsdbview, hashLoaded));
+    int nTipHeight;
+    {
+        LOCK(cs_main);
+        nTipHeight = chainActive.Height();
+    }
+    BOOST_REQUIRE(nTipHeight > 2);
+
+    // Replay half of the chain, stop as if interrupted, and resume from the coins written so far
+    {
+        CCoinsViewDB db(1 << 20, false, true, "chainstate_snapshot");
+        CCoinsViewCache view(&db);
+        view.SetBestBlock(chainActive.Genesis()->GetBlockHash());
+        ReplaySnapshotBlocks(view, 1, nTipHeight / 2);
+        BOOST_CHECK(view.Flush());
+    }
+    CCoinsViewDB db(1 << 20, false, false, "chainstate_snapshot");
+    BOOST_CHECK(db.GetBestBlock() == chainActive[nTipHeight / 2]->GetBlockHash());
+    {
+        CCoinsViewCache view(&db);
+        ReplaySnapshotBlocks(view, nTipHeight / 2 + 1, nTipHeight - 1);
+
+        // A block that does not match the block index entry the snapshot filled in is rejected
+        CBlockIndex* pindexTip = chainActive.Tip();
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindexTip, Params().GetConsensus()));
+        CCoinsViewCache viewTampered(&view);
+        CValidationState state;
+        pindexTip->nMint++;
+        BOOST_CHECK(!ConnectSnapshotBlock(block, pindexTip, viewTampered, Params(), state));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-snapshot-money-supply");
+        pindexTip->nMint--;
+
+        ReplaySnapshotBlocks(view, nTipHeight, nTipHeight);
+        BOOST_CHECK(view.GetBestBlock() == pindexTip->GetBlockHash());
+        BOOST_CHECK(view.Flush());
+    }
+
+    // The replayed coins match the loaded ones
+    uint256 hashReplayed;
+    BOOST_REQUIRE(GetSnapshotCoinsHash(db, hashReplayed));
+    BOOST_CHECK(hashReplayed == hashLoaded);
+
+    // A snapshot coin with the right output but another height, as a tampered snapshot could have
+    // to change stake ages, does not
+    CBlock blockTip;
+    BOOST_REQUIRE(ReadBlockFromDisk(blockTip, chainActive.Tip(), Params().GetConsensus()));
+    COutPoint outpoint(blockTip.vtx[0]->GetHash(), 0);
+    {
+        CCoinsViewCache view(&db);
+        Coin coin = view.AccessCoin(outpoint);
+        BOOST_REQUIRE(!coin.IsSpent());
+        coin.nHeight--;
+        view.AddCoin(outpoint, std::move(coin), true);
+        BOOST_CHECK(view.Flush());
+    }
+    uint256 hashTampered;
+    BOOST_REQUIRE(GetSnapshotCoinsHash(db, hashTampered));
+    BOOST_CHECK(hashTampered != hashLoaded);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
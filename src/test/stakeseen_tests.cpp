@@ -0,0 +1,49 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "random.h"
+#include "stakeseen.h"
+#include "test/test_bitcoin.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakeseen_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(stakeseen_matches_set)
+{
+    // Few distinct prevouts and times, so the same stakes show up again and the table grows several times
+    std::vector<CBlockIndex> vIndex(5000);
+    std::set<std::pair<COutPoint, unsigned int> > setExpected;
+    CStakeSeenSet stakeSeen;
+    for (CBlockIndex& index : vIndex) {
+        index.SetStake(COutPoint(ArithToUint256(arith_uint256(GetRand(2000))), GetRand(3)), 1518000000 + GetRand(2));
+        stakeSeen.insert(&index);
+        setExpected.insert(std::make_pair(index.GetPrevoutStake(), index.GetStakeTime()));
+    }
+    BOOST_CHECK_EQUAL(stakeSeen.size(), setExpected.size());
+
+    for (unsigned int i = 0; i < 2000; i++) {
+        for (uint32_t n = 0; n < 4; n++) {
+            for (unsigned int nTime = 1518000000; nTime < 1518000003; nTime++) {
+                std::pair<COutPoint, unsigned int> stake(COutPoint(ArithToUint256(arith_uint256(i)), n), nTime);
+                BOOST_CHECK_EQUAL(stakeSeen.count(stake), setExpected.count(stake));
+            }
+        }
+    }
+
+    // Blocks without a stake are not added
+    CBlockIndex indexNull;
+    stakeSeen.insert(&indexNull);
+    BOOST_CHECK_EQUAL(stakeSeen.size(), setExpected.size());
+
+    stakeSeen.clear();
+    BOOST_CHECK_EQUAL(stakeSeen.size(), 0);
+    BOOST_CHECK_EQUAL(stakeSeen.count(*setExpected.begin()), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
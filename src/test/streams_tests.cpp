@@ -72,6 +72,29 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_writer_reader)
+{
+    unsigned char buf[8];
+    uint32_t a = 1;
+    uint16_t b = 2;
+    CSpanWriter writer(SER_NETWORK, INIT_PROTO_VERSION, buf, buf + sizeof(buf));
+    writer << a << b;
+    BOOST_CHECK_EQUAL(writer.size(), 6U);
+    BOOST_CHECK((std::vector<unsigned char>(writer.data(), writer.data() + writer.size()) == std::vector<unsigned char>{{1, 0, 0, 0, 2, 0}}));
+    // The buffer is not overrun
+    BOOST_CHECK_THROW(writer << a, std::ios_base::failure);
+    BOOST_CHECK_EQUAL(writer.size(), 6U);
+
+    uint32_t c;
+    uint16_t d;
+    CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, buf, buf + writer.size());
+    reader >> c >> d;
+    BOOST_CHECK_EQUAL(c, a);
+    BOOST_CHECK_EQUAL(d, b);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> d, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
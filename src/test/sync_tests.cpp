@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "utiltime.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+static const CLockSite* FindLockSite(int nLine)
+{
+    for (const CLockSite* psite : GetLockSites()) {
+        if (psite->nLine == nLine && std::string(psite->pszFile) == __FILE__)
+            return psite;
+    }
+    return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(lock_profile)
+{
+    CCriticalSection cs;
+    std::atomic<bool> fHeld(false);
+
+    // Not profiled: no site is made
+    const int nLineOff = __LINE__ + 1;
+    { LOCK(cs); }
+    BOOST_CHECK(!FindLockSite(nLineOff));
+
+    fLockProfile = true;
+    const int nLineHolder = __LINE__ + 3;
+    std::thread holder([&] {
+        // The first acquisition of a site has its hold time sampled
+        LOCK(cs);
+        fHeld = true;
+        MilliSleep(50);
+    });
+    while (!fHeld)
+        MilliSleep(1);
+    const int nLineWaiter = __LINE__ + 1;
+    { LOCK(cs); }
+    holder.join();
+    const int nLineTry = __LINE__ + 1;
+    { TRY_LOCK(cs, lockTry); BOOST_CHECK(bool(lockTry)); }
+    fLockProfile = false;
+
+    const CLockSite* pholder = FindLockSite(nLineHolder);
+    const CLockSite* pwaiter = FindLockSite(nLineWaiter);
+    BOOST_REQUIRE(pholder && pwaiter);
+    BOOST_CHECK_EQUAL(std::string(pwaiter->pszName), "cs");
+    BOOST_CHECK_EQUAL(pwaiter->nContentions.load(), 1U);
+    BOOST_CHECK_EQUAL(pwaiter->histWait.GetCount(), 1U);
+    BOOST_CHECK(pwaiter->histWait.GetTotal() > 0);
+    BOOST_CHECK_EQUAL(pwaiter->nBlocking.load(), 0U);
+
+    // The wait is put down to the site holding the lock
+    BOOST_CHECK_EQUAL(pholder->nContentions.load(), 0U);
+    BOOST_CHECK_EQUAL(pholder->nBlocking.load(), 1U);
+    BOOST_CHECK_EQUAL(pholder->histBlocking.GetTotal(), pwaiter->histWait.GetTotal());
+    BOOST_CHECK_EQUAL(pholder->histHold.GetCount(), 1U);
+
+    const CLockSite* ptry = FindLockSite(nLineTry);
+    BOOST_REQUIRE(ptry);
+    BOOST_CHECK_EQUAL(ptry->nContentions.load(), 0U);
+    BOOST_CHECK(cs.pProfileHolder.load() == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(lock_profile_recursive)
+{
+    CCriticalSection cs;
+    fLockProfile = true;
+    {
+        const int nLineOuter = __LINE__ + 1;
+        LOCK(cs);
+        {
+            LOCK(cs);
+            BOOST_CHECK(cs.pProfileHolder.load() != FindLockSite(nLineOuter));
+        }
+        // The outer site holds it again when the inner lock is released
+        BOOST_CHECK(cs.pProfileHolder.load() == FindLockSite(nLineOuter));
+    }
+    BOOST_CHECK(cs.pProfileHolder.load() == NULL);
+    fLockProfile = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,9 @@
 #include "chainparams.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/aes.h"
+#include "crypto/scrypt.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -21,6 +24,7 @@
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "script/sigcache.h"
+#include "script/standard.h"
 
 #include "test/testutil.h"
 
@@ -38,6 +42,9 @@ extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
+        SHA256AutoDetect();
+        scrypt_detect();
+        AESAutoDetect();
         ECC_Start();
         SetupEnvironment();
         SetupNetworking();
@@ -168,3 +175,45 @@ bool ShutdownRequested()
 {
   return false;
 }
+
+IndexTestBlock::IndexTestBlock() :
+    keyA(uint160(std::vector<unsigned char>(20, 0xaa))), keyB(uint160(std::vector<unsigned char>(20, 0xbb))),
+    outPrev(6 * COIN, GetScriptForDestination(keyA)), prevout(uint256S("0xabcdef"), 0),
+    hashPrev(uint256S("0x01")), hashBlock(uint256S("0x02"))
+{
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 1 * COIN;
+    coinbase.vout[0].scriptPubKey = GetScriptForDestination(keyB);
+
+    tx1.vin.resize(1);
+    tx1.vin[0].prevout = prevout;
+    tx1.vout.resize(1);
+    tx1.vout[0].nValue = 5 * COIN;
+    tx1.vout[0].scriptPubKey = GetScriptForDestination(keyA);
+
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vout.resize(3);
+    tx2.vout[0].nValue = 3 * COIN;
+    tx2.vout[0].scriptPubKey = GetScriptForDestination(keyB);
+    tx2.vout[1].nValue = 2 * COIN;
+    tx2.vout[1].scriptPubKey = GetScriptForDestination(keyA);
+    tx2.vout[2].nValue = 0;
+    tx2.vout[2].scriptPubKey = CScript() << OP_RETURN;
+
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(tx1));
+    block.vtx.push_back(MakeTransactionRef(tx2));
+
+    blockundo.vtxundo.resize(2);
+    blockundo.vtxundo[0].vprevout.push_back(Coin(outPrev, 7, false, false, 0));
+    blockundo.vtxundo[1].vprevout.push_back(Coin(tx1.vout[0], 10, false, false, 0));
+
+    indexPrev.phashBlock = &hashPrev;
+    indexPrev.nHeight = 9;
+    index.phashBlock = &hashBlock;
+    index.pprev = &indexPrev;
+    index.nHeight = 10;
+}
@@ -5,11 +5,14 @@
 #ifndef BITCOIN_TEST_TEST_BITCOIN_H
 #define BITCOIN_TEST_TEST_BITCOIN_H
 
+#include "chain.h"
 #include "chainparamsbase.h"
 #include "key.h"
+#include "primitives/block.h"
 #include "pubkey.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "undo.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
@@ -29,7 +32,6 @@ struct BasicTestingSetup {
  */
 class CConnman;
 struct TestingSetup: public BasicTestingSetup {
-    CCoinsViewDB *pcoinsdbview;
     boost::filesystem::path pathTemp;
     boost::thread_group threadGroup;
     CConnman* connman;
@@ -89,4 +91,31 @@ struct TestMemPoolEntryHelper
     TestMemPoolEntryHelper &SpendsCoinbase(bool _flag) { spendsCoinbase = _flag; return *this; }
     TestMemPoolEntryHelper &SigOpsCost(unsigned int _sigopsCost) { sigOpCost = _sigopsCost; return *this; }
 };
+
+/**
+ * SolarCoin: A block for the tests of the indexes, with its undo data and a fake index entry at
+ * height 10. The coinbase pays 1 to B; tx1 spends 6 of A, received at height 7, and pays 5 to A;
+ * tx2 spends that in the same block, paying 3 to B, 2 back to A and nothing to an unspendable
+ * output. The index entries point at the hashes, so it is not copied.
+ */
+struct IndexTestBlock
+{
+    CKeyID keyA;
+    CKeyID keyB;
+    CTxOut outPrev;
+    COutPoint prevout;
+    CMutableTransaction coinbase;
+    CMutableTransaction tx1;
+    CMutableTransaction tx2;
+    CBlock block;
+    CBlockUndo blockundo;
+    uint256 hashPrev;
+    uint256 hashBlock;
+    CBlockIndex indexPrev;
+    CBlockIndex index;
+
+    IndexTestBlock();
+    IndexTestBlock(const IndexTestBlock&) = delete;
+    IndexTestBlock& operator=(const IndexTestBlock&) = delete;
+};
 #endif
@@ -12,6 +12,9 @@
 #include "core_io.h"
 #include "key.h"
 #include "keystore.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
 #include "validation.h" // For CheckTransaction
 #include "policy/policy.h"
 #include "script/script.h"
@@ -278,6 +281,75 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(transaction_arena_tests)
+{
+    CBlock block;
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction tx;
+        tx.nTime = 1000 + i;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i) << std::vector<unsigned char>(33, i);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = i * CENT;
+        tx.vout[1].scriptPubKey = CScript() << OP_RETURN;
+        tx.strTxComment = std::string(40, 'a' + i);
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    BOOST_CHECK(!IsArenaTransaction(block.vtx[0]));
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    const std::string strBlock = stream.str();
+    CBlock blockRead;
+    stream >> blockRead;
+    BOOST_CHECK_EQUAL(blockRead.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(IsArenaTransaction(blockRead.vtx[i]));
+        BOOST_CHECK(blockRead.vtx[i]->GetHash() == block.vtx[i]->GetHash());
+        BOOST_CHECK_EQUAL(blockRead.vtx[i]->strTxComment, block.vtx[i]->strTxComment);
+    }
+    // One arena for the block, side by side
+    BOOST_CHECK_EQUAL(blockRead.vtx[1].get() - blockRead.vtx[0].get(), 1);
+    CDataStream streamRead(SER_NETWORK, PROTOCOL_VERSION);
+    streamRead << blockRead;
+    BOOST_CHECK(streamRead.str() == strBlock);
+
+    // A transaction kept past its block is copied out of the arena
+    CTransactionRef tx = DetachTransactionRef(blockRead.vtx[2]);
+    BOOST_CHECK(!IsArenaTransaction(tx));
+    blockRead.SetNull();
+    BOOST_CHECK(tx->GetHash() == block.vtx[2]->GetHash());
+
+    // The transactions of a truncated block are freed with its arena
+    CDataStream streamTruncated(std::vector<char>(strBlock.begin(), strBlock.end() - 20), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_THROW(streamTruncated >> blockRead, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(transaction_size_tests)
+{
+    CMutableTransaction mtx;
+    mtx.nTime = 1000;
+    mtx.vin.resize(2);
+    mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+    mtx.vout.resize(1);
+    mtx.vout[0].scriptPubKey = CScript() << OP_RETURN;
+    mtx.strTxComment = "comment";
+    const int vTypes[] = {SER_NETWORK, SER_DISK, SER_GETHASH, SER_NETWORK | SER_LEGACYPROTOCOL};
+    for (int nVersion = CTransaction::LEGACY_VERSION_1; nVersion <= CTransaction::CURRENT_VERSION; nVersion++) {
+        mtx.nVersion = nVersion;
+        const CTransaction tx(mtx);
+        // The cached size against the size of the serialization
+        for (int nType : vTypes) {
+            CDataStream stream(nType, PROTOCOL_VERSION);
+            stream << mtx;
+            BOOST_CHECK_EQUAL(::GetSerializeSize(tx, nType, PROTOCOL_VERSION), stream.size());
+            BOOST_CHECK_EQUAL(::GetSerializeSize(tx, nType, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS), stream.size());
+        }
+        BOOST_CHECK_EQUAL(tx.GetTotalSize(), ::GetSerializeSize(mtx, SER_NETWORK, PROTOCOL_VERSION));
+    }
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
@@ -304,14 +376,14 @@ SetupDummyInputs(CBasicKeyStore& keystoreRet, CCoinsViewCache& coinsRet)
     dummyTransactions[0].vout[0].scriptPubKey << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
     dummyTransactions[0].vout[1].nValue = 50*CENT;
     dummyTransactions[0].vout[1].scriptPubKey << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG;
-    coinsRet.ModifyCoins(dummyTransactions[0].GetHash())->FromTx(dummyTransactions[0], 0);
+    AddCoins(coinsRet, dummyTransactions[0], 0);
 
     dummyTransactions[1].vout.resize(2);
     dummyTransactions[1].vout[0].nValue = 21*CENT;
     dummyTransactions[1].vout[0].scriptPubKey = GetScriptForDestination(key[2].GetPubKey().GetID());
     dummyTransactions[1].vout[1].nValue = 22*CENT;
     dummyTransactions[1].vout[1].scriptPubKey = GetScriptForDestination(key[3].GetPubKey().GetID());
-    coinsRet.ModifyCoins(dummyTransactions[1].GetHash())->FromTx(dummyTransactions[1], 0);
+    AddCoins(coinsRet, dummyTransactions[1], 0);
 
     return dummyTransactions;
 }
@@ -467,19 +539,20 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     for (int i=0; i<20; i++)
         threadGroup.create_thread(boost::bind(&CCheckQueue<CScriptCheck>::Thread, boost::ref(scriptcheckqueue)));
 
-    CCoins coins;
-    coins.nVersion = 1;
-    coins.fCoinBase = false;
+    std::vector<Coin> coins;
     for(uint32_t i = 0; i < mtx.vin.size(); i++) {
-        CTxOut txout;
-        txout.nValue = 1000;
-        txout.scriptPubKey = scriptPubKey;
-        coins.vout.push_back(txout);
+        Coin coin;
+        coin.nHeight = 1;
+        coin.fCoinBase = false;
+        coin.out.nValue = 1000;
+        coin.out.scriptPubKey = scriptPubKey;
+        coins.emplace_back(std::move(coin));
     }
 
     for(uint32_t i = 0; i < mtx.vin.size(); i++) {
         std::vector<CScriptCheck> vChecks;
-        CScriptCheck check(coins, tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, &txdata);
+        const CTxOut& out = coins[i].out;
+        CScriptCheck check(out.scriptPubKey, out.nValue, tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, &txdata);
         vChecks.push_back(CScriptCheck());
         check.swap(vChecks.back());
         control.Add(vChecks);
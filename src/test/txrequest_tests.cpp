@@ -0,0 +1,130 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrequest.h"
+#include "uint256.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txrequest_tests, BasicTestingSetup)
+
+static uint256 TxHash(unsigned int n)
+{
+    uint256 hash;
+    *hash.begin() = n & 0xff;
+    *(hash.begin() + 1) = (n >> 8) & 0xff;
+    *(hash.begin() + 2) = n >> 16;
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_preferred)
+{
+    CTxRequestTracker tracker;
+    const int64_t nNow = 1000000000;
+    const uint256 txid = TxHash(1);
+
+    // The inbound peer announced first, but the outbound one is asked
+    tracker.ReceivedInv(1, txid, false, nNow);
+    tracker.ReceivedInv(2, txid, true, nNow + 1);
+    BOOST_CHECK(tracker.GetRequestable(1, nNow + 1).empty());
+    std::vector<uint256> vRequest = tracker.GetRequestable(2, nNow + 1);
+    BOOST_CHECK(vRequest.size() == 1 && vRequest[0] == txid);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(2), 1U);
+
+    // Nor is the inbound peer asked once its delay passed, while the request is in flight
+    BOOST_CHECK(tracker.GetRequestable(1, nNow + NONPREF_PEER_TX_DELAY).empty());
+    BOOST_CHECK(tracker.GetRequestable(2, nNow + NONPREF_PEER_TX_DELAY).empty());
+
+    // Announcing it again does not make it requestable twice
+    tracker.ReceivedInv(2, txid, true, nNow + 2);
+    BOOST_CHECK_EQUAL(tracker.CountTracked(2), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_nonpreferred_delay)
+{
+    CTxRequestTracker tracker;
+    const int64_t nNow = 1000000000;
+    const uint256 txid = TxHash(1);
+
+    tracker.ReceivedInv(1, txid, false, nNow);
+    BOOST_CHECK(tracker.GetRequestable(1, nNow).empty());
+    BOOST_CHECK(tracker.GetRequestable(1, nNow + NONPREF_PEER_TX_DELAY - 1).empty());
+    std::vector<uint256> vRequest = tracker.GetRequestable(1, nNow + NONPREF_PEER_TX_DELAY);
+    BOOST_CHECK(vRequest.size() == 1 && vRequest[0] == txid);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_timeout_and_response)
+{
+    CTxRequestTracker tracker;
+    int64_t nNow = 1000000000;
+    const uint256 txid = TxHash(1);
+
+    tracker.ReceivedInv(1, txid, true, nNow);
+    tracker.ReceivedInv(2, txid, true, nNow);
+    tracker.ReceivedInv(3, txid, true, nNow);
+    BOOST_CHECK_EQUAL(tracker.GetRequestable(1, nNow).size(), 1U);
+
+    // The first peer does not answer in time, so the next one is asked
+    nNow += TX_REQUEST_TIMEOUT;
+    BOOST_CHECK(tracker.GetRequestable(2, nNow - 1).empty());
+    BOOST_CHECK_EQUAL(tracker.GetRequestable(2, nNow).size(), 1U);
+    BOOST_CHECK_EQUAL(tracker.CountTracked(1), 0U);
+    BOOST_CHECK(tracker.GetRequestable(1, nNow).empty());
+
+    // The second answers notfound, so the third is asked
+    tracker.ReceivedResponse(2, txid);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(2), 0U);
+    BOOST_CHECK_EQUAL(tracker.GetRequestable(3, nNow).size(), 1U);
+
+    // The transaction arrived: nothing of it is left
+    tracker.ForgetTxHash(txid);
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK_EQUAL(tracker.CountTracked(3), 0U);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(3), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_disconnect)
+{
+    CTxRequestTracker tracker;
+    const int64_t nNow = 1000000000;
+    const uint256 txid = TxHash(1);
+
+    tracker.ReceivedInv(1, txid, true, nNow);
+    tracker.ReceivedInv(2, txid, true, nNow);
+    tracker.ReceivedInv(1, TxHash(2), true, nNow);
+    BOOST_CHECK_EQUAL(tracker.GetRequestable(1, nNow).size(), 2U);
+
+    // The peer that was asked goes away, so the other one is asked right away
+    tracker.DisconnectedPeer(1);
+    BOOST_CHECK_EQUAL(tracker.CountTracked(1), 0U);
+    std::vector<uint256> vRequest = tracker.GetRequestable(2, nNow);
+    BOOST_CHECK(vRequest.size() == 1 && vRequest[0] == txid);
+
+    tracker.DisconnectedPeer(2);
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_limits)
+{
+    CTxRequestTracker tracker;
+    const int64_t nNow = 1000000000;
+
+    for (unsigned int n = 0; n < MAX_PEER_TX_IN_FLIGHT + 10; n++)
+        tracker.ReceivedInv(1, TxHash(n), true, nNow);
+    BOOST_CHECK_EQUAL(tracker.GetRequestable(1, nNow).size(), MAX_PEER_TX_IN_FLIGHT);
+    BOOST_CHECK(tracker.GetRequestable(1, nNow).empty());
+    tracker.ReceivedResponse(1, TxHash(0));
+    std::vector<uint256> vRequest = tracker.GetRequestable(1, nNow);
+    BOOST_CHECK(vRequest.size() == 1 && vRequest[0] == TxHash(MAX_PEER_TX_IN_FLIGHT));
+
+    for (unsigned int n = 0; n < MAX_PEER_TX_ANNOUNCEMENTS + 10; n++)
+        tracker.ReceivedInv(2, TxHash(n), false, nNow);
+    BOOST_CHECK_EQUAL(tracker.CountTracked(2), MAX_PEER_TX_ANNOUNCEMENTS);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
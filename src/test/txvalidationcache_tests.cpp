@@ -6,9 +6,12 @@
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
+#include "policy/policy.h"
 #include "pubkey.h"
 #include "txmempool.h"
 #include "random.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "test/test_bitcoin.h"
 #include "utiltime.h"
@@ -84,4 +87,102 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(script_execution_cache, BasicTestingSetup)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.hash = GetRandHash();
+    mtx.vout.resize(1);
+    CTransaction tx(mtx);
+
+    uint256 entry, entryOtherFlags;
+    ComputeScriptExecutionCacheEntry(entry, tx, SCRIPT_VERIFY_NONE);
+    ComputeScriptExecutionCacheEntry(entryOtherFlags, tx, SCRIPT_VERIFY_P2SH);
+    BOOST_CHECK(entry != entryOtherFlags);
+
+    CacheStats before = GetScriptExecutionCacheStats();
+    BOOST_CHECK(!ScriptExecutionCacheGet(entry, false));
+    ScriptExecutionCacheSet(entry);
+    BOOST_CHECK(!ScriptExecutionCacheGet(entryOtherFlags, false));
+    BOOST_CHECK(ScriptExecutionCacheGet(entry, true));
+
+    CacheStats after = GetScriptExecutionCacheStats();
+    BOOST_CHECK_EQUAL(after.nHits - before.nHits, 1U);
+    BOOST_CHECK_EQUAL(after.nMisses - before.nMisses, 2U);
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_preverify_scripts, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A valid spend of a mature coinbase, and one with a signature for other data
+    std::vector<CMutableTransaction> spends(2);
+    for (int i = 0; i < 2; i++)
+    {
+        spends[i].nVersion = 1;
+        spends[i].vin.resize(1);
+        spends[i].vin[0].prevout.hash = coinbaseTxns[i].GetHash();
+        spends[i].vin[0].prevout.n = 0;
+        spends[i].vout.resize(1);
+        spends[i].vout[0].nValue = 11*CENT;
+        spends[i].vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = i == 0 ? SignatureHash(scriptPubKey, spends[i], 0, SIGHASH_ALL, 0, SIGVERSION_BASE) : GetRandHash();
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spends[i].vin[0].scriptSig << vchSig;
+    }
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(spends[0]));
+    vtx.push_back(MakeTransactionRef(spends[1]));
+
+    // A valid spend the acceptance turns down before running any script, for not being final
+    CMutableTransaction nonFinal = spends[0];
+    nonFinal.nLockTime = chainActive.Height() + 10;
+    nonFinal.vin[0].nSequence = 0;
+    vtx.push_back(MakeTransactionRef(nonFinal));
+
+    std::vector<CValidationState> vState;
+    PreVerifyTransactionScripts(vtx, &vState);
+
+    uint256 entryValid, entryInvalid, entryNonFinal;
+    ComputeScriptExecutionCacheEntry(entryValid, *vtx[0], STANDARD_SCRIPT_VERIFY_FLAGS);
+    ComputeScriptExecutionCacheEntry(entryInvalid, *vtx[1], STANDARD_SCRIPT_VERIFY_FLAGS);
+    ComputeScriptExecutionCacheEntry(entryNonFinal, *vtx[2], STANDARD_SCRIPT_VERIFY_FLAGS);
+    BOOST_CHECK(ScriptExecutionCacheGet(entryValid, false));
+    BOOST_CHECK(!ScriptExecutionCacheGet(entryInvalid, false));
+    BOOST_CHECK(!ScriptExecutionCacheGet(entryNonFinal, false));
+
+    // The invalid signature is scored as the acceptance would; the others are left to it
+    BOOST_CHECK_EQUAL(vState.size(), 3U);
+    int nDoS = 0;
+    BOOST_CHECK(vState[0].IsValid());
+    BOOST_CHECK(vState[1].IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK(vState[2].IsValid());
+
+    // The acceptance still rejects the invalid one, and consumes the entry of the valid one
+    BOOST_CHECK(ToMemPool(spends[0]));
+    BOOST_CHECK(!ToMemPool(spends[1]));
+    BOOST_CHECK(!ScriptExecutionCacheGet(entryValid, false));
+    mempool.clear();
+
+    // SolarCoin: a cache hit skips the scripts without building the precomputed signature hash
+    // data, as block connection does for the transactions the mempool accepted
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        const CTransaction tx(spends[0]);
+        uint256 entry;
+        ComputeScriptExecutionCacheEntry(entry, tx, STANDARD_SCRIPT_VERIFY_FLAGS);
+        ScriptExecutionCacheSet(entry);
+        CValidationState state;
+        PrecomputedTransactionData txdata;
+        BOOST_CHECK(CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata));
+        BOOST_CHECK(!txdata.fReady);
+        BOOST_CHECK(CheckInputs(tx, state, view, true, SCRIPT_VERIFY_P2SH, true, false, txdata));
+        BOOST_CHECK(txdata.fReady);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
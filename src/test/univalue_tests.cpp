@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <limits>
 #include <stdint.h>
 #include <vector>
 #include <string>
@@ -141,6 +142,15 @@ BOOST_AUTO_TEST_CASE(univalue_set)
     BOOST_CHECK(v.isNum());
     BOOST_CHECK_EQUAL(v.getValStr(), "1023");
 
+    BOOST_CHECK(v.setInt(std::numeric_limits<int64_t>::min()));
+    BOOST_CHECK_EQUAL(v.getValStr(), "-9223372036854775808");
+
+    BOOST_CHECK(v.setInt(std::numeric_limits<uint64_t>::max()));
+    BOOST_CHECK_EQUAL(v.getValStr(), "18446744073709551615");
+
+    BOOST_CHECK(v.setInt((int64_t)0));
+    BOOST_CHECK_EQUAL(v.getValStr(), "0");
+
     BOOST_CHECK(v.setNumStr("-688"));
     BOOST_CHECK(v.isNum());
     BOOST_CHECK_EQUAL(v.getValStr(), "-688");
@@ -284,6 +294,25 @@ BOOST_AUTO_TEST_CASE(univalue_object)
     BOOST_CHECK_EQUAL(obj.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(univalue_pushkvend)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.reserve(3);
+    BOOST_CHECK(obj.pushKVEnd("a", UniValue(1)));
+    UniValue arr(UniValue::VARR);
+    arr.reserve(2);
+    BOOST_CHECK(arr.push_back(UniValue("x")));
+    BOOST_CHECK(arr.push_back(UniValue(2)));
+    BOOST_CHECK(obj.pushKVEnd("b", std::move(arr)));
+    BOOST_CHECK(obj.push_back(Pair("c", "y")));
+    BOOST_CHECK_EQUAL(obj.write(), "{\"a\":1,\"b\":[\"x\",2],\"c\":\"y\"}");
+
+    // Neither adds to a value of the wrong type
+    UniValue arr2(UniValue::VARR);
+    BOOST_CHECK(!arr2.pushKVEnd("d", UniValue(3)));
+    BOOST_CHECK(!obj.push_back(UniValue(3)));
+}
+
 static const char *json1 =
 "[1.10000000,{\"key1\":\"str\\u0000\",\"key2\":800,\"key3\":{\"name\":\"martian http://test.com\"}}]";
 
@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "primitives/transaction.h"
+#include "validationinterface.h"
+
+#include "test/test_bitcoin.h"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+class CRecordingInterface : public CValidationInterface
+{
+public:
+    std::vector<int> vHeights;
+    std::vector<int> vPositions;
+    std::vector<std::thread::id> vThreads;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+    {
+        vHeights.push_back(pindexNew->nHeight);
+        vThreads.push_back(std::this_thread::get_id());
+    }
+
+    void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, int posInBlock)
+    {
+        vPositions.push_back(posInBlock);
+        vThreads.push_back(std::this_thread::get_id());
+    }
+};
+
+BOOST_AUTO_TEST_CASE(validationinterface_queued)
+{
+    CRecordingInterface listener;
+    RegisterValidationInterfaceQueued(&listener);
+
+    // More callbacks than the queue holds, so signalling waits for room
+    std::vector<CBlockIndex> vIndex(MAX_VALIDATION_QUEUE_CALLBACKS + 10);
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        vIndex[i].nHeight = i;
+        CMutableTransaction tx;
+        tx.nLockTime = i;
+        GetMainSignals().SyncTransaction(tx, &vIndex[i], i);
+        GetMainSignals().UpdatedBlockTip(&vIndex[i], NULL, false);
+    }
+    SyncWithValidationInterfaceQueue();
+
+    // Run in order, on the queue thread
+    BOOST_REQUIRE_EQUAL(listener.vHeights.size(), vIndex.size());
+    BOOST_REQUIRE_EQUAL(listener.vPositions.size(), vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        BOOST_CHECK_EQUAL(listener.vHeights[i], (int)i);
+        BOOST_CHECK_EQUAL(listener.vPositions[i], (int)i);
+    }
+    for (const std::thread::id& id : listener.vThreads)
+        BOOST_CHECK(id != std::this_thread::get_id());
+
+    // Not called once unregistered
+    UnregisterValidationInterface(&listener);
+    GetMainSignals().UpdatedBlockTip(&vIndex[0], NULL, false);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(listener.vHeights.size(), vIndex.size());
+
+    StopValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_CASE(validationinterface_queue_stopped)
+{
+    // Without the queue thread, the callbacks run when signalled
+    StopValidationInterfaceQueue();
+    CRecordingInterface listener;
+    RegisterValidationInterfaceQueued(&listener);
+    StopValidationInterfaceQueue();
+    CBlockIndex index;
+    index.nHeight = 7;
+    GetMainSignals().UpdatedBlockTip(&index, NULL, false);
+    BOOST_REQUIRE_EQUAL(listener.vHeights.size(), 1U);
+    BOOST_CHECK_EQUAL(listener.vHeights[0], 7);
+    BOOST_CHECK(listener.vThreads[0] == std::this_thread::get_id());
+    UnregisterValidationInterface(&listener);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validationstats.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(latency_histogram_percentiles)
+{
+    CLatencyHistogram hist;
+    BOOST_CHECK_EQUAL(hist.GetCount(), 0U);
+    BOOST_CHECK_EQUAL(hist.GetPercentile(0.5), 0);
+
+    // 90 fast samples of 100us, 9 of 5ms and one of 1s
+    for (int i = 0; i < 90; i++)
+        hist.Add(100);
+    for (int i = 0; i < 9; i++)
+        hist.Add(5000);
+    hist.Add(1000000);
+
+    BOOST_CHECK_EQUAL(hist.GetCount(), 100U);
+    BOOST_CHECK_EQUAL(hist.GetTotal(), 90 * 100 + 9 * 5000 + 1000000);
+    BOOST_CHECK_EQUAL(hist.GetMax(), 1000000);
+    // Percentiles are the upper bounds of their power-of-two buckets
+    BOOST_CHECK_EQUAL(hist.GetPercentile(0.5), 127);
+    BOOST_CHECK_EQUAL(hist.GetPercentile(0.9), 8191);
+    BOOST_CHECK_EQUAL(hist.GetPercentile(0.99), 1000000);
+    BOOST_CHECK_EQUAL(hist.GetPercentile(1.0), 1000000);
+
+    // Negative durations (clock adjustments) count as zero
+    CLatencyHistogram histZero;
+    histZero.Add(-5);
+    BOOST_CHECK_EQUAL(histZero.GetMax(), 0);
+    BOOST_CHECK_EQUAL(histZero.GetPercentile(0.5), 0);
+}
+
+BOOST_AUTO_TEST_CASE(block_phase_names)
+{
+    for (int i = 0; i < BLOCK_PHASE_COUNT; i++)
+        BOOST_CHECK(!std::string(GetBlockPhaseName((BlockProcessingPhase)i)).empty());
+    for (int i = 0; i < BLOCK_COUNTER_COUNT; i++)
+        BOOST_CHECK(!std::string(GetBlockCounterName((BlockProcessingCounter)i)).empty());
+
+    uint64_t nCount = GetBlockPhaseHistogram(BLOCK_PHASE_STAKE_TIME).GetCount();
+    RecordBlockPhase(BLOCK_PHASE_STAKE_TIME, 10);
+    BOOST_CHECK_EQUAL(GetBlockPhaseHistogram(BLOCK_PHASE_STAKE_TIME).GetCount(), nCount + 1);
+
+    uint64_t nHits = GetBlockCounter(BLOCK_COUNTER_STAKE_PREVOUT_HIT);
+    IncrementBlockCounter(BLOCK_COUNTER_STAKE_PREVOUT_HIT);
+    BOOST_CHECK_EQUAL(GetBlockCounter(BLOCK_COUNTER_STAKE_PREVOUT_HIT), nHits + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,8 @@
 #include "netbase.h"
 #include "net.h"
 #include "util.h"
+#include "utiltime.h"
+#include "sync.h"
 #include "crypto/hmac_sha256.h"
 
 #include <vector>
@@ -43,6 +45,11 @@ static const std::string TOR_SAFE_CLIENTKEY = "Tor safe cookie authentication co
 static const float RECONNECT_TIMEOUT_START = 1.0;
 /** Exponential backoff configuration - growth factor */
 static const float RECONNECT_TIMEOUT_EXP = 1.5;
+/**
+ * SolarCoin: Exponential backoff configuration - longest timeout in seconds, so the service is
+ * set up again within seconds of the Tor daemon coming back after a restart
+ */
+static const float RECONNECT_TIMEOUT_MAX = 5.0;
 /** Maximum length for lines received on TorControlConnection.
  * tor-control-spec.txt mentions that there is explicitly no limit defined to line length,
  * this is belt-and-suspenders sanity limit to prevent memory exhaustion.
@@ -348,6 +355,11 @@ static bool WriteBinaryFile(const std::string &filename, const std::string &data
 
 /****** Bitcoin specific TorController implementation ********/
 
+/** SolarCoin: The stats of the running TorController */
+static CCriticalSection cs_torStats;
+static bool fTorControlRunning = false; // protected by cs_torStats
+static TorControlStats torStats; // protected by cs_torStats
+
 /** Controller that connects to Tor control socket, authenticate, then create
  * and maintain a ephemeral hidden service.
  */
@@ -362,6 +374,8 @@ public:
 
     /** Reconnect, after getting disconnected */
     void Reconnect();
+    /** SolarCoin: Start the reconnect timer, backing off after every failure */
+    void ScheduleReconnect();
 private:
     struct event_base* base;
     std::string target;
@@ -372,6 +386,9 @@ private:
     struct event *reconnect_ev;
     float reconnect_timeout;
     CService service;
+    /** SolarCoin: when the control connection was opened, and when the service was lost, in milliseconds */
+    int64_t nConnectStart;
+    int64_t nOutageStart;
     /** Cookie for SAFECOOKIE auth */
     std::vector<uint8_t> cookie;
     /** ClientNonce for SAFECOOKIE auth */
@@ -397,22 +414,24 @@ private:
 TorController::TorController(struct event_base* _base, const std::string& _target):
     base(_base),
     target(_target), conn(base), reconnect(true), reconnect_ev(0),
-    reconnect_timeout(RECONNECT_TIMEOUT_START)
+    reconnect_timeout(RECONNECT_TIMEOUT_START), nConnectStart(0), nOutageStart(0)
 {
     reconnect_ev = event_new(base, -1, 0, reconnect_cb, this);
     if (!reconnect_ev)
         LogPrintf("tor: Failed to create event for reconnection: out of memory?\n");
-    // Start connection attempts immediately
-    if (!conn.Connect(_target, boost::bind(&TorController::connected_cb, this, _1),
-         boost::bind(&TorController::disconnected_cb, this, _1) )) {
-        LogPrintf("tor: Initiating connection to Tor control port %s failed\n", _target);
-    }
-    // Read service private key if cached
+    // Read service private key if cached. SolarCoin: it is only read here and kept in memory,
+    // so a reconnect after a Tor restart asks for the same service without touching the disk
     std::pair<bool,std::string> pkf = ReadBinaryFile(GetPrivateKeyFile());
     if (pkf.first) {
         LogPrint("tor", "tor: Reading cached private key from %s\n", GetPrivateKeyFile());
         private_key = pkf.second;
     }
+    // Start connection attempts immediately
+    nConnectStart = GetTimeMillis();
+    if (!conn.Connect(_target, boost::bind(&TorController::connected_cb, this, _1),
+         boost::bind(&TorController::disconnected_cb, this, _1) )) {
+        LogPrintf("tor: Initiating connection to Tor control port %s failed\n", _target);
+    }
 }
 
 TorController::~TorController()
@@ -430,27 +449,47 @@ void TorController::add_onion_cb(TorControlConnection& _conn, const TorControlRe
 {
     if (reply.code == 250) {
         LogPrint("tor", "tor: ADD_ONION successful\n");
+        bool fNewKey = false;
         BOOST_FOREACH(const std::string &s, reply.lines) {
             std::map<std::string,std::string> m = ParseTorReplyMapping(s);
             std::map<std::string,std::string>::iterator i;
             if ((i = m.find("ServiceID")) != m.end())
                 service_id = i->second;
-            if ((i = m.find("PrivateKey")) != m.end())
+            if ((i = m.find("PrivateKey")) != m.end()) {
                 private_key = i->second;
+                fNewKey = true;
+            }
         }
         service = LookupNumeric(std::string(service_id+".onion").c_str(), GetListenPort());
-        LogPrintf("tor: Got service ID %s, advertising service %s\n", service_id, service.ToString());
-        if (WriteBinaryFile(GetPrivateKeyFile(), private_key)) {
-            LogPrint("tor", "tor: Cached service private key to %s\n", GetPrivateKeyFile());
-        } else {
-            LogPrintf("tor: Error writing service private key to %s\n", GetPrivateKeyFile());
-        }
         AddLocal(service, LOCAL_MANUAL);
+        // SolarCoin: the backoff restarts once the service is up, not merely the connection
+        reconnect_timeout = RECONNECT_TIMEOUT_START;
+        const int64_t nNow = GetTimeMillis();
+        LogPrintf("tor: Got service ID %s, advertising service %s (%dms after connecting)\n", service_id, service.ToString(), nNow - nConnectStart);
+        {
+            LOCK(cs_torStats);
+            torStats.strService = service.ToString();
+            torStats.nLastSetupMillis = nNow - nConnectStart;
+            if (nOutageStart != 0)
+                torStats.nLastOutageMillis = nNow - nOutageStart;
+        }
+        nOutageStart = 0;
+        // SolarCoin: Tor only returns the key of a new service; a reused one is on disk already
+        if (fNewKey) {
+            if (WriteBinaryFile(GetPrivateKeyFile(), private_key)) {
+                LogPrint("tor", "tor: Cached service private key to %s\n", GetPrivateKeyFile());
+            } else {
+                LogPrintf("tor: Error writing service private key to %s\n", GetPrivateKeyFile());
+            }
+        }
         // ... onion requested - keep connection open
     } else if (reply.code == 510) { // 510 Unrecognized command
         LogPrintf("tor: Add onion failed with unrecognized command (You probably need to upgrade Tor)\n");
     } else {
+        // SolarCoin: Tor may not be ready for it yet after a restart, so try again over a new connection
         LogPrintf("tor: Add onion failed; error code %d\n", reply.code);
+        _conn.Disconnect();
+        ScheduleReconnect();
     }
 }
 
@@ -458,6 +497,10 @@ void TorController::auth_cb(TorControlConnection& _conn, const TorControlReply&
 {
     if (reply.code == 250) {
         LogPrint("tor", "tor: Authentication successful\n");
+        {
+            LOCK(cs_torStats);
+            torStats.fAuthenticated = true;
+        }
 
         // Now that we know Tor is running setup the proxy for onion addresses
         // if -onion isn't set to something else.
@@ -615,7 +658,6 @@ void TorController::protocolinfo_cb(TorControlConnection& _conn, const TorContro
 
 void TorController::connected_cb(TorControlConnection& _conn)
 {
-    reconnect_timeout = RECONNECT_TIMEOUT_START;
     // First send a PROTOCOLINFO command to figure out what authentication is expected
     if (!_conn.Command("PROTOCOLINFO 1", boost::bind(&TorController::protocolinfo_cb, this, _1, _2)))
         LogPrintf("tor: Error sending initial protocolinfo command\n");
@@ -624,19 +666,30 @@ void TorController::connected_cb(TorControlConnection& _conn)
 void TorController::disconnected_cb(TorControlConnection& _conn)
 {
     // Stop advertising service when disconnected
-    if (service.IsValid())
+    if (service.IsValid()) {
         RemoveLocal(service);
+        nOutageStart = GetTimeMillis();
+    }
     service = CService();
+    {
+        LOCK(cs_torStats);
+        torStats.fAuthenticated = false;
+        torStats.strService.clear();
+    }
     if (!reconnect)
         return;
 
     LogPrint("tor", "tor: Not connected to Tor control port %s, trying to reconnect\n", target);
+    ScheduleReconnect();
+}
 
+void TorController::ScheduleReconnect()
+{
     // Single-shot timer for reconnect. Use exponential backoff.
     struct timeval time = MillisToTimeval(int64_t(reconnect_timeout * 1000.0));
     if (reconnect_ev)
         event_add(reconnect_ev, &time);
-    reconnect_timeout *= RECONNECT_TIMEOUT_EXP;
+    reconnect_timeout = std::min(reconnect_timeout * RECONNECT_TIMEOUT_EXP, RECONNECT_TIMEOUT_MAX);
 }
 
 void TorController::Reconnect()
@@ -644,6 +697,11 @@ void TorController::Reconnect()
     /* Try to reconnect and reestablish if we get booted - for example, Tor
      * may be restarting.
      */
+    nConnectStart = GetTimeMillis();
+    {
+        LOCK(cs_torStats);
+        torStats.nReconnects++;
+    }
     if (!conn.Connect(target, boost::bind(&TorController::connected_cb, this, _1),
          boost::bind(&TorController::disconnected_cb, this, _1) )) {
         LogPrintf("tor: Re-initiating connection to Tor control port %s failed\n", target);
@@ -685,6 +743,11 @@ void StartTorControl(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf("tor: Unable to create event_base\n");
         return;
     }
+    {
+        LOCK(cs_torStats);
+        fTorControlRunning = true;
+        torStats = TorControlStats();
+    }
 
     torControlThread = boost::thread(boost::bind(&TraceThread<void (*)()>, "torcontrol", &TorControlThread));
 }
@@ -704,5 +767,14 @@ void StopTorControl()
         event_base_free(base);
         base = 0;
     }
+    LOCK(cs_torStats);
+    fTorControlRunning = false;
+}
+
+bool GetTorControlStats(TorControlStats& stats)
+{
+    LOCK(cs_torStats);
+    stats = torStats;
+    return fTorControlRunning;
 }
 
@@ -10,11 +10,26 @@
 
 #include "scheduler.h"
 
+#include <stdint.h>
+#include <string>
+
 extern const std::string DEFAULT_TOR_CONTROL;
 static const bool DEFAULT_LISTEN_ONION = true;
 
+/** SolarCoin: How the onion service setup went, for getnetworkinfo */
+struct TorControlStats
+{
+    bool fAuthenticated = false;     //!< connected and authenticated to the Tor control port
+    std::string strService;          //!< the onion service advertised, empty if none
+    int64_t nLastSetupMillis = -1;   //!< from opening the control connection to advertising the service, the last time
+    int64_t nLastOutageMillis = -1;  //!< from losing the service to advertising it again, the last time
+    int nReconnects = 0;             //!< control connections opened after the first
+};
+
 void StartTorControl(boost::thread_group& threadGroup, CScheduler& scheduler);
 void InterruptTorControl();
 void StopTorControl();
+/** SolarCoin: Whether the Tor controller is running, and if so its stats */
+bool GetTorControlStats(TorControlStats& stats);
 
 #endif /* BITCOIN_TORCONTROL_H */
@@ -8,7 +8,10 @@
 #include "chainparams.h"
 #include "validation.h"
 #include "hash.h"
+#include "init.h"
 #include "pow.h"
+#include "random.h"
+#include "ui_interface.h"
 #include "uint256.h"
 
 #include <stdint.h>
@@ -17,27 +20,179 @@
 
 using namespace std;
 
+static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_TXINDEX_COMPACT = 'T';
+static const char DB_TXINDEX_COMPACT_SALT = 'S';
+static const char DB_TXINDEX_LOCATOR = 'x';
+static const char DB_TXINDEX_COMPACT_LOCATOR = 'X';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'I';
+static const char DB_SNAPSHOT_VALIDATION = 'V';
+
+
+namespace {
+
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << outpoint->hash;
+        s << VARINT(outpoint->n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> outpoint->hash;
+        s >> VARINT(outpoint->n);
+    }
+};
+
+/**
+ * Key of a compact transaction index entry: the truncated salted txid, then the height, so
+ * all entries sharing a truncated txid are next to each other. The value is VARINT(nTxOffset).
+ */
+struct CompactTxIndexEntry {
+    char key;
+    uint64_t nKey;
+    int nHeight;
+    CompactTxIndexEntry(uint64_t nKeyIn = 0, int nHeightIn = 0) : key(DB_TXINDEX_COMPACT), nKey(nKeyIn), nHeight(nHeightIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        ser_writedata64(s, nKey);
+        ser_writedata32(s, nHeight);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        nKey = ser_readdata64(s);
+        nHeight = ser_readdata32(s);
+    }
+};
+
+/**
+ * A per-txid record of the pre-upgrade chainstate format, only read by CCoinsViewDB::Upgrade().
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nCode), bit 0: coinbase, bits 1 and 2: vout[0] and vout[1] are unspent,
+ *   higher bits: the number of non-zero bytes in the following bitvector
+ * - unspentness bitvector, for vout[2] and further; least significant byte first
+ * - the non-spent CTxOuts (via CTxOutCompressor)
+ * - VARINT(nHeight)
+ */
+class CLegacyCoins
+{
+public:
+    bool fCoinBase;
+    std::vector<CTxOut> vout;
+    int nHeight;
+
+    CLegacyCoins() : fCoinBase(false), nHeight(0) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        // version
+        int nVersionDummy;
+        ::Unserialize(s, VARINT(nVersionDummy));
+        // header code
+        ::Unserialize(s, VARINT(nCode));
+        fCoinBase = nCode & 1;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 2) != 0;
+        vAvail[1] = (nCode & 4) != 0;
+        unsigned int nMaskCode = (nCode / 8) + ((nCode & 6) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])));
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight));
+    }
+
+    // SolarCoin: the old format did not store the coinstake flag. A coinstake is the only
+    // kind of non-coinbase transaction whose first output is empty (see CTransaction::IsCoinStake()).
+    bool IsCoinStake() const {
+        return !fCoinBase && vout.size() >= 2 && vout[0].IsEmpty();
+    }
+};
+
+}
 
+CDBOptions GetDBOptionsFromArgs(const std::string& strName)
+{
+    CDBOptions dboptions;
+    dboptions.nMaxOpenFiles = std::max(10, (int)GetArg("-" + strName + "maxopenfiles", DEFAULT_DB_MAX_OPEN_FILES));
+    dboptions.nBlockSize = std::max<int64_t>(1 << 10, GetArg("-" + strName + "blocksize", DEFAULT_DB_BLOCK_SIZE));
+    dboptions.nBloomBits = std::max(0, (int)GetArg("-" + strName + "bloombits", DEFAULT_DB_BLOOM_BITS));
+    dboptions.nWriteBufferSize = std::max<int64_t>(0, GetArg("-" + strName + "writebuffer", 0)) << 20;
+    dboptions.fCompression = GetBoolArg("-" + strName + "compression", DEFAULT_DB_COMPRESSION);
+    return dboptions;
+}
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const std::string& strName) : db(GetDataDir() / strName, nCacheSize, fMemory, fWipe, true, GetDBOptionsFromArgs("chainstate")), fWriting(false), fWriteFailed(false), nWriteSequence(0)
 {
 }
 
-bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(std::make_pair(DB_COINS, txid), coins);
+CCoinsViewDB::~CCoinsViewDB()
+{
+    WaitForWrite();
+    if (threadWrite.joinable())
+        threadWrite.join();
+}
+
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        WAIT_LOCK(cs_writing, lock);
+        CCoinsMap::const_iterator it = mapWriting.find(outpoint);
+        if (it != mapWriting.end()) {
+            if (it->second.coin.IsSpent())
+                return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    return db.Read(CoinEntry(&outpoint), coin);
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(std::make_pair(DB_COINS, txid));
+bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        WAIT_LOCK(cs_writing, lock);
+        CCoinsMap::const_iterator it = mapWriting.find(outpoint);
+        if (it != mapWriting.end())
+            return !it->second.coin.IsSpent();
+    }
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -47,30 +202,198 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    std::vector<uint256> vhashHeadBlocks;
+    if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks))
+        return std::vector<uint256>();
+    return vhashHeadBlocks;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    // Entries still being written in the background are older than these
+    if (!WaitForWrite())
+        return false;
+    nWriteSequence++;
+
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(std::make_pair(DB_COINS, it->first));
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
             else
-                batch.Write(std::make_pair(DB_COINS, it->first), it->second.coins);
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
-    if (!hashBlock.IsNull())
+    if (!hashBlock.IsNull()) {
+        // The database is consistent at hashBlock again, nothing left to replay
         batch.Write(DB_BEST_BLOCK, hashBlock);
+        batch.Erase(DB_HEAD_BLOCKS);
+    }
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+void CCoinsViewDB::WriteEntries(const uint256 &hashHead, const boost::function<bool()> &fnBeforeWrite) {
+    RenameThread("solarcoin-coinsdb");
+
+    // mapWriting is only modified while fWriting is false, so it can be read here
+    // without cs_writing.
+    bool fSuccess = false;
+    try {
+        if (fnBeforeWrite && !fnBeforeWrite())
+            throw std::runtime_error("the write this one depends on failed");
+        CDBBatch batch(db);
+        for (CCoinsMap::const_iterator it = mapWriting.begin(); it != mapWriting.end(); ++it) {
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
+            else
+                batch.Write(entry, it->second.coin);
+        }
+        // Replaying from the best block to hashHead makes the database consistent again
+        std::vector<uint256> vhashHeadBlocks;
+        vhashHeadBlocks.push_back(hashHead);
+        vhashHeadBlocks.push_back(GetBestBlock());
+        batch.Write(DB_HEAD_BLOCKS, vhashHeadBlocks);
+        fSuccess = db.WriteBatch(batch);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+
+    WAIT_LOCK(cs_writing, lock);
+    if (fSuccess)
+        mapWriting.clear();
+    else
+        fWriteFailed = true;
+    fWriting = false;
+    condWriting.notify_all();
+}
+
+bool CCoinsViewDB::BatchWriteAsync(CCoinsMap &mapCoins, const uint256 &hashHead, const boost::function<bool()> &fnBeforeWrite) {
+    if (!WaitForWrite())
+        return false;
+    if (threadWrite.joinable())
+        threadWrite.join();
+    nWriteSequence++;
+
+    size_t nWriting;
+    {
+        WAIT_LOCK(cs_writing, lock);
+        mapWriting.clear();
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                mapWriting.insert(*it);
+        }
+        mapCoins.clear();
+        nWriting = mapWriting.size();
+        fWriting = true;
+    }
+
+    LogPrint("coindb", "Writing %u changed transaction outputs to coin database in the background...\n", (unsigned int)nWriting);
+    threadWrite = std::thread(&CCoinsViewDB::WriteEntries, this, hashHead, fnBeforeWrite);
+    return true;
+}
+
+bool CCoinsViewDB::WaitForWrite() const {
+    WAIT_LOCK(cs_writing, lock);
+    while (fWriting)
+        condWriting.wait(lock);
+    return !fWriteFailed;
+}
+
+/**
+ * Rewrite the per-txid records of older versions as one record per unspent output.
+ *
+ * The old records did not store the nTime of the transaction, so the upgraded coins have
+ * nTime 0 (unknown). Upgraded coinstake outputs are recognized by their empty first output.
+ */
+bool CCoinsViewDB::Upgrade() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+    if (!pcursor->Valid()) {
+        return true;
+    }
+
+    int64_t count = 0;
+    LogPrintf("Upgrading utxo-set database...\n");
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    std::pair<unsigned char, uint256> key;
+    std::pair<unsigned char, uint256> prev_key = std::make_pair(DB_COINS, uint256());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (pcursor->GetKey(key) && key.first == DB_COINS) {
+            if (count++ % 256 == 0) {
+                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+                uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone);
+                if (reportDone < percentageDone/10) {
+                    // report max. every 10% step
+                    LogPrintf("[%d%%]...", percentageDone);
+                    reportDone = percentageDone/10;
+                }
+            }
+            CLegacyCoins old_coins;
+            if (!pcursor->GetValue(old_coins)) {
+                return error("%s: cannot parse CCoins record", __func__);
+            }
+            bool fCoinStake = old_coins.IsCoinStake();
+            COutPoint outpoint(key.second, 0);
+            for (size_t i = 0; i < old_coins.vout.size(); ++i) {
+                if (!old_coins.vout[i].IsNull() && !old_coins.vout[i].scriptPubKey.IsUnspendable()) {
+                    Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase, fCoinStake, 0);
+                    outpoint.n = i;
+                    CoinEntry entry(&outpoint);
+                    batch.Write(entry, newcoin);
+                }
+            }
+            batch.Erase(key);
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+                db.CompactRange(prev_key, key);
+                prev_key = key;
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    db.WriteBatch(batch);
+    db.CompactRange(std::make_pair((unsigned char)DB_COINS, uint256()), key);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, GetDBOptionsFromArgs("blockindex")), fWriting(false), fWriteFailed(false) {
+    std::pair<uint64_t, uint64_t> salt;
+    if (!Read(DB_TXINDEX_COMPACT_SALT, salt)) {
+        salt = std::make_pair(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max()));
+        Write(DB_TXINDEX_COMPACT_SALT, salt);
+    }
+    nTxIndexSalt0 = salt.first;
+    nTxIndexSalt1 = salt.second;
+}
+
+CBlockTreeDB::~CBlockTreeDB() {
+    WaitForWrite();
+    if (threadWrite.joinable())
+        threadWrite.join();
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -95,29 +418,38 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // SolarCoin: The iterator is a snapshot of the database; take it while no background write
+    // is half done, and hold cs_writing so that none starts meanwhile
+    WAIT_LOCK(cs_writing, lock);
+    while (fWriting)
+        condWriting.wait(lock);
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
+    i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    i->pcursor->GetKey(i->keyTmp);
+    CoinEntry entry(&i->keyTmp.second);
+    if (!i->pcursor->Valid() || !i->pcursor->GetKey(entry))
+        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+    else
+        i->keyTmp.first = entry.key;
     return i;
 }
 
-bool CCoinsViewDBCursor::GetKey(uint256 &key) const
+bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
+    if (keyTmp.first == DB_COIN) {
         key = keyTmp.second;
         return true;
     }
     return false;
 }
 
-bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
+bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coins);
+    return pcursor->GetValue(coin);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
@@ -127,39 +459,126 @@ unsigned int CCoinsViewDBCursor::GetValueSize() const
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return keyTmp.first == DB_COIN;
 }
 
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else {
+        keyTmp.first = entry.key;
+    }
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
-    CDBBatch batch(*this);
+void CBlockTreeDB::WriteEntries() {
+    RenameThread("solarcoin-blockdb");
+
+    bool fSuccess = false;
+    try {
+        fSuccess = WriteBatch(*pbatchWriting, true);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+
+    WAIT_LOCK(cs_writing, lock);
+    pbatchWriting.reset();
+    fWriteFailed |= !fSuccess;
+    fWriting = false;
+    condWriting.notify_all();
+}
+
+bool CBlockTreeDB::WriteBatchAsync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+    // Serialize the entries now, while the caller keeps them from changing
+    std::unique_ptr<CDBBatch> pbatch(new CDBBatch(*this));
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
-        batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
+        pbatch->Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
     }
-    batch.Write(DB_LAST_BLOCK, nLastFile);
+    pbatch->Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        pbatch->Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
-    return WriteBatch(batch, true);
+
+    // Writes land in order, so a later batch never gets overwritten by an earlier one
+    if (!WaitForWrite())
+        return false;
+    if (threadWrite.joinable())
+        threadWrite.join();
+    {
+        WAIT_LOCK(cs_writing, lock);
+        pbatchWriting = std::move(pbatch);
+        fWriting = true;
+    }
+    LogPrint("db", "Writing %u block index entries in the background...\n", (unsigned int)blockinfo.size());
+    threadWrite = std::thread(&CBlockTreeDB::WriteEntries, this);
+    return true;
+}
+
+bool CBlockTreeDB::WaitForWrite() const {
+    WAIT_LOCK(cs_writing, lock);
+    while (fWriting)
+        condWriting.wait(lock);
+    return !fWriteFailed;
 }
 
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect, const CBlockLocator &locator) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    batch.Write(DB_TXINDEX_LOCATOR, locator);
+    return WriteBatch(batch);
+}
+
+uint64_t CBlockTreeDB::GetCompactTxIndexKey(const uint256 &txid) const {
+    return SipHashUint256(nTxIndexSalt0, nTxIndexSalt1, txid);
+}
+
+bool CBlockTreeDB::ReadCompactTxIndex(const uint256 &txid, std::vector<CCompactTxPos> &vpos) {
+    vpos.clear();
+    uint64_t nKey = GetCompactTxIndexKey(txid);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(CompactTxIndexEntry(nKey, 0));
+    CompactTxIndexEntry entry;
+    while (pcursor->Valid() && pcursor->GetKey(entry) && entry.key == DB_TXINDEX_COMPACT && entry.nKey == nKey) {
+        unsigned int nTxOffset = 0;
+        if (!pcursor->GetValue(REF(VARINT(nTxOffset))))
+            return error("%s: failed to read value", __func__);
+        vpos.push_back(CCompactTxPos(entry.nHeight, nTxOffset));
+        pcursor->Next();
+    }
+    return !vpos.empty();
+}
+
+bool CBlockTreeDB::WriteCompactTxIndex(const std::vector<std::pair<uint256, CCompactTxPos> > &vect, const CBlockLocator &locator) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<uint256, CCompactTxPos> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(CompactTxIndexEntry(GetCompactTxIndexKey(it->first), it->second.nHeight), VARINT(it->second.nTxOffset));
+    batch.Write(DB_TXINDEX_COMPACT_LOCATOR, locator);
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::CompactTxIndex(int nSplits, const boost::function<bool()>& fnStep) const {
+    return CompactInSteps(std::string{DB_TXINDEX, DB_TXINDEX_COMPACT}, nSplits, fnStep);
+}
+
+bool CBlockTreeDB::ReadTxIndexLocator(bool fCompact, CBlockLocator &locator) {
+    return Read(fCompact ? DB_TXINDEX_COMPACT_LOCATOR : DB_TXINDEX_LOCATOR, locator);
+}
+
+bool CBlockTreeDB::WriteTxIndexLocator(bool fCompact, const CBlockLocator &locator) {
+    return Write(fCompact ? DB_TXINDEX_COMPACT_LOCATOR : DB_TXINDEX_LOCATOR, locator);
+}
+
+bool CBlockTreeDB::EraseTxIndexLocator(bool fCompact) {
+    return Erase(fCompact ? DB_TXINDEX_COMPACT_LOCATOR : DB_TXINDEX_LOCATOR);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -172,6 +591,26 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::ReadBlockIndexSnapshotId(uint64_t &nId) {
+    return Read(DB_BLOCK_INDEX_SNAPSHOT, nId);
+}
+
+bool CBlockTreeDB::WriteBlockIndexSnapshotId(uint64_t nId) {
+    return Write(DB_BLOCK_INDEX_SNAPSHOT, nId, true);
+}
+
+bool CBlockTreeDB::EraseBlockIndexSnapshotId() {
+    return Erase(DB_BLOCK_INDEX_SNAPSHOT, true);
+}
+
+bool CBlockTreeDB::ReadSnapshotValidation(CSnapshotValidationTarget &target) {
+    return Read(DB_SNAPSHOT_VALIDATION, target);
+}
+
+bool CBlockTreeDB::WriteSnapshotValidation(const CSnapshotValidationTarget &target) {
+    return Write(DB_SNAPSHOT_VALIDATION, target, true);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -204,9 +643,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                 pindexNew->nMoneySupply     = diskindex.nMoneySupply;
                 pindexNew->nFlags           = diskindex.nFlags;
                 pindexNew->nStakeModifier   = diskindex.nStakeModifier;
-                pindexNew->prevoutStake     = diskindex.prevoutStake;
-                pindexNew->nStakeTime       = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+                pindexNew->nStakeModifierChecksum = diskindex.nStakeModifierChecksum;
+                pindexNew->SetStake(diskindex.GetPrevoutStake(), diskindex.GetStakeTime());
+                pindexNew->SetHashProofOfStake(diskindex.GetHashProofOfStake());
 
                 // SolarCoin: Disable PoW Sanity check while loading block index from disk.
                 // We use the sha256 hash for the block index for performance reasons, which is recorded for later use.
@@ -221,15 +660,15 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                 if (pindexNew->nHeight > Params().GetConsensus().LAST_POW_BLOCK) {
                     // DEBUG: Show proofs, stake modifier mint and moneysupply of first 20 PoST blocks
                     if (pindexNew->nHeight <= Params().GetConsensus().LAST_POW_BLOCK + 20)
-                        LogPrintf("DEBUG: txdb: nHeight=%d hashProofOfStake=%s nStakeTime=%d nStakeModifier=%d nMint=%s nMoneySupply=%s\n", pindexNew->nHeight, pindexNew->hashProofOfStake.ToString(), pindexNew->nStakeTime, pindexNew->nStakeModifier, FormatMoney(pindexNew->nMint).c_str(), FormatMoneySupply(pindexNew->nMoneySupply).c_str());
+                        LogPrintf("DEBUG: txdb: nHeight=%d hashProofOfStake=%s nStakeTime=%d nStakeModifier=%d nMint=%s nMoneySupply=%s\n", pindexNew->nHeight, pindexNew->GetHashProofOfStake().ToString(), pindexNew->GetStakeTime(), pindexNew->nStakeModifier, FormatMoney(pindexNew->nMint).c_str(), FormatMoneySupply(pindexNew->nMoneySupply).c_str());
                 } else {
                     // DEBUG: Show Mint, MoneySupply, Stake Modifier and hashProofOfStake of 20 PoW blocks
                     if (pindexNew->nHeight >= 4000 && pindexNew->nHeight < 4020)
-                        LogPrintf("DEBUG: txdb: nHeight=%d nMint=%s nMoneySupply=%s nStakeModifier=%d hashProofOfStake=%s\n", pindexNew->nHeight, FormatMoney(pindexNew->nMint).c_str(), FormatMoneySupply(pindexNew->nMoneySupply).c_str(), pindexNew->nStakeModifier, pindexNew->hashProofOfStake.ToString());
+                        LogPrintf("DEBUG: txdb: nHeight=%d nMint=%s nMoneySupply=%s nStakeModifier=%d hashProofOfStake=%s\n", pindexNew->nHeight, FormatMoney(pindexNew->nMint).c_str(), FormatMoneySupply(pindexNew->nMoneySupply).c_str(), pindexNew->nStakeModifier, pindexNew->GetHashProofOfStake().ToString());
                 }
                 // SolarCoin: build setStakeSeen
                 if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+                    setStakeSeen.insert(pindexNew);
 
                 pcursor->Next();
             } else {
@@ -9,9 +9,13 @@
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "sync.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -23,6 +27,8 @@ class uint256;
 
 //! Compensate for extra memory peak (x1.5-x1.9) at flush time.
 static constexpr int DB_PEAK_USAGE_FACTOR = 2;
+//! SolarCoin: A partial flush evicts coins until the cache is at this percentage of its limit.
+static constexpr int COINS_CACHE_LOW_WATER_PERCENT = 75;
 //! No need to periodic flush if at least this much space still available.
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 200 * DB_PEAK_USAGE_FACTOR;
 //! Always periodic flush if less than this much space still available.
@@ -42,6 +48,13 @@ static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
+/**
+ * SolarCoin: LevelDB tuning of a database from its -<strName>maxopenfiles, -<strName>blocksize,
+ * -<strName>bloombits, -<strName>writebuffer and -<strName>compression options. The databases
+ * are "chainstate" and "blockindex" (which also holds the transaction index).
+ */
+CDBOptions GetDBOptionsFromArgs(const std::string& strName);
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -67,19 +80,110 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/**
+ * SolarCoin: Position of a transaction in the compact transaction index (-txindexcompact): the
+ * height of its block in the active chain and its offset in the block, after the header. Entries
+ * are keyed by a truncated salted txid, so a lookup returns every transaction sharing that key and
+ * the caller has to check the txid. Entries of blocks that were disconnected point to whatever
+ * block is at that height now, and are told apart the same way.
+ */
+struct CCompactTxPos
+{
+    int nHeight;
+    unsigned int nTxOffset; // after header
+
+    CCompactTxPos() : nHeight(-1), nTxOffset(0) {}
+    CCompactTxPos(int nHeightIn, unsigned int nTxOffsetIn) : nHeight(nHeightIn), nTxOffset(nTxOffsetIn) {}
+};
+
+/** SolarCoin: Outcomes of the background validation of a loaded UTXO snapshot */
+enum SnapshotValidationStatus
+{
+    SNAPSHOT_VALIDATION_PENDING = 0,
+    SNAPSHOT_VALIDATION_VALID = 1,
+    SNAPSHOT_VALIDATION_INVALID = 2,
+};
+
+/**
+ * SolarCoin: A UTXO snapshot loaded by loadtxoutset, kept in the block tree database until the
+ * blocks below it were replayed and found to produce the same coins (see StartSnapshotValidation()).
+ */
+struct CSnapshotValidationTarget
+{
+    uint256 hashBlock;
+    int nHeight;
+    //! MuHash3072 of the loaded coins, each as its outpoint and CTxOut (see ApplyCoinHash())
+    uint256 hashCoins;
+    int nStatus;
+    std::string strError;
+
+    CSnapshotValidationTarget() : nHeight(0), nStatus(SNAPSHOT_VALIDATION_PENDING) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(hashCoins);
+        READWRITE(nStatus);
+        READWRITE(strError);
+    }
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    /** SolarCoin: Entries being written by BatchWriteAsync(); read from here until they are in the database */
+    mutable CWaitableCriticalSection cs_writing;
+    mutable CConditionVariable condWriting;
+    CCoinsMap mapWriting;
+    //! Joined only by BatchWriteAsync() and the destructor; others wait for fWriting to clear
+    std::thread threadWrite;
+    bool fWriting;
+    bool fWriteFailed;
+
+    /** SolarCoin: Incremented before every change of the state, see GetWriteSequence() */
+    std::atomic<uint64_t> nWriteSequence;
+
+    void WriteEntries(const uint256 &hashHead, const boost::function<bool()> &fnBeforeWrite);
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    //! SolarCoin: strName is the directory in the data directory, chainstate for the active chain
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const std::string& strName = "chainstate");
+    ~CCoinsViewDB();
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
+    std::vector<uint256> GetHeadBlocks() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+
+    /**
+     * SolarCoin: Write some of the entries of the state at block hashHead on a background thread.
+     * The best block stays unchanged; hashHead is recorded as the head block to replay to if the node
+     * stops before the next BatchWrite() (see ReplayBlocks()). mapCoins is emptied.
+     * fnBeforeWrite, if given, runs on the background thread before the write; it returning false fails the write.
+     */
+    bool BatchWriteAsync(CCoinsMap &mapCoins, const uint256 &hashHead, const boost::function<bool()> &fnBeforeWrite = boost::function<bool()>());
+
+    /**
+     * SolarCoin: A number that changes before the state is written. Coins read while it stays
+     * the same are still current (used by the coins prefetch, which reads without cs_main).
+     */
+    uint64_t GetWriteSequence() const { return nWriteSequence.load(); }
+
+    //! SolarCoin: The underlying database, for statistics
+    const CDBWrapper& GetDB() const { return db; }
+
+    //! Wait for a write started by BatchWriteAsync(). Returns false if it failed.
+    bool WaitForWrite() const;
+
+    //! Attempt to update from an older database format (per-txid records). Returns false on an error or if interrupted.
+    bool Upgrade();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -88,8 +192,8 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     ~CCoinsViewDBCursor() {}
 
-    bool GetKey(uint256 &key) const;
-    bool GetValue(CCoins &coins) const;
+    bool GetKey(COutPoint &key) const;
+    bool GetValue(Coin &coin) const;
     unsigned int GetValueSize() const;
 
     bool Valid() const;
@@ -99,7 +203,7 @@ private:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
         CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
     std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
 };
@@ -112,16 +216,58 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    //! SolarCoin: salt of the compact transaction index keys, stored in the database
+    uint64_t nTxIndexSalt0, nTxIndexSalt1;
+
+    //! SolarCoin: The batch being written by WriteBatchAsync(), and whether that write is still going on
+    std::unique_ptr<CDBBatch> pbatchWriting;
+    std::thread threadWrite;
+    mutable CWaitableCriticalSection cs_writing;
+    mutable CConditionVariable condWriting;
+    bool fWriting;
+    bool fWriteFailed;
+
+    uint64_t GetCompactTxIndexKey(const uint256 &txid) const;
+    void WriteEntries();
 public:
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    ~CBlockTreeDB();
+
+    /**
+     * SolarCoin: Write block file information and block index entries on a background thread,
+     * with fsync. The entries are serialized before returning, so the block index can change
+     * meanwhile. Writes that depend on these entries (coins database flushes, pruning) must
+     * call WaitForWrite() first.
+     */
+    bool WriteBatchAsync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    //! SolarCoin: Wait for the write started by WriteBatchAsync(). Returns false if it failed.
+    bool WaitForWrite() const;
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    //! SolarCoin: Add entries to the transaction index, which is then complete up to the locator's block
+    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list, const CBlockLocator &locator);
+    //! SolarCoin: All entries of the compact transaction index that may be txid
+    bool ReadCompactTxIndex(const uint256 &txid, std::vector<CCompactTxPos> &vpos);
+    //! SolarCoin: Add entries to the compact transaction index, which is then complete up to the locator's block
+    bool WriteCompactTxIndex(const std::vector<std::pair<uint256, CCompactTxPos> > &list, const CBlockLocator &locator);
+    //! SolarCoin: Where the full or compact transaction index is complete up to
+    bool ReadTxIndexLocator(bool fCompact, CBlockLocator &locator);
+    bool WriteTxIndexLocator(bool fCompact, const CBlockLocator &locator);
+    bool EraseTxIndexLocator(bool fCompact);
+    //! SolarCoin: Compact the entries of the full and compact transaction indexes, see CDBWrapper::CompactInSteps()
+    bool CompactTxIndex(int nSplits, const boost::function<bool()>& fnStep) const;
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! SolarCoin: Identifier of the block index snapshot that matches the database, see DumpBlockIndexSnapshot()
+    bool ReadBlockIndexSnapshotId(uint64_t &nId);
+    //! SolarCoin: The loaded UTXO snapshot and how its background validation ended, if one was loaded
+    bool ReadSnapshotValidation(CSnapshotValidationTarget &target);
+    bool WriteSnapshotValidation(const CSnapshotValidationTarget &target);
+    bool WriteBlockIndexSnapshotId(uint64_t nId);
+    bool EraseBlockIndexSnapshotId();
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -0,0 +1,194 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+CTxIndex* ptxindex = NULL;
+
+static bool ReadTransactionAt(const CDiskTxPos &postx, CTransactionRef &txOut, uint256 &hashBlock)
+{
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+
+    CBlockHeader header;
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
+CTxIndex::CTxIndex(bool fCompactIn, int64_t nMaxSyncRateIn, const CBlockIndex* pindexBestIn) :
+    CBaseIndex("transaction index", "bitcoin-txindex", "txindex", TXINDEX_SYNC_BATCH_BLOCKS, false, nMaxSyncRateIn), fCompact(fCompactIn)
+{
+    pindexBest = pindexBestIn;
+}
+
+bool CTxIndex::WriteBlocks(const std::vector<CIndexedBlock>& vBlocks, const CBlockLocator& locator)
+{
+    // The transaction index rules out pruning, so the blocks stay where the index entries say
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    std::vector<std::pair<uint256, CCompactTxPos> > vCompactPos;
+    for (const CIndexedBlock& indexed : vBlocks) {
+        const CBlock& block = *indexed.pblock;
+        unsigned int nTxOffset = GetSizeOfCompactSize(block.vtx.size());
+        for (const auto& tx : block.vtx) {
+            if (fCompact)
+                vCompactPos.push_back(std::make_pair(tx->GetHash(), CCompactTxPos(indexed.pindex->nHeight, nTxOffset)));
+            else
+                vPos.push_back(std::make_pair(tx->GetHash(), CDiskTxPos(indexed.pindex->GetBlockPos(), nTxOffset)));
+            nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+        }
+    }
+    return fCompact ? pblocktree->WriteCompactTxIndex(vCompactPos, locator) : pblocktree->WriteTxIndex(vPos, locator);
+}
+
+bool CTxIndex::FindTx(const uint256& txid, CTransactionRef& txOut, unsigned int& nTxOffset, uint256& hashBlock, bool& fIndexed) const
+{
+    fIndexed = false;
+    if (fCompact) {
+        // Try each entry sharing the truncated txid in the block now at its height
+        std::vector<CCompactTxPos> vpos;
+        if (!pblocktree->ReadCompactTxIndex(txid, vpos))
+            return false;
+        for (const CCompactTxPos& pos : vpos) {
+            CDiskTxPos postx;
+            {
+                LOCK(cs_main);
+                CBlockIndex* pindex = chainActive[pos.nHeight];
+                if (!pindex || !(pindex->nStatus & BLOCK_HAVE_DATA))
+                    continue;
+                postx = CDiskTxPos(pindex->GetBlockPos(), pos.nTxOffset);
+            }
+            CTransactionRef tx;
+            uint256 hashTxBlock;
+            if (ReadTransactionAt(postx, tx, hashTxBlock) && tx->GetHash() == txid) {
+                txOut = tx;
+                hashBlock = hashTxBlock;
+                nTxOffset = pos.nTxOffset;
+                fIndexed = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    CDiskTxPos postx;
+    fIndexed = pblocktree->ReadTxIndex(txid, postx);
+    if (!fIndexed)
+        return false;
+
+    if (!ReadTransactionAt(postx, txOut, hashBlock))
+        return false;
+
+    nTxOffset = postx.nTxOffset;
+
+    if (txOut->GetHash() != txid) {
+        return error("%s: txid mismatch", __func__);
+    }
+    return true;
+}
+
+bool CTxIndex::FindTxOffset(const uint256& txid, const CBlockIndex* pindex, unsigned int& nTxOffset) const
+{
+    CDiskTxPos postx;
+    if (fCompact) {
+        // Take the entry at the block's height; the key is only part of the txid, so if another
+        // transaction there shares it, the caller reads the transaction instead.
+        std::vector<CCompactTxPos> vpos;
+        if (!pblocktree->ReadCompactTxIndex(txid, vpos))
+            return false;
+        int nFound = 0;
+        for (const CCompactTxPos& pos : vpos) {
+            if (pos.nHeight == pindex->nHeight) {
+                postx.nTxOffset = pos.nTxOffset;
+                nFound++;
+            }
+        }
+        if (nFound != 1)
+            return false;
+    } else if (!pblocktree->ReadTxIndex(txid, postx)) {
+        return false;
+    }
+
+    LOCK(cs_main);
+    // A duplicate txid or a reorg in between would leave the index entry pointing at a different block
+    if (!chainActive.Contains(pindex))
+        return false;
+    if (fCompact) {
+        // Entries up to the last indexed block in the active chain are those of the active chain
+        if (!pindexBest || !chainActive.Contains(pindexBest) || pindexBest->nHeight < pindex->nHeight)
+            return false;
+    } else if (postx.nFile != pindex->nFile || postx.nPos != pindex->nDataPos) {
+        return false;
+    }
+    nTxOffset = postx.nTxOffset;
+    return true;
+}
+
+bool InitTxIndex(boost::thread_group& threadGroup)
+{
+    const bool fCompact = fTxIndex && fTxIndexCompact;
+    const CBlockIndex* pindexBest = NULL;
+    {
+        LOCK(cs_main);
+        bool fWasEnabled = false, fWasCompact = false, fHasLocator = false;
+        pblocktree->ReadFlag("txindex", fWasEnabled);
+        pblocktree->ReadFlag("txindexcompact", fWasCompact);
+        pblocktree->ReadFlag("txindexlocator", fHasLocator);
+
+        // A full index written by ConnectBlock() in older versions covers the active chain
+        if (fWasEnabled && !fWasCompact && !fHasLocator && chainActive.Tip()) {
+            if (!pblocktree->WriteTxIndexLocator(false, chainActive.GetLocator()))
+                return InitError(_("Failed to write to the transaction index"));
+        }
+        // A format turned off misses the blocks connected meanwhile, so it starts over when turned on again
+        for (int i = 0; i < 2; i++) {
+            if (!(fTxIndex && fCompact == (i == 1)) && !pblocktree->EraseTxIndexLocator(i == 1))
+                return InitError(_("Failed to write to the transaction index"));
+        }
+        if (!pblocktree->WriteFlag("txindex", fTxIndex) || !pblocktree->WriteFlag("txindexcompact", fCompact) ||
+            !pblocktree->WriteFlag("txindexlocator", true))
+            return InitError(_("Failed to write to the transaction index"));
+
+        CBlockLocator locator;
+        if (fTxIndex && pblocktree->ReadTxIndexLocator(fCompact, locator))
+            pindexBest = FindForkInGlobalIndex(chainActive, locator);
+        LogPrintf("%s: transaction index %s, complete up to height %d\n", __func__,
+            fTxIndex ? (fCompact ? "enabled (compact)" : "enabled") : "disabled", pindexBest ? pindexBest->nHeight : -1);
+    }
+    if (!fTxIndex)
+        return true;
+
+    int64_t nMaxSyncRate = std::max((int64_t)0, GetArg("-txindexsyncrate", DEFAULT_TXINDEX_SYNC_RATE)) << 20;
+    ptxindex = new CTxIndex(fCompact, nMaxSyncRate, pindexBest);
+    RegisterValidationInterface(ptxindex);
+    threadGroup.create_thread(boost::bind(&CBaseIndex::ThreadSync, ptxindex));
+    return true;
+}
+
+void StopTxIndex()
+{
+    if (ptxindex) {
+        UnregisterValidationInterface(ptxindex);
+        delete ptxindex;
+        ptxindex = NULL;
+    }
+}
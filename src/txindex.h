@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINDEX_H
+#define BITCOIN_TXINDEX_H
+
+#include "baseindex.h"
+#include "primitives/transaction.h"
+
+#include <stdint.h>
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+/** Default for -txindexsyncrate, in MiB of blocks read per second */
+static const unsigned int DEFAULT_TXINDEX_SYNC_RATE = 32;
+/** Blocks added to the transaction index in one database write while catching up */
+static const unsigned int TXINDEX_SYNC_BATCH_BLOCKS = 64;
+
+/**
+ * SolarCoin: The transaction index (-txindex, in the full or the compact format of -txindexcompact),
+ * kept in the block tree database and caught up by its sync thread like any CBaseIndex.
+ */
+class CTxIndex : public CBaseIndex
+{
+private:
+    const bool fCompact;
+
+protected:
+    bool WriteBlocks(const std::vector<CIndexedBlock>& vBlocks, const CBlockLocator& locator) override;
+
+public:
+    CTxIndex(bool fCompactIn, int64_t nMaxSyncRateIn, const CBlockIndex* pindexBestIn);
+
+    /**
+     * Read a confirmed transaction through the index, without cs_main.
+     * fIndexed is set if the index knows the transaction, even if reading it failed.
+     */
+    bool FindTx(const uint256& txid, CTransactionRef& txOut, unsigned int& nTxOffset, uint256& hashBlock, bool& fIndexed) const;
+
+    /** The offset of a transaction in a block of the active chain, without reading it */
+    bool FindTxOffset(const uint256& txid, const CBlockIndex* pindex, unsigned int& nTxOffset) const;
+};
+
+/** The transaction index, NULL unless -txindex */
+extern CTxIndex* ptxindex;
+
+/** Record the -txindex settings in the block tree database and start the index if enabled */
+bool InitTxIndex(boost::thread_group& threadGroup);
+/** Delete the transaction index, after its thread stopped */
+void StopTxIndex();
+
+#endif // BITCOIN_TXINDEX_H
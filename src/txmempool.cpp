@@ -8,6 +8,7 @@
 #include "clientversion.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "metrics.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "policy/fees.h"
@@ -37,11 +38,16 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     assert(inChainInputValue <= nValueIn);
 
     feeDelta = 0;
+    priorityDelta = 0;
+    priorityHeight = entryHeight;
+    priorityScore = GetPriority(entryHeight);
 
     nCountWithAncestors = 1;
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+
+    nEpochMarker = 0;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -71,6 +77,13 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints& lp)
     lockPoints = lp;
 }
 
+void CTxMemPoolEntry::UpdatePriority(double newPriorityDelta, unsigned int newPriorityHeight)
+{
+    priorityDelta = newPriorityDelta;
+    priorityHeight = newPriorityHeight;
+    priorityScore = GetPriority(priorityHeight) + priorityDelta;
+}
+
 size_t CTxMemPoolEntry::GetTxSize() const
 {
     return GetVirtualTransactionSize(nTxWeight, sigOpCost);
@@ -81,34 +94,40 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    // SolarCoin: the entries reached are marked rather than looked up in the sets
+    const EpochGuard epoch(*this);
+    std::vector<txiter> vStage, vAllDescendants;
+    BOOST_FOREACH(const txiter childEntry, GetMemPoolChildren(updateIt)) {
+        if (!Visited(childEntry))
+            vStage.push_back(childEntry);
+    }
 
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
+    while (!vStage.empty()) {
+        const txiter cit = vStage.back();
+        vStage.pop_back();
+        vAllDescendants.push_back(cit);
+        const linkEntries &setChildren = GetMemPoolChildren(cit);
         BOOST_FOREACH(const txiter childEntry, setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 BOOST_FOREACH(const txiter cacheEntry, cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!Visited(cacheEntry))
+                        vAllDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else if (!Visited(childEntry)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                vStage.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    BOOST_FOREACH(txiter cit, setAllDescendants) {
+    BOOST_FOREACH(txiter cit, vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
@@ -129,6 +148,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
 {
     LOCK(cs);
+    snapshot.reset();
     // For each entry in vHashesToUpdate, store the set of in-mempool, but not
     // in-vHashesToUpdate transactions, so that we don't have to recalculate
     // descendants when we come across a previously seen entry.
@@ -173,7 +193,12 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 {
     LOCK(cs);
 
-    setEntries parentHashes;
+    // SolarCoin: the ancestors reached are marked rather than kept in a staging set
+    const EpochGuard epoch(*this);
+    BOOST_FOREACH(const txiter ancestorIt, setAncestors) {
+        Visited(ancestorIt);
+    }
+    std::vector<txiter> parentHashes;
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -182,8 +207,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
+            if (piter != mapTx.end() && !Visited(piter)) {
+                parentHashes.push_back(piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -194,16 +219,19 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        BOOST_FOREACH(const txiter piter, GetMemPoolParents(it)) {
+            if (!Visited(piter))
+                parentHashes.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -217,11 +245,11 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
+        const linkEntries & setMemPoolParents = GetMemPoolParents(stageit);
         BOOST_FOREACH(const txiter &phash, setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!Visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -235,7 +263,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
+    const linkEntries &memPoolParents = GetMemPoolParents(it);
+    setEntries parentIters(memPoolParents.begin(), memPoolParents.end());
     // add or remove this tx as a child of each parent
     BOOST_FOREACH(txiter piter, parentIters) {
         UpdateChild(piter, it, add);
@@ -264,7 +293,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const linkEntries &setMemPoolChildren = GetMemPoolChildren(it);
     BOOST_FOREACH(txiter updateIt, setMemPoolChildren) {
         UpdateParent(updateIt, it, false);
     }
@@ -349,7 +378,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), nEpoch(0), fHaveEpoch(false), nPriorityHeight(0)
 {
     _clear(); //lock free clear
 
@@ -366,17 +395,10 @@ CTxMemPool::~CTxMemPool()
     delete minerPolicyEstimator;
 }
 
-void CTxMemPool::pruneSpent(const uint256 &hashTx, CCoins &coins)
+bool CTxMemPool::isSpent(const COutPoint& outpoint)
 {
     LOCK(cs);
-
-    auto it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
-
-    // iterate over all COutPoints in mapNextTx whose hash equals the provided hashTx
-    while (it != mapNextTx.end() && it->first->hash == hashTx) {
-        coins.Spend(it->first->n); // and remove those outputs from coins
-        it++;
-    }
+    return mapNextTx.count(outpoint);
 }
 
 unsigned int CTxMemPool::GetTransactionsUpdated() const
@@ -411,6 +433,8 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
             mapTx.modify(newit, update_fee_delta(deltas.second));
         }
     }
+    // SolarCoin: Key the new entry in the priority index like the others
+    mapTx.modify(newit, update_priority(pos != mapDeltas.end() ? pos->second.first : 0, nPriorityHeight));
 
     // Update cachedInnerUsage to include contained transaction's usage.
     // (When we update the entry for in-mempool parents, memory usage will be
@@ -443,6 +467,8 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, validFeeEstimate);
+    SetMetric(METRIC_MEMPOOL_TRANSACTIONS, mapTx.size());
+    SetMetric(METRIC_MEMPOOL_BYTES, totalTxSize);
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
@@ -468,11 +494,13 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
+    cachedInnerUsage -= mapLinks[it].parents.DynamicMemoryUsage() + mapLinks[it].children.DynamicMemoryUsage();
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(hash);
+    SetMetric(METRIC_MEMPOOL_TRANSACTIONS, mapTx.size());
+    SetMetric(METRIC_MEMPOOL_BYTES, totalTxSize);
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and adds to
@@ -483,27 +511,58 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
+    // SolarCoin: the entries reached are marked rather than kept in a staging set
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stage;
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        Visited(entryit);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const linkEntries &setChildren = GetMemPoolChildren(it);
         BOOST_FOREACH(const txiter &childiter, setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!Visited(childiter) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
 }
 
+void CTxMemPool::CalculateDescendants(txiter entryit, std::vector<txiter> &vDescendants)
+{
+    // The output doubles as the queue of the breadth-first walk
+    const EpochGuard epoch(*this);
+    Visited(entryit);
+    size_t nNext = vDescendants.size();
+    BOOST_FOREACH(const txiter &childiter, GetMemPoolChildren(entryit)) {
+        if (!Visited(childiter))
+            vDescendants.push_back(childiter);
+    }
+    for (; nNext < vDescendants.size(); nNext++) {
+        BOOST_FOREACH(const txiter &childiter, GetMemPoolChildren(vDescendants[nNext])) {
+            if (!Visited(childiter))
+                vDescendants.push_back(childiter);
+        }
+    }
+}
+
+void CTxMemPool::CalculateNewerThan(unsigned int nTime, setEntries &setNewer)
+{
+    indexed_transaction_set::index<tx_time>::type::iterator it = mapTx.get<tx_time>().upper_bound(nTime);
+    for (; it != mapTx.get<tx_time>().end(); it++) {
+        txiter entryit = mapTx.project<0>(it);
+        if (!setNewer.count(entryit))
+            CalculateDescendants(entryit, setNewer);
+    }
+}
+
 void CTxMemPool::removeRecursive(const CTransaction &origTx, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
@@ -554,9 +613,9 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
                 indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
                 if (it2 != mapTx.end())
                     continue;
-                const CCoins *coins = pcoins->AccessCoins(txin.prevout.hash);
-                if (nCheckFrequency != 0) assert(coins);
-                if (!coins || ((coins->IsCoinBase() || coins->IsCoinStake()) && ((signed long)nMemPoolHeight) - coins->nHeight < (coins->IsCoinBase() ? COINBASE_MATURITY_POW : COINBASE_MATURITY))) { // SolarCoin: Two maturities
+                const Coin &coin = pcoins->AccessCoin(txin.prevout);
+                if (nCheckFrequency != 0) assert(!coin.IsSpent());
+                if (coin.IsSpent() || ((coin.IsCoinBase() || coin.IsCoinStake()) && ((signed long)nMemPoolHeight) - coin.nHeight < (coin.IsCoinBase() ? COINBASE_MATURITY_POW : COINBASE_MATURITY))) { // SolarCoin: Two maturities
                     txToRemove.insert(it);
                     break;
                 }
@@ -633,6 +692,8 @@ void CTxMemPool::_clear()
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    SetMetric(METRIC_MEMPOOL_TRANSACTIONS, 0);
+    SetMetric(METRIC_MEMPOOL_BYTES, 0);
 }
 
 void CTxMemPool::clear()
@@ -663,11 +724,12 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
+        assert(it->GetPriorityHeight() == nPriorityHeight);
         const CTransaction& tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
         assert(linksiter != mapLinks.end());
         const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        innerUsage += links.parents.DynamicMemoryUsage() + links.children.DynamicMemoryUsage();
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -684,8 +746,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                     parentSigOpCost += it2->GetSigOpCost();
                 }
             } else {
-                const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-                assert(coins && coins->IsAvailable(txin.prevout.n));
+                assert(pcoins->HaveCoin(txin.prevout));
             }
             // Check whether its inputs are marked in mapNextTx.
             auto it3 = mapNextTx.find(txin.prevout);
@@ -694,7 +755,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        const linkEntries &memPoolParents = GetMemPoolParents(it);
+        assert(setParentCheck.size() == memPoolParents.size() && std::equal(setParentCheck.begin(), setParentCheck.end(), memPoolParents.begin()));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -727,7 +789,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        const linkEntries &memPoolChildren = GetMemPoolChildren(it);
+        assert(setChildrenCheck.size() == memPoolChildren.size() && std::equal(setChildrenCheck.begin(), setChildrenCheck.end(), memPoolChildren.begin()));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
@@ -829,6 +892,15 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
     }
 }
 
+void CTxMemPool::queryHashesUnsorted(std::vector<uint256>& vtxid) const
+{
+    LOCK(cs);
+    vtxid.clear();
+    vtxid.reserve(mapTx.size());
+    for (const CTxMemPoolEntry& entry : mapTx)
+        vtxid.push_back(entry.GetTx().GetHash());
+}
+
 static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
     return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee()};
 }
@@ -847,6 +919,70 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<TxMempoolInfo> CTxMemPool::infoSorted(const std::vector<uint256>& hashes) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(hashes.size());
+    for (const uint256& hash : hashes) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i != mapTx.end())
+            iters.push_back(i);
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    std::vector<TxMempoolInfo> ret;
+    ret.reserve(iters.size());
+    for (auto it : iters) {
+        ret.push_back(GetInfo(it));
+    }
+    return ret;
+}
+
+TxMempoolEntrySummary CTxMemPool::GetEntrySummary(txiter it, int nChainHeight) const
+{
+    AssertLockHeld(cs);
+    TxMempoolEntrySummary summary;
+    summary.hash = it->GetTx().GetHash();
+    summary.nTxSize = it->GetTxSize();
+    summary.nFee = it->GetFee();
+    summary.nModifiedFee = it->GetModifiedFee();
+    summary.nTime = it->GetTime();
+    summary.nHeight = it->GetHeight();
+    summary.dStartingPriority = it->GetPriority(it->GetHeight());
+    summary.dCurrentPriority = it->GetPriority(nChainHeight);
+    summary.nCountWithDescendants = it->GetCountWithDescendants();
+    summary.nSizeWithDescendants = it->GetSizeWithDescendants();
+    summary.nModFeesWithDescendants = it->GetModFeesWithDescendants();
+    summary.nCountWithAncestors = it->GetCountWithAncestors();
+    summary.nSizeWithAncestors = it->GetSizeWithAncestors();
+    summary.nModFeesWithAncestors = it->GetModFeesWithAncestors();
+    const linkEntries& parents = GetMemPoolParents(it);
+    summary.vDepends.reserve(parents.size());
+    for (txiter parent : parents)
+        summary.vDepends.push_back(parent->GetTx().GetHash());
+    std::sort(summary.vDepends.begin(), summary.vDepends.end());
+    return summary;
+}
+
+std::shared_ptr<const TxMempoolSnapshot> CTxMemPool::GetSnapshot(int nChainHeight) const
+{
+    LOCK(cs);
+    if (snapshot && snapshot->nTransactionsUpdated == nTransactionsUpdated && snapshot->nChainHeight == nChainHeight)
+        return snapshot;
+
+    std::shared_ptr<TxMempoolSnapshot> newSnapshot = std::make_shared<TxMempoolSnapshot>();
+    newSnapshot->nTransactionsUpdated = nTransactionsUpdated;
+    newSnapshot->nChainHeight = nChainHeight;
+    newSnapshot->vEntries.reserve(mapTx.size());
+    for (txiter it = mapTx.begin(); it != mapTx.end(); it++)
+        newSnapshot->vEntries.push_back(GetEntrySummary(it, nChainHeight));
+    std::sort(newSnapshot->vEntries.begin(), newSnapshot->vEntries.end(),
+              [](const TxMempoolEntrySummary& a, const TxMempoolEntrySummary& b) { return a.hash < b.hash; });
+    snapshot = newSnapshot;
+    return snapshot;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -865,14 +1001,14 @@ TxMempoolInfo CTxMemPool::info(const uint256& hash) const
     return GetInfo(i);
 }
 
+// SolarCoin: the estimator publishes its estimates as a snapshot and guards its own state, so
+// neither reading nor saving the estimates takes cs.
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
-    LOCK(cs);
     return minerPolicyEstimator->estimateFee(nBlocks);
 }
 CFeeRate CTxMemPool::estimateSmartFee(int nBlocks, int *answerFoundAtBlocks) const
 {
-    LOCK(cs);
     return minerPolicyEstimator->estimateSmartFee(nBlocks, answerFoundAtBlocks, *this);
 }
 double CTxMemPool::estimatePriority(int nBlocks) const
@@ -886,11 +1022,15 @@ double CTxMemPool::estimateSmartPriority(int nBlocks, int *answerFoundAtBlocks)
     return minerPolicyEstimator->estimateSmartPriority(nBlocks, answerFoundAtBlocks, *this);
 }
 
+void CTxMemPool::ProcessFeeEstimates()
+{
+    minerPolicyEstimator->ProcessQueued();
+}
+
 bool
 CTxMemPool::WriteFeeEstimates(CAutoFile& fileout) const
 {
     try {
-        LOCK(cs);
         fileout << 139900; // version required to read: 0.13.99 or later
         fileout << CLIENT_VERSION; // version that wrote the file
         minerPolicyEstimator->Write(fileout);
@@ -910,7 +1050,6 @@ CTxMemPool::ReadFeeEstimates(CAutoFile& filein)
         filein >> nVersionRequired >> nVersionThatWrote;
         if (nVersionRequired > CLIENT_VERSION)
             return error("CTxMemPool::ReadFeeEstimates(): up-version (%d) fee estimate file", nVersionRequired);
-        LOCK(cs);
         minerPolicyEstimator->Read(filein, nVersionThatWrote);
     }
     catch (const std::exception&) {
@@ -924,12 +1063,14 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
 {
     {
         LOCK(cs);
+        snapshot.reset();
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(deltas.second));
+            mapTx.modify(it, update_priority(deltas.first, nPriorityHeight));
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -967,6 +1108,16 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
     mapDeltas.erase(hash);
 }
 
+void CTxMemPool::UpdatePriorityHeight(unsigned int nHeight)
+{
+    LOCK(cs);
+    if (nHeight == nPriorityHeight)
+        return;
+    nPriorityHeight = nHeight;
+    for (txiter it = mapTx.begin(); it != mapTx.end(); ++it)
+        mapTx.modify(it, update_priority(it->GetPriorityDelta(), nHeight));
+}
+
 bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 {
     for (unsigned int i = 0; i < tx.vin.size(); i++)
@@ -977,26 +1128,30 @@ bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) { }
 
-bool CCoinsViewMemPool::GetCoins(const uint256 &txid, CCoins &coins) const {
+bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
-    CTransactionRef ptx = mempool.get(txid);
+    CTransactionRef ptx = mempool.get(outpoint.hash);
     if (ptx) {
-        coins = CCoins(*ptx, MEMPOOL_HEIGHT);
-        return true;
+        if (outpoint.n < ptx->vout.size()) {
+            coin = Coin(ptx->vout[outpoint.n], MEMPOOL_HEIGHT, false, ptx->IsCoinStake(), ptx->nTime);
+            return true;
+        } else {
+            return false;
+        }
     }
-    return (base->GetCoins(txid, coins) && !coins.IsPruned());
+    return (base->GetCoin(outpoint, coin) && !coin.IsSpent());
 }
 
-bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
-    return mempool.exists(txid) || base->HaveCoins(txid);
+bool CCoinsViewMemPool::HaveCoin(const COutPoint &outpoint) const {
+    return mempool.exists(outpoint) || base->HaveCoin(outpoint);
 }
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // Estimate the overhead of mapTx to be 18 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 21 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -1033,27 +1188,55 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
     return addUnchecked(hash, entry, setAncestors, validFeeEstimate);
 }
 
+size_t CTxMemPool::linkEntries::count(txiter it) const
+{
+    const_iterator pos = std::lower_bound(v.begin(), v.end(), it, CompareIteratorByHash());
+    return pos != v.end() && !CompareIteratorByHash()(it, *pos);
+}
+
+bool CTxMemPool::linkEntries::insert(txiter it)
+{
+    prevector<2, txiter>::iterator pos = std::lower_bound(v.begin(), v.end(), it, CompareIteratorByHash());
+    if (pos != v.end() && !CompareIteratorByHash()(it, *pos))
+        return false;
+    v.insert(pos, it);
+    return true;
+}
+
+size_t CTxMemPool::linkEntries::erase(txiter it)
+{
+    prevector<2, txiter>::iterator pos = std::lower_bound(v.begin(), v.end(), it, CompareIteratorByHash());
+    if (pos == v.end() || CompareIteratorByHash()(it, *pos))
+        return 0;
+    v.erase(pos);
+    return 1;
+}
+
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    linkEntries &children = mapLinks[entry].children;
+    cachedInnerUsage -= children.DynamicMemoryUsage();
+    if (add) {
+        children.insert(child);
+    } else {
+        children.erase(child);
     }
+    cachedInnerUsage += children.DynamicMemoryUsage();
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    linkEntries &parents = mapLinks[entry].parents;
+    cachedInnerUsage -= parents.DynamicMemoryUsage();
+    if (add) {
+        parents.insert(parent);
+    } else {
+        parents.erase(parent);
     }
+    cachedInnerUsage += parents.DynamicMemoryUsage();
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPool::linkEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -1061,7 +1244,7 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
     return it->second.parents;
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPool::linkEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -1101,7 +1284,7 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining) {
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining) {
     LOCK(cs);
 
     unsigned nTxnRemoved = 0;
@@ -1134,9 +1317,8 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRe
                 BOOST_FOREACH(const CTxIn& txin, tx.vin) {
                     if (exists(txin.prevout.hash))
                         continue;
-                    auto iter = mapNextTx.lower_bound(COutPoint(txin.prevout.hash, 0));
-                    if (iter == mapNextTx.end() || iter->first->hash != txin.prevout.hash)
-                        pvNoSpendsRemaining->push_back(txin.prevout.hash);
+                    if (!mapNextTx.count(txin.prevout))
+                        pvNoSpendsRemaining->push_back(txin.prevout);
                 }
             }
         }
@@ -16,6 +16,8 @@
 #include "amount.h"
 #include "coins.h"
 #include "indirectmap.h"
+#include "memusage.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 #include "random.h"
@@ -42,8 +44,9 @@ inline bool AllowFree(double dPriority)
     return dPriority > AllowFreeThreshold();
 }
 
-/** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
-static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
+/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8).
+ *  SolarCoin: the largest value that fits in Coin::nHeight. */
+static const unsigned int MEMPOOL_HEIGHT = 0x3FFFFFFF;
 
 struct LockPoints
 {
@@ -94,6 +97,9 @@ private:
     bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
+    double priorityDelta;      //!< SolarCoin: priority added by PrioritiseTransaction
+    unsigned int priorityHeight; //!< SolarCoin: the height priorityScore is computed at
+    double priorityScore;      //!< SolarCoin: GetPriority(priorityHeight) + priorityDelta, the key of the priority index
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
     // Information about descendants of this transaction that are in the
@@ -133,6 +139,9 @@ public:
     unsigned int GetHeight() const { return entryHeight; }
     int64_t GetSigOpCost() const { return sigOpCost; }
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
+    double GetPriorityScore() const { return priorityScore; }
+    double GetPriorityDelta() const { return priorityDelta; }
+    unsigned int GetPriorityHeight() const { return priorityHeight; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
 
@@ -145,6 +154,8 @@ public:
     void UpdateFeeDelta(int64_t feeDelta);
     // Update the LockPoints after a reorg
     void UpdateLockPoints(const LockPoints& lp);
+    // SolarCoin: Updates the priority delta and the height of the priority score
+    void UpdatePriority(double newPriorityDelta, unsigned int newPriorityHeight);
 
     uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
     uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
@@ -158,6 +169,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t nEpochMarker; //!< SolarCoin: the last mempool walk that reached this entry, see CTxMemPool::Visited()
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -202,6 +214,17 @@ private:
     int64_t feeDelta;
 };
 
+struct update_priority
+{
+    update_priority(double _priorityDelta, unsigned int _priorityHeight) : priorityDelta(_priorityDelta), priorityHeight(_priorityHeight) { }
+
+    void operator() (CTxMemPoolEntry &e) { e.UpdatePriority(priorityDelta, priorityHeight); }
+
+private:
+    double priorityDelta;
+    unsigned int priorityHeight;
+};
+
 struct update_lock_points
 {
     update_lock_points(const LockPoints& _lp) : lp(_lp) { }
@@ -222,6 +245,16 @@ struct mempoolentry_txid
     }
 };
 
+// SolarCoin: extracts the transaction's own nTime
+struct mempoolentry_txtime
+{
+    typedef unsigned int result_type;
+    result_type operator() (const CTxMemPoolEntry &entry) const
+    {
+        return entry.GetTx().nTime;
+    }
+};
+
 /** \class CompareTxMemPoolEntryByDescendantScore
  *
  *  Sort an entry by max(score/size of entry's tx, score/size with all descendants).
@@ -277,6 +310,22 @@ public:
     }
 };
 
+/** \class CompareTxMemPoolEntryByPriority
+ *
+ *  SolarCoin: Sort by coin age priority at the mempool's priority height in descending order,
+ *  then like TxCoinAgePriorityCompare
+ */
+class CompareTxMemPoolEntryByPriority
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    {
+        if (a.GetPriorityScore() == b.GetPriorityScore())
+            return CompareTxMemPoolEntryByScore()(a, b);
+        return a.GetPriorityScore() > b.GetPriorityScore();
+    }
+};
+
 class CompareTxMemPoolEntryByEntryTime
 {
 public:
@@ -314,6 +363,8 @@ struct descendant_score {};
 struct entry_time {};
 struct mining_score {};
 struct ancestor_score {};
+struct tx_time {};
+struct priority_score {};
 
 class CBlockPolicyEstimator;
 
@@ -335,6 +386,38 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/** SolarCoin: The summary of a mempool entry, as getrawmempool and REST export it */
+struct TxMempoolEntrySummary
+{
+    uint256 hash;
+    size_t nTxSize;
+    CAmount nFee;
+    CAmount nModifiedFee;
+    int64_t nTime;
+    unsigned int nHeight;
+    double dStartingPriority;
+    double dCurrentPriority;  //!< at the chain height of the snapshot
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    std::vector<uint256> vDepends; //!< the in-mempool parents, sorted
+};
+
+/**
+ * SolarCoin: An immutable copy of the summaries of all mempool entries, sorted by txid. It is
+ * shared by everyone reading it, and only built again once the mempool or the chain height
+ * changed, so exporting the mempool holds its lock only for copying the summaries.
+ */
+struct TxMempoolSnapshot
+{
+    unsigned int nTransactionsUpdated;
+    int nChainHeight;
+    std::vector<TxMempoolEntrySummary> vEntries;
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -435,6 +518,10 @@ private:
     unsigned int nTransactionsUpdated;
     CBlockPolicyEstimator* minerPolicyEstimator;
 
+    mutable uint64_t nEpoch;   //!< SolarCoin: the current or last mempool walk, see Visited()
+    mutable bool fHaveEpoch;   //!< SolarCoin: whether a walk is in progress
+    mutable std::shared_ptr<const TxMempoolSnapshot> snapshot; //!< SolarCoin: see GetSnapshot()
+    unsigned int nPriorityHeight; //!< SolarCoin: the height the priority index is keyed at, see UpdatePriorityHeight()
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
@@ -476,6 +563,17 @@ public:
                 boost::multi_index::tag<ancestor_score>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
+            >,
+            // SolarCoin: sorted by the transaction's own nTime, for PoST block templates
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<tx_time>,
+                mempoolentry_txtime
+            >,
+            // SolarCoin: sorted by coin age priority, for the priority part of block templates
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<priority_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByPriority
             >
         >
     > indexed_transaction_set;
@@ -493,14 +591,66 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    /** SolarCoin: The in-mempool parents or children of an entry, kept sorted in a prevector.
+     *  Nearly every entry has at most two, which then need no allocation of their own. */
+    class linkEntries
+    {
+    public:
+        typedef prevector<2, txiter>::const_iterator const_iterator;
+        typedef const_iterator iterator;
+
+        const_iterator begin() const { return v.begin(); }
+        const_iterator end() const { return v.end(); }
+        size_t size() const { return v.size(); }
+        bool empty() const { return v.empty(); }
+        size_t count(txiter it) const;
+        /** Returns whether it was not present yet */
+        bool insert(txiter it);
+        /** Returns the number of entries removed */
+        size_t erase(txiter it);
+        size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(v); }
+
+    private:
+        prevector<2, txiter> v;
+    };
+
+    const linkEntries & GetMemPoolParents(txiter entry) const;
+    const linkEntries & GetMemPoolChildren(txiter entry) const;
+
+    /**
+     * SolarCoin: A walk over the mempool graph marks the entries it reached with its epoch instead
+     * of collecting them in a set, so it needs no allocations for them. Each walk holds an
+     * EpochGuard for a fresh epoch; walks may not nest. Requires cs.
+     */
+    class EpochGuard
+    {
+    public:
+        EpochGuard(const CTxMemPool& poolIn) : pool(poolIn)
+        {
+            assert(!pool.fHaveEpoch);
+            pool.fHaveEpoch = true;
+            ++pool.nEpoch;
+        }
+        ~EpochGuard() { pool.fHaveEpoch = false; }
+
+    private:
+        const CTxMemPool& pool;
+    };
+    /** SolarCoin: Mark it reached by the current walk; returns whether it was already */
+    bool Visited(txiter it) const
+    {
+        assert(fHaveEpoch);
+        if (it->nEpochMarker == nEpoch)
+            return true;
+        it->nEpochMarker = nEpoch;
+        return false;
+    }
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        linkEntries parents;
+        linkEntries children;
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
@@ -545,7 +695,9 @@ public:
     void _clear(); //lock free
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
     void queryHashes(std::vector<uint256>& vtxid);
-    void pruneSpent(const uint256& hash, CCoins &coins);
+    /** SolarCoin: the hashes of all transactions in no particular order, which skips the sort of queryHashes */
+    void queryHashesUnsorted(std::vector<uint256>& vtxid) const;
+    bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
     /**
@@ -558,6 +710,12 @@ public:
     void PrioritiseTransaction(const uint256 hash, const std::string strHash, double dPriorityDelta, const CAmount& nFeeDelta);
     void ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount &nFeeDelta) const;
     void ClearPrioritisation(const uint256 hash);
+    /**
+     * SolarCoin: Key the priority index by the priority at nHeight. Priorities grow linearly with
+     * the height at different rates, so their order only holds for one height: the entries are
+     * keyed again once per height the block templates are built for, not once per template.
+     */
+    void UpdatePriorityHeight(unsigned int nHeight);
 
 public:
     /** Remove a set of transactions from the mempool.
@@ -596,6 +754,13 @@ public:
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
     void CalculateDescendants(txiter it, setEntries &setDescendants);
+    /** SolarCoin: Append all in-mempool descendants of it, without it, to vDescendants, each once.
+     *  Parents come before their children. */
+    void CalculateDescendants(txiter it, std::vector<txiter> &vDescendants);
+    /** SolarCoin: Populate setNewer with the entries whose transaction time is after nTime, and
+     *  their descendants: a block of that time cannot include any of them.
+     *  Assumes cs is held. */
+    void CalculateNewerThan(unsigned int nTime, setEntries &setNewer);
 
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
@@ -609,7 +774,7 @@ public:
       *  pvNoSpendsRemaining, if set, will be populated with the list of transactions
       *  which are not in mempool which no longer have any spends in this mempool.
       */
-    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining=NULL);
+    void TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining=NULL);
 
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -634,10 +799,23 @@ public:
         LOCK(cs);
         return (mapTx.count(hash) != 0);
     }
+    bool exists(const COutPoint& outpoint) const
+    {
+        LOCK(cs);
+        auto it = mapTx.find(outpoint.hash);
+        return (it != mapTx.end() && outpoint.n < it->GetTx().vout.size());
+    }
 
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** SolarCoin: info() of those of the hashes still in the pool, in the order of infoAll(), under a single lock. */
+    std::vector<TxMempoolInfo> infoSorted(const std::vector<uint256>& hashes) const;
+
+    /** SolarCoin: the summary of an entry; requires cs */
+    TxMempoolEntrySummary GetEntrySummary(txiter it, int nChainHeight) const;
+    /** SolarCoin: the summaries of all entries, built again only if stale; see TxMempoolSnapshot */
+    std::shared_ptr<const TxMempoolSnapshot> GetSnapshot(int nChainHeight) const;
 
     /** Estimate fee rate needed to get into the next nBlocks
      *  If no answer can be given at nBlocks, return an estimate
@@ -657,6 +835,9 @@ public:
     /** Estimate priority needed to get into the next nBlocks */
     double estimatePriority(int nBlocks) const;
     
+    /** SolarCoin: apply the fee estimator events queued since the last call */
+    void ProcessFeeEstimates();
+
     /** Write/Read estimates to disk */
     bool WriteFeeEstimates(CAutoFile& fileout) const;
     bool ReadFeeEstimates(CAutoFile& filein);
@@ -716,8 +897,8 @@ protected:
 
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn);
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
 };
 
 // We want to sort transactions by coin age priority
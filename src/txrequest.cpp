@@ -0,0 +1,170 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrequest.h"
+
+#include <assert.h>
+
+#include <boost/tuple/tuple.hpp>
+
+CTxRequestTracker::AnnouncementSet::index<CTxRequestTracker::by_txid>::type::iterator CTxRequestTracker::Find(NodeId peer, const uint256& txid)
+{
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    AnnouncementSet::index<by_txid>::type::iterator it = index.lower_bound(boost::make_tuple(txid));
+    for (; it != index.end() && it->txid == txid; it++) {
+        if (it->peer == peer)
+            return it;
+    }
+    return index.end();
+}
+
+void CTxRequestTracker::Complete(AnnouncementSet::index<by_txid>::type::iterator it)
+{
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    if (it->state == COMPLETED)
+        return;
+    std::map<NodeId, PeerCounts>::iterator itCounts = mapPeerCounts.find(it->peer);
+    assert(itCounts != mapPeerCounts.end());
+    itCounts->second.nTracked--;
+    if (it->state == REQUESTED)
+        itCounts->second.nInFlight--;
+    if (itCounts->second.nTracked == 0)
+        mapPeerCounts.erase(itCounts);
+
+    const uint256 txid = it->txid;
+    index.modify(it, [](Announcement& ann) { ann.state = COMPLETED; });
+
+    // Once no peer is left to ask, the completed announcements are of no use either
+    AnnouncementSet::index<by_txid>::type::iterator first = index.lower_bound(boost::make_tuple(txid));
+    if (first->state == COMPLETED)
+        index.erase(first, index.upper_bound(boost::make_tuple(txid)));
+}
+
+void CTxRequestTracker::ExpireRequests(int64_t nNow)
+{
+    AnnouncementSet::index<by_time>::type& index = setAnnouncements.get<by_time>();
+    while (true) {
+        AnnouncementSet::index<by_time>::type::iterator it = index.lower_bound(boost::make_tuple(REQUESTED));
+        if (it == index.end() || it->state != REQUESTED || it->nTime > nNow)
+            break;
+        Complete(setAnnouncements.project<by_txid>(it));
+    }
+}
+
+void CTxRequestTracker::ReceivedInv(NodeId peer, const uint256& txid, bool fPreferred, int64_t nNow)
+{
+    PeerCounts& counts = mapPeerCounts[peer];
+    if (counts.nTracked >= MAX_PEER_TX_ANNOUNCEMENTS || Find(peer, txid) != setAnnouncements.get<by_txid>().end()) {
+        if (counts.nTracked == 0)
+            mapPeerCounts.erase(peer);
+        return;
+    }
+
+    Announcement ann;
+    ann.txid = txid;
+    ann.peer = peer;
+    ann.nTime = fPreferred ? nNow : nNow + NONPREF_PEER_TX_DELAY;
+    ann.nSequence = nSequence++;
+    ann.fPreferred = fPreferred;
+    ann.state = CANDIDATE;
+    setAnnouncements.insert(ann);
+    counts.nTracked++;
+}
+
+std::vector<uint256> CTxRequestTracker::GetRequestable(NodeId peer, int64_t nNow)
+{
+    ExpireRequests(nNow);
+
+    std::vector<uint256> vRequest;
+    std::map<NodeId, PeerCounts>::iterator itCounts = mapPeerCounts.find(peer);
+    if (itCounts == mapPeerCounts.end())
+        return vRequest;
+
+    // The candidates of this peer that are due, oldest first
+    std::vector<uint256> vDue;
+    AnnouncementSet::index<by_peer>::type& indexPeer = setAnnouncements.get<by_peer>();
+    AnnouncementSet::index<by_peer>::type::iterator it = indexPeer.lower_bound(boost::make_tuple(peer, CANDIDATE));
+    AnnouncementSet::index<by_peer>::type::iterator itEnd = indexPeer.upper_bound(boost::make_tuple(peer, CANDIDATE, nNow));
+    for (; it != itEnd; it++)
+        vDue.push_back(it->txid);
+
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    for (const uint256& txid : vDue) {
+        if (itCounts->second.nInFlight >= MAX_PEER_TX_IN_FLIGHT)
+            break;
+        // Another peer is being asked already
+        AnnouncementSet::index<by_txid>::type::iterator itReq = index.lower_bound(boost::make_tuple(txid, REQUESTED));
+        if (itReq != index.end() && itReq->txid == txid && itReq->state == REQUESTED)
+            continue;
+        // The best due candidate: the first of the preferred ones, else the first of the others
+        AnnouncementSet::index<by_txid>::type::iterator itBest = index.lower_bound(boost::make_tuple(txid, CANDIDATE, false));
+        if (itBest == index.end() || itBest->txid != txid || itBest->state != CANDIDATE || itBest->nTime > nNow)
+            itBest = index.lower_bound(boost::make_tuple(txid, CANDIDATE, true));
+        if (itBest == index.end() || itBest->txid != txid || itBest->state != CANDIDATE || itBest->peer != peer)
+            continue;
+        index.modify(itBest, [nNow](Announcement& ann) {
+            ann.state = REQUESTED;
+            ann.nTime = nNow + TX_REQUEST_TIMEOUT;
+        });
+        itCounts->second.nInFlight++;
+        vRequest.push_back(txid);
+    }
+    return vRequest;
+}
+
+void CTxRequestTracker::ReceivedResponse(NodeId peer, const uint256& txid)
+{
+    AnnouncementSet::index<by_txid>::type::iterator it = Find(peer, txid);
+    if (it != setAnnouncements.get<by_txid>().end())
+        Complete(it);
+}
+
+void CTxRequestTracker::ForgetTxHash(const uint256& txid)
+{
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    AnnouncementSet::index<by_txid>::type::iterator it = index.lower_bound(boost::make_tuple(txid));
+    AnnouncementSet::index<by_txid>::type::iterator itEnd = index.upper_bound(boost::make_tuple(txid));
+    for (AnnouncementSet::index<by_txid>::type::iterator itAnn = it; itAnn != itEnd; itAnn++) {
+        if (itAnn->state == COMPLETED)
+            continue;
+        std::map<NodeId, PeerCounts>::iterator itCounts = mapPeerCounts.find(itAnn->peer);
+        assert(itCounts != mapPeerCounts.end());
+        itCounts->second.nTracked--;
+        if (itAnn->state == REQUESTED)
+            itCounts->second.nInFlight--;
+        if (itCounts->second.nTracked == 0)
+            mapPeerCounts.erase(itCounts);
+    }
+    index.erase(it, itEnd);
+}
+
+void CTxRequestTracker::DisconnectedPeer(NodeId peer)
+{
+    AnnouncementSet::index<by_peer>::type& indexPeer = setAnnouncements.get<by_peer>();
+    while (true) {
+        AnnouncementSet::index<by_peer>::type::iterator it = indexPeer.lower_bound(boost::make_tuple(peer));
+        if (it == indexPeer.end() || it->peer != peer)
+            break;
+        AnnouncementSet::index<by_txid>::type::iterator itTxid = setAnnouncements.project<by_txid>(it);
+        if (it->state == COMPLETED) {
+            setAnnouncements.get<by_txid>().erase(itTxid);
+        } else {
+            // Completing it lets the next peer be asked, or drops the txid with its last peer
+            Complete(itTxid);
+        }
+    }
+    mapPeerCounts.erase(peer);
+}
+
+size_t CTxRequestTracker::CountTracked(NodeId peer) const
+{
+    std::map<NodeId, PeerCounts>::const_iterator it = mapPeerCounts.find(peer);
+    return it == mapPeerCounts.end() ? 0 : it->second.nTracked;
+}
+
+size_t CTxRequestTracker::CountInFlight(NodeId peer) const
+{
+    std::map<NodeId, PeerCounts>::const_iterator it = mapPeerCounts.find(peer);
+    return it == mapPeerCounts.end() ? 0 : it->second.nInFlight;
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXREQUEST_H
+#define BITCOIN_TXREQUEST_H
+
+#include "net.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include "boost/multi_index_container.hpp"
+#include "boost/multi_index/composite_key.hpp"
+#include "boost/multi_index/mem_fun.hpp"
+#include "boost/multi_index/member.hpp"
+#include "boost/multi_index/ordered_index.hpp"
+
+/** Delay before a transaction announced by a non-preferred (inbound) peer may be requested from it, in microseconds */
+static const int64_t NONPREF_PEER_TX_DELAY = 2 * 1000000;
+/** Time a peer gets to answer a transaction request before another peer is asked, in microseconds */
+static const int64_t TX_REQUEST_TIMEOUT = 2 * 60 * 1000000;
+/** Maximum number of transaction announcements tracked per peer */
+static const size_t MAX_PEER_TX_ANNOUNCEMENTS = 2 * MAX_INV_SZ;
+/** Maximum number of transactions requested from one peer at a time */
+static const size_t MAX_PEER_TX_IN_FLIGHT = 100;
+
+/**
+ * SolarCoin: Tracks the transactions announced by peers and which of them are requested from
+ * which peer. It replaces the per-node mapAskFor/setAskFor queues and the global
+ * mapAlreadyAskedFor.
+ *
+ * Every (txid, peer) announcement is a candidate, in flight, or completed (answered, timed out or
+ * reported not found). A transaction is in flight from at most one peer at a time; when that
+ * request completes without the transaction, the best remaining candidate is asked: preferred
+ * (outbound or whitelisted) peers first, then the earliest announcement. A peer is never asked
+ * twice for the same transaction. The announcements are indexed by txid, by peer and by expiry,
+ * so every operation costs O(log n) per announcement it touches. Guarded by cs_main.
+ */
+class CTxRequestTracker
+{
+public:
+    CTxRequestTracker() : nSequence(0) {}
+
+    /**
+     * Peer announced txid. It can be requested from the peer from nNow on (later for a peer that
+     * is not preferred), unless the peer announced it before or announced too many already.
+     */
+    void ReceivedInv(NodeId peer, const uint256& txid, bool fPreferred, int64_t nNow);
+
+    /**
+     * The transactions to request from peer now, in announcement order; they are marked in
+     * flight. Requests that expired by nNow are completed first, for every peer.
+     */
+    std::vector<uint256> GetRequestable(NodeId peer, int64_t nNow);
+
+    /** Peer answered for txid, with the transaction or notfound. */
+    void ReceivedResponse(NodeId peer, const uint256& txid);
+
+    /** Forget every announcement of txid, once it is no longer needed. */
+    void ForgetTxHash(const uint256& txid);
+
+    /** Forget every announcement of peer. */
+    void DisconnectedPeer(NodeId peer);
+
+    /** The number of announcements of peer that are not completed, and of those in flight. */
+    size_t CountTracked(NodeId peer) const;
+    size_t CountInFlight(NodeId peer) const;
+    /** The number of announcements, of all states. */
+    size_t Size() const { return setAnnouncements.size(); }
+
+private:
+    enum State {
+        CANDIDATE,
+        REQUESTED,
+        COMPLETED,
+    };
+
+    struct Announcement
+    {
+        uint256 txid;
+        NodeId peer;
+        int64_t nTime;      //!< candidate: when it may be requested; requested: when the request expires
+        uint64_t nSequence; //!< order of announcement, to break ties
+        bool fPreferred;
+        State state;
+
+        bool IsNotPreferred() const { return !fPreferred; }
+    };
+
+    struct by_txid {};
+    struct by_peer {};
+    struct by_time {};
+
+    typedef boost::multi_index_container<
+        Announcement,
+        boost::multi_index::indexed_by<
+            // the announcements of a txid in state order, and candidates best first
+            boost::multi_index::ordered_unique<
+                boost::multi_index::tag<by_txid>,
+                boost::multi_index::composite_key<
+                    Announcement,
+                    boost::multi_index::member<Announcement, uint256, &Announcement::txid>,
+                    boost::multi_index::member<Announcement, State, &Announcement::state>,
+                    boost::multi_index::const_mem_fun<Announcement, bool, &Announcement::IsNotPreferred>,
+                    boost::multi_index::member<Announcement, int64_t, &Announcement::nTime>,
+                    boost::multi_index::member<Announcement, uint64_t, &Announcement::nSequence>
+                >
+            >,
+            // the announcements of a peer, per state in time order
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<by_peer>,
+                boost::multi_index::composite_key<
+                    Announcement,
+                    boost::multi_index::member<Announcement, NodeId, &Announcement::peer>,
+                    boost::multi_index::member<Announcement, State, &Announcement::state>,
+                    boost::multi_index::member<Announcement, int64_t, &Announcement::nTime>
+                >
+            >,
+            // all announcements per state in time order, for the expiry of requests
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<by_time>,
+                boost::multi_index::composite_key<
+                    Announcement,
+                    boost::multi_index::member<Announcement, State, &Announcement::state>,
+                    boost::multi_index::member<Announcement, int64_t, &Announcement::nTime>
+                >
+            >
+        >
+    > AnnouncementSet;
+
+    struct PeerCounts
+    {
+        size_t nTracked = 0;  //!< candidates and requests
+        size_t nInFlight = 0; //!< requests
+    };
+
+    AnnouncementSet setAnnouncements;
+    std::map<NodeId, PeerCounts> mapPeerCounts;
+    uint64_t nSequence;
+
+    AnnouncementSet::index<by_txid>::type::iterator Find(NodeId peer, const uint256& txid);
+    void Complete(AnnouncementSet::index<by_txid>::type::iterator it);
+    void ExpireRequests(int64_t nNow);
+};
+
+#endif // BITCOIN_TXREQUEST_H
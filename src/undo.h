@@ -6,73 +6,174 @@
 #ifndef BITCOIN_UNDO_H
 #define BITCOIN_UNDO_H
 
+#include "coins.h"
 #include "compressor.h" 
+#include "consensus/consensus.h"
 #include "primitives/transaction.h"
 #include "serialize.h"
+#include "version.h"
+
+/** SolarCoin: First byte of the undo data of a block written with an undo format version. Older
+ *  versions started with the CompactSize number of transactions, which never begins with 0xff. */
+static const unsigned char BLOCK_UNDO_FORMAT_MARKER = 0xff;
+/** Undo format with the coin's SolarCoin metadata in each CTxIn undo record */
+static const unsigned int BLOCK_UNDO_FORMAT_METADATA = 1;
+
+/** Flag of a CTxIn undo record with metadata: the coin belongs to a coinstake */
+static const unsigned int TXIN_UNDO_COINSTAKE = 1 << 0;
 
 /** Undo information for a CTxIn
  *
- *  Contains the prevout's CTxOut being spent, and if this was the
- *  last output of the affected transaction, its metadata as well
- *  (coinbase or not, height, transaction version)
+ *  Contains the prevout's CTxOut being spent, and its metadata as well
+ *  (coinbase and coinstake or not, height, transaction nTime, block time and offset).
+ *  The coinstake flag is stored where older versions stored the transaction version,
+ *  followed by the nTime, the block time and the transaction offset.
+ *
+ *  Records written by older versions, in undo data without BLOCK_UNDO_FORMAT_MARKER, only
+ *  carry the metadata if the outpoint was the last unspent output of its transaction
+ *  (nHeight is 0 otherwise), and never the coinstake flag or nTime.
  */
-class CTxInUndo
+class TxInUndoSerializer
 {
-public:
-    CTxOut txout;         // the txout data before being spent
-    bool fCoinBase;       // if the outpoint was the last unspent: whether it belonged to a coinbase
-    unsigned int nHeight; // if the outpoint was the last unspent: its height
-    int nVersion;         // if the outpoint was the last unspent: its version
-
-    CTxInUndo() : txout(), fCoinBase(false), nHeight(0), nVersion(0) {}
-    CTxInUndo(const CTxOut &txoutIn, bool fCoinBaseIn = false, unsigned int nHeightIn = 0, int nVersionIn = 0) : txout(txoutIn), fCoinBase(fCoinBaseIn), nHeight(nHeightIn), nVersion(nVersionIn) { }
+    const Coin* txout;
 
+public:
     template<typename Stream>
     void Serialize(Stream &s) const {
-        ::Serialize(s, VARINT(nHeight*2+(fCoinBase ? 1 : 0)));
-        if (nHeight > 0)
-            ::Serialize(s, VARINT(this->nVersion));
-        ::Serialize(s, CTxOutCompressor(REF(txout)));
+        ::Serialize(s, VARINT(txout->nHeight * 2 + (txout->fCoinBase ? 1 : 0)));
+        if (txout->nHeight > 0) {
+            // Where older versions stored the transaction version
+            unsigned int nFlags = txout->fCoinStake ? TXIN_UNDO_COINSTAKE : 0;
+            ::Serialize(s, VARINT(nFlags));
+            ::Serialize(s, txout->nTime);
+            ::Serialize(s, txout->nBlockTime);
+            ::Serialize(s, VARINT(txout->nTxOffset));
+        }
+        ::Serialize(s, CTxOutCompressor(REF(txout->out)));
     }
 
+    TxInUndoSerializer(const Coin* coin) : txout(coin) {}
+};
+
+class TxInUndoDeserializer
+{
+    Coin* txout;
+    //! Whether the record was written with BLOCK_UNDO_FORMAT_METADATA
+    bool fMetadata;
+
+public:
     template<typename Stream>
     void Unserialize(Stream &s) {
         unsigned int nCode = 0;
         ::Unserialize(s, VARINT(nCode));
-        nHeight = nCode / 2;
-        fCoinBase = nCode & 1;
-        if (nHeight > 0)
-            ::Unserialize(s, VARINT(this->nVersion));
-        ::Unserialize(s, REF(CTxOutCompressor(REF(txout))));
+        txout->nHeight = nCode / 2;
+        txout->fCoinBase = nCode & 1;
+        txout->fCoinStake = false;
+        txout->nTime = 0;
+        txout->nBlockTime = 0;
+        txout->nTxOffset = 0;
+        if (txout->nHeight > 0) {
+            // Old versions stored the version number for the last spend of
+            // a transaction's outputs. Non-final spends were indicated with
+            // height = 0.
+            unsigned int nFlags;
+            ::Unserialize(s, VARINT(nFlags));
+            if (fMetadata) {
+                txout->fCoinStake = (nFlags & TXIN_UNDO_COINSTAKE) != 0;
+                ::Unserialize(s, txout->nTime);
+                ::Unserialize(s, txout->nBlockTime);
+                ::Unserialize(s, VARINT(txout->nTxOffset));
+            }
+        }
+        ::Unserialize(s, REF(CTxOutCompressor(REF(txout->out))));
     }
+
+    TxInUndoDeserializer(Coin* coin, bool fMetadataIn = true) : txout(coin), fMetadata(fMetadataIn) {}
 };
 
+static const size_t MIN_TRANSACTION_INPUT_WEIGHT = WITNESS_SCALE_FACTOR * ::GetSerializeSize(CTxIn(), SER_NETWORK, PROTOCOL_VERSION);
+static const size_t MAX_INPUTS_PER_BLOCK = MAX_BLOCK_WEIGHT / MIN_TRANSACTION_INPUT_WEIGHT;
+
 /** Undo information for a CTransaction */
 class CTxUndo
 {
 public:
     // undo information for all txins
-    std::vector<CTxInUndo> vprevout;
+    std::vector<Coin> vprevout;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        // TODO: avoid reimplementing vector serializer
+        uint64_t count = vprevout.size();
+        ::Serialize(s, COMPACTSIZE(REF(count)));
+        for (const auto& prevout : vprevout) {
+            ::Serialize(s, REF(TxInUndoSerializer(&prevout)));
+        }
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(vprevout);
+    /** fMetadata: whether the records were written with BLOCK_UNDO_FORMAT_METADATA */
+    template <typename Stream>
+    void Unserialize(Stream& s, bool fMetadata = true) {
+        // TODO: avoid reimplementing vector deserializer
+        uint64_t count = 0;
+        ::Unserialize(s, COMPACTSIZE(count));
+        if (count > MAX_INPUTS_PER_BLOCK) {
+            throw std::ios_base::failure("Too many input undo records");
+        }
+        vprevout.resize(count);
+        for (auto& prevout : vprevout) {
+            ::Unserialize(s, REF(TxInUndoDeserializer(&prevout, fMetadata)));
+        }
     }
 };
 
-/** Undo information for a CBlock */
+/** Undo information for a CBlock
+ *
+ *  SolarCoin: Serialized as BLOCK_UNDO_FORMAT_MARKER, VARINT(format) and the CTxUndo
+ *  vector; older versions wrote just the vector.
+ */
 class CBlockUndo
 {
 public:
     std::vector<CTxUndo> vtxundo; // for all but the coinbase
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        unsigned int nFormat = BLOCK_UNDO_FORMAT_METADATA;
+        ::Serialize(s, BLOCK_UNDO_FORMAT_MARKER);
+        ::Serialize(s, VARINT(nFormat));
+        ::Serialize(s, vtxundo);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(vtxundo);
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        // The marker takes the place of the first byte of the CompactSize size of the vector
+        unsigned char chFirst;
+        ::Unserialize(s, chFirst);
+        uint64_t count;
+        bool fMetadata = chFirst == BLOCK_UNDO_FORMAT_MARKER;
+        if (fMetadata) {
+            unsigned int nFormat = 0;
+            ::Unserialize(s, VARINT(nFormat));
+            if (nFormat != BLOCK_UNDO_FORMAT_METADATA)
+                throw std::ios_base::failure("Unknown block undo format");
+            count = ReadCompactSize(s);
+        } else if (chFirst < 253) {
+            count = chFirst;
+        } else if (chFirst == 253) {
+            count = ser_readdata16(s);
+            if (count < 253)
+                throw std::ios_base::failure("non-canonical ReadCompactSize()");
+        } else {
+            count = ser_readdata32(s);
+            if (count < 0x10000u)
+                throw std::ios_base::failure("non-canonical ReadCompactSize()");
+        }
+        if (count > MAX_INPUTS_PER_BLOCK)
+            throw std::ios_base::failure("Too many transaction undo records");
+        vtxundo.resize(count);
+        for (auto& txundo : vtxundo)
+            txundo.Unserialize(s, fMetadata);
     }
 };
 
@@ -47,6 +47,10 @@ public:
         std::string s(val_);
         setStr(s);
     }
+    UniValue(const UniValue&) = default;
+    UniValue(UniValue&&) = default;
+    UniValue& operator=(const UniValue&) = default;
+    UniValue& operator=(UniValue&&) = default;
     ~UniValue() {}
 
     void clear();
@@ -84,6 +88,7 @@ public:
     bool isObject() const { return (typ == VOBJ); }
 
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_back(const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return push_back(tmpVal);
@@ -95,6 +100,7 @@ public:
     bool push_backV(const std::vector<UniValue>& vec);
 
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return pushKV(key, tmpVal);
@@ -120,6 +126,11 @@ public:
         return pushKV(key, tmpVal);
     }
     bool pushKVs(const UniValue& obj);
+    // Append a key the caller knows is not in the object yet; no lookup is done
+    bool pushKVEnd(const std::string& key, const UniValue& val) { return pushKV(key, val); }
+    bool pushKVEnd(const std::string& key, UniValue&& val) { return pushKV(key, std::move(val)); }
+    // Make room for n elements of an array or object
+    void reserve(size_t n);
 
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
@@ -154,7 +165,11 @@ public:
 
     enum VType type() const { return getType(); }
     bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
+        if (typ != VOBJ)
+            return false;
+        keys.push_back(std::move(pear.first));
+        values.push_back(std::move(pear.second));
+        return true;
     }
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 };
@@ -119,22 +119,36 @@ bool UniValue::setNumStr(const string& val_)
     return true;
 }
 
-bool UniValue::setInt(uint64_t val_)
+// Format the digits of an integer without a stream; they need no validation
+static void formatInt(uint64_t n, bool fNegative, std::string& out)
 {
-    ostringstream oss;
-
-    oss << val_;
+    char buf[21];
+    char *end = buf + sizeof(buf);
+    char *p = end;
+    do {
+        *--p = '0' + (n % 10);
+        n /= 10;
+    } while (n);
+    if (fNegative)
+        *--p = '-';
+    out.assign(p, end);
+}
 
-    return setNumStr(oss.str());
+bool UniValue::setInt(uint64_t val_)
+{
+    clear();
+    typ = VNUM;
+    formatInt(val_, false, val);
+    return true;
 }
 
 bool UniValue::setInt(int64_t val_)
 {
-    ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    bool fNegative = val_ < 0;
+    formatInt(fNegative ? -(uint64_t)val_ : (uint64_t)val_, fNegative, val);
+    return true;
 }
 
 bool UniValue::setFloat(double val_)
@@ -179,6 +193,15 @@ bool UniValue::push_back(const UniValue& val_)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val_)
+{
+    if (typ != VARR)
+        return false;
+
+    values.push_back(std::move(val_));
+    return true;
+}
+
 bool UniValue::push_backV(const std::vector<UniValue>& vec)
 {
     if (typ != VARR)
@@ -199,6 +222,23 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val_)
     return true;
 }
 
+bool UniValue::pushKV(const std::string& key, UniValue&& val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    keys.push_back(key);
+    values.push_back(std::move(val_));
+    return true;
+}
+
+void UniValue::reserve(size_t n)
+{
+    if (typ == VOBJ)
+        keys.reserve(n);
+    values.reserve(n);
+}
+
 bool UniValue::pushKVs(const UniValue& obj)
 {
     if (typ != VOBJ || obj.typ != VOBJ)
@@ -76,6 +76,10 @@
 #include <malloc.h>
 #endif
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
@@ -120,6 +124,7 @@ bool fPrintToDebugLog = true;
 
 bool fLogTimestamps = DEFAULT_LOGTIMESTAMPS;
 bool fLogTimeMicros = DEFAULT_LOGTIMEMICROS;
+bool fLogJson = false;
 bool fLogIPs = DEFAULT_LOGIPS;
 std::atomic<bool> fReopenDebugLog(false);
 CTranslationInterface translationInterface;
@@ -235,6 +240,17 @@ void OpenDebugLog()
     vMsgsBeforeOpenLog = NULL;
 }
 
+namespace {
+/** SolarCoin: The -debug categories of a thread, and whether they include all of them */
+struct CLogCategories
+{
+    std::set<std::string> setCategories;
+    bool fAll;
+
+    CLogCategories() : fAll(false) {}
+};
+} // anon namespace
+
 bool LogAcceptCategory(const char* category)
 {
     if (category != NULL)
@@ -246,22 +262,21 @@ bool LogAcceptCategory(const char* category)
         // This helps prevent issues debugging global destructors,
         // where mapMultiArgs might be deleted before another
         // global destructor calls LogPrint()
-        static boost::thread_specific_ptr<set<string> > ptrCategory;
+        static boost::thread_specific_ptr<CLogCategories> ptrCategory;
         if (ptrCategory.get() == NULL)
         {
+            ptrCategory.reset(new CLogCategories());
             if (mapMultiArgs.count("-debug")) {
                 const vector<string>& categories = mapMultiArgs.at("-debug");
-                ptrCategory.reset(new set<string>(categories.begin(), categories.end()));
-                // thread_specific_ptr automatically deletes the set when the thread ends.
-            } else
-                ptrCategory.reset(new set<string>());
+                ptrCategory->setCategories.insert(categories.begin(), categories.end());
+                ptrCategory->fAll = ptrCategory->setCategories.count("") || ptrCategory->setCategories.count("1");
+            }
+            // thread_specific_ptr automatically deletes the set when the thread ends.
         }
-        const set<string>& setCategories = *ptrCategory.get();
+        const CLogCategories& categories = *ptrCategory.get();
 
         // if not debugging everything and not debugging specific category, LogPrint does nothing.
-        if (setCategories.count(string("")) == 0 &&
-            setCategories.count(string("1")) == 0 &&
-            setCategories.count(string(category)) == 0)
+        if (!categories.fAll && categories.setCategories.count(category) == 0)
             return false;
     }
     return true;
@@ -272,7 +287,7 @@ bool LogAcceptCategory(const char* category)
  * suppress printing of the timestamp when multiple calls are made that don't
  * end in a newline. Initialize it to true, and hold it, in the calling context.
  */
-static std::string LogTimestampStr(const std::string &str, std::atomic_bool *fStartedNewLine)
+static std::string LogTimestampStr(const std::string &str, int64_t nTimeMicros, std::atomic_bool *fStartedNewLine)
 {
     string strStamped;
 
@@ -280,7 +295,6 @@ static std::string LogTimestampStr(const std::string &str, std::atomic_bool *fSt
         return str;
 
     if (*fStartedNewLine) {
-        int64_t nTimeMicros = GetLogTimeMicros();
         strStamped = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros/1000000);
         if (fLogTimeMicros)
             strStamped += strprintf(".%06d", nTimeMicros%1000000);
@@ -296,17 +310,48 @@ static std::string LogTimestampStr(const std::string &str, std::atomic_bool *fSt
     return strStamped;
 }
 
-int LogPrintStr(const std::string &str)
+/** SolarCoin: A log message as a line of JSON, for -logformat=json */
+static std::string LogJsonStr(const std::string &str, const char* category, int64_t nTimeMicros)
 {
-    int ret = 0; // Returns total number of characters written
-    static std::atomic_bool fStartedNewLine(true);
+    std::string strJson = strprintf("{\"time\":\"%sT%s.%06dZ\"", DateTimeStrFormat("%Y-%m-%d", nTimeMicros/1000000),
+        DateTimeStrFormat("%H:%M:%S", nTimeMicros/1000000), nTimeMicros%1000000);
+    if (category)
+        strJson += strprintf(",\"category\":\"%s\"", category);
+    strJson += ",\"message\":\"";
+    size_t nEnd = str.size();
+    while (nEnd > 0 && str[nEnd - 1] == '\n')
+        nEnd--;
+    for (size_t i = 0; i < nEnd; i++) {
+        unsigned char ch = str[i];
+        if (ch == '"' || ch == '\\')
+            strJson += '\\';
+        if (ch < 0x20)
+            strJson += strprintf("\\u%04x", ch);
+        else
+            strJson += ch;
+    }
+    strJson += "\"}\n";
+    return strJson;
+}
 
-    string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
+static std::atomic_bool fLogStartedNewLine(true);
+
+static std::string LogFormatStr(const std::string &str, const char* category, int64_t nTimeMicros)
+{
+    if (fLogJson)
+        return LogJsonStr(str, category, nTimeMicros);
+    return LogTimestampStr(str, nTimeMicros, &fLogStartedNewLine);
+}
+
+/** Write a formatted log message to the console or debug.log */
+static int LogWriteStr(const std::string &strFormatted)
+{
+    int ret = 0; // Returns total number of characters written
 
     if (fPrintToConsole)
     {
         // print to console
-        ret = fwrite(strTimestamped.data(), 1, strTimestamped.size(), stdout);
+        ret = fwrite(strFormatted.data(), 1, strFormatted.size(), stdout);
         fflush(stdout);
     }
     else if (fPrintToDebugLog)
@@ -317,8 +362,8 @@ int LogPrintStr(const std::string &str)
         // buffer if we haven't opened the log yet
         if (fileout == NULL) {
             assert(vMsgsBeforeOpenLog);
-            ret = strTimestamped.length();
-            vMsgsBeforeOpenLog->push_back(strTimestamped);
+            ret = strFormatted.length();
+            vMsgsBeforeOpenLog->push_back(strFormatted);
         }
         else
         {
@@ -330,12 +375,179 @@ int LogPrintStr(const std::string &str)
                     setbuf(fileout, NULL); // unbuffered
             }
 
-            ret = FileWriteStr(strTimestamped, fileout);
+            ret = FileWriteStr(strFormatted, fileout);
         }
     }
     return ret;
 }
 
+namespace {
+
+/** SolarCoin: A log message waiting for the log writer thread, formatted but not yet timestamped */
+struct CLogEntry
+{
+    std::string str;
+    const char* category;
+    int64_t nTimeMicros;
+};
+
+/**
+ * Bounded queue of log messages, pushed by any thread without a lock and popped by the log
+ * writer only. Each slot carries a sequence number telling whether it is free for the push of
+ * a given position, or holds the message of that position for the pop.
+ */
+class CLogQueue
+{
+private:
+    struct Slot
+    {
+        std::atomic<size_t> nSequence;
+        CLogEntry entry;
+    };
+
+    Slot vSlots[LOG_QUEUE_SIZE];
+    std::atomic<size_t> nPushPos;
+    size_t nPopPos; //!< log writer only
+
+public:
+    CLogQueue() : nPushPos(0), nPopPos(0)
+    {
+        static_assert((LOG_QUEUE_SIZE & (LOG_QUEUE_SIZE - 1)) == 0, "LOG_QUEUE_SIZE is a power of two");
+        for (size_t i = 0; i < LOG_QUEUE_SIZE; i++)
+            vSlots[i].nSequence.store(i, std::memory_order_relaxed);
+    }
+
+    /** Returns false, leaving entry untouched, if the queue is full */
+    bool Push(CLogEntry& entry)
+    {
+        size_t nPos = nPushPos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = vSlots[nPos & (LOG_QUEUE_SIZE - 1)];
+            intptr_t nDiff = (intptr_t)slot.nSequence.load(std::memory_order_acquire) - (intptr_t)nPos;
+            if (nDiff == 0) {
+                if (nPushPos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed)) {
+                    slot.entry = std::move(entry);
+                    slot.nSequence.store(nPos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (nDiff < 0) {
+                return false;
+            } else {
+                nPos = nPushPos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Returns false if the next message is not pushed yet */
+    bool Pop(CLogEntry& entry)
+    {
+        Slot& slot = vSlots[nPopPos & (LOG_QUEUE_SIZE - 1)];
+        if (slot.nSequence.load(std::memory_order_acquire) != nPopPos + 1)
+            return false;
+        entry = std::move(slot.entry);
+        slot.nSequence.store(nPopPos + LOG_QUEUE_SIZE, std::memory_order_release);
+        nPopPos++;
+        return true;
+    }
+
+    bool Empty() const
+    {
+        return vSlots[nPopPos & (LOG_QUEUE_SIZE - 1)].nSequence.load(std::memory_order_acquire) != nPopPos + 1;
+    }
+};
+
+//! Leaked like fileout, threads may log while the statics are destroyed, and a process exiting
+//! without StopAsyncLog() must not find the writer thread joinable
+CLogQueue* plogQueue = NULL;
+std::atomic<bool> fLogAsync(false);
+//! Threads between their check of fLogAsync and the push of their message
+std::atomic<int> nLogPushing(0);
+std::atomic<bool> fLogWriterWaiting(false);
+std::atomic<bool> fLogWriterStop(false);
+std::mutex csLogWriter;
+std::condition_variable condLogWriter;
+std::thread* pthreadLogWriter = NULL;
+
+void WakeLogWriter()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (fLogWriterWaiting.load(std::memory_order_seq_cst))
+        condLogWriter.notify_one();
+}
+
+void ThreadLogWriter()
+{
+    RenameThread("solarcoin-logwriter");
+    CLogEntry entry;
+    while (true) {
+        while (plogQueue->Pop(entry))
+            LogWriteStr(LogFormatStr(entry.str, entry.category, entry.nTimeMicros));
+        if (fLogWriterStop)
+            break;
+        std::unique_lock<std::mutex> lock(csLogWriter);
+        fLogWriterWaiting.store(true, std::memory_order_seq_cst);
+        // The timeout bounds the delay of a message whose wake-up crossed the wait
+        condLogWriter.wait_for(lock, std::chrono::milliseconds(100), [] { return fLogWriterStop || !plogQueue->Empty(); });
+        fLogWriterWaiting.store(false, std::memory_order_relaxed);
+    }
+}
+
+} // anon namespace
+
+int LogPrintStr(std::string str, const char* category)
+{
+    if (!fPrintToConsole && !fPrintToDebugLog)
+        return 0;
+    const int64_t nTimeMicros = GetLogTimeMicros();
+
+    if (fLogAsync.load(std::memory_order_relaxed)) {
+        nLogPushing++;
+        if (fLogAsync) {
+            int ret = str.size();
+            CLogEntry entry{std::move(str), category, nTimeMicros};
+            // A full queue holds the thread back until the writer catches up
+            while (!plogQueue->Push(entry)) {
+                WakeLogWriter();
+                std::this_thread::yield();
+            }
+            nLogPushing--;
+            WakeLogWriter();
+            return ret;
+        }
+        nLogPushing--;
+    }
+
+    return LogWriteStr(LogFormatStr(str, category, nTimeMicros));
+}
+
+void StartAsyncLog()
+{
+    if (fLogAsync)
+        return;
+    if (!plogQueue)
+        plogQueue = new CLogQueue();
+    fLogWriterStop = false;
+    pthreadLogWriter = new std::thread(&ThreadLogWriter);
+    fLogAsync = true;
+}
+
+void StopAsyncLog()
+{
+    if (!fLogAsync.exchange(false))
+        return;
+    // Messages being pushed still go to the writer, later ones are written by their thread
+    while (nLogPushing.load())
+        std::this_thread::yield();
+    {
+        std::lock_guard<std::mutex> lock(csLogWriter);
+        fLogWriterStop = true;
+    }
+    condLogWriter.notify_one();
+    pthreadLogWriter->join();
+    delete pthreadLogWriter;
+    pthreadLogWriter = NULL;
+}
+
 /** Interpret string as boolean, for argument parsing */
 static bool InterpretBool(const std::string& strValue)
 {
@@ -798,6 +1010,14 @@ void RenameThread(const char* name)
 #endif
 }
 
+void SetThreadLowPriority()
+{
+#ifdef __linux__
+    // PRIO_PROCESS with who 0 is the calling thread on Linux; threads it starts inherit the value
+    setpriority(PRIO_PROCESS, 0, 10);
+#endif
+}
+
 void SetupEnvironment()
 {
 #ifdef HAVE_MALLOPT_ARENA_MAX
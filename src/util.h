@@ -32,6 +32,10 @@
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+/** SolarCoin: -logasync default */
+static const bool DEFAULT_LOGASYNC      = false;
+/** Messages the asynchronous log holds for the writer thread, a power of two */
+static const size_t LOG_QUEUE_SIZE      = 4096;
 
 /** Signals for translation. */
 class CTranslationInterface
@@ -52,6 +56,8 @@ extern bool fPrintToDebugLog;
 
 extern bool fLogTimestamps;
 extern bool fLogTimeMicros;
+//! SolarCoin: One JSON object per message instead of timestamped text (-logformat=json)
+extern bool fLogJson;
 extern bool fLogIPs;
 extern std::atomic<bool> fReopenDebugLog;
 extern CTranslationInterface translationInterface;
@@ -74,12 +80,19 @@ bool SetupNetworking();
 
 /** Return true if log accepts specified category */
 bool LogAcceptCategory(const char* category);
-/** Send a string to the log output */
-int LogPrintStr(const std::string &str);
+/**
+ * Send a string to the log output. The category, if any, must outlive the process (a literal),
+ * as the asynchronous log writes it after the call returns.
+ */
+int LogPrintStr(std::string str, const char* category = NULL);
+/** SolarCoin: Hand the log output to a writer thread, so logging threads only queue their messages */
+void StartAsyncLog();
+/** Write the queued messages and go back to writing them on the logging threads */
+void StopAsyncLog();
 
 #define LogPrint(category, ...) do { \
     if (LogAcceptCategory((category))) { \
-        LogPrintStr(tfm::format(__VA_ARGS__)); \
+        LogPrintStr(tfm::format(__VA_ARGS__), (category)); \
     } \
 } while(0)
 
@@ -208,6 +221,8 @@ std::string HelpMessageOpt(const std::string& option, const std::string& message
 int GetNumCores();
 
 void RenameThread(const char* name);
+/** SolarCoin: Lower the scheduling priority of the calling thread, for background work. Only on Linux, which keeps the nice value per thread. */
+void SetThreadLowPriority();
 
 /**
  * .. and a wrapper that just calls func once
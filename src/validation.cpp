@@ -10,26 +10,39 @@
 #include "validation.h"
 #include "kernel.h"
 #include "arith_uint256.h"
+#include "blockindexsnapshot.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
 #include "hash.h"
 #include "init.h"
+#include "memusage.h"
+#include "metrics.h"
+#include "notify.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "profile.h"
+#include "pubkey.h"
 #include "random.h"
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "support/allocators/pool.h"
 #include "timedata.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txdb.h"
+#include "addressindex.h"
+#include "blockfilemap.h"
+#include "coinstatsindex.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "undo.h"
@@ -37,11 +50,18 @@
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 #include "validationinterface.h"
+#include "validationstats.h"
 #include "versionbits.h"
 #include "warnings.h"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -50,6 +70,10 @@
 #include <boost/math/distributions/poisson.hpp>
 #include <boost/thread.hpp>
 
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
 #if defined(NDEBUG)
 # error "SolarCoin cannot be compiled without assertions."
 #endif
@@ -63,18 +87,47 @@ using namespace std;
 CCriticalSection cs_main;
 
 // SolarCoin: PoST
-HashMap mapProofOfStake;
-std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
+CStakeSeenSet setStakeSeen;
 
 BlockMap mapBlockIndex;
+
+/**
+ * SolarCoin: The entries of mapBlockIndex are carved from large chunks rather than allocated one
+ * by one, which saves the allocator overhead of each and keeps entries created after each other,
+ * as the blocks of a chain are, close together. Protected by cs_main, like mapBlockIndex.
+ */
+static PoolResource<sizeof(CBlockIndex), alignof(CBlockIndex)> blockIndexPool(1 << 20);
+
+template <typename... Args>
+static CBlockIndex* NewBlockIndex(Args&&... args)
+{
+    void* p = blockIndexPool.Allocate(sizeof(CBlockIndex), alignof(CBlockIndex));
+    return new (p) CBlockIndex(std::forward<Args>(args)...);
+}
+
+static void DeleteBlockIndex(CBlockIndex* pindex)
+{
+    if (pindex == NULL)
+        return;
+    pindex->~CBlockIndex();
+    blockIndexPool.Deallocate(pindex, sizeof(CBlockIndex), alignof(CBlockIndex));
+}
+
+size_t GetBlockIndexMemoryUsage()
+{
+    AssertLockHeld(cs_main);
+    return blockIndexPool.NumAllocatedChunks() * memusage::MallocUsage(blockIndexPool.ChunkSizeBytes()) + memusage::DynamicUsage(mapBlockIndex);
+}
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nCoinsPrefetchThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
+bool fTxIndexCompact = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -82,6 +135,9 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nReindexBufferSize = DEFAULT_REINDEX_BUFFER * 1024 * 1024;
+unsigned int nBlockFileChunkSize = BLOCKFILE_CHUNK_SIZE;
+unsigned int nUndoFileChunkSize = UNDOFILE_CHUNK_SIZE;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -140,6 +196,12 @@ namespace {
     CCriticalSection cs_LastBlockFile;
     std::vector<CBlockFileInfo> vinfoBlockFile;
     int nLastBlockFile = 0;
+    /**
+     * SolarCoin: The block and undo file last appended to, kept open between writes (protected by
+     * cs_LastBlockFile); see TakeAppendFile().
+     */
+    std::pair<int, FILE*> blockAppendFile(-1, NULL);
+    std::pair<int, FILE*> undoAppendFile(-1, NULL);
     /** Global flag to indicate we should check to see if there are
      *  block/undo files that should be deleted.  Set on startup
      *  or if we allocate more file space when we're in prune mode
@@ -216,6 +278,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CCoinsViewDB *pcoinsdbview = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
@@ -228,7 +291,10 @@ enum FlushStateMode {
 
 // See definition for documentation
 bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int nManualPruneHeight=0);
-void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
+bool FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight, size_t nMaxFiles);
+
+/** SolarCoin: Height pruneblockchain asked to prune up to, pruned in batches by the next flushes (protected by cs_main) */
+static int nScheduledPruneHeight = 0;
 
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
 {
@@ -450,15 +516,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -630,9 +696,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -681,14 +747,26 @@ static bool IsCurrentForFeeEstimation()
  * @param plTxnReplaced 
  * @param fOverrideMempoolLimit 
  * @param nAbsurdFee 
- * @param vHashTxnToUncache 
+ * @param coins_to_uncache 
  * @return true 
  * @return false 
  */
+/** Script verification flags of the transactions of the block at pindex */
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams)
+{
+    // BIP16 didn't become active until Apr 1 2012
+    //int64_t nBIP16SwitchTime = 1333238400;
+    //bool fStrictPayToScriptHash = (pindex->GetBlockTime() >= nBIP16SwitchTime);
+    bool fStrictPayToScriptHash = false; // SolarCoin: Verify in kernel
+
+    return fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
 {
+    PROFILE_SCOPE("AcceptToMemoryPool");
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
@@ -783,23 +861,23 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
         view.SetBackend(viewMemPool);
 
-        // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
-        }
-
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
-                if (pfMissingInputs)
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                coins_to_uncache.push_back(txin.prevout);
+            }
+            if (!view.HaveCoin(txin.prevout)) {
+                // Are inputs missing because we already have the tx?
+                for (size_t out = 0; out < tx.vout.size(); out++) {
+                    // Optimistically just do efficient check of cache for outputs
+                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out))) {
+                        return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+                    }
+                }
+                // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
+                if (pfMissingInputs) {
                     *pfMissingInputs = true;
+                }
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
             }
         }
@@ -847,10 +925,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 
         // Keep track of transactions that spend a coinbase, which we re-scan
         // during reorgs to ensure COINBASE_MATURITY is still met.
+        // SolarCoin: coinstakes mature too, see CTxMemPool::removeForReorg().
         bool fSpendsCoinbase = false;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase()) {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
                 fSpendsCoinbase = true;
                 break;
             }
@@ -1067,14 +1146,14 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
+        PrecomputedTransactionData txdata; // SolarCoin: initialized by CheckInputs on a cache miss
+        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
             CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
+            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
+                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
                 // Only the witness is missing, so the transaction itself may be fine.
                 state.SetCorruptionPossible();
             }
@@ -1090,11 +1169,20 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        //
+        // SolarCoin: the transaction is also checked against the flags ConnectBlock() uses, with
+        // the result stored in the script execution cache so the block skips its scripts.
+        unsigned int blockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, blockScriptVerifyFlags == MANDATORY_SCRIPT_VERIFY_FLAGS, txdata))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
         }
+        if (blockScriptVerifyFlags != MANDATORY_SCRIPT_VERIFY_FLAGS && !CheckInputs(tx, state, view, true, blockScriptVerifyFlags, true, true, txdata))
+        {
+            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against block but not STANDARD flags %s, %s",
+                __func__, hash.ToString(), FormatStateMessage(state));
+        }
 
         // Remove conflicting transactions from the mempool
         BOOST_FOREACH(const CTxMemPool::txiter it, allConflicting)
@@ -1152,11 +1240,14 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                         bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> coins_to_uncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+        TRACE3(mempool, rejected, tx->GetHash().begin(), state.GetRejectReason().c_str(), pfMissingInputs && *pfMissingInputs);
+        BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
+    } else {
+        TRACE2(mempool, added, tx->GetHash().begin(), (uint64_t)tx->GetTotalSize());
     }
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
     CValidationState stateDummy;
@@ -1220,42 +1311,17 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, unsigned int &n
         return true;
     }
 
-    if (fTxIndex) {
-        CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-
-            // SolarCoin: Return nTxOffset into block
-            nTxOffset = postx.nTxOffset;
-
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut->GetHash() != hash) {
-                return error("%s: txid mismatch", __func__);
-            }
-            return true;
-        }
+    if (ptxindex) {
+        bool fIndexed = false;
+        bool fRead = ptxindex->FindTx(hash, txOut, nTxOffset, hashBlock, fIndexed);
+        if (fIndexed)
+            return fRead;
     }
 
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
-        int nHeight = -1;
-        {
-            const CCoinsViewCache& view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
-        }
-        if (nHeight > 0)
-            pindexSlow = chainActive[nHeight];
+        const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+        if (!coin.IsSpent())
+            pindexSlow = chainActive[coin.nHeight];
     }
 
     if (pindexSlow) {
@@ -1293,10 +1359,63 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, unsigned int &n
  * @return true 
  * @return false 
  */
+/**
+ * SolarCoin: The open block or undo file to append at pos, positioned there. The caller owns it until
+ * it gives it back with ReturnAppendFile(), so a write that fails or throws just closes it. The
+ * handles stay open between blocks instead of being opened for each; FlushBlockFile() closes them
+ * before it syncs the files to disk.
+ */
+static FILE* TakeAppendFile(const CDiskBlockPos& pos, bool fUndo)
+{
+    AssertLockHeld(cs_LastBlockFile);
+    std::pair<int, FILE*>& handle = fUndo ? undoAppendFile : blockAppendFile;
+    FILE* file = handle.second;
+    handle.second = NULL;
+    if (file && handle.first != pos.nFile) {
+        fclose(file);
+        file = NULL;
+    }
+    if (!file)
+        return fUndo ? OpenUndoFile(pos) : OpenBlockFile(pos);
+    if (fseek(file, pos.nPos, SEEK_SET)) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+/** Keep the handle of a file appended to for the next write, after handing the data to the OS */
+static bool ReturnAppendFile(int nFile, bool fUndo, FILE* file)
+{
+    AssertLockHeld(cs_LastBlockFile);
+    // Readers open the file themselves, so the data must not stay in this handle's buffer
+    if (fflush(file) != 0) {
+        fclose(file);
+        return false;
+    }
+    std::pair<int, FILE*>& handle = fUndo ? undoAppendFile : blockAppendFile;
+    if (handle.second)
+        fclose(handle.second);
+    handle = std::make_pair(nFile, file);
+    return true;
+}
+
+static void CloseAppendFiles()
+{
+    LOCK(cs_LastBlockFile);
+    for (std::pair<int, FILE*>* handle : {&blockAppendFile, &undoAppendFile}) {
+        if (handle->second)
+            fclose(handle->second);
+        *handle = std::make_pair(-1, (FILE*)NULL);
+    }
+}
+
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
+    LOCK(cs_LastBlockFile);
+
     // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+    CAutoFile fileout(TakeAppendFile(pos, false), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
@@ -1311,6 +1430,8 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     pos.nPos = (unsigned int)fileOutPos;
     fileout << block;
 
+    if (!ReturnAppendFile(pos.nFile, false, fileout.release()))
+        return error("WriteBlockToDisk: fflush failed");
     return true;
 }
 /**
@@ -1323,30 +1444,54 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
  * @return true 
  * @return false 
  */
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns)
+static bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns, bool fCheckPoW)
 {
+    PROFILE_SCOPE("ReadBlockFromDisk");
     block.SetNull();
+    const int nType = fReadTxns ? SER_DISK : SER_DISK|SER_BLOCKHEADERONLY;
+    TRACE3(blockstorage, read_block_start, pos.nFile, pos.nPos, fReadTxns);
+
+    // SolarCoin: Straight from the mapped file if -blockfilemmap; a record that does not read is
+    // read again from the file
+    CMappedRecord record;
+    bool fRead = false;
+    if (MapBlockFileRecord(pos, false, 0, record)) {
+        try {
+            CSpanReader(nType, CLIENT_VERSION, record.pbegin, record.pend) >> block;
+            fRead = true;
+        } catch (const std::exception& e) {
+            block.SetNull();
+        }
+    }
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), fReadTxns ? SER_DISK : SER_DISK|SER_BLOCKHEADERONLY, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    if (!fRead) {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), nType, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
-    if (block.IsProofOfWork() && !CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+    if (fCheckPoW && block.IsProofOfWork() && !CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
+    TRACE4(blockstorage, read_block, pos.nFile, pos.nPos, (uint64_t)block.vtx.size(), fRead);
     return true;
 }
 
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns)
+{
+    return ReadBlockFromDisk(block, pos, consensusParams, fReadTxns, true);
+}
+
 /**
  * @brief Read a block from disk based on an in-memory block pointer
  * 
@@ -1359,7 +1504,10 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
  */
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fReadTxns)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, fReadTxns))
+    // SolarCoin: the proof of work was accepted with the block, checked or assumed valid. The
+    // GetHash() comparison below still guarantees the data on disk is that block.
+    bool fCheckPoW = !(pindex->nStatus & BLOCK_POW_VERIFIED);
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, fReadTxns, fCheckPoW))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
@@ -1367,6 +1515,96 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // The block is preceded by the message start and its size, see WriteBlockToDisk()
+    if (pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s: invalid position %s", __func__, pos.ToString());
+    CMappedRecord record;
+    if (MapBlockFileRecord(pos, false, 0, record) &&
+        memcmp(record.pbegin - CMessageHeader::MESSAGE_START_SIZE - sizeof(unsigned int), messageStart, CMessageHeader::MESSAGE_START_SIZE) == 0) {
+        block.assign(record.pbegin, record.pend);
+        return true;
+    }
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blkStart;
+        unsigned int nSize;
+        filein >> FLATDATA(blkStart) >> nSize;
+        if (memcmp(blkStart, messageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+            return error("%s: message start mismatch at %s", __func__, pos.ToString());
+        if (nSize > MAX_SIZE)
+            return error("%s: block size %u too large at %s", __func__, nSize, pos.ToString());
+        block.resize(nSize);
+        filein.read((char*)block.data(), nSize);
+    } catch (const std::exception& e) {
+        return error("%s: Read or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!ReadRawBlockFromDisk(block, pindex->GetBlockPos(), messageStart))
+        return false;
+    // The block hash only covers the 80 byte header, so checking it is cheap
+    if (block.size() < 80 || Hash(block.begin(), block.begin() + 80) != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
+bool IsRawBlockSerialization(const CBlockIndex* pindex, int nSerializeFlags, const Consensus::Params& params)
+{
+    if (!(nSerializeFlags & SERIALIZE_TRANSACTION_NO_WITNESS))
+        return true;
+    return !IsWitnessEnabled(pindex->pprev, params);
+}
+
+bool ReadRawUndoFromDisk(std::vector<unsigned char>& undo, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    const CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull() || !pindex->pprev)
+        return error("%s: no undo data for %s", __func__, pindex->GetBlockHash().ToString());
+    // The undo data is preceded by the message start and its size, and followed by its checksum, see UndoWriteToDisk()
+    if (pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s: invalid position %s", __func__, pos.ToString());
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    CAutoFile filein(OpenUndoFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed for %s", __func__, pos.ToString());
+
+    uint256 hashChecksum;
+    try {
+        CMessageHeader::MessageStartChars undoStart;
+        unsigned int nSize;
+        filein >> FLATDATA(undoStart) >> nSize;
+        if (memcmp(undoStart, messageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+            return error("%s: message start mismatch at %s", __func__, pos.ToString());
+        if (nSize > MAX_SIZE)
+            return error("%s: undo size %u too large at %s", __func__, nSize, pos.ToString());
+        undo.resize(nSize);
+        filein.read((char*)undo.data(), nSize);
+        filein >> hashChecksum;
+    } catch (const std::exception& e) {
+        return error("%s: Read or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    // The checksum covers the hash of the parent block and the serialized undo data
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << pindex->pprev->GetBlockHash();
+    hasher.write((const char*)undo.data(), undo.size());
+    if (hashChecksum != hasher.GetHash())
+        return error("%s: checksum mismatch at %s", __func__, pos.ToString());
+    return true;
+}
+
 /**
  * @brief Get the block subsidy.
  * 
@@ -1475,9 +1713,7 @@ static void AlertNotify(const std::string& strMessage)
     std::string singleQuote("'");
     std::string safeStatus = SanitizeString(strMessage);
     safeStatus = singleQuote+safeStatus+singleQuote;
-    boost::replace_all(strCmd, "%s", safeStatus);
-
-    boost::thread t(runCommand, strCmd); // thread runs free
+    QueueNotification("alertnotify", strCmd, safeStatus);
 }
 
 /**
@@ -1606,31 +1842,22 @@ void static InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state
  * @param inputs ?
  * @param txundo Back out an inadvertently applied tx?
  * @param nHeight 
+ * @param nBlockTime Time of the block containing tx, 0 if not in a block
+ * @param nTxOffset Offset of tx in its block after the header, stored with the outputs for stake kernels
  */
-void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight)
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight, uint32_t nBlockTime, uint32_t nTxOffset)
 {
     // mark inputs spent
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
-            // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight, false, nBlockTime, nTxOffset);
 }
 
 /**
@@ -1643,7 +1870,7 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 {
     CTxUndo txundo;
-    UpdateCoins(tx, inputs, txundo, nHeight);
+    UpdateCoins(tx, inputs, txundo, nHeight, 0, 0);
 }
 
 bool CScriptCheck::operator()() {
@@ -1675,20 +1902,20 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
-                if (nSpendHeight - coins->nHeight < (coins->IsCoinBase() ? COINBASE_MATURITY_POW : COINBASE_MATURITY)) // SolarCoin: Two maturities
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
+                if (nSpendHeight - coin.nHeight < (coin.IsCoinBase() ? COINBASE_MATURITY_POW : COINBASE_MATURITY)) // SolarCoin: Two maturities
                     return state.Invalid(false,
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
         }
@@ -1711,7 +1938,7 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
     {
@@ -1731,13 +1958,24 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // Of course, if an assumed valid block is invalid due to false scriptSigs
         // this optimization would allow an invalid chain to be accepted.
         if (fScriptChecks) {
+            // SolarCoin: skip the scripts if they all passed with these flags before, which
+            // relies on the prevouts committing to the spent outputs
+            uint256 hashCacheEntry;
+            ComputeScriptExecutionCacheEntry(hashCacheEntry, tx, flags);
+            if (ScriptExecutionCacheGet(hashCacheEntry, !cacheFullScriptStore))
+                return true;
+            txdata.Init(tx);
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
+
+                const CScript& scriptPubKey = coin.out.scriptPubKey;
+                const CAmount amount = coin.out.nValue;
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheSigStore, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1749,8 +1987,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
+                        CScriptCheck check2(scriptPubKey, amount, tx, i,
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1764,6 +2002,11 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // All the scripts were run above and passed
+                ScriptExecutionCacheSet(hashCacheEntry);
+            }
         }
     }
 
@@ -1774,8 +2017,10 @@ namespace {
 
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
+    LOCK(cs_LastBlockFile);
+
     // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    CAutoFile fileout(TakeAppendFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
@@ -1796,21 +2041,55 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     hasher << blockundo;
     fileout << hasher.GetHash();
 
+    if (!ReturnAppendFile(pos.nFile, true, fileout.release()))
+        return error("%s: fflush failed", __func__);
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
+    PROFILE_SCOPE("UndoReadFromDisk");
+    uint256 hashChecksum;
+
+    // SolarCoin: The checksum covers the record as it was written: undo data of older versions do
+    // not serialize back the same. Straight from the mapped file if -blockfilemmap, as for blocks.
+    CMappedRecord record;
+    std::vector<unsigned char> vRecord;
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    if (MapBlockFileRecord(pos, true, sizeof(hashChecksum), record)) {
+        pbegin = record.pbegin;
+        pend = record.pend - sizeof(hashChecksum);
+    } else {
+        // Open history file to read, at the size in the record header
+        if (pos.nPos < sizeof(unsigned int))
+            return error("%s: no record header", __func__);
+        CAutoFile filein(OpenUndoFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenUndoFile failed", __func__);
+
+        try {
+            unsigned int nSize;
+            filein >> nSize;
+            if (nSize > MAX_SIZE)
+                return error("%s: record size too large", __func__);
+            vRecord.resize(nSize + sizeof(hashChecksum));
+            filein.read((char*)vRecord.data(), vRecord.size());
+        }
+        catch (const std::exception& e) {
+            return error("%s: I/O error - %s", __func__, e.what());
+        }
+        pbegin = vRecord.data();
+        pend = pbegin + vRecord.size() - sizeof(hashChecksum);
+    }
+    memcpy(hashChecksum.begin(), pend, sizeof(hashChecksum));
 
     // Read block
-    uint256 hashChecksum;
     try {
+        CSpanReader filein(SER_DISK, CLIENT_VERSION, pbegin, pend);
         filein >> blockundo;
-        filein >> hashChecksum;
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
@@ -1819,13 +2098,15 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     // Verify checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
-    hasher << blockundo;
+    hasher.write((const char*)pbegin, pend - pbegin);
     if (hashChecksum != hasher.GetHash())
         return error("%s: Checksum mismatch", __func__);
 
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1847,40 +2128,40 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 } // anon namespace
 
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the UTXO in a Coin at a given COutPoint
+ * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
-    }
-    if (coins->IsAvailable(out.n))
+    if (view.HaveCoin(out))
         fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height and coinbase). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("%s: undo data adding output to missing transaction", __func__);
+        undo.nHeight = alternate.nHeight;
+        undo.fCoinBase = alternate.fCoinBase;
+        undo.fCoinStake = alternate.fCoinStake;
+        undo.nTime = alternate.nTime;
+        undo.nBlockTime = alternate.nBlockTime;
+        undo.nTxOffset = alternate.nTxOffset;
+    }
+    view.AddCoin(out, std::move(undo), !fClean);
 
     return fClean;
 }
 
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CBlockUndo* pblockundoOut, CBlockUndo* pblockundoIn)
 {
+    PROFILE_SCOPE("DisconnectBlock");
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
     if (pfClean)
@@ -1889,14 +2170,21 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     bool fClean = true;
 
     CBlockUndo blockUndo;
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull())
-        return error("DisconnectBlock(): no undo data available");
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
-        return error("DisconnectBlock(): failure reading undo data");
+    if (pblockundoIn) {
+        blockUndo = std::move(*pblockundoIn);
+    } else {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull())
+            return error("DisconnectBlock(): no undo data available");
+        if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
+            return error("DisconnectBlock(): failure reading undo data");
+    }
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
+    // Copied before the coins are moved out of it below
+    if (pblockundoOut)
+        *pblockundoOut = blockUndo;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -1904,35 +2192,28 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         if (!tx.IsCoinStake()) {
 
             uint256 hash = tx.GetHash();
+            bool is_coinbase = tx.IsCoinBase();
 
             // Check that all outputs are available and match the outputs in the block itself
             // exactly.
-            {
-            CCoinsModifier outs = view.ModifyCoins(hash);
-            outs->ClearUnspendable();
-
-            CCoins outsBlock(tx, pindex->nHeight);
-            // The CCoins serialization does not serialize negative numbers.
-            // No network rules currently depend on the version here, so an inconsistency is harmless
-            // but it must be corrected before txout nversion ever influences a network rule.
-            if (outsBlock.nVersion < 0)
-                outs->nVersion = outsBlock.nVersion;
-            if (*outs != outsBlock)
-                fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-
-            // remove outputs
-            outs->Clear();
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                    COutPoint out(hash, o);
+                    Coin coin;
+                    bool is_spent = view.SpendCoin(out, &coin);
+                    if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase)
+                        fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
+                }
             }
 
             // restore inputs
             if (i > 0) { // not coinbases
-                const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+                CTxUndo &txundo = blockUndo.vtxundo[i-1];
                 if (txundo.vprevout.size() != tx.vin.size())
                     return error("DisconnectBlock(): transaction and undo data inconsistent");
                 for (unsigned int j = tx.vin.size(); j-- > 0;) {
                     const COutPoint &out = tx.vin[j].prevout;
-                    const CTxInUndo &undo = txundo.vprevout[j];
-                    if (!ApplyTxInUndo(undo, view, out))
+                    if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out))
                         fClean = false;
                 }
             }
@@ -1953,6 +2234,10 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
+    CloseAppendFiles();
+    // The mapping must not reach past the end of the file once it is truncated
+    if (fFinalize)
+        UnmapBlockFile(nLastBlockFile);
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
@@ -1975,57 +2260,485 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+/** SolarCoin: The -par threads running the checks of all the queues below */
+static CCheckPool checkpool;
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, &checkpool);
 
 void ThreadScriptCheck() {
     RenameThread("bitcoin-scriptch");
-    scriptcheckqueue.Thread();
+    checkpool.Thread();
 }
 
-// Protected by cs_main
-VersionBitsCache versionbitscache;
+static CCheckQueue<CHeaderPoWCheck> headercheckqueue(8, &checkpool);
+static CCriticalSection cs_headercheckqueue;
 
-int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
+static CCheckQueue<CBlockCheck> blockcheckqueue(4, &checkpool);
+static CCriticalSection cs_blockcheckqueue;
+
+static CCheckQueue<CTxScriptsCheck> txscriptcheckqueue(8, &checkpool);
+static CCriticalSection cs_txscriptcheckqueue;
+
+/** SolarCoin: The pool priority of the checks of blocks, background while reindexing or importing */
+static int GetBlockCheckPriority()
 {
-    LOCK(cs_main);
-    int32_t nVersion = VERSIONBITS_TOP_BITS;
+    return fReindex || fImporting ? CHECK_PRIORITY_BACKGROUND : CHECK_PRIORITY_TIP;
+}
 
-    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
-        ThresholdState state = VersionBitsState(pindexPrev, params, (Consensus::DeploymentPos)i, versionbitscache);
-        if (state == THRESHOLD_LOCKED_IN || state == THRESHOLD_STARTED) {
-            nVersion |= VersionBitsMask(params, (Consensus::DeploymentPos)i);
+bool CTxScriptsCheck::operator()()
+{
+    PrecomputedTransactionData txdata(*ptx);
+    for (size_t nFlags = 0; nFlags < vFlags.size(); nFlags++) {
+        for (unsigned int i = 0; i < ptx->vin.size(); i++) {
+            CScriptCheck check(vSpent[i].scriptPubKey, vSpent[i].nValue, *ptx, i, vFlags[nFlags], true, &txdata);
+            if (check())
+                continue;
+            // Failing the flags AcceptToMemoryPool() checks first is how it would reject the
+            // transaction too; tell apart the failures it scores as CheckInputs() does. Witness
+            // transactions are left to it, their witness may have been malleated.
+            if (nFlags == 0 && pstate && !ptx->HasWitness()) {
+                CScriptCheck check2(vSpent[i].scriptPubKey, vSpent[i].nValue, *ptx, i,
+                        vFlags[0] & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, true, &txdata);
+                if (check2())
+                    pstate->Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
+                else
+                    pstate->DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+            }
+            return true;
         }
     }
+    for (unsigned int flags : vFlags) {
+        uint256 hashCacheEntry;
+        ComputeScriptExecutionCacheEntry(hashCacheEntry, *ptx, flags);
+        ScriptExecutionCacheSet(hashCacheEntry);
+    }
+    return true;
+}
 
-    return nVersion;
+void PreVerifyTransactionScripts(const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>* pvState)
+{
+    std::vector<CTxScriptsCheck> vChecks;
+    if (pvState) {
+        pvState->clear();
+        pvState->resize(vtx.size());
+    }
+    {
+        LOCK2(cs_main, mempool.cs);
+        // The flag sets AcceptToMemoryPoolWorker() checks the scripts with
+        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+        if (!Params().RequireStandard()) {
+            scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+        }
+        std::vector<unsigned int> vFlags(1, scriptVerifyFlags);
+        const unsigned int blockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
+        if (std::find(vFlags.begin(), vFlags.end(), (unsigned int)MANDATORY_SCRIPT_VERIFY_FLAGS) == vFlags.end())
+            vFlags.push_back(MANDATORY_SCRIPT_VERIFY_FLAGS);
+        if (std::find(vFlags.begin(), vFlags.end(), blockScriptVerifyFlags) == vFlags.end())
+            vFlags.push_back(blockScriptVerifyFlags);
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        CCoinsViewCache view(&viewMemPool);
+        std::vector<COutPoint> coins_to_uncache;
+        vChecks.reserve(vtx.size());
+        const bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus());
+        const CFeeRate mempoolMinFee = mempool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        for (size_t nTx = 0; nTx < vtx.size(); nTx++) {
+            const CTransaction& tx = *vtx[nTx];
+            CValidationState state;
+            std::string reason;
+            if (tx.IsCoinBase() || tx.IsCoinStake() || !CheckTransaction(tx, state) || mempool.exists(tx.GetHash()))
+                continue;
+            // The cheap checks AcceptToMemoryPoolWorker() rejects with before it runs any script,
+            // so that a transaction it would turn down anyway costs no script verification here
+            if (tx.HasWitness() && !witnessEnabled && !GetBoolArg("-prematurewitness", false))
+                continue;
+            if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled))
+                continue;
+            if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
+                continue;
+            bool fConflict = false;
+            std::vector<CTxOut> vSpent;
+            vSpent.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                if (mempool.mapNextTx.count(txin.prevout)) {
+                    fConflict = true;
+                    break;
+                }
+                if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                    coins_to_uncache.push_back(txin.prevout);
+                const Coin& coin = view.AccessCoin(txin.prevout);
+                if (coin.IsSpent())
+                    break;
+                vSpent.push_back(coin.out);
+            }
+            if (fConflict || vSpent.size() != tx.vin.size())
+                continue;
+            if (fRequireStandard && (!AreInputsStandard(tx, view) || (tx.HasWitness() && !IsWitnessStandard(tx, view))))
+                continue;
+            if (!Consensus::CheckTxInputs(tx, state, view, chainActive.Height() + 1))
+                continue;
+            const int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+            if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+                continue;
+            // Free and low fee transactions are rate limited by the acceptance; leave them to it
+            const size_t nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+            CAmount nModifiedFees = view.GetValueIn(tx) - tx.GetValueOut();
+            double nPriorityDummy = 0;
+            mempool.ApplyDeltas(tx.GetHash(), nPriorityDummy, nModifiedFees);
+            if (nModifiedFees < mempoolMinFee.GetFee(nSize) || nModifiedFees < ::minRelayTxFee.GetFee(nSize))
+                continue;
+            vChecks.push_back(CTxScriptsCheck(tx, vSpent, vFlags, pvState ? &(*pvState)[nTx] : NULL));
+        }
+        // Like AcceptToMemoryPool(), don't let the lookups fill the coins cache; the acceptance
+        // reads the coins it keeps again
+        for (const COutPoint& outpoint : coins_to_uncache)
+            pcoinsTip->Uncache(outpoint);
+    }
+
+    if (nScriptCheckThreads && vChecks.size() > 1) {
+        TRY_LOCK(cs_txscriptcheckqueue, lockQueue);
+        if (lockQueue) {
+            CCheckQueueControl<CTxScriptsCheck> control(&txscriptcheckqueue, CHECK_PRIORITY_MEMPOOL);
+            control.Add(vChecks);
+            control.Wait();
+            return;
+        }
+    }
+    for (CTxScriptsCheck& check : vChecks)
+        check();
 }
 
+namespace {
+
+/** Outpoints read in one go by a coins prefetch thread */
+static const size_t COINS_PREFETCH_BATCH_SIZE = 32;
+/** Blocks queued for the coins prefetch at most; older ones are dropped */
+static const size_t MAX_COINS_PREFETCH_JOBS = 8;
+
+/** The inputs of a block, read from the coins database ahead of ConnectBlock() (SolarCoin) */
+struct CCoinsPrefetchJob
+{
+    uint256 hashBlock;
+    CDiskBlockPos pos;                    //!< where to read the block if pblock is NULL
+    bool fCheckPoW;                       //!< whether reading the block checks its scrypt hash
+    const Consensus::Params* pparams;
+    std::shared_ptr<const CBlock> pblock; //!< NULL until read, and if reading failed
+    CCoinsViewDB* pview;
+    uint64_t nWriteSequence;              //!< pview->GetWriteSequence() before anything was read
+    bool fPreparing;
+    bool fPrepared;                       //!< the block is read and vOutpoints is filled in
+    std::vector<COutPoint> vOutpoints;    //!< inputs spending outputs of earlier blocks
+    std::vector<Coin> vCoins;             //!< the coins read for vOutpoints, spent if not found
+    size_t nNext;                         //!< first entry of vOutpoints no thread took yet
+    int nReading;                         //!< threads reading entries of vOutpoints
+
+    CCoinsPrefetchJob() : fCheckPoW(true), pparams(NULL), pview(NULL), nWriteSequence(0), fPreparing(false), fPrepared(false), nNext(0), nReading(0) {}
+
+    /** Read the block if needed and collect its inputs */
+    void Prepare()
+    {
+        if (!pblock) {
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockRead, pos, *pparams, true, fCheckPoW) && pblockRead->GetHash() == hashBlock)
+                pblock = pblockRead;
+        }
+        if (!pblock)
+            return;
+        // Outputs created in the block itself are not in the database yet
+        std::vector<uint256> vTxids;
+        vTxids.reserve(pblock->vtx.size());
+        for (const auto& tx : pblock->vtx)
+            vTxids.push_back(tx->GetHash());
+        std::sort(vTxids.begin(), vTxids.end());
+        for (const auto& tx : pblock->vtx) {
+            if (tx->IsCoinBase())
+                continue;
+            for (const CTxIn& txin : tx->vin) {
+                if (!std::binary_search(vTxids.begin(), vTxids.end(), txin.prevout.hash))
+                    vOutpoints.push_back(txin.prevout);
+            }
+        }
+        vCoins.resize(vOutpoints.size());
+    }
+
+    /** Read the coins of vOutpoints[nBegin, nEnd), skipping those in pcache if given */
+    void Read(size_t nBegin, size_t nEnd, const CCoinsViewCache* pcache)
+    {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            if (pcache && pcache->HaveCoinInCache(vOutpoints[i]))
+                continue;
+            try {
+                if (!pview->GetCoin(vOutpoints[i], vCoins[i]))
+                    vCoins[i].Clear();
+            } catch (const std::exception&) {
+                // Reported when ConnectBlock() reads the coin again
+                vCoins[i].Clear();
+            }
+        }
+    }
+};
+
 /**
- * Threshold condition checker that triggers when unknown versionbits are seen on the network.
+ * Reads the inputs of blocks about to be connected from the coins database on a pool of
+ * threads, so ConnectBlock() finds them in pcoinsTip instead of reading them one by one.
+ * Apply() helps with the reads left and moves the coins to the cache, unless the database
+ * was written since they were read.
  */
-class WarningBitsConditionChecker : public AbstractThresholdConditionChecker
+class CCoinsPrefetcher
 {
 private:
-    int bit;
+    boost::mutex mutex;
+    boost::condition_variable condWorker; //!< the workers wait for jobs with work left
+    boost::condition_variable condDone;   //!< Apply() and Cancel() wait for work in progress
+    std::deque<std::shared_ptr<CCoinsPrefetchJob> > queue;
+    int nBusy;                            //!< threads working on a job
+
+    /** Do some of the work left on a job, with the mutex released. Returns false if there is none. */
+    bool Work(boost::unique_lock<boost::mutex>& lock, const std::shared_ptr<CCoinsPrefetchJob>& job, const CCoinsViewCache* pcache)
+    {
+        size_t nBegin = 0, nEnd = 0;
+        if (!job->fPrepared) {
+            if (job->fPreparing)
+                return false;
+            job->fPreparing = true;
+        } else {
+            if (job->nNext == job->vOutpoints.size())
+                return false;
+            nBegin = job->nNext;
+            nEnd = std::min(nBegin + COINS_PREFETCH_BATCH_SIZE, job->vOutpoints.size());
+            job->nNext = nEnd;
+            job->nReading++;
+        }
+        nBusy++;
+        lock.unlock();
+        if (nEnd == 0)
+            job->Prepare();
+        else
+            job->Read(nBegin, nEnd, pcache);
+        lock.lock();
+        nBusy--;
+        if (nEnd == 0) {
+            job->fPreparing = false;
+            job->fPrepared = true;
+            condWorker.notify_all();
+        } else {
+            job->nReading--;
+        }
+        condDone.notify_all();
+        return true;
+    }
 
 public:
-    WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
-
-    int64_t BeginTime(const Consensus::Params& params) const { return 0; }
-    int64_t EndTime(const Consensus::Params& params) const { return std::numeric_limits<int64_t>::max(); }
-    int Period(const Consensus::Params& params) const { return params.nMinerConfirmationWindow; }
-    int Threshold(const Consensus::Params& params) const { return params.nRuleChangeActivationThreshold; }
+    CCoinsPrefetcher() : nBusy(0) {}
 
-    bool Condition(const CBlockIndex* pindex, const Consensus::Params& params) const
+    //! Worker thread
+    void Thread()
     {
-        return ((pindex->nVersion & VERSIONBITS_TOP_MASK) == VERSIONBITS_TOP_BITS) &&
-               ((pindex->nVersion >> bit) & 1) != 0 &&
-               ((ComputeBlockVersion(pindex->pprev, params) >> bit) & 1) == 0;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true) {
+            bool fWorked = false;
+            for (size_t i = 0; i < queue.size() && !fWorked; i++) {
+                std::shared_ptr<CCoinsPrefetchJob> job = queue[i];
+                fWorked = Work(lock, job, NULL);
+            }
+            if (!fWorked)
+                condWorker.wait(lock);
+        }
     }
-};
-
-// Protected by cs_main
-static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
+
+    /** Start reading the inputs of a block. pblock may be NULL to read the block from disk. */
+    void Prefetch(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& pblock, CCoinsViewDB* pview, const Consensus::Params& params)
+    {
+        AssertLockHeld(cs_main);
+        if (!pblock && !(pindex->nStatus & BLOCK_HAVE_DATA))
+            return;
+        std::shared_ptr<CCoinsPrefetchJob> job = std::make_shared<CCoinsPrefetchJob>();
+        job->hashBlock = pindex->GetBlockHash();
+        job->pos = pindex->GetBlockPos();
+        job->fCheckPoW = !(pindex->nStatus & BLOCK_POW_VERIFIED);
+        job->pparams = &params;
+        job->pblock = pblock;
+        job->pview = pview;
+        job->nWriteSequence = pview->GetWriteSequence();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (const auto& jobQueued : queue) {
+            if (jobQueued->hashBlock == job->hashBlock)
+                return;
+        }
+        // Threads still working on a dropped job finish their part and let go of it
+        while (queue.size() >= MAX_COINS_PREFETCH_JOBS)
+            queue.pop_front();
+        queue.push_back(job);
+        condWorker.notify_all();
+    }
+
+    /**
+     * Finish the prefetch of a block and add the coins read to cache (pcoinsTip). If pblock
+     * is NULL, it is set to the block read by the prefetch, if any.
+     * @return the number of coins added
+     */
+    size_t Apply(const uint256& hashBlock, CCoinsViewCache& cache, std::shared_ptr<const CBlock>& pblock)
+    {
+        AssertLockHeld(cs_main);
+        boost::this_thread::disable_interruption di;
+        std::shared_ptr<CCoinsPrefetchJob> job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            std::deque<std::shared_ptr<CCoinsPrefetchJob> >::iterator it = queue.begin();
+            while (it != queue.end() && (*it)->hashBlock != hashBlock)
+                ++it;
+            if (it == queue.end())
+                return 0;
+            job = *it;
+            // Help with the reads left rather than waiting for the workers
+            while (true) {
+                if (Work(lock, job, &cache))
+                    continue;
+                if (job->fPrepared && job->nReading == 0)
+                    break;
+                condDone.wait(lock);
+            }
+            it = std::find(queue.begin(), queue.end(), job);
+            if (it != queue.end())
+                queue.erase(it);
+        }
+
+        if (!pblock)
+            pblock = job->pblock;
+        if (job->pview->GetWriteSequence() != job->nWriteSequence) {
+            // A coin read before the write may have been spent and evicted from the cache since
+            LogPrint("coindb", "%s: coins database written, discarding the prefetch of %s\n", __func__, hashBlock.ToString());
+            IncrementBlockCounter(BLOCK_COUNTER_COINS_PREFETCH_STALE);
+            return 0;
+        }
+        size_t nAdded = 0;
+        for (size_t i = 0; i < job->vOutpoints.size(); i++) {
+            if (!job->vCoins[i].IsSpent() && cache.WarmCoin(job->vOutpoints[i], std::move(job->vCoins[i])))
+                nAdded++;
+        }
+        return nAdded;
+    }
+
+    /** Drop all jobs and wait for the work in progress */
+    void Cancel()
+    {
+        boost::this_thread::disable_interruption di;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queue.clear();
+        while (nBusy > 0)
+            condDone.wait(lock);
+    }
+};
+
+} // anon namespace
+
+static CCoinsPrefetcher coinsprefetcher;
+
+void ThreadCoinsPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    coinsprefetcher.Thread();
+}
+
+void CancelCoinsPrefetch() {
+    coinsprefetcher.Cancel();
+}
+
+bool CompactChainDB(const std::string& strName)
+{
+    const int nSplits = GetArg("-dbcompactsplits", DEFAULT_DB_COMPACT_SPLITS);
+    const int64_t nPause = std::max<int64_t>(0, GetArg("-dbcompactpause", DEFAULT_DB_COMPACT_PAUSE));
+    // The pause lets the flushes and reads of block connection through between ranges
+    auto step = [nPause]() {
+        if (ShutdownRequested())
+            return false;
+        if (nPause > 0)
+            MilliSleep(nPause);
+        return true;
+    };
+
+    const CDBWrapper* pdb = NULL;
+    const CBlockTreeDB* pblocktreedb = NULL;
+    {
+        LOCK(cs_main);
+        if (strName == "chainstate" && pcoinsdbview)
+            pdb = &pcoinsdbview->GetDB();
+        else if (strName == "blockindex")
+            pdb = pblocktree;
+        else if (strName == "txindex")
+            pblocktreedb = pblocktree;
+    }
+    if (pblocktreedb)
+        return pblocktreedb->CompactTxIndex(nSplits, step);
+    return pdb && pdb->CompactInSteps("", nSplits, step);
+}
+
+void ThreadCompactAfterIBD()
+{
+    RenameThread("bitcoin-compactdb");
+    int nHeightStart;
+    {
+        LOCK(cs_main);
+        nHeightStart = chainActive.Height();
+    }
+    while (IsInitialBlockDownload())
+        MilliSleep(10000);
+    {
+        LOCK(cs_main);
+        // A node that was only a little behind has little to gain
+        if (chainActive.Height() - nHeightStart < DB_COMPACT_AFTER_IBD_MIN_BLOCKS)
+            return;
+    }
+    LogPrintf("%s: compacting the chainstate database after the initial block download\n", __func__);
+    const int64_t nStart = GetTimeMillis();
+    if (CompactChainDB("chainstate"))
+        LogPrintf("%s: done in %dms\n", __func__, GetTimeMillis() - nStart);
+}
+
+// Protected by cs_main
+VersionBitsCache versionbitscache;
+
+int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    LOCK(cs_main);
+    int32_t nVersion = VERSIONBITS_TOP_BITS;
+
+    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
+        ThresholdState state = VersionBitsState(pindexPrev, params, (Consensus::DeploymentPos)i, versionbitscache);
+        if (state == THRESHOLD_LOCKED_IN || state == THRESHOLD_STARTED) {
+            nVersion |= VersionBitsMask(params, (Consensus::DeploymentPos)i);
+        }
+    }
+
+    return nVersion;
+}
+
+/**
+ * Threshold condition checker that triggers when unknown versionbits are seen on the network.
+ */
+class WarningBitsConditionChecker : public AbstractThresholdConditionChecker
+{
+private:
+    int bit;
+
+public:
+    WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
+
+    int64_t BeginTime(const Consensus::Params& params) const { return 0; }
+    int64_t EndTime(const Consensus::Params& params) const { return std::numeric_limits<int64_t>::max(); }
+    int Period(const Consensus::Params& params) const { return params.nMinerConfirmationWindow; }
+    int Threshold(const Consensus::Params& params) const { return params.nRuleChangeActivationThreshold; }
+
+    bool Condition(const CBlockIndex* pindex, const Consensus::Params& params) const
+    {
+        return ((pindex->nVersion & VERSIONBITS_TOP_MASK) == VERSIONBITS_TOP_BITS) &&
+               ((pindex->nVersion >> bit) & 1) != 0 &&
+               ((ComputeBlockVersion(pindex->pprev, params) >> bit) & 1) == 0;
+    }
+};
+
+// Protected by cs_main
+static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
@@ -2035,15 +2748,114 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/**
+ * Whether pindex is an ancestor of both the -assumevalid block and the best header, and the best
+ * header has at least nMinimumChainWork.
+ *
+ * We've been configured with the hash of a block which has been externally verified to have a valid history.
+ * A suitable default value is included with the software and updated from time to time.  Because validity
+ *  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+ * This setting doesn't force the selection of any particular chain but makes validating some faster by
+ *  effectively caching the result of part of the verification.
+ * The test against nMinimumChainWork prevents the skipping when denied access to any chain at
+ *  least as good as the expected chain.
+ */
+static bool IsBlockAssumedValid(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid.IsNull() || pindexBestHeader == NULL)
+        return false;
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end())
+        return false;
+    return it->second->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->nChainWork >= UintToArith256(consensusParams.nMinimumChainWork);
+}
+
+/**
+ * SolarCoin: The amounts of a block's transactions that its rewards and money supply follow from,
+ * added up the same way by ConnectBlock() and ConnectSnapshotBlock()
+ */
+struct CBlockAmounts
+{
+    CAmount nFees;
+    int64_t nValueIn;
+    int64_t nValueOut;
+    int64_t nStakeReward;
+
+    CBlockAmounts() : nFees(0), nValueIn(0), nValueOut(0), nStakeReward(0) {}
+
+    //! Add tx, whose inputs are still unspent in view
+    void Add(const CTransaction& tx, const CCoinsViewCache& view)
+    {
+        if (tx.IsCoinBase()) {
+            nValueOut += tx.GetValueOut();
+            return;
+        }
+        int64_t nTxValueIn = view.GetValueIn(tx);
+        int64_t nTxValueOut = tx.GetValueOut();
+        // The coinstake earns its reward instead of paying a fee
+        if (tx.IsCoinStake())
+            nStakeReward = nTxValueOut - nTxValueIn;
+        else
+            nFees += nTxValueIn - nTxValueOut;
+        nValueIn += nTxValueIn;
+        nValueOut += nTxValueOut;
+    }
+
+    int64_t GetMint() const { return nValueOut - nValueIn + nFees; }
+    int64_t GetMoneySupply(const CBlockIndex* pindexPrev) const { return (pindexPrev ? pindexPrev->nMoneySupply : 0) + nValueOut - nValueIn; }
+};
+
+/**
+ * SolarCoin: The coinstake of a PoST block earns at most the reward for the stake time nStakeTime
+ * of its inputs, the coinbase of a PoW block at most the subsidy and the fees
+ */
+static bool CheckBlockReward(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, const CBlockAmounts& amounts, uint64_t nStakeTime, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    if (block.IsProofOfStake()) {
+        int64_t nCalculatedStakeReward = GetProofOfStakeTimeReward(nStakeTime, amounts.nFees, pindex->pprev, consensusParams);
+        if (amounts.nStakeReward > nCalculatedStakeReward)
+            return state.DoS(100,
+                            error("%s: coinstake pays too much(actual=%ld vs calculated=%ld)",
+                                __func__, amounts.nStakeReward, nCalculatedStakeReward),
+                                REJECT_INVALID, "bad-cs-amount");
+        if (fDebug)
+            LogPrintf("%s: coinstake (actual=%ld vs calculated=%ld)\n", __func__, amounts.nStakeReward, nCalculatedStakeReward);
+    } else {
+        CAmount blockReward = amounts.nFees + GetBlockSubsidy(pindex->nHeight, consensusParams);
+        if (block.vtx[0]->GetValueOut() > blockReward)
+            return state.DoS(100,
+                            error("%s: coinbase pays too much (actual=%d vs limit=%d)",
+                                    __func__, block.vtx[0]->GetValueOut(), blockReward),
+                                    REJECT_INVALID, "bad-cb-amount");
+    }
+    return true;
+}
+
+bool IsBlockPoWCheckNeeded(const uint256& hashBlock, const Consensus::Params& consensusParams)
+{
+    LOCK(cs_main);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hashBlock);
+    return mi == mapBlockIndex.end() || !IsBlockAssumedValid(mi->second, consensusParams);
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, CBlockUndo* pblockundoOut)
 {
+    PROFILE_SCOPE("ConnectBlock");
     AssertLockHeld(cs_main);
 
     int64_t nTimeStart = GetTimeMicros();
+    TRACE3(validation, connect_block_start, pindex->phashBlock->begin(), pindex->nHeight, fJustCheck);
+
+    // SolarCoin: the scrypt hash of assumed valid blocks is not checked again, their header was checked on accept
+    bool fAssumedValid = IsBlockAssumedValid(pindex, chainparams.GetConsensus());
 
     // Check it again in case a previous version let a bad block in
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck))
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck && !fAssumedValid, !fJustCheck))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
 
     // verify that the view's current state corresponds to the previous block
@@ -2060,29 +2872,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // SolarCoin: Scripts are checked in kernel. If hashAssumeValid (defaultAssumeValid) is set to null.
     bool fScriptChecks = false; //true;
-    if (!hashAssumeValid.IsNull()) {
-        // We've been configured with the hash of a block which has been externally verified to have a valid history.
-        // A suitable default value is included with the software and updated from time to time.  Because validity
-        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
-        // This setting doesn't force the selection of any particular chain but makes validating some faster by
-        //  effectively caching the result of part of the verification.
-        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
-        if (it != mapBlockIndex.end()) {
-            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->nChainWork >= UintToArith256(chainparams.GetConsensus().nMinimumChainWork)) {
-                // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // The equivalent time check discourages hashpower from extorting the network via DOS attack
-                //  into accepting an invalid block through telling users they must manually set assumevalid.
-                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
-                //  it hard to hide the implication of the demand.  This also avoids having release candidates
-                //  that are hardly doing any signature verification at all in testing without having to
-                //  artificially set the default assumed verified block further back.
-                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
-                //  least as good as the expected chain.
-                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
-            }
-        }
+    if (fAssumedValid) {
+        // The equivalent time check discourages hashpower from extorting the network via DOS attack
+        //  into accepting an invalid block through telling users they must manually set assumevalid.
+        //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+        //  it hard to hide the implication of the demand.  This also avoids having release candidates
+        //  that are hardly doing any signature verification at all in testing without having to
+        //  artificially set the default assumed verified block further back.
+        fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
     }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
@@ -2116,19 +2913,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     //if (fEnforceBIP30) {
     //    for (const auto& tx : block.vtx) {
-    //        const CCoins* coins = view.AccessCoins(tx->GetHash());
-    //        if (coins && !coins->IsPruned())
-    //            return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-    //                             REJECT_INVALID, "bad-txns-BIP30");
+    //        for (size_t o = 0; o < tx->vout.size(); o++) {
+    //            if (view.HaveCoin(COutPoint(tx->GetHash(), o)))
+    //                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+    //                                 REJECT_INVALID, "bad-txns-BIP30");
+    //        }
     //    }
     //}
 
-    // BIP16 didn't become active until Apr 1 2012
-    //int64_t nBIP16SwitchTime = 1333238400;
-    //bool fStrictPayToScriptHash = (pindex->GetBlockTime() >= nBIP16SwitchTime);
-    bool fStrictPayToScriptHash = false; // SolarCoin: Verify in kernel
-
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+    unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
 
     // Start enforcing the DERSIG (BIP66) rule
     //if (pindex->nHeight >= chainparams.GetConsensus().BIP66Height) {
@@ -2158,18 +2951,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr, GetBlockCheckPriority());
 
     std::vector<int> prevheights;
-    CAmount nFees = 0;
-    int64_t nValueIn = 0; // SolarCoin
-    int64_t nValueOut = 0; // SolarCoin
-    int64_t nStakeReward = 0; // SolarCoin
+    CBlockAmounts amounts; // SolarCoin
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -2190,7 +2978,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // be in ConnectBlock because they require the UTXO set
             //prevheights.resize(tx.vin.size());
             //for (size_t j = 0; j < tx.vin.size(); j++) {
-            //    prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+            //    prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             //}
 
             //if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
@@ -2208,24 +2996,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             return state.DoS(100, error("ConnectBlock(): too many sigops"),
                              REJECT_INVALID, "bad-blk-sigops");
 
-        txdata.emplace_back(tx);
-        if (tx.IsCoinBase()) {
-            nValueOut += tx.GetValueOut();
-        } else {
-            int64_t nTxValueIn = view.GetValueIn(tx);
-            int64_t nTxValueOut = tx.GetValueOut();
-            if (tx.IsCoinStake()) {
-                nStakeReward = nTxValueOut - nTxValueIn;
-            }
-            nValueIn += nTxValueIn;
-            nValueOut += nTxValueOut;
-            if (!tx.IsCoinStake()) {
-                nFees += nTxValueIn - nTxValueOut;
-            }
-
+        // SolarCoin: initialized by CheckInputs, only if the scripts have to run
+        txdata.emplace_back();
+        amounts.Add(tx, view);
+        if (!tx.IsCoinBase()) {
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
@@ -2235,39 +3012,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
-        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, block.GetBlockTime(), pos.nTxOffset);
 
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
 
     // SolarCoin: PoW/PoST rewards
+    uint64_t nStakeTime = 0;
     if (block.IsProofOfStake()) {
-        int64_t nCalculatedStakeReward;
-        // SolarCoin: coin stake tx earns reward instead of paying fee
-        uint64_t nStakeTime;
+        int64_t nTimeStakeStart = GetTimeMicros();
         if (!GetStakeTime(*(block.vtx[1]), nStakeTime, pindex->pprev, chainparams.GetConsensus()))
             return error("() : %s unable to get coin age for coinstake", (*block.vtx[1]).GetHash().ToString().substr(0,10).c_str());
-        nCalculatedStakeReward = GetProofOfStakeTimeReward(nStakeTime, nFees, pindex->pprev, chainparams.GetConsensus());
-
-        if (nStakeReward > nCalculatedStakeReward)
-            return state.DoS(100,
-                            error("ConnectBlock() : coinstake pays too much(actual=%ld vs calculated=%ld)",
-                                nStakeReward, nCalculatedStakeReward),
-                                REJECT_INVALID, "bad-cs-amount");
-        else
-            if (fDebug)
-                LogPrintf("ConnectBlock() : coinstake (actual=%ld vs calculated=%ld)\n", nStakeReward, nCalculatedStakeReward);
-    } else {
-        CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
-        if (block.vtx[0]->GetValueOut() > blockReward)
-            return state.DoS(100,
-                            error("ConnectBlock(): coinbase pays too much (actual=%d vs limit=%d)",
-                                    block.vtx[0]->GetValueOut(), blockReward),
-                                    REJECT_INVALID, "bad-cb-amount");
+        RecordBlockPhase(BLOCK_PHASE_STAKE_TIME, GetTimeMicros() - nTimeStakeStart);
     }
+    if (!CheckBlockReward(block, state, pindex, amounts, nStakeTime, chainparams.GetConsensus()))
+        return false;
 
     if (!control.Wait())
         return state.DoS(100, false);
@@ -2277,9 +3038,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    RecordBlockPhase(BLOCK_PHASE_CHECK, nTime1 - nTimeStart);
+    RecordBlockPhase(BLOCK_PHASE_FORKS, nTime2 - nTime1);
+    RecordBlockPhase(BLOCK_PHASE_CONNECT, nTime3 - nTime2);
+    RecordBlockPhase(BLOCK_PHASE_VERIFY, nTime4 - nTime2);
+
     // SolarCoin: Need to update CBlockIndex PoST parameters 'Mint' and 'MoneySupply' now that we have the block's txns
-    pindex->nMint = nValueOut - nValueIn + nFees;
-    pindex->nMoneySupply = (pindex->pprev ? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
+    pindex->nMint = amounts.GetMint();
+    pindex->nMoneySupply = amounts.GetMoneySupply(pindex->pprev);
 
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
@@ -2300,15 +3066,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_INDEX, nTime5 - nTime4);
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
@@ -2318,6 +3081,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_CALLBACKS, nTime6 - nTime5);
+    RecordBlockPhase(BLOCK_PHASE_CONNECT_BLOCK, nTime6 - nTimeStart);
+    TRACE6(validation, block_connected, pindex->phashBlock->begin(), pindex->nHeight, (uint64_t)block.vtx.size(), nInputs, nSigOpsCost, nTime6 - nTimeStart);
+
+    if (pblockundoOut)
+        *pblockundoOut = std::move(blockundo);
 
     return true;
 }
@@ -2329,18 +3098,25 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
  * or always and in all cases if we're in prune mode and are deleting files.
  */
 bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int nManualPruneHeight) {
+    PROFILE_SCOPE("FlushStateToDisk");
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
     const CChainParams& chainparams = Params();
     LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    // SolarCoin: block whose state was last (partially) written to the coins database
+    static uint256 hashLastCoinsWrite;
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
-    if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
-        if (nManualPruneHeight > 0) {
-            FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
+    if (nManualPruneHeight > 0)
+        nScheduledPruneHeight = std::max(nScheduledPruneHeight, nManualPruneHeight);
+    if (fPruneMode && (fCheckForPruning || nScheduledPruneHeight > 0) && !fReindex) {
+        if (nScheduledPruneHeight > 0) {
+            // SolarCoin: A few files per flush, so a large manual prune does not stall validation
+            if (FindFilesToPruneManual(setFilesToPrune, nScheduledPruneHeight, MAX_PRUNE_FILES_PER_FLUSH))
+                nScheduledPruneHeight = 0;
         } else {
             FindFilesToPrune(setFilesToPrune, chainparams.PruneAfterHeight());
             fCheckForPruning = false;
@@ -2366,6 +3142,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     }
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+    SetMetric(METRIC_COINS_CACHE_COINS, pcoinsTip->GetCacheSize());
+    SetMetric(METRIC_COINS_CACHE_USAGE, pcoinsTip->DynamicMemoryUsage());
     int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
     // The cache is large and we're within 10% and 200 MiB or 50% and 50MiB of the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::min(std::max(nTotalSpace / 2, nTotalSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
@@ -2376,10 +3154,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+    // SolarCoin: When only the cache size is the problem, write just its oldest entries down to the low-water
+    // mark in the background, and keep the rest. The coins database is left at the last fully flushed block,
+    // with a marker to replay the blocks since (see ReplayBlocks()). That replay cannot undo entries written
+    // for a block that was reorganized away, so a partial flush needs the tip to descend from the last one.
+    bool fPartialFlush = false;
+    if ((fCacheLarge || fCacheCritical) && mode != FLUSH_STATE_ALWAYS && !fPeriodicFlush && !fFlushForPrune && pcoinsdbview != NULL) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hashLastCoinsWrite.IsNull() ? pcoinsdbview->GetBestBlock() : hashLastCoinsWrite);
+        if (it != mapBlockIndex.end() && chainActive.Tip() != NULL)
+            fPartialFlush = chainActive.Tip()->GetAncestor(it->second->nHeight) == it->second;
+    }
     // Combine all conditions that result in a full cache flush.
-    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+    bool fDoFullFlush = !fPartialFlush && ((mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune);
     // Write blocks and block index to disk.
-    if (fDoFullFlush || fPeriodicWrite) {
+    if (fDoFullFlush || fPartialFlush || fPeriodicWrite) {
         // Depend on nMinDiskSpace to ensure we can write block index
         if (!CheckDiskSpace(0))
             return state.Error("out of disk space");
@@ -2399,28 +3187,61 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
                 vBlocks.push_back(*it);
                 setDirtyBlockIndex.erase(it++);
             }
-            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+            // SolarCoin: The fsync'd write goes on in the background; the coins database writes below
+            // wait for it first, so the chainstate never refers to index entries that are not on disk.
+            if (!pblocktree->WriteBatchAsync(vFiles, nLastBlockFile, vBlocks)) {
                 return AbortNode(state, "Failed to write to block index database");
             }
         }
-        // Finally remove any pruned files
-        if (fFlushForPrune)
+        // Finally remove any pruned files, once the index no longer refers to them
+        if (fFlushForPrune) {
+            if (!pblocktree->WaitForWrite())
+                return AbortNode(state, "Failed to write to block index database");
             UnlinkPrunedFiles(setFilesToPrune);
+        }
         nLastWrite = nNow;
     }
+    // SolarCoin: The address and coin statistics indexes are written before the coins, so they are never behind them
+    if ((fDoFullFlush || fPartialFlush) && paddressindex && !paddressindex->Flush(pcoinsTip->GetBestBlock()))
+        return AbortNode(state, "Failed to write to the address index");
+    if ((fDoFullFlush || fPartialFlush) && pcoinstatsindex && !pcoinstatsindex->Flush(pcoinsTip->GetBestBlock()))
+        return AbortNode(state, "Failed to write to the coin statistics index");
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
+    if (fPartialFlush) {
+        CCoinsMap mapEvicted;
+        size_t nTargetUsage = nTotalSpace * COINS_CACHE_LOW_WATER_PERCENT / 100 / DB_PEAK_USAGE_FACTOR;
+        pcoinsTip->Evict(nTargetUsage, mapEvicted);
+        if (!CheckDiskSpace(48 * 2 * 2 * mapEvicted.size()))
+            return state.Error("out of disk space");
+        LogPrint("coindb", "Partial flush: wrote %u coins, %u kB left in cache\n", (unsigned int)mapEvicted.size(), (unsigned int)(pcoinsTip->DynamicMemoryUsage() / 1000));
+        if (!pcoinsdbview->BatchWriteAsync(mapEvicted, pcoinsTip->GetBestBlock(), boost::bind(&CBlockTreeDB::WaitForWrite, pblocktree)))
+            return AbortNode(state, "Failed to write to coin database");
+        hashLastCoinsWrite = pcoinsTip->GetBestBlock();
+        TRACE4(utxocache, partial_flush, GetTimeMicros() - nNow, (uint64_t)mapEvicted.size(), (uint64_t)pcoinsTip->GetCacheSize(), (uint64_t)pcoinsTip->DynamicMemoryUsage());
+        // Only the current block's coins are left; nothing more can be done without a full flush
+        if (fCacheCritical && (int64_t)(pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR) > nTotalSpace)
+            fDoFullFlush = true;
+    }
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
-        // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        // Flush the chainstate (which may refer to block index entries). Unless it has grown too
+        // large, the cache keeps its entries (SolarCoin).
+        if (!pblocktree->WaitForWrite())
+            return AbortNode(state, "Failed to write to block index database");
+        bool fEmptyCache = fCacheLarge || fCacheCritical;
+        TRACE5(utxocache, flush_start, (int)mode, (uint64_t)pcoinsTip->GetCacheSize(), (uint64_t)pcoinsTip->DynamicMemoryUsage(), fFlushForPrune, fEmptyCache);
+        bool fWritten = fEmptyCache ? pcoinsTip->Flush() : pcoinsTip->Sync();
+        if (!fWritten)
             return AbortNode(state, "Failed to write to coin database");
+        hashLastCoinsWrite = pcoinsTip->GetBestBlock();
         nLastFlush = nNow;
+        TRACE1(utxocache, flush, GetTimeMicros() - nNow);
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -2444,9 +3265,46 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+/** SolarCoin: The summary of the tip returned by GetChainTipSnapshot(), only accessed with std::atomic_load/atomic_store */
+static CChainTipSnapshotRef chainTipSnapshot;
+
+CChainTipSnapshotRef GetChainTipSnapshot()
+{
+    return std::atomic_load(&chainTipSnapshot);
+}
+
+/** SolarCoin: Publish a new summary of chainActive's tip; call after changing it or pindexBestHeader */
+static void PublishChainTipSnapshot(const CChainParams& chainParams)
+{
+    AssertLockHeld(cs_main);
+    CBlockIndex* pindex = chainActive.Tip();
+    if (!pindex) {
+        std::atomic_store(&chainTipSnapshot, CChainTipSnapshotRef());
+        return;
+    }
+    std::shared_ptr<CChainTipSnapshot> snapshot = std::make_shared<CChainTipSnapshot>();
+    snapshot->nHeight = pindex->nHeight;
+    snapshot->hashBlock = pindex->GetBlockHash();
+    snapshot->nBits = pindex->nBits;
+    snapshot->nTime = pindex->GetBlockTime();
+    snapshot->nMedianTimePast = pindex->GetMedianTimePast();
+    snapshot->nChainWork = ArithToUint256(pindex->nChainWork);
+    snapshot->nMoneySupply = pindex->nMoneySupply;
+    // Walking back to the last proof-of-stake blocks is left until the chain is synced
+    if (pindex->nHeight > chainParams.GetConsensus().LAST_POW_BLOCK && !IsInitialBlockDownload())
+        snapshot->dNetStakeWeight = GetPoSKernelPS(pindex, chainParams.GetConsensus());
+    else
+        snapshot->dNetStakeWeight = 0;
+    snapshot->dNetworkHashPS = GetNetworkHashPS(pindex, DEFAULT_NETWORK_HASHPS_LOOKUP, chainParams.GetConsensus());
+    snapshot->dVerificationProgress = GuessVerificationProgress(chainParams.TxData(), pindex);
+    snapshot->nHeaders = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+    std::atomic_store(&chainTipSnapshot, CChainTipSnapshotRef(snapshot));
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
+    PublishChainTipSnapshot(chainParams);
 
     // New best block
     mempool.AddTransactionsUpdated(1);
@@ -2507,103 +3365,331 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
 
 }
 
-/** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
-bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, bool fBare = false)
+//! SolarCoin: Maximum memory the transactions of disconnected blocks may take while a reorganization is in progress
+static const size_t MAX_DISCONNECTED_TX_POOL_SIZE = 20 * 1000 * 1000;
+//! Number of the blocks a reorganization disconnects that are read at once
+static const size_t DISCONNECT_PREFETCH_BLOCKS = 32;
+//! Maximum number of threads reading the blocks a reorganization disconnects
+static const int MAX_DISCONNECT_PREFETCH_THREADS = 8;
+
+/**
+ * SolarCoin: The transactions of the blocks a reorganization disconnects, added back to the
+ * mempool in one pass once it is done, by UpdateMempoolForReorg(), rather than block by block.
+ *
+ * They are kept in chain order, so a transaction always comes after the ones it spends: the tip
+ * is disconnected first, so the transactions of each block go in front of those of the blocks
+ * above it. A transaction the new chain confirms again is dropped when its block is connected.
+ */
+class DisconnectedBlockTransactions
 {
-    CBlockIndex *pindexDelete = chainActive.Tip();
-    assert(pindexDelete);
-    // Read block from disk.
-    CBlock block;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
-        return AbortNode(state, "Failed to read block");
-    // Apply the block atomically to the chain state.
-    int64_t nStart = GetTimeMicros();
-    {
-        CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
-            return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
-        bool flushed = view.Flush();
-        assert(flushed);
-    }
-    LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
-    // Write the chain state to disk, if necessary.
-    if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
-        return false;
+private:
+    std::deque<CTransactionRef> queuedTx;
+    std::set<uint256> setQueued;
+    size_t nUsage;
+
+public:
+    DisconnectedBlockTransactions() : nUsage(0) {}
+
+    // Only UpdateMempoolForReorg() may empty it, which also drops what it held from the mempool
+    ~DisconnectedBlockTransactions() { assert(queuedTx.empty()); }
 
-    if (!fBare) {
-        // Resurrect mempool transactions from the disconnected block.
-        std::vector<uint256> vHashUpdate;
-        for (const auto& it : block.vtx) {
-            const CTransaction& tx = *it;
-            // ignore validation errors in resurrected transactions
-            CValidationState stateDummy;
-            if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, it, false, NULL, NULL, true)) {
-                mempool.removeRecursive(tx, MemPoolRemovalReason::REORG);
-            } else if (mempool.exists(tx.GetHash())) {
-                vHashUpdate.push_back(tx.GetHash());
+    const std::deque<CTransactionRef>& GetQueued() const { return queuedTx; }
+    bool IsQueued(const uint256& hash) const { return setQueued.count(hash) != 0; }
+
+    //! Queue the transactions of a block, disconnected after those queued before
+    void AddBlock(const std::vector<CTransactionRef>& vtx)
+    {
+        for (std::vector<CTransactionRef>::const_reverse_iterator it = vtx.rbegin(); it != vtx.rend(); ++it) {
+            // Out of the arena of the block, which the queue would keep allocated
+            CTransactionRef tx = DetachTransactionRef(*it);
+            if (!setQueued.insert(tx->GetHash()).second)
+                continue;
+            nUsage += RecursiveDynamicUsage(*tx);
+            queuedTx.push_front(tx);
+        }
+        // Past the limit, drop the transactions of the highest blocks, along with what spends
+        // them in the mempool
+        while (nUsage > MAX_DISCONNECTED_TX_POOL_SIZE && !queuedTx.empty()) {
+            CTransactionRef tx = queuedTx.back();
+            queuedTx.pop_back();
+            if (setQueued.erase(tx->GetHash())) {
+                nUsage -= RecursiveDynamicUsage(*tx);
+                mempool.removeRecursive(*tx, MemPoolRemovalReason::REORG);
             }
         }
-        // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
-        // no in-mempool children, which is generally not true when adding
-        // previously-confirmed transactions back to the mempool.
-        // UpdateTransactionsFromBlock finds descendants of any transactions in this
-        // block that were added back and cleans up the mempool state.
-        mempool.UpdateTransactionsFromBlock(vHashUpdate);
     }
 
-    // Update chainActive and related variables.
-    UpdateTip(pindexDelete->pprev, chainparams);
-    // Let wallets know transactions went from 1-confirmed to
-    // 0-confirmed or conflicted:
-    for (const auto& tx : block.vtx) {
-        GetMainSignals().SyncTransaction(*tx, pindexDelete->pprev, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+    //! Forget the transactions a block of the new chain confirms
+    void RemoveForBlock(const std::vector<CTransactionRef>& vtx)
+    {
+        if (setQueued.empty())
+            return;
+        for (const CTransactionRef& tx : vtx) {
+            if (setQueued.erase(tx->GetHash()))
+                nUsage -= RecursiveDynamicUsage(*tx);
+        }
     }
-    return true;
-}
 
-static int64_t nTimeReadFromDisk = 0;
-static int64_t nTimeConnectTotal = 0;
-static int64_t nTimeFlush = 0;
-static int64_t nTimeChainState = 0;
-static int64_t nTimePostConnect = 0;
+    void Clear()
+    {
+        queuedTx.clear();
+        setQueued.clear();
+        nUsage = 0;
+    }
+};
 
 /**
- * Used to track blocks whose transactions were applied to the UTXO state as a
- * part of a single ActivateBestChainStep call.
+ * SolarCoin: Add the transactions of the disconnected blocks back to the mempool, or only drop
+ * what spends them from it if fAddToMempool is false (the reorganization failed), then remove the
+ * mempool transactions the new tip made invalid.
  */
-struct ConnectTrace {
-    std::vector<std::pair<CBlockIndex*, std::shared_ptr<const CBlock> > > blocksConnected;
+static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool, bool fAddToMempool)
+{
+    AssertLockHeld(cs_main);
+    std::vector<uint256> vHashUpdate;
+    for (const CTransactionRef& tx : disconnectpool.GetQueued()) {
+        if (!disconnectpool.IsQueued(tx->GetHash()))
+            continue;
+        // ignore validation errors in resurrected transactions
+        CValidationState stateDummy;
+        if (!fAddToMempool || tx->IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, NULL, true)) {
+            mempool.removeRecursive(*tx, MemPoolRemovalReason::REORG);
+        } else if (mempool.exists(tx->GetHash())) {
+            vHashUpdate.push_back(tx->GetHash());
+        }
+    }
+    disconnectpool.Clear();
+    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in the
+    // disconnected blocks that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
+
+    mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+}
+
+/** SolarCoin: A block to disconnect and its undo data, read ahead of time */
+struct CDisconnectPrefetch
+{
+    CBlockIndex* pindex;
+    std::shared_ptr<CBlock> pblock;
+    CBlockUndo undo;
+    bool fUndoRead;
+
+    CDisconnectPrefetch(CBlockIndex* pindexIn) : pindex(pindexIn), fUndoRead(false) {}
 };
 
 /**
- * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
- * corresponding to pindexNew, to bypass loading it again from disk.
- *
- * The block is always added to connectTrace (either after loading from disk or by copying
- * pblock) - if that is not intended, care must be taken to remove the last entry in
- * blocksConnected in case of failure.
+ * SolarCoin: Read the blocks and undo data of vPrefetch, on several threads when there are more
+ * than one: reading a block without BLOCK_POW_VERIFIED checks its proof of work, which hashes it
+ * with scrypt. An entry that fails to read is left empty, for DisconnectTip() to read it again and
+ * report the error.
  */
-bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace)
+static void PrefetchDisconnectData(std::vector<CDisconnectPrefetch>& vPrefetch, const Consensus::Params& params)
 {
-    assert(pindexNew->pprev == chainActive.Tip());
-    // Read block from disk.
-    int64_t nTime1 = GetTimeMicros();
-    if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        connectTrace.blocksConnected.emplace_back(pindexNew, pblockNew);
+    auto readRange = [&vPrefetch, &params](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            CDisconnectPrefetch& prefetch = vPrefetch[i];
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblock, prefetch.pindex, params))
+                prefetch.pblock = pblock;
+            CDiskBlockPos pos = prefetch.pindex->GetUndoPos();
+            prefetch.fUndoRead = !pos.IsNull() && UndoReadFromDisk(prefetch.undo, pos, prefetch.pindex->pprev->GetBlockHash());
+        }
+    };
+
+    const size_t nThreads = std::max(1, std::min(GetNumCores(), MAX_DISCONNECT_PREFETCH_THREADS));
+    if (nThreads == 1 || vPrefetch.size() < 2) {
+        readRange(0, vPrefetch.size());
+        return;
+    }
+    boost::thread_group threadGroup;
+    const size_t nChunk = (vPrefetch.size() + nThreads - 1) / nThreads;
+    for (size_t nBegin = 0; nBegin < vPrefetch.size(); nBegin += nChunk)
+        threadGroup.create_thread(boost::bind<void>(readRange, nBegin, std::min(nBegin + nChunk, vPrefetch.size())));
+    threadGroup.join_all();
+}
+
+//! Below this many outputs to read, a disconnected block's coins are read on the calling thread
+static const size_t MIN_PARALLEL_DISCONNECT_COINS = 256;
+
+/**
+ * SolarCoin: Read the outputs of a block that DisconnectBlock() spends from the coins database
+ * into cache, a cache on top of it (pcoinsTip), in one batch split across several threads instead
+ * of one cache miss at a time. The outputs already in cache are skipped, as the cached entries
+ * may be newer.
+ * @return the number of coins added
+ */
+static size_t PrefetchDisconnectCoins(const CBlock& block, CCoinsViewCache& cache)
+{
+    AssertLockHeld(cs_main);
+    if (pcoinsdbview == NULL)
+        return 0;
+    std::vector<COutPoint> vOutpoints;
+    for (const auto& tx : block.vtx) {
+        // DisconnectBlock() leaves the outputs of coinstakes alone
+        if (tx->IsCoinStake())
+            continue;
+        const uint256& hash = tx->GetHash();
+        for (size_t o = 0; o < tx->vout.size(); o++) {
+            COutPoint out(hash, o);
+            if (!tx->vout[o].scriptPubKey.IsUnspendable() && !cache.HaveCoinInCache(out))
+                vOutpoints.push_back(out);
+        }
+    }
+    if (vOutpoints.size() < MIN_PARALLEL_DISCONNECT_COINS)
+        return 0;
+
+    std::vector<Coin> vCoins(vOutpoints.size());
+    const CCoinsViewDB* pview = pcoinsdbview;
+    auto readRange = [&vOutpoints, &vCoins, pview](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            try {
+                if (!pview->GetCoin(vOutpoints[i], vCoins[i]))
+                    vCoins[i].Clear();
+            } catch (const std::exception&) {
+                // Reported when DisconnectBlock() reads the coin again
+                vCoins[i].Clear();
+            }
+        }
+    };
+    const size_t nThreads = std::max(1, std::min(GetNumCores(), MAX_DISCONNECT_PREFETCH_THREADS));
+    boost::thread_group threadGroup;
+    const size_t nChunk = (vOutpoints.size() + nThreads - 1) / nThreads;
+    for (size_t nBegin = 0; nBegin < vOutpoints.size(); nBegin += nChunk)
+        threadGroup.create_thread(boost::bind<void>(readRange, nBegin, std::min(nBegin + nChunk, vOutpoints.size())));
+    threadGroup.join_all();
+
+    size_t nAdded = 0;
+    for (size_t i = 0; i < vOutpoints.size(); i++) {
+        if (!vCoins[i].IsSpent() && cache.WarmCoin(vOutpoints[i], std::move(vCoins[i])))
+            nAdded++;
+    }
+    return nAdded;
+}
+
+/**
+ * Disconnect chainActive's tip.
+ * SolarCoin: The transactions of the block are queued in disconnectpool, for
+ * UpdateMempoolForReorg() to add them back to the mempool once the reorganization is done; with
+ * no disconnectpool they are not. pprefetch, if given, holds the block and undo data read ahead
+ * of time.
+ */
+bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions* disconnectpool, CDisconnectPrefetch* pprefetch = NULL)
+{
+    CBlockIndex *pindexDelete = chainActive.Tip();
+    assert(pindexDelete);
+    assert(!pprefetch || pprefetch->pindex == pindexDelete);
+    // Read block from disk.
+    std::shared_ptr<CBlock> pblock = pprefetch ? pprefetch->pblock : std::shared_ptr<CBlock>();
+    if (!pblock) {
+        pblock = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblock, pindexDelete, chainparams.GetConsensus()))
+            return AbortNode(state, "Failed to read block");
+    }
+    const CBlock& block = *pblock;
+    // Apply the block atomically to the chain state.
+    int64_t nStart = GetTimeMicros();
+    size_t nPrefetched = PrefetchDisconnectCoins(block, *pcoinsTip);
+    {
+        CCoinsViewCache view(pcoinsTip);
+        CBlockUndo blockundo;
+        CBlockUndo* pblockundoIn = pprefetch && pprefetch->fUndoRead ? &pprefetch->undo : NULL;
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, (paddressindex || pcoinstatsindex) ? &blockundo : NULL, pblockundoIn))
+            return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        bool flushed = view.Flush();
+        assert(flushed);
+        if (paddressindex && !paddressindex->DisconnectBlock(block, blockundo, pindexDelete))
+            return AbortNode(state, "Failed to write to the address index");
+        if (pcoinstatsindex && !pcoinstatsindex->DisconnectBlock(block, blockundo, pindexDelete))
+            return AbortNode(state, "Failed to write to the coin statistics index");
+    }
+    LogPrint("bench", "- Disconnect block: %u coins read ahead, %.2fms\n", (unsigned int)nPrefetched, (GetTimeMicros() - nStart) * 0.001);
+    RecordBlockPhase(BLOCK_PHASE_DISCONNECT, GetTimeMicros() - nStart);
+    // Write the chain state to disk, if necessary.
+    if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
+        return false;
+
+    if (disconnectpool)
+        disconnectpool->AddBlock(block.vtx);
+
+    // Update chainActive and related variables.
+    UpdateTip(pindexDelete->pprev, chainparams);
+    // Let wallets know transactions went from 1-confirmed to
+    // 0-confirmed or conflicted:
+    for (const auto& tx : block.vtx) {
+        GetMainSignals().SyncTransaction(*tx, pindexDelete->pprev, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+    }
+    return true;
+}
+
+static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimeConnectTotal = 0;
+static int64_t nTimeFlush = 0;
+static int64_t nTimeChainState = 0;
+static int64_t nTimePostConnect = 0;
+//! SolarCoin: when the first block was connected, for the throughput in LogBlockConnectSummary()
+static int64_t nTimeFirstConnect = 0;
+
+/**
+ * Used to track blocks whose transactions were applied to the UTXO state as a
+ * part of a single ActivateBestChainStep call.
+ */
+struct PerBlockConnectTrace {
+    CBlockIndex* pindex;
+    std::shared_ptr<const CBlock> pblock;
+    //! SolarCoin: The undo data ConnectBlock() built, handed to the BlockConnected listeners
+    std::shared_ptr<const CBlockUndo> pblockundo;
+    PerBlockConnectTrace(CBlockIndex* pindexIn, const std::shared_ptr<const CBlock>& pblockIn) : pindex(pindexIn), pblock(pblockIn) {}
+};
+struct ConnectTrace {
+    std::vector<PerBlockConnectTrace> blocksConnected;
+};
+
+/**
+ * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
+ * corresponding to pindexNew, to bypass loading it again from disk.
+ *
+ * The block is always added to connectTrace (either after loading from disk or by copying
+ * pblock) - if that is not intended, care must be taken to remove the last entry in
+ * blocksConnected in case of failure.
+ */
+bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool)
+{
+    PROFILE_SCOPE("ConnectTip");
+    assert(pindexNew->pprev == chainActive.Tip());
+    // SolarCoin: Move the inputs read ahead of time to pcoinsTip, and take the block if the prefetch read it.
+    int64_t nTime0 = GetTimeMicros();
+    if (nTimeFirstConnect == 0)
+        nTimeFirstConnect = nTime0;
+    std::shared_ptr<const CBlock> pblockPrefetched = pblock;
+    size_t nPrefetched = coinsprefetcher.Apply(pindexNew->GetBlockHash(), *pcoinsTip, pblockPrefetched);
+    IncrementBlockCounter(BLOCK_COUNTER_COINS_PREFETCHED, nPrefetched);
+    // Read block from disk.
+    int64_t nTime1 = GetTimeMicros();
+    LogPrint("bench", "  - Prefetch: %u coins, %.2fms\n", (unsigned int)nPrefetched, (nTime1 - nTime0) * 0.001);
+    RecordBlockPhase(BLOCK_PHASE_PREFETCH, nTime1 - nTime0);
+    if (!pblockPrefetched) {
+        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+        connectTrace.blocksConnected.emplace_back(pindexNew, pblockNew);
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
     } else {
-        connectTrace.blocksConnected.emplace_back(pindexNew, pblock);
+        connectTrace.blocksConnected.emplace_back(pindexNew, pblockPrefetched);
     }
-    const CBlock& blockConnecting = *connectTrace.blocksConnected.back().second;
+    const CBlock& blockConnecting = *connectTrace.blocksConnected.back().pblock;
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_READ, nTime2 - nTime1);
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        std::shared_ptr<CBlockUndo> pblockundo = std::make_shared<CBlockUndo>();
+        const CBlockUndo& blockundo = *pblockundo;
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, pblockundo.get());
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2614,25 +3700,86 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         bool flushed = view.Flush();
         assert(flushed);
+        if (paddressindex && !paddressindex->ConnectBlock(blockConnecting, blockundo, pindexNew))
+            return AbortNode(state, "Failed to write to the address index");
+        if (pcoinstatsindex && !pcoinstatsindex->ConnectBlock(blockConnecting, blockundo, pindexNew))
+            return AbortNode(state, "Failed to write to the coin statistics index");
+        connectTrace.blocksConnected.back().pblockundo = pblockundo;
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_FLUSH, nTime4 - nTime3);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_CHAINSTATE, nTime5 - nTime4);
     // Remove conflicting transactions from the mempool.;
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+    disconnectpool.RemoveForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_POSTCONNECT, nTime6 - nTime5);
+    RecordBlockPhase(BLOCK_PHASE_CONNECT_TIP, nTime6 - nTime1);
+    uint64_t nInputs = 0;
+    for (const auto& tx : blockConnecting.vtx)
+        nInputs += tx->vin.size();
+    IncrementBlockCounter(BLOCK_COUNTER_BLOCKS);
+    IncrementBlockCounter(BLOCK_COUNTER_TRANSACTIONS, blockConnecting.vtx.size());
+    IncrementBlockCounter(BLOCK_COUNTER_INPUTS, nInputs);
     return true;
 }
 
+//! SolarCoin: Peak resident set size of the process in bytes, 0 if unknown
+static uint64_t GetPeakResidentSize()
+{
+#ifndef WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef MAC_OSX
+    return usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+void LogBlockConnectSummary()
+{
+    LOCK(cs_main);
+    uint64_t nBlocks = GetBlockCounter(BLOCK_COUNTER_BLOCKS);
+    uint64_t nInputs = GetBlockCounter(BLOCK_COUNTER_INPUTS);
+    double dElapsed = nTimeFirstConnect ? (GetTimeMicros() - nTimeFirstConnect) * 0.000001 : 0;
+    LogPrintf("Block connect summary: %u blocks, %u transactions, %u inputs in %.3fs (%.2f blocks/s, %.1f txin/s), -dbcache=%d MiB, %d script check threads\n",
+        nBlocks, GetBlockCounter(BLOCK_COUNTER_TRANSACTIONS), nInputs, dElapsed,
+        dElapsed > 0 ? nBlocks / dElapsed : 0, dElapsed > 0 ? nInputs / dElapsed : 0,
+        GetArg("-dbcache", nDefaultDbCache), nScriptCheckThreads ? nScriptCheckThreads : 1);
+    for (int i = 0; i < BLOCK_PHASE_COUNT; i++) {
+        BlockProcessingPhase phase = (BlockProcessingPhase)i;
+        const CLatencyHistogram& hist = GetBlockPhaseHistogram(phase);
+        if (hist.GetCount() > 0)
+            LogPrintf("Block connect summary: %-14s %8u x, total %10.3fs, p50 %9.3fms, p99 %9.3fms, max %9.3fms\n", GetBlockPhaseName(phase), hist.GetCount(),
+                hist.GetTotal() * 0.000001, hist.GetPercentile(0.5) * 0.001, hist.GetPercentile(0.99) * 0.001, hist.GetMax() * 0.001);
+    }
+    if (pcoinsTip) {
+        uint64_t nHits = pcoinsTip->GetFetchHits(), nMisses = pcoinsTip->GetFetchMisses();
+        LogPrintf("Block connect summary: coins cache %u hits, %u misses (%.2f%% hit rate), %.1f MiB of %.1f MiB used\n", nHits, nMisses,
+            nHits + nMisses ? 100.0 * nHits / (nHits + nMisses) : 0, pcoinsTip->DynamicMemoryUsage() / 1048576.0, nCoinCacheUsage / 1048576.0);
+    }
+    uint64_t nStakeHits = GetBlockCounter(BLOCK_COUNTER_STAKE_PREVOUT_HIT), nStakeMisses = GetBlockCounter(BLOCK_COUNTER_STAKE_PREVOUT_MISS);
+    LogPrintf("Block connect summary: stake prevout cache %u hits, %u misses (%.2f%% hit rate), %u coins prefetched\n", nStakeHits, nStakeMisses,
+        nStakeHits + nStakeMisses ? 100.0 * nStakeHits / (nStakeHits + nStakeMisses) : 0, GetBlockCounter(BLOCK_COUNTER_COINS_PREFETCHED));
+    LogPrintf("Block connect summary: peak resident size %.1f MiB\n", GetPeakResidentSize() / 1048576.0);
+}
+
 /**
  * Return the tip of the chain with the most work in it, that isn't
  * known to be invalid (it's however far from certain to be valid).
@@ -2716,11 +3863,24 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
 
     // Disconnect active blocks which are no longer in the best chain.
+    // SolarCoin: Their blocks and undo data are read together beforehand, and their transactions
+    // go back to the mempool once the new blocks are connected.
     bool fBlocksDisconnected = false;
+    DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams))
-            return false;
-        fBlocksDisconnected = true;
+        std::vector<CDisconnectPrefetch> vPrefetch;
+        for (CBlockIndex* pindexIter = chainActive.Tip(); pindexIter && pindexIter != pindexFork && vPrefetch.size() < DISCONNECT_PREFETCH_BLOCKS; pindexIter = pindexIter->pprev)
+            vPrefetch.emplace_back(pindexIter);
+        PrefetchDisconnectData(vPrefetch, chainparams.GetConsensus());
+        for (CDisconnectPrefetch& prefetch : vPrefetch) {
+            if (!DisconnectTip(state, chainparams, &disconnectpool, &prefetch)) {
+                UpdateMempoolForReorg(disconnectpool, false);
+                return false;
+            }
+            // The undo data was moved out, free the block as well
+            prefetch.pblock.reset();
+            fBlocksDisconnected = true;
+        }
     }
 
     // Build list of new blocks to connect.
@@ -2741,8 +3901,14 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace)) {
+        for (int i = vpindexToConnect.size() - 1; i >= 0; i--) {
+            CBlockIndex *pindexConnect = vpindexToConnect[i];
+            // SolarCoin: Read the inputs of this block and the next ones while it is connected
+            if (nCoinsPrefetchThreads > 0 && pcoinsdbview != NULL) {
+                for (int j = i; j >= 0 && j >= i - COINS_PREFETCH_AHEAD; j--)
+                    coinsprefetcher.Prefetch(vpindexToConnect[j], vpindexToConnect[j] == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), pcoinsdbview, chainparams.GetConsensus());
+            }
+            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -2755,6 +3921,9 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
                     break;
                 } else {
                     // A system error occurred (disk space, database error, ...).
+                    // SolarCoin: Only drop what spends the disconnected transactions from the mempool
+                    if (fBlocksDisconnected)
+                        UpdateMempoolForReorg(disconnectpool, false);
                     return false;
                 }
             } else {
@@ -2768,10 +3937,8 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
     }
 
-    if (fBlocksDisconnected) {
-        mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
-        LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
-    }
+    if (fBlocksDisconnected)
+        UpdateMempoolForReorg(disconnectpool, true);
     mempool.check(pcoinsTip);
 
     // Callbacks/notifications for a new best chain.
@@ -2810,6 +3977,7 @@ static void NotifyHeaderTip() {
  * that is already loaded (to avoid loading it again from disk).
  */
 bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock) {
+    PROFILE_SCOPE("ActivateBestChain");
     // Note that while we're often called here from ProcessNewBlock, this is
     // far from a guarantee. Things in the P2P/RPC will often end up calling
     // us in the middle of ProcessNewBlock - do not assume pblock is set
@@ -2855,6 +4023,7 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
             }
             pindexNewTip = chainActive.Tip();
             pindexFork = chainActive.FindFork(pindexOldTip);
+            UpdateStakeModifierIndex(chainActive);
             fInitialDownload = IsInitialBlockDownload();
 
             // throw all transactions though the signal-interface
@@ -2862,11 +4031,12 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
             } // MemPoolConflictRemovalTracker destroyed and conflict evictions are notified
 
             // Transactions in the connnected block are notified
-            for (const auto& pair : connectTrace.blocksConnected) {
-                assert(pair.second);
-                const CBlock& block = *(pair.second);
+            for (const auto& trace : connectTrace.blocksConnected) {
+                assert(trace.pblock);
+                const CBlock& block = *(trace.pblock);
                 for (unsigned int i = 0; i < block.vtx.size(); i++)
-                    GetMainSignals().SyncTransaction(*block.vtx[i], pair.first, i);
+                    GetMainSignals().SyncTransaction(*block.vtx[i], trace.pindex, i);
+                GetMainSignals().BlockConnected(trace.pblock, trace.pindex, trace.pblockundo);
             }
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
@@ -2880,6 +4050,14 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
         if (pindexFork != pindexNewTip) {
             uiInterface.NotifyBlockTip(fInitialDownload, pindexNewTip);
         }
+
+        // SolarCoin: End a replay of blocks at -stopatheight, see contrib/devtools/replay-blocks.sh
+        int nStopAtHeight = GetArg("-stopatheight", DEFAULT_STOPATHEIGHT);
+        if (nStopAtHeight && pindexNewTip && pindexNewTip->nHeight >= nStopAtHeight && !ShutdownRequested()) {
+            LogPrintf("%s: reached -stopatheight=%d, shutting down\n", __func__, nStopAtHeight);
+            LogBlockConnectSummary();
+            StartShutdown();
+        }
     } while (pindexNewTip != pindexMostWork);
     CheckBlockIndex(chainparams.GetConsensus());
 
@@ -2930,6 +4108,7 @@ bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, C
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
 
+    DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Contains(pindex)) {
         CBlockIndex *pindexWalk = chainActive.Tip();
         pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
@@ -2937,13 +4116,14 @@ bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, C
         setBlockIndexCandidates.erase(pindexWalk);
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(state, chainparams)) {
-            mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+        if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+            UpdateMempoolForReorg(disconnectpool, false);
             return false;
         }
     }
 
-    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    // SolarCoin: Add the transactions of the disconnected blocks back to the mempool, oldest first
+    UpdateMempoolForReorg(disconnectpool, true);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
     // add it again.
@@ -2956,7 +4136,6 @@ bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, C
     }
 
     InvalidChainFound(pindex);
-    mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
     uiInterface.NotifyBlockTip(IsInitialBlockDownload(), pindex->pprev);
     return true;
 }
@@ -3003,15 +4182,12 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const CChainParams& chai
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = NewBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
@@ -3019,8 +4195,10 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const CChainParams& chai
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
+        pindexNew->BuildPrevOtherType(chainparams.GetConsensus().LAST_POW_BLOCK);
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
+    pindexNew->BuildMedianTimePast();
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
 
     // ppcoin: compute stake entropy bit for stake modifier
@@ -3040,26 +4218,21 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const CChainParams& chai
 //    pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
 //    pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew, chainparams.GetConsensus());
 
-    // ppcoin: record proof-of-stake hash value
-    if (pindexNew->nHeight > chainparams.GetConsensus().LAST_POW_BLOCK)
-    {
-        LogPrintf("DEBUG: mapProofOfStake. Looking for block hash %s, at height %d, count is %d, hashProofOfStake is %s\n",hash.ToString().c_str(),pindexNew->nHeight,mapProofOfStake.count(hash),mapProofOfStake[hash].ToString().c_str());
-        //if (!mapProofOfStake.count(hash))
-        //    return error("AddToBlockIndex() : hashProofOfStake not found in map");
-        //pindexNew->hashProofOfStake = mapProofOfStake[hash];
-    }
+    // ppcoin: the proof-of-stake hash value is recorded by ProcessNewBlock() once the kernel is checked
 
     if (pindexNew->nHeight > 0)
         if (!fTestNet && !CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
             LogPrintf("%s: Rejected by stake modifier checkpoint height=%d, modifier=%016x\n", __func__, pindexNew->nHeight, nStakeModifier);
 
     // SolarCoin: CBlockIndex::IsProofOfStake is not valid during header download. Use height instead.
-    if (pindexNew->nHeight > chainparams.GetConsensus().LAST_POW_BLOCK)
-        setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    if (pindexNew->IsProofOfStake() || pindexNew->nHeight > chainparams.GetConsensus().LAST_POW_BLOCK)
+        setStakeSeen.insert(pindexNew);
 
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork) {
         pindexBestHeader = pindexNew;
+        PublishChainTipSnapshot(chainparams);
+    }
 
     setDirtyBlockIndex.insert(pindexNew);
 
@@ -3069,11 +4242,15 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const CChainParams& chai
 //Solarcoin added by ging 2018-09-18
 void ComputeStakeModifier(CBlockIndex *pindexNew, uint64_t &nStakeModifier, bool& fGeneratedStakeModifier, const CChainParams& chainparams)
 {
+    int64_t nTimeStart = GetTimeMicros();
     if (!ComputeNextStakeModifier(pindexNew, nStakeModifier, fGeneratedStakeModifier, chainparams.GetConsensus()))
         LogPrintf("%s: ComputeNextStakeModifier() failed at nHeight=%d\n", __func__, pindexNew->nHeight);
 
     pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
     pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew, chainparams.GetConsensus());
+    pindexNew->nStatus |= BLOCK_HAVE_STAKE_CHECKSUM;
+    setDirtyBlockIndex.insert(pindexNew);
+    RecordBlockPhase(BLOCK_PHASE_STAKE_MODIFIER, GetTimeMicros() - nTimeStart);
 }
 
 
@@ -3161,16 +4338,16 @@ bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned int nAdd
         vinfoBlockFile[nFile].nSize += nAddSize;
 
     if (!fKnown) {
-        unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
-        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
+        unsigned int nOldChunks = (pos.nPos + nBlockFileChunkSize - 1) / nBlockFileChunkSize;
+        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + nBlockFileChunkSize - 1) / nBlockFileChunkSize;
         if (nNewChunks > nOldChunks) {
             if (fPruneMode)
                 fCheckForPruning = true;
-            if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
+            if (CheckDiskSpace(nNewChunks * nBlockFileChunkSize - pos.nPos)) {
                 FILE *file = OpenBlockFile(pos);
                 if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
+                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * nBlockFileChunkSize, pos.nFile);
+                    AllocateFileRange(file, pos.nPos, nNewChunks * nBlockFileChunkSize - pos.nPos);
                     fclose(file);
                 }
             }
@@ -3194,16 +4371,16 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     nNewSize = vinfoBlockFile[nFile].nUndoSize += nAddSize;
     setDirtyFileInfo.insert(nFile);
 
-    unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
-    unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
+    unsigned int nOldChunks = (pos.nPos + nUndoFileChunkSize - 1) / nUndoFileChunkSize;
+    unsigned int nNewChunks = (nNewSize + nUndoFileChunkSize - 1) / nUndoFileChunkSize;
     if (nNewChunks > nOldChunks) {
         if (fPruneMode)
             fCheckForPruning = true;
-        if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
+        if (CheckDiskSpace(nNewChunks * nUndoFileChunkSize - pos.nPos)) {
             FILE *file = OpenUndoFile(pos);
             if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
+                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * nUndoFileChunkSize, pos.nFile);
+                AllocateFileRange(file, pos.nPos, nNewChunks * nUndoFileChunkSize - pos.nPos);
                 fclose(file);
             }
         }
@@ -3214,22 +4391,95 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
+/**
+ * SolarCoin: Check the scrypt proof of work of up to SCRYPT_MULTI_MAX_WAYS headers, hashed together.
+ * fValid[i] is set if the hash of *pheaders[i] meets its target.
+ */
+static void CheckProofOfWorkMulti(const CBlockHeader* const pheaders[], size_t n, const Consensus::Params& consensusParams, bool fValid[])
+{
+    assert(n <= (size_t)SCRYPT_MULTI_MAX_WAYS);
+    const char* input[SCRYPT_MULTI_MAX_WAYS];
+    char* output[SCRYPT_MULTI_MAX_WAYS];
+    uint256 hash[SCRYPT_MULTI_MAX_WAYS];
+    for (size_t i = 0; i < n; i++) {
+        input[i] = BEGIN(pheaders[i]->nVersion);
+        output[i] = BEGIN(hash[i]);
+    }
+    scrypt_1024_1_1_256_multi(input, output, n, GetScryptScratchpad());
+    for (size_t i = 0; i < n; i++)
+        fValid[i] = CheckProofOfWork(hash[i], pheaders[i]->nBits, consensusParams);
+}
+
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
-    // SolarCoin: Only check PoW and instantiate a block with the header to get the PoW hash.
+    // SolarCoin: Only check PoW.
     bool fPoW = block.nVersion <= CBlockHeader::LEGACY_VERSION_2 ? true : false;
     // Check proof of work matches claimed amount
     if (fPoW && fCheckPOW) {
-        CBlock b(block);
-        if (!CheckProofOfWork(b.GetPoWHash(), block.nBits, consensusParams))
+        if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
             return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
     }
 
     return true;
 }
 
+/** SolarCoin: Whether CheckBlock() runs CheckTransaction() on a transaction of the block, see CBlock::fTemplateTxsChecked */
+static bool IsBlockTransactionCheckNeeded(const CBlock& block, const CTransaction& tx)
+{
+    return !block.fTemplateTxsChecked || tx.IsCoinBase() || tx.IsCoinStake();
+}
+
+bool CBlockCheck::operator()()
+{
+    if (nBegin == nEnd) {
+        bool mutated;
+        return BlockMerkleRoot(*pblock, &mutated) == pblock->hashMerkleRoot && !mutated;
+    }
+    *pnSigOps = 0;
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CValidationState state;
+        if (IsBlockTransactionCheckNeeded(*pblock, *pblock->vtx[i]) && !CheckTransaction(*pblock->vtx[i], state, false))
+            return false;
+        *pnSigOps += GetLegacySigOpCount(*pblock->vtx[i]);
+    }
+    return true;
+}
+
+/**
+ * SolarCoin: Check the merkle root and the transactions of a large block on the block check threads,
+ * and count its legacy sigops. Returns false if any check failed, or if the queue is not available
+ * (no -par threads, or in use by another thread). CheckBlock() then checks the block serially.
+ */
+static bool CheckBlockTransactionsParallel(const CBlock& block, unsigned int& nSigOps)
+{
+    if (!nScriptCheckThreads || block.vtx.size() <= BLOCK_CHECK_TXS_PER_JOB)
+        return false;
+    TRY_LOCK(cs_blockcheckqueue, lockQueue);
+    if (!lockQueue)
+        return false;
+
+    size_t nJobs = (block.vtx.size() + BLOCK_CHECK_TXS_PER_JOB - 1) / BLOCK_CHECK_TXS_PER_JOB;
+    std::vector<unsigned int> vSigOps(nJobs);
+    std::vector<CBlockCheck> vChecks;
+    vChecks.reserve(nJobs + 1);
+    vChecks.push_back(CBlockCheck(block, 0, 0, NULL));
+    for (size_t i = 0; i < nJobs; i++)
+        vChecks.push_back(CBlockCheck(block, i * BLOCK_CHECK_TXS_PER_JOB, std::min<size_t>((i + 1) * BLOCK_CHECK_TXS_PER_JOB, block.vtx.size()), &vSigOps[i]));
+
+    CCheckQueueControl<CBlockCheck> control(&blockcheckqueue, GetBlockCheckPriority());
+    control.Add(vChecks);
+    if (!control.Wait())
+        return false;
+
+    nSigOps = 0;
+    for (unsigned int n : vSigOps)
+        nSigOps += n;
+    return true;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
 {
+    PROFILE_SCOPE("CheckBlock");
     // These are checks that are independent of context.
 
     if (block.fChecked)
@@ -3240,8 +4490,13 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW))
         return false;
 
+    // SolarCoin: Large blocks are checked in parallel first; the serial checks below then only
+    // run for small blocks, or to find the error of a block that failed
+    unsigned int nSigOps = 0;
+    bool fCheckedTransactions = fCheckMerkleRoot && CheckBlockTransactionsParallel(block, nSigOps);
+
     // Check the merkle root.
-    if (fCheckMerkleRoot) {
+    if (fCheckMerkleRoot && !fCheckedTransactions) {
         bool mutated;
         uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
@@ -3271,16 +4526,17 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
         if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
-    // Check transactions
-    for (const auto& tx : block.vtx)
-        if (!CheckTransaction(*tx, state, false))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    if (!fCheckedTransactions) {
+        // Check transactions
+        for (const auto& tx : block.vtx)
+            if (IsBlockTransactionCheckNeeded(block, *tx) && !CheckTransaction(*tx, state, false))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
 
-    unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(*tx);
+        for (const auto& tx : block.vtx)
+        {
+            nSigOps += GetLegacySigOpCount(*tx);
+        }
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
@@ -3291,6 +4547,33 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     return true;
 }
 
+/**
+ * SolarCoin: CheckBlock() of up to SCRYPT_MULTI_MAX_WAYS blocks, with the scrypt hashes of the proof
+ * of work ones computed together. Blocks that fail are left unchecked; CheckBlock() reports the
+ * error when they are checked again.
+ */
+static void CheckBlocksMulti(const std::vector<std::shared_ptr<CBlock> >& vpblock, const Consensus::Params& consensusParams)
+{
+    const CBlockHeader* pheaders[SCRYPT_MULTI_MAX_WAYS];
+    bool fValid[SCRYPT_MULTI_MAX_WAYS];
+    size_t nPoW = 0;
+    for (const auto& pblock : vpblock) {
+        if (pblock->nVersion <= CBlockHeader::LEGACY_VERSION_2)
+            pheaders[nPoW++] = pblock.get();
+    }
+    CheckProofOfWorkMulti(pheaders, nPoW, consensusParams, fValid);
+
+    size_t nPoWChecked = 0;
+    for (const auto& pblock : vpblock) {
+        CValidationState state;
+        if (pblock->nVersion > CBlockHeader::LEGACY_VERSION_2) {
+            CheckBlock(*pblock, state, consensusParams);
+        } else if (fValid[nPoWChecked++] && CheckBlock(*pblock, state, consensusParams, false)) {
+            pblock->fChecked = true;
+        }
+    }
+}
+
 static bool CheckIndexAgainstCheckpoint(const CBlockIndex* pindexPrev, CValidationState& state, const CChainParams& chainparams, const uint256& hash)
 {
     if (*pindexPrev->phashBlock == chainparams.GetConsensus().hashGenesisBlock)
@@ -3367,6 +4650,20 @@ std::vector<unsigned char> GenerateCoinbaseCommitment(CBlock& block, const CBloc
     return commitment;
 }
 
+/** SolarCoin: The timestamp checks of ContextualCheckBlockHeader(), which ProcessNewBlock() also runs before the kernel check */
+static bool CheckBlockTime(const CBlockHeader& block, CValidationState& state, const CBlockIndex* pindexPrev, int64_t nAdjustedTime)
+{
+    // Check timestamp against prev
+    if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast())
+        return state.Invalid(false, REJECT_INVALID, "time-too-old", "block's timestamp is too early");
+
+    // Check timestamp
+    if (block.GetBlockTime() > nAdjustedTime + 2 * 60 * 60)
+        return state.Invalid(false, REJECT_INVALID, "time-too-new", "block timestamp too far in the future");
+
+    return true;
+}
+
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev, int64_t nAdjustedTime)
 {
     const int nHeight = pindexPrev == NULL ? 0 : pindexPrev->nHeight + 1;
@@ -3381,13 +4678,8 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
             return state.DoS(100, false, REJECT_INVALID, "bad-diffbits", false, "incorrect proof of stake");
     }
 
-    // Check timestamp against prev
-    if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast())
-        return state.Invalid(false, REJECT_INVALID, "time-too-old", "block's timestamp is too early");
-
-    // Check timestamp
-    if (block.GetBlockTime() > nAdjustedTime + 2 * 60 * 60)
-        return state.Invalid(false, REJECT_INVALID, "time-too-new", "block timestamp too far in the future");
+    if (!CheckBlockTime(block, state, pindexPrev, nAdjustedTime))
+        return false;
 
     // SolarCoin: Legacy block version rules
     if (block.nVersion < CBlockHeader::LEGACY_VERSION_3) {
@@ -3533,7 +4825,17 @@ bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned int nRe
     return (nFound >= nRequired);
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CHeaderPoWCheck::operator()()
+{
+    bool fValid[SCRYPT_MULTI_MAX_WAYS];
+    CheckProofOfWorkMulti(pheaders, nHeaders, *pparams, fValid);
+    for (size_t i = 0; i < nHeaders; i++)
+        *pfValid[i] = fValid[i];
+    return true;
+}
+
+/** Accept a header into mapBlockIndex. fCheckPOW=false if its proof of work has already been verified. */
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3552,7 +4854,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3594,12 +4896,44 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
+    PROFILE_SCOPE("ProcessNewBlockHeaders");
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    // SolarCoin: scrypt is by far the most expensive part of accepting a PoW header. Verify the
+    // PoW headers we don't know yet on the header check threads, before taking cs_main for the
+    // contextual checks. Headers that fail here are checked again serially to report the error.
+    std::vector<char> vPoWValid(headers.size(), 0);
+    if (nScriptCheckThreads && headers.size() > 1) {
+        std::vector<size_t> vToCheck;
+        {
+            LOCK(cs_main);
+            for (size_t i = 0; i < headers.size(); i++) {
+                if (headers[i].nVersion <= CBlockHeader::LEGACY_VERSION_2 && !mapBlockIndex.count(headers[i].GetHash()))
+                    vToCheck.push_back(i);
+            }
+        }
+        // A few per check, which the multi-buffer scrypt code hashes in about the time of one
+        std::vector<CHeaderPoWCheck> vChecks;
+        vChecks.reserve((vToCheck.size() + SCRYPT_MULTI_MAX_WAYS - 1) / SCRYPT_MULTI_MAX_WAYS);
+        for (size_t i : vToCheck) {
+            if (vChecks.empty() || vChecks.back().IsFull())
+                vChecks.push_back(CHeaderPoWCheck(chainparams.GetConsensus()));
+            vChecks.back().Add(headers[i], &vPoWValid[i]);
+        }
+        if (vToCheck.size() > 1) {
+            LOCK(cs_headercheckqueue);
+            CCheckQueueControl<CHeaderPoWCheck> control(&headercheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        }
+    }
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, !vPoWValid[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3612,8 +4946,74 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
-/** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
-static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
+/**
+ * SolarCoin: Whether a PoST block is signed by the pay-to-pubkey key of its coinstake, as the stake
+ * miner signs them. This is not a consensus rule, it only decides whether a block is relayed
+ * before it is connected.
+ */
+static bool IsBlockSignedByStaker(const CBlock& block)
+{
+    if (!block.IsProofOfStake() || block.vtx[1]->vout.size() < 2 || block.vchBlockSig.empty())
+        return false;
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(block.vtx[1]->vout[1].scriptPubKey, whichType, vSolutions) || whichType != TX_PUBKEY)
+        return false;
+    return CPubKey(vSolutions[0]).Verify(block.GetHash(), block.vchBlockSig);
+}
+
+bool CheckNewBlockProofOfStake(const CBlock& block, CValidationState& state, bool& fCheckedProofOfStake, uint256& hashProofOfStake, bool& fRelayEarly, int64_t* pnProofFailedMicros, const Consensus::Params& params)
+{
+    if (fCheckedProofOfStake || !block.IsProofOfStake())
+        return true;
+    {
+        // Duplicate stakes are rejected by the caller without the kernel check
+        LOCK(cs_main);
+        BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+        if (miPrev == mapBlockIndex.end() || setStakeSeen.count(block.GetProofOfStake()))
+            return true;
+        // Timestamps ContextualCheckBlockHeader() rejects are rejected here, before any kernel lookup
+        if (!CheckBlockTime(block, state, miPrev->second, GetAdjustedTime()))
+            return false;
+    }
+
+    uint256 targetProofOfStake;
+    int64_t nTimeProofStart = GetTimeMicros();
+    bool fProofOfStake = CheckProofOfStake(*block.vtx[1], block.nBits, hashProofOfStake, targetProofOfStake, params);
+    int64_t nTimeProof = GetTimeMicros() - nTimeProofStart;
+    RecordBlockPhase(BLOCK_PHASE_PROOF_OF_STAKE, nTimeProof);
+    TRACE4(validation, check_proof_of_stake, block.vtx[1]->GetHash().begin(), hashProofOfStake.begin(), fProofOfStake, nTimeProof);
+    if (!fProofOfStake) {
+        if (pnProofFailedMicros) *pnProofFailedMicros = nTimeProof;
+        LogPrintf("WARNING: ProcessNewBlock() : CheckProofOfStake() failed for block=%s\n", block.GetHash().ToString().c_str());
+        return false;
+    }
+    LogPrintf("ProcessNewBlock() - Is ProofOfStake, block is in index, computed proofOfStake is %s\n",hashProofOfStake.ToString());
+    fCheckedProofOfStake = true;
+    // SolarCoin: Checked here too, as only signed blocks are relayed early
+    fRelayEarly = IsBlockSignedByStaker(block);
+    return true;
+}
+
+/** SolarCoin: The result of ProcessNewBlock() for a PoST block that failed CheckNewBlockProofOfStake() */
+static bool ProofOfStakeFailed(const CBlock& block, const CValidationState& state, int64_t nTimeStart, int64_t* pnProofFailedMicros)
+{
+    // do not error here as we expect this during initial block download
+    if (!state.IsInvalid())
+        return false;
+    // The time spent on a block with a bad timestamp is charged to the peer like a failed kernel
+    if (pnProofFailedMicros) *pnProofFailedMicros = std::max<int64_t>(1, GetTimeMicros() - nTimeStart);
+    LOCK(cs_main);
+    GetMainSignals().BlockChecked(block, state);
+    return error("ProcessNewBlock: %s", FormatStateMessage(state));
+}
+
+/**
+ * Store block on disk. If dbp is non-NULL, the file is known to already reside on disk.
+ * SolarCoin: fRelayEarly tells a PoST block passed its kernel and signature checks, so it can be
+ * relayed before it is connected like a PoW block.
+ */
+static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock, bool fRelayEarly = false)
 {
     const CBlock& block = *pblock;
 
@@ -3623,7 +5023,8 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
     CBlockIndex *pindexDummy = NULL;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    // SolarCoin: A block that passed CheckBlock() already had its scrypt hash checked
+    if (!AcceptBlockHeader(block, state, chainparams, &pindex, !block.fChecked))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3653,7 +5054,10 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
     }
     if (fNewBlock) *fNewBlock = true;
 
-    if (!CheckBlock(block, state, chainparams.GetConsensus()) ||
+    // SolarCoin: AcceptBlockHeader() checked the scrypt hash of the header already, only check it
+    // again for blocks that are not assumed valid
+    bool fAssumedValid = IsBlockAssumedValid(pindex, chainparams.GetConsensus());
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fAssumedValid) ||
         !ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -3662,9 +5066,14 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
         return error("%s: %s", __func__, FormatStateMessage(state));
     }
 
+    // SolarCoin: The proof of work is accepted, whether scrypt ran here, ran earlier or was skipped
+    // for an assumed valid block; remember it so later reads skip it the same way
+    if (block.IsProofOfWork())
+        pindex->nStatus |= BLOCK_POW_VERIFIED;
+
     // Header is valid/has work, merkle tree and segwit merkle tree are good...RELAY NOW
     // (but if it does not build on our best tip, let the SendMessages loop relay it)
-    if (!IsInitialBlockDownload() && chainActive.Tip() == pindex->pprev)
+    if (!IsInitialBlockDownload() && chainActive.Tip() == pindex->pprev && (block.IsProofOfWork() || fRelayEarly))
         GetMainSignals().NewPoWValidBlock(pindex, pblock);
 
     int nHeight = pindex->nHeight;
@@ -3692,18 +5101,30 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
     return true;
 }
 
-bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool *fNewBlock)
+bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool *fNewBlock, int64_t* pnProofFailedMicros)
 {
+    PROFILE_SCOPE("ProcessNewBlock");
+    int64_t nTimeStart = GetTimeMicros();
     {
-        bool fhashProofOfStake = false; //  ppcoin: flag to update BlockIndex
         CBlockIndex *pindex = NULL;
         if (fNewBlock) *fNewBlock = false;
+        if (pnProofFailedMicros) *pnProofFailedMicros = 0;
         CValidationState state;
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
         // belt-and-suspenders.
-        bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
+        // SolarCoin: Decided before CheckBlock(), which caches its result in fChecked
+        bool fCheckPOW = IsBlockPoWCheckNeeded(pblock->GetHash(), chainparams.GetConsensus());
+        bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus(), fCheckPOW);
         uint256 hashProofOfStake;
 
+        // ppcoin: verify hash target and signature of coinstake tx
+        // if we have the previous block and we are not downloading
+        // SolarCoin: Done before taking cs_main, CheckProofOfStake() only takes it briefly
+        bool fCheckedProofOfStake = false;
+        bool fRelayEarly = false;
+        if (ret && !CheckNewBlockProofOfStake(*pblock, state, fCheckedProofOfStake, hashProofOfStake, fRelayEarly, pnProofFailedMicros, chainparams.GetConsensus()))
+            return ProofOfStakeFailed(*pblock, state, nTimeStart, pnProofFailedMicros);
+
         LOCK(cs_main);
 
         if (ret) {
@@ -3738,37 +5159,20 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
                         pblock->GetProofOfStake().first.ToString(), pblock->GetProofOfStake().second,
                         hash.ToString());
             }
-            // ppcoin: verify hash target and signature of coinstake tx
-            // if we have the previous block and we are not downloading
-            if (pblock->IsProofOfStake() && mapBlockIndex.count(pblock->hashPrevBlock))
-            {
-                uint256 targetProofOfStake;
-                if (!CheckProofOfStake(*pblock->vtx[1], pblock->nBits, hashProofOfStake, targetProofOfStake, chainparams.GetConsensus())) {
-                    LogPrintf("WARNING: ProcessNewBlock() : CheckProofOfStake() failed for block=%s\n", hash.ToString().c_str());
-                    return false; // do not error here as we expect this during initial block download
-                }
-                LogPrintf("ProcessNewBlock() - Is ProofOfStake, block is in index, computed proofOfStake is %s\n",hashProofOfStake.ToString());
-                HashMap::iterator mi = mapProofOfStake.find(hash);
-                if (mi == mapProofOfStake.end())
-                {
-                    LogPrintf("ProcessNewBlock() : Inserting hashProofOfStake %s for block hash %s into mapProofOfStake\n", hashProofOfStake.ToString().c_str(), hash.ToString().c_str());
-                    mapProofOfStake.insert(std::make_pair(hash, hashProofOfStake));
-                    fhashProofOfStake = true;
-                }
-                else {
-                    LogPrintf("ProcessNewBlock(): Did not insert into mapProofOfStake\n");
-                }
-            }
-            else {
+            // SolarCoin: The parent may have been added by another thread since the check above
+            if (!CheckNewBlockProofOfStake(*pblock, state, fCheckedProofOfStake, hashProofOfStake, fRelayEarly, pnProofFailedMicros, chainparams.GetConsensus()))
+                return ProofOfStakeFailed(*pblock, state, nTimeStart, pnProofFailedMicros);
+            if (!fCheckedProofOfStake) {
                 LogPrintf("ProcessNewBlock(): Not PoS or did not find prev block in mapBlockIndex. MBI count of %s is %d\n",pblock->hashPrevBlock.ToString(), mapBlockIndex.count(pblock->hashPrevBlock));
             }
 
             // Store to disk
-            ret = AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, NULL, fNewBlock);
+            ret = AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, NULL, fNewBlock, fRelayEarly);
 
-            if (ret && fhashProofOfStake) {
-                pindex->hashProofOfStake = hashProofOfStake;
-                LogPrintf("ProcessNewBlock(): Setting hashProofOfStake to %s, new pindex value is %s\n",hashProofOfStake.ToString().c_str(), pindex->hashProofOfStake.ToString().c_str());
+            // ppcoin: record proof-of-stake hash value
+            if (ret && fCheckedProofOfStake && pindex->GetHashProofOfStake() != hashProofOfStake) {
+                pindex->SetHashProofOfStake(hashProofOfStake);
+                LogPrintf("ProcessNewBlock(): Setting hashProofOfStake to %s, new pindex value is %s\n",hashProofOfStake.ToString().c_str(), pindex->GetHashProofOfStake().ToString().c_str());
                 setDirtyBlockIndex.insert(pindex); // Update BlockIndex
             }
         }
@@ -3831,11 +5235,20 @@ uint64_t CalculateCurrentUsage()
 /* Prune a block file (modify associated database entries)*/
 void PruneOneBlockFile(const int fileNumber)
 {
+    PruneBlockFiles(std::set<int>{fileNumber});
+}
+
+void PruneBlockFiles(const std::set<int>& setFilesToPrune)
+{
+    if (setFilesToPrune.empty())
+        return;
+    // SolarCoin: One pass over the block index for all the files
     for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
         CBlockIndex* pindex = it->second;
-        if (pindex->nFile == fileNumber) {
+        if (setFilesToPrune.count(pindex->nFile)) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~BLOCK_POW_VERIFIED;
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -3856,41 +5269,145 @@ void PruneOneBlockFile(const int fileNumber)
         }
     }
 
-    vinfoBlockFile[fileNumber].SetNull();
-    setDirtyFileInfo.insert(fileNumber);
+    for (int fileNumber : setFilesToPrune) {
+        vinfoBlockFile[fileNumber].SetNull();
+        setDirtyFileInfo.insert(fileNumber);
+    }
 }
 
-
-void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+static void UnlinkBlockFile(int fileNumber)
 {
-    for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
-        CDiskBlockPos pos(*it, 0);
+    UnmapBlockFile(fileNumber);
+    CDiskBlockPos pos(fileNumber, 0);
+    try {
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
-        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("Prune: %s failed to delete blk/rev (%05u): %s\n", __func__, fileNumber, e.what());
+        return;
     }
+    LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, fileNumber);
 }
 
-/* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
-void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
+namespace {
+
+/**
+ * SolarCoin: Deletes the files of pruned blocks on a background thread, one blk/rev pair every
+ * PRUNE_UNLINK_INTERVAL milliseconds, so a prune burst does not hold up FlushStateToDisk() and
+ * block connection on the file system. The files are queued once the block index no longer
+ * refers to them; those left behind by a crash are queued again by LoadBlockIndexDB().
+ */
+class CBlockFileRemover
 {
-    assert(fPruneMode && nManualPruneHeight > 0);
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<int> queue;
+    bool fStop;
+    std::thread thread;
 
-    LOCK2(cs_main, cs_LastBlockFile);
-    if (chainActive.Tip() == NULL)
-        return;
+    void ThreadRemove()
+    {
+        RenameThread("solarcoin-prune");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            while (!fStop && queue.empty())
+                cond.wait(lock);
+            if (queue.empty())
+                return;
+            int fileNumber = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            UnlinkBlockFile(fileNumber);
+            lock.lock();
+            // Once stopping, the rest is deleted without waiting
+            cond.wait_for(lock, std::chrono::milliseconds(PRUNE_UNLINK_INTERVAL), [this] { return fStop; });
+        }
+    }
 
-    // last block to prune is the lesser of (user-specified height, MIN_BLOCKS_TO_KEEP from the tip)
-    unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
-    int count=0;
-    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
-        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+public:
+    CBlockFileRemover() : fStop(false), thread(&CBlockFileRemover::ThreadRemove, this) {}
+
+    ~CBlockFileRemover()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fStop = true;
+            cond.notify_all();
+        }
+        thread.join();
+    }
+
+    void Add(const std::set<int>& setFiles)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue.insert(queue.end(), setFiles.begin(), setFiles.end());
+        cond.notify_all();
+    }
+};
+
+} // anon namespace
+
+/** The remover of pruned files, NULL when they are deleted synchronously (protected by cs_main) */
+static std::unique_ptr<CBlockFileRemover> pblockfileremover;
+
+void StartBlockFileRemover()
+{
+    LOCK(cs_main);
+    if (!pblockfileremover)
+        pblockfileremover.reset(new CBlockFileRemover());
+}
+
+void StopBlockFileRemover()
+{
+    std::unique_ptr<CBlockFileRemover> premover;
+    {
+        LOCK(cs_main);
+        premover.swap(pblockfileremover);
+    }
+    // Deletes what is left before returning
+    premover.reset();
+}
+
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    LOCK(cs_main);
+    if (pblockfileremover) {
+        pblockfileremover->Add(setFilesToPrune);
+        return;
+    }
+    for (int fileNumber : setFilesToPrune)
+        UnlinkBlockFile(fileNumber);
+}
+
+/*
+ * Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain,
+ * at most nMaxFiles of them. Returns whether no more files are left to prune up to that height.
+ */
+bool FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight, size_t nMaxFiles)
+{
+    assert(fPruneMode && nManualPruneHeight > 0);
+
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL)
+        return true;
+
+    // last block to prune is the lesser of (user-specified height, MIN_BLOCKS_TO_KEEP from the tip)
+    unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
+    bool fComplete = true;
+    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
             continue;
-        PruneOneBlockFile(fileNumber);
+        if (setFilesToPrune.size() >= nMaxFiles) {
+            fComplete = false;
+            break;
+        }
         setFilesToPrune.insert(fileNumber);
-        count++;
     }
-    LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n", nLastBlockWeCanPrune, count);
+    PruneBlockFiles(setFilesToPrune);
+    LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs%s\n", nLastBlockWeCanPrune, setFilesToPrune.size(),
+              fComplete ? "" : ", more with the next flushes");
+    return fComplete;
 }
 
 /* This function is called from the RPC code for pruneblockchain */
@@ -3916,7 +5433,7 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
     // before the next pruning.
-    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    uint64_t nBuffer = nBlockFileChunkSize + nUndoFileChunkSize;
     uint64_t nBytesToPrune;
     int count=0;
 
@@ -3934,12 +5451,12 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
             if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
                 continue;
 
-            PruneOneBlockFile(fileNumber);
             // Queue up the files for removal
             setFilesToPrune.insert(fileNumber);
             nCurrentUsage -= nBytesToPrune;
             count++;
         }
+        PruneBlockFiles(setFilesToPrune);
     }
 
     LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
@@ -4006,20 +5523,209 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = NewBlockIndex();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
+//! Maximum number of threads checking stored stake modifier checksums
+static const int MAX_STAKE_CHECKSUM_THREADS = 16;
+//! Below this many block index entries the checksums are checked on the calling thread
+static const size_t MIN_PARALLEL_STAKE_CHECKSUMS = 100000;
+
+/**
+ * SolarCoin: check the stored stake modifier checksums of the block index, in parallel.
+ *
+ * A checksum chains the one of the previous block, so computing them is sequential. With both
+ * stored, every link can be checked on its own though. vChecked[i] is set when the stored checksum
+ * of vSortedByHeight[i] is the one computed from the stored checksum of its parent.
+ */
+static void CheckStoredStakeModifierChecksums(const std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight, std::vector<char>& vChecked, const Consensus::Params& params)
+{
+    vChecked.assign(vSortedByHeight.size(), 0);
+    auto checkRange = [&vSortedByHeight, &vChecked, &params](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const CBlockIndex* pindex = vSortedByHeight[i].second;
+            if (!(pindex->nStatus & BLOCK_HAVE_STAKE_CHECKSUM))
+                continue;
+            if (pindex->pprev ? !(pindex->pprev->nStatus & BLOCK_HAVE_STAKE_CHECKSUM) : pindex->GetBlockHash() != params.hashGenesisBlock)
+                continue;
+            vChecked[i] = GetStakeModifierChecksum(pindex, params) == pindex->nStakeModifierChecksum;
+        }
+    };
+
+    const size_t nThreads = std::max(1, std::min(GetNumCores(), MAX_STAKE_CHECKSUM_THREADS));
+    if (nThreads == 1 || vSortedByHeight.size() < MIN_PARALLEL_STAKE_CHECKSUMS) {
+        checkRange(0, vSortedByHeight.size());
+        return;
+    }
+    boost::thread_group threadGroup;
+    const size_t nChunk = (vSortedByHeight.size() + nThreads - 1) / nThreads;
+    for (size_t nBegin = 0; nBegin < vSortedByHeight.size(); nBegin += nChunk)
+        threadGroup.create_thread(boost::bind<void>(checkRange, nBegin, std::min(nBegin + nChunk, vSortedByHeight.size())));
+    threadGroup.join_all();
+}
+
+/** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
+static bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, params.GetConsensus()))
+        return error("ReplayBlock(): ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+
+    // SolarCoin: the coins keep the kernel data of their transaction, as in ConnectBlock()
+    uint32_t nTxOffset = GetSizeOfCompactSize(block.vtx.size());
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn &txin : tx->vin)
+                inputs.SpendCoin(txin.prevout);
+        }
+        // Pass check = true as every addition may be an overwrite.
+        AddCoins(inputs, *tx, pindex->nHeight, true, block.GetBlockTime(), nTxOffset);
+        nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return true;
+}
+
+bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
+{
+    LOCK(cs_main);
+
+    CCoinsViewCache cache(view);
+
+    std::vector<uint256> hashHeads = view->GetHeadBlocks();
+    if (hashHeads.empty())
+        return true; // We're already in a consistent state.
+    if (hashHeads.size() != 2)
+        return error("ReplayBlocks(): unknown inconsistent state");
+
+    uiInterface.ShowProgress(_("Replaying blocks..."), 0);
+    LogPrintf("Replaying blocks\n");
+
+    const CBlockIndex* pindexOld = NULL;  // Best block of the database during the interrupted partial flush.
+    const CBlockIndex* pindexNew;         // Tip during the interrupted partial flush.
+    const CBlockIndex* pindexFork = NULL; // Latest block common to both.
+
+    if (mapBlockIndex.count(hashHeads[0]) == 0)
+        return error("ReplayBlocks(): reorganization to unknown block requested");
+    pindexNew = mapBlockIndex[hashHeads[0]];
+
+    if (!hashHeads[1].IsNull()) { // The old tip is allowed to be 0, indicating it's the first flush.
+        if (mapBlockIndex.count(hashHeads[1]) == 0)
+            return error("ReplayBlocks(): reorganization from unknown block requested");
+        pindexOld = mapBlockIndex[hashHeads[1]];
+        pindexFork = LastCommonAncestor(pindexOld, pindexNew);
+        assert(pindexFork != NULL);
+    }
+
+    // Rollback along the old branch.
+    while (pindexOld != pindexFork) {
+        if (pindexOld->nHeight > 0) { // Never disconnect the genesis block.
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexOld, params.GetConsensus()))
+                return error("RollbackBlock(): ReadBlockFromDisk() failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+            LogPrintf("Rolling back %s (%i)\n", pindexOld->GetBlockHash().ToString(), pindexOld->nHeight);
+            // An unclean result means that a non-existing coin was deleted or an existing one overwritten, as
+            // the block never had all of its changes written. Both are idempotent, so the block is still undone.
+            CValidationState state;
+            bool fClean = true;
+            if (!DisconnectBlock(block, state, pindexOld, cache, &fClean))
+                return error("RollbackBlock(): DisconnectBlock failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+        }
+        pindexOld = pindexOld->pprev;
+    }
+
+    // Roll forward from the forking point to the new tip.
+    int nForkHeight = pindexFork ? pindexFork->nHeight : 0;
+    for (int nHeight = nForkHeight + 1; nHeight <= pindexNew->nHeight; ++nHeight) {
+        const CBlockIndex* pindex = pindexNew->GetAncestor(nHeight);
+        LogPrintf("Rolling forward %s (%i)\n", pindex->GetBlockHash().ToString(), nHeight);
+        if (!RollforwardBlock(pindex, cache, params))
+            return false;
+    }
+
+    cache.SetBestBlock(pindexNew->GetBlockHash());
+    if (!cache.Flush())
+        return error("ReplayBlocks(): failed to write the replayed blocks");
+    uiInterface.ShowProgress("", 100);
+    return true;
+}
+
+static boost::filesystem::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+/**
+ * SolarCoin: The state of the databases a block index snapshot goes with: the block of the coins
+ * database, and the last block file with its size, as written. A binary from before the snapshots
+ * leaves the identifier of one in place; the blocks it stores or connects change this state, so
+ * the snapshot is not loaded after it ran.
+ */
+static uint256 GetBlockIndexSnapshotState()
+{
+    int nFile = 0;
+    CBlockFileInfo info;
+    if (pblocktree->ReadLastBlockFile(nFile))
+        pblocktree->ReadBlockFileInfo(nFile, info);
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pcoinsTip->GetBestBlock() << nFile << info;
+    return ss.GetHash();
+}
+
+bool DumpBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
+    // Only a complete block index, all of it written to the database, matches the database
+    if (chainActive.Tip() == NULL || !setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty() || !pblocktree->WaitForWrite())
+        return false;
+
+    int64_t nStart = GetTimeMicros();
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(mapBlockIndex.size());
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        vIndex.push_back(item.second);
+    std::sort(vIndex.begin(), vIndex.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+    const uint64_t nId = GetRand(std::numeric_limits<uint64_t>::max());
+    if (!WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath(), nId, GetBlockIndexSnapshotState(), vIndex) || !pblocktree->WriteBlockIndexSnapshotId(nId))
+        return false;
+    LogPrintf("%s: wrote %u block index entries in %.2fms\n", __func__, vIndex.size(), 0.001 * (GetTimeMicros() - nStart));
+    return true;
+}
+
+/**
+ * SolarCoin: Load the block index from the snapshot of the last clean shutdown, if the database
+ * still refers to it. The reference is erased first, as the block index changes from here on.
+ */
+static bool LoadBlockIndexSnapshot(std::vector<CBlockIndex*>& vIndex)
+{
+    uint64_t nId;
+    if (!pblocktree->ReadBlockIndexSnapshotId(nId) || !pblocktree->EraseBlockIndexSnapshotId())
+        return false;
+
+    int64_t nStart = GetTimeMicros();
+    const boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    bool fLoaded = ReadBlockIndexSnapshot(path, nId, GetBlockIndexSnapshotState(), InsertBlockIndex, vIndex);
+    boost::system::error_code ec;
+    boost::filesystem::remove(path, ec);
+    if (!fLoaded) {
+        LogPrintf("%s: snapshot not usable, scanning the database\n", __func__);
+        return false;
+    }
+    for (CBlockIndex* pindex : vIndex) {
+        if (pindex->IsProofOfStake())
+            setStakeSeen.insert(pindex);
+    }
+    LogPrintf("%s: loaded %u block index entries in %.2fms\n", __func__, vIndex.size(), 0.001 * (GetTimeMicros() - nStart));
+    return true;
+}
+
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    std::vector<CBlockIndex*> vSnapshot;
+    if (!LoadBlockIndexSnapshot(vSnapshot) && !pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
         return false;
 
     boost::this_thread::interruption_point();
@@ -4027,23 +5733,47 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     // Calculate nChainWork
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
-    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+    if (!vSnapshot.empty()) {
+        // SolarCoin: the snapshot is in height order already
+        for (CBlockIndex* pindex : vSnapshot)
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+    } else {
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
+    if (!std::is_sorted(vSortedByHeight.begin(), vSortedByHeight.end(),
+                        [](const std::pair<int, CBlockIndex*>& a, const std::pair<int, CBlockIndex*>& b) { return a.first < b.first; }))
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    // SolarCoin: verify the stored stake modifier checksums up front, only the others are computed below
+    std::vector<char> vChecksumChecked;
+    CheckStoredStakeModifierChecksums(vSortedByHeight, vChecksumChecked, chainparams.GetConsensus());
+    // Blocks whose stored checksum was replaced; a check against it does not hold for their children
+    std::set<const CBlockIndex*> setChecksumReplaced;
+
+    for (size_t i = 0; i < vSortedByHeight.size(); i++)
     {
-        CBlockIndex* pindex = item.second;
+        CBlockIndex* pindex = vSortedByHeight[i].second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
-        // SolarCoin: calculate stake modifier checksum
-        if (pindex->nHeight > 0) {
-            pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex, chainparams.GetConsensus());
-            if (!fTestNet && !CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
-                return false;
+        pindex->BuildMedianTimePast();
+        // SolarCoin: calculate stake modifier checksum, unless the stored one was verified
+        bool fHasChecksum = pindex->pprev || pindex->GetBlockHash() == chainparams.GetConsensus().hashGenesisBlock;
+        if (fHasChecksum && (!vChecksumChecked[i] || setChecksumReplaced.count(pindex->pprev))) {
+            unsigned int nChecksum = GetStakeModifierChecksum(pindex, chainparams.GetConsensus());
+            if (!(pindex->nStatus & BLOCK_HAVE_STAKE_CHECKSUM) || nChecksum != pindex->nStakeModifierChecksum) {
+                if (pindex->nStatus & BLOCK_HAVE_STAKE_CHECKSUM)
+                    setChecksumReplaced.insert(pindex);
+                pindex->nStakeModifierChecksum = nChecksum;
+                pindex->nStatus |= BLOCK_HAVE_STAKE_CHECKSUM;
+                setDirtyBlockIndex.insert(pindex);
+            }
         }
+        if (pindex->nHeight > 0 && !fTestNet && !CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
+            return false;
 
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
@@ -4063,8 +5793,10 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
-        if (pindex->pprev)
+        if (pindex->pprev) {
             pindex->BuildSkip();
+            pindex->BuildPrevOtherType(chainparams.GetConsensus().LAST_POW_BLOCK);
+        }
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
@@ -4106,23 +5838,33 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
-    if (fHavePruned)
+    if (fHavePruned) {
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+        // SolarCoin: Delete pruned files whose deletion was still queued when the node stopped
+        std::set<int> setFilesLeft;
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            if (vinfoBlockFile[fileNumber].nSize == 0 && !setBlkDataFiles.count(fileNumber) &&
+                boost::filesystem::exists(GetBlockPosFilename(CDiskBlockPos(fileNumber, 0), "blk")))
+                setFilesLeft.insert(fileNumber);
+        }
+        UnlinkPrunedFiles(setFilesLeft);
+    }
 
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
+    // SolarCoin: Finish a partial flush of the coins cache that was interrupted
+    if (!ReplayBlocks(chainparams, pcoinsTip) || !pcoinsTip->Flush())
+        return error("LoadBlockIndexDB(): failed to replay blocks since the last coins database flush");
 
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainTipSnapshot(chainparams);
 
     PruneBlockIndexCandidates();
 
@@ -4134,6 +5876,117 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     return true;
 }
 
+namespace {
+
+/** A block of the active chain read and checked by the CVerifyDB pipeline */
+struct CBlockVerifyJob
+{
+    CBlockIndex* pindex;
+    std::shared_ptr<CBlock> pblock; //!< NULL if it could not be read
+    CBlockUndo undo;
+    bool fUndoRead;
+    bool fDone;
+
+    CBlockVerifyJob(CBlockIndex* pindexIn) : pindex(pindexIn), fUndoRead(false), fDone(false) {}
+};
+
+/**
+ * SolarCoin: Reads the blocks VerifyDB() checks, their undo data at check level 2, and runs
+ * CheckBlock() on them at level 1, on a pool of workers that stay at most VERIFYDB_WINDOW_BLOCKS
+ * ahead of Next(). The chain state checks of the higher levels stay on the caller's thread, which
+ * holds cs_main, so the block index entries do not change under the workers.
+ */
+class CBlockVerifyPipeline
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker; //!< the workers wait for room in the window
+    boost::condition_variable condNext;   //!< Next() waits for its block to be done
+    std::vector<std::shared_ptr<CBlockVerifyJob> > vJobs; //!< in the order of Next()
+    size_t nNextWork;                     //!< first job no worker took yet
+    size_t nNextOut;                      //!< job Next() hands out next
+    bool fStop;
+    boost::thread_group threadGroup;
+
+    void ThreadWork(const CChainParams& chainparams, int nCheckLevel)
+    {
+        const Consensus::Params& params = chainparams.GetConsensus();
+        while (true) {
+            // Take a few blocks at once, so their scrypt hashes are computed together
+            std::vector<std::shared_ptr<CBlockVerifyJob> > vTaken;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNextWork < vJobs.size() && nNextWork >= nNextOut + VERIFYDB_WINDOW_BLOCKS)
+                    condWorker.wait(lock);
+                if (fStop || nNextWork == vJobs.size())
+                    return;
+                while (nNextWork < vJobs.size() && vTaken.size() < (size_t)SCRYPT_MULTI_MAX_WAYS)
+                    vTaken.push_back(vJobs[nNextWork++]);
+            }
+            std::vector<std::shared_ptr<CBlock> > vpblock;
+            for (const auto& job : vTaken) {
+                // check level 0: read from disk
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                if (ReadBlockFromDisk(*pblock, job->pindex, params)) {
+                    job->pblock = pblock;
+                    vpblock.push_back(pblock);
+                }
+                // check level 2: read the undo data
+                if (nCheckLevel >= 2) {
+                    CDiskBlockPos pos = job->pindex->GetUndoPos();
+                    job->fUndoRead = pos.IsNull() || UndoReadFromDisk(job->undo, pos, job->pindex->pprev->GetBlockHash());
+                }
+            }
+            // check level 1: the blocks that pass are marked checked, VerifyDB() checks the others
+            // again to report the error
+            if (nCheckLevel >= 1)
+                CheckBlocksMulti(vpblock, params);
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (const auto& job : vTaken)
+                job->fDone = true;
+            condNext.notify_all();
+        }
+    }
+
+public:
+    CBlockVerifyPipeline(const std::vector<CBlockIndex*>& vIndex, const CChainParams& chainparams, int nCheckLevel, int nWorkers) :
+        nNextWork(0), nNextOut(0), fStop(false)
+    {
+        vJobs.reserve(vIndex.size());
+        for (CBlockIndex* pindex : vIndex)
+            vJobs.push_back(std::make_shared<CBlockVerifyJob>(pindex));
+        for (int i = 0; i < nWorkers; i++)
+            threadGroup.create_thread(boost::bind(&CBlockVerifyPipeline::ThreadWork, this, boost::cref(chainparams), nCheckLevel));
+    }
+
+    ~CBlockVerifyPipeline()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+            condWorker.notify_all();
+        }
+        threadGroup.join_all();
+    }
+
+    /** Wait for the next block, in the order of the blocks given. Returns false after the last one. */
+    bool Next(std::shared_ptr<CBlockVerifyJob>& job)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nNextOut == vJobs.size())
+            return false;
+        while (!vJobs[nNextOut]->fDone)
+            condNext.wait(lock);
+        job = vJobs[nNextOut];
+        // Release the job's block once it is handed out
+        vJobs[nNextOut++].reset();
+        condWorker.notify_all();
+        return true;
+    }
+};
+
+} // anon namespace
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -4161,10 +6014,28 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     int nGoodTransactions = 0;
     CValidationState state;
     int reportDone = 0;
+
+    // The blocks to check, from the tip down
+    std::vector<CBlockIndex*> vIndex;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
+            break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
+        vIndex.push_back(pindex);
+    }
+
+    // SolarCoin: the blocks are read and checked ahead on the workers, levels 0 to 2 in parallel
+    CBlockVerifyPipeline pipeline(vIndex, chainparams, nCheckLevel, std::max(nScriptCheckThreads, 1));
+    std::shared_ptr<CBlockVerifyJob> job;
     LogPrintf("[0%%]...");
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    while (pipeline.Next(job))
     {
         boost::this_thread::interruption_point();
+        CBlockIndex* pindex = job->pindex;
         int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
         if (reportDone < percentageDone/10) {
             // report every 10% step
@@ -4172,34 +6043,27 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             reportDone = percentageDone/10;
         }
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
-            break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
-            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
-            break;
-        }
-        CBlock block;
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+        if (!job->pblock)
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        const CBlock& block = *job->pblock;
         // check level 1: verify block validity
         if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
             return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
                          pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
         // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-        }
+        if (nCheckLevel >= 2 && !job->fUndoRead)
+            return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            // SolarCoin: The undo data was read ahead on the workers, and the outputs of the block are read in one batch
+            if (coinsview == pcoinsdbview)
+                PrefetchDisconnectCoins(block, coins);
+            else if (coinsview == pcoinsTip)
+                PrefetchDisconnectCoins(block, *pcoinsTip);
+            CBlockUndo* pblockundoIn = pindex->GetUndoPos().IsNull() ? NULL : &job->undo;
+            if (!DisconnectBlock(block, state, pindex, coins, &fClean, NULL, pblockundoIn))
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -4259,7 +6123,7 @@ bool RewindBlockIndex(const CChainParams& params)
             // of the blockchain).
             break;
         }
-        if (!DisconnectTip(state, params, true)) {
+        if (!DisconnectTip(state, params, NULL)) {
             return error("RewindBlockIndex: unable to disconnect block at height %i", pindex->nHeight);
         }
         // Occasionally flush state to disk.
@@ -4329,8 +6193,11 @@ void UnloadBlockIndex()
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
+    PublishChainTipSnapshot(Params());
     mempool.clear();
     mapBlocksUnlinked.clear();
+    CloseAppendFiles();
+    UnmapBlockFiles();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     nBlockSequenceId = 1;
@@ -4342,11 +6209,13 @@ void UnloadBlockIndex()
     }
 
     BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+        DeleteBlockIndex(entry.second);
     }
     mapBlockIndex.clear();
-    mapProofOfStake.clear();
+    setStakeSeen.clear();
+    UnloadStakeModifierIndex();
     fHavePruned = false;
+    nScheduledPruneHeight = 0;
 }
 
 bool LoadBlockIndex(const CChainParams& chainparams)
@@ -4368,9 +6237,6 @@ bool InitBlockIndex(const CChainParams& chainparams)
     if (mapBlockIndex.count(chainparams.GenesisBlock().GetHash()))
         return true;
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4398,101 +6264,847 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+/** SolarCoin: The block index fields of a block that ConnectBlock() fills in, as stored in a UTXO snapshot */
+struct CSnapshotBlockIndexEntry
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+    uint256 hashBlock;
+    unsigned int nTx;
+    int64_t nMint;
+    uint64_t nMoneySupply;
+    unsigned int nFlags;
+    uint64_t nStakeModifier;
+    COutPoint prevoutStake;
+    unsigned int nStakeTime;
+    uint256 hashProofOfStake;
+
+    // memory only
+    unsigned int nStakeModifierChecksum;
+
+    CSnapshotBlockIndexEntry() : nTx(0), nMint(0), nMoneySupply(0), nFlags(0), nStakeModifier(0), nStakeTime(0), nStakeModifierChecksum(0) {}
+
+    explicit CSnapshotBlockIndexEntry(const CBlockIndex* pindex) :
+        hashBlock(pindex->GetBlockHash()), nTx(pindex->nTx), nMint(pindex->nMint), nMoneySupply(pindex->nMoneySupply),
+        nFlags(pindex->nFlags), nStakeModifier(pindex->nStakeModifier), prevoutStake(pindex->GetPrevoutStake()),
+        nStakeTime(pindex->GetStakeTime()), hashProofOfStake(pindex->GetHashProofOfStake()), nStakeModifierChecksum(pindex->nStakeModifierChecksum) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(VARINT(nTx));
+        READWRITE(nMint);
+        READWRITE(nMoneySupply);
+        READWRITE(VARINT(nFlags));
+        READWRITE(nStakeModifier);
+        READWRITE(prevoutStake);
+        READWRITE(VARINT(nStakeTime));
+        READWRITE(hashProofOfStake);
+    }
+};
 
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+/** Writes a snapshot file through a buffer, hashing everything written */
+class CSnapshotFileWriter
+{
+private:
+    FILE* file;
+    CHash256 hasher;
+    CDataStream ss;
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+public:
+    CSnapshotFileWriter(FILE* fileIn) : file(fileIn), ss(SER_DISK, CLIENT_VERSION) {}
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+    template<typename T>
+    CSnapshotFileWriter& operator<<(const T& obj)
+    {
+        ss << obj;
+        if (ss.size() >= (1 << 20))
+            Flush();
+        return *this;
+    }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+    void Flush()
+    {
+        hasher.Write((const unsigned char*)ss.data(), ss.size());
+        if (fwrite(ss.data(), 1, ss.size(), file) != ss.size())
+            throw std::ios_base::failure("CSnapshotFileWriter::Flush: write failed");
+        ss.clear();
+    }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
+    /** Append the checksum of everything written before */
+    void Finalize()
+    {
+        Flush();
+        uint256 hashChecksum;
+        hasher.Finalize(hashChecksum.begin());
+        ss << hashChecksum;
+        if (fwrite(ss.data(), 1, ss.size(), file) != ss.size())
+            throw std::ios_base::failure("CSnapshotFileWriter::Finalize: write failed");
+        ss.clear();
+    }
+};
 
-                NotifyHeaderTip();
+bool DumpTxOutSetSnapshot(const boost::filesystem::path& path, CTxOutSetSnapshotInfo& info, std::string& strError)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::vector<CSnapshotBlockIndexEntry> vEntries;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsTip->Cursor());
+        BlockMap::const_iterator it = mapBlockIndex.find(pcursor->GetBestBlock());
+        if (it == mapBlockIndex.end()) {
+            strError = "Best block of the coins database not found";
+            return false;
+        }
+        info.hashBlock = it->first;
+        info.nHeight = it->second->nHeight;
+        vEntries.reserve(info.nHeight);
+        for (const CBlockIndex* pindex = it->second; pindex->pprev; pindex = pindex->pprev)
+            vEntries.push_back(CSnapshotBlockIndexEntry(pindex));
+        std::reverse(vEntries.begin(), vEntries.end());
+    }
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".incomplete";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file) {
+        strError = strprintf("Unable to open %s for writing", pathTmp.string());
+        return false;
+    }
+    info.nCoins = 0;
+    try {
+        CSnapshotFileWriter writer(file);
+        writer << FLATDATA(Params().MessageStart()) << TXOUTSET_SNAPSHOT_VERSION << info.hashBlock << info.nHeight;
+        writer << (uint64_t)vEntries.size();
+        for (const CSnapshotBlockIndexEntry& entry : vEntries)
+            writer << entry;
+
+        // The cursor iterates over a snapshot of the database, so cs_main is not needed here
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint outpoint;
+            Coin coin;
+            if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin))
+                throw std::runtime_error("unable to read the coins database");
+            writer << outpoint << coin;
+            info.nCoins++;
+            pcursor->Next();
+        }
+        // A null outpoint ends the list of coins
+        writer << COutPoint();
+        writer.Finalize();
+    } catch (const std::exception& e) {
+        fclose(file);
+        boost::filesystem::remove(pathTmp);
+        strError = strprintf("Writing the snapshot failed: %s", e.what());
+        return false;
+    }
+    FileCommit(file);
+    if (fclose(file) != 0 || !RenameOver(pathTmp, path)) {
+        boost::filesystem::remove(pathTmp);
+        strError = strprintf("Unable to write %s", path.string());
+        return false;
+    }
+    LogPrintf("%s: wrote %u coins at height %d (%s) to %s\n", __func__, info.nCoins, info.nHeight, info.hashBlock.ToString(), path.string());
+    return true;
+}
+
+/** Check the trailing checksum of a snapshot file */
+static bool CheckSnapshotChecksum(const boost::filesystem::path& path, std::string& strError)
+{
+    boost::system::error_code ec;
+    uint64_t nSize = boost::filesystem::file_size(path, ec);
+    if (ec || nSize < 32) {
+        strError = strprintf("Unable to read %s", path.string());
+        return false;
+    }
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file) {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    CHash256 hasher;
+    std::vector<unsigned char> vBuf(1 << 20);
+    uint64_t nRemaining = nSize - 32;
+    bool fOk = true;
+    while (fOk && nRemaining > 0) {
+        size_t nRead = std::min<uint64_t>(vBuf.size(), nRemaining);
+        fOk = fread(vBuf.data(), 1, nRead, file) == nRead;
+        hasher.Write(vBuf.data(), nRead);
+        nRemaining -= nRead;
+    }
+    uint256 hashChecksum, hashStored;
+    fOk = fOk && fread(hashStored.begin(), 1, 32, file) == 32;
+    fclose(file);
+    hasher.Finalize(hashChecksum.begin());
+    if (!fOk || hashChecksum != hashStored) {
+        strError = "Snapshot checksum mismatch";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * SolarCoin: Add a coin to the hash of a UTXO snapshot. The whole coin is hashed, not just its
+ * output: its height, flags and times set stake ages and PoST rewards.
+ */
+static void ApplySnapshotCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << outpoint << coin;
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+}
+
+bool GetSnapshotCoinsHash(const CCoinsView& view, uint256& hashCoins)
+{
+    MuHash3072 muhash;
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin))
+            return false;
+        ApplySnapshotCoinHash(muhash, outpoint, coin);
+    }
+    unsigned char hash[32];
+    muhash.Finalize(hash);
+    hashCoins = uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+    return true;
+}
+
+bool LoadTxOutSetSnapshot(const CChainParams& chainparams, const boost::filesystem::path& path, CTxOutSetSnapshotInfo& info, std::string& strError)
+{
+    if (!fPruneMode) {
+        strError = "Loading a snapshot requires -prune, blocks below the snapshot are not available";
+        return false;
+    }
+    if (!CheckSnapshotChecksum(path, strError))
+        return false;
+
+    LOCK(cs_main);
+    if (chainActive.Height() != 0) {
+        strError = "Loading a snapshot requires an empty chainstate";
+        return false;
+    }
+    FlushStateToDisk();
+
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    try {
+        CMessageHeader::MessageStartChars pchMessageStart;
+        uint32_t nVersion;
+        filein >> FLATDATA(pchMessageStart) >> nVersion;
+        if (memcmp(pchMessageStart, chainparams.MessageStart(), sizeof(pchMessageStart)) != 0) {
+            strError = "Snapshot is for a different network";
+            return false;
+        }
+        if (nVersion != TXOUTSET_SNAPSHOT_VERSION) {
+            strError = strprintf("Unsupported snapshot version %u", nVersion);
+            return false;
+        }
+        filein >> info.hashBlock >> info.nHeight;
+        BlockMap::iterator mi = mapBlockIndex.find(info.hashBlock);
+        if (mi == mapBlockIndex.end() || mi->second->nHeight != info.nHeight || (mi->second->nStatus & BLOCK_FAILED_MASK)) {
+            strError = strprintf("Header of snapshot block %s not found, sync headers first", info.hashBlock.ToString());
+            return false;
+        }
+        CBlockIndex* pindexSnapshot = mi->second;
+
+        // Read and check the block index entries before anything is changed
+        uint64_t nEntries;
+        filein >> nEntries;
+        if (nEntries != (uint64_t)info.nHeight) {
+            strError = "Snapshot block index entries do not match its height";
+            return false;
+        }
+        std::vector<CSnapshotBlockIndexEntry> vEntries(nEntries);
+        std::vector<CBlockIndex*> vIndex(nEntries);
+        for (CBlockIndex* pindex = pindexSnapshot; pindex->pprev; pindex = pindex->pprev)
+            vIndex[pindex->nHeight - 1] = pindex;
+        CBlockIndex indexPrev, index;
+        indexPrev.nStakeModifierChecksum = chainActive.Genesis()->nStakeModifierChecksum;
+        index.pprev = &indexPrev;
+        for (size_t i = 0; i < vEntries.size(); i++) {
+            CSnapshotBlockIndexEntry& entry = vEntries[i];
+            filein >> entry;
+            if (entry.hashBlock != vIndex[i]->GetBlockHash() || entry.nTx == 0) {
+                strError = strprintf("Snapshot block index entry at height %d does not match the headers", i + 1);
+                return false;
+            }
+            index.nFlags = entry.nFlags;
+            index.SetHashProofOfStake(entry.hashProofOfStake);
+            index.nStakeModifier = entry.nStakeModifier;
+            entry.nStakeModifierChecksum = GetStakeModifierChecksum(&index, chainparams.GetConsensus());
+            if (!fTestNet && !CheckStakeModifierCheckpoints(i + 1, entry.nStakeModifierChecksum)) {
+                strError = strprintf("Snapshot stake modifier checksum at height %d does not match its checkpoint", i + 1);
+                return false;
+            }
+            indexPrev.nStakeModifierChecksum = entry.nStakeModifierChecksum;
+        }
+
+        // Write the coins in large batches. Only the last one sets the best block, so an
+        // interrupted load leaves a chainstate that -reindex-chainstate can recover from.
+        // The coins are hashed as well, for the background validation to compare its own against.
+        CCoinsMap mapCoins;
+        MuHash3072 muhash;
+        info.nCoins = 0;
+        while (true) {
+            boost::this_thread::interruption_point();
+            COutPoint outpoint;
+            filein >> outpoint;
+            bool fEnd = outpoint.IsNull();
+            if (!fEnd) {
+                CCoinsCacheEntry& entry = mapCoins[outpoint];
+                filein >> entry.coin;
+                entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+                ApplySnapshotCoinHash(muhash, outpoint, entry.coin);
+                info.nCoins++;
+            }
+            if (mapCoins.size() >= TXOUTSET_SNAPSHOT_BATCH_SIZE || fEnd) {
+                if (!pcoinsTip->BatchWrite(mapCoins, fEnd ? info.hashBlock : pcoinsTip->GetBestBlock()) || !pcoinsTip->Flush()) {
+                    strError = "Writing the coins database failed, restart with -reindex-chainstate";
+                    return false;
+                }
+                mapCoins.clear();
+            }
+            if (fEnd)
+                break;
+        }
+
+        // Fill in the block index as if the blocks had been connected and pruned
+        for (size_t i = 0; i < vEntries.size(); i++) {
+            const CSnapshotBlockIndexEntry& entry = vEntries[i];
+            CBlockIndex* pindex = vIndex[i];
+            pindex->nTx = entry.nTx;
+            pindex->nChainTx = pindex->pprev->nChainTx + entry.nTx;
+            pindex->nMint = entry.nMint;
+            pindex->nMoneySupply = entry.nMoneySupply;
+            pindex->nFlags = entry.nFlags;
+            pindex->nStakeModifier = entry.nStakeModifier;
+            pindex->nStakeModifierChecksum = entry.nStakeModifierChecksum;
+            pindex->SetStake(entry.prevoutStake, entry.nStakeTime);
+            pindex->SetHashProofOfStake(entry.hashProofOfStake);
+            pindex->nStatus |= BLOCK_HAVE_STAKE_CHECKSUM;
+            pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setStakeSeen.insert(pindex);
+            setDirtyBlockIndex.insert(pindex);
+        }
+        chainActive.SetTip(pindexSnapshot);
+        PublishChainTipSnapshot(chainparams);
+        setBlockIndexCandidates.insert(pindexSnapshot);
+
+        // Blocks that were received on top of the snapshot chain can be connected now
+        std::deque<CBlockIndex*> queue(vIndex.begin(), vIndex.end());
+        while (!queue.empty()) {
+            CBlockIndex *pindex = queue.front();
+            queue.pop_front();
+            if (pindex->nChainTx == 0) {
+                pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+                {
+                    LOCK(cs_nBlockSequenceId);
+                    pindex->nSequenceId = nBlockSequenceId++;
+                }
+                if (!setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip()))
+                    setBlockIndexCandidates.insert(pindex);
+            }
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+                if (it->second->nChainTx == 0)
+                    queue.push_back(it->second);
+                range.first++;
+                mapBlocksUnlinked.erase(it);
+            }
+        }
+        PruneBlockIndexCandidates();
+
+        pblocktree->WriteFlag("prunedblockfiles", true);
+        fHavePruned = true;
+
+        CSnapshotValidationTarget target;
+        target.hashBlock = info.hashBlock;
+        target.nHeight = info.nHeight;
+        unsigned char hash[32];
+        muhash.Finalize(hash);
+        target.hashCoins = uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+        if (!pblocktree->WriteSnapshotValidation(target)) {
+            strError = "Writing the block index failed";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Reading the snapshot failed: %s", e.what());
+        return false;
+    }
+
+    CValidationState state;
+    if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS)) {
+        strError = strprintf("Writing the block index failed: %s", FormatStateMessage(state));
+        return false;
+    }
+    CheckBlockIndex(chainparams.GetConsensus());
+    LogPrintf("%s: loaded %u coins at height %d (%s) from %s\n", __func__, info.nCoins, info.nHeight, info.hashBlock.ToString(), path.string());
+    return true;
+}
+
+//! Headers read from a bundle between two interruption points, and added to the block index under one lock of cs_main
+static const unsigned int HEADER_BUNDLE_BATCH_SIZE = 10000;
+
+bool DumpHeaderBundle(const CChainParams& chainparams, const boost::filesystem::path& path, int nHeight, CHeaderBundleInfo& info, std::string& strError)
+{
+    // Header fields never change once in the block index, so they are read without cs_main
+    std::vector<const CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexLast = NULL;
+        if (nHeight < 0) {
+            pindexLast = Checkpoints::GetLastCheckpoint(chainparams.Checkpoints());
+            if (pindexLast && !chainActive.Contains(pindexLast))
+                pindexLast = NULL;
+        } else {
+            pindexLast = chainActive[nHeight];
+        }
+        if (!pindexLast || pindexLast->nHeight == 0) {
+            strError = "No block to end the bundle at in the active chain";
+            return false;
+        }
+        info.hashBlock = pindexLast->GetBlockHash();
+        info.nHeight = pindexLast->nHeight;
+        vIndex.reserve(info.nHeight);
+        for (const CBlockIndex* pindex = pindexLast; pindex->pprev; pindex = pindex->pprev)
+            vIndex.push_back(pindex);
+        std::reverse(vIndex.begin(), vIndex.end());
+    }
+
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".incomplete";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file) {
+        strError = strprintf("Unable to open %s for writing", pathTmp.string());
+        return false;
+    }
+    try {
+        CSnapshotFileWriter writer(file);
+        writer << FLATDATA(chainparams.MessageStart()) << HEADER_BUNDLE_VERSION << (uint64_t)vIndex.size();
+        for (const CBlockIndex* pindex : vIndex)
+            writer << pindex->GetBlockHeader();
+        writer.Finalize();
+    } catch (const std::exception& e) {
+        fclose(file);
+        boost::filesystem::remove(pathTmp);
+        strError = strprintf("Writing the header bundle failed: %s", e.what());
+        return false;
+    }
+    FileCommit(file);
+    if (fclose(file) != 0 || !RenameOver(pathTmp, path)) {
+        boost::filesystem::remove(pathTmp);
+        strError = strprintf("Unable to write %s", path.string());
+        return false;
+    }
+    info.nHeaders = vIndex.size();
+    LogPrintf("%s: wrote %u headers up to height %d (%s) to %s\n", __func__, info.nHeaders, info.nHeight, info.hashBlock.ToString(), path.string());
+    return true;
+}
+
+/** Open a header bundle and read its network, version and number of headers */
+static bool OpenHeaderBundle(const CChainParams& chainparams, const boost::filesystem::path& path, CAutoFile& filein, uint64_t& nHeaders, std::string& strError)
+{
+    if (filein.IsNull()) {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    CMessageHeader::MessageStartChars pchMessageStart;
+    uint32_t nVersion;
+    filein >> FLATDATA(pchMessageStart) >> nVersion;
+    if (memcmp(pchMessageStart, chainparams.MessageStart(), sizeof(pchMessageStart)) != 0) {
+        strError = "Header bundle is for a different network";
+        return false;
+    }
+    if (nVersion != HEADER_BUNDLE_VERSION) {
+        strError = strprintf("Unsupported header bundle version %u", nVersion);
+        return false;
+    }
+    filein >> nHeaders;
+    return true;
+}
+
+bool LoadHeaderBundle(const CChainParams& chainparams, const boost::filesystem::path& path, CHeaderBundleInfo& info, std::string& strError)
+{
+    if (!CheckSnapshotChecksum(path, strError))
+        return false;
+
+    // First pass: check that the headers link up and find the last checkpoint they reach,
+    // without touching the block index
+    const MapCheckpoints& checkpoints = chainparams.Checkpoints().mapCheckpoints;
+    try {
+        CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        uint64_t nHeaders;
+        if (!OpenHeaderBundle(chainparams, path, filein, nHeaders, strError))
+            return false;
+        uint256 hashPrev = chainparams.GetConsensus().hashGenesisBlock;
+        for (uint64_t i = 0; i < nHeaders; i++) {
+            if (i % HEADER_BUNDLE_BATCH_SIZE == 0)
+                boost::this_thread::interruption_point();
+            CBlockHeader header;
+            filein >> header;
+            if (header.hashPrevBlock != hashPrev) {
+                strError = strprintf("Header at height %d does not follow the previous one", i + 1);
+                return false;
+            }
+            hashPrev = header.GetHash();
+            MapCheckpoints::const_iterator it = checkpoints.find(i + 1);
+            if (it != checkpoints.end()) {
+                if (it->second != hashPrev) {
+                    strError = strprintf("Header at height %d does not match its checkpoint", i + 1);
+                    return false;
+                }
+                info.hashBlock = hashPrev;
+                info.nHeight = i + 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Reading the header bundle failed: %s", e.what());
+        return false;
+    }
+    if (info.nHeight == 0) {
+        strError = "The header bundle does not reach a checkpoint";
+        return false;
+    }
+
+    // Second pass: add the pinned headers to the block index, taking cs_main for one batch at a
+    // time so block validation and the RPC server are not held up for the whole import
+    {
+        LOCK(cs_main);
+        if (!mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock)) {
+            strError = "The genesis block is not loaded";
+            return false;
+        }
+    }
+    info.nHeaders = 0;
+    try {
+        CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        uint64_t nHeaders;
+        if (!OpenHeaderBundle(chainparams, path, filein, nHeaders, strError))
+            return false;
+        std::vector<CBlockHeader> vHeaders;
+        vHeaders.reserve(HEADER_BUNDLE_BATCH_SIZE);
+        int nRead = 0;
+        while (nRead < info.nHeight) {
+            boost::this_thread::interruption_point();
+            vHeaders.clear();
+            for (; nRead < info.nHeight && vHeaders.size() < HEADER_BUNDLE_BATCH_SIZE; nRead++) {
+                vHeaders.push_back(CBlockHeader());
+                filein >> vHeaders.back();
+            }
+            // The batches come in order, so the previous header of each is in the block index
+            LOCK(cs_main);
+            size_t nBlockIndexSize = mapBlockIndex.size();
+            for (const CBlockHeader& header : vHeaders)
+                AddToBlockIndex(header, chainparams);
+            info.nHeaders += mapBlockIndex.size() - nBlockIndexSize;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Reading the header bundle failed: %s", e.what());
+        return false;
+    }
+    {
+        LOCK(cs_main);
+        CheckBlockIndex(chainparams.GetConsensus());
+    }
+    NotifyHeaderTip();
+    LogPrintf("%s: added %u headers up to height %d (%s) from %s\n", __func__, info.nHeaders, info.nHeight, info.hashBlock.ToString(), path.string());
+    return true;
+}
+
+namespace {
+
+/** A block read by the LoadExternalBlockFile pipeline */
+struct CBlockImportJob
+{
+    uint64_t nPos;                 //!< position of the block in the file
+    unsigned int nSize;            //!< serialized size of the block
+    CDataStream ssBlock;           //!< serialized block, released once deserialized
+    std::shared_ptr<CBlock> pblock; //!< NULL if deserialization failed
+    std::string strError;
+    bool fDone;
+
+    CBlockImportJob() : nPos(0), nSize(0), ssBlock(SER_DISK, CLIENT_VERSION), fDone(false) {}
+};
+
+/**
+ * Reads a block file on a reader thread and deserializes and checks the blocks with
+ * CheckBlock() on a pool of workers. Next() hands the blocks out in file order.
+ */
+class CBlockImportPipeline
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condReader; //!< the reader waits for room in the queue
+    boost::condition_variable condWorker; //!< the workers wait for blocks to deserialize
+    boost::condition_variable condNext;   //!< Next() waits for the first block to be deserialized
+    std::deque<std::shared_ptr<CBlockImportJob> > queue; //!< blocks handed out by Next(), in file order
+    size_t nNextWork;                     //!< index in queue of the first block no worker took yet
+    size_t nQueueBytes;                   //!< serialized size of the blocks in queue
+    bool fReadDone;
+    bool fStop;
+    std::string strReadError;
+    boost::thread_group threadGroup;
+
+    void Push(const std::shared_ptr<CBlockImportJob>& job)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fStop && !queue.empty() && nQueueBytes + job->nSize > MAX_IMPORT_QUEUE_BYTES)
+            condReader.wait(lock);
+        queue.push_back(job);
+        nQueueBytes += job->nSize;
+        condWorker.notify_one();
+    }
+
+    bool IsStopping()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return fStop;
+    }
+
+    void ThreadRead(FILE* fileIn, const CChainParams& chainparams)
+    {
+        try {
+            // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+            CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+            uint64_t nRewind = blkdat.GetPos();
+            while (!blkdat.eof() && !IsStopping()) {
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                std::shared_ptr<CBlockImportJob> job = std::make_shared<CBlockImportJob>();
+                try {
+                    // read block
+                    job->nPos = blkdat.GetPos();
+                    job->nSize = nSize;
+                    blkdat.SetLimit(job->nPos + nSize);
+                    job->ssBlock.resize(nSize);
+                    blkdat.read(job->ssBlock.data(), nSize);
+                    nRewind = blkdat.GetPos();
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: I/O error - %s\n", __func__, e.what());
+                    continue;
+                }
+                Push(job);
+            }
+        } catch (const std::runtime_error& e) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            strReadError = e.what();
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fReadDone = true;
+        condWorker.notify_all();
+        condNext.notify_all();
+    }
+
+    void ThreadWork(const Consensus::Params& params)
+    {
+        while (true) {
+            // Take a few blocks at once, so their scrypt hashes are computed together
+            std::vector<std::shared_ptr<CBlockImportJob> > vJobs;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNextWork == queue.size()) {
+                    if (fReadDone)
+                        return;
+                    condWorker.wait(lock);
+                }
+                if (fStop)
+                    return;
+                while (nNextWork < queue.size() && vJobs.size() < (size_t)SCRYPT_MULTI_MAX_WAYS)
+                    vJobs.push_back(queue[nNextWork++]);
+            }
+            std::vector<std::shared_ptr<CBlock> > vpblock;
+            for (const auto& job : vJobs) {
+                try {
+                    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                    job->ssBlock >> *pblock;
+                    job->pblock = pblock;
+                    vpblock.push_back(pblock);
+                } catch (const std::exception& e) {
+                    job->strError = e.what();
+                }
+                job->ssBlock = CDataStream(SER_DISK, CLIENT_VERSION);
+            }
+            // Run the context-free checks (scrypt hash, merkle root, transactions) here, so
+            // AcceptBlock() only does the contextual ones. A block that fails is checked
+            // again there to report the error.
+            CheckBlocksMulti(vpblock, params);
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (const auto& job : vJobs)
+                job->fDone = true;
+            condNext.notify_all();
+        }
+    }
+
+public:
+    CBlockImportPipeline(FILE* fileIn, const CChainParams& chainparams, int nWorkers) :
+        nNextWork(0), nQueueBytes(0), fReadDone(false), fStop(false)
+    {
+        threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadRead, this, fileIn, boost::cref(chainparams)));
+        for (int i = 0; i < nWorkers; i++)
+            threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadWork, this, boost::cref(chainparams.GetConsensus())));
+    }
+
+    ~CBlockImportPipeline()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+            condReader.notify_all();
+            condWorker.notify_all();
+        }
+        threadGroup.join_all();
+    }
+
+    /** Wait for the next block of the file. Returns false once the whole file was handed out. */
+    bool Next(std::shared_ptr<CBlockImportJob>& job)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queue.empty() || !queue.front()->fDone) {
+            if (queue.empty() && fReadDone)
+                return false;
+            condNext.wait(lock);
+        }
+        job = queue.front();
+        queue.pop_front();
+        nNextWork--;
+        nQueueBytes -= job->nSize;
+        condReader.notify_one();
+        return true;
+    }
+
+    /** The error that stopped the reader, if any */
+    std::string GetReadError()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return strReadError;
+    }
+};
+
+/** A block whose parent was not known yet when LoadExternalBlockFile read it */
+struct CBlockUnknownParent
+{
+    CDiskBlockPos pos;                    //!< null for -loadblock files, which have no position
+    std::shared_ptr<const CBlock> pblock; //!< NULL if it did not fit in -reindexbuffer, read again from pos
+    size_t nSize;
+};
+
+} // anon namespace
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+{
+    // Blocks with unknown parent (in memory up to nReindexBufferSize, otherwise only stored if read from a block file)
+    static std::multimap<uint256, CBlockUnknownParent> mapBlocksUnknownParent;
+    static size_t nUnknownParentBytes = 0;
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    try {
+        CBlockImportPipeline pipeline(fileIn, chainparams, std::max(nScriptCheckThreads, 1));
+        std::shared_ptr<CBlockImportJob> job;
+        while (pipeline.Next(job)) {
+            boost::this_thread::interruption_point();
+
+            if (!job->pblock) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, job->strError);
+                continue;
+            }
+            try {
+                if (dbp)
+                    dbp->nPos = job->nPos;
+                std::shared_ptr<CBlock> pblock = job->pblock;
+                CBlock& block = *pblock;
+
+                // detect out of order blocks, and store them for later
+                uint256 hash = block.GetHash();
+                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                            block.hashPrevBlock.ToString());
+                    CBlockUnknownParent unknown;
+                    if (dbp)
+                        unknown.pos = *dbp;
+                    unknown.nSize = job->nSize;
+                    if (nUnknownParentBytes + job->nSize <= nReindexBufferSize) {
+                        unknown.pblock = pblock;
+                        nUnknownParentBytes += job->nSize;
+                    }
+                    if (unknown.pblock || dbp)
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, unknown));
+                    continue;
+                }
+
+                // process in case the block isn't known yet
+                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                    LOCK(cs_main);
+                    CValidationState state;
+                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
+                        nLoaded++;
+                    if (state.IsError())
+                        break;
+                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                }
+
+                // Activate the genesis block so normal node progress can continue
+                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                    CValidationState state;
+                    if (!ActivateBestChain(state, chainparams)) {
+                        break;
+                    }
+                }
+
+                NotifyHeaderTip();
+
+                // Recursively process earlier encountered successors of this block
+                std::deque<uint256> queue;
+                queue.push_back(hash);
+                while (!queue.empty()) {
+                    uint256 head = queue.front();
                     queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                    std::pair<std::multimap<uint256, CBlockUnknownParent>::iterator, std::multimap<uint256, CBlockUnknownParent>::iterator> range = mapBlocksUnknownParent.equal_range(head);
                     while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+                        std::multimap<uint256, CBlockUnknownParent>::iterator it = range.first;
+                        std::shared_ptr<const CBlock> pblockrecursive = it->second.pblock;
+                        if (pblockrecursive) {
+                            nUnknownParentBytes -= it->second.nSize;
+                        } else {
+                            std::shared_ptr<CBlock> pblockread = std::make_shared<CBlock>();
+                            if (ReadBlockFromDisk(*pblockread, it->second.pos, chainparams.GetConsensus()))
+                                pblockrecursive = pblockread;
+                        }
+                        if (pblockrecursive)
                         {
                             LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
                                     head.ToString());
                             LOCK(cs_main);
                             CValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
+                            if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, it->second.pos.IsNull() ? NULL : &it->second.pos, NULL))
                             {
                                 nLoaded++;
                                 queue.push_back(pblockrecursive->GetHash());
@@ -4507,6 +7119,8 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
+        if (!pipeline.GetReadError().empty())
+            throw std::runtime_error(pipeline.GetReadError());
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -4515,6 +7129,306 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     return nLoaded > 0;
 }
 
+bool ConnectSnapshotBlock(const CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams, CValidationState& state)
+{
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+    assert(pindex->pprev && pindex->pprev->GetBlockHash() == view.GetBestBlock());
+
+    if (!CheckBlock(block, state, consensusParams))
+        return false;
+    if (block.IsProofOfStake() != pindex->IsProofOfStake())
+        return state.DoS(100, false, REJECT_INVALID, "bad-snapshot-stake-flag");
+    if ((unsigned int)block.GetStakeEntropyBit(pindex->nTime) != pindex->GetStakeEntropyBit())
+        return state.DoS(100, false, REJECT_INVALID, "bad-snapshot-entropy-bit");
+    if (block.IsProofOfStake() && (block.vtx[1]->vin[0].prevout != pindex->GetPrevoutStake() || block.vtx[1]->nTime != pindex->GetStakeTime()))
+        return state.DoS(100, false, REJECT_INVALID, "bad-snapshot-stake");
+
+    unsigned int flags = GetBlockScriptFlags(pindex, consensusParams);
+    CBlockAmounts amounts;
+    uint64_t nStakeTime = 0;
+    int64_t nSigOpsCost = 0;
+    unsigned int nTxOffset = GetSizeOfCompactSize(block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *(block.vtx[i]);
+
+        nSigOpsCost += GetTransactionSigOpCost(tx, view, flags);
+        if (nSigOpsCost > MAX_BLOCK_SIGOPS_COST)
+            return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops");
+
+        if (!tx.IsCoinBase()) {
+            if (!view.HaveInputs(tx))
+                return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-missingorspent");
+            if (!Consensus::CheckTxInputs(tx, state, view, pindex->nHeight))
+                return false;
+        }
+        amounts.Add(tx, view);
+
+        // The stake time needs the spent outputs, so it is computed before they are spent
+        if (tx.IsCoinStake()) {
+            LOCK(cs_main);
+            if (!GetStakeTime(tx, nStakeTime, pindex->pprev, consensusParams, &view))
+                return state.DoS(100, false, REJECT_INVALID, "bad-cs-staketime");
+        }
+
+        CTxUndo undoDummy;
+        UpdateCoins(tx, view, undoDummy, pindex->nHeight, block.GetBlockTime(), nTxOffset);
+        nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+
+    {
+        LOCK(cs_main);
+        if (!CheckBlockReward(block, state, pindex, amounts, nStakeTime, consensusParams))
+            return false;
+    }
+    if (pindex->nMint != amounts.GetMint() || pindex->nMoneySupply != amounts.GetMoneySupply(pindex->pprev))
+        return state.DoS(100, false, REJECT_INVALID, "bad-snapshot-money-supply");
+
+    {
+        LOCK(cs_main);
+        uint64_t nStakeModifier = 0;
+        bool fGeneratedStakeModifier = false;
+        if (!ComputeNextStakeModifier(pindex, nStakeModifier, fGeneratedStakeModifier, consensusParams) ||
+            nStakeModifier != pindex->nStakeModifier || fGeneratedStakeModifier != pindex->GeneratedStakeModifier())
+            return state.DoS(100, false, REJECT_INVALID, "bad-snapshot-stake-modifier");
+    }
+
+    view.SetBestBlock(pindex->GetBlockHash());
+    return true;
+}
+
+namespace {
+
+boost::thread threadSnapshotValidation;
+CCriticalSection cs_snapshotvalidation;
+CSnapshotValidationInfo snapshotValidationInfo;
+
+void UpdateSnapshotValidationInfo(int nValidated)
+{
+    LOCK(cs_snapshotvalidation);
+    snapshotValidationInfo.nValidated = nValidated;
+}
+
+/** Record how the validation ended, in the block tree database and for getblockchaininfo */
+void FinishSnapshotValidation(CSnapshotValidationTarget& target, int nStatus, const std::string& strError)
+{
+    target.nStatus = nStatus;
+    target.strError = strError;
+    if (!pblocktree->WriteSnapshotValidation(target))
+        LogPrintf("%s: failed to write the snapshot validation status\n", __func__);
+    LOCK(cs_snapshotvalidation);
+    snapshotValidationInfo.nStatus = nStatus;
+    snapshotValidationInfo.strError = strError;
+}
+
+void ThreadSnapshotValidation(const CChainParams& chainparams)
+{
+    SetThreadLowPriority();
+
+    CSnapshotValidationTarget target;
+    CBlockIndex* pindexSnapshot = NULL;
+    {
+        LOCK(cs_main);
+        if (!pblocktree->ReadSnapshotValidation(target) || target.nStatus != SNAPSHOT_VALIDATION_PENDING)
+            return;
+        BlockMap::iterator mi = mapBlockIndex.find(target.hashBlock);
+        if (mi == mapBlockIndex.end()) {
+            LogPrintf("%s: snapshot block %s not found\n", __func__, target.hashBlock.ToString());
+            return;
+        }
+        pindexSnapshot = mi->second;
+    }
+    std::vector<boost::filesystem::path> vFiles;
+    if (mapMultiArgs.count("-snapshotblocks")) {
+        for (const std::string& strFile : mapMultiArgs.at("-snapshotblocks"))
+            vFiles.push_back(boost::filesystem::absolute(strFile, GetDataDir()));
+    }
+    if (vFiles.empty()) {
+        LogPrintf("%s: the snapshot at height %d is not validated yet, -snapshotblocks is needed to check it\n", __func__, target.nHeight);
+        return;
+    }
+
+    int64_t nTotalCache = std::max(GetArg("-snapshotvalidationdbcache", DEFAULT_SNAPSHOT_VALIDATION_DBCACHE), MIN_SNAPSHOT_VALIDATION_DBCACHE) << 20;
+    size_t nDBCache = nTotalCache / 8;
+    size_t nCoinsCache = nTotalCache - nDBCache;
+
+    // Continue from the last flush if it is on the way to the snapshot, otherwise start over
+    std::unique_ptr<CCoinsViewDB> pdbview(new CCoinsViewDB(nDBCache, false, false, "chainstate_snapshot"));
+    CBlockIndex* pindexBest = NULL;
+    uint256 hashBest = pdbview->GetBestBlock();
+    if (!hashBest.IsNull()) {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+        if (mi != mapBlockIndex.end() && pindexSnapshot->GetAncestor(mi->second->nHeight) == mi->second)
+            pindexBest = mi->second;
+    }
+    if (!pindexBest) {
+        pdbview.reset();
+        pdbview.reset(new CCoinsViewDB(nDBCache, false, true, "chainstate_snapshot"));
+    }
+    std::unique_ptr<CCoinsViewCache> pview(new CCoinsViewCache(pdbview.get()));
+    if (!pindexBest) {
+        // The outputs of the genesis block are not spendable, so it is connected without its transactions
+        pindexBest = pindexSnapshot->GetAncestor(0);
+        pview->SetBestBlock(pindexBest->GetBlockHash());
+    }
+    UpdateSnapshotValidationInfo(pindexBest->nHeight);
+    LogPrintf("%s: validating the snapshot at height %d from height %d\n", __func__, target.nHeight, pindexBest->nHeight);
+
+    // Blocks of the snapshot chain read before their parent, by parent hash, up to -reindexbuffer
+    std::map<uint256, std::pair<std::shared_ptr<const CBlock>, size_t> > mapAhead;
+    size_t nAheadBytes = 0;
+    int64_t nStart = GetTimeMillis();
+    try {
+        for (const boost::filesystem::path& path : vFiles) {
+            if (pindexBest == pindexSnapshot)
+                break;
+            FILE* file = fopen(path.string().c_str(), "rb");
+            if (!file) {
+                LogPrintf("%s: unable to open %s\n", __func__, path.string());
+                continue;
+            }
+            CBlockImportPipeline pipeline(file, chainparams, 1);
+            std::shared_ptr<CBlockImportJob> job;
+            while (pindexBest != pindexSnapshot && pipeline.Next(job)) {
+                boost::this_thread::interruption_point();
+                if (!job->pblock)
+                    continue;
+                std::shared_ptr<const CBlock> pblock = job->pblock;
+                if (pblock->hashPrevBlock != pindexBest->GetBlockHash()) {
+                    LOCK(cs_main);
+                    BlockMap::iterator mi = mapBlockIndex.find(pblock->GetHash());
+                    if (mi != mapBlockIndex.end() && mi->second->nHeight > pindexBest->nHeight + 1 &&
+                        pindexSnapshot->GetAncestor(mi->second->nHeight) == mi->second &&
+                        nAheadBytes + job->nSize <= nReindexBufferSize && !mapAhead.count(pblock->hashPrevBlock)) {
+                        mapAhead[pblock->hashPrevBlock] = std::make_pair(pblock, (size_t)job->nSize);
+                        nAheadBytes += job->nSize;
+                    }
+                    continue;
+                }
+                while (pblock) {
+                    CBlockIndex* pindex = pindexSnapshot->GetAncestor(pindexBest->nHeight + 1);
+                    if (pblock->GetHash() != pindex->GetBlockHash())
+                        break; // a block of another branch
+                    CValidationState state;
+                    if (!ConnectSnapshotBlock(*pblock, pindex, *pview, chainparams, state)) {
+                        std::string strError = strprintf("block %s at height %d does not match the snapshot: %s",
+                            pindex->GetBlockHash().ToString(), pindex->nHeight, FormatStateMessage(state));
+                        std::string strWarning = strprintf(_("Warning: The loaded UTXO snapshot is invalid, %s. Reload the chainstate with -reindex-chainstate from a trusted source."), strError);
+                        SetMiscWarning(strWarning);
+                        LogPrintf("*** %s\n", strWarning);
+                        AlertNotify(strWarning);
+                        FinishSnapshotValidation(target, SNAPSHOT_VALIDATION_INVALID, strError);
+                        return;
+                    }
+                    pindexBest = pindex;
+                    UpdateSnapshotValidationInfo(pindexBest->nHeight);
+                    if (pview->DynamicMemoryUsage() > nCoinsCache && !pview->Flush())
+                        throw std::runtime_error("unable to write the snapshot validation coins");
+                    if (pindexBest->nHeight % 10000 == 0)
+                        LogPrintf("%s: validated up to height %d\n", __func__, pindexBest->nHeight);
+
+                    pblock.reset();
+                    std::map<uint256, std::pair<std::shared_ptr<const CBlock>, size_t> >::iterator it = mapAhead.find(pindexBest->GetBlockHash());
+                    if (it != mapAhead.end() && pindexBest != pindexSnapshot) {
+                        pblock = it->second.first;
+                        nAheadBytes -= it->second.second;
+                        mapAhead.erase(it);
+                    }
+                }
+            }
+            if (!pipeline.GetReadError().empty())
+                throw std::runtime_error(pipeline.GetReadError());
+        }
+        if (!pview->Flush())
+            throw std::runtime_error("unable to write the snapshot validation coins");
+    } catch (const boost::thread_interrupted&) {
+        pview->Flush();
+        LogPrintf("%s: interrupted at height %d, continuing after a restart\n", __func__, pindexBest->nHeight);
+        throw;
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return;
+    }
+
+    if (pindexBest != pindexSnapshot) {
+        LogPrintf("%s: the -snapshotblocks files end at height %d, below the snapshot at height %d\n", __func__, pindexBest->nHeight, target.nHeight);
+        return;
+    }
+
+    // Hash the coins the blocks produced the same way LoadTxOutSetSnapshot() hashed the loaded ones
+    pview.reset();
+    uint256 hashCoins;
+    if (!GetSnapshotCoinsHash(*pdbview, hashCoins)) {
+        LogPrintf("%s: unable to read the snapshot validation coins\n", __func__);
+        return;
+    }
+    if (hashCoins != target.hashCoins) {
+        std::string strError = strprintf("the coins at height %d hash to %s instead of %s", target.nHeight, hashCoins.ToString(), target.hashCoins.ToString());
+        std::string strWarning = strprintf(_("Warning: The loaded UTXO snapshot is invalid, %s. Reload the chainstate with -reindex-chainstate from a trusted source."), strError);
+        SetMiscWarning(strWarning);
+        LogPrintf("*** %s\n", strWarning);
+        AlertNotify(strWarning);
+        FinishSnapshotValidation(target, SNAPSHOT_VALIDATION_INVALID, strError);
+        return;
+    }
+    FinishSnapshotValidation(target, SNAPSHOT_VALIDATION_VALID, "");
+    pdbview.reset();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(GetDataDir() / "chainstate_snapshot", ec);
+    LogPrintf("%s: the snapshot at height %d is valid, checked in %ds\n", __func__, target.nHeight, (GetTimeMillis() - nStart) / 1000);
+}
+
+void RunSnapshotValidation(const CChainParams& chainparams)
+{
+    try {
+        TraceThread("snapshotval", boost::bind(&ThreadSnapshotValidation, boost::cref(chainparams)));
+    } catch (const boost::thread_interrupted&) {
+        // Logged by TraceThread; the progress was flushed before
+    }
+    LOCK(cs_snapshotvalidation);
+    snapshotValidationInfo.fRunning = false;
+}
+
+} // anon namespace
+
+void StartSnapshotValidation(const CChainParams& chainparams)
+{
+    CSnapshotValidationTarget target;
+    if (!pblocktree->ReadSnapshotValidation(target))
+        return;
+    {
+        LOCK(cs_snapshotvalidation);
+        if (snapshotValidationInfo.fRunning)
+            return;
+        snapshotValidationInfo.fLoaded = true;
+        snapshotValidationInfo.hashBlock = target.hashBlock;
+        snapshotValidationInfo.nHeight = target.nHeight;
+        snapshotValidationInfo.nValidated = target.nStatus == SNAPSHOT_VALIDATION_VALID ? target.nHeight : -1;
+        snapshotValidationInfo.nStatus = target.nStatus;
+        snapshotValidationInfo.strError = target.strError;
+        if (target.nStatus != SNAPSHOT_VALIDATION_PENDING)
+            return;
+        snapshotValidationInfo.fRunning = true;
+    }
+    // A thread that ended leaves threadSnapshotValidation joinable, so wait for it before replacing it
+    if (threadSnapshotValidation.joinable())
+        threadSnapshotValidation.join();
+    threadSnapshotValidation = boost::thread(boost::bind(&RunSnapshotValidation, boost::cref(chainparams)));
+}
+
+void StopSnapshotValidation()
+{
+    threadSnapshotValidation.interrupt();
+    if (threadSnapshotValidation.joinable())
+        threadSnapshotValidation.join();
+}
+
+void GetSnapshotValidationInfo(CSnapshotValidationInfo& info)
+{
+    LOCK(cs_snapshotvalidation);
+    info = snapshotValidationInfo;
+}
+
 void static CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -4721,7 +7635,53 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/**
+ * SolarCoin: Version 1 holds the number of transactions followed by the transactions, in
+ * dependency order. Version 2 holds chunks of transactions, each preceded by its size and the
+ * last one empty, in no particular order, so that it can be written without holding mempool.cs
+ * for the whole dump.
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+/** SolarCoin: Transactions read from mempool.dat whose scripts are verified together */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 256;
+/** SolarCoin: Transactions copied out of the mempool per lock while dumping it */
+static const size_t MEMPOOL_DUMP_CHUNK_SIZE = 1000;
+
+/** SolarCoin: Order transactions so parents come before the children spending them */
+static std::vector<size_t> SortByDependencies(const std::vector<CTransactionRef>& vtx)
+{
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++)
+        mapIndex[vtx[i]->GetHash()] = i;
+
+    // Depth first, placing a transaction once all of its parents are placed
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vtx.size());
+    std::vector<bool> vSeen(vtx.size(), false);
+    std::vector<std::pair<size_t, size_t> > vStack; // transaction, next input to look at
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vSeen[i])
+            continue;
+        vSeen[i] = true;
+        vStack.push_back(std::make_pair(i, 0));
+        while (!vStack.empty()) {
+            const size_t nTx = vStack.back().first;
+            const size_t nIn = vStack.back().second;
+            if (nIn == vtx[nTx]->vin.size()) {
+                vOrder.push_back(nTx);
+                vStack.pop_back();
+                continue;
+            }
+            vStack.back().second++;
+            std::map<uint256, size_t>::const_iterator it = mapIndex.find(vtx[nTx]->vin[nIn].prevout.hash);
+            if (it != mapIndex.end() && !vSeen[it->second]) {
+                vSeen[it->second] = true;
+                vStack.push_back(std::make_pair(it->second, 0));
+            }
+        }
+    }
+    return vOrder;
+}
 
 bool LoadMempool(void)
 {
@@ -4741,38 +7701,37 @@ bool LoadMempool(void)
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+        double prioritydummy = 0;
+        std::vector<CTransactionRef> vtx;
+        std::vector<int64_t> vTime;
         uint64_t num;
         file >> num;
-        double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
-            }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime);
-                if (state.IsValid()) {
-                    ++count;
+        while (num) {
+            while (num) {
+                num--;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vtx.push_back(tx);
+                    vTime.push_back(nTime);
                 } else {
-                    ++failed;
+                    ++skipped;
                 }
-            } else {
-                ++skipped;
             }
-            if (ShutdownRequested())
-                return false;
+            if (version != 1)
+                file >> num;
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -4780,6 +7739,33 @@ bool LoadMempool(void)
         for (const auto& i : mapDeltas) {
             mempool.PrioritiseTransaction(i.first, i.first.ToString(), prioritydummy, i.second);
         }
+
+        // SolarCoin: accept the transactions in dependency order, a batch at a time: the scripts
+        // of a batch are verified on the script check threads, then it is accepted under one lock
+        std::vector<size_t> vOrder = SortByDependencies(vtx);
+        for (size_t nBegin = 0; nBegin < vOrder.size(); nBegin += MEMPOOL_LOAD_BATCH_SIZE) {
+            const size_t nEnd = std::min(nBegin + MEMPOOL_LOAD_BATCH_SIZE, vOrder.size());
+            std::vector<CTransactionRef> vBatch;
+            vBatch.reserve(nEnd - nBegin);
+            for (size_t i = nBegin; i < nEnd; i++)
+                vBatch.push_back(vtx[vOrder[i]]);
+            PreVerifyTransactionScripts(vBatch);
+
+            {
+                LOCK(cs_main);
+                for (size_t i = nBegin; i < nEnd; i++) {
+                    CValidationState state;
+                    AcceptToMemoryPoolWithTime(mempool, state, vtx[vOrder[i]], true, NULL, vTime[vOrder[i]]);
+                    if (state.IsValid()) {
+                        ++count;
+                    } else {
+                        ++failed;
+                    }
+                }
+            }
+            if (ShutdownRequested())
+                return false;
+        }
     } catch (const std::exception& e) {
         LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
         return false;
@@ -4794,15 +7780,16 @@ void DumpMempool(void)
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    std::vector<uint256> vHashes;
 
     {
         LOCK(mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second.second;
         }
-        vinfo = mempool.infoAll();
     }
+    // SolarCoin: only the hashes are copied up front; the entries are copied a chunk per lock
+    mempool.queryHashesUnsorted(vHashes);
 
     int64_t mid = GetTimeMicros();
 
@@ -4817,13 +7804,20 @@ void DumpMempool(void)
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
+        for (size_t nBegin = 0; nBegin < vHashes.size(); nBegin += MEMPOOL_DUMP_CHUNK_SIZE) {
+            std::vector<uint256> vChunk(vHashes.begin() + nBegin, vHashes.begin() + std::min(nBegin + MEMPOOL_DUMP_CHUNK_SIZE, vHashes.size()));
+            std::vector<TxMempoolInfo> vinfo = mempool.infoSorted(vChunk);
+            if (vinfo.empty())
+                continue;
+            file << (uint64_t)vinfo.size();
+            for (const auto& i : vinfo) {
+                file << *(i.tx);
+                file << (int64_t)i.nTime;
+                file << (int64_t)i.nFeeDelta;
+                mapDeltas.erase(i.tx->GetHash());
+            }
         }
+        file << (uint64_t)0;
 
         file << mapDeltas;
         FileCommit(file.Get());
@@ -4862,7 +7856,7 @@ public:
         // block headers
         BlockMap::iterator it1 = mapBlockIndex.begin();
         for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+            DeleteBlockIndex((*it1).second);
         mapBlockIndex.clear();
     }
 } instance_of_cmaincleanup;
@@ -13,8 +13,10 @@
 #include "amount.h"
 #include "chain.h"
 #include "coins.h"
+#include "crypto/scrypt.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "script/script_error.h"
+#include "stakeseen.h"
 #include "sync.h"
 #include "versionbits.h"
 
@@ -28,14 +30,17 @@
 #include <vector>
 
 #include <atomic>
+#include <memory>
 
 #include <boost/unordered_map.hpp>
 #include <boost/filesystem/path.hpp>
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CBloomFilter;
 class CChainParams;
+class CCoinsViewDB;
 class CInv;
 class CConnman;
 class CScriptCheck;
@@ -75,15 +80,57 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** -blockfileprealloc default (MiB the blk?????.dat files are pre-allocated by; rev?????.dat files by 1/16 of it) */
+static const unsigned int DEFAULT_BLOCKFILE_PREALLOC = BLOCKFILE_CHUNK_SIZE / 1024 / 1024;
 
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -reindexbuffer default (MiB of out-of-order blocks kept in memory by LoadExternalBlockFile) */
+static const unsigned int DEFAULT_REINDEX_BUFFER = 128;
+/** Transactions per CBlockCheck job; blocks with more are checked on the block check threads */
+static const unsigned int BLOCK_CHECK_TXS_PER_JOB = 64;
+/** Serialized bytes of blocks LoadExternalBlockFile reads ahead of validation */
+static const unsigned int MAX_IMPORT_QUEUE_BYTES = 32 * 1024 * 1024;
+/** Block files pruned by one flush when pruning up to a height given to pruneblockchain */
+static const unsigned int MAX_PRUNE_FILES_PER_FLUSH = 4;
+/** Milliseconds between the deletions of pruned blk/rev file pairs */
+static const int64_t PRUNE_UNLINK_INTERVAL = 500;
+/** Blocks CVerifyDB reads and checks ahead of the one it verifies */
+static const unsigned int VERIFYDB_WINDOW_BLOCKS = 64;
+/** -coinsprefetch default (number of threads reading the inputs of blocks ahead of ConnectBlock, 0 = off) */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 4;
+/** Maximum number of coins prefetch threads allowed */
+static const int MAX_COINS_PREFETCH_THREADS = 16;
+/** Number of blocks after the one being connected whose inputs are prefetched */
+static const int COINS_PREFETCH_AHEAD = 2;
+/** SolarCoin: Whether to compact the chainstate database once the initial block download is done */
+static const bool DEFAULT_DB_COMPACT_AFTER_IBD = true;
+/** SolarCoin: Blocks the initial block download must have connected for the chainstate to be compacted after it */
+static const int DB_COMPACT_AFTER_IBD_MIN_BLOCKS = 10000;
+/** SolarCoin: Ranges each key prefix is compacted in, and the pause in milliseconds between ranges */
+static const int DEFAULT_DB_COMPACT_SPLITS = 16;
+static const int64_t DEFAULT_DB_COMPACT_PAUSE = 100;
+/** SolarCoin: -snapshotvalidationdbcache default and minimum (MiB), split between the coins cache and the database cache */
+static const int64_t DEFAULT_SNAPSHOT_VALIDATION_DBCACHE = 100;
+static const int64_t MIN_SNAPSHOT_VALIDATION_DBCACHE = 4;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** SolarCoin: Bounds of the blocks in transit from a peer once its throughput is measured */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** SolarCoin: Seconds of a peer's measured block throughput requested from it at a time */
+static const int64_t BLOCKS_IN_TRANSIT_TARGET_TIME = 4;
+/** SolarCoin: Requested blocks a peer must have delivered before its throughput is used */
+static const int BLOCK_DOWNLOAD_MIN_SAMPLES = 4;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** SolarCoin: Microseconds the block at the lower edge of the download window may be in flight from a slower peer before a faster one is asked for it */
+static const int64_t BLOCK_EDGE_REFETCH_TIMEOUT = 1000000;
+/** SolarCoin: Times the lower edge of the download window may be refetched from a peer before it is disconnected; one is forgiven every BLOCK_STALL_FORGIVE_BLOCKS blocks it delivers */
+static const int MAX_BLOCK_STALLS = 4;
+static const int BLOCK_STALL_FORGIVE_BLOCKS = 64;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
@@ -95,8 +142,14 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
- *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
+ *  harder). SolarCoin: The window adapts to the measured rates (see GetBlockDownloadWindow()); this
+ *  is its size until they are measured. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** SolarCoin: The download window is sized to cover this many seconds of the slower of the measured download
+ *  and validation rates, within these bounds; BLOCK_DOWNLOAD_WINDOW is used until they are measured. */
+static const int64_t BLOCK_DOWNLOAD_WINDOW_TIME = 30;
+static const unsigned int MIN_BLOCK_DOWNLOAD_WINDOW = 256;
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 4096;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -137,6 +190,8 @@ static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 // (nTxOffset) in kernel.cpp. Nobody's going to know that when compiling, so default to true
 // to avoid confusing stake check failure messages. 
 static const bool DEFAULT_TXINDEX = true;
+/** SolarCoin: -txindexcompact default (index transactions by truncated salted txid, block height and offset) */
+static const bool DEFAULT_TXINDEX_COMPACT = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -mempoolreplacement */
@@ -158,9 +213,7 @@ struct BlockHasher
 };
 
 // SolarCoin: PoST
-typedef boost::unordered_map<uint256, uint256, BlockHasher> HashMap;
-extern HashMap mapProofOfStake;
-extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
+extern CStakeSeenSet setStakeSeen;
 /**
  * Returns true if there are nRequired or more blocks of minVersion or above
  * in the last nToCheck blocks, starting at pstart and going backwards.
@@ -173,6 +226,8 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** SolarCoin: Bytes of memory used by mapBlockIndex and its entries */
+size_t GetBlockIndexMemoryUsage();
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern uint64_t nLastBlockWeight;
@@ -182,12 +237,19 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nCoinsPrefetchThreads;
 extern bool fTxIndex;
+extern bool fTxIndexCompact;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Bytes of out-of-order blocks LoadExternalBlockFile keeps in memory instead of reading them again */
+extern size_t nReindexBufferSize;
+/** Pre-allocation chunk sizes of the block and undo files (-blockfileprealloc) */
+extern unsigned int nBlockFileChunkSize;
+extern unsigned int nUndoFileChunkSize;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -220,6 +282,8 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 512; // SolarCoin: Needs to be >=
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -stopatheight (0 = do not stop) */
+static const int DEFAULT_STOPATHEIGHT = 0;
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -248,9 +312,24 @@ static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
  * @param[in]   pblock  The block we want to process.
  * @param[in]   fForceProcessing Process this block even if unrequested; used for non-network block sources and whitelisted peers.
  * @param[out]  fNewBlock A boolean which is set to indicate if the block was first received via this call
+ * @param[out]  pnProofFailedMicros SolarCoin: If not NULL, set to the time spent on the block when it failed its proof-of-stake or timestamp check, 0 otherwise
  * @return True if state.IsValid()
  */
-bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool* fNewBlock);
+bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool* fNewBlock, int64_t* pnProofFailedMicros = NULL);
+
+/**
+ * SolarCoin: Check the timestamp and the kernel of a PoST block whose parent is in the block index,
+ * unless fCheckedProofOfStake tells they were checked already. ProcessNewBlock() calls it before it
+ * takes cs_main, and again under cs_main before AcceptBlock() for a parent added in between.
+ *
+ * @param[out]     state Invalid when the timestamp is rejected, left valid when the kernel fails
+ * @param[in,out]  fCheckedProofOfStake Set once the kernel passed
+ * @param[out]     hashProofOfStake The kernel hash, to record in the block index
+ * @param[out]     fRelayEarly Whether the block may be relayed before it is connected
+ * @param[out]     pnProofFailedMicros If not NULL, set to the time the failed kernel check took
+ * @return False if the block failed either check
+ */
+bool CheckNewBlockProofOfStake(const CBlock& block, CValidationState& state, bool& fCheckedProofOfStake, uint256& hashProofOfStake, bool& fRelayEarly, int64_t* pnProofFailedMicros, const Consensus::Params& params);
 
 /**
  * Process incoming block headers.
@@ -272,16 +351,127 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
-/** Import blocks from an external file */
+/**
+ * Import blocks from an external file. A reader thread scans the file while a pool of
+ * nScriptCheckThreads workers deserializes and checks the blocks ahead of validation.
+ */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
+
+/** SolarCoin: Version of the UTXO snapshot files written by dumptxoutset */
+static const uint32_t TXOUTSET_SNAPSHOT_VERSION = 3;
+/** SolarCoin: Number of coins written to the coins database per batch by loadtxoutset */
+static const size_t TXOUTSET_SNAPSHOT_BATCH_SIZE = 100000;
+
+/** Base block and size of a UTXO snapshot */
+struct CTxOutSetSnapshotInfo
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nCoins;
+
+    CTxOutSetSnapshotInfo() : nHeight(0), nCoins(0) {}
+};
+
+/**
+ * SolarCoin: Write the coins database and the block index fields ConnectBlock() fills in
+ * (money supply, mint, stake modifiers, proof-of-stake data) of the active chain to a
+ * versioned, checksummed snapshot file.
+ */
+bool DumpTxOutSetSnapshot(const boost::filesystem::path& path, CTxOutSetSnapshotInfo& info, std::string& strError);
+/**
+ * SolarCoin: Bootstrap an empty chainstate from a snapshot written by DumpTxOutSetSnapshot().
+ * The headers up to the snapshot block must be known. Blocks below it are treated as pruned,
+ * so this requires -prune.
+ */
+bool LoadTxOutSetSnapshot(const CChainParams& chainparams, const boost::filesystem::path& path, CTxOutSetSnapshotInfo& info, std::string& strError);
+
+/** SolarCoin: Progress of the background validation of a loaded UTXO snapshot */
+struct CSnapshotValidationInfo
+{
+    bool fLoaded;      //!< a snapshot was loaded into this chainstate
+    bool fRunning;     //!< the blocks below it are being replayed
+    uint256 hashBlock; //!< the snapshot block
+    int nHeight;       //!< height of the snapshot block
+    int nValidated;    //!< height of the last block replayed, -1 before the first
+    int nStatus;       //!< see SnapshotValidationStatus
+    std::string strError;
+
+    CSnapshotValidationInfo() : fLoaded(false), fRunning(false), nHeight(0), nValidated(-1), nStatus(0) {}
+};
+
+/**
+ * SolarCoin: Check a loaded UTXO snapshot in the background, at a low thread priority. The blocks
+ * below it are read from the -snapshotblocks files (the node is pruned, so it has none of them),
+ * connected to a separate coins database in chainstate_snapshot/ and checked against the block index
+ * entries the snapshot filled in. Once the snapshot block is reached, the resulting coins must hash
+ * to those that were loaded; a mismatch raises an alert. Resumes where it stopped after a restart.
+ * Does nothing if no snapshot is pending validation.
+ */
+void StartSnapshotValidation(const CChainParams& chainparams);
+/**
+ * SolarCoin: Connect a block below a loaded UTXO snapshot to the coins of the background validation,
+ * and check that it matches the block index entry the snapshot filled in. Shares the amount and
+ * reward checks of ConnectBlock(), without the script checks it skips as well and without undo
+ * data, as these coins are never rolled back.
+ */
+bool ConnectSnapshotBlock(const CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams, CValidationState& state);
+/** SolarCoin: The hash of all the coins of view that a UTXO snapshot is checked against */
+bool GetSnapshotCoinsHash(const CCoinsView& view, uint256& hashCoins);
+/** SolarCoin: Interrupt the snapshot validation and wait for it to write its progress */
+void StopSnapshotValidation();
+void GetSnapshotValidationInfo(CSnapshotValidationInfo& info);
+
+/** SolarCoin: Version of the header bundle files written by dumpheaders */
+static const uint32_t HEADER_BUNDLE_VERSION = 1;
+
+/** Last header and number of headers of a header bundle */
+struct CHeaderBundleInfo
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nHeaders; //!< headers written, or headers new to the block index when loading
+
+    CHeaderBundleInfo() : nHeight(0), nHeaders(0) {}
+};
+
+/**
+ * SolarCoin: Write the headers of the active chain from height 1 up to nHeight (the last
+ * checkpoint in the active chain if nHeight < 0) to a versioned, checksummed header bundle.
+ */
+bool DumpHeaderBundle(const CChainParams& chainparams, const boost::filesystem::path& path, int nHeight, CHeaderBundleInfo& info, std::string& strError);
+/**
+ * SolarCoin: Add the headers of a bundle written by DumpHeaderBundle() to the block index, up to
+ * the last checkpoint among them. The headers must link up from genesis and match every
+ * checkpoint they reach, which pins them all: their proof of work and contextual checks are
+ * skipped. The headers are added in batches, each under its own lock of cs_main.
+ */
+bool LoadHeaderBundle(const CChainParams& chainparams, const boost::filesystem::path& path, CHeaderBundleInfo& info, std::string& strError);
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex(const CChainParams& chainparams);
+/**
+ * SolarCoin: Write the block index to a snapshot, loaded instead of scanning the block tree
+ * database at the next startup. Called at shutdown, after the last flush; returns false if some of
+ * the block index is not in the database.
+ */
+bool DumpBlockIndexSnapshot();
 /** Unload database information */
 void UnloadBlockIndex();
-/** Run an instance of the script checking thread */
+/** Run an instance of the verification thread, shared by the script, header, block and mempool checks */
 void ThreadScriptCheck();
+/** Run an instance of the thread reading the inputs of blocks about to be connected */
+void ThreadCoinsPrefetch();
+/** Drop the pending coins prefetches and wait for the reads in progress, before pcoinsdbview is replaced */
+void CancelCoinsPrefetch();
+/**
+ * SolarCoin: Compact the "chainstate", "blockindex" or "txindex" database a key range at a time,
+ * pausing -dbcompactpause milliseconds between ranges. Returns false if it was interrupted, or if
+ * there is no such database.
+ */
+bool CompactChainDB(const std::string& strName);
+/** SolarCoin: Run the thread that compacts the chainstate database once the initial block download is done */
+void ThreadCompactAfterIBD();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -296,6 +486,12 @@ std::string GetWarnings(const std::string& strFor);
 bool GetTransaction(const uint256 &hash, CTransactionRef &tx, unsigned int &nTxOffset, const Consensus::Params& params, uint256 &hashBlock, bool fAllowSlow = false);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock = std::shared_ptr<const CBlock>());
+/**
+ * SolarCoin: Log the blocks, transactions and inputs connected since startup with their rate, the
+ * total and percentiles of each block processing phase, the coins and stake prevout cache hit
+ * rates and the peak resident size. Logged when -stopatheight is reached, to measure a replay.
+ */
+void LogBlockConnectSummary();
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 
 /** Guess verification progress (as a fraction between 0.0=genesis and 1.0=current tip). */
@@ -324,17 +520,27 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
 void PruneOneBlockFile(const int fileNumber);
 
 /**
- *  Actually unlink the specified files
+ *  Mark block files as pruned, in one pass over the block index.
+ */
+void PruneBlockFiles(const std::set<int>& setFilesToPrune);
+
+/**
+ *  Actually unlink the specified files, in the background once StartBlockFileRemover() was called
  */
 void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
+/** Start deleting pruned files on a background thread */
+void StartBlockFileRemover();
+/** Delete the pruned files still queued, and stop the background thread */
+void StopBlockFileRemover();
+
 /** Create a new block index entry for a given block hash */
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
-/** Prune block files up to a given height */
+/** Prune block files up to a given height, MAX_PRUNE_FILES_PER_FLUSH at a time with the following flushes */
 void PruneBlockFilesManual(int nPruneUpToHeight);
 
 /** (try to) add transaction to memory pool
@@ -348,6 +554,19 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced = NULL,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/**
+ * SolarCoin: Run the scripts of transactions about to be given to AcceptToMemoryPool() without
+ * holding cs_main while they run, on the transaction script check threads when there are several.
+ * Must not be called with cs_main held. Their inputs are looked up under cs_main first, along with
+ * the policy, fee and input checks AcceptToMemoryPool() makes before any script; only transactions
+ * passing those have their scripts run. Those whose scripts all pass are recorded in the script
+ * execution cache, so the acceptance under cs_main that follows skips their scripts; the others
+ * are left for AcceptToMemoryPool() to reject. If pvState is given, its entry for a transaction
+ * failing its scripts is set the way AcceptToMemoryPool() would reject it, so the caller can do
+ * without the acceptance and its second run of the scripts.
+ */
+void PreVerifyTransactionScripts(const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>* pvState = NULL);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -385,10 +604,13 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. cacheSigStore stores the checked signatures in the
+ * signature cache; cacheFullScriptStore stores that all scripts passed with these flags in the
+ * script execution cache, if they were performed inline. txdata is initialized only if the
+ * scripts are not found in that cache.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -466,8 +688,8 @@ private:
 
 public:
     CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
+    CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(scriptPubKeyIn), amount(amountIn),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
@@ -486,11 +708,124 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * SolarCoin: Closure representing the scrypt proof of work check of up to SCRYPT_MULTI_MAX_WAYS
+ * headers, so a batch of headers can be verified on the header check threads before they are
+ * accepted under cs_main. The headers of a check are hashed together (see
+ * scrypt_1024_1_1_256_multi()). The check itself always succeeds; the result for each header
+ * is written to the flag given with it.
+ */
+class CHeaderPoWCheck
+{
+private:
+    const CBlockHeader* pheaders[SCRYPT_MULTI_MAX_WAYS];
+    char* pfValid[SCRYPT_MULTI_MAX_WAYS];
+    size_t nHeaders;
+    const Consensus::Params* pparams;
+
+public:
+    CHeaderPoWCheck(): nHeaders(0), pparams(NULL) {}
+    CHeaderPoWCheck(const Consensus::Params& paramsIn) : nHeaders(0), pparams(&paramsIn) {}
+
+    /** Add a header to the check, until IsFull() */
+    void Add(const CBlockHeader& header, char* pfValidIn)
+    {
+        assert(nHeaders < SCRYPT_MULTI_MAX_WAYS);
+        pheaders[nHeaders] = &header;
+        pfValid[nHeaders] = pfValidIn;
+        nHeaders++;
+    }
+    bool IsFull() const { return nHeaders == SCRYPT_MULTI_MAX_WAYS; }
+
+    bool operator()();
+
+    void swap(CHeaderPoWCheck &check) {
+        std::swap(pheaders, check.pheaders);
+        std::swap(pfValid, check.pfValid);
+        std::swap(nHeaders, check.nHeaders);
+        std::swap(pparams, check.pparams);
+    }
+};
+
+
+/**
+ * SolarCoin: Closure representing a part of the context-free CheckBlock() checks of a large block:
+ * either the merkle root (nBegin == nEnd) or CheckTransaction() of a range of its transactions,
+ * whose legacy sigops are written to *pnSigOps.
+ */
+class CBlockCheck
+{
+private:
+    const CBlock* pblock;
+    size_t nBegin;
+    size_t nEnd;
+    unsigned int* pnSigOps;
+
+public:
+    CBlockCheck(): pblock(NULL), nBegin(0), nEnd(0), pnSigOps(NULL) {}
+    CBlockCheck(const CBlock& blockIn, size_t nBeginIn, size_t nEndIn, unsigned int* pnSigOpsIn) :
+        pblock(&blockIn), nBegin(nBeginIn), nEnd(nEndIn), pnSigOps(pnSigOpsIn) {}
+
+    bool operator()();
+
+    void swap(CBlockCheck &check) {
+        std::swap(pblock, check.pblock);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pnSigOps, check.pnSigOps);
+    }
+};
+
+/**
+ * SolarCoin: Closure representing the script verification of one transaction for the mempool (see
+ * PreVerifyTransactionScripts()), given the outputs it spends. If all its inputs pass with each
+ * set of flags, every set is recorded in the script execution cache. If it fails the first set,
+ * the flags AcceptToMemoryPool() checks with, pstate is set to its rejection. The check itself
+ * always succeeds.
+ */
+class CTxScriptsCheck
+{
+private:
+    const CTransaction* ptx;
+    std::vector<CTxOut> vSpent;
+    std::vector<unsigned int> vFlags;
+    CValidationState* pstate;
+
+public:
+    CTxScriptsCheck(): ptx(NULL), pstate(NULL) {}
+    CTxScriptsCheck(const CTransaction& txIn, std::vector<CTxOut>& vSpentIn, const std::vector<unsigned int>& vFlagsIn, CValidationState* pstateIn = NULL) :
+        ptx(&txIn), vFlags(vFlagsIn), pstate(pstateIn) { vSpent.swap(vSpentIn); }
+
+    bool operator()();
+
+    void swap(CTxScriptsCheck &check) {
+        std::swap(ptx, check.ptx);
+        vSpent.swap(check.vSpent);
+        vFlags.swap(check.vFlags);
+        std::swap(pstate, check.pstate);
+    }
+};
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fReadTxns = true);
+/**
+ * SolarCoin: Read a block as the bytes stored in the block file, without deserializing it. The
+ * stored form is the network serialization with witness data; IsRawBlockSerialization() tells
+ * whether it also is the serialization for given flags.
+ */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+/** SolarCoin: Blocks from before segwit carry no witness data, so their stored bytes serve either flag. Requires cs_main. */
+bool IsRawBlockSerialization(const CBlockIndex* pindex, int nSerializeFlags, const Consensus::Params& params);
+/**
+ * SolarCoin: Read the undo data of a block (a CBlockUndo, with the outputs it spent) as the bytes
+ * stored in the undo file, checked against the checksum stored after them.
+ */
+bool ReadRawUndoFromDisk(std::vector<unsigned char>& undo, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+/** Read the undo data of a block, stored at pos, and check it against its checksum */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -499,6 +834,12 @@ void ComputeStakeModifier(CBlockIndex *pindexNew, uint64_t &nStakeModifier, bool
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/**
+ * SolarCoin: Whether CheckBlock() must check the scrypt hash of a block received whole. Not for
+ * the ancestors of the -assumevalid block and the best header: their headers were checked when
+ * they entered the index.
+ */
+bool IsBlockPoWCheckNeeded(const uint256& hashBlock, const Consensus::Params& consensusParams);
 
 /** Context-dependent validity checks.
  *  By "context", we mean only the previous block headers, but not the UTXO
@@ -508,15 +849,19 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const Co
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons).
+ *  SolarCoin: pblockundoOut, if given, receives the undo data of the block (the outputs it spent). */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins,
-                  const CChainParams& chainparams, bool fJustCheck = false);
+                  const CChainParams& chainparams, bool fJustCheck = false, CBlockUndo* pblockundoOut = NULL);
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified.
+ *  SolarCoin: pblockundoOut, if given, receives the undo data that was read. pblockundoIn, if
+ *  given, is the undo data of the block read ahead of time; it is used instead of reading it, and
+ *  its coins are moved out. */
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, CBlockUndo* pblockundoOut = NULL, CBlockUndo* pblockundoIn = NULL);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
@@ -541,6 +886,9 @@ public:
     bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/** Replay blocks that aren't fully applied to the database. */
+bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -556,6 +904,35 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/**
+ * SolarCoin: An immutable summary of the tip of chainActive. A new one is published after
+ * every change of the tip or of the best header, so read-only RPCs can serve it without cs_main.
+ */
+struct CChainTipSnapshot
+{
+    int nHeight;
+    uint256 hashBlock;
+    unsigned int nBits;
+    int64_t nTime;
+    int64_t nMedianTimePast;
+    uint256 nChainWork;
+    CAmount nMoneySupply;
+    //! GetPoSKernelPS() of the tip, or 0 during the initial block download
+    double dNetStakeWeight;
+    //! GetNetworkHashPS() of the tip over DEFAULT_NETWORK_HASHPS_LOOKUP blocks
+    double dNetworkHashPS;
+    double dVerificationProgress;
+    //! Height of pindexBestHeader
+    int nHeaders;
+};
+typedef std::shared_ptr<const CChainTipSnapshot> CChainTipSnapshotRef;
+
+/** SolarCoin: The last published summary of the tip, or null before the block index is loaded; needs no lock */
+CChainTipSnapshotRef GetChainTipSnapshot();
+
+/** Global variable that points to the coins database, the base of pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
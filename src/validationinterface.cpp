@@ -5,8 +5,122 @@
 
 #include "validationinterface.h"
 
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "util.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 static CMainSignals g_signals;
 
+namespace {
+
+/**
+ * SolarCoin: Runs the callbacks of the queued listeners on one thread, in the order they were
+ * signalled. Signalling waits while the queue is full, so a listener falling behind slows
+ * validation down rather than letting the queue grow without bound.
+ */
+class CValidationInterfaceQueue
+{
+private:
+    std::mutex mutex;
+    std::condition_variable condWork;  //!< the thread waits for callbacks
+    std::condition_variable condDone;  //!< signalling waits for room, Sync() for callbacks to run
+    std::deque<std::function<void ()> > queue;
+    uint64_t nQueued;  //!< callbacks queued so far
+    uint64_t nDone;    //!< callbacks run so far
+    bool fStop;
+    std::thread thread;
+
+    void ThreadRun()
+    {
+        RenameThread("solarcoin-valqueue");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            while (!fStop && queue.empty())
+                condWork.wait(lock);
+            // Once stopping, what was queued still runs
+            if (queue.empty())
+                return;
+            std::function<void ()> callback = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            callback();
+            lock.lock();
+            nDone++;
+            condDone.notify_all();
+        }
+    }
+
+public:
+    CValidationInterfaceQueue() : nQueued(0), nDone(0), fStop(false) {}
+
+    ~CValidationInterfaceQueue()
+    {
+        Stop();
+    }
+
+    void Start()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (thread.joinable())
+            return;
+        fStop = false;
+        thread = std::thread(&CValidationInterfaceQueue::ThreadRun, this);
+    }
+
+    void Stop()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fStop = true;
+            condWork.notify_all();
+        }
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void Push(std::function<void ()> callback)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // Without a running thread, and for what a queued callback signals, the callback runs here
+        if (!thread.joinable() || fStop || std::this_thread::get_id() == thread.get_id()) {
+            lock.unlock();
+            callback();
+            return;
+        }
+        while (queue.size() >= MAX_VALIDATION_QUEUE_CALLBACKS)
+            condDone.wait(lock);
+        queue.push_back(std::move(callback));
+        nQueued++;
+        condWork.notify_one();
+    }
+
+    void Sync()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (std::this_thread::get_id() == thread.get_id())
+            return;
+        const uint64_t nTarget = nQueued;
+        while (nDone < nTarget)
+            condDone.wait(lock);
+    }
+};
+
+CValidationInterfaceQueue g_queue;
+
+std::mutex cs_queuedInterfaces;
+//! The connections forwarding the signals of the queued listeners to the queue
+std::map<CValidationInterface*, std::vector<boost::signals2::connection> > mapQueuedInterfaces;
+
+} // anon namespace
+
 CMainSignals& GetMainSignals()
 {
     return g_signals;
@@ -15,6 +129,7 @@ CMainSignals& GetMainSignals()
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
+    g_signals.BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -25,6 +140,39 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
 }
 
+void RegisterValidationInterfaceQueued(CValidationInterface* pwalletIn) {
+    g_queue.Start();
+    std::vector<boost::signals2::connection> vConnections;
+    vConnections.push_back(g_signals.UpdatedBlockTip.connect([pwalletIn](const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {
+        g_queue.Push([pwalletIn, pindexNew, pindexFork, fInitialDownload] { pwalletIn->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload); });
+    }));
+    // The transaction is only referenced by the caller, so the queue keeps a copy
+    vConnections.push_back(g_signals.SyncTransaction.connect([pwalletIn](const CTransaction &tx, const CBlockIndex *pindex, int posInBlock) {
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        g_queue.Push([pwalletIn, ptx, pindex, posInBlock] { pwalletIn->SyncTransaction(*ptx, pindex, posInBlock); });
+    }));
+    vConnections.push_back(g_signals.BlockConnected.connect([pwalletIn](const std::shared_ptr<const CBlock> &block, const CBlockIndex *pindex, const std::shared_ptr<const CBlockUndo> &blockundo) {
+        g_queue.Push([pwalletIn, block, pindex, blockundo] { pwalletIn->BlockConnected(block, pindex, blockundo); });
+    }));
+    vConnections.push_back(g_signals.BlockChecked.connect([pwalletIn](const CBlock &block, const CValidationState &state) {
+        std::shared_ptr<const CBlock> pblock = std::make_shared<const CBlock>(block);
+        g_queue.Push([pwalletIn, pblock, state] { pwalletIn->BlockChecked(*pblock, state); });
+    }));
+    vConnections.push_back(g_signals.NewPoWValidBlock.connect([pwalletIn](const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &block) {
+        g_queue.Push([pwalletIn, pindex, block] { pwalletIn->NewPoWValidBlock(pindex, block); });
+    }));
+    {
+        std::lock_guard<std::mutex> lock(cs_queuedInterfaces);
+        mapQueuedInterfaces[pwalletIn] = vConnections;
+    }
+    g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+    g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+    g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
+    g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
+    g_signals.BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+}
+
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.BlockFound.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
     g_signals.ScriptForMining.disconnect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
@@ -33,9 +181,24 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    g_signals.BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    bool fQueued = false;
+    {
+        std::lock_guard<std::mutex> lock(cs_queuedInterfaces);
+        std::map<CValidationInterface*, std::vector<boost::signals2::connection> >::iterator it = mapQueuedInterfaces.find(pwalletIn);
+        if (it != mapQueuedInterfaces.end()) {
+            for (boost::signals2::connection& connection : it->second)
+                connection.disconnect();
+            mapQueuedInterfaces.erase(it);
+            fQueued = true;
+        }
+    }
+    // The listener may be deleted once its queued callbacks have run
+    if (fQueued)
+        g_queue.Sync();
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -46,7 +209,21 @@ void UnregisterAllValidationInterfaces() {
     g_signals.Inventory.disconnect_all_slots();
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
+    g_signals.BlockConnected.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NewPoWValidBlock.disconnect_all_slots();
+    {
+        std::lock_guard<std::mutex> lock(cs_queuedInterfaces);
+        mapQueuedInterfaces.clear();
+    }
+    g_queue.Sync();
+}
+
+void SyncWithValidationInterfaceQueue() {
+    g_queue.Sync();
+}
+
+void StopValidationInterfaceQueue() {
+    g_queue.Stop();
 }
@@ -12,6 +12,7 @@
 
 class CBlock;
 class CBlockIndex;
+class CBlockUndo;
 struct CBlockLocator;
 class CBlockIndex;
 class CConnman;
@@ -30,10 +31,30 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
 
+/** Most callbacks waiting in the validation interface queue; signalling waits for room beyond */
+static const size_t MAX_VALIDATION_QUEUE_CALLBACKS = 1000;
+
+/**
+ * SolarCoin: Register a listener whose UpdatedBlockTip, SyncTransaction, BlockConnected,
+ * BlockChecked and NewPoWValidBlock callbacks run on the validation interface queue thread, in the
+ * order they were signalled, instead of on the validating thread with cs_main held. Its other
+ * callbacks are synchronous. The queued callbacks must not take cs_main: signalling holds it while
+ * waiting for room in a full queue.
+ */
+void RegisterValidationInterfaceQueued(CValidationInterface* pwalletIn);
+/** Wait for the queued callbacks of what was signalled so far to run */
+void SyncWithValidationInterfaceQueue();
+/** Run the callbacks still queued and stop the queue thread */
+void StopValidationInterfaceQueue();
+
 class CValidationInterface {
+public:
+    virtual ~CValidationInterface() {}
+
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, int posInBlock) {}
+    virtual void BlockConnected(const std::shared_ptr<const CBlock> &block, const CBlockIndex *pindex, const std::shared_ptr<const CBlockUndo> &blockundo) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void Inventory(const uint256 &hash) {}
@@ -43,6 +64,7 @@ protected:
     virtual void ResetRequestCount(const uint256 &hash) {};
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
     friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterfaceQueued(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
 };
@@ -61,6 +83,11 @@ struct CMainSignals {
      * removal was due to conflict from connected block), or appeared in a
      * disconnected block.*/
     boost::signals2::signal<void (const CTransaction &, const CBlockIndex *pindex, int posInBlock)> SyncTransaction;
+    /**
+     * SolarCoin: Notifies listeners of a block connected to the active chain, with the undo data
+     * ConnectBlock() built for it, after the SyncTransaction calls for its transactions. Called
+     * with cs_main held, in chain order. */
+    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::shared_ptr<const CBlockUndo> &)> BlockConnected;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
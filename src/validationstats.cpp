@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validationstats.h"
+
+#include <assert.h>
+
+static CLatencyHistogram histBlockPhases[BLOCK_PHASE_COUNT];
+static std::atomic<uint64_t> nBlockCounters[BLOCK_COUNTER_COUNT];
+
+static const char* const pszBlockPhaseNames[BLOCK_PHASE_COUNT] = {
+    "check",
+    "forks",
+    "connect",
+    "verify",
+    "index",
+    "callbacks",
+    "connectblock",
+    "prefetch",
+    "read",
+    "flush",
+    "chainstate",
+    "postconnect",
+    "connecttip",
+    "disconnect",
+    "staketime",
+    "proofofstake",
+    "stakemodifier",
+};
+
+static const char* const pszBlockCounterNames[BLOCK_COUNTER_COUNT] = {
+    "stakeprevout_cache_hits",
+    "stakeprevout_cache_misses",
+    "coins_prefetched",
+    "coins_prefetch_stale",
+    "blocks",
+    "transactions",
+    "inputs",
+};
+
+void RecordBlockPhase(BlockProcessingPhase phase, int64_t nMicros)
+{
+    assert(phase < BLOCK_PHASE_COUNT);
+    histBlockPhases[phase].Add(nMicros);
+}
+
+const CLatencyHistogram& GetBlockPhaseHistogram(BlockProcessingPhase phase)
+{
+    assert(phase < BLOCK_PHASE_COUNT);
+    return histBlockPhases[phase];
+}
+
+const char* GetBlockPhaseName(BlockProcessingPhase phase)
+{
+    assert(phase < BLOCK_PHASE_COUNT);
+    return pszBlockPhaseNames[phase];
+}
+
+void IncrementBlockCounter(BlockProcessingCounter counter, uint64_t nAmount)
+{
+    assert(counter < BLOCK_COUNTER_COUNT);
+    nBlockCounters[counter].fetch_add(nAmount, std::memory_order_relaxed);
+}
+
+uint64_t GetBlockCounter(BlockProcessingCounter counter)
+{
+    assert(counter < BLOCK_COUNTER_COUNT);
+    return nBlockCounters[counter].load(std::memory_order_relaxed);
+}
+
+const char* GetBlockCounterName(BlockProcessingCounter counter)
+{
+    assert(counter < BLOCK_COUNTER_COUNT);
+    return pszBlockCounterNames[counter];
+}
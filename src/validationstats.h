@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_VALIDATIONSTATS_H
+#define BITCOIN_VALIDATIONSTATS_H
+
+#include "latencyhistogram.h"
+
+#include <atomic>
+#include <stdint.h>
+
+/** Phases of block processing whose latency is recorded, reported by getblockprocessingstats */
+enum BlockProcessingPhase
+{
+    // ConnectBlock()
+    BLOCK_PHASE_CHECK,           //!< sanity checks
+    BLOCK_PHASE_FORKS,           //!< fork and BIP30 checks
+    BLOCK_PHASE_CONNECT,         //!< connecting the transactions to the view
+    BLOCK_PHASE_VERIFY,          //!< connecting and waiting for the script checks
+    BLOCK_PHASE_INDEX,           //!< writing undo data and the block index
+    BLOCK_PHASE_CALLBACKS,       //!< updating the hash cache
+    BLOCK_PHASE_CONNECT_BLOCK,   //!< all of ConnectBlock()
+    // ConnectTip()
+    BLOCK_PHASE_PREFETCH,        //!< finishing the coins prefetch of the block
+    BLOCK_PHASE_READ,            //!< reading the block from disk
+    BLOCK_PHASE_FLUSH,           //!< flushing the view to pcoinsTip
+    BLOCK_PHASE_CHAINSTATE,      //!< writing the chain state to disk, if needed
+    BLOCK_PHASE_POSTCONNECT,     //!< mempool and tip updates
+    BLOCK_PHASE_CONNECT_TIP,     //!< all of ConnectTip()
+    BLOCK_PHASE_DISCONNECT,      //!< DisconnectBlock() and flushing its view
+    // PoST
+    BLOCK_PHASE_STAKE_TIME,      //!< GetStakeTime() of a coinstake
+    BLOCK_PHASE_PROOF_OF_STAKE,  //!< CheckProofOfStake()
+    BLOCK_PHASE_STAKE_MODIFIER,  //!< ComputeStakeModifier()
+    BLOCK_PHASE_COUNT
+};
+
+/** Events counted alongside the phases */
+enum BlockProcessingCounter
+{
+    BLOCK_COUNTER_STAKE_PREVOUT_HIT,    //!< stake prevout cache hits
+    BLOCK_COUNTER_STAKE_PREVOUT_MISS,   //!< stake prevout cache misses
+    BLOCK_COUNTER_COINS_PREFETCHED,     //!< coins added to the cache by the coins prefetch
+    BLOCK_COUNTER_COINS_PREFETCH_STALE, //!< block prefetches discarded as the coins database was written
+    BLOCK_COUNTER_BLOCKS,               //!< blocks connected
+    BLOCK_COUNTER_TRANSACTIONS,         //!< transactions of the blocks connected
+    BLOCK_COUNTER_INPUTS,               //!< transaction inputs of the blocks connected
+    BLOCK_COUNTER_COUNT
+};
+
+/** Record the latency of a block processing phase */
+void RecordBlockPhase(BlockProcessingPhase phase, int64_t nMicros);
+const CLatencyHistogram& GetBlockPhaseHistogram(BlockProcessingPhase phase);
+/** Name of a phase in getblockprocessingstats */
+const char* GetBlockPhaseName(BlockProcessingPhase phase);
+
+void IncrementBlockCounter(BlockProcessingCounter counter, uint64_t nAmount = 1);
+uint64_t GetBlockCounter(BlockProcessingCounter counter);
+/** Name of a counter in getblockprocessingstats */
+const char* GetBlockCounterName(BlockProcessingCounter counter);
+
+#endif // BITCOIN_VALIDATIONSTATS_H
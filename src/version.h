@@ -12,7 +12,7 @@
 static const int LEGACY_PROTOCOL_VERSION = 70005; // SolarCoin v2.1.8
 
 //static const int PROTOCOL_VERSION = 70015; // Bitcoin
-static const int PROTOCOL_VERSION = 70005; // SolarCoin v3.15.1
+static const int PROTOCOL_VERSION = 70007; // SolarCoin: feefilter
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -45,14 +45,14 @@ static const int SENDHEADERS_VERSION = GETHEADERS_VERSION; // SolarCoin: Allow s
 
 //! "feefilter" tells peers to filter invs to you by fee starts with this version
 //static const int FEEFILTER_VERSION = 70013; // Bitcoin
-static const int FEEFILTER_VERSION = 70013; // SolarCoin: TODO: Introduce feefilter in future protocol.
+static const int FEEFILTER_VERSION = 70007; // SolarCoin
 
 //! short-id-based block download starts with this version
 //static const int SHORT_IDS_BLOCKS_VERSION = 70014; // Bitcoin
-static const int SHORT_IDS_BLOCKS_VERSION = 70014; // SolarCoin: TODO: Introduce short_ids in future protocol.
+static const int SHORT_IDS_BLOCKS_VERSION = 70006; // SolarCoin: cmpctblock carries the block signature and the coinstake.
 
 //! not banning for invalid compact blocks starts with this version
 //static const int INVALID_CB_NO_BAN_VERSION = 70015; // Bitcoin
-static const int INVALID_CB_NO_BAN_VERSION = 70015; // SolarCoin
+static const int INVALID_CB_NO_BAN_VERSION = SHORT_IDS_BLOCKS_VERSION; // SolarCoin: No peer sends cmpctblock before this.
 
 #endif // BITCOIN_VERSION_H
@@ -10,9 +10,14 @@
 #include "script/standard.h"
 #include "util.h"
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+
+//! SolarCoin: keys checked per thread at least when a large wallet is first unlocked
+static const size_t UNLOCK_KEYS_PER_THREAD = 64;
 
 int CCrypter::BytesToKeySHA512AES(const std::vector<unsigned char>& chSalt, const SecureString& strKeyData, int count, unsigned char *key,unsigned char *iv) const
 {
@@ -154,6 +159,13 @@ bool CCryptoKeyStore::SetCrypted()
     return true;
 }
 
+void CCryptoKeyStore::ClearDecryptedKeys()
+{
+    AssertLockHeld(cs_KeyStore);
+    mapDecryptedKeys.clear();
+    lruDecryptedKeys.clear();
+}
+
 bool CCryptoKeyStore::Lock()
 {
     if (!SetCrypted())
@@ -162,6 +174,7 @@ bool CCryptoKeyStore::Lock()
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        ClearDecryptedKeys();
     }
 
     NotifyStatusChanged(this);
@@ -177,20 +190,47 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
 
         bool keyPass = false;
         bool keyFail = false;
-        CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
-        for (; mi != mapCryptedKeys.end(); ++mi)
-        {
-            const CPubKey &vchPubKey = (*mi).second.first;
-            const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-            CKey key;
-            if (!DecryptKey(vMasterKeyIn, vchCryptedSecret, vchPubKey, key))
+        if (fDecryptionThoroughlyChecked || mapCryptedKeys.size() < UNLOCK_KEYS_PER_THREAD * 2) {
+            CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
+            for (; mi != mapCryptedKeys.end(); ++mi)
             {
-                keyFail = true;
-                break;
+                const CPubKey &vchPubKey = (*mi).second.first;
+                const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
+                CKey key;
+                if (!DecryptKey(vMasterKeyIn, vchCryptedSecret, vchPubKey, key))
+                {
+                    keyFail = true;
+                    break;
+                }
+                keyPass = true;
+                if (fDecryptionThoroughlyChecked)
+                    break;
             }
-            keyPass = true;
-            if (fDecryptionThoroughlyChecked)
-                break;
+        } else {
+            // SolarCoin: the first unlock checks every key, mostly the key pair check of
+            // DecryptKey(), so large wallets spread the keys over all cores
+            std::vector<const std::pair<CPubKey, std::vector<unsigned char> >*> vKeys;
+            vKeys.reserve(mapCryptedKeys.size());
+            for (const auto& item : mapCryptedKeys)
+                vKeys.push_back(&item.second);
+            size_t nThreads = std::min((size_t)std::max(GetNumCores(), 1), vKeys.size() / UNLOCK_KEYS_PER_THREAD);
+            std::atomic<bool> fAnyPass(false), fAnyFail(false);
+            boost::thread_group threads;
+            for (size_t t = 0; t < nThreads; t++) {
+                threads.create_thread([&, t] {
+                    for (size_t i = t; i < vKeys.size() && !fAnyFail; i += nThreads) {
+                        CKey key;
+                        if (!DecryptKey(vMasterKeyIn, vKeys[i]->second, vKeys[i]->first, key)) {
+                            fAnyFail = true;
+                            break;
+                        }
+                        fAnyPass = true;
+                    }
+                });
+            }
+            threads.join_all();
+            keyPass = fAnyPass;
+            keyFail = fAnyFail;
         }
         if (keyPass && keyFail)
         {
@@ -200,6 +240,7 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
         if (keyFail || !keyPass)
             return false;
         vMasterKey = vMasterKeyIn;
+        ClearDecryptedKeys();
         fDecryptionThoroughlyChecked = true;
     }
     NotifyStatusChanged(this);
@@ -247,12 +288,31 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey& keyOut) const
         if (!IsCrypted())
             return CBasicKeyStore::GetKey(address, keyOut);
 
+        if (vMasterKey.empty())
+            return false;
+
+        auto itCached = mapDecryptedKeys.find(address);
+        if (itCached != mapDecryptedKeys.end()) {
+            lruDecryptedKeys.splice(lruDecryptedKeys.begin(), lruDecryptedKeys, itCached->second);
+            keyOut = itCached->second->second;
+            return true;
+        }
+
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.find(address);
         if (mi != mapCryptedKeys.end())
         {
             const CPubKey &vchPubKey = (*mi).second.first;
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-            return DecryptKey(vMasterKey, vchCryptedSecret, vchPubKey, keyOut);
+            if (!DecryptKey(vMasterKey, vchCryptedSecret, vchPubKey, keyOut))
+                return false;
+
+            lruDecryptedKeys.push_front(std::make_pair(address, keyOut));
+            mapDecryptedKeys[address] = lruDecryptedKeys.begin();
+            if (lruDecryptedKeys.size() > WALLET_DECRYPTED_KEY_CACHE_SIZE) {
+                mapDecryptedKeys.erase(lruDecryptedKeys.back().first);
+                lruDecryptedKeys.pop_back();
+            }
+            return true;
         }
     }
     return false;
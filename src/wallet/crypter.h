@@ -9,11 +9,16 @@
 #include "serialize.h"
 #include "support/allocators/secure.h"
 
+#include <list>
+#include <map>
+
 class uint256;
 
 const unsigned int WALLET_CRYPTO_KEY_SIZE = 32;
 const unsigned int WALLET_CRYPTO_SALT_SIZE = 8;
 const unsigned int WALLET_CRYPTO_IV_SIZE = 16;
+//! Decrypted keys an unlocked wallet keeps, most recently used first
+const unsigned int WALLET_DECRYPTED_KEY_CACHE_SIZE = 1000;
 
 /**
  * Private key encryption is done based on a CMasterKey,
@@ -126,6 +131,14 @@ private:
     //! keeps track of whether Unlock has run a thorough check before
     bool fDecryptionThoroughlyChecked;
 
+    //! SolarCoin: keys decrypted while unlocked, so signing with them again (staking, for one)
+    //! skips the AES decryption and the key pair check. The secrets live in locked memory (CKey
+    //! uses the secure allocator of the LockedPoolManager) and are wiped on Lock().
+    mutable std::list<std::pair<CKeyID, CKey> > lruDecryptedKeys;
+    mutable std::map<CKeyID, std::list<std::pair<CKeyID, CKey> >::iterator> mapDecryptedKeys;
+
+    void ClearDecryptedKeys();
+
 protected:
     bool SetCrypted();
 
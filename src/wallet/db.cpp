@@ -51,7 +51,7 @@ void CDBEnv::Reset()
     fMockDb = false;
 }
 
-CDBEnv::CDBEnv() : dbenv(NULL)
+CDBEnv::CDBEnv() : dbenv(NULL), nFlushInterval(DEFAULT_WALLET_FLUSH_INTERVAL)
 {
     Reset();
 }
@@ -237,7 +237,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL)
+CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL), parentTxn(NULL), fBatchOwner(false)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -293,7 +293,42 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
             bitdb.mapDb[strFile] = pdb;
         }
+
+        // SolarCoin: write within the batch transaction of the file, if one is open
+        std::map<std::string, DbTxn*>::const_iterator it = bitdb.mapBatchTxn.find(strFile);
+        if (it != bitdb.mapBatchTxn.end())
+            activeTxn = parentTxn = it->second;
+    }
+}
+
+bool CDB::BeginBatch()
+{
+    if (!pdb || activeTxn)
+        return false;
+    DbTxn* ptxn = bitdb.TxnBegin();
+    if (!ptxn)
+        return false;
+    {
+        LOCK(bitdb.cs_db);
+        bitdb.mapBatchTxn[strFile] = ptxn;
     }
+    activeTxn = ptxn;
+    fBatchOwner = true;
+    return true;
+}
+
+bool CDB::CommitBatch()
+{
+    if (!pdb || !fBatchOwner)
+        return false;
+    {
+        LOCK(bitdb.cs_db);
+        bitdb.mapBatchTxn.erase(strFile);
+    }
+    int ret = activeTxn->commit(0);
+    activeTxn = NULL;
+    fBatchOwner = false;
+    return (ret == 0);
 }
 
 void CDB::Flush()
@@ -313,12 +348,15 @@ void CDB::Close()
 {
     if (!pdb)
         return;
-    if (activeTxn)
+    if (fBatchOwner && !CommitBatch())
+        LogPrintf("CDB::Close: failed to commit the batch transaction of %s\n", strFile);
+    if (activeTxn && activeTxn != parentTxn)
         activeTxn->abort();
     activeTxn = NULL;
     pdb = NULL;
 
-    if (fFlushOnClose)
+    // SolarCoin: within a batch, the batch owner flushes; with -walletflushinterval, the flush thread
+    if (fFlushOnClose && !parentTxn && bitdb.nFlushInterval <= 0)
         Flush();
 
     {
@@ -22,6 +22,8 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+//! SolarCoin: default for -walletflushinterval
+static const int64_t DEFAULT_WALLET_FLUSH_INTERVAL = 0;
 
 class CDBEnv
 {
@@ -39,6 +41,11 @@ public:
     DbEnv *dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    //! SolarCoin: the open batch transaction of each file, see CDB::BeginBatch() (protected by cs_db)
+    std::map<std::string, DbTxn*> mapBatchTxn;
+    //! SolarCoin: seconds the flush thread may defer checkpoints by (-walletflushinterval); 0
+    //! checkpoints whenever a CDB that flushes on close is closed
+    int64_t nFlushInterval;
 
     CDBEnv();
     ~CDBEnv();
@@ -75,10 +82,10 @@ public:
     void CloseDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
 
-    DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC)
+    DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC, DbTxn* parent = NULL)
     {
         DbTxn* ptxn = NULL;
-        int ret = dbenv->txn_begin(NULL, &ptxn, flags);
+        int ret = dbenv->txn_begin(parent, &ptxn, flags);
         if (!ptxn || ret != 0)
             return NULL;
         return ptxn;
@@ -95,6 +102,10 @@ protected:
     Db* pdb;
     std::string strFile;
     DbTxn* activeTxn;
+    //! SolarCoin: the batch transaction of another CDB of the file this one writes within, or NULL
+    DbTxn* parentTxn;
+    //! SolarCoin: whether this CDB began the batch transaction it is in
+    bool fBatchOwner;
     bool fReadOnly;
     bool fFlushOnClose;
 
@@ -262,11 +273,12 @@ protected:
     }
 
 public:
+    /** Begin a transaction; within a batch transaction, a nested one that can be aborted alone */
     bool TxnBegin()
     {
-        if (!pdb || activeTxn)
+        if (!pdb || activeTxn != parentTxn || fBatchOwner)
             return false;
-        DbTxn* ptxn = bitdb.TxnBegin();
+        DbTxn* ptxn = bitdb.TxnBegin(DB_TXN_WRITE_NOSYNC, parentTxn);
         if (!ptxn)
             return false;
         activeTxn = ptxn;
@@ -275,22 +287,34 @@ public:
 
     bool TxnCommit()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || activeTxn == parentTxn || fBatchOwner)
             return false;
         int ret = activeTxn->commit(0);
-        activeTxn = NULL;
+        activeTxn = parentTxn;
         return (ret == 0);
     }
 
     bool TxnAbort()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || activeTxn == parentTxn || fBatchOwner)
             return false;
         int ret = activeTxn->abort();
-        activeTxn = NULL;
+        activeTxn = parentTxn;
         return (ret == 0);
     }
 
+    /**
+     * SolarCoin: Begin a batch transaction of the file. Until CommitBatch(), every CDB of the file
+     * opened meanwhile writes within it, so a group of writes is logged as one transaction and
+     * checkpointed once. Those CDBs must be closed before the batch is committed, and their
+     * users must hold the lock that serializes writers of the file (cs_wallet for wallets), as
+     * the transaction is not used by two threads at once. Cursors do not read within it, so the
+     * file must not be iterated over during a batch. Fails within another batch.
+     */
+    bool BeginBatch();
+    /** SolarCoin: Commit the batch transaction this CDB began; Close() does if it was not */
+    bool CommitBatch();
+
     bool ReadVersion(int& nVersion)
     {
         nVersion = 0;
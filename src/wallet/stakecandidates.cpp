@@ -0,0 +1,169 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakecandidates.h"
+
+#include "chain.h"
+#include "consensus/consensus.h"
+#include "txmempool.h"
+#include "validation.h"
+#include "validationinterface.h"
+#include "wallet/wallet.h"
+
+CStakeCandidateSet::CStakeCandidateSet() : fDirty(true), fChanged(false), nWeight(0), pindexWeight(NULL)
+{
+}
+
+void CStakeCandidateSet::AddOutputs(const CWallet& wallet, const CWalletTx& wtx, int nHeight)
+{
+    AssertLockHeld(cs);
+
+    // Mirrors CWalletTx::GetBlocksToMaturity()
+    int nMinTipHeight = nHeight;
+    if (wtx.IsCoinBase())
+        nMinTipHeight += COINBASE_MATURITY_POW;
+    else if (wtx.IsCoinStake())
+        nMinTipHeight += COINBASE_MATURITY;
+
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        const CTxOut& txout = wtx.tx->vout[i];
+        if (txout.nValue <= 0 || !(wallet.IsMine(txout) & ISMINE_SPENDABLE))
+            continue;
+        if (wallet.IsSpent(hash, i) || wallet.IsLockedCoin(hash, i))
+            continue;
+
+        CStakeCandidate& candidate = mapCandidates[COutPoint(hash, i)];
+        candidate.prevout = COutPoint(hash, i);
+        candidate.nMinTipHeight = nMinTipHeight;
+        candidate.pscriptPubKey = &txout.scriptPubKey;
+        candidate.txPrev = wtx.tx;
+        setPending.insert(candidate.prevout);
+        fChanged = true;
+    }
+}
+
+void CStakeCandidateSet::SyncTransaction(const CWallet& wallet, const CWalletTx& wtx, const CBlockIndex* pindex, int posInBlock)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(wallet.cs_wallet);
+
+    LOCK(cs);
+    if (fDirty)
+        return;
+
+    // Disconnected, or dropped from the mempool: the outputs it spent may be stakeable again
+    if (posInBlock == CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK && (pindex != NULL || !mempool.exists(wtx.GetHash()))) {
+        fDirty = true;
+        return;
+    }
+
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            if (mapCandidates.erase(txin.prevout)) {
+                setPending.erase(txin.prevout);
+                fChanged = true;
+            }
+        }
+    }
+
+    // Outputs only become stakeable once confirmed
+    if (pindex != NULL)
+        AddOutputs(wallet, wtx, pindex->nHeight);
+}
+
+void CStakeCandidateSet::SetDirty()
+{
+    LOCK(cs);
+    fDirty = true;
+}
+
+void CStakeCandidateSet::UpdateWeight(const std::vector<CStakeCandidate>& vCandidates, const CBlockIndex* pindexTip, const Consensus::Params& params)
+{
+    AssertLockHeld(cs);
+
+    nWeight = 0;
+    pindexWeight = pindexTip;
+    if (pindexTip == NULL)
+        return;
+    // Like the stake miner, which skips the candidates failing these rules
+    for (const CStakeCandidate& candidate : vCandidates) {
+        if (candidate.nMinTipHeight <= pindexTip->nHeight &&
+            (int64_t)candidate.info.nBlockTime + params.nStakeMinAge <= pindexTip->GetBlockTime())
+            nWeight += candidate.info.nValue;
+    }
+}
+
+void CStakeCandidateSet::Update(const CWallet& wallet, const Consensus::Params& params)
+{
+    const CBlockIndex* pindexTip;
+    {
+        // Lock order as in SyncTransaction: cs_main, cs_wallet, cs
+        LOCK2(cs_main, wallet.cs_wallet);
+        pindexTip = chainActive.Tip();
+        LOCK(cs);
+        if (fDirty) {
+            mapCandidates.clear();
+            setPending.clear();
+            for (std::map<uint256, CWalletTx>::const_iterator it = wallet.mapWallet.begin(); it != wallet.mapWallet.end(); ++it) {
+                const CBlockIndex* pindex = NULL;
+                if (it->second.GetDepthInMainChain(pindex) > 0)
+                    AddOutputs(wallet, it->second, pindex->nHeight);
+            }
+            fDirty = false;
+            fChanged = true;
+        }
+        if (!fChanged) {
+            StakeCandidatesRef candidates = Get();
+            if (pindexTip != pindexWeight && candidates)
+                UpdateWeight(*candidates, pindexTip, params);
+            return;
+        }
+    }
+
+    // Look up the kernel data of new outputs. GetStakePrevoutInfo takes cs_main, so cs is not held.
+    std::vector<COutPoint> vPending;
+    {
+        LOCK(cs);
+        vPending.assign(setPending.begin(), setPending.end());
+    }
+    std::vector<std::pair<COutPoint, CStakePrevoutInfo> > vResolved;
+    vResolved.reserve(vPending.size());
+    for (const COutPoint& prevout : vPending) {
+        CStakePrevoutInfo info;
+        if (GetStakePrevoutInfo(prevout, info, params))
+            vResolved.push_back(std::make_pair(prevout, info));
+    }
+
+    std::shared_ptr<std::vector<CStakeCandidate> > vCandidates = std::make_shared<std::vector<CStakeCandidate> >();
+    {
+        LOCK(cs);
+        for (const auto& resolved : vResolved) {
+            std::map<COutPoint, CStakeCandidate>::iterator it = mapCandidates.find(resolved.first);
+            if (it != mapCandidates.end() && setPending.erase(resolved.first))
+                it->second.info = resolved.second;
+        }
+
+        vCandidates->reserve(mapCandidates.size());
+        for (const auto& entry : mapCandidates) {
+            if (!setPending.count(entry.first))
+                vCandidates->push_back(entry.second);
+        }
+        // Outputs whose data could not be found yet are retried on the next update
+        fChanged = !setPending.empty();
+        UpdateWeight(*vCandidates, pindexTip, params);
+    }
+    std::atomic_store(&published, StakeCandidatesRef(vCandidates));
+}
+
+StakeCandidatesRef CStakeCandidateSet::Get() const
+{
+    return std::atomic_load(&published);
+}
+
+CAmount CStakeCandidateSet::GetWeight() const
+{
+    LOCK(cs);
+    return nWeight;
+}
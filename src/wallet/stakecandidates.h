@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_STAKECANDIDATES_H
+#define BITCOIN_WALLET_STAKECANDIDATES_H
+
+#include "amount.h"
+#include "kernel.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+class CBlockIndex;
+class CWallet;
+class CWalletTx;
+
+namespace Consensus { struct Params; };
+
+/** A wallet output that may be used as a stake kernel, with the chain data its kernel hash needs */
+struct CStakeCandidate
+{
+    COutPoint prevout;
+    CStakePrevoutInfo info;       //!< block time, tx offset, tx time and value used in the kernel hash
+    int nMinTipHeight;            //!< the output is mature once the tip reaches this height
+    const CScript* pscriptPubKey; //!< script of the output, owned by txPrev
+    CTransactionRef txPrev;
+
+    CStakeCandidate() : nMinTipHeight(0), pscriptPubKey(NULL) {}
+};
+
+typedef std::shared_ptr<const std::vector<CStakeCandidate> > StakeCandidatesRef;
+
+/**
+ * The stakeable outputs of a wallet, kept up to date from its SyncTransaction notifications.
+ *
+ * Transactions connected in a block add their spendable outputs and drop the outputs they spend,
+ * mempool transactions drop the outputs they spend. Disconnects, rescans and coin (un)locking ask
+ * for a full rebuild from mapWallet instead. Update() publishes a flat, immutable array through an
+ * atomic shared_ptr swap, so the kernel search reads it without cs_wallet or cs_main.
+ */
+class CStakeCandidateSet
+{
+public:
+    CStakeCandidateSet();
+
+    /** Apply a SyncTransaction notification for one of the wallet's transactions. Requires cs_main and cs_wallet. */
+    void SyncTransaction(const CWallet& wallet, const CWalletTx& wtx, const CBlockIndex* pindex, int posInBlock);
+    /** Rebuild from the wallet on the next Update() */
+    void SetDirty();
+    /** Look up the kernel data of new outputs and publish the current candidates. Takes cs_main and cs_wallet itself. */
+    void Update(const CWallet& wallet, const Consensus::Params& params);
+    /** The candidates of the last Update(), possibly immature */
+    StakeCandidatesRef Get() const;
+    /**
+     * The value of the candidates that could stake on the tip of the last Update(): mature, and
+     * past the minimum age at the tip's time. It is summed when the candidates or the tip change,
+     * so reading it costs no walk of the wallet.
+     */
+    CAmount GetWeight() const;
+
+private:
+    void AddOutputs(const CWallet& wallet, const CWalletTx& wtx, int nHeight);
+    void UpdateWeight(const std::vector<CStakeCandidate>& vCandidates, const CBlockIndex* pindexTip, const Consensus::Params& params);
+
+    mutable CCriticalSection cs;
+    std::map<COutPoint, CStakeCandidate> mapCandidates; //!< guarded by cs
+    std::set<COutPoint> setPending;                     //!< guarded by cs; candidates without kernel data yet
+    bool fDirty;                                        //!< guarded by cs
+    bool fChanged;                                      //!< guarded by cs
+    StakeCandidatesRef published;                       //!< only accessed through std::atomic_load/atomic_store
+    CAmount nWeight;                                    //!< guarded by cs
+    const CBlockIndex* pindexWeight;                    //!< guarded by cs; the tip nWeight was summed at
+};
+
+#endif // BITCOIN_WALLET_STAKECANDIDATES_H
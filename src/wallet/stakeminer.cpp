@@ -0,0 +1,708 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakeminer.h"
+
+#include "arith_uint256.h"
+#include "base58.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "kernel.h"
+#include "keystore.h"
+#include "metrics.h"
+#include "miner.h"
+#include "net.h"
+#include "pow.h"
+#include "profile.h"
+#include "pubkey.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "sync.h"
+#include "timedata.h"
+#include "trace.h"
+#include "util.h"
+#include "utilmoneystr.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+#include "wallet/coincontrol.h"
+#include "wallet/wallet.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/** A kernel that meets the PoST target */
+struct CStakeKernel
+{
+    COutPoint prevout;
+    CTransactionRef txPrev;
+    unsigned int nTime;
+    uint256 hashProofOfStake;
+
+    CStakeKernel() : nTime(0) {}
+};
+
+/**
+ * The key a kernel output is staked with, and the pay-to-pubkey script the coinstake pays it back
+ * to. Looked up before a kernel is found, so a hit does not decrypt the key or parse the script.
+ */
+struct CStakeSigner
+{
+    CKey key;
+    CScript scriptPayout;
+};
+
+//! Number of kernels a worker hashes together
+static const size_t STAKE_KERNEL_BATCH_SIZE = 64;
+
+/** A kernel hashed in the current batch of a worker */
+struct CQueuedKernel
+{
+    const CStakeCandidate* pcandidate;
+    unsigned int nTime;
+    arith_uint256 bnTargetBound; //!< CStakeKernelContext::GetTargetBound() of the candidate
+
+    CQueuedKernel(const CStakeCandidate* pcandidateIn, unsigned int nTimeIn, const arith_uint256& bnTargetBoundIn) :
+        pcandidate(pcandidateIn), nTime(nTimeIn), bnTargetBound(bnTargetBoundIn) {}
+};
+
+CCriticalSection cs_stakeMinerStats;
+CStakeMinerStats stakeMinerStats;
+
+/**
+ * PoST block generator: one coordinator (the thread calling Run()) and a pool of kernel search workers.
+ *
+ * The coordinator takes the wallet's published stake candidates and the chain tip, then starts a
+ * round. Each worker takes every nWorkers-th candidate and tries each timestamp in
+ * [nSearchFrom, nSearchTo]; the kernel data comes with the candidate and the modifiers from the
+ * stake modifier index, so cs_main is only taken for one batch of kernels at a time and cs_wallet
+ * not at all. Kernels are queued across candidates and hashed STAKE_KERNEL_BATCH_SIZE at a time.
+ *
+ * A miner without workers (nWorkers 0) does not run rounds; StakeOnce() searches on the calling thread.
+ */
+class CStakeMiner
+{
+public:
+    CStakeMiner(CWallet* pwalletIn, int nWorkersIn, const CChainParams& chainparamsIn);
+    ~CStakeMiner();
+
+    /** Search for kernels until interrupted */
+    void Run();
+
+    /**
+     * Stake one block on the tip with the first kernel in [tip time + 1, adjusted time], trying
+     * the candidates in outpoint order. Returns false if the next block is a PoW block, no kernel
+     * was found or its block was not accepted.
+     */
+    bool StakeOnce(uint256& hashBlock);
+
+private:
+    bool CanStake() const;
+    void ThreadWorker(int nWorker);
+    void SearchCandidates(int nWorker);
+    void UpdateTemplate();
+    bool PrepareSigner(const CScript& scriptPubKey, CStakeSigner& signer) const;
+    void PrepareSigners();
+    bool SubmitStakeBlock(const CStakeKernel& kernel, uint256* phashBlock = NULL);
+    bool OptimizeOutputs();
+    bool SendToSelf(const std::vector<CStakeCandidate>& vInputs, const CScript& scriptPubKey, unsigned int nOutputs, const std::string& strAction);
+
+    CWallet* const pwallet;
+    const int nWorkers;
+    const CChainParams& chainparams;
+    boost::thread_group workers;
+
+    boost::mutex csRound;
+    boost::condition_variable condRoundStart;
+    boost::condition_variable condRoundDone;
+    uint64_t nRound;           //!< guarded by csRound
+    int nWorkersBusy;          //!< guarded by csRound
+    CStakeKernel kernelFound;  //!< guarded by csRound
+
+    // Round parameters, only written by the coordinator while no round is running
+    StakeCandidatesRef candidates;
+    CBlockIndex* pindexPrev;
+    unsigned int nBits;
+    unsigned int nSearchFrom;
+    unsigned int nSearchTo;
+
+    std::atomic<bool> fFound;
+    std::atomic<bool> fStale;
+    std::atomic<uint64_t> nKernels;
+
+    // The template the next coinstake goes into, only used by the coordinator. It is built with
+    // the start of a search as coinstake time, so it holds no transaction newer than any kernel
+    // the search can find.
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    unsigned int nTransactionsUpdatedTemplate;
+    int64_t nTemplateTime;
+
+    // The signers of the candidates, only used by the coordinator; the keys live in locked memory
+    // and are dropped when the wallet is locked
+    std::map<CScript, CStakeSigner> mapSigners;
+    StakeCandidatesRef candidatesSigned;
+
+    // Stake output optimizer (-stakeoptimize); a threshold of 0 follows the average stake weight
+    const bool fOptimize;
+    CAmount nSplitThreshold;
+    CAmount nCombineThreshold;
+    int64_t nLastOptimize;
+};
+
+CStakeMiner::CStakeMiner(CWallet* pwalletIn, int nWorkersIn, const CChainParams& chainparamsIn) :
+    pwallet(pwalletIn), nWorkers(nWorkersIn), chainparams(chainparamsIn), nRound(0), nWorkersBusy(0),
+    pindexPrev(NULL), nBits(0), nSearchFrom(0), nSearchTo(0), fFound(false), fStale(false), nKernels(0),
+    nTransactionsUpdatedTemplate(0), nTemplateTime(0), fOptimize(GetBoolArg("-stakeoptimize", DEFAULT_STAKEOPTIMIZE)),
+    nSplitThreshold(0), nCombineThreshold(0), nLastOptimize(GetTime())
+{
+    // Checked by CWallet::ParameterInteraction()
+    ParseMoney(GetArg("-stakesplitthreshold", "0"), nSplitThreshold);
+    ParseMoney(GetArg("-stakecombinethreshold", "0"), nCombineThreshold);
+
+    for (int i = 0; i < nWorkers; i++)
+        workers.create_thread(boost::bind(&CStakeMiner::ThreadWorker, this, i));
+}
+
+CStakeMiner::~CStakeMiner()
+{
+    boost::this_thread::disable_interruption di;
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+bool CStakeMiner::CanStake() const
+{
+    if (pwallet->IsLocked())
+        return false;
+    if (chainparams.MiningRequiresPeers() && (!g_connman || g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0))
+        return false;
+    if (IsInitialBlockDownload())
+        return false;
+    return true;
+}
+
+void CStakeMiner::ThreadWorker(int nWorker)
+{
+    RenameThread("solarcoin-stakeworker");
+    uint64_t nRoundDone = 0;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(csRound);
+            while (nRound == nRoundDone)
+                condRoundStart.wait(lock);
+            nRoundDone = nRound;
+        }
+
+        SearchCandidates(nWorker);
+
+        {
+            boost::unique_lock<boost::mutex> lock(csRound);
+            if (--nWorkersBusy == 0)
+                condRoundDone.notify_one();
+        }
+    }
+}
+
+void CStakeMiner::SearchCandidates(int nWorker)
+{
+    PROFILE_SCOPE("StakeSearchCandidates");
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+
+    const std::vector<CStakeCandidate>& vCandidates = *candidates;
+
+    unsigned char vKernelData[STAKE_KERNEL_BATCH_SIZE * STAKE_KERNEL_SIZE];
+    uint256 vHashes[STAKE_KERNEL_BATCH_SIZE];
+    std::vector<CQueuedKernel> vQueued;
+    vQueued.reserve(STAKE_KERNEL_BATCH_SIZE);
+
+    // Like CheckProofOfStake, weigh the kernels against the parent of the block they build on
+    std::unique_ptr<CStakeKernelContext> context;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexPrev) {
+            fStale = true;
+            return;
+        }
+        context.reset(new CStakeKernelContext(nBits, pindexPrev->pprev, consensusParams));
+    }
+
+    const size_t nStride = std::max(nWorkers, 1);
+    size_t i = nWorker;
+    unsigned int nTimeTx = 0;    // next timestamp of vCandidates[i], 0 until the candidate is set up
+    uint64_t nStakeModifier = 0; // stake modifier of vCandidates[i]
+    arith_uint256 bnTargetBound; // target bound of vCandidates[i] over the search range
+    while (i < vCandidates.size() && !fFound && !fStale) {
+        boost::this_thread::interruption_point();
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexPrev) {
+            fStale = true;
+            return;
+        }
+
+        vQueued.clear();
+        while (vQueued.size() < STAKE_KERNEL_BATCH_SIZE && i < vCandidates.size()) {
+            const CStakeCandidate& candidate = vCandidates[i];
+            if (nTimeTx == 0) {
+                // Timestamps failing the time or min age rules cannot win, don't hash them
+                const CStakePrevoutInfo& prevoutInfo = candidate.info;
+                unsigned int nTimeFrom = std::max(nSearchFrom, std::max(prevoutInfo.nTxTime, prevoutInfo.nBlockTime + consensusParams.nStakeMinAge));
+                if (candidate.nMinTipHeight > pindexPrev->nHeight || nTimeFrom > nSearchTo ||
+                    !context->GetModifier(prevoutInfo, nStakeModifier)) {
+                    i += nStride;
+                    continue;
+                }
+                nTimeTx = nTimeFrom;
+                bnTargetBound = context->GetTargetBound(prevoutInfo, nTimeFrom, nSearchTo);
+            }
+            SerializeStakeKernel(vKernelData + vQueued.size() * STAKE_KERNEL_SIZE, nStakeModifier, candidate.info, candidate.prevout.n, nTimeTx);
+            vQueued.push_back(CQueuedKernel(&candidate, nTimeTx, bnTargetBound));
+            if (nTimeTx++ == nSearchTo) {
+                nTimeTx = 0;
+                i += nStride;
+            }
+        }
+        if (vQueued.empty())
+            break;
+
+        ComputeStakeKernelHashes(vKernelData, vQueued.size(), vHashes);
+        nKernels += vQueued.size();
+
+        for (size_t j = 0; j < vQueued.size(); j++) {
+            const CQueuedKernel& queued = vQueued[j];
+            // Nearly every hash is above the bound, only the rest needs the exact target.
+            // CheckStakeTimeKernelHash does not apply the target to outputs of PoW blocks; the stake miner always does.
+            arith_uint256 bnHash = UintToArith256(vHashes[j]);
+            if (bnHash > queued.bnTargetBound || bnHash > context->GetTarget(queued.pcandidate->info, queued.nTime))
+                continue;
+
+            TRACE4(stake, kernel_hit, queued.pcandidate->prevout.hash.begin(), queued.pcandidate->prevout.n, queued.nTime, vHashes[j].begin());
+            boost::unique_lock<boost::mutex> lock(csRound);
+            if (!fFound) {
+                kernelFound.prevout = queued.pcandidate->prevout;
+                kernelFound.txPrev = queued.pcandidate->txPrev;
+                kernelFound.nTime = queued.nTime;
+                kernelFound.hashProofOfStake = vHashes[j];
+                fFound = true;
+            }
+            return;
+        }
+    }
+}
+
+void CStakeMiner::UpdateTemplate()
+{
+    PROFILE_SCOPE("StakeUpdateTemplate");
+    if (pblocktemplate && pblocktemplate->block.hashPrevBlock == pindexPrev->GetBlockHash() &&
+        (mempool.GetTransactionsUpdated() == nTransactionsUpdatedTemplate || GetTime() - nTemplateTime < STAKE_TEMPLATE_REFRESH_SECONDS))
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    nTransactionsUpdatedTemplate = mempool.GetTransactionsUpdated();
+    nTemplateTime = GetTime();
+    try {
+        pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(CScript(), true, nSearchFrom);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: cannot create block template: %s\n", __func__, e.what());
+        pblocktemplate.reset();
+    }
+    if (pblocktemplate)
+        LogPrint("stake", "%s: %u transactions in %.2fms\n", __func__, pblocktemplate->block.vtx.size() - 1, 0.001 * (GetTimeMicros() - nTimeStart));
+}
+
+bool CStakeMiner::PrepareSigner(const CScript& scriptPubKey, CStakeSigner& signer) const
+{
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return error("%s: cannot parse kernel script %s", __func__, HexStr(scriptPubKey));
+    CKeyID keyID;
+    if (whichType == TX_PUBKEY)
+        keyID = CPubKey(vSolutions[0]).GetID();
+    else if (whichType == TX_PUBKEYHASH)
+        keyID = CKeyID(uint160(vSolutions[0]));
+    else
+        return error("%s: unsupported kernel script type %s", __func__, GetTxnOutputType(whichType));
+
+    LOCK(pwallet->cs_wallet);
+    if (!pwallet->GetKey(keyID, signer.key))
+        return error("%s: key %s not available", __func__, CBitcoinAddress(keyID).ToString());
+    signer.scriptPayout = CScript() << ToByteVector(signer.key.GetPubKey()) << OP_CHECKSIG;
+    return true;
+}
+
+void CStakeMiner::PrepareSigners()
+{
+    if (candidates == candidatesSigned)
+        return;
+    candidatesSigned = candidates;
+
+    // Keep the signers of the scripts still staked, add the new ones
+    std::map<CScript, CStakeSigner> mapPrepared;
+    for (const CStakeCandidate& candidate : *candidates) {
+        const CScript& scriptPubKey = *candidate.pscriptPubKey;
+        if (mapPrepared.count(scriptPubKey))
+            continue;
+        std::map<CScript, CStakeSigner>::iterator it = mapSigners.find(scriptPubKey);
+        if (it != mapSigners.end()) {
+            mapPrepared[scriptPubKey] = it->second;
+            continue;
+        }
+        CStakeSigner signer;
+        if (PrepareSigner(scriptPubKey, signer))
+            mapPrepared[scriptPubKey] = signer;
+    }
+    mapSigners.swap(mapPrepared);
+}
+
+bool CStakeMiner::SubmitStakeBlock(const CStakeKernel& kernel, uint256* phashBlock)
+{
+    PROFILE_SCOPE("StakeSubmitBlock");
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+
+    // The block is signed, and the coinstake paid, with the key of the kernel output
+    const CTxOut& txoutPrev = kernel.txPrev->vout[kernel.prevout.n];
+    CStakeSigner signer;
+    std::map<CScript, CStakeSigner>::const_iterator itSigner = mapSigners.find(txoutPrev.scriptPubKey);
+    if (itSigner != mapSigners.end())
+        signer = itSigner->second;
+    else if (!PrepareSigner(txoutPrev.scriptPubKey, signer))
+        return false;
+    CBasicKeyStore keystore;
+    keystore.AddKey(signer.key);
+
+    std::shared_ptr<CBlock> pblock;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexPrev)
+            return false; // a new block arrived while searching
+
+        // The candidates may predate a reorg, so check the kernel against the current chain data
+        CStakePrevoutInfo prevoutInfo;
+        uint256 hashProofOfStake, targetProofOfStake;
+        if (!GetStakePrevoutInfo(kernel.prevout, prevoutInfo, consensusParams) ||
+            !CheckStakeTimeKernelHash(nBits, prevoutInfo, kernel.prevout, kernel.nTime, hashProofOfStake, targetProofOfStake, pindexPrev->pprev, false, consensusParams) ||
+            hashProofOfStake != kernel.hashProofOfStake)
+            return error("%s: kernel %s is no longer valid", __func__, kernel.prevout.ToString());
+
+        // The template built before the search fits any kernel it found, unless it spends the kernel
+        bool fTemplate = pblocktemplate && pblocktemplate->block.hashPrevBlock == pindexPrev->GetBlockHash();
+        for (size_t i = 1; fTemplate && i < pblocktemplate->block.vtx.size(); i++) {
+            for (const CTxIn& txin : pblocktemplate->block.vtx[i]->vin)
+                fTemplate &= txin.prevout != kernel.prevout;
+        }
+        if (!fTemplate) {
+            pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(CScript(), true, kernel.nTime);
+            if (!pblocktemplate.get())
+                return error("%s: cannot create block template", __func__);
+        }
+        pblock = std::make_shared<CBlock>(pblocktemplate->block);
+        CAmount nFees = -pblocktemplate->vTxFees[0];
+        pblock->nTime = kernel.nTime;
+        CMutableTransaction txCoinBase(*pblock->vtx[0]);
+        txCoinBase.nTime = kernel.nTime;
+        pblock->vtx[0] = MakeTransactionRef(std::move(txCoinBase));
+
+        // Pay the kernel back to its key (as pay-to-pubkey, so the block signature can be checked against it)
+        CMutableTransaction txCoinStake;
+        txCoinStake.nTime = kernel.nTime;
+        txCoinStake.vin.push_back(CTxIn(kernel.prevout));
+        txCoinStake.vout.push_back(CTxOut(0, CScript()));
+        txCoinStake.vout.push_back(CTxOut(txoutPrev.nValue, signer.scriptPayout));
+
+        uint64_t nStakeTime = 0;
+        if (!GetStakeTime(txCoinStake, nStakeTime, pindexPrev, consensusParams))
+            return error("%s: unable to get stake time of kernel %s", __func__, kernel.prevout.ToString());
+        CAmount nReward = GetProofOfStakeTimeReward(nStakeTime, nFees, pindexPrev, consensusParams);
+        txCoinStake.vout[1].nValue += nReward;
+
+        if (!SignSignature(keystore, *kernel.txPrev, txCoinStake, 0, SIGHASH_ALL))
+            return error("%s: unable to sign coinstake spending %s", __func__, kernel.prevout.ToString());
+
+        pblock->vtx.insert(pblock->vtx.begin() + 1, MakeTransactionRef(std::move(txCoinStake)));
+        GenerateCoinbaseCommitment(*pblock, pindexPrev, consensusParams);
+        pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+        if (!signer.key.Sign(pblock->GetHash(), pblock->vchBlockSig))
+            return error("%s: unable to sign block", __func__);
+
+        LogPrintf("%s: new PoST block %s at height %d, kernel %s time %u hashProofOfStake %s reward %s\n", __func__,
+            pblock->GetHash().ToString(), pindexPrev->nHeight + 1, kernel.prevout.ToString(), kernel.nTime,
+            kernel.hashProofOfStake.ToString(), FormatMoney(nReward));
+    }
+
+    if (!ProcessNewBlock(chainparams, pblock, true, NULL))
+        return error("%s: block %s not accepted", __func__, pblock->GetHash().ToString());
+    if (phashBlock)
+        *phashBlock = pblock->GetHash();
+    return true;
+}
+
+bool CStakeMiner::SendToSelf(const std::vector<CStakeCandidate>& vInputs, const CScript& scriptPubKey, unsigned int nOutputs, const std::string& strAction)
+{
+    CAmount nValue = 0;
+    CCoinControl coinControl;
+    for (const CStakeCandidate& candidate : vInputs) {
+        nValue += candidate.info.nValue;
+        coinControl.Select(candidate.prevout);
+    }
+
+    // Equal outputs back to the script of the inputs, the last one paying the fee
+    std::vector<CRecipient> vecSend;
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        CRecipient recipient = {scriptPubKey, nValue / nOutputs, i == nOutputs - 1};
+        if (i == nOutputs - 1)
+            recipient.nAmount += nValue % nOutputs;
+        vecSend.push_back(recipient);
+    }
+
+    CWalletTx wtx;
+    CReserveKey reservekey(pwallet);
+    CAmount nFeeRequired;
+    int nChangePos = -1;
+    std::string strError;
+    if (!pwallet->CreateTransaction(vecSend, wtx, reservekey, nFeeRequired, nChangePos, strError, &coinControl))
+        return error("%s: cannot %s %s: %s", __func__, strAction, FormatMoney(nValue), strError);
+    CValidationState state;
+    if (!pwallet->CommitTransaction(wtx, reservekey, g_connman.get(), state))
+        return error("%s: cannot %s %s: %s", __func__, strAction, FormatMoney(nValue), state.GetRejectReason());
+    LogPrintf("%s: %s %s, %u inputs into %u outputs, fee %s, tx %s\n", __func__, strAction, FormatMoney(nValue),
+        vInputs.size(), nOutputs, FormatMoney(nFeeRequired), wtx.GetHash().ToString());
+    return true;
+}
+
+bool CStakeMiner::OptimizeOutputs()
+{
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+
+    // An output of value v, unspent for t seconds past the min age, weighs v * t / COIN / day
+    // coin days; the automatic split threshold weighs STAKE_SPLIT_WEIGHT_FRACTION of the average
+    // stake weight at t = nStakeMinAge.
+    CAmount nSplit = nSplitThreshold;
+    if (nSplit == 0) {
+        LOCK(cs_main);
+        nSplit = GetAverageStakeWeight(pindexPrev, consensusParams) * STAKE_SPLIT_WEIGHT_FRACTION * COIN * (24 * 60 * 60) / consensusParams.nStakeMinAge;
+    }
+    CAmount nCombine = nCombineThreshold ? nCombineThreshold : nSplit / STAKE_COMBINE_RATIO;
+    if (nSplit <= 0 || nCombine <= 0)
+        return false;
+
+    // The stake candidates are the wallet's indexed spendable outputs; only touch mature ones
+    std::vector<CStakeCandidate> vMature;
+    for (const CStakeCandidate& candidate : *candidates) {
+        if (candidate.nMinTipHeight <= pindexPrev->nHeight)
+            vMature.push_back(candidate);
+    }
+    std::sort(vMature.begin(), vMature.end(), [](const CStakeCandidate& a, const CStakeCandidate& b) {
+        return a.info.nValue < b.info.nValue;
+    });
+
+    bool fSent = false;
+    if (!vMature.empty() && vMature.back().info.nValue >= 2 * nSplit) {
+        const CStakeCandidate& candidate = vMature.back();
+        unsigned int nOutputs = std::min<CAmount>(STAKE_SPLIT_MAX_OUTPUTS, (candidate.info.nValue + nSplit - 1) / nSplit);
+        fSent |= SendToSelf(std::vector<CStakeCandidate>(1, candidate), *candidate.pscriptPubKey, nOutputs, "split");
+    }
+
+    std::vector<CStakeCandidate> vCombine;
+    CAmount nCombined = 0;
+    for (const CStakeCandidate& candidate : vMature) {
+        if (candidate.info.nValue >= nCombine || nCombined + candidate.info.nValue > nSplit || vCombine.size() >= STAKE_COMBINE_MAX_INPUTS)
+            break;
+        vCombine.push_back(candidate);
+        nCombined += candidate.info.nValue;
+    }
+    if (vCombine.size() >= 2)
+        fSent |= SendToSelf(vCombine, *vCombine.back().pscriptPubKey, 1, "combine");
+    return fSent;
+}
+
+void CStakeMiner::Run()
+{
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+    unsigned int nLastSearchTime = GetAdjustedTime();
+
+    LogPrintf("%s: started with %d kernel search threads\n", __func__, nWorkers);
+    {
+        LOCK(cs_stakeMinerStats);
+        stakeMinerStats.fEnabled = true;
+        stakeMinerStats.nThreads = nWorkers;
+    }
+
+    while (true) {
+        MilliSleep(STAKE_MINER_SLEEP_MS);
+
+        bool fCanStake = CanStake();
+        if (fCanStake) {
+            pwallet->stakeCandidates.Update(*pwallet, consensusParams);
+            candidates = pwallet->stakeCandidates.Get();
+
+            LOCK(cs_main);
+            pindexPrev = chainActive.Tip();
+            // The next block must be a PoST block
+            if (pindexPrev->nHeight < consensusParams.LAST_POW_BLOCK) {
+                fCanStake = false;
+            } else {
+                nBits = GetNextTargetRequired(pindexPrev, true, consensusParams);
+                nSearchFrom = std::max<int64_t>(nLastSearchTime + 1, pindexPrev->GetMedianTimePast() + 1);
+                UpdateTemplate();
+            }
+        }
+        if (!fCanStake) {
+            if (pwallet->IsLocked()) {
+                mapSigners.clear();
+                candidatesSigned.reset();
+            }
+            LOCK(cs_stakeMinerStats);
+            stakeMinerStats.fStaking = false;
+            continue;
+        }
+
+        // The optimizer's transactions drop their inputs from the candidates, search the new ones
+        if (fOptimize && GetTime() - nLastOptimize >= STAKE_OPTIMIZE_INTERVAL) {
+            nLastOptimize = GetTime();
+            if (OptimizeOutputs())
+                continue;
+        }
+
+        nSearchTo = GetAdjustedTime();
+        if (nSearchFrom > nSearchTo)
+            continue;
+        PrepareSigners();
+
+        int64_t nTimeStart = GetTimeMicros();
+        {
+            boost::unique_lock<boost::mutex> lock(csRound);
+            fFound = false;
+            fStale = false;
+            nKernels = 0;
+            nWorkersBusy = nWorkers;
+            nRound++;
+            condRoundStart.notify_all();
+            while (nWorkersBusy > 0)
+                condRoundDone.wait(lock);
+        }
+        int64_t nTimeElapsed = std::max<int64_t>(GetTimeMicros() - nTimeStart, 1);
+
+        // A new tip changes the kernel target: search the same interval again on top of it
+        if (fStale)
+            continue;
+
+        {
+            LOCK(cs_stakeMinerStats);
+            stakeMinerStats.fStaking = true;
+            stakeMinerStats.nCandidates = candidates->size();
+            stakeMinerStats.nLastSearchTime = nSearchTo;
+            stakeMinerStats.nLastSearchInterval = nSearchTo - nLastSearchTime;
+            stakeMinerStats.dKernelsPerSecond = nKernels * 1000000.0 / nTimeElapsed;
+        }
+        LogPrint("stake", "%s: %u candidates, %u kernels in %.2fms for [%u, %u]\n", __func__,
+            candidates->size(), (uint64_t)nKernels, 0.001 * nTimeElapsed, nSearchFrom, nSearchTo);
+        TRACE5(stake, search, (uint64_t)candidates->size(), (uint64_t)nKernels, nTimeElapsed, nSearchFrom, nSearchTo);
+        AddMetric(METRIC_STAKE_SEARCHES);
+        AddMetric(METRIC_STAKE_KERNELS, nKernels);
+        nLastSearchTime = nSearchTo;
+
+        if (fFound) {
+            CStakeKernel kernel;
+            {
+                boost::unique_lock<boost::mutex> lock(csRound);
+                kernel = kernelFound;
+            }
+            if (SubmitStakeBlock(kernel)) {
+                AddMetric(METRIC_STAKE_BLOCKS);
+                LOCK(cs_stakeMinerStats);
+                stakeMinerStats.nBlocksFound++;
+            }
+        }
+    }
+}
+
+bool CStakeMiner::StakeOnce(uint256& hashBlock)
+{
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+    pwallet->stakeCandidates.Update(*pwallet, consensusParams);
+    candidates = pwallet->stakeCandidates.Get();
+    {
+        LOCK(cs_main);
+        pindexPrev = chainActive.Tip();
+        if (pindexPrev->nHeight < consensusParams.LAST_POW_BLOCK)
+            return false;
+        nBits = GetNextTargetRequired(pindexPrev, true, consensusParams);
+        // Not before the tip, so the block times of a staked chain keep increasing
+        nSearchFrom = std::max<int64_t>(pindexPrev->GetBlockTime() + 1, pindexPrev->GetMedianTimePast() + 1);
+        UpdateTemplate();
+    }
+    nSearchTo = GetAdjustedTime();
+    if (nSearchFrom > nSearchTo)
+        return false;
+    PrepareSigners();
+
+    fFound = false;
+    fStale = false;
+    nKernels = 0;
+    SearchCandidates(0);
+    if (!fFound)
+        return false;
+
+    CStakeKernel kernel;
+    {
+        boost::unique_lock<boost::mutex> lock(csRound);
+        kernel = kernelFound;
+    }
+    if (!SubmitStakeBlock(kernel, &hashBlock))
+        return false;
+    AddMetric(METRIC_STAKE_BLOCKS);
+    return true;
+}
+
+void ThreadStakeMiner(CWallet* pwallet, int nThreads, const CChainParams& chainparams)
+{
+    RenameThread("solarcoin-staker");
+    try {
+        CStakeMiner miner(pwallet, nThreads, chainparams);
+        miner.Run();
+    } catch (const boost::thread_interrupted&) {
+        LogPrintf("%s: stake miner stopped\n", __func__);
+        LOCK(cs_stakeMinerStats);
+        stakeMinerStats.fEnabled = false;
+        stakeMinerStats.fStaking = false;
+        throw;
+    } catch (const std::exception& e) {
+        LogPrintf("%s: stake miner stopped: %s\n", __func__, e.what());
+        LOCK(cs_stakeMinerStats);
+        stakeMinerStats.fEnabled = false;
+        stakeMinerStats.fStaking = false;
+    }
+}
+
+} // namespace
+
+void StartStakeMiner(boost::thread_group& threadGroup, CWallet* pwallet, int nThreads, const CChainParams& chainparams)
+{
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    threadGroup.create_thread(boost::bind(&ThreadStakeMiner, pwallet, nThreads, boost::cref(chainparams)));
+}
+
+CStakeMinerStats GetStakeMinerStats()
+{
+    LOCK(cs_stakeMinerStats);
+    return stakeMinerStats;
+}
+
+std::vector<uint256> GenerateStakeBlocks(CWallet* pwallet, int nBlocks, const CChainParams& chainparams)
+{
+    std::vector<uint256> vBlocks;
+    CStakeMiner miner(pwallet, 0, chainparams);
+    uint256 hashBlock;
+    while ((int)vBlocks.size() < nBlocks && miner.StakeOnce(hashBlock))
+        vBlocks.push_back(hashBlock);
+    return vBlocks;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2018 The SolarCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_STAKEMINER_H
+#define BITCOIN_WALLET_STAKEMINER_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CChainParams;
+class CWallet;
+
+namespace boost {
+class thread_group;
+} // namespace boost
+
+//! -staking default
+static const bool DEFAULT_STAKING = false;
+//! -stakingthreads default (0 = one kernel search thread per core)
+static const int DEFAULT_STAKING_THREADS = 1;
+//! Milliseconds between two kernel searches of the stake miner
+static const unsigned int STAKE_MINER_SLEEP_MS = 1000;
+//! Seconds a block template is kept for new mempool transactions before it is rebuilt; a new tip rebuilds it at once
+static const int64_t STAKE_TEMPLATE_REFRESH_SECONDS = 5;
+//! -stakeoptimize default
+static const bool DEFAULT_STAKEOPTIMIZE = false;
+//! Seconds between two passes of the stake output optimizer
+static const int64_t STAKE_OPTIMIZE_INTERVAL = 30 * 60;
+//! The automatic split threshold gives an output this fraction of the average stake weight one min age after it matured
+static const double STAKE_SPLIT_WEIGHT_FRACTION = 0.25;
+//! The automatic combine threshold is the split threshold divided by this
+static const int STAKE_COMBINE_RATIO = 10;
+//! Most outputs a split transaction creates
+static const unsigned int STAKE_SPLIT_MAX_OUTPUTS = 20;
+//! Most inputs a combine transaction spends
+static const unsigned int STAKE_COMBINE_MAX_INPUTS = 100;
+
+/** Progress of the stake miner, as reported by getstakinginfo. */
+struct CStakeMinerStats
+{
+    bool fEnabled;               //!< the stake miner threads are running
+    bool fStaking;               //!< the last round searched for a kernel
+    int nThreads;                //!< number of kernel search threads
+    unsigned int nCandidates;    //!< stakeable outputs in the last round
+    int64_t nLastSearchTime;     //!< last kernel timestamp searched
+    int64_t nLastSearchInterval; //!< seconds covered by the last round
+    double dKernelsPerSecond;    //!< kernel hash rate of the last round
+    uint64_t nBlocksFound;       //!< PoST blocks accepted since startup
+
+    CStakeMinerStats() : fEnabled(false), fStaking(false), nThreads(0), nCandidates(0),
+                         nLastSearchTime(0), nLastSearchInterval(0), dKernelsPerSecond(0), nBlocksFound(0) {}
+};
+
+/**
+ * Start the PoST stake miner of pwallet in threadGroup.
+ *
+ * Every STAKE_MINER_SLEEP_MS the mature outputs of the wallet are snapshotted and split across
+ * nThreads kernel search threads (one per core if nThreads <= 0), which try every timestamp since
+ * the previous search. A winning kernel is turned into a signed coinstake block and submitted.
+ * The block template and the keys of the candidates are prepared between searches, so a winning
+ * kernel only needs its coinstake added and signed, the merkle root computed and the block signed.
+ *
+ * With -stakeoptimize, every STAKE_OPTIMIZE_INTERVAL the miner also sends the wallet one
+ * transaction splitting its largest output above -stakesplitthreshold, and one combining its
+ * outputs below -stakecombinethreshold. Outputs whose coin-day weight nears 0.45 of the average
+ * stake weight lose their time weight to the cos^2 stake-time factor, and every small output
+ * costs the kernel search as much as a large one.
+ */
+void StartStakeMiner(boost::thread_group& threadGroup, CWallet* pwallet, int nThreads, const CChainParams& chainparams);
+
+/** Return a snapshot of the stake miner progress */
+CStakeMinerStats GetStakeMinerStats();
+
+/**
+ * Stake up to nBlocks PoST blocks with the outputs of pwallet on the calling thread (generatestake).
+ *
+ * Each block takes the first kernel found trying the wallet's candidates in outpoint order, each
+ * from the first timestamp past the tip it may stake at up to the adjusted time, so a wallet
+ * and chain under the same mock time always stake the same blocks. Stops at the first tip no
+ * candidate can stake on.
+ * @return the hashes of the blocks staked
+ */
+std::vector<uint256> GenerateStakeBlocks(CWallet* pwallet, int nBlocks, const CChainParams& chainparams);
+
+#endif // BITCOIN_WALLET_STAKEMINER_H
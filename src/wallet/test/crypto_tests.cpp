@@ -6,6 +6,7 @@
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 #include "wallet/crypter.h"
+#include "key.h"
 
 #include <vector>
 
@@ -235,4 +236,38 @@ BOOST_AUTO_TEST_CASE(decrypt) {
     }
 }
 
+class TestCryptoKeyStore : public CCryptoKeyStore
+{
+public:
+    using CCryptoKeyStore::EncryptKeys;
+    using CCryptoKeyStore::Unlock;
+};
+
+BOOST_AUTO_TEST_CASE(decrypted_key_cache) {
+    TestCryptoKeyStore keystore;
+    std::vector<CKey> vKeys(WALLET_DECRYPTED_KEY_CACHE_SIZE + 2);
+    for (CKey& key : vKeys) {
+        key.MakeNewKey(true);
+        BOOST_CHECK(keystore.AddKeyPubKey(key, key.GetPubKey()));
+    }
+    uint256 hash(GetRandHash());
+    CKeyingMaterial vMasterKey(hash.begin(), hash.end());
+    BOOST_CHECK(keystore.EncryptKeys(vMasterKey));
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+
+    // Keys read back the same, whether decrypted or cached, also once evicted from the cache
+    for (int nPass = 0; nPass < 2; nPass++) {
+        for (const CKey& key : vKeys) {
+            CKey keyOut;
+            BOOST_CHECK(keystore.GetKey(key.GetPubKey().GetID(), keyOut));
+            BOOST_CHECK(keyOut == key);
+        }
+    }
+
+    // Locking wipes them
+    BOOST_CHECK(keystore.Lock());
+    CKey keyOut;
+    BOOST_CHECK(!keystore.GetKey(vKeys.back().GetPubKey().GetID(), keyOut));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,9 +9,11 @@
 #include <utility>
 #include <vector>
 
+#include "base58.h"
 #include "rpc/server.h"
 #include "test/test_bitcoin.h"
 #include "validation.h"
+#include "wallet/rpcwallet.h"
 #include "wallet/test/wallet_test_fixture.h"
 
 #include <boost/foreach.hpp>
@@ -19,6 +21,7 @@
 #include <univalue.h>
 
 extern UniValue importmulti(const JSONRPCRequest& request);
+extern UniValue importprivkey(const JSONRPCRequest& request);
 extern UniValue dumpwallet(const JSONRPCRequest& request);
 extern UniValue importwallet(const JSONRPCRequest& request);
 
@@ -363,6 +366,71 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    const CFeeRate noFee(0);
+
+    LOCK(wallet.cs_wallet);
+
+    empty_wallet();
+    add_coin(1 * CENT);
+    add_coin(2 * CENT);
+    add_coin(3 * CENT);
+    add_coin(4 * CENT);
+
+    // an exact match, and nothing more than 1+2+3+4
+    BOOST_CHECK(wallet.SelectCoinsBnB(5 * CENT, 1, 6, 0, vCoins, noFee, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    BOOST_CHECK(wallet.SelectCoinsBnB(10 * CENT, 1, 6, 0, vCoins, noFee, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+    BOOST_CHECK(!wallet.SelectCoinsBnB(11 * CENT, 1, 6, 0, vCoins, noFee, 0, setCoinsRet, nValueRet));
+
+    // no exact match: only a cost of change wide enough allows the excess
+    empty_wallet();
+    add_coin(5 * CENT);
+    add_coin(7 * CENT);
+    BOOST_CHECK(!wallet.SelectCoinsBnB(11 * CENT, 1, 6, 0, vCoins, noFee, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK(!wallet.SelectCoinsBnB(11 * CENT, 1, 6, 0, vCoins, noFee, CENT / 2, setCoinsRet, nValueRet));
+    BOOST_CHECK(wallet.SelectCoinsBnB(11 * CENT, 1, 6, 0, vCoins, noFee, CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 12 * CENT);
+
+    // the least excess wins
+    add_coin(6 * CENT);
+    BOOST_CHECK(wallet.SelectCoinsBnB(11 * CENT, 1, 6, 0, vCoins, noFee, CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 11 * CENT);
+
+    // coins are valued after the fee of spending them, and those worth less are left alone
+    empty_wallet();
+    const CFeeRate feeRate(10000);
+    const CAmount nInputFee = feeRate.GetFee(INPUT_SIZE_ESTIMATE);
+    add_coin(nInputFee);
+    add_coin(1 * CENT);
+    add_coin(2 * CENT);
+    BOOST_CHECK(!wallet.SelectCoinsBnB(3 * CENT, 1, 6, 0, vCoins, feeRate, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK(wallet.SelectCoinsBnB(3 * CENT - 2 * nInputFee, 1, 6, 0, vCoins, feeRate, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 3 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // confirmations are respected
+    add_coin(4 * CENT, 1);
+    BOOST_CHECK(!wallet.SelectCoinsBnB(4 * CENT - nInputFee, 1, 6, 0, vCoins, feeRate, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK(wallet.SelectCoinsBnB(4 * CENT - nInputFee, 1, 1, 0, vCoins, feeRate, 0, setCoinsRet, nValueRet));
+
+    // many equal small outputs and one odd one are searched quickly
+    empty_wallet();
+    for (int i = 0; i < 5000; i++)
+        add_coin(1000);
+    add_coin(333);
+    BOOST_CHECK(wallet.SelectCoinsBnB(2000333, 1, 6, 0, vCoins, noFee, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 2000333);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2001U);
+
+    empty_wallet();
+}
+
 BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
 {
     LOCK(cs_main);
@@ -402,8 +470,7 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     // after.
     {
         CWallet wallet;
-        CWallet *backup = ::pwalletMain;
-        ::pwalletMain = &wallet;
+        vpwallets.insert(vpwallets.begin(), &wallet);
         UniValue keys;
         keys.setArray();
         UniValue key;
@@ -426,8 +493,119 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
 
         UniValue response = importmulti(request);
         BOOST_CHECK_EQUAL(response.write(), strprintf("[{\"success\":false,\"error\":{\"code\":-1,\"message\":\"Failed to rescan before time %d, transactions may be missing.\"}},{\"success\":true}]", newTip->GetBlockTimeMax()));
-        ::pwalletMain = backup;
+        vpwallets.erase(vpwallets.begin());
+    }
+}
+
+// Verify that a key imported without a rescan is covered by the rescan of the
+// next import, even if that key is born later.
+BOOST_FIXTURE_TEST_CASE(importprivkey_batched_rescan, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CWallet wallet;
+    vpwallets.insert(vpwallets.begin(), &wallet);
+    CKey futureKey;
+    futureKey.MakeNewKey(true);
+
+    JSONRPCRequest request;
+    request.params.setArray();
+    request.params.push_back(CBitcoinSecret(coinbaseKey).ToString());
+    request.params.push_back("");
+    request.params.push_back(false);
+    ::importprivkey(request);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 0);
+
+    request.params.setArray();
+    request.params.push_back(CBitcoinSecret(futureKey).ToString());
+    request.params.push_back("");
+    request.params.push_back(true);
+    request.params.push_back(chainActive.Tip()->GetBlockTimeMax() + 2 * TIMESTAMP_WINDOW);
+    ::importprivkey(request);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 100);
+
+    vpwallets.erase(vpwallets.begin());
+}
+
+// Verify the height index listsinceblock reads only returns the transactions
+// above a height, and the ones in no block.
+BOOST_FIXTURE_TEST_CASE(transactions_above_height, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 100);
+
+    BOOST_CHECK_EQUAL(wallet.GetTransactionsAbove(-1).size(), 100);
+    std::vector<uint256> vAbove = wallet.GetTransactionsAbove(90);
+    BOOST_CHECK_EQUAL(vAbove.size(), 10);
+    for (const uint256& hash : vAbove)
+        BOOST_CHECK(wallet.mapWallet[hash].GetDepthInMainChain() <= 10);
+    BOOST_CHECK(wallet.GetTransactionsAbove(chainActive.Height()).empty());
+
+    // A transaction in no block comes last, whatever the height
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    mtx.vout[0].nValue = COIN;
+    CWalletTx wtx(&wallet, MakeTransactionRef(mtx));
+    BOOST_CHECK(wallet.AddToWallet(wtx));
+    vAbove = wallet.GetTransactionsAbove(chainActive.Height());
+    BOOST_CHECK_EQUAL(vAbove.size(), 1);
+    BOOST_CHECK(vAbove[0] == wtx.GetHash());
+    BOOST_CHECK(wallet.GetTransactionsAbove(95).back() == wtx.GetHash());
+}
+
+// Verify the balances updated a transaction at a time match the ones computed
+// from scratch, as blocks mature coinbases and wallet transactions change.
+static void CheckBalancesMatch(CWallet& wallet)
+{
+    CWallet::Balances balances = wallet.GetBalances();
+    wallet.MarkDirty();
+    CWallet::Balances full = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.nTrusted, full.nTrusted);
+    BOOST_CHECK_EQUAL(balances.nUntrustedPending, full.nUntrustedPending);
+    BOOST_CHECK_EQUAL(balances.nImmature, full.nImmature);
+    BOOST_CHECK_EQUAL(balances.nWatchTrusted, full.nWatchTrusted);
+    BOOST_CHECK_EQUAL(balances.nWatchUntrustedPending, full.nWatchUntrustedPending);
+    BOOST_CHECK_EQUAL(balances.nWatchImmature, full.nWatchImmature);
+}
+
+BOOST_FIXTURE_TEST_CASE(balances_incremental, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    CWallet::Balances before = wallet.GetBalances();
+
+    // New blocks mature the oldest immature coinbases, without any wallet transaction changing
+    for (int i = 0; i < 3; i++) {
+        CBlock block = CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+        wallet.BlockConnected(std::make_shared<const CBlock>(block), chainActive.Tip(), std::shared_ptr<const CBlockUndo>());
+        CheckBalancesMatch(wallet);
     }
+    BOOST_CHECK(wallet.GetBalances().nTrusted > before.nTrusted);
+
+    // Spending a coinbase changes the transaction and, as in CommitTransaction(), the one it spends
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    mtx.vout[0].nValue = COIN;
+    CWalletTx wtx(&wallet, MakeTransactionRef(mtx));
+    wallet.GetBalances();
+    BOOST_CHECK(wallet.AddToWallet(wtx));
+    wallet.mapWallet[coinbaseTxns[0].GetHash()].MarkDirty();
+    CheckBalancesMatch(wallet);
 }
 
 // Verify importwallet RPC starts rescan at earliest block with timestamp
@@ -436,7 +614,6 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
 // than or equal to key birthday.
 BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
 {
-    CWallet *pwalletMainBackup = ::pwalletMain;
     LOCK(cs_main);
 
     // Create two blocks with same timestamp to verify that importwallet rescan
@@ -462,8 +639,9 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
         JSONRPCRequest request;
         request.params.setArray();
         request.params.push_back("wallet.backup");
-        ::pwalletMain = &wallet;
+        vpwallets.insert(vpwallets.begin(), &wallet);
         ::dumpwallet(request);
+        vpwallets.erase(vpwallets.begin());
     }
 
     // Call importwallet RPC and verify all blocks with timestamps >= BLOCK_TIME
@@ -474,20 +652,122 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
         JSONRPCRequest request;
         request.params.setArray();
         request.params.push_back("wallet.backup");
-        ::pwalletMain = &wallet;
+        vpwallets.insert(vpwallets.begin(), &wallet);
         ::importwallet(request);
+        vpwallets.erase(vpwallets.begin());
 
         BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 3);
         BOOST_CHECK_EQUAL(coinbaseTxns.size(), 103);
         for (size_t i = 0; i < coinbaseTxns.size(); ++i) {
-            bool found = wallet.GetWalletTx(coinbaseTxns[i].GetHash());
+            bool found = wallet.GetWalletTx(coinbaseTxns[i].GetHash()) != NULL;
             bool expected = i >= 100;
             BOOST_CHECK_EQUAL(found, expected);
         }
     }
 
     SetMockTime(0);
-    ::pwalletMain = pwalletMainBackup;
+}
+
+// Verify wallet RPCs go to the wallet named by their /wallet/<filename>
+// endpoint, and need one when several wallets are loaded.
+BOOST_AUTO_TEST_CASE(wallet_for_rpc_request)
+{
+    CWallet wallet("other wallet.dat");
+    JSONRPCRequest request;
+    BOOST_CHECK(GetWalletForJSONRPCRequest(request) == NULL);
+
+    vpwallets.push_back(pwalletMain);
+    BOOST_CHECK(GetWalletForJSONRPCRequest(request) == pwalletMain);
+
+    vpwallets.push_back(&wallet);
+    BOOST_CHECK(GetWalletForJSONRPCRequest(request) == NULL);
+    BOOST_CHECK_THROW(EnsureWalletIsAvailable(NULL, false), UniValue);
+    request.fHelp = true;
+    BOOST_CHECK(GetWalletForJSONRPCRequest(request) == pwalletMain);
+    request.fHelp = false;
+
+    request.URI = "/wallet/other%20wallet.dat";
+    BOOST_CHECK(GetWalletForJSONRPCRequest(request) == &wallet);
+    request.URI = "/wallet/wallet_test.dat";
+    BOOST_CHECK(GetWalletForJSONRPCRequest(request) == pwalletMain);
+    request.URI = "/wallet/missing.dat";
+    BOOST_CHECK_THROW(GetWalletForJSONRPCRequest(request), UniValue);
+
+    vpwallets.clear();
+}
+
+BOOST_AUTO_TEST_CASE(keypool_batch_hd)
+{
+    // The batched keypool refill must derive the keys m/0'/0'/k' for consecutive k, like
+    // DeriveNewChildKey() does one at a time
+    LOCK(pwalletMain->cs_wallet);
+    CPubKey masterPubKey = pwalletMain->GenerateNewHDMasterKey();
+    BOOST_CHECK(pwalletMain->SetHDMasterKey(masterPubKey));
+    BOOST_CHECK(pwalletMain->TopUpKeyPool(KEYPOOL_BATCH_SIZE + 10));
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), KEYPOOL_BATCH_SIZE + 11);
+
+    const uint32_t nHardened = 0x80000000;
+    CKey masterKey;
+    BOOST_CHECK(pwalletMain->GetKey(masterPubKey.GetID(), masterKey));
+    CExtKey extMasterKey, accountKey, chainKey, childKey;
+    extMasterKey.SetMaster(masterKey.begin(), masterKey.size());
+    extMasterKey.Derive(accountKey, nHardened);
+    accountKey.Derive(chainKey, nHardened);
+
+    std::set<uint32_t> setIndexes;
+    for (const auto& item : pwalletMain->mapKeyMetadata) {
+        const std::string& strPath = item.second.hdKeypath;
+        if (strPath.compare(0, 8, "m/0'/0'/") != 0)
+            continue;
+        uint32_t nIndex = std::stoul(strPath.substr(8, strPath.size() - 9));
+        setIndexes.insert(nIndex);
+        chainKey.Derive(childKey, nIndex | nHardened);
+        BOOST_CHECK(item.first == CTxDestination(childKey.key.GetPubKey().GetID()));
+    }
+    BOOST_CHECK_EQUAL(setIndexes.size(), KEYPOOL_BATCH_SIZE + 11);
+    BOOST_CHECK_EQUAL(*setIndexes.rbegin(), KEYPOOL_BATCH_SIZE + 10);
+}
+
+BOOST_AUTO_TEST_CASE(lazywallet_unloaded_tx_pinned)
+{
+    // Unloaded transactions, only in the database as UnloadSettledTransactions() leaves them
+    LOCK(pwalletMain->cs_wallet);
+    std::vector<uint256> vHashes;
+    for (unsigned int i = 0; i < LAZYWALLET_CACHE_TXS + 1; i++) {
+        CMutableTransaction mtx;
+        mtx.nLockTime = i;
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = i + 1;
+        CWalletTx wtx(pwalletMain, MakeTransactionRef(mtx));
+        wtx.nOrderPos = i;
+        BOOST_CHECK(CWalletDB(pwalletMain->strWalletFile).WriteTx(wtx));
+        pwalletMain->mapUnloadedTx[wtx.GetHash()] = i;
+        pwalletMain->mapUnloadedOrdered.insert(std::make_pair((int64_t)i, wtx.GetHash()));
+        vHashes.push_back(wtx.GetHash());
+    }
+
+    // A transaction read back stays valid once the others have pushed it out of the cache
+    std::shared_ptr<const CWalletTx> pwtx = pwalletMain->GetWalletTx(vHashes[0]);
+    BOOST_REQUIRE(pwtx);
+    for (unsigned int i = 1; i < vHashes.size(); i++)
+        BOOST_CHECK(pwalletMain->GetWalletTx(vHashes[i]));
+    BOOST_CHECK(pwtx->GetHash() == vHashes[0]);
+    BOOST_CHECK_EQUAL(pwtx->tx->vout[0].nValue, 1);
+    std::shared_ptr<const CWalletTx> pwtxAgain = pwalletMain->GetWalletTx(vHashes[0]);
+    BOOST_CHECK(pwtxAgain && pwtxAgain != pwtx);
+
+    // And once the cache is cleared
+    pwalletMain->MarkDirty();
+    BOOST_CHECK(pwtxAgain->GetHash() == vHashes[0]);
+
+    // A transaction of mapWallet is not owned by the pointer
+    CWalletTx wtxLoaded(pwalletMain, MakeTransactionRef(CMutableTransaction()));
+    const uint256 hashLoaded = wtxLoaded.GetHash();
+    pwalletMain->mapWallet.insert(std::make_pair(hashLoaded, wtxLoaded));
+    std::shared_ptr<const CWalletTx> pwtxLoaded = pwalletMain->GetWalletTx(hashLoaded);
+    BOOST_CHECK(pwtxLoaded.get() == &pwalletMain->mapWallet.at(hashLoaded));
+    BOOST_CHECK_EQUAL(pwtxLoaded.use_count(), 0);
+    BOOST_CHECK(!pwalletMain->GetWalletTx(uint256S("0x1234")));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
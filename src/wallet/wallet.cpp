@@ -6,18 +6,25 @@
 #include "wallet/wallet.h"
 
 #include "base58.h"
+#include "blockfilter.h"
 #include "checkpoints.h"
 #include "chain.h"
 #include "wallet/coincontrol.h"
+#include "wallet/stakeminer.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
+#include "init.h"
 #include "key.h"
 #include "keystore.h"
 #include "validation.h"
 #include "net.h"
+#include "notify.h"
 #include "policy/policy.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "profile.h"
+#include "scheduler.h"
 #include "script/script.h"
 #include "script/sign.h"
 #include "timedata.h"
@@ -27,6 +34,7 @@
 #include "utilmoneystr.h"
 
 #include <assert.h>
+#include <functional>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -39,6 +47,7 @@ bool fWalletUnlockStakingOnly = true;
 using namespace std;
 
 CWallet* pwalletMain = NULL;
+std::vector<CWallet*> vpwallets;
 /** Transaction fee set by the user */
 CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
@@ -77,18 +86,187 @@ struct CompareValueOnly
     }
 };
 
+struct CompareOutputValueDescending
+{
+    bool operator()(const COutput& t1, const COutput& t2) const
+    {
+        return t1.tx->tx->vout[t1.i].nValue > t2.tx->tx->vout[t2.i].nValue;
+    }
+};
+
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->tx->vout[i].nValue));
 }
 
-const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
+std::shared_ptr<const CWalletTx> CWallet::GetWalletTx(const uint256& hash) const
 {
     LOCK(cs_wallet);
     std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
-    if (it == mapWallet.end())
+    if (it != mapWallet.end())
+        return std::shared_ptr<const CWalletTx>(std::shared_ptr<const CWalletTx>(), &(it->second));
+    if (!mapUnloadedTx.count(hash))
+        return NULL;
+
+    std::map<uint256, std::list<std::shared_ptr<const CWalletTx> >::iterator>::const_iterator itCache = mapUnloadedTxCache.find(hash);
+    if (itCache != mapUnloadedTxCache.end()) {
+        lruUnloadedTx.splice(lruUnloadedTx.begin(), lruUnloadedTx, itCache->second);
+        return lruUnloadedTx.front();
+    }
+
+    std::shared_ptr<CWalletTx> pwtx = std::make_shared<CWalletTx>();
+    if (!CWalletDB(strWalletFile, "r").ReadTx(hash, *pwtx)) {
+        LogPrintf("%s: cannot read unloaded transaction %s\n", __func__, hash.ToString());
+        return NULL;
+    }
+    pwtx->BindWallet(this);
+    // Dropping it from the cache leaves it to the callers still holding it
+    lruUnloadedTx.push_front(pwtx);
+    mapUnloadedTxCache[hash] = lruUnloadedTx.begin();
+    if (lruUnloadedTx.size() > LAZYWALLET_CACHE_TXS) {
+        mapUnloadedTxCache.erase(lruUnloadedTx.back()->GetHash());
+        lruUnloadedTx.pop_back();
+    }
+    return pwtx;
+}
+
+void CWallet::UnloadSettledTransactions()
+{
+    LOCK2(cs_main, cs_wallet);
+    // The height index keeps the unloaded transactions at their heights
+    UpdateTxHeightIndex();
+
+    std::vector<uint256> vSettled;
+    for (const auto& entry : mapWallet) {
+        const CWalletTx& wtx = entry.second;
+        if (wtx.GetDepthInMainChain() < LAZYWALLET_MIN_DEPTH || wtx.GetBlocksToMaturity() > 0)
+            continue;
+        bool fSettled = true;
+        for (unsigned int i = 0; i < wtx.tx->vout.size() && fSettled; i++) {
+            if (IsMine(wtx.tx->vout[i]) == ISMINE_NO)
+                continue;
+            fSettled = false;
+            std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(entry.first, i));
+            for (TxSpends::const_iterator it = range.first; it != range.second && !fSettled; ++it) {
+                std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+                fSettled = mit != mapWallet.end() && mit->second.GetDepthInMainChain() >= LAZYWALLET_MIN_DEPTH;
+            }
+        }
+        if (fSettled)
+            vSettled.push_back(entry.first);
+    }
+
+    for (const uint256& hash : vSettled) {
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(hash);
+        const int64_t nOrderPos = it->second.nOrderPos;
+        std::pair<TxItems::iterator, TxItems::iterator> range = wtxOrdered.equal_range(nOrderPos);
+        for (TxItems::iterator itOrdered = range.first; itOrdered != range.second; ++itOrdered) {
+            if (itOrdered->second.first == &it->second) {
+                wtxOrdered.erase(itOrdered);
+                break;
+            }
+        }
+        mapUnloadedTx[hash] = nOrderPos;
+        mapUnloadedOrdered.insert(std::make_pair(nOrderPos, hash));
+        mapWallet.erase(it);
+    }
+    fUnspentOutputsDirty = true;
+    LogPrintf("Unloaded %u settled wallet transactions\n", vSettled.size());
+}
+
+CWalletTx* CWallet::ReloadWalletTx(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, int64_t>::iterator it = mapUnloadedTx.find(hash);
+    if (it == mapUnloadedTx.end())
+        return NULL;
+
+    CWalletTx wtx;
+    if (!CWalletDB(strWalletFile, "r").ReadTx(hash, wtx)) {
+        LogPrintf("%s: cannot read unloaded transaction %s\n", __func__, hash.ToString());
         return NULL;
-    return &(it->second);
+    }
+
+    std::pair<std::multimap<int64_t, uint256>::iterator, std::multimap<int64_t, uint256>::iterator> range = mapUnloadedOrdered.equal_range(it->second);
+    for (std::multimap<int64_t, uint256>::iterator itOrdered = range.first; itOrdered != range.second; ++itOrdered) {
+        if (itOrdered->second == hash) {
+            mapUnloadedOrdered.erase(itOrdered);
+            break;
+        }
+    }
+    mapUnloadedTx.erase(it);
+    std::map<uint256, std::list<std::shared_ptr<const CWalletTx> >::iterator>::iterator itCache = mapUnloadedTxCache.find(hash);
+    if (itCache != mapUnloadedTxCache.end()) {
+        lruUnloadedTx.erase(itCache->second);
+        mapUnloadedTxCache.erase(itCache);
+    }
+
+    // Its spends are still in mapTxSpends
+    CWalletTx& wtxReloaded = mapWallet.insert(std::make_pair(hash, wtx)).first->second;
+    wtxReloaded.BindWallet(this);
+    wtxOrdered.insert(std::make_pair(wtxReloaded.nOrderPos, TxPair(&wtxReloaded, (CAccountingEntry*)0)));
+    return &wtxReloaded;
+}
+
+void CWallet::UpdateTxHeightIndex()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    for (const uint256& hash : setTxHeightPending) {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        // An unloaded transaction keeps the height it had, a removed one is dropped
+        if (mi == mapWallet.end() && mapUnloadedTx.count(hash))
+            continue;
+        std::map<uint256, int>::iterator it = mapTxHeight.find(hash);
+        if (it != mapTxHeight.end()) {
+            setTxByHeight.erase(std::make_pair(it->second, hash));
+            mapTxHeight.erase(it);
+        }
+        if (mi == mapWallet.end())
+            continue;
+        int nHeight = TX_HEIGHT_NOT_IN_CHAIN;
+        if (mi->second.GetDepthInMainChain() > 0)
+            nHeight = mapBlockIndex[mi->second.hashBlock]->nHeight;
+        mapTxHeight[hash] = nHeight;
+        setTxByHeight.insert(std::make_pair(nHeight, hash));
+    }
+    setTxHeightPending.clear();
+}
+
+std::vector<uint256> CWallet::GetTransactionsAbove(int nHeight)
+{
+    UpdateTxHeightIndex();
+    std::vector<uint256> vHashes;
+    std::set<std::pair<int, uint256> >::const_iterator it = setTxByHeight.lower_bound(std::make_pair(nHeight + 1, uint256()));
+    for (; it != setTxByHeight.end(); ++it)
+        vHashes.push_back(it->second);
+    return vHashes;
+}
+
+CWalletTxWalker::CWalletTxWalker(const CWallet& walletIn, bool fUnloadedIn) : wallet(walletIn), fUnloaded(fUnloadedIn)
+{
+    AssertLockHeld(wallet.cs_wallet);
+    itResident = wallet.mapWallet.begin();
+    itUnloaded = wallet.mapUnloadedTx.begin();
+}
+
+const CWalletTx* CWalletTxWalker::Next()
+{
+    if (itResident != wallet.mapWallet.end())
+        return &(itResident++)->second;
+    if (!fUnloaded)
+        return NULL;
+    while (itUnloaded != wallet.mapUnloadedTx.end()) {
+        const uint256& hash = (itUnloaded++)->first;
+        if (!pwalletdb)
+            pwalletdb.reset(new CWalletDB(wallet.strWalletFile, "r"));
+        if (pwalletdb->ReadTx(hash, wtxUnloaded)) {
+            wtxUnloaded.BindWallet(&wallet);
+            return &wtxUnloaded;
+        }
+        LogPrintf("%s: cannot read unloaded transaction %s\n", __func__, hash.ToString());
+    }
+    return NULL;
 }
 
 CPubKey CWallet::GenerateNewKey()
@@ -124,17 +302,16 @@ CPubKey CWallet::GenerateNewKey()
     return pubkey;
 }
 
-void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
+/** SolarCoin: the key at m/0'/0', whose hardened children are the keys of the wallet */
+static void DeriveExternalChainKey(const CKeyStore& keystore, const CHDChain& hdChain, CExtKey& externalChainChildKey)
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey key;                      //master key seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
-    CExtKey externalChainChildKey; //key at m/0'/0'
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the master key
-    if (!GetKey(hdChain.masterKeyID, key))
+    if (!keystore.GetKey(hdChain.masterKeyID, key))
         throw std::runtime_error(std::string(__func__) + ": Master key not found");
 
     masterKey.SetMaster(key.begin(), key.size());
@@ -145,6 +322,34 @@ void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
 
     // derive m/0'/0'
     accountKey.Derive(externalChainChildKey, BIP32_HARDENED_KEY_LIMIT);
+}
+
+/** SolarCoin: run f(i) for each i below n, spread over the cores */
+static void ParallelFor(size_t n, const std::function<void(size_t)>& f)
+{
+    // Threads are only worth starting for a few dozen EC multiplications each
+    size_t nThreads = std::max((size_t)1, std::min((size_t)std::max(GetNumCores(), 1), n / 32));
+    if (nThreads == 1) {
+        for (size_t i = 0; i < n; i++)
+            f(i);
+        return;
+    }
+    boost::thread_group threads;
+    for (size_t t = 0; t < nThreads; t++) {
+        threads.create_thread([&f, n, nThreads, t] {
+            for (size_t i = t; i < n; i += nThreads)
+                f(i);
+        });
+    }
+    threads.join_all();
+}
+
+void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
+{
+    CExtKey externalChainChildKey; //key at m/0'/0'
+    CExtKey childKey;              //key at m/0'/0'/<n>'
+
+    DeriveExternalChainKey(*this, hdChain, externalChainChildKey);
 
     // derive child key at next index, skip keys already known to the wallet
     do {
@@ -164,27 +369,103 @@ void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
 }
 
+std::vector<CPubKey> CWallet::GenerateNewKeys(CWalletDB& walletdb, unsigned int nKeys)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+
+    int64_t nCreationTime = GetTime();
+    bool fHD = IsHDEnabled();
+    CExtKey externalChainChildKey;
+    if (fHD)
+        DeriveExternalChainKey(*this, hdChain, externalChainChildKey);
+
+    std::vector<CPubKey> vResult;
+    vResult.reserve(nKeys);
+    while (vResult.size() < nKeys) {
+        // The EC multiplications of the derivation and of the key pair check are independent
+        size_t nBatch = nKeys - vResult.size();
+        uint32_t nCounter = hdChain.nExternalChainCounter;
+        std::vector<CKey> vSecrets(nBatch);
+        std::vector<CPubKey> vPubKeys(nBatch);
+        ParallelFor(nBatch, [&](size_t i) {
+            if (fHD) {
+                CExtKey childKey;
+                externalChainChildKey.Derive(childKey, (nCounter + i) | BIP32_HARDENED_KEY_LIMIT);
+                vSecrets[i] = childKey.key;
+            } else {
+                vSecrets[i].MakeNewKey(fCompressed);
+            }
+            vPubKeys[i] = vSecrets[i].GetPubKey();
+            assert(vSecrets[i].VerifyPubKey(vPubKeys[i]));
+        });
+
+        for (size_t i = 0; i < nBatch; i++) {
+            CKeyMetadata metadata(nCreationTime);
+            if (fHD) {
+                metadata.hdKeypath = "m/0'/0'/" + std::to_string(hdChain.nExternalChainCounter) + "'";
+                metadata.hdMasterKeyID = hdChain.masterKeyID;
+                hdChain.nExternalChainCounter++;
+                // skip keys already known to the wallet, like DeriveNewChildKey()
+                if (HaveKey(vPubKeys[i].GetID()))
+                    continue;
+            }
+            mapKeyMetadata[vPubKeys[i].GetID()] = metadata;
+            if (!AddKeyPubKeyWithDB(walletdb, vSecrets[i], vPubKeys[i]))
+                throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+            vResult.push_back(vPubKeys[i]);
+        }
+    }
+
+    // Compressed public keys were introduced in version 0.6.0
+    if (fCompressed)
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
+    UpdateTimeFirstKey(nCreationTime);
+
+    // update the chain model in the database
+    if (fHD && !walletdb.WriteHDChain(hdChain))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+    return vResult;
+}
+
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
+{
+    CWalletDB walletdb(strWalletFile);
+    return AddKeyPubKeyWithDB(walletdb, secret, pubkey);
+}
+
+bool CWallet::AddKeyPubKeyWithDB(CWalletDB& walletdb, const CKey& secret, const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
-    if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
-        return false;
 
-    // check if we need to remove from watch-only
-    CScript script;
-    script = GetScriptForDestination(pubkey.GetID());
-    if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
-    script = GetScriptForRawPubKey(pubkey);
-    if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
+    // SolarCoin: CCryptoKeyStore calls AddCryptedKey() for encrypted wallets, and this may call
+    // RemoveWatchOnly(); both write through pwalletdbEncryption when it is set, so walletdb is
+    // tunneled through it unless a wallet encryption already is
+    bool fTunnel = !pwalletdbEncryption;
+    if (fTunnel)
+        pwalletdbEncryption = &walletdb;
+    bool fAdded = CCryptoKeyStore::AddKeyPubKey(secret, pubkey);
+    if (fAdded) {
+        // check if we need to remove from watch-only
+        CScript script;
+        script = GetScriptForDestination(pubkey.GetID());
+        if (HaveWatchOnly(script))
+            RemoveWatchOnly(script);
+        script = GetScriptForRawPubKey(pubkey);
+        if (HaveWatchOnly(script))
+            RemoveWatchOnly(script);
+    }
+    if (fTunnel)
+        pwalletdbEncryption = NULL;
+    if (!fAdded)
+        return false;
 
     if (!fFileBacked)
         return true;
     if (!IsCrypted()) {
-        return CWalletDB(strWalletFile).WriteKey(pubkey,
-                                                 secret.GetPrivKey(),
-                                                 mapKeyMetadata[pubkey.GetID()]);
+        return walletdb.WriteKey(pubkey,
+                                 secret.GetPrivKey(),
+                                 mapKeyMetadata[pubkey.GetID()]);
     }
     return true;
 }
@@ -285,9 +566,14 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (fFileBacked)
-        if (!CWalletDB(strWalletFile).EraseWatchOnly(dest))
+    if (fFileBacked) {
+        if (pwalletdbEncryption) {
+            if (!pwalletdbEncryption->EraseWatchOnly(dest))
+                return false;
+        } else if (!CWalletDB(strWalletFile).EraseWatchOnly(dest)) {
             return false;
+        }
+    }
 
     return true;
 }
@@ -443,20 +729,22 @@ void CWallet::Flush(bool shutdown)
     bitdb.Flush(shutdown);
 }
 
+/** SolarCoin: The wallet files named by -wallet, which can be given more than once */
+static std::vector<std::string> GetWalletFiles()
+{
+    if (mapMultiArgs.count("-wallet") && !mapMultiArgs.at("-wallet").empty())
+        return mapMultiArgs.at("-wallet");
+    return std::vector<std::string>(1, DEFAULT_WALLET_DAT);
+}
+
 bool CWallet::Verify()
 {
     if (GetBoolArg("-disablewallet", DEFAULT_DISABLE_WALLET))
         return true;
 
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
-    std::string walletFile = GetArg("-wallet", DEFAULT_WALLET_DAT);
-
-    LogPrintf("Using wallet %s\n", walletFile);
-    uiInterface.InitMessage(_("Verifying wallet..."));
 
-    // Wallet file must be a plain filename without a directory
-    if (walletFile != boost::filesystem::basename(walletFile) + boost::filesystem::extension(walletFile))
-        return InitError(strprintf(_("Wallet %s resides outside data directory %s"), walletFile, GetDataDir().string()));
+    uiInterface.InitMessage(_("Verifying wallet(s)..."));
 
     if (!bitdb.Open(GetDataDir()))
     {
@@ -476,29 +764,41 @@ bool CWallet::Verify()
             return InitError(strprintf(_("Error initializing wallet database environment %s!"), GetDataDir()));
         }
     }
-    
-    if (GetBoolArg("-salvagewallet", false))
-    {
-        // Recover readable keypairs:
-        if (!CWalletDB::Recover(bitdb, walletFile, true))
-            return false;
-    }
-    
-    if (boost::filesystem::exists(GetDataDir() / walletFile))
-    {
-        CDBEnv::VerifyResult r = bitdb.Verify(walletFile, CWalletDB::Recover);
-        if (r == CDBEnv::RECOVER_OK)
+
+    std::set<std::string> setWalletFiles;
+    for (const std::string& walletFile : GetWalletFiles()) {
+        LogPrintf("Using wallet %s\n", walletFile);
+
+        // Wallet file must be a plain filename without a directory
+        if (walletFile != boost::filesystem::basename(walletFile) + boost::filesystem::extension(walletFile))
+            return InitError(strprintf(_("Wallet %s resides outside data directory %s"), walletFile, GetDataDir().string()));
+
+        if (!setWalletFiles.insert(walletFile).second)
+            return InitError(strprintf(_("Error loading wallet %s. Duplicate -wallet filename specified."), walletFile));
+
+        if (GetBoolArg("-salvagewallet", false))
         {
-            InitWarning(strprintf(_("Warning: Wallet file corrupt, data salvaged!"
-                                         " Original %s saved as %s in %s; if"
-                                         " your balance or transactions are incorrect you should"
-                                         " restore from a backup."),
-                walletFile, "wallet.{timestamp}.bak", GetDataDir()));
+            // Recover readable keypairs:
+            if (!CWalletDB::Recover(bitdb, walletFile, true))
+                return false;
+        }
+
+        if (boost::filesystem::exists(GetDataDir() / walletFile))
+        {
+            CDBEnv::VerifyResult r = bitdb.Verify(walletFile, CWalletDB::Recover);
+            if (r == CDBEnv::RECOVER_OK)
+            {
+                InitWarning(strprintf(_("Warning: Wallet file corrupt, data salvaged!"
+                                             " Original %s saved as %s in %s; if"
+                                             " your balance or transactions are incorrect you should"
+                                             " restore from a backup."),
+                    walletFile, "wallet.{timestamp}.bak", GetDataDir()));
+            }
+            if (r == CDBEnv::RECOVER_FAIL)
+                return InitError(strprintf(_("%s corrupt, salvage failed"), walletFile));
         }
-        if (r == CDBEnv::RECOVER_FAIL)
-            return InitError(strprintf(_("%s corrupt, salvage failed"), walletFile));
     }
-    
+
     return true;
 }
 
@@ -513,6 +813,8 @@ void CWallet::SyncMetaData(pair<TxSpends::iterator, TxSpends::iterator> range)
     for (TxSpends::iterator it = range.first; it != range.second; ++it)
     {
         const uint256& hash = it->second;
+        // SolarCoin: transactions -lazywallet unloaded are left as they are
+        if (!mapWallet.count(hash)) continue;
         int n = mapWallet[hash].nOrderPos;
         if (n < nMinOrderPos)
         {
@@ -520,10 +822,12 @@ void CWallet::SyncMetaData(pair<TxSpends::iterator, TxSpends::iterator> range)
             copyFrom = &mapWallet[hash];
         }
     }
+    if (!copyFrom) return;
     // Now copy data from copyFrom to rest:
     for (TxSpends::iterator it = range.first; it != range.second; ++it)
     {
         const uint256& hash = it->second;
+        if (!mapWallet.count(hash)) continue;
         CWalletTx* copyTo = &mapWallet[hash];
         if (copyFrom == copyTo) continue;
         if (!copyFrom->IsEquivalentTo(*copyTo)) continue;
@@ -557,6 +861,8 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
             int depth = mit->second.GetDepthInMainChain();
             if (depth > 0  || (depth == 0 && !mit->second.isAbandoned()))
                 return true; // Spent
+        } else if (mapUnloadedTx.count(wtxid)) {
+            return true; // SolarCoin: spent by a settled transaction -lazywallet unloaded
         }
     }
     return false;
@@ -848,8 +1154,13 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
+        // The balances are computed again from mapWallet, rather than a transaction at a time
+        fBalancesCached = false;
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        fUnspentOutputsDirty = true;
+        lruUnloadedTx.clear();
+        mapUnloadedTxCache.clear();
     }
 }
 
@@ -895,6 +1206,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     CWalletTx& wtx = (*ret.first).second;
     wtx.BindWallet(this);
     bool fInsertedNew = ret.second;
+    setTxHeightPending.insert(hash);
     if (fInsertedNew)
     {
         wtx.nTimeReceived = GetAdjustedTime();
@@ -975,6 +1287,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         }
     }
 
+    if (wtxIn.hashUnset())
+        AddResendCandidate(wtx);
+
     //// debug print
     LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -986,17 +1301,21 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
+    // SolarCoin: its outputs may be spent, and the outputs it spends no longer are
+    if (!fUnspentOutputsDirty) {
+        BOOST_FOREACH(const CTxIn& txin, wtx.tx->vin) {
+            if (IsSpent(txin.prevout.hash, txin.prevout.n))
+                setUnspentOutputs.erase(txin.prevout);
+        }
+        AddUnspentOutputs(wtx);
+    }
+
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
     // notify an external script when a wallet transaction comes in or is updated
-    std::string strCmd = GetArg("-walletnotify", "");
-
-    if ( !strCmd.empty())
-    {
-        boost::replace_all(strCmd, "%s", wtxIn.GetHash().GetHex());
-        boost::thread t(runCommand, strCmd); // thread runs free
-    }
+    // SolarCoin: queued for the bounded notification workers, coalescing repeated changes of a transaction
+    QueueNotification("walletnotify", GetArg("-walletnotify", ""), wtxIn.GetHash().GetHex());
 
     return true;
 }
@@ -1010,6 +1329,8 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     wtx.BindWallet(this);
     wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
     AddToSpends(hash);
+    setTxHeightPending.insert(hash);
+    AddResendCandidate(wtx);
     BOOST_FOREACH(const CTxIn& txin, wtx.tx->vin) {
         if (mapWallet.count(txin.prevout.hash)) {
             CWalletTx& prevtx = mapWallet[txin.prevout.hash];
@@ -1037,6 +1358,7 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
  */
 bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate)
 {
+    PROFILE_SCOPE("AddToWalletIfInvolvingMe");
     {
         AssertLockHeld(cs_wallet);
 
@@ -1053,6 +1375,12 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex
             }
         }
 
+        // SolarCoin: a transaction -lazywallet unloaded is moved back to be updated
+        if (mapUnloadedTx.count(tx.GetHash())) {
+            if (!fUpdate) return false;
+            ReloadWalletTx(tx.GetHash());
+        }
+
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
         if (fExisted || IsMine(tx) || IsFromMe(tx))
@@ -1093,6 +1421,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
         done.insert(now);
         assert(mapWallet.count(now));
         CWalletTx& wtx = mapWallet[now];
+        setTxHeightPending.insert(now);
         int currentconfirm = wtx.GetDepthInMainChain();
         // If the orig tx was not in block, none of its spends can be
         assert(currentconfirm <= 0);
@@ -1122,6 +1451,9 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             }
         }
     }
+    // The outputs spent by the abandoned transactions are available again
+    stakeCandidates.SetDirty();
+    fUnspentOutputsDirty = true;
 
     return true;
 }
@@ -1147,6 +1479,9 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
     // Do not flush the wallet here for performance reasons
     CWalletDB walletdb(strWalletFile, "r+", false);
 
+    // SolarCoin: the outputs spent by the conflicted transactions are available again
+    fUnspentOutputsDirty = true;
+
     std::set<uint256> todo;
     std::set<uint256> done;
 
@@ -1156,8 +1491,12 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
         uint256 now = *todo.begin();
         todo.erase(now);
         done.insert(now);
+        // SolarCoin: a transaction -lazywallet unloaded is moved back to be marked
+        if (!mapWallet.count(now))
+            ReloadWalletTx(now);
         assert(mapWallet.count(now));
         CWalletTx& wtx = mapWallet[now];
+        setTxHeightPending.insert(now);
         int currentconfirm = wtx.GetDepthInMainChain();
         if (conflictconfirms < currentconfirm) {
             // Block is 'more conflicted' than current confirm; update.
@@ -1187,11 +1526,38 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
 
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock)
 {
+    // SolarCoin: the transactions of a connected block are synced by BlockConnected(), which
+    // follows their SyncTransaction() calls
+    if (pindex && posInBlock != CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK)
+        return;
+
+    LOCK2(cs_main, cs_wallet);
+    SyncWalletTransaction(tx, pindex, posInBlock);
+}
+
+void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::shared_ptr<const CBlockUndo>& pblockundo)
+{
+    PROFILE_SCOPE("WalletBlockConnected");
     LOCK2(cs_main, cs_wallet);
 
+    // SolarCoin: write what the block changes in the wallet as one database transaction
+    CWalletDBBatch batch(strWalletFile, false);
+    for (size_t posInBlock = 0; posInBlock < pblock->vtx.size(); posInBlock++)
+        SyncWalletTransaction(*pblock->vtx[posInBlock], pindex, posInBlock);
+}
+
+void CWallet::SyncWalletTransaction(const CTransaction& tx, const CBlockIndex* pindex, int posInBlock)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
     if (!AddToWalletIfInvolvingMe(tx, pindex, posInBlock, true))
         return; // Not one of ours
 
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(tx.GetHash());
+    if (mi != mapWallet.end())
+        stakeCandidates.SyncTransaction(*this, mi->second, pindex, posInBlock);
+
     // If a transaction changes 'conflicted' state, that changes the balance
     // available of the outputs it spends. So force those to be
     // recomputed, also:
@@ -1207,10 +1573,10 @@ isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end())
+        std::shared_ptr<const CWalletTx> pprev = GetWalletTx(txin.prevout.hash);
+        if (pprev)
         {
-            const CWalletTx& prev = (*mi).second;
+            const CWalletTx& prev = *pprev;
             if (txin.prevout.n < prev.tx->vout.size())
                 return IsMine(prev.tx->vout[txin.prevout.n]);
         }
@@ -1224,10 +1590,10 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end())
+        std::shared_ptr<const CWalletTx> pprev = GetWalletTx(txin.prevout.hash);
+        if (pprev)
         {
-            const CWalletTx& prev = (*mi).second;
+            const CWalletTx& prev = *pprev;
             if (txin.prevout.n < prev.tx->vout.size())
                 if (IsMine(prev.tx->vout[txin.prevout.n]) & filter)
                     return prev.tx->vout[txin.prevout.n].nValue;
@@ -1545,60 +1911,353 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
     }
 }
 
+/**
+ * SolarCoin: What a rescan looks for, copied from the wallet so that reader threads can match
+ * blocks without its lock. It matches every transaction AddToWalletIfInvolvingMe() could add or
+ * update, and some more: outputs to our keys, scripts and watch-only scripts, spends of wallet
+ * transactions or of outputs a wallet transaction spends, and wallet transactions themselves.
+ */
+struct CRescanFilter
+{
+    std::set<CKeyID> setKeys;
+    std::set<CScriptID> setScripts;
+    std::set<CScript> setWatchOnly;
+    std::set<uint256> setTxids;
+    std::set<COutPoint> setSpent;
+
+    bool MayBeMine(const CScript& scriptPubKey) const
+    {
+        if (setWatchOnly.count(scriptPubKey))
+            return true;
+
+        std::vector<std::vector<unsigned char> > vSolutions;
+        txnouttype whichType;
+        if (!Solver(scriptPubKey, whichType, vSolutions))
+            return false;
+
+        switch (whichType)
+        {
+        case TX_PUBKEY:
+            return setKeys.count(CPubKey(vSolutions[0]).GetID()) != 0;
+        case TX_PUBKEYHASH:
+            return setKeys.count(CKeyID(uint160(vSolutions[0]))) != 0;
+        case TX_SCRIPTHASH:
+            return setScripts.count(CScriptID(uint160(vSolutions[0]))) != 0;
+        case TX_WITNESS_V0_KEYHASH:
+        case TX_WITNESS_V0_SCRIPTHASH:
+            return setScripts.count(CScriptID(CScript() << OP_0 << vSolutions[0])) != 0;
+        case TX_MULTISIG:
+            for (size_t i = 1; i + 1 < vSolutions.size(); i++)
+                if (setKeys.count(CPubKey(vSolutions[i]).GetID()))
+                    return true;
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    bool IsRelevant(const CTransaction& tx) const
+    {
+        if (setTxids.count(tx.GetHash()))
+            return true;
+        for (const CTxIn& txin : tx.vin)
+            if (setTxids.count(txin.prevout.hash) || setSpent.count(txin.prevout))
+                return true;
+        for (const CTxOut& txout : tx.vout)
+            if (MayBeMine(txout.scriptPubKey))
+                return true;
+        return false;
+    }
+};
+
+/**
+ * SolarCoin: a block of a rescan, with the positions of its transactions the filter matched.
+ * A block whose compact filter matched none of the wallet's scripts and outpoints is skipped
+ * unread, and keeps the filter to test the transactions found later in the scan.
+ */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    bool fSkipped;
+    CGCSFilter blockFilter;
+    std::vector<size_t> vMatches;
+};
+
+static void MatchRescanBlock(CRescanBlock& entry, const CRescanFilter& filter)
+{
+    for (size_t posInBlock = 0; posInBlock < entry.block.vtx.size(); posInBlock++)
+        if (filter.IsRelevant(*entry.block.vtx[posInBlock]))
+            entry.vMatches.push_back(posInBlock);
+}
+
+/**
+ * SolarCoin: Reads and matches a batch of rescan blocks on up to nThreads threads, which take
+ * the blocks in turn. They are done when the object goes out of scope. Given the block filter
+ * elements of the wallet, blocks whose filter rules them all out are not read.
+ */
+class CRescanReaders
+{
+public:
+    CRescanReaders(std::vector<CRescanBlock>& vBatch, const CRescanFilter& filter, const std::vector<GCSElement>* pvQuery, const Consensus::Params& params, int nThreads) : nNext(0)
+    {
+        for (int i = 0; i < nThreads && (size_t)i < vBatch.size(); i++)
+            threads.create_thread(boost::bind(&CRescanReaders::Read, this, boost::ref(vBatch), boost::cref(filter), pvQuery, boost::cref(params)));
+    }
+
+    ~CRescanReaders()
+    {
+        threads.join_all();
+    }
+
+private:
+    std::atomic<size_t> nNext;
+    boost::thread_group threads;
+
+    void Read(std::vector<CRescanBlock>& vBatch, const CRescanFilter& filter, const std::vector<GCSElement>* pvQuery, const Consensus::Params& params)
+    {
+        for (size_t i = nNext++; i < vBatch.size(); i = nNext++) {
+            CRescanBlock& entry = vBatch[i];
+            if (pvQuery && pblockfilterindex->LookupFilter(entry.pindex, entry.blockFilter) && !entry.blockFilter.MatchAny(*pvQuery)) {
+                entry.fSkipped = true;
+                continue;
+            }
+            entry.fRead = ReadBlockFromDisk(entry.block, entry.pindex, params);
+            if (entry.fRead)
+                MatchRescanBlock(entry, filter);
+        }
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * SolarCoin: blocks are read and matched against a CRescanFilter on reader threads, a batch
+ * ahead of the one whose matches are added to the wallet in chain order. With -blockfilterindex,
+ * blocks whose filters match none of the wallet's scripts and outpoints are not read at all.
+ * The scan stops after pindexStop if given, and early on AbortRescan() or shutdown.
+ *
  * Returns pointer to the first block in the last contiguous range that was
  * successfully scanned.
  *
  */
-CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
+CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, CBlockIndex* pindexStop)
 {
     CBlockIndex* ret = nullptr;
     int64_t nNow = GetTime();
     const CChainParams& chainParams = Params();
 
     CBlockIndex* pindex = pindexStart;
+    fAbortRescan = false;
+    fScanningWallet = true;
     {
         LOCK2(cs_main, cs_wallet);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
-        while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
+        while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - TIMESTAMP_WINDOW)))
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
         double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
-        while (pindex)
-        {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate);
-                }
-                if (!ret) {
-                    ret = pindex;
+        CRescanFilter filter;
+        GetKeys(filter.setKeys);
+        {
+            LOCK(cs_KeyStore);
+            for (const auto& script : mapScripts)
+                filter.setScripts.insert(script.first);
+            filter.setWatchOnly = setWatchOnly;
+        }
+        for (const auto& entry : mapWallet)
+            filter.setTxids.insert(entry.first);
+        for (const auto& entry : mapUnloadedTx)
+            filter.setTxids.insert(entry.first);
+        for (const auto& spend : mapTxSpends)
+            filter.setSpent.insert(spend.first);
+
+        // The block filters hold output scripts and spent outpoints: look for the scripts paying
+        // our keys and scripts, and for the outputs of wallet transactions and what they spend
+        std::vector<GCSElement> vQuery;
+        if (pblockfilterindex) {
+            for (const CKeyID& keyID : filter.setKeys) {
+                CPubKey pubkey;
+                if (!GetPubKey(keyID, pubkey))
+                    continue;
+                vQuery.push_back(ScriptFilterElement(GetScriptForDestination(keyID)));
+                vQuery.push_back(ScriptFilterElement(GetScriptForRawPubKey(pubkey)));
+            }
+            {
+                LOCK(cs_KeyStore);
+                for (const auto& script : mapScripts) {
+                    vQuery.push_back(ScriptFilterElement(script.second));
+                    vQuery.push_back(ScriptFilterElement(GetScriptForDestination(script.first)));
                 }
-            } else {
-                ret = nullptr;
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+            for (const CScript& script : filter.setWatchOnly)
+                vQuery.push_back(ScriptFilterElement(script));
+            for (const auto& entry : mapWallet)
+                for (unsigned int i = 0; i < entry.second.tx->vout.size(); i++)
+                    vQuery.push_back(OutPointFilterElement(COutPoint(entry.first, i)));
+            for (const COutPoint& outpoint : filter.setSpent)
+                vQuery.push_back(OutPointFilterElement(outpoint));
+            // Past some size, testing the filters costs more than reading the blocks. Bare
+            // multisig outputs to our keys are only found through scripts we know, as with
+            // importaddress.
+            if (vQuery.size() > BLOCKFILTER_SCAN_MAX_ELEMENTS)
+                vQuery.clear();
+            else
+                LogPrint("blockfilter", "%s: testing block filters for %u elements\n", __func__, vQuery.size());
+        }
+        const std::vector<GCSElement>* pvQuery = vQuery.empty() ? nullptr : &vQuery;
+
+        // The filter does not know the transactions found during the scan, so those are checked here
+        std::set<uint256> setFoundTxids;
+        std::set<COutPoint> setFoundSpent;
+        std::vector<GCSElement> vFoundQuery;
+        auto involvesFound = [&setFoundTxids, &setFoundSpent](const CTransaction& tx) {
+            if (setFoundTxids.empty())
+                return false;
+            if (setFoundTxids.count(tx.GetHash()))
+                return true;
+            for (const CTxIn& txin : tx.vin)
+                if (setFoundTxids.count(txin.prevout.hash) || setFoundSpent.count(txin.prevout))
+                    return true;
+            return false;
+        };
+
+        CBlockIndex* pindexRead = pindex;
+        auto nextBatch = [&pindexRead, pindexStop](std::vector<CRescanBlock>& vBatch) {
+            vBatch.clear();
+            vBatch.reserve(RESCAN_BATCH_SIZE);
+            while (pindexRead && vBatch.size() < RESCAN_BATCH_SIZE) {
+                vBatch.emplace_back();
+                vBatch.back().pindex = pindexRead;
+                vBatch.back().fRead = false;
+                vBatch.back().fSkipped = false;
+                pindexRead = pindexRead == pindexStop ? nullptr : chainActive.Next(pindexRead);
             }
+        };
+
+        const int nThreads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+        std::vector<CRescanBlock> vBatch, vNextBatch;
+        nextBatch(vBatch);
+        {
+            CRescanReaders readers(vBatch, filter, pvQuery, chainParams.GetConsensus(), nThreads);
+        }
+        bool fAborted = false;
+        while (!vBatch.empty() && !fAborted)
+        {
+            nextBatch(vNextBatch);
+            {
+                CRescanReaders readers(vNextBatch, filter, pvQuery, chainParams.GetConsensus(), nThreads);
+
+                // Each batch of blocks is written to the wallet as one database transaction
+                CWalletDBBatch dbBatch(strWalletFile, false);
+                for (CRescanBlock& entry : vBatch)
+                {
+                    if (fAbortRescan || ShutdownRequested()) {
+                        LogPrintf("Rescan aborted at block %d. Progress=%f\n", entry.pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), entry.pindex));
+                        fAborted = true;
+                        break;
+                    }
+                    pindex = entry.pindex;
+                    if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                        ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                    // A skipped block may still spend what the scan found since its filter was tested
+                    if (entry.fSkipped && !vFoundQuery.empty() && entry.blockFilter.MatchAny(vFoundQuery)) {
+                        entry.fSkipped = false;
+                        entry.fRead = ReadBlockFromDisk(entry.block, pindex, chainParams.GetConsensus());
+                        if (entry.fRead)
+                            MatchRescanBlock(entry, filter);
+                    }
+
+                    if (entry.fRead || entry.fSkipped) {
+                        std::vector<size_t>::const_iterator itMatch = entry.vMatches.begin();
+                        for (size_t posInBlock = 0; posInBlock < entry.block.vtx.size(); ++posInBlock) {
+                            const CTransaction& tx = *entry.block.vtx[posInBlock];
+                            bool fMatch = itMatch != entry.vMatches.end() && *itMatch == posInBlock;
+                            if (fMatch)
+                                itMatch++;
+                            if ((fMatch || involvesFound(tx)) && AddToWalletIfInvolvingMe(tx, pindex, posInBlock, fUpdate)) {
+                                setFoundTxids.insert(tx.GetHash());
+                                for (const CTxIn& txin : tx.vin)
+                                    setFoundSpent.insert(txin.prevout);
+                                if (pvQuery) {
+                                    for (unsigned int i = 0; i < tx.vout.size(); i++)
+                                        vFoundQuery.push_back(OutPointFilterElement(COutPoint(tx.GetHash(), i)));
+                                    for (const CTxIn& txin : tx.vin)
+                                        vFoundQuery.push_back(OutPointFilterElement(txin.prevout));
+                                }
+                            }
+                        }
+                        if (!ret) {
+                            ret = pindex;
+                        }
+                    } else {
+                        ret = nullptr;
+                    }
+                    if (GetTime() >= nNow + 60) {
+                        nNow = GetTime();
+                        LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+                    }
+                }
+            }
+            vBatch.swap(vNextBatch);
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+    fScanningWallet = false;
+    stakeCandidates.SetDirty();
+    {
+        LOCK(cs_wallet);
+        fUnspentOutputsDirty = true;
+    }
     return ret;
 }
 
+int64_t CWallet::RescanFromTime(int64_t nTime, bool fUpdate)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (nTimePendingRescan && nTimePendingRescan < nTime)
+        nTime = nTimePendingRescan;
+    // Keys of unknown birth (time 0 or 1) are looked for from the genesis block. Start where
+    // ScanForWalletTransactions() does, so a gap before the range it returns is a failed read.
+    CBlockIndex* pindexStart = chainActive.FindEarliestAtLeast(nTime - TIMESTAMP_WINDOW);
+    while (pindexStart && nTimeFirstKey && pindexStart->GetBlockTime() < nTimeFirstKey - TIMESTAMP_WINDOW)
+        pindexStart = chainActive.Next(pindexStart);
+    LogPrintf("%s: rescanning the last %i blocks\n", __func__, pindexStart ? chainActive.Height() - pindexStart->nHeight + 1 : 0);
+    if (!pindexStart) {
+        nTimePendingRescan = 0;
+        return nTime;
+    }
+
+    CBlockIndex* pindexScanned = ScanForWalletTransactions(pindexStart, fUpdate);
+    if (fAbortRescan)
+        return nTime;
+    if (!pindexScanned)
+        return chainActive.Tip()->GetBlockTimeMax() + TIMESTAMP_WINDOW + 1;
+    if (pindexScanned != pindexStart)
+        return pindexScanned->GetBlockTimeMax() + TIMESTAMP_WINDOW;
+    nTimePendingRescan = 0;
+    return nTime;
+}
+
+void CWallet::AddPendingRescan(int64_t nTime)
+{
+    AssertLockHeld(cs_wallet);
+    nTime = std::max<int64_t>(nTime, 1);
+    if (!nTimePendingRescan || nTime < nTimePendingRescan)
+        nTimePendingRescan = nTime;
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     // If transactions aren't being broadcasted, don't let them into local mempool either
@@ -1826,6 +2485,21 @@ CAmount CWalletTx::GetChange() const
     return nChangeCached;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet)
+        pwallet->MarkBalancesDirty(GetHash());
+}
+
 bool CWalletTx::InMempool() const
 {
     LOCK(mempool.cs);
@@ -1856,8 +2530,8 @@ bool CWalletTx::IsTrusted() const
     BOOST_FOREACH(const CTxIn& txin, tx->vin)
     {
         // Transactions not sent by us: not trusted
-        const CWalletTx* parent = pwallet->GetWalletTx(txin.prevout.hash);
-        if (parent == NULL)
+        std::shared_ptr<const CWalletTx> parent = pwallet->GetWalletTx(txin.prevout.hash);
+        if (!parent)
             return false;
         const CTxOut& parentOut = parent->tx->vout[txin.prevout.n];
         if (pwallet->IsMine(parentOut) != ISMINE_SPENDABLE)
@@ -1880,25 +2554,29 @@ std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime, CCon
     std::vector<uint256> result;
 
     LOCK(cs_wallet);
-    // Sort them in chronological order
-    multimap<unsigned int, CWalletTx*> mapSorted;
-    BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
+    // In chronological order, and don't rebroadcast if newer than nTime
+    std::set<std::pair<unsigned int, uint256> >::iterator it = setResendCandidates.begin();
+    while (it != setResendCandidates.end() && (int64_t)it->first <= nTime)
     {
-        CWalletTx& wtx = item.second;
-        // Don't rebroadcast if newer than nTime:
-        if (wtx.nTimeReceived > nTime)
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(it->second);
+        // SolarCoin: conflicted transactions stay, they are pending again once the conflict is disconnected
+        if (mi == mapWallet.end() || mi->second.isAbandoned() || mi->second.GetDepthInMainChain() > 0) {
+            setResendCandidates.erase(it++);
             continue;
-        mapSorted.insert(make_pair(wtx.nTimeReceived, &wtx));
-    }
-    BOOST_FOREACH(PAIRTYPE(const unsigned int, CWalletTx*)& item, mapSorted)
-    {
-        CWalletTx& wtx = *item.second;
-        if (wtx.RelayWalletTransaction(connman))
-            result.push_back(wtx.GetHash());
+        }
+        if (mi->second.RelayWalletTransaction(connman))
+            result.push_back(mi->first);
+        ++it;
     }
     return result;
 }
 
+void CWallet::AddResendCandidate(const CWalletTx& wtx)
+{
+    if (!wtx.IsCoinBase() && !wtx.IsCoinStake() && !wtx.isAbandoned())
+        setResendCandidates.insert(std::make_pair(wtx.nTimeReceived, wtx.GetHash()));
+}
+
 void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman)
 {
     // Do this infrequently and randomly to avoid giving away
@@ -1933,105 +2611,177 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+void CWallet::MarkBalancesDirty(const uint256& hash) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
+    LOCK(cs_wallet);
+    // Nothing to update a transaction at a time before the first GetBalances() or after MarkDirty()
+    if (fBalancesCached)
+        setBalanceDirtyTx.insert(hash);
+}
+
+void CWallet::AddBalanceContribution(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    const int nDepth = wtx.GetDepthInMainChain();
+    Balances balances;
+    if (wtx.IsTrusted()) {
+        balances.nTrusted = wtx.GetAvailableCredit();
+        balances.nWatchTrusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        balances.nUntrustedPending = wtx.GetAvailableCredit();
+        balances.nWatchUntrustedPending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = wtx.GetImmatureCredit();
+    balances.nWatchImmature = wtx.GetImmatureWatchOnlyCredit();
+
+    if (nDepth == 0)
+        setBalanceUnconfirmedTx.insert(hash);
+    if (nDepth > 0 && (wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.GetBlocksToMaturity() > 0)
+        queueBalanceMaturity.push(std::make_pair(chainActive.Height() + wtx.GetBlocksToMaturity(), hash));
+
+    if (balances.nTrusted || balances.nUntrustedPending || balances.nImmature ||
+        balances.nWatchTrusted || balances.nWatchUntrustedPending || balances.nWatchImmature) {
+        mapBalanceContributions[hash] = balances;
+        cachedBalances.nTrusted += balances.nTrusted;
+        cachedBalances.nUntrustedPending += balances.nUntrustedPending;
+        cachedBalances.nImmature += balances.nImmature;
+        cachedBalances.nWatchTrusted += balances.nWatchTrusted;
+        cachedBalances.nWatchUntrustedPending += balances.nWatchUntrustedPending;
+        cachedBalances.nWatchImmature += balances.nWatchImmature;
+    }
+}
+
+void CWallet::RemoveBalanceContribution(const uint256& hash) const
+{
+    AssertLockHeld(cs_wallet);
+    setBalanceUnconfirmedTx.erase(hash);
+    std::map<uint256, Balances>::iterator it = mapBalanceContributions.find(hash);
+    if (it == mapBalanceContributions.end())
+        return;
+    const Balances& balances = it->second;
+    cachedBalances.nTrusted -= balances.nTrusted;
+    cachedBalances.nUntrustedPending -= balances.nUntrustedPending;
+    cachedBalances.nImmature -= balances.nImmature;
+    cachedBalances.nWatchTrusted -= balances.nWatchTrusted;
+    cachedBalances.nWatchUntrustedPending -= balances.nWatchUntrustedPending;
+    cachedBalances.nWatchImmature -= balances.nWatchImmature;
+    mapBalanceContributions.erase(it);
+}
+
+CWallet::Balances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    const bool fNewTip = pindexTip != pindexCachedBalanceTip;
+    if (fBalancesCached && !fNewTip && nCachedBalanceMempoolUpdated == nMempoolUpdated && setBalanceDirtyTx.empty())
+        return cachedBalances;
+
+    // Confirmed transactions only change when their block is disconnected, which the wallet is not told of
+    bool fReorg = fNewTip && (!pindexTip || !pindexCachedBalanceTip ||
+                              pindexTip->GetAncestor(pindexCachedBalanceTip->nHeight) != pindexCachedBalanceTip);
+    if (!fBalancesCached || fReorg) {
+        cachedBalances = Balances();
+        mapBalanceContributions.clear();
+        setBalanceDirtyTx.clear();
+        setBalanceUnconfirmedTx.clear();
+        queueBalanceMaturity = std::priority_queue<std::pair<int, uint256>, std::vector<std::pair<int, uint256> >, std::greater<std::pair<int, uint256> > >();
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+            AddBalanceContribution(it->second);
+    } else {
+        std::set<uint256> setUpdate;
+        setUpdate.swap(setBalanceDirtyTx);
+        if (fNewTip || nCachedBalanceMempoolUpdated != nMempoolUpdated)
+            setUpdate.insert(setBalanceUnconfirmedTx.begin(), setBalanceUnconfirmedTx.end());
+        while (!queueBalanceMaturity.empty() && pindexTip && queueBalanceMaturity.top().first <= pindexTip->nHeight) {
+            setUpdate.insert(queueBalanceMaturity.top().second);
+            queueBalanceMaturity.pop();
+        }
+        for (const uint256& hash : setUpdate) {
+            RemoveBalanceContribution(hash);
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it != mapWallet.end())
+                AddBalanceContribution(it->second);
         }
     }
 
-    return nTotal;
+    pindexCachedBalanceTip = pindexTip;
+    nCachedBalanceMempoolUpdated = nMempoolUpdated;
+    fBalancesCached = true;
+    return cachedBalances;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
+    return GetBalances().nWatchImmature;
+}
+
+void CWallet::AddUnspentOutputs(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) != ISMINE_NO && !IsSpent(hash, i))
+            setUnspentOutputs.insert(COutPoint(hash, i));
     }
-    return nTotal;
 }
 
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl, bool fIncludeZeroValue) const
 {
+    PROFILE_SCOPE("AvailableCoins");
     vCoins.clear();
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (fUnspentOutputsDirty) {
+            setUnspentOutputs.clear();
+            for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+                AddUnspentOutputs(it->second);
+            fUnspentOutputsDirty = false;
+        }
+
+        // SolarCoin: only the transactions with unspent outputs, a transaction at a time
+        std::set<COutPoint>::const_iterator itOut = setUnspentOutputs.begin();
+        while (itOut != setUnspentOutputs.end())
         {
-            const uint256& wtxid = it->first;
+            const uint256 wtxid = itOut->hash;
+            std::set<COutPoint>::const_iterator itOutEnd = itOut;
+            while (itOutEnd != setUnspentOutputs.end() && itOutEnd->hash == wtxid)
+                ++itOutEnd;
+            std::set<COutPoint>::const_iterator itTxOut = itOut;
+            itOut = itOutEnd;
+
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end()) {
+                setUnspentOutputs.erase(itTxOut, itOutEnd);
+                continue;
+            }
             const CWalletTx* pcoin = &(*it).second;
 
             if (!CheckFinalTx(*pcoin))
@@ -2083,10 +2833,16 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 continue;
             }
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
+            for (; itTxOut != itOutEnd; ) {
+                unsigned int i = itTxOut->n;
                 isminetype mine = IsMine(pcoin->tx->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->tx->vout[i].nValue > 0 || fIncludeZeroValue) &&
+                if (mine == ISMINE_NO || IsSpent(wtxid, i)) {
+                    // Spent for good, unless a conflict or abandonment asks for a rebuild
+                    setUnspentOutputs.erase(itTxOut++);
+                    continue;
+                }
+                ++itTxOut;
+                if (!IsLockedCoin((*it).first, i) && (pcoin->tx->vout[i].nValue > 0 || fIncludeZeroValue) &&
                     (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint((*it).first, i))))
                         vCoins.push_back(COutput(pcoin, i, nDepth,
                                                  ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
@@ -2097,7 +2853,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
     }
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
+static void ApproximateBestSubset(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
     vector<char> vfIncluded;
@@ -2143,7 +2899,21 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,uns
     }
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, vector<COutput> vCoins,
+// SolarCoin: whether output may be spent in a selection pass with these confirmation and chain limits
+static bool IsSelectable(const COutput& output, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors)
+{
+    if (!output.fSpendable)
+        return false;
+
+    const CWalletTx *pcoin = output.tx;
+
+    if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
+        return false;
+
+    return mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors);
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const vector<COutput>& vCoins,
                                  set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
@@ -2156,25 +2926,19 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
+    // SolarCoin: shuffle the eligible candidates instead of a copy of every output
+    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vCandidates;
+    vCandidates.reserve(vCoins.size());
     BOOST_FOREACH(const COutput &output, vCoins)
     {
-        if (!output.fSpendable)
-            continue;
-
-        const CWalletTx *pcoin = output.tx;
-
-        if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
-            continue;
-
-        if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
-            continue;
-
-        int i = output.i;
-        CAmount n = pcoin->tx->vout[i].nValue;
+        if (IsSelectable(output, nConfMine, nConfTheirs, nMaxAncestors))
+            vCandidates.push_back(make_pair(output.tx->tx->vout[output.i].nValue, make_pair(output.tx, (unsigned int)output.i)));
+    }
+    random_shuffle(vCandidates.begin(), vCandidates.end(), GetRandInt);
 
-        pair<CAmount,pair<const CWalletTx*,unsigned int> > coin = make_pair(n,make_pair(pcoin, i));
+    for (const auto& coin : vCandidates)
+    {
+        CAmount n = coin.first;
 
         if (n == nTargetValue)
         {
@@ -2215,6 +2979,18 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     // Solve subset sum by stochastic approximation
     std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
     std::reverse(vValue.begin(), vValue.end());
+
+    // SolarCoin: in large wallets only the biggest candidates are searched, as long as they cover the target
+    if (vValue.size() > MAX_KNAPSACK_CANDIDATES)
+    {
+        size_t nKeep = 0;
+        CAmount nTotalKept = 0;
+        while (nKeep < vValue.size() && (nKeep < MAX_KNAPSACK_CANDIDATES || nTotalKept < nTargetValue + MIN_CHANGE))
+            nTotalKept += vValue[nKeep++].first;
+        vValue.resize(nKeep);
+        nTotalLower = nTotalKept;
+    }
+
     vector<char> vfBest;
     CAmount nBest;
 
@@ -2248,8 +3024,115 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     return true;
 }
 
+/**
+ * SolarCoin: Depth-first search over vValue, sorted by descending value, for the subset adding up
+ * to between nTargetValue and nTargetValue + nCostOfChange with the least excess. A branch is
+ * cut as soon as it overshoots the window or the coins left cannot reach the target, and equal
+ * coins are only tried in one order, so even wallets with a great many small outputs are
+ * searched quickly. Gives up after BNB_MAX_TRIES steps, keeping the best subset found so far.
+ */
+static bool SearchBranchAndBound(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTargetValue,
+                                 const CAmount& nCostOfChange, vector<char>& vfBest)
+{
+    CAmount nAvailable = 0;
+    for (const auto& coin : vValue)
+        nAvailable += coin.first;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    vector<char> vfSelected(vValue.size(), false);
+    CAmount nSelected = 0;
+    CAmount nBestExcess = std::numeric_limits<CAmount>::max();
+    size_t i = 0;
+    for (size_t nTries = 0; nTries < BNB_MAX_TRIES; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nSelected + nAvailable < nTargetValue || nSelected > nTargetValue + nCostOfChange) {
+            fBacktrack = true;
+        } else if (nSelected >= nTargetValue) {
+            if (nSelected - nTargetValue < nBestExcess) {
+                nBestExcess = nSelected - nTargetValue;
+                vfBest = vfSelected;
+                if (nBestExcess == 0)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Put back the coins excluded after the last selected one, then exclude that one instead
+            while (i > 0 && !vfSelected[i - 1]) {
+                i--;
+                nAvailable += vValue[i].first;
+            }
+            if (i == 0)
+                break;
+            i--;
+            vfSelected[i] = false;
+            nSelected -= vValue[i].first;
+            i++;
+        } else if (i > 0 && !vfSelected[i - 1] && vValue[i].first == vValue[i - 1].first) {
+            // Selecting a coin equal to the one just excluded only repeats that branch, so the
+            // whole run of them is excluded
+            while (i < vValue.size() && vValue[i].first == vValue[i - 1].first) {
+                nAvailable -= vValue[i].first;
+                i++;
+            }
+        } else {
+            nAvailable -= vValue[i].first;
+            vfSelected[i] = true;
+            nSelected += vValue[i].first;
+            i++;
+        }
+    }
+
+    return nBestExcess != std::numeric_limits<CAmount>::max();
+}
+
+bool CWallet::SelectCoinsBnB(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const vector<COutput>& vCoins,
+                             const CFeeRate& effectiveFeeRate, const CAmount& nCostOfChange, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    const CAmount nInputFee = effectiveFeeRate.GetFee(INPUT_SIZE_ESTIMATE);
+    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
+    vValue.reserve(vCoins.size());
+    BOOST_FOREACH(const COutput &output, vCoins)
+    {
+        if (!IsSelectable(output, nConfMine, nConfTheirs, nMaxAncestors))
+            continue;
+        CAmount nEffectiveValue = output.tx->tx->vout[output.i].nValue - nInputFee;
+        if (nEffectiveValue <= 0)
+            continue;
+        vValue.push_back(make_pair(nEffectiveValue, make_pair(output.tx, (unsigned int)output.i)));
+    }
+
+    // Every input pays the same fee, so coins sorted by value stay sorted by effective value
+    if (!std::is_sorted(vValue.rbegin(), vValue.rend(), CompareValueOnly()))
+    {
+        std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
+        std::reverse(vValue.begin(), vValue.end());
+    }
+
+    vector<char> vfBest;
+    if (!SearchBranchAndBound(vValue, nTargetValue, nCostOfChange, vfBest))
+        return false;
+
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        if (vfBest[i])
+        {
+            setCoinsRet.insert(vValue[i].second);
+            nValueRet += vValue[i].first + nInputFee;
+        }
+
+    LogPrint("selectcoins", "SelectCoinsBnB() selected %u coins, total %s\n", setCoinsRet.size(), FormatMoney(nValueRet));
+    return true;
+}
+
 bool CWallet::SelectCoins(const vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
 {
+    PROFILE_SCOPE("SelectCoins");
     vector<COutput> vCoins(vAvailableCoins);
 
     // coin control -> return all selected outputs (we want all selected to go into the transaction for sure)
@@ -2317,6 +3200,42 @@ bool CWallet::SelectCoins(const vector<COutput>& vAvailableCoins, const CAmount&
     return res;
 }
 
+bool CWallet::SelectCoinsChangeless(const vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, const CFeeRate& effectiveFeeRate, const CAmount& nCostOfChange,
+                                    set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    vector<COutput> vCoins(vAvailableCoins);
+    std::sort(vCoins.begin(), vCoins.end(), CompareOutputValueDescending());
+
+    return SelectCoinsBnB(nTargetValue, 1, 6, 0, vCoins, effectiveFeeRate, nCostOfChange, setCoinsRet, nValueRet) ||
+        SelectCoinsBnB(nTargetValue, 1, 1, 0, vCoins, effectiveFeeRate, nCostOfChange, setCoinsRet, nValueRet);
+}
+
+void CWallet::AddDustInputs(const vector<COutput>& vAvailableCoins, const CFeeRate& effectiveFeeRate, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    const CAmount nInputFee = effectiveFeeRate.GetFee(INPUT_SIZE_ESTIMATE);
+    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vDust;
+    BOOST_FOREACH(const COutput& output, vAvailableCoins)
+    {
+        if (!IsSelectable(output, 1, 6, 0))
+            continue;
+        CAmount n = output.tx->tx->vout[output.i].nValue;
+        if (n <= nInputFee || n >= MIN_CHANGE)
+            continue;
+        pair<const CWalletTx*,unsigned int> coin = make_pair(output.tx, (unsigned int)output.i);
+        if (!setCoinsRet.count(coin))
+            vDust.push_back(make_pair(n, coin));
+    }
+
+    // The smallest go first, they are the closest to costing more to spend than they are worth
+    size_t nAdd = std::min(vDust.size(), (size_t)MAX_DUST_CONSOLIDATE_INPUTS);
+    std::partial_sort(vDust.begin(), vDust.begin() + nAdd, vDust.end(), CompareValueOnly());
+    for (size_t i = 0; i < nAdd; i++)
+    {
+        setCoinsRet.insert(vDust[i].second);
+        nValueRet += vDust[i].first;
+    }
+}
+
 bool CWallet::FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, bool overrideEstimatedFeeRate, const CFeeRate& specificFeeRate, int& nChangePosInOut, std::string& strFailReason, bool includeWatching, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, bool keepReserveKey, const CTxDestination& destChange)
 {
     vector<CRecipient> vecSend;
@@ -2376,6 +3295,7 @@ bool CWallet::FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, bool ov
 bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet,
                                 int& nChangePosInOut, std::string& strFailReason, const CCoinControl* coinControl, bool sign)
 {
+    PROFILE_SCOPE("CreateTransaction");
     CAmount nValue = 0;
     int nChangePosRequest = nChangePosInOut;
     unsigned int nSubtractFeeFromAmount = 0;
@@ -2440,6 +3360,23 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
             std::vector<COutput> vAvailableCoins;
             AvailableCoins(vAvailableCoins, true, coinControl);
 
+            // SolarCoin: the fee rate the transaction will pay, to value each coin by what it adds
+            // after paying for its own input
+            int nSelectionConfirmTarget = nTxConfirmTarget;
+            if (coinControl && coinControl->nConfirmTarget > 0)
+                nSelectionConfirmTarget = coinControl->nConfirmTarget;
+            CFeeRate effectiveFeeRate(GetMinimumFee(1000, nSelectionConfirmTarget, mempool));
+            if (coinControl && coinControl->fOverrideFeeRate)
+                effectiveFeeRate = coinControl->nFeeRate;
+            const CAmount nCostOfChange = effectiveFeeRate.GetFee(CHANGE_OUTPUT_SIZE) + effectiveFeeRate.GetFee(INPUT_SIZE_ESTIMATE);
+
+            // First look for coins that need no change output, unless the recipients pay the fee
+            // or coin control picks inputs or a minimum fee; while fees are at their floor, sweep
+            // some dust into the change otherwise
+            const bool fFreeCoinChoice = nSubtractFeeFromAmount == 0 && (!coinControl || !coinControl->HasSelected());
+            bool fTryChangeless = fFreeCoinChoice && (!coinControl || coinControl->nMinimumTotalFee == 0);
+            const bool fConsolidateDust = fFreeCoinChoice && effectiveFeeRate <= minTxFee;
+
             nFeeRet = 0;
             // Start with no fee and loop until there is enough fee
             while (true)
@@ -2489,10 +3426,23 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                 // Choose coins to use
                 CAmount nValueIn = 0;
                 setCoins.clear();
-                if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coinControl))
+                bool fChangeless = false;
+                if (fTryChangeless)
                 {
-                    strFailReason = _("Insufficient funds");
-                    return false;
+                    // Only on the first pass; the outputs alone set the rest of the fee
+                    fTryChangeless = false;
+                    CAmount nFeeOutputs = effectiveFeeRate.GetFee(GetVirtualTransactionSize(txNew));
+                    fChangeless = SelectCoinsChangeless(vAvailableCoins, nValueToSelect + nFeeOutputs, effectiveFeeRate, nCostOfChange, setCoins, nValueIn);
+                }
+                if (!fChangeless)
+                {
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coinControl))
+                    {
+                        strFailReason = _("Insufficient funds");
+                        return false;
+                    }
+                    if (fConsolidateDust)
+                        AddDustInputs(vAvailableCoins, effectiveFeeRate, setCoins, nValueIn);
                 }
                 for (const auto& pcoin : setCoins)
                 {
@@ -2509,7 +3459,14 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                 }
 
                 const CAmount nChange = nValueIn - nValueToSelect;
-                if (nChange > 0)
+                if (fChangeless)
+                {
+                    // SolarCoin: less than a change output would cost is left over, it goes to the fee
+                    nFeeRet += nChange;
+                    reservekey.ReturnKey();
+                    nChangePosInOut = -1;
+                }
+                else if (nChange > 0)
                 {
                     // Fill a vout to ourself
                     // TODO: pass in scriptChange instead of reservekey so
@@ -2876,6 +3833,10 @@ DBErrors CWallet::ZapSelectTx(vector<uint256>& vHashIn, vector<uint256>& vHashOu
     if (!fFileBacked)
         return DB_LOAD_OK;
     DBErrors nZapSelectTxRet = CWalletDB(strWalletFile,"cr+").ZapSelectTx(this, vHashIn, vHashOut);
+    {
+        LOCK(cs_wallet);
+        setTxHeightPending.insert(vHashOut.begin(), vHashOut.end());
+    }
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
         if (CDB::Rewrite(strWalletFile, "\x04pool"))
@@ -3022,15 +3983,25 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         else
             nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
 
+        // SolarCoin: the keys are generated in batches, each written in one database transaction
         while (setKeyPool.size() < (nTargetSize + 1))
         {
+            unsigned int nBatch = std::min((unsigned int)(nTargetSize + 1 - setKeyPool.size()), KEYPOOL_BATCH_SIZE);
             int64_t nEnd = 1;
             if (!setKeyPool.empty())
                 nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error(std::string(__func__) + ": writing generated key failed");
-            setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
+            if (!walletdb.TxnBegin())
+                throw runtime_error(std::string(__func__) + ": TxnBegin failed");
+            std::vector<CPubKey> vPubKeys = GenerateNewKeys(walletdb, nBatch);
+            for (unsigned int i = 0; i < nBatch; i++) {
+                if (!walletdb.WritePool(nEnd + i, CKeyPool(vPubKeys[i])))
+                    throw runtime_error(std::string(__func__) + ": writing generated key failed");
+            }
+            if (!walletdb.TxnCommit())
+                throw runtime_error(std::string(__func__) + ": TxnCommit failed");
+            for (unsigned int i = 0; i < nBatch; i++)
+                setKeyPool.insert(nEnd + i);
+            LogPrintf("keypool added keys %d to %d, size=%u\n", nEnd, nEnd + nBatch - 1, setKeyPool.size());
         }
     }
     return true;
@@ -3167,10 +4138,9 @@ set< set<CTxDestination> > CWallet::GetAddressGroupings()
     set< set<CTxDestination> > groupings;
     set<CTxDestination> grouping;
 
-    BOOST_FOREACH(PAIRTYPE(uint256, CWalletTx) walletEntry, mapWallet)
+    CWalletTxWalker walker(*this);
+    while (const CWalletTx* pcoin = walker.Next())
     {
-        CWalletTx *pcoin = &walletEntry.second;
-
         if (pcoin->tx->vin.size() > 0)
         {
             bool any_mine = false;
@@ -3180,7 +4150,7 @@ set< set<CTxDestination> > CWallet::GetAddressGroupings()
                 CTxDestination address;
                 if(!IsMine(txin)) /* If this input isn't mine, ignore it */
                     continue;
-                if(!ExtractDestination(mapWallet[txin.prevout.hash].tx->vout[txin.prevout.n].scriptPubKey, address))
+                if(!ExtractDestination(GetWalletTx(txin.prevout.hash)->tx->vout[txin.prevout.n].scriptPubKey, address))
                     continue;
                 grouping.insert(address);
                 any_mine = true;
@@ -3265,9 +4235,10 @@ CAmount CWallet::GetAccountBalance(CWalletDB& walletdb, const std::string& strAc
     CAmount nBalance = 0;
 
     // Tally wallet transactions
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    CWalletTxWalker walker(*this);
+    while (const CWalletTx* pwtx = walker.Next())
     {
-        const CWalletTx& wtx = (*it).second;
+        const CWalletTx& wtx = *pwtx;
         if (!CheckFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 0)
             continue;
 
@@ -3374,22 +4345,34 @@ void CWallet::GetScriptForMining(boost::shared_ptr<CReserveScript> &script)
     script->reserveScript = CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
 }
 
+size_t CWallet::DynamicMemoryUsage() const
+{
+    LOCK(cs_wallet);
+    size_t nUsage = memusage::DynamicUsage(mapWallet) + memusage::DynamicUsage(mapTxSpends);
+    for (const std::pair<const uint256, CWalletTx>& item : mapWallet)
+        nUsage += memusage::DynamicUsage(item.second.tx) + RecursiveDynamicUsage(*item.second.tx);
+    return nUsage;
+}
+
 void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    stakeCandidates.SetDirty();
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    stakeCandidates.SetDirty();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    stakeCandidates.SetDirty();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -3472,9 +4455,10 @@ void CWallet::GetKeyBirthTimes(std::map<CTxDestination, int64_t> &mapKeyBirth) c
 
     // find first block that affects those keys, if there are any left
     std::vector<CKeyID> vAffected;
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); it++) {
+    CWalletTxWalker walker(*this);
+    while (const CWalletTx* pwtx = walker.Next()) {
         // iterate over all wallet transactions...
-        const CWalletTx &wtx = (*it).second;
+        const CWalletTx &wtx = *pwtx;
         BlockMap::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
         if (blit != mapBlockIndex.end() && chainActive.Contains(blit->second)) {
             // ... which are already in a block
@@ -3545,6 +4529,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     std::string strUsage = HelpMessageGroup(_("Wallet options:"));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
+    strUsage += HelpMessageOpt("-lazywallet", strprintf(_("Keep only the wallet transactions that can still change the balance in memory, and read older ones from the wallet file when needed (default: %u)"), DEFAULT_LAZYWALLET));
     strUsage += HelpMessageOpt("-fallbackfee=<amt>", strprintf(_("A fee rate (in %s/kB) that will be used when fee estimation has insufficient data (default: %s)"),
                                                                CURRENCY_UNIT, FormatMoney(DEFAULT_FALLBACK_FEE)));
     strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for transaction creation (default: %s)"),
@@ -3555,14 +4540,20 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-staking", strprintf(_("Stake the wallet's mature coins to generate PoST blocks while it is unlocked (default: %u)"), DEFAULT_STAKING));
+    strUsage += HelpMessageOpt("-stakeoptimize", strprintf(_("While staking, periodically split the wallet's large outputs and combine its small ones to the sizes that stake best (default: %u)"), DEFAULT_STAKEOPTIMIZE));
+    strUsage += HelpMessageOpt("-stakesplitthreshold=<amt>", strprintf(_("With -stakeoptimize, split outputs of at least twice this value (in %s) into outputs of this value (default: 0, follow the network stake weight)"), CURRENCY_UNIT));
+    strUsage += HelpMessageOpt("-stakecombinethreshold=<amt>", strprintf(_("With -stakeoptimize, combine outputs smaller than this value (in %s) (default: 0, 1/%d of the split threshold)"), CURRENCY_UNIT, STAKE_COMBINE_RATIO));
+    strUsage += HelpMessageOpt("-stakingthreads=<n>", strprintf(_("Set the number of kernel search threads used for staking (0 = one per core, default: %d)"), DEFAULT_STAKING_THREADS));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
     strUsage += HelpMessageOpt("-usehd", _("Use hierarchical deterministic key generation (HD) after BIP32. Only has effect during wallet creation/first start") + " " + strprintf(_("(default: %u)"), DEFAULT_USE_HD_WALLET));
     strUsage += HelpMessageOpt("-walletrbf", strprintf(_("Send transactions with full-RBF opt-in enabled (default: %u)"), DEFAULT_WALLET_RBF));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
-    strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
+    strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT) + " " + _("(can be specified multiple times to load multiple wallets)"));
     strUsage += HelpMessageOpt("-walletbroadcast", _("Make the wallet broadcast transactions") + " " + strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
-    strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
+    strUsage += HelpMessageOpt("-walletflushinterval=<n>", strprintf(_("Write wallet changes to disk in the background at most every <n> seconds instead of after each change; a system crash can lose the last <n> seconds of them (0 = after each change, default: %u)"), DEFAULT_WALLET_FLUSH_INTERVAL));
+    strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID, or by up to -notifybatch TxIDs separated by spaces)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
                                " " + _("(1 = keep tx meta data e.g. account owner and payment request information, 2 = drop tx meta data)"));
 
@@ -3748,12 +4739,19 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
             }
         }
     }
+    if (GetBoolArg("-lazywallet", DEFAULT_LAZYWALLET))
+    {
+        nStart = GetTimeMillis();
+        walletInstance->UnloadSettledTransactions();
+        LogPrintf(" unload      %15dms\n", GetTimeMillis() - nStart);
+    }
     walletInstance->SetBroadcastTransactions(GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
     {
         LOCK(walletInstance->cs_wallet);
         LogPrintf("setKeyPool.size() = %u\n",      walletInstance->GetKeyPoolSize());
         LogPrintf("mapWallet.size() = %u\n",       walletInstance->mapWallet.size());
+        LogPrintf("mapUnloadedTx.size() = %u\n",   walletInstance->mapUnloadedTx.size());
         LogPrintf("mapAddressBook.size() = %u\n",  walletInstance->mapAddressBook.size());
     }
 
@@ -3768,29 +4766,36 @@ bool CWallet::InitLoadWallet()
         return true;
     }
 
-    std::string walletFile = GetArg("-wallet", DEFAULT_WALLET_DAT);
-
-    CWallet * const pwallet = CreateWalletFromFile(walletFile);
-    if (!pwallet) {
-        return false;
+    for (const std::string& walletFile : GetWalletFiles()) {
+        CWallet * const pwallet = CreateWalletFromFile(walletFile);
+        if (!pwallet) {
+            return false;
+        }
+        vpwallets.push_back(pwallet);
     }
-    pwalletMain = pwallet;
+    // SolarCoin: The first wallet is the default one, used by the GUI and RPC calls that name none
+    pwalletMain = vpwallets[0];
 
     return true;
 }
 
-std::atomic<bool> CWallet::fFlushThreadRunning(false);
+std::atomic<bool> CWallet::fFlushScheduled(false);
 
-void CWallet::postInitProcess(boost::thread_group& threadGroup)
+void CWallet::postInitProcess(boost::thread_group& threadGroup, CScheduler& scheduler)
 {
     // Add wallet transactions that aren't already in a block to mempool
     // Do this here as mempool requires genesis block to be loaded
     ReacceptWalletTransactions();
 
-    // Run a thread to flush wallet periodically
-    if (!CWallet::fFlushThreadRunning.exchange(true)) {
-        threadGroup.create_thread(ThreadFlushWalletDB);
+    // Flush the wallets periodically. SolarCoin: on a queue of their own, so that a flush that
+    // takes a while does not hold up the other periodic tasks
+    if (!CWallet::fFlushScheduled.exchange(true)) {
+        scheduler.scheduleEvery(&MaybeFlushWalletDB, 1, scheduler.addQueue("walletflush", 1));
     }
+
+    // SolarCoin: Run the PoST stake miner
+    if (GetBoolArg("-staking", DEFAULT_STAKING))
+        StartStakeMiner(threadGroup, this, GetArg("-stakingthreads", DEFAULT_STAKING_THREADS), Params());
 }
 
 bool CWallet::ParameterInteraction()
@@ -3802,6 +4807,13 @@ bool CWallet::ParameterInteraction()
         LogPrintf("%s: parameter interaction: -blocksonly=1 -> setting -walletbroadcast=0\n", __func__);
     }
 
+    if (GetWalletFiles().size() > 1) {
+        for (const char* strArg : {"-salvagewallet", "-zapwallettxes", "-upgradewallet"}) {
+            if (GetBoolArg(strArg, false))
+                return InitError(strprintf("%s is only allowed with a single wallet file", strArg));
+        }
+    }
+
     if (GetBoolArg("-salvagewallet", false) && SoftSetBoolArg("-rescan", true)) {
         // Rewrite just private keys: rescan to find transactions
         LogPrintf("%s: parameter interaction: -salvagewallet=1 -> setting -rescan=1\n", __func__);
@@ -3814,6 +4826,9 @@ bool CWallet::ParameterInteraction()
 
     if (GetBoolArg("-sysperms", false))
         return InitError("-sysperms is not allowed in combination with enabled wallet functionality");
+    // SolarCoin: deferred checkpoints are made by the flush thread, so they need it
+    if (GetBoolArg("-flushwallet", DEFAULT_FLUSHWALLET))
+        bitdb.nFlushInterval = std::max<int64_t>(0, GetArg("-walletflushinterval", DEFAULT_WALLET_FLUSH_INTERVAL));
     if (GetArg("-prune", 0) && GetBoolArg("-rescan", false))
         return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
 
@@ -3821,6 +4836,12 @@ bool CWallet::ParameterInteraction()
         InitWarning(AmountHighWarn("-minrelaytxfee") + " " +
                     _("The wallet will avoid paying less than the minimum relay fee."));
 
+    for (const char* strArg : {"-stakesplitthreshold", "-stakecombinethreshold"}) {
+        CAmount nThreshold = 0;
+        if (IsArgSet(strArg) && !ParseMoney(GetArg(strArg, ""), nThreshold))
+            return InitError(AmountErrMsg(strArg + 1, GetArg(strArg, "")));
+    }
+
     if (IsArgSet("-mintxfee"))
     {
         CAmount n = 0;
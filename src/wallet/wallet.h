@@ -15,12 +15,17 @@
 #include "script/ismine.h"
 #include "script/sign.h"
 #include "wallet/crypter.h"
+#include "wallet/stakecandidates.h"
 #include "wallet/walletdb.h"
 #include "wallet/rpcwallet.h"
 
 #include <algorithm>
 #include <atomic>
+#include <limits>
+#include <list>
 #include <map>
+#include <memory>
+#include <queue>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
@@ -32,6 +37,8 @@
 #include <boost/thread.hpp>
 
 extern CWallet* pwalletMain;
+//! SolarCoin: All loaded wallets, the first of which is pwalletMain
+extern std::vector<CWallet*> vpwallets;
 
 /**
  * Settings
@@ -44,6 +51,8 @@ extern bool fWalletRbf;
 extern bool fWalletUnlockStakingOnly;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! SolarCoin: keys generated and written in one database transaction by TopUpKeyPool
+static const unsigned int KEYPOOL_BATCH_SIZE = 1000;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
 //! -fallbackfee default
@@ -56,6 +65,30 @@ static const CAmount WALLET_INCREMENTAL_RELAY_FEE = 5000;
 static const CAmount MIN_CHANGE = CENT;
 //! final minimum change amount after paying for fees
 static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
+//! SolarCoin: size estimates (in bytes) used to put a fee on an input and on a change output before signing
+static const unsigned int INPUT_SIZE_ESTIMATE = 148;
+static const unsigned int CHANGE_OUTPUT_SIZE = 34;
+//! SolarCoin: branches the Branch-and-Bound coin selection explores before giving up
+static const size_t BNB_MAX_TRIES = 100000;
+//! SolarCoin: the randomized subset search only looks at this many of the largest candidates
+static const size_t MAX_KNAPSACK_CANDIDATES = 2000;
+//! SolarCoin: dust outputs swept into a transaction's change while fees are at their floor
+static const unsigned int MAX_DUST_CONSOLIDATE_INPUTS = 10;
+//! SolarCoin: blocks a rescan reads ahead at a time, and the threads reading them
+static const unsigned int RESCAN_BATCH_SIZE = 100;
+static const int MAX_RESCAN_THREADS = 8;
+//! SolarCoin: a rescan tests block filters for at most this many scripts and outpoints of the wallet
+static const size_t BLOCKFILTER_SCAN_MAX_ELEMENTS = 10000;
+//! SolarCoin: how far block times may be off, so rescans for a key start this long before its birth
+static const int64_t TIMESTAMP_WINDOW = 2 * 60 * 60;
+//! SolarCoin: default for -lazywallet
+static const bool DEFAULT_LAZYWALLET = false;
+//! SolarCoin: -lazywallet unloads transactions this deep whose owned outputs were spent this deep
+static const int LAZYWALLET_MIN_DEPTH = 1000;
+//! SolarCoin: unloaded transactions kept in memory after they were read back
+static const size_t LAZYWALLET_CACHE_TXS = 1000;
+//! SolarCoin: the height the wallet indexes transactions in no block of the active chain at
+static const int TX_HEIGHT_NOT_IN_CHAIN = std::numeric_limits<int>::max();
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -sendfreetransactions
@@ -79,6 +112,7 @@ class CBlockIndex;
 class CCoinControl;
 class COutput;
 class CReserveKey;
+class CScheduler;
 class CScript;
 class CTxMemPool;
 class CWalletTx;
@@ -378,20 +412,9 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
-    void BindWallet(CWallet *pwalletIn)
+    void BindWallet(const CWallet *pwalletIn)
     {
         pwallet = pwalletIn;
         MarkDirty();
@@ -571,7 +594,7 @@ private:
 class CWallet : public CCryptoKeyStore, public CValidationInterface
 {
 private:
-    static std::atomic<bool> fFlushThreadRunning;
+    static std::atomic<bool> fFlushScheduled;
 
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
@@ -580,6 +603,19 @@ private:
      */
     bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL) const;
 
+    /**
+     * SolarCoin: Select confirmed coins whose value after paying for their own input at
+     * effectiveFeeRate covers nTargetValue with at most nCostOfChange to spare, so that the
+     * transaction needs no change output. The coins are sorted by value once for all passes.
+     */
+    bool SelectCoinsChangeless(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, const CFeeRate& effectiveFeeRate, const CAmount& nCostOfChange, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+
+    /**
+     * SolarCoin: While fees are at their floor, add up to MAX_DUST_CONSOLIDATE_INPUTS of the
+     * smallest outputs below MIN_CHANGE that are still worth spending to setCoinsRet.
+     */
+    void AddDustInputs(const std::vector<COutput>& vAvailableCoins, const CFeeRate& effectiveFeeRate, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+
     CWalletDB *pwalletdbEncryption;
 
     //! the current wallet version: clients below this version are not able to load the wallet
@@ -627,6 +663,86 @@ private:
      */
     bool AddWatchOnly(const CScript& dest) override;
 
+    /**
+     * SolarCoin: the owned outputs that were unspent when last looked at, so AvailableCoins() only
+     * walks those instead of all of mapWallet. New wallet transactions add their outputs and drop
+     * the ones they spend, and AvailableCoins() drops those it finds spent. Anything that may make
+     * a spent output available again (conflicts, abandoning, rescans, imports) asks for a rebuild
+     * from mapWallet instead. Guarded by cs_wallet.
+     */
+    mutable std::set<COutPoint> setUnspentOutputs;
+    mutable bool fUnspentOutputsDirty;
+    void AddUnspentOutputs(const CWalletTx& wtx) const;
+
+    /**
+     * SolarCoin: the wallet transactions that may still need to be rebroadcast, by nTimeReceived,
+     * so ResendWalletTransactionsBefore() only walks those instead of all of mapWallet. Loading
+     * adds every candidate and AddToWallet() those it sees outside a block (new, in the mempool or
+     * disconnected); the resend walk drops the ones it finds confirmed, abandoned or unloaded.
+     * Guarded by cs_wallet.
+     */
+    std::set<std::pair<unsigned int, uint256> > setResendCandidates;
+    void AddResendCandidate(const CWalletTx& wtx);
+
+    //! SolarCoin: SyncTransaction() with cs_main and cs_wallet held
+    void SyncWalletTransaction(const CTransaction& tx, const CBlockIndex* pindex, int posInBlock);
+
+    //! SolarCoin: whether ScanForWalletTransactions() runs, and whether it was asked to stop
+    std::atomic<bool> fScanningWallet;
+    std::atomic<bool> fAbortRescan;
+
+    //! SolarCoin: the earliest birth time of the keys imported without a rescan since the last
+    //! import rescan, 0 if none; the next RescanFromTime() covers them (protected by cs_wallet)
+    int64_t nTimePendingRescan;
+
+    //! SolarCoin: the unloaded transactions read back lately, most recent first (guarded by cs_wallet)
+    mutable std::list<std::shared_ptr<const CWalletTx> > lruUnloadedTx;
+    mutable std::map<uint256, std::list<std::shared_ptr<const CWalletTx> >::iterator> mapUnloadedTxCache;
+
+    /**
+     * SolarCoin: The wallet transactions, resident or unloaded, by the height of their block in
+     * the active chain, or TX_HEIGHT_NOT_IN_CHAIN. Changed transactions are queued in
+     * setTxHeightPending, as cs_main may not be held then, and indexed on the next use.
+     * Guarded by cs_wallet.
+     */
+    std::map<uint256, int> mapTxHeight;
+    std::set<std::pair<int, uint256> > setTxByHeight;
+    std::set<uint256> setTxHeightPending;
+    void UpdateTxHeightIndex();
+
+public:
+    //! SolarCoin: all balances of the wallet, see GetBalances()
+    struct Balances
+    {
+        CAmount nTrusted = 0;                //!< GetBalance()
+        CAmount nUntrustedPending = 0;       //!< GetUnconfirmedBalance()
+        CAmount nImmature = 0;               //!< GetImmatureBalance()
+        CAmount nWatchTrusted = 0;           //!< GetWatchOnlyBalance()
+        CAmount nWatchUntrustedPending = 0;  //!< GetUnconfirmedWatchOnlyBalance()
+        CAmount nWatchImmature = 0;          //!< GetImmatureWatchOnlyBalance()
+    };
+
+private:
+    /**
+     * SolarCoin: the balances as of the last GetBalances(), kept up to date a transaction at a time.
+     * mapBalanceContributions holds what each wallet transaction adds to them, for those that add
+     * anything. A later call only computes again the transactions marked dirty since, the unconfirmed
+     * ones if the tip or the mempool changed (their trust depends on both) and the coinbases and
+     * coinstakes that matured since, popped from a queue by maturity height. Confirmed transactions
+     * keep their contribution while the tip only moves forward; a reorg or CWallet::MarkDirty()
+     * starts over from mapWallet. Guarded by cs_wallet.
+     */
+    mutable Balances cachedBalances;
+    mutable bool fBalancesCached;
+    mutable const CBlockIndex* pindexCachedBalanceTip;
+    mutable unsigned int nCachedBalanceMempoolUpdated;
+    mutable std::map<uint256, Balances> mapBalanceContributions;
+    mutable std::set<uint256> setBalanceDirtyTx;
+    mutable std::set<uint256> setBalanceUnconfirmedTx;
+    mutable std::priority_queue<std::pair<int, uint256>, std::vector<std::pair<int, uint256> >, std::greater<std::pair<int, uint256> > > queueBalanceMaturity;
+    void AddBalanceContribution(const CWalletTx& wtx) const;
+    void RemoveBalanceContribution(const uint256& hash) const;
+
 public:
     /*
      * Main wallet lock.
@@ -688,15 +804,37 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        fBalancesCached = false;
+        pindexCachedBalanceTip = NULL;
+        nCachedBalanceMempoolUpdated = 0;
+        fUnspentOutputsDirty = true;
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nTimePendingRescan = 0;
+        nRelockTime = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
     std::list<CAccountingEntry> laccentries;
 
+    //! SolarCoin: When walletpassphrase relocks this wallet, 0 while locked
+    int64_t nRelockTime;
+
+    //! SolarCoin: outputs the stake miner may use as kernels
+    CStakeCandidateSet stakeCandidates;
+
     typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
     typedef std::multimap<int64_t, TxPair > TxItems;
     TxItems wtxOrdered;
 
+    /**
+     * SolarCoin: The transactions -lazywallet unloaded from mapWallet, by hash and by order
+     * position; see UnloadSettledTransactions(). Their spends stay in mapTxSpends, and
+     * GetWalletTx() reads them back from the database. Guarded by cs_wallet.
+     */
+    std::map<uint256, int64_t> mapUnloadedTx;
+    std::multimap<int64_t, uint256> mapUnloadedOrdered;
+
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
 
@@ -706,7 +844,28 @@ public:
 
     std::set<COutPoint> setLockedCoins;
 
-    const CWalletTx* GetWalletTx(const uint256& hash) const;
+    /**
+     * A transaction of the wallet, or NULL. SolarCoin: an unloaded one is read back from the
+     * database and kept alive by the returned pointer, however many others are read after it;
+     * one in mapWallet is not owned by it and stays valid as long as it is there.
+     */
+    std::shared_ptr<const CWalletTx> GetWalletTx(const uint256& hash) const;
+
+    /**
+     * SolarCoin: Unload the settled transactions from memory (-lazywallet): those at least
+     * LAZYWALLET_MIN_DEPTH deep whose owned outputs were all spent by transactions as deep.
+     * They no longer change the balances, so only the history reads them back.
+     */
+    void UnloadSettledTransactions();
+    //! SolarCoin: Move an unloaded transaction back into mapWallet to update it; NULL if it was not unloaded or cannot be read
+    CWalletTx* ReloadWalletTx(const uint256& hash);
+
+    /**
+     * SolarCoin: The wallet transactions, resident or unloaded, in blocks of the active chain
+     * above nHeight, by height, followed by those in no block of it (unconfirmed, conflicted or
+     * abandoned ones). Needs cs_main and cs_wallet.
+     */
+    std::vector<uint256> GetTransactionsAbove(int nHeight);
 
     //! check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf) { AssertLockHeld(cs_wallet); return nWalletMaxVersion >= wf; }
@@ -722,7 +881,16 @@ public:
      * completion the coin set and corresponding actual target value is
      * assembled
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+
+    /**
+     * SolarCoin: Branch-and-Bound search for the coins whose effective values (value less the
+     * fee of spending them at effectiveFeeRate) add up to between nTargetValue and
+     * nTargetValue + nCostOfChange, wasting as little as possible. Coins that cost more to spend
+     * than they are worth are skipped. vCoins sorted by descending value is used as is.
+     * nValueRet is the nominal value of the selection.
+     */
+    bool SelectCoinsBnB(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, const CFeeRate& effectiveFeeRate, const CAmount& nCostOfChange, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -738,8 +906,15 @@ public:
      */
     CPubKey GenerateNewKey();
     void DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret);
+    /**
+     * SolarCoin: generate nKeys new keys like GenerateNewKey(), deriving them on all cores and
+     * writing them through walletdb, which may be in a transaction
+     */
+    std::vector<CPubKey> GenerateNewKeys(CWalletDB& walletdb, unsigned int nKeys);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
+    //! SolarCoin: AddKeyPubKey() saving through walletdb
+    bool AddKeyPubKeyWithDB(CWalletDB& walletdb, const CKey& key, const CPubKey &pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
     bool LoadKey(const CKey& key, const CPubKey &pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
     //! Load metadata (used by LoadWallet)
@@ -789,11 +964,32 @@ public:
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock) override;
+    void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::shared_ptr<const CBlockUndo>& pblockundo) override;
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
-    CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, CBlockIndex* pindexStop = nullptr);
+    //! SolarCoin: stop a running ScanForWalletTransactions() at the next block
+    void AbortRescan() { fAbortRescan = true; }
+    bool IsAbortingRescan() const { return fAbortRescan; }
+    bool IsScanning() const { return fScanningWallet; }
+    /**
+     * SolarCoin: Rescan the active chain for keys born at nTime or later, and for those imported
+     * before without a rescan. Returns the earliest birth time the rescan covers, later than
+     * nTime if some blocks could not be read.
+     */
+    int64_t RescanFromTime(int64_t nTime, bool fUpdate);
+    //! SolarCoin: leave the rescan for keys born at nTime to the next RescanFromTime()
+    void AddPendingRescan(int64_t nTime);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    /**
+     * SolarCoin: all balances, computed in one pass over mapWallet and then updated for the
+     * transactions that changed since (see cachedBalances), so that polling them is cheap.
+     * The Get*Balance() methods below read them.
+     */
+    Balances GetBalances() const;
+    //! SolarCoin: a wallet transaction changed, so its part of the balances must be computed again
+    void MarkBalancesDirty(const uint256& hash) const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -909,6 +1105,9 @@ public:
         return setKeyPool.size();
     }
 
+    //! SolarCoin: Bytes of memory used by mapWallet, with the transactions it holds, and mapTxSpends
+    size_t DynamicMemoryUsage() const;
+
     bool SetDefaultKey(const CPubKey &vchPubKey);
 
     //! signify that a particular wallet feature is now used. this may change nWalletVersion and nWalletMaxVersion if those are lower
@@ -976,7 +1175,7 @@ public:
      * Wallet post-init setup
      * Gives the wallet a chance to register repetitive tasks and complete post-init tasks
      */
-    void postInitProcess(boost::thread_group& threadGroup);
+    void postInitProcess(boost::thread_group& threadGroup, CScheduler& scheduler);
 
     /* Wallets parameter interaction */
     static bool ParameterInteraction();
@@ -997,6 +1196,30 @@ public:
     bool SetHDMasterKey(const CPubKey& key);
 };
 
+/**
+ * SolarCoin: Walks all the transactions of a wallet: those of mapWallet, then the ones
+ * -lazywallet unloaded, read from the database one at a time without going through the cache
+ * of GetWalletTx(). A transaction it returns stays valid until the next call of Next(). Needs
+ * cs_wallet held while in use.
+ */
+class CWalletTxWalker
+{
+private:
+    const CWallet& wallet;
+    bool fUnloaded;
+    std::map<uint256, CWalletTx>::const_iterator itResident;
+    std::map<uint256, int64_t>::const_iterator itUnloaded;
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletTx wtxUnloaded;
+
+public:
+    /** fUnloadedIn = false walks mapWallet only, for callers that cannot want a settled transaction */
+    explicit CWalletTxWalker(const CWallet& walletIn, bool fUnloadedIn = true);
+
+    /** The next transaction, or NULL at the end */
+    const CWalletTx* Next();
+};
+
 /** A key allocated from the key pool. */
 class CReserveKey : public CReserveScript
 {
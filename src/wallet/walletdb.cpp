@@ -64,6 +64,11 @@ bool CWalletDB::WriteTx(const CWalletTx& wtx)
     return Write(std::make_pair(std::string("tx"), wtx.GetHash()), wtx);
 }
 
+bool CWalletDB::ReadTx(const uint256& hash, CWalletTx& wtx)
+{
+    return Read(std::make_pair(std::string("tx"), hash), wtx);
+}
+
 bool CWalletDB::EraseTx(uint256 hash)
 {
     nWalletDBUpdateCounter++;
@@ -781,54 +786,61 @@ DBErrors CWalletDB::ZapWalletTx(CWallet* pwallet, vector<CWalletTx>& vWtx)
     return DB_LOAD_OK;
 }
 
-void ThreadFlushWalletDB()
+void MaybeFlushWalletDB()
 {
-    // Make this thread recognisable as the wallet flushing thread
-    RenameThread("bitcoin-wallet");
-
-    static bool fOneThread;
-    if (fOneThread)
+    static std::atomic<bool> fOneThread(false);
+    if (fOneThread.exchange(true))
         return;
-    fOneThread = true;
-    if (!GetBoolArg("-flushwallet", DEFAULT_FLUSHWALLET))
+    if (!GetBoolArg("-flushwallet", DEFAULT_FLUSHWALLET)) {
+        fOneThread = false;
         return;
+    }
 
-    unsigned int nLastSeen = CWalletDB::GetUpdateCounter();
-    unsigned int nLastFlushed = CWalletDB::GetUpdateCounter();
-    int64_t nLastWalletUpdate = GetTime();
-    while (true)
+    static unsigned int nLastSeen = CWalletDB::GetUpdateCounter();
+    static unsigned int nLastFlushed = CWalletDB::GetUpdateCounter();
+    static unsigned int nLastCheckpointed = CWalletDB::GetUpdateCounter();
+    static int64_t nLastWalletUpdate = GetTime();
+    static int64_t nLastCheckpoint = GetTime();
+
+    if (nLastSeen != CWalletDB::GetUpdateCounter())
     {
-        MilliSleep(500);
+        nLastSeen = CWalletDB::GetUpdateCounter();
+        nLastWalletUpdate = GetTime();
+    }
 
-        if (nLastSeen != CWalletDB::GetUpdateCounter())
-        {
-            nLastSeen = CWalletDB::GetUpdateCounter();
-            nLastWalletUpdate = GetTime();
-        }
+    // SolarCoin: with -walletflushinterval, writers leave the checkpoints to this task, which
+    // makes them at most that often while the wallet keeps changing
+    if (bitdb.nFlushInterval > 0 && nLastCheckpointed != nLastSeen && GetTime() - nLastCheckpoint >= bitdb.nFlushInterval)
+    {
+        nLastCheckpointed = nLastSeen;
+        nLastCheckpoint = GetTime();
+        int64_t nStart = GetTimeMillis();
+        bitdb.dbenv->txn_checkpoint(0, 0, 0);
+        LogPrint("db", "Checkpointed the wallet database log %dms\n", GetTimeMillis() - nStart);
+    }
 
-        if (nLastFlushed != CWalletDB::GetUpdateCounter() && GetTime() - nLastWalletUpdate >= 2)
+    if (nLastFlushed != CWalletDB::GetUpdateCounter() && GetTime() - nLastWalletUpdate >= 2)
+    {
+        TRY_LOCK(bitdb.cs_db,lockDb);
+        if (lockDb)
         {
-            TRY_LOCK(bitdb.cs_db,lockDb);
-            if (lockDb)
+            // Don't do this if any databases are in use
+            int nRefCount = 0;
+            map<string, int>::iterator mi = bitdb.mapFileUseCount.begin();
+            while (mi != bitdb.mapFileUseCount.end())
             {
-                // Don't do this if any databases are in use
-                int nRefCount = 0;
-                map<string, int>::iterator mi = bitdb.mapFileUseCount.begin();
-                while (mi != bitdb.mapFileUseCount.end())
-                {
-                    nRefCount += (*mi).second;
-                    mi++;
-                }
+                nRefCount += (*mi).second;
+                mi++;
+            }
 
-                if (nRefCount == 0)
-                {
-                    boost::this_thread::interruption_point();
-                    const std::string& strFile = pwalletMain->strWalletFile;
+            if (nRefCount == 0)
+            {
+                for (const CWallet* pwallet : vpwallets) {
+                    const std::string& strFile = pwallet->strWalletFile;
                     map<string, int>::iterator _mi = bitdb.mapFileUseCount.find(strFile);
                     if (_mi != bitdb.mapFileUseCount.end())
                     {
                         LogPrint("db", "Flushing %s\n", strFile);
-                        nLastFlushed = CWalletDB::GetUpdateCounter();
                         int64_t nStart = GetTimeMillis();
 
                         // Flush wallet file so it's self contained
@@ -839,9 +851,11 @@ void ThreadFlushWalletDB()
                         LogPrint("db", "Flushed %s %dms\n", strFile, GetTimeMillis() - nStart);
                     }
                 }
+                nLastFlushed = CWalletDB::GetUpdateCounter();
             }
         }
     }
+    fOneThread = false;
 }
 
 //
@@ -127,6 +127,8 @@ public:
     bool ErasePurpose(const std::string& strAddress);
 
     bool WriteTx(const CWalletTx& wtx);
+    //! SolarCoin: read back a transaction -lazywallet unloaded
+    bool ReadTx(const uint256& hash, CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata &keyMeta);
@@ -183,6 +185,27 @@ private:
     void operator=(const CWalletDB&);
 };
 
-void ThreadFlushWalletDB();
+/**
+ * SolarCoin: Groups the writes to a wallet file into one database transaction while in scope,
+ * see CDB::BeginBatch(). Every CWalletDB of the file opened meanwhile writes within it, and must
+ * be closed before it goes out of scope. Inside another batch, it leaves the writes to that one.
+ */
+class CWalletDBBatch
+{
+public:
+    explicit CWalletDBBatch(const std::string& strFilename, bool fFlushOnClose = true) : walletdb(strFilename, "r+", fFlushOnClose)
+    {
+        walletdb.BeginBatch();
+    }
+
+private:
+    CWalletDB walletdb;
+
+    CWalletDBBatch(const CWalletDBBatch&);
+    void operator=(const CWalletDBBatch&);
+};
+
+/** Flush or checkpoint the wallet databases once they have not changed for a while; run periodically by the scheduler */
+void MaybeFlushWalletDB();
 
 #endif // BITCOIN_WALLET_WALLETDB_H
@@ -7,8 +7,11 @@
 
 #include "zmqconfig.h"
 
+#include <memory>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
@@ -32,8 +35,12 @@ public:
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    /** SolarCoin: A block connected to the active chain, with the block itself */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    /** SolarCoin: A transaction added to or removed from the mempool */
+    virtual bool NotifyMempoolAdded(const CTransaction &transaction);
+    virtual bool NotifyMempoolRemoved(const CTransaction &transaction, MemPoolRemovalReason reason);
 
 protected:
     void *psocket;
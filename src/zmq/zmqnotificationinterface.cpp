@@ -5,6 +5,7 @@
 #include "zmqnotificationinterface.h"
 #include "zmqpublishnotifier.h"
 
+#include "txmempool.h"
 #include "version.h"
 #include "validation.h"
 #include "streams.h"
@@ -15,7 +16,7 @@ void zmqError(const char *str)
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), fInitialDownload(IsInitialBlockDownload())
 {
 }
 
@@ -37,6 +38,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
 
     factories["pubhashblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockNotifier>;
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
+    factories["pubmempool"] = CZMQAbstractNotifier::Create<CZMQPublishMempoolNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
 
@@ -103,6 +105,9 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    mempool.NotifyEntryAdded.connect(boost::bind(&CZMQNotificationInterface::TransactionAddedToMempool, this, _1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&CZMQNotificationInterface::TransactionRemovedFromMempool, this, _1, _2));
+
     return true;
 }
 
@@ -112,6 +117,9 @@ void CZMQNotificationInterface::Shutdown()
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
     if (pcontext)
     {
+        mempool.NotifyEntryAdded.disconnect(boost::bind(&CZMQNotificationInterface::TransactionAddedToMempool, this, _1));
+        mempool.NotifyEntryRemoved.disconnect(boost::bind(&CZMQNotificationInterface::TransactionRemovedFromMempool, this, _1, _2));
+
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
@@ -124,15 +132,57 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+// SolarCoin: Runs on the validation interface queue, which must not take cs_main; the blocks
+// connected after a tip update during the initial block download are skipped
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownloadIn)
+{
+    fInitialDownload = fInitialDownloadIn;
+}
+
+// SolarCoin: Each block connected, as it is in memory, instead of only the new tip read back from disk
+void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::shared_ptr<const CBlockUndo>& pblockundo)
 {
-    if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
+    if (fInitialDownload)
         return;
 
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew))
+        if (notifier->NotifyBlock(pindex, pblock))
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
+
+void CZMQNotificationInterface::TransactionAddedToMempool(CTransactionRef tx)
+{
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyMempoolAdded(*tx))
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
+
+void CZMQNotificationInterface::TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyMempoolRemoved(*tx, reason))
         {
             i++;
         }
@@ -5,12 +5,15 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "primitives/transaction.h"
 #include "validationinterface.h"
+#include <atomic>
 #include <string>
 #include <map>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
 
 class CZMQNotificationInterface : public CValidationInterface
 {
@@ -25,12 +28,19 @@ protected:
 
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
+    void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::shared_ptr<const CBlockUndo>& pblockundo);
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
 
+    // CTxMemPool signals
+    void TransactionAddedToMempool(CTransactionRef tx);
+    void TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason);
+
 private:
     CZMQNotificationInterface();
 
     void *pcontext;
+    //! Whether the last tip update was during the initial block download
+    std::atomic<bool> fInitialDownload;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
 
@@ -5,16 +5,23 @@
 #include "chainparams.h"
 #include "streams.h"
 #include "zmqpublishnotifier.h"
+#include "txmempool.h"
 #include "validation.h"
 #include "util.h"
 #include "rpc/server.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_MEMPOOL   = "mempool";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -56,9 +63,129 @@ static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
     return 0;
 }
 
+namespace {
+
+/** A message waiting for the ZMQ send thread */
+struct CZMQQueuedMessage
+{
+    void *psocket;
+    const char *command;
+    std::vector<unsigned char> data;
+    std::shared_ptr<const CBlock> pblock; //!< serialized into data by the send thread
+    uint32_t nSequence;
+    size_t nSize;
+};
+
+/**
+ * SolarCoin: Sends the messages of all the publish notifiers on one thread, so the validation
+ * callbacks only queue them. A ZMQ socket must not be used by several threads at once, and the
+ * notifiers publishing on the same address share theirs, so one thread sends for all of them.
+ */
+class CZMQSendQueue
+{
+private:
+    std::mutex mutex;
+    std::condition_variable condWork;  //!< the send thread waits for messages
+    std::condition_variable condIdle;  //!< Flush() waits for the queue to be sent
+    std::deque<CZMQQueuedMessage> queue;
+    size_t nQueueBytes;
+    bool fSending;
+    bool fStop;
+    uint64_t nDropped;
+    std::thread thread;
+
+    void ThreadSend()
+    {
+        RenameThread("solarcoin-zmqsend");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            while (!fStop && queue.empty())
+                condWork.wait(lock);
+            // Once stopping, what was queued is still sent
+            if (queue.empty())
+                return;
+            CZMQQueuedMessage msg = std::move(queue.front());
+            queue.pop_front();
+            fSending = true;
+            lock.unlock();
+
+            if (msg.pblock) {
+                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+                ss << *msg.pblock;
+                msg.data.assign(ss.begin(), ss.end());
+            }
+            unsigned char msgseq[sizeof(uint32_t)];
+            WriteLE32(&msgseq[0], msg.nSequence);
+            zmq_send_multipart(msg.psocket, msg.command, strlen(msg.command), msg.data.data(), msg.data.size(), msgseq, (size_t)sizeof(uint32_t), (void*)0);
+
+            lock.lock();
+            nQueueBytes -= msg.nSize;
+            fSending = false;
+            if (queue.empty())
+                condIdle.notify_all();
+        }
+    }
+
+public:
+    CZMQSendQueue() : nQueueBytes(0), fSending(false), fStop(false), nDropped(0) {}
+
+    ~CZMQSendQueue()
+    {
+        Stop();
+    }
+
+    void Start()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (thread.joinable())
+            return;
+        fStop = false;
+        thread = std::thread(&CZMQSendQueue::ThreadSend, this);
+    }
+
+    /** Send what is queued and stop the thread */
+    void Stop()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fStop = true;
+            condWork.notify_all();
+        }
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void Push(CZMQQueuedMessage&& msg)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!queue.empty() && nQueueBytes + msg.nSize > MAX_ZMQ_SEND_QUEUE_BYTES) {
+            // Subscribers see the gap in the sequence numbers
+            if (nDropped++ % 1000 == 0)
+                LogPrint("zmq", "zmq: Send queue full, dropped %s (%u messages dropped so far)\n", msg.command, nDropped);
+            return;
+        }
+        nQueueBytes += msg.nSize;
+        queue.push_back(std::move(msg));
+        condWork.notify_one();
+    }
+
+    /** Wait for the queued messages to be sent, before a socket is closed */
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (thread.joinable() && (!queue.empty() || fSending))
+            condIdle.wait(lock);
+    }
+};
+
+CZMQSendQueue sendQueue;
+
+} // anon namespace
+
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 {
     assert(!psocket);
+    sendQueue.Start();
 
     // check if address is being used by other publish notifier
     std::multimap<std::string, CZMQAbstractPublishNotifier*>::iterator i = mapPublishNotifiers.find(address);
@@ -98,6 +225,7 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 void CZMQAbstractPublishNotifier::Shutdown()
 {
     assert(psocket);
+    sendQueue.Flush();
 
     int count = mapPublishNotifiers.count(address);
 
@@ -122,6 +250,9 @@ void CZMQAbstractPublishNotifier::Shutdown()
         zmq_close(psocket);
     }
 
+    if (mapPublishNotifiers.empty())
+        sendQueue.Stop();
+
     psocket = 0;
 }
 
@@ -130,19 +261,31 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     assert(psocket);
 
     /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
-    if (rc == -1)
-        return false;
+    CZMQQueuedMessage msg;
+    msg.psocket = psocket;
+    msg.command = command;
+    msg.data.assign((const unsigned char*)data, (const unsigned char*)data + size);
+    msg.nSequence = nSequence++;
+    msg.nSize = size;
+    sendQueue.Push(std::move(msg));
+    return true;
+}
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
+bool CZMQAbstractPublishNotifier::SendBlockMessage(const char *command, const std::shared_ptr<const CBlock>& pblock)
+{
+    assert(psocket);
 
+    CZMQQueuedMessage msg;
+    msg.psocket = psocket;
+    msg.command = command;
+    msg.pblock = pblock;
+    msg.nSequence = nSequence++;
+    msg.nSize = ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    sendQueue.Push(std::move(msg));
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& /*pblock*/)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
@@ -162,25 +305,12 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
-    }
-
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    // SolarCoin: The block connected is in memory, the send thread serializes it
+    return SendBlockMessage(MSG_RAWBLOCK, pblock);
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
@@ -191,3 +321,25 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+static bool SendMempoolMessage(CZMQAbstractPublishNotifier* notifier, const CTransaction &transaction, char label, MemPoolRemovalReason reason)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint("zmq", "zmq: Publish mempool %s %c\n", hash.GetHex(), label);
+    char data[34];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = label;
+    data[33] = (char)reason;
+    return notifier->SendMessage(MSG_MEMPOOL, data, sizeof(data));
+}
+
+bool CZMQPublishMempoolNotifier::NotifyMempoolAdded(const CTransaction &transaction)
+{
+    return SendMempoolMessage(this, transaction, 'A', MemPoolRemovalReason::UNKNOWN);
+}
+
+bool CZMQPublishMempoolNotifier::NotifyMempoolRemoved(const CTransaction &transaction, MemPoolRemovalReason reason)
+{
+    return SendMempoolMessage(this, transaction, 'R', reason);
+}
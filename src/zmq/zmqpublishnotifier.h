@@ -7,22 +7,34 @@
 
 #include "zmqabstractnotifier.h"
 
+#include <atomic>
+
 class CBlockIndex;
 
+/** Bytes of messages waiting to be sent by the ZMQ send thread; messages beyond are dropped */
+static const size_t MAX_ZMQ_SEND_QUEUE_BYTES = 64 * 1024 * 1024;
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
-    uint32_t nSequence; //!< upcounting per message sequence number
+    std::atomic<uint32_t> nSequence; //!< upcounting per message sequence number
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) {}
 
     /* send zmq multipart message
        parts:
           * command
           * data
           * message sequence number
+
+       SolarCoin: The message is queued for the send thread, so publishing never waits on the
+       socket. The sequence number is taken when queuing, so subscribers see a gap for a message
+       dropped because the queue was full.
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    /* send a block, serialized by the send thread */
+    bool SendBlockMessage(const char *command, const std::shared_ptr<const CBlock>& pblock);
 
     bool Initialize(void *pcontext);
     void Shutdown();
@@ -31,7 +43,7 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -43,7 +55,7 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -52,4 +64,15 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+/**
+ * SolarCoin: Publishes the transactions added to and removed from the mempool, as the hash of the
+ * transaction, 'A' or 'R', and the MemPoolRemovalReason of a removal (0 for an addition).
+ */
+class CZMQPublishMempoolNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMempoolAdded(const CTransaction &transaction);
+    bool NotifyMempoolRemoved(const CTransaction &transaction, MemPoolRemovalReason reason);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H